@@ -0,0 +1,670 @@
+/*
+ * Host benchmark for the image render and encode kernels
+ *
+ * Runs the kernels shared by the camera and the web GUI on recorded Tiny1C frames (raw
+ * files saved by the camera) or synthetic frames and reports the average time each takes
+ * per frame.  The numbers are only comparable between runs on the same host but give a
+ * repeatable measure of the effect of changes to the kernels.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd_list.h"
+#include "esp_ota_ops.h"
+#include "file_raw.h"
+#include "file_render.h"
+#include "gui_render.h"
+#include "palettes.h"
+#include "t1c_agc.h"
+#include "tiny1c.h"
+#include "tjpgd.h"
+#include "vid_render.h"
+#include "y16_codec.h"
+
+#define TJE_IMPLEMENTATION
+#include "tiny_jpeg.h"
+
+
+
+//
+// Constants
+//
+#define DEF_ITERATIONS   200
+#define MAX_FRAMES       16
+#define NUM_SYNTH_FRAMES 8
+
+#define HIST_BINS        AGC_HIST_BINS
+
+#define JPEG_BUF_LEN     (T1C_WIDTH*T1C_HEIGHT*4)
+#define JPEG_QUALITY     3
+#define TJPGD_WORK_LEN   JD_WORK_LEN
+
+#define NUM_PIXELS       (T1C_WIDTH*T1C_HEIGHT)
+
+
+
+//
+// Typedefs
+//
+typedef struct {
+	uint16_t y16[NUM_PIXELS];
+	uint8_t y8[NUM_PIXELS];
+	uint8_t y16_enc[NUM_PIXELS*2];   // Rice coded y16 (for the decoder)
+	uint32_t y16_enc_len;
+	uint16_t y16_min;
+	uint16_t y16_max;
+	uint16_t hist[HIST_BINS];
+	uint16_t hist_base;
+	int hist_shift;
+	t1c_buffer_t t1c;
+	gui_img_buf_t gui;
+} bench_frame_t;
+
+typedef struct {
+	const char* name;
+	void (*setup)();                 // Called once before the kernel is timed (may be NULL)
+	void (*run)(bench_frame_t* f);
+} bench_kernel_t;
+
+typedef struct {
+	uint8_t* buf;
+	uint32_t len;
+	uint32_t pos;
+} bench_jpeg_t;
+
+
+
+//
+// Variables
+//
+static bench_frame_t frames[MAX_FRAMES];
+static int num_frames = 0;
+
+static esp_app_desc_t app_desc = {"bench"};
+
+static uint8_t y16_enc_buf[FILE_RAW_MAX_LEN];
+static uint16_t y16_dec_buf[NUM_PIXELS];
+static uint32_t gui_img_buf[(GUI_RAW_IMG_W*GUI_LARGEST_MAG_FACTOR)*(GUI_RAW_IMG_H*GUI_LARGEST_MAG_FACTOR)];
+static uint32_t rgb_buf[NUM_PIXELS];
+static uint8_t vid_buf[IMG_BUF_WIDTH*IMG_BUF_HEIGHT];
+static uint8_t y8_buf[NUM_PIXELS];
+static uint8_t jpeg_buf[JPEG_BUF_LEN];
+static uint8_t rgb888_buf[NUM_PIXELS*3];
+static uint8_t tjpgd_work_buf[TJPGD_WORK_LEN];
+static bench_jpeg_t jpeg = {jpeg_buf, 0, 0};
+
+// State normally defined in gui_state.c and out_state_utilities.c
+gui_state_t gui_state;
+out_state_t out_state;
+
+static t1c_agc_hist_eq_t agc_he;
+
+// Sum of results so the compiler can't discard the work
+static volatile uint32_t sink;
+
+
+
+//
+// Forward declarations for internal functions
+//
+static bool _load_raw_file(const char* name, bench_frame_t* f);
+static bool _decode_y16_delta(const uint8_t* src, uint32_t len, uint16_t* dst);
+static inline uint16_t _y16_pred(const uint16_t* dst, int i);
+static void _make_synth_frame(int n, bench_frame_t* f);
+static void _prepare_frame(bench_frame_t* f);
+static uint16_t _get_u16(const uint8_t* buf);
+static uint32_t _get_u32(const uint8_t* buf);
+static int64_t _get_nsec();
+
+static void _setup_gui_0_5();
+static void _setup_gui_1_0();
+static void _setup_gui_1_5();
+static void _setup_gui_2_0();
+static void _setup_gui_portrait();
+static void _setup_jpeg_decode();
+
+static void _run_agc_linear(bench_frame_t* f);
+static void _run_agc_hist_eq(bench_frame_t* f);
+static void _run_y16_encode(bench_frame_t* f);
+static void _run_y16_decode(bench_frame_t* f);
+static void _run_gui_y8(bench_frame_t* f);
+static void _run_gui_render(bench_frame_t* f);
+static void _run_file_render(bench_frame_t* f);
+static void _run_vid_render(bench_frame_t* f);
+static void _run_jpeg_encode_rgb(bench_frame_t* f);
+static void _run_jpeg_encode_gray(bench_frame_t* f);
+static void _run_jpeg_decode(bench_frame_t* f);
+
+static void _jpeg_write_func(void* context, void* data, int size);
+static size_t _tjpgd_in_func(JDEC* jd, uint8_t* buff, size_t nbyte);
+static int _tjpgd_out_func(JDEC* jd, void* bitmap, JRECT* rect);
+
+
+
+//
+// Kernels, in image pipeline order
+//
+static const bench_kernel_t kernels[] = {
+	{"t1c_agc_scale_linear",         NULL,                _run_agc_linear},
+	{"t1c_agc_scale_hist_eq",        NULL,                _run_agc_hist_eq},
+	{"y16_codec_encode",             NULL,                _run_y16_encode},
+	{"y16_codec_decode",             NULL,                _run_y16_decode},
+	{"gui_render_get_y8_data (land)", _setup_gui_1_0,     _run_gui_y8},
+	{"gui_render_get_y8_data (port)", _setup_gui_portrait, _run_gui_y8},
+	{"gui_render_image_data 0.5x",   _setup_gui_0_5,      _run_gui_render},
+	{"gui_render_image_data 1.0x",   _setup_gui_1_0,      _run_gui_render},
+	{"gui_render_image_data 1.5x",   _setup_gui_1_5,      _run_gui_render},
+	{"gui_render_image_data 2.0x",   _setup_gui_2_0,      _run_gui_render},
+	{"file_render_t1c_data",         NULL,                _run_file_render},
+	{"vid_render_t1c_data",          NULL,                _run_vid_render},
+	{"tje_encode (RGBA)",            NULL,                _run_jpeg_encode_rgb},
+	{"tje_encode (gray)",            NULL,                _run_jpeg_encode_gray},
+	{"jd_decomp (RGB888)",           _setup_jpeg_decode,  _run_jpeg_decode}
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(bench_kernel_t))
+
+
+
+//
+// API
+//
+int main(int argc, char** argv)
+{
+	int i, k;
+	int iterations = DEF_ITERATIONS;
+	int64_t t;
+	uint32_t enc_len = 0;
+	
+	// Command line: [-n ITERATIONS] [FILE.RAW ...]
+	for (i=1; i<argc; i++) {
+		if ((strcmp(argv[i], "-n") == 0) && (i < (argc - 1))) {
+			iterations = atoi(argv[++i]);
+			if (iterations < 1) iterations = 1;
+		} else if (num_frames < MAX_FRAMES) {
+			if (_load_raw_file(argv[i], &frames[num_frames])) {
+				num_frames++;
+			}
+		} else {
+			printf("Only the first %d frames are used\n", MAX_FRAMES);
+		}
+	}
+	
+	if (num_frames == 0) {
+		for (i=0; i<NUM_SYNTH_FRAMES; i++) {
+			_make_synth_frame(i, &frames[i]);
+		}
+		num_frames = NUM_SYNTH_FRAMES;
+		printf("Using %d synthetic frames\n", num_frames);
+	} else {
+		printf("Using %d recorded frames\n", num_frames);
+	}
+	
+	for (i=0; i<num_frames; i++) {
+		_prepare_frame(&frames[i]);
+		enc_len += frames[i].y16_enc_len;
+	}
+	printf("Y16 codec compression: %.2f\n", (double) (num_frames * NUM_PIXELS * 2) / enc_len);
+	
+	if (!gui_render_init()) {
+		return 1;
+	}
+	set_palette(PALETTE_IRONBLACK);
+	set_save_palette(PALETTE_IRONBLACK);
+	gui_state.palette_index = PALETTE_IRONBLACK;
+	out_state.sav_palette_index = PALETTE_IRONBLACK;
+	out_state.vid_palette_index = PALETTE_GRAY;
+	
+	printf("%-32s %12s\n", "Kernel", "nSec/frame");
+	for (k=0; k<NUM_KERNELS; k++) {
+		if (kernels[k].setup != NULL) {
+			kernels[k].setup();
+		}
+	
+		// One untimed pass to warm the caches
+		for (i=0; i<num_frames; i++) {
+			kernels[k].run(&frames[i]);
+		}
+	
+		t = _get_nsec();
+		for (i=0; i<iterations; i++) {
+			kernels[k].run(&frames[i % num_frames]);
+		}
+		t = _get_nsec() - t;
+	
+		printf("%-32s %12lld\n", kernels[k].name, (long long) (t / iterations));
+	}
+	
+	return 0;
+}
+
+
+// vid_render.c gets the firmware version from the application description
+const esp_app_desc_t* esp_app_get_description()
+{
+	return &app_desc;
+}
+
+
+
+//
+// Internal functions - frames
+//
+
+// Load the Y16 image data and AGC range from a raw file (see file_raw.h)
+static bool _load_raw_file(const char* name, bench_frame_t* f)
+{
+	bool success = false;
+	FILE* fp;
+	long len;
+	uint8_t* buf;
+	uint32_t hdr_len, data_len;
+	
+	fp = fopen(name, "rb");
+	if (fp == NULL) {
+		printf("Couldn't open %s\n", name);
+		return false;
+	}
+	
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	buf = (uint8_t*) malloc(len);
+	if ((buf == NULL) || (fread(buf, 1, len, fp) != (size_t) len)) {
+		printf("Couldn't read %s\n", name);
+		goto done;
+	}
+	
+	if ((len < 40) || (memcmp(buf, "IRAW", 4) != 0)) {
+		printf("%s is not a raw file\n", name);
+		goto done;
+	}
+	
+	hdr_len = _get_u16(&buf[6]);
+	if ((_get_u16(&buf[8]) != T1C_WIDTH) || (_get_u16(&buf[10]) != T1C_HEIGHT) || (hdr_len > len)) {
+		printf("%s has an unexpected size\n", name);
+		goto done;
+	}
+	
+	data_len = _get_u32(&buf[14]);
+	if ((data_len == 0) || (data_len > (len - hdr_len))) {
+		data_len = len - hdr_len;
+	}
+	
+	if (buf[12] == FILE_RAW_ENC_RICE) {
+		success = y16_codec_decode(&buf[hdr_len], data_len, f->y16, T1C_WIDTH, T1C_HEIGHT);
+	} else if (buf[12] == FILE_RAW_ENC_DELTA) {
+		success = _decode_y16_delta(&buf[hdr_len], data_len, f->y16);
+	} else if (data_len >= NUM_PIXELS*2) {
+		for (int i=0; i<NUM_PIXELS; i++) {
+			f->y16[i] = _get_u16(&buf[hdr_len + 2*i]);
+		}
+		success = true;
+	}
+	if (!success) {
+		printf("Couldn't decode the image data in %s\n", name);
+	}
+	
+done:
+	free(buf);
+	fclose(fp);
+	return success;
+}
+
+
+// Decode FILE_RAW_ENC_DELTA (CMD_IMG_Y16_ENC_DELTA) image data
+static bool _decode_y16_delta(const uint8_t* src, uint32_t len, uint16_t* dst)
+{
+	const uint8_t* endP = src + len;
+	int i = 0;
+	int n;
+	uint8_t c;
+	
+	while ((i < NUM_PIXELS) && (src < endP)) {
+		c = *src++;
+		switch (c & 0xC0) {
+			case CMD_IMG16_DELTA_RUN:
+				n = (c & 0x3F) + 1;
+				while ((n-- > 0) && (i < NUM_PIXELS)) {
+					dst[i] = _y16_pred(dst, i);
+					i++;
+				}
+				break;
+			case CMD_IMG16_DELTA_DIFF6:
+				dst[i] = (uint16_t) (_y16_pred(dst, i) + (int) (c & 0x3F) - 32);
+				i++;
+				break;
+			case CMD_IMG16_DELTA_DIFF14:
+				if (src >= endP) return false;
+				dst[i] = (uint16_t) (_y16_pred(dst, i) + ((int) ((c & 0x3F) << 8) | *src++) - 8192);
+				i++;
+				break;
+			default:
+				if ((src + 1) >= endP) return false;
+				dst[i++] = _get_u16(src);
+				src += 2;
+		}
+	}
+	
+	return (i == NUM_PIXELS);
+}
+
+
+// Prediction used by the delta encoding (pixel to the left, above for the first pixel in
+// a row)
+static inline uint16_t _y16_pred(const uint16_t* dst, int i)
+{
+	if (i == 0) {
+		return 0;
+	} else if ((i % T1C_WIDTH) == 0) {
+		return dst[i - T1C_WIDTH];
+	} else {
+		return dst[i - 1];
+	}
+}
+
+
+// Synthetic scene: a horizontal gradient with a warm blob that moves from frame to frame
+// and a little noise (values are Tiny1C 1/16 °K temperatures)
+static void _make_synth_frame(int n, bench_frame_t* f)
+{
+	int x, y;
+	int bx = 48 + n * 20;
+	int by = 64 + n * 8;
+	int dx, dy, d2;
+	int v;
+	uint32_t seed = 12345 + n;
+	
+	for (y=0; y<T1C_HEIGHT; y++) {
+		for (x=0; x<T1C_WIDTH; x++) {
+			seed = seed * 1103515245 + 12345;
+			v = 4700 + x/2 + y/4 + (int) ((seed >> 16) & 0x7) - 3;
+			dx = x - bx;
+			dy = y - by;
+			d2 = dx*dx + dy*dy;
+			if (d2 < 1600) {
+				v += (1600 - d2) / 4;
+			}
+			f->y16[y*T1C_WIDTH + x] = (uint16_t) v;
+		}
+	}
+}
+
+
+// Compute the range, histogram and 8-bit data for a frame and fill its buffers the
+// kernels use
+static void _prepare_frame(bench_frame_t* f)
+{
+	int i;
+	uint32_t bin, range;
+	t1c_agc_linear_t agc;
+	
+	f->y16_min = 0xFFFF;
+	f->y16_max = 0;
+	for (i=0; i<NUM_PIXELS; i++) {
+		if (f->y16[i] < f->y16_min) f->y16_min = f->y16[i];
+		if (f->y16[i] > f->y16_max) f->y16_max = f->y16[i];
+	}
+	
+	// Histogram sized as t1c_task does
+	f->hist_base = f->y16_min;
+	f->hist_shift = 0;
+	range = f->y16_max - f->y16_min;
+	while ((range >> f->hist_shift) >= HIST_BINS) {
+		f->hist_shift++;
+	}
+	memset(f->hist, 0, sizeof(f->hist));
+	for (i=0; i<NUM_PIXELS; i++) {
+		bin = (uint32_t) (f->y16[i] - f->hist_base) >> f->hist_shift;
+		if (bin >= HIST_BINS) bin = HIST_BINS - 1;
+		f->hist[bin]++;
+	}
+	
+	t1c_agc_setup_linear(&agc, f->y16_min, f->y16_max, false, false);
+	t1c_agc_scale_linear(&agc, f->y16, f->y8, NUM_PIXELS);
+	
+	memset(&f->t1c, 0, sizeof(t1c_buffer_t));
+	f->t1c.img_data = f->y16;
+	f->t1c.y8_data = f->y8;
+	f->t1c.y16_min = f->y16_min;
+	f->t1c.y16_max = f->y16_max;
+	f->t1c.agc_min = f->y16_min;
+	f->t1c.agc_max = f->y16_max;
+	f->t1c.y16_is_temp = true;
+	
+	memset(&f->gui, 0, sizeof(gui_img_buf_t));
+	f->gui.y8_data = f->y8;
+	f->gui.y16_data = f->y16;
+	f->gui.y16_is_temp = true;
+	f->gui.agc_min = f->y16_min;
+	f->gui.agc_max = f->y16_max;
+	
+	// Encoded as the camera sends and saves it (raw when that isn't smaller)
+	f->y16_enc_len = y16_codec_encode(f->y16, T1C_WIDTH, T1C_HEIGHT, f->y16_enc, sizeof(f->y16_enc) - 1);
+	if (f->y16_enc_len == 0) {
+		f->y16_enc_len = sizeof(f->y16_enc);
+	} else if (!y16_codec_decode(f->y16_enc, f->y16_enc_len, y16_dec_buf, T1C_WIDTH, T1C_HEIGHT) ||
+	           (memcmp(y16_dec_buf, f->y16, sizeof(f->y16)) != 0)) {
+		printf("Y16 codec round trip failed\n");
+	}
+}
+
+
+static uint16_t _get_u16(const uint8_t* buf)
+{
+	return ((uint16_t) buf[0] << 8) | buf[1];
+}
+
+
+static uint32_t _get_u32(const uint8_t* buf)
+{
+	return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+
+static int64_t _get_nsec()
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+
+//
+// Internal functions - kernel setup
+//
+static void _setup_gui_0_5()
+{
+	gui_render_set_configuration(GUI_RENDER_LANDSCAPE, GUI_MAGNIFICATION_0_5);
+}
+
+
+static void _setup_gui_1_0()
+{
+	gui_render_set_configuration(GUI_RENDER_LANDSCAPE, GUI_MAGNIFICATION_1_0);
+}
+
+
+static void _setup_gui_1_5()
+{
+	gui_render_set_configuration(GUI_RENDER_LANDSCAPE, GUI_MAGNIFICATION_1_5);
+}
+
+
+static void _setup_gui_2_0()
+{
+	gui_render_set_configuration(GUI_RENDER_LANDSCAPE, GUI_MAGNIFICATION_2_0);
+}
+
+
+static void _setup_gui_portrait()
+{
+	gui_render_set_configuration(GUI_RENDER_PORTRAIT, GUI_MAGNIFICATION_1_0);
+}
+
+
+// Decode the jpeg image of the first frame
+static void _setup_jpeg_decode()
+{
+	_run_jpeg_encode_rgb(&frames[0]);
+}
+
+
+
+//
+// Internal functions - kernels
+//
+static void _run_agc_linear(bench_frame_t* f)
+{
+	t1c_agc_linear_t agc;
+	
+	t1c_agc_setup_linear(&agc, f->y16_min, f->y16_max, true, false);
+	t1c_agc_scale_linear(&agc, f->y16, y8_buf, NUM_PIXELS);
+	sink += y8_buf[NUM_PIXELS/2];
+}
+
+
+static void _run_agc_hist_eq(bench_frame_t* f)
+{
+	t1c_agc_setup_hist_eq(&agc_he, f->hist, f->hist_base, f->hist_shift, false);
+	t1c_agc_scale_hist_eq(&agc_he, f->y16, y8_buf, NUM_PIXELS);
+	sink += y8_buf[NUM_PIXELS/2];
+}
+
+
+static void _run_y16_encode(bench_frame_t* f)
+{
+	sink += y16_codec_encode(f->y16, T1C_WIDTH, T1C_HEIGHT, y16_enc_buf, NUM_PIXELS*2 - 1);
+}
+
+
+static void _run_y16_decode(bench_frame_t* f)
+{
+	if (f->y16_enc_len < NUM_PIXELS*2) {
+		sink += y16_codec_decode(f->y16_enc, f->y16_enc_len, y16_dec_buf, T1C_WIDTH, T1C_HEIGHT);
+	}
+}
+
+
+static void _run_gui_y8(bench_frame_t* f)
+{
+	sink += *gui_render_get_y8_data(f->y8);
+}
+
+
+static void _run_gui_render(bench_frame_t* f)
+{
+	gui_render_image_data(&f->gui, gui_img_buf, &gui_state);
+	sink += gui_img_buf[0];
+}
+
+
+static void _run_file_render(bench_frame_t* f)
+{
+	file_render_t1c_data(&f->t1c, rgb_buf);
+	sink += rgb_buf[0];
+}
+
+
+static void _run_vid_render(bench_frame_t* f)
+{
+	vid_render_t1c_data(&f->t1c, vid_buf, &out_state);
+	sink += vid_buf[IMG_BUF_CMAP_WIDTH];
+}
+
+
+static void _run_jpeg_encode_rgb(bench_frame_t* f)
+{
+	file_render_t1c_data(&f->t1c, rgb_buf);
+	jpeg.len = 0;
+	(void) tje_encode_with_func(_jpeg_write_func, &jpeg, JPEG_QUALITY, T1C_WIDTH, T1C_HEIGHT, 4, (unsigned char*) rgb_buf);
+	sink += jpeg.len;
+}
+
+
+static void _run_jpeg_encode_gray(bench_frame_t* f)
+{
+	jpeg.len = 0;
+	(void) tje_encode_with_func(_jpeg_write_func, &jpeg, JPEG_QUALITY, T1C_WIDTH, T1C_HEIGHT, 1, f->y8);
+	sink += jpeg.len;
+}
+
+
+static void _run_jpeg_decode(bench_frame_t* f)
+{
+	JDEC jdec;
+	
+	jpeg.pos = 0;
+	if (jd_prepare(&jdec, _tjpgd_in_func, tjpgd_work_buf, TJPGD_WORK_LEN, &jpeg) == JDR_OK) {
+		(void) jd_decomp(&jdec, _tjpgd_out_func, 0);
+	}
+	sink += rgb888_buf[0];
+}
+
+
+
+//
+// Internal functions - jpeg io
+//
+static void _jpeg_write_func(void* context, void* data, int size)
+{
+	bench_jpeg_t* j = (bench_jpeg_t*) context;
+	
+	if ((j->len + size) <= JPEG_BUF_LEN) {
+		memcpy(j->buf + j->len, data, size);
+		j->len += size;
+	}
+}
+
+
+static size_t _tjpgd_in_func(JDEC* jd, uint8_t* buff, size_t nbyte)
+{
+	bench_jpeg_t* j = (bench_jpeg_t*) jd->device;
+	
+	if ((j->pos + nbyte) > j->len) {
+		nbyte = j->len - j->pos;
+	}
+	if (buff != NULL) {
+		memcpy(buff, j->buf + j->pos, nbyte);
+	}
+	j->pos += nbyte;
+	
+	return nbyte;
+}
+
+
+static int _tjpgd_out_func(JDEC* jd, void* bitmap, JRECT* rect)
+{
+	uint8_t* src = (uint8_t*) bitmap;
+	uint8_t* dst;
+	int w = (rect->right - rect->left + 1) * 3;
+	int y;
+	
+	for (y=rect->top; y<=rect->bottom; y++) {
+		dst = rgb888_buf + (y*T1C_WIDTH + rect->left) * 3;
+		memcpy(dst, src, w);
+		src += w;
+	}
+	
+	return 1;
+}
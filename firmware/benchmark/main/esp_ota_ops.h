@@ -0,0 +1,13 @@
+/*
+ * Minimal application description for vid_render.c (provided by bench_main.c)
+ */
+#ifndef ESP_OTA_OPS_H
+#define ESP_OTA_OPS_H
+
+typedef struct {
+	char version[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t* esp_app_get_description();
+
+#endif /* ESP_OTA_OPS_H */
@@ -0,0 +1,3 @@
+/*
+ * Dummy file to satisfy include requirements for the benchmarked files
+ */
@@ -0,0 +1,5 @@
+/*
+ * Dummy file to satisfy include requirements for the benchmarked files
+ */
+#include <stdio.h>
+#include <stdlib.h>
@@ -0,0 +1,4 @@
+/*
+ * Dummy file to satisfy include requirements for the benchmarked files
+ */
+typedef void* SemaphoreHandle_t;
@@ -148,7 +148,7 @@ VL53LX_Error VL53LX_WriteMulti(
 	i2c_buffer[1] = index & 0xFF;
 	memcpy(&i2c_buffer[2], pdata, count);
 
-	i2c_sensor_lock();
+	i2c_sensor_lock_prio(I2C_PRIO_LOW);
 	
 	ret = i2c_sensor_write_slave(pdev->i2c_slave_address >> 1, i2c_buffer, (size_t) count + 2);
 	if (ret != ESP_OK) {
@@ -169,26 +169,37 @@ VL53LX_Error VL53LX_ReadMulti(
 	uint32_t      count)
 {
 	esp_err_t ret;
+	uint32_t len;
 	VL53LX_Error status = VL53LX_ERROR_NONE;
 	
-	i2c_buffer[0] = index >> 8;
-	i2c_buffer[1] = index & 0xFF;
-
-	i2c_sensor_lock();
-	
-	ret = i2c_sensor_write_slave(pdev->i2c_slave_address >> 1, i2c_buffer, 2);
-	if (ret != ESP_OK) {
-		ESP_LOGE(TAG, "VL53LX_WriteMulti i2c write failed with %d", (int) ret);
-		status = VL53LX_ERROR_CONTROL_INTERFACE;
-	} else {
-		ret = i2c_sensor_read_slave(pdev->i2c_slave_address >> 1, pdata, (size_t) count);
+	// Large reads (e.g. the ranging results) are split into pieces so the Tiny1C CCI can
+	// get the bus in between.  The sensor auto-increments the register index.
+	while ((count > 0) && (status == VL53LX_ERROR_NONE)) {
+		len = (count > I2C_SENSOR_MAX_LOW_PRIO_LEN) ? I2C_SENSOR_MAX_LOW_PRIO_LEN : count;
+		
+		i2c_buffer[0] = index >> 8;
+		i2c_buffer[1] = index & 0xFF;
+		
+		i2c_sensor_lock_prio(I2C_PRIO_LOW);
+		
+		ret = i2c_sensor_write_slave(pdev->i2c_slave_address >> 1, i2c_buffer, 2);
 		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "VL53LX_ReadMulti i2c read failed with %d", (int) ret);
+			ESP_LOGE(TAG, "VL53LX_WriteMulti i2c write failed with %d", (int) ret);
 			status = VL53LX_ERROR_CONTROL_INTERFACE;
+		} else {
+			ret = i2c_sensor_read_slave(pdev->i2c_slave_address >> 1, pdata, (size_t) len);
+			if (ret != ESP_OK) {
+				ESP_LOGE(TAG, "VL53LX_ReadMulti i2c read failed with %d", (int) ret);
+				status = VL53LX_ERROR_CONTROL_INTERFACE;
+			}
 		}
+		
+		i2c_sensor_unlock();
+		
+		index += len;
+		pdata += len;
+		count -= len;
 	}
-	
-	i2c_sensor_unlock();
 
 	return status;
 }
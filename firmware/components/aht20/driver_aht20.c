@@ -384,6 +384,106 @@ uint8_t aht20_read_temperature_humidity(aht20_handle_t *handle, uint32_t *temper
     }
 }
 
+/**
+ * @brief     start a temperature and humidity measurement
+ * @param[in] *handle points to an aht20 handle structure
+ * @return    status code
+ *            - 0 success
+ *            - 1 start measurement failed
+ *            - 2 handle is NULL
+ *            - 3 handle is not initialized
+ * @note      the result can be read with aht20_get_temperature_humidity 85ms later
+ */
+uint8_t aht20_start_temperature_humidity(aht20_handle_t *handle)
+{
+    uint8_t buf[3];
+    
+    if (handle == NULL)                                               /* check handle */
+    {
+        return 2;                                                     /* return error */
+    }
+    if (handle->inited != 1)                                          /* check handle initialization */
+    {
+        return 3;                                                     /* return error */
+    }
+    
+    buf[0] = 0xAC;                                                    /* set the addr */
+    buf[1] = 0x33;                                                    /* set 0x33 */
+    buf[2] = 0x00;                                                    /* set 0x00 */
+    if (a_aht20_iic_write(handle, buf, 3) != 0)                       /* write the command */
+    {
+        handle->debug_print("aht20: sent command failed.\n");         /* sent command failed */
+        
+        return 1;                                                     /* return error */
+    }
+    
+    return 0;                                                         /* success return 0 */
+}
+
+/**
+ * @brief      get the result of a measurement started by aht20_start_temperature_humidity
+ * @param[in]  *handle points to an aht20 handle structure
+ * @param[out] *temperature_raw points to a raw temperature buffer
+ * @param[out] *temperature_s points to a converted temperature buffer
+ * @param[out] *humidity_raw points to a raw humidity buffer
+ * @param[out] *humidity_s points to a converted humidity buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read temperature humidity failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ *             - 4 data is not ready
+ *             - 5 crc is error
+ * @note       none
+ */
+uint8_t aht20_get_temperature_humidity(aht20_handle_t *handle, uint32_t *temperature_raw, float *temperature_s,
+                                       uint32_t *humidity_raw, uint8_t *humidity_s)
+{
+    uint8_t buf[7];
+    
+    if (handle == NULL)                                               /* check handle */
+    {
+        return 2;                                                     /* return error */
+    }
+    if (handle->inited != 1)                                          /* check handle initialization */
+    {
+        return 3;                                                     /* return error */
+    }
+    
+    if (a_aht20_iic_read(handle, buf, 7) != 0)                        /* read status and data */
+    {
+        handle->debug_print("aht20: read data failed.\n");            /* read data failed */
+        
+        return 1;                                                     /* return error */
+    }
+    if ((buf[0] & 0x80) != 0)                                         /* check the status */
+    {
+        return 4;                                                     /* data is not ready */
+    }
+    if (a_aht20_calc_crc(buf, 6) != buf[6])                           /* check the crc */
+    {
+        handle->debug_print("aht20: crc is error.\n");                /* crc is error */
+        
+        return 5;                                                     /* return error */
+    }
+    
+    *humidity_raw = (((uint32_t)buf[1]) << 16) |
+                    (((uint32_t)buf[2]) << 8) |
+                    (((uint32_t)buf[3]) << 0);                        /* set the humidity */
+    *humidity_raw = (*humidity_raw) >> 4;                             /* right shift 4 */
+    *humidity_s = (uint8_t)((float)(*humidity_raw)
+                            / 1048576.0f * 100.0f);                   /* convert the humidity */
+    *temperature_raw = (((uint32_t)buf[3]) << 16) |
+                       (((uint32_t)buf[4]) << 8) |
+                       (((uint32_t)buf[5]) << 0);                     /* set the temperature */
+    *temperature_raw = (*temperature_raw) & 0xFFFFF;                  /* cut the temperature part */
+    *temperature_s = (float)(*temperature_raw) 
+                             / 1048576.0f * 200.0f
+                             - 50.0f;                                 /* convert the temperature */
+    
+    return 0;                                                         /* success return 0 */
+}
+
 /**
  * @brief      read the temperature
  * @param[in]  *handle points to an aht20 handle structure
@@ -203,6 +203,37 @@ uint8_t aht20_deinit(aht20_handle_t *handle);
 uint8_t aht20_read_temperature_humidity(aht20_handle_t *handle, uint32_t *temperature_raw, float *temperature_s,
                                         uint32_t *humidity_raw, uint8_t *humidity_s);
 
+/**
+ * @brief     start a temperature and humidity measurement
+ * @param[in] *handle points to an aht20 handle structure
+ * @return    status code
+ *            - 0 success
+ *            - 1 start measurement failed
+ *            - 2 handle is NULL
+ *            - 3 handle is not initialized
+ * @note      the result can be read with aht20_get_temperature_humidity 85ms later
+ */
+uint8_t aht20_start_temperature_humidity(aht20_handle_t *handle);
+
+/**
+ * @brief      get the result of a measurement started by aht20_start_temperature_humidity
+ * @param[in]  *handle points to an aht20 handle structure
+ * @param[out] *temperature_raw points to a raw temperature buffer
+ * @param[out] *temperature_s points to a converted temperature buffer
+ * @param[out] *humidity_raw points to a raw humidity buffer
+ * @param[out] *humidity_s points to a converted humidity buffer
+ * @return     status code
+ *             - 0 success
+ *             - 1 read temperature humidity failed
+ *             - 2 handle is NULL
+ *             - 3 handle is not initialized
+ *             - 4 data is not ready
+ *             - 5 crc is error
+ * @note       none
+ */
+uint8_t aht20_get_temperature_humidity(aht20_handle_t *handle, uint32_t *temperature_raw, float *temperature_s,
+                                       uint32_t *humidity_raw, uint8_t *humidity_s);
+
 /**
  * @brief      read the temperature
  * @param[in]  *handle points to an aht20 handle structure
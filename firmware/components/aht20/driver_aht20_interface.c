@@ -85,7 +85,7 @@ uint8_t aht20_interface_iic_read_cmd(uint8_t addr, uint8_t *buf, uint16_t len)
 {
 	int ret = 0;
 	
-	i2c_sensor_lock();
+	i2c_sensor_lock_prio(I2C_PRIO_LOW);
 	if (i2c_sensor_read_slave(addr >> 1, buf, (size_t) len) != ESP_OK) {
 		ret = 1;
 	}
@@ -108,7 +108,7 @@ uint8_t aht20_interface_iic_write_cmd(uint8_t addr, uint8_t *buf, uint16_t len)
 {
 	int ret = 0;
 	
-	i2c_sensor_lock();
+	i2c_sensor_lock_prio(I2C_PRIO_LOW);
 	if (i2c_sensor_write_slave(addr >> 1, buf, (size_t) len) != ESP_OK) {
 		ret = 1;
 	}
@@ -30,43 +30,80 @@
 
 // Command list (alphabetical order, starting with a value of 0)
 typedef enum {
-    CMD_AMBIENT_CORRECT = 0,
+    CMD_AGC_MODE = 0,
+	CMD_AMBIENT_CORRECT,
 	CMD_BACKLIGHT,
+	CMD_BATCH,
 	CMD_BATT_LEVEL,
+	CMD_BENCHMARK,
 	CMD_BRIGHTNESS,
+	CMD_BURST,
 	CMD_CARD_PRESENT,
+	CMD_CHANGE_DETECT,
 	CMD_CRIT_BATT,
 	CMD_CTRL_ACTIVITY,
+	CMD_DEAD_PIXELS,
 	CMD_EMISSIVITY,
 	CMD_FFC,
 	CMD_FILE_CATALOG,
+	CMD_FILE_CATALOG_PAGE,
+	CMD_FILE_CATALOG_RANGE,
 	CMD_FILE_DELETE,
 	CMD_FILE_GET_IMAGE,
+	CMD_FILE_GET_JPEG,
+	CMD_FILE_GET_THUMB,
+	CMD_FRAME_STATS,
 	CMD_FW_UPD_EN,
 	CMD_FW_UPD_END,
 	CMD_GAIN,
+	CMD_GUI_STATE,
 	CMD_IMAGE,
+	CMD_IMAGE_SAME,
+	CMD_IMAGE_Y16,
+	CMD_LINK_STATS,
+	CMD_LOG,
 	CMD_TIME,
 	CMD_TIMELAPSE_CFG,
 	CMD_TIMELAPSE_STATUS,
+	CMD_MCAST_STREAM,
 	CMD_MIN_MAX_EN,
 	CMD_MSG_ON,
 	CMD_MSG_OFF,
 	CMD_ORIENTATION,
 	CMD_PALETTE,
+	CMD_PALETTE_STOPS,
+	CMD_PALETTE_THRESHOLD,
+	CMD_PERF_STATS,
+	CMD_PICTURE_AVG,
+	CMD_PING,
 	CMD_POWEROFF,
+	CMD_PRE_TRIGGER,
+	CMD_RECORD,
 	CMD_REGION_EN,
 	CMD_REGION_LOC,
+	CMD_REPLAY,
+	CMD_REPLAY_FRAME,
+	CMD_REPLAY_RATE,
+	CMD_ROI_TABLE,
 	CMD_SAVE_BACKLIGHT,
+	CMD_SAVE_FORMAT,
 	CMD_SAVE_OVL_EN,
 	CMD_SAVE_PALETTE,
 	CMD_SHUTDOWN,
 	CMD_SHUTTER_INFO,
+	CMD_SPATIAL_FILTER,
 	CMD_SPOT_EN,
 	CMD_SPOT_LOC,
 	CMD_STREAM_EN,
+	CMD_STREAM_RATE,
+	CMD_STREAM_VIEW,
+	CMD_SUBSCRIBE,
 	CMD_SYS_INFO,
 	CMD_TAKE_PICTURE,
+	CMD_TELEMETRY,
+	CMD_TNR,
+	CMD_TRIGGER_CFG,
+	CMD_UDP_STREAM,
 	CMD_UNITS,
 	CMD_WIFI_INFO
 } cmd_id_t;
@@ -82,8 +119,594 @@ enum cmd_ctrl_act_param
 	CMD_CTRL_ACT_TINY1C_CAL_1,
 	CMD_CTRL_ACT_TINY1C_CAL_2L,
 	CMD_CTRL_ACT_TINY1C_CAL_2H,
-	CMD_CTRL_ACT_SD_FORMAT
+	CMD_CTRL_ACT_SD_FORMAT,
+	CMD_CTRL_ACT_BENCHMARK,
+	CMD_CTRL_ACT_TINY1C_FW_UPD
 };
 
+// A Tiny1C firmware update (CMD_CTRL_ACT_TINY1C_FW_UPD) writes the first FW/tiny1c_M_N_fw.bin
+// file found on the SD card into the Tiny1C.  The image stream stops while the update runs
+// and the camera shuts down when it finishes (progress and the result are sent as for other
+// activities).
+
+// Gain settings (sent with CMD_GAIN).  CMD_GAIN_AUTO lets the camera switch between high
+// and low gain based on the scene.
+enum cmd_gain_param
+{
+	CMD_GAIN_LOW = 0,
+	CMD_GAIN_HIGH,
+	CMD_GAIN_AUTO
+};
+
+// Saved image file formats (sent with CMD_SAVE_FORMAT).  Raw files hold the radiometric
+// Y16 data (see file_raw.h).  When both are saved the raw file has the same number as the
+// jpeg file.  Radiometric jpeg files carry the raw file inside the jpeg file.
+enum cmd_save_format_param
+{
+	CMD_SAVE_FMT_JPEG = 0,
+	CMD_SAVE_FMT_RAW,
+	CMD_SAVE_FMT_BOTH,
+	CMD_SAVE_FMT_RJPEG
+};
+
+#define CMD_SAVE_FMT_NUM       4
+
+// Image stream settings (sent with CMD_STREAM_EN).  Any non-zero value enables the stream
+// and selects how the 8-bit image data in CMD_IMAGE is encoded.  Older clients send 1.
+// The Y16 settings send CMD_IMAGE_Y16 with the raw Tiny1C data instead of CMD_IMAGE.
+enum cmd_stream_param
+{
+	CMD_STREAM_OFF = 0,
+	CMD_STREAM_Y8,
+	CMD_STREAM_Y8_DELTA,
+	CMD_STREAM_Y16,
+	CMD_STREAM_Y16_DELTA
+};
+
+// CMD_STREAM_Y8_DELTA image data encoding.  Each pixel is predicted from the pixel to its
+// left (the pixel above for the first pixel of a row and 0 for the first pixel of the
+// image) and the difference from the prediction is coded with one of the following.  A
+// frame that would not be smaller than the raw data is sent raw so the encoding can be
+// identified by the image data length.
+//   00nnnnnn           - n+1 pixels equal their prediction
+//   01aaabbb           - Two pixels with differences a-4 and b-4
+//   10dddddd           - One pixel with difference d-32
+//   11000000 vvvvvvvv  - One pixel with value v
+#define CMD_IMG_DELTA_RUN      0x00
+#define CMD_IMG_DELTA_PAIR     0x40
+#define CMD_IMG_DELTA_DIFF     0x80
+#define CMD_IMG_DELTA_LITERAL  0xC0
+#define CMD_IMG_DELTA_OP_MASK  0xC0
+#define CMD_IMG_DELTA_MAX_RUN  64
+
+// CMD_IMAGE_Y16 image data follows the same metadata as CMD_IMAGE
+//   uint8_t   encoding   (CMD_IMG_Y16_ENC_xxx)
+//   uint8_t   is_temp    (1 if the data is temperature in 1/16 °K units)
+//   uint16_t  agc_min    (range the camera is scaling to 8-bits)
+//   uint16_t  agc_max
+//   uint8_t[] data       (big endian 16-bit pixels or encoded data)
+#define CMD_IMAGE_Y16_HDR_LEN  6
+#define CMD_IMG_Y16_ENC_RAW    0
+#define CMD_IMG_Y16_ENC_DELTA  1
+#define CMD_IMG_Y16_ENC_RICE   2
+
+// CMD_IMG_Y16_ENC_DELTA data encoding.  Pixels are predicted as for CMD_STREAM_Y8_DELTA.
+//   00nnnnnn                    - n+1 pixels equal their prediction
+//   01dddddd                    - One pixel with difference d-32
+//   10dddddd dddddddd           - One pixel with difference d-8192
+//   11000000 vvvvvvvv vvvvvvvv  - One pixel with value v
+#define CMD_IMG16_DELTA_RUN     0x00
+#define CMD_IMG16_DELTA_DIFF6   0x40
+#define CMD_IMG16_DELTA_DIFF14  0x80
+#define CMD_IMG16_DELTA_LITERAL 0xC0
+
+// CMD_IMG_Y16_ENC_RICE data is a predictive Rice coded image described in y16_codec.h.
+// The camera sends it for CMD_STREAM_Y16_DELTA (CMD_IMG_Y16_ENC_DELTA data is from older
+// cameras) and sends the raw data when it wouldn't be smaller.
+
+// Stream view (CMD_SET CMD_STREAM_VIEW) selects the region of the image sent in CMD_IMAGE
+// and how much it is decimated (box filtered) to save bandwidth.  The binary data is an
+// int32 decimation (1, 2 or 4) followed by the inclusive region {x1, y1}, {x2, y2} in full
+// resolution pixels packed as for a marker location.  The camera aligns the region to the
+// decimation.  CMD_IMAGE_Y16 is always sent at full resolution.
+#define CMD_STREAM_VIEW_LEN    12
+
+// CMD_IMAGE image data follows the metadata with a view header describing it
+//   uint16_t  decimation
+//   uint16_t  x1, y1     (top left of the region in full resolution pixels)
+//   uint16_t  w, h       (size of the image data in decimated pixels)
+//   uint8_t   Y16 is temperature flag
+//   uint8_t   reserved
+//   uint16_t  agc_min, agc_max (Y16 range mapped to the 8-bit data)
+#define CMD_IMAGE_VIEW_HDR_LEN 16
+
+// Stream rate (CMD_SET CMD_STREAM_RATE) is sent by the camera as an int32 when the rate
+// it is sending images to a client at changes because of the client's link.  The rate
+// is in units of fps x 10.
+
+// CMD_IMAGE, CMD_IMAGE_Y16 and CMD_IMAGE_SAME data starts with a cmd_image_meta_t.  Unlike
+// other binary data it is little endian (the native order of the ESP32 and WebAssembly)
+// with no padding so it is copied as-is by both sides.  The camera sets version to
+// CMD_IMAGE_META_VERSION and len to the size of the structure it sent.  New fields are only
+// added at the end (so a client can use the fields it knows about from a longer header)
+// and the version changes if existing fields change.  The frame timing lets clients order
+// and pace frames arriving with variable network delay.  The ROI table holds all entries
+// so the length doesn't depend on the counts.
+#define CMD_IMAGE_META_VERSION 1
+#define CMD_IMAGE_ROI_SPOTS    8
+#define CMD_IMAGE_ROI_RECTS    4
+#define CMD_IMAGE_ROI_LINES    2
+
+typedef struct __attribute__((packed)) {
+	uint16_t x;
+	uint16_t y;
+	uint16_t temp;
+} cmd_image_roi_spot_t;
+
+typedef struct __attribute__((packed)) {
+	uint16_t x1;
+	uint16_t y1;
+	uint16_t x2;
+	uint16_t y2;
+	uint16_t avg_temp;
+	uint16_t min_temp;
+	uint16_t max_temp;
+} cmd_image_roi_area_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t version;
+	uint8_t reserved;
+	uint16_t len;
+	uint32_t frame_seq;            // Incremented by the camera for each frame it acquires
+	uint32_t frame_msec;           // Camera time the frame was acquired (wraps)
+	uint8_t high_gain;
+	uint8_t vid_frozen;
+	uint8_t spot_valid;
+	uint8_t minmax_valid;
+	uint8_t region_valid;
+	uint8_t amb_temp_valid;
+	uint8_t amb_hum_valid;
+	uint8_t distance_valid;
+	int16_t amb_temp;
+	uint16_t amb_hum;
+	uint16_t distance;
+	uint16_t spot_temp;
+	uint16_t spot_x;
+	uint16_t spot_y;
+	uint16_t min_temp;
+	uint16_t min_x;
+	uint16_t min_y;
+	uint16_t max_temp;
+	uint16_t max_x;
+	uint16_t max_y;
+	uint16_t region_x1;
+	uint16_t region_y1;
+	uint16_t region_x2;
+	uint16_t region_y2;
+	uint16_t region_avg_temp;
+	uint16_t region_min_temp;
+	uint16_t region_min_x;
+	uint16_t region_min_y;
+	uint16_t region_max_temp;
+	uint16_t region_max_x;
+	uint16_t region_max_y;
+	uint8_t roi_num_spots;
+	uint8_t roi_num_rects;
+	uint8_t roi_num_lines;
+	uint8_t roi_spot_valid_mask;
+	uint8_t roi_rect_valid_mask;
+	uint8_t roi_line_valid_mask;
+	cmd_image_roi_spot_t roi_spot[CMD_IMAGE_ROI_SPOTS];
+	cmd_image_roi_area_t roi_rect[CMD_IMAGE_ROI_RECTS];
+	cmd_image_roi_area_t roi_line[CMD_IMAGE_ROI_LINES];
+} cmd_image_meta_t;
+
+#define CMD_IMAGE_META_LEN     sizeof(cmd_image_meta_t)
+
+// Image unchanged (CMD_SET CMD_IMAGE_SAME) is sent in place of CMD_IMAGE or CMD_IMAGE_Y16
+// when the image data would be the same as the last image sent to the client (the shutter
+// has frozen the image or the scene, view and AGC haven't changed).  It is just the metadata
+// and the client displays its last image with it.  A full image is sent at least every
+// CMD_IMAGE_SAME_MAX frames so a client can't be left with a stale image.
+#define CMD_IMAGE_SAME_MAX     25
+
+// Batch (CMD_SET CMD_BATCH) carries several complete command packets, each with its own
+// header, one after another as binary data so they can be sent in one websocket frame.  The
+// receiver processes them in order as if they had arrived separately.  Batches don't nest.
+#define CMD_BATCH_MAX_LEN      2048
+
+// GUI state (CMD_GET CMD_GUI_STATE) requests all the camera state a remote GUI needs when it
+// starts.  The camera responds with a CMD_BATCH holding the CMD_RSP packet for each of the
+// items it would otherwise request individually followed by a CMD_RSP CMD_GUI_STATE with
+// binary data holding a uint32 session token (different each time the camera starts) and
+// uint32 state version.  A client reconnecting to the same camera can send those as binary
+// data with the CMD_GET to resume the session: then only the items that have changed since
+// that version are included (all of them if the token doesn't match).
+#define CMD_GUI_STATE_LEN      8
+
+// Subscribe (CMD_SET CMD_SUBSCRIBE) is sent by a client with an int32 mask of the
+// CMD_SUB_xxx items it wants pushed to it instead of polling for them (0 cancels).  The
+// camera immediately responds with the CMD_RSP packet for each subscribed item and after
+// that sends the ones that have changed, as a CMD_BATCH, ahead of the next image while
+// streaming and within CMD_SUB_IDLE_MSEC otherwise.  Subscriptions are shared by all clients.
+#define CMD_SUB_BATT_LEVEL     0x01
+#define CMD_SUB_CARD_PRESENT   0x02
+#define CMD_SUB_SHUTTER_INFO   0x04
+#define CMD_SUB_NUM            3
+#define CMD_SUB_IDLE_MSEC      1000
+
+// Link statistics (CMD_GET CMD_LINK_STATS) describe the camera's WiFi link and how images
+// are being streamed to each websocket client (iCamMini only).  The response is binary data
+// with a header
+//   int8_t    rssi       (dBm, AP signal in client mode, weakest station in AP mode, 0 if unknown)
+//   uint8_t   num_clients
+//   uint16_t  reserved
+// followed by num_clients entries of
+//   uint32_t  bytes_per_sec
+//   uint16_t  fps        (images sent per second x 10)
+//   uint16_t  rate       (adaptive stream rate, fps x 10, see CMD_STREAM_RATE)
+//   uint32_t  send_avg   (uSec to send each image)
+//   uint32_t  send_max
+//   uint32_t  frames     (images sent since the client connected)
+//   uint32_t  failures   (image sends that failed since the client connected)
+// The rates and send times are measured over the last second and are 0 when the client
+// isn't streaming.
+#define CMD_LINK_HDR_LEN       4
+#define CMD_LINK_CLIENT_LEN    24
+
+// Palette stops (CMD_SET/CMD_GET CMD_PALETTE_STOPS) are the gradient for the custom palette
+// (PALETTE_CUSTOM) as binary data: 2 - CMD_PALETTE_MAX_STOPS stops of CMD_PALETTE_STOP_LEN
+// bytes each holding the palette index (increasing from stop to stop) and the r, g, b color.
+#define CMD_PALETTE_STOP_LEN   4
+#define CMD_PALETTE_MAX_STOPS  16
+
+// Palette threshold (CMD_SET/CMD_GET CMD_PALETTE_THRESHOLD) configures the threshold palette
+// (PALETTE_THRESHOLD) as binary data: a uint16 Tiny1C temperature (1/16 °K) followed by a
+// uint16 CMD_PAL_THRESH_xxx selecting which side of it is colored.
+#define CMD_PALETTE_THRESH_LEN 4
+#define CMD_PAL_THRESH_ABOVE   0
+#define CMD_PAL_THRESH_BELOW   1
+
+// Ping (CMD_GET CMD_PING) is sent by a client with binary data holding its uint32 time in
+// mSec.  The camera responds immediately with that time followed by its own uint32 time in
+// mSec (the same clock as the frame timing) so the client can estimate the round trip time
+// and the offset between the clocks.
+#define CMD_PING_LEN           8
+
+// Performance statistics (CMD_GET CMD_PERF_STATS) are the time the camera spends in each
+// stage of its image pipeline.  The response is binary data with CMD_PERF_NUM_STAGES
+// entries, in acquire, scale, CCI, render, serialize, send and save order, of
+//   uint32_t  count      (number of times the stage has run)
+//   uint32_t  min        (uSec, over the recent runs)
+//   uint32_t  avg
+//   uint32_t  p99
+//   uint32_t  max
+// A stage the camera hasn't run has all 0 times.
+#define CMD_PERF_NUM_STAGES    7
+#define CMD_PERF_STAGE_LEN     20
+
+// Telemetry (CMD_SET CMD_TELEMETRY) is sent by a client with an int32 sample period in mSec
+// (CMD_TELEM_MIN_MSEC to CMD_TELEM_MAX_MSEC, 0 stops sampling).  The camera then samples its
+// CPU, heap and stack usage every period and pushes each sample to all clients as the
+// CMD_RSP CMD_TELEMETRY response to a CMD_GET, which returns the latest sample.  The
+// period is shared by all clients.  The response is binary data with a header
+//   uint32_t  msec       (camera time of the sample, the same clock as the frame timing)
+//   uint32_t  int_free   (internal heap bytes free)
+//   uint32_t  int_min    (minimum internal heap bytes free since boot)
+//   uint32_t  ext_free   (PSRAM heap bytes free)
+//   uint32_t  ext_min    (minimum PSRAM heap bytes free since boot)
+//   uint16_t  interval   (mSec the task loads were measured over, 0 for the first sample)
+//   uint8_t   num_tasks
+//   uint8_t   reserved
+// followed by num_tasks entries of
+//   char[12]  name       (null padded, may be truncated)
+//   uint8_t   load       (percent of the total CPU time of all cores)
+//   uint8_t   priority
+//   uint16_t  stack      (minimum bytes of stack that have been free)
+#define CMD_TELEM_MIN_MSEC     1000
+#define CMD_TELEM_MAX_MSEC     60000
+#define CMD_TELEM_HDR_LEN      24
+#define CMD_TELEM_TASK_LEN     16
+#define CMD_TELEM_NAME_LEN     12
+#define CMD_TELEM_MAX_TASKS    24
+#define CMD_TELEM_MAX_LEN      (CMD_TELEM_HDR_LEN + CMD_TELEM_MAX_TASKS*CMD_TELEM_TASK_LEN)
+
+// File jpeg (CMD_GET CMD_FILE_GET_JPEG) is requested with the same file indices as
+// CMD_FILE_GET_IMAGE.  The response is the stored jpeg file as binary data for the client
+// to decode instead of the decoded RGB888 image.
+	
+// File thumbnail (CMD_GET CMD_FILE_GET_THUMB) is requested with the same file indices as
+// CMD_FILE_GET_IMAGE for a quick preview while browsing.  The response is a
+// CMD_FILE_THUMB_W x CMD_FILE_THUMB_H jpeg image (the thumbnail saved with the image) as
+// binary data for the client to decode.  The local GUI gets the thumbnail already decoded
+// and expanded to the full image size in the shared file image buffer.
+#define CMD_FILE_THUMB_W       64
+#define CMD_FILE_THUMB_H       48
+	
+// File catalog page (CMD_GET CMD_FILE_CATALOG_PAGE) requests part of a catalog.  The binary
+// data is three int32 values: the catalog type (-1 for directories, 0.. for the files in the
+// indexed directory), the index of the first entry and the number of entries (up to
+// CMD_FILE_CATALOG_PAGE_MAX).  The response is binary data with a header
+//   int16_t   type
+//   uint16_t  total      (number of entries in the catalog)
+//   uint16_t  offset     (index of the first entry in this page)
+//   uint16_t  count      (number of entries in this page)
+// followed by count entries, in catalog (name) order
+//   uint32_t  size       (file length in bytes or number of files in a directory)
+//   uint32_t  timestamp  (FAT date in the upper 16 bits and time in the lower 16 bits)
+//   char[]    name       (null terminated)
+#define CMD_FILE_CATALOG_PAGE_REQ_LEN 12
+#define CMD_FILE_CATALOG_PAGE_HDR_LEN 8
+#define CMD_FILE_CATALOG_PAGE_MAX     32
+
+// File catalog range (CMD_GET CMD_FILE_CATALOG_RANGE) finds the files saved in a time
+// window.  The binary data is three uint32 values: the start and end timestamps (FAT
+// date in the upper 16 bits and time in the lower 16 bits, files from start up to but not
+// including end match) and the number of matching files to skip (for fetching more than
+// CMD_FILE_CATALOG_RANGE_MAX of them).  A file's timestamp is the time it was opened to be
+// saved so a movie or log file has the time its capture started.  The response is binary
+// data with a header
+//   uint32_t  start
+//   uint32_t  end
+//   uint16_t  total      (number of files in the range)
+//   uint16_t  offset     (number of matching files skipped)
+//   uint16_t  count      (number of entries in this response)
+//   uint16_t  reserved
+// followed by count entries, in catalog order
+//   uint16_t  dir_index  (the same indices as CMD_FILE_GET_IMAGE)
+//   uint16_t  file_index
+//   uint32_t  timestamp
+#define CMD_FILE_CATALOG_RANGE_REQ_LEN 12
+#define CMD_FILE_CATALOG_RANGE_HDR_LEN 16
+#define CMD_FILE_CATALOG_RANGE_ENT_LEN 8
+#define CMD_FILE_CATALOG_RANGE_MAX     64
+
+// Benchmark results (CMD_GET CMD_BENCHMARK) are the times measured by the last on-device
+// benchmark (started with CMD_CTRL_ACT_BENCHMARK).  The response is binary data with
+// CMD_BENCH_NUM_ITEMS entries, in SPI frame read, CCI parameter read, Y16 to Y8 scaling,
+// GUI render at 0.5x, 1x, 1.5x and 2x magnification, file render, jpeg encode, jpeg decode
+// and SD card write order, of
+//   uint32_t  count      (number of times the item was run)
+//   uint32_t  min        (uSec)
+//   uint32_t  avg
+//   uint32_t  max
+// An item that wasn't run (the GUI renderers on iCamMini or the SD card write without a
+// card) has a count of 0.  Each SD card write is CMD_BENCH_SD_WRITE_LEN bytes.
+#define CMD_BENCH_NUM_ITEMS       11
+#define CMD_BENCH_ITEM_LEN        16
+#define CMD_BENCH_SD_WRITE_LEN    (1024 * 256)
+
+// Controller Activity responses (CMD_RSP CMD_CTRL_ACTIVITY).  The result is sent as an int32
+// (1 = succeeded, 0 = failed) when an activity finishes.  Long running activities may send
+// progress before then as binary data containing two uint32 values: the number of steps
+// completed and the total number of steps.
+#define CMD_CTRL_ACT_PROGRESS_LEN 8
+
+// Burst capture (CMD_SET CMD_BURST) is sent with an int32 number of frames (1 to
+// CMD_BURST_MAX_FRAMES).  The camera captures that many consecutive raw frames at the full
+// sensor frame rate and then saves each as a jpeg image in the background.  It is ignored
+// while a burst or timelapse series is in progress.
+#define CMD_BURST_MAX_FRAMES      16
+
+// Pre-trigger frames (CMD_SET CMD_PRE_TRIGGER) is sent with an int32 number of frames (0 to
+// CMD_BURST_MAX_FRAMES - 1) the camera keeps from before a picture is taken.  When it is
+// not 0 taking a picture saves those frames followed by the picture as a burst.
+
+// Picture averaging (CMD_SET CMD_PICTURE_AVG) is sent with an int32 number of consecutive
+// frames (1 to CMD_PICTURE_AVG_MAX) averaged into each picture, including timelapse and
+// trigger pictures, to reduce the temporal noise in the saved radiometric data.  The spot,
+// region and min/max temperatures saved with it are averaged over the same frames.  1 saves
+// a single frame.  The picture is taken over (n / 25) seconds so the camera should be
+// held still.  It isn't used for bursts or movies.
+#define CMD_PICTURE_AVG_MAX       64
+
+// Movie recording (CMD_SET CMD_RECORD) is sent with an int32 frame rate (1 to
+// CMD_RECORD_MAX_FPS) to start recording jpeg frames into an ICAM_NNNN.MJPG file and 0
+// to stop.  Frames are dropped when the camera can't keep up with the rate.  Saving a
+// picture while recording also stops it.  Frames carry the Y16 data when the save format
+// is CMD_SAVE_FMT_RJPEG.  It is ignored while a burst or timelapse series is in progress.
+#define CMD_RECORD_MAX_FPS        10
+
+// Data logging (CMD_SET CMD_LOG) is sent with an int32 record rate (1 to CMD_LOG_MAX_RATE
+// records/sec) to start logging the spot, scene min/max, region and ROI table temperatures
+// of each frame, without the image, into an ICAM_NNNN.LOG file and 0 to stop.  Records
+// are fixed length binary records (described in file_log.h).  Frames are dropped when the
+// camera can't keep up with the rate.  Saving a picture while logging also stops it.  It
+// is ignored while a movie, burst or timelapse series is in progress.
+#define CMD_LOG_MAX_RATE          25
+
+// Frame replay (CMD_SET CMD_REPLAY) replaces the Tiny1C image data with recorded frames so
+// the rest of the image pipeline can be tested and benchmarked with known scenes (or
+// demonstrated, or a timelapse series played back on every output).  A string naming a DCIM
+// directory ("NNNICAMF") replays the raw images in it (raw files, the raw files saved with
+// jpeg files and the raw data in radiometric jpeg files) from the SD card in order, starting
+// over at the end.  An int32 CMD_REPLAY_HOST replays frames sent by the client with
+// CMD_REPLAY_FRAME and CMD_REPLAY_OFF returns to the Tiny1C.  Each frame is used until the
+// next one is loaded.  Spot, min/max and region temperatures are still measured by the
+// Tiny1C.  CMD_GET CMD_REPLAY returns the current source as an int32.
+enum cmd_replay_param
+{
+	CMD_REPLAY_OFF = 0,
+	CMD_REPLAY_FILE,
+	CMD_REPLAY_HOST
+};
+
+// Replay rate (CMD_SET CMD_REPLAY_RATE) is sent, and the CMD_RSP to a CMD_GET is returned,
+// with an int32 rate (1 to CMD_REPLAY_MAX_FPS frames/sec) directory replay is paced at or 0
+// to load each frame as soon as the previous one has been used.  The next frame is read
+// while the current one is shown.
+#define CMD_REPLAY_MAX_FPS        25
+
+// Spatial filter (CMD_SET CMD_SPATIAL_FILTER) is sent, and the CMD_RSP to a CMD_GET is
+// returned, with binary data
+//   uint8_t   mode       (0 = off, 1 = edge-preserving denoise, 2 = sharpen)
+//   uint8_t   outputs    (CMD_SPATIAL_OUT_xxx mask of the outputs that use the filter)
+// The filter is run once per frame on the scaled image for all the selected outputs.  The
+// GUI output includes the websocket image stream.
+#define CMD_SPATIAL_FILTER_LEN    2
+#define CMD_SPATIAL_OUT_GUI       0x01
+#define CMD_SPATIAL_OUT_VID       0x02
+#define CMD_SPATIAL_OUT_SAVE      0x04
+
+// Change detection (CMD_SET CMD_CHANGE_DETECT) is sent, and the CMD_RSP to a CMD_GET is
+// returned, with binary data
+//   uint16_t  mode       (CMD_CHG_xxx)
+//   uint16_t  threshold  (raw Y16 counts, CMD_CHG_THRESH_MIN - CMD_CHG_THRESH_MAX)
+// Pixels that differ from a slowly updated background of the scene by more than the
+// threshold (in the direction selected by the mode) are highlighted on the local display.
+// The background absorbs a change over a period of a few seconds (longer for larger
+// thresholds).
+#define CMD_CHANGE_DETECT_LEN     4
+#define CMD_CHG_THRESH_MIN        4
+#define CMD_CHG_THRESH_MAX        4096
+
+enum cmd_chg_mode_param
+{
+	CMD_CHG_OFF = 0,
+	CMD_CHG_ANY,
+	CMD_CHG_WARMER,
+	CMD_CHG_COOLER
+};
+
+// Temporal noise reduction (CMD_SET CMD_TNR) is sent with an int32 level (T1C_TNR_xxx):
+// 0 = off, 1 = low, 2 = medium, 3 = high.  Higher levels average more frames for a
+// cleaner image of static scenes.  Moving objects are passed through unfiltered.
+
+// Replay frames (CMD_SET CMD_REPLAY_FRAME) are sent in pieces that fit in a websocket
+// packet.  The binary data is a uint32 byte offset into the frame followed by up to
+// CMD_REPLAY_CHUNK_MAX bytes of big endian 16-bit pixels.  The frame is complete when the
+// piece ending at the last pixel arrives.  A frame started before the camera has used the
+// previous one is dropped.
+#define CMD_REPLAY_FRAME_HDR_LEN  4
+#define CMD_REPLAY_CHUNK_MAX      8000
+
+// Dead pixels (CMD_SET CMD_DEAD_PIXELS) is sent with an int32 CMD_DPC_xxx action.
+// CMD_DPC_DETECT analyzes the next CMD_DPC_DETECT_FRAMES frames for pixels that are stuck or
+// differ from their neighbors and proposes them (up to CMD_DPC_MAX_POINTS, detection fails
+// if there are more).  The camera should be held still looking at a uniform scene such as a
+// wall.  Proposed pixels are replaced by their neighbors in the image until CMD_DPC_APPLY
+// adds them to the Tiny1C dead pixel table and saves it.  CMD_DPC_CLEAR discards them.
+// CMD_GET CMD_DEAD_PIXELS returns binary data with a header
+//   uint8_t   state      (CMD_DPC_ST_xxx)
+//   uint8_t   progress   (percent of the detection completed)
+//   uint16_t  num_points
+// followed by num_points entries of
+//   uint16_t  x, y       (image coordinates)
+#define CMD_DPC_HDR_LEN           4
+#define CMD_DPC_POINT_LEN         4
+#define CMD_DPC_MAX_POINTS        32
+#define CMD_DPC_DETECT_FRAMES     64
+
+enum cmd_dpc_action_param
+{
+	CMD_DPC_DETECT = 0,
+	CMD_DPC_APPLY,
+	CMD_DPC_CLEAR
+};
+
+enum cmd_dpc_state_param
+{
+	CMD_DPC_ST_IDLE = 0,
+	CMD_DPC_ST_DETECT,
+	CMD_DPC_ST_FOUND,
+	CMD_DPC_ST_APPLY,
+	CMD_DPC_ST_APPLIED,
+	CMD_DPC_ST_FAILED
+};
+
+// Event trigger (CMD_SET CMD_TRIGGER_CFG) arms the camera to capture when a condition is met
+// in the image.  The binary data is
+//   uint8_t   mode         (CMD_TRIG_xxx)
+//   uint8_t   action       (CMD_TRIG_ACT_xxx)
+//   uint8_t   pre_frames   (frames from before the trigger starting a burst)
+//   uint8_t   record_fps   (1 to CMD_RECORD_MAX_FPS)
+//   uint32_t  post         (burst frames or recording length in mSec)
+//   uint32_t  threshold    (see below)
+//   uint32_t  holdoff      (minimum mSec between triggers)
+// The threshold for CMD_TRIG_TEMP_ABOVE is a temperature and for CMD_TRIG_TEMP_RISE a rate
+// in °K/sec, both in 1/16 °K units.  The temperature is the region max temp when the region
+// is enabled and the scene max temp otherwise (one must be enabled).  The threshold for
+// CMD_TRIG_MOTION is the mean change in the raw Y16 value of 16x16 pixel block averages
+// between frames.  Pre-trigger frames are limited so the burst fits in
+// CMD_BURST_MAX_FRAMES.  Triggers are ignored while a burst, recording or timelapse series
+// is in progress.
+#define CMD_TRIGGER_CFG_LEN       16
+
+enum cmd_trig_mode_param
+{
+	CMD_TRIG_OFF = 0,
+	CMD_TRIG_TEMP_ABOVE,
+	CMD_TRIG_TEMP_RISE,
+	CMD_TRIG_MOTION
+};
+
+enum cmd_trig_action_param
+{
+	CMD_TRIG_ACT_PICTURE = 0,
+	CMD_TRIG_ACT_BURST,
+	CMD_TRIG_ACT_RECORD
+};
+
+// UDP stream (CMD_SET/CMD_GET CMD_UDP_STREAM) sends images to the requesting client as UDP
+// datagrams in addition to anything it gets over the websocket (iCamMini only).  A lost
+// datagram only loses its frame instead of delaying the frames behind it like the TCP
+// connection can.  The binary data is
+//   uint16_t  port         (client UDP port, 0 stops the stream)
+//   uint8_t   format       (CMD_STREAM_Y8 or CMD_STREAM_Y16)
+//   uint8_t   decimation   (send every Nth frame, 1 - CMD_UDP_MAX_DECIMATION)
+// The stream stops when the client's websocket closes.  Each datagram holds whole rows of one
+// frame after a header of
+//   uint8_t   version      (CMD_UDP_VERSION)
+//   uint8_t   format
+//   uint16_t  pkt_seq      (incremented for each datagram so loss can be counted)
+//   uint32_t  frame_seq    (same as the CMD_IMAGE metadata)
+//   uint32_t  msec
+//   uint16_t  width
+//   uint16_t  height
+//   uint16_t  row          (first row in this datagram)
+//   uint16_t  num_rows
+//   uint8_t   flags        (CMD_UDP_FLAG_xxx)
+//   uint8_t   reserved[3]
+// followed by num_rows * width Y8 bytes or uint16 Y16 values.  A receiver should display a
+// frame only when all its rows have arrived and drop it when a later frame starts.
+#define CMD_UDP_STREAM_LEN        4
+#define CMD_UDP_HDR_LEN           24
+#define CMD_UDP_MAX_PAYLOAD       1400
+#define CMD_UDP_MAX_DECIMATION    25
+#define CMD_UDP_VERSION           1
+#define CMD_UDP_FLAG_HIGH_GAIN    0x01
+#define CMD_UDP_FLAG_Y16_TEMP     0x02
+
+// Multicast stream (CMD_SET/CMD_GET CMD_MCAST_STREAM) sends images to the CMD_MCAST_GROUP
+// multicast group so any number of viewers on the network can receive them for the cost of
+// one stream (iCamMini only).  Datagrams are the same as the CMD_UDP_STREAM datagrams.  It
+// keeps running without a websocket client.  The stream is advertised with mDNS as a
+// "_icam-stream._udp" service (when mDNS is enabled) with the group in its TXT record.  The
+// CMD_SET binary data is
+//   uint8_t   format       (CMD_STREAM_OFF, CMD_STREAM_Y8 or CMD_STREAM_Y16)
+//   uint8_t   decimation   (send every Nth frame, 1 - CMD_UDP_MAX_DECIMATION)
+// and the CMD_GET response adds
+//   uint16_t  port
+//   uint8_t   group[4]     (IPv4 address, most significant byte first)
+#define CMD_MCAST_SET_LEN         2
+#define CMD_MCAST_STREAM_LEN      8
+#define CMD_MCAST_GROUP           "239.255.73.67"
+#define CMD_MCAST_PORT            5004
+
+// Synchronized capture trigger (iCamMini with CONFIG_SYNC_CAPTURE_ENABLE).  A UDP datagram
+// broadcast to CMD_SYNC_PORT makes every camera that receives it save the frame acquired
+// closest to delay_msec after the datagram arrived.  Cameras on the same network receive
+// a broadcast within a few mSec of each other so a delay longer than that jitter (and the
+// sender's time to repeat the datagram) gives them a common capture time without a shared
+// clock.  A sender may repeat the datagram with the same trigger_id and a delay reduced by
+// the time since the first one; repeats of a trigger_id already seen are ignored.
+//   uint8_t   magic[4]     (CMD_SYNC_MAGIC)
+//   uint32_t  trigger_id   (little endian)
+//   uint32_t  delay_msec   (little endian, 0 - CMD_SYNC_MAX_DELAY_MSEC)
+#define CMD_SYNC_PORT             5005
+#define CMD_SYNC_MAGIC            "iCSy"
+#define CMD_SYNC_PKT_LEN          12
+#define CMD_SYNC_MAX_DELAY_MSEC   10000
+
 
 #endif /* CMD_LIST_H */
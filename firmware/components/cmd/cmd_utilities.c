@@ -118,7 +118,7 @@ bool cmd_process_received_cmd(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_t
 {
 	bool null_handler = false;
 	
-	if (cmd_id > CMD_TOTAL_COUNT) {
+	if (cmd_id >= CMD_TOTAL_COUNT) {
 #ifdef ESP_PLATFORM
 		ESP_LOGE(TAG, "No handler for received cmd %ul", cmd_id);
 #else
@@ -166,7 +166,7 @@ bool cmd_process_received_cmd(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_t
 
 bool cmd_register_cmd_id(cmd_id_t cmd_id, cmd_handler get_handler, cmd_handler set_handler, cmd_handler rsp_handler)
 {
-	if (cmd_id > CMD_TOTAL_COUNT) {
+	if (cmd_id >= CMD_TOTAL_COUNT) {
 #ifdef ESP_PLATFORM
 		ESP_LOGE(TAG, "Attempt to register illegal command %ul", cmd_id);
 #else
@@ -265,6 +265,91 @@ bool cmd_decode_marker_location(uint32_t len, uint8_t* data, uint16_t* x1, uint1
 }
 
 
+bool cmd_send_stream_view(cmd_t cmd_type, cmd_id_t cmd_id, int decimation, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	uint8_t array[CMD_STREAM_VIEW_LEN];
+	
+	// First dword contains the decimation
+	*((uint32_t*) &array[0]) = htonl((uint32_t) decimation);
+	
+	// Followed by the region in the same format as a marker location
+	*((uint32_t*) &array[4]) = htonl((x1 << 16) | y1);
+	*((uint32_t*) &array[8]) = htonl((x2 << 16) | y2);
+	
+	if (is_local) {
+		return cmd_process_received_cmd(cmd_type, cmd_id, CMD_DATA_BINARY, CMD_STREAM_VIEW_LEN, array);
+	} else {
+		return send_handler(cmd_type, cmd_id, CMD_DATA_BINARY, CMD_STREAM_VIEW_LEN, array);
+	}
+}
+
+
+bool cmd_decode_stream_view(uint32_t len, uint8_t* data, int* decimation, uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2)
+{
+	if (len != CMD_STREAM_VIEW_LEN) return false;
+	
+	*decimation = (int) ntohl(*((uint32_t*) &data[0]));
+	
+	return cmd_decode_marker_location(8, &data[4], x1, y1, x2, y2);
+}
+
+
+bool cmd_send_catalog_page_request(cmd_t cmd_type, cmd_id_t cmd_id, int type, int offset, int count)
+{
+	uint8_t array[CMD_FILE_CATALOG_PAGE_REQ_LEN];
+	
+	*((uint32_t*) &array[0]) = htonl((uint32_t) type);
+	*((uint32_t*) &array[4]) = htonl((uint32_t) offset);
+	*((uint32_t*) &array[8]) = htonl((uint32_t) count);
+	
+	if (is_local) {
+		return cmd_process_received_cmd(cmd_type, cmd_id, CMD_DATA_BINARY, CMD_FILE_CATALOG_PAGE_REQ_LEN, array);
+	} else {
+		return send_handler(cmd_type, cmd_id, CMD_DATA_BINARY, CMD_FILE_CATALOG_PAGE_REQ_LEN, array);
+	}
+}
+
+
+bool cmd_decode_catalog_page_request(uint32_t len, uint8_t* data, int* type, int* offset, int* count)
+{
+	if (len != CMD_FILE_CATALOG_PAGE_REQ_LEN) return false;
+	
+	*type = (int) ((int32_t) ntohl(*((uint32_t*) &data[0])));
+	*offset = (int) ntohl(*((uint32_t*) &data[4]));
+	*count = (int) ntohl(*((uint32_t*) &data[8]));
+	
+	return true;
+}
+
+
+bool cmd_send_catalog_range_request(cmd_t cmd_type, cmd_id_t cmd_id, uint32_t start, uint32_t end, int offset)
+{
+	uint8_t array[CMD_FILE_CATALOG_RANGE_REQ_LEN];
+	
+	*((uint32_t*) &array[0]) = htonl(start);
+	*((uint32_t*) &array[4]) = htonl(end);
+	*((uint32_t*) &array[8]) = htonl((uint32_t) offset);
+	
+	if (is_local) {
+		return cmd_process_received_cmd(cmd_type, cmd_id, CMD_DATA_BINARY, CMD_FILE_CATALOG_RANGE_REQ_LEN, array);
+	} else {
+		return send_handler(cmd_type, cmd_id, CMD_DATA_BINARY, CMD_FILE_CATALOG_RANGE_REQ_LEN, array);
+	}
+}
+
+
+bool cmd_decode_catalog_range_request(uint32_t len, uint8_t* data, uint32_t* start, uint32_t* end, int* offset)
+{
+	if (len != CMD_FILE_CATALOG_RANGE_REQ_LEN) return false;
+	
+	*start = ntohl(*((uint32_t*) &data[0]));
+	*end = ntohl(*((uint32_t*) &data[4]));
+	*offset = (int) ntohl(*((uint32_t*) &data[8]));
+	
+	return true;
+}
+
+
 bool cmd_send_file_indicies(cmd_t cmd_type, cmd_id_t cmd_id, int dir_index, int file_index)
 {
 	uint32_t t;
@@ -72,6 +72,14 @@ bool cmd_send_binary(cmd_t cmd_type, cmd_id_t cmd_id, uint32_t len, uint8_t* val
 bool cmd_send_marker_location(cmd_t cmd_type, cmd_id_t cmd_id, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
 bool cmd_decode_marker_location(uint32_t len, uint8_t* data, uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2);
 
+bool cmd_send_stream_view(cmd_t cmd_type, cmd_id_t cmd_id, int decimation, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+bool cmd_decode_stream_view(uint32_t len, uint8_t* data, int* decimation, uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2);
+
+bool cmd_send_catalog_page_request(cmd_t cmd_type, cmd_id_t cmd_id, int type, int offset, int count);
+bool cmd_decode_catalog_page_request(uint32_t len, uint8_t* data, int* type, int* offset, int* count);
+bool cmd_send_catalog_range_request(cmd_t cmd_type, cmd_id_t cmd_id, uint32_t start, uint32_t end, int offset);
+bool cmd_decode_catalog_range_request(uint32_t len, uint8_t* data, uint32_t* start, uint32_t* end, int* offset);
+
 bool cmd_send_file_indicies(cmd_t cmd_type, cmd_id_t cmd_id, int dir_index, int file_index);
 bool cmd_decode_file_indicies(uint32_t len, uint8_t* data, int* dir_index, int* file_index);
 
@@ -0,0 +1,346 @@
+/*
+ * Lossless 16-bit image codec.  Designed to be built by both the ESP32 IDF and
+ * emscripten build tools for use on both sides of the interface.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "y16_codec.h"
+#include <stddef.h>
+
+
+//
+// Private constants
+//
+
+// Largest k (u is at most 16 bits)
+#define K_MAX  15
+
+// Bytes a pixel can add to the output, including bits still held from the previous pixel
+#define PIXEL_MAX_LEN  ((7 + Y16_CODEC_QMAX + 16 + 7) / 8)
+
+
+
+//
+// Private typedefs
+//
+
+// Bit packer.  acc holds n bits not yet written in its low bits.
+typedef struct {
+	uint8_t* p;
+	uint32_t acc;
+	int n;
+} bit_wr_t;
+
+// Bit unpacker.  acc holds n unread bits in its low bits.
+typedef struct {
+	const uint8_t* p;
+	const uint8_t* endP;
+	uint32_t acc;
+	int n;
+} bit_rd_t;
+
+
+
+//
+// Forward declarations for internal functions
+//
+static inline uint16_t _predict(const uint16_t* row, const uint16_t* prev, int x);
+static inline int _get_k(y16_codec_t* st);
+static inline void _update(y16_codec_t* st, uint32_t u);
+static inline void _put_bits(bit_wr_t* wr, uint32_t v, int n);
+static inline bool _get_bits(bit_rd_t* rd, int n, uint32_t* v);
+
+
+
+//
+// API
+//
+
+/**
+ * Reset the coder state for a new image
+ */
+void y16_codec_init(y16_codec_t* st)
+{
+	st->s = Y16_CODEC_S_INIT;
+	st->n = 1;
+}
+
+
+/**
+ * Encode a row of w pixels into at most max_len bytes of dst.  prev is the row above (NULL
+ * for the first row of the image).  Returns the encoded length or 0, leaving st unchanged,
+ * if it doesn't fit.
+ */
+uint32_t y16_codec_encode_row(y16_codec_t* st, const uint16_t* row, const uint16_t* prev, int w, uint8_t* dst, uint32_t max_len)
+{
+	bit_wr_t wr = {dst, 0, 0};
+	y16_codec_t cs = *st;
+	uint32_t u;
+	uint32_t q;
+	int16_t d;
+	int k;
+	int x;
+	
+	for (x=0; x<w; x++) {
+		if ((uint32_t) (wr.p - dst) + PIXEL_MAX_LEN > max_len) {
+			return 0;
+		}
+	
+		d = (int16_t) (row[x] - _predict(row, prev, x));
+		u = (d >= 0) ? 2 * (uint32_t) d : (uint32_t) (-2 * (int32_t) d - 1);
+	
+		k = _get_k(&cs);
+		q = u >> k;
+		if (q < Y16_CODEC_QMAX) {
+			_put_bits(&wr, 1, q + 1);
+			if (k != 0) {
+				_put_bits(&wr, u & ((1 << k) - 1), k);
+			}
+		} else {
+			_put_bits(&wr, 0, Y16_CODEC_QMAX);
+			_put_bits(&wr, u, 16);
+		}
+		_update(&cs, u);
+	}
+	
+	// Pad to a byte boundary
+	if (wr.n != 0) {
+		_put_bits(&wr, 0, 8 - wr.n);
+	}
+	
+	*st = cs;
+	return (wr.p - dst);
+}
+
+
+/**
+ * Decode a row of w pixels from len bytes of src into row.  prev is the row above (NULL
+ * for the first row of the image).  Returns the number of bytes used or 0, leaving st
+ * unchanged, if src doesn't hold the whole row.
+ */
+uint32_t y16_codec_decode_row(y16_codec_t* st, const uint8_t* src, uint32_t len, const uint16_t* prev, int w, uint16_t* row)
+{
+	bit_rd_t rd = {src, src + len, 0, 0};
+	y16_codec_t cs = *st;
+	uint32_t b;
+	uint32_t u;
+	uint32_t q;
+	int k;
+	int x;
+	
+	for (x=0; x<w; x++) {
+		k = _get_k(&cs);
+	
+		// Unary part
+		q = 0;
+		do {
+			if (!_get_bits(&rd, 1, &b)) return 0;
+		} while ((b == 0) && (++q < Y16_CODEC_QMAX));
+	
+		if (q < Y16_CODEC_QMAX) {
+			u = q << k;
+			if (k != 0) {
+				if (!_get_bits(&rd, k, &b)) return 0;
+				u |= b;
+			}
+		} else {
+			if (!_get_bits(&rd, 16, &u)) return 0;
+		}
+		_update(&cs, u);
+	
+		row[x] = _predict(row, prev, x) + (uint16_t) ((u & 1) ? -(int32_t) ((u + 1) >> 1) : (int32_t) (u >> 1));
+	}
+	
+	// The padding is the fraction of a byte left over
+	*st = cs;
+	return (rd.p - src) - (rd.n / 8);
+}
+
+
+/**
+ * Encode the rows of a w x h image, starting with row *rowP, into at most max_len bytes
+ * of dst.  Updates *rowP to the next row to encode (h when the image is done) and returns
+ * the encoded length.  The image can be encoded in pieces this way without a buffer for
+ * the whole thing.  max_len should be at least Y16_CODEC_MAX_ROW_LEN(w) to guarantee
+ * progress.
+ */
+uint32_t y16_codec_encode_chunk(y16_codec_t* st, const uint16_t* src, int w, int h, int* rowP, uint8_t* dst, uint32_t max_len)
+{
+	uint32_t len = 0;
+	uint32_t n;
+	int y = *rowP;
+	
+	if (y == 0) {
+		y16_codec_init(st);
+	}
+	
+	while (y < h) {
+		n = y16_codec_encode_row(st, src + y*w, (y == 0) ? NULL : src + (y-1)*w, w, dst + len, max_len - len);
+		if (n == 0) break;
+		len += n;
+		y += 1;
+	}
+	*rowP = y;
+	
+	return len;
+}
+
+
+/**
+ * Decode len bytes of src into the rows of a w x h image, starting with row *rowP.  Only
+ * complete rows are decoded.  Updates *rowP to the next row to decode (h when the image is
+ * done) and returns the number of bytes used so the image can be decoded in pieces as it is
+ * read.
+ */
+uint32_t y16_codec_decode_chunk(y16_codec_t* st, const uint8_t* src, uint32_t len, uint16_t* dst, int w, int h, int* rowP)
+{
+	uint32_t used = 0;
+	uint32_t n;
+	int y = *rowP;
+	
+	if (y == 0) {
+		y16_codec_init(st);
+	}
+	
+	while (y < h) {
+		n = y16_codec_decode_row(st, src + used, len - used, (y == 0) ? NULL : dst + (y-1)*w, w, dst + y*w);
+		if (n == 0) break;
+		used += n;
+		y += 1;
+	}
+	*rowP = y;
+	
+	return used;
+}
+
+
+/**
+ * Encode a w x h image into at most max_len bytes of dst.  Returns the encoded length or
+ * 0 if it doesn't fit.
+ */
+uint32_t y16_codec_encode(const uint16_t* src, int w, int h, uint8_t* dst, uint32_t max_len)
+{
+	y16_codec_t st;
+	uint32_t len;
+	int y = 0;
+	
+	len = y16_codec_encode_chunk(&st, src, w, h, &y, dst, max_len);
+	
+	return (y == h) ? len : 0;
+}
+
+
+/**
+ * Decode a w x h image from len bytes of src into dst.  Returns false if src doesn't hold
+ * exactly one encoded image.
+ */
+bool y16_codec_decode(const uint8_t* src, uint32_t len, uint16_t* dst, int w, int h)
+{
+	y16_codec_t st;
+	uint32_t used;
+	int y = 0;
+	
+	used = y16_codec_decode_chunk(&st, src, len, dst, w, h, &y);
+	
+	return (y == h) && (used == len);
+}
+
+
+
+//
+// Internal functions
+//
+static inline uint16_t _predict(const uint16_t* row, const uint16_t* prev, int x)
+{
+	uint16_t a, b, c;
+	uint16_t mn, mx;
+	
+	if (prev == NULL) {
+		return (x == 0) ? 0 : row[x - 1];
+	}
+	
+	b = prev[x];
+	if (x == 0) {
+		return b;
+	}
+	a = row[x - 1];
+	c = prev[x - 1];
+	
+	// Median edge detector
+	if (a < b) {
+		mn = a;
+		mx = b;
+	} else {
+		mn = b;
+		mx = a;
+	}
+	if (c >= mx) {
+		return mn;
+	} else if (c <= mn) {
+		return mx;
+	} else {
+		return a + b - c;
+	}
+}
+
+
+static inline int _get_k(y16_codec_t* st)
+{
+	int k = 0;
+	
+	while (((st->n << k) < st->s) && (k < K_MAX)) {
+		k++;
+	}
+	
+	return k;
+}
+
+
+static inline void _update(y16_codec_t* st, uint32_t u)
+{
+	st->s += u;
+	if (++st->n == Y16_CODEC_RESET) {
+		st->s >>= 1;
+		st->n >>= 1;
+	}
+}
+
+
+static inline void _put_bits(bit_wr_t* wr, uint32_t v, int n)
+{
+	wr->acc = (wr->acc << n) | v;
+	wr->n += n;
+	while (wr->n >= 8) {
+		wr->n -= 8;
+		*wr->p++ = (uint8_t) (wr->acc >> wr->n);
+	}
+}
+
+
+static inline bool _get_bits(bit_rd_t* rd, int n, uint32_t* v)
+{
+	while ((rd->n < n) && (rd->p < rd->endP)) {
+		rd->acc = (rd->acc << 8) | *rd->p++;
+		rd->n += 8;
+	}
+	if (rd->n < n) {
+		return false;
+	}
+	
+	rd->n -= n;
+	*v = (uint32_t) (rd->acc >> rd->n) & ((1UL << n) - 1);
+	return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * Lossless 16-bit image codec.  Used for the CMD_IMG_Y16_ENC_RICE image data sent to
+ * clients and the FILE_RAW_ENC_RICE image data in raw files.  Designed to be built by
+ * both the ESP32 IDF and emscripten build tools for use on both sides of the interface.
+ *
+ * Each pixel x is predicted from its neighbours a (left), b (above) and c (above left)
+ * with the LOCO-I median edge detector
+ *
+ *   min(a, b)     if c >= max(a, b)
+ *   max(a, b)     if c <= min(a, b)
+ *   a + b - c     otherwise
+ *
+ * In the first row b and c are a and in the first column a and c are b.  The first pixel
+ * of the image is predicted as 0.  The difference from the prediction (modulo 2^16, as a
+ * signed value) is mapped to an unsigned value u (0, -1, 1, -2, 2 ... to 0, 1, 2, 3, 4 ...)
+ * and Rice coded with parameter k: u >> k as that many 0 bits followed by a 1 bit, then
+ * the low k bits of u.  A value needing Y16_CODEC_QMAX or more 0 bits is coded as
+ * Y16_CODEC_QMAX 0 bits followed by the 16 bits of u.  k is the smallest value for which
+ * (n << k) >= s where s is the sum of the previously coded u and n the number of them
+ * (n starts at 1 and s at Y16_CODEC_S_INIT for each image and both are halved when n
+ * reaches Y16_CODEC_RESET).  Bits are packed MSB first and each row is padded with 0 bits
+ * to a byte boundary so an image can be encoded and decoded a row at a time with only
+ * the state in y16_codec_t kept between rows.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef Y16_CODEC_H
+#define Y16_CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+//
+// Constants
+//
+#define Y16_CODEC_QMAX     24
+#define Y16_CODEC_RESET    64
+#define Y16_CODEC_S_INIT   16
+
+// Longest encoded row of w pixels
+#define Y16_CODEC_MAX_ROW_LEN(w) (((w)*(Y16_CODEC_QMAX + 16) + 7) / 8)
+
+
+
+//
+// Typedefs
+//
+
+// Coder state carried from row to row
+typedef struct {
+	uint32_t s;                // Sum of the coded values
+	uint32_t n;                // Number of values in s
+} y16_codec_t;
+
+
+
+//
+// API
+//
+void y16_codec_init(y16_codec_t* st);
+uint32_t y16_codec_encode_row(y16_codec_t* st, const uint16_t* row, const uint16_t* prev, int w, uint8_t* dst, uint32_t max_len);
+uint32_t y16_codec_decode_row(y16_codec_t* st, const uint8_t* src, uint32_t len, const uint16_t* prev, int w, uint16_t* row);
+uint32_t y16_codec_encode_chunk(y16_codec_t* st, const uint16_t* src, int w, int h, int* rowP, uint8_t* dst, uint32_t max_len);
+uint32_t y16_codec_decode_chunk(y16_codec_t* st, const uint8_t* src, uint32_t len, uint16_t* dst, int w, int h, int* rowP);
+uint32_t y16_codec_encode(const uint16_t* src, int w, int h, uint8_t* dst, uint32_t max_len);
+bool y16_codec_decode(const uint8_t* src, uint32_t len, uint16_t* dst, int w, int h);
+
+#endif /* Y16_CODEC_H */
@@ -17,6 +17,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include "driver/gpio.h"
 #include "driver_aht20_interface.h"
 #include "driver_aht20.h"
 #include "env_task.h"
@@ -24,12 +25,15 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "ps_utilities.h"
 #include "sys_utilities.h"
+#include "system_config.h"
 #include "t1c_task.h"
 #include "vl53lx_api.h"
 #include "vl53lx_platform.h"
 #include "vl53lx_platform_user_data.h"
 #include <math.h>
+#include <stdlib.h>
 
 
 
@@ -40,6 +44,29 @@
 // Uncomment to display some debug info
 //#define DEBUG_UPDATES
 
+// Number of evaluation intervals to wait for a temperature/humidity measurement before
+// giving up on it (a measurement takes 85 mSec)
+#define ENV_TASK_T_H_MAX_POLLS   3
+
+// Distance filter: a median of the last ENV_TASK_DIST_MEDIAN_LEN readings feeds an
+// exponential moving average with weight 1/(2^ENV_TASK_DIST_EMA_SHIFT).  A median that
+// jumps by more than ENV_TASK_DIST_STEP_PERCENT restarts the average so a new target is
+// picked up quickly.
+#define ENV_TASK_DIST_MEDIAN_LEN     3
+#define ENV_TASK_DIST_EMA_SHIFT      2
+#define ENV_TASK_DIST_STEP_PERCENT   25
+
+// Filtered distance changes smaller than both of these are not sent to t1c_task
+#define ENV_TASK_DIST_MIN_CHANGE_CM  2
+#define ENV_TASK_DIST_CHANGE_PERCENT 3
+
+// Number of consecutive readings without a target before the distance is invalid
+#define ENV_TASK_DIST_MAX_INVALID    3
+
+// Temperature/humidity changes at least this large keep the sample rate up
+#define ENV_TASK_T_CHANGE_C          1
+#define ENV_TASK_H_CHANGE_PERCENT    2
+
 
 
 //
@@ -68,12 +95,34 @@ static VL53LX_MultiRangingData_t multi_ranging_data;
 static bool found_temp_humidity_sensor = false;
 static bool found_dist_sensor = false;
 
+// Distance filter state
+static int dist_hist_count = 0;
+static int dist_hist_index = 0;
+static int dist_invalid_count = 0;
+static int32_t dist_ema;                  // cm * 16
+static uint16_t dist_hist[ENV_TASK_DIST_MEDIAN_LEN];
+static uint16_t dist_reported_cm = 0;
+static bool dist_reported_valid = false;
+
+#ifdef BRD_DIST_INT_IO
+// Set by the VL53L4CX data ready interrupt
+static volatile bool dist_int_seen = false;
+#endif
+
 
 //
 // Forward declarations for internal functions
 //
-static void _update_temp_humidity(int16_t* temp, uint8_t* humidity, bool* valid);
+static bool _update_temp_humidity(int16_t* temp, uint8_t* humidity, bool* valid);
 static void _update_distance(uint16_t* dist_cm, bool* valid);
+static bool _filter_distance(uint16_t dist_cm, bool valid);
+static bool _t_h_changed(int16_t temp, uint8_t humidity, bool valid);
+static int _next_period(int cur_msec, int min_msec, int max_msec, bool changed, bool auto_ambient);
+static uint16_t _dist_median();
+#ifdef BRD_DIST_INT_IO
+static void _init_dist_int();
+static void IRAM_ATTR _dist_isr_handler(void* arg);
+#endif
 
 
 
@@ -85,6 +134,13 @@ void env_task()
 	bool temp_humidity_valid = false;
 	bool dist_valid = false;
 	int temp_eval_count = 1;   // Trigger right away
+	int temp_poll_count = 0;
+	int temp_period_msec = ENV_TASK_READ_T_H_MSEC;
+	int dist_period_msec = ENV_TASK_READ_DIST_MSEC;
+	bool auto_ambient;
+	bool prev_auto_ambient = true;
+	bool dist_changed;
+	t1c_config_t t1c_config;
 	int dist_eval_count = 1;
 	uint8_t humidity = 0;
 	uint8_t dist_data_ready;
@@ -129,9 +185,14 @@ void env_task()
 		} else if ((dist_status = VL53LX_SetMeasurementTimingBudgetMicroSeconds(&dist_handle, 100000)) != VL53LX_ERROR_NONE) {
 			ESP_LOGE(TAG, "Distance sensor set timing budget failed - %d", (int) dist_status);
 			found_dist_sensor = false;
-		} else if ((dist_status = VL53LX_StartMeasurement(&dist_handle)) != VL53LX_ERROR_NONE) {
-			ESP_LOGE(TAG, "Distance sensor start measurements failed - %d", (int) dist_status);
-			found_dist_sensor = false;
+		} else {
+#ifdef BRD_DIST_INT_IO
+			_init_dist_int();
+#endif
+			if ((dist_status = VL53LX_StartMeasurement(&dist_handle)) != VL53LX_ERROR_NONE) {
+				ESP_LOGE(TAG, "Distance sensor start measurements failed - %d", (int) dist_status);
+				found_dist_sensor = false;
+			}
 		}
 	}
 	
@@ -145,42 +206,82 @@ void env_task()
 	prev_eval_usec = esp_timer_get_time();
 	
 	while (1) {
-		// Temperature/Humidity sensor evaluation
+		// Restart fast sampling when ambient correction is turned on
+		(void) ps_get_config(PS_CONFIG_TYPE_T1C, &t1c_config);
+		auto_ambient = t1c_config.use_auto_ambient;
+		if (auto_ambient && !prev_auto_ambient) {
+			temp_period_msec = ENV_TASK_READ_T_H_MSEC;
+			dist_period_msec = ENV_TASK_READ_DIST_MSEC;
+			if (temp_poll_count == 0) temp_eval_count = 1;
+			dist_eval_count = 1;
+		}
+		prev_auto_ambient = auto_ambient;
+		
+		// Temperature/Humidity sensor evaluation.  A measurement is started in one
+		// evaluation and read in a following one so we don't sit on the bus while the
+		// sensor converts.
 		if (found_temp_humidity_sensor) {
-			if (--temp_eval_count == 0) {
-				temp_eval_count = ENV_TASK_READ_T_H_MSEC / ENV_TASK_EVAL_MSEC;
-				_update_temp_humidity(&temp, &humidity, &temp_humidity_valid);
-				t1c_set_ambient_temp(temp, temp_humidity_valid);
-				t1c_set_ambient_humidity((uint16_t) humidity, temp_humidity_valid);
-				xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_T_H_MASK, eSetBits);
+			if (temp_poll_count != 0) {
+				if (_update_temp_humidity(&temp, &humidity, &temp_humidity_valid) || (--temp_poll_count == 0)) {
+					temp_poll_count = 0;
+					temp_period_msec = _next_period(temp_period_msec, ENV_TASK_READ_T_H_MSEC, ENV_TASK_READ_T_H_MAX_MSEC,
+					                                _t_h_changed(temp, humidity, temp_humidity_valid), auto_ambient);
+					t1c_set_ambient_temp(temp, temp_humidity_valid);
+					t1c_set_ambient_humidity((uint16_t) humidity, temp_humidity_valid);
+					xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_T_H_MASK, eSetBits);
 #ifdef DEBUG_UPDATES
-				ESP_LOGI(TAG, "temp = %u, hum = %u %%", temp, humidity);
+					ESP_LOGI(TAG, "temp = %u, hum = %u %%", temp, humidity);
 #endif
+				}
+			}
+			
+			if (--temp_eval_count == 0) {
+				temp_eval_count = temp_period_msec / ENV_TASK_EVAL_MSEC;
+				if (aht20_start_temperature_humidity(&aht20_handle) == 0) {
+					temp_poll_count = ENV_TASK_T_H_MAX_POLLS;
+				} else {
+					temp_humidity_valid = false;
+					t1c_set_ambient_temp(temp, temp_humidity_valid);
+					t1c_set_ambient_humidity((uint16_t) humidity, temp_humidity_valid);
+					xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_T_H_MASK, eSetBits);
+				}
 			}
 		}
 		
 		// Distance sensor evaluation
 		if (found_dist_sensor) {
 			if (--dist_eval_count == 0) {
-				dist_eval_count = ENV_TASK_READ_DIST_MSEC / ENV_TASK_EVAL_MSEC;
+				dist_changed = false;
 				
-				// See if there is data
+				// See if there is data (without touching the bus when the sensor interrupts us)
+#ifdef BRD_DIST_INT_IO
+				dist_status = VL53LX_ERROR_NONE;
+				dist_data_ready = dist_int_seen ? 1 : 0;
+				dist_int_seen = false;
+#else
 				dist_status = VL53LX_GetMeasurementDataReady(&dist_handle, &dist_data_ready);
+#endif
 				if (dist_status == VL53LX_ERROR_NONE) {
 					if (dist_data_ready != 0) {
 						_update_distance(&dist_cm, &dist_valid);
-						t1c_set_target_distance(dist_cm, dist_valid);
-						xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_DIST_MASK, eSetBits);
+						if (_filter_distance(dist_cm, dist_valid)) {
+							dist_changed = true;
+							t1c_set_target_distance(dist_reported_cm, dist_reported_valid);
+							xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_DIST_MASK, eSetBits);
 #ifdef DEBUG_UPDATES
-						ESP_LOGI(TAG, "dist = %u", dist_cm);
+							ESP_LOGI(TAG, "dist = %u (%u)", dist_reported_cm, dist_cm);
 #endif
-						
+						}
 					} else {
 						ESP_LOGI(TAG, "dist not ready");
 					}
 				} else {
 					ESP_LOGE(TAG, "VL53LX_GetMeasurementDataReady failed with %d", (int) dist_status);
 				}
+				
+				dist_period_msec = _next_period(dist_period_msec, ENV_TASK_READ_DIST_MSEC, ENV_TASK_READ_DIST_MAX_MSEC,
+				                                dist_changed, auto_ambient);
+				dist_eval_count = dist_period_msec / ENV_TASK_EVAL_MSEC;
 			}
 		}
 		
@@ -207,20 +308,26 @@ void env_sensor_present(bool* temp_hum, bool* dist)
 //
 // Internal functions
 //
-static void _update_temp_humidity(int16_t* temp, uint8_t* humidity, bool* valid)
+// Returns true when the measurement is complete (valid indicates if it succeeded),
+// false if it is still in progress
+static bool _update_temp_humidity(int16_t* temp, uint8_t* humidity, bool* valid)
 {
 	float t;
 	uint8_t h;
+	uint8_t ret;
 	uint32_t humidity_raw;
 	uint32_t temp_raw;
 	
-	if (aht20_read_temperature_humidity(&aht20_handle, &temp_raw, &t, &humidity_raw, &h) == 0) {
+	ret = aht20_get_temperature_humidity(&aht20_handle, &temp_raw, &t, &humidity_raw, &h);
+	if (ret == 0) {
 		*temp = (int16_t) round(t);
 		*humidity = h;
 		*valid = true;
-	} else{
+	} else {
 		*valid = false;
 	}
+	
+	return (ret != 4);
 }
 
 
@@ -258,3 +365,144 @@ static void _update_distance(uint16_t* dist_cm, bool* valid)
 		*valid = false;
 	}
 }
+
+
+// Filter a new distance reading.  Returns true if the reported distance (dist_reported_cm,
+// dist_reported_valid) changed enough that t1c_task should be told.
+static bool _filter_distance(uint16_t dist_cm, bool valid)
+{
+	int32_t diff;
+	int32_t thresh;
+	uint16_t median;
+	uint16_t filt_cm;
+	
+	if (!valid) {
+		// Require a few misses in a row before giving up on the target
+		if (++dist_invalid_count < ENV_TASK_DIST_MAX_INVALID) {
+			return false;
+		}
+		dist_invalid_count = ENV_TASK_DIST_MAX_INVALID;
+		dist_hist_count = 0;
+		if (dist_reported_valid) {
+			dist_reported_valid = false;
+			return true;
+		}
+		return false;
+	}
+	dist_invalid_count = 0;
+	
+	// Median of the most recent readings removes single outliers
+	dist_hist[dist_hist_index] = dist_cm;
+	if (++dist_hist_index == ENV_TASK_DIST_MEDIAN_LEN) dist_hist_index = 0;
+	if (dist_hist_count < ENV_TASK_DIST_MEDIAN_LEN) dist_hist_count++;
+	median = _dist_median();
+	
+	// Moving average smooths the rest, restarting on a large step
+	diff = ((int32_t) median << 4) - dist_ema;
+	if ((dist_hist_count == 1) ||
+	    ((abs(diff) >> 4) * 100 > ENV_TASK_DIST_STEP_PERCENT * (int32_t) median)) {
+		dist_ema = (int32_t) median << 4;
+	} else {
+		dist_ema += diff >> ENV_TASK_DIST_EMA_SHIFT;
+	}
+	filt_cm = (uint16_t) ((dist_ema + 8) >> 4);
+	
+	// Only report meaningful changes
+	if (dist_reported_valid) {
+		thresh = ((int32_t) dist_reported_cm * ENV_TASK_DIST_CHANGE_PERCENT) / 100;
+		if (thresh < ENV_TASK_DIST_MIN_CHANGE_CM) thresh = ENV_TASK_DIST_MIN_CHANGE_CM;
+		if (abs((int32_t) filt_cm - (int32_t) dist_reported_cm) < thresh) {
+			return false;
+		}
+	}
+	
+	dist_reported_cm = filt_cm;
+	dist_reported_valid = true;
+	return true;
+}
+
+
+// Returns true if a temperature/humidity reading differs meaningfully from the previous one
+static bool _t_h_changed(int16_t temp, uint8_t humidity, bool valid)
+{
+	static bool prev_valid = false;
+	static int16_t prev_temp;
+	static uint8_t prev_humidity;
+	bool changed;
+	
+	if (valid != prev_valid) {
+		changed = true;
+	} else if (valid) {
+		changed = (abs(temp - prev_temp) >= ENV_TASK_T_CHANGE_C) ||
+		          (abs((int) humidity - (int) prev_humidity) >= ENV_TASK_H_CHANGE_PERCENT);
+	} else {
+		changed = false;
+	}
+	
+	if (changed) {
+		prev_valid = valid;
+		prev_temp = temp;
+		prev_humidity = humidity;
+	}
+	
+	return changed;
+}
+
+
+// Compute the next sample interval for a sensor
+static int _next_period(int cur_msec, int min_msec, int max_msec, bool changed, bool auto_ambient)
+{
+	if (!auto_ambient) {
+		return max_msec;
+	} else if (changed) {
+		return min_msec;
+	} else {
+		return (2*cur_msec > max_msec) ? max_msec : 2*cur_msec;
+	}
+}
+
+
+static uint16_t _dist_median()
+{
+	int i, j;
+	uint16_t t;
+	uint16_t sorted[ENV_TASK_DIST_MEDIAN_LEN];
+	
+	for (i=0; i<dist_hist_count; i++) {
+		sorted[i] = dist_hist[i];
+	}
+	for (i=1; i<dist_hist_count; i++) {
+		t = sorted[i];
+		for (j=i; (j > 0) && (sorted[j-1] > t); j--) {
+			sorted[j] = sorted[j-1];
+		}
+		sorted[j] = t;
+	}
+	
+	return sorted[dist_hist_count / 2];
+}
+
+
+#ifdef BRD_DIST_INT_IO
+// The VL53L4CX drives GPIO1 low when a measurement is ready
+static void _init_dist_int()
+{
+	gpio_config_t io_conf = {
+		.pin_bit_mask = 1ULL << BRD_DIST_INT_IO,
+		.mode = GPIO_MODE_INPUT,
+		.pull_up_en = GPIO_PULLUP_ENABLE,
+		.pull_down_en = GPIO_PULLDOWN_DISABLE,
+		.intr_type = GPIO_INTR_NEGEDGE
+	};
+	
+	gpio_config(&io_conf);
+	gpio_install_isr_service(0);
+	gpio_isr_handler_add(BRD_DIST_INT_IO, _dist_isr_handler, NULL);
+}
+
+
+static void IRAM_ATTR _dist_isr_handler(void* arg)
+{
+	dist_int_seen = true;
+}
+#endif
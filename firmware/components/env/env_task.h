@@ -28,10 +28,15 @@
 // Constants
 //
 
-// Evaluation intervals
-#define ENV_TASK_EVAL_MSEC       100
-#define ENV_TASK_READ_T_H_MSEC   2000
-#define ENV_TASK_READ_DIST_MSEC  500
+// Evaluation intervals.  Each sensor is read at its READ interval while its readings
+// change and backs off, doubling the interval each time, towards its MAX interval while
+// they are stable.  The MAX interval is used while ambient correction is disabled since
+// the readings are then only informational.
+#define ENV_TASK_EVAL_MSEC           100
+#define ENV_TASK_READ_T_H_MSEC       2000
+#define ENV_TASK_READ_T_H_MAX_MSEC   16000
+#define ENV_TASK_READ_DIST_MSEC      500
+#define ENV_TASK_READ_DIST_MAX_MSEC  4000
 
 
 
@@ -0,0 +1,170 @@
+/*
+ * On-device benchmark
+ *
+ * Collects the times measured by the tasks that take part in a benchmark run started with
+ * CMD_CTRL_ACT_BENCHMARK.  t1c_task times the Tiny1C interfaces and scaling over a series
+ * of frames, file_task the save renderer, jpeg codec and SD card and, on iCam, gui_task the
+ * GUI renderer at each magnification.  The results of the last run are kept for
+ * CMD_BENCHMARK.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#include "bench_utilities.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+
+
+//
+// Bench Utilities typedefs
+//
+typedef struct {
+	uint32_t count;
+	uint32_t min_usec;
+	uint32_t max_usec;
+	uint64_t sum_usec;
+} bench_item_t;
+
+
+
+//
+// Bench Utilities variables
+//
+static const char* TAG = "bench_utilities";
+
+static const char* item_names[BENCH_NUM_ITEMS] = {
+	"SPI read", "CCI read", "Scale", "Render 0.5x", "Render 1x", "Render 1.5x", "Render 2x",
+	"File render", "JPEG encode", "JPEG decode", "SD write"
+};
+
+// Items are recorded by several tasks and read by the command handler
+static portMUX_TYPE bench_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool bench_is_running = false;
+static bench_item_t bench_items[BENCH_NUM_ITEMS];
+
+
+
+//
+// Bench Utilities API
+//
+
+/**
+ * Start a benchmark run, clearing the results of the last one.  Returns false if one
+ * is already running.
+ */
+bool bench_start()
+{
+	bool started = false;
+	
+	portENTER_CRITICAL(&bench_mux);
+	if (!bench_is_running) {
+		memset(bench_items, 0, sizeof(bench_items));
+		bench_is_running = true;
+		started = true;
+	}
+	portEXIT_CRITICAL(&bench_mux);
+	
+	return started;
+}
+
+
+/**
+ * End the benchmark run and log its results
+ */
+void bench_finish()
+{
+	int i;
+	bench_stats_t stats;
+	
+	portENTER_CRITICAL(&bench_mux);
+	bench_is_running = false;
+	portEXIT_CRITICAL(&bench_mux);
+	
+	for (i=0; i<BENCH_NUM_ITEMS; i++) {
+		bench_get_stats(i, &stats);
+		if (stats.count != 0) {
+			ESP_LOGI(TAG, "%-12s %7lu %7lu %7lu uSec (%lu)", item_names[i], stats.min_usec, stats.avg_usec, stats.max_usec, stats.count);
+		}
+	}
+}
+
+
+bool bench_running()
+{
+	return bench_is_running;
+}
+
+
+/**
+ * Record the time since start_usec (from bench_begin) for item
+ */
+void bench_end(int item, int64_t start_usec)
+{
+	int64_t d = esp_timer_get_time() - start_usec;
+	
+	bench_record(item, (d > UINT32_MAX) ? UINT32_MAX : (uint32_t) d);
+}
+
+
+void bench_record(int item, uint32_t usec)
+{
+	bench_item_t* itemP;
+	
+	if ((item < 0) || (item >= BENCH_NUM_ITEMS)) return;
+	itemP = &bench_items[item];
+	
+	portENTER_CRITICAL(&bench_mux);
+	if ((itemP->count == 0) || (usec < itemP->min_usec)) itemP->min_usec = usec;
+	if (usec > itemP->max_usec) itemP->max_usec = usec;
+	itemP->sum_usec += usec;
+	itemP->count += 1;
+	portEXIT_CRITICAL(&bench_mux);
+}
+
+
+/**
+ * Get the statistics for an item from the last (or current) run.  All values are 0 if
+ * it wasn't run.
+ */
+void bench_get_stats(int item, bench_stats_t* stats)
+{
+	bench_item_t cur;
+	
+	memset(stats, 0, sizeof(bench_stats_t));
+	if ((item < 0) || (item >= BENCH_NUM_ITEMS)) return;
+	
+	portENTER_CRITICAL(&bench_mux);
+	cur = bench_items[item];
+	portEXIT_CRITICAL(&bench_mux);
+	
+	if (cur.count == 0) return;
+	
+	stats->count = cur.count;
+	stats->min_usec = cur.min_usec;
+	stats->avg_usec = (uint32_t) (cur.sum_usec / cur.count);
+	stats->max_usec = cur.max_usec;
+}
+
+
+const char* bench_get_item_name(int item)
+{
+	if ((item < 0) || (item >= BENCH_NUM_ITEMS)) return "";
+	
+	return item_names[item];
+}
@@ -0,0 +1,93 @@
+/*
+ * On-device benchmark
+ *
+ * Collects the times measured by the tasks that take part in a benchmark run started with
+ * CMD_CTRL_ACT_BENCHMARK.  t1c_task times the Tiny1C interfaces and scaling over a series
+ * of frames, file_task the save renderer, jpeg codec and SD card and, on iCam, gui_task the
+ * GUI renderer at each magnification.  The results of the last run are kept for
+ * CMD_BENCHMARK.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef BENCH_UTILITIES_H
+#define BENCH_UTILITIES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_timer.h"
+
+
+
+//
+// Bench Utilities constants
+//
+
+// Benchmark items (CMD_BENCHMARK order)
+#define BENCH_ITEM_SPI_READ     0   // t1c_task: read a frame over VOSPI
+#define BENCH_ITEM_CCI          1   // t1c_task: read a parameter over CCI
+#define BENCH_ITEM_SCALE        2   // t1c_task: Y16 to Y8 scaling
+#define BENCH_ITEM_RENDER_0_5   3   // gui_task: GUI renderer at each magnification (iCam)
+#define BENCH_ITEM_RENDER_1_0   4
+#define BENCH_ITEM_RENDER_1_5   5
+#define BENCH_ITEM_RENDER_2_0   6
+#define BENCH_ITEM_FILE_RENDER  7   // file_task: render a frame for saving
+#define BENCH_ITEM_JPEG_ENC     8   // file_task: encode a rendered frame
+#define BENCH_ITEM_JPEG_DEC     9   // file_task: decode the encoded frame
+#define BENCH_ITEM_SD_WRITE     10  // file_task: write CMD_BENCH_SD_WRITE_LEN bytes to the card
+#define BENCH_NUM_ITEMS         11
+
+// Frames t1c_task times
+#define BENCH_T1C_FRAMES        32
+
+// Number of times each processing kernel is run
+#define BENCH_ITERATIONS        8
+
+// Number of SD card writes
+#define BENCH_SD_WRITES         4
+
+
+
+//
+// Bench Utilities typedefs
+//
+typedef struct {
+	uint32_t count;
+	uint32_t min_usec;
+	uint32_t avg_usec;
+	uint32_t max_usec;
+} bench_stats_t;
+
+
+
+//
+// Bench Utilities API
+//
+bool bench_start();
+void bench_finish();
+bool bench_running();
+void bench_end(int item, int64_t start_usec);
+void bench_record(int item, uint32_t usec);
+void bench_get_stats(int item, bench_stats_t* stats);
+const char* bench_get_item_name(int item);
+
+// Get the start time of an item to pass to bench_end
+static inline int64_t bench_begin()
+{
+	return esp_timer_get_time();
+}
+
+#endif /* BENCH_UTILITIES_H */
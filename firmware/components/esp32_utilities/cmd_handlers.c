@@ -19,25 +19,32 @@
 #include <arpa/inet.h>
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "bench_utilities.h"
 #include "cmd_handlers.h"
 #include "cmd_utilities.h"
 #include "falcon_cmd.h"
 #include "file_task.h"
+#include "mon_task.h"
 #include "out_state_utilities.h"
 #include "palettes.h"
+#include "perf_utilities.h"
 #include "ps_utilities.h"
 #include "sys_info.h"
 #include "sys_utilities.h"
 #include "time_utilities.h"
 #include "tiny1c.h"
+#include "t1c_agc.h"
+#include "t1c_y8_filter.h"
 #include "t1c_task.h"
 #include <string.h>
 
 #ifdef CONFIG_BUILD_ICAM_MINI
 	#include "ctrl_task.h"
 	#include "web_task.h"
+	#include "wifi_utilities.h"
 #else
 	#include "gcore_task.h"
 	#include "gui_task.h"
@@ -50,6 +57,13 @@
 
 // These must match code below and in gui response handler and sender
 #define CMD_AMBIENT_CORRECT_LEN 18
+#define CMD_BENCHMARK_LEN       (CMD_BENCH_NUM_ITEMS*CMD_BENCH_ITEM_LEN)
+#define CMD_DEAD_PIXELS_LEN     (CMD_DPC_HDR_LEN + CMD_DPC_MAX_POINTS*CMD_DPC_POINT_LEN)
+#define CMD_FRAME_STATS_LEN     (4*(4 + 2*T1C_NUM_CONSUMERS))
+#define CMD_LINK_STATS_LEN      (CMD_LINK_HDR_LEN + WEB_MAX_CLIENTS*CMD_LINK_CLIENT_LEN)
+#define CMD_PERF_STATS_LEN      (CMD_PERF_NUM_STAGES*CMD_PERF_STAGE_LEN)
+#define CMD_ROI_TABLE_PTS_LEN   (4 + 4*T1C_ROI_MAX_SPOTS + 8*T1C_ROI_MAX_RECTS + 8*T1C_ROI_MAX_LINES)
+#define CMD_ROI_TABLE_LEN       (CMD_ROI_TABLE_PTS_LEN + T1C_ROI_MAX_SPOTS + T1C_ROI_MAX_RECTS + T1C_ROI_MAX_LINES)
 #define CMD_SHUTTER_INFO_LEN    13
 #define CMD_TIME_LEN            36
 #define CMD_TIMELAPSE_LEN       10
@@ -63,11 +77,40 @@
 static const char* TAG = "cmd_handlers";
 
 // Notification state for our controlling task
-static bool stream_enable_flag = false;
+static int stream_mode = CMD_STREAM_OFF;
+static int stream_decimation = 1;
+static uint16_t stream_x1 = 0;
+static uint16_t stream_y1 = 0;
+static uint16_t stream_w = T1C_WIDTH;
+static uint16_t stream_h = T1C_HEIGHT;
 static bool notify_take_picture = false;
+static int sub_mask = 0;
+static uint16_t* replay_frame_bufP = NULL;     // Host replay frame being loaded (NULL when dropped)
 
 // Statically allocated big data structures used by functions below to save stack space
 static uint8_t send_buf[CMD_WIFI_INFO_LEN];     // Sized for the largest packet type we send
+static uint8_t telem_buf[CMD_TELEM_MAX_LEN];    // Except telemetry
+
+_Static_assert(CMD_PERF_STATS_LEN <= CMD_WIFI_INFO_LEN, "send_buf too small for perf stats");
+_Static_assert(CMD_PERF_NUM_STAGES == PERF_NUM_STAGES, "CMD_PERF_NUM_STAGES mismatch");
+_Static_assert(CMD_BENCHMARK_LEN <= CMD_WIFI_INFO_LEN, "send_buf too small for benchmark results");
+_Static_assert(CMD_BENCH_NUM_ITEMS == BENCH_NUM_ITEMS, "CMD_BENCH_NUM_ITEMS mismatch");
+_Static_assert(CMD_PICTURE_AVG_MAX == T1C_PICTURE_AVG_MAX, "CMD_PICTURE_AVG_MAX mismatch");
+_Static_assert(CMD_ROI_TABLE_LEN <= CMD_WIFI_INFO_LEN, "send_buf too small for roi table");
+_Static_assert(CMD_DEAD_PIXELS_LEN <= CMD_WIFI_INFO_LEN, "send_buf too small for dead pixels");
+_Static_assert((CMD_DPC_MAX_POINTS == T1C_DPC_MAX_POINTS) && (CMD_DPC_DETECT_FRAMES == T1C_DPC_DETECT_FRAMES),
+               "CMD_DPC_xxx mismatch");
+_Static_assert((CMD_DPC_ST_DETECT == T1C_DPC_ST_DETECT) && (CMD_DPC_ST_FAILED == T1C_DPC_ST_FAILED),
+               "CMD_DPC_ST_xxx mismatch");
+_Static_assert((CMD_SPATIAL_OUT_GUI == T1C_Y8F_OUT_GUI) && (CMD_SPATIAL_OUT_VID == T1C_Y8F_OUT_VID) &&
+               (CMD_SPATIAL_OUT_SAVE == T1C_Y8F_OUT_SAVE), "CMD_SPATIAL_OUT_xxx mismatch");
+_Static_assert((CMD_CHG_ANY == T1C_CHG_ANY) && (CMD_CHG_WARMER == T1C_CHG_WARMER) &&
+               (CMD_CHG_COOLER == T1C_CHG_COOLER), "CMD_CHG_xxx mismatch");
+_Static_assert((CMD_CHG_THRESH_MIN == T1C_CHG_THRESH_MIN) && (CMD_CHG_THRESH_MAX == T1C_CHG_THRESH_MAX),
+               "CMD_CHG_THRESH_xxx mismatch");
+#ifdef CONFIG_BUILD_ICAM_MINI
+_Static_assert(CMD_LINK_STATS_LEN <= CMD_WIFI_INFO_LEN, "send_buf too small for link stats");
+#endif
 static net_config_t orig_net_config;
 static net_config_t new_net_config;
 static t1c_config_t t1c_config;
@@ -84,6 +127,14 @@ static bool net_config_structs_eq(net_config_t* s1, net_config_t* s2);
 //
 // API
 //
+void cmd_handler_get_agc_mode(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if (!cmd_send_int32(CMD_RSP, CMD_AGC_MODE, (int32_t) out_state.agc_mode)) {
+		ESP_LOGE(TAG, "Couldn't send agc_mode");
+	}
+}
+
+
 void cmd_handler_get_ambient_correct(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	// Pack the byte array - the response handler must unpack in the same order
@@ -124,6 +175,28 @@ void cmd_handler_get_batt_level(cmd_data_t data_type, uint32_t len, uint8_t* dat
 }
 
 
+void cmd_handler_get_benchmark(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	bench_stats_t stats;
+	uint8_t* bufP = send_buf;
+	
+	// Pack the byte array: count, min, avg, max for each item
+	for (i=0; i<CMD_BENCH_NUM_ITEMS; i++) {
+		bench_get_stats(i, &stats);
+		*(uint32_t*)&bufP[0] = htonl(stats.count);
+		*(uint32_t*)&bufP[4] = htonl(stats.min_usec);
+		*(uint32_t*)&bufP[8] = htonl(stats.avg_usec);
+		*(uint32_t*)&bufP[12] = htonl(stats.max_usec);
+		bufP += CMD_BENCH_ITEM_LEN;
+	}
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_BENCHMARK, CMD_BENCHMARK_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send benchmark results");
+	}
+}
+
+
 void cmd_handler_get_brightness(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_BRIGHTNESS, (int32_t) out_state.brightness)) {
@@ -140,6 +213,41 @@ void cmd_handler_get_card_present(cmd_data_t data_type, uint32_t len, uint8_t* d
 }
 
 
+void cmd_handler_get_change_detect(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	// Pack the byte array - the response handler must unpack in the same order
+	*(uint16_t*)&send_buf[0] = htons((uint16_t) out_state.chg_mode);
+	*(uint16_t*)&send_buf[2] = htons((uint16_t) out_state.chg_thresh);
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_CHANGE_DETECT, CMD_CHANGE_DETECT_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send change detect");
+	}
+}
+
+
+void cmd_handler_get_dead_pixels(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	t1c_dpc_status_t dpc;
+	uint8_t* bufP = &send_buf[CMD_DPC_HDR_LEN];
+	
+	t1c_get_dpc_status(&dpc);
+	
+	// Pack the byte array: header then x, y for each point
+	send_buf[0] = (uint8_t) dpc.state;
+	send_buf[1] = (uint8_t) dpc.progress;
+	*(uint16_t*)&send_buf[2] = htons((uint16_t) dpc.num_points);
+	for (int i=0; i<dpc.num_points; i++) {
+		*(uint16_t*)&bufP[0] = htons(dpc.points[i].x);
+		*(uint16_t*)&bufP[2] = htons(dpc.points[i].y);
+		bufP += CMD_DPC_POINT_LEN;
+	}
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_DEAD_PIXELS, CMD_DPC_HDR_LEN + dpc.num_points*CMD_DPC_POINT_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send dead pixels");
+	}
+}
+
+
 void cmd_handler_get_emissivity(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_EMISSIVITY, (int32_t) out_state.emissivity)) {
@@ -162,6 +270,33 @@ void cmd_handler_get_file_catalog(cmd_data_t data_type, uint32_t len, uint8_t* d
 }
 
 
+void cmd_handler_get_file_catalog_page(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int type, offset, count;
+	
+	if (data_type == CMD_DATA_BINARY) {
+		if (cmd_decode_catalog_page_request(len, data, &type, &offset, &count)) {
+			file_set_catalog_page(type, offset, count);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_GET_PAGE_MASK, eSetBits);
+		}
+	}
+}
+
+
+void cmd_handler_get_file_catalog_range(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t start, end;
+	int offset;
+	
+	if (data_type == CMD_DATA_BINARY) {
+		if (cmd_decode_catalog_range_request(len, data, &start, &end, &offset)) {
+			file_set_catalog_range(start, end, offset);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_GET_RANGE_MASK, eSetBits);
+		}
+	}
+}
+
+
 void cmd_handler_get_file_image(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	int d, f;
@@ -176,14 +311,125 @@ void cmd_handler_get_file_image(cmd_data_t data_type, uint32_t len, uint8_t* dat
 }
 
 
+void cmd_handler_get_file_jpeg(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int d, f;
+	
+	if (data_type == CMD_DATA_INT32) {
+		if (cmd_decode_file_indicies(len, data, &d, &f)) {
+			// Set the file info and request file_task to read the file as-is
+			file_set_image_fileinfo(d, f);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_GET_JPEG_MASK, eSetBits);
+		}
+	}
+}
+
+
+void cmd_handler_get_file_thumb(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int d, f;
+	
+	if (data_type == CMD_DATA_INT32) {
+		if (cmd_decode_file_indicies(len, data, &d, &f)) {
+			// Set the file info and request file_task to get the file's thumbnail
+			file_set_image_fileinfo(d, f);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_GET_THUMB_MASK, eSetBits);
+		}
+	}
+}
+
+
+void cmd_handler_get_frame_stats(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	t1c_frame_stats_t stats;
+	
+	t1c_get_frame_stats(&stats);
+	
+	// Pack the byte array: frames, sensor_skipped, consumed[GUI, VID, WEB], dropped[GUI, VID, WEB],
+	// vospi_bad, vospi_freq_khz
+	*(uint32_t*)&send_buf[0] = htonl(stats.frames);
+	*(uint32_t*)&send_buf[4] = htonl(stats.sensor_skipped);
+	for (i=0; i<T1C_NUM_CONSUMERS; i++) {
+		*(uint32_t*)&send_buf[8 + 4*i] = htonl(stats.consumed[i]);
+		*(uint32_t*)&send_buf[8 + 4*(T1C_NUM_CONSUMERS + i)] = htonl(stats.dropped[i]);
+	}
+	*(uint32_t*)&send_buf[8 + 8*T1C_NUM_CONSUMERS] = htonl(stats.vospi_bad);
+	*(uint32_t*)&send_buf[12 + 8*T1C_NUM_CONSUMERS] = htonl(stats.vospi_freq_khz);
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_FRAME_STATS, CMD_FRAME_STATS_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send frame stats");
+	}
+}
+
+
 void cmd_handler_get_gain(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
-	if (!cmd_send_int32(CMD_RSP, CMD_GAIN, (int32_t) out_state.high_gain)) {
+	int32_t t;
+	
+	if (out_state.auto_gain_en) {
+		t = CMD_GAIN_AUTO;
+	} else {
+		t = out_state.high_gain ? CMD_GAIN_HIGH : CMD_GAIN_LOW;
+	}
+	
+	if (!cmd_send_int32(CMD_RSP, CMD_GAIN, t)) {
 		ESP_LOGE(TAG, "Couldn't send high_gain");
 	}
 }
 
 
+#ifdef CONFIG_BUILD_ICAM_MINI
+void cmd_handler_get_link_stats(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int8_t rssi;
+	web_link_stats_t stats;
+	uint8_t* bufP = &send_buf[CMD_LINK_HDR_LEN];
+	
+	if (!wifi_get_rssi(&rssi)) rssi = 0;
+	web_get_link_stats(&stats);
+	
+	// Pack the byte array: header then bytes/sec, fps, rate, send avg, send max, frames,
+	// failures for each client
+	send_buf[0] = (uint8_t) rssi;
+	send_buf[1] = (uint8_t) stats.num_clients;
+	*(uint16_t*)&send_buf[2] = 0;
+	for (int i=0; i<stats.num_clients; i++) {
+		*(uint32_t*)&bufP[0] = htonl(stats.clients[i].bytes_per_sec);
+		*(uint16_t*)&bufP[4] = htons((uint16_t) stats.clients[i].fps_x10);
+		*(uint16_t*)&bufP[6] = htons((uint16_t) stats.clients[i].rate_x10);
+		*(uint32_t*)&bufP[8] = htonl(stats.clients[i].send_avg_usec);
+		*(uint32_t*)&bufP[12] = htonl(stats.clients[i].send_max_usec);
+		*(uint32_t*)&bufP[16] = htonl(stats.clients[i].frames);
+		*(uint32_t*)&bufP[20] = htonl(stats.clients[i].failures);
+		bufP += CMD_LINK_CLIENT_LEN;
+	}
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_LINK_STATS, CMD_LINK_HDR_LEN + stats.num_clients*CMD_LINK_CLIENT_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send link stats");
+	}
+}
+
+
+void cmd_handler_get_mcast_stream(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int format;
+	int decimation;
+	uint32_t group = inet_addr(CMD_MCAST_GROUP);   // Already in network byte order
+	
+	web_get_mcast_stream(&format, &decimation);
+	send_buf[0] = (uint8_t) format;
+	send_buf[1] = (uint8_t) decimation;
+	*(uint16_t*)&send_buf[2] = htons(CMD_MCAST_PORT);
+	memcpy(&send_buf[4], &group, 4);
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_MCAST_STREAM, CMD_MCAST_STREAM_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send mcast stream");
+	}
+}
+#endif
+
+
 void cmd_handler_get_min_max_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_MIN_MAX_EN, (int32_t) out_state.min_max_mrk_enable)) {
@@ -200,6 +446,85 @@ void cmd_handler_get_palette(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_get_palette_stops(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	palette_stop_t stops[PALETTE_MAX_STOPS];
+	int n;
+	
+	n = get_custom_palette_stops(stops);
+	for (int i=0; i<n; i++) {
+		send_buf[i*CMD_PALETTE_STOP_LEN + 0] = stops[i].pos;
+		send_buf[i*CMD_PALETTE_STOP_LEN + 1] = stops[i].r;
+		send_buf[i*CMD_PALETTE_STOP_LEN + 2] = stops[i].g;
+		send_buf[i*CMD_PALETTE_STOP_LEN + 3] = stops[i].b;
+	}
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_PALETTE_STOPS, n*CMD_PALETTE_STOP_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send palette stops");
+	}
+}
+
+
+void cmd_handler_get_palette_threshold(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint16_t t;
+	bool below;
+	
+	get_threshold_palette(&t, &below);
+	*(uint16_t*)&send_buf[0] = htons(t);
+	*(uint16_t*)&send_buf[2] = htons(below ? CMD_PAL_THRESH_BELOW : CMD_PAL_THRESH_ABOVE);
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_PALETTE_THRESHOLD, CMD_PALETTE_THRESH_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send palette threshold");
+	}
+}
+
+
+void cmd_handler_get_perf_stats(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	perf_stats_t stats;
+	uint8_t* bufP = send_buf;
+	
+	// Pack the byte array: count, min, avg, p99, max for each stage
+	for (i=0; i<CMD_PERF_NUM_STAGES; i++) {
+		perf_get_stats(i, &stats);
+		*(uint32_t*)&bufP[0] = htonl(stats.count);
+		*(uint32_t*)&bufP[4] = htonl(stats.min_usec);
+		*(uint32_t*)&bufP[8] = htonl(stats.avg_usec);
+		*(uint32_t*)&bufP[12] = htonl(stats.p99_usec);
+		*(uint32_t*)&bufP[16] = htonl(stats.max_usec);
+		bufP += CMD_PERF_STAGE_LEN;
+	}
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_PERF_STATS, CMD_PERF_STATS_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send perf stats");
+	}
+}
+
+
+void cmd_handler_get_picture_avg(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if (!cmd_send_int32(CMD_RSP, CMD_PICTURE_AVG, (int32_t) t1c_get_picture_avg())) {
+		ESP_LOGE(TAG, "Couldn't send picture average");
+	}
+}
+
+
+void cmd_handler_get_ping(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_BINARY) && (len == 4)) {
+		// Echo the client's time followed by ours
+		memcpy(&send_buf[0], data, 4);
+		*(uint32_t*)&send_buf[4] = htonl((uint32_t) (esp_timer_get_time() / 1000));
+		
+		if (!cmd_send_binary(CMD_RSP, CMD_PING, CMD_PING_LEN, send_buf)) {
+			ESP_LOGE(TAG, "Couldn't send ping");
+		}
+	}
+}
+
+
 void cmd_handler_get_region_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_REGION_EN, (int32_t) out_state.region_enable)) {
@@ -208,6 +533,88 @@ void cmd_handler_get_region_enable(cmd_data_t data_type, uint32_t len, uint8_t*
 }
 
 
+void cmd_handler_get_replay(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int32_t src;
+	
+	switch (t1c_get_replay_source()) {
+		case T1C_REPLAY_FILE:
+			src = CMD_REPLAY_FILE;
+			break;
+		case T1C_REPLAY_HOST:
+			src = CMD_REPLAY_HOST;
+			break;
+		default:
+			src = CMD_REPLAY_OFF;
+	}
+	
+	if (!cmd_send_int32(CMD_RSP, CMD_REPLAY, src)) {
+		ESP_LOGE(TAG, "Couldn't send replay");
+	}
+}
+
+
+void cmd_handler_get_replay_rate(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if (!cmd_send_int32(CMD_RSP, CMD_REPLAY_RATE, (int32_t) file_get_replay_rate())) {
+		ESP_LOGE(TAG, "Couldn't send replay rate");
+	}
+}
+
+
+void cmd_handler_get_roi_table(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	uint8_t* dP = &send_buf[4];
+	t1c_roi_table_t roi;
+	
+	t1c_get_roi_table(&roi);
+	
+	// Pack the byte array: num_spots, num_rects, num_lines, reserved followed by all spot
+	// {x, y}, rect {x1, y1}, {x2, y2} and line {x1, y1}, {x2, y2} entries and then the spot,
+	// rect and line emissivities (percent, 0 for the global emissivity).  Unused entries are 0.
+	send_buf[0] = roi.num_spots;
+	send_buf[1] = roi.num_rects;
+	send_buf[2] = roi.num_lines;
+	send_buf[3] = 0;
+	for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+		*(uint32_t*)dP = htonl((i < roi.num_spots) ? ((roi.spot_points[i].x << 16) | roi.spot_points[i].y) : 0);
+		dP += 4;
+	}
+	for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+		*(uint32_t*)dP = htonl((i < roi.num_rects) ? ((roi.rect_points[i].start_point.x << 16) | roi.rect_points[i].start_point.y) : 0);
+		*(uint32_t*)(dP+4) = htonl((i < roi.num_rects) ? ((roi.rect_points[i].end_point.x << 16) | roi.rect_points[i].end_point.y) : 0);
+		dP += 8;
+	}
+	for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+		*(uint32_t*)dP = htonl((i < roi.num_lines) ? ((roi.line_points[i].start_point.x << 16) | roi.line_points[i].start_point.y) : 0);
+		*(uint32_t*)(dP+4) = htonl((i < roi.num_lines) ? ((roi.line_points[i].end_point.x << 16) | roi.line_points[i].end_point.y) : 0);
+		dP += 8;
+	}
+	for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+		*dP++ = (i < roi.num_spots) ? roi.spot_emissivity[i] : 0;
+	}
+	for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+		*dP++ = (i < roi.num_rects) ? roi.rect_emissivity[i] : 0;
+	}
+	for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+		*dP++ = (i < roi.num_lines) ? roi.line_emissivity[i] : 0;
+	}
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_ROI_TABLE, CMD_ROI_TABLE_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send roi table");
+	}
+}
+
+
+void cmd_handler_get_save_format(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if (!cmd_send_int32(CMD_RSP, CMD_SAVE_FORMAT, (int32_t) out_state.save_format)) {
+		ESP_LOGE(TAG, "Couldn't send save format");
+	}
+}
+
+
 void cmd_handler_get_save_ovl_en(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_SAVE_OVL_EN, (int32_t) out_state.save_ovl_en)) {
@@ -230,6 +637,18 @@ void cmd_handler_get_shutter(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_get_spatial_filter(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	// Pack the byte array - the response handler must unpack in the same order
+	send_buf[0] = (uint8_t) out_state.y8_filt_mode;
+	send_buf[1] = (uint8_t) out_state.y8_filt_outputs;
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_SPATIAL_FILTER, CMD_SPATIAL_FILTER_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send spatial filter");
+	}
+}
+
+
 void cmd_handler_get_spot_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_SPOT_EN, (int32_t) out_state.spotmeter_enable)) {
@@ -246,6 +665,17 @@ void cmd_handler_get_sys_info(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_get_telemetry(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t telem_len;
+	
+	telem_len = mon_get_telemetry(telem_buf);
+	if (!cmd_send_binary(CMD_RSP, CMD_TELEMETRY, telem_len, telem_buf)) {
+		ESP_LOGE(TAG, "Couldn't send telemetry");
+	}
+}
+
+
 void cmd_handler_get_time(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	// Get the current time
@@ -268,6 +698,33 @@ void cmd_handler_get_time(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_get_tnr(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if (!cmd_send_int32(CMD_RSP, CMD_TNR, (int32_t) out_state.tnr_level)) {
+		ESP_LOGE(TAG, "Couldn't send tnr_level");
+	}
+}
+
+
+#ifdef CONFIG_BUILD_ICAM_MINI
+void cmd_handler_get_udp_stream(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint16_t port;
+	int format;
+	int decimation;
+	
+	web_get_udp_stream(&port, &format, &decimation);
+	*(uint16_t*)&send_buf[0] = htons(port);
+	send_buf[2] = (uint8_t) format;
+	send_buf[3] = (uint8_t) decimation;
+	
+	if (!cmd_send_binary(CMD_RSP, CMD_UDP_STREAM, CMD_UDP_STREAM_LEN, send_buf)) {
+		ESP_LOGE(TAG, "Couldn't send udp stream");
+	}
+}
+#endif
+
+
 void cmd_handler_get_units(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (!cmd_send_int32(CMD_RSP, CMD_UNITS, (int32_t) out_state.temp_unit_C)) {
@@ -303,6 +760,23 @@ void cmd_handler_get_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_set_agc_mode(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t t;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		t = ntohl(*((uint32_t*) &data[0]));
+		if (t < T1C_AGC_NUM_MODES) {
+			out_state.agc_mode = t;
+			out_state_save();
+			
+			// Update t1c_task
+			t1c_set_agc_mode((int) t);
+		}
+	}
+}
+
+
 void cmd_handler_set_ambient_correct(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if ((data_type == CMD_DATA_BINARY) && (len == CMD_AMBIENT_CORRECT_LEN)) {
@@ -350,6 +824,41 @@ void cmd_handler_set_brightness(cmd_data_t data_type, uint32_t len, uint8_t* dat
 }
 
 
+void cmd_handler_set_burst(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int n;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		n = (int) ntohl(*((uint32_t*) &data[0]));
+		
+		// Setup the burst and let file_task start it
+		if ((n > 0) && (n <= CMD_BURST_MAX_FRAMES)) {
+			file_set_burst_info(n);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_BURST_MASK, eSetBits);
+		}
+	}
+}
+
+
+void cmd_handler_set_change_detect(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint16_t mode, thresh;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_CHANGE_DETECT_LEN)) {
+		mode = ntohs(*((uint16_t*) &data[0]));
+		thresh = ntohs(*((uint16_t*) &data[2]));
+		if ((mode < T1C_CHG_NUM_MODES) && (thresh >= T1C_CHG_THRESH_MIN) && (thresh <= T1C_CHG_THRESH_MAX)) {
+			out_state.chg_mode = mode;
+			out_state.chg_thresh = thresh;
+			out_state_save();
+			
+			// Update t1c_task
+			t1c_set_change_detect((int) mode, thresh);
+		}
+	}
+}
+
+
 void cmd_handler_set_ctrl_activity(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if ((data_type == CMD_DATA_BINARY) && (len == 8)) {
@@ -388,6 +897,40 @@ void cmd_handler_set_ctrl_activity(cmd_data_t data_type, uint32_t len, uint8_t*
 				// Notify the file_task to format the card.  It'll let the output task know success/fail
 				xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_FORMAT_MASK, eSetBits);
 				break;
+				
+			case CMD_CTRL_ACT_BENCHMARK:
+				// Notify t1c_task to start the benchmark.  It hands off to file_task (which
+				// hands off to gui_task on iCam) and the last one lets the output task know
+				// success/fail
+				xTaskNotify(task_handle_t1c, T1C_NOTIFY_BENCHMARK_MASK, eSetBits);
+				break;
+				
+			case CMD_CTRL_ACT_TINY1C_FW_UPD:
+				// Notify file_task to read the firmware file.  It hands the file to t1c_task
+				// which lets the output task know success/fail and then shuts down
+				xTaskNotify(task_handle_file, FILE_NOTIFY_T1C_FW_UPD_MASK, eSetBits);
+				break;
+		}
+	}
+}
+
+
+void cmd_handler_set_dead_pixels(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t t;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		t = ntohl(*((uint32_t*) &data[0]));
+		switch (t) {
+			case CMD_DPC_DETECT:
+				xTaskNotify(task_handle_t1c, T1C_NOTIFY_DPC_DETECT_MASK, eSetBits);
+				break;
+			case CMD_DPC_APPLY:
+				xTaskNotify(task_handle_t1c, T1C_NOTIFY_DPC_APPLY_MASK, eSetBits);
+				break;
+			case CMD_DPC_CLEAR:
+				xTaskNotify(task_handle_t1c, T1C_NOTIFY_DPC_CLEAR_MASK, eSetBits);
+				break;
 		}
 	}
 }
@@ -422,15 +965,9 @@ void cmd_handler_set_file_delete(cmd_data_t data_type, uint32_t len, uint8_t* da
 	
 	if (data_type == CMD_DATA_INT32) {
 		if (cmd_decode_file_indicies(len, data, &d, &f)) {
-			// Setup delete info
-			file_set_delete_file(d, f);
-			
-			if (f == -1) {
-				// Notify file_task to delete directory
-				xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_DEL_DIR_MASK, eSetBits);
-			} else {
-				// Notify file_task to delete file
-				xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_DEL_FILE_MASK, eSetBits);
+			// Queue the directory (f == -1) or file and notify file_task to start deleting
+			if (file_set_delete_file(d, f)) {
+				xTaskNotify(task_handle_file, FILE_NOTIFY_GUI_DELETE_MASK, eSetBits);
 			}
 		}
 	}
@@ -443,17 +980,65 @@ void cmd_handler_set_gain(cmd_data_t data_type, uint32_t len, uint8_t* data)
 	
 	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
 		t = ntohl(*((uint32_t*) &data[0]));
-		out_state.high_gain = (t != 0);
-		out_state_save();
+		if (t == CMD_GAIN_AUTO) {
+			out_state.auto_gain_en = true;
+			out_state_save();
+			
+			// t1c_task takes over the gain
+			t1c_set_auto_gain_enable(true);
+		} else {
+			out_state.auto_gain_en = false;
+			out_state.high_gain = (t != CMD_GAIN_LOW);
+			out_state_save();
+			
+			// Update t1c_task
+			t1c_set_auto_gain_enable(false);
+			if (!t1c_set_param_tpd(TPD_PROP_GAIN_SEL, out_state.high_gain ? 1 : 0)) {
+				ESP_LOGE(TAG, "Failed to set gain mode");
+			}
+		}
+	}
+}
+
+
+void cmd_handler_set_log(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int rate;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		rate = (int) ntohl(*((uint32_t*) &data[0]));
 		
-		// Update t1c_task
-		if (!t1c_set_param_tpd(TPD_PROP_GAIN_SEL, out_state.high_gain ? 1 : 0)) {
-			ESP_LOGE(TAG, "Failed to set gain mode");
+		// Setup the log and let file_task start or stop it
+		if ((rate >= 0) && (rate <= CMD_LOG_MAX_RATE)) {
+			file_set_log_info(rate);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_LOG_MASK, eSetBits);
 		}
 	}
 }
 
 
+#ifdef CONFIG_BUILD_ICAM_MINI
+void cmd_handler_set_mcast_stream(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int format;
+	int decimation;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_MCAST_SET_LEN)) {
+		if ((data[0] == CMD_STREAM_Y8) || (data[0] == CMD_STREAM_Y16)) {
+			format = data[0];
+		} else {
+			format = CMD_STREAM_OFF;
+		}
+		decimation = data[1];
+		if (decimation < 1) decimation = 1;
+		if (decimation > CMD_UDP_MAX_DECIMATION) decimation = CMD_UDP_MAX_DECIMATION;
+		
+		web_set_mcast_stream(format, decimation);
+	}
+}
+#endif
+
+
 void cmd_handler_set_min_max_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -493,6 +1078,52 @@ void cmd_handler_set_palette(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_set_palette_stops(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	palette_stop_t stops[PALETTE_MAX_STOPS];
+	int n = len / CMD_PALETTE_STOP_LEN;
+	
+	if ((data_type == CMD_DATA_BINARY) && ((len % CMD_PALETTE_STOP_LEN) == 0) && (n <= PALETTE_MAX_STOPS)) {
+		for (int i=0; i<n; i++) {
+			stops[i].pos = data[i*CMD_PALETTE_STOP_LEN + 0];
+			stops[i].r = data[i*CMD_PALETTE_STOP_LEN + 1];
+			stops[i].g = data[i*CMD_PALETTE_STOP_LEN + 2];
+			stops[i].b = data[i*CMD_PALETTE_STOP_LEN + 3];
+		}
+		if (!set_custom_palette_stops(n, stops)) {
+			ESP_LOGE(TAG, "Illegal palette stops");
+		}
+	}
+}
+
+
+void cmd_handler_set_palette_threshold(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint16_t t;
+	uint16_t mode;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_PALETTE_THRESH_LEN)) {
+		t = ntohs(*((uint16_t*) &data[0]));
+		mode = ntohs(*((uint16_t*) &data[2]));
+		set_threshold_palette(t, mode == CMD_PAL_THRESH_BELOW);
+	}
+}
+
+
+void cmd_handler_set_picture_avg(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int n;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		n = (int) ntohl(*((uint32_t*) &data[0]));
+		
+		if ((n >= 1) && (n <= CMD_PICTURE_AVG_MAX)) {
+			t1c_set_picture_avg(n);
+		}
+	}
+}
+
+
 void cmd_handler_set_poweroff(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if (data_type == CMD_DATA_NONE) {
@@ -520,6 +1151,20 @@ void cmd_handler_set_save_backlight(cmd_data_t data_type, uint32_t len, uint8_t*
 }
 
 
+void cmd_handler_set_save_format(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t t;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		t = ntohl(*((uint32_t*) &data[0]));
+		if (t < CMD_SAVE_FMT_NUM) {
+			out_state.save_format = t;
+			out_state_save();
+		}
+	}
+}
+
+
 void cmd_handler_set_save_ovl_en(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -546,6 +1191,37 @@ void cmd_handler_set_save_palette(cmd_data_t data_type, uint32_t len, uint8_t* d
 }
 
 
+void cmd_handler_set_pre_trigger(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int n;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		n = (int) ntohl(*((uint32_t*) &data[0]));
+		
+		if ((n >= 0) && (n < CMD_BURST_MAX_FRAMES)) {
+			file_set_pre_trigger_info(n);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_PRE_TRIGGER_MASK, eSetBits);
+		}
+	}
+}
+
+
+void cmd_handler_set_record(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int fps;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		fps = (int) ntohl(*((uint32_t*) &data[0]));
+		
+		// Setup the recording and let file_task start or stop it
+		if ((fps >= 0) && (fps <= CMD_RECORD_MAX_FPS)) {
+			file_set_record_info(fps);
+			xTaskNotify(task_handle_file, FILE_NOTIFY_RECORD_MASK, eSetBits);
+		}
+	}
+}
+
+
 void cmd_handler_set_region_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -571,6 +1247,122 @@ void cmd_handler_set_region_location(cmd_data_t data_type, uint32_t len, uint8_t
 }
 
 
+void cmd_handler_set_replay(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	char dir_name[DIR_NAME_LEN];
+	uint32_t t;
+	
+	if ((data_type == CMD_DATA_STRING) && (len != 0)) {
+		// Let file_task start replaying the named directory
+		if (len > (DIR_NAME_LEN - 1)) len = DIR_NAME_LEN - 1;
+		memcpy(dir_name, data, len);
+		dir_name[len] = '\0';
+		file_set_replay_info(dir_name);
+		xTaskNotify(task_handle_file, FILE_NOTIFY_REPLAY_MASK, eSetBits);
+	} else if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		t = ntohl(*((uint32_t*) &data[0]));
+		if (t == CMD_REPLAY_OFF) {
+			t1c_set_replay_source(T1C_REPLAY_OFF);
+		} else if (t == CMD_REPLAY_HOST) {
+			replay_frame_bufP = NULL;
+			t1c_set_replay_source(T1C_REPLAY_HOST);
+		}
+	}
+}
+
+
+void cmd_handler_set_replay_frame(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	uint8_t* sP = &data[CMD_REPLAY_FRAME_HDR_LEN];
+	uint16_t* dP;
+	uint32_t offset;
+	
+	if ((data_type != CMD_DATA_BINARY) || (len <= CMD_REPLAY_FRAME_HDR_LEN)) return;
+	if (t1c_get_replay_source() != T1C_REPLAY_HOST) return;
+	
+	offset = ntohl(*((uint32_t*) &data[0]));
+	len -= CMD_REPLAY_FRAME_HDR_LEN;
+	if (((offset | len) & 1) || (len > CMD_REPLAY_CHUNK_MAX) || ((offset + len) > T1C_WIDTH*T1C_HEIGHT*2)) return;
+	
+	// The first piece of a frame gets the buffer to load it into (if t1c_task has used the
+	// previous frame)
+	if (offset == 0) {
+		replay_frame_bufP = t1c_get_replay_buffer();
+	}
+	if (replay_frame_bufP == NULL) return;
+	
+	dP = replay_frame_bufP + offset/2;
+	for (i=0; i<len/2; i++) {
+		*dP++ = (sP[0] << 8) | sP[1];
+		sP += 2;
+	}
+	
+	if ((offset + len) == T1C_WIDTH*T1C_HEIGHT*2) {
+		t1c_set_replay_frame_loaded(out_state.high_gain);
+		replay_frame_bufP = NULL;
+	}
+}
+
+
+void cmd_handler_set_replay_rate(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int n;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		n = (int) ntohl(*((uint32_t*) &data[0]));
+		
+		if ((n >= 0) && (n <= CMD_REPLAY_MAX_FPS)) {
+			file_set_replay_rate(n);
+		}
+	}
+}
+
+
+void cmd_handler_set_roi_table(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	uint32_t t;
+	uint8_t* dP = &data[4];
+	t1c_roi_table_t roi;
+	
+	// Tables without emissivities (CMD_ROI_TABLE_PTS_LEN) use the global emissivity
+	if ((data_type == CMD_DATA_BINARY) && ((len == CMD_ROI_TABLE_LEN) || (len == CMD_ROI_TABLE_PTS_LEN))) {
+		// Unpack the byte array in the same order the get command packed it
+		roi.num_spots = data[0];
+		roi.num_rects = data[1];
+		roi.num_lines = data[2];
+		for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+			t = ntohl(*((uint32_t*) dP));
+			roi.spot_points[i].x = t >> 16;
+			roi.spot_points[i].y = t & 0x0000FFFF;
+			dP += 4;
+		}
+		for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+			(void) cmd_decode_marker_location(8, dP, &roi.rect_points[i].start_point.x, &roi.rect_points[i].start_point.y,
+			                                  &roi.rect_points[i].end_point.x, &roi.rect_points[i].end_point.y);
+			dP += 8;
+		}
+		for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+			(void) cmd_decode_marker_location(8, dP, &roi.line_points[i].start_point.x, &roi.line_points[i].start_point.y,
+			                                  &roi.line_points[i].end_point.x, &roi.line_points[i].end_point.y);
+			dP += 8;
+		}
+		for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+			roi.spot_emissivity[i] = (len == CMD_ROI_TABLE_LEN) ? *dP++ : 0;
+		}
+		for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+			roi.rect_emissivity[i] = (len == CMD_ROI_TABLE_LEN) ? *dP++ : 0;
+		}
+		for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+			roi.line_emissivity[i] = (len == CMD_ROI_TABLE_LEN) ? *dP++ : 0;
+		}
+		
+		t1c_set_roi_table(&roi);
+	}
+}
+
+
 void cmd_handler_set_shutter(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {	
 	if ((data_type == CMD_DATA_BINARY) && (len == CMD_SHUTTER_INFO_LEN)) {
@@ -613,6 +1405,21 @@ void cmd_handler_set_shutter(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_set_spatial_filter(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_SPATIAL_FILTER_LEN)) {
+		if (data[0] < T1C_Y8F_NUM_MODES) {
+			out_state.y8_filt_mode = data[0];
+			out_state.y8_filt_outputs = data[1] & T1C_Y8F_OUT_MASK;
+			out_state_save();
+			
+			// Update t1c_task
+			t1c_set_y8_filter((int) out_state.y8_filt_mode, (uint8_t) out_state.y8_filt_outputs);
+		}
+	}
+}
+
+
 void cmd_handler_set_spot_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -644,7 +1451,55 @@ void cmd_handler_set_stream_enable(cmd_data_t data_type, uint32_t len, uint8_t*
 	
 	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
 		t = ntohl(*((uint32_t*) &data[0]));
-		stream_enable_flag = (t != 0);
+		stream_mode = (t <= CMD_STREAM_Y16_DELTA) ? (int) t : CMD_STREAM_Y8;
+		
+		// Consumers only read frames while streaming so restart drop accounting
+		t1c_reset_frame_consumers();
+	}
+}
+
+
+void cmd_handler_set_stream_view(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int dec;
+	uint16_t x1, y1, x2, y2;
+	
+	if ((data_type == CMD_DATA_BINARY) && cmd_decode_stream_view(len, data, &dec, &x1, &y1, &x2, &y2)) {
+		if ((dec != 2) && (dec != 4)) dec = 1;
+		
+		// Clamp the region to the image, falling back to the full image if it is invalid
+		if (x2 >= T1C_WIDTH) x2 = T1C_WIDTH - 1;
+		if (y2 >= T1C_HEIGHT) y2 = T1C_HEIGHT - 1;
+		if ((x1 > x2) || (y1 > y2)) {
+			x1 = 0;
+			y1 = 0;
+			x2 = T1C_WIDTH - 1;
+			y2 = T1C_HEIGHT - 1;
+		}
+		
+		// Align the region to the decimation (the image dimensions are multiples of 4)
+		x1 -= x1 % dec;
+		y1 -= y1 % dec;
+		stream_w = (x2 - x1 + 1) / dec;
+		stream_h = (y2 - y1 + 1) / dec;
+		if (stream_w == 0) stream_w = 1;
+		if (stream_h == 0) stream_h = 1;
+		stream_x1 = x1;
+		stream_y1 = y1;
+		stream_decimation = dec;
+	}
+}
+
+
+void cmd_handler_set_subscribe(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		sub_mask = (int) ntohl(*((uint32_t*) &data[0])) & ((1 << CMD_SUB_NUM) - 1);
+		
+		// Respond with the current values
+		if (sub_mask & CMD_SUB_BATT_LEVEL) cmd_handler_get_batt_level(CMD_DATA_NONE, 0, NULL);
+		if (sub_mask & CMD_SUB_CARD_PRESENT) cmd_handler_get_card_present(CMD_DATA_NONE, 0, NULL);
+		if (sub_mask & CMD_SUB_SHUTTER_INFO) cmd_handler_get_shutter(CMD_DATA_NONE, 0, NULL);
 	}
 }
 
@@ -657,6 +1512,14 @@ void cmd_handler_set_take_picture(cmd_data_t data_type, uint32_t len, uint8_t* d
 }
 
 
+void cmd_handler_set_telemetry(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		mon_set_telemetry_period((int) ntohl(*((uint32_t*) &data[0])));
+	}
+}
+
+
 void cmd_handler_set_time(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if ((data_type == CMD_DATA_BINARY) && (len == CMD_TIME_LEN)) {
@@ -683,9 +1546,9 @@ void cmd_handler_set_timelapse_cfg(cmd_data_t data_type, uint32_t len, uint8_t*
 	uint32_t num;
 	
 	if ((data_type == CMD_DATA_BINARY) && (len == CMD_TIMELAPSE_LEN)) {
-		en = ntohl(*((uint32_t*) &data[0])) != 0;
-		notify = ntohl(*((uint32_t*) &data[1])) != 0;
-		interval = ntohl(*((uint32_t*) &data[2]));
+		en = data[0] != 0;
+		notify = data[1] != 0;
+		interval = ntohl(*((uint32_t*) &data[2]));  // mSec
 		num = ntohl(*((uint32_t*) &data[6]));
 		
 		// Set the parameters
@@ -694,6 +1557,65 @@ void cmd_handler_set_timelapse_cfg(cmd_data_t data_type, uint32_t len, uint8_t*
 }
 
 
+void cmd_handler_set_tnr(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t t;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		t = ntohl(*((uint32_t*) &data[0]));
+		if (t < T1C_TNR_NUM_LEVELS) {
+			out_state.tnr_level = t;
+			out_state_save();
+			
+			// Update t1c_task
+			t1c_set_tnr_level((int) t);
+		}
+	}
+}
+
+
+void cmd_handler_set_trigger_cfg(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	file_trigger_config_t cfg;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_TRIGGER_CFG_LEN)) {
+		cfg.mode = data[0];
+		cfg.action = data[1];
+		cfg.pre_frames = data[2];
+		cfg.record_fps = data[3];
+		cfg.post = ntohl(*((uint32_t*) &data[4]));
+		cfg.threshold = ntohl(*((uint32_t*) &data[8]));
+		cfg.holdoff_msec = ntohl(*((uint32_t*) &data[12]));
+		
+		// Set the parameters and let file_task arm or disarm the trigger
+		file_set_trigger_info(&cfg);
+		xTaskNotify(task_handle_file, FILE_NOTIFY_TRIGGER_MASK, eSetBits);
+	}
+}
+
+
+#ifdef CONFIG_BUILD_ICAM_MINI
+void cmd_handler_set_udp_stream(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint16_t port;
+	int format;
+	int decimation;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_UDP_STREAM_LEN)) {
+		port = ntohs(*((uint16_t*) &data[0]));
+		format = (data[2] == CMD_STREAM_Y16) ? CMD_STREAM_Y16 : CMD_STREAM_Y8;
+		decimation = data[3];
+		if (decimation < 1) decimation = 1;
+		if (decimation > CMD_UDP_MAX_DECIMATION) decimation = CMD_UDP_MAX_DECIMATION;
+		
+		if (!web_set_udp_stream(port, format, decimation)) {
+			ESP_LOGE(TAG, "Couldn't start udp stream");
+		}
+	}
+}
+#endif
+
+
 void cmd_handler_set_units(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -729,8 +1651,9 @@ void cmd_handler_set_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data)
 		for (i=0; i<4; i++) new_net_config.sta_netmask[i] = data[n++];
 		
 		if (!net_config_structs_eq(&orig_net_config, &new_net_config)) {
-			// Update PS if changed
+			// Update PS if changed (immediately since the network will be restarted)
 			ps_set_config(PS_CONFIG_TYPE_NET, &new_net_config);
+			(void) ps_flush_config(true);
 			
 #ifdef CONFIG_BUILD_ICAM_MINI
 			// Notify ctrl_task to restart the network
@@ -743,7 +1666,31 @@ void cmd_handler_set_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data)
 
 bool cmd_handler_stream_enabled()
 {
-	return stream_enable_flag;
+	return (stream_mode != CMD_STREAM_OFF);
+}
+
+
+int cmd_handler_stream_mode()
+{
+	return stream_mode;
+}
+
+
+// Returns the mask of CMD_SUB_xxx items clients have subscribed to
+int cmd_handler_subscriptions()
+{
+	return sub_mask;
+}
+
+
+// Returns the stream view region's top left (full resolution) and size (decimated pixels)
+void cmd_handler_stream_view(int* decimation, uint16_t* x1, uint16_t* y1, uint16_t* w, uint16_t* h)
+{
+	*decimation = stream_decimation;
+	*x1 = stream_x1;
+	*y1 = stream_y1;
+	*w = stream_w;
+	*h = stream_h;
 }
 
 
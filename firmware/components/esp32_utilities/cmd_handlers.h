@@ -28,54 +28,104 @@
 //
 // API
 //
+void cmd_handler_get_agc_mode(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_ambient_correct(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_backlight(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_batt_level(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_benchmark(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_brightness(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_card_present(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_change_detect(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_dead_pixels(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_emissivity(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_file_catalog(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_file_catalog_page(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_file_catalog_range(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_file_image(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_file_jpeg(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_file_thumb(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_frame_stats(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_gain(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_link_stats(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_mcast_stream(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_min_max_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_palette(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_palette_stops(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_palette_threshold(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_perf_stats(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_picture_avg(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_ping(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_region_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_replay(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_replay_rate(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_roi_table(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_save_format(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_save_ovl_en(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_shutter(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_spatial_filter(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_spot_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_sys_info(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_telemetry(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_time(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_tnr(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_get_udp_stream(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_units(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_get_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data);
 
+void cmd_handler_set_agc_mode(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_ambient_correct(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_backlight(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_brightness(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_burst(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_change_detect(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_ctrl_activity(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_dead_pixels(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_emissivity(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_ffc(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_file_delete(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_gain(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_log(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_mcast_stream(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_min_max_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_palette(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_palette_stops(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_palette_threshold(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_poweroff(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_save_backlight(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_save_format(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_save_ovl_en(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_orientation(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_save_palette(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_picture_avg(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_pre_trigger(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_record(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_region_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_region_location(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_replay(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_replay_frame(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_replay_rate(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_roi_table(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_shutter(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_spatial_filter(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_spot_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_spot_location(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_stream_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_stream_view(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_subscribe(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_take_picture(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_telemetry(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_time(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_timelapse_cfg(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_tnr(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_trigger_cfg(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_udp_stream(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_units(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data);
 
 bool cmd_handler_stream_enabled();
+int cmd_handler_stream_mode();
+void cmd_handler_stream_view(int* decimation, uint16_t* x1, uint16_t* y1, uint16_t* w, uint16_t* h);
+int cmd_handler_subscriptions();
 bool cmd_handler_take_picture_notification();
 
 #endif /* CMD_HANDLERS_H */
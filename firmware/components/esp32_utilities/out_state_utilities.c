@@ -50,11 +50,14 @@ void out_state_init()
 	(void) ps_get_config(PS_CONFIG_TYPE_OUT, &out_config);
 
 	out_state.auto_ffc_en = t1c_config.auto_ffc_en;
+	out_state.auto_gain_en = t1c_config.auto_gain_en;
 	out_state.high_gain = t1c_config.high_gain;
 	out_state.is_portrait = false;  // Will be set by output_task
 	out_state.min_max_mrk_enable = (out_config.config_flags & PS_EN_FLAG_MINMAX_MRK) != 0;
 	out_state.min_max_tmp_enable = (out_config.config_flags & PS_EN_FLAG_MINMAX_TMP) != 0;
 	out_state.output_mode_PAL = (out_config.config_flags & PS_EN_FLAG_VID_IS_PAL) != 0;
+	out_state.output_scaled = (out_config.config_flags & PS_EN_FLAG_VID_SCALED) != 0;
+	out_state.output_color = (out_config.config_flags & PS_EN_FLAG_VID_COLOR) != 0;
 	out_state.refl_equals_ambient = t1c_config.refl_equals_ambient;
 	out_state.region_enable = false; // Region always starts out disabled
 	out_state.save_ovl_en = (out_config.config_flags & PS_EN_FLAG_SAVE_OVL) != 0;
@@ -65,6 +68,13 @@ void out_state_init()
 	out_state.gui_palette_index = out_config.gui_palette_index;
 	out_state.sav_palette_index = out_config.sav_palette_index;
 	out_state.vid_palette_index = out_config.vid_palette_index;
+	out_state.agc_mode = out_config.agc_mode;
+	out_state.save_format = out_config.save_format;
+	out_state.tnr_level = out_config.tnr_level;
+	out_state.y8_filt_mode = out_config.y8_filt_mode;
+	out_state.y8_filt_outputs = out_config.y8_filt_outputs;
+	out_state.chg_mode = out_config.chg_mode;
+	out_state.chg_thresh = out_config.chg_thresh;
 
 	out_state.atmospheric_temp = t1c_config.atmospheric_temp;
 	out_state.brightness = t1c_config.brightness;
@@ -95,6 +105,10 @@ void out_state_save()
 		t1c_parm_changed = true;
 		t1c_config.high_gain = out_state.high_gain;
 	}
+	if (out_state.auto_gain_en != t1c_config.auto_gain_en) {
+		t1c_parm_changed = true;
+		t1c_config.auto_gain_en = out_state.auto_gain_en;
+	}
 	if (out_state.use_auto_ambient != t1c_config.use_auto_ambient) {
 		t1c_parm_changed = true;
 		t1c_config.use_auto_ambient = out_state.use_auto_ambient;
@@ -153,6 +167,34 @@ void out_state_save()
 		gui_parm_changed = true;
 		out_config.vid_palette_index = out_state.vid_palette_index;
 	}
+	if (out_state.agc_mode != out_config.agc_mode) {
+		gui_parm_changed = true;
+		out_config.agc_mode = out_state.agc_mode;
+	}
+	if (out_state.save_format != out_config.save_format) {
+		gui_parm_changed = true;
+		out_config.save_format = out_state.save_format;
+	}
+	if (out_state.tnr_level != out_config.tnr_level) {
+		gui_parm_changed = true;
+		out_config.tnr_level = out_state.tnr_level;
+	}
+	if (out_state.y8_filt_mode != out_config.y8_filt_mode) {
+		gui_parm_changed = true;
+		out_config.y8_filt_mode = out_state.y8_filt_mode;
+	}
+	if (out_state.y8_filt_outputs != out_config.y8_filt_outputs) {
+		gui_parm_changed = true;
+		out_config.y8_filt_outputs = out_state.y8_filt_outputs;
+	}
+	if (out_state.chg_mode != out_config.chg_mode) {
+		gui_parm_changed = true;
+		out_config.chg_mode = out_state.chg_mode;
+	}
+	if (out_state.chg_thresh != out_config.chg_thresh) {
+		gui_parm_changed = true;
+		out_config.chg_thresh = out_state.chg_thresh;
+	}
 	if (out_state.lcd_brightness != out_config.lcd_brightness) {
 		gui_parm_changed = true;
 		out_config.lcd_brightness = out_state.lcd_brightness;
@@ -197,6 +239,22 @@ void out_state_save()
 			out_config.config_flags &= ~PS_EN_FLAG_VID_IS_PAL;
 		}
 	}
+	if (out_state.output_scaled != ((out_config.config_flags & PS_EN_FLAG_VID_SCALED) != 0)) {
+		gui_parm_changed = true;
+		if (out_state.output_scaled) {
+			out_config.config_flags |= PS_EN_FLAG_VID_SCALED;
+		} else {
+			out_config.config_flags &= ~PS_EN_FLAG_VID_SCALED;
+		}
+	}
+	if (out_state.output_color != ((out_config.config_flags & PS_EN_FLAG_VID_COLOR) != 0)) {
+		gui_parm_changed = true;
+		if (out_state.output_color) {
+			out_config.config_flags |= PS_EN_FLAG_VID_COLOR;
+		} else {
+			out_config.config_flags &= ~PS_EN_FLAG_VID_COLOR;
+		}
+	}
 	if (out_state.save_ovl_en != ((out_config.config_flags & PS_EN_FLAG_SAVE_OVL) != 0)) {
 		gui_parm_changed = true;
 		if (out_state.save_ovl_en) {
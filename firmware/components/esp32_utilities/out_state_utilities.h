@@ -30,11 +30,14 @@
 // Output module state
 typedef struct {
 	bool auto_ffc_en;                 // Automatic Shutter control enable
+	bool auto_gain_en;                // Automatic gain switching enable
 	bool high_gain;                   // Tiny1C gain
 	bool is_portrait;                 // Output display landscape = 0, portrait = 1 (set by output task)
 	bool min_max_mrk_enable;          // Min/Max Marker control
 	bool min_max_tmp_enable;          // Min/Max Temp display control
 	bool output_mode_PAL;             // Only used for video output
+	bool output_scaled;               // Only used for video output (scale to fill raster)
+	bool output_color;                // Only used for video output (save palette in color)
 	bool refl_equals_ambient;         // Use the ambient temp for reflected temp
 	bool region_enable;               // Region marker control
 	bool save_ovl_en;                 // Save Overlay info on picture enable
@@ -44,6 +47,13 @@ typedef struct {
 	uint32_t gui_palette_index;       // Used for LVGL output
 	uint32_t sav_palette_index;       // Used for saving to file output
 	uint32_t vid_palette_index;       // Used for video output
+	uint32_t agc_mode;                // Y16 to Y8 scaling mode
+	uint32_t save_format;             // Saved image file format
+	uint32_t tnr_level;               // Temporal noise reduction level
+	uint32_t y8_filt_mode;            // Spatial filter mode
+	uint32_t y8_filt_outputs;         // Outputs using the spatial filter
+	uint32_t chg_mode;                // Change detection mode
+	uint32_t chg_thresh;              // Change detection threshold
 	int32_t atmospheric_temp;
 	uint32_t brightness;
 	uint32_t distance;
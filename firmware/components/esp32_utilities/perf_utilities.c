@@ -0,0 +1,147 @@
+/*
+ * Frame pipeline profiler
+ *
+ * Records how long each stage of the image pipeline takes for every frame in a ring of
+ * recent samples per stage so the min, average, 99th percentile and max times can be
+ * reported at any time (over the command interface and in the system information).  It is
+ * cheap enough to always be enabled.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "perf_utilities.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+
+//
+// Perf Utilities typedefs
+//
+typedef struct {
+	uint32_t count;
+	uint32_t samples[PERF_RING_LEN];
+} perf_ring_t;
+
+
+
+//
+// Perf Utilities variables
+//
+static const char* stage_names[PERF_NUM_STAGES] = {
+	"Acquire", "Scale", "CCI", "Render", "Serialize", "Send", "Save"
+};
+
+// Stages are recorded by several tasks (and a httpd callback) and read by the command handler
+static portMUX_TYPE perf_mux = portMUX_INITIALIZER_UNLOCKED;
+static perf_ring_t perf_rings[PERF_NUM_STAGES];
+
+// Sort buffer for perf_get_stats (only called by the command handler task)
+static uint32_t sort_buf[PERF_RING_LEN];
+
+
+
+//
+// Forward declarations for internal functions
+//
+static int _compare_u32(const void* a, const void* b);
+
+
+
+//
+// Perf Utilities API
+//
+
+/**
+ * Record the time since start_usec (from perf_start) for stage
+ */
+void perf_end(int stage, int64_t start_usec)
+{
+	int64_t d = esp_timer_get_time() - start_usec;
+	
+	perf_record(stage, (d > UINT32_MAX) ? UINT32_MAX : (uint32_t) d);
+}
+
+
+/**
+ * Record a sample for stage
+ */
+void perf_record(int stage, uint32_t usec)
+{
+	perf_ring_t* ringP;
+	
+	if ((stage < 0) || (stage >= PERF_NUM_STAGES)) return;
+	ringP = &perf_rings[stage];
+	
+	portENTER_CRITICAL(&perf_mux);
+	ringP->samples[ringP->count % PERF_RING_LEN] = usec;
+	ringP->count += 1;
+	portEXIT_CRITICAL(&perf_mux);
+}
+
+
+/**
+ * Get the statistics for the recent samples of a stage.  All times are 0 if it hasn't
+ * been recorded yet.
+ */
+void perf_get_stats(int stage, perf_stats_t* stats)
+{
+	int i, n;
+	uint64_t sum = 0;
+	
+	memset(stats, 0, sizeof(perf_stats_t));
+	if ((stage < 0) || (stage >= PERF_NUM_STAGES)) return;
+	
+	portENTER_CRITICAL(&perf_mux);
+	stats->count = perf_rings[stage].count;
+	n = (stats->count < PERF_RING_LEN) ? stats->count : PERF_RING_LEN;
+	memcpy(sort_buf, perf_rings[stage].samples, n * sizeof(uint32_t));
+	portEXIT_CRITICAL(&perf_mux);
+	
+	if (n == 0) return;
+	
+	qsort(sort_buf, n, sizeof(uint32_t), _compare_u32);
+	for (i=0; i<n; i++) {
+		sum += sort_buf[i];
+	}
+	stats->min_usec = sort_buf[0];
+	stats->avg_usec = (uint32_t) (sum / n);
+	stats->p99_usec = sort_buf[(99 * n - 1) / 100];
+	stats->max_usec = sort_buf[n - 1];
+}
+
+
+const char* perf_get_stage_name(int stage)
+{
+	if ((stage < 0) || (stage >= PERF_NUM_STAGES)) return "";
+	
+	return stage_names[stage];
+}
+
+
+
+//
+// Internal functions
+//
+static int _compare_u32(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*) a;
+	uint32_t y = *(const uint32_t*) b;
+	
+	return (x > y) - (x < y);
+}
@@ -0,0 +1,80 @@
+/*
+ * Frame pipeline profiler
+ *
+ * Records how long each stage of the image pipeline takes for every frame in a ring of
+ * recent samples per stage so the min, average, 99th percentile and max times can be
+ * reported at any time (over the command interface and in the system information).  It is
+ * cheap enough to always be enabled.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef PERF_UTILITIES_H
+#define PERF_UTILITIES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_timer.h"
+
+
+
+//
+// Perf Utilities constants
+//
+
+// Pipeline stages (CMD_PERF_STATS order)
+#define PERF_STAGE_ACQUIRE    0   // t1c_task: read a frame over VOSPI
+#define PERF_STAGE_SCALE      1   // t1c_task: Y16 to Y8 scaling
+#define PERF_STAGE_CCI        2   // t1c_task: CCI commands and measurements between frames
+#define PERF_STAGE_RENDER     3   // vid_task / gui_task: render a frame for display
+#define PERF_STAGE_SERIALIZE  4   // web_task: encode a frame into an image packet
+#define PERF_STAGE_SEND       5   // web_task: send an image packet to a client
+#define PERF_STAGE_SAVE       6   // file_task: encode and queue a saved image
+#define PERF_NUM_STAGES       7
+
+// Number of recent samples kept for each stage
+#define PERF_RING_LEN         128
+
+
+
+//
+// Perf Utilities typedefs
+//
+typedef struct {
+	uint32_t count;           // Samples since boot
+	uint32_t min_usec;        // Over the recent samples
+	uint32_t avg_usec;
+	uint32_t p99_usec;
+	uint32_t max_usec;
+} perf_stats_t;
+
+
+
+//
+// Perf Utilities API
+//
+void perf_end(int stage, int64_t start_usec);
+void perf_record(int stage, uint32_t usec);
+void perf_get_stats(int stage, perf_stats_t* stats);
+const char* perf_get_stage_name(int stage);
+
+// Get the start time of a stage to pass to perf_end
+static inline int64_t perf_start()
+{
+	return esp_timer_get_time();
+}
+
+#endif /* PERF_UTILITIES_H */
@@ -24,6 +24,8 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include <stdlib.h>
@@ -60,6 +62,13 @@ static const char* config_keys[PS_NUM_CONFIGS] = {"net_key", "t1c_key", "out_key
 static const size_t config_data_len[PS_NUM_CONFIGS] = {sizeof(net_config_t), sizeof(t1c_config_t), sizeof(out_config_t)};
 static uint8_t* config_data[PS_NUM_CONFIGS];
 
+// Deferred writes - config_data and the dirty state are protected by ps_mux since they are
+// updated by the command handlers and written to NVS by the task calling ps_flush_config
+static portMUX_TYPE ps_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool config_dirty[PS_NUM_CONFIGS];
+static int64_t config_change_usec[PS_NUM_CONFIGS];
+static uint8_t* flush_buf;
+
 
 //
 // PS Utilities Forward Declarations for internal functions
@@ -157,7 +166,9 @@ bool ps_get_config(int index, void* cfg)
 {
 	if ((index >=0) && (index < PS_NUM_CONFIGS)) {
 		// Give them our local copy
+		portENTER_CRITICAL(&ps_mux);
 		(void) memcpy(cfg,  config_data[index], config_data_len[index]);
+		portEXIT_CRITICAL(&ps_mux);
 		return true;
 	} else {
 		ESP_LOGE(TAG, "Requested read of illegal config index %d", index);
@@ -166,17 +177,19 @@ bool ps_get_config(int index, void* cfg)
 }
 
 
+/**
+ * Update our local copy.  NVS is updated by ps_flush_config once the config has stopped
+ * changing for PS_WRITE_DELAY_MSEC so a series of changes (e.g. sliding a control) only
+ * causes one flash write.
+ */
 bool ps_set_config(int index, void* cfg)
 {
 	if ((index >=0) && (index < PS_NUM_CONFIGS)) {
-		// Update our local copy
+		portENTER_CRITICAL(&ps_mux);
 		(void) memcpy(config_data[index], cfg, config_data_len[index]);
-		
-		// Update NVS
-		if (!_ps_write_config_info(index, config_data[index])) {
-			ESP_LOGE(TAG, "Failed to save %s config to NVS storage", config_keys[index]);
-			return false;
-		}
+		config_dirty[index] = true;
+		config_change_usec[index] = esp_timer_get_time();
+		portEXIT_CRITICAL(&ps_mux);
 		
 		return true;
 	} else {
@@ -201,7 +214,10 @@ bool ps_reinit_all()
 bool ps_reinit_config(int index)
 {
 	if ((index >=0) && (index < PS_NUM_CONFIGS)) {
-		// Reset default values to our local copy
+		// Reset default values to our local copy (superseding any deferred write)
+		portENTER_CRITICAL(&ps_mux);
+		config_dirty[index] = false;
+		portEXIT_CRITICAL(&ps_mux);
 		_ps_init_config_memory(index);
 		
 		// Update NVS
@@ -218,6 +234,49 @@ bool ps_reinit_config(int index)
 }
 
 
+/**
+ * Write changed configs to NVS.  Called periodically by a housekeeping task with
+ * force false to write configs that have stopped changing and with force true to
+ * write all changes immediately before a shutdown or restart.  Returns false if any
+ * write failed (the config will be retried on the next call).
+ */
+bool ps_flush_config(bool force)
+{
+	bool do_write;
+	bool success = true;
+	int64_t cur_usec = esp_timer_get_time();
+	
+	for (int i=0; i<PS_NUM_CONFIGS; i++) {
+		// Take a snapshot of a pending config so we can write it without blocking updates
+		portENTER_CRITICAL(&ps_mux);
+		do_write = config_dirty[i] &&
+		           (force || ((cur_usec - config_change_usec[i]) >= (PS_WRITE_DELAY_MSEC * 1000)));
+		if (do_write) {
+			(void) memcpy(flush_buf, config_data[i], config_data_len[i]);
+			config_dirty[i] = false;
+		}
+		portEXIT_CRITICAL(&ps_mux);
+		
+		if (do_write) {
+			if (!_ps_write_config_info(i, flush_buf)) {
+				ESP_LOGE(TAG, "Failed to save %s config to NVS storage", config_keys[i]);
+				
+				// Try again later unless it has been changed again in the meantime
+				portENTER_CRITICAL(&ps_mux);
+				if (!config_dirty[i]) {
+					config_dirty[i] = true;
+					config_change_usec[i] = cur_usec;
+				}
+				portEXIT_CRITICAL(&ps_mux);
+				success = false;
+			}
+		}
+	}
+	
+	return success;
+}
+
+
 bool ps_has_new_cam_name(const char* name)
 {
 	net_config_t* net_configP;
@@ -229,6 +288,48 @@ bool ps_has_new_cam_name(const char* name)
 }
 
 
+/**
+ * Caches hold data other subsystems derive at runtime and want to keep across restarts
+ * (they aren't configuration and aren't reset by ps_reinit_xxx).  The owner defines and
+ * validates the contents.  Returns false if there is no cache of exactly len bytes.
+ */
+bool ps_get_cache(const char* key, void* buf, size_t len)
+{
+	size_t read_len = len;
+	
+	if (nvs_get_blob(ps_handle, key, buf, &read_len) != ESP_OK) {
+		return false;
+	}
+	
+	return (read_len == len);
+}
+
+
+bool ps_set_cache(const char* key, const void* buf, size_t len)
+{
+	esp_err_t ret;
+	
+	ret = nvs_set_blob(ps_handle, key, buf, len);
+	if (ret == ESP_OK) {
+		ret = nvs_commit(ps_handle);
+	}
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "Set cache blob %s failed with %d", key, ret);
+		return false;
+	}
+	
+	return true;
+}
+
+
+void ps_clear_cache(const char* key)
+{
+	if (nvs_erase_key(ps_handle, key) == ESP_OK) {
+		(void) nvs_commit(ps_handle);
+	}
+}
+
+
 char ps_nibble_to_ascii(uint8_t n)
 {
 	n = n & 0x0F;
@@ -248,6 +349,7 @@ char ps_nibble_to_ascii(uint8_t n)
 static bool _ps_malloc_local_memory()
 {
 	bool success = true;
+	size_t max_len = 0;
 	
 	// Allocate and zero memory for each config item
 	for (int i=0; i<PS_NUM_CONFIGS; i++) {
@@ -255,6 +357,13 @@ static bool _ps_malloc_local_memory()
 			ESP_LOGE(TAG, "Failed to allocate %d bytes for %s config item", config_data_len[i], config_keys[i]);
 			success = false;
 		}
+		if (config_data_len[i] > max_len) max_len = config_data_len[i];
+	}
+	
+	// Snapshot buffer for deferred writes
+	if ((flush_buf = malloc(max_len)) == NULL) {
+		ESP_LOGE(TAG, "Failed to allocate %d bytes for config flush", max_len);
+		success = false;
 	}
 	
 	return success;
@@ -359,6 +468,7 @@ static void _ps_init_config_memory(int index)
 			
 			t1c_configP->auto_ffc_en = PS_DEF_AUTO_FFC;
 			t1c_configP->high_gain = PS_DEF_HIGH_GAIN;
+			t1c_configP->auto_gain_en = PS_DEF_AUTO_GAIN;
 			t1c_configP->use_auto_ambient = PS_DEF_USE_AUTO;
 			t1c_configP->refl_equals_ambient = PS_DEF_REFL_EQ_AMB;
 			t1c_configP->atmospheric_temp = PS_DEF_ATMOSPHERIC_TEMP;
@@ -380,6 +490,13 @@ static void _ps_init_config_memory(int index)
 			out_configP->sav_palette_index = 0;
 			out_configP->vid_palette_index = 0;
 			out_configP->lcd_brightness = 80;
+			out_configP->agc_mode = PS_DEF_AGC_MODE;
+			out_configP->save_format = PS_DEF_SAVE_FORMAT;
+			out_configP->tnr_level = PS_DEF_TNR_LEVEL;
+			out_configP->y8_filt_mode = PS_DEF_Y8_FILT_MODE;
+			out_configP->y8_filt_outputs = PS_DEF_Y8_FILT_OUTPUTS;
+			out_configP->chg_mode = PS_DEF_CHG_MODE;
+			out_configP->chg_thresh = PS_DEF_CHG_THRESH;
 			break;
 	}
 }
@@ -24,6 +24,7 @@
 #define PS_UTILITIES_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -40,6 +41,9 @@
 #define PS_CONFIG_TYPE_T1C       1
 #define PS_CONFIG_TYPE_OUT       2
 
+// Time a config must be unchanged before a deferred write to NVS
+#define PS_WRITE_DELAY_MSEC      2000
+
 // Net 
 
 // Output module enable flag masks (32-bit flag)
@@ -49,6 +53,8 @@
 #define PS_EN_FLAG_MINMAX_TMP    0x00000008
 #define PS_EN_FLAG_UNITS_METRIC  0x00000010
 #define PS_EN_FLAG_SAVE_OVL      0x00000020
+#define PS_EN_FLAG_VID_SCALED    0x00000040
+#define PS_EN_FLAG_VID_COLOR     0x00000080
 
 // Field lengths
 #define PS_SSID_MAX_LEN          32
@@ -70,6 +76,7 @@
 // Tiny1C configuration
 #define PS_DEF_AUTO_FFC          true
 #define PS_DEF_HIGH_GAIN         true
+#define PS_DEF_AUTO_GAIN         false
 #define PS_DEF_USE_AUTO          false
 #define PS_DEF_REFL_EQ_AMB       false
 #define PS_DEF_ATMOSPHERIC_TEMP  25
@@ -94,6 +101,23 @@
 // Palettes
 #define PS_DEF_PALETTE_INDEX    0
 
+// AGC (T1C_AGC_MODE_LINEAR)
+#define PS_DEF_AGC_MODE         0
+
+// Temporal noise reduction (T1C_TNR_OFF)
+#define PS_DEF_TNR_LEVEL        0
+
+// Spatial filter (T1C_Y8F_MODE_OFF, no outputs)
+#define PS_DEF_Y8_FILT_MODE     0
+#define PS_DEF_Y8_FILT_OUTPUTS  0
+
+// Change detection (T1C_CHG_OFF)
+#define PS_DEF_CHG_MODE         0
+#define PS_DEF_CHG_THRESH       64
+
+// Saved image format (CMD_SAVE_FMT_JPEG)
+#define PS_DEF_SAVE_FORMAT      0
+
 
 
 //
@@ -115,6 +139,7 @@ typedef struct {
 typedef struct {
 	bool auto_ffc_en;                  // Enable automatic FFC
 	bool high_gain;                    // Set for high gain, clear for low gain
+	bool auto_gain_en;                 // Enable automatic gain switching (overrides high_gain)
     bool use_auto_ambient;             // Use ambient values from sensors
     bool refl_equals_ambient;          // Use ambient temp for reflective temp when set
     int32_t atmospheric_temp;          // °C
@@ -134,6 +159,13 @@ typedef struct {
 	uint32_t sav_palette_index;        // Used for save operations with video output
 	uint32_t vid_palette_index;        // Used for GUI with video output
 	uint32_t lcd_brightness;           // 0 - 100, Used for gCore LCD backlight
+	uint32_t agc_mode;                 // T1C_AGC_MODE_xxx, Y16 to Y8 scaling mode
+	uint32_t save_format;              // CMD_SAVE_FMT_xxx, Saved image file format
+	uint32_t tnr_level;                // T1C_TNR_xxx, Temporal noise reduction level
+	uint32_t y8_filt_mode;             // T1C_Y8F_MODE_xxx, Spatial filter mode
+	uint32_t y8_filt_outputs;          // T1C_Y8F_OUT_xxx mask, Outputs using the spatial filter
+	uint32_t chg_mode;                 // T1C_CHG_xxx, Change detection mode
+	uint32_t chg_thresh;               // Y16 counts, Change detection threshold
 } out_config_t;
 
 
@@ -145,7 +177,11 @@ bool ps_get_config(int index, void* cfg);
 bool ps_set_config(int index, void* cfg);
 bool ps_reinit_all();
 bool ps_reinit_config(int index);
+bool ps_flush_config(bool force);
 bool ps_has_new_cam_name(const char* name);
+bool ps_get_cache(const char* key, void* buf, size_t len);
+bool ps_set_cache(const char* key, const void* buf, size_t len);
+void ps_clear_cache(const char* key);
 char ps_nibble_to_ascii(uint8_t n);
 
 #endif /* PS_UTILITIES_H */
\ No newline at end of file
@@ -24,11 +24,16 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "file_utilities.h"
+#include "perf_utilities.h"
 #include "sys_info.h"
 #include "t1c_task.h"
 #include "time_utilities.h"
 #include <string.h>
 
+#ifdef CONFIG_PM_ENABLE
+	#include "esp_pm.h"
+#endif
+
 #ifdef CONFIG_BUILD_ICAM_MINI
 	#include "ctrl_task.h"
 	#include "esp_mac.h"
@@ -37,6 +42,7 @@
 #else
 	#include "gcore.h"
 	#include "gcore_task.h"
+	#include "gui_task.h"
 	#include "power_utilities.h"
 #endif
 
@@ -83,9 +89,12 @@ static int _add_sdk_version(int n);
 static int _add_tiny1c_info(int n);
 static int _add_sensor_info(int n);
 static int _add_battery_info(int n);
+static int _add_power_info(int n);
 static int _add_time(int n);
 static int _add_storage_info(int n);
+static int _add_card_write_info(int n);
 static int _add_mem_info(int n);
+static int _add_perf_info(int n);
 static int _add_copyright_info(int n);
 
 #ifdef CONFIG_BUILD_ICAM_MINI
@@ -94,6 +103,7 @@ static int _add_ip_address(int n);
 static int _add_mac_address(int n);
 #else
 static int _add_gcore_pmic_version(int n);
+static int _add_lvgl_mem_info(int n);
 #endif
 
 
@@ -130,6 +140,7 @@ static void _update_info()
 	n = _add_gcore_pmic_version(n);
 #endif
 	n = _add_battery_info(n);
+	n = _add_power_info(n);
 #ifdef CONFIG_BUILD_ICAM_MINI
 	n = _add_wifi_mode(n);
 	n = _add_ip_address(n);
@@ -137,7 +148,12 @@ static void _update_info()
 #endif
 	n = _add_time(n);
 	n = _add_storage_info(n);
+	n = _add_card_write_info(n);
 	n = _add_mem_info(n);
+#ifndef CONFIG_BUILD_ICAM_MINI
+	n = _add_lvgl_mem_info(n);
+#endif
+	n = _add_perf_info(n);
 	n = _add_copyright_info(n);
 }
 
@@ -175,10 +191,16 @@ static int _add_sdk_version(int n)
 
 static int _add_tiny1c_info(int n)
 {
+	t1c_frame_stats_t stats;
+	
 	sprintf(&cam_info_buf[n], "Tiny1C Version: %s\n", t1c_get_module_version());
 	
 	n = strlen(cam_info_buf);
 	sprintf(&cam_info_buf[n], "Tiny1C Serial Number: %s\n", t1c_get_module_sn());
+	
+	t1c_get_frame_stats(&stats);
+	n = strlen(cam_info_buf);
+	sprintf(&cam_info_buf[n], "VOSPI: %lu kHz, %lu corrupt frames\n", stats.vospi_freq_khz, stats.vospi_bad);
 
 	return (strlen(cam_info_buf));
 }
@@ -219,8 +241,8 @@ static int _add_battery_info(int n)
 	enum CHARGE_STATE_t cs;
 	
 	gcore_get_power_state(&bs, &cs);
-	sprintf(&cam_info_buf[n], "Battery: %1.2fv, %umA, Charge ",
-	       (float) gcore_get_batt_mv() / 1000.0, gcore_get_load_ma());
+	sprintf(&cam_info_buf[n], "Battery: %1.2fv, %umA (avg %umA), Charge ",
+	       (float) gcore_get_batt_mv() / 1000.0, gcore_get_load_ma(), gcore_get_avg_load_ma());
 	n = strlen(cam_info_buf);
 	switch (cs) {
 		case CHARGE_OFF:
@@ -242,6 +264,26 @@ static int _add_battery_info(int n)
 }
 
 
+static int _add_power_info(int n)
+{
+#ifdef CONFIG_PM_ENABLE
+	esp_pm_config_t pm_config;
+	
+	if (esp_pm_get_configuration(&pm_config) == ESP_OK) {
+		sprintf(&cam_info_buf[n], "CPU Clock: %d - %d MHz%s\n", pm_config.min_freq_mhz,
+			pm_config.max_freq_mhz, pm_config.light_sleep_enable ? ", Light Sleep" : "");
+		n = strlen(cam_info_buf);
+	}
+#else
+	sprintf(&cam_info_buf[n], "CPU Clock: %d MHz\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+	n = strlen(cam_info_buf);
+#endif
+	sprintf(&cam_info_buf[n], "Acquisition: %s\n", t1c_is_idle() ? "Throttled" : "Full Rate");
+	
+	return (strlen(cam_info_buf));
+}
+
+
 static int _add_time(int n)
 {
 	char buf[28];
@@ -280,6 +322,48 @@ static int _add_storage_info(int n)
 }
 
 
+static int _add_card_write_info(int n)
+{
+	file_write_stats_t stats;
+	file_op_stats_t* opP;
+	
+	file_get_write_stats(&stats);
+	if (stats.ops[FILE_OP_MOUNT].count == 0) {
+		// No card mounted since it was inserted
+		return n;
+	}
+	
+	sprintf(&cam_info_buf[n], "Card mSec (avg / max):\n");
+	for (int i=0; i<FILE_NUM_OPS; i++) {
+		opP = &stats.ops[i];
+		if (opP->count != 0) {
+			n = strlen(cam_info_buf);
+			sprintf(&cam_info_buf[n], "  %s: %1.1f / %1.1f\n", file_get_op_name(i),
+				(float) opP->total_usec / (1000 * opP->count), (float) opP->max_usec / 1000);
+		}
+	}
+	
+	// Write latency histogram and throughput while writing
+	opP = &stats.ops[FILE_OP_WRITE];
+	if ((opP->count != 0) && (opP->total_usec != 0)) {
+		n = strlen(cam_info_buf);
+		sprintf(&cam_info_buf[n], "  Write KB/sec: %d\n  Write <1..>=256:",
+			(int) (stats.write_bytes * 1000 / opP->total_usec));
+		for (int i=0; i<FILE_LAT_NUM_BINS; i++) {
+			n = strlen(cam_info_buf);
+			sprintf(&cam_info_buf[n], " %lu", opP->bins[i]);
+		}
+		n = strlen(cam_info_buf);
+		sprintf(&cam_info_buf[n], "\n");
+	}
+	
+	n = strlen(cam_info_buf);
+	sprintf(&cam_info_buf[n], "  Stalls >= %d mSec: %lu\n", FILE_STALL_MSEC, stats.stalls);
+	
+	return (strlen(cam_info_buf));
+}
+
+
 static int _add_mem_info(int n)
 {
 	sprintf(&cam_info_buf[n], "Heap Free: Int %d (min %d)\n            PSRAM %d (min %d)\n",
@@ -292,6 +376,25 @@ static int _add_mem_info(int n)
 }
 
 
+static int _add_perf_info(int n)
+{
+	perf_stats_t stats;
+	
+	sprintf(&cam_info_buf[n], "Pipeline mSec (avg / p99 / max):\n");
+	
+	for (int i=0; i<PERF_NUM_STAGES; i++) {
+		perf_get_stats(i, &stats);
+		if (stats.count != 0) {
+			n = strlen(cam_info_buf);
+			sprintf(&cam_info_buf[n], "  %s: %1.1f / %1.1f / %1.1f\n", perf_get_stage_name(i),
+				(float) stats.avg_usec / 1000, (float) stats.p99_usec / 1000, (float) stats.max_usec / 1000);
+		}
+	}
+	
+	return (strlen(cam_info_buf));
+}
+
+
 static int _add_copyright_info(int n)
 {
 	sprintf(&cam_info_buf[n], copyright_info);
@@ -364,4 +467,16 @@ static int _add_gcore_pmic_version(int n)
 	return (strlen(cam_info_buf));
 }
 
+
+static int _add_lvgl_mem_info(int n)
+{
+	gui_mem_info_t info;
+	
+	gui_get_mem_info(&info);
+	sprintf(&cam_info_buf[n], "LVGL Heap: %lu (%u%% used, max %lu)\n           Frag %u%%, largest free %lu\n",
+		info.total_size, info.used_pct, info.max_used, info.frag_pct, info.free_biggest_size);
+	
+	return (strlen(cam_info_buf));
+}
+
 #endif
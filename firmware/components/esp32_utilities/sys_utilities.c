@@ -23,7 +23,11 @@
 #include "ctrl_task.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
+#ifdef CONFIG_PM_ENABLE
+	#include "esp_pm.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "i2cs.h"
@@ -48,6 +52,26 @@
 // System Utilities internal constants
 //
 
+// Image plane placement map (see the IMG_PLANES_INTERNAL Kconfig options).  Planes marked
+// for internal RAM are put there while enough remains free, otherwise in PSRAM.  The
+// palette tables are static and always in internal RAM.
+#ifdef CONFIG_IMG_PLANES_INTERNAL
+	#define PLACE_Y8_INTERNAL     true
+	#ifdef CONFIG_IMG_Y16_PLANES_INTERNAL
+		#define PLACE_Y16_INTERNAL true
+	#else
+		#define PLACE_Y16_INTERNAL false
+	#endif
+	#define INTERNAL_RESERVE_BYTES (CONFIG_IMG_INTERNAL_RESERVE_KB * 1024)
+#else
+	#define PLACE_Y8_INTERNAL     false
+	#define PLACE_Y16_INTERNAL    false
+	#define INTERNAL_RESERVE_BYTES 0
+#endif
+
+// Minimum CPU frequency when power management is enabled
+#define PM_MIN_CPU_FREQ_MHZ    80
+
 
 
 //
@@ -55,18 +79,44 @@
 //
 static const char* TAG = "sys";
 
+// Image plane placement statistics
+static int num_planes_internal = 0;
+static int num_planes_psram = 0;
+
+// Tasks started by system_start_task and their stack sizes (for the memory report)
+static int num_tasks = 0;
+static TaskHandle_t task_handles[SYS_MAX_TASKS];
+static uint32_t task_stack_lens[SYS_MAX_TASKS];
+
+// Boot timeline (time since esp_timer started, 0 for events that haven't happened)
+static int64_t boot_event_usec[SYS_BOOT_NUM_EVENTS];
+static const char* boot_event_name[SYS_BOOT_NUM_EVENTS] = {
+	"ESP32 peripherals initialized",
+	"Tiny1C reset",
+	"Subsystems initialized",
+	"Buffers allocated",
+	"Tasks started",
+	"Catalog built",
+	"Tiny1C ready",
+	"First frame"
+};
+
 
 //
 // Task handle externs for use by tasks to communicate with each other
 //
 #ifdef CONFIG_BUILD_ICAM_MINI
+	TaskHandle_t task_handle_aux = NULL;
 	TaskHandle_t task_handle_ctrl;
 	TaskHandle_t task_handle_env;
 	TaskHandle_t task_handle_file;
+	TaskHandle_t task_handle_mqtt;
+	TaskHandle_t task_handle_sync;
 	TaskHandle_t task_handle_t1c;
 	TaskHandle_t task_handle_vid;
 	TaskHandle_t task_handle_web;
 #else
+	TaskHandle_t task_handle_disp;
 	TaskHandle_t task_handle_env;
 	TaskHandle_t task_handle_file;
 	TaskHandle_t task_handle_gcore;
@@ -74,9 +124,7 @@ static const char* TAG = "sys";
 	TaskHandle_t task_handle_t1c;
 #endif
 
-#ifdef INCLUDE_SYS_MON
 TaskHandle_t task_handle_mon;
-#endif
 
 
 
@@ -85,27 +133,57 @@ TaskHandle_t task_handle_mon;
 //
 
 // Shared memory data structures
-uint16_t* t1c_y16_buffer;         // Holds image read from camera module
+uint16_t* t1c_y16_pool[T1C_Y16_POOL_LEN]; // Pool of image planes read from camera module
+uint8_t* t1c_y8_pool[T1C_Y16_POOL_LEN];   // Paired scaled 8-bit image planes
+uint8_t* t1c_y8f_pool[T1C_Y16_POOL_LEN];  // Paired spatially filtered 8-bit image planes
+uint32_t* t1c_chg_pool[T1C_Y16_POOL_LEN]; // Paired changed pixel masks
 
 t1c_buffer_t out_t1c_buffer[2];     // Ping-pong buffer loaded by t1c_task for the output task
 t1c_buffer_t file_t1c_buffer;       // Buffer loaded by t1c_task for the file task
+#ifdef CONFIG_AUX_UART_ENABLE
+t1c_buffer_t aux_t1c_buffer;        // Buffer loaded by t1c_task for the AUX port task
+#endif
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+t1c_buffer_t mqtt_t1c_buffer;       // Measurements (no image) loaded by t1c_task for the MQTT task
+#endif
 t1c_param_metadata_t file_t1c_meta; // Loaded by t1c_task for the file task
+t1c_buffer_t file_burst_buffer[FILE_BURST_MAX_FRAMES]; // Burst frames copied by t1c_task for the file task
+uint8_t* file_burst_y8;             // Burst frames are scaled into this by the file task
+uint16_t* t1c_replay_buffer[2];     // Replayed frames loaded by file_task or a client for t1c_task
+uint16_t* t1c_tnr_history;          // Temporal noise reduction filter state for t1c_task
+uint32_t* t1c_avg_accum;            // Frame accumulator for averaged pictures taken by t1c_task
+uint32_t* t1c_dpc_accum;            // Per-pixel statistics for dead pixel detection by t1c_task
+uint16_t* t1c_chg_background;       // Change detection background model for t1c_task
 
 #ifdef CONFIG_BUILD_ICAM_MINI
-uint8_t* rend_fbP[2];             // Ping-pong rendering buffers for vid_task
+uint8_t* rend_fbP[VID_NUM_FB];    // Video frame buffers rendered by vid_task
 #endif
 
-uint32_t* rgb_save_image;         // Buffer to render a 24-bit color image into for compression to jpeg
+uint32_t* rgb_save_strip;         // Strip of a 24-bit color image rendered for compression to jpeg
+uint32_t* rgb_save_thumb;         // RGBA thumbnail followed by room for its jpeg encoding
+uint8_t* file_jpeg_slots[FILE_JPEG_NUM_SLOTS]; // Encoded jpeg images waiting to be written to the card
 
 #ifdef CONFIG_BUILD_ICAM_MINI
 uint32_t* rgb_file_image;         // Buffer to render a 24-bit color image to from jpeg decompression
 #else
 uint16_t* rgb_file_image;         // Buffer to render a 16-bit color image to from jpeg decompression
 #endif
+uint8_t* file_prefetch_bufs[FILE_PREFETCH_NUM]; // Browser image cache entries (rgb_file_image sized)
 
 // Pointer to filesystem information structure (catalog)
 void* file_info_bufferP;
 
+// Internal DMA capable buffer image and movie files are written to the card through
+uint8_t* file_write_bufferP;
+
+
+//
+// Forward declarations for internal functions
+//
+static void* _malloc_image_plane(size_t len, bool prefer_internal);
+static void _malloc_prefetch_bufs(size_t len);
+
+
 
 //
 // System Utilities API
@@ -135,13 +213,32 @@ bool system_esp_io_init()
 	}
 #endif
 	
+#ifdef CONFIG_PM_ENABLE
+	// Let the CPU clock drop, and optionally the system light sleep, when no one holds a
+	// lock (t1c_task while handling a frame, the GUI while rendering, video output)
+	esp_pm_config_t pm_config = {
+		.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz = PM_MIN_CPU_FREQ_MHZ,
+#ifdef CONFIG_LIGHT_SLEEP_ENABLE
+		.light_sleep_enable = true
+#else
+		.light_sleep_enable = false
+#endif
+	};
+	ret = esp_pm_configure(&pm_config);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "Power management configuration failed - %d", ret);
+		return false;
+	}
+#endif
+	
 #ifdef BRD_DIAG_IO
 	// Initialize the diagnostic output pin
 	gpio_reset_pin(BRD_DIAG_IO);
 	gpio_set_direction(BRD_DIAG_IO, GPIO_MODE_OUTPUT);
 	gpio_set_level(BRD_DIAG_IO, 0);
 #endif
-
+	
 	return true;
 }
 
@@ -153,6 +250,15 @@ bool system_peripheral_init(bool init_wifi)
 {
 	ESP_LOGI(TAG, "System Peripheral Initialization");
 	
+	// Reset the Tiny1C (and, optionally, and other sensors) first so it boots while the
+	// rest of the system is initialized
+	gpio_set_direction(BRD_SENSOR_RSTN_IO, GPIO_MODE_OUTPUT);
+	gpio_set_level(BRD_SENSOR_RSTN_IO, 0);
+	vTaskDelay(pdMS_TO_TICKS(10));
+	gpio_set_level(BRD_SENSOR_RSTN_IO, 1);
+	gpio_set_direction(BRD_SENSOR_RSTN_IO, GPIO_MODE_INPUT);
+	system_boot_mark(SYS_BOOT_T1C_RESET);
+	
 	time_init();
 	
 	if (!ps_init()) {
@@ -175,73 +281,199 @@ bool system_peripheral_init(bool init_wifi)
 		}
 	}
 	
-	// Reset the Tiny1C (and, optionally, and other sensors)
-	gpio_set_direction(BRD_SENSOR_RSTN_IO, GPIO_MODE_OUTPUT);
-	gpio_set_level(BRD_SENSOR_RSTN_IO, 0);
-	vTaskDelay(pdMS_TO_TICKS(10));
-	gpio_set_level(BRD_SENSOR_RSTN_IO, 1);
-	gpio_set_direction(BRD_SENSOR_RSTN_IO, GPIO_MODE_INPUT);
-	
 	return true;
 }
 
 
 /**
- * Allocate shared buffers for use by tasks for image data in the external RAM
+ * Allocate shared buffers for use by tasks for image data, mostly in the external RAM.
+ * Image planes may be placed in internal RAM according to the placement map.
  */
 bool system_buffer_init(bool init_vid_buffers)
 {
+	size_t int_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+	size_t psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+	
 	ESP_LOGI(TAG, "Buffer Allocation");
 	
-	// Allocate the image read buffer
-	t1c_y16_buffer = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
-	if (t1c_y16_buffer == NULL) {
-		ESP_LOGE(TAG, "malloc image buffer failed");
+	// Buffers that must be in internal RAM are allocated first, before any image planes
+	// are placed there
+#ifdef CONFIG_BUILD_ICAM_MINI
+	if (init_vid_buffers) {
+		// Create the video frame buffers (displayed directly by the video driver)
+		for (int i=0; i<VID_NUM_FB; i++) {
+			rend_fbP[i] = heap_caps_calloc(IMG_BUF_WIDTH*IMG_BUF_HEIGHT, sizeof(uint8_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+			if (rend_fbP[i] == NULL) {
+				ESP_LOGE(TAG, "create vid frame buffer %d failed", i);
+				return false;
+			}
+		}
+	}
+#endif
+	
+	// Allocate the card write buffer in internal RAM (the SD Card DMA can't access external
+	// RAM).  Done here at startup because a buffer this size may not be available later.
+	file_write_bufferP = heap_caps_malloc(FILE_WRITE_BUF_LEN, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+	if (file_write_bufferP == NULL) {
+		ESP_LOGE(TAG, "malloc card write buffer failed");
 		return false;
 	}
 	
-	// Allocate the ping/pong t1c->output task Tiny1C buffers in the external RAM
-	for (int i=0; i<2; i++) {
-		memset(&out_t1c_buffer[i], 0, sizeof(t1c_buffer_t));
-		out_t1c_buffer[i].img_data = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
-		if (out_t1c_buffer[i].img_data == NULL) {
-			ESP_LOGE(TAG, "malloc VID shared image buffer %d failed", i);
+	// Allocate the strip buffer saved images are rendered into, strip by strip, as 24-bit
+	// RGB for conversion to jpeg
+	rgb_save_strip = (uint32_t*) heap_caps_malloc(T1C_WIDTH*FILE_SAVE_STRIP_LINES*4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if (rgb_save_strip == NULL) {
+		ESP_LOGE(TAG, "malloc save RGB strip failed");
+		return false;
+	}
+	
+	// Allocate the pool of image planes t1c_task reads into.  Planes are handed off by
+	// pointer to the output and file buffers (so there must be one more than the number of
+	// t1c_buffer_t consumers to always have one free for the next frame).  The Y8 planes are
+	// allocated first since they are read for every rendered pixel.
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		t1c_y8_pool[i] = (uint8_t*) _malloc_image_plane(T1C_WIDTH*T1C_HEIGHT, PLACE_Y8_INTERNAL);
+		if (t1c_y8_pool[i] == NULL) {
+			ESP_LOGE(TAG, "malloc scaled image buffer %d failed", i);
 			return false;
 		}
+	}
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		t1c_y16_pool[i] = (uint16_t*) _malloc_image_plane(T1C_WIDTH*T1C_HEIGHT*2, PLACE_Y16_INTERNAL);
+		if (t1c_y16_pool[i] == NULL) {
+			ESP_LOGE(TAG, "malloc image buffer %d failed", i);
+			return false;
+		}
+	}
+	
+	// The spatially filtered Y8 planes are only used when the filter is enabled so they
+	// always go in PSRAM
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		t1c_y8f_pool[i] = (uint8_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT, MALLOC_CAP_SPIRAM);
+		if (t1c_y8f_pool[i] == NULL) {
+			ESP_LOGE(TAG, "malloc filtered image buffer %d failed", i);
+			return false;
+		}
+	}
+	
+	// As are the changed pixel masks
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		t1c_chg_pool[i] = (uint32_t*) heap_caps_malloc(T1C_CHG_MASK_WORDS*4, MALLOC_CAP_SPIRAM);
+		if (t1c_chg_pool[i] == NULL) {
+			ESP_LOGE(TAG, "malloc changed pixel mask %d failed", i);
+			return false;
+		}
+	}
+	ESP_LOGI(TAG, "Image planes: %d internal, %d PSRAM - Int free %d (largest %d) / PSRAM free %d",
+	         num_planes_internal, num_planes_psram,
+	         heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+	
+	// Setup the ping/pong t1c->output task Tiny1C buffers with their initial image planes
+	for (int i=0; i<2; i++) {
+		memset(&out_t1c_buffer[i], 0, sizeof(t1c_buffer_t));
+		out_t1c_buffer[i].img_data = t1c_y16_pool[i];
+		out_t1c_buffer[i].y8_data = t1c_y8_pool[i];
+		out_t1c_buffer[i].y8_filt_data = t1c_y8f_pool[i];
+		out_t1c_buffer[i].chg_mask = t1c_chg_pool[i];
 		out_t1c_buffer[i].mutex = xSemaphoreCreateMutex();
 	}
 	
-	// Allocate the t1c->file task buffers
+	// Setup the t1c->file task buffer
 	memset(&file_t1c_buffer, 0, sizeof(t1c_buffer_t));
-	file_t1c_buffer.img_data = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
-	if (file_t1c_buffer.img_data == NULL) {
-		ESP_LOGE(TAG, "malloc file save image buffer failed");
-		return false;
-	}
+	file_t1c_buffer.img_data = t1c_y16_pool[2];
+	file_t1c_buffer.y8_data = t1c_y8_pool[2];
+	file_t1c_buffer.y8_filt_data = t1c_y8f_pool[2];
+	file_t1c_buffer.chg_mask = t1c_chg_pool[2];
 	file_t1c_buffer.mutex = xSemaphoreCreateMutex();
 	
-	// Allocate the rending frame buffer for raw 24-bit RGB images for conversion to jpeg
-	rgb_save_image = (uint32_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*4, MALLOC_CAP_SPIRAM);
-	if (rgb_save_image == NULL) {
-		ESP_LOGE(TAG, "malloc save RGB buffer failed");
+#ifdef CONFIG_AUX_UART_ENABLE
+	// Setup the t1c->aux task buffer
+	memset(&aux_t1c_buffer, 0, sizeof(t1c_buffer_t));
+	aux_t1c_buffer.img_data = t1c_y16_pool[3];
+	aux_t1c_buffer.y8_data = t1c_y8_pool[3];
+	aux_t1c_buffer.y8_filt_data = t1c_y8f_pool[3];
+	aux_t1c_buffer.chg_mask = t1c_chg_pool[3];
+	aux_t1c_buffer.mutex = xSemaphoreCreateMutex();
+#endif
+	
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+	// Setup the t1c->mqtt task buffer.  It only gets the frame info so has no image planes.
+	memset(&mqtt_t1c_buffer, 0, sizeof(t1c_buffer_t));
+	mqtt_t1c_buffer.mutex = xSemaphoreCreateMutex();
+#endif
+	
+	// Allocate the burst frame buffers.  These hold copies of the raw frames (not pool
+	// references) so the pool isn't tied up while a burst is saved.  The scaled planes are
+	// only needed one at a time when each frame is saved so they share one.
+	file_burst_y8 = (uint8_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT, MALLOC_CAP_SPIRAM);
+	if (file_burst_y8 == NULL) {
+		ESP_LOGE(TAG, "malloc burst scaled image buffer failed");
 		return false;
 	}
+	for (int i=0; i<FILE_BURST_MAX_FRAMES; i++) {
+		memset(&file_burst_buffer[i], 0, sizeof(t1c_buffer_t));
+		file_burst_buffer[i].img_data = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
+		if (file_burst_buffer[i].img_data == NULL) {
+			ESP_LOGE(TAG, "malloc burst image buffer %d failed", i);
+			return false;
+		}
+		file_burst_buffer[i].y8_data = file_burst_y8;
+	}
 	
-#ifdef CONFIG_BUILD_ICAM_MINI
-	if (init_vid_buffers) {
-		// Create the ping-pong video rendering buffers
-		rend_fbP[0] = heap_caps_malloc(IMG_BUF_WIDTH*IMG_BUF_HEIGHT, MALLOC_CAP_SPIRAM);
-		if (rend_fbP[0] == NULL) {
-			ESP_LOGE(TAG, "create vid rendering buffer 0 failed");
+	// Allocate the replay frame buffers (one being loaded while t1c_task uses the other)
+	for (int i=0; i<2; i++) {
+		t1c_replay_buffer[i] = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
+		if (t1c_replay_buffer[i] == NULL) {
+			ESP_LOGE(TAG, "malloc replay image buffer %d failed", i);
 			return false;
 		}
-		rend_fbP[1] = heap_caps_malloc(IMG_BUF_WIDTH*IMG_BUF_HEIGHT, MALLOC_CAP_SPIRAM);
-		if (rend_fbP[1] == NULL) {
-			ESP_LOGE(TAG, "create vid rendering buffer 1 failed");
+	}
+	
+	// Allocate the temporal noise reduction history
+	t1c_tnr_history = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
+	if (t1c_tnr_history == NULL) {
+		ESP_LOGE(TAG, "malloc noise reduction history failed");
+		return false;
+	}
+	
+	// Allocate the accumulator for averaged pictures
+	t1c_avg_accum = (uint32_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*4, MALLOC_CAP_SPIRAM);
+	if (t1c_avg_accum == NULL) {
+		ESP_LOGE(TAG, "malloc frame accumulator failed");
+		return false;
+	}
+	
+	// Allocate the dead pixel detection statistics (two words per pixel)
+	t1c_dpc_accum = (uint32_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*8, MALLOC_CAP_SPIRAM);
+	if (t1c_dpc_accum == NULL) {
+		ESP_LOGE(TAG, "malloc dead pixel statistics failed");
+		return false;
+	}
+	
+	// Allocate the change detection background
+	t1c_chg_background = (uint16_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
+	if (t1c_chg_background == NULL) {
+		ESP_LOGE(TAG, "malloc change detection background failed");
+		return false;
+	}
+	
+	// Allocate the thumbnail buffer for saved images
+	rgb_save_thumb = (uint32_t*) heap_caps_malloc(FILE_THUMB_W*FILE_THUMB_H*4 + FILE_THUMB_JPEG_LEN, MALLOC_CAP_SPIRAM);
+	if (rgb_save_thumb == NULL) {
+		ESP_LOGE(TAG, "malloc save thumbnail buffer failed");
+		return false;
+	}
+	
+	// Allocate the encoded jpeg buffers for the save pipeline
+	for (int i=0; i<FILE_JPEG_NUM_SLOTS; i++) {
+		file_jpeg_slots[i] = (uint8_t*) heap_caps_malloc(FILE_JPEG_SLOT_LEN, MALLOC_CAP_SPIRAM);
+		if (file_jpeg_slots[i] == NULL) {
+			ESP_LOGE(TAG, "malloc jpeg slot %d failed", i);
 			return false;
 		}
 	}
-#endif
 	
 	// Allocate the filesystem information buffer in external RAM
 	file_info_bufferP = heap_caps_malloc(FILE_INFO_BUFFER_LEN, MALLOC_CAP_SPIRAM);
@@ -256,6 +488,8 @@ bool system_buffer_init(bool init_vid_buffers)
 		rgb_file_image = heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*3, MALLOC_CAP_SPIRAM);
 		if (rgb_file_image == NULL) {
 			ESP_LOGE(TAG, "create file image failed");
+		} else {
+			_malloc_prefetch_bufs(T1C_WIDTH*T1C_HEIGHT*3);
 		}
 	}
 #else
@@ -263,8 +497,147 @@ bool system_buffer_init(bool init_vid_buffers)
 	rgb_file_image = heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*2, MALLOC_CAP_SPIRAM);
 	if (rgb_file_image == NULL) {
 		ESP_LOGE(TAG, "create file image failed");
+	} else {
+		_malloc_prefetch_bufs(T1C_WIDTH*T1C_HEIGHT*2);
 	}
 #endif
 	
+	// The buffers are never freed so they can't fragment the heap
+	ESP_LOGI(TAG, "Buffers: Int %d bytes, PSRAM %d bytes - Int free %d (largest %d) / PSRAM free %d",
+	         int_free - heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+	         psram_free - heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+	         heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+	
+	return true;
+}
+
+
+/**
+ * Record the time of a boot timeline event (the first time it happens) and log it to
+ * show where startup time is spent.  Safe to call from any task.
+ */
+void system_boot_mark(int event)
+{
+	int64_t t;
+	
+	if ((event < 0) || (event >= SYS_BOOT_NUM_EVENTS) || (boot_event_usec[event] != 0)) {
+		return;
+	}
+	
+	t = esp_timer_get_time();
+	boot_event_usec[event] = t;
+	ESP_LOGI(TAG, "Boot: %s at %d mSec", boot_event_name[event], (int) (t / 1000));
+}
+
+
+/**
+ * Return the time a boot timeline event happened or 0 if it hasn't yet
+ */
+int64_t system_boot_get_usec(int event)
+{
+	if ((event < 0) || (event >= SYS_BOOT_NUM_EVENTS)) {
+		return 0;
+	}
+	
+	return boot_event_usec[event];
+}
+
+
+/**
+ * Start a task with a statically allocated stack of stack_len bytes and control block.
+ * Otherwise the same as xTaskCreatePinnedToCore.  The stacks of the long running tasks
+ * are reserved at link time so starting them can't fail (or fragment the heap) however
+ * much internal RAM has been allocated by then.
+ */
+bool system_start_task(TaskFunction_t fn, const char* name, uint32_t stack_len, StackType_t* stack, StaticTask_t* tcb,
+                       UBaseType_t prio, TaskHandle_t* handle, BaseType_t core)
+{
+	TaskHandle_t h;
+	
+	// A static task's handle is its control block.  It is set before the task is started so
+	// it (and tasks it notifies) can use it right away as with xTaskCreatePinnedToCore.
+	if (handle != NULL) {
+		*handle = (TaskHandle_t) tcb;
+	}
+	
+	h = xTaskCreateStaticPinnedToCore(fn, name, stack_len, NULL, prio, stack, tcb, core);
+	if (handle != NULL) {
+		*handle = h;
+	}
+	if (h == NULL) {
+		ESP_LOGE(TAG, "Could not start %s", name);
+		return false;
+	}
+	
+	if (num_tasks < SYS_MAX_TASKS) {
+		task_handles[num_tasks] = h;
+		task_stack_lens[num_tasks] = stack_len;
+		num_tasks++;
+	}
+	
 	return true;
 }
+
+
+/**
+ * Return the stack size of a task started by system_start_task or 0 for other tasks
+ */
+uint32_t system_get_task_stack_len(TaskHandle_t handle)
+{
+	for (int i=0; i<num_tasks; i++) {
+		if (task_handles[i] == handle) {
+			return task_stack_lens[i];
+		}
+	}
+	
+	return 0;
+}
+
+
+
+//
+// System Utilities internal functions
+//
+
+// Allocate an image plane in internal RAM if requested and it leaves enough free,
+// otherwise in PSRAM
+static void* _malloc_image_plane(size_t len, bool prefer_internal)
+{
+	void* p = NULL;
+	
+	if (prefer_internal &&
+	    (heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) >= len) &&
+	    (heap_caps_get_free_size(MALLOC_CAP_INTERNAL) >= (len + INTERNAL_RESERVE_BYTES))) {
+		
+		p = heap_caps_malloc(len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	}
+	
+	if (p != NULL) {
+		num_planes_internal++;
+	} else {
+		p = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+		if (p != NULL) num_planes_psram++;
+	}
+	
+	return p;
+}
+
+
+// Allocate the browser image cache.  It is optional so the cache is left disabled (the
+// first entry is NULL) if all of them can't be allocated.
+static void _malloc_prefetch_bufs(size_t len)
+{
+	for (int i=0; i<FILE_PREFETCH_NUM; i++) {
+		file_prefetch_bufs[i] = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+		if (file_prefetch_bufs[i] == NULL) {
+			ESP_LOGE(TAG, "malloc browser image cache failed");
+			while (--i >= 0) {
+				heap_caps_free(file_prefetch_bufs[i]);
+				file_prefetch_bufs[i] = NULL;
+			}
+			return;
+		}
+	}
+}
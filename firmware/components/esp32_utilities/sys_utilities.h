@@ -42,17 +42,41 @@
 
 
 
+//
+// System Utilities constants
+//
+
+// Boot timeline events (system_boot_mark)
+#define SYS_BOOT_IO_INIT      0
+#define SYS_BOOT_T1C_RESET    1
+#define SYS_BOOT_PERIPH_INIT  2
+#define SYS_BOOT_BUFFER_INIT  3
+#define SYS_BOOT_TASKS_START  4
+#define SYS_BOOT_CATALOG      5
+#define SYS_BOOT_T1C_READY    6
+#define SYS_BOOT_FIRST_FRAME  7
+#define SYS_BOOT_NUM_EVENTS   8
+
+// Maximum number of tasks started by system_start_task
+#define SYS_MAX_TASKS         12
+
+
+
 //
 // Task handle externs for use by tasks to communicate with each other
 //
 #ifdef CONFIG_BUILD_ICAM_MINI
+	extern TaskHandle_t task_handle_aux;
 	extern TaskHandle_t task_handle_ctrl;
 	extern TaskHandle_t task_handle_env;
 	extern TaskHandle_t task_handle_file;
+	extern TaskHandle_t task_handle_mqtt;
+	extern TaskHandle_t task_handle_sync;
 	extern TaskHandle_t task_handle_t1c;
 	extern TaskHandle_t task_handle_vid;
 	extern TaskHandle_t task_handle_web;
 #else
+	extern TaskHandle_t task_handle_disp;
 	extern TaskHandle_t task_handle_env;
 	extern TaskHandle_t task_handle_file;
 	extern TaskHandle_t task_handle_gcore;
@@ -60,9 +84,7 @@
 	extern TaskHandle_t task_handle_t1c;
 #endif
 
-#ifdef INCLUDE_SYS_MON
 extern TaskHandle_t task_handle_mon;
-#endif
 
 
 
@@ -71,27 +93,49 @@ extern TaskHandle_t task_handle_mon;
 //
 
 // Shared memory data structures
-extern uint16_t* t1c_y16_buffer;         // Holds image read from camera module
+extern uint16_t* t1c_y16_pool[T1C_Y16_POOL_LEN]; // Pool of image planes read from camera module
+extern uint8_t* t1c_y8_pool[T1C_Y16_POOL_LEN];   // Paired scaled 8-bit image planes
+extern uint8_t* t1c_y8f_pool[T1C_Y16_POOL_LEN];  // Paired spatially filtered 8-bit image planes
+extern uint32_t* t1c_chg_pool[T1C_Y16_POOL_LEN]; // Paired changed pixel masks
 
 extern t1c_buffer_t out_t1c_buffer[2];     // Ping-pong buffer loaded by t1c_task for the output task
 extern t1c_buffer_t file_t1c_buffer;       // Buffer loaded by t1c_task for the file task
+#ifdef CONFIG_AUX_UART_ENABLE
+extern t1c_buffer_t aux_t1c_buffer;        // Buffer loaded by t1c_task for the AUX port task
+#endif
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+extern t1c_buffer_t mqtt_t1c_buffer;       // Measurements (no image) loaded by t1c_task for the MQTT task
+#endif
 extern t1c_param_metadata_t file_t1c_meta; // Loaded by t1c_task for the file task
+extern t1c_buffer_t file_burst_buffer[FILE_BURST_MAX_FRAMES]; // Burst frames copied by t1c_task for the file task
+extern uint8_t* file_burst_y8;             // Burst frames are scaled into this by the file task
+extern uint16_t* t1c_replay_buffer[2];     // Replayed frames loaded by file_task or a client for t1c_task
+extern uint16_t* t1c_tnr_history;          // Temporal noise reduction filter state for t1c_task
+extern uint32_t* t1c_avg_accum;            // Frame accumulator for averaged pictures taken by t1c_task
+extern uint32_t* t1c_dpc_accum;            // Per-pixel statistics for dead pixel detection by t1c_task
+extern uint16_t* t1c_chg_background;       // Change detection background model for t1c_task
 
 #ifdef CONFIG_BUILD_ICAM_MINI
-extern uint8_t* rend_fbP[2];             // Ping-pong rendering buffers for vid_task
+extern uint8_t* rend_fbP[VID_NUM_FB];    // Video frame buffers rendered by vid_task
 #endif
 
-extern uint32_t* rgb_save_image;         // Buffer to render a 24-bit color image into for compression to jpeg
+extern uint32_t* rgb_save_strip;         // Strip of a 24-bit color image rendered for compression to jpeg
+extern uint32_t* rgb_save_thumb;         // RGBA thumbnail followed by room for its jpeg encoding
+extern uint8_t* file_jpeg_slots[FILE_JPEG_NUM_SLOTS]; // Encoded jpeg images waiting to be written to the card
 
 #ifdef CONFIG_BUILD_ICAM_MINI
 extern uint32_t* rgb_file_image;         // Buffer to render a 24-bit color image to from jpeg decompression
 #else
 extern uint16_t* rgb_file_image;         // Buffer to render a 16-bit color image to from jpeg decompression
 #endif
+extern uint8_t* file_prefetch_bufs[FILE_PREFETCH_NUM]; // Browser image cache entries (rgb_file_image sized)
 
 // Pointer to filesystem information structure (catalog)
 extern void* file_info_bufferP;
 
+// Internal DMA capable buffer image and movie files are written to the card through
+extern uint8_t* file_write_bufferP;
+
 
 //
 // System Utilities API
@@ -99,5 +143,10 @@ extern void* file_info_bufferP;
 bool system_esp_io_init();
 bool system_peripheral_init(bool init_wifi);
 bool system_buffer_init(bool init_vid_buffers);
+void system_boot_mark(int event);
+int64_t system_boot_get_usec(int event);
+bool system_start_task(TaskFunction_t fn, const char* name, uint32_t stack_len, StackType_t* stack, StaticTask_t* tcb,
+                       UBaseType_t prio, TaskHandle_t* handle, BaseType_t core);
+uint32_t system_get_task_stack_len(TaskHandle_t handle);
  
 #endif /* SYS_UTILITIES_H */
\ No newline at end of file
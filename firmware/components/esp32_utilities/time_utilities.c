@@ -23,6 +23,7 @@
 #include "esp_system.h"
 #include "time_utilities.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <stdlib.h>
 #include <sys/time.h>
 
@@ -75,11 +76,14 @@ static const char* mon_strings[] = {
 //
 static const char* TAG = "time_utilities";
 
+// esp_timer time the system time was last set from (or written to) the RTC
+static int64_t last_sync_usec;
+
 
 //
 // Forward declarations for internal functions
 //
-void _rtc_read_time(tmElements_t* tm);
+bool _rtc_read_secs(uint32_t* secs);
 bool _rtc_write_time(tmElements_t* tm);
  
 //
@@ -115,6 +119,7 @@ void time_init()
 	tv.tv_sec = secs;
 	tv.tv_usec = 0;
 	settimeofday((const struct timeval *) &tv, NULL);
+	last_sync_usec = esp_timer_get_time();
 	
 	// Diagnostic display of time
 	time_get(&te);
@@ -137,6 +142,7 @@ void time_set(tmElements_t* te)
 	tv.tv_sec = secs;
 	tv.tv_usec = 0;
 	settimeofday((const struct timeval *) &tv, NULL);
+	last_sync_usec = esp_timer_get_time();
 	
 	// Then attempt to set the RTC
 	if (_rtc_write_time(te)) {
@@ -166,6 +172,37 @@ void time_get(tmElements_t* te)
 }
 
 
+/**
+ * Correct the system time for drift from the RTC every TIME_RESYNC_SECS.  Called
+ * periodically by a housekeeping task so time_get() never has to access the RTC.
+ */
+void time_resync()
+{
+	int64_t cur_usec = esp_timer_get_time();
+	struct timeval tv;
+	uint32_t secs;
+	
+	if ((cur_usec - last_sync_usec) < ((int64_t) TIME_RESYNC_SECS * 1000000)) {
+		return;
+	}
+	last_sync_usec = cur_usec;
+	
+	if (!_rtc_read_secs(&secs)) {
+		ESP_LOGE(TAG, "RTC resync read failed");
+		return;
+	}
+	
+	// Only step the system clock if it has drifted by at least a second
+	(void) gettimeofday(&tv, NULL);
+	if (llabs((int64_t) tv.tv_sec - (int64_t) secs) >= 1) {
+		ESP_LOGI(TAG, "Resync time (%lld sec)", (int64_t) secs - (int64_t) tv.tv_sec);
+		tv.tv_sec = secs;
+		tv.tv_usec = 0;
+		settimeofday((const struct timeval *) &tv, NULL);
+	}
+}
+
+
 /**
  * Return true if the system time (in seconds) has changed from the last time
  * this function returned true. Each calling task must maintain its own prev_time
@@ -223,26 +260,19 @@ void time_get_disp_string(tmElements_t* te, char* buf)
 //
 // Internal functions
 //
-void _rtc_read_time(tmElements_t* tm)
+bool _rtc_read_secs(uint32_t* secs)
 {
-	uint32_t secs = 0;
-	time_t tv;
-	tmElements_t* te;
-		
 #ifdef CONFIG_BUILD_ICAM_MINI
-	if (!pcf85063_get_time(tm)) {
-		secs = MIN_EPOCH_TIME;
-		tv = (time_t) secs;
-		te = localtime(&tv);
-		*tm = *te;
-	}
-#else	
-	if (!gcore_get_time_secs(&secs)) {
-		secs = MIN_EPOCH_TIME;
+	tmElements_t te;
+	
+	if (!pcf85063_get_time(&te)) {
+		return false;
 	}
-	tv = (time_t) secs;
-	te = localtime(&tv);
-	*tm = *te;
+	*secs = mktime(&te);
+	
+	return true;
+#else
+	return (gcore_get_time_secs(secs));
 #endif
 }
 
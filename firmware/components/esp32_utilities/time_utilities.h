@@ -33,6 +33,9 @@
 // RTC constants
 //
 
+// Interval between re-synchronizations of the system time from the RTC
+#define TIME_RESYNC_SECS 3600
+
 
 //
 // Time structures
@@ -47,6 +50,7 @@ typedef struct tm tmElements_t;
 void time_init();
 void time_set(tmElements_t* te);
 void time_get(tmElements_t* te);
+void time_resync();
 bool time_changed(tmElements_t* te, time_t* prev_time);
 void time_get_disp_string(tmElements_t* te, char* buf);
 
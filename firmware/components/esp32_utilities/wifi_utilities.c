@@ -71,6 +71,7 @@ static bool mdns_running = false;
 static bool sta_connected = false; // Set when we connect to an AP so we can disconnect if we restart
 static int sta_retry_num = 0;
 static uint8_t wifi_flags = 0;
+static int wifi_profile = WIFI_PROFILE_IDLE;
 
 // mDNS TXT records
 #define NUM_SERVICE_TXT_ITEMS 2
@@ -80,6 +81,11 @@ static char* txt_item_keys[NUM_SERVICE_TXT_ITEMS] = {
 	"version"
 };
 
+// Multicast image stream mDNS service (port 0 when there isn't one)
+static mdns_txt_item_t mcast_txt_data[1];
+static char mcast_group[16];
+static uint16_t mcast_port = 0;
+
 
 
 //
@@ -91,6 +97,8 @@ static bool enable_esp_wifi_client();
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static void ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 static bool start_mdns();
+static void add_mcast_service();
+static void apply_wifi_profile();
 
 
 
@@ -299,6 +307,67 @@ void wifi_get_ipv4_addr(char* s)
 }
 
 
+/**
+ * Select the link profile (WIFI_PROFILE_xxx).  It is applied immediately if the interface
+ * is enabled and when it is enabled later.
+ */
+void wifi_set_profile(int profile)
+{
+	if (profile == wifi_profile) return;
+	
+	wifi_profile = profile;
+	if ((wifi_flags & WIFI_INFO_FLAG_ENABLED) != 0) {
+		apply_wifi_profile();
+	}
+}
+
+
+/**
+ * Advertise the multicast image stream at group:port with mDNS, or stop advertising it if
+ * port is 0.  It is advertised whenever mDNS is running.
+ */
+void wifi_set_mcast_service(const char* group, uint16_t port)
+{
+	if (mdns_running && (mcast_port != 0)) {
+		(void) mdns_service_remove("_icam-stream", "_udp");
+	}
+	
+	strncpy(mcast_group, group, sizeof(mcast_group) - 1);
+	mcast_port = port;
+	
+	if (mdns_running) {
+		add_mcast_service();
+	}
+}
+
+
+/**
+ * Get the signal strength (dBm) of our link.  In client mode it is the AP's signal and in AP
+ * mode it is the weakest connected station's since that limits what the clients see.
+ * Returns false if there is no link.
+ */
+bool wifi_get_rssi(int8_t* rssi)
+{
+	wifi_ap_record_t ap_info;
+	wifi_sta_list_t sta_list;
+	
+	if ((wifi_flags & WIFI_INFO_FLAG_ENABLED) == 0) return false;
+	
+	if (wifi_config.sta_mode) {
+		if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) return false;
+		*rssi = ap_info.rssi;
+	} else {
+		if ((esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK) || (sta_list.num == 0)) return false;
+		*rssi = 0;
+		for (int i=0; i<sta_list.num; i++) {
+			if (sta_list.sta[i].rssi < *rssi) *rssi = sta_list.sta[i].rssi;
+		}
+	}
+	
+	return true;
+}
+
+
 
 //
 // WiFi Utilities internal functions
@@ -373,11 +442,18 @@ static bool enable_esp_wifi_ap()
     	return false;
     }
     
+    // Use 40 MHz channels for more throughput (stations that can't use them fall back to 20 MHz)
+    ret = esp_wifi_set_bandwidth(ESP_IF_WIFI_AP, WIFI_BW_HT40);
+    if (ret != ESP_OK) {
+    	ESP_LOGW(TAG, "Could not set Soft AP bandwidth (%d)", ret);
+    }
+    
     ret = esp_wifi_start();
     if (ret != ESP_OK) {
     	ESP_LOGE(TAG, "Could not start Soft AP (%d)", ret);
     	return false;
     }
+    apply_wifi_profile();
     	
     return true;
 }
@@ -439,7 +515,7 @@ static bool enable_esp_wifi_client()
 			.scan_method = WIFI_FAST_SCAN,
 			.bssid_set = 0,
 			.channel = 0,
-			.listen_interval = 0,
+			.listen_interval = WIFI_IDLE_LISTEN_INTERVAL,
 			.sort_method = WIFI_CONNECT_AP_BY_SIGNAL			
 		}
 	};	
@@ -462,16 +538,43 @@ static bool enable_esp_wifi_client()
     	return false;
     }
     
+    // Use 40 MHz channels if the AP supports them
+    ret = esp_wifi_set_bandwidth(ESP_IF_WIFI_STA, WIFI_BW_HT40);
+    if (ret != ESP_OK) {
+    	ESP_LOGW(TAG, "Could not set Station bandwidth (%d)", ret);
+    }
+    
     ret = esp_wifi_start();
     if (ret != ESP_OK) {
     	ESP_LOGE(TAG, "Could not start Station (%d)", ret);
     	return false;
     }
+    apply_wifi_profile();
     
     return true;
 }
 
 
+/**
+ * Configure power save for the current profile.  Only a station can sleep (the Soft AP has
+ * to stay awake to beacon) so the idle profile's modem sleep, waking every
+ * WIFI_IDLE_LISTEN_INTERVAL beacons, only applies in client mode.
+ */
+static void apply_wifi_profile()
+{
+	esp_err_t ret;
+	
+	if (!wifi_config.sta_mode) return;
+	
+	ret = esp_wifi_set_ps((wifi_profile == WIFI_PROFILE_STREAM) ? WIFI_PS_NONE : WIFI_PS_MAX_MODEM);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "Could not set power save mode (%d)", ret);
+	} else {
+		ESP_LOGI(TAG, "WiFi %s profile", (wifi_profile == WIFI_PROFILE_STREAM) ? "streaming" : "idle");
+	}
+}
+
+
 /*
  * Handle events from the WiFi stack
  */
@@ -588,6 +691,25 @@ static bool start_mdns()
 	}
 	
 	mdns_running = true;
+	add_mcast_service();
 	return true;
 }
+
+
+/**
+ * Add the multicast image stream service if it is running
+ */
+static void add_mcast_service()
+{
+	esp_err_t ret;
+	
+	if (mcast_port == 0) return;
+	
+	mcast_txt_data[0].key = "group";
+	mcast_txt_data[0].value = mcast_group;
+	ret = mdns_service_add(NULL, "_icam-stream", "_udp", mcast_port, mcast_txt_data, 1);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "Could not add mDNS stream service (%d)", ret);
+	}
+}
 	
\ No newline at end of file
@@ -34,6 +34,15 @@
 // Maximum attempts to reconnect to an AP in client mode before starting to wait
 #define WIFI_FAST_RECONNECT_ATTEMPTS  10
 
+// Link profiles (wifi_set_profile).  The streaming profile keeps the radio on for the lowest
+// latency while a client is connected.  The idle profile lets a station sleep between
+// beacons to save power the rest of the time (e.g. during a timelapse).
+#define WIFI_PROFILE_STREAM           0
+#define WIFI_PROFILE_IDLE             1
+
+// Beacon intervals a station sleeps through in the idle profile
+#define WIFI_IDLE_LISTEN_INTERVAL     3
+
 
 
 //
@@ -45,5 +54,8 @@ bool wifi_en_mdns(bool en);
 bool wifi_is_enabled();
 bool wifi_is_connected();
 void wifi_get_ipv4_addr(char* s);   // s must be large enough for "XXX.XXX.XXX.XXX" + null
+bool wifi_get_rssi(int8_t* rssi);
+void wifi_set_profile(int profile);
+void wifi_set_mcast_service(const char* group, uint16_t port);
 
 #endif /* WIFI_UTILITIES_H */
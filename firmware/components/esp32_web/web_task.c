@@ -18,28 +18,43 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "esp_system.h"
+#include "esp_app_desc.h"
 #ifdef CONFIG_BUILD_ICAM_MINI
 
+#include <arpa/inet.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "cmd_handlers.h"
 #include "cmd_list.h"
 #include "cmd_utilities.h"
 #include "ctrl_task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_ota_ops.h"
 #include "esp_wifi.h"
 #include "esp_http_server.h"
+#include "lwip/sockets.h"
+#include "file_raw.h"
+#include "file_render.h"
 #include "file_task.h"
 #include "file_utilities.h"
 #include "out_state_utilities.h"
 #include "palettes.h"
+#include "perf_utilities.h"
 #include "sys_utilities.h"
+#include "t1c_task.h"
 #include "tiny1c.h"
+#include "time_utilities.h"
 #include "ws_cmd_utilities.h"
 #include "web_task.h"
 #include "wifi_utilities.h"
@@ -50,7 +65,113 @@
 //
 
 // Maximum number of connections
-#define max_sockets 3
+#define max_sockets WEB_MAX_CLIENTS
+
+// Longest the main loop blocks waiting for a notification (client connections and picture
+// requests from a command are polled)
+#define WEB_TASK_EVAL_MSEC       50
+
+// Shared image packets: one per client that may still be sending plus one to encode into
+// (in each of the full image and CMD_IMAGE_SAME pools)
+#define WEB_NUM_IMG_PKTS         (max_sockets + 1)
+
+// Preallocated command frame buffers for packets queued to the httpd task.  Queued command
+// packets are combined into as few frames as fit in them.  Larger packets are copied into
+// an allocated buffer.
+#define WEB_NUM_CMD_BUFS         4
+#define WEB_CMD_BUF_LEN          CMD_BATCH_MAX_LEN
+
+// Largest response packet for a subscribed item
+#define WEB_SUB_MAX_LEN          32
+
+// Number of state items broadcast to the other clients when one changes them
+#define WEB_NUM_BCAST_ITEMS      (sizeof(bcast_items) / sizeof(web_bcast_item_t))
+
+// Adaptive stream rate.  A client's images are spaced by at least WEB_RATE_HEADROOM times
+// its average send time (which grows when the socket's send buffer fills) so the link is
+// never kept fully busy and latency can't build up in the TCP backlog.  Rate changes are
+// sent to the client (CMD_STREAM_RATE) no more often than WEB_RATE_REPORT_USEC.
+#define WEB_RATE_HEADROOM        2
+#define WEB_RATE_MAX_INTERVAL    1000000
+#define WEB_RATE_REPORT_USEC     2000000
+#define WEB_RATE_REPORT_DELTA    10
+
+// Link statistics.  Each client's throughput, frame rate and send times are measured over
+// windows of at least WEB_LINK_WINDOW_USEC of completed image sends.
+#define WEB_LINK_WINDOW_USEC     1000000
+
+// Dead client detection.  A websocket client we haven't received anything from (including
+// a pong) for WEB_PING_IDLE_USEC is pinged.  Its connection is closed if it doesn't answer
+// within WEB_PING_TIMEOUT_USEC or WEB_MAX_SEND_FAILS image sends to it fail in a row, so a
+// client that went away without closing doesn't hold a socket or keep the httpd task
+// waiting on sends.
+#define WEB_PING_IDLE_USEC       5000000
+#define WEB_PING_TIMEOUT_USEC    5000000
+#define WEB_MAX_SEND_FAILS       3
+
+// UDP image stream (CMD_UDP_STREAM) whole rows per datagram
+#define WEB_UDP_ROWS_Y8          (CMD_UDP_MAX_PAYLOAD / T1C_WIDTH)
+#define WEB_UDP_ROWS_Y16         (CMD_UDP_MAX_PAYLOAD / (2*T1C_WIDTH))
+
+// MJPEG stream server.  It runs as a separate server so a client streaming from it doesn't
+// block the web page and websocket.  The frame rate and jpeg quality may be set with query
+// parameters (e.g. "/stream.mjpg?fps=5&quality=2").
+#define WEB_STREAM_PORT          81
+#define WEB_STREAM_CTRL_PORT     32769
+#define WEB_STREAM_MAX_SOCKETS   2
+#define WEB_STREAM_STACK_SIZE    8192
+#define WEB_STREAM_DEF_FPS       10
+#define WEB_STREAM_DEF_QUALITY   1
+#define WEB_STREAM_JPEG_BUF_LEN  (64*1024)
+#define WEB_STREAM_BOUNDARY      "icamframe"
+
+// Card file downloads on the stream server.  Files are read from the card WEB_CARD_BUF_LEN
+// bytes at a time (a multiple of the tar block size so each file's padding fits in its
+// last piece).
+//   /DCIM/NNNICAMF/ICAM_NNNN.ext   - A catalogued file (single byte Range requests supported)
+//   /archive.tar?dir=NNNICAMF      - The directory's catalogued files as an uncompressed tar
+//                                    generated while it is sent (catalog entries are read
+//                                    WEB_ARCHIVE_PAGE_LEN at a time)
+//   /sync.json?since=N             - Up to WEB_SYNC_MAX_FILES catalogued files with a
+//                                    timestamp of at least N, in catalog order, so a client
+//                                    keeping a copy of the card only fetches new files.  The
+//                                    response's "next" has dir and file query parameters to
+//                                    continue the listing after the last one when "more" is set.
+// The file and sync responses allow any origin so the web GUI, served from the main server,
+// may fetch them.
+#define WEB_CARD_BUF_LEN         (16*1024)
+#define WEB_FILE_HDR_LEN         64
+#define WEB_ARCHIVE_PAGE_LEN     16
+#define WEB_ARCHIVE_BLOCK_LEN    512
+#define WEB_SYNC_MAX_FILES       32
+#define WEB_SYNC_LINE_LEN        128
+
+// Embedded assets are sent with an ETag made from the firmware version and ELF hash so a
+// browser revalidating its cached copy gets a 304 instead of the whole page again
+#define WEB_ASSET_ETAG_LEN       64
+#define WEB_MAX_URI_HANDLERS     12
+
+// HTTP API for clients that just want the latest frame or temperatures without running the
+// web GUI.  Each response carries the frame sequence number as its ETag so a client polling
+// with If-None-Match gets a 304 until there is a new frame.
+//   /frame.raw  - Raw file (see file_raw.h) with delta encoded Y16 data
+//   /frame.jpg  - Palette colored jpeg ("quality" query parameter 1-3)
+//   /stats.json - Scene min/max, spot meter and region temperatures (°C)
+#define WEB_API_JPEG_BUF_LEN     WEB_STREAM_JPEG_BUF_LEN
+#define WEB_API_ETAG_LEN         16
+#define WEB_API_STATS_LEN        512
+
+// Firmware update.  The application image is POSTed to "/update" (e.g. "curl --data-binary
+// @iCamMini.bin http://<camera>/update") and received into one of WEB_OTA_NUM_BUFS buffers
+// while _web_ota_wr_task writes the previous one to the next OTA partition so the network
+// receive and flash writes overlap.  Image streams are paused during the update.  With
+// CONFIG_WEB_OTA_REQUIRE_BUTTON the camera blinks its LED and waits up to WEB_OTA_AUTH_MSEC
+// for the power button to be pressed before accepting the image; pressing it again during
+// the update aborts it.  The camera reboots once the image has been verified.
+#define WEB_OTA_NUM_BUFS         2
+#define WEB_OTA_BUF_LEN          (16*1024)
+#define WEB_OTA_AUTH_MSEC        30000
+#define WEB_OTA_RECV_RETRIES     5
 
 
 
@@ -58,6 +179,84 @@
 // WEB Task typedefs
 //
 
+// Firmware update receive buffer
+typedef struct {
+	uint8_t* buf;
+	uint32_t len;
+} web_ota_buf_t;
+
+// Embedded asset served by _web_asset_handler
+typedef struct {
+	const uint8_t* start;
+	const uint8_t* end;
+	const char* type;
+	bool gzip;               // Stored gzip compressed
+} web_asset_t;
+
+// MJPEG stream jpeg buffer
+typedef struct {
+	uint8_t* buf;
+	uint32_t len;
+	bool overflow;
+} stream_jpeg_t;
+
+// Image packet encoded once and shared by all clients sending it
+typedef struct {
+	uint8_t* buf;
+	uint32_t len;
+	int ref_count;           // Number of clients still sending this packet
+	bool same;               // CMD_IMAGE_SAME packet (not used to measure the link)
+} web_img_pkt_t;
+
+// Command frame buffer handed to the httpd task
+typedef struct {
+	uint8_t* buf;
+	uint32_t len;
+	int ref_count;           // Number of users (web_task and sends queued to the httpd task)
+} web_cmd_buf_t;
+
+// State item whose current value is sent to the other clients when one client sets it
+typedef struct {
+	cmd_id_t cmd_id;
+	cmd_handler get_handler;
+} web_bcast_item_t;
+
+// Per-client websocket send state.  Packets are handed to the httpd task using
+// httpd_ws_send_data_async so web_task never blocks on a slow client.  Each client
+// has one image in flight at most and frames arriving while it is busy are dropped
+// so they always get the latest frame.
+typedef struct {
+	int sock;                // -1 when unused
+	web_img_pkt_t* img_pktP; // Image being sent by the httpd task, NULL when idle
+	bool img_key_valid;      // img_key is the key of the last full image sent
+	uint32_t img_key;
+	int img_same_count;      // CMD_IMAGE_SAME packets sent since the last full image
+	int64_t send_start_usec; // When the image being sent was queued
+	int64_t last_img_usec;   // When the previous image was queued
+	int64_t send_avg_usec;   // Smoothed image send time
+	int64_t report_usec;     // When the stream rate was last reported
+	int32_t reported_rate;   // Last reported rate (fps x 10), 0 when not yet reported
+	int64_t win_start_usec;  // Link statistics measurement window
+	uint32_t win_bytes;
+	uint32_t win_frames;
+	uint32_t win_send_usec;
+	uint32_t win_max_usec;
+	web_link_client_t link;  // Link statistics from the last window
+	int64_t rx_usec;         // When something was last received from the client
+	int64_t ping_usec;       // When an unanswered ping was sent, 0 if none
+	int send_fails;          // Consecutive failed image sends
+	bool closing;            // Its connection is being closed
+} web_client_t;
+
+// File image or jpeg response sent as a header fragment followed by the data directly from
+// rgb_file_image
+typedef struct {
+	httpd_handle_t handle;
+	int sock;
+	uint32_t len;
+	uint8_t hdr[WS_CMD_HDR_LEN];
+} web_file_image_pkt_t;
+
 // Command packet data types
 typedef enum {
 	SEND_CMD_FW_UPD_EN,
@@ -67,11 +266,17 @@ typedef enum {
 	SEND_CMD_FILE_MSG_ON,
 	SEND_CMD_FILE_MSG_OFF,
 	SEND_CMD_FILE_CATALOG,
+	SEND_CMD_FILE_PAGE,
+	SEND_CMD_FILE_RANGE,
 	SEND_CMD_FILE_IMAGE,
+	SEND_CMD_FILE_JPEG,
+	SEND_CMD_FILE_THUMB,
 	SEND_CMD_TIMELAPSE_ON,
 	SEND_CMD_TIMELAPSE_OFF,
 	SEND_CMD_CTRL_ACT_SUCCEEDED,
-	SEND_CMD_CTRL_ACT_FAILED
+	SEND_CMD_CTRL_ACT_FAILED,
+	SEND_CMD_CTRL_ACT_PROGRESS,
+	SEND_CMD_TELEMETRY
 } send_cmd_type_t;
 
 
@@ -95,36 +300,221 @@ static bool notify_clear_file_message = false;
 static bool notify_image_1 = false;
 static bool notify_image_2 = false;
 static bool notify_catalog_response = false;
+static bool notify_page_response = false;
+static bool notify_range_response = false;
 static bool notify_file_image_response = false;
+static bool notify_file_jpeg_response = false;
+static bool notify_file_thumb_response = false;
 static bool notify_timelapse_on = false;
 static bool notify_timelapse_off = false;
 static bool notify_ctrl_act_succeeded = false;
 static bool notify_ctrl_act_failed = false;
+static bool notify_ctrl_act_progress = false;
+static bool notify_telemetry = false;
+
+// Websocket client send state and shared image packets (in PSRAM) protected by img_pkt_mutex
+static web_client_t web_clients[max_sockets];
+static web_img_pkt_t img_pkts[WEB_NUM_IMG_PKTS];
+static web_img_pkt_t img_same_pkts[WEB_NUM_IMG_PKTS];
+static web_img_pkt_t* cur_img_pktP;
+static web_img_pkt_t* cur_same_pktP;
+static SemaphoreHandle_t img_pkt_mutex;
+
+// Command frame buffers (in PSRAM) protected by cmd_buf_mutex and the buffer for responses
+// sent directly from the websocket handler in the httpd task
+static web_cmd_buf_t cmd_bufs[WEB_NUM_CMD_BUFS];
+static SemaphoreHandle_t cmd_buf_mutex;
+static uint8_t* ws_rsp_buf;
+
+// Subscribed items last sent to clients (response packets) and the changed ones to send
+static uint8_t sub_last[CMD_SUB_NUM][WEB_SUB_MAX_LEN];
+static uint32_t sub_last_len[CMD_SUB_NUM];
+static uint8_t sub_changed[CMD_SUB_NUM*WEB_SUB_MAX_LEN];
+static int64_t sub_check_usec = 0;
+
+// Get handlers for each CMD_SUB_xxx item (in bit order)
+static const cmd_handler sub_handlers[CMD_SUB_NUM] = {
+	cmd_handler_get_batt_level,
+	cmd_handler_get_card_present,
+	cmd_handler_get_shutter
+};
+
+// State set by a client that is broadcast to the others.  The spot meter and region
+// locations aren't included since they reach every client in the image metadata.
+static const web_bcast_item_t bcast_items[] = {
+	{CMD_AGC_MODE, cmd_handler_get_agc_mode},
+	{CMD_AMBIENT_CORRECT, cmd_handler_get_ambient_correct},
+	{CMD_BRIGHTNESS, cmd_handler_get_brightness},
+	{CMD_EMISSIVITY, cmd_handler_get_emissivity},
+	{CMD_GAIN, cmd_handler_get_gain},
+	{CMD_MIN_MAX_EN, cmd_handler_get_min_max_enable},
+	{CMD_PALETTE, cmd_handler_get_palette},
+	{CMD_PALETTE_STOPS, cmd_handler_get_palette_stops},
+	{CMD_PALETTE_THRESHOLD, cmd_handler_get_palette_threshold},
+	{CMD_REGION_EN, cmd_handler_get_region_enable},
+	{CMD_SAVE_FORMAT, cmd_handler_get_save_format},
+	{CMD_SAVE_OVL_EN, cmd_handler_get_save_ovl_en},
+	{CMD_SHUTTER_INFO, cmd_handler_get_shutter},
+	{CMD_SPOT_EN, cmd_handler_get_spot_enable},
+	{CMD_TNR, cmd_handler_get_tnr},
+	{CMD_UNITS, cmd_handler_get_units}
+};
+
+// Broadcast items set since the last pass through the main loop (protected by cmd_buf_mutex),
+// the socket that set them (-1 if more than one did) and the socket whose packet the httpd
+// task is processing
+static uint32_t bcast_pending_mask = 0;
+static int bcast_origin_sock = -1;
+static int ws_rx_sock = -1;
+
+// UDP image and multicast streams.  They are configured by a client in the httpd task
+// (protected by udp_mux) and sent by web_task.  udp_owner_sock is the websocket of the
+// client receiving the UDP stream (-1 when it is off).
+static portMUX_TYPE udp_mux = portMUX_INITIALIZER_UNLOCKED;
+static int udp_owner_sock = -1;
+static struct sockaddr_in udp_addr;
+static int udp_format = CMD_STREAM_Y8;
+static int udp_decimation = 1;
+static int udp_frame_count = 0;
+static uint16_t udp_pkt_seq = 0;
+static int mcast_format = CMD_STREAM_OFF;
+static int mcast_decimation = 1;
+static int mcast_frame_count = 0;
+static uint16_t mcast_pkt_seq = 0;
+static int udp_sock = -1;
+static uint8_t udp_pkt_buf[CMD_UDP_HDR_LEN + CMD_UDP_MAX_PAYLOAD];
 
-// served web page and favicon
+// MJPEG stream server and buffers (in PSRAM)
+static httpd_handle_t stream_server = NULL;
+static uint32_t* stream_rgb_image;
+static stream_jpeg_t stream_jpeg;
+
+// HTTP API buffers (in PSRAM).  The handlers run in the httpd task one at a time.
+static uint8_t* api_raw_buf;
+static uint32_t* api_rgb_image;
+static stream_jpeg_t api_jpeg;
+static char api_etag[WEB_API_ETAG_LEN];
+
+// Card file response headers (the handlers run in the stream server task)
+static char archive_disp[48];
+static char file_range_hdr[WEB_FILE_HDR_LEN];
+static char file_etag[WEB_FILE_HDR_LEN];
+
+// served web page and favicon.  When the GUI is built without SINGLE_FILE its javascript
+// and wasm binary are separate assets (WEB_SPLIT_ASSETS is set by CMakeLists.txt when they
+// exist) so they can be cached and revalidated on their own.
 extern const uint8_t index_html_start[] asm("_binary_index_html_gz_start");
 extern const uint8_t index_html_end[] asm("_binary_index_html_gz_end");
 
+#ifdef WEB_SPLIT_ASSETS
+extern const uint8_t index_js_start[] asm("_binary_index_js_gz_start");
+extern const uint8_t index_js_end[] asm("_binary_index_js_gz_end");
+
+extern const uint8_t index_wasm_start[] asm("_binary_index_wasm_gz_start");
+extern const uint8_t index_wasm_end[] asm("_binary_index_wasm_gz_end");
+#endif
+
 extern const uint8_t favicon_ico_start[] asm("_binary_favicon_ico_start");
 extern const uint8_t favicon_ico_end[] asm("_binary_favicon_ico_end");
 
+static const web_asset_t asset_index_html = {index_html_start, index_html_end, "text/html", true};
+#ifdef WEB_SPLIT_ASSETS
+static const web_asset_t asset_index_js = {index_js_start, index_js_end, "application/javascript", true};
+static const web_asset_t asset_index_wasm = {index_wasm_start, index_wasm_end, "application/wasm", true};
+#endif
+static const web_asset_t asset_favicon = {favicon_ico_start, favicon_ico_end, "image/x-icon", false};
+
+static char asset_etag[WEB_ASSET_ETAG_LEN];
+
+// Firmware update state.  ota_running pauses the image streams.  The buffers are allocated
+// for each update and passed between the handler and writer task through the queues (the
+// writer is sent -1 to finish).
+static volatile bool ota_running = false;
+static volatile bool ota_waiting_auth = false;
+static volatile bool ota_abort = false;
+static SemaphoreHandle_t ota_auth_sem;
+static SemaphoreHandle_t ota_wr_done_sem;
+static QueueHandle_t ota_free_queue;
+static QueueHandle_t ota_full_queue;
+static web_ota_buf_t ota_bufs[WEB_OTA_NUM_BUFS];
+static esp_ota_handle_t ota_handle;
+static esp_err_t ota_wr_err;
+
 
 
 //
 // WEB Task Forward Declarations for internal functions
 //
-static void _web_handle_notifications();
+static TickType_t _web_get_eval_wait();
+static void _web_handle_notifications(TickType_t wait);
 static httpd_handle_t _web_start_webserver(void);
 static esp_err_t _web_stop_webserver(httpd_handle_t server);
 static void _web_connect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 static void _web_disconnect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
-static esp_err_t _web_req_handler(httpd_req_t *req);
-static esp_err_t _web_favicon_handler(httpd_req_t *req);
+static void _web_init_asset_etag();
+static esp_err_t _web_asset_handler(httpd_req_t *req);
 static esp_err_t _web_ws_handler(httpd_req_t *req);
+static bool _web_init_clients();
+static void _web_reset_clients();
+static void _web_update_clients(size_t num_fds, int* fds);
+static web_client_t* _web_get_client(int sock);
+static bool _web_check_client_alive(httpd_handle_t handle, int sock);
+static void _web_note_client_rx(int sock);
+static void _web_ping_done(esp_err_t err, int socket, void* arg);
+static web_img_pkt_t* _web_get_free_img_pkt(web_img_pkt_t* pkts);
+static int32_t _web_get_client_rate(web_client_t* clientP);
+static void _web_send_stream_rate(httpd_handle_t handle, web_client_t* clientP);
+static void _web_update_link_stats(web_client_t* clientP, esp_err_t err, uint32_t len, uint32_t send_usec);
+static bool _web_udp_stream_active(size_t num_fds, int* fds, struct sockaddr_in* addrP, int* formatP);
+static bool _web_mcast_stream_active(struct sockaddr_in* addrP, int* formatP);
+static void _web_send_udp_image(struct sockaddr_in* addrP, int format, uint16_t* seqP, int render_buf_index);
+static uint32_t _web_check_subscriptions();
+static void _web_queue_cmd_packets(httpd_handle_t handle, int sock);
+static void _web_queue_cmd_packet(httpd_handle_t handle, int sock, uint32_t len, uint8_t* payload);
+static web_cmd_buf_t* _web_get_free_cmd_buf();
+static void _web_release_cmd_buf(web_cmd_buf_t* bufP);
+static void _web_note_set(cmd_id_t cmd_id);
+static web_cmd_buf_t* _web_build_broadcast(size_t clients, int* origin_sock);
+static void _web_queue_cmd_buf(httpd_handle_t handle, int sock, web_cmd_buf_t* bufP);
+static void _web_cmd_packet_done(esp_err_t err, int socket, void* arg);
+static void _web_cmd_buf_done(esp_err_t err, int socket, void* arg);
+static void _web_image_packet_done(esp_err_t err, int socket, void* arg);
+static bool _web_init_stream();
+static httpd_handle_t _web_start_stream_server();
+static esp_err_t _web_stream_handler(httpd_req_t *req);
+static int _web_stream_get_query_int(httpd_req_t* req, const char* key, int def, int min, int max);
+static void _web_stream_write(void* context, void* data, int size);
+static bool _web_init_api();
+static t1c_buffer_t* _web_api_get_frame();
+static bool _web_api_not_modified(httpd_req_t* req, t1c_buffer_t* t1cP);
+static esp_err_t _web_api_frame_raw_handler(httpd_req_t *req);
+static esp_err_t _web_api_frame_jpg_handler(httpd_req_t *req);
+static esp_err_t _web_api_stats_handler(httpd_req_t *req);
+static char* _web_api_add_temp(char* bufP, const char* name, uint16_t t, bool valid);
+static bool _web_init_ota();
+static esp_err_t _web_ota_handler(httpd_req_t *req);
+static bool _web_ota_authorize();
+static esp_err_t _web_ota_receive(httpd_req_t* req);
+static void _web_ota_wr_task(void* arg);
+static esp_err_t _web_file_handler(httpd_req_t *req);
+static int _web_file_get_range(httpd_req_t* req, uint32_t size, uint32_t* startP, uint32_t* endP);
+static esp_err_t _web_archive_handler(httpd_req_t *req);
+static esp_err_t _web_sync_handler(httpd_req_t *req);
+static esp_err_t _web_archive_send_file(httpd_req_t* req, uint8_t* buf, char* dir_name, file_catalog_entry_t* entryP);
+static void _web_archive_header(uint8_t* hdr, const char* name, uint32_t size, uint32_t timestamp, char type);
+static uint8_t* _web_alloc_card_buf();
+static esp_err_t _web_send_card_file(httpd_req_t* req, uint8_t* buf, char* dir_name, char* file_name, uint32_t pos, uint32_t len, uint32_t pad);
 static void _web_send_cmd(httpd_handle_t handle, int sock, send_cmd_type_t cmd_type);
 static void _web_send_image(httpd_handle_t handle, int sock, int render_buf_index);
 static void _web_send_get_file_catalog_response();
-static void _web_send_get_file_image_response();
+static void _web_send_get_file_catalog_page_response();
+static void _web_send_get_file_catalog_range_response();
+static void _web_send_get_file_image_response(httpd_handle_t handle, int sock);
+static void _web_send_get_file_jpeg_response(httpd_handle_t handle, int sock);
+static void _web_send_get_file_thumb_response(httpd_handle_t handle, int sock);
+static void _web_queue_file_pkt(httpd_handle_t handle, int sock, cmd_id_t id, uint32_t len);
+static void _web_send_file_image_work(void* arg);
+static void _web_send_ctrl_activity_progress();
 
 
 
@@ -134,16 +524,34 @@ static void _web_send_get_file_image_response();
 static const httpd_uri_t uri_get = {
         .uri        = "/",
         .method     = HTTP_GET,
-        .handler    = _web_req_handler,
-        .user_ctx   = NULL,
+        .handler    = _web_asset_handler,
+        .user_ctx   = (void*) &asset_index_html,
+        .is_websocket = false
+};
+
+#ifdef WEB_SPLIT_ASSETS
+static const httpd_uri_t uri_get_js = {
+        .uri        = "/index.js",
+        .method     = HTTP_GET,
+        .handler    = _web_asset_handler,
+        .user_ctx   = (void*) &asset_index_js,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_get_wasm = {
+        .uri        = "/index.wasm",
+        .method     = HTTP_GET,
+        .handler    = _web_asset_handler,
+        .user_ctx   = (void*) &asset_index_wasm,
         .is_websocket = false
 };
+#endif
 
 static const httpd_uri_t uri_get_favicon = {
         .uri        = "/favicon.ico",
         .method     = HTTP_GET,
-        .handler    = _web_favicon_handler,
-        .user_ctx   = NULL,
+        .handler    = _web_asset_handler,
+        .user_ctx   = (void*) &asset_favicon,
         .is_websocket = false
 };
 
@@ -155,6 +563,70 @@ static const httpd_uri_t uri_ws = {
         .is_websocket = true
 };
 
+static const httpd_uri_t uri_frame_raw = {
+        .uri        = "/frame.raw",
+        .method     = HTTP_GET,
+        .handler    = _web_api_frame_raw_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_frame_jpg = {
+        .uri        = "/frame.jpg",
+        .method     = HTTP_GET,
+        .handler    = _web_api_frame_jpg_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_stats = {
+        .uri        = "/stats.json",
+        .method     = HTTP_GET,
+        .handler    = _web_api_stats_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_update = {
+        .uri        = "/update",
+        .method     = HTTP_POST,
+        .handler    = _web_ota_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_stream = {
+        .uri        = "/stream.mjpg",
+        .method     = HTTP_GET,
+        .handler    = _web_stream_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_file = {
+        .uri        = "/DCIM/*",
+        .method     = HTTP_GET,
+        .handler    = _web_file_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_archive = {
+        .uri        = "/archive.tar",
+        .method     = HTTP_GET,
+        .handler    = _web_archive_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
+static const httpd_uri_t uri_sync = {
+        .uri        = "/sync.json",
+        .method     = HTTP_GET,
+        .handler    = _web_sync_handler,
+        .user_ctx   = NULL,
+        .is_websocket = false
+};
+
 
 
 //
@@ -165,7 +637,13 @@ void web_task()
 	esp_err_t ret;
 	size_t clients;
 	int client_fds[max_sockets];
+	int img_index;
 	int sock;
+	int bcast_sock;
+	uint32_t sub_len;
+	web_cmd_buf_t* bcast_bufP;
+	struct sockaddr_in udp_dest;
+	int udp_dest_format;
 	static httpd_handle_t server = NULL;
 	
 	ESP_LOGI(TAG, "Start task");
@@ -173,12 +651,43 @@ void web_task()
 	// Configure the save palette
 	set_save_palette(out_state.gui_palette_index);
 	
+	_web_init_asset_etag();
+	
 	// Initialize cmd interface
 	if (!ws_gui_cmd_init()) {
 		ESP_LOGE(TAG, "Could not initialize command interface");
 		ctrl_set_fault_type(CTRL_FAULT_WEB_SERVER);
 		vTaskDelete(NULL);
 	}
+	ws_cmd_set_rx_set_callback(_web_note_set);
+	
+	// Allocate per-client send buffers
+	if (!_web_init_clients()) {
+		ESP_LOGE(TAG, "Could not allocate client buffers");
+		ctrl_set_fault_type(CTRL_FAULT_WEB_SERVER);
+		vTaskDelete(NULL);
+	}
+	
+	// Allocate MJPEG stream buffers
+	if (!_web_init_stream()) {
+		ESP_LOGE(TAG, "Could not allocate stream buffers");
+		ctrl_set_fault_type(CTRL_FAULT_WEB_SERVER);
+		vTaskDelete(NULL);
+	}
+	
+	// Allocate HTTP API buffers
+	if (!_web_init_api()) {
+		ESP_LOGE(TAG, "Could not allocate HTTP API buffers");
+		ctrl_set_fault_type(CTRL_FAULT_WEB_SERVER);
+		vTaskDelete(NULL);
+	}
+	
+	// Firmware update synchronization
+	if (!_web_init_ota()) {
+		ESP_LOGE(TAG, "Could not create firmware update queues");
+		ctrl_set_fault_type(CTRL_FAULT_WEB_SERVER);
+		vTaskDelete(NULL);
+	}
 	
 	// Wait until we are connected to start the web server
 	while (!wifi_is_connected()) {
@@ -199,12 +708,8 @@ void web_task()
 
 	
 	while (1) {
-		_web_handle_notifications();
-
-		// Give the scheduler some time between images
-		if (!notify_image_1 && !notify_image_2) {
-			vTaskDelay(pdMS_TO_TICKS(10));
-		}
+		// Block until notified (e.g. a new frame) or the next timed evaluation is due
+		_web_handle_notifications(_web_get_eval_wait());
 		
 		// Look for notifications that we've been asked to take a picture from
 		//   - local button press via ctrl_task
@@ -218,10 +723,42 @@ void web_task()
 			// Look for things to send to a connected client over the websocket
 			clients = max_sockets;
 			if ((ret = httpd_get_client_list(server, &clients, client_fds)) == ESP_OK) {
+				if ((clients != 0) && !client_connected) {
+					// Return t1c_task to the full frame rate for the new client
+					client_connected = true;
+					t1c_wake();
+				}
 				client_connected = (clients != 0);
+				_web_update_clients(clients, client_fds);
+				
+				// Only send the newest image if both buffers were filled since last time.
+				// It is encoded once for all clients.
+				img_index = -1;
+				if (cmd_handler_stream_enabled() && !ota_running) {
+					if (notify_image_1 && notify_image_2) {
+						img_index = (out_t1c_buffer[1].frame_seq > out_t1c_buffer[0].frame_seq) ? 1 : 0;
+					} else if (notify_image_1) {
+						img_index = 0;
+					} else if (notify_image_2) {
+						img_index = 1;
+					}
+				}
+				cur_img_pktP = NULL;
+				cur_same_pktP = NULL;
+				
+				// Look for changes to subscribed items with each image while streaming and
+				// every CMD_SUB_IDLE_MSEC otherwise
+				sub_len = 0;
+				if ((clients != 0) && ((img_index >= 0) || ((esp_timer_get_time() - sub_check_usec) >= (CMD_SUB_IDLE_MSEC * 1000)))) {
+					sub_len = _web_check_subscriptions();
+				}
+				
+				// State changed by one client is encoded once for all the others
+				bcast_bufP = _web_build_broadcast(clients, &bcast_sock);
+				
 				for (int i=0; i<clients; i++) {
 					sock = client_fds[i];
-					if (httpd_ws_get_fd_info(server, sock) == HTTPD_WS_CLIENT_WEBSOCKET) {
+					if ((httpd_ws_get_fd_info(server, sock) == HTTPD_WS_CLIENT_WEBSOCKET) && _web_check_client_alive(server, sock)) {
 						// Look for things to send
 						if (notify_network_disconnect) {
 							ret = httpd_sess_trigger_close(server, sock);
@@ -262,14 +799,34 @@ void web_task()
 							_web_send_cmd(server, sock, SEND_CMD_CTRL_ACT_FAILED);
 						}
 						
+						if (notify_ctrl_act_progress) {
+							_web_send_cmd(server, sock, SEND_CMD_CTRL_ACT_PROGRESS);
+						}
+						
 						if (notify_catalog_response) {
 							_web_send_cmd(server, sock, SEND_CMD_FILE_CATALOG);
 						}
 						
+						if (notify_page_response) {
+							_web_send_cmd(server, sock, SEND_CMD_FILE_PAGE);
+						}
+						
+						if (notify_range_response) {
+							_web_send_cmd(server, sock, SEND_CMD_FILE_RANGE);
+						}
+						
 						if (notify_file_image_response) {
 							_web_send_cmd(server, sock, SEND_CMD_FILE_IMAGE);
 						}
 						
+						if (notify_file_jpeg_response) {
+							_web_send_cmd(server, sock, SEND_CMD_FILE_JPEG);
+						}
+						
+						if (notify_file_thumb_response) {
+							_web_send_cmd(server, sock, SEND_CMD_FILE_THUMB);
+						}
+						
 						if (notify_timelapse_on) {
 							_web_send_cmd(server, sock, SEND_CMD_TIMELAPSE_ON);
 						}
@@ -278,15 +835,44 @@ void web_task()
 							_web_send_cmd(server, sock, SEND_CMD_TIMELAPSE_OFF);
 						}
 						
-						if (notify_image_1 && cmd_handler_stream_enabled()) {
-							_web_send_image(server, sock, 0);
+						if (notify_telemetry) {
+							_web_send_cmd(server, sock, SEND_CMD_TELEMETRY);
+						}
+						
+						if (sub_len != 0) {
+							(void) cmd_send_binary(CMD_SET, CMD_BATCH, sub_len, sub_changed);
+							_web_queue_cmd_packets(server, sock);
+						}
+						
+						if ((bcast_bufP != NULL) && (sock != bcast_sock)) {
+							_web_queue_cmd_buf(server, sock, bcast_bufP);
 						}
 						
-						if (notify_image_2 && cmd_handler_stream_enabled()) {
-							_web_send_image(server, sock, 1);
+						if (img_index >= 0) {
+							_web_send_image(server, sock, img_index);
 						}
 					}
 				}
+				
+				if (bcast_bufP != NULL) {
+					_web_release_cmd_buf(bcast_bufP);
+				}
+				
+				// Send the newest image over UDP too if a client asked for it and to the
+				// multicast group if it is enabled
+				if ((notify_image_1 || notify_image_2) && !ota_running) {
+					if (notify_image_1 && notify_image_2) {
+						img_index = (out_t1c_buffer[1].frame_seq > out_t1c_buffer[0].frame_seq) ? 1 : 0;
+					} else {
+						img_index = notify_image_1 ? 0 : 1;
+					}
+					if (_web_udp_stream_active(clients, client_fds, &udp_dest, &udp_dest_format)) {
+						_web_send_udp_image(&udp_dest, udp_dest_format, &udp_pkt_seq, img_index);
+					}
+					if (_web_mcast_stream_active(&udp_dest, &udp_dest_format)) {
+						_web_send_udp_image(&udp_dest, udp_dest_format, &mcast_pkt_seq, img_index);
+					}
+				}
 			} else {
 				ESP_LOGE(TAG, "httpd_get_client_list failed (%d)", ret);
 			}
@@ -304,10 +890,16 @@ void web_task()
 		notify_clear_file_message = false;
 		notify_ctrl_act_succeeded = false;
 		notify_ctrl_act_failed = false;
+		notify_ctrl_act_progress = false;
 		notify_catalog_response = false;
+		notify_page_response = false;
+		notify_range_response = false;
 		notify_file_image_response = false;
+		notify_file_jpeg_response = false;
+		notify_file_thumb_response = false;
 		notify_timelapse_on = false;
 		notify_timelapse_off = false;
+		notify_telemetry = false;
 		notify_image_1 = false;
 		notify_image_2 = false;
 	}
@@ -320,16 +912,170 @@ bool web_has_client()
 }
 
 
+/**
+ * Returns true if images are being sent to a client or multicast group
+ */
+bool web_needs_frames()
+{
+	return (client_connected || (mcast_format != CMD_STREAM_OFF)) && !ota_running;
+}
+
+
+/**
+ * Start sending images over UDP to port on the client whose websocket command is being
+ * processed, replacing any existing UDP stream, or stop it if port is 0.  Called in the
+ * httpd task.  Returns false if the client's address can't be determined.
+ */
+bool web_set_udp_stream(uint16_t port, int format, int decimation)
+{
+	struct sockaddr_storage peer;
+	socklen_t peer_len = sizeof(peer);
+	uint32_t ip;
+	
+	if (port == 0) {
+		portENTER_CRITICAL(&udp_mux);
+		udp_owner_sock = -1;
+		portEXIT_CRITICAL(&udp_mux);
+		return true;
+	}
+	
+	// The httpd sockets are IPv6 with IPv4 clients at IPv4-mapped addresses
+	if (getpeername(ws_rx_sock, (struct sockaddr*) &peer, &peer_len) != 0) {
+		ESP_LOGE(TAG, "Could not get UDP stream client address (%d)", errno);
+		return false;
+	}
+	if (peer.ss_family == AF_INET6) {
+		ip = ((struct sockaddr_in6*) &peer)->sin6_addr.un.u32_addr[3];
+	} else {
+		ip = ((struct sockaddr_in*) &peer)->sin_addr.s_addr;
+	}
+	
+	portENTER_CRITICAL(&udp_mux);
+	memset(&udp_addr, 0, sizeof(udp_addr));
+	udp_addr.sin_family = AF_INET;
+	udp_addr.sin_port = htons(port);
+	udp_addr.sin_addr.s_addr = ip;
+	udp_format = format;
+	udp_decimation = decimation;
+	udp_owner_sock = ws_rx_sock;
+	portEXIT_CRITICAL(&udp_mux);
+	
+	return true;
+}
+
+
+/**
+ * Get the UDP stream configuration (port is 0 when it is off)
+ */
+void web_get_udp_stream(uint16_t* port, int* format, int* decimation)
+{
+	portENTER_CRITICAL(&udp_mux);
+	*port = (udp_owner_sock < 0) ? 0 : ntohs(udp_addr.sin_port);
+	*format = udp_format;
+	*decimation = udp_decimation;
+	portEXIT_CRITICAL(&udp_mux);
+}
+
+
+/**
+ * Start sending images to the multicast group, or stop if format is CMD_STREAM_OFF.  The
+ * stream is advertised with mDNS while it is running.
+ */
+void web_set_mcast_stream(int format, int decimation)
+{
+	bool was_on;
+	
+	portENTER_CRITICAL(&udp_mux);
+	was_on = (mcast_format != CMD_STREAM_OFF);
+	mcast_format = format;
+	mcast_decimation = decimation;
+	portEXIT_CRITICAL(&udp_mux);
+	
+	if (was_on != (format != CMD_STREAM_OFF)) {
+		wifi_set_mcast_service(CMD_MCAST_GROUP, (format != CMD_STREAM_OFF) ? CMD_MCAST_PORT : 0);
+	}
+	if (format != CMD_STREAM_OFF) {
+		t1c_wake();
+	}
+}
+
+
+void web_get_mcast_stream(int* format, int* decimation)
+{
+	portENTER_CRITICAL(&udp_mux);
+	*format = mcast_format;
+	*decimation = mcast_decimation;
+	portEXIT_CRITICAL(&udp_mux);
+}
+
+
+/**
+ * Get the image stream statistics for the connected websocket clients
+ */
+void web_get_link_stats(web_link_stats_t* stats)
+{
+	int64_t cur_usec = esp_timer_get_time();
+	web_link_client_t* linkP;
+	
+	stats->num_clients = 0;
+	
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	for (int i=0; i<max_sockets; i++) {
+		if (web_clients[i].sock < 0) continue;
+		
+		linkP = &stats->clients[stats->num_clients++];
+		*linkP = web_clients[i].link;
+		linkP->rate_x10 = (uint32_t) _web_get_client_rate(&web_clients[i]);
+		if ((cur_usec - web_clients[i].win_start_usec) > (2 * WEB_LINK_WINDOW_USEC)) {
+			// Not streaming
+			linkP->bytes_per_sec = 0;
+			linkP->fps_x10 = 0;
+			linkP->send_avg_usec = 0;
+			linkP->send_max_usec = 0;
+		}
+	}
+	xSemaphoreGive(img_pkt_mutex);
+}
+
+
 
 //
 // WEB Task Internal functions
 //
-static void _web_handle_notifications()
+/**
+ * Get how long the main loop can block waiting for a notification: until the next
+ * subscription check while a client is connected or WEB_TASK_EVAL_MSEC
+ */
+static TickType_t _web_get_eval_wait()
+{
+	int64_t wait_usec = WEB_TASK_EVAL_MSEC * 1000;
+	int64_t sub_usec;
+	
+	if (client_connected) {
+		sub_usec = sub_check_usec + (CMD_SUB_IDLE_MSEC * 1000) - esp_timer_get_time();
+		if (sub_usec < wait_usec) {
+			wait_usec = sub_usec;
+		}
+	}
+	
+	if (wait_usec <= 0) {
+		return 0;
+	}
+	
+	return pdMS_TO_TICKS(wait_usec / 1000 + 1);
+}
+
+
+/**
+ * Process notifications from other tasks, waiting up to wait ticks for one.
+ * WEB_NOTIFY_BCAST_MASK only wakes us since the pending items are kept by _web_note_set.
+ */
+static void _web_handle_notifications(TickType_t wait)
 {
 	uint32_t notification_value;
 	
 	notification_value = 0;
-	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, 0)) {
+	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, wait)) {
 		if (Notification(notification_value, WEB_NOTIFY_T1C_FRAME_MASK_1)) {
 			notify_image_1 = true;
 		}
@@ -348,10 +1094,16 @@ static void _web_handle_notifications()
 		
 		if (Notification(notification_value, WEB_NOTIFY_FW_UPD_EN_MASK)) {
 			notify_fw_upd_en = true;
+			if (ota_waiting_auth) {
+				xSemaphoreGive(ota_auth_sem);
+			}
 		}
 		
 		if (Notification(notification_value, WEB_NOTIFY_FW_UPD_END_MASK)) {
 			notify_fw_upd_end = true;
+			if (ota_running) {
+				ota_abort = true;
+			}
 		}
 		
 		if (Notification(notification_value, WEB_NOTIFY_CRIT_BATT_DET_MASK)) {
@@ -374,10 +1126,26 @@ static void _web_handle_notifications()
 			notify_catalog_response = true;
 		}
 		
+		if (Notification(notification_value, WEB_NOTIFY_FILE_PAGE_READY_MASK)) {
+			notify_page_response = true;
+		}
+		
+		if (Notification(notification_value, WEB_NOTIFY_FILE_RANGE_READY_MASK)) {
+			notify_range_response = true;
+		}
+		
 		if (Notification(notification_value, WEB_NOTIFY_FILE_IMAGE_READY_MASK)) {
 			notify_file_image_response = true;
 		}
 		
+		if (Notification(notification_value, WEB_NOTIFY_FILE_JPEG_READY_MASK)) {
+			notify_file_jpeg_response = true;
+		}
+		
+		if (Notification(notification_value, WEB_NOTIFY_FILE_THUMB_READY_MASK)) {
+			notify_file_thumb_response = true;
+		}
+		
 		if (Notification(notification_value, WEB_NOTIFY_FILE_TIMELAPSE_ON_MASK)) {
 			notify_timelapse_on = true;
 		}
@@ -393,6 +1161,14 @@ static void _web_handle_notifications()
 		if (Notification(notification_value, WEB_NOTIFY_CTRL_ACT_FAILED_MASK)) {
 			notify_ctrl_act_failed = true;
 		}
+		
+		if (Notification(notification_value, WEB_NOTIFY_CTRL_ACT_PROGRESS_MASK)) {
+			notify_ctrl_act_progress = true;
+		}
+		
+		if (Notification(notification_value, WEB_NOTIFY_TELEMETRY_MASK)) {
+			notify_telemetry = true;
+		}
 
 	}
 }
@@ -405,6 +1181,7 @@ static httpd_handle_t _web_start_webserver(void)
     
     // Setup our specific config items
     config.max_open_sockets = max_sockets;
+    config.max_uri_handlers = WEB_MAX_URI_HANDLERS;
 
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
@@ -412,8 +1189,19 @@ static httpd_handle_t _web_start_webserver(void)
         // Registering the ws handler
         ESP_LOGI(TAG, "Registering URI handlers");
         httpd_register_uri_handler(server, &uri_get);
+#ifdef WEB_SPLIT_ASSETS
+        httpd_register_uri_handler(server, &uri_get_js);
+        httpd_register_uri_handler(server, &uri_get_wasm);
+#endif
         httpd_register_uri_handler(server, &uri_get_favicon);
         httpd_register_uri_handler(server, &uri_ws);
+        httpd_register_uri_handler(server, &uri_frame_raw);
+        httpd_register_uri_handler(server, &uri_frame_jpg);
+        httpd_register_uri_handler(server, &uri_stats);
+        httpd_register_uri_handler(server, &uri_update);
+        
+        // Start the MJPEG stream server (the camera is still usable without it)
+        stream_server = _web_start_stream_server();
         return server;
     }
 
@@ -424,8 +1212,19 @@ static httpd_handle_t _web_start_webserver(void)
 
 static esp_err_t _web_stop_webserver(httpd_handle_t server)
 {
-    // Stop the httpd server
-    return httpd_stop(server);
+    esp_err_t ret;
+    
+    // Stop the httpd servers
+    if (stream_server != NULL) {
+    	(void) httpd_stop(stream_server);
+    	stream_server = NULL;
+    }
+    ret = httpd_stop(server);
+    
+    // Any queued sends were discarded with the server
+    _web_reset_clients();
+    
+    return ret;
 }
 
 
@@ -458,30 +1257,47 @@ static void _web_disconnect_handler(void* arg, esp_event_base_t event_base, int3
 }
 
 
-static esp_err_t _web_req_handler(httpd_req_t *req)
+static void _web_init_asset_etag()
 {
-	uint32_t len = index_html_end - index_html_start;
-	
-	ESP_LOGI(TAG, "Sending index.html");
+	char sha[9];
+	const esp_app_desc_t* app_desc;
 	
-	if (httpd_resp_set_hdr(req, "Content-Encoding", "gzip") != ESP_OK) {
-		ESP_LOGE(TAG, "set_hdr failed");
-		return false;
-	}
-	
-	return httpd_resp_send(req, (const char*) index_html_start, (ssize_t) len);
+	app_desc = esp_app_get_description();
+	(void) esp_app_get_elf_sha256(sha, sizeof(sha));
+	snprintf(asset_etag, sizeof(asset_etag), "\"%s-%s\"", app_desc->version, sha);
 }
 
 
-static esp_err_t _web_favicon_handler(httpd_req_t *req)
+// Send the embedded asset in the uri's user_ctx.  Browsers have to revalidate their cached
+// copy ("no-cache") since the asset changes with the firmware but its uri doesn't.
+static esp_err_t _web_asset_handler(httpd_req_t *req)
 {
-	uint32_t len = favicon_ico_end - favicon_ico_start;
+	char etag[WEB_ASSET_ETAG_LEN];
+	const web_asset_t* assetP = (const web_asset_t*) req->user_ctx;
+	uint32_t len = assetP->end - assetP->start;
+	
+	(void) httpd_resp_set_hdr(req, "ETag", asset_etag);
+	(void) httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
 	
-	ESP_LOGI(TAG, "Sending favicon");
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", etag, sizeof(etag)) == ESP_OK) {
+		if (strcmp(etag, asset_etag) == 0) {
+			ESP_LOGI(TAG, "%s not modified", req->uri);
+			(void) httpd_resp_set_status(req, "304 Not Modified");
+			return httpd_resp_send(req, NULL, 0);
+		}
+	}
 	
-	(void) httpd_resp_set_type(req, "image/x-icon");
+	ESP_LOGI(TAG, "Sending %s", req->uri);
+	
+	(void) httpd_resp_set_type(req, assetP->type);
+	if (assetP->gzip) {
+		if (httpd_resp_set_hdr(req, "Content-Encoding", "gzip") != ESP_OK) {
+			ESP_LOGE(TAG, "set_hdr failed");
+			return ESP_FAIL;
+		}
+	}
 	
-	return httpd_resp_send(req, (const char*) favicon_ico_start, (ssize_t) len);
+	return httpd_resp_send(req, (const char*) assetP->start, (ssize_t) len);
 }
 
 
@@ -496,6 +1312,9 @@ static esp_err_t _web_ws_handler(httpd_req_t *req)
         return ESP_OK;
     }
     
+    // Any frame (pongs are passed to us too) shows the client is still there
+    _web_note_client_rx(httpd_req_to_sockfd(req));
+    
     // Look for incoming packets to process
     memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
     ws_pkt.type = HTTPD_WS_TYPE_BINARY;
@@ -515,10 +1334,19 @@ static esp_err_t _web_ws_handler(httpd_req_t *req)
         }
         
         // May push response data into the tx buffer
+        ws_rx_sock = httpd_req_to_sockfd(req);
         (void) ws_cmd_process_socket_rx_data(ws_pkt.len, ws_pkt.payload);
         
-        // Check for response data (from a GET)
-        while (ws_cmd_get_tx_data((uint32_t*) &ws_pkt.len, &ws_pkt.payload)) {
+        // Check for response data (from a GET), combining the responses into as few frames
+        // as possible
+        while (true) {
+        	ws_pkt.len = ws_cmd_get_tx_batch(ws_rsp_buf, WEB_CMD_BUF_LEN);
+        	if (ws_pkt.len != 0) {
+        		ws_pkt.payload = ws_rsp_buf;
+        	} else if (!ws_cmd_get_tx_data((uint32_t*) &ws_pkt.len, &ws_pkt.payload)) {
+        		break;
+        	}
+        	
         	// Send the response
         	ws_pkt.type = HTTPD_WS_TYPE_BINARY;
         	ws_pkt.final = true;
@@ -536,9 +1364,6 @@ static esp_err_t _web_ws_handler(httpd_req_t *req)
 
 static void _web_send_cmd(httpd_handle_t handle, int sock, send_cmd_type_t cmd_type)
 {
-	esp_err_t ret;
-	httpd_ws_frame_t ws_pkt;
-	
 	if (handle == NULL) return;
 	
 	// Create the specific command to send
@@ -564,8 +1389,20 @@ static void _web_send_cmd(httpd_handle_t handle, int sock, send_cmd_type_t cmd_t
 		case SEND_CMD_FILE_CATALOG:
 			_web_send_get_file_catalog_response();
 			break;
+		case SEND_CMD_FILE_PAGE:
+			_web_send_get_file_catalog_page_response();
+			break;
+		case SEND_CMD_FILE_RANGE:
+			_web_send_get_file_catalog_range_response();
+			break;
 		case SEND_CMD_FILE_IMAGE:
-			_web_send_get_file_image_response();
+			_web_send_get_file_image_response(handle, sock);
+			break;
+		case SEND_CMD_FILE_JPEG:
+			_web_send_get_file_jpeg_response(handle, sock);
+			break;
+		case SEND_CMD_FILE_THUMB:
+			_web_send_get_file_thumb_response(handle, sock);
 			break;
 		case SEND_CMD_TIMELAPSE_ON:
 			(void) cmd_send_int32(CMD_SET, CMD_TIMELAPSE_STATUS, 1);
@@ -579,18 +1416,16 @@ static void _web_send_cmd(httpd_handle_t handle, int sock, send_cmd_type_t cmd_t
 		case SEND_CMD_CTRL_ACT_FAILED:
 			(void) cmd_send_int32(CMD_RSP, CMD_CTRL_ACTIVITY, 0);
 			break;
+		case SEND_CMD_CTRL_ACT_PROGRESS:
+			_web_send_ctrl_activity_progress();
+			break;
+		case SEND_CMD_TELEMETRY:
+			cmd_handler_get_telemetry(CMD_DATA_NONE, 0, NULL);
+			break;
 	}
 	
-	// Synchronously send the packet
-	while (ws_cmd_get_tx_data((uint32_t*) &ws_pkt.len, &ws_pkt.payload)) {
-		ws_pkt.type = HTTPD_WS_TYPE_BINARY;
-		ws_pkt.final = true;
-		ws_pkt.fragmented = false;
-		ret = httpd_ws_send_data(handle, sock, &ws_pkt);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "httpd_ws_send_data failed - %d", ret);
-		}
-	}
+	// Queue the packet for the httpd task to send
+	_web_queue_cmd_packets(handle, sock);
 }
 
 
@@ -599,20 +1434,74 @@ static void _web_send_image(httpd_handle_t handle, int sock, int render_buf_inde
 	esp_err_t ret;
 	t1c_buffer_t* t1cP = (render_buf_index == 0) ? &out_t1c_buffer[0] : &out_t1c_buffer[1];
 	httpd_ws_frame_t ws_pkt;
+	web_client_t* clientP;
+	web_img_pkt_t* pktP;
+	web_img_pkt_t** cur_pktPP;
+	int64_t stage_usec;
+	uint32_t key;
+	bool same;
 	
 	if (handle == NULL) return;
 	
-	(void) ws_cmd_send_t1c_image(t1cP);
+	// Drop this frame for a client still sending the previous one or whose link can't
+	// keep up with the full frame rate
+	clientP = _web_get_client(sock);
+	if ((clientP == NULL) || (clientP->img_pktP != NULL)) return;
+	if ((esp_timer_get_time() - clientP->last_img_usec) < (WEB_RATE_HEADROOM * clientP->send_avg_usec)) {
+		return;
+	}
+	_web_send_stream_rate(handle, clientP);
+	
+	// Just send the metadata to a client that already has this image (with a full image
+	// every so often in case it missed something)
+	key = ws_cmd_t1c_image_key(t1cP);
+	same = clientP->img_key_valid && (key == clientP->img_key) && (clientP->img_same_count < CMD_IMAGE_SAME_MAX);
 	
-	// Synchronously send the packet
-	if (ws_cmd_get_tx_data((uint32_t*) &ws_pkt.len, &ws_pkt.payload)) {
-		ws_pkt.type = HTTPD_WS_TYPE_BINARY;
-		ws_pkt.final = true;
-		ws_pkt.fragmented = false;
-		ret = httpd_ws_send_data(handle, sock, &ws_pkt);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "httpd_ws_send_data image failed - %d", ret);
+	// Encode the packet the first time it is needed this pass
+	cur_pktPP = same ? &cur_same_pktP : &cur_img_pktP;
+	if (*cur_pktPP == NULL) {
+		if ((pktP = _web_get_free_img_pkt(same ? img_same_pkts : img_pkts)) == NULL) {
+			ESP_LOGE(TAG, "No free image packet");
+			return;
+		}
+		t1c_note_frame_consumed(T1C_CONSUMER_WEB, t1cP->frame_seq);
+		if (same) {
+			pktP->len = ws_cmd_encode_t1c_image_same(t1cP, pktP->buf);
+		} else {
+			stage_usec = perf_start();
+			pktP->len = ws_cmd_encode_t1c_image(t1cP, pktP->buf);
+			perf_end(PERF_STAGE_SERIALIZE, stage_usec);
 		}
+		pktP->same = same;
+		*cur_pktPP = pktP;
+	}
+	pktP = *cur_pktPP;
+	
+	if (same) {
+		clientP->img_same_count += 1;
+	} else {
+		clientP->img_key = key;
+		clientP->img_key_valid = true;
+		clientP->img_same_count = 0;
+	}
+	
+	// Asynchronously send the shared packet, holding a reference until it is done
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	pktP->ref_count += 1;
+	clientP->img_pktP = pktP;
+	clientP->send_start_usec = esp_timer_get_time();
+	clientP->last_img_usec = clientP->send_start_usec;
+	xSemaphoreGive(img_pkt_mutex);
+	
+	ws_pkt.payload = pktP->buf;
+	ws_pkt.len = pktP->len;
+	ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+	ws_pkt.final = true;
+	ws_pkt.fragmented = false;
+	ret = httpd_ws_send_data_async(handle, sock, &ws_pkt, _web_image_packet_done, clientP);
+	if (ret != ESP_OK) {
+		// Release the reference since the send was never queued
+		_web_image_packet_done(ret, sock, clientP);
 	}
 }
 
@@ -641,10 +1530,1745 @@ static void _web_send_get_file_catalog_response()
 }
 
 
-// web_task specific routine to send an image to a remote response handler
-static void _web_send_get_file_image_response()
+// web_task specific routine to send a catalog page to a remote response handler
+static void _web_send_get_file_catalog_page_response()
 {
-	(void) ws_cmd_send_file_image(rgb_file_image);
+	static uint8_t buf[CMD_FILE_CATALOG_PAGE_HDR_LEN + FILE_MAX_CATALOG_PAGE*(8 + FILE_NAME_LEN)];
+	file_catalog_entry_t* entryP;
+	int num, type, offset, total;
+	int n;
+	uint8_t* bufP = buf;
+	
+	// Get the catalog page from file_task
+	entryP = file_get_catalog_page_entries(&num, &type, &offset, &total);
+	
+	// Header
+	*((uint16_t*) &bufP[0]) = htons((uint16_t) ((int16_t) type));
+	*((uint16_t*) &bufP[2]) = htons((uint16_t) total);
+	*((uint16_t*) &bufP[4]) = htons((uint16_t) offset);
+	*((uint16_t*) &bufP[6]) = htons((uint16_t) num);
+	bufP += CMD_FILE_CATALOG_PAGE_HDR_LEN;
+	
+	// Entries
+	while (num--) {
+		*((uint32_t*) &bufP[0]) = htonl(entryP->size);
+		*((uint32_t*) &bufP[4]) = htonl(entryP->timestamp);
+		n = strlen(entryP->name) + 1;
+		memcpy(&bufP[8], entryP->name, n);
+		bufP += 8 + n;
+		entryP++;
+	}
+	
+	(void) cmd_send_binary(CMD_RSP, CMD_FILE_CATALOG_PAGE, (uint32_t) (bufP - buf), buf);
+}
+
+
+// web_task specific routine to send the files in a catalog time range to a remote response handler
+static void _web_send_get_file_catalog_range_response()
+{
+	static uint8_t buf[CMD_FILE_CATALOG_RANGE_HDR_LEN + FILE_MAX_CATALOG_RANGE*CMD_FILE_CATALOG_RANGE_ENT_LEN];
+	file_range_entry_t* entryP;
+	uint32_t start, end;
+	int num, offset, total;
+	uint8_t* bufP = buf;
+	
+	// Get the matching files from file_task
+	entryP = file_get_catalog_range_entries(&num, &start, &end, &offset, &total);
+	
+	// Header
+	*((uint32_t*) &bufP[0]) = htonl(start);
+	*((uint32_t*) &bufP[4]) = htonl(end);
+	*((uint16_t*) &bufP[8]) = htons((uint16_t) total);
+	*((uint16_t*) &bufP[10]) = htons((uint16_t) offset);
+	*((uint16_t*) &bufP[12]) = htons((uint16_t) num);
+	*((uint16_t*) &bufP[14]) = 0;
+	bufP += CMD_FILE_CATALOG_RANGE_HDR_LEN;
+	
+	// Entries
+	while (num--) {
+		*((uint16_t*) &bufP[0]) = htons(entryP->dir_index);
+		*((uint16_t*) &bufP[2]) = htons(entryP->file_index);
+		*((uint32_t*) &bufP[4]) = htonl(entryP->timestamp);
+		bufP += CMD_FILE_CATALOG_RANGE_ENT_LEN;
+		entryP++;
+	}
+	
+	(void) cmd_send_binary(CMD_RSP, CMD_FILE_CATALOG_RANGE, (uint32_t) (bufP - buf), buf);
+}
+
+
+// web_task specific routine to send an image to a remote response handler.  The image is
+// large so it is sent by the httpd task directly from rgb_file_image instead of being
+// copied into a packet.
+static void _web_send_get_file_image_response(httpd_handle_t handle, int sock)
+{
+	_web_queue_file_pkt(handle, sock, CMD_FILE_GET_IMAGE, 3*T1C_WIDTH*T1C_HEIGHT);
+}
+
+
+// web_task specific routine to send the raw jpeg file (left in rgb_file_image by file_task)
+// to a remote response handler for decoding by the browser
+static void _web_send_get_file_jpeg_response(httpd_handle_t handle, int sock)
+{
+	_web_queue_file_pkt(handle, sock, CMD_FILE_GET_JPEG, file_get_jpeg_file_len());
+}
+
+
+// web_task specific routine to send the thumbnail jpeg file (left in rgb_file_image by
+// file_task) to a remote response handler for decoding by the browser
+static void _web_send_get_file_thumb_response(httpd_handle_t handle, int sock)
+{
+	_web_queue_file_pkt(handle, sock, CMD_FILE_GET_THUMB, file_get_jpeg_file_len());
+}
+
+
+// Queue a response whose len bytes of data are sent from rgb_file_image by the httpd task
+static void _web_queue_file_pkt(httpd_handle_t handle, int sock, cmd_id_t id, uint32_t len)
+{
+	web_file_image_pkt_t* pktP;
+	
+	pktP = (web_file_image_pkt_t*) malloc(sizeof(web_file_image_pkt_t));
+	if (pktP == NULL) {
+		ESP_LOGE(TAG, "malloc file image packet failed");
+		return;
+	}
+	pktP->handle = handle;
+	pktP->sock = sock;
+	pktP->len = len;
+	ws_cmd_encode_header(CMD_RSP, id, CMD_DATA_BINARY, len, pktP->hdr);
+	
+	if (httpd_queue_work(handle, _web_send_file_image_work, pktP) != ESP_OK) {
+		ESP_LOGE(TAG, "httpd_queue_work file image failed");
+		free(pktP);
+	}
+}
+
+
+// Called in the httpd task to send both fragments of a file image response in one work
+// item so nothing else can be sent to the client between them
+static void _web_send_file_image_work(void* arg)
+{
+	esp_err_t ret;
+	httpd_ws_frame_t ws_pkt;
+	web_file_image_pkt_t* pktP = (web_file_image_pkt_t*) arg;
+	
+	ws_pkt.payload = pktP->hdr;
+	ws_pkt.len = WS_CMD_HDR_LEN;
+	ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+	ws_pkt.final = false;
+	ws_pkt.fragmented = true;
+	ret = httpd_ws_send_frame_async(pktP->handle, pktP->sock, &ws_pkt);
+	
+	if (ret == ESP_OK) {
+		ws_pkt.payload = (uint8_t*) rgb_file_image;
+		ws_pkt.len = pktP->len;
+		ws_pkt.type = HTTPD_WS_TYPE_CONTINUE;
+		ws_pkt.final = true;
+		ret = httpd_ws_send_frame_async(pktP->handle, pktP->sock, &ws_pkt);
+	}
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "file image send failed - %d", ret);
+	}
+	
+	free(pktP);
+}
+
+
+// web_task specific routine to send controller activity progress to a remote response handler
+static void _web_send_ctrl_activity_progress()
+{
+	int step, num_steps;
+	uint8_t buf[CMD_CTRL_ACT_PROGRESS_LEN];
+	uint32_t* tx32P = (uint32_t*) buf;
+	
+	t1c_get_activity_progress(&step, &num_steps);
+	*tx32P++ = htonl((uint32_t) step);
+	*tx32P = htonl((uint32_t) num_steps);
+	
+	(void) cmd_send_binary(CMD_RSP, CMD_CTRL_ACTIVITY, CMD_CTRL_ACT_PROGRESS_LEN, buf);
+}
+
+
+static bool _web_init_clients()
+{
+	img_pkt_mutex = xSemaphoreCreateMutex();
+	
+	for (int i=0; i<WEB_NUM_IMG_PKTS; i++) {
+		img_pkts[i].ref_count = 0;
+		img_pkts[i].buf = (uint8_t*) heap_caps_malloc(WS_CMD_MAX_PKT_LEN, MALLOC_CAP_SPIRAM);
+		img_same_pkts[i].ref_count = 0;
+		img_same_pkts[i].buf = (uint8_t*) heap_caps_malloc(WS_CMD_SAME_PKT_LEN, MALLOC_CAP_SPIRAM);
+		if ((img_pkts[i].buf == NULL) || (img_same_pkts[i].buf == NULL)) {
+			ESP_LOGE(TAG, "malloc image packet buffer failed");
+			return false;
+		}
+	}
+	
+	cmd_buf_mutex = xSemaphoreCreateMutex();
+	
+	for (int i=0; i<WEB_NUM_CMD_BUFS; i++) {
+		cmd_bufs[i].ref_count = 0;
+		cmd_bufs[i].buf = (uint8_t*) heap_caps_malloc(WEB_CMD_BUF_LEN, MALLOC_CAP_SPIRAM);
+		if (cmd_bufs[i].buf == NULL) {
+			ESP_LOGE(TAG, "malloc command buffer failed");
+			return false;
+		}
+	}
+	
+	ws_rsp_buf = (uint8_t*) heap_caps_malloc(WEB_CMD_BUF_LEN, MALLOC_CAP_SPIRAM);
+	if (ws_rsp_buf == NULL) {
+		ESP_LOGE(TAG, "malloc response buffer failed");
+		return false;
+	}
+	
+	_web_reset_clients();
+	
+	return true;
+}
+
+
+static void _web_reset_clients()
+{
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	for (int i=0; i<max_sockets; i++) {
+		web_clients[i].sock = -1;
+		web_clients[i].img_pktP = NULL;
+		web_clients[i].closing = false;
+	}
+	for (int i=0; i<WEB_NUM_IMG_PKTS; i++) {
+		img_pkts[i].ref_count = 0;
+		img_same_pkts[i].ref_count = 0;
+	}
+	xSemaphoreGive(img_pkt_mutex);
+}
+
+
+// Release the state of clients that have gone away (once any send in progress has completed)
+static void _web_update_clients(size_t num_fds, int* fds)
+{
+	bool found;
+	
+	for (int i=0; i<max_sockets; i++) {
+		if ((web_clients[i].sock >= 0) && (web_clients[i].img_pktP == NULL)) {
+			found = false;
+			for (int j=0; j<num_fds; j++) {
+				if (fds[j] == web_clients[i].sock) found = true;
+			}
+			if (!found) {
+				web_clients[i].sock = -1;
+			}
+		}
+	}
+}
+
+
+// Return the state for a client, assigning an unused entry for a new client
+static web_client_t* _web_get_client(int sock)
+{
+	web_client_t* freeP = NULL;
+	
+	for (int i=0; i<max_sockets; i++) {
+		if (web_clients[i].sock == sock) {
+			return &web_clients[i];
+		} else if ((web_clients[i].sock < 0) && (freeP == NULL)) {
+			freeP = &web_clients[i];
+		}
+	}
+	
+	if (freeP != NULL) {
+		// New clients start at the full rate
+		freeP->sock = sock;
+		freeP->last_img_usec = 0;
+		freeP->send_avg_usec = 0;
+		freeP->report_usec = 0;
+		freeP->reported_rate = 0;
+		freeP->img_key_valid = false;
+		
+		// And new link statistics
+		xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+		freeP->win_start_usec = esp_timer_get_time();
+		freeP->win_bytes = 0;
+		freeP->win_frames = 0;
+		freeP->win_send_usec = 0;
+		freeP->win_max_usec = 0;
+		memset(&freeP->link, 0, sizeof(web_link_client_t));
+		
+		// And start out alive
+		freeP->rx_usec = freeP->win_start_usec;
+		freeP->ping_usec = 0;
+		freeP->send_fails = 0;
+		freeP->closing = false;
+		xSemaphoreGive(img_pkt_mutex);
+	}
+	return freeP;
+}
+
+
+// Ping a websocket client that has been quiet and close the connection of one that hasn't
+// answered a ping or whose sends keep failing.  Returns false if it is being closed.
+static bool _web_check_client_alive(httpd_handle_t handle, int sock)
+{
+	esp_err_t ret;
+	httpd_ws_frame_t ws_pkt;
+	web_client_t* clientP;
+	int64_t cur_usec = esp_timer_get_time();
+	bool evict = false;
+	bool ping = false;
+	
+	clientP = _web_get_client(sock);
+	if (clientP == NULL) return true;
+	
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	if (clientP->closing) {
+		xSemaphoreGive(img_pkt_mutex);
+		return false;
+	}
+	if (clientP->send_fails >= WEB_MAX_SEND_FAILS) {
+		evict = true;
+	} else if (clientP->ping_usec != 0) {
+		evict = (cur_usec - clientP->ping_usec) >= WEB_PING_TIMEOUT_USEC;
+	} else if ((cur_usec - clientP->rx_usec) >= WEB_PING_IDLE_USEC) {
+		clientP->ping_usec = cur_usec;
+		ping = true;
+	}
+	clientP->closing = evict;
+	xSemaphoreGive(img_pkt_mutex);
+	
+	if (evict) {
+		ESP_LOGI(TAG, "Closing unresponsive client %d", sock);
+		ret = httpd_sess_trigger_close(handle, sock);
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "Couldn't close connection (%d)", ret);
+		}
+		return false;
+	}
+	
+	if (ping) {
+		memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+		ws_pkt.type = HTTPD_WS_TYPE_PING;
+		ws_pkt.final = true;
+		ret = httpd_ws_send_data_async(handle, sock, &ws_pkt, _web_ping_done, NULL);
+		if (ret != ESP_OK) {
+			ESP_LOGE(TAG, "httpd_ws_send_data_async ping failed - %d", ret);
+		}
+	}
+	
+	return true;
+}
+
+
+// Called in the httpd task when a websocket frame is received from a client
+static void _web_note_client_rx(int sock)
+{
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	for (int i=0; i<max_sockets; i++) {
+		if (web_clients[i].sock == sock) {
+			web_clients[i].rx_usec = esp_timer_get_time();
+			web_clients[i].ping_usec = 0;
+		}
+	}
+	xSemaphoreGive(img_pkt_mutex);
+}
+
+
+// Called in the httpd task when a ping has been sent (an unanswered ping closes the client)
+static void _web_ping_done(esp_err_t err, int socket, void* arg)
+{
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "ping send failed - %d", err);
+	}
+}
+
+
+// Return an image packet from pkts (img_pkts or img_same_pkts) no client is still sending
+static web_img_pkt_t* _web_get_free_img_pkt(web_img_pkt_t* pkts)
+{
+	web_img_pkt_t* pktP = NULL;
+	
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	for (int i=0; i<WEB_NUM_IMG_PKTS; i++) {
+		if (pkts[i].ref_count == 0) {
+			pktP = &pkts[i];
+			break;
+		}
+	}
+	xSemaphoreGive(img_pkt_mutex);
+	
+	return pktP;
+}
+
+
+// Queue the command packets waiting in the ws_cmd_utilities tx buffer for the httpd task to
+// send, combined into as few frames as possible
+static void _web_queue_cmd_packets(httpd_handle_t handle, int sock)
+{
+	esp_err_t ret;
+	httpd_ws_frame_t ws_pkt;
+	uint32_t len;
+	uint8_t* payload;
+	web_cmd_buf_t* bufP;
+	
+	while (true) {
+		bufP = _web_get_free_cmd_buf();
+		if (bufP != NULL) {
+			len = ws_cmd_get_tx_batch(bufP->buf, WEB_CMD_BUF_LEN);
+			if (len != 0) {
+				ws_pkt.payload = bufP->buf;
+				ws_pkt.len = len;
+				ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+				ws_pkt.final = true;
+				ws_pkt.fragmented = false;
+				ret = httpd_ws_send_data_async(handle, sock, &ws_pkt, _web_cmd_buf_done, bufP);
+				if (ret != ESP_OK) {
+					_web_release_cmd_buf(bufP);
+					ESP_LOGE(TAG, "httpd_ws_send_data_async failed - %d", ret);
+				}
+				continue;
+			}
+			_web_release_cmd_buf(bufP);
+		}
+		
+		// Packets too large for a command buffer (or none free)
+		if (!ws_cmd_get_tx_data(&len, &payload)) break;
+		_web_queue_cmd_packet(handle, sock, len, payload);
+	}
+}
+
+
+// Queue a copy of a command packet to be sent by the httpd task.  Packets to one client
+// are sent in order.
+static void _web_queue_cmd_packet(httpd_handle_t handle, int sock, uint32_t len, uint8_t* payload)
+{
+	esp_err_t ret;
+	httpd_ws_frame_t ws_pkt;
+	uint8_t* buf;
+	
+	buf = (uint8_t*) heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+	if (buf == NULL) {
+		ESP_LOGE(TAG, "malloc cmd packet failed");
+		return;
+	}
+	memcpy(buf, payload, len);
+	
+	ws_pkt.payload = buf;
+	ws_pkt.len = len;
+	ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+	ws_pkt.final = true;
+	ws_pkt.fragmented = false;
+	ret = httpd_ws_send_data_async(handle, sock, &ws_pkt, _web_cmd_packet_done, buf);
+	if (ret != ESP_OK) {
+		free(buf);
+		ESP_LOGE(TAG, "httpd_ws_send_data_async failed - %d", ret);
+	}
+}
+
+
+// Called in the httpd task when a queued command packet has been sent
+static void _web_cmd_packet_done(esp_err_t err, int socket, void* arg)
+{
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "cmd packet send failed - %d", err);
+	}
+	free(arg);
+}
+
+
+static web_cmd_buf_t* _web_get_free_cmd_buf()
+{
+	web_cmd_buf_t* bufP = NULL;
+	
+	xSemaphoreTake(cmd_buf_mutex, portMAX_DELAY);
+	for (int i=0; i<WEB_NUM_CMD_BUFS; i++) {
+		if (cmd_bufs[i].ref_count == 0) {
+			cmd_bufs[i].ref_count = 1;
+			bufP = &cmd_bufs[i];
+			break;
+		}
+	}
+	xSemaphoreGive(cmd_buf_mutex);
+	
+	return bufP;
+}
+
+
+static void _web_release_cmd_buf(web_cmd_buf_t* bufP)
+{
+	xSemaphoreTake(cmd_buf_mutex, portMAX_DELAY);
+	bufP->ref_count -= 1;
+	xSemaphoreGive(cmd_buf_mutex);
+}
+
+
+// Called in the httpd task after a client's CMD_SET has been processed to note broadcast
+// items that changed
+static void _web_note_set(cmd_id_t cmd_id)
+{
+	bool first;
+	
+	for (int i=0; i<WEB_NUM_BCAST_ITEMS; i++) {
+		if (bcast_items[i].cmd_id == cmd_id) {
+			xSemaphoreTake(cmd_buf_mutex, portMAX_DELAY);
+			first = (bcast_pending_mask == 0);
+			if (first) {
+				bcast_origin_sock = ws_rx_sock;
+			} else if (bcast_origin_sock != ws_rx_sock) {
+				bcast_origin_sock = -1;
+			}
+			bcast_pending_mask |= 1 << i;
+			xSemaphoreGive(cmd_buf_mutex);
+			
+			// Wake web_task to send it to the other clients
+			if (first) {
+				xTaskNotify(task_handle_web, WEB_NOTIFY_BCAST_MASK, eSetBits);
+			}
+			break;
+		}
+	}
+}
+
+
+// Encode the current values of the broadcast items set since the last call as one CMD_BATCH
+// packet in a command buffer held by the caller (released with _web_release_cmd_buf).
+// Returns NULL if there is nothing to send or nobody else to send it to.  *origin_sock is set
+// to the socket that set the items, which already has them.
+static web_cmd_buf_t* _web_build_broadcast(size_t clients, int* origin_sock)
+{
+	uint32_t mask;
+	uint32_t len;
+	web_cmd_buf_t* bufP;
+	
+	xSemaphoreTake(cmd_buf_mutex, portMAX_DELAY);
+	mask = bcast_pending_mask;
+	bcast_pending_mask = 0;
+	*origin_sock = bcast_origin_sock;
+	xSemaphoreGive(cmd_buf_mutex);
+	
+	if ((mask == 0) || (clients < 2)) return NULL;
+	
+	bufP = _web_get_free_cmd_buf();
+	if (bufP == NULL) {
+		ESP_LOGE(TAG, "No command buffer for broadcast");
+		return NULL;
+	}
+	
+	ws_cmd_batch_begin();
+	for (int i=0; i<WEB_NUM_BCAST_ITEMS; i++) {
+		if ((mask & (1 << i)) != 0) {
+			bcast_items[i].get_handler(CMD_DATA_NONE, 0, NULL);
+		}
+	}
+	len = ws_cmd_batch_take(bufP->buf + WS_CMD_HDR_LEN, WEB_CMD_BUF_LEN - WS_CMD_HDR_LEN);
+	if (len == 0) {
+		_web_release_cmd_buf(bufP);
+		return NULL;
+	}
+	
+	ws_cmd_encode_header(CMD_SET, CMD_BATCH, CMD_DATA_BINARY, len, bufP->buf);
+	bufP->len = WS_CMD_HDR_LEN + len;
+	
+	return bufP;
+}
+
+
+// Queue a shared command buffer to be sent to a client by the httpd task
+static void _web_queue_cmd_buf(httpd_handle_t handle, int sock, web_cmd_buf_t* bufP)
+{
+	esp_err_t ret;
+	httpd_ws_frame_t ws_pkt;
+	
+	xSemaphoreTake(cmd_buf_mutex, portMAX_DELAY);
+	bufP->ref_count += 1;
+	xSemaphoreGive(cmd_buf_mutex);
+	
+	ws_pkt.payload = bufP->buf;
+	ws_pkt.len = bufP->len;
+	ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+	ws_pkt.final = true;
+	ws_pkt.fragmented = false;
+	ret = httpd_ws_send_data_async(handle, sock, &ws_pkt, _web_cmd_buf_done, bufP);
+	if (ret != ESP_OK) {
+		_web_release_cmd_buf(bufP);
+		ESP_LOGE(TAG, "httpd_ws_send_data_async failed - %d", ret);
+	}
+}
+
+
+// Called in the httpd task when a queued command frame buffer has been sent
+static void _web_cmd_buf_done(esp_err_t err, int socket, void* arg)
+{
+	web_cmd_buf_t* bufP = (web_cmd_buf_t*) arg;
+	
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "cmd packet send failed - %d", err);
+	}
+	_web_release_cmd_buf(bufP);
+}
+
+
+// Called in the httpd task when a client's image packet has been sent
+static void _web_image_packet_done(esp_err_t err, int socket, void* arg)
+{
+	web_client_t* clientP = (web_client_t*) arg;
+	int64_t send_usec;
+	bool same;
+	
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "image packet send failed - %d", err);
+	}
+	
+	xSemaphoreTake(img_pkt_mutex, portMAX_DELAY);
+	if (clientP->img_pktP != NULL) {
+		send_usec = esp_timer_get_time() - clientP->send_start_usec;
+		_web_update_link_stats(clientP, err, clientP->img_pktP->len, (uint32_t) send_usec);
+		
+		// The client doesn't have the image if it couldn't be sent
+		if (err != ESP_OK) {
+			clientP->img_key_valid = false;
+			clientP->send_fails += 1;
+		} else {
+			clientP->send_fails = 0;
+		}
+		same = clientP->img_pktP->same;
+		clientP->img_pktP->ref_count -= 1;
+		clientP->img_pktP = NULL;
+		
+		// Update the smoothed send time (1/4 weight for the newest) from full images
+		if (!same) {
+			perf_record(PERF_STAGE_SEND, (uint32_t) send_usec);
+			if (send_usec > (WEB_RATE_MAX_INTERVAL / WEB_RATE_HEADROOM)) {
+				send_usec = WEB_RATE_MAX_INTERVAL / WEB_RATE_HEADROOM;
+			}
+			clientP->send_avg_usec = (3*clientP->send_avg_usec + send_usec) / 4;
+		}
+	}
+	xSemaphoreGive(img_pkt_mutex);
+}
+
+
+// Return the rate (fps x 10) a client is being sent images at
+static int32_t _web_get_client_rate(web_client_t* clientP)
+{
+	int64_t interval_usec = WEB_RATE_HEADROOM * clientP->send_avg_usec;
+	
+	if (interval_usec < (1000000 / T1C_FPS)) {
+		return T1C_FPS * 10;
+	} else {
+		return (int32_t) (10000000 / interval_usec);
+	}
+}
+
+
+// Let a client know the rate it is being sent images at when it has changed significantly
+static void _web_send_stream_rate(httpd_handle_t handle, web_client_t* clientP)
+{
+	int64_t cur_usec = esp_timer_get_time();
+	int32_t rate = _web_get_client_rate(clientP);
+	
+	if ((clientP->reported_rate != 0) && (abs(rate - clientP->reported_rate) < WEB_RATE_REPORT_DELTA)) return;
+	if ((cur_usec - clientP->report_usec) < WEB_RATE_REPORT_USEC) return;
+	
+	clientP->reported_rate = rate;
+	clientP->report_usec = cur_usec;
+	(void) cmd_send_int32(CMD_SET, CMD_STREAM_RATE, rate);
+	_web_queue_cmd_packets(handle, clientP->sock);
+}
+
+
+// Add a completed image send to a client's link statistics, computing the statistics for the
+// window when it is over (called with img_pkt_mutex taken)
+static void _web_update_link_stats(web_client_t* clientP, esp_err_t err, uint32_t len, uint32_t send_usec)
+{
+	int64_t cur_usec = esp_timer_get_time();
+	int64_t win_usec;
+	
+	if (err != ESP_OK) {
+		clientP->link.failures += 1;
+	} else {
+		clientP->link.frames += 1;
+		clientP->win_frames += 1;
+		clientP->win_bytes += len;
+		clientP->win_send_usec += send_usec;
+		if (send_usec > clientP->win_max_usec) clientP->win_max_usec = send_usec;
+	}
+	
+	win_usec = cur_usec - clientP->win_start_usec;
+	if (win_usec >= WEB_LINK_WINDOW_USEC) {
+		if (win_usec < (2 * WEB_LINK_WINDOW_USEC)) {
+			clientP->link.bytes_per_sec = (uint32_t) ((int64_t) clientP->win_bytes * 1000000 / win_usec);
+			clientP->link.fps_x10 = (uint32_t) ((int64_t) clientP->win_frames * 10000000 / win_usec);
+			clientP->link.send_avg_usec = (clientP->win_frames == 0) ? 0 : clientP->win_send_usec / clientP->win_frames;
+			clientP->link.send_max_usec = clientP->win_max_usec;
+		}
+		// else the stream was stopped during the window so start over
+		clientP->win_start_usec = cur_usec;
+		clientP->win_bytes = 0;
+		clientP->win_frames = 0;
+		clientP->win_send_usec = 0;
+		clientP->win_max_usec = 0;
+	}
+}
+
+
+// Return true with the destination and format if a UDP image should be sent for this frame.  The
+// stream is stopped if the client that requested it has gone away.
+static bool _web_udp_stream_active(size_t num_fds, int* fds, struct sockaddr_in* addrP, int* formatP)
+{
+	bool found = false;
+	bool send = false;
+	
+	portENTER_CRITICAL(&udp_mux);
+	if (udp_owner_sock >= 0) {
+		for (int i=0; i<num_fds; i++) {
+			if (fds[i] == udp_owner_sock) found = true;
+		}
+		if (!found) {
+			udp_owner_sock = -1;
+		} else if (++udp_frame_count >= udp_decimation) {
+			udp_frame_count = 0;
+			*addrP = udp_addr;
+			*formatP = udp_format;
+			send = true;
+		}
+	}
+	portEXIT_CRITICAL(&udp_mux);
+	
+	return send;
+}
+
+
+// Return true with the group address and format if a multicast image should be sent for
+// this frame
+static bool _web_mcast_stream_active(struct sockaddr_in* addrP, int* formatP)
+{
+	bool send = false;
+	
+	portENTER_CRITICAL(&udp_mux);
+	if ((mcast_format != CMD_STREAM_OFF) && (++mcast_frame_count >= mcast_decimation)) {
+		mcast_frame_count = 0;
+		*formatP = mcast_format;
+		send = true;
+	}
+	portEXIT_CRITICAL(&udp_mux);
+	
+	if (send) {
+		memset(addrP, 0, sizeof(struct sockaddr_in));
+		addrP->sin_family = AF_INET;
+		addrP->sin_port = htons(CMD_MCAST_PORT);
+		addrP->sin_addr.s_addr = inet_addr(CMD_MCAST_GROUP);
+	}
+	
+	return send;
+}
+
+
+// Send an image as UDP datagrams of whole rows.  Sending stops at the first datagram the
+// stack can't take since the receiver will drop the incomplete frame anyway.
+static void _web_send_udp_image(struct sockaddr_in* addrP, int format, uint16_t* seqP, int render_buf_index)
+{
+	t1c_buffer_t* t1cP = (render_buf_index == 0) ? &out_t1c_buffer[0] : &out_t1c_buffer[1];
+	bool y16 = (format == CMD_STREAM_Y16);
+	int rows_per_pkt = y16 ? WEB_UDP_ROWS_Y16 : WEB_UDP_ROWS_Y8;
+	int num_rows;
+	uint8_t ttl = 1;
+	uint16_t* y16P;
+	uint16_t* dP;
+	uint32_t len;
+	
+	if (udp_sock < 0) {
+		if ((udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP)) < 0) {
+			ESP_LOGE(TAG, "Could not create UDP stream socket (%d)", errno);
+			return;
+		}
+		
+		// Multicast stays on the local network
+		(void) setsockopt(udp_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+	}
+	
+	// Header fields that are the same for every datagram in the frame
+	udp_pkt_buf[0] = CMD_UDP_VERSION;
+	udp_pkt_buf[1] = (uint8_t) format;
+	*(uint32_t*)&udp_pkt_buf[4] = htonl(t1cP->frame_seq);
+	*(uint32_t*)&udp_pkt_buf[8] = htonl((uint32_t) (t1cP->frame_usec / 1000));
+	*(uint16_t*)&udp_pkt_buf[12] = htons(T1C_WIDTH);
+	*(uint16_t*)&udp_pkt_buf[14] = htons(T1C_HEIGHT);
+	udp_pkt_buf[20] = (t1cP->high_gain ? CMD_UDP_FLAG_HIGH_GAIN : 0) |
+	                  (t1cP->y16_is_temp ? CMD_UDP_FLAG_Y16_TEMP : 0);
+	udp_pkt_buf[21] = 0;
+	*(uint16_t*)&udp_pkt_buf[22] = 0;
+	
+	for (int row=0; row<T1C_HEIGHT; row += num_rows) {
+		num_rows = ((T1C_HEIGHT - row) < rows_per_pkt) ? (T1C_HEIGHT - row) : rows_per_pkt;
+		*(uint16_t*)&udp_pkt_buf[2] = htons((*seqP)++);
+		*(uint16_t*)&udp_pkt_buf[16] = htons((uint16_t) row);
+		*(uint16_t*)&udp_pkt_buf[18] = htons((uint16_t) num_rows);
+		
+		if (y16) {
+			y16P = t1cP->img_data + row*T1C_WIDTH;
+			dP = (uint16_t*) &udp_pkt_buf[CMD_UDP_HDR_LEN];
+			for (int i=0; i<num_rows*T1C_WIDTH; i++) {
+				*dP++ = htons(*y16P++);
+			}
+			len = CMD_UDP_HDR_LEN + 2*num_rows*T1C_WIDTH;
+		} else {
+			memcpy(&udp_pkt_buf[CMD_UDP_HDR_LEN], t1cP->y8_data + row*T1C_WIDTH, num_rows*T1C_WIDTH);
+			len = CMD_UDP_HDR_LEN + num_rows*T1C_WIDTH;
+		}
+		
+		if (sendto(udp_sock, udp_pkt_buf, len, MSG_DONTWAIT, (struct sockaddr*) addrP, sizeof(struct sockaddr_in)) < 0) {
+			break;
+		}
+	}
+}
+
+
+// Collect the response packets for the subscribed items that have changed since they were
+// last sent into sub_changed and return their total length
+static uint32_t _web_check_subscriptions()
+{
+	int mask = cmd_handler_subscriptions();
+	uint8_t pkt[WEB_SUB_MAX_LEN];
+	uint32_t len = 0;
+	uint32_t plen;
+	
+	sub_check_usec = esp_timer_get_time();
+	
+	for (int i=0; i<CMD_SUB_NUM; i++) {
+		if ((mask & (1 << i)) == 0) {
+			// Send the current value if it is subscribed to again
+			sub_last_len[i] = 0;
+			continue;
+		}
+		
+		ws_cmd_batch_begin();
+		sub_handlers[i](CMD_DATA_NONE, 0, NULL);
+		plen = ws_cmd_batch_take(pkt, WEB_SUB_MAX_LEN);
+		
+		if ((plen != 0) && ((plen != sub_last_len[i]) || (memcmp(pkt, sub_last[i], plen) != 0))) {
+			memcpy(sub_last[i], pkt, plen);
+			sub_last_len[i] = plen;
+			memcpy(&sub_changed[len], pkt, plen);
+			len += plen;
+		}
+	}
+	
+	return len;
+}
+
+
+static bool _web_init_stream()
+{
+	stream_rgb_image = (uint32_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*4, MALLOC_CAP_SPIRAM);
+	if (stream_rgb_image == NULL) {
+		ESP_LOGE(TAG, "malloc stream RGB buffer failed");
+		return false;
+	}
+	
+	stream_jpeg.buf = (uint8_t*) heap_caps_malloc(WEB_STREAM_JPEG_BUF_LEN, MALLOC_CAP_SPIRAM);
+	if (stream_jpeg.buf == NULL) {
+		ESP_LOGE(TAG, "malloc stream jpeg buffer failed");
+		return false;
+	}
+	
+	return true;
+}
+
+
+static httpd_handle_t _web_start_stream_server()
+{
+	httpd_handle_t server = NULL;
+	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	
+	config.server_port = WEB_STREAM_PORT;
+	config.ctrl_port = WEB_STREAM_CTRL_PORT;
+	config.max_open_sockets = WEB_STREAM_MAX_SOCKETS;
+	config.stack_size = WEB_STREAM_STACK_SIZE;
+	config.uri_match_fn = httpd_uri_match_wildcard;
+	
+	ESP_LOGI(TAG, "Starting stream server on port: '%d'", config.server_port);
+	if (httpd_start(&server, &config) == ESP_OK) {
+		httpd_register_uri_handler(server, &uri_stream);
+		httpd_register_uri_handler(server, &uri_file);
+		httpd_register_uri_handler(server, &uri_archive);
+		httpd_register_uri_handler(server, &uri_sync);
+		return server;
+	}
+	
+	ESP_LOGE(TAG, "Error starting stream server!");
+	return NULL;
+}
+
+
+// Send palette colored frames as a multipart jpeg stream until the client goes away.  Runs
+// in the stream server task so only one client is streamed at a time.
+static esp_err_t _web_stream_handler(httpd_req_t *req)
+{
+	char part_buf[96];
+	esp_err_t ret;
+	int fps;
+	int quality;
+	int64_t frame_usec;
+	int64_t next_usec;
+	t1c_buffer_t* t1cP;
+	uint32_t last_seq = 0;
+	
+	fps = _web_stream_get_query_int(req, "fps", WEB_STREAM_DEF_FPS, 1, T1C_FPS);
+	quality = _web_stream_get_query_int(req, "quality", WEB_STREAM_DEF_QUALITY, 1, 3);
+	frame_usec = 1000000 / fps;
+	ESP_LOGI(TAG, "Start stream: %d fps, quality %d", fps, quality);
+	
+	ret = httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=" WEB_STREAM_BOUNDARY);
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	
+	next_usec = esp_timer_get_time();
+	while (1) {
+		// Pace the stream
+		while (esp_timer_get_time() < next_usec) {
+			vTaskDelay(pdMS_TO_TICKS(10));
+		}
+		next_usec += frame_usec;
+		if (next_usec < esp_timer_get_time()) {
+			// Don't try to catch up after a slow frame
+			next_usec = esp_timer_get_time() + frame_usec;
+		}
+		
+		// Paused during a firmware update
+		if (ota_running) {
+			continue;
+		}
+		
+		// Use the most recent frame from t1c_task
+		t1cP = ((int32_t) (out_t1c_buffer[1].frame_seq - out_t1c_buffer[0].frame_seq) > 0) ? &out_t1c_buffer[1] : &out_t1c_buffer[0];
+		if (t1cP->frame_seq == last_seq) {
+			continue;
+		}
+		
+		xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+		last_seq = t1cP->frame_seq;
+		file_render_t1c_data(t1cP, stream_rgb_image);
+		xSemaphoreGive(t1cP->mutex);
+		
+		stream_jpeg.len = 0;
+		stream_jpeg.overflow = false;
+		if (!file_encode_jpeg(stream_rgb_image, quality, _web_stream_write, &stream_jpeg) || stream_jpeg.overflow) {
+			ESP_LOGE(TAG, "Stream jpeg encode failed");
+			continue;
+		}
+		
+		sprintf(part_buf, "\r\n--" WEB_STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\n\r\n", stream_jpeg.len);
+		ret = httpd_resp_send_chunk(req, part_buf, strlen(part_buf));
+		if (ret == ESP_OK) {
+			ret = httpd_resp_send_chunk(req, (const char*) stream_jpeg.buf, stream_jpeg.len);
+		}
+		if (ret != ESP_OK) {
+			// Client has gone away
+			break;
+		}
+	}
+	
+	ESP_LOGI(TAG, "End stream");
+	return ESP_OK;
+}
+
+
+static int _web_stream_get_query_int(httpd_req_t* req, const char* key, int def, int min, int max)
+{
+	char query[64];
+	char val[8];
+	int n;
+	
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+		return def;
+	}
+	if (httpd_query_key_value(query, key, val, sizeof(val)) != ESP_OK) {
+		return def;
+	}
+	
+	n = atoi(val);
+	if (n < min) n = min;
+	if (n > max) n = max;
+	return n;
+}
+
+
+// file_encode_jpeg output function
+static void _web_stream_write(void* context, void* data, int size)
+{
+	stream_jpeg_t* jP = (stream_jpeg_t*) context;
+	
+	if ((jP->len + size) > WEB_STREAM_JPEG_BUF_LEN) {
+		jP->overflow = true;
+		return;
+	}
+	
+	memcpy(jP->buf + jP->len, data, size);
+	jP->len += size;
+}
+
+
+static bool _web_init_api()
+{
+	api_raw_buf = (uint8_t*) heap_caps_malloc(FILE_RAW_MAX_LEN, MALLOC_CAP_SPIRAM);
+	if (api_raw_buf == NULL) {
+		ESP_LOGE(TAG, "malloc API raw buffer failed");
+		return false;
+	}
+	
+	api_rgb_image = (uint32_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT*4, MALLOC_CAP_SPIRAM);
+	if (api_rgb_image == NULL) {
+		ESP_LOGE(TAG, "malloc API RGB buffer failed");
+		return false;
+	}
+	
+	api_jpeg.buf = (uint8_t*) heap_caps_malloc(WEB_API_JPEG_BUF_LEN, MALLOC_CAP_SPIRAM);
+	if (api_jpeg.buf == NULL) {
+		ESP_LOGE(TAG, "malloc API jpeg buffer failed");
+		return false;
+	}
+	
+	return true;
+}
+
+
+// Return the most recent frame from t1c_task
+static t1c_buffer_t* _web_api_get_frame()
+{
+	return ((int32_t) (out_t1c_buffer[1].frame_seq - out_t1c_buffer[0].frame_seq) > 0) ? &out_t1c_buffer[1] : &out_t1c_buffer[0];
+}
+
+
+// Set the ETag and caching headers for a response describing t1cP and return true if the
+// client already has it (after sending a 304 response)
+static bool _web_api_not_modified(httpd_req_t* req, t1c_buffer_t* t1cP)
+{
+	char etag[WEB_API_ETAG_LEN];
+	
+	sprintf(api_etag, "\"%lu\"", t1cP->frame_seq);
+	(void) httpd_resp_set_hdr(req, "ETag", api_etag);
+	(void) httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", etag, sizeof(etag)) == ESP_OK) {
+		if (strcmp(etag, api_etag) == 0) {
+			(void) httpd_resp_set_status(req, "304 Not Modified");
+			(void) httpd_resp_send(req, NULL, 0);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+
+static esp_err_t _web_api_frame_raw_handler(httpd_req_t *req)
+{
+	t1c_buffer_t* t1cP = _web_api_get_frame();
+	tmElements_t te;
+	uint32_t len;
+	
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	if (_web_api_not_modified(req, t1cP)) {
+		xSemaphoreGive(t1cP->mutex);
+		return ESP_OK;
+	}
+	time_get(&te);
+	len = file_raw_encode(t1cP, &file_t1c_meta, &te, api_raw_buf);
+	xSemaphoreGive(t1cP->mutex);
+	
+	(void) httpd_resp_set_type(req, "application/octet-stream");
+	
+	return httpd_resp_send(req, (const char*) api_raw_buf, (ssize_t) len);
+}
+
+
+static esp_err_t _web_api_frame_jpg_handler(httpd_req_t *req)
+{
+	t1c_buffer_t* t1cP = _web_api_get_frame();
+	int quality;
+	
+	quality = _web_stream_get_query_int(req, "quality", WEB_STREAM_DEF_QUALITY, 1, 3);
+	
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	if (_web_api_not_modified(req, t1cP)) {
+		xSemaphoreGive(t1cP->mutex);
+		return ESP_OK;
+	}
+	file_render_t1c_data(t1cP, api_rgb_image);
+	xSemaphoreGive(t1cP->mutex);
+	
+	api_jpeg.len = 0;
+	api_jpeg.overflow = false;
+	if (!file_encode_jpeg(api_rgb_image, quality, _web_stream_write, &api_jpeg) || api_jpeg.overflow) {
+		ESP_LOGE(TAG, "API jpeg encode failed");
+		return httpd_resp_send_500(req);
+	}
+	
+	(void) httpd_resp_set_type(req, "image/jpeg");
+	
+	return httpd_resp_send(req, (const char*) api_jpeg.buf, (ssize_t) api_jpeg.len);
+}
+
+
+static esp_err_t _web_api_stats_handler(httpd_req_t *req)
+{
+	char buf[WEB_API_STATS_LEN];
+	char* bP = buf;
+	t1c_buffer_t* t1cP = _web_api_get_frame();
+	
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	if (_web_api_not_modified(req, t1cP)) {
+		xSemaphoreGive(t1cP->mutex);
+		return ESP_OK;
+	}
+	
+	bP += sprintf(bP, "{\"frame_seq\":%lu,\"frame_index\":%u,", t1cP->frame_seq, t1cP->frame_index);
+	bP = _web_api_add_temp(bP, "min", t1cP->max_min_temp_info.min_temp, t1cP->minmax_valid);
+	bP += sprintf(bP, ",\"min_x\":%u,\"min_y\":%u,", t1cP->max_min_temp_info.min_temp_point.x, t1cP->max_min_temp_info.min_temp_point.y);
+	bP = _web_api_add_temp(bP, "max", t1cP->max_min_temp_info.max_temp, t1cP->minmax_valid);
+	bP += sprintf(bP, ",\"max_x\":%u,\"max_y\":%u,", t1cP->max_min_temp_info.max_temp_point.x, t1cP->max_min_temp_info.max_temp_point.y);
+	bP = _web_api_add_temp(bP, "spot", t1cP->spot_temp, t1cP->spot_valid);
+	bP += sprintf(bP, ",\"spot_x\":%u,\"spot_y\":%u,\"region\":{\"x1\":%u,\"y1\":%u,\"x2\":%u,\"y2\":%u,",
+	              t1cP->spot_point.x, t1cP->spot_point.y,
+	              t1cP->region_points.start_point.x, t1cP->region_points.start_point.y,
+	              t1cP->region_points.end_point.x, t1cP->region_points.end_point.y);
+	bP = _web_api_add_temp(bP, "ave", t1cP->region_temp_info.temp_info_value.ave_temp, t1cP->region_valid);
+	*bP++ = ',';
+	bP = _web_api_add_temp(bP, "min", t1cP->region_temp_info.temp_info_value.min_temp, t1cP->region_valid);
+	*bP++ = ',';
+	bP = _web_api_add_temp(bP, "max", t1cP->region_temp_info.temp_info_value.max_temp, t1cP->region_valid);
+	xSemaphoreGive(t1cP->mutex);
+	bP += sprintf(bP, "}}");
+	
+	(void) httpd_resp_set_type(req, "application/json");
+	
+	return httpd_resp_send(req, buf, (ssize_t) (bP - buf));
+}
+
+
+// Add a "name":temp JSON member with a Tiny1C temperature in °C (null if not valid)
+static char* _web_api_add_temp(char* bufP, const char* name, uint16_t t, bool valid)
+{
+	if (valid) {
+		bufP += sprintf(bufP, "\"%s\":%.1f", name, temp_to_float_temp(t, true));
+	} else {
+		bufP += sprintf(bufP, "\"%s\":null", name);
+	}
+	
+	return bufP;
+}
+
+
+static bool _web_init_ota()
+{
+	ota_auth_sem = xSemaphoreCreateBinary();
+	ota_wr_done_sem = xSemaphoreCreateBinary();
+	ota_free_queue = xQueueCreate(WEB_OTA_NUM_BUFS, sizeof(int));
+	ota_full_queue = xQueueCreate(WEB_OTA_NUM_BUFS + 1, sizeof(int));
+	
+	return ((ota_auth_sem != NULL) && (ota_wr_done_sem != NULL) &&
+	        (ota_free_queue != NULL) && (ota_full_queue != NULL));
+}
+
+
+// Receive a firmware image for "/update" into the next OTA partition and reboot into it.
+// Runs in the main server task so only one update can be in progress.
+static esp_err_t _web_ota_handler(httpd_req_t *req)
+{
+	const esp_partition_t* partP;
+	esp_err_t err;
+	int i;
+	
+	if (req->content_len == 0) {
+		return httpd_resp_send_err(req, HTTPD_411_LENGTH_REQUIRED, "Image length required");
+	}
+	
+	partP = esp_ota_get_next_update_partition(NULL);
+	if ((partP == NULL) || (req->content_len > partP->size)) {
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image does not fit");
+	}
+	
+	// Let ctrl_task show the update (and ask for the button press)
+	xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_FW_UPD_REQ, eSetBits);
+	if (!_web_ota_authorize()) {
+		xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_FW_UPD_DONE, eSetBits);
+		return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Update not authorized");
+	}
+	xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_FW_UPD_PROCESS, eSetBits);
+	
+	// Get the buffers and writer ready
+	for (i=0; i<WEB_OTA_NUM_BUFS; i++) {
+		ota_bufs[i].buf = heap_caps_malloc(WEB_OTA_BUF_LEN, MALLOC_CAP_SPIRAM);
+		if (ota_bufs[i].buf == NULL) {
+			while (--i >= 0) {
+				free(ota_bufs[i].buf);
+			}
+			xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_FW_UPD_DONE, eSetBits);
+			return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+		}
+		(void) xQueueSend(ota_free_queue, &i, 0);
+	}
+	
+	ota_abort = false;
+	ota_running = true;
+	ESP_LOGI(TAG, "Start firmware update: %d bytes to %s", req->content_len, partP->label);
+	
+	err = esp_ota_begin(partP, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+	if (err == ESP_OK) {
+		ota_wr_err = ESP_OK;
+		if (xTaskCreatePinnedToCore(&_web_ota_wr_task, "web_ota_wr", TASK_WEB_OTA_WR_STACK, NULL, TASK_WEB_OTA_WR_PRIO, NULL, TASK_WEB_OTA_WR_CORE) != pdPASS) {
+			err = ESP_ERR_NO_MEM;
+			(void) esp_ota_abort(ota_handle);
+		}
+	}
+	
+	if (err == ESP_OK) {
+		err = _web_ota_receive(req);
+		
+		// Wait for the writer to finish what it has
+		i = -1;
+		(void) xQueueSend(ota_full_queue, &i, portMAX_DELAY);
+		xSemaphoreTake(ota_wr_done_sem, portMAX_DELAY);
+		if (err == ESP_OK) {
+			err = ota_wr_err;
+		}
+		
+		if (err == ESP_OK) {
+			// Validates the image
+			err = esp_ota_end(ota_handle);
+		} else {
+			(void) esp_ota_abort(ota_handle);
+		}
+		
+		if (err == ESP_OK) {
+			err = esp_ota_set_boot_partition(partP);
+		}
+	}
+	
+	xQueueReset(ota_free_queue);
+	xQueueReset(ota_full_queue);
+	for (i=0; i<WEB_OTA_NUM_BUFS; i++) {
+		free(ota_bufs[i].buf);
+	}
+	ota_running = false;
+	
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Firmware update failed - %s", esp_err_to_name(err));
+		xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_FW_UPD_DONE, eSetBits);
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+	}
+	
+	ESP_LOGI(TAG, "Firmware update done");
+	(void) httpd_resp_sendstr(req, "Update complete, rebooting\n");
+	xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_FW_UPD_REBOOT, eSetBits);
+	
+	return ESP_OK;
+}
+
+
+// Wait for the user to allow the update with the power button (ctrl_task notifies us)
+static bool _web_ota_authorize()
+{
+#ifdef CONFIG_WEB_OTA_REQUIRE_BUTTON
+	bool authorized;
+	
+	(void) xSemaphoreTake(ota_auth_sem, 0);
+	ota_waiting_auth = true;
+	authorized = (xSemaphoreTake(ota_auth_sem, pdMS_TO_TICKS(WEB_OTA_AUTH_MSEC)) == pdTRUE);
+	ota_waiting_auth = false;
+	
+	return authorized;
+#else
+	return true;
+#endif
+}
+
+
+// Receive the image a buffer at a time, handing each full buffer to the writer
+static esp_err_t _web_ota_receive(httpd_req_t* req)
+{
+	int i;
+	int n;
+	int retries = 0;
+	uint32_t remaining = req->content_len;
+	web_ota_buf_t* bufP;
+	
+	while (remaining != 0) {
+		if (ota_abort) {
+			ESP_LOGI(TAG, "Firmware update aborted");
+			return ESP_ERR_INVALID_STATE;
+		}
+		
+		// Blocks while both buffers are waiting to be written
+		(void) xQueueReceive(ota_free_queue, &i, portMAX_DELAY);
+		if (ota_wr_err != ESP_OK) {
+			return ota_wr_err;
+		}
+		
+		bufP = &ota_bufs[i];
+		bufP->len = 0;
+		while ((bufP->len < WEB_OTA_BUF_LEN) && (remaining != 0)) {
+			n = WEB_OTA_BUF_LEN - bufP->len;
+			if (n > remaining) n = remaining;
+			n = httpd_req_recv(req, (char*) &bufP->buf[bufP->len], n);
+			if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+				if (++retries > WEB_OTA_RECV_RETRIES) {
+					return ESP_ERR_TIMEOUT;
+				}
+				continue;
+			}
+			if (n <= 0) {
+				return ESP_FAIL;
+			}
+			retries = 0;
+			bufP->len += n;
+			remaining -= n;
+		}
+		
+		(void) xQueueSend(ota_full_queue, &i, portMAX_DELAY);
+	}
+	
+	return ESP_OK;
+}
+
+
+// Write received buffers to the OTA partition (created for each update)
+static void _web_ota_wr_task(void* arg)
+{
+	int i;
+	
+	while (1) {
+		(void) xQueueReceive(ota_full_queue, &i, portMAX_DELAY);
+		if (i < 0) break;
+		
+		// Once a write has failed the rest of the image is discarded
+		if (ota_wr_err == ESP_OK) {
+			ota_wr_err = esp_ota_write(ota_handle, ota_bufs[i].buf, ota_bufs[i].len);
+		}
+		(void) xQueueSend(ota_free_queue, &i, portMAX_DELAY);
+	}
+	
+	xSemaphoreGive(ota_wr_done_sem);
+	vTaskDelete(NULL);
+}
+
+
+// Send a catalogued file, or the part of it in a Range header, for "/DCIM/NNNICAMF/ICAM_NNNN.ext"
+static esp_err_t _web_file_handler(httpd_req_t *req)
+{
+	char dir_name[DIR_NAME_LEN];
+	char file_name[FILE_NAME_LEN];
+	const char* cP;
+	esp_err_t ret;
+	file_catalog_entry_t entry;
+	int dir_index;
+	int file_index;
+	int n;
+	int range;
+	int total;
+	uint32_t start;
+	uint32_t end;
+	uint8_t* buf;
+	
+	// Split the path into the directory and file names
+	cP = req->uri + strlen("/DCIM/");
+	n = strcspn(cP, "/");
+	if ((n == 0) || (n >= DIR_NAME_LEN) || (cP[n] != '/')) {
+		return httpd_resp_send_404(req);
+	}
+	memcpy(dir_name, cP, n);
+	dir_name[n] = 0;
+	cP += n + 1;
+	n = strcspn(cP, "?");
+	if ((n == 0) || (n >= FILE_NAME_LEN)) {
+		return httpd_resp_send_404(req);
+	}
+	memcpy(file_name, cP, n);
+	file_name[n] = 0;
+	
+	// The catalog has its length
+	if (!file_card_available() ||
+	    ((dir_index = file_get_named_directory_index(dir_name)) < 0) ||
+	    ((file_index = file_get_named_file_index(dir_index, file_name)) < 0) ||
+	    (file_get_catalog_page(dir_index, file_index, 1, &entry, &total) != 1)) {
+		return httpd_resp_send_404(req);
+	}
+	
+	(void) httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	(void) httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+	sprintf(file_etag, "\"%lu-%lu\"", entry.size, entry.timestamp);
+	(void) httpd_resp_set_hdr(req, "ETag", file_etag);
+	
+	range = _web_file_get_range(req, entry.size, &start, &end);
+	if (range < 0) {
+		sprintf(file_range_hdr, "bytes */%lu", entry.size);
+		(void) httpd_resp_set_hdr(req, "Content-Range", file_range_hdr);
+		(void) httpd_resp_set_status(req, "416 Range Not Satisfiable");
+		return httpd_resp_send(req, NULL, 0);
+	}
+	if (range > 0) {
+		sprintf(file_range_hdr, "bytes %lu-%lu/%lu", start, end, entry.size);
+		(void) httpd_resp_set_hdr(req, "Content-Range", file_range_hdr);
+		(void) httpd_resp_set_status(req, "206 Partial Content");
+	} else {
+		start = 0;
+		end = entry.size - 1;
+	}
+	
+	n = strlen(file_name);
+	if (strcmp(&file_name[n - 4], ".JPG") == 0) {
+		(void) httpd_resp_set_type(req, "image/jpeg");
+	} else if (strcmp(&file_name[n - 5], ".MJPG") == 0) {
+		(void) httpd_resp_set_type(req, "video/x-motion-jpeg");
+	} else {
+		(void) httpd_resp_set_type(req, "application/octet-stream");
+	}
+	
+	if (entry.size == 0) {
+		return httpd_resp_send(req, NULL, 0);
+	}
+	
+	if ((buf = _web_alloc_card_buf()) == NULL) {
+		return httpd_resp_send_500(req);
+	}
+	
+	ret = _web_send_card_file(req, buf, dir_name, file_name, start, end - start + 1, 0);
+	if (ret == ESP_OK) {
+		ret = httpd_resp_send_chunk(req, NULL, 0);
+	}
+	
+	free(buf);
+	
+	return (ret == ESP_OK) ? ESP_OK : ESP_FAIL;
+}
+
+
+// Get a single "bytes=" range from the Range header.  Returns 0 if there is no usable Range
+// header (the whole file is sent), 1 with the first and last byte positions of a valid
+// range or -1 if the range is outside the file.
+static int _web_file_get_range(httpd_req_t* req, uint32_t size, uint32_t* startP, uint32_t* endP)
+{
+	char val[WEB_FILE_HDR_LEN];
+	char* cP;
+	char* eP;
+	unsigned long n;
+	
+	if (httpd_req_get_hdr_value_str(req, "Range", val, sizeof(val)) != ESP_OK) {
+		return 0;
+	}
+	if ((strncmp(val, "bytes=", 6) != 0) || (strchr(val, ',') != NULL)) {
+		// Multiple ranges aren't supported
+		return 0;
+	}
+	cP = &val[6];
+	
+	if (*cP == '-') {
+		// Last n bytes
+		n = strtoul(cP + 1, &eP, 10);
+		if ((eP == (cP + 1)) || (n == 0) || (size == 0)) return -1;
+		if (n > size) n = size;
+		*startP = size - n;
+		*endP = size - 1;
+		return 1;
+	}
+	
+	*startP = strtoul(cP, &eP, 10);
+	if ((eP == cP) || (*eP != '-')) return 0;
+	if (*startP >= size) return -1;
+	
+	cP = eP + 1;
+	*endP = strtoul(cP, &eP, 10);
+	if ((eP == cP) || (*endP >= size)) {
+		// Open ended or past the end of the file
+		*endP = size - 1;
+	} else if (*endP < *startP) {
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+// Send a directory of the catalog as a tar archive.  Runs in the stream server task so a
+// long download doesn't hold up the web page (it waits for a running MJPEG stream to end).
+// The archive is cut short if the card can't be read part way through.
+static esp_err_t _web_archive_handler(httpd_req_t *req)
+{
+	char query[64];
+	char dir_name[DIR_NAME_LEN];
+	char name[DIR_NAME_LEN + 2];
+	file_catalog_entry_t entries[WEB_ARCHIVE_PAGE_LEN];
+	esp_err_t ret;
+	int dir_index;
+	int n;
+	int offset = 0;
+	int total;
+	uint8_t* buf;
+	
+	if ((httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) ||
+	    (httpd_query_key_value(query, "dir", dir_name, sizeof(dir_name)) != ESP_OK)) {
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing dir");
+	}
+	
+	if (!file_card_available() || ((dir_index = file_get_named_directory_index(dir_name)) < 0)) {
+		return httpd_resp_send_404(req);
+	}
+	
+	if ((buf = _web_alloc_card_buf()) == NULL) {
+		return httpd_resp_send_500(req);
+	}
+	
+	ESP_LOGI(TAG, "Start archive %s", dir_name);
+	(void) httpd_resp_set_type(req, "application/x-tar");
+	sprintf(archive_disp, "attachment; filename=\"%s.tar\"", dir_name);
+	(void) httpd_resp_set_hdr(req, "Content-Disposition", archive_disp);
+	
+	// Directory entry
+	(void) file_get_catalog_page(-1, dir_index, 1, entries, &total);
+	sprintf(name, "%s/", dir_name);
+	_web_archive_header(buf, name, 0, entries[0].timestamp, '5');
+	ret = httpd_resp_send_chunk(req, (const char*) buf, WEB_ARCHIVE_BLOCK_LEN);
+	
+	// Files, looking the directory up again for each page in case one before it is deleted
+	while (ret == ESP_OK) {
+		if ((dir_index = file_get_named_directory_index(dir_name)) < 0) {
+			ret = ESP_FAIL;
+			break;
+		}
+		n = file_get_catalog_page(dir_index, offset, WEB_ARCHIVE_PAGE_LEN, entries, &total);
+		if (n == 0) break;
+		offset += n;
+		
+		for (int i=0; i<n; i++) {
+			if ((ret = _web_archive_send_file(req, buf, dir_name, &entries[i])) != ESP_OK) {
+				break;
+			}
+		}
+	}
+	
+	// End of archive marker
+	if (ret == ESP_OK) {
+		memset(buf, 0, 2*WEB_ARCHIVE_BLOCK_LEN);
+		ret = httpd_resp_send_chunk(req, (const char*) buf, 2*WEB_ARCHIVE_BLOCK_LEN);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_send_chunk(req, NULL, 0);
+	}
+	
+	free(buf);
+	
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "Archive %s ended early", dir_name);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(TAG, "End archive %s: %d files", dir_name, offset);
+	return ESP_OK;
+}
+
+
+// List the catalogued files with a timestamp of at least "since", starting after the
+// file in the optional "dir" and "file" query parameters.  If that file has been deleted
+// the listing starts at the beginning of its directory (or of the card if the directory
+// is gone) since the client skips files it already has.
+static esp_err_t _web_sync_handler(httpd_req_t *req)
+{
+	char query[80];
+	char val[16];
+	char dir_name[DIR_NAME_LEN];
+	char file_name[FILE_NAME_LEN];
+	char line[WEB_SYNC_LINE_LEN];
+	file_catalog_entry_t entries[WEB_ARCHIVE_PAGE_LEN];
+	esp_err_t ret = ESP_OK;
+	file_catalog_entry_t dir_entry;
+	int dir_index = 0;
+	int file_index = 0;
+	int n;
+	int num_sent = 0;
+	int total;
+	uint32_t since = 0;
+	
+	dir_name[0] = 0;
+	file_name[0] = 0;
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+		if (httpd_query_key_value(query, "since", val, sizeof(val)) == ESP_OK) {
+			since = strtoul(val, NULL, 10);
+		}
+		if ((httpd_query_key_value(query, "dir", dir_name, sizeof(dir_name)) == ESP_OK) &&
+		    (httpd_query_key_value(query, "file", file_name, sizeof(file_name)) != ESP_OK)) {
+			file_name[0] = 0;
+		}
+	}
+	
+	if (!file_card_available()) {
+		return httpd_resp_send_404(req);
+	}
+	
+	if ((dir_name[0] != 0) && ((n = file_get_named_directory_index(dir_name)) >= 0)) {
+		dir_index = n;
+		if ((file_name[0] != 0) && ((n = file_get_named_file_index(dir_index, file_name)) >= 0)) {
+			file_index = n + 1;
+		}
+	}
+	
+	(void) httpd_resp_set_type(req, "application/json");
+	(void) httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+	(void) httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	ret = httpd_resp_sendstr_chunk(req, "{\"files\":[");
+	
+	while ((ret == ESP_OK) && (num_sent < WEB_SYNC_MAX_FILES)) {
+		// Ends past the last directory
+		if (file_get_catalog_page(-1, dir_index, 1, &dir_entry, &total) != 1) break;
+		
+		n = file_get_catalog_page(dir_index, file_index, WEB_ARCHIVE_PAGE_LEN, entries, &total);
+		if (n == 0) {
+			dir_index += 1;
+			file_index = 0;
+			continue;
+		}
+		
+		for (int i=0; i<n; i++) {
+			file_index += 1;
+			if (entries[i].timestamp >= since) {
+				sprintf(line, "%s{\"dir\":\"%s\",\"name\":\"%s\",\"size\":%lu,\"timestamp\":%lu}",
+				        (num_sent == 0) ? "" : ",", dir_entry.name, entries[i].name,
+				        entries[i].size, entries[i].timestamp);
+				if ((ret = httpd_resp_sendstr_chunk(req, line)) != ESP_OK) break;
+				strcpy(dir_name, dir_entry.name);
+				strcpy(file_name, entries[i].name);
+				if (++num_sent == WEB_SYNC_MAX_FILES) break;
+			}
+		}
+	}
+	
+	if (ret == ESP_OK) {
+		if (num_sent == WEB_SYNC_MAX_FILES) {
+			sprintf(line, "],\"more\":true,\"next\":\"dir=%s&file=%s\"}", dir_name, file_name);
+		} else {
+			strcpy(line, "],\"more\":false}");
+		}
+		ret = httpd_resp_sendstr_chunk(req, line);
+	}
+	if (ret == ESP_OK) {
+		ret = httpd_resp_sendstr_chunk(req, NULL);
+	}
+	
+	return (ret == ESP_OK) ? ESP_OK : ESP_FAIL;
+}
+
+
+// Send a file's tar header and contents, padded to the block size.  It is sent with the
+// length from the catalog (zero filled if it has since gotten shorter).
+static esp_err_t _web_archive_send_file(httpd_req_t* req, uint8_t* buf, char* dir_name, file_catalog_entry_t* entryP)
+{
+	char name[DIR_NAME_LEN + FILE_NAME_LEN + 2];
+	esp_err_t ret;
+	uint32_t pad;
+	
+	sprintf(name, "%s/%s", dir_name, entryP->name);
+	_web_archive_header(buf, name, entryP->size, entryP->timestamp, '0');
+	ret = httpd_resp_send_chunk(req, (const char*) buf, WEB_ARCHIVE_BLOCK_LEN);
+	
+	if (ret == ESP_OK) {
+		pad = (WEB_ARCHIVE_BLOCK_LEN - (entryP->size % WEB_ARCHIVE_BLOCK_LEN)) % WEB_ARCHIVE_BLOCK_LEN;
+		ret = _web_send_card_file(req, buf, dir_name, entryP->name, 0, entryP->size, pad);
+	}
+	
+	return ret;
+}
+
+
+// Fill a ustar header block for name.  timestamp is the FAT date and time from the catalog.
+static void _web_archive_header(uint8_t* hdr, const char* name, uint32_t size, uint32_t timestamp, char type)
+{
+	char* cP = (char*) hdr;
+	struct tm tm;
+	uint32_t mtime = 0;
+	uint32_t sum = 0;
+	
+	if (timestamp != 0) {
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_year = ((timestamp >> 25) & 0x7F) + 80;
+		tm.tm_mon = ((timestamp >> 21) & 0x0F) - 1;
+		tm.tm_mday = (timestamp >> 16) & 0x1F;
+		tm.tm_hour = (timestamp >> 11) & 0x1F;
+		tm.tm_min = (timestamp >> 5) & 0x3F;
+		tm.tm_sec = (timestamp & 0x1F) * 2;
+		tm.tm_isdst = -1;
+		mtime = (uint32_t) mktime(&tm);
+	}
+	
+	memset(hdr, 0, WEB_ARCHIVE_BLOCK_LEN);
+	strncpy(cP, name, 99);
+	strcpy(&cP[100], (type == '5') ? "0000755" : "0000644");
+	strcpy(&cP[108], "0000000");
+	strcpy(&cP[116], "0000000");
+	sprintf(&cP[124], "%011lo", size);
+	sprintf(&cP[136], "%011lo", mtime);
+	cP[156] = type;
+	memcpy(&cP[257], "ustar", 6);
+	memcpy(&cP[263], "00", 2);
+	
+	// Checksum is computed with its own field filled with spaces
+	memset(&cP[148], ' ', 8);
+	for (int i=0; i<WEB_ARCHIVE_BLOCK_LEN; i++) {
+		sum += hdr[i];
+	}
+	sprintf(&cP[148], "%06lo", sum);
+	cP[155] = ' ';
+}
+
+
+
+// Allocate a buffer for card file reads.  The reads are DMA'd straight into internal RAM.
+// It is only needed for one download so it comes from PSRAM if there isn't that much
+// internal RAM free.
+static uint8_t* _web_alloc_card_buf()
+{
+	uint8_t* buf;
+	
+	buf = heap_caps_malloc(WEB_CARD_BUF_LEN, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+	if (buf == NULL) {
+		buf = heap_caps_malloc(WEB_CARD_BUF_LEN, MALLOC_CAP_SPIRAM);
+		if (buf == NULL) {
+			ESP_LOGE(TAG, "malloc card file buffer failed");
+		}
+	}
+	
+	return buf;
+}
+
+
+// Send len bytes of a catalogued file starting at pos, followed by pad zero bytes (less than
+// WEB_ARCHIVE_BLOCK_LEN, added to the last piece).  The card is read WEB_CARD_BUF_LEN bytes
+// at a time.  Bytes past the end of a file that has gotten shorter are sent as zeros.
+static esp_err_t _web_send_card_file(httpd_req_t* req, uint8_t* buf, char* dir_name, char* file_name, uint32_t pos, uint32_t len, uint32_t pad)
+{
+	esp_err_t ret = ESP_OK;
+	int rlen;
+	uint32_t n;
+	uint32_t end = pos + len;
+	
+	while ((ret == ESP_OK) && (pos < end)) {
+		n = end - pos;
+		if (n > WEB_CARD_BUF_LEN) n = WEB_CARD_BUF_LEN;
+		
+		rlen = file_read_card_file(dir_name, file_name, pos, buf, n);
+		if (rlen < 0) {
+			return ESP_FAIL;
+		}
+		if (rlen < n) {
+			memset(&buf[rlen], 0, n - rlen);
+		}
+		pos += n;
+		
+		if (pos == end) {
+			memset(&buf[n], 0, pad);
+			n += pad;
+		}
+		
+		ret = httpd_resp_send_chunk(req, (const char*) buf, (ssize_t) n);
+	}
+	
+	return ret;
 }
 
 #endif /* CONFIG_BUILD_ICAM_MINI */
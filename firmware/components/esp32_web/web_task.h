@@ -27,6 +27,9 @@
 // WEB Task Constants
 //
 
+// Maximum number of websocket clients
+#define WEB_MAX_CLIENTS                     3
+
 //
 // WEB Task notifications
 //
@@ -49,10 +52,44 @@
 #define WEB_NOTIFY_FILE_IMAGE_READY_MASK    0x00008000
 #define WEB_NOTIFY_FILE_TIMELAPSE_ON_MASK   0x00010000
 #define WEB_NOTIFY_FILE_TIMELAPSE_OFF_MASK  0x00020000
+#define WEB_NOTIFY_FILE_JPEG_READY_MASK     0x00040000
+#define WEB_NOTIFY_FILE_PAGE_READY_MASK     0x00080000
+#define WEB_NOTIFY_FILE_THUMB_READY_MASK    0x00800000
+#define WEB_NOTIFY_FILE_RANGE_READY_MASK    0x04000000
 
 // From a controller activity
 #define WEB_NOTIFY_CTRL_ACT_SUCCEEDED_MASK  0x00100000
 #define WEB_NOTIFY_CTRL_ACT_FAILED_MASK     0x00200000
+#define WEB_NOTIFY_CTRL_ACT_PROGRESS_MASK   0x00400000
+
+// From mon_task
+#define WEB_NOTIFY_TELEMETRY_MASK           0x01000000
+
+// From the httpd task when one client changes state broadcast to the others
+#define WEB_NOTIFY_BCAST_MASK               0x02000000
+
+
+//
+// WEB Task typedefs
+//
+
+// Image stream statistics for a websocket client.  Rates and send times are over the last
+// measurement window and are 0 when the client hasn't been sent images recently.
+typedef struct {
+	uint32_t bytes_per_sec;
+	uint32_t fps_x10;         // Images sent per second x 10
+	uint32_t rate_x10;        // Adaptive stream rate (fps x 10)
+	uint32_t send_avg_usec;   // Time to send each image
+	uint32_t send_max_usec;
+	uint32_t frames;          // Images sent since the client connected
+	uint32_t failures;        // Failed image sends since the client connected
+} web_link_client_t;
+
+typedef struct {
+	int num_clients;
+	web_link_client_t clients[WEB_MAX_CLIENTS];
+} web_link_stats_t;
+
 
 
 //
@@ -60,5 +97,11 @@
 //
 void web_task();
 bool web_has_client();
+bool web_needs_frames();
+void web_get_link_stats(web_link_stats_t* stats);
+bool web_set_udp_stream(uint16_t port, int format, int decimation);
+void web_get_udp_stream(uint16_t* port, int* format, int* decimation);
+void web_set_mcast_stream(int format, int decimation);
+void web_get_mcast_stream(int* format, int* decimation);
 
 #endif /* WEB_TASK_H */
@@ -25,10 +25,14 @@
 #include "cmd_utilities.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_random.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "sys_utilities.h"
 #include "tiny1c.h"
 #include "ws_cmd_utilities.h"
+#include "y16_codec.h"
+#include <string.h>
 
 
 
@@ -50,10 +54,10 @@
 #define WS_PKT_DATA_OFFSET  16
 
 // Minimum websocket packet size (no data)
-#define MIN_WS_PKT_LEN      16
+#define MIN_WS_PKT_LEN      WS_CMD_HDR_LEN
 
 // Maximum websocket packet size (sized for the largest item: RGB888 image from jpeg)
-#define MAX_WS_PKT_LEN      (MIN_WS_PKT_LEN + 3*T1C_WIDTH*T1C_HEIGHT)
+#define MAX_WS_PKT_LEN      WS_CMD_MAX_PKT_LEN
 
 // Each TX buffer (sent to gui through websocket) is sized to hold one packet
 #define WS_TX_BUFFER_LEN    (MAX_WS_PKT_LEN)
@@ -66,6 +70,14 @@
 // Maximum number of stored TX packets
 #define WS_MAX_TX_PKTS      4
 
+// The image metadata ROI table holds the whole Tiny1C ROI table and CMD_IMAGE_SAME fits
+// its packet
+_Static_assert((CMD_IMAGE_ROI_SPOTS == T1C_ROI_MAX_SPOTS) && (CMD_IMAGE_ROI_RECTS == T1C_ROI_MAX_RECTS) &&
+               (CMD_IMAGE_ROI_LINES == T1C_ROI_MAX_LINES), "Image metadata ROI table size mismatch");
+_Static_assert((WS_PKT_DATA_OFFSET + CMD_IMAGE_META_LEN) <= WS_CMD_SAME_PKT_LEN, "WS_CMD_SAME_PKT_LEN too small");
+
+#define WS_NUM_GUI_STATE_ITEMS (sizeof(gui_state_handlers) / sizeof(cmd_handler))
+
 
 
 //
@@ -97,13 +109,66 @@ static int tx_buffer_pop_index = 0;
 static int tx_buffer_num_entries = 0;
 static SemaphoreHandle_t tx_mutex;
 
+// Batch being assembled by ws_cmd_batch_begin/end.  Only packets sent by the task that
+// started the batch are added to it.  batch_mutex is held while a batch is in progress.
+static SemaphoreHandle_t batch_mutex;
+static uint8_t* batch_buffer;
+static uint32_t batch_len;
+static TaskHandle_t batch_task = NULL;
+
+// Called with the id of each CMD_SET successfully processed from a received packet
+static void (*rx_set_cb)(cmd_id_t cmd_id) = NULL;
+
+// Cropped and decimated 8-bit image for streams not sending the full image
+static uint8_t* view_buffer;
+
+// Get handlers for the items a remote GUI requests in gui_state_init
+static const cmd_handler gui_state_handlers[] = {
+	cmd_handler_get_agc_mode,
+	cmd_handler_get_ambient_correct,
+	cmd_handler_get_brightness,
+	cmd_handler_get_card_present,
+	cmd_handler_get_emissivity,
+	cmd_handler_get_gain,
+	cmd_handler_get_min_max_enable,
+	cmd_handler_get_palette,
+	cmd_handler_get_palette_stops,
+	cmd_handler_get_palette_threshold,
+	cmd_handler_get_region_enable,
+	cmd_handler_get_save_format,
+	cmd_handler_get_save_ovl_en,
+	cmd_handler_get_spot_enable,
+	cmd_handler_get_shutter,
+	cmd_handler_get_tnr,
+	cmd_handler_get_units,
+	cmd_handler_get_wifi
+};
+
+// GUI state session.  The token identifies this boot of the camera.  Each GUI state item
+// has the state version at which its response (compared by hash) last changed, however it
+// was changed, so a reconnecting client is only sent the items newer than the version it
+// has.  Only used in the httpd task.
+static uint32_t gui_session_token;
+static uint32_t gui_state_version = 0;
+static uint32_t gui_state_hash[WS_NUM_GUI_STATE_ITEMS];
+static uint32_t gui_state_item_version[WS_NUM_GUI_STATE_ITEMS];
+
 
 
 //
 // Forward declarations for internal functions
 //
-static uint32_t _serialize_t1c_buffer(t1c_buffer_t* t1cP, uint8_t* data);
-static uint8_t* _add_i16(int16_t data, uint8_t* buf);
+static bool _process_packet(uint32_t len, uint8_t* data, bool in_batch);
+static void _batch_flush();
+static void _cmd_handler_get_gui_state(cmd_data_t data_type, uint32_t len, uint8_t* data);
+static uint32_t _hash_bytes(uint8_t* buf, uint32_t len);
+static uint32_t _serialize_t1c_buffer(t1c_buffer_t* t1cP, int mode, uint8_t* data);
+static uint32_t _serialize_t1c_view(t1c_buffer_t* t1cP, int mode, int dec, uint16_t x1, uint16_t y1, uint16_t w, uint16_t h, uint8_t y8_output, uint8_t* view_buf, uint8_t* data);
+static uint8_t* _serialize_t1c_meta(t1c_buffer_t* t1cP, uint8_t* data);
+static void _set_roi_area(cmd_image_roi_area_t* aP, IrPoint_t* start, IrPoint_t* end, TpdLineRectTempInfo_t* info);
+static void _get_y8_view(uint8_t* src, int dec, int x1, int y1, int w, int h, uint8_t* dst);
+static uint32_t _encode_y8_delta(uint8_t* src, int w, int h, uint8_t* dst);
+static inline uint8_t _y8_delta_pred(uint8_t* src, int w, int i);
 static uint8_t* _add_u16(uint16_t data, uint8_t* buf);
 
 
@@ -122,6 +187,7 @@ bool ws_gui_cmd_init()
 		}
 	}
 	tx_mutex = xSemaphoreCreateMutex();
+	batch_mutex = xSemaphoreCreateMutex();
 	
 	rx_buffer = (uint8_t*) heap_caps_malloc(WS_RX_BUFFER_LEN, MALLOC_CAP_SPIRAM);
 	if (rx_buffer == NULL) {
@@ -129,39 +195,86 @@ bool ws_gui_cmd_init()
 		return false;
 	}
 	
+	view_buffer = (uint8_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT, MALLOC_CAP_SPIRAM);
+	if (view_buffer == NULL) {
+		ESP_LOGE(TAG, "malloc view_buffer failed");
+		return false;
+	}
+	
+	batch_buffer = (uint8_t*) heap_caps_malloc(CMD_BATCH_MAX_LEN, MALLOC_CAP_SPIRAM);
+	if (batch_buffer == NULL) {
+		ESP_LOGE(TAG, "malloc batch_buffer failed");
+		return false;
+	}
+	
+	gui_session_token = esp_random();
+	
 	// Initialize the command system
 	if (!cmd_init_remote(ws_cmd_send_handler)) {
 		return false;
 	}
 	
 	// Register command handlers supported on our end (get, set, rsp)
+	(void) cmd_register_cmd_id(CMD_AGC_MODE, cmd_handler_get_agc_mode, cmd_handler_set_agc_mode, NULL);
 	(void) cmd_register_cmd_id(CMD_AMBIENT_CORRECT, cmd_handler_get_ambient_correct, cmd_handler_set_ambient_correct, NULL);
 	(void) cmd_register_cmd_id(CMD_BATT_LEVEL, cmd_handler_get_batt_level, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_BENCHMARK, cmd_handler_get_benchmark, NULL, NULL);
 	(void) cmd_register_cmd_id(CMD_BRIGHTNESS, cmd_handler_get_brightness, cmd_handler_set_brightness, NULL);
+	(void) cmd_register_cmd_id(CMD_BURST, NULL, cmd_handler_set_burst, NULL);
 	(void) cmd_register_cmd_id(CMD_CTRL_ACTIVITY, NULL, cmd_handler_set_ctrl_activity, NULL);
+	(void) cmd_register_cmd_id(CMD_DEAD_PIXELS, cmd_handler_get_dead_pixels, cmd_handler_set_dead_pixels, NULL);
 	(void) cmd_register_cmd_id(CMD_CARD_PRESENT, cmd_handler_get_card_present, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_CHANGE_DETECT, cmd_handler_get_change_detect, cmd_handler_set_change_detect, NULL);
 	(void) cmd_register_cmd_id(CMD_EMISSIVITY, cmd_handler_get_emissivity, cmd_handler_set_emissivity, NULL);
 	(void) cmd_register_cmd_id(CMD_FILE_CATALOG, cmd_handler_get_file_catalog, NULL, NULL);
 	(void) cmd_register_cmd_id(CMD_FILE_DELETE, NULL, cmd_handler_set_file_delete, NULL);
+	(void) cmd_register_cmd_id(CMD_FILE_CATALOG_PAGE, cmd_handler_get_file_catalog_page, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_FILE_CATALOG_RANGE, cmd_handler_get_file_catalog_range, NULL, NULL);
 	(void) cmd_register_cmd_id(CMD_FILE_GET_IMAGE, cmd_handler_get_file_image, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_FILE_GET_JPEG, cmd_handler_get_file_jpeg, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_FILE_GET_THUMB, cmd_handler_get_file_thumb, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_FRAME_STATS, cmd_handler_get_frame_stats, NULL, NULL);
 	(void) cmd_register_cmd_id(CMD_FFC, NULL, cmd_handler_set_ffc, NULL);
 	(void) cmd_register_cmd_id(CMD_GAIN, cmd_handler_get_gain, cmd_handler_set_gain, NULL);
+	(void) cmd_register_cmd_id(CMD_GUI_STATE, _cmd_handler_get_gui_state, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_LINK_STATS, cmd_handler_get_link_stats, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_LOG, NULL, cmd_handler_set_log, NULL);
+	(void) cmd_register_cmd_id(CMD_MCAST_STREAM, cmd_handler_get_mcast_stream, cmd_handler_set_mcast_stream, NULL);
 	(void) cmd_register_cmd_id(CMD_MIN_MAX_EN, cmd_handler_get_min_max_enable, cmd_handler_set_min_max_enable, NULL);
 	(void) cmd_register_cmd_id(CMD_ORIENTATION, NULL, cmd_handler_set_orientation, NULL);
 	(void) cmd_register_cmd_id(CMD_PALETTE, cmd_handler_get_palette, cmd_handler_set_palette, NULL);
+	(void) cmd_register_cmd_id(CMD_PALETTE_STOPS, cmd_handler_get_palette_stops, cmd_handler_set_palette_stops, NULL);
+	(void) cmd_register_cmd_id(CMD_PALETTE_THRESHOLD, cmd_handler_get_palette_threshold, cmd_handler_set_palette_threshold, NULL);
+	(void) cmd_register_cmd_id(CMD_PERF_STATS, cmd_handler_get_perf_stats, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_PICTURE_AVG, cmd_handler_get_picture_avg, cmd_handler_set_picture_avg, NULL);
+	(void) cmd_register_cmd_id(CMD_PING, cmd_handler_get_ping, NULL, NULL);
 	(void) cmd_register_cmd_id(CMD_POWEROFF, NULL, cmd_handler_set_poweroff, NULL);
+	(void) cmd_register_cmd_id(CMD_PRE_TRIGGER, NULL, cmd_handler_set_pre_trigger, NULL);
+	(void) cmd_register_cmd_id(CMD_RECORD, NULL, cmd_handler_set_record, NULL);
 	(void) cmd_register_cmd_id(CMD_REGION_EN, cmd_handler_get_region_enable, cmd_handler_set_region_enable, NULL);
 	(void) cmd_register_cmd_id(CMD_REGION_LOC, NULL, cmd_handler_set_region_location, NULL);
+	(void) cmd_register_cmd_id(CMD_REPLAY, cmd_handler_get_replay, cmd_handler_set_replay, NULL);
+	(void) cmd_register_cmd_id(CMD_REPLAY_FRAME, NULL, cmd_handler_set_replay_frame, NULL);
+	(void) cmd_register_cmd_id(CMD_REPLAY_RATE, cmd_handler_get_replay_rate, cmd_handler_set_replay_rate, NULL);
+	(void) cmd_register_cmd_id(CMD_ROI_TABLE, cmd_handler_get_roi_table, cmd_handler_set_roi_table, NULL);
 	(void) cmd_register_cmd_id(CMD_SHUTTER_INFO, cmd_handler_get_shutter, cmd_handler_set_shutter, NULL);
+	(void) cmd_register_cmd_id(CMD_SAVE_FORMAT, cmd_handler_get_save_format, cmd_handler_set_save_format, NULL);
 	(void) cmd_register_cmd_id(CMD_SAVE_OVL_EN, cmd_handler_get_save_ovl_en, cmd_handler_set_save_ovl_en, NULL);
 	(void) cmd_register_cmd_id(CMD_SAVE_PALETTE, NULL, cmd_handler_set_save_palette, NULL);
+	(void) cmd_register_cmd_id(CMD_SPATIAL_FILTER, cmd_handler_get_spatial_filter, cmd_handler_set_spatial_filter, NULL);
 	(void) cmd_register_cmd_id(CMD_SPOT_EN, cmd_handler_get_spot_enable, cmd_handler_set_spot_enable, NULL);
 	(void) cmd_register_cmd_id(CMD_SPOT_LOC, NULL, cmd_handler_set_spot_location, NULL);
 	(void) cmd_register_cmd_id(CMD_STREAM_EN, NULL, cmd_handler_set_stream_enable, NULL);
+	(void) cmd_register_cmd_id(CMD_STREAM_VIEW, NULL, cmd_handler_set_stream_view, NULL);
+	(void) cmd_register_cmd_id(CMD_SUBSCRIBE, NULL, cmd_handler_set_subscribe, NULL);
 	(void) cmd_register_cmd_id(CMD_SYS_INFO, cmd_handler_get_sys_info, NULL, NULL);
 	(void) cmd_register_cmd_id(CMD_TAKE_PICTURE, NULL, cmd_handler_set_take_picture, NULL);
+	(void) cmd_register_cmd_id(CMD_TELEMETRY, cmd_handler_get_telemetry, cmd_handler_set_telemetry, NULL);
 	(void) cmd_register_cmd_id(CMD_TIME, cmd_handler_get_time, cmd_handler_set_time, NULL);
 	(void) cmd_register_cmd_id(CMD_TIMELAPSE_CFG, NULL, cmd_handler_set_timelapse_cfg, NULL);
+	(void) cmd_register_cmd_id(CMD_TNR, cmd_handler_get_tnr, cmd_handler_set_tnr, NULL);
+	(void) cmd_register_cmd_id(CMD_TRIGGER_CFG, NULL, cmd_handler_set_trigger_cfg, NULL);
+	(void) cmd_register_cmd_id(CMD_UDP_STREAM, cmd_handler_get_udp_stream, cmd_handler_set_udp_stream, NULL);
 	(void) cmd_register_cmd_id(CMD_UNITS, cmd_handler_get_units, cmd_handler_set_units, NULL);
 	(void) cmd_register_cmd_id(CMD_WIFI_INFO, cmd_handler_get_wifi, cmd_handler_set_wifi, NULL);
 	
@@ -187,6 +300,52 @@ bool ws_cmd_get_tx_data(uint32_t* len, uint8_t** data)
 }
 
 
+// Copy as many of the packets waiting in the tx buffer as fit into buf (max_len bytes long),
+// combined into one CMD_BATCH packet when there is more than one, and return the length.
+// Returns 0 when there are none or the next one doesn't fit (get it using
+// ws_cmd_get_tx_data instead).  The contents of batches already in the tx buffer are added
+// to the new batch since batches don't nest.
+uint32_t ws_cmd_get_tx_batch(uint8_t* buf, uint32_t max_len)
+{
+	int n = 0;
+	bool first_is_batch = false;
+	bool is_batch;
+	uint8_t* srcP;
+	uint32_t len = 0;
+	uint32_t slen;
+	
+	xSemaphoreTake(tx_mutex, portMAX_DELAY);
+	while (tx_buffer_num_entries > 0) {
+		srcP = tx_buffer[tx_buffer_pop_index].buf;
+		slen = tx_buffer[tx_buffer_pop_index].len;
+		is_batch = (ntohl(*((uint32_t*) &srcP[WS_PKT_ID_OFFSET])) == (uint32_t) CMD_BATCH);
+		if (is_batch) {
+			srcP += WS_PKT_DATA_OFFSET;
+			slen -= WS_PKT_DATA_OFFSET;
+		}
+		if ((WS_PKT_DATA_OFFSET + len + slen) > max_len) break;
+		
+		memcpy(buf + WS_PKT_DATA_OFFSET + len, srcP, slen);
+		len += slen;
+		if (n++ == 0) first_is_batch = is_batch;
+		if (++tx_buffer_pop_index >= WS_MAX_TX_PKTS) tx_buffer_pop_index = 0;
+		tx_buffer_num_entries -= 1;
+	}
+	xSemaphoreGive(tx_mutex);
+	
+	if (n == 0) {
+		return 0;
+	} else if ((n == 1) && !first_is_batch) {
+		// A single packet is sent as-is
+		memmove(buf, buf + WS_PKT_DATA_OFFSET, len);
+		return len;
+	} else {
+		ws_cmd_encode_header(CMD_SET, CMD_BATCH, CMD_DATA_BINARY, len, buf);
+		return WS_PKT_DATA_OFFSET + len;
+	}
+}
+
+
 uint8_t* ws_cmd_get_rx_data_buffer()
 {
 	return rx_buffer;
@@ -195,30 +354,15 @@ uint8_t* ws_cmd_get_rx_data_buffer()
 
 bool ws_cmd_process_socket_rx_data(uint32_t len, uint8_t* data)
 {
-	cmd_t cmd_type;
-	cmd_id_t cmd_id;
-	cmd_data_t data_type;
-	uint32_t dlen;
-	
-	// Make sure received data contains at least the minimum cmd arguments
-	if (len < MIN_WS_PKT_LEN) {
-		ESP_LOGE(TAG, "Illegal websocket packet length %lu", len);
-		return false;
-	}
-	
-	// Make sure the received data length matches what the cmd says its length is
-	dlen = ntohl(*((uint32_t*) &data[WS_PKT_LEN_OFFSET]));
-	if (len != dlen) {
-		ESP_LOGE(TAG, "websocket packet len %lu does not match expected %lu", len, dlen);
-		return false;
-	}
-	
-	// Convert raw packet data in network order to cmd arguments
-	cmd_type = (cmd_t) ntohl(*((uint32_t*) &data[WS_PKT_CTYPE_OFFSET]));
-	cmd_id = (cmd_id_t) ntohl(*((uint32_t*) &data[WS_PKT_ID_OFFSET]));
-	data_type = (cmd_data_t) ntohl(*((uint32_t*) &data[WS_PKT_DTYPE_OFFSET]));
-	dlen = len - WS_PKT_DATA_OFFSET;
-	return cmd_process_received_cmd(cmd_type, cmd_id, data_type, dlen, data + WS_PKT_DATA_OFFSET);
+	return _process_packet(len, data, false);
+}
+
+
+// Register a function to be called (in the task processing received packets) after each
+// CMD_SET, including those in a CMD_BATCH, is processed
+void ws_cmd_set_rx_set_callback(void (*cb)(cmd_id_t cmd_id))
+{
+	rx_set_cb = cb;
 }
 
 
@@ -228,6 +372,21 @@ bool ws_cmd_send_handler(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type,
 	uint32_t* tx32P;
 	uint8_t* tx8P;
 	
+	// Add the packet to the batch being assembled by this task
+	if ((batch_task != NULL) && (batch_task == xTaskGetCurrentTaskHandle())) {
+		if ((batch_len + WS_PKT_DATA_OFFSET + len) > CMD_BATCH_MAX_LEN) {
+			_batch_flush();
+		}
+		if ((batch_len + WS_PKT_DATA_OFFSET + len) <= CMD_BATCH_MAX_LEN) {
+			ws_cmd_encode_header(cmd_type, cmd_id, data_type, len, batch_buffer + batch_len);
+			if (len != 0) {
+				memcpy(batch_buffer + batch_len + WS_PKT_DATA_OFFSET, data, len);
+			}
+			batch_len += WS_PKT_DATA_OFFSET + len;
+			return true;
+		}
+	}
+	
 	if (tx_buffer_num_entries == WS_MAX_TX_PKTS) {
 		ESP_LOGE(TAG, "TX Buffer full for ws_cmd_send_handler(%d, %d, %d, ...)", (int) cmd_type, (int) cmd_id, (int) data_type);
 		return false;
@@ -242,14 +401,11 @@ bool ws_cmd_send_handler(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type,
 	tx_buffer_num_entries += 1;
 	
 	// Add the fields, in order, to the websocket packet in network byte order
-	*tx32P++ = htonl(WS_PKT_DATA_OFFSET + len);
-	*tx32P++ = htonl((uint32_t) cmd_type);
-	*tx32P++ = htonl((uint32_t) cmd_id);
-	*tx32P   = htonl((uint32_t) data_type);
+	ws_cmd_encode_header(cmd_type, cmd_id, data_type, len, (uint8_t*) tx32P);
 	
 	// Add data if it exists
-	while (len--) {
-		*tx8P++ = *data++;
+	if (len != 0) {
+		memcpy(tx8P, data, len);
 	}
 	
 	xSemaphoreGive(tx_mutex);
@@ -258,143 +414,379 @@ bool ws_cmd_send_handler(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type,
 }
 
 
-// Directly encode a t1c_buffer_t buffer as a command response into our tx_buffer
-bool ws_cmd_send_t1c_image(t1c_buffer_t* t1cP)
+// Collect the packets sent by the calling task until ws_cmd_batch_end into one CMD_BATCH
+// packet (or more if they don't fit in one)
+void ws_cmd_batch_begin()
 {
-	uint32_t* tx32P;
-	uint8_t* tx8P;
-	uint32_t dlen;
-	int push_index;
+	xSemaphoreTake(batch_mutex, portMAX_DELAY);
+	batch_len = 0;
+	batch_task = xTaskGetCurrentTaskHandle();
+}
+
+
+void ws_cmd_batch_end()
+{
+	_batch_flush();
+	batch_task = NULL;
+	xSemaphoreGive(batch_mutex);
+}
+
+
+// End a batch copying the packets collected (without a CMD_BATCH header) into buf instead of
+// sending them.  Returns the length or 0 if they don't fit in max_len bytes.
+uint32_t ws_cmd_batch_take(uint8_t* buf, uint32_t max_len)
+{
+	uint32_t len = batch_len;
 	
-	if (tx_buffer_num_entries == WS_MAX_TX_PKTS) {
-		ESP_LOGE(TAG, "TX Buffer full for ws_cmd_send_t1c_image");
-		return false;
+	if (len > max_len) {
+		len = 0;
+	} else if (len != 0) {
+		memcpy(buf, batch_buffer, len);
 	}
+	batch_task = NULL;
+	xSemaphoreGive(batch_mutex);
 	
-	// Atomically get and fill a buffer
-	xSemaphoreTake(tx_mutex, portMAX_DELAY);
-	tx32P = (uint32_t*) tx_buffer[tx_buffer_push_index].buf;
-	tx8P = tx_buffer[tx_buffer_push_index].buf + WS_PKT_DATA_OFFSET;
-	push_index = tx_buffer_push_index;
-	if (++tx_buffer_push_index == WS_MAX_TX_PKTS) tx_buffer_push_index = 0;
-	tx_buffer_num_entries += 1;
+	return len;
+}
+
+
+// Directly encode a t1c_buffer_t buffer as a complete command packet into buf (which must
+// be at least WS_CMD_MAX_PKT_LEN bytes) and return its length.  This bypasses our tx_buffer
+// so one packet can be shared by all clients.
+uint32_t ws_cmd_encode_t1c_image(t1c_buffer_t* t1cP, uint8_t* buf)
+{
+	uint32_t* tx32P = (uint32_t*) buf;
+	uint32_t dlen;
+	int mode = cmd_handler_stream_mode();
 	
 	// Start by adding the t1c data to the data area
-	dlen = _serialize_t1c_buffer(t1cP, tx8P);
-	
-	// Set the length of the websocket packet
-	tx_buffer[push_index].len = WS_PKT_DATA_OFFSET + dlen;
+	dlen = _serialize_t1c_buffer(t1cP, mode, buf + WS_PKT_DATA_OFFSET);
 	
 	// Finally add the websocket packet fields in network byte order
 	*tx32P++ = htonl(WS_PKT_DATA_OFFSET + dlen);
 	*tx32P++ = htonl((uint32_t) CMD_SET);
-	*tx32P++ = htonl((uint32_t) CMD_IMAGE);
+	if ((mode == CMD_STREAM_Y16) || (mode == CMD_STREAM_Y16_DELTA)) {
+		*tx32P++ = htonl((uint32_t) CMD_IMAGE_Y16);
+	} else {
+		*tx32P++ = htonl((uint32_t) CMD_IMAGE);
+	}
 	*tx32P   = htonl((uint32_t) CMD_DATA_BINARY);
 	
-	xSemaphoreGive(tx_mutex);
+	return WS_PKT_DATA_OFFSET + dlen;
+}
+
+
+// Encode a CMD_IMAGE_SAME packet with just the metadata from a t1c_buffer_t into buf (which
+// must be at least WS_CMD_SAME_PKT_LEN bytes) for a client that already has its image data
+// and return its length
+uint32_t ws_cmd_encode_t1c_image_same(t1c_buffer_t* t1cP, uint8_t* buf)
+{
+	uint32_t* tx32P = (uint32_t*) buf;
+	uint32_t dlen;
 	
-	return true;
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	dlen = _serialize_t1c_meta(t1cP, buf + WS_PKT_DATA_OFFSET) - (buf + WS_PKT_DATA_OFFSET);
+	xSemaphoreGive(t1cP->mutex);
+	
+	*tx32P++ = htonl(WS_PKT_DATA_OFFSET + dlen);
+	*tx32P++ = htonl((uint32_t) CMD_SET);
+	*tx32P++ = htonl((uint32_t) CMD_IMAGE_SAME);
+	*tx32P   = htonl((uint32_t) CMD_DATA_BINARY);
+	
+	return WS_PKT_DATA_OFFSET + dlen;
 }
 
 
-bool ws_cmd_send_file_image(uint32_t* rgb888)
+// Encode the data of a CMD_IMAGE packet (for the Y8 stream modes) with the whole image
+// decimated by dec, or of a CMD_IMAGE_Y16 packet (for the Y16 modes), into buf for another
+// transport and return its length.  view_buf must be T1C_WIDTH*T1C_HEIGHT bytes when dec
+// is not 1.
+uint32_t ws_cmd_encode_t1c_data(t1c_buffer_t* t1cP, int mode, int dec, uint8_t y8_output, uint8_t* view_buf, uint8_t* buf)
 {
-	uint32_t* tx32P;
-	uint8_t* tx8P;
+	return _serialize_t1c_view(t1cP, mode, dec, 0, 0, T1C_WIDTH/dec, T1C_HEIGHT/dec, y8_output, view_buf, buf);
+}
+
+
+// Encode just the cmd_image_meta_t of a CMD_IMAGE_SAME packet into buf for another transport
+// and return its length
+uint32_t ws_cmd_encode_t1c_meta(t1c_buffer_t* t1cP, uint8_t* buf)
+{
+	uint32_t len;
+	
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	len = _serialize_t1c_meta(t1cP, buf) - buf;
+	xSemaphoreGive(t1cP->mutex);
+	
+	return len;
+}
+
+
+// Return a key identifying the image data ws_cmd_encode_t1c_image would send for a
+// t1c_buffer_t.  It depends on the frame's hash and everything that changes how it is
+// encoded so two images with the same key look the same to a client.
+uint32_t ws_cmd_t1c_image_key(t1c_buffer_t* t1cP)
+{
+	int dec;
+	uint16_t x1, y1, w, h;
+	uint32_t key;
+	
+	cmd_handler_stream_view(&dec, &x1, &y1, &w, &h);
+	
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	key = t1cP->img_hash ^ (t1cP->agc_seq * 2654435761UL);
+	key ^= ((uint32_t) t1cP->y8_filt_mask << 28) | ((uint32_t) t1cP->y16_is_temp << 27);
+	xSemaphoreGive(t1cP->mutex);
+	
+	key ^= ((uint32_t) cmd_handler_stream_mode() << 24) | ((uint32_t) dec << 20);
+	key ^= ((uint32_t) x1 << 16) ^ ((uint32_t) y1 << 8) ^ ((uint32_t) w << 12) ^ (uint32_t) h;
+	
+	return key;
+}
+
+
+// Encode the websocket packet header for a packet with len bytes of data that will follow
+// in a separate fragment.  buf must be at least WS_CMD_HDR_LEN bytes long.
+void ws_cmd_encode_header(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type, uint32_t len, uint8_t* buf)
+{
+	uint32_t* tx32P = (uint32_t*) buf;
+	
+	*tx32P++ = htonl(WS_PKT_DATA_OFFSET + len);
+	*tx32P++ = htonl((uint32_t) cmd_type);
+	*tx32P++ = htonl((uint32_t) cmd_id);
+	*tx32P   = htonl((uint32_t) data_type);
+}
+
+
+
+//
+// Internal functions
+//
+static bool _process_packet(uint32_t len, uint8_t* data, bool in_batch)
+{
+	cmd_t cmd_type;
+	cmd_id_t cmd_id;
+	cmd_data_t data_type;
 	uint32_t dlen;
-	int push_index;
+	uint32_t plen;
 	
-	if (tx_buffer_num_entries == WS_MAX_TX_PKTS) {
-		ESP_LOGE(TAG, "TX Buffer full for ws_cmd_send_file_image");
+	// Make sure received data contains at least the minimum cmd arguments
+	if (len < MIN_WS_PKT_LEN) {
+		ESP_LOGE(TAG, "Illegal websocket packet length %lu", len);
 		return false;
 	}
 	
-	// Atomically get and fill a buffer
-	xSemaphoreTake(tx_mutex, portMAX_DELAY);
-	tx32P = (uint32_t*) tx_buffer[tx_buffer_push_index].buf;
-	tx8P = tx_buffer[tx_buffer_push_index].buf + WS_PKT_DATA_OFFSET;
-	push_index = tx_buffer_push_index;
-	if (++tx_buffer_push_index == WS_MAX_TX_PKTS) tx_buffer_push_index = 0;
-	tx_buffer_num_entries += 1;
+	// Make sure the received data length matches what the cmd says its length is
+	dlen = ntohl(*((uint32_t*) &data[WS_PKT_LEN_OFFSET]));
+	if (len != dlen) {
+		ESP_LOGE(TAG, "websocket packet len %lu does not match expected %lu", len, dlen);
+		return false;
+	}
 	
-	// Start by adding the pixel data to the data area
-	dlen = 3*T1C_WIDTH*T1C_HEIGHT;
-	memcpy(tx8P, (uint8_t*) rgb888, (size_t) dlen);
+	// Convert raw packet data in network order to cmd arguments
+	cmd_type = (cmd_t) ntohl(*((uint32_t*) &data[WS_PKT_CTYPE_OFFSET]));
+	cmd_id = (cmd_id_t) ntohl(*((uint32_t*) &data[WS_PKT_ID_OFFSET]));
+	data_type = (cmd_data_t) ntohl(*((uint32_t*) &data[WS_PKT_DTYPE_OFFSET]));
+	dlen = len - WS_PKT_DATA_OFFSET;
+	data += WS_PKT_DATA_OFFSET;
 	
-	// Set the length of the websocket packet
-	tx_buffer[push_index].len = WS_PKT_DATA_OFFSET + dlen;
+	if ((cmd_type == CMD_SET) && (cmd_id == CMD_BATCH)) {
+		if (in_batch) {
+			ESP_LOGE(TAG, "Nested batch packet");
+			return false;
+		}
+		
+		// Process each contained packet in order
+		while (dlen != 0) {
+			if (dlen < MIN_WS_PKT_LEN) {
+				ESP_LOGE(TAG, "Illegal batch packet length %lu", dlen);
+				return false;
+			}
+			plen = ntohl(*((uint32_t*) &data[WS_PKT_LEN_OFFSET]));
+			if ((plen < MIN_WS_PKT_LEN) || (plen > dlen)) {
+				ESP_LOGE(TAG, "Illegal batch packet length %lu", plen);
+				return false;
+			}
+			if (!_process_packet(plen, data, true)) {
+				return false;
+			}
+			data += plen;
+			dlen -= plen;
+		}
+		return true;
+	}
 	
-	// Finally add the websocket packet fields in network byte order
-	*tx32P++ = htonl(WS_PKT_DATA_OFFSET + dlen);
-	*tx32P++ = htonl((uint32_t) CMD_RSP);
-	*tx32P++ = htonl((uint32_t) CMD_FILE_GET_IMAGE);
-	*tx32P   = htonl((uint32_t) CMD_DATA_BINARY);
+	if (!cmd_process_received_cmd(cmd_type, cmd_id, data_type, dlen, data)) {
+		return false;
+	}
 	
-	xSemaphoreGive(tx_mutex);
+	if ((cmd_type == CMD_SET) && (rx_set_cb != NULL)) {
+		rx_set_cb(cmd_id);
+	}
 	
 	return true;
 }
 
 
+// Send the packets collected so far as a CMD_BATCH packet
+static void _batch_flush()
+{
+	TaskHandle_t task = batch_task;
+	
+	if (batch_len != 0) {
+		batch_task = NULL;
+		(void) ws_cmd_send_handler(CMD_SET, CMD_BATCH, CMD_DATA_BINARY, batch_len, batch_buffer);
+		batch_task = task;
+		batch_len = 0;
+	}
+}
 
-//
-// Internal functions
-//
 
-// Serialize a t1c_buffer_t into a network order byte array and return the length.
-// This is full-on custom code which must be reversed in the gui's rsp handler.  It
-// has to change if the contents of t1c_buffer_t change.
-static uint32_t _serialize_t1c_buffer(t1c_buffer_t* t1cP, uint8_t* data)
+// Respond with the items a remote GUI requests in gui_state_init as one batch followed by
+// the session token and state version.  A client resuming this session is only sent the
+// items that changed since the version it has.
+static void _cmd_handler_get_gui_state(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint8_t rsp[CMD_GUI_STATE_LEN];
+	uint32_t client_version = 0;
+	uint32_t start;
+	uint32_t h;
+	bool changed = false;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_GUI_STATE_LEN)) {
+		if (ntohl(*((uint32_t*) &data[0])) == gui_session_token) {
+			client_version = ntohl(*((uint32_t*) &data[4]));
+			if (client_version > gui_state_version) client_version = 0;
+		}
+	}
+	
+	ws_cmd_batch_begin();
+	for (int i=0; i<WS_NUM_GUI_STATE_ITEMS; i++) {
+		start = batch_len;
+		gui_state_handlers[i](CMD_DATA_NONE, 0, NULL);
+		if (batch_len < start) {
+			// The batch was sent to make room for this item
+			start = 0;
+		}
+		
+		h = _hash_bytes(batch_buffer + start, batch_len - start);
+		if (h != gui_state_hash[i]) {
+			gui_state_hash[i] = h;
+			gui_state_item_version[i] = gui_state_version + 1;
+			changed = true;
+		}
+		
+		// Drop items the client already has
+		if (gui_state_item_version[i] <= client_version) {
+			batch_len = start;
+		}
+	}
+	if (changed) {
+		gui_state_version += 1;
+	}
+	
+	*((uint32_t*) &rsp[0]) = htonl(gui_session_token);
+	*((uint32_t*) &rsp[4]) = htonl(gui_state_version);
+	if (!cmd_send_binary(CMD_RSP, CMD_GUI_STATE, CMD_GUI_STATE_LEN, rsp)) {
+		ESP_LOGE(TAG, "Couldn't send gui state");
+	}
+	ws_cmd_batch_end();
+}
+
+
+// FNV-1a
+static uint32_t _hash_bytes(uint8_t* buf, uint32_t len)
+{
+	uint32_t h = 2166136261UL;
+	
+	while (len--) {
+		h = (h ^ *buf++) * 16777619UL;
+	}
+	
+	return h;
+}
+
+
+// Serialize a t1c_buffer_t into a byte array for the websocket clients and return the
+// length.  The image data is encoded according to the stream mode and view.
+static uint32_t _serialize_t1c_buffer(t1c_buffer_t* t1cP, int mode, uint8_t* data)
+{
+	int dec;
+	uint16_t x1, y1, w, h;
+	
+	cmd_handler_stream_view(&dec, &x1, &y1, &w, &h);
+	
+	return _serialize_t1c_view(t1cP, mode, dec, x1, y1, w, h, T1C_Y8F_OUT_GUI, view_buffer, data);
+}
+
+
+// Serialize a t1c_buffer_t into a byte array and return the length.  The metadata is a
+// cmd_image_meta_t followed by the network order Y16 or view header which must be reversed
+// in the gui's rsp handler.  The image data is encoded according to mode.  Y8 data is taken
+// from the plane for y8_output and cropped and decimated into view_buf when the view isn't
+// the whole image.
+static uint32_t _serialize_t1c_view(t1c_buffer_t* t1cP, int mode, int dec, uint16_t x1, uint16_t y1, uint16_t w, uint16_t h, uint8_t y8_output, uint8_t* view_buf, uint8_t* data)
 {
-	uint8_t* dP = data;
-	uint16_t* imgP = t1cP->img_data;
-	uint32_t diff;
-	uint32_t t32;
+	uint8_t* dP;
+	uint8_t* srcP;
+	uint32_t len;
 	
 	// Lock access
 	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
 	
-	// Boolean flags as bytes
-	*dP++ = (uint8_t) t1cP->high_gain;
-	*dP++ = (uint8_t) t1cP->vid_frozen;
-	*dP++ = (uint8_t) t1cP->spot_valid;
-	*dP++ = (uint8_t) t1cP->minmax_valid;
-	*dP++ = (uint8_t) t1cP->region_valid;
-	*dP++ = (uint8_t) t1cP->amb_temp_valid;
-	*dP++ = (uint8_t) t1cP->amb_hum_valid;
-	*dP++ = (uint8_t) t1cP->distance_valid;
-	
-	// Various data values
-	dP = _add_i16(t1cP->amb_temp, dP);
-	dP = _add_u16(t1cP->amb_hum, dP);
-	dP = _add_u16(t1cP->distance, dP);
-	dP = _add_u16(t1cP->spot_temp, dP);
-	dP = _add_u16(t1cP->spot_point.x, dP);
-	dP = _add_u16(t1cP->spot_point.y, dP);
-	dP = _add_u16(t1cP->max_min_temp_info.min_temp, dP);
-	dP = _add_u16(t1cP->max_min_temp_info.min_temp_point.x, dP);
-	dP = _add_u16(t1cP->max_min_temp_info.min_temp_point.y, dP);
-	dP = _add_u16(t1cP->max_min_temp_info.max_temp, dP);
-	dP = _add_u16(t1cP->max_min_temp_info.max_temp_point.x, dP);
-	dP = _add_u16(t1cP->max_min_temp_info.max_temp_point.y, dP);
-	dP = _add_u16(t1cP->region_points.start_point.x, dP);
-	dP = _add_u16(t1cP->region_points.start_point.y, dP);
-	dP = _add_u16(t1cP->region_points.end_point.x, dP);
-	dP = _add_u16(t1cP->region_points.end_point.y, dP);
-	dP = _add_u16(t1cP->region_temp_info.temp_info_value.ave_temp, dP);
-	dP = _add_u16(t1cP->region_temp_info.temp_info_value.min_temp, dP);
-	dP = _add_u16(t1cP->region_temp_info.min_temp_point.x, dP);
-	dP = _add_u16(t1cP->region_temp_info.min_temp_point.y, dP);
-	dP = _add_u16(t1cP->region_temp_info.temp_info_value.max_temp, dP);
-	dP = _add_u16(t1cP->region_temp_info.max_temp_point.x, dP);
-	dP = _add_u16(t1cP->region_temp_info.max_temp_point.y, dP);
-	
-	// Add the raw image data, scaling it to 8-bits
-	diff = t1cP->y16_max - t1cP->y16_min;
-	if (diff == 0) diff = 1;
-	while (imgP < (t1cP->img_data + T1C_WIDTH*T1C_HEIGHT)) {
-		t32 = ((uint32_t)(*imgP++ - t1cP->y16_min) * 255) / diff;
-		*dP++ = ((t32 > 255) ? 255 : (uint8_t) t32);
+	// Metadata common to all image packets
+	dP = _serialize_t1c_meta(t1cP, data);
+	
+	if ((mode == CMD_STREAM_Y16) || (mode == CMD_STREAM_Y16_DELTA)) {
+		// Add the raw Y16 data, encoded if requested and smaller
+		*dP = CMD_IMG_Y16_ENC_RAW;
+		*(dP+1) = (uint8_t) t1cP->y16_is_temp;
+		(void) _add_u16(t1cP->agc_min, dP+2);
+		(void) _add_u16(t1cP->agc_max, dP+4);
+		dP += CMD_IMAGE_Y16_HDR_LEN;
+		if (mode == CMD_STREAM_Y16_DELTA) {
+			len = y16_codec_encode(t1cP->img_data, T1C_WIDTH, T1C_HEIGHT, dP, 2*T1C_WIDTH*T1C_HEIGHT - 1);
+		} else {
+			len = 0;
+		}
+		if (len != 0) {
+			*(dP - CMD_IMAGE_Y16_HDR_LEN) = CMD_IMG_Y16_ENC_RICE;
+		} else {
+			for (int i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+				dP = _add_u16(t1cP->img_data[i], dP);
+			}
+		}
+		dP += len;
+	} else {
+		// Add the view header
+		dP = _add_u16((uint16_t) dec, dP);
+		dP = _add_u16(x1, dP);
+		dP = _add_u16(y1, dP);
+		dP = _add_u16(w, dP);
+		dP = _add_u16(h, dP);
+		*dP++ = (uint8_t) t1cP->y16_is_temp;
+		*dP++ = 0;
+		dP = _add_u16(t1cP->agc_min, dP);
+		dP = _add_u16(t1cP->agc_max, dP);
+		
+		// Add the image data already scaled to 8-bits (and filtered if enabled for the GUI
+		// the client displays), cropped and decimated to the view, encoded if requested and
+		// smaller
+		if ((w == T1C_WIDTH) && (h == T1C_HEIGHT)) {
+			srcP = t1c_get_y8_data(t1cP, y8_output);
+		} else {
+			_get_y8_view(t1c_get_y8_data(t1cP, y8_output), dec, x1, y1, w, h, view_buf);
+			srcP = view_buf;
+		}
+		if (mode == CMD_STREAM_Y8_DELTA) {
+			len = _encode_y8_delta(srcP, w, h, dP);
+		} else {
+			len = 0;
+		}
+		if (len == 0) {
+			memcpy(dP, srcP, w*h);
+			len = w*h;
+		}
+		dP += len;
 	}
 	
 	// Unlock
@@ -404,13 +796,178 @@ static uint32_t _serialize_t1c_buffer(t1c_buffer_t* t1cP, uint8_t* data)
 }
 
 
-static uint8_t* _add_i16(int16_t data, uint8_t* buf)
+// Serialize the metadata from a t1c_buffer_t that starts CMD_IMAGE, CMD_IMAGE_Y16 and
+// CMD_IMAGE_SAME (the caller holds the buffer's mutex) and return the next location.  The
+// cmd_image_meta_t is filled in place (it is packed so it may be unaligned) and the gui's
+// rsp handler copies it back out.
+static uint8_t* _serialize_t1c_meta(t1c_buffer_t* t1cP, uint8_t* data)
 {
-	// Network order - big endian
-	*buf++ = data >> 8;
-	*buf++ = data & 0xFF;
+	cmd_image_meta_t* mP = (cmd_image_meta_t*) data;
+	t1c_roi_table_t* roiP = &t1cP->roi;
+	int i;
 	
-	return buf;
+	mP->version = CMD_IMAGE_META_VERSION;
+	mP->reserved = 0;
+	mP->len = CMD_IMAGE_META_LEN;
+	
+	// Frame timing
+	mP->frame_seq = t1cP->frame_seq;
+	mP->frame_msec = (uint32_t) (t1cP->frame_usec / 1000);
+	
+	// Boolean flags as bytes
+	mP->high_gain = (uint8_t) t1cP->high_gain;
+	mP->vid_frozen = (uint8_t) t1cP->vid_frozen;
+	mP->spot_valid = (uint8_t) t1cP->spot_valid;
+	mP->minmax_valid = (uint8_t) t1cP->minmax_valid;
+	mP->region_valid = (uint8_t) t1cP->region_valid;
+	mP->amb_temp_valid = (uint8_t) t1cP->amb_temp_valid;
+	mP->amb_hum_valid = (uint8_t) t1cP->amb_hum_valid;
+	mP->distance_valid = (uint8_t) t1cP->distance_valid;
+	
+	// Various data values
+	mP->amb_temp = t1cP->amb_temp;
+	mP->amb_hum = t1cP->amb_hum;
+	mP->distance = t1cP->distance;
+	mP->spot_temp = t1cP->spot_temp;
+	mP->spot_x = t1cP->spot_point.x;
+	mP->spot_y = t1cP->spot_point.y;
+	mP->min_temp = t1cP->max_min_temp_info.min_temp;
+	mP->min_x = t1cP->max_min_temp_info.min_temp_point.x;
+	mP->min_y = t1cP->max_min_temp_info.min_temp_point.y;
+	mP->max_temp = t1cP->max_min_temp_info.max_temp;
+	mP->max_x = t1cP->max_min_temp_info.max_temp_point.x;
+	mP->max_y = t1cP->max_min_temp_info.max_temp_point.y;
+	mP->region_x1 = t1cP->region_points.start_point.x;
+	mP->region_y1 = t1cP->region_points.start_point.y;
+	mP->region_x2 = t1cP->region_points.end_point.x;
+	mP->region_y2 = t1cP->region_points.end_point.y;
+	mP->region_avg_temp = t1cP->region_temp_info.temp_info_value.ave_temp;
+	mP->region_min_temp = t1cP->region_temp_info.temp_info_value.min_temp;
+	mP->region_min_x = t1cP->region_temp_info.min_temp_point.x;
+	mP->region_min_y = t1cP->region_temp_info.min_temp_point.y;
+	mP->region_max_temp = t1cP->region_temp_info.temp_info_value.max_temp;
+	mP->region_max_x = t1cP->region_temp_info.max_temp_point.x;
+	mP->region_max_y = t1cP->region_temp_info.max_temp_point.y;
+	
+	// ROI table
+	mP->roi_num_spots = roiP->num_spots;
+	mP->roi_num_rects = roiP->num_rects;
+	mP->roi_num_lines = roiP->num_lines;
+	mP->roi_spot_valid_mask = roiP->spot_valid_mask;
+	mP->roi_rect_valid_mask = roiP->rect_valid_mask;
+	mP->roi_line_valid_mask = roiP->line_valid_mask;
+	for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+		mP->roi_spot[i].x = roiP->spot_points[i].x;
+		mP->roi_spot[i].y = roiP->spot_points[i].y;
+		mP->roi_spot[i].temp = roiP->spot_temps[i];
+	}
+	for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+		_set_roi_area(&mP->roi_rect[i], &roiP->rect_points[i].start_point, &roiP->rect_points[i].end_point, &roiP->rect_temp_info[i]);
+	}
+	for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+		_set_roi_area(&mP->roi_line[i], &roiP->line_points[i].start_point, &roiP->line_points[i].end_point, &roiP->line_temp_info[i]);
+	}
+	
+	return data + CMD_IMAGE_META_LEN;
+}
+
+
+static void _set_roi_area(cmd_image_roi_area_t* aP, IrPoint_t* start, IrPoint_t* end, TpdLineRectTempInfo_t* info)
+{
+	aP->x1 = start->x;
+	aP->y1 = start->y;
+	aP->x2 = end->x;
+	aP->y2 = end->y;
+	aP->avg_temp = info->temp_info_value.ave_temp;
+	aP->min_temp = info->temp_info_value.min_temp;
+	aP->max_temp = info->temp_info_value.max_temp;
+}
+
+
+// Encode w x h 8-bit image data using the CMD_STREAM_Y8_DELTA format (see cmd_list.h) and
+// return the encoded length.  Returns 0 if the encoded data would not be smaller than the
+// raw data.
+static uint32_t _encode_y8_delta(uint8_t* src, int w, int h, uint8_t* dst)
+{
+	uint8_t* dP = dst;
+	uint8_t* endP = dst + w*h - 2;    // Room for the largest code
+	int8_t d1, d2;
+	int i = 0;
+	int n;
+	
+	while (i < w*h) {
+		if (dP >= endP) return 0;
+		
+		d1 = (int8_t) (src[i] - _y8_delta_pred(src, w, i));
+		
+		if (d1 == 0) {
+			// Extend the run while pixels match their prediction
+			n = 1;
+			while (((i + n) < w*h) && (n < CMD_IMG_DELTA_MAX_RUN)) {
+				if (src[i + n] != _y8_delta_pred(src, w, i + n)) break;
+				n++;
+			}
+			*dP++ = CMD_IMG_DELTA_RUN | (n - 1);
+			i += n;
+			continue;
+		}
+		
+		if ((d1 >= -4) && (d1 <= 3) && ((i + 1) < w*h)) {
+			d2 = (int8_t) (src[i + 1] - _y8_delta_pred(src, w, i + 1));
+			if ((d2 >= -4) && (d2 <= 3)) {
+				*dP++ = CMD_IMG_DELTA_PAIR | ((d1 + 4) << 3) | (d2 + 4);
+				i += 2;
+				continue;
+			}
+		}
+		
+		if ((d1 >= -32) && (d1 <= 31)) {
+			*dP++ = CMD_IMG_DELTA_DIFF | (d1 + 32);
+		} else {
+			*dP++ = CMD_IMG_DELTA_LITERAL;
+			*dP++ = src[i];
+		}
+		i += 1;
+	}
+	
+	return (dP - dst);
+}
+
+
+// Prediction for pixel i: the pixel to the left, the pixel above at the start of a row
+static inline uint8_t _y8_delta_pred(uint8_t* src, int w, int i)
+{
+	if (i == 0) {
+		return 0;
+	} else if ((i % w) == 0) {
+		return src[i - w];
+	} else {
+		return src[i - 1];
+	}
+}
+
+
+// Crop the 8-bit image to the w x h (decimated pixels) region starting at x1, y1 and
+// decimate it by averaging each dec x dec block
+static void _get_y8_view(uint8_t* src, int dec, int x1, int y1, int w, int h, uint8_t* dst)
+{
+	uint8_t* sP;
+	uint32_t sum;
+	int shift = (dec == 4) ? 4 : ((dec == 2) ? 2 : 0);
+	
+	for (int y=0; y<h; y++) {
+		for (int x=0; x<w; x++) {
+			sP = src + (y1 + y*dec)*T1C_WIDTH + x1 + x*dec;
+			sum = 0;
+			for (int j=0; j<dec; j++) {
+				for (int i=0; i<dec; i++) {
+					sum += sP[i];
+				}
+				sP += T1C_WIDTH;
+			}
+			*dst++ = (uint8_t) (sum >> shift);
+		}
+	}
 }
 
 
@@ -20,11 +20,27 @@
 #define WS_CMD_UTILITIES_H
 
 #include "cmd_utilities.h"
+#include "tiny1c.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 
 
+//
+// Constants
+//
+
+// Websocket packet header length
+#define WS_CMD_HDR_LEN     16
+
+// Maximum websocket packet length
+#define WS_CMD_MAX_PKT_LEN (WS_CMD_HDR_LEN + 3*T1C_WIDTH*T1C_HEIGHT)
+
+// Maximum CMD_IMAGE_SAME packet length (metadata only)
+#define WS_CMD_SAME_PKT_LEN (WS_CMD_HDR_LEN + 256)
+
+
+
 //
 // API
 //
@@ -32,15 +48,24 @@ bool ws_gui_cmd_init();
 
 // web socket interface
 bool ws_cmd_get_tx_data(uint32_t* len, uint8_t** data); // Valid data when returning true
+uint32_t ws_cmd_get_tx_batch(uint8_t* buf, uint32_t max_len);
 uint8_t* ws_cmd_get_rx_data_buffer();
 bool ws_cmd_process_socket_rx_data(uint32_t len, uint8_t* data);
+void ws_cmd_set_rx_set_callback(void (*cb)(cmd_id_t cmd_id));
 
 // cmd_utilities send handler
 bool ws_cmd_send_handler(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type, uint32_t len, uint8_t* data);
 
 // Custom send utilities
-bool ws_cmd_send_t1c_image(t1c_buffer_t* t1cP);
-bool ws_cmd_send_file_image(uint32_t* rgb888);
+void ws_cmd_batch_begin();
+void ws_cmd_batch_end();
+uint32_t ws_cmd_batch_take(uint8_t* buf, uint32_t max_len);
+uint32_t ws_cmd_encode_t1c_image(t1c_buffer_t* t1cP, uint8_t* buf);
+uint32_t ws_cmd_encode_t1c_image_same(t1c_buffer_t* t1cP, uint8_t* buf);
+uint32_t ws_cmd_t1c_image_key(t1c_buffer_t* t1cP);
+uint32_t ws_cmd_encode_t1c_data(t1c_buffer_t* t1cP, int mode, int dec, uint8_t y8_output, uint8_t* view_buf, uint8_t* buf);
+uint32_t ws_cmd_encode_t1c_meta(t1c_buffer_t* t1cP, uint8_t* buf);
+void ws_cmd_encode_header(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type, uint32_t len, uint8_t* buf);
 
 
 #endif /* WS_CMD_UTILITIES_H */
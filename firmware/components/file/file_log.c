@@ -0,0 +1,152 @@
+/*
+ * Radiometric data log file format
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "file_log.h"
+
+
+_Static_assert((12 + 2*(1 + 2 + 3 + T1C_ROI_MAX_SPOTS + 3*T1C_ROI_MAX_RECTS + 3*T1C_ROI_MAX_LINES + 2)) == FILE_LOG_REC_LEN,
+               "FILE_LOG_REC_LEN doesn't match the ROI table capacity");
+
+
+
+//
+// Forward declarations for internal functions
+//
+static uint8_t* _add_u16(uint16_t data, uint8_t* buf);
+static uint8_t* _add_u32(uint32_t data, uint8_t* buf);
+static uint8_t* _add_temp_info(TpdTempInfoValue_t* info, uint8_t* buf);
+
+
+
+//
+// API
+//
+
+/**
+ * Write a log file header into dst for a log started at te.  Returns the header length.
+ */
+uint32_t file_log_encode_header(tmElements_t* te, int rate, uint8_t* dst)
+{
+	uint8_t* dP = dst;
+	
+	// Format
+	memcpy(dP, "ILOG", 4);
+	dP += 4;
+	dP = _add_u16(FILE_LOG_VERSION, dP);
+	dP = _add_u16(FILE_LOG_HDR_LEN, dP);
+	dP = _add_u16(FILE_LOG_REC_LEN, dP);
+	dP = _add_u16((uint16_t) rate, dP);
+	
+	// Time
+	dP = _add_u16((uint16_t) (te->tm_year + 1900), dP);
+	*dP++ = (uint8_t) (te->tm_mon + 1);
+	*dP++ = (uint8_t) te->tm_mday;
+	*dP++ = (uint8_t) te->tm_hour;
+	*dP++ = (uint8_t) te->tm_min;
+	*dP++ = (uint8_t) te->tm_sec;
+	*dP++ = 0;
+	
+	return (dP - dst);
+}
+
+
+/**
+ * Write the measurements from the frame in t1c into dst as a log record timed from
+ * start_usec (the esp_timer time of the first record).  Returns the record length.
+ */
+uint32_t file_log_encode_record(t1c_buffer_t* t1c, int64_t start_usec, uint8_t* dst)
+{
+	int i;
+	uint8_t flags = 0;
+	uint8_t* dP = dst;
+	
+	if (t1c->y16_is_temp) flags |= FILE_LOG_FLAG_IS_TEMP;
+	if (t1c->high_gain) flags |= FILE_LOG_FLAG_HIGH_GAIN;
+	if (t1c->amb_temp_valid) flags |= FILE_LOG_FLAG_AMB_TEMP;
+	if (t1c->spot_valid) flags |= FILE_LOG_FLAG_SPOT;
+	if (t1c->minmax_valid) flags |= FILE_LOG_FLAG_MINMAX;
+	if (t1c->region_valid) flags |= FILE_LOG_FLAG_REGION;
+	if (t1c->vid_frozen) flags |= FILE_LOG_FLAG_FROZEN;
+	
+	// Frame
+	dP = _add_u32((uint32_t) ((t1c->frame_usec - start_usec) / 1000), dP);
+	dP = _add_u32(t1c->frame_seq, dP);
+	*dP++ = flags;
+	*dP++ = t1c->roi.spot_valid_mask;
+	*dP++ = t1c->roi.rect_valid_mask;
+	*dP++ = t1c->roi.line_valid_mask;
+	
+	// Temperature metadata
+	dP = _add_u16(t1c->spot_temp, dP);
+	dP = _add_u16(t1c->max_min_temp_info.min_temp, dP);
+	dP = _add_u16(t1c->max_min_temp_info.max_temp, dP);
+	dP = _add_temp_info(&t1c->region_temp_info.temp_info_value, dP);
+	
+	// ROI table (entries past the ones in use have clear valid mask bits)
+	for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+		dP = _add_u16(t1c->roi.spot_temps[i], dP);
+	}
+	for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+		dP = _add_temp_info(&t1c->roi.rect_temp_info[i].temp_info_value, dP);
+	}
+	for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+		dP = _add_temp_info(&t1c->roi.line_temp_info[i].temp_info_value, dP);
+	}
+	
+	// Environmental conditions
+	dP = _add_u16((uint16_t) t1c->amb_temp, dP);
+	dP = _add_u16(0, dP);
+	
+	return (dP - dst);
+}
+
+
+
+//
+// Internal functions
+//
+static uint8_t* _add_u16(uint16_t data, uint8_t* buf)
+{
+	// Network order - big endian
+	*buf++ = data >> 8;
+	*buf++ = data & 0xFF;
+	
+	return buf;
+}
+
+
+static uint8_t* _add_u32(uint32_t data, uint8_t* buf)
+{
+	*buf++ = data >> 24;
+	*buf++ = (data >> 16) & 0xFF;
+	*buf++ = (data >> 8) & 0xFF;
+	*buf++ = data & 0xFF;
+	
+	return buf;
+}
+
+
+static uint8_t* _add_temp_info(TpdTempInfoValue_t* info, uint8_t* buf)
+{
+	buf = _add_u16(info->ave_temp, buf);
+	buf = _add_u16(info->max_temp, buf);
+	buf = _add_u16(info->min_temp, buf);
+	
+	return buf;
+}
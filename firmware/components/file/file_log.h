@@ -0,0 +1,91 @@
+/*
+ * Radiometric data log file format
+ *
+ * A log file holds the temperature measurements from a series of frames without the
+ * images: a short header followed by fixed length records, one per logged frame.  All
+ * multi-byte values are big endian (network order, as in the command protocol).
+ *
+ * Header
+ *   Offset  Size  Contents
+ *      0      4   "ILOG"
+ *      4      2   Format version (FILE_LOG_VERSION)
+ *      6      2   Header length (offset of the first record)
+ *      8      2   Record length
+ *     10      2   Requested record rate (records/sec)
+ *     12      2   Year
+ *     14      5   Month (1-12), day, hour, minute, second of the first record
+ *     19      1   Reserved
+ *
+ * Record
+ *   Offset  Size  Contents
+ *      0      4   Time since the first record (mSec)
+ *      4      4   Frame sequence number
+ *      8      1   Flags (FILE_LOG_FLAG_xxx)
+ *      9      3   ROI table spot, rectangle and line valid masks
+ *     12      2   Spot meter temperature
+ *     14      4   Scene min temperature, scene max temperature
+ *     18      6   Region average, max and min temperatures
+ *     24     16   ROI table spot temperatures (T1C_ROI_MAX_SPOTS)
+ *     40     24   ROI table rectangle average, max and min temperatures (T1C_ROI_MAX_RECTS)
+ *     64     12   ROI table line average, max and min temperatures (T1C_ROI_MAX_LINES)
+ *     76      2   Ambient temperature (°C, signed)
+ *     78      2   Reserved
+ *
+ * Temperatures are Tiny1C 1/16 °K values.  A value is only meaningful when its flag or
+ * valid mask bit is set.  The number of records is (file length - header length) / record
+ * length.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FILE_LOG_H
+#define FILE_LOG_H
+
+#include <stdint.h>
+#include "tiny1c.h"
+#include "time_utilities.h"
+
+
+//
+// File Log Constants
+//
+
+// File name extension
+#define FILE_LOG_EXT              ".LOG"
+
+#define FILE_LOG_VERSION          1
+
+// Flags
+#define FILE_LOG_FLAG_IS_TEMP     0x01
+#define FILE_LOG_FLAG_HIGH_GAIN   0x02
+#define FILE_LOG_FLAG_AMB_TEMP    0x04
+#define FILE_LOG_FLAG_SPOT        0x08
+#define FILE_LOG_FLAG_MINMAX      0x10
+#define FILE_LOG_FLAG_REGION      0x20
+#define FILE_LOG_FLAG_FROZEN      0x40
+
+// Sizes
+#define FILE_LOG_HDR_LEN          20
+#define FILE_LOG_REC_LEN          80
+
+
+
+//
+// File Log API
+//
+uint32_t file_log_encode_header(tmElements_t* te, int rate, uint8_t* dst);
+uint32_t file_log_encode_record(t1c_buffer_t* t1c, int64_t start_usec, uint8_t* dst);
+
+#endif /* FILE_LOG_H */
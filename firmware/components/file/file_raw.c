@@ -0,0 +1,277 @@
+/*
+ * Raw radiometric image file format
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "cmd_list.h"
+#include "file_raw.h"
+#include "y16_codec.h"
+
+
+
+//
+// Forward declarations for internal functions
+//
+static inline uint16_t _y16_delta_pred(uint16_t* src, int i);
+static uint8_t* _add_u16(uint16_t data, uint8_t* buf);
+static uint8_t* _add_u32(uint32_t data, uint8_t* buf);
+static uint16_t _get_u16(uint8_t* buf);
+static uint32_t _get_u32(uint8_t* buf);
+
+
+
+//
+// API
+//
+
+/**
+ * Pack the frame in t1c and the parameters in meta into dst (which must hold
+ * FILE_RAW_MAX_LEN bytes) as a raw file.  The image data is Rice coded when that makes
+ * it smaller.  Returns the file length.
+ */
+uint32_t file_raw_encode(t1c_buffer_t* t1c, t1c_param_metadata_t* meta, tmElements_t* te, uint8_t* dst)
+{
+	int i;
+	uint8_t enc;
+	uint8_t* imgP = dst + FILE_RAW_HDR_LEN;
+	uint32_t len;
+	
+	// Encode the image data first so the header can describe it
+	len = y16_codec_encode(t1c->img_data, T1C_WIDTH, T1C_HEIGHT, imgP, 2*T1C_WIDTH*T1C_HEIGHT - 1);
+	if (len != 0) {
+		enc = FILE_RAW_ENC_RICE;
+	} else {
+		enc = FILE_RAW_ENC_NONE;
+		len = T1C_WIDTH*T1C_HEIGHT*2;
+		for (i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+			imgP = _add_u16(t1c->img_data[i], imgP);
+		}
+	}
+	
+	(void) file_raw_encode_header(t1c, meta, te, enc, len, dst);
+	
+	return FILE_RAW_HDR_LEN + len;
+}
+
+
+/**
+ * Write a raw file header describing len bytes of image data encoded as enc into dst.
+ * Returns the header length.
+ */
+uint32_t file_raw_encode_header(t1c_buffer_t* t1c, t1c_param_metadata_t* meta, tmElements_t* te, uint8_t enc, uint32_t len, uint8_t* dst)
+{
+	int i;
+	uint8_t flags = 0;
+	uint8_t* dP = dst;
+	
+	if (t1c->y16_is_temp) flags |= FILE_RAW_FLAG_IS_TEMP;
+	if (t1c->high_gain) flags |= FILE_RAW_FLAG_HIGH_GAIN;
+	if (t1c->amb_temp_valid) flags |= FILE_RAW_FLAG_AMB_TEMP;
+	if (t1c->amb_hum_valid) flags |= FILE_RAW_FLAG_AMB_HUM;
+	if (t1c->distance_valid) flags |= FILE_RAW_FLAG_DISTANCE;
+	if (t1c->spot_valid) flags |= FILE_RAW_FLAG_SPOT;
+	if (t1c->minmax_valid) flags |= FILE_RAW_FLAG_MINMAX;
+	if (t1c->region_valid) flags |= FILE_RAW_FLAG_REGION;
+	
+	// Format
+	memcpy(dP, "IRAW", 4);
+	dP += 4;
+	dP = _add_u16(FILE_RAW_VERSION, dP);
+	dP = _add_u16(FILE_RAW_HDR_LEN, dP);
+	dP = _add_u16(T1C_WIDTH, dP);
+	dP = _add_u16(T1C_HEIGHT, dP);
+	*dP++ = enc;
+	*dP++ = flags;
+	dP = _add_u32(len, dP);
+	
+	// Time
+	dP = _add_u16((uint16_t) (te->tm_year + 1900), dP);
+	*dP++ = (uint8_t) (te->tm_mon + 1);
+	*dP++ = (uint8_t) te->tm_mday;
+	*dP++ = (uint8_t) te->tm_hour;
+	*dP++ = (uint8_t) te->tm_min;
+	*dP++ = (uint8_t) te->tm_sec;
+	*dP++ = 0;
+	
+	// Frame
+	dP = _add_u32(t1c->frame_seq, dP);
+	dP = _add_u16(t1c->frame_index, dP);
+	dP = _add_u16(t1c->y16_min, dP);
+	dP = _add_u16(t1c->y16_max, dP);
+	dP = _add_u16(t1c->agc_min, dP);
+	dP = _add_u16(t1c->agc_max, dP);
+	
+	// Environmental conditions
+	dP = _add_u16((uint16_t) t1c->amb_temp, dP);
+	dP = _add_u16(t1c->amb_hum, dP);
+	dP = _add_u16(t1c->distance, dP);
+	
+	// Temperature metadata
+	dP = _add_u16(t1c->spot_point.x, dP);
+	dP = _add_u16(t1c->spot_point.y, dP);
+	dP = _add_u16(t1c->spot_temp, dP);
+	
+	dP = _add_u16(t1c->max_min_temp_info.min_temp, dP);
+	dP = _add_u16(t1c->max_min_temp_info.min_temp_point.x, dP);
+	dP = _add_u16(t1c->max_min_temp_info.min_temp_point.y, dP);
+	dP = _add_u16(t1c->max_min_temp_info.max_temp, dP);
+	dP = _add_u16(t1c->max_min_temp_info.max_temp_point.x, dP);
+	dP = _add_u16(t1c->max_min_temp_info.max_temp_point.y, dP);
+	
+	dP = _add_u16(t1c->region_points.start_point.x, dP);
+	dP = _add_u16(t1c->region_points.start_point.y, dP);
+	dP = _add_u16(t1c->region_points.end_point.x, dP);
+	dP = _add_u16(t1c->region_points.end_point.y, dP);
+	dP = _add_u16(t1c->region_temp_info.temp_info_value.ave_temp, dP);
+	dP = _add_u16(t1c->region_temp_info.temp_info_value.max_temp, dP);
+	dP = _add_u16(t1c->region_temp_info.temp_info_value.min_temp, dP);
+	dP = _add_u16(t1c->region_temp_info.min_temp_point.x, dP);
+	dP = _add_u16(t1c->region_temp_info.min_temp_point.y, dP);
+	dP = _add_u16(t1c->region_temp_info.max_temp_point.x, dP);
+	dP = _add_u16(t1c->region_temp_info.max_temp_point.y, dP);
+	
+	// Tiny1C parameters
+	dP = _add_u16(FILE_RAW_NUM_IMAGE_PARAMS, dP);
+	for (i=0; i<FILE_RAW_NUM_IMAGE_PARAMS; i++) {
+		dP = _add_u16(meta->image_params[i], dP);
+	}
+	dP = _add_u16(FILE_RAW_NUM_TPD_PARAMS, dP);
+	for (i=0; i<FILE_RAW_NUM_TPD_PARAMS; i++) {
+		dP = _add_u16(meta->tpd_params[i], dP);
+	}
+	
+	return FILE_RAW_HDR_LEN;
+}
+
+
+/**
+ * Parse the format section (the first FILE_RAW_FORMAT_LEN bytes) of a raw file header in
+ * src.  Returns false if it isn't a raw file holding a T1C_WIDTH x T1C_HEIGHT image.  The
+ * image data starts hdr_len bytes into the file.
+ */
+bool file_raw_decode_header(uint8_t* src, uint16_t* hdr_len, uint8_t* enc, uint8_t* flags, uint32_t* len)
+{
+	if (memcmp(src, "IRAW", 4) != 0) return false;
+	if (_get_u16(&src[8]) != T1C_WIDTH) return false;
+	if (_get_u16(&src[10]) != T1C_HEIGHT) return false;
+	
+	*hdr_len = _get_u16(&src[6]);
+	*enc = src[12];
+	*flags = src[13];
+	*len = _get_u32(&src[14]);
+	
+	return (*hdr_len >= FILE_RAW_FORMAT_LEN) &&
+	       ((*enc == FILE_RAW_ENC_NONE) || (*enc == FILE_RAW_ENC_DELTA) || (*enc == FILE_RAW_ENC_RICE));
+}
+
+
+/**
+ * Decode len bytes of CMD_IMG_Y16_ENC_DELTA data in src into dst starting with the pixel at
+ * *indexP.  Only complete codes are decoded.  Updates *indexP to the next pixel to decode
+ * (T1C_WIDTH*T1C_HEIGHT when the image is done) and returns the number of bytes used so
+ * the image can be decoded in pieces as it is read.
+ */
+uint32_t file_raw_decode_y16_delta_chunk(uint8_t* src, uint32_t len, uint16_t* dst, int* indexP)
+{
+	uint8_t* sP = src;
+	uint8_t* endP = src + len;
+	uint8_t op;
+	int i = *indexP;
+	int n;
+	
+	while (i < T1C_WIDTH*T1C_HEIGHT) {
+		if (sP >= endP) break;
+		op = *sP & CMD_IMG_DELTA_OP_MASK;
+		
+		// Stop at a code that doesn't fit in what is left
+		n = (op == CMD_IMG16_DELTA_DIFF14) ? 2 : ((op == CMD_IMG16_DELTA_LITERAL) ? 3 : 1);
+		if ((endP - sP) < n) break;
+		
+		if (op == CMD_IMG16_DELTA_RUN) {
+			n = (*sP & 0x3F) + 1;
+			while ((n-- > 0) && (i < T1C_WIDTH*T1C_HEIGHT)) {
+				dst[i] = _y16_delta_pred(dst, i);
+				i += 1;
+			}
+			sP += 1;
+		} else if (op == CMD_IMG16_DELTA_DIFF6) {
+			dst[i] = _y16_delta_pred(dst, i) + (int) (*sP & 0x3F) - 32;
+			i += 1;
+			sP += 1;
+		} else if (op == CMD_IMG16_DELTA_DIFF14) {
+			dst[i] = _y16_delta_pred(dst, i) + (int) (((*sP & 0x3F) << 8) | sP[1]) - 8192;
+			i += 1;
+			sP += 2;
+		} else {
+			dst[i] = _get_u16(&sP[1]);
+			i += 1;
+			sP += 3;
+		}
+	}
+	*indexP = i;
+	
+	return (sP - src);
+}
+
+
+
+//
+// Internal functions
+//
+static inline uint16_t _y16_delta_pred(uint16_t* src, int i)
+{
+	if (i == 0) {
+		return 0;
+	} else if ((i % T1C_WIDTH) == 0) {
+		return src[i - T1C_WIDTH];
+	} else {
+		return src[i - 1];
+	}
+}
+
+
+static uint8_t* _add_u16(uint16_t data, uint8_t* buf)
+{
+	// Network order - big endian
+	*buf++ = data >> 8;
+	*buf++ = data & 0xFF;
+	
+	return buf;
+}
+
+
+static uint8_t* _add_u32(uint32_t data, uint8_t* buf)
+{
+	*buf++ = data >> 24;
+	*buf++ = (data >> 16) & 0xFF;
+	*buf++ = (data >> 8) & 0xFF;
+	*buf++ = data & 0xFF;
+	
+	return buf;
+}
+
+
+static uint16_t _get_u16(uint8_t* buf)
+{
+	return ((uint16_t) buf[0] << 8) | buf[1];
+}
+
+
+static uint32_t _get_u32(uint8_t* buf)
+{
+	return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
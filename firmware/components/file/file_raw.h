@@ -0,0 +1,117 @@
+/*
+ * Raw radiometric image file format
+ *
+ * A raw file holds one Tiny1C frame: a header with the frame metadata and the Tiny1C
+ * parameters in effect followed by the Y16 image data.  All multi-byte values are big
+ * endian (network order, as in the command protocol).
+ *
+ *   Offset  Size  Contents
+ *      0      4   "IRAW"
+ *      4      2   Format version (FILE_RAW_VERSION)
+ *      6      2   Header length (offset of the image data)
+ *      8      2   Width
+ *     10      2   Height
+ *     12      1   Image data encoding (FILE_RAW_ENC_xxx)
+ *     13      1   Flags (FILE_RAW_FLAG_xxx)
+ *     14      4   Image data length (0 if unknown, see below)
+ *     18      2   Year
+ *     20      5   Month (1-12), day, hour, minute, second
+ *     25      1   Reserved
+ *     26      4   Frame sequence number
+ *     30      2   Tiny1C frame index
+ *     32      8   Y16 min, Y16 max, AGC min, AGC max
+ *     40      2   Ambient temperature (°C, signed)
+ *     42      2   Ambient humidity (%)
+ *     44      2   Target distance (cm)
+ *     46      6   Spot meter x, y, temperature
+ *     52     12   Scene min temperature, x, y, scene max temperature, x, y
+ *     64     22   Region x1, y1, x2, y2, average, max and min temperatures, min x, y, max x, y
+ *     86      2   Number of image parameters (n)
+ *     88     2n   Image parameters (IMAGE_PROP_xxx order)
+ *   88+2n     2   Number of TPD parameters (m)
+ *   90+2n    2m   TPD parameters (TPD_PROP_xxx order)
+ *
+ * Temperatures are Tiny1C 1/16 °K values.  FILE_RAW_ENC_NONE image data is width*height
+ * 16-bit pixels.  FILE_RAW_ENC_RICE image data is coded as described in y16_codec.h.
+ * FILE_RAW_ENC_DELTA image data, written by older firmware, uses the CMD_IMG_Y16_ENC_DELTA
+ * encoding described in cmd_list.h.
+ *
+ * A radiometric jpeg file carries a raw file with Rice coded image data in a series of
+ * APPn (FILE_RAW_APP_MARKER) segments written after the comments.  Each segment starts with
+ * FILE_RAW_APP_ID.  The raw file is the rest of the segments concatenated in order.  Since
+ * it is streamed into the segments as it is encoded its image data length is 0, the data
+ * runs to the end of the last segment.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FILE_RAW_H
+#define FILE_RAW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tiny1c.h"
+#include "time_utilities.h"
+
+
+//
+// File Raw Constants
+//
+
+// File name extension
+#define FILE_RAW_EXT              ".RAW"
+
+#define FILE_RAW_VERSION          1
+
+// Image data encoding
+#define FILE_RAW_ENC_NONE         0
+#define FILE_RAW_ENC_DELTA        1
+#define FILE_RAW_ENC_RICE         2
+
+// Radiometric jpeg segments (APP9)
+#define FILE_RAW_APP_MARKER       9
+#define FILE_RAW_APP_ID           "iCamRaw"
+#define FILE_RAW_APP_ID_LEN       8
+
+// Flags
+#define FILE_RAW_FLAG_IS_TEMP     0x01
+#define FILE_RAW_FLAG_HIGH_GAIN   0x02
+#define FILE_RAW_FLAG_AMB_TEMP    0x04
+#define FILE_RAW_FLAG_AMB_HUM     0x08
+#define FILE_RAW_FLAG_DISTANCE    0x10
+#define FILE_RAW_FLAG_SPOT        0x20
+#define FILE_RAW_FLAG_MINMAX      0x40
+#define FILE_RAW_FLAG_REGION      0x80
+
+// Sizes
+#define FILE_RAW_NUM_IMAGE_PARAMS (IMAGE_PROP_SEL_MIRROR_FLIP+1)
+#define FILE_RAW_NUM_TPD_PARAMS   (TPD_PROP_GAIN_SEL+1)
+#define FILE_RAW_HDR_LEN          (90 + 2*(FILE_RAW_NUM_IMAGE_PARAMS + FILE_RAW_NUM_TPD_PARAMS))
+#define FILE_RAW_MAX_LEN          (FILE_RAW_HDR_LEN + T1C_WIDTH*T1C_HEIGHT*2)
+
+// Bytes at the start of the header describing the file (through the image data length)
+#define FILE_RAW_FORMAT_LEN       18
+
+
+
+//
+// File Raw API
+//
+uint32_t file_raw_encode(t1c_buffer_t* t1c, t1c_param_metadata_t* meta, tmElements_t* te, uint8_t* dst);
+uint32_t file_raw_encode_header(t1c_buffer_t* t1c, t1c_param_metadata_t* meta, tmElements_t* te, uint8_t enc, uint32_t len, uint8_t* dst);
+bool file_raw_decode_header(uint8_t* src, uint16_t* hdr_len, uint8_t* enc, uint8_t* flags, uint32_t* len);
+uint32_t file_raw_decode_y16_delta_chunk(uint8_t* src, uint32_t len, uint16_t* dst, int* indexP);
+
+#endif /* FILE_RAW_H */
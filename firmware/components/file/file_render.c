@@ -24,6 +24,7 @@
 #include <math.h>
 #include <string.h>
 #include "file_render.h"
+#include "draw_utilities.h"
 #include "font.h"
 #include "font7x10.h"
 
@@ -34,6 +35,29 @@
 //
 #define COLOR_BLACK       RGB_TO_24BIT(0, 0, 0)
 
+#ifndef MIN
+	#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+	#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+
+
+//
+// Typedefs
+//
+
+// Character placement for an orientation.  Glyph column c, row r is drawn at image
+// (x + c*col_dx + r*row_dx, y + c*col_dy + r*row_dy) for a character drawn at (x, y).
+// Portrait text runs up the image.
+typedef struct {
+	int16_t col_dx;
+	int16_t col_dy;
+	int16_t row_dx;
+	int16_t row_dy;
+} glyph_map_t;
+
 
 
 //
@@ -43,6 +67,25 @@ static bool img_is_portrait;
 static int16_t img_w;
 static int16_t img_h;
 
+static const glyph_map_t landscape_glyph_map = {1, 0, 0, 1};
+static const glyph_map_t portrait_glyph_map = {0, -1, 1, 0};
+static const glyph_map_t* glyph_map = &landscape_glyph_map;
+
+// Palette bar entry for each line, from top to bottom (warm to cold).  Computed when the
+// orientation changes so each frame only has to look up the colors.
+static bool pal_bar_valid = false;
+static bool pal_bar_is_portrait;
+static int16_t pal_bar_len;
+static uint8_t pal_bar_index[T1C_WIDTH];
+
+// Rows of the image held in the buffer passed to the overlay render functions.  Images may
+// be rendered a strip at a time, with the overlays drawn into each strip.
+static int16_t strip_y = 0;
+static int16_t strip_h = T1C_HEIGHT;
+
+// Overlay clip region matching the strip
+static draw_clip_t clip = {T1C_WIDTH, 0, 0, 0, T1C_WIDTH - 1, T1C_HEIGHT - 1};
+
 
 
 //
@@ -51,16 +94,10 @@ static int16_t img_h;
 static void draw_min_marker(t1c_buffer_t* t1c, int16_t n, uint32_t* img);
 static void draw_max_marker(t1c_buffer_t* t1c, int16_t n, uint32_t* img);
 static void draw_temp(uint32_t* img, int16_t x, int16_t y, uint16_t v, out_state_t* g);
-static void draw_hline(uint32_t* img, int16_t x1, int16_t x2, int16_t y, uint32_t c);
-static void draw_vline(uint32_t* img, int16_t x, int16_t y1, int16_t y2, uint32_t c);
-static void draw_line(uint32_t* img, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint32_t c);
-static void draw_circle(uint32_t* img, int16_t x0, int16_t y0, int16_t r, uint32_t c);
-static void draw_rect(uint32_t* img, int16_t x, int16_t y, int16_t w, int16_t h, uint32_t c);
 static void darken_rect(uint32_t* img, int16_t x, int16_t y, int16_t w, int16_t h);
-static int16_t draw_landscape_char(uint32_t* img, int16_t x, int16_t y, uint32_t c, const Font_TypeDef *Font);
-static int16_t draw_portrait_char(uint32_t* img, int16_t x, int16_t y, uint32_t c, const Font_TypeDef *Font);
+static void compute_palette_bar();
+static int16_t draw_char(uint32_t* img, int16_t x, int16_t y, uint8_t c, const Font_TypeDef *Font);
 static void draw_string(uint32_t* img, int16_t x, int16_t y, const char *str, const Font_TypeDef *Font);
-static __inline__ void draw_pixel(uint32_t* img, int16_t x, int16_t y, uint32_t c);
 
 
 
@@ -74,25 +111,66 @@ void file_render_set_orientation(bool is_portrait)
 	if (is_portrait) {
 		img_w = T1C_HEIGHT;
 		img_h = T1C_WIDTH;
+		glyph_map = &portrait_glyph_map;
 	} else {
 		img_w = T1C_WIDTH;
 		img_h = T1C_HEIGHT;
+		glyph_map = &landscape_glyph_map;
+	}
+	
+	if (!pal_bar_valid || (pal_bar_is_portrait != is_portrait)) {
+		compute_palette_bar();
 	}
 }
 
 
+/**
+ * Set the rows of the image held in the buffer passed to the overlay render functions
+ * (strip_y = 0, strip_h = T1C_HEIGHT for a full image).  Overlay drawing is clipped to
+ * the strip.
+ */
+void file_render_set_strip(int16_t y, int16_t h)
+{
+	strip_y = y;
+	strip_h = h;
+	
+	clip.y0 = y;
+	clip.y1 = y;
+	clip.y2 = y + h - 1;
+}
+
+
 void file_render_t1c_data(t1c_buffer_t* t1c, uint32_t* img)
 {
-	uint16_t* t1cP = t1c->img_data;
-	uint32_t diff;
-	uint32_t t32;
-	
-	// Scale and render the raw Tiny1C data into 24-bit RGB (RGB888)
-	diff = t1c->y16_max - t1c->y16_min;
-	if (diff == 0) diff = 1;
-	while (t1cP < (t1c->img_data + (T1C_WIDTH*T1C_HEIGHT))) {
-		t32 = ((uint32_t)(*t1cP++ - t1c->y16_min) * 255) / diff;
-		*img++ = PALETTE_SAVE_LOOKUP(t32 & 0x000000FF);
+	uint8_t* t1cP = t1c_get_y8_data(t1c, T1C_Y8F_OUT_SAVE);
+	uint8_t* endP = t1cP + T1C_WIDTH*T1C_HEIGHT;
+	
+	// Runtime computed palettes may depend on the image's AGC range
+	update_save_palette_range(t1c->agc_min, t1c->agc_max, t1c->y16_is_temp);
+	
+	// Render the pre-scaled Tiny1C data into 24-bit RGB (RGB888)
+	while (t1cP < endP) {
+		*img++ = PALETTE_SAVE_LOOKUP(*t1cP++);
+	}
+}
+
+
+/**
+ * Render the h rows of Tiny1C data starting at row y into img, which holds just those
+ * rows.  The save palette range is updated with row 0 so an image rendered in strips must
+ * start at the top.
+ */
+void file_render_t1c_rows(t1c_buffer_t* t1c, uint32_t* img, int16_t y, int16_t h)
+{
+	uint8_t* t1cP = t1c_get_y8_data(t1c, T1C_Y8F_OUT_SAVE) + y*T1C_WIDTH;
+	uint8_t* endP = t1cP + h*T1C_WIDTH;
+	
+	if (y == 0) {
+		update_save_palette_range(t1c->agc_min, t1c->agc_max, t1c->y16_is_temp);
+	}
+	
+	while (t1cP < endP) {
+		*img++ = PALETTE_SAVE_LOOKUP(*t1cP++);
 	}
 }
 
@@ -114,8 +192,8 @@ void file_render_spotmeter(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g)
 	
 	// Draw a white circle surrounded by a black circle for contrast on all
 	// color palettes
-	draw_circle(img, c, r, d/2, FILE_MARKER_COLOR);
-	draw_circle(img, c, r, (d+2)/2, COLOR_BLACK);
+	draw32_circle(img, &clip, c, r, d/2, FILE_MARKER_COLOR);
+	draw32_circle(img, &clip, c, r, (d+2)/2, COLOR_BLACK);
 	
 	// Get the temperature string
 	if (g->temp_unit_C) {
@@ -168,8 +246,8 @@ void file_render_region_marker(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g)
 	
 	// Draw a white bounding box surrounded by a black bounding box for contrast
 	// on all color palettes
-	draw_rect(img, x, y, w, h, FILE_MARKER_COLOR);	
-	draw_rect(img, x-1, y-1, w+2, h+2, COLOR_BLACK);
+	draw32_rect(img, &clip, x, y, w, h, FILE_MARKER_COLOR);	
+	draw32_rect(img, &clip, x-1, y-1, w+2, h+2, COLOR_BLACK);
 }
 
 
@@ -213,37 +291,64 @@ void file_render_region_temps(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g)
 }
 
 
-void file_render_palette(uint32_t* img, out_state_t* g)
+void file_render_roi_markers(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g)
 {
-	float delta;
-	float cur;
 	int i;
-	int16_t l;
+	int16_t x1, y1, x2, y2;
+	t1c_roi_table_t* roi = &t1c->roi;
+	
+	// Each marker is drawn in white with a black outline for contrast on all color palettes
+	for (i=0; i<roi->num_spots; i++) {
+		if (roi->spot_valid_mask & (1 << i)) {
+			x1 = (int16_t) roi->spot_points[i].x;
+			y1 = (int16_t) roi->spot_points[i].y;
+			draw32_circle(img, &clip, x1, y1, FILE_IMG_ROI_SPOT_SIZE/2, FILE_MARKER_COLOR);
+			draw32_circle(img, &clip, x1, y1, (FILE_IMG_ROI_SPOT_SIZE+2)/2, COLOR_BLACK);
+		}
+	}
 	
-	// Compute the palette length
-	l = img_h - 2*FILE_IMG_PAL_TEXT_HEIGHT;
+	for (i=0; i<roi->num_rects; i++) {
+		if (roi->rect_valid_mask & (1 << i)) {
+			x1 = (int16_t) roi->rect_points[i].start_point.x;
+			y1 = (int16_t) roi->rect_points[i].start_point.y;
+			x2 = (int16_t) roi->rect_points[i].end_point.x;
+			y2 = (int16_t) roi->rect_points[i].end_point.y;
+			draw32_rect(img, &clip, x1, y1, x2 - x1 + 1, y2 - y1 + 1, FILE_MARKER_COLOR);
+			draw32_rect(img, &clip, x1-1, y1-1, x2 - x1 + 3, y2 - y1 + 3, COLOR_BLACK);
+		}
+	}
 	
-	// Draw the palette from top to bottom (warm to cold)
-	delta = 255.0 / (float) -l;
-	cur = 255.0;
+	for (i=0; i<roi->num_lines; i++) {
+		if (roi->line_valid_mask & (1 << i)) {
+			x1 = (int16_t) roi->line_points[i].start_point.x;
+			y1 = (int16_t) roi->line_points[i].start_point.y;
+			x2 = (int16_t) roi->line_points[i].end_point.x;
+			y2 = (int16_t) roi->line_points[i].end_point.y;
+			draw32_line(img, &clip, x1+1, y1+1, x2+1, y2+1, COLOR_BLACK);
+			draw32_line(img, &clip, x1, y1, x2, y2, FILE_MARKER_COLOR);
+		}
+	}
+}
+
+
+void file_render_palette(uint32_t* img, out_state_t* g)
+{
+	int16_t i;
+	int16_t l = pal_bar_len;
 	
+	// Draw the palette from top to bottom (warm to cold).  Only the marker strip next to it
+	// is darkened since the palette covers the rest of the area.
 	if (img_is_portrait) {
-		darken_rect(img, FILE_IMG_PAL_TEXT_HEIGHT, img_w-FILE_IMG_PALETTE_WIDTH, l, FILE_IMG_PALETTE_WIDTH);
+		darken_rect(img, FILE_IMG_PAL_TEXT_HEIGHT, img_w-FILE_IMG_PALETTE_WIDTH, l, FILE_IMG_PALETTE_WIDTH-FILE_IMG_CMAP_WIDTH);
 		
-		for (int16_t x=FILE_IMG_PAL_TEXT_HEIGHT; x<(FILE_IMG_PAL_TEXT_HEIGHT+l); x++) {
-			i = round(cur);
-			if (i < 0) i = 0;
-			draw_vline(img, x, T1C_HEIGHT-FILE_IMG_CMAP_WIDTH, T1C_HEIGHT-1, PALETTE_SAVE_LOOKUP(i));
-			cur += delta;
+		for (i=0; i<l; i++) {
+			draw32_vline(img, &clip, FILE_IMG_PAL_TEXT_HEIGHT + i, T1C_HEIGHT-FILE_IMG_CMAP_WIDTH, T1C_HEIGHT-1, PALETTE_SAVE_LOOKUP(pal_bar_index[i]));
 		}
 	} else {
-		darken_rect(img, 0, FILE_IMG_PAL_TEXT_HEIGHT, FILE_IMG_PALETTE_WIDTH, l);
+		darken_rect(img, FILE_IMG_CMAP_WIDTH, FILE_IMG_PAL_TEXT_HEIGHT, FILE_IMG_PALETTE_WIDTH-FILE_IMG_CMAP_WIDTH, l);
 		
-		for (int16_t y=FILE_IMG_PAL_TEXT_HEIGHT; y<(FILE_IMG_PAL_TEXT_HEIGHT+l); y++) {
-			i = round(cur);
-			if (i < 0) i = 0;
-			draw_hline(img, 0, FILE_IMG_CMAP_WIDTH-1, y, PALETTE_SAVE_LOOKUP(i));
-			cur += delta;
+		for (i=0; i<l; i++) {
+			draw32_hline(img, &clip, 0, FILE_IMG_CMAP_WIDTH-1, FILE_IMG_PAL_TEXT_HEIGHT + i, PALETTE_SAVE_LOOKUP(pal_bar_index[i]));
 		}
 	}
 }
@@ -267,12 +372,12 @@ void file_render_palette_marker(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g
 		y_offset = T1C_HEIGHT - FILE_IMG_PALETTE_MRK_X - FILE_IMG_PALETTE_MRK_W;
 		
 		// Draw the marker
-		draw_vline(img, x_offset, y_offset, y_offset + FILE_IMG_PALETTE_MRK_W - 1, FILE_MARKER_COLOR);
+		draw32_vline(img, &clip, x_offset, y_offset, y_offset + FILE_IMG_PALETTE_MRK_W - 1, FILE_MARKER_COLOR);
 	} else {
 		x_offset = FILE_IMG_PALETTE_MRK_X;
 		y_offset = FILE_IMG_PAL_TEXT_HEIGHT + round(offset);
 		
-		draw_hline(img, x_offset, x_offset + FILE_IMG_PALETTE_MRK_W - 1, y_offset, FILE_MARKER_COLOR);
+		draw32_hline(img, &clip, x_offset, x_offset + FILE_IMG_PALETTE_MRK_W - 1, y_offset, FILE_MARKER_COLOR);
 	}
 }
 
@@ -374,18 +479,18 @@ static void draw_min_marker(t1c_buffer_t* t1c, int16_t n, uint32_t* img)
 		y2 = y1 + n;
 		
 		// Draw a white right facing triangle surrounded by a black triangle for contrast
-		draw_vline(img, x1, y1, y2, FILE_MARKER_COLOR);
-		draw_line(img, x1, y1, x2, m, FILE_MARKER_COLOR);
-		draw_line(img, x1, y2, x2, m, FILE_MARKER_COLOR);
+		draw32_vline(img, &clip, x1, y1, y2, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, x1, y1, x2, m, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, x1, y2, x2, m, FILE_MARKER_COLOR);
 		
 		x1--;
 		y1--;
 		x2++;
 		y2++;
 		
-		draw_vline(img, x1, y1, y2, COLOR_BLACK);
-		draw_line(img, x1, y1, x2, m, COLOR_BLACK);
-		draw_line(img, x1, y2, x2, m, COLOR_BLACK);
+		draw32_vline(img, &clip, x1, y1, y2, COLOR_BLACK);
+		draw32_line(img, &clip, x1, y1, x2, m, COLOR_BLACK);
+		draw32_line(img, &clip, x1, y2, x2, m, COLOR_BLACK);
 	} else {
 		// Compute a bounding box around the marker triangle
 		x1 = t1c->max_min_temp_info.min_temp_point.x - (n/2);
@@ -395,18 +500,18 @@ static void draw_min_marker(t1c_buffer_t* t1c, int16_t n, uint32_t* img)
 		y2 = y1 + n;
 	
 		// Draw a white downward facing triangle surrounded by a black triangle for contrast
-		draw_hline(img, x1, x2, y1, FILE_MARKER_COLOR);
-		draw_line(img, x1, y1, m, y2, FILE_MARKER_COLOR);
-		draw_line(img, m, y2, x2, y1, FILE_MARKER_COLOR);
+		draw32_hline(img, &clip, x1, x2, y1, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, x1, y1, m, y2, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, m, y2, x2, y1, FILE_MARKER_COLOR);
 		
 		x1--;
 		y1--;
 		x2++;
 		y2++;
 		
-		draw_hline(img, x1, x2, y1, COLOR_BLACK);
-		draw_line(img, x1, y1, m, y2, COLOR_BLACK);
-		draw_line(img, m, y2, x2, y1, COLOR_BLACK);
+		draw32_hline(img, &clip, x1, x2, y1, COLOR_BLACK);
+		draw32_line(img, &clip, x1, y1, m, y2, COLOR_BLACK);
+		draw32_line(img, &clip, m, y2, x2, y1, COLOR_BLACK);
 	}
 }
 
@@ -424,18 +529,18 @@ static void draw_max_marker(t1c_buffer_t* t1c, int16_t n, uint32_t* img)
 		y2 = y1 + n;
 		
 		// Draw a white left facing triangle surrounded by a black triangle for contrast
-		draw_line(img, x1, m, x2, y1, FILE_MARKER_COLOR);
-		draw_line(img, x1, m, x2, y2, FILE_MARKER_COLOR);
-		draw_vline(img, x2, y1, y2, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, x1, m, x2, y1, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, x1, m, x2, y2, FILE_MARKER_COLOR);
+		draw32_vline(img, &clip, x2, y1, y2, FILE_MARKER_COLOR);
 		
 		x1--;
 		y1--;
 		x2++;
 		y2++;
 		
-		draw_line(img, x1, m, x2, y1, COLOR_BLACK);
-		draw_line(img, x1, m, x2, y2, COLOR_BLACK);
-		draw_vline(img, x2, y1, y2, COLOR_BLACK);
+		draw32_line(img, &clip, x1, m, x2, y1, COLOR_BLACK);
+		draw32_line(img, &clip, x1, m, x2, y2, COLOR_BLACK);
+		draw32_vline(img, &clip, x2, y1, y2, COLOR_BLACK);
 	} else {
 		// Compute a bounding box around the marker triangle
 		x1 = t1c->max_min_temp_info.max_temp_point.x - (n/2);
@@ -445,18 +550,18 @@ static void draw_max_marker(t1c_buffer_t* t1c, int16_t n, uint32_t* img)
 		y2 = y1 + n;
 	
 		// Draw a white upward facing triangle surrounded by a black triangle for contrast
-		draw_hline(img, x1, x2, y2, FILE_MARKER_COLOR);
-		draw_line(img, x1, y2, m, y1, FILE_MARKER_COLOR);
-		draw_line(img, m, y1, x2, y2, FILE_MARKER_COLOR);
+		draw32_hline(img, &clip, x1, x2, y2, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, x1, y2, m, y1, FILE_MARKER_COLOR);
+		draw32_line(img, &clip, m, y1, x2, y2, FILE_MARKER_COLOR);
 		
 		x1--;
 		y1--;
 		x2++;
 		y2++;
 		
-		draw_hline(img, x1, x2, y2, COLOR_BLACK);
-		draw_line(img, x1, y2, m, y1, COLOR_BLACK);
-		draw_line(img, m, y1, x2, y2, COLOR_BLACK);
+		draw32_hline(img, &clip, x1, x2, y2, COLOR_BLACK);
+		draw32_line(img, &clip, x1, y2, m, y1, COLOR_BLACK);
+		draw32_line(img, &clip, m, y1, x2, y2, COLOR_BLACK);
 	}
 }
 
@@ -490,136 +595,9 @@ static void draw_temp(uint32_t* img, int16_t x, int16_t y, uint16_t v, out_state
 }
 
 
-static void draw_hline(uint32_t* img, int16_t x1, int16_t x2, int16_t y, uint32_t c)
-{
-	uint32_t* imgP;
-	
-	if (x1 < 0)
-		x1 = 0;
-	if (x2 > (T1C_WIDTH-1))
-		x2 = T1C_WIDTH-1;
-	if ((y < 0) || (y > (T1C_HEIGHT-1))) return;
-	
-	imgP = img + y*T1C_WIDTH + x1;
-	
-	while (x1++ <= x2) {
-		*imgP++ = c;
-	}
-}
-
-
-static void draw_vline(uint32_t* img, int16_t x, int16_t y1, int16_t y2, uint32_t c)
-{
-	uint32_t* imgP;
-	
-	if ((x < 0) || (x > (T1C_WIDTH-1))) return;
-	if (y1 < 0)
-		y1 = 0;
-	if (y2 > (T1C_HEIGHT-1))
-		y2 = T1C_HEIGHT-1;
-	
-	imgP = img + y1*T1C_WIDTH + x;
-	
-	while (y1++ <= y2) {
-		*imgP = c;
-		imgP += T1C_WIDTH;
-	}
-}
-
-
-static void draw_line(uint32_t* img, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint32_t c)
-{
-	int16_t dx = abs(x2 - x1);
-	int16_t dy = -abs(y2 - y1);
-	int16_t err = dx + dy;
-	int16_t e2;
-	int16_t sx = (x1 < x2) ? 1 : -1;
-	int16_t sy = (y1 < y2) ? 1 : -1;
-	
-	for (;;) {
-		draw_pixel(img, x1, y1, c);
-		
-		if ((x1 == x2) && (y1 == y2)) break;
-		
-		e2 = 2 * err;
-		if (e2 >= dy) {
-			err += dy;
-			x1 += sx;
-		}
-		if (e2 <= dx) {
-			err += dx;
-			y1 += sy;
-		}
-	}
-}
-
-
-static void draw_circle(uint32_t* img, int16_t x0, int16_t y0, int16_t r, uint32_t c) {
-	int16_t f = 1 - r;
-	int16_t ddF_x = 1;
-	int16_t ddF_y = -2 * r;
-	int16_t x = 0;
-	int16_t y = r;
-
-	draw_pixel(img, x0, y0 + r, c);
-	draw_pixel(img, x0, y0 - r, c);
-	draw_pixel(img, x0 + r, y0, c);
-	draw_pixel(img, x0 - r, y0, c);
-
-	while (x < y) {
-		if (f >= 0) {
-			y--;
-			ddF_y += 2;
-			f += ddF_y;
-		}
-		x++;
-		ddF_x += 2;
-		f += ddF_x;
-		
-		draw_pixel(img, x0 + x, y0 + y, c);
-		draw_pixel(img, x0 - x, y0 + y, c);
-		draw_pixel(img, x0 + x, y0 - y, c);
-		draw_pixel(img, x0 - x, y0 - y, c);
-		draw_pixel(img, x0 + y, y0 + x, c);
-		draw_pixel(img, x0 - y, y0 + x, c);
-		draw_pixel(img, x0 + y, y0 - x, c);
-		draw_pixel(img, x0 - y, y0 - x, c);
-	}
-}
-
-
-static void draw_rect(uint32_t* img, int16_t x, int16_t y, int16_t w, int16_t h, uint32_t c)
-{
-	if (x < 0) {
-		w += x;
-		if (w <= 0) return;
-		x = 0;
-	}
-	if ((x+w) > T1C_WIDTH)
-		w -= (x+w) - T1C_WIDTH;
-	if (y < 0)
-		y = 0;
-	if ((y+h) > T1C_HEIGHT) {
-		h += y;
-		if (h <= 0) return;
-		h -= (y+h) - T1C_HEIGHT;
-	}
-	
-	// Top and bottom lines
-	draw_hline(img, x, x+w-1, y, c);
-	draw_hline(img, x, x+w-1, y+h-1, c);
-	
-	// Left and right lines
-	draw_vline(img, x, y, y+h-1, c);
-	draw_vline(img, x+w-1, y, y+h-1, c);
-}
-
-
 static void darken_rect(uint32_t* img, int16_t x, int16_t y, int16_t w, int16_t h)
 {
-	uint8_t r, g, b;
-	int16_t x1, y1;
-	uint32_t c;
+	int16_t x1, y1, y2;
 	uint32_t* imgP;
 	
 	if (x < 0) {
@@ -629,251 +607,128 @@ static void darken_rect(uint32_t* img, int16_t x, int16_t y, int16_t w, int16_t
 	}
 	if ((x+w) > T1C_WIDTH)
 		w -= (x+w) - T1C_WIDTH;
-	if (y < 0)
-		y = 0;
-	if ((y+h) > T1C_HEIGHT) {
-		h += y;
-		if (h <= 0) return;
-		h -= (y+h) - T1C_HEIGHT;
-	}
 	
+	// Clip to the rows in the buffer
+	y2 = y + h;
+	if (y < strip_y)
+		y = strip_y;
+	if (y2 > (strip_y+strip_h))
+		y2 = strip_y+strip_h;
+	if ((w <= 0) || (y >= y2)) return;
+	
+	// Halve all three color components at once
 	y1 = y;
 	do {
 		x1 = x;
-		imgP = img + y1*T1C_WIDTH + x1;
+		imgP = img + (y1-strip_y)*T1C_WIDTH + x1;
 		while (x1++ < (x+w)) {
-			c = *imgP;
-			b = ((c >> 16) & 0xFF) >> 1;
-			g = ((c >> 8) & 0xFF) >> 1;
-			r = (c & 0xFF) >> 1;
-			*imgP++ = RGB_TO_24BIT(r, g, b);
+			*imgP = (*imgP >> 1) & RGB_TO_24BIT(0x7F, 0x7F, 0x7F);
+			imgP++;
 		}
-	} while (++y1 < (y+h));
+	} while (++y1 < y2);
 }
 
 
-static int16_t draw_landscape_char(uint32_t* img, int16_t x, int16_t y, uint32_t c, const Font_TypeDef *Font)
+static void compute_palette_bar()
 {
-	uint16_t pX;
-	uint16_t pY;
-	uint8_t tmpCh;
-	uint8_t bL;
-	const uint8_t *pCh;
-
-	// If the specified character code is out of bounds should substitute the code of the "unknown" character
-	if ((c < Font->font_MinChar) || (c > Font->font_MaxChar)) c = Font->font_UnknownChar;
-
-	// Pointer to the first byte of character in font data array
-	pCh = &Font->font_Data[(c - Font->font_MinChar) * Font->font_BPC];
-
-	// Draw character
-	if (Font->font_Scan == FONT_V) {
-		// Vertical pixels order
-		if (Font->font_Height < 9) {
-			// Height is 8 pixels or less (one byte per column)
-			pX = x;
-			while (pX < x + Font->font_Width) {
-				pY = y;
-				tmpCh = *pCh++;
-				while (tmpCh) {
-					if (tmpCh & 0x01) {
-						draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-					}
-					tmpCh >>= 1;
-					pY++;
-				}
-				pX++;
-			}
-		} else {
-			// Height is more than 8 pixels (several bytes per column)
-			pX = x;
-			while (pX < x + Font->font_Width) {
-				pY = y;
-				while (pY < y + Font->font_Height) {
-					bL = 8;
-					tmpCh = *pCh++;
-					if (tmpCh) {
-						while (bL) {
-							if (tmpCh & 0x01) {
-								draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-							}
-							tmpCh >>= 1;
-							if (tmpCh) {
-								pY++;
-								bL--;
-							} else {
-								pY += bL;
-								break;
-							}
-						}
-					} else {
-						pY += bL;
-					}
-				}
-				pX++;
-			}
-		}
-	} else {
-		// Horizontal pixels order
-		if (Font->font_Width < 9) {
-			// Width is 8 pixels or less (one byte per row)
-			pY = y;
-			while (pY < y + Font->font_Height) {
-				pX = x;
-				tmpCh = *pCh++;
-				while (tmpCh) {
-					if (tmpCh & 0x01) {
-						draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-					}
-					tmpCh >>= 1;
-					pX++;
-				}
-				pY++;
-			}
-		} else {
-			// Width is more than 8 pixels (several bytes per row)
-			pY = y;
-			while (pY < y + Font->font_Height) {
-				pX = x;
-				while (pX < x + Font->font_Width) {
-					bL = 8;
-					tmpCh = *pCh++;
-					if (tmpCh) {
-						while (bL) {
-							if (tmpCh & 0x01) {
-								draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-							}
-							tmpCh >>= 1;
-							if (tmpCh) {
-								pX++;
-								bL--;
-							} else {
-								pX += bL;
-								break;
-							}
-						}
-					} else {
-						pX += bL;
-					}
-				}
-				pY++;
-			}
-		}
+	float delta;
+	float cur;
+	int i;
+	int16_t n;
+	
+	// Compute the palette length
+	pal_bar_len = img_h - 2*FILE_IMG_PAL_TEXT_HEIGHT;
+	
+	delta = 255.0 / (float) -pal_bar_len;
+	cur = 255.0;
+	for (n=0; n<pal_bar_len; n++) {
+		i = round(cur);
+		if (i < 0) i = 0;
+		pal_bar_index[n] = (uint8_t) i;
+		cur += delta;
 	}
-
-	return Font->font_Width + 1;
+	
+	pal_bar_is_portrait = img_is_portrait;
+	pal_bar_valid = true;
 }
 
 
-static int16_t draw_portrait_char(uint32_t* img, int16_t x, int16_t y, uint32_t c, const Font_TypeDef *Font)
+static int16_t draw_char(uint32_t* img, int16_t x, int16_t y, uint8_t c, const Font_TypeDef *Font)
 {
-	uint16_t pX;
-	uint16_t pY;
-	uint8_t tmpCh;
-	uint8_t bL;
+	const glyph_map_t* m = glyph_map;
 	const uint8_t *pCh;
-
+	int16_t n_outer, n_bytes;
+	int16_t outer_dx, outer_dy, inner_dx, inner_dy;
+	int16_t x2, y2;
+	int16_t i, b;
+	int16_t pX, pY;
+	int32_t outer_step, inner_step;
+	uint32_t* p;
+	uint32_t* q;
+	uint8_t tmpCh;
+	
 	// If the specified character code is out of bounds should substitute the code of the "unknown" character
 	if ((c < Font->font_MinChar) || (c > Font->font_MaxChar)) c = Font->font_UnknownChar;
 
 	// Pointer to the first byte of character in font data array
 	pCh = &Font->font_Data[(c - Font->font_MinChar) * Font->font_BPC];
-
-	// Draw character
+	
+	// Vertical fonts hold each column top to bottom, horizontal fonts each row left to right,
+	// with bit 0 of each byte first
 	if (Font->font_Scan == FONT_V) {
-		// Vertical pixels order
-		if (Font->font_Height < 9) {
-			// Height is 8 pixels or less (one byte per column)
-			pY = y;
-			while (pY > y - Font->font_Height) {
-				pX = x;
+		n_outer = Font->font_Width;
+		n_bytes = (Font->font_Height + 7) / 8;
+		outer_dx = m->col_dx;
+		outer_dy = m->col_dy;
+		inner_dx = m->row_dx;
+		inner_dy = m->row_dy;
+	} else {
+		n_outer = Font->font_Height;
+		n_bytes = (Font->font_Width + 7) / 8;
+		outer_dx = m->row_dx;
+		outer_dy = m->row_dy;
+		inner_dx = m->col_dx;
+		inner_dy = m->col_dy;
+	}
+	
+	// Opposite corner of the character cell
+	x2 = x + (Font->font_Width - 1)*m->col_dx + (Font->font_Height - 1)*m->row_dx;
+	y2 = y + (Font->font_Width - 1)*m->col_dy + (Font->font_Height - 1)*m->row_dy;
+	
+	if ((MIN(x, x2) >= clip.x1) && (MAX(x, x2) <= clip.x2) &&
+	    (MIN(y, y2) >= clip.y1) && (MAX(y, y2) <= clip.y2)) {
+		// Entirely visible: step through the buffer without clipping each pixel
+		outer_step = outer_dx + outer_dy*T1C_WIDTH;
+		inner_step = inner_dx + inner_dy*T1C_WIDTH;
+		p = img + (y - clip.y0)*T1C_WIDTH + x;
+		for (i=0; i<n_outer; i++) {
+			for (b=0; b<n_bytes; b++) {
+				q = p + 8*b*inner_step;
 				tmpCh = *pCh++;
 				while (tmpCh) {
-					if (tmpCh & 0x01) {
-						draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-					}
+					if (tmpCh & 0x01) *q = FILE_TEXT_COLOR;
 					tmpCh >>= 1;
-					pX++;
+					q += inner_step;
 				}
-				pY--;
-			}
-		} else {
-			// Height is more than 8 pixels (several bytes per column)
-			pY = y;
-			while (pY > y - Font->font_Height) {
-				pX = x;
-				while (pX < x + Font->font_Width) {
-					bL = 8;
-					tmpCh = *pCh++;
-					if (tmpCh) {
-						while (bL) {
-							if (tmpCh & 0x01) {
-								draw_pixel(img, pY, pX, FILE_TEXT_COLOR);
-							}
-							tmpCh >>= 1;
-							if (tmpCh) {
-								pX++;
-								bL--;
-							} else {
-								pX += bL;
-								break;
-							}
-						}
-					} else {
-						pX += bL;
-					}
-				}
-				pY--;
 			}
+			p += outer_step;
 		}
 	} else {
-		// Horizontal pixels order
-		if (Font->font_Width < 9) {
-			// Width is 8 pixels or less (one byte per row)
-			pX = x;
-			while (pX < x + Font->font_Height) {
-				pY = y;
+		for (i=0; i<n_outer; i++) {
+			for (b=0; b<n_bytes; b++) {
+				pX = x + i*outer_dx + 8*b*inner_dx;
+				pY = y + i*outer_dy + 8*b*inner_dy;
 				tmpCh = *pCh++;
 				while (tmpCh) {
-					if (tmpCh & 0x01) {
-						draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-					}
+					if (tmpCh & 0x01) draw32_pixel(img, &clip, pX, pY, FILE_TEXT_COLOR);
 					tmpCh >>= 1;
-					pY--;
-				}
-				pX++;
-			}
-		} else {
-			// Width is more than 8 pixels (several bytes per row)
-			pX = x;
-			while (pX < x + Font->font_Height) {
-				pY = y;
-				while (pY > y + Font->font_Width) {
-					bL = 8;
-					tmpCh = *pCh++;
-					if (tmpCh) {
-						while (bL) {
-							if (tmpCh & 0x01) {
-								draw_pixel(img, pX, pY, FILE_TEXT_COLOR);
-							}
-							tmpCh >>= 1;
-							if (tmpCh) {
-								pY--;
-								bL--;
-							} else {
-								pY -= bL;
-								break;
-							}
-						}
-					} else {
-						pY -= bL;
-					}
+					pX += inner_dx;
+					pY += inner_dy;
 				}
-				pX++;
 			}
 		}
 	}
-
+	
 	return Font->font_Width + 1;
 }
 
@@ -884,7 +739,7 @@ static void draw_string(uint32_t* img, int16_t x, int16_t y, const char *str, co
 		int16_t pY = y;
 		
 		while (*str) {
-			pY -= draw_portrait_char(img, x, pY, *str++, Font);
+			pY -= draw_char(img, x, pY, *str++, Font);
 			if (pY < 0) break;
 		}
 	} else {
@@ -892,16 +747,10 @@ static void draw_string(uint32_t* img, int16_t x, int16_t y, const char *str, co
 		uint16_t eX = img_w - Font->font_Width - 1;
 		
 		while (*str) {
-			pX += draw_landscape_char(img, pX, y, *str++, Font);
+			pX += draw_char(img, pX, y, *str++, Font);
 			if (pX > eX) break;
 		}
 	}
 }
 
 
-static __inline__ void draw_pixel(uint32_t* img, int16_t x, int16_t y, uint32_t c)
-{
-	if ((x < 0) || (x > (T1C_WIDTH-1))) return;
-	if ((y < 0) || (y > (T1C_HEIGHT-1))) return;
-	*(img + x + y*T1C_WIDTH) = c;
-}
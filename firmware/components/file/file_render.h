@@ -52,6 +52,9 @@
 // Spot meter
 #define FILE_IMG_SPOT_SIZE        6
 
+// ROI table spot markers
+#define FILE_IMG_ROI_SPOT_SIZE    4
+
 // Min/Max markers
 #define FILE_IMG_MARKER_SIZE      8
 
@@ -73,11 +76,14 @@
 // File Render API
 //
 void file_render_set_orientation(bool is_portrait);
+void file_render_set_strip(int16_t y, int16_t h);
 void file_render_t1c_data(t1c_buffer_t* t1c, uint32_t* img);
+void file_render_t1c_rows(t1c_buffer_t* t1c, uint32_t* img, int16_t y, int16_t h);
 void file_render_spotmeter(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
 void file_render_min_max_markers(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
 void file_render_region_marker(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
 void file_render_region_temps(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
+void file_render_roi_markers(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
 void file_render_palette(uint32_t* img, out_state_t* g);  // Render Palette related after markers
 void file_render_palette_marker(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
 void file_render_min_max_temps(t1c_buffer_t* t1c, uint32_t* img, out_state_t* g);
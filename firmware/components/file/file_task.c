@@ -19,6 +19,8 @@
  */
 #include "file_task.h"
 #include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
 #include "esp_timer.h"
 #include "esp_ota_ops.h"
 #include "esp_log.h"
@@ -26,18 +28,27 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "bench_utilities.h"
+#include "cmd_list.h"
+#include "file_log.h"
+#include "file_raw.h"
 #include "file_render.h"
 #include "file_utilities.h"
 #include "palettes.h"
 #include "out_state_utilities.h"
+#include "perf_utilities.h"
 #include "system_config.h"
 #include "sys_utilities.h"
+#include "t1c_agc.h"
 #include "t1c_task.h"
 #include "time_utilities.h"
 #include "tiny1c.h"
 #include "tjpgd.h"
+#include "y16_codec.h"
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 
 #define TJE_IMPLEMENTATION
 #include "tiny_jpeg.h"
@@ -56,9 +67,44 @@
 //
 // File Task private constants
 //
-#define FILE_TASK_EVAL_NORM_MSEC 50
 #define FILE_TASK_EVAL_FAST_MSEC 10
 
+// Shortest timelapse interval
+#define FILE_TIMELAPSE_MIN_MSEC  100
+
+// Automatic FFC is held off from this long before each timelapse picture until it has been
+// saved.  An FFC is requested at the start of the hold for intervals at least FFC_MIN long.
+#define FILE_TL_FFC_LEAD_MSEC    2000
+#define FILE_TL_FFC_MIN_MSEC     10000
+
+// Shortest deep sleep between timelapse pictures worth rebooting for
+#define FILE_TL_SLEEP_MIN_MSEC   5000
+
+// Marks valid timelapse state kept through deep sleep
+#define FILE_TL_SLEEP_MAGIC      0x544C534C
+
+// Period a temperature rise is measured over for CMD_TRIG_TEMP_RISE
+#define FILE_TRIGGER_RISE_MSEC   1000
+
+// The card is left mounted between accesses and unmounted after it has been idle this long
+#define FILE_SESSION_IDLE_MSEC   10000
+
+// Directories and files that can be queued for deletion
+#define FILE_DEL_QUEUE_LEN       32
+
+// The images before and after the one being viewed in the file browser are prefetched into
+// the browser image cache once it hasn't read an image for this long
+#define FILE_PREFETCH_IDLE_MSEC  250
+
+// Image name (relative to DCIM) length
+#define FILE_PATH_LEN            (DIR_NAME_LEN + FILE_NAME_LEN + 2)
+
+// Jpeg writer task notification
+#define FILE_WR_NOTIFY_SLOT_MASK 0x00000001
+
+// Screenshot BMP header (file header, info header and the RGB565 BI_BITFIELDS masks)
+#define FILE_SCREEN_HDR_LEN      66
+
 // Uncomment to log various file processing timestamps
 //#define LOG_WRITE_TIMESTAMP
 //#define LOG_READ_TIMESTAMP
@@ -70,8 +116,36 @@
 	#define TJPGD_NUM_BPP        2
 #endif
 
-// tjpgd decoder work buffer length (seem to use about 2776 bytes)
-#define TJPGD_WORK_BUF_LEN       3500
+// tjpgd decoder work buffer length (CONFIG_JPEG_FAST_DECODE dependent)
+#define TJPGD_WORK_BUF_LEN       JD_WORK_LEN
+
+// Raw image data is Rice coded a row at a time.  Replay decodes whole rows read into the
+// tjpgd work buffer and each radiometric jpeg segment must have room for a row after the
+// raw file header.
+_Static_assert((TJPGD_WORK_BUF_LEN >= Y16_CODEC_MAX_ROW_LEN(T1C_WIDTH)) &&
+               ((TJEI_APP_LEN - FILE_RAW_APP_ID_LEN - FILE_RAW_HDR_LEN) >= Y16_CODEC_MAX_ROW_LEN(T1C_WIDTH)),
+               "Buffers too small for a Rice coded row");
+
+// Largest jpeg file that can be read as-is into rgb_file_image
+#define FILE_MAX_JPEG_LEN        (T1C_WIDTH*T1C_HEIGHT*TJPGD_NUM_BPP)
+
+// Image to thumbnail size as a tjpgd scale (1/2^n)
+#define FILE_THUMB_SCALE         2
+_Static_assert(((FILE_THUMB_W << FILE_THUMB_SCALE) == T1C_WIDTH) && ((FILE_THUMB_H << FILE_THUMB_SCALE) == T1C_HEIGHT),
+               "Bad thumbnail size");
+
+// The benchmark renders a full RGBA image into one jpeg slot and encodes it into the other
+_Static_assert((FILE_JPEG_NUM_SLOTS >= 2) && (FILE_JPEG_SLOT_LEN >= T1C_WIDTH*T1C_HEIGHT*4),
+               "Jpeg slots too small for the benchmark");
+
+// Data log records are collected in a jpeg slot
+_Static_assert((FILE_LOG_FLUSH_LEN <= FILE_JPEG_SLOT_LEN) && (FILE_LOG_FLUSH_LEN >= (FILE_LOG_HDR_LEN + FILE_LOG_REC_LEN)),
+               "Bad data log flush length");
+
+// Saved images are rendered a strip at a time as they are encoded and the thumbnail is
+// made from each strip
+_Static_assert(((FILE_SAVE_STRIP_LINES % 16) == 0) && ((FILE_SAVE_STRIP_LINES % (T1C_HEIGHT / FILE_THUMB_H)) == 0),
+               "Bad save strip size");
 
 
 
@@ -81,19 +155,62 @@
 
 // Session identifier for tjpgd decoder input/output functions
 typedef struct {
-    FILE *fp;               /* Input stream */
+    FILE *fp;               /* Input stream (NULL to read from mem) */
+    const uint8_t *mem;     /* Input buffer */
+    size_t mem_len;
+    size_t mem_pos;
     uint8_t *fbuf;          /* Output frame buffer */
     unsigned int wfbuf;     /* Width of the frame buffer [pix] */
+    uint8_t expand;         /* Output pixels are written as 2^expand square blocks */
 } tjpgd_iodev_t;
 
+// Directory (empty file_name) or file queued for deletion
+typedef struct {
+	char dir_name[DIR_NAME_LEN];
+	char file_name[FILE_NAME_LEN];
+	bool success;
+} file_del_target_t;
+
+// Browser image cache entry holding a decoded image (the contents of rgb_file_image after
+// FILE_NOTIFY_GUI_GET_IMAGE_MASK) or a jpeg file read as-is (FILE_NOTIFY_GUI_GET_JPEG_MASK)
+typedef struct {
+	char name[FILE_PATH_LEN];  // Empty when unused
+	bool decoded;
+	uint32_t len;              // File length when not decoded
+	uint8_t* bufP;
+} file_prefetch_t;
+
+// Encoded jpeg image waiting to be written to the card
+typedef struct {
+	uint8_t* bufP;
+	uint32_t buf_len;       // Size of bufP
+	uint32_t len;
+	uint32_t thumb_len;     // Length of the thumbnail jpeg following the image (0 for none)
+	bool overflow;          // Set if the encoded image didn't fit in the buffer
+	bool is_raw;            // Set for a raw file, clear for a jpeg file
+	bool is_sibling;        // Set if the file takes the name of the previous file written
+	bool is_movie;          // Set for a movie frame (a movie slot with len 0 ends the movie)
+	bool is_log;            // Set for data log records (a log slot with len 0 ends the log)
+	volatile bool full;     // Set by file_task when encoded, cleared by the writer when written
+} jpeg_slot_t;
+
 // Timelapse configuration
 typedef struct {
 	bool timelapse_en;
 	bool timelapse_notify;
-	uint32_t timelapse_interval;
+	uint32_t timelapse_interval;  // mSec
 	uint32_t timelapse_count;
 } timelapse_config_t;
 
+// Timelapse state kept in RTC memory while sleeping between pictures
+typedef struct {
+	uint32_t magic;               // FILE_TL_SLEEP_MAGIC when valid
+	timelapse_config_t config;
+	uint32_t img_count;
+	uint32_t missed_count;
+	int64_t trig_usec;            // Next picture (gettimeofday time since it runs through sleep)
+} timelapse_sleep_state_t;
+
 
 
 //
@@ -101,8 +218,8 @@ typedef struct {
 //
 static const char* TAG = "file_task";
 
-// Counter used to probe card for presence 
-static int card_check_count = FILE_CARD_CHECK_PERIOD_MSEC / FILE_TASK_EVAL_NORM_MSEC;
+// Time to next probe card for presence
+static int64_t card_check_usec = FILE_CARD_CHECK_PERIOD_MSEC * 1000;
 
 // Hardware card detection state from the hardware switch on the card socket
 static bool card_present = false;
@@ -110,6 +227,22 @@ static bool card_present = false;
 // Card present and available for access
 static bool card_available = false;
 
+// Card mounted session state (card_mutex serializes access between file_task and the
+// jpeg writer task)
+static bool card_session_mounted = false;
+static int64_t card_session_usec;           // Time of last access
+static SemaphoreHandle_t card_mutex;
+
+// Save pipeline: file_task encodes images into the slots in order and the writer task
+// writes them to the card in the same order
+static jpeg_slot_t jpeg_slots[FILE_JPEG_NUM_SLOTS];
+static int jpeg_encode_slot = 0;
+static bool jpeg_write_success = false;   // Set when the writer's last file was written
+static int jpeg_write_slot = 0;
+static TaskHandle_t task_handle_file_wr;
+static StackType_t file_wr_stack[TASK_FILE_WR_STACK];
+static StaticTask_t file_wr_tcb;
+
 // Notifications
 static bool save_image_requested = false;
 static bool notify_image = false;
@@ -122,6 +255,10 @@ static uint32_t task_file_act_succeeded_notification;
 static uint32_t task_file_act_failed_notification;
 static uint32_t task_file_catalog_ready_notification;
 static uint32_t task_file_image_ready_notification;
+static uint32_t task_file_jpeg_ready_notification;
+static uint32_t task_file_page_ready_notification;
+static uint32_t task_file_range_ready_notification;
+static uint32_t task_file_thumb_ready_notification;
 static uint32_t task_file_timelapse_start_notification;
 static uint32_t task_file_timelapse_stop_notification;
 
@@ -135,44 +272,251 @@ static int catalog_type;                            // -1 is list of directories
 static int num_catalog_names;                       // Set with catalog_names_buffer
 static char catalog_names_buffer[FILE_MAX_CATALOG_NAMES * FILE_NAME_LEN];
 
-// Filesystem delete indicies for GUI commands
-static int del_dir;
-static int del_file;
+// Filesystem catalog page information for GUI commands
+static int catalog_page_type;
+static int catalog_page_offset;
+static int catalog_page_count;                      // Requested, then set with catalog_page_entries
+static int catalog_page_total;
+static file_catalog_entry_t catalog_page_entries[FILE_MAX_CATALOG_PAGE];
+
+// Filesystem catalog time range information for GUI commands
+static uint32_t catalog_range_start;
+static uint32_t catalog_range_end;
+static int catalog_range_offset;
+static int catalog_range_count;                     // Set with catalog_range_entries
+static int catalog_range_total;
+static file_range_entry_t catalog_range_entries[FILE_MAX_CATALOG_RANGE];
+
+// Background delete queue for GUI commands
+//  - Targets are added by a command handler (protected by del_queue_mux) and deleted by
+//    this task one card operation per evaluation so saves aren't blocked
+//  - The catalog isn't updated until the queue is empty so the indices of targets queued
+//    from the same catalog view stay valid.  Catalog requests are held until then.
+static portMUX_TYPE del_queue_mux = portMUX_INITIALIZER_UNLOCKED;
+static file_del_target_t del_queue[FILE_DEL_QUEUE_LEN];
+static int del_queue_count = 0;
+static int del_queue_pos = 0;                       // Target being deleted
+static bool del_catalog_held = false;
+static bool del_page_held = false;
+static bool del_range_held = false;
 
 // File image read directory + filename for GUI commands
-static char file_read_filename[DIR_NAME_LEN + FILE_NAME_LEN + 2];
+static char file_read_filename[FILE_PATH_LEN];
+static uint32_t file_jpeg_len;
+
+// Browser image cache holding the image being viewed and its prefetched neighbours.  It is
+// disabled if file_prefetch_bufs couldn't be allocated.
+static file_prefetch_t prefetch_cache[FILE_PREFETCH_NUM];
+static bool prefetch_pending = false;               // Neighbours of prefetch_base may be missing
+static bool prefetch_decoded;                       // Type of the last browser read
+static char prefetch_base[FILE_PATH_LEN];
+static int64_t prefetch_usec;                       // When the browser is considered idle
 
 // Timelapse control
 static bool timelapse_running = false;
 static uint32_t timelapse_img_count;
+static uint32_t timelapse_missed_count;
 static int64_t timelapse_trig_usec;
+static bool timelapse_ffc_hold = false;             // Holding FFC off for the next picture
+static esp_timer_handle_t timelapse_timer;
 static timelapse_config_t cur_timelapse_config;
 static timelapse_config_t new_timelapse_config;
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+static RTC_DATA_ATTR timelapse_sleep_state_t timelapse_sleep_state;
+static bool timelapse_woke = false;                 // Series resumed after a deep sleep
+static bool timelapse_sleep_pending = false;        // Sleep (or power off) once written
+#endif
+
+// Burst capture related
+static int new_burst_num = 0;
+static bool burst_running = false;                  // Capturing or saving a burst
+static int burst_num;
+static int burst_first;                             // file_burst_buffer entry of the first frame
+static int burst_save_index = -1;                   // Next frame to save (-1 while capturing)
+
+// Movie recording related
+static int new_record_fps = 0;
+static bool record_running = false;
+static bool record_frame_requested = false;
+static int64_t record_interval_usec;
+static int64_t record_trig_usec;
+static int64_t record_start_usec;                   // Timestamp of the first frame
+static uint32_t record_num_frames;
+
+// Data logging related
+static int new_log_rate = 0;
+static int log_rate;
+static bool log_running = false;
+static bool log_frame_requested = false;
+static int64_t log_interval_usec;
+static int64_t log_trig_usec;
+static int64_t log_start_usec;                      // Timestamp of the first record
+static uint32_t log_num_records;
+static jpeg_slot_t* log_slotP = NULL;               // Slot being filled with records
+
+// Pre-trigger frames kept for pictures
+static int new_pre_trigger_num = 0;
+static int pre_trigger_num = 0;
+
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+// Synchronized capture trigger time (esp_timer)
+static int64_t new_sync_usec;
+#endif
+
+#ifdef CONFIG_SCREENDUMP_ENABLE
+// Screen rendered by gui_task for a screenshot (RGB565 pixels, byte swapped if swapped)
+static uint16_t* screen_fb;
+static int screen_w;
+static int screen_h;
+static bool screen_swapped;
+#endif
+
+// Event trigger related
+static file_trigger_config_t new_trigger_config;
+static file_trigger_config_t cur_trigger_config;
+static bool trigger_armed = false;
+static bool notify_stats = false;
+static bool trigger_record = false;                 // Recording was started by the trigger
+static int64_t trigger_record_end_usec;
+static int64_t trigger_holdoff_usec;                // No triggers before this time
+static bool trigger_ref_valid;
+static uint16_t trigger_ref_temp;                   // Start of the CMD_TRIG_TEMP_RISE period
+static int64_t trigger_ref_usec;
+static uint32_t trigger_count;
+
+// Frame replay from the card
+static char new_replay_dir[DIR_NAME_LEN];
+static bool replay_running = false;
+static int replay_dir_index;
+static int replay_file_index;                       // Next file in the directory to try
+static uint32_t replay_num_frames;
+static int replay_rate = 0;                         // Frames/sec, 0 = as fast as they are used
+static int64_t replay_next_usec;                    // Earliest time to pass the next frame on
+static bool replay_frame_ready;                     // Next frame is waiting in the t1c_task buffer
+static bool replay_high_gain;
+static uint32_t replay_seg_left;                    // Raw data left in the current jpeg segment
+
+// Movie file being written by the writer task
+static bool movie_open = false;
+static uint32_t movie_len;
+static volatile bool movie_write_failed = false;
+
+// Data log file being written by the writer task
+static bool log_open = false;
+static uint32_t log_len;
+static volatile bool log_write_failed = false;
+
+// Image being encoded (for the jpeg comments) and its burst frame index (-1 if not a burst)
+static t1c_buffer_t* enc_t1cP = &file_t1c_buffer;
+static int enc_burst_index = -1;
+static bool enc_movie = false;                      // Set when encoding a movie frame
+
+// How the image being encoded is rendered into the save strip
+static bool enc_gray;                               // Y8 data encoded as grayscale
+static bool enc_invert;                             // Grayscale data is inverted
+static bool enc_thumb;                              // Make the thumbnail from each strip
+
+// Next row to stream into a radiometric jpeg segment and the coder state
+static int enc_y16_row;
+static y16_codec_t enc_y16_codec;
 
 // tjpgd work buffer
 static uint8_t tjpgd_work_buf[TJPGD_WORK_BUF_LEN];
 
+// Serializes use of the jpeg encoder (it keeps its state in static variables) between saving
+// images here and other tasks calling file_encode_jpeg
+static SemaphoreHandle_t jpeg_enc_mutex = NULL;
+
 
 
 //
 // File Task Forward Declarations for internal functions
 //
 static void _setup_notifications();
-static void _handle_notifications();
+static TickType_t _get_eval_wait();
+static void _handle_notifications(TickType_t wait);
 static void _update_card_present_info();
+static bool _mount_card();
+static void _release_card(bool success);
+static void _end_card_session();
+static void _unmount_card_session();
+static void _eval_card_session();
 static bool _catalog_filesystem();
-static void _eval_timelapse();
+static void _timelapse_timer_cb(void* arg);
 static void _set_timelapse(bool en);
-static bool _delete_dir(int dir_index);
-static bool _delete_file(int dir_index, int file_index);
+static void _eval_timelapse_ffc();
+static void _end_timelapse_ffc();
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+static void _resume_timelapse();
+static void _eval_timelapse_sleep();
+#endif
+static void _start_burst(int pre);
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+static void _start_sync_capture();
+#endif
+static void _save_burst_frame();
+static void _eval_record();
+static void _set_record(bool en);
+static void _save_record_frame();
+static void _eval_log();
+static void _set_log(bool en);
+static void _save_log_record();
+static jpeg_slot_t* _get_log_slot();
+static void _set_trigger();
+static void _update_trigger_ring();
+static void _eval_trigger();
+static void _start_replay();
+static void _eval_replay();
+static bool _load_replay_frame(uint16_t* bufP, bool* high_gain);
+static bool _read_replay_file(char* name, uint16_t* bufP, bool* high_gain, bool rjpeg);
+static uint32_t _read_replay_data(FILE* fd, uint8_t* buf, uint32_t len, bool rjpeg);
+static bool _next_replay_segment(FILE* fd);
+static void _eval_delete();
+static void _finish_delete();
+static void _clear_delete_queue();
 static bool _format_card();
+static bool _run_benchmark();
+#ifdef CONFIG_SCREENDUMP_ENABLE
+static void _save_screenshot();
+static void _put_le32(uint8_t* dst, uint32_t v);
+#endif
+static bool _update_t1c_fw();
 static bool _read_jpeg_image();
-static void _save_image_to_jpeg();
+static bool _read_jpeg_file();
+static bool _read_jpeg_thumb();
+static bool _read_file_to_buffer(char* name, uint8_t* bufP, uint32_t* lenP);
+static bool _decode_jpeg_file(char* name, uint8_t* bufP, uint8_t scale, uint8_t expand);
+static bool _get_cached_image(char* name, bool decoded);
+static void _put_cached_image(char* name, bool decoded);
+static void _eval_prefetch();
+static void _clear_cached_images();
+static int _get_neighbour_names(char* base, char names[][FILE_PATH_LEN]);
+static file_prefetch_t* _find_cached_image(char* name, bool decoded);
+static file_prefetch_t* _get_free_cache_entry(char* base, char names[][FILE_PATH_LEN], int n);
+static uint32_t _encode_thumb(jpeg_slot_t* slotP);
+static void _make_thumb_from_strip(int y, int h);
+static void _make_thumb_from_y8(uint8_t* y8P);
+static void _make_thumb_from_file_image(int w, int step);
+static bool _save_image(t1c_buffer_t* t1cP);
+static bool _encode_image_to_jpeg(t1c_buffer_t* t1cP, bool radiometric);
+static bool _encode_image_to_raw(t1c_buffer_t* t1cP, bool is_sibling);
+static jpeg_slot_t* _get_free_slot();
+static void _queue_slot(jpeg_slot_t* slotP);
+static void _jpeg_slot_write_func(void* context, void* data, int size);
+static void _file_wr_task();
+static void _write_jpeg_slot(jpeg_slot_t* slotP);
+static void _write_movie_slot(jpeg_slot_t* slotP);
+static void _write_log_slot(jpeg_slot_t* slotP);
+static void _add_catalog_file(char* dir_name, char* file_name, bool new_dir);
+static void _display_save_error(char* msg);
 static void _notify_save_msg_start(bool success);
 static void _notify_save_msg_end();
 static size_t _tjpgd_in_func(JDEC* jd, uint8_t* buff, size_t nbyte);
 static int _tjpgd_out_func(JDEC* jd, void* bitmap, JRECT* rect);
 static char* _tjpgd_comment_func(int item_index, char* buf);
+static int _tjpgd_app_func(int seg_index, unsigned char* buf);
+static const unsigned char* _tjpgd_strip_func(int y, int h);
+static void _render_overlay(t1c_buffer_t* t1cP);
 
 
 //
@@ -182,37 +526,133 @@ void file_task()
 {
 	ESP_LOGI(TAG, "Start task");
 	
+	jpeg_enc_mutex = xSemaphoreCreateMutex();
+	card_mutex = xSemaphoreCreateMutex();
+	
 	// Setup our notifications
 	_setup_notifications();
 	
-	while (1) {	
-		if (save_image_requested) {
-			vTaskDelay(pdMS_TO_TICKS(FILE_TASK_EVAL_FAST_MSEC));
-		} else {
-			vTaskDelay(pdMS_TO_TICKS(FILE_TASK_EVAL_NORM_MSEC));
-		}
-		
-		_handle_notifications();
+	// Timelapse images are requested from a timer so they are taken on schedule
+	const esp_timer_create_args_t timelapse_timer_args = {
+		.callback = &_timelapse_timer_cb,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "file_timelapse",
+		.skip_unhandled_events = true
+	};
+	if (esp_timer_create(&timelapse_timer_args, &timelapse_timer) != ESP_OK) {
+		ESP_LOGE(TAG, "Create timelapse timer failed");
+	}
+	
+	// Start the writer stage of the save pipeline
+	for (int i=0; i<FILE_JPEG_NUM_SLOTS; i++) {
+		jpeg_slots[i].bufP = file_jpeg_slots[i];
+		jpeg_slots[i].buf_len = FILE_JPEG_SLOT_LEN;
+		jpeg_slots[i].full = false;
+	}
+	(void) system_start_task(&_file_wr_task, "file_wr_task", TASK_FILE_WR_STACK, file_wr_stack, &file_wr_tcb, TASK_FILE_WR_PRIO, &task_handle_file_wr, TASK_FILE_WR_CORE);
+	
+	// Setup the browser image cache
+	for (int i=0; i<FILE_PREFETCH_NUM; i++) {
+		prefetch_cache[i].name[0] = 0;
+		prefetch_cache[i].bufP = file_prefetch_bufs[i];
+	}
+	
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+	// Synchronized captures take their frame from the pre-trigger ring
+	_update_trigger_ring();
+#endif
+	
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+	// Continue a timelapse series we slept through part of.  Any other boot ends it.
+	if (file_is_timelapse_wakeup()) {
+		_resume_timelapse();
+	}
+	timelapse_sleep_state.magic = 0;
+#endif
+	
+	while (1) {
+		// Block until notified or the next timed evaluation is due
+		_handle_notifications(_get_eval_wait());
 		
 		_update_card_present_info();
 		
+		_eval_card_session();
+		
+		if (record_running) {
+			_eval_record();
+		}
+		
+		if (log_running) {
+			_eval_log();
+		}
+		
 		if (timelapse_running) {
-			_eval_timelapse();
+			_eval_timelapse_ffc();
+		}
+		
+		if (replay_running) {
+			_eval_replay();
 		}
 		
-		// Note: _save_image_to_jpeg may take significant time
+		if (trigger_armed && notify_stats) {
+			notify_stats = false;
+			_eval_trigger();
+		}
+		
+		// Note: _save_image may have to wait for the writer to free a slot
 		if (notify_image) {
 			notify_image = false;
 			if (save_image_requested) {
+				// The request is cleared after the save so the timelapse timer won't ask for
+				// another image while this one is still being encoded from file_t1c_buffer
+				(void) _save_image(&file_t1c_buffer);
 				save_image_requested = false;
-				_save_image_to_jpeg();
+				_end_timelapse_ffc();
 				
 				// Look for end of timelapse series
 				if (timelapse_running && (timelapse_img_count >= cur_timelapse_config.timelapse_count)) {
 					_set_timelapse(false);
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+					// A series that has been sleeping between pictures powers off at the end
+					timelapse_sleep_pending = timelapse_woke;
+#endif
+				}
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+				// Sleep until shortly before the next picture of a long interval series
+				if (timelapse_running && (cur_timelapse_config.timelapse_interval >= (CONFIG_TIMELAPSE_SLEEP_MIN_SEC * 1000))) {
+					timelapse_sleep_pending = true;
 				}
+#endif
+			} else if (record_frame_requested) {
+				record_frame_requested = false;
+				_save_record_frame();
+			} else if (log_frame_requested) {
+				log_frame_requested = false;
+				_save_log_record();
 			}
 		}
+		
+		// Burst frames are saved one per evaluation so other requests are still handled
+		if (burst_running && (burst_save_index >= 0)) {
+			_save_burst_frame();
+		}
+		
+		// Queued deletions are also done a piece at a time
+		if (del_queue_count != 0) {
+			_eval_delete();
+		}
+		
+		// Browser images are prefetched one per evaluation when there is nothing else to do
+		if (prefetch_pending) {
+			_eval_prefetch();
+		}
+		
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+		if (timelapse_sleep_pending) {
+			_eval_timelapse_sleep();
+		}
+#endif
 	}
 }
 
@@ -258,45 +698,300 @@ char* file_get_catalog(int* num, int* type)
 
 
 /**
- * Called by a command handler prior to sending a delete notification
+ * Called by a command handler prior to sending FILE_NOTIFY_GUI_GET_PAGE_MASK
+ */
+void file_set_catalog_page(int type, int offset, int count)
+{
+	catalog_page_type = type;
+	catalog_page_offset = (offset < 0) ? 0 : offset;
+	if (count < 0) count = 0;
+	if (count > FILE_MAX_CATALOG_PAGE) count = FILE_MAX_CATALOG_PAGE;
+	catalog_page_count = count;
+}
+
+
+/**
+ * Called by the output task to get the catalog page after notification
+ */
+file_catalog_entry_t* file_get_catalog_page_entries(int* num, int* type, int* offset, int* total)
+{
+	*num = catalog_page_count;
+	*type = catalog_page_type;
+	*offset = catalog_page_offset;
+	*total = catalog_page_total;
+	return catalog_page_entries;
+}
+
+
+/**
+ * Called by a command handler to set the time range to find prior to sending
+ * FILE_NOTIFY_GUI_GET_RANGE_MASK
+ */
+void file_set_catalog_range(uint32_t start, uint32_t end, int offset)
+{
+	catalog_range_start = start;
+	catalog_range_end = end;
+	catalog_range_offset = (offset < 0) ? 0 : offset;
+}
+
+
+/**
+ * Called by the output task to get the files in the time range after notification
  */
-void file_set_delete_file(int dir_index, int file_index)
+file_range_entry_t* file_get_catalog_range_entries(int* num, uint32_t* start, uint32_t* end, int* offset, int* total)
 {
-	del_dir = dir_index;
-	del_file = file_index;
+	*num = catalog_range_count;
+	*start = catalog_range_start;
+	*end = catalog_range_end;
+	*offset = catalog_range_offset;
+	*total = catalog_range_total;
+	return catalog_range_entries;
+}
+
+
+/**
+ * Called by a command handler to queue a directory (file_index -1) or file for deletion
+ * prior to sending FILE_NOTIFY_GUI_DELETE_MASK.  Returns false if the entry doesn't exist
+ * or the queue is full.
+ */
+bool file_set_delete_file(int dir_index, int file_index)
+{
+	file_del_target_t t;
+	bool ret = false;
+	
+	if (!file_get_directory_name(dir_index, t.dir_name)) {
+		return false;
+	}
+	if (file_index < 0) {
+		t.file_name[0] = 0;
+	} else if (!file_get_file_name(dir_index, file_index, t.file_name)) {
+		return false;
+	}
+	t.success = false;
+	
+	portENTER_CRITICAL(&del_queue_mux);
+	if (del_queue_count < FILE_DEL_QUEUE_LEN) {
+		del_queue[del_queue_count++] = t;
+		ret = true;
+	}
+	portEXIT_CRITICAL(&del_queue_mux);
+	
+	if (!ret) {
+		ESP_LOGE(TAG, "Delete queue full");
+	}
+	
+	return ret;
 }
 
 
 /**
- * Called by a command handler prior to sending FILE_NOTIFY_GUI_GET_IMAGE_MASK
+ * Called by a command handler prior to sending FILE_NOTIFY_GUI_GET_IMAGE_MASK,
+ * FILE_NOTIFY_GUI_GET_JPEG_MASK or FILE_NOTIFY_GUI_GET_THUMB_MASK
  */
 void file_set_image_fileinfo(int dir_index, int file_index)
 {
-	directory_node_t* dn;
-	file_node_t* fn;
+	char dir_name[DIR_NAME_LEN];
+	char file_name[FILE_NAME_LEN];
 	
-	dn = file_get_indexed_directory(dir_index);
-	if (dn != NULL) {
-		fn = file_get_indexed_file(dn, file_index);
-		if (fn != NULL) {
-			sprintf(file_read_filename, "%s/%s", dn->nameP, fn->nameP);
-		}
+	if (file_get_directory_name(dir_index, dir_name) && file_get_file_name(dir_index, file_index, file_name)) {
+		sprintf(file_read_filename, "%s/%s", dir_name, file_name);
+	}
+}
+
+
+/**
+ * Called by an output task after getting the jpeg or thumbnail ready notification
+ */
+uint32_t file_get_jpeg_file_len()
+{
+	return file_jpeg_len;
+}
+
+
+/**
+ * Called by another task to read part of a catalogued file directly from the card (e.g. to
+ * stream it to a client).  The card is held only for the read so saves continue between
+ * calls.  Returns the number of bytes read or -1 if the card or file isn't available.
+ */
+int file_read_card_file(char* dir_name, char* file_name, uint32_t offset, uint8_t* buf, uint32_t len)
+{
+	char name[DIR_NAME_LEN + FILE_NAME_LEN + 2];
+	int ret;
+	
+	if (!card_available) {
+		return -1;
+	}
+	
+	sprintf(name, "%s/%s", dir_name, file_name);
+	if (!_mount_card()) {
+		return -1;
 	}
+	ret = file_read_image_section(name, offset, buf, len);
+	_release_card(ret >= 0);
+	
+	return ret;
 }
 
 
 /**
- * Called by a command handler prior to sending FILE_NOTIFY_TIMELAPSE_MASK
+ * Called by a command handler prior to sending FILE_NOTIFY_TIMELAPSE_MASK.  The interval
+ * is in mSec.
  */
 void file_set_timelapse_info(bool en, bool notify, uint32_t interval, uint32_t num)
 {
 	new_timelapse_config.timelapse_en = en;
 	new_timelapse_config.timelapse_notify = notify;
-	new_timelapse_config.timelapse_interval = interval;
+	new_timelapse_config.timelapse_interval = (interval < FILE_TIMELAPSE_MIN_MSEC) ? FILE_TIMELAPSE_MIN_MSEC : interval;
 	new_timelapse_config.timelapse_count = num;
 }
 
 
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+/**
+ * Returns true if we were woken from deep sleep to take the next picture of a timelapse
+ * series.  May be called before file_task is running.
+ */
+bool file_is_timelapse_wakeup()
+{
+	return ((esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) && (timelapse_sleep_state.magic == FILE_TL_SLEEP_MAGIC));
+}
+#endif
+
+
+/**
+ * Called by a command handler prior to sending FILE_NOTIFY_BURST_MASK
+ */
+void file_set_burst_info(int num)
+{
+	new_burst_num = num;
+}
+
+
+/**
+ * Called by a command handler prior to sending FILE_NOTIFY_RECORD_MASK
+ */
+void file_set_record_info(int fps)
+{
+	new_record_fps = fps;
+}
+
+
+/**
+ * Called by a command handler prior to sending FILE_NOTIFY_LOG_MASK
+ */
+void file_set_log_info(int rate)
+{
+	new_log_rate = rate;
+}
+
+
+/**
+ * Called by a command handler prior to sending FILE_NOTIFY_PRE_TRIGGER_MASK
+ */
+void file_set_pre_trigger_info(int num)
+{
+	if (num < 0) num = 0;
+	if (num >= FILE_BURST_MAX_FRAMES) num = FILE_BURST_MAX_FRAMES - 1;
+	new_pre_trigger_num = num;
+}
+
+
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+/**
+ * Called by sync_task prior to sending FILE_NOTIFY_SYNC_MASK with the esp_timer time the
+ * frame should be acquired closest to
+ */
+void file_set_sync_capture(int64_t target_usec)
+{
+	new_sync_usec = target_usec;
+}
+#endif
+
+
+#ifdef CONFIG_SCREENDUMP_ENABLE
+/**
+ * Called by gui_task prior to sending FILE_NOTIFY_SCREENSHOT_MASK with the w x h screen
+ * it rendered.  The pixels must not change until the screenshot is saved.
+ */
+void file_set_screenshot_info(uint16_t* fb, int w, int h, bool swapped)
+{
+	screen_fb = fb;
+	screen_w = w;
+	screen_h = h;
+	screen_swapped = swapped;
+}
+#endif
+
+
+/**
+ * Called by a command handler prior to sending FILE_NOTIFY_TRIGGER_MASK
+ */
+void file_set_trigger_info(file_trigger_config_t* cfg)
+{
+	new_trigger_config = *cfg;
+	if (new_trigger_config.record_fps < 1) new_trigger_config.record_fps = 1;
+	if (new_trigger_config.record_fps > CMD_RECORD_MAX_FPS) new_trigger_config.record_fps = CMD_RECORD_MAX_FPS;
+	if (new_trigger_config.action == CMD_TRIG_ACT_BURST) {
+		if (new_trigger_config.post < 1) new_trigger_config.post = 1;
+		if (new_trigger_config.post > FILE_BURST_MAX_FRAMES) new_trigger_config.post = FILE_BURST_MAX_FRAMES;
+	}
+}
+
+
+/**
+ * Called by a command handler prior to sending FILE_NOTIFY_REPLAY_MASK
+ */
+void file_set_replay_info(char* dir_name)
+{
+	strncpy(new_replay_dir, dir_name, DIR_NAME_LEN - 1);
+	new_replay_dir[DIR_NAME_LEN - 1] = '\0';
+}
+
+
+/**
+ * Set the rate replay frames are passed to t1c_task.  Takes effect with the next frame.
+ */
+void file_set_replay_rate(int fps)
+{
+	if ((fps >= 0) && (fps <= CMD_REPLAY_MAX_FPS)) {
+		replay_rate = fps;
+	}
+}
+
+
+int file_get_replay_rate()
+{
+	return replay_rate;
+}
+
+
+/**
+ * Encode a T1C_WIDTH x T1C_HEIGHT RGBA image (rendered by file_render_t1c_data) to jpeg
+ * for another task, passing the jpeg data to func.  Quality is 1 - 3 (see tiny_jpeg.h).
+ * Images encoded this way don't carry the comments added to saved images.  Blocks while
+ * an image is being saved.
+ */
+bool file_encode_jpeg(uint32_t* rgb, int quality, file_jpeg_write_func* func, void* context)
+{
+	int ret;
+	
+	if (jpeg_enc_mutex == NULL) {
+		// file_task isn't running yet
+		return false;
+	}
+	
+	xSemaphoreTake(jpeg_enc_mutex, portMAX_DELAY);
+	tje_register_comment_callback(NULL);
+	tje_register_app_callback(0, NULL);
+	tje_register_strip_callback(NULL, 0);
+	tje_set_chroma_subsampling(0);
+	ret = tje_encode_with_func(func, context, quality, T1C_WIDTH, T1C_HEIGHT, 4, (unsigned char*) rgb);
+	xSemaphoreGive(jpeg_enc_mutex);
+	
+	return (ret == 1);
+}
+
+
 
 //
 // File Task internal functions
@@ -315,6 +1010,10 @@ static void _setup_notifications()
 		task_file_act_failed_notification = 0;
 		task_file_catalog_ready_notification = 0;
 		task_file_image_ready_notification = 0;
+		task_file_jpeg_ready_notification = 0;
+		task_file_page_ready_notification = 0;
+		task_file_range_ready_notification = 0;
+		task_file_thumb_ready_notification = 0;
 		task_file_timelapse_start_notification = VID_NOTIFY_FILE_TIMELAPSE_ON_MASK;
 		task_file_timelapse_stop_notification = VID_NOTIFY_FILE_TIMELAPSE_OFF_MASK;
 	} else {
@@ -325,6 +1024,10 @@ static void _setup_notifications()
 		task_file_act_failed_notification = WEB_NOTIFY_CTRL_ACT_FAILED_MASK;
 		task_file_catalog_ready_notification = WEB_NOTIFY_FILE_CATALOG_READY_MASK;
 		task_file_image_ready_notification = WEB_NOTIFY_FILE_IMAGE_READY_MASK;
+		task_file_jpeg_ready_notification = WEB_NOTIFY_FILE_JPEG_READY_MASK;
+		task_file_page_ready_notification = WEB_NOTIFY_FILE_PAGE_READY_MASK;
+		task_file_range_ready_notification = WEB_NOTIFY_FILE_RANGE_READY_MASK;
+		task_file_thumb_ready_notification = WEB_NOTIFY_FILE_THUMB_READY_MASK;
 		task_file_timelapse_start_notification = WEB_NOTIFY_FILE_TIMELAPSE_ON_MASK;
 		task_file_timelapse_stop_notification = WEB_NOTIFY_FILE_TIMELAPSE_OFF_MASK;
 	}
@@ -336,6 +1039,10 @@ static void _setup_notifications()
 	task_file_act_failed_notification = GUI_NOTIFY_CTRL_ACT_FAILED_MASK;
 	task_file_catalog_ready_notification = GUI_NOTIFY_FILE_CATALOG_READY_MASK;
 	task_file_image_ready_notification = GUI_NOTIFY_FILE_IMAGE_READY_MASK;
+	task_file_jpeg_ready_notification = 0;
+	task_file_page_ready_notification = 0;
+	task_file_range_ready_notification = 0;
+	task_file_thumb_ready_notification = GUI_NOTIFY_FILE_THUMB_READY_MASK;
 	task_file_timelapse_start_notification = GUI_NOTIFY_FILE_TIMELAPSE_ON_MASK;
 	task_file_timelapse_stop_notification = GUI_NOTIFY_FILE_TIMELAPSE_OFF_MASK;
 #endif
@@ -343,35 +1050,134 @@ static void _setup_notifications()
 
 
 /**
- * Process notifications from other tasks
+ * Get how long the main loop can block waiting for a notification: until the earliest
+ * deadline of the card check, card session idle timeout, movie frame, triggered recording
+ * end or timelapse FFC hold.  Pending burst frames are saved without waiting and replay,
+ * which has no notification for t1c_task taking a frame, is polled.
+ */
+static TickType_t _get_eval_wait()
+{
+	int64_t cur_usec = esp_timer_get_time();
+	int64_t next_usec = card_check_usec;
+	
+	if ((burst_running && (burst_save_index >= 0)) || (del_queue_count != 0)) {
+		return 0;
+	}
+	
+	if (replay_running) {
+		return pdMS_TO_TICKS(FILE_TASK_EVAL_FAST_MSEC);
+	}
+	
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+	if (timelapse_sleep_pending) {
+		// Waiting for the writer before sleeping
+		return pdMS_TO_TICKS(FILE_TASK_EVAL_FAST_MSEC);
+	}
+#endif
+	
+	if (card_session_mounted && ((card_session_usec + FILE_SESSION_IDLE_MSEC * 1000) < next_usec)) {
+		next_usec = card_session_usec + FILE_SESSION_IDLE_MSEC * 1000;
+	}
+	
+	if (record_running) {
+		if (!record_frame_requested && (record_trig_usec < next_usec)) {
+			next_usec = record_trig_usec;
+		}
+		if (trigger_record && (trigger_record_end_usec < next_usec)) {
+			next_usec = trigger_record_end_usec;
+		}
+	}
+	
+	if (log_running && !log_frame_requested && (log_trig_usec < next_usec)) {
+		next_usec = log_trig_usec;
+	}
+	
+	if (timelapse_running && !timelapse_ffc_hold) {
+		if ((timelapse_trig_usec - FILE_TL_FFC_LEAD_MSEC * 1000) < next_usec) {
+			next_usec = timelapse_trig_usec - FILE_TL_FFC_LEAD_MSEC * 1000;
+		}
+	}
+	
+	if (prefetch_pending && (prefetch_usec < next_usec)) {
+		next_usec = prefetch_usec;
+	}
+	
+	if (next_usec <= cur_usec) {
+		// A deadline that has passed is waiting on something else (e.g. the card is busy)
+		return pdMS_TO_TICKS(FILE_TASK_EVAL_FAST_MSEC);
+	}
+	
+	return pdMS_TO_TICKS((next_usec - cur_usec) / 1000 + 1);
+}
+
+
+/**
+ * Process notifications from other tasks, waiting up to wait ticks for one
  */
-static void _handle_notifications()
+static void _handle_notifications(TickType_t wait)
 {
 	uint32_t notification_value;
 	
 	notification_value = 0;
-	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, 0)) {
+	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, wait)) {
 		if (Notification(notification_value, FILE_NOTIFY_CARD_PRESENT_MASK)) {
 			card_present = true;
 		}
 		if (Notification(notification_value, FILE_NOTIFY_CARD_REMOVED_MASK)) {
 			card_present = false;
+			_end_card_session();
 		}
 		
-		if (Notification(notification_value, FILE_NOTIFY_SAVE_JPG_MASK)) {
-			if (timelapse_running) {
-				// Receiving this while a timelapse series is in progress ends the timelapse
-				_set_timelapse(false);
-			} else {
-				if (new_timelapse_config.timelapse_en) {
+		if (Notification(notification_value, FILE_NOTIFY_RECORD_MASK)) {
+			_set_record(new_record_fps != 0);
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_LOG_MASK)) {
+			_set_log(new_log_rate != 0);
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_TRIGGER_MASK)) {
+			_set_trigger();
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_T1C_STATS_MASK)) {
+			notify_stats = true;
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_PRE_TRIGGER_MASK)) {
+			pre_trigger_num = new_pre_trigger_num;
+			ESP_LOGI(TAG, "Pre-trigger frames: %d", pre_trigger_num);
+			_update_trigger_ring();
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_REPLAY_MASK)) {
+			_start_replay();
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_SAVE_JPG_MASK)) {
+			if (record_running) {
+				// Receiving this while recording ends the recording
+				_set_record(false);
+			} else if (log_running) {
+				// As does receiving it while logging
+				_set_log(false);
+			} else if (timelapse_running) {
+				// Receiving this while a timelapse series is in progress ends the timelapse
+				_set_timelapse(false);
+			} else {
+				if (new_timelapse_config.timelapse_en) {
 					// Start timelapse
 					_set_timelapse(true);
 					
 					// Clear timelapse request
 					new_timelapse_config.timelapse_en = false;
+				} else if ((pre_trigger_num != 0) && !burst_running) {
+					// Picture with the frames before it from the pre-trigger ring
+					new_burst_num = 1;
+					_start_burst(pre_trigger_num);
 				} else {
-					// Single picture: Ask t1c_task for an image
-					xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_IMAGE_MASK, eSetBits);
+					// Single picture: Ask t1c_task for an image (averaged if configured)
+					xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_AVG_MASK, eSetBits);
 					save_image_requested = true;
 				}
 			}
@@ -381,19 +1187,62 @@ static void _handle_notifications()
 			notify_image = true;
 		}
 		
-		// note: we process deletions before get catalog for the case we're getting
-		// a catalog after issuing a deletion command
-		if (Notification(notification_value, FILE_NOTIFY_GUI_DEL_DIR_MASK)) {
-			(void) _delete_dir(del_dir);
+		if (Notification(notification_value, FILE_NOTIFY_BURST_MASK)) {
+			_start_burst(0);
 		}
 		
-		if (Notification(notification_value, FILE_NOTIFY_GUI_DEL_FILE_MASK)) {
-			(void) _delete_file(del_dir, del_file);
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+		if (Notification(notification_value, FILE_NOTIFY_SYNC_MASK)) {
+			_start_sync_capture();
 		}
-
+#endif
+		
+		if (Notification(notification_value, FILE_NOTIFY_T1C_BURST_MASK)) {
+			// All frames captured, start saving them
+			burst_first = t1c_get_burst_frames(&burst_num);
+			burst_save_index = 0;
+			t1c_set_ffc_hold(T1C_FFC_HOLD_BURST, false);
+		}
+		
+		// note: FILE_NOTIFY_GUI_DELETE_MASK only wakes us to process the delete queue.
+		// Catalog requests made while it is being processed (e.g. to refresh the catalog
+		// after issuing a deletion command) are answered once it is done.
 		if (Notification(notification_value, FILE_NOTIFY_GUI_GET_CATALOG_MASK)) {
-			num_catalog_names = file_get_name_list(catalog_type, catalog_names_buffer);
-			xTaskNotify(output_task, task_file_catalog_ready_notification, eSetBits);
+			if (del_queue_count != 0) {
+				del_catalog_held = true;
+			} else {
+				num_catalog_names = file_get_name_list(catalog_type, catalog_names_buffer);
+				xTaskNotify(output_task, task_file_catalog_ready_notification, eSetBits);
+			}
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_GUI_GET_PAGE_MASK)) {
+			if (del_queue_count != 0) {
+				del_page_held = true;
+			} else {
+				catalog_page_count = file_get_catalog_page(catalog_page_type, catalog_page_offset, catalog_page_count,
+				                                           catalog_page_entries, &catalog_page_total);
+				xTaskNotify(output_task, task_file_page_ready_notification, eSetBits);
+			}
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_GUI_GET_RANGE_MASK)) {
+			if (del_queue_count != 0) {
+				del_range_held = true;
+			} else {
+				catalog_range_count = file_get_catalog_range(catalog_range_start, catalog_range_end, catalog_range_offset,
+				                                             FILE_MAX_CATALOG_RANGE, catalog_range_entries, &catalog_range_total);
+				xTaskNotify(output_task, task_file_range_ready_notification, eSetBits);
+			}
+		}
+		
+		// note: the thumbnail is processed first so it can be displayed while the image
+		// is decoded
+		if (Notification(notification_value, FILE_NOTIFY_GUI_GET_THUMB_MASK)) {
+			// Read the thumbnail for the previously set name
+			if (_read_jpeg_thumb()) {
+				xTaskNotify(output_task, task_file_thumb_ready_notification, eSetBits);
+			}
 		}
 		
 		if (Notification(notification_value, FILE_NOTIFY_GUI_GET_IMAGE_MASK)) {
@@ -403,6 +1252,13 @@ static void _handle_notifications()
 			}
 		}
 		
+		if (Notification(notification_value, FILE_NOTIFY_GUI_GET_JPEG_MASK)) {
+			// Read the file with previously set name without decompressing it
+			if (_read_jpeg_file()) {
+				xTaskNotify(output_task, task_file_jpeg_ready_notification, eSetBits);
+			}
+		}
+		
 		if (Notification(notification_value, FILE_NOTIFY_GUI_FORMAT_MASK)) {
 			if (_format_card()) {
 				xTaskNotify(output_task, task_file_act_succeeded_notification, eSetBits);
@@ -410,6 +1266,39 @@ static void _handle_notifications()
 				xTaskNotify(output_task, task_file_act_failed_notification, eSetBits);
 			}
 		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_T1C_FW_UPD_MASK)) {
+			// t1c_task reports the result once the update has started
+			if (!_update_t1c_fw()) {
+				xTaskNotify(output_task, task_file_act_failed_notification, eSetBits);
+			}
+		}
+		
+		if (Notification(notification_value, FILE_NOTIFY_BENCHMARK_MASK)) {
+#ifdef CONFIG_BUILD_ICAM_MINI
+			// The GUI renderers run in the browser so we finish the benchmark
+			if (_run_benchmark()) {
+				xTaskNotify(output_task, task_file_act_succeeded_notification, eSetBits);
+			} else {
+				xTaskNotify(output_task, task_file_act_failed_notification, eSetBits);
+			}
+			bench_finish();
+#else
+			// gui_task times its renderer and finishes the benchmark
+			if (_run_benchmark()) {
+				xTaskNotify(task_handle_gui, GUI_NOTIFY_FILE_BENCHMARK_MASK, eSetBits);
+			} else {
+				bench_finish();
+				xTaskNotify(output_task, task_file_act_failed_notification, eSetBits);
+			}
+#endif
+		}
+		
+#ifdef CONFIG_SCREENDUMP_ENABLE
+		if (Notification(notification_value, FILE_NOTIFY_SCREENSHOT_MASK)) {
+			_save_screenshot();
+		}
+#endif
 	}
 }
 
@@ -420,7 +1309,9 @@ static void _handle_notifications()
  */
 static void _update_card_present_info()
 {
-	if (--card_check_count == 0) {
+	int64_t cur_usec = esp_timer_get_time();
+	
+	if (cur_usec >= card_check_usec) {
 		if (card_present) {
 			if (!card_available) {
 				// Card has just shown up, see if we can initialize it
@@ -429,23 +1320,98 @@ static void _update_card_present_info()
 					
 					// Mount it briefly to force a format if necessary and create an initial
 					// filesystem information structure (catalog), then unmount it.
-					if (file_mount_sdcard()) {
+					if (_mount_card()) {
 						card_available = _catalog_filesystem();
-						file_unmount_sdcard();
+						_release_card(card_available);
 					}
 				}
 			}
 		} else {
 			if (card_available) {
 				// Card just removed, clear memory of it
+				_end_card_session();
 				file_delete_filesystem_info();  // Delete the filesystem information structure (catalog)
+				_clear_delete_queue();
+				_clear_cached_images();
 				ESP_LOGI(TAG, "SD Card removed");
 				card_available = false;
 			}
 		}
 		
 		// Reset timer
-		card_check_count = FILE_CARD_CHECK_PERIOD_MSEC / FILE_TASK_EVAL_NORM_MSEC;
+		card_check_usec = cur_usec + FILE_CARD_CHECK_PERIOD_MSEC * 1000;
+	}
+}
+
+
+/**
+ * Mount the card if it isn't already mounted from a previous access.  Back-to-back
+ * accesses (e.g. a fast timelapse) skip the mount and its card statistics scan.
+ */
+static bool _mount_card()
+{
+	xSemaphoreTake(card_mutex, portMAX_DELAY);
+	
+	if (!card_session_mounted) {
+		if (!file_mount_sdcard()) {
+			xSemaphoreGive(card_mutex);
+			return false;
+		}
+		card_session_mounted = true;
+	}
+	card_session_usec = esp_timer_get_time();
+	
+	return true;
+}
+
+
+/**
+ * Finish an access started with _mount_card.  The card is left mounted (all files are
+ * closed so everything written is on the card).  A failed access ends the session so
+ * the next access starts with a fresh mount.
+ */
+static void _release_card(bool success)
+{
+	if (success) {
+		card_session_usec = esp_timer_get_time();
+	} else {
+		_unmount_card_session();
+	}
+	
+	xSemaphoreGive(card_mutex);
+}
+
+
+static void _end_card_session()
+{
+	xSemaphoreTake(card_mutex, portMAX_DELAY);
+	_unmount_card_session();
+	xSemaphoreGive(card_mutex);
+}
+
+
+// Must be called holding card_mutex
+static void _unmount_card_session()
+{
+	if (card_session_mounted) {
+		file_unmount_sdcard();
+		card_session_mounted = false;
+	}
+}
+
+
+/**
+ * Unmount the card once it has been idle for a while (skipped if the card is in use)
+ */
+static void _eval_card_session()
+{
+	if (xSemaphoreTake(card_mutex, 0) == pdTRUE) {
+		if (card_session_mounted) {
+			if ((esp_timer_get_time() - card_session_usec) >= (FILE_SESSION_IDLE_MSEC * 1000)) {
+				_unmount_card_session();
+			}
+		}
+		xSemaphoreGive(card_mutex);
 	}
 }
 
@@ -461,6 +1427,7 @@ static bool _catalog_filesystem()
 	
 	if (file_create_filesystem_info()) {
 		kb_free = (uint32_t) (file_get_storage_free() / 1024);
+		system_boot_mark(SYS_BOOT_CATALOG);
 		ESP_LOGI(TAG, "Filesystem catalog created");
 		ESP_LOGI(TAG, "    %d files", file_get_num_files());
 		if (kb_free > (1024*1024)) {
@@ -480,29 +1447,43 @@ static bool _catalog_filesystem()
 
 
 /**
- * Evaluate the timelapse timer and logic to trigger image captures
- *   Assumes timelapse has been initiated
+ * Timelapse timer callback (runs in the esp_timer task).  Asks t1c_task for an image at
+ * each scheduled instant.  A slot is missed if the previous image hasn't been saved yet.
+ * The next instant is computed from the start of the series so the intervals don't drift.
  *   Assumes timelapse will be ended by processing of last image
  */
-static void _eval_timelapse()
+static void _timelapse_timer_cb(void* arg)
 {
-	int64_t cur_usec = esp_timer_get_time();
+	int64_t cur_usec;
+	int64_t interval_usec = (int64_t) cur_timelapse_config.timelapse_interval * 1000;
 	
-	if (cur_usec >= timelapse_trig_usec) {
-		// Update trigger timestampe for next time
-		timelapse_trig_usec += ((int64_t) cur_timelapse_config.timelapse_interval * 1000000);
-		
+	if (!timelapse_running || (timelapse_img_count >= cur_timelapse_config.timelapse_count)) {
+		return;
+	}
+	
+	if (save_image_requested) {
+		timelapse_missed_count += 1;
+	} else {
 		// Increment image count
 		timelapse_img_count += 1;
 		
-		// Ask t1c_task for an image
-		xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_IMAGE_MASK, eSetBits);
-		save_image_requested = true; 
+		// Ask t1c_task for an image (averaged if configured)
+		save_image_requested = true;
+		xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_AVG_MASK, eSetBits);
 	}
-}
-/*
 	
-*/
+	// Schedule the next slot, skipping (and counting) any that have already passed
+	cur_usec = esp_timer_get_time();
+	timelapse_trig_usec += interval_usec;
+	while (timelapse_trig_usec <= cur_usec) {
+		timelapse_trig_usec += interval_usec;
+		timelapse_missed_count += 1;
+	}
+	if (timelapse_img_count < cur_timelapse_config.timelapse_count) {
+		(void) esp_timer_start_once(timelapse_timer, timelapse_trig_usec - cur_usec);
+	}
+}
+
 
 /**
  * Start or stop timelapse picture taking
@@ -511,25 +1492,32 @@ static void _set_timelapse(bool en)
 {
 	if (en) {
 		if (!timelapse_running) {
-			ESP_LOGI(TAG, "Start Timelapse: %lu @ %lu seconds each", cur_timelapse_config.timelapse_count, cur_timelapse_config.timelapse_interval);
-			
 			// Setup the new configuration
 			cur_timelapse_config = new_timelapse_config;
-			timelapse_running = true;
+			ESP_LOGI(TAG, "Start Timelapse: %lu @ %lu mSec each", cur_timelapse_config.timelapse_count, cur_timelapse_config.timelapse_interval);
 			
-			// Reset our count
+			// Reset our counts
 			timelapse_img_count = 0;
+			timelapse_missed_count = 0;
+			timelapse_running = true;
 			
-			// Setup the first image trigger timestamp (one second from now)
+			// Setup the first image trigger (one second from now)
+			(void) esp_timer_stop(timelapse_timer);
 			timelapse_trig_usec = esp_timer_get_time() + 1000000;
+			(void) esp_timer_start_once(timelapse_timer, 1000000);
 			
 			// Inform the output task that we're starting timelapse operation
 			xTaskNotify(output_task, task_file_timelapse_start_notification, eSetBits);
 		}
 	} else {
 		if (timelapse_running) {
-			ESP_LOGI(TAG, "Stop Timelapse");
+			ESP_LOGI(TAG, "Stop Timelapse (%lu missed)", timelapse_missed_count);
 			timelapse_running = false;
+			(void) esp_timer_stop(timelapse_timer);
+			_end_timelapse_ffc();
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+			timelapse_sleep_pending = false;
+#endif
 			
 			// Inform the output task that we're stopping timelapse operation
 			xTaskNotify(output_task, task_file_timelapse_stop_notification, eSetBits);
@@ -539,36 +1527,1815 @@ static void _set_timelapse(bool en)
 
 
 /**
- * Delete a directory.  Update the catalog.
+ * Hold automatic FFC off (and possibly request an FFC) when the next timelapse picture
+ * is close so a shutter event doesn't freeze it
+ */
+static void _eval_timelapse_ffc()
+{
+	if (timelapse_ffc_hold || ((timelapse_trig_usec - esp_timer_get_time()) > (FILE_TL_FFC_LEAD_MSEC * 1000))) {
+		return;
+	}
+	
+	timelapse_ffc_hold = true;
+	t1c_set_ffc_hold(T1C_FFC_HOLD_TIMELAPSE, true);
+	if (cur_timelapse_config.timelapse_interval >= FILE_TL_FFC_MIN_MSEC) {
+		xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_PRE_FFC_MASK, eSetBits);
+	}
+}
+
+
+static void _end_timelapse_ffc()
+{
+	if (timelapse_ffc_hold) {
+		timelapse_ffc_hold = false;
+		t1c_set_ffc_hold(T1C_FFC_HOLD_TIMELAPSE, false);
+	}
+}
+
+
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+/**
+ * Pick up a timelapse series from the state saved before sleeping.  We were woken
+ * CONFIG_TIMELAPSE_SLEEP_WAKE_SEC early so the Tiny1C is warmed up (and the usual
+ * FFC taken) by the time the next picture is due.
+ */
+static void _resume_timelapse()
+{
+	int64_t wait_usec;
+	struct timeval tv;
+	
+	(void) gettimeofday(&tv, NULL);
+	wait_usec = timelapse_sleep_state.trig_usec - ((int64_t) tv.tv_sec * 1000000 + tv.tv_usec);
+	if (wait_usec < 1000) {
+		// Late (the timer callback counts any slots we missed)
+		wait_usec = 1000;
+	}
+	
+	cur_timelapse_config = timelapse_sleep_state.config;
+	timelapse_img_count = timelapse_sleep_state.img_count;
+	timelapse_missed_count = timelapse_sleep_state.missed_count;
+	timelapse_running = true;
+	timelapse_woke = true;
+	ESP_LOGI(TAG, "Resume Timelapse: %lu of %lu in %lld mSec", timelapse_img_count + 1, cur_timelapse_config.timelapse_count, wait_usec / 1000);
+	
+	timelapse_trig_usec = esp_timer_get_time() + wait_usec;
+	(void) esp_timer_start_once(timelapse_timer, wait_usec);
+	
+	xTaskNotify(output_task, task_file_timelapse_start_notification, eSetBits);
+}
+
+
+/**
+ * Once the last timelapse picture has been written to the card, ask ctrl_task to deep
+ * sleep until shortly before the next one (or power off after a series we've been sleeping
+ * through ends).  We stay awake if the next picture is too close.
+ */
+static void _eval_timelapse_sleep()
+{
+	int64_t sleep_usec;
+	struct timeval tv;
+	
+	for (int i=0; i<FILE_JPEG_NUM_SLOTS; i++) {
+		if (jpeg_slots[i].full) return;
+	}
+	timelapse_sleep_pending = false;
+	
+	if (!timelapse_running) {
+		ESP_LOGI(TAG, "Timelapse done - power off");
+		_end_card_session();
+		xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_SHUTDOWN, eSetBits);
+		return;
+	}
+	
+	sleep_usec = timelapse_trig_usec - esp_timer_get_time() - ((int64_t) CONFIG_TIMELAPSE_SLEEP_WAKE_SEC * 1000000);
+	if (save_image_requested || timelapse_ffc_hold || (sleep_usec < (FILE_TL_SLEEP_MIN_MSEC * 1000))) {
+		return;
+	}
+	
+	(void) esp_timer_stop(timelapse_timer);
+	_end_card_session();
+	
+	(void) gettimeofday(&tv, NULL);
+	timelapse_sleep_state.config = cur_timelapse_config;
+	timelapse_sleep_state.img_count = timelapse_img_count;
+	timelapse_sleep_state.missed_count = timelapse_missed_count;
+	timelapse_sleep_state.trig_usec = (int64_t) tv.tv_sec * 1000000 + tv.tv_usec + (timelapse_trig_usec - esp_timer_get_time());
+	timelapse_sleep_state.magic = FILE_TL_SLEEP_MAGIC;
+	
+	ctrl_set_sleep_msec((uint32_t) (sleep_usec / 1000));
+	xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_SLEEP, eSetBits);
+}
+#endif
+
+
+/**
+ * Start capturing a burst of new_burst_num frames into file_burst_buffer, preceded by up
+ * to pre frames from the pre-trigger ring.  Only one burst may be captured or saved at a
+ * time and bursts aren't taken during a timelapse series.
+ */
+static void _start_burst(int pre)
+{
+	if (burst_running || timelapse_running || record_running || log_running) {
+		ESP_LOGI(TAG, "Ignoring burst request");
+		return;
+	}
+	
+	if (!card_available) {
+		_display_save_error("No SD Card");
+		return;
+	}
+	
+	ESP_LOGI(TAG, "Start Burst: %d frames (%d pre-trigger)", new_burst_num, pre);
+	burst_running = true;
+	burst_num = new_burst_num;
+	burst_save_index = -1;
+	t1c_set_ffc_hold(T1C_FFC_HOLD_BURST, true);
+	t1c_start_burst(burst_num, pre);
+}
+
+
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+/**
+ * Save the frame acquired closest to the synchronized capture time.  t1c_task picks it from
+ * the pre-trigger ring and it is saved as a one frame burst.
+ */
+static void _start_sync_capture()
+{
+	if (burst_running || timelapse_running || record_running || log_running) {
+		ESP_LOGI(TAG, "Ignoring sync capture request");
+		return;
+	}
+	
+	if (!card_available) {
+		_display_save_error("No SD Card");
+		return;
+	}
+	
+	ESP_LOGI(TAG, "Start Sync Capture: %d mSec from now", (int) ((new_sync_usec - esp_timer_get_time()) / 1000));
+	burst_running = true;
+	burst_num = 1;
+	burst_save_index = -1;
+	t1c_set_ffc_hold(T1C_FFC_HOLD_BURST, true);
+	t1c_start_sync_capture(new_sync_usec);
+}
+#endif
+
+
+/**
+ * Scale the next captured burst frame and hand it to the save pipeline.  The frames are
+ * scaled linearly over the AGC range t1c_task was using when each was captured.
+ */
+static void _save_burst_frame()
+{
+	t1c_agc_linear_t agc;
+	t1c_buffer_t* t1cP = &file_burst_buffer[(burst_first + burst_save_index) % FILE_BURST_MAX_FRAMES];
+	bool success;
+	
+	t1c_agc_setup_linear(&agc, t1cP->agc_min, t1cP->agc_max, true, false);
+	t1c_agc_scale_linear(&agc, t1cP->img_data, t1cP->y8_data, T1C_WIDTH*T1C_HEIGHT);
+	
+	enc_burst_index = burst_save_index;
+	success = _save_image(t1cP);
+	enc_burst_index = -1;
+	
+	// Give up on the rest of the burst after a failure (each would fail the same way)
+	if (!success || (++burst_save_index == burst_num)) {
+		ESP_LOGI(TAG, "End Burst");
+		burst_running = false;
+		burst_save_index = -1;
+		_update_trigger_ring();
+	}
+}
+
+
+/**
+ * Evaluate the movie frame timer to request frames at the recording rate.  Frames the
+ * encoder was too slow to take are skipped.
+ */
+static void _eval_record()
+{
+	int64_t cur_usec;
+	
+	if (movie_write_failed) {
+		// Give up after the writer fails (each following frame would fail the same way)
+		_set_record(false);
+		return;
+	}
+	
+	cur_usec = esp_timer_get_time();
+	if (trigger_record && (cur_usec >= trigger_record_end_usec)) {
+		_set_record(false);
+		return;
+	}
+	
+	if (!record_frame_requested && (cur_usec >= record_trig_usec)) {
+		record_trig_usec += record_interval_usec;
+		if (record_trig_usec < cur_usec) {
+			record_trig_usec = cur_usec + record_interval_usec;
+		}
+		
+		// Ask t1c_task for an image
+		xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_IMAGE_MASK, eSetBits);
+		record_frame_requested = true;
+	}
+}
+
+
+/**
+ * Start recording a movie at new_record_fps or stop recording.  Movies aren't recorded
+ * during a burst or timelapse series.  The writer task opens the movie file with the first
+ * frame and closes it when it gets the empty slot queued here at the end.
+ */
+static void _set_record(bool en)
+{
+	jpeg_slot_t* slotP;
+	
+	if (en) {
+		if (record_running) {
+			// Just change the rate
+			record_interval_usec = 1000000 / new_record_fps;
+			return;
+		}
+		
+		if (burst_running || timelapse_running || log_running) {
+			ESP_LOGI(TAG, "Ignoring record request");
+			return;
+		}
+		
+		if (!card_available) {
+			_display_save_error("No SD Card");
+			return;
+		}
+		
+		ESP_LOGI(TAG, "Start Recording: %d fps", new_record_fps);
+		record_running = true;
+		record_frame_requested = false;
+		record_num_frames = 0;
+		record_interval_usec = 1000000 / new_record_fps;
+		record_trig_usec = esp_timer_get_time();
+		movie_write_failed = false;
+		t1c_set_ffc_hold(T1C_FFC_HOLD_RECORD, true);
+	} else {
+		if (record_running) {
+			ESP_LOGI(TAG, "Stop Recording: %lu frames", record_num_frames);
+			record_running = false;
+			record_frame_requested = false;
+			trigger_record = false;
+			t1c_set_ffc_hold(T1C_FFC_HOLD_RECORD, false);
+			
+			slotP = _get_free_slot();
+			slotP->len = 0;
+			slotP->thumb_len = 0;
+			slotP->overflow = false;
+			slotP->is_raw = false;
+			slotP->is_sibling = false;
+			slotP->is_movie = true;
+			slotP->is_log = false;
+			_queue_slot(slotP);
+		}
+	}
+}
+
+
+/**
+ * Encode the frame from t1c_task into the save pipeline as the next movie frame.  Frames
+ * are radiometric jpeg images when that is the save format.
+ */
+static void _save_record_frame()
+{
+	bool success;
+	
+	if (record_num_frames == 0) {
+		record_start_usec = file_t1c_buffer.frame_usec;
+	}
+	
+	enc_movie = true;
+	success = _encode_image_to_jpeg(&file_t1c_buffer, out_state.save_format == CMD_SAVE_FMT_RJPEG);
+	enc_movie = false;
+	
+	if (success) {
+		record_num_frames += 1;
+	} else {
+		_set_record(false);
+	}
+}
+
+
+/**
+ * Evaluate the data log timer to request frames at the logging rate
+ */
+static void _eval_log()
+{
+	int64_t cur_usec;
+	
+	if (log_write_failed) {
+		// Give up after the writer fails
+		_set_log(false);
+		return;
+	}
+	
+	cur_usec = esp_timer_get_time();
+	if (!log_frame_requested && (cur_usec >= log_trig_usec)) {
+		log_trig_usec += log_interval_usec;
+		if (log_trig_usec < cur_usec) {
+			log_trig_usec = cur_usec + log_interval_usec;
+		}
+		
+		// Ask t1c_task for an image
+		xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_IMAGE_MASK, eSetBits);
+		log_frame_requested = true;
+	}
+}
+
+
+/**
+ * Start logging the temperature measurements at new_log_rate records/sec or stop logging.
+ * Records are collected in a slot that is handed to the writer task each time it fills
+ * so the card is only written (and powered up) every FILE_LOG_FLUSH_LEN bytes.  Like a
+ * movie the writer opens the log file with the first slot and closes it when it gets the
+ * empty slot queued here at the end.  Since that keeps the write file open, logging is
+ * exclusive with movies, bursts and timelapse series.  FFCs aren't held off during a log
+ * (it may run for hours).  Frozen frames are flagged in their records instead.
+ */
+static void _set_log(bool en)
+{
+	jpeg_slot_t* slotP;
+	
+	if (en) {
+		if (log_running) {
+			// Just change the rate (the records are timestamped)
+			log_interval_usec = 1000000 / new_log_rate;
+			return;
+		}
+		
+		if (burst_running || timelapse_running || record_running) {
+			ESP_LOGI(TAG, "Ignoring log request");
+			return;
+		}
+		
+		if (!card_available) {
+			_display_save_error("No SD Card");
+			return;
+		}
+		
+		ESP_LOGI(TAG, "Start Logging: %d records/sec", new_log_rate);
+		log_running = true;
+		log_frame_requested = false;
+		log_num_records = 0;
+		log_rate = new_log_rate;
+		log_interval_usec = 1000000 / new_log_rate;
+		log_trig_usec = esp_timer_get_time();
+		log_slotP = NULL;
+		log_write_failed = false;
+	} else {
+		if (log_running) {
+			ESP_LOGI(TAG, "Stop Logging: %lu records", log_num_records);
+			log_running = false;
+			log_frame_requested = false;
+			
+			// Write the partially filled slot and then close the file
+			if (log_slotP != NULL) {
+				_queue_slot(log_slotP);
+				log_slotP = NULL;
+			}
+			slotP = _get_log_slot();
+			_queue_slot(slotP);
+		}
+	}
+}
+
+
+/**
+ * Add a record for the frame from t1c_task to the data log, starting the log with its
+ * header.  The slot is written when another record won't fit.
+ */
+static void _save_log_record()
+{
+	tmElements_t te;
+	
+	if (log_slotP == NULL) {
+		log_slotP = _get_log_slot();
+	}
+	
+	if (log_num_records == 0) {
+		log_start_usec = file_t1c_buffer.frame_usec;
+		time_get(&te);
+		log_slotP->len += file_log_encode_header(&te, log_rate, log_slotP->bufP + log_slotP->len);
+	}
+	
+	log_slotP->len += file_log_encode_record(&file_t1c_buffer, log_start_usec, log_slotP->bufP + log_slotP->len);
+	log_num_records += 1;
+	
+	if ((log_slotP->len + FILE_LOG_REC_LEN) > FILE_LOG_FLUSH_LEN) {
+		_queue_slot(log_slotP);
+		log_slotP = NULL;
+	}
+}
+
+
+/**
+ * Return the next slot, empty and set up for data log records
+ */
+static jpeg_slot_t* _get_log_slot()
+{
+	jpeg_slot_t* slotP = _get_free_slot();
+	
+	slotP->len = 0;
+	slotP->thumb_len = 0;
+	slotP->overflow = false;
+	slotP->is_raw = false;
+	slotP->is_sibling = false;
+	slotP->is_movie = false;
+	slotP->is_log = true;
+	
+	return slotP;
+}
+
+
+/**
+ * Arm the event trigger with new_trigger_config or disarm it.  t1c_task computes the
+ * scene statistics for each frame while the trigger is armed.
+ */
+static void _set_trigger()
+{
+	cur_trigger_config = new_trigger_config;
+	trigger_armed = (cur_trigger_config.mode != CMD_TRIG_OFF);
+	trigger_ref_valid = false;
+	trigger_holdoff_usec = 0;
+	
+	if (trigger_armed) {
+		ESP_LOGI(TAG, "Arm Trigger: mode %d, action %d, threshold %lu", cur_trigger_config.mode,
+		         cur_trigger_config.action, cur_trigger_config.threshold);
+		trigger_count = 0;
+	} else {
+		ESP_LOGI(TAG, "Disarm Trigger: %lu triggers", trigger_count);
+	}
+	
+	t1c_set_scene_stats_enable(trigger_armed);
+	_update_trigger_ring();
+}
+
+
+/**
+ * Keep pre-trigger frames in file_burst_buffer while pictures, synchronized captures or a
+ * trigger armed for a burst use them (except while a burst is held there to be saved).  The frames are saved
+ * directly from the ring.
+ */
+static void _update_trigger_ring()
+{
+	bool trig_pre = trigger_armed && (cur_trigger_config.action == CMD_TRIG_ACT_BURST) &&
+	                (cur_trigger_config.pre_frames != 0);
+	bool ring_en = trig_pre || (pre_trigger_num != 0);
+	
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+	// Synchronized captures are always armed
+	ring_en = true;
+#endif
+	
+	t1c_set_burst_ring_enable(ring_en && !burst_running);
+}
+
+
+/**
+ * Evaluate the trigger condition against the latest scene statistics from t1c_task and
+ * start the trigger action when it is met.  Conditions met while another capture is in
+ * progress or during the holdoff period are ignored.
+ */
+static void _eval_trigger()
+{
+	bool fire = false;
+	int64_t dt;
+	t1c_scene_stats_t stats;
+	
+	t1c_get_scene_stats(&stats);
+	
+	switch (cur_trigger_config.mode) {
+		case CMD_TRIG_TEMP_ABOVE:
+			fire = stats.temp_valid && (stats.max_temp >= cur_trigger_config.threshold);
+			break;
+		
+		case CMD_TRIG_TEMP_RISE:
+			if (!stats.temp_valid) {
+				trigger_ref_valid = false;
+			} else if (!trigger_ref_valid) {
+				trigger_ref_valid = true;
+				trigger_ref_temp = stats.max_temp;
+				trigger_ref_usec = stats.frame_usec;
+			} else {
+				dt = stats.frame_usec - trigger_ref_usec;
+				if (dt >= (FILE_TRIGGER_RISE_MSEC * 1000)) {
+					// Rate in 1/16 °K per second
+					fire = (((int64_t) stats.max_temp - trigger_ref_temp) * 1000000) >= ((int64_t) cur_trigger_config.threshold * dt);
+					trigger_ref_temp = stats.max_temp;
+					trigger_ref_usec = stats.frame_usec;
+				}
+			}
+			break;
+		
+		case CMD_TRIG_MOTION:
+			fire = stats.motion >= cur_trigger_config.threshold;
+			break;
+	}
+	
+	if (!fire || burst_running || record_running || log_running || timelapse_running || save_image_requested) {
+		return;
+	}
+	if (stats.frame_usec < trigger_holdoff_usec) {
+		return;
+	}
+	trigger_holdoff_usec = stats.frame_usec + (int64_t) cur_trigger_config.holdoff_msec * 1000;
+	trigger_count += 1;
+	ESP_LOGI(TAG, "Trigger %lu (frame %lu)", trigger_count, stats.frame_seq);
+	
+	switch (cur_trigger_config.action) {
+		case CMD_TRIG_ACT_PICTURE:
+			// Ask t1c_task for an image (averaged if configured)
+			xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_GET_AVG_MASK, eSetBits);
+			save_image_requested = true;
+			break;
+		
+		case CMD_TRIG_ACT_BURST:
+			new_burst_num = (int) cur_trigger_config.post;
+			_start_burst(cur_trigger_config.pre_frames);
+			break;
+		
+		case CMD_TRIG_ACT_RECORD:
+			new_record_fps = cur_trigger_config.record_fps;
+			_set_record(true);
+			if (record_running) {
+				trigger_record = true;
+				trigger_record_end_usec = esp_timer_get_time() + (int64_t) cur_trigger_config.post * 1000;
+			}
+			break;
+	}
+}
+
+
+/**
+ * Start replaying the raw images in the new_replay_dir directory into t1c_task in place
+ * of the Tiny1C image data.  Replay ends when t1c_task is switched to another source.
+ */
+static void _start_replay()
+{
+	if (!card_available) {
+		ESP_LOGE(TAG, "No SD Card to replay from");
+		return;
+	}
+	
+	replay_dir_index = file_get_named_directory_index(new_replay_dir);
+	if (replay_dir_index < 0) {
+		ESP_LOGE(TAG, "Replay directory %s not found", new_replay_dir);
+		return;
+	}
+	
+	ESP_LOGI(TAG, "Start Replay: %s", new_replay_dir);
+	replay_running = true;
+	replay_file_index = 0;
+	replay_num_frames = 0;
+	replay_frame_ready = false;
+	replay_next_usec = esp_timer_get_time();
+	t1c_set_replay_source(T1C_REPLAY_FILE);
+}
+
+
+/**
+ * Load the next replay frame as soon as t1c_task has taken the previous one so it is read
+ * and decoded while the previous one is displayed, then pass it on when it is due
+ */
+static void _eval_replay()
+{
+	int64_t cur_usec;
+	uint16_t* bufP;
+	
+	if ((t1c_get_replay_source() != T1C_REPLAY_FILE) || !card_available) {
+		ESP_LOGI(TAG, "Stop Replay: %lu frames", replay_num_frames);
+		replay_running = false;
+		if (t1c_get_replay_source() == T1C_REPLAY_FILE) {
+			t1c_set_replay_source(T1C_REPLAY_OFF);
+		}
+		return;
+	}
+	
+	bufP = t1c_get_replay_buffer();
+	if (bufP == NULL) return;
+	
+	if (!replay_frame_ready) {
+		if (_load_replay_frame(bufP, &replay_high_gain)) {
+			replay_frame_ready = true;
+		} else {
+			// Stopped by the next evaluation
+			ESP_LOGE(TAG, "Nothing to replay in %s", new_replay_dir);
+			t1c_set_replay_source(T1C_REPLAY_OFF);
+			return;
+		}
+	}
+	
+	cur_usec = esp_timer_get_time();
+	if ((replay_rate == 0) || (cur_usec >= replay_next_usec)) {
+		t1c_set_replay_frame_loaded(replay_high_gain);
+		replay_frame_ready = false;
+		replay_num_frames += 1;
+		
+		if (replay_rate != 0) {
+			// Don't try to catch up after a slow card read
+			replay_next_usec += 1000000 / replay_rate;
+			if (replay_next_usec < cur_usec) {
+				replay_next_usec = cur_usec;
+			}
+		}
+	}
+}
+
+
+/**
+ * Load the next raw image in the replay directory into bufP.  Jpeg images are replayed
+ * from the raw file saved with them when there is one, otherwise from the raw data in a
+ * radiometric jpeg.  Movies and jpeg images without raw data are skipped.  Wraps around
+ * to the first file at the end of the directory.  Returns false if there is nothing to
+ * replay.
+ */
+static bool _load_replay_frame(uint16_t* bufP, bool* high_gain)
+{
+	bool rjpeg;
+	bool success = false;
+	char dir_name[DIR_NAME_LEN];
+	char file_name[FILE_NAME_LEN];
+	char name[DIR_NAME_LEN + FILE_NAME_LEN];
+	int n;
+	int tries = 0;
+	
+	if (!file_get_directory_name(replay_dir_index, dir_name)) return false;
+	
+	if (!_mount_card()) return false;
+	
+	while (!success && (tries++ <= MAX_FILES_PER_DIR)) {
+		if (!file_get_file_name(replay_dir_index, replay_file_index, file_name)) {
+			if (replay_file_index == 0) break;  // Empty directory
+			replay_file_index = 0;
+			continue;
+		}
+		replay_file_index += 1;
+		
+		n = strlen(file_name);
+		rjpeg = false;
+		if (strcmp(&file_name[n - 4], ".JPG") == 0) {
+			strcpy(&file_name[n - 4], FILE_RAW_EXT);
+			sprintf(name, "%s/%s", dir_name, file_name);
+			if (!file_image_file_exists(name)) {
+				strcpy(&file_name[n - 4], ".JPG");
+				sprintf(name, "%s/%s", dir_name, file_name);
+				rjpeg = true;
+			}
+		} else if (strcmp(&file_name[n - 4], FILE_RAW_EXT) == 0) {
+			sprintf(name, "%s/%s", dir_name, file_name);
+		} else {
+			continue;
+		}
+		
+		success = _read_replay_file(name, bufP, high_gain, rjpeg);
+	}
+	
+	_release_card(true);
+	
+	return success;
+}
+
+
+/**
+ * Read the image in the raw file name (relative to DCIM), or the raw data in the radiometric
+ * jpeg file name, into bufP.  Encoded image data is read in pieces through the tjpgd work
+ * buffer.  The card must be mounted.
+ */
+static bool _read_replay_file(char* name, uint16_t* bufP, bool* high_gain, bool rjpeg)
+{
+	bool success = false;
+	FILE* fd;
+	uint8_t* rdP = tjpgd_work_buf;
+	uint8_t enc, flags;
+	uint16_t hdr_len;
+	uint32_t len, n, used;
+	uint32_t held = 0;
+	int i = 0;
+	int y = 0;
+	y16_codec_t codec;
+	
+	if (!file_open_image_read_file(name, &fd)) return false;
+	
+	// The rest of the header is skipped by reading it since it may span jpeg segments
+	replay_seg_left = 0;
+	if ((!rjpeg || ((fread(rdP, 1, 2, fd) == 2) && (rdP[0] == 0xFF) && (rdP[1] == 0xD8))) &&
+	    (_read_replay_data(fd, rdP, FILE_RAW_FORMAT_LEN, rjpeg) == FILE_RAW_FORMAT_LEN) &&
+	    file_raw_decode_header(rdP, &hdr_len, &enc, &flags, &len) &&
+	    (hdr_len >= FILE_RAW_FORMAT_LEN) && (hdr_len - FILE_RAW_FORMAT_LEN <= TJPGD_WORK_BUF_LEN) &&
+	    (_read_replay_data(fd, rdP, hdr_len - FILE_RAW_FORMAT_LEN, rjpeg) == hdr_len - FILE_RAW_FORMAT_LEN)) {
+		*high_gain = (flags & FILE_RAW_FLAG_HIGH_GAIN) != 0;
+		if (enc == FILE_RAW_ENC_NONE) {
+			if (_read_replay_data(fd, (uint8_t*) bufP, 2*T1C_WIDTH*T1C_HEIGHT, rjpeg) == 2*T1C_WIDTH*T1C_HEIGHT) {
+				// Pixels are stored big endian
+				for (i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+					bufP[i] = (bufP[i] >> 8) | (bufP[i] << 8);
+				}
+				success = true;
+			}
+		} else {
+			// A piece may end with part of a code (or row) which is kept for the next piece
+			while ((i < T1C_WIDTH*T1C_HEIGHT) && (y < T1C_HEIGHT)) {
+				n = _read_replay_data(fd, rdP + held, TJPGD_WORK_BUF_LEN - held, rjpeg);
+				if (n == 0) break;
+				n += held;
+				if (enc == FILE_RAW_ENC_RICE) {
+					used = y16_codec_decode_chunk(&codec, rdP, n, bufP, T1C_WIDTH, T1C_HEIGHT, &y);
+				} else {
+					used = file_raw_decode_y16_delta_chunk(rdP, n, bufP, &i);
+				}
+				held = n - used;
+				memmove(rdP, rdP + used, held);
+			}
+			success = (i == T1C_WIDTH*T1C_HEIGHT) || (y == T1C_HEIGHT);
+		}
+	}
+	file_close_file(fd);
+	
+	if (!success && !rjpeg) {
+		// Jpeg images without raw data are expected
+		ESP_LOGE(TAG, "Replay %s failed", name);
+	}
+	
+	return success;
+}
+
+
+/**
+ * Read up to len bytes of raw file data from a raw file or from the segments of a
+ * radiometric jpeg file.  Returns the number of bytes read, less than len at the end of
+ * the data.
+ */
+static uint32_t _read_replay_data(FILE* fd, uint8_t* buf, uint32_t len, bool rjpeg)
+{
+	uint32_t n;
+	uint32_t count = 0;
+	
+	if (!rjpeg) {
+		return fread(buf, 1, len, fd);
+	}
+	
+	while (count < len) {
+		if ((replay_seg_left == 0) && !_next_replay_segment(fd)) break;
+		
+		n = len - count;
+		if (n > replay_seg_left) n = replay_seg_left;
+		n = fread(buf + count, 1, n, fd);
+		if (n == 0) break;
+		count += n;
+		replay_seg_left -= n;
+	}
+	
+	return count;
+}
+
+
+/**
+ * Skip jpeg segments up to the next FILE_RAW_APP_MARKER segment with FILE_RAW_APP_ID and
+ * set replay_seg_left to the length of its data.  Returns false when the image data or
+ * the end of the file is reached first.
+ */
+static bool _next_replay_segment(FILE* fd)
+{
+	uint8_t hdr[4];
+	uint8_t id[FILE_RAW_APP_ID_LEN];
+	uint32_t seg_len;
+	
+	while (fread(hdr, 1, 4, fd) == 4) {
+		// Stop at start of scan or end of image
+		if ((hdr[0] != 0xFF) || (hdr[1] == 0xDA) || (hdr[1] == 0xD9)) break;
+		
+		seg_len = (hdr[2] << 8) | hdr[3];
+		if (seg_len < 2) break;
+		seg_len -= 2;
+		
+		if ((hdr[1] == (0xE0 + FILE_RAW_APP_MARKER)) && (seg_len >= FILE_RAW_APP_ID_LEN)) {
+			if (fread(id, 1, FILE_RAW_APP_ID_LEN, fd) != FILE_RAW_APP_ID_LEN) break;
+			seg_len -= FILE_RAW_APP_ID_LEN;
+			if (memcmp(id, FILE_RAW_APP_ID, FILE_RAW_APP_ID_LEN) == 0) {
+				replay_seg_left = seg_len;
+				if (seg_len != 0) return true;
+				continue;
+			}
+		}
+		
+		if (fseek(fd, seg_len, SEEK_CUR) != 0) break;
+	}
+	
+	return false;
+}
+
+
+/**
+ * Do the next card operation for the target being deleted: one entry of a directory
+ * (or the directory itself once it is empty) or a file and its thumbnail.
+ */
+static void _eval_delete()
+{
+	bool done = true;
+	bool finished;
+	int ret;
+	file_del_target_t* tP = &del_queue[del_queue_pos];
+	
+	if (!_mount_card()) {
+		// Card has gone away
+		_clear_delete_queue();
+		return;
+	}
+	
+	if (tP->file_name[0] == 0) {
+		ret = file_delete_directory_step(tP->dir_name);
+		done = (ret <= 0);
+		tP->success = (ret == 0);
+	} else {
+		tP->success = file_delete_file(tP->dir_name, tP->file_name);
+		if (tP->success) {
+			// A raw file shares its number with the jpeg file that owns the thumbnail
+			if (strstr(tP->file_name, FILE_RAW_EXT) == NULL) {
+				file_delete_sibling_file(tP->dir_name, tP->file_name, FILE_THUMB_EXT);
+			}
+		}
+	}
+	
+	_release_card(!done || tP->success);
+	
+	if (done) {
+		portENTER_CRITICAL(&del_queue_mux);
+		del_queue_pos += 1;
+		finished = (del_queue_pos == del_queue_count);
+		portEXIT_CRITICAL(&del_queue_mux);
+		
+		if (finished) {
+			_finish_delete();
+		}
+	}
+}
+
+
+/**
+ * Remove all the deleted targets from the catalog at once and answer any catalog requests
+ * that were held while they were being deleted
+ */
+static void _finish_delete()
+{
+	int d, f, i, n;
+	file_del_target_t* tP;
+	
+	n = del_queue_pos;
+	for (i=0; i<n; i++) {
+		tP = &del_queue[i];
+		if (tP->success) {
+			d = file_get_named_directory_index(tP->dir_name);
+			if (d >= 0) {
+				if (tP->file_name[0] == 0) {
+					file_delete_directory_info(d);
+				} else if ((f = file_get_named_file_index(d, tP->file_name)) >= 0) {
+					file_delete_file_info(d, f);
+				}
+			}
+		}
+	}
+	file_update_storage_info();
+	ESP_LOGI(TAG, "Deleted %d entries", n);
+	
+	// A deleted image's name may be used again by a new image
+	_clear_cached_images();
+	
+	// Any targets queued while we were finishing are still valid (resolved to names)
+	portENTER_CRITICAL(&del_queue_mux);
+	del_queue_count -= n;
+	memmove(&del_queue[0], &del_queue[n], del_queue_count * sizeof(file_del_target_t));
+	del_queue_pos = 0;
+	portEXIT_CRITICAL(&del_queue_mux);
+	
+	if (del_queue_count == 0) {
+		_clear_delete_queue();
+	}
+}
+
+
+/**
+ * Abandon any queued deletions and answer held catalog requests
+ */
+static void _clear_delete_queue()
+{
+	portENTER_CRITICAL(&del_queue_mux);
+	del_queue_count = 0;
+	del_queue_pos = 0;
+	portEXIT_CRITICAL(&del_queue_mux);
+	
+	if (del_catalog_held) {
+		del_catalog_held = false;
+		num_catalog_names = file_get_name_list(catalog_type, catalog_names_buffer);
+		xTaskNotify(output_task, task_file_catalog_ready_notification, eSetBits);
+	}
+	
+	if (del_page_held) {
+		del_page_held = false;
+		catalog_page_count = file_get_catalog_page(catalog_page_type, catalog_page_offset, catalog_page_count,
+		                                           catalog_page_entries, &catalog_page_total);
+		xTaskNotify(output_task, task_file_page_ready_notification, eSetBits);
+	}
+	
+	if (del_range_held) {
+		del_range_held = false;
+		catalog_range_count = file_get_catalog_range(catalog_range_start, catalog_range_end, catalog_range_offset,
+		                                             FILE_MAX_CATALOG_RANGE, catalog_range_entries, &catalog_range_total);
+		xTaskNotify(output_task, task_file_range_ready_notification, eSetBits);
+	}
+}
+
+
+/**
+ * Format the storage medium.  Stop any ongoing playback or recording.
+ */ 
+static bool _format_card()
+{
+	if (!card_available) {
+		ESP_LOGI(TAG, "No SD Card for format");
+		return false;
+	}
+	
+	// Everything queued for deletion or cached is going away
+	_clear_delete_queue();
+	_clear_cached_images();
+	
+	// Execute the format and delete the filesystem information structure (catalog)
+	xSemaphoreTake(card_mutex, portMAX_DELAY);
+	_unmount_card_session();
+	if (file_format_card()) {
+		ESP_LOGI(TAG, "Format SD Card");
+		file_delete_filesystem_info();
+		xSemaphoreGive(card_mutex);
+	} else {
+		ESP_LOGE(TAG, "Format SD Card failed");
+		xSemaphoreGive(card_mutex);
+		return false;
+	}
+	
+	// Mount it to update the card statistics
+	if (_mount_card()) {
+		_release_card(true);
+	}
+	
+	return true;
+}
+
+
+/**
+ * Stream the Tiny1C firmware file from the card to t1c_task.  Each buffer is read while
+ * t1c_task is writing the previous one into the Tiny1C.  Returns false if the update could
+ * not be started (t1c_task reports the result of an update it has started).
+ */
+static bool _update_t1c_fw()
+{
+	char name[FILE_FW_NAME_LEN];
+	uint32_t len, left;
+	uint8_t* bufP;
+	int n;
+	
+	if (!card_available) {
+		ESP_LOGI(TAG, "No SD Card for firmware update");
+		return false;
+	}
+	
+	if (!_mount_card()) {
+		return false;
+	}
+	
+	if (!file_open_fw_file(FILE_T1C_FW_PREFIX, name, &len)) {
+		_release_card(true);
+		return false;
+	}
+	
+	if (!t1c_start_fw_update(len)) {
+		file_close_fw_file();
+		_release_card(true);
+		return false;
+	}
+	ESP_LOGI(TAG, "Update Tiny1C from %s", name);
+	
+	left = len;
+	while (left != 0) {
+		// NULL if t1c_task stopped the update
+		bufP = t1c_fw_update_get_buffer();
+		if (bufP == NULL) break;
+		
+		n = file_read_fw_file(bufP, (left < T1C_FW_UPD_BUF_LEN) ? left : T1C_FW_UPD_BUF_LEN);
+		if (n <= 0) {
+			t1c_fw_update_put_buffer(bufP, 0);
+			break;
+		}
+		t1c_fw_update_put_buffer(bufP, (uint32_t) n);
+		left -= (uint32_t) n;
+	}
+	
+	file_close_fw_file();
+	_release_card(left == 0);
+	
+	return true;
+}
+
+
+/**
+ * Time the save renderer, jpeg codec and SD card writes for the benchmark started by
+ * t1c_task, which left its last frame in file_t1c_buffer.  The image is rendered into one
+ * jpeg slot and encoded into the other so this only runs when nothing is being saved.
+ * The SD card write is skipped without a card.
+ */
+static bool _run_benchmark()
+{
+	bool success = true;
+	int i;
+	int64_t start_usec;
+	uint32_t* rgbP = (uint32_t*) file_jpeg_slots[1];
+	jpeg_slot_t slot;
+	JDEC jdec;
+	JRESULT res;
+	tjpgd_iodev_t devid;
+	
+	if (save_image_requested || burst_running || record_running || log_running || timelapse_running) {
+		ESP_LOGE(TAG, "Benchmark not run while saving images");
+		return false;
+	}
+	
+	// Let the writer finish with the slots
+	while (jpeg_slots[0].full || jpeg_slots[1].full) {
+		vTaskDelay(pdMS_TO_TICKS(FILE_TASK_EVAL_FAST_MSEC));
+	}
+	
+	for (i=0; i<BENCH_ITERATIONS; i++) {
+		start_usec = bench_begin();
+		file_render_t1c_data(&file_t1c_buffer, rgbP);
+		bench_end(BENCH_ITEM_FILE_RENDER, start_usec);
+	}
+	
+	slot.bufP = file_jpeg_slots[0];
+	slot.buf_len = FILE_JPEG_SLOT_LEN;
+	xSemaphoreTake(jpeg_enc_mutex, portMAX_DELAY);
+	tje_register_comment_callback(NULL);
+	tje_register_app_callback(0, NULL);
+	tje_register_strip_callback(NULL, 0);
+	tje_set_chroma_subsampling(0);
+	for (i=0; i<BENCH_ITERATIONS; i++) {
+		slot.len = 0;
+		slot.overflow = false;
+		start_usec = bench_begin();
+		if ((tje_encode_with_func(_jpeg_slot_write_func, &slot, 3, T1C_WIDTH, T1C_HEIGHT, 4, (unsigned char*) rgbP) != 1) || slot.overflow) {
+			ESP_LOGE(TAG, "Benchmark jpeg encode failed");
+			success = false;
+			break;
+		}
+		bench_end(BENCH_ITEM_JPEG_ENC, start_usec);
+	}
+	xSemaphoreGive(jpeg_enc_mutex);
+	if (!success) return false;
+	
+	// Decode the encoded image from memory into the file image buffer
+	devid.fp = NULL;
+	devid.mem = slot.bufP;
+	devid.mem_len = slot.len;
+	devid.fbuf = (uint8_t*) rgb_file_image;
+	devid.wfbuf = T1C_WIDTH;
+	devid.expand = 0;
+	for (i=0; i<BENCH_ITERATIONS; i++) {
+		devid.mem_pos = 0;
+		start_usec = bench_begin();
+		res = jd_prepare(&jdec, _tjpgd_in_func, tjpgd_work_buf, TJPGD_WORK_BUF_LEN, &devid);
+		if (res == JDR_OK) {
+			res = jd_decomp(&jdec, _tjpgd_out_func, 0);
+		}
+		if (res != JDR_OK) {
+			ESP_LOGE(TAG, "Benchmark jpeg decode failed with %d", (int) res);
+			return false;
+		}
+		bench_end(BENCH_ITEM_JPEG_DEC, start_usec);
+	}
+	
+	if (card_available) {
+		if (!_mount_card()) {
+			ESP_LOGE(TAG, "Benchmark could not mount the card");
+			return false;
+		}
+		for (i=0; i<BENCH_SD_WRITES; i++) {
+			start_usec = bench_begin();
+			if (!file_write_test_file(CMD_BENCH_SD_WRITE_LEN)) {
+				success = false;
+				break;
+			}
+			bench_end(BENCH_ITEM_SD_WRITE, start_usec);
+		}
+		file_delete_test_file();
+		_release_card(success);
+	}
+	
+	return success;
+}
+
+
+#ifdef CONFIG_SCREENDUMP_ENABLE
+/**
+ * Save the screen rendered by gui_task as a 16-bit top-down BMP file in FILE_SCREEN_DIR.
+ * The pixels are written as they are (after fixing the byte order) so the file is an
+ * exact copy of what was drawn.  It is written directly like the card benchmark so it
+ * can't be done while the writer task holds a movie or log file open.
+ */
+static void _save_screenshot()
+{
+	uint8_t hdr[FILE_SCREEN_HDR_LEN];
+	uint32_t pix_len = screen_w * screen_h * 2;
+	char name[FILE_NAME_LEN];
+	bool success;
+	int i;
+	
+	if (!card_available) {
+		_display_save_error("No SD Card");
+		return;
+	}
+	if (movie_open || log_open) {
+		_display_save_error("SD Card busy");
+		return;
+	}
+	
+	// BMP pixels are little endian RGB565
+	if (screen_swapped) {
+		for (i=0; i<(screen_w * screen_h); i++) {
+			screen_fb[i] = (screen_fb[i] >> 8) | (screen_fb[i] << 8);
+		}
+	}
+	
+	// BITMAPFILEHEADER
+	memset(hdr, 0, sizeof(hdr));
+	hdr[0] = 'B';
+	hdr[1] = 'M';
+	_put_le32(&hdr[2], sizeof(hdr) + pix_len);
+	_put_le32(&hdr[10], sizeof(hdr));
+	
+	// BITMAPINFOHEADER with a negative height for rows stored top to bottom
+	_put_le32(&hdr[14], 40);
+	_put_le32(&hdr[18], screen_w);
+	_put_le32(&hdr[22], (uint32_t) -screen_h);
+	hdr[26] = 1;                       // Planes
+	hdr[28] = 16;                      // Bits/pixel
+	hdr[30] = 3;                       // BI_BITFIELDS
+	_put_le32(&hdr[34], pix_len);
+	
+	// RGB565 color masks
+	_put_le32(&hdr[54], 0xF800);
+	_put_le32(&hdr[58], 0x07E0);
+	_put_le32(&hdr[62], 0x001F);
+	
+	if (!_mount_card()) {
+		_display_save_error("Can't mount SD Card");
+		return;
+	}
+	success = file_write_screen_file(hdr, sizeof(hdr), (uint8_t*) screen_fb, pix_len, name);
+	_release_card(success);
+	
+	if (success) {
+		ESP_LOGI(TAG, "Saved screenshot %s/%s", FILE_SCREEN_DIR, name);
+		sprintf(file_save_info, "Saved %s", name);
+		_notify_save_msg_start(true);
+		vTaskDelay(pdMS_TO_TICKS(FILE_MSG_DISPLAY_MSEC));
+		_notify_save_msg_end();
+	} else {
+		_display_save_error("Can't write to SD Card");
+	}
+}
+
+
+static void _put_le32(uint8_t* dst, uint32_t v)
+{
+	*dst++ = v & 0xFF;
+	*dst++ = (v >> 8) & 0xFF;
+	*dst++ = (v >> 16) & 0xFF;
+	*dst = (v >> 24) & 0xFF;
+}
+#endif
+
+
+/**
+ * Encode stage of the save pipeline.  Encode the image from t1cP into the file format(s)
+ * selected by out_state.save_format for the writer task.  Returns false if the image
+ * could not be encoded.
+ */
+static bool _save_image(t1c_buffer_t* t1cP)
+{
+	bool success;
+	int64_t stage_usec = perf_start();
+	
+	// Make sure a card is inserted
+	if (!card_available) {
+		_display_save_error("No SD Card");
+		return false;
+	}
+	
+	switch (out_state.save_format) {
+		case CMD_SAVE_FMT_RAW:
+			success = _encode_image_to_raw(t1cP, false);
+			break;
+		
+		case CMD_SAVE_FMT_BOTH:
+			// The raw file is named after the jpeg file
+			success = _encode_image_to_jpeg(t1cP, false) && _encode_image_to_raw(t1cP, true);
+			break;
+		
+		case CMD_SAVE_FMT_RJPEG:
+			success = _encode_image_to_jpeg(t1cP, true);
+			break;
+		
+		default:
+			success = _encode_image_to_jpeg(t1cP, false);
+	}
+	perf_end(PERF_STAGE_SAVE, stage_usec);
+	
+	return success;
+}
+
+
+/**
+ * Render and encode the image from t1cP into the next slot as a jpeg file.  A radiometric
+ * jpeg file also carries the Y16 data and parameters (see file_raw.h).  The image is
+ * rendered a strip at a time into rgb_save_strip as the encoder needs it.
+ */
+static bool _encode_image_to_jpeg(t1c_buffer_t* t1cP, bool radiometric)
+{
+	int ret;
+	jpeg_slot_t* slotP = _get_free_slot();
+	
+	// Images with a gray palette and no overlay are encoded as single component grayscale
+	// jpegs directly from the Y8 data, skipping the render to RGB
+	enc_gray = !out_state.save_ovl_en && ((out_state.sav_palette_index == PALETTE_GRAY) ||
+	                                      (out_state.sav_palette_index == PALETTE_BLACK_HOT));
+	enc_invert = enc_gray && (out_state.sav_palette_index == PALETTE_BLACK_HOT);
+	
+	// Movie frames don't get a thumbnail.  Grayscale thumbnails are made from the whole Y8
+	// image.
+	enc_thumb = !enc_movie && !enc_gray;
+	
+	// Configure the overlay image orientation
+	if (out_state.save_ovl_en) {
+		file_render_set_orientation(out_state.is_portrait);
+	}
+	
+	// Compress the jpeg file into the slot.  The comments and radiometric data come from
+	// t1cP so this must be done before it can be loaded with the next image.
+	slotP->len = 0;
+	slotP->overflow = false;
+	xSemaphoreTake(jpeg_enc_mutex, portMAX_DELAY);
+	enc_t1cP = t1cP;
+	tje_register_comment_callback(_tjpgd_comment_func);
+	tje_register_app_callback(FILE_RAW_APP_MARKER, radiometric ? _tjpgd_app_func : NULL);
+	tje_set_chroma_subsampling(enc_movie ? 1 : 0);  // Movie frames trade color detail for speed
+	if (enc_gray && !enc_invert) {
+		tje_register_strip_callback(NULL, 0);
+		ret = tje_encode_with_func(_jpeg_slot_write_func, slotP, 3, T1C_WIDTH, T1C_HEIGHT, 1, t1c_get_y8_data(t1cP, T1C_Y8F_OUT_SAVE));
+	} else {
+		tje_register_strip_callback(_tjpgd_strip_func, FILE_SAVE_STRIP_LINES);
+		ret = tje_encode_with_func(_jpeg_slot_write_func, slotP, 3, T1C_WIDTH, T1C_HEIGHT, enc_gray ? 1 : 4, NULL);
+	}
+	tje_register_strip_callback(NULL, 0);
+	xSemaphoreGive(jpeg_enc_mutex);
+	file_render_set_strip(0, T1C_HEIGHT);
+	if ((ret != 1) || slotP->overflow) {
+		ESP_LOGE(TAG, "Jpeg encode failed");
+		_display_save_error("File save failed");
+		return false;
+	}
+	
+	// Add a thumbnail for the file browser (movie frames don't get one)
+	if (enc_movie) {
+		slotP->thumb_len = 0;
+	} else {
+		if (enc_gray) {
+			_make_thumb_from_y8(t1c_get_y8_data(t1cP, T1C_Y8F_OUT_SAVE));
+		}
+		slotP->thumb_len = _encode_thumb(slotP);
+	}
+	
+	slotP->is_raw = false;
+	slotP->is_sibling = false;
+	slotP->is_movie = enc_movie;
+	slotP->is_log = false;
+	_queue_slot(slotP);
+	
+	return true;
+}
+
+
+/**
+ * Pack the image from t1cP into the next slot as a raw file.  This is much faster than
+ * encoding a jpeg file.
+ */
+static bool _encode_image_to_raw(t1c_buffer_t* t1cP, bool is_sibling)
+{
+	jpeg_slot_t* slotP = _get_free_slot();
+	tmElements_t te;
+	
+	time_get(&te);
+	slotP->len = file_raw_encode(t1cP, &file_t1c_meta, &te, slotP->bufP);
+	slotP->thumb_len = 0;
+	slotP->overflow = false;
+	slotP->is_raw = true;
+	slotP->is_sibling = is_sibling;
+	slotP->is_movie = false;
+	slotP->is_log = false;
+	_queue_slot(slotP);
+	
+	return true;
+}
+
+
+/**
+ * Return the next slot for the encode stage, waiting for the writer to finish with it
+ */
+static jpeg_slot_t* _get_free_slot()
+{
+	jpeg_slot_t* slotP = &jpeg_slots[jpeg_encode_slot];
+	
+	while (slotP->full) {
+		vTaskDelay(pdMS_TO_TICKS(FILE_TASK_EVAL_FAST_MSEC));
+	}
+	
+	return slotP;
+}
+
+
+/**
+ * Hand an encoded slot to the writer
+ */
+static void _queue_slot(jpeg_slot_t* slotP)
+{
+	slotP->full = true;
+	if (++jpeg_encode_slot == FILE_JPEG_NUM_SLOTS) jpeg_encode_slot = 0;
+	xTaskNotify(task_handle_file_wr, FILE_WR_NOTIFY_SLOT_MASK, eSetBits);
+}
+
+
+static void _jpeg_slot_write_func(void* context, void* data, int size)
+{
+	jpeg_slot_t* slotP = (jpeg_slot_t*) context;
+	
+	if ((slotP->len + size) > slotP->buf_len) {
+		slotP->overflow = true;
+	} else {
+		memcpy(slotP->bufP + slotP->len, data, size);
+		slotP->len += size;
+	}
+}
+
+
+/**
+ * Writer stage of the save pipeline.  Writes encoded slots to the card in order.
+ */
+static void _file_wr_task()
+{
+	uint32_t notification_value;
+	
+	while (1) {
+		(void) xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, portMAX_DELAY);
+		
+		while (jpeg_slots[jpeg_write_slot].full) {
+			_write_jpeg_slot(&jpeg_slots[jpeg_write_slot]);
+			jpeg_slots[jpeg_write_slot].full = false;
+			if (++jpeg_write_slot == FILE_JPEG_NUM_SLOTS) jpeg_write_slot = 0;
+		}
+	}
+}
+
+
+static void _write_jpeg_slot(jpeg_slot_t* slotP)
+{
+	bool new_dir;
+	bool success;
+	char* dir_name;
+	char* file_name;
+	bool prev_success = jpeg_write_success;
+	
+	jpeg_write_success = false;
+	
+	if (slotP->is_movie) {
+		_write_movie_slot(slotP);
+		return;
+	}
+	if (slotP->is_log) {
+		_write_log_slot(slotP);
+		return;
+	}
+	
+	// Attempt to open the card
+	if (!_mount_card()) {
+		_display_save_error("Can't mount SD Card");
+		return;
+	}
+	
+	// Attempt to get a file to write to.  A sibling file takes the name of the previous
+	// file if that was written (e.g. the raw file saved with a jpeg file).  The file's
+	// length is known so it is preallocated.
+	if (slotP->is_sibling && prev_success) {
+		success = file_open_image_sibling_file(FILE_RAW_EXT, slotP->len);
+	} else {
+		success = file_open_image_write_file(slotP->is_raw ? FILE_RAW_EXT : ".JPG", slotP->len);
+	}
+	if (!success) {
+		_release_card(false);
+		_display_save_error("Can't write to SD Card");
+		return;
+	}
+	
+	// Let the output task know what file we're writing too
+	dir_name = file_get_open_write_dirname(&new_dir);
+	file_name = file_get_open_write_filename();
+	ESP_LOGI(TAG, "Writing %s/%s %s", dir_name, file_name, new_dir ? "(new dir)" : "");
+	sprintf(file_save_info, "Saving %s", file_name);
+	_notify_save_msg_start(true);
+	
+	// Write the file
+	success = file_write_file(slotP->bufP, slotP->len);
+	success = file_close_write_file() && success;
+	if (success) {
+		// The thumbnail is written before the catalog is updated so the catalog index
+		// records the final state of the card
+		if (slotP->thumb_len != 0) {
+			(void) file_write_image_sibling_file(FILE_THUMB_EXT, slotP->bufP + slotP->len, slotP->thumb_len);
+		}
+		_add_catalog_file(dir_name, file_name, new_dir);
+		_release_card(true);
+		_notify_save_msg_end();
+		jpeg_write_success = true;
+	} else {
+		_release_card(false);
+		
+		// End previous display
+		_notify_save_msg_end();
+		vTaskDelay(pdMS_TO_TICKS(50));  // Allow the output task to clear the previous message
+		
+		ESP_LOGE(TAG, "Image write failed");
+		_display_save_error("File save failed");
+	}
+}
+
+
+/**
+ * Append a movie frame to the movie file, creating the file with the first frame.  The
+ * card is released between frames so file_task can still use it.  An empty slot closes
+ * the file and adds it to the catalog.
+ */
+static void _write_movie_slot(jpeg_slot_t* slotP)
+{
+	bool new_dir;
+	bool success;
+	char* dir_name;
+	char* file_name;
+	
+	if (movie_write_failed) {
+		// Discard what's left of a failed recording
+		return;
+	}
+	
+	if (!_mount_card()) {
+		if (movie_open) {
+			// The card went away under the open file
+			(void) file_close_write_file();
+			movie_open = false;
+		}
+		movie_write_failed = true;
+		_display_save_error("Can't mount SD Card");
+		return;
+	}
+	
+	if (!movie_open) {
+		if (slotP->len == 0) {
+			// Recording stopped before the first frame was taken
+			_release_card(true);
+			return;
+		}
+		
+		if (!file_open_image_write_file(".MJPG", FILE_MOVIE_PREALLOC_LEN)) {
+			movie_write_failed = true;
+			_release_card(false);
+			_display_save_error("Can't write to SD Card");
+			return;
+		}
+		movie_open = true;
+		movie_len = 0;
+		
+		file_name = file_get_open_write_filename();
+		ESP_LOGI(TAG, "Recording %s/%s", file_get_open_write_dirname(&new_dir), file_name);
+		sprintf(file_save_info, "Recording %s", file_name);
+		_notify_save_msg_start(true);
+		_notify_save_msg_end();
+	}
+	
+	if (slotP->len != 0) {
+		success = file_write_file(slotP->bufP, slotP->len);
+		if (success) {
+			movie_len += slotP->len;
+		} else {
+			(void) file_close_write_file();
+			movie_open = false;
+		}
+	} else {
+		// Closing trims the unused preallocated space
+		success = file_close_write_file();
+		movie_open = false;
+		
+		// Add the file to our filesystem catalog
+		dir_name = file_get_open_write_dirname(&new_dir);
+		file_name = file_get_open_write_filename();
+		if (success) {
+			ESP_LOGI(TAG, "Recorded %lu bytes", movie_len);
+			_add_catalog_file(dir_name, file_name, new_dir);
+			sprintf(file_save_info, "Saved %s", file_name);
+			_notify_save_msg_start(true);
+			_notify_save_msg_end();
+		}
+	}
+	
+	if (success) {
+		_release_card(true);
+	} else {
+		movie_write_failed = true;
+		_release_card(false);
+		ESP_LOGE(TAG, "Movie write failed");
+		_display_save_error("File save failed");
+	}
+}
+
+
+/**
+ * Append data log records to the log file, creating the file with the first slot.  An
+ * empty slot closes the file and adds it to the catalog.
+ */
+static void _write_log_slot(jpeg_slot_t* slotP)
+{
+	bool new_dir;
+	bool success;
+	char* dir_name;
+	char* file_name;
+	
+	if (log_write_failed) {
+		// Discard what's left of a failed log
+		return;
+	}
+	
+	if (!_mount_card()) {
+		if (log_open) {
+			// The card went away under the open file
+			(void) file_close_write_file();
+			log_open = false;
+		}
+		log_write_failed = true;
+		_display_save_error("Can't mount SD Card");
+		return;
+	}
+	
+	if (!log_open) {
+		if (slotP->len == 0) {
+			// Logging stopped before the first record was taken
+			_release_card(true);
+			return;
+		}
+		
+		if (!file_open_image_write_file(FILE_LOG_EXT, FILE_LOG_PREALLOC_LEN)) {
+			log_write_failed = true;
+			_release_card(false);
+			_display_save_error("Can't write to SD Card");
+			return;
+		}
+		log_open = true;
+		log_len = 0;
+		
+		file_name = file_get_open_write_filename();
+		ESP_LOGI(TAG, "Logging %s/%s", file_get_open_write_dirname(&new_dir), file_name);
+		sprintf(file_save_info, "Logging %s", file_name);
+		_notify_save_msg_start(true);
+		_notify_save_msg_end();
+	}
+	
+	if (slotP->len != 0) {
+		success = file_write_file(slotP->bufP, slotP->len);
+		if (success) {
+			log_len += slotP->len;
+		} else {
+			(void) file_close_write_file();
+			log_open = false;
+		}
+	} else {
+		// Closing writes the records still in the write buffer and trims the unused
+		// preallocated space
+		success = file_close_write_file();
+		log_open = false;
+		
+		// Add the file to our filesystem catalog
+		dir_name = file_get_open_write_dirname(&new_dir);
+		file_name = file_get_open_write_filename();
+		if (success) {
+			ESP_LOGI(TAG, "Logged %lu bytes", log_len);
+			_add_catalog_file(dir_name, file_name, new_dir);
+			sprintf(file_save_info, "Saved %s", file_name);
+			_notify_save_msg_start(true);
+			_notify_save_msg_end();
+		}
+	}
+	
+	if (success) {
+		_release_card(true);
+	} else {
+		log_write_failed = true;
+		_release_card(false);
+		ESP_LOGE(TAG, "Log write failed");
+		_display_save_error("File save failed");
+	}
+}
+
+
+/**
+ * Add a newly written file to our filesystem catalog (card must be mounted)
+ */
+static void _add_catalog_file(char* dir_name, char* file_name, bool new_dir)
+{
+	if (new_dir || (file_get_named_directory_index(dir_name) < 0)) {
+		(void) file_add_directory_info(dir_name);
+	}
+	(void) file_add_file_info(dir_name, file_name);
+	file_update_storage_info();
+}
+
+
+static void _display_save_error(char* msg)
+{
+	strcpy(file_save_info, msg);
+	_notify_save_msg_start(false);
+	vTaskDelay(pdMS_TO_TICKS(FILE_MSG_DISPLAY_MSEC));
+	_notify_save_msg_end();
+}
+
+
+static bool _read_jpeg_image()
+{
+	bool success;
+	
+	if (_get_cached_image(file_read_filename, true)) {
+		return true;
+	}
+	
+	// Attempt to open the card
+	if (!_mount_card()) {
+		strcpy(file_save_info, "Can't mount SD Card");
+		return false;
+	}
+	
+	success = _decode_jpeg_file(file_read_filename, (uint8_t*) rgb_file_image, 0, 0);
+	
+	_release_card(success);
+	
+	if (success) {
+		_put_cached_image(file_read_filename, true);
+	}
+	
+	return success;
+}
+
+
+static bool _read_jpeg_file()
+{
+	bool success;
+	
+	if (_get_cached_image(file_read_filename, false)) {
+		return true;
+	}
+	
+	// Attempt to open the card
+	if (!_mount_card()) {
+		strcpy(file_save_info, "Can't mount SD Card");
+		return false;
+	}
+	
+	success = _read_file_to_buffer(file_read_filename, (uint8_t*) rgb_file_image, &file_jpeg_len);
+	
+	_release_card(success);
+	
+	if (success) {
+		_put_cached_image(file_read_filename, false);
+	}
+	
+	return success;
+}
+
+
+/**
+ * Get the thumbnail for the file with the previously set name.  It is read from the
+ * thumbnail file saved with the image when that exists.  Otherwise it is made from a
+ * reduced scale decode of the image and saved so it is there the next time.  The iCamMini
+ * leaves the thumbnail jpeg file in rgb_file_image for the browser to decode.  The iCam
+ * leaves the thumbnail, or the reduced scale image, expanded to full size in rgb_file_image.
+ */
+static bool _read_jpeg_thumb()
+{
+	bool have_thumb_file;
+	bool success;
+	char thumb_filename[FILE_PATH_LEN];
+	char* cP;
+	jpeg_slot_t thumb_slot;
+	uint32_t thumb_len;
+	
+	strcpy(thumb_filename, file_read_filename);
+	cP = strrchr(thumb_filename, '.');
+	if (cP == NULL) {
+		return false;
+	}
+	strcpy(cP, FILE_THUMB_EXT);
+	
+	// Attempt to open the card
+	if (!_mount_card()) {
+		strcpy(file_save_info, "Can't mount SD Card");
+		return false;
+	}
+	
+	have_thumb_file = file_image_file_exists(thumb_filename);
+	if (have_thumb_file) {
+#ifdef CONFIG_BUILD_ICAM_MINI
+		success = _read_file_to_buffer(thumb_filename, (uint8_t*) rgb_file_image, &file_jpeg_len);
+#else
+		success = _decode_jpeg_file(thumb_filename, (uint8_t*) rgb_file_image, 0, FILE_THUMB_SCALE);
+#endif
+		_release_card(success);
+		return success;
+	}
+	
+	// Decode the image at thumbnail scale and then make the RGBA thumbnail at the start of
+	// rgb_save_thumb from it
+#ifdef CONFIG_BUILD_ICAM_MINI
+	success = _decode_jpeg_file(file_read_filename, (uint8_t*) rgb_file_image, FILE_THUMB_SCALE, 0);
+	if (success) {
+		_make_thumb_from_file_image(FILE_THUMB_W, 1);
+	}
+#else
+	success = _decode_jpeg_file(file_read_filename, (uint8_t*) rgb_file_image, FILE_THUMB_SCALE, FILE_THUMB_SCALE);
+	if (success) {
+		_make_thumb_from_file_image(T1C_WIDTH, 1 << FILE_THUMB_SCALE);
+	}
+#endif
+	
+	if (success) {
+		// Encode the thumbnail after it in rgb_save_thumb
+		thumb_slot.bufP = (uint8_t*) (rgb_save_thumb + FILE_THUMB_W*FILE_THUMB_H);
+		thumb_slot.buf_len = FILE_THUMB_JPEG_LEN;
+		thumb_slot.len = 0;
+		thumb_slot.overflow = false;
+		thumb_len = _encode_thumb(&thumb_slot);
+		success = (thumb_len != 0);
+		
+		// Save it unless a movie or data log, which has the write file open, is being written
+		if (success && !movie_open && !log_open) {
+			if (file_write_image_file(thumb_filename, thumb_slot.bufP, thumb_len)) {
+				file_sync_filesystem_info();
+				file_update_storage_info();
+			}
+		}
+		
+#ifdef CONFIG_BUILD_ICAM_MINI
+		if (success) {
+			memcpy((uint8_t*) rgb_file_image, thumb_slot.bufP, thumb_len);
+			file_jpeg_len = thumb_len;
+		}
+#endif
+	}
+	
+	_release_card(success);
+	
+	return success;
+}
+
+
+/**
+ * Read the whole file name (relative to DCIM) as-is into bufP (the size of rgb_file_image)
+ * and set lenP to its length.  The card must be mounted.
  */
-static bool _delete_dir(int dir_index)
+static bool _read_file_to_buffer(char* name, uint8_t* bufP, uint32_t* lenP)
 {
 	bool success = true;
-	directory_node_t* dir_node;
-	int i;
+	FILE* fd;
+	size_t len;
 	
-	// Get the directory node associated with this index
-	dir_node = file_get_indexed_directory(dir_index);
-	if (dir_node != NULL) {
-		// Attempt to mount the filesystem
-		success = file_mount_sdcard();
-		if (success) {
-			// Attempt to delete the directory (and all files in it)
-			success = file_delete_directory(dir_node->nameP);
-			if (success) {
-				// Delete file entries in this directory node from the catalog
-				if (dir_node->num_files != 0) {
-					for (i=dir_node->num_files-1; i>=0; i--) {
-						file_delete_file_info(dir_node, i);
-					}
-				}
-				
-				// Delete the directory node
-				file_delete_directory_info(dir_index);
-			}
-			
-			file_unmount_sdcard();
+	if (file_open_image_read_file(name, &fd)) {
+		// Read the whole file (a file filling the buffer is assumed to be too large)
+		len = fread(bufP, 1, FILE_MAX_JPEG_LEN, fd);
+		if ((len == 0) || (len == FILE_MAX_JPEG_LEN)) {
+			ESP_LOGE(TAG, "Read %s failed", name);
+			success = false;
+		} else {
+			*lenP = (uint32_t) len;
 		}
+		file_close_file(fd);
+	} else {
+		ESP_LOGE(TAG, "Open %s failed", name);
+		success = false;
 	}
 	
 	return success;
@@ -576,216 +3343,382 @@ static bool _delete_dir(int dir_index)
 
 
 /**
- * Delete a file.  Update the catalog.
+ * Decode the jpeg file name (relative to DCIM) into bufP (the size of rgb_file_image) in the
+ * display format.  The image is decoded at 1/2^scale size using the tjpgd scale feature,
+ * which skips much of the work for the smaller sizes, and each decoded pixel is written as
+ * a 2^expand square block.  A preview (expand = scale) fills the same area as the full size
+ * image in a fraction of the time.  The card must be mounted.
  */
-static bool _delete_file(int dir_index, int file_index)
+static bool _decode_jpeg_file(char* name, uint8_t* bufP, uint8_t scale, uint8_t expand)
 {
 	bool success = true;
-	directory_node_t* dir_node;
-	file_node_t* file_node;
+	FILE* fd;
+	JRESULT res;
+	JDEC jdec;
+	tjpgd_iodev_t devid;
+	unsigned int w, h;
 	
-	// Get the directory node associated with this index
-	dir_node = file_get_indexed_directory(dir_index);
+	if (!file_open_image_read_file(name, &fd)) {
+		ESP_LOGE(TAG, "Open %s failed", name);
+		return false;
+	}
 	
-	if (dir_node != NULL) {
-		// Attempt to mount the filesystem
-		success = file_mount_sdcard();
-		if (success) {
-			// Attempt to delete the file
-			file_node = file_get_indexed_file(dir_node, file_index);
-			if (file_node != NULL) {
-				success = file_delete_file(dir_node->nameP, file_node->nameP);
-				if (success) {
-					// Delete the file entry from the catalog
-					file_delete_file_info(dir_node, file_index);
-				}
+	// Setup tjpgd to decompress the file
+	devid.fp = fd;
+	res = jd_prepare(&jdec, _tjpgd_in_func, tjpgd_work_buf, TJPGD_WORK_BUF_LEN, &devid);
+//	ESP_LOGI(TAG, "jpeg dim = %d, %d, work = %d", (int) jdec.width, (int) jdec.height, TJPGD_WORK_BUF_LEN - jdec.sz_pool);
+	if (res == JDR_OK) {
+		// Make sure the output fits
+		w = (jdec.width >> scale) << expand;
+		h = (jdec.height >> scale) << expand;
+		if ((w <= T1C_WIDTH) && (h <= T1C_HEIGHT)) {
+			// Start the decompression
+			devid.fbuf = bufP;
+			devid.wfbuf = w;
+			devid.expand = expand;
+			res = jd_decomp(&jdec, _tjpgd_out_func, scale);
+			if (res != JDR_OK) {
+				ESP_LOGE(TAG, "jd_decomp failed with %d", (int) res);
+				success = false;
 			}
-			
-			file_unmount_sdcard();
-		}			
+		} else {
+			ESP_LOGE(TAG, "%s is too large to decode", name);
+			success = false;
+		}
+	} else {
+		ESP_LOGE(TAG, "jd_prepare failed with %d", (int) res);
+		success = false;
 	}
+	file_close_file(fd);
 	
 	return success;
 }
 
 
 /**
- * Format the storage medium.  Stop any ongoing playback or recording.
- */ 
-static bool _format_card()
+ * Copy the image or file (relative to DCIM) for a browser read into rgb_file_image from
+ * the browser image cache.  Returns false if it isn't there.  Either way its neighbours are
+ * prefetched once the browser is idle.
+ */
+static bool _get_cached_image(char* name, bool decoded)
 {
-	if (!card_available) {
-		ESP_LOGI(TAG, "No SD Card for format");
+	file_prefetch_t* pP;
+	
+	if (prefetch_cache[0].bufP == NULL) {
 		return false;
 	}
 	
-	// Execute the format and delete the filesystem information structure (catalog)
-	if (file_format_card()) {
-		ESP_LOGI(TAG, "Format SD Card");
-		file_delete_filesystem_info();
-	} else {
-		ESP_LOGE(TAG, "Format SD Card failed");
+	strcpy(prefetch_base, name);
+	prefetch_decoded = decoded;
+	prefetch_pending = true;
+	prefetch_usec = esp_timer_get_time() + FILE_PREFETCH_IDLE_MSEC * 1000;
+	
+	if ((pP = _find_cached_image(name, decoded)) == NULL) {
 		return false;
 	}
 	
-	// Mount it briefly to update the card statistics
-	if (file_mount_sdcard()) {
-		file_unmount_sdcard();
-	}	
+	if (decoded) {
+		memcpy((uint8_t*) rgb_file_image, pP->bufP, FILE_MAX_JPEG_LEN);
+	} else {
+		memcpy((uint8_t*) rgb_file_image, pP->bufP, pP->len);
+		file_jpeg_len = pP->len;
+	}
 	
 	return true;
 }
 
 
-static void _save_image_to_jpeg()
+/**
+ * Keep a copy of the image or file just read into rgb_file_image in the browser image
+ * cache so it can be viewed again without reading the card when the browser steps back
+ */
+static void _put_cached_image(char* name, bool decoded)
 {
-	bool new_dir;
-	char* dir_name;
-	char* file_name;
-	directory_node_t* cat_dir_node;
-	FILE* fd;
-	int ret;
-	t1c_buffer_t* t1cP = &file_t1c_buffer;
+	char names[2][FILE_PATH_LEN];
+	file_prefetch_t* pP;
 	
-	// Make sure a card is inserted
-	if (!card_available) {
-		strcpy(file_save_info, "No SD Card");
-		_notify_save_msg_start(false);
-		vTaskDelay(pdMS_TO_TICKS(FILE_MSG_DISPLAY_MSEC));
-		_notify_save_msg_end();
+	if (prefetch_cache[0].bufP == NULL) {
 		return;
 	}
 	
-	// Attempt to open the card
-	if (!file_mount_sdcard()) {
-		strcpy(file_save_info, "Can't mount SD Card");
-		_notify_save_msg_start(false);
-		vTaskDelay(pdMS_TO_TICKS(FILE_MSG_DISPLAY_MSEC));
-		_notify_save_msg_end();
+	pP = _get_free_cache_entry(name, names, _get_neighbour_names(name, names));
+	if (pP != NULL) {
+		strcpy(pP->name, name);
+		pP->decoded = decoded;
+		pP->len = decoded ? FILE_MAX_JPEG_LEN : file_jpeg_len;
+		memcpy(pP->bufP, (uint8_t*) rgb_file_image, pP->len);
+	}
+}
+
+
+/**
+ * Read one missing neighbour of the image last viewed in the browser into the browser image
+ * cache, the same way the browser read it, once the browser and the card are idle
+ */
+static void _eval_prefetch()
+{
+	bool success;
+	char names[2][FILE_PATH_LEN];
+	file_prefetch_t* pP;
+	int i, n;
+	
+	if (esp_timer_get_time() < prefetch_usec) {
 		return;
 	}
 	
-	// Attempt to get a file to write to
-	if (!file_open_image_write_file(&fd)) {
-		strcpy(file_save_info, "Can't write to SD Card");
-		_notify_save_msg_start(false);
-		vTaskDelay(pdMS_TO_TICKS(FILE_MSG_DISPLAY_MSEC));
-		_notify_save_msg_end();
+	if (!card_available || save_image_requested || burst_running || record_running || log_running ||
+	    replay_running || (del_queue_count != 0)) {
+		// Try again when the card may be free
+		prefetch_usec = esp_timer_get_time() + FILE_PREFETCH_IDLE_MSEC * 1000;
 		return;
 	}
 	
-	// Let the output task know what file we're writing too
-	dir_name = file_get_open_write_dirname(&new_dir);
-	file_name = file_get_open_write_filename();
-	ESP_LOGI(TAG, "Writing %s/%s %s", dir_name, file_name, new_dir ? "(new dir)" : "");
-	sprintf(file_save_info, "Saving %s", file_name);
-	_notify_save_msg_start(true);
+	n = _get_neighbour_names(prefetch_base, names);
+	for (i=0; i<n; i++) {
+		if (_find_cached_image(names[i], prefetch_decoded) == NULL) break;
+	}
+	if ((i == n) || ((pP = _get_free_cache_entry(prefetch_base, names, n)) == NULL)) {
+		prefetch_pending = false;
+		return;
+	}
 	
-	// Render the raw Tiny1C data into the 24-bit RGB (RGB888) buffer
-	file_render_t1c_data(t1cP, rgb_save_image);
+	if (!_mount_card()) {
+		prefetch_pending = false;
+		return;
+	}
 	
-	// Render overlay data if enabled
-	if (out_state.save_ovl_en) {
-		// Configure the image orientation 
-		file_render_set_orientation(out_state.is_portrait);
-		
-		// Draw enabled markers
-		if (out_state.min_max_mrk_enable && t1cP->minmax_valid) {
-			file_render_min_max_markers(t1cP, rgb_save_image, &out_state);
+	pP->name[0] = 0;
+	if (prefetch_decoded) {
+		success = _decode_jpeg_file(names[i], pP->bufP, 0, 0);
+		pP->len = FILE_MAX_JPEG_LEN;
+	} else {
+		success = _read_file_to_buffer(names[i], pP->bufP, &pP->len);
+	}
+	
+	_release_card(success);
+	
+	if (success) {
+		strcpy(pP->name, names[i]);
+		pP->decoded = prefetch_decoded;
+	} else {
+		// Don't keep trying to read a bad file
+		prefetch_pending = false;
+	}
+}
+
+
+static void _clear_cached_images()
+{
+	for (int i=0; i<FILE_PREFETCH_NUM; i++) {
+		prefetch_cache[i].name[0] = 0;
+	}
+	prefetch_pending = false;
+}
+
+
+/**
+ * Load names with the jpeg images before and after base (relative to DCIM) in its
+ * directory.  Returns the number of names.
+ */
+static int _get_neighbour_names(char* base, char names[][FILE_PATH_LEN])
+{
+	char dir_name[DIR_NAME_LEN];
+	char file_name[FILE_NAME_LEN];
+	char* cP;
+	int d, f, i, len;
+	int n = 0;
+	
+	cP = strchr(base, '/');
+	if ((cP == NULL) || ((cP - base) >= DIR_NAME_LEN)) {
+		return 0;
+	}
+	memcpy(dir_name, base, cP - base);
+	dir_name[cP - base] = 0;
+	
+	if (((d = file_get_named_directory_index(dir_name)) < 0) || ((f = file_get_named_file_index(d, cP + 1)) < 0)) {
+		return 0;
+	}
+	
+	for (i=f+1; i>=f-1; i-=2) {
+		if (file_get_file_name(d, i, file_name)) {
+			len = strlen(file_name);
+			if (strcmp(&file_name[len - 4], ".JPG") == 0) {
+				sprintf(names[n++], "%s/%s", dir_name, file_name);
+			}
 		}
-		
-		if (out_state.region_enable && t1cP->region_valid) {
-			file_render_region_marker(t1cP, rgb_save_image, &out_state);
-			file_render_region_temps(t1cP, rgb_save_image, &out_state);
+	}
+	
+	return n;
+}
+
+
+static file_prefetch_t* _find_cached_image(char* name, bool decoded)
+{
+	for (int i=0; i<FILE_PREFETCH_NUM; i++) {
+		if ((prefetch_cache[i].decoded == decoded) && (strcmp(prefetch_cache[i].name, name) == 0)) {
+			return &prefetch_cache[i];
 		}
-		
-		if (out_state.spotmeter_enable && t1cP->spot_valid) {
-			file_render_spotmeter(t1cP, rgb_save_image, &out_state);
+	}
+	
+	return NULL;
+}
+
+
+/**
+ * Return a cache entry that doesn't hold base or any of its n neighbour names (or NULL
+ * if they fill the cache)
+ */
+static file_prefetch_t* _get_free_cache_entry(char* base, char names[][FILE_PATH_LEN], int n)
+{
+	bool keep;
+	int i, j;
+	
+	for (i=0; i<FILE_PREFETCH_NUM; i++) {
+		keep = (strcmp(prefetch_cache[i].name, base) == 0);
+		for (j=0; j<n; j++) {
+			keep |= (strcmp(prefetch_cache[i].name, names[j]) == 0);
 		}
-		
-		// Then draw the palette (over a marker if necessary)
-		file_render_palette(rgb_save_image, &out_state);
-		file_render_min_max_temps(t1cP, rgb_save_image, &out_state);
-		if (out_state.spotmeter_enable && t1cP->spot_valid) {
-			file_render_palette_marker(t1cP, rgb_save_image, &out_state);
+		if (!keep) {
+			return &prefetch_cache[i];
 		}
-		
-		// Finally add environmental conditions if they exist
-		file_render_env_info(t1cP, rgb_save_image, &out_state);
 	}
 	
-	// Compress and write the jpeg file (closes file)
-	tje_register_comment_callback(_tjpgd_comment_func);
-	ret = tje_encode_to_file_at_quality(fd, 3, T1C_WIDTH, T1C_HEIGHT, 4, (unsigned char*) rgb_save_image);
-	if (ret == 1) {
-		// Add the file to our filesystem catalog
-		if (new_dir) {
-			cat_dir_node = file_add_directory_info(dir_name);
-		} else {
-			ret = file_get_named_directory_index(dir_name);
-			if (ret < 0) ret = file_get_num_directories() - 1;
-			cat_dir_node = file_get_indexed_directory(ret);
-		}
-		(void) file_add_file_info(cat_dir_node, file_name);
-		_notify_save_msg_end();
-	} else {
-		// End previous display
-		_notify_save_msg_end();
-		vTaskDelay(pdMS_TO_TICKS(50));  // Allow the output task to clear the previous message
-		
-		// Start new display
-		ESP_LOGE(TAG, "Jpeg save failed");
-		strcpy(file_save_info, "File save failed");
-		_notify_save_msg_start(false);
-		vTaskDelay(pdMS_TO_TICKS(FILE_MSG_DISPLAY_MSEC));
-		_notify_save_msg_end();
+	return NULL;
+}
+
+/**
+ * Encode the FILE_THUMB_W x FILE_THUMB_H RGBA thumbnail at the start of rgb_save_thumb as
+ * a jpeg image following the data in slotP.  Returns the thumbnail length (the slot length
+ * is not changed) or 0 if it could not be encoded.
+ */
+static uint32_t _encode_thumb(jpeg_slot_t* slotP)
+{
+	int ret;
+	uint32_t len = slotP->len;
+	
+	xSemaphoreTake(jpeg_enc_mutex, portMAX_DELAY);
+	tje_register_comment_callback(NULL);
+	tje_register_app_callback(0, NULL);
+	tje_register_strip_callback(NULL, 0);
+	tje_set_chroma_subsampling(0);
+	ret = tje_encode_with_func(_jpeg_slot_write_func, slotP, 2, FILE_THUMB_W, FILE_THUMB_H, 4, (unsigned char*) rgb_save_thumb);
+	xSemaphoreGive(jpeg_enc_mutex);
+	
+	if ((ret != 1) || slotP->overflow) {
+		ESP_LOGE(TAG, "Thumbnail encode failed");
+		slotP->overflow = false;
+		slotP->len = len;
+		return 0;
 	}
 	
-	file_unmount_sdcard();
+	len = slotP->len - len;
+	slotP->len -= len;
+	
+	return len;
 }
 
 
-static bool _read_jpeg_image()
+/**
+ * Shrink the h rows starting at row y of the RGBA image rendered into rgb_save_strip into
+ * the matching rows of the FILE_THUMB_W x FILE_THUMB_H thumbnail at the start of
+ * rgb_save_thumb by averaging each block of pixels.
+ */
+static void _make_thumb_from_strip(int y, int h)
 {
-	bool success = true;
-	FILE* fd;
-	JRESULT res;
-	JDEC jdec;
-	tjpgd_iodev_t devid;
+	const int bw = T1C_WIDTH / FILE_THUMB_W;
+	const int bh = T1C_HEIGHT / FILE_THUMB_H;
+	uint8_t* src = (uint8_t*) rgb_save_strip;
+	uint8_t* dst = (uint8_t*) (rgb_save_thumb + (y / bh)*FILE_THUMB_W);
+	uint8_t* sP;
+	uint32_t sum[3];
+	int c, i, j, x, ty;
 	
-	// Attempt to open the card
-	if (!file_mount_sdcard()) {
-		strcpy(file_save_info, "Can't mount SD Card");
-		return false;
+	for (ty=0; ty<(h / bh); ty++) {
+		for (x=0; x<FILE_THUMB_W; x++) {
+			sum[0] = sum[1] = sum[2] = 0;
+			for (j=0; j<bh; j++) {
+				sP = src + 4*((ty*bh + j)*T1C_WIDTH + x*bw);
+				for (i=0; i<bw; i++) {
+					sum[0] += *sP++;
+					sum[1] += *sP++;
+					sum[2] += *sP++;
+					sP++;
+				}
+			}
+			for (c=0; c<3; c++) {
+				*dst++ = (uint8_t) (sum[c] / (bw*bh));
+			}
+			*dst++ = 0xFF;
+		}
 	}
+}
+
+
+/**
+ * Make the FILE_THUMB_W x FILE_THUMB_H RGBA thumbnail at the start of rgb_save_thumb from
+ * the Y8 image for images that aren't rendered.  Each block of Y8 pixels is averaged and then
+ * looked up in the save palette, which is the same as averaging the rendered pixels for the
+ * gray palettes.
+ */
+static void _make_thumb_from_y8(uint8_t* y8P)
+{
+	const int bw = T1C_WIDTH / FILE_THUMB_W;
+	const int bh = T1C_HEIGHT / FILE_THUMB_H;
+	uint32_t* dst = rgb_save_thumb;
+	uint8_t* sP;
+	uint32_t sum;
+	int i, j, x, y;
 	
-	if (file_open_image_read_file(file_read_filename, &fd)) {
-		// Setup tjpgd to decompress the file
-		devid.fp = fd;
-		res = jd_prepare(&jdec, _tjpgd_in_func, tjpgd_work_buf, TJPGD_WORK_BUF_LEN, &devid);
-//		ESP_LOGI(TAG, "jpeg dim = %d, %d, work = %d", (int) jdec.width, (int) jdec.height, TJPGD_WORK_BUF_LEN - jdec.sz_pool);
-		if (res == JDR_OK) {
-			// Start the decompression
-			devid.fbuf = (uint8_t*) rgb_file_image;
-			devid.wfbuf = jdec.width;
-			res = jd_decomp(&jdec, _tjpgd_out_func, 0);
-			if (res != JDR_OK) {
-				ESP_LOGE(TAG, "jd_decomp failed with %d", (int) res);
-				success = false;
+	for (y=0; y<FILE_THUMB_H; y++) {
+		for (x=0; x<FILE_THUMB_W; x++) {
+			sum = 0;
+			for (j=0; j<bh; j++) {
+				sP = y8P + (y*bh + j)*T1C_WIDTH + x*bw;
+				for (i=0; i<bw; i++) {
+					sum += *sP++;
+				}
 			}
-		} else {
-			ESP_LOGE(TAG, "jd_prepare failed with %d", (int) res);
-			success = false;
+			*dst++ = 0xFF000000 | PALETTE_SAVE_LOOKUP(sum / (bw*bh));
 		}
-		file_close_file(fd);
-	} else {
-		ESP_LOGE(TAG, "Open %s failed", file_read_filename);
-		success = false;
 	}
+}
+
+
+/**
+ * Make the FILE_THUMB_W x FILE_THUMB_H RGBA thumbnail at the start of rgb_save_thumb from
+ * every step pixel of the w pixel wide image decoded into rgb_file_image
+ */
+static void _make_thumb_from_file_image(int w, int step)
+{
+	uint8_t* src;
+	uint8_t* dst = (uint8_t*) rgb_save_thumb;
+	int x, y;
+#if TJPGD_NUM_BPP == 2
+	uint16_t c;
+#endif
 	
-	file_unmount_sdcard();
-	
-	return success;
+	for (y=0; y<FILE_THUMB_H; y++) {
+		for (x=0; x<FILE_THUMB_W; x++) {
+			src = (uint8_t*) rgb_file_image + TJPGD_NUM_BPP*(y*step*w + x*step);
+#if TJPGD_NUM_BPP == 2
+			// RGB565
+#if JD_SWAP_RGB565
+			c = (src[0] << 8) | src[1];
+#else
+			c = (src[1] << 8) | src[0];
+#endif
+			*dst++ = (c >> 8) & 0xF8;
+			*dst++ = (c >> 3) & 0xFC;
+			*dst++ = (c << 3) & 0xF8;
+#else
+			// RGB888
+			*dst++ = src[0];
+			*dst++ = src[1];
+			*dst++ = src[2];
+#endif
+			*dst++ = 0xFF;
+		}
+	}
 }
 
 
@@ -818,7 +3751,19 @@ static void _notify_save_msg_end()
 static size_t _tjpgd_in_func (JDEC* jd, uint8_t* buff, size_t nbyte)
 {
 	tjpgd_iodev_t *dev = (tjpgd_iodev_t*)jd->device;   /* Session identifier (5th argument of jd_prepare function) */
-
+	
+    if (dev->fp == NULL) {
+    	// Read or remove data from the input buffer
+    	if (nbyte > (dev->mem_len - dev->mem_pos)) {
+    		nbyte = dev->mem_len - dev->mem_pos;
+    	}
+    	if (buff) {
+    		memcpy(buff, dev->mem + dev->mem_pos, nbyte);
+    	}
+    	dev->mem_pos += nbyte;
+    	return nbyte;
+    }
+    
     if (buff) {
     	// Read data from imput stream
         return fread(buff, 1, nbyte, dev->fp);
@@ -832,18 +3777,39 @@ static size_t _tjpgd_in_func (JDEC* jd, uint8_t* buff, size_t nbyte)
 static int _tjpgd_out_func (JDEC* jd, void* bitmap, JRECT* rect)
 {
 	tjpgd_iodev_t *dev = (tjpgd_iodev_t*)jd->device;   /* Session identifier (5th argument of jd_prepare function) */
-    uint8_t *src, *dst;
-    uint16_t y, bws;
+    uint8_t *src, *dst, *row;
+    uint16_t x, y, bws;
     unsigned int bwd;
-
+    int i, n;
+	
 	// Copy the output image rectangle to the frame buffer 
     src = (uint8_t*)bitmap;
-    dst = dev->fbuf + TJPGD_NUM_BPP * (rect->top * dev->wfbuf + rect->left);
+    dst = dev->fbuf + TJPGD_NUM_BPP * (((rect->top * dev->wfbuf) + rect->left) << dev->expand);
     bws = TJPGD_NUM_BPP * (rect->right - rect->left + 1);
     bwd = TJPGD_NUM_BPP * dev->wfbuf;
-    for (y = rect->top; y <= rect->bottom; y++) {
-        memcpy(dst, src, bws);
-        src += bws; dst += bwd;
+    if (dev->expand == 0) {
+        for (y = rect->top; y <= rect->bottom; y++) {
+            memcpy(dst, src, bws);
+            src += bws; dst += bwd;
+        }
+    } else {
+        // Write each pixel as a block directly in the display format: expand a row
+        // horizontally into the first row of the blocks and then copy it to the rest
+        n = 1 << dev->expand;
+        for (y = rect->top; y <= rect->bottom; y++) {
+            row = dst;
+            for (x = rect->left; x <= rect->right; x++) {
+                for (i = 0; i < n; i++) {
+                    memcpy(dst, src, TJPGD_NUM_BPP);
+                    dst += TJPGD_NUM_BPP;
+                }
+                src += TJPGD_NUM_BPP;
+            }
+            for (i = 1; i < n; i++) {
+                memcpy(row + i*bwd, row, n*bws);
+            }
+            dst = row + n*bwd;
+        }
     }
 	
     return 1;    /* Continue to decompress */
@@ -882,7 +3848,13 @@ static char* _tjpgd_comment_func(int item_index, char* buf)
 			time_get_disp_string(&te, &buf[6]);
 			break;
 		case 5:
-			if (timelapse_running == false) {
+			if (enc_burst_index >= 0) {
+				sprintf(buf, "Type: Burst %d of %d (+%d mSec)", enc_burst_index + 1, burst_num,
+				        (int) ((enc_t1cP->frame_usec - file_burst_buffer[burst_first].frame_usec) / 1000));
+			} else if (enc_movie) {
+				sprintf(buf, "Type: Movie frame %lu (+%d mSec)", record_num_frames + 1,
+				        (int) ((enc_t1cP->frame_usec - record_start_usec) / 1000));
+			} else if (timelapse_running == false) {
 				strcpy(buf, "Type: Single");
 			} else {
 				sprintf(buf, "Type: Timelapse %lu of %lu", timelapse_img_count, cur_timelapse_config.timelapse_count);
@@ -904,50 +3876,50 @@ static char* _tjpgd_comment_func(int item_index, char* buf)
 			sprintf(buf, "Palette: %s", get_palette_name(out_state.sav_palette_index));
 			break;
 		case 8:
-			sprintf(buf, "Scene Min: %1.1f °%c (%u, %u)", temp_to_float_temp(file_t1c_buffer.max_min_temp_info.min_temp, out_state.temp_unit_C),
-			        out_state.temp_unit_C ? 'C' : 'F', file_t1c_buffer.max_min_temp_info.min_temp_point.x, file_t1c_buffer.max_min_temp_info.min_temp_point.y);
+			sprintf(buf, "Scene Min: %1.1f °%c (%u, %u)", temp_to_float_temp(enc_t1cP->max_min_temp_info.min_temp, out_state.temp_unit_C),
+			        out_state.temp_unit_C ? 'C' : 'F', enc_t1cP->max_min_temp_info.min_temp_point.x, enc_t1cP->max_min_temp_info.min_temp_point.y);
 			break;
 		case 9:
-			sprintf(buf, "Scene Max: %1.1f °%c (%u, %u)", temp_to_float_temp(file_t1c_buffer.max_min_temp_info.max_temp, out_state.temp_unit_C),
-			        out_state.temp_unit_C ? 'C' : 'F', file_t1c_buffer.max_min_temp_info.max_temp_point.x, file_t1c_buffer.max_min_temp_info.max_temp_point.y);
+			sprintf(buf, "Scene Max: %1.1f °%c (%u, %u)", temp_to_float_temp(enc_t1cP->max_min_temp_info.max_temp, out_state.temp_unit_C),
+			        out_state.temp_unit_C ? 'C' : 'F', enc_t1cP->max_min_temp_info.max_temp_point.x, enc_t1cP->max_min_temp_info.max_temp_point.y);
 			break;
 		case 10:
 			if (out_state.spotmeter_enable) {
-				sprintf(buf, "Spot Meter: %1.1f °%c (%u, %u)", temp_to_float_temp(file_t1c_buffer.spot_temp, out_state.temp_unit_C),
-				        out_state.temp_unit_C ? 'C' : 'F', file_t1c_buffer.spot_point.x, file_t1c_buffer.spot_point.y);
+				sprintf(buf, "Spot Meter: %1.1f °%c (%u, %u)", temp_to_float_temp(enc_t1cP->spot_temp, out_state.temp_unit_C),
+				        out_state.temp_unit_C ? 'C' : 'F', enc_t1cP->spot_point.x, enc_t1cP->spot_point.y);
 			} else {
 				strcpy(buf, "Spot Meter: Not Enabled");
 			}
 			break;
 		case 11:
 			if (out_state.region_enable) {
-				sprintf(buf, "Region Meter Avg: %1.1f °%c (%u, %u) - (%u, %u)", temp_to_float_temp(file_t1c_buffer.region_temp_info.temp_info_value.ave_temp, out_state.temp_unit_C),
+				sprintf(buf, "Region Meter Avg: %1.1f °%c (%u, %u) - (%u, %u)", temp_to_float_temp(enc_t1cP->region_temp_info.temp_info_value.ave_temp, out_state.temp_unit_C),
 				        out_state.temp_unit_C ? 'C' : 'F',
-				        file_t1c_buffer.region_points.start_point.x, file_t1c_buffer.region_points.start_point.y,
-				        file_t1c_buffer.region_points.end_point.x, file_t1c_buffer.region_points.end_point.y);
+				        enc_t1cP->region_points.start_point.x, enc_t1cP->region_points.start_point.y,
+				        enc_t1cP->region_points.end_point.x, enc_t1cP->region_points.end_point.y);
 			} else {
 				strcpy(buf, "Region Meter Avg: Not Enabled");
 			}
 			break;
 		case 12:
 			if (out_state.region_enable) {
-				sprintf(buf, "Region Meter Min: %1.1f °%c (%u, %u)", temp_to_float_temp(file_t1c_buffer.region_temp_info.temp_info_value.min_temp, out_state.temp_unit_C),
-				        out_state.temp_unit_C ? 'C' : 'F', file_t1c_buffer.region_temp_info.min_temp_point.x, file_t1c_buffer.region_temp_info.min_temp_point.y);
+				sprintf(buf, "Region Meter Min: %1.1f °%c (%u, %u)", temp_to_float_temp(enc_t1cP->region_temp_info.temp_info_value.min_temp, out_state.temp_unit_C),
+				        out_state.temp_unit_C ? 'C' : 'F', enc_t1cP->region_temp_info.min_temp_point.x, enc_t1cP->region_temp_info.min_temp_point.y);
 			} else {
 				strcpy(buf, "Region Meter Min: Not Enabled");
 			}
 			break;
 		case 13:
 			if (out_state.region_enable) {
-				sprintf(buf, "Region Meter Max: %1.1f °%c (%u, %u)", temp_to_float_temp(file_t1c_buffer.region_temp_info.temp_info_value.max_temp, out_state.temp_unit_C),
-				        out_state.temp_unit_C ? 'C' : 'F', file_t1c_buffer.region_temp_info.max_temp_point.x, file_t1c_buffer.region_temp_info.max_temp_point.y);
+				sprintf(buf, "Region Meter Max: %1.1f °%c (%u, %u)", temp_to_float_temp(enc_t1cP->region_temp_info.temp_info_value.max_temp, out_state.temp_unit_C),
+				        out_state.temp_unit_C ? 'C' : 'F', enc_t1cP->region_temp_info.max_temp_point.x, enc_t1cP->region_temp_info.max_temp_point.y);
 			} else {
 				strcpy(buf, "Region Meter Max: Not Enabled");
 			}
 			break;
 		case 14:
-			if (file_t1c_buffer.amb_temp_valid) {
-				t = (int) file_t1c_buffer.amb_temp;
+			if (enc_t1cP->amb_temp_valid) {
+				t = (int) enc_t1cP->amb_temp;
 				if (!out_state.temp_unit_C) {
 					t = t * 9.0 / 5.0 + 32.0;
 				}
@@ -958,19 +3930,19 @@ static char* _tjpgd_comment_func(int item_index, char* buf)
 			}
 			break;
 		case 15:
-			if (file_t1c_buffer.amb_hum_valid) {
-				sprintf(buf, "Environmental Humidity: %u%% (Correction %s)", file_t1c_buffer.amb_hum, out_state.use_auto_ambient ? "Enabled" : "Disabled");
+			if (enc_t1cP->amb_hum_valid) {
+				sprintf(buf, "Environmental Humidity: %u%% (Correction %s)", enc_t1cP->amb_hum, out_state.use_auto_ambient ? "Enabled" : "Disabled");
 			} else {
 				strcpy(buf, "Environmental Humidity: Not available");
 			}
 			break;
 		case 16:
-			if (file_t1c_buffer.distance_valid) {
+			if (enc_t1cP->distance_valid) {
 				if (out_state.temp_unit_C) {
-					d = (float) file_t1c_buffer.distance / 100.0;
+					d = (float) enc_t1cP->distance / 100.0;
 					sprintf(buf, "Environmental Distance: %1.2f m (Correction %s)", d, out_state.use_auto_ambient ? "Enabled" : "Disabled");
 				} else {
-					d = (float) file_t1c_buffer.distance / (2.54 * 12);
+					d = (float) enc_t1cP->distance / (2.54 * 12);
 					i = floor(d);
 					t = round((d - i) * 12);
 					if (t == 12) {
@@ -1056,3 +4028,100 @@ static char* _tjpgd_comment_func(int item_index, char* buf)
 	
 	return buf;
 }
+
+
+/**
+ * Stream the raw file for a radiometric jpeg file into its segments: the header in the
+ * first, followed by as many Rice coded image rows as fit in each
+ */
+static int _tjpgd_app_func(int seg_index, unsigned char* buf)
+{
+	tmElements_t te;
+	uint8_t* dP = buf;
+	
+	if (seg_index == 0) {
+		enc_y16_row = 0;
+	} else if (enc_y16_row >= T1C_HEIGHT) {
+		return 0;
+	}
+	
+	memcpy(dP, FILE_RAW_APP_ID, FILE_RAW_APP_ID_LEN);
+	dP += FILE_RAW_APP_ID_LEN;
+	
+	if (seg_index == 0) {
+		time_get(&te);
+		dP += file_raw_encode_header(enc_t1cP, &file_t1c_meta, &te, FILE_RAW_ENC_RICE, 0, dP);
+	}
+	
+	dP += y16_codec_encode_chunk(&enc_y16_codec, enc_t1cP->img_data, T1C_WIDTH, T1C_HEIGHT, &enc_y16_row, dP, TJEI_APP_LEN - (dP - buf));
+	
+	return (dP - buf);
+}
+
+
+/**
+ * Render the h rows of the image being encoded starting at row y into rgb_save_strip for
+ * the jpeg encoder
+ */
+static const unsigned char* _tjpgd_strip_func(int y, int h)
+{
+	int i;
+	uint8_t* grayP;
+	uint8_t* srcP;
+	
+	if (enc_gray) {
+		// Inverted grayscale
+		grayP = (uint8_t*) rgb_save_strip;
+		srcP = t1c_get_y8_data(enc_t1cP, T1C_Y8F_OUT_SAVE) + y*T1C_WIDTH;
+		for (i=0; i<h*T1C_WIDTH; i++) {
+			grayP[i] = 255 - *srcP++;
+		}
+		return (const unsigned char*) rgb_save_strip;
+	}
+	
+	// Render the raw Tiny1C data into 24-bit RGB (RGB888) and then any enabled overlay
+	file_render_t1c_rows(enc_t1cP, rgb_save_strip, (int16_t) y, (int16_t) h);
+	if (out_state.save_ovl_en) {
+		file_render_set_strip((int16_t) y, (int16_t) h);
+		_render_overlay(enc_t1cP);
+	}
+	
+	if (enc_thumb) {
+		_make_thumb_from_strip(y, h);
+	}
+	
+	return (const unsigned char*) rgb_save_strip;
+}
+
+
+/**
+ * Draw the enabled overlay items into the current render strip
+ */
+static void _render_overlay(t1c_buffer_t* t1cP)
+{
+	// Draw enabled markers
+	if (out_state.min_max_mrk_enable && t1cP->minmax_valid) {
+		file_render_min_max_markers(t1cP, rgb_save_strip, &out_state);
+	}
+	
+	if (out_state.region_enable && t1cP->region_valid) {
+		file_render_region_marker(t1cP, rgb_save_strip, &out_state);
+		file_render_region_temps(t1cP, rgb_save_strip, &out_state);
+	}
+	
+	file_render_roi_markers(t1cP, rgb_save_strip, &out_state);
+	
+	if (out_state.spotmeter_enable && t1cP->spot_valid) {
+		file_render_spotmeter(t1cP, rgb_save_strip, &out_state);
+	}
+	
+	// Then draw the palette (over a marker if necessary)
+	file_render_palette(rgb_save_strip, &out_state);
+	file_render_min_max_temps(t1cP, rgb_save_strip, &out_state);
+	if (out_state.spotmeter_enable && t1cP->spot_valid) {
+		file_render_palette_marker(t1cP, rgb_save_strip, &out_state);
+	}
+	
+	// Finally add environmental conditions if they exist
+	file_render_env_info(t1cP, rgb_save_strip, &out_state);
+}
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "file_utilities.h"
 
 
 //
@@ -40,19 +41,55 @@
 //
 #define FILE_NOTIFY_CARD_PRESENT_MASK     0x00000001
 #define FILE_NOTIFY_CARD_REMOVED_MASK     0x00000002
+#define FILE_NOTIFY_TRIGGER_MASK          0x00000004
 
+#define FILE_NOTIFY_RECORD_MASK           0x00000008
 #define FILE_NOTIFY_SAVE_JPG_MASK         0x00000010
 #define FILE_NOTIFY_T1C_FRAME_MASK        0x00000020
+#define FILE_NOTIFY_BURST_MASK            0x00000040
+#define FILE_NOTIFY_T1C_BURST_MASK        0x00000080
 
 #define FILE_NOTIFY_GUI_GET_CATALOG_MASK  0x00000100
 #define FILE_NOTIFY_GUI_GET_IMAGE_MASK    0x00000200
-#define FILE_NOTIFY_GUI_DEL_FILE_MASK     0x00000400
-#define FILE_NOTIFY_GUI_DEL_DIR_MASK      0x00000800
+#define FILE_NOTIFY_GUI_DELETE_MASK       0x00000400
+#define FILE_NOTIFY_GUI_GET_RANGE_MASK    0x00000800
 #define FILE_NOTIFY_GUI_FORMAT_MASK       0x00001000
+#define FILE_NOTIFY_GUI_GET_JPEG_MASK     0x00002000
+#define FILE_NOTIFY_GUI_GET_PAGE_MASK     0x00004000
+#define FILE_NOTIFY_GUI_GET_THUMB_MASK    0x00008000
 
 #define FILE_NOTIFY_FW_UPD_EN_MASK        0x00010000
 #define FILE_NOTIFY_FW_UPD_END_MASK       0x00020000
 
+#define FILE_NOTIFY_T1C_STATS_MASK        0x00040000
+#define FILE_NOTIFY_PRE_TRIGGER_MASK      0x00080000
+#define FILE_NOTIFY_BENCHMARK_MASK        0x00100000
+#define FILE_NOTIFY_REPLAY_MASK           0x00200000
+#define FILE_NOTIFY_SYNC_MASK             0x00400000
+#define FILE_NOTIFY_T1C_FW_UPD_MASK       0x00800000
+#define FILE_NOTIFY_LOG_MASK              0x01000000
+#define FILE_NOTIFY_SCREENSHOT_MASK       0x02000000
+
+
+
+//
+// File Task typedefs
+//
+
+// Output function for file_encode_jpeg (called with successive pieces of the jpeg data)
+typedef void file_jpeg_write_func(void* context, void* data, int size);
+
+// Event trigger configuration (see CMD_TRIGGER_CFG in cmd_list.h)
+typedef struct {
+	uint8_t mode;                // CMD_TRIG_xxx
+	uint8_t action;              // CMD_TRIG_ACT_xxx
+	uint8_t pre_frames;          // Pre-trigger frames for a burst
+	uint8_t record_fps;          // Recording rate
+	uint32_t post;               // Burst frames or recording mSec
+	uint32_t threshold;
+	uint32_t holdoff_msec;       // Minimum time between triggers
+} file_trigger_config_t;
+
 
 
 //
@@ -63,8 +100,26 @@ bool file_card_available();
 char* file_get_file_save_status_string();  // To be called by an output task after getting file save notification
 void file_set_catalog_index(int type);     // -1 = folder index, 0.. file index for specified folder index
 char* file_get_catalog(int* num, int* type);
-void file_set_delete_file(int dir_index, int file_index);
+void file_set_catalog_page(int type, int offset, int count);
+file_catalog_entry_t* file_get_catalog_page_entries(int* num, int* type, int* offset, int* total);
+void file_set_catalog_range(uint32_t start, uint32_t end, int offset);  // FAT timestamps
+file_range_entry_t* file_get_catalog_range_entries(int* num, uint32_t* start, uint32_t* end, int* offset, int* total);
+bool file_set_delete_file(int dir_index, int file_index);  // file_index -1 for the directory
 void file_set_image_fileinfo(int dir_index, int file_index);
+uint32_t file_get_jpeg_file_len();         // Length of the jpeg file read into rgb_file_image
+int file_read_card_file(char* dir_name, char* file_name, uint32_t offset, uint8_t* buf, uint32_t len);
 void file_set_timelapse_info(bool en, bool notify, uint32_t interval, uint32_t num);
+bool file_is_timelapse_wakeup();           // CONFIG_TIMELAPSE_SLEEP_ENABLE only
+void file_set_burst_info(int num);         // 1 - FILE_BURST_MAX_FRAMES
+void file_set_record_info(int fps);        // 0 to stop, 1 - CMD_RECORD_MAX_FPS to start
+void file_set_log_info(int rate);          // 0 to stop, 1 - CMD_LOG_MAX_RATE to start
+void file_set_trigger_info(file_trigger_config_t* cfg);
+void file_set_pre_trigger_info(int num);   // 0 - FILE_BURST_MAX_FRAMES-1 frames before a picture
+void file_set_sync_capture(int64_t target_usec);  // esp_timer time to capture closest to
+void file_set_screenshot_info(uint16_t* fb, int w, int h, bool swapped);  // CONFIG_SCREENDUMP_ENABLE only
+void file_set_replay_info(char* dir_name); // Directory of raw files to replay into t1c_task
+void file_set_replay_rate(int fps);        // 0 - CMD_REPLAY_MAX_FPS (0 is unpaced)
+int file_get_replay_rate();
+bool file_encode_jpeg(uint32_t* rgb, int quality, file_jpeg_write_func* func, void* context);
 
 #endif /* FILE_TASK_H */
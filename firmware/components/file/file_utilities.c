@@ -24,6 +24,7 @@
 #include "sys_utilities.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -37,6 +38,7 @@
 #include "vfs_fat_internal.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
@@ -54,11 +56,97 @@
 // Uncomment to debug filesystem information structure (generates a lot of data)
 //#define DEBUG_FS_INFO_STRUCT
 
+// Catalog index file.  It starts with a header followed by a log of catalog changes
+// that is replayed to recreate the catalog when the card is mounted instead of scanning
+// the card.  The file is preallocated for the maximum number of records so updates only
+// rewrite existing sectors.  It is rebuilt from the catalog when the card was changed
+// elsewhere or the log fills.  Values are stored in the ESP32's byte order.
+#define FILE_INDEX_NAME      "/DCIM/ICAMCAT.IDX"
+#define FILE_INDEX_MAGIC     0x58444943
+#define FILE_INDEX_VERSION   1
+#define FILE_INDEX_MAX_RECS  (FILE_CAT_MAX_DIRS + FILE_CAT_MAX_FILES + 1024)
+#define FILE_INDEX_LEN       (sizeof(file_index_hdr_t) + FILE_INDEX_MAX_RECS*sizeof(file_index_rec_t))
+#define FILE_INDEX_BUF_RECS  16
+
+// Format cluster sizes (following the SD Association recommendations for FAT32 where
+// larger cards have larger erase blocks).  FAT32 clusters are limited to 64 kB.
+#define FILE_FMT_SDHC_MIN_BYTES   (4ULL * 1024 * 1024 * 1024)
+#define FILE_FMT_SDXC_MIN_BYTES   (32ULL * 1024 * 1024 * 1024)
+#define FILE_FMT_SDHC_AU_SIZE     (32 * 1024)
+#define FILE_FMT_SDXC_AU_SIZE     (64 * 1024)
+
+// Index record operations
+#define FILE_INDEX_OP_ADD_DIR  1
+#define FILE_INDEX_OP_ADD_FILE 2
+#define FILE_INDEX_OP_DEL_DIR  3
+#define FILE_INDEX_OP_DEL_FILE 4
+#define FILE_INDEX_OP_SYNC     5
+
+// Catalog capacity in file_info_bufferP.  Room is reserved for every possible "NNNICAMF"
+// directory and the rest holds files so there is no per-directory limit.
+#define FILE_CAT_MAX_DIRS    1000
+#define FILE_CAT_MAX_FILES   ((FILE_INFO_BUFFER_LEN - FILE_CAT_MAX_DIRS*sizeof(file_dir_rec_t)) / sizeof(file_file_rec_t))
+
+// Catalog file types (file_file_rec_t key type bits) in file_rec_type_ext order
+#define FILE_REC_TYPE_BITS   2
+#define FILE_REC_TYPE_MASK   0x3
+#define FILE_REC_NUM_TYPES   4
+
+
+
+//
+// File Utilities internal types
+//
+
+// Catalog records.  Names always follow the "NNNICAMF" and "ICAM_NNNN.ext" patterns so
+// only the numbers are stored and names are generated when needed.  Directories are kept
+// sorted by number.  Files are kept in one table sorted by directory then by number and
+// type so each directory's files are contiguous and their position in the table is their
+// absolute index.
+typedef struct {
+	uint16_t num;             // NNN
+	uint16_t num_files;
+	uint32_t first_file;      // file_table index of the first file in the directory
+	uint32_t timestamp;       // FAT date (upper 16 bits) and time (lower 16 bits)
+} file_dir_rec_t;
+
+typedef struct {
+	uint16_t key;             // NNNN << FILE_REC_TYPE_BITS | type
+	uint16_t reserved;
+	uint32_t size;
+	uint32_t timestamp;
+} file_file_rec_t;
+
+// Catalog index file
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_recs;
+	uint32_t n_fatent;        // Filesystem geometry when written
+	uint32_t csize;
+	uint32_t reserved[11];
+} file_index_hdr_t;
+
+typedef struct {
+	uint32_t op;
+	uint32_t free_clusters;   // Free clusters after the change
+	uint32_t size;
+	uint32_t timestamp;
+	char dir_name[DIR_NAME_LEN];
+	char file_name[32];
+} file_index_rec_t;
+
+_Static_assert(FILE_CAT_MAX_FILES >= MAX_NUM_DIRS*MAX_FILES_PER_DIR, "FILE_INFO_BUFFER_LEN too small for catalog");
+_Static_assert(sizeof(file_index_hdr_t) == sizeof(file_index_rec_t), "Catalog index record size mismatch");
+
 //
 // File Utilities internal variables
 //
 static const char* TAG = "file_utilities";
 
+// Catalog file type extensions (FILE_REC_NUM_TYPES entries in sort order)
+static const char* file_rec_type_ext[FILE_REC_NUM_TYPES] = {".JPG", ".LOG", ".MJPG", ".RAW"};
+
 static const char base_path[] = "/sdcard";
 
 #ifdef FILE_USE_SPI_IF
@@ -97,17 +185,46 @@ static bool write_dir_is_new;
 static char write_dir_name[DIR_NAME_LEN];
 static char write_file_name[FILE_NAME_LEN];
 
-// Pointer to indexed storage
-static void* file_info_cur_bufferP;
-static directory_node_t* indexed_fs_rootP;
+// Image and movie file being written
+static FIL write_fil;
+static uint32_t write_buf_len;   // Bytes waiting in file_write_bufferP
+static DWORD write_fattime;      // FAT timestamp when it was opened
+
+// Catalog (in file_info_bufferP)
+static file_dir_rec_t* dir_table;
+static file_file_rec_t* file_table;
+static int num_dirs = 0;
+static int num_files_total = 0;
+static int peak_dirs = 0;
+static int peak_files = 0;
+
+// Firmware update file being read
+static FIL fw_fil;
+static bool fw_fil_open = false;
+
+// Catalog index file state (the FIL is static because it holds a sector buffer)
+static FIL index_fil;
+static bool index_valid = false;
+static int index_num_recs;
+static file_index_hdr_t index_hdr;
+static file_index_rec_t index_rec_buf[FILE_INDEX_BUF_RECS];
 
 // Mutex to protect access to the indexed storage data structure
 static SemaphoreHandle_t catalog_mutex;
 
+// Card write statistics (updated by file_task, read by other tasks)
+static portMUX_TYPE write_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static file_write_stats_t write_stats;
+static const char* write_op_names[FILE_NUM_OPS] = {"Mount", "Open", "Write", "Close"};
+
 // Card Info
 static uint64_t card_total_bytes = 0;
 static uint64_t card_free_bytes = 0;
 
+// Free cluster count kept across unmount/mount of the same card so a remount doesn't
+// require f_getfree to scan the FAT (0xFFFFFFFF when unknown)
+static DWORD saved_free_clst = 0xFFFFFFFF;
+
 
 
 //
@@ -119,16 +236,32 @@ static bool file_init_sdspi_driver();
 static bool file_init_sdmmc_driver();
 #endif
 static void file_get_card_stats();
+static size_t file_format_au_size();
 static bool file_create_directory(char* dir_name);
-static directory_node_t* file_insert_directory_info(char* name);
-static file_node_t* file_insert_file_info(directory_node_t* dirP, char* name);
-static directory_node_t* file_allocate_dir_entry();
-static file_node_t* file_allocate_file_entry();
-static char* file_allocate_name_entry(char* name);
+static void file_reset_filesystem_info();
+static bool file_parse_dir_name(char* name, uint16_t* num);
+static bool file_parse_file_name(char* name, uint16_t* key);
+static void file_make_dir_name(file_dir_rec_t* dirP, char* name);
+static void file_make_file_name(file_file_rec_t* fileP, char* name);
+static int file_search_directory(uint16_t num, int* insertP);
+static int file_search_file(int dir_index, uint16_t key, int* insertP);
+static int file_compare_files(const void* a, const void* b);
+static int file_insert_directory_info(char* name);
+static int file_insert_file_info(int dir_index, char* name);
+static void file_remove_directory_info(int n);
+static void file_remove_file_info(int dir_index, int n);
 static bool file_is_valid_dir(char* name);
 static bool file_is_valid_name(char* name);
 static FRESULT delete_node (TCHAR* path, UINT sz_buff, FILINFO* fno);
-static int parse_filename_for_number(const char* name);
+static bool file_set_write_names(const char* ext);
+static bool file_open_write_file(uint32_t prealloc_len);
+static bool file_flush_write_file();
+static uint32_t file_get_stats(char* dir_name, char* file_name, uint32_t* size);
+static bool file_index_load();
+static bool file_index_rebuild();
+static void file_index_log(uint32_t op, char* dir_name, char* file_name, uint32_t size, uint32_t timestamp);
+static void file_update_catalog_peaks();
+static void file_record_write_op(int op, int64_t start_usec, uint32_t len);
 
 #ifdef DEBUG_FS_INFO_STRUCT
 static void dump_filesystem_info();
@@ -148,7 +281,7 @@ bool file_init_driver()
 {
 	// Create the indexed storage data structure protection mutex
 	catalog_mutex = xSemaphoreCreateMutex();
-
+	
 #ifdef FILE_USE_SPI_IF
 	return file_init_sdspi_driver();
 #else
@@ -195,9 +328,10 @@ bool file_format_card()
 	// Format the partition
 	size_t alloc_unit_size = esp_vfs_fat_get_allocation_unit_size(
             sd_card.csd.sector_size,
-            mount_config.allocation_unit_size);
+            file_format_au_size());
     MKFS_PARM opt = {(BYTE)FM_ANY, 1, 0, 0, alloc_unit_size};
     ESP_LOGI(TAG, "formatting card, allocation unit size=%d", alloc_unit_size);
+    saved_free_clst = 0xFFFFFFFF;
     ret = f_mkfs("", &opt, workbuf, workbuf_size);
     if (ret != FR_OK) {
         free(workbuf);
@@ -223,7 +357,7 @@ bool file_init_card()
 	if (sdmmc_card_init(&host_driver, &sd_card) != ESP_OK) {
  		return false;
  	}
-
+	
  	return true;
 }
 
@@ -242,6 +376,14 @@ bool file_reinit_card()
 		return false;
 	}
 	
+	// A different card may have been inserted
+	saved_free_clst = 0xFFFFFFFF;
+	
+	// Write statistics are for the card that was inserted
+	portENTER_CRITICAL(&write_stats_mux);
+	memset(&write_stats, 0, sizeof(file_write_stats_t));
+	portEXIT_CRITICAL(&write_stats_mux);
+	
 	return true;
 }
 
@@ -253,6 +395,7 @@ bool file_mount_sdcard()
 {
 	FILINFO fno;
 	FRESULT ret;
+	int64_t start_usec = esp_timer_get_time();
 	
 	// Attempt to mount the default drive immediately to verify it's still present
 	ret = f_mount(fat_fs, "", 1);
@@ -273,6 +416,12 @@ bool file_mount_sdcard()
 		return false;
 	}
 	
+	// Restore the free cluster count from the last time this card was mounted.  FatFs
+	// keeps it up to date as files are written and deleted while mounted.
+	if (saved_free_clst <= (fat_fs->n_fatent - 2)) {
+		fat_fs->free_clst = saved_free_clst;
+	}
+	
 	// Make sure that the top-level DCIM folder exists
 	ret = f_stat("/DCIM", &fno);
 	if (ret == FR_NO_FILE) {
@@ -298,11 +447,13 @@ bool file_mount_sdcard()
 		return false;
 	}
 	
-	// Update usage information every time we mount a card
+	// Update usage information every time we mount a card (only slow for the first mount
+	// after a card is inserted when the FAT may have to be scanned)
 	file_get_card_stats();
 	
 	card_mounted = true;
-
+	file_record_write_op(FILE_OP_MOUNT, start_usec, 0);
+	
 	return true;
 }
 
@@ -334,6 +485,65 @@ bool file_delete_directory(char* dir_name)
 }
 
 
+/**
+ * Delete one entry from a directory, or the directory itself once it is empty, so a
+ * large directory can be deleted a piece at a time between other card accesses.  Returns
+ * 1 when an entry was deleted, 0 when the directory was deleted and -1 on failure.  The
+ * same catalog requirements as file_delete_directory apply.  The filesystem should be
+ * mounted.
+ */
+int file_delete_directory_step(char* dir_name)
+{
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 32];        // include room for full file pathname + extra for delete_node work buffer
+	int n;
+	FRESULT ret;
+	FF_DIR dir;
+	FILINFO fno;
+	
+	// Get the first remaining entry
+	n = sprintf(full_name, "/DCIM/%s", dir_name);
+	ret = f_opendir(&dir, full_name);
+	if (ret == FR_OK) {
+		ret = f_readdir(&dir, &fno);
+		f_closedir(&dir);
+	}
+	if (ret != FR_OK) {
+		ESP_LOGE(TAG, "Read %s failed (%d)", full_name, ret);
+		return -1;
+	}
+	
+	if (fno.fname[0] == 0) {
+		// Empty - delete the directory itself
+		ret = f_unlink(full_name);
+		if (ret != FR_OK) {
+			ESP_LOGE(TAG, "Delete %s failed (%d)", full_name, ret);
+			return -1;
+		}
+		ESP_LOGI(TAG, "Delete directory %s", full_name);
+		return 0;
+	}
+	
+	if ((n + 1 + strlen(fno.fname)) >= sizeof(full_name)) {
+		ESP_LOGE(TAG, "Name too long in %s", full_name);
+		return -1;
+	}
+	full_name[n] = '/';
+	strcpy(&full_name[n+1], fno.fname);
+	
+	if (fno.fattrib & AM_DIR) {
+		ret = delete_node(full_name, sizeof(full_name), &fno);
+	} else {
+		ret = f_unlink(full_name);
+	}
+	if (ret != FR_OK) {
+		ESP_LOGE(TAG, "Delete %s failed (%d)", full_name, ret);
+		return -1;
+	}
+	
+	return 1;
+}
+
+
 /**
  * Delete a file.  The filesystem should be mounted.
  */
@@ -359,88 +569,316 @@ bool file_delete_file(char* dir_name, char* file_name)
 
 
 /**
- * Open a file for writing an image or movie to and return a file pointer to it
+ * Open a new image or movie file with extension ext (e.g. ".JPG") for writing with
+ * file_write_file.  When prealloc_len is non-zero the file is preallocated as that many
+ * contiguous bytes when possible so the card doesn't have to search for free clusters as
+ * it is written.  Only one file can be open for writing at a time.
  */
-bool file_open_image_write_file(FILE** fp)
+bool file_open_image_write_file(const char* ext, uint32_t prealloc_len)
 {
-	char full_name[sizeof(base_path) + DIR_NAME_LEN + FILE_NAME_LEN + 9]; // include room for "DCIM" + '/' characters
-	directory_node_t* dirP;
-	file_node_t* fileP = NULL;
-	int dir_num;
-	int num_dirs = 0;
-	int num_files = 0;
-	int new_file_num;
+	if (!file_set_write_names(ext)) {
+		return false;
+	}
 	
-	// Get the total number of directories, a pointer to the last directory if it exists,
-	// and the number of files in it.  Then get a pointer to the last file in that directory
-	// if it exists.
-	dirP = indexed_fs_rootP;
-	if (dirP != NULL) {
-		num_dirs = 1;
-		num_files = dirP->num_files;
-		while (dirP->nextP != NULL) {
-			dirP = dirP->nextP;
-			num_dirs += 1;
-			num_files = dirP->num_files;
-		}
+	return file_open_write_file(prealloc_len);
+}
+
+
+/**
+ * Open a file for writing with the same number and in the same directory as the file
+ * last opened by file_open_image_write_file but with a different extension
+ */
+bool file_open_image_sibling_file(const char* ext, uint32_t prealloc_len)
+{
+	char* cP;
+	
+	// Replace the extension
+	cP = strrchr(write_file_name, '.');
+	if (cP == NULL) {
+		return false;
+	}
+	strcpy(cP, ext);
+	write_dir_is_new = false;
+	
+	return file_open_write_file(prealloc_len);
+}
+
+
+/**
+ * Write len bytes to the open write file.  The data is collected in the DMA capable
+ * file_write_bufferP and written FILE_WRITE_BUF_LEN bytes at a time so FatFs hands the
+ * driver large, sector (and for most cards cluster) aligned multi-sector writes instead
+ * of the driver copying data from external RAM a sector at a time.
+ */
+bool file_write_file(const uint8_t* bufP, uint32_t len)
+{
+	uint32_t n;
+	
+	while (len != 0) {
+		n = FILE_WRITE_BUF_LEN - write_buf_len;
+		if (n > len) n = len;
+		memcpy(file_write_bufferP + write_buf_len, bufP, n);
+		write_buf_len += n;
+		bufP += n;
+		len -= n;
 		
-		fileP = dirP->fileP;
-		if (fileP != NULL) {
-			while (fileP->nextP != NULL) {
-				fileP = fileP->nextP;
+		if (write_buf_len == FILE_WRITE_BUF_LEN) {
+			if (!file_flush_write_file()) {
+				return false;
 			}
 		}
 	}
 	
-	// Get the current highest numbered file from its name if possible
-	if (fileP != NULL) {
-		new_file_num = parse_filename_for_number(fileP->nameP) + 1;
-	} else {
-		new_file_num = 1;
-	}
-	num_files += 1;
+	return true;
+}
+
+
+/**
+ * Write any remaining data and close the open write file, trimming any unused
+ * preallocated space.  The file is given the time it was opened (when the capture of a
+ * movie or log file started) instead of the time it was last written so the catalog can
+ * be searched by capture time.
+ */
+bool file_close_write_file()
+{
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 8];
+	bool success;
+	int64_t start_usec;
+	FILINFO fno;
 	
-	// Determine the directory number to use and if a new directory is needed
-	if ((dirP == NULL) || (num_files > MAX_FILES_PER_DIR)) {
-		// Need a new directory
-		dir_num = DIR_NAME_START_NUM + num_dirs;
-	} else {
-		// Use the existing directory
-		dir_num = DIR_NAME_START_NUM + (num_dirs - 1);
+	success = file_flush_write_file();
+	start_usec = esp_timer_get_time();
+	if (success && (f_tell(&write_fil) < f_size(&write_fil))) {
+		if (f_truncate(&write_fil) != FR_OK) {
+			ESP_LOGE(TAG, "Could not truncate %s", write_file_name);
+			success = false;
+		}
+	}
+	if (f_close(&write_fil) != FR_OK) {
+		success = false;
 	}
+	if (success && (get_fattime() != write_fattime)) {
+		sprintf(full_name, "/DCIM/%s/%s", write_dir_name, write_file_name);
+		fno.fdate = (WORD) (write_fattime >> 16);
+		fno.ftime = (WORD) write_fattime;
+		if (f_utime(full_name, &fno) != FR_OK) {
+			ESP_LOGW(TAG, "Could not set the time of %s", full_name);
+		}
+	}
+	file_record_write_op(FILE_OP_CLOSE, start_usec, 0);
 	
-	// Error if too many dirs
-	if ((dir_num - DIR_NAME_START_NUM) >= MAX_NUM_DIRS) {
-		ESP_LOGE(TAG, "Too many directories for writing");
+	return success;
+}
+
+
+/**
+ * Write a complete small file (e.g. a thumbnail) from bufP.  dir_plus_file_name is
+ * relative to DCIM like the read file names.  The names of the last file opened for
+ * writing are left alone.  No other file may be open for writing.
+ */
+bool file_write_image_file(char* dir_plus_file_name, const uint8_t* bufP, uint32_t len)
+{
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 8];
+	bool success;
+	int64_t start_usec;
+	UINT bw;
+	
+	sprintf(full_name, "/DCIM/%s", dir_plus_file_name);
+	start_usec = esp_timer_get_time();
+	if (f_open(&write_fil, full_name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s for writing", full_name);
 		return false;
 	}
+	file_record_write_op(FILE_OP_OPEN, start_usec, 0);
 	
-	// Create the full directory and file names
-	sprintf(write_dir_name, "%03dICAMF", dir_num);
-	sprintf(write_file_name, "ICAM_%04d.JPG", new_file_num);
+	start_usec = esp_timer_get_time();
+	success = (f_write(&write_fil, bufP, len, &bw) == FR_OK) && (bw == len);
+	file_record_write_op(FILE_OP_WRITE, start_usec, bw);
 	
-	// Create the directory if necessary (will set write_dir_is_new if necessary)
-	sprintf(full_name, "DCIM/%s", write_dir_name);
-	if (!file_create_directory(full_name)) {
+	start_usec = esp_timer_get_time();
+	if (f_close(&write_fil) != FR_OK) {
+		success = false;
+	}
+	file_record_write_op(FILE_OP_CLOSE, start_usec, 0);
+	if (!success) {
+		ESP_LOGE(TAG, "Write %s failed", full_name);
+		(void) f_unlink(full_name);
+	}
+	
+	return success;
+}
+
+
+/**
+ * Write the len byte FILE_TEST_NAME file, replacing it if it exists, to measure the card's
+ * write speed.  It is written FILE_WRITE_BUF_LEN bytes at a time from file_write_bufferP
+ * (whatever it holds) like an image file.  No other file may be open for writing.
+ */
+bool file_write_test_file(uint32_t len)
+{
+	bool success = true;
+	int64_t start_usec;
+	uint32_t n;
+	UINT bw;
+	
+	if (f_open(&write_fil, FILE_TEST_NAME, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s for writing", FILE_TEST_NAME);
 		return false;
 	}
 	
-	// Fill a buffer with the full VFS file name for Posix functions
-	sprintf(full_name, "%s/DCIM/%s/%s", base_path, write_dir_name, write_file_name);
+	while (success && (len != 0)) {
+		n = (len > FILE_WRITE_BUF_LEN) ? FILE_WRITE_BUF_LEN : len;
+		start_usec = esp_timer_get_time();
+		success = (f_write(&write_fil, file_write_bufferP, n, &bw) == FR_OK) && (bw == n);
+		file_record_write_op(FILE_OP_WRITE, start_usec, bw);
+		len -= n;
+	}
+	if (f_close(&write_fil) != FR_OK) {
+		success = false;
+	}
+	if (!success) {
+		ESP_LOGE(TAG, "Write %s failed", FILE_TEST_NAME);
+	}
+	
+	return success;
+}
 
-	// Attempt to open the file
-	*fp = fopen(full_name, "w");
-	if (*fp == NULL) {
-		ESP_LOGE(TAG, "Could not open %s for writing", full_name);
+
+void file_delete_test_file()
+{
+	(void) f_unlink(FILE_TEST_NAME);
+}
+
+
+/**
+ * Write a screenshot, hdr_len bytes of header followed by len bytes of pixels, to the next
+ * unused FILE_SCREEN_DIR/SCRN_NNNN.BMP file, creating the directory if necessary.  The
+ * file name is returned in name (room for FILE_NAME_LEN characters).  No other file may
+ * be open for writing.
+ */
+bool file_write_screen_file(const uint8_t* hdrP, uint32_t hdr_len, const uint8_t* bufP, uint32_t len, char* name)
+{
+	char full_name[sizeof(FILE_SCREEN_DIR) + FILE_NAME_LEN + 1];
+	int prefix_len = strlen(FILE_SCREEN_PREFIX);
+	int num = 0;
+	int n;
+	bool success;
+	int64_t start_usec;
+	FF_DIR dir;
+	FILINFO fno;
+	FRESULT ret;
+	UINT bw;
+	
+	ret = f_mkdir(FILE_SCREEN_DIR);
+	if ((ret != FR_OK) && (ret != FR_EXIST)) {
+		ESP_LOGE(TAG, "Could not create %s (%d)", FILE_SCREEN_DIR, ret);
 		return false;
-	} else {
-		// Increase the buffer size for newlib to speed up access
-		if (setvbuf(*fp, NULL, _IOFBF, STREAM_BUF_SIZE) != 0) {
-  			ESP_LOGE(TAG, "write setvbuf failed");
+	}
+	
+	// Find the highest numbered screenshot
+	if (f_opendir(&dir, FILE_SCREEN_DIR) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s", FILE_SCREEN_DIR);
+		return false;
+	}
+	for (;;) {
+		if ((f_readdir(&dir, &fno) != FR_OK) || (fno.fname[0] == 0)) {
+			break;
 		}
+		if (strncasecmp(fno.fname, FILE_SCREEN_PREFIX, prefix_len) == 0) {
+			n = atoi(&fno.fname[prefix_len]);
+			if (n > num) num = n;
+		}
+	}
+	f_closedir(&dir);
+	if (num >= 9999) {
+		ESP_LOGE(TAG, "No more screenshot file names");
+		return false;
 	}
 	
-	return true;
+	sprintf(name, "%s%04d%s", FILE_SCREEN_PREFIX, num + 1, FILE_SCREEN_EXT);
+	sprintf(full_name, "%s/%s", FILE_SCREEN_DIR, name);
+	start_usec = esp_timer_get_time();
+	if (f_open(&write_fil, full_name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s for writing", full_name);
+		return false;
+	}
+	file_record_write_op(FILE_OP_OPEN, start_usec, 0);
+	
+	start_usec = esp_timer_get_time();
+	success = (f_write(&write_fil, hdrP, hdr_len, &bw) == FR_OK) && (bw == hdr_len);
+	if (success) {
+		success = (f_write(&write_fil, bufP, len, &bw) == FR_OK) && (bw == len);
+	}
+	file_record_write_op(FILE_OP_WRITE, start_usec, hdr_len + len);
+	
+	start_usec = esp_timer_get_time();
+	if (f_close(&write_fil) != FR_OK) {
+		success = false;
+	}
+	file_record_write_op(FILE_OP_CLOSE, start_usec, 0);
+	if (!success) {
+		ESP_LOGE(TAG, "Write %s failed", full_name);
+		(void) f_unlink(full_name);
+	}
+	
+	return success;
+}
+
+
+/**
+ * Write a complete small file with the same number and in the same directory as the file
+ * last written but with a different extension
+ */
+bool file_write_image_sibling_file(const char* ext, const uint8_t* bufP, uint32_t len)
+{
+	char name[DIR_NAME_LEN + FILE_NAME_LEN + 2];
+	char* cP;
+	
+	sprintf(name, "%s/%s", write_dir_name, write_file_name);
+	cP = strrchr(name, '.');
+	if (cP == NULL) {
+		return false;
+	}
+	strcpy(cP, ext);
+	
+	return file_write_image_file(name, bufP, len);
+}
+
+
+/**
+ * Return true if dir_plus_file_name (relative to DCIM) exists
+ */
+bool file_image_file_exists(char* dir_plus_file_name)
+{
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 8];
+	
+	sprintf(full_name, "/DCIM/%s", dir_plus_file_name);
+	
+	return (f_stat(full_name, NULL) == FR_OK);
+}
+
+
+/**
+ * Delete the file with the same number as file_name but extension ext (e.g. a thumbnail)
+ * if it exists.  The filesystem should be mounted.
+ */
+void file_delete_sibling_file(char* dir_name, char* file_name, const char* ext)
+{
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 8];
+	char* cP;
+	FRESULT ret;
+	
+	sprintf(full_name, "/DCIM/%s/%s", dir_name, file_name);
+	cP = strrchr(full_name, '.');
+	if (cP == NULL) {
+		return;
+	}
+	strcpy(cP, ext);
+	
+	ret = f_unlink(full_name);
+	if ((ret != FR_OK) && (ret != FR_NO_FILE)) {
+		ESP_LOGE(TAG, "Delete %s failed (%d)", full_name, ret);
+	}
 }
 
 
@@ -453,7 +891,7 @@ bool file_open_image_read_file(char* dir_plus_file_name, FILE** fp)
 	
 	// Fill a buffer with the full VFS file name for Posix functions
 	sprintf(full_name, "%s/DCIM/%s", base_path, dir_plus_file_name);
-
+	
 	// Attempt to open the file
 	*fp = fopen(full_name, "r");
 	if (*fp == NULL) {
@@ -528,49 +966,184 @@ bool file_read_open_section(FILE* fp, char* buf, int start_pos, int len)
 
 
 /**
- * Close a file
+ * Read up to len bytes of dir_plus_file_name (relative to DCIM) starting at offset into
+ * buf using FatFs directly so a DMA capable buffer is filled by multi-sector card reads.
+ * Returns the number of bytes read (less than len at the end of the file) or -1 if the
+ * file can't be read.
  */
-void file_close_file(FILE* fp)
+int file_read_image_section(char* dir_plus_file_name, uint32_t offset, uint8_t* buf, uint32_t len)
 {
-	fclose(fp);
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 8];
+	FIL fil;
+	UINT br;
+	bool success;
+
+	sprintf(full_name, "/DCIM/%s", dir_plus_file_name);
+
+	if (f_open(&fil, full_name, FA_READ) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s for reading", full_name);
+		return -1;
+	}
+
+	success = (f_lseek(&fil, offset) == FR_OK) && (f_read(&fil, buf, len, &br) == FR_OK);
+	(void) f_close(&fil);
+	if (!success) {
+		ESP_LOGE(TAG, "Read %s at %lu failed", full_name, offset);
+		return -1;
+	}
+
+	return (int) br;
 }
 
 
 /**
- * Unmount the sd card
+ * Find and open the firmware update file in the FW directory whose name starts with prefix
+ * for reading with file_read_fw_file.  The name (without the directory) and length of the
+ * file are returned.  The first matching file is used if there are more than one.
  */
-void file_unmount_sdcard()
+bool file_open_fw_file(const char* prefix, char* name, uint32_t* len)
 {
-	f_mount(0, "", 0);
-	card_mounted = false;
+	char full_name[sizeof(FILE_FW_DIR) + FILE_FW_NAME_LEN + 1];
+	int prefix_len = strlen(prefix);
+	int suffix_len = strlen(FILE_FW_SUFFIX);
+	int name_len;
+	FF_DIR dir;
+	FILINFO fno;
+	bool found = false;
+	
+	if (f_opendir(&dir, FILE_FW_DIR) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s", FILE_FW_DIR);
+		return false;
+	}
+	
+	for (;;) {
+		if ((f_readdir(&dir, &fno) != FR_OK) || (fno.fname[0] == 0)) {
+			break;
+		}
+		name_len = strlen(fno.fname);
+		if (((fno.fattrib & AM_DIR) == 0) && (fno.fsize != 0) &&
+		    (name_len > (prefix_len + suffix_len)) && (name_len < FILE_FW_NAME_LEN) &&
+		    (strncasecmp(fno.fname, prefix, prefix_len) == 0) &&
+		    (strcasecmp(&fno.fname[name_len - suffix_len], FILE_FW_SUFFIX) == 0)) {
+			
+			strcpy(name, fno.fname);
+			*len = (uint32_t) fno.fsize;
+			found = true;
+			break;
+		}
+	}
+	f_closedir(&dir);
+	
+	if (!found) {
+		ESP_LOGI(TAG, "No %s*%s in %s", prefix, FILE_FW_SUFFIX, FILE_FW_DIR);
+		return false;
+	}
+	
+	if (fw_fil_open) {
+		(void) f_close(&fw_fil);
+		fw_fil_open = false;
+	}
+	
+	sprintf(full_name, "%s/%s", FILE_FW_DIR, name);
+	if (f_open(&fw_fil, full_name, FA_READ) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s for reading", full_name);
+		return false;
+	}
+	fw_fil_open = true;
+	
+	return true;
 }
 
 
 /**
- * Traverse the storage medium finding tCam related directories and files and
- * create a filesystem information structure.  Should only be called on a mounted
- * filesystem.
+ * Read the next len bytes of the file opened by file_open_fw_file into buf using FatFs
+ * directly so large reads become multi-sector card reads.  Returns the number of bytes
+ * read (less than len at the end of the file) or -1 if the file can't be read.
  */
-bool file_create_filesystem_info()
+int file_read_fw_file(uint8_t* buf, uint32_t len)
 {
-	bool success = true;
-    FF_DIR top_dir;
-    FF_DIR file_dir;
-    FRESULT res;
-    static FILINFO dir_fno;
-    static FILINFO file_fno;
-    char dir_name[sizeof(dir_fno.fname) + 8];
-    directory_node_t* cur_dirP;
-    
-#ifdef DEBUG_FS_INFO_STRUCT
-	ESP_LOGI(TAG, "file_create_filesystem_info()");
-#endif
-
-    // Start allocating at the start of our buffer
-    file_info_cur_bufferP = file_info_bufferP;
-    indexed_fs_rootP = NULL;
-    
-	// Open the top-level DCIM directory
+	UINT br;
+	
+	if (!fw_fil_open || (f_read(&fw_fil, buf, len, &br) != FR_OK)) {
+		ESP_LOGE(TAG, "Read firmware file failed");
+		return -1;
+	}
+	
+	return (int) br;
+}
+
+
+void file_close_fw_file()
+{
+	if (fw_fil_open) {
+		(void) f_close(&fw_fil);
+		fw_fil_open = false;
+	}
+}
+
+
+/**
+ * Close a file
+ */
+void file_close_file(FILE* fp)
+{
+	fclose(fp);
+}
+
+
+/**
+ * Unmount the sd card
+ */
+void file_unmount_sdcard()
+{
+	// Remember the free cluster count for the next mount
+	if (card_mounted && (fat_fs->free_clst <= (fat_fs->n_fatent - 2))) {
+		saved_free_clst = fat_fs->free_clst;
+	}
+	
+	f_mount(0, "", 0);
+	card_mounted = false;
+}
+
+
+/**
+ * Create the filesystem information structure (catalog).  It is loaded from the catalog
+ * index file when that is up to date.  Otherwise the storage medium is traversed finding
+ * iCam related directories and files and the index is rewritten.  Should only be called
+ * on a mounted filesystem.
+ */
+bool file_create_filesystem_info()
+{
+	bool success = true;
+    FF_DIR top_dir;
+    FF_DIR file_dir;
+    FRESULT res;
+    static FILINFO dir_fno;
+    static FILINFO file_fno;
+    char dir_name[DIR_NAME_LEN + 8];
+    file_dir_rec_t* dirP;
+    file_file_rec_t* fileP;
+    uint16_t key;
+    int d;
+    int n;
+    
+#ifdef DEBUG_FS_INFO_STRUCT
+	ESP_LOGI(TAG, "file_create_filesystem_info()");
+#endif
+	
+	file_reset_filesystem_info();
+	
+	// Use the index if nothing has changed the card since it was written
+	if (file_index_load()) {
+		ESP_LOGI(TAG, "Loaded catalog index");
+#ifdef DEBUG_FS_INFO_STRUCT
+		dump_filesystem_info();
+#endif
+		return true;
+	}
+	file_reset_filesystem_info();
+    
+	// Open the top-level DCIM directory
 	res = f_opendir(&top_dir, "/DCIM");
 	if (res == FR_OK) {
 		// Scan through all directories at the top level
@@ -580,33 +1153,62 @@ bool file_create_filesystem_info()
 				// Break on error or end of dir
 				break;
 			}
-			// Look for valid directories
+			// Look for valid directories and add them to the filesystem information structure
 			if ((dir_fno.fattrib & AM_DIR) && file_is_valid_dir(dir_fno.fname)) {
-				// Add the directory to the filesystem information structure
-				cur_dirP = file_insert_directory_info(dir_fno.fname);
-				
-				// Open the directory
-				sprintf(dir_name, "/DCIM/%s", dir_fno.fname);
-				res = f_opendir(&file_dir, dir_name);
-				if (res == FR_OK) {
-					// Scan through the directory
-					for (;;) {
-						res = f_readdir(&file_dir, &file_fno);
-						if ((res != FR_OK) || (file_fno.fname[0] == 0)) {
-							// Break on error or end of dir
-							break;
-						}
-						// Look for valid files
-						if (((file_fno.fattrib & AM_DIR) == 0) && (file_fno.fsize != 0) && file_is_valid_name(file_fno.fname)) {
-							// Add the file to the filesystem information structure
-							(void) file_insert_file_info(cur_dirP, file_fno.fname);
+				d = file_insert_directory_info(dir_fno.fname);
+				if (d >= 0) {
+					dir_table[d].timestamp = ((uint32_t) dir_fno.fdate << 16) | dir_fno.ftime;
+				}
+			}
+		}
+		f_closedir(&top_dir);
+		
+		// Scan each directory in order appending its files to the file table and then
+		// sorting them (so cataloging isn't slowed down by inserts into the table)
+		for (d=0; d<num_dirs; d++) {
+			dirP = &dir_table[d];
+			dirP->first_file = num_files_total;
+			
+			// Open the directory
+			file_make_dir_name(dirP, dir_name + 6);
+			memcpy(dir_name, "/DCIM/", 6);
+			res = f_opendir(&file_dir, dir_name);
+			if (res == FR_OK) {
+				// Scan through the directory
+				for (;;) {
+					res = f_readdir(&file_dir, &file_fno);
+					if ((res != FR_OK) || (file_fno.fname[0] == 0)) {
+						// Break on error or end of dir
+						break;
+					}
+					// Look for valid files to add to the filesystem information structure
+					if (((file_fno.fattrib & AM_DIR) == 0) && (file_fno.fsize != 0) &&
+					    file_is_valid_name(file_fno.fname) && file_parse_file_name(file_fno.fname, &key)) {
+						if (num_files_total >= FILE_CAT_MAX_FILES) {
+							ESP_LOGE(TAG, "Too many files for catalog - skipping %s", file_fno.fname);
+							continue;
 						}
+						fileP = &file_table[num_files_total++];
+						fileP->key = key;
+						fileP->size = (uint32_t) file_fno.fsize;
+						fileP->timestamp = ((uint32_t) file_fno.fdate << 16) | file_fno.ftime;
+						dirP->num_files += 1;
 					}
-					f_closedir(&file_dir);
 				}
+				f_closedir(&file_dir);
+			}
+			
+			n = dirP->num_files;
+			if (n > 1) {
+				qsort(&file_table[dirP->first_file], n, sizeof(file_file_rec_t), file_compare_files);
 			}
 		}
-		f_closedir(&top_dir);
+		
+		file_update_catalog_peaks();
+		
+		// Save the catalog for the next time the card is mounted
+		(void) file_index_rebuild();
+		file_get_card_stats();
 	} else {
 		success = false;
 	}
@@ -626,19 +1228,25 @@ void file_delete_filesystem_info()
 	ESP_LOGI(TAG, "file_delete_filesystem_info()");
 #endif
 	
-	indexed_fs_rootP = NULL;
+	file_reset_filesystem_info();
+	
+	// The card may have changed (or been formatted) so the index is rebuilt when it is
+	// next updated
+	index_valid = false;
 }
 
 
 /**
- * Create a new directory information record and append it to the end of the list.
+ * Add a new directory record to the catalog.  The card must be mounted so the change
+ * can be recorded in the index.
  */
-directory_node_t* file_add_directory_info(char* name)
+bool file_add_directory_info(char* name)
 {
-	char* nameP;
-	directory_node_t* dirP;
-	directory_node_t* newP;
-	directory_node_t* prevP = NULL;
+	int d;
+	uint32_t size;
+	uint32_t timestamp;
+	
+	timestamp = file_get_stats(name, NULL, &size);
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
@@ -646,34 +1254,9 @@ directory_node_t* file_add_directory_info(char* name)
 	ESP_LOGI(TAG, "file_add_directory_info(%s)", name);
 #endif
 	
-	// Create a new directory record
-	newP = file_allocate_dir_entry();
-	if (newP != NULL) {
-		newP->nextP = NULL;
-		newP->prevP = NULL;
-		newP->fileP = NULL;
-		newP->num_files = 0;
-		
-		// Add the name
-		nameP = file_allocate_name_entry(name);
-		if (nameP != NULL) {
-			strcpy(nameP, name);
-		}
-		newP->nameP = nameP;
-	
-		// Then either add it as the first record or append it to the end of the list
-		if (indexed_fs_rootP == NULL) {
-			indexed_fs_rootP = newP;
-		} else {
-			// Find the end of the directory list
-			dirP = indexed_fs_rootP;
-			while (dirP != NULL) {
-				prevP = dirP;
-				dirP = dirP->nextP;
-			}
-			prevP->nextP = newP;
-			newP->prevP = prevP;
-		}
+	d = file_insert_directory_info(name);
+	if (d >= 0) {
+		dir_table[d].timestamp = timestamp;
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
@@ -682,29 +1265,42 @@ directory_node_t* file_add_directory_info(char* name)
 	
 	xSemaphoreGive(catalog_mutex);
 	
-	return newP;
+	if (d >= 0) {
+		file_index_log(FILE_INDEX_OP_ADD_DIR, name, NULL, 0, timestamp);
+	}
+	
+	return (d >= 0);
 }
 
 
 /**
- * Create a new file information record and append it to the end of the file list
- * for the specified dirP directory record. 
+ * Add a new file record to the catalog for the named directory.  The card must be mounted
+ * so the change can be recorded in the index.
  */
-file_node_t* file_add_file_info(directory_node_t* dirP, char* name)
+bool file_add_file_info(char* dir_name, char* name)
 {
-	file_node_t* newP;
+	int d;
+	int n = -1;
+	uint16_t num;
+	uint32_t size;
+	uint32_t timestamp;
+	
+	timestamp = file_get_stats(dir_name, name, &size);
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	if (dirP != NULL) {
-		ESP_LOGI(TAG, "file_add_file_info(%s, %s)", dirP->nameP, name);
-	} else {
-		ESP_LOGI(TAG, "file_add_file_info(NULL, %s)", name);
-	}
+	ESP_LOGI(TAG, "file_add_file_info(%s, %s)", dir_name, name);
 #endif
 	
-	newP = file_insert_file_info(dirP, name);
+	d = file_parse_dir_name(dir_name, &num) ? file_search_directory(num, NULL) : -1;
+	if (d >= 0) {
+		n = file_insert_file_info(d, name);
+		if (n >= 0) {
+			file_table[n].size = size;
+			file_table[n].timestamp = timestamp;
+		}
+	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
 	dump_filesystem_info();
@@ -712,18 +1308,22 @@ file_node_t* file_add_file_info(directory_node_t* dirP, char* name)
 	
 	xSemaphoreGive(catalog_mutex);
 	
-	return newP;
+	if (n >= 0) {
+		file_index_log(FILE_INDEX_OP_ADD_FILE, dir_name, name, size, timestamp);
+	}
+	
+	return (n >= 0);
 }
 
 
 /**
- * Delete the specified directory record, connecting subsequent records to previous
- * records.  All file records pointed to by this record should have previously been
- * deleted.
+ * Delete the specified directory record along with the file records in it.  The card
+ * must be mounted so the change can be recorded in the index.
  */
 void file_delete_directory_info(int n)
 {
-	directory_node_t* dirP;
+	char name[DIR_NAME_LEN];
+	bool deleted = false;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
@@ -731,34 +1331,10 @@ void file_delete_directory_info(int n)
 	ESP_LOGI(TAG, "file_delete_directory_info(%d)", n);
 #endif
 	
-	// Find the nth directory record
-	dirP = indexed_fs_rootP;
-	while ((dirP != NULL) && (n != 0)) {
-		dirP = dirP->nextP;
-		n -= 1;
-	}
-	
-	if (dirP != NULL) {
-		// Link any subsequent record to the previous record if it exists
-		if (dirP->nextP != NULL) {
-			if (dirP != indexed_fs_rootP) {
-				// Directory record exists previous to this record
-				dirP->nextP->prevP = dirP->prevP;
-				dirP->prevP->nextP = dirP->nextP;
-			} else {
-				// This record is first directory record pointed to by indexed_fs_rootP
-				dirP->nextP->prevP = NULL;
-				indexed_fs_rootP = dirP->nextP;
-			}
-		} else {
-			if (dirP != indexed_fs_rootP) {
-				// Set previous directory record as end
-				dirP->prevP->nextP = NULL;
-			} else {
-				// No directories
-				indexed_fs_rootP = NULL;
-			}
-		}
+	if ((n >= 0) && (n < num_dirs)) {
+		file_make_dir_name(&dir_table[n], name);
+		file_remove_directory_info(n);
+		deleted = true;
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
@@ -766,59 +1342,34 @@ void file_delete_directory_info(int n)
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
+	
+	if (deleted) {
+		file_index_log(FILE_INDEX_OP_DEL_DIR, name, NULL, 0, 0);
+	}
 }
 
 
 /**
- * Delete the specified file record for dirP, connecting subsequent records to previous records.
+ * Delete the specified file record for the dir_index directory.  The card must be mounted
+ * so the change can be recorded in the index.
  */
-void file_delete_file_info(directory_node_t* dirP, int n)
+void file_delete_file_info(int dir_index, int n)
 {
-	file_node_t* fileP;
+	char dir_name[DIR_NAME_LEN];
+	char name[FILE_NAME_LEN];
+	bool deleted = false;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	if (dirP != NULL) {
-		ESP_LOGI(TAG, "file_delete_file_info(%s, %d)", dirP->nameP, n);
-	} else {
-		ESP_LOGI(TAG, "file_delete_file_info(NULL, %d)", n);
-	}
+	ESP_LOGI(TAG, "file_delete_file_info(%d, %d)", dir_index, n);
 #endif
 	
-	// Find the nth file record pointer for dirP
-	fileP = dirP->fileP;
-	while ((fileP != NULL) && (n != 0)) {
-		fileP = fileP->nextP;
-		n -= 1;
-	}
-	
-	if (fileP != NULL) {
-		// Link any subsequent record to the previous record if it exists
-		if (fileP->nextP != NULL) {
-			// File record exists beyond this record
-			if (fileP != dirP->fileP) {
-				// File record exists previous to this record
-				fileP->nextP->prevP = fileP->prevP;
-				fileP->prevP->nextP = fileP->nextP;
-			} else {
-				// This record is first file record pointed to by directory record
-				fileP->nextP->prevP = NULL;
-				dirP->fileP = fileP->nextP;
-			}
-		} else {
-			// This is last file record
-			if (fileP != dirP->fileP) {
-				// Set previous file record as end
-				fileP->prevP->nextP = NULL;
-			} else {
-				// No files
-				dirP->fileP = NULL;
-			}
-		}
-		
-		// Decrement the count of files
-		dirP->num_files = dirP->num_files - 1;
+	if ((dir_index >= 0) && (dir_index < num_dirs) && (n >= 0) && (n < dir_table[dir_index].num_files)) {
+		file_make_dir_name(&dir_table[dir_index], dir_name);
+		file_make_file_name(&file_table[dir_table[dir_index].first_file + n], name);
+		file_remove_file_info(dir_index, n);
+		deleted = true;
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
@@ -826,6 +1377,20 @@ void file_delete_file_info(directory_node_t* dirP, int n)
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
+	
+	if (deleted) {
+		file_index_log(FILE_INDEX_OP_DEL_FILE, dir_name, name, 0, 0);
+	}
+}
+
+
+/**
+ * Record in the index that the card changed without changing the catalog (e.g. a thumbnail
+ * was written) so the index is still used at the next mount.  The card must be mounted.
+ */
+void file_sync_filesystem_info()
+{
+	file_index_log(FILE_INDEX_OP_SYNC, "", NULL, 0, 0);
 }
 
 
@@ -838,193 +1403,181 @@ void file_delete_file_info(directory_node_t* dirP, int n)
 int file_get_name_list(int type, char* list)
 {
 	int cnt = 0;
-	int n;
-	directory_node_t* dirP;
-	file_node_t* fileP;
+	file_dir_rec_t* dirP;
+#ifdef DEBUG_FS_INFO_STRUCT
+	char* startP = list;
+#endif
+	
+	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
 	if (type < 0) {
 		// Generate a comma separated list of directory names
-		dirP = indexed_fs_rootP;
-		while ((dirP != NULL) && (cnt < FILE_MAX_CATALOG_NAMES)) {
-			// Copy the name into the list
-			n = strlen(dirP->nameP);
-			memcpy(list, dirP->nameP, n);
-			list += n;
+		while ((cnt < num_dirs) && (cnt < FILE_MAX_CATALOG_NAMES)) {
+			file_make_dir_name(&dir_table[cnt], list);
+			list += strlen(list);
 			*(list++) = ',';
 			cnt++;
-			// Next record
-			dirP = dirP->nextP;
 		}
-	} else {
-		// Generate a comma separated list of files for the specified directory
-		dirP = file_get_indexed_directory(type);
-		if (dirP != NULL) {
-			// Generate a comma separated list of file names
-			fileP = dirP->fileP;
-			while ((fileP != NULL) && (cnt < FILE_MAX_CATALOG_NAMES)) {
-				// Copy the name into the list
-				n = strlen(fileP->nameP);
-				memcpy(list, fileP->nameP, n);
-				list += n;
-				*(list++) = ',';
-				cnt++;
-				// Next record
-				fileP = fileP->nextP;
-			}
+	} else if (type < num_dirs) {
+		// Generate a comma separated list of file names for the specified directory
+		dirP = &dir_table[type];
+		while ((cnt < dirP->num_files) && (cnt < FILE_MAX_CATALOG_NAMES)) {
+			file_make_file_name(&file_table[dirP->first_file + cnt], list);
+			list += strlen(list);
+			*(list++) = ',';
+			cnt++;
 		}
 	}
 	
+	xSemaphoreGive(catalog_mutex);
+	
 	// Null terminate the list
 	*list = 0;
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	ESP_LOGI(TAG, "%d <- file_get_name_list(%d, %s)", cnt, type, list);
+	ESP_LOGI(TAG, "%d <- file_get_name_list(%d, %s)", cnt, type, startP);
 #endif
 	
 	return cnt;
 }
 
 
-
 /**
- * Find and return the nth directory record pointer (n = 0 returns the indexed_fs_rootP).
+ * Copy up to count catalog entries starting with the offset entry into entries.  Returns
+ * the number of entries copied and sets total to the number of entries in the catalog.
+ *   type - specify the catalog type (-1 for directories, 0-n for the files in the specified
+ *          directory index)
  */
-directory_node_t* file_get_indexed_directory(int n)
+int file_get_catalog_page(int type, int offset, int count, file_catalog_entry_t* entries, int* total)
 {
-	directory_node_t* dirP;
-#ifdef DEBUG_FS_INFO_STRUCT
-	int sav_n = n;
-#endif
+	int cnt = 0;
+	int n = 0;
+	file_dir_rec_t* dirP;
+	file_file_rec_t* fileP;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	dirP = indexed_fs_rootP;
-	
-	while ((dirP != NULL) && (n-- != 0)) {
-		dirP = dirP->nextP;
+	if (type < 0) {
+		n = num_dirs;
+		while (((offset + cnt) < n) && (cnt < count)) {
+			dirP = &dir_table[offset + cnt];
+			file_make_dir_name(dirP, entries->name);
+			entries->size = (uint32_t) dirP->num_files;
+			entries->timestamp = dirP->timestamp;
+			entries++;
+			cnt++;
+		}
+	} else if (type < num_dirs) {
+		dirP = &dir_table[type];
+		n = dirP->num_files;
+		while (((offset + cnt) < n) && (cnt < count)) {
+			fileP = &file_table[dirP->first_file + offset + cnt];
+			file_make_file_name(fileP, entries->name);
+			entries->size = fileP->size;
+			entries->timestamp = fileP->timestamp;
+			entries++;
+			cnt++;
+		}
 	}
 	
+	xSemaphoreGive(catalog_mutex);
+	
+	*total = n;
+	
 #ifdef DEBUG_FS_INFO_STRUCT
-	if (dirP != NULL) {
-		ESP_LOGI(TAG, "%s <- file_get_indexed_directory(%d)", dirP->nameP, sav_n);
-	} else {
-		ESP_LOGI(TAG, "NULL <- file_get_indexed_directory(%d)", sav_n);
-	}
+	ESP_LOGI(TAG, "%d <- file_get_catalog_page(%d, %d, %d) of %d", cnt, type, offset, count, n);
 #endif
 	
-	xSemaphoreGive(catalog_mutex);
-	
-	return dirP;
+	return cnt;
 }
 
 
 /**
- * Find and return the index of first directory entry matching the specified directory name.
- * Return -1 if not found.
+ * Copy up to count entries for the catalog files with timestamps from start up to (but not
+ * including) end, skipping the first offset of them, into entries.  Returns the number of
+ * entries copied and sets total to the number of files in the range.  Timestamps are FAT
+ * date (upper 16 bits) and time (lower 16 bits) values so they compare in time order.
  */
-int file_get_named_directory_index(char* name)
+int file_get_catalog_range(uint32_t start, uint32_t end, int offset, int count, file_range_entry_t* entries, int* total)
 {
-	bool done = false;
-	directory_node_t* dirP;
+	int cnt = 0;
 	int n = 0;
-	int ret;
+	int d, f;
+	file_file_rec_t* fileP;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	dirP = indexed_fs_rootP;
-	
-	while ((dirP != NULL) && !done) {
-		if (strcmp(name, dirP->nameP) == 0) {
-			done = true;
-		} else {
-			dirP = dirP->nextP;
-			n++;
+	for (d=0; d<num_dirs; d++) {
+		fileP = &file_table[dir_table[d].first_file];
+		for (f=0; f<dir_table[d].num_files; f++) {
+			if ((fileP->timestamp >= start) && (fileP->timestamp < end)) {
+				if ((n >= offset) && (cnt < count)) {
+					entries->dir_index = (uint16_t) d;
+					entries->file_index = (uint16_t) f;
+					entries->timestamp = fileP->timestamp;
+					entries++;
+					cnt++;
+				}
+				n++;
+			}
+			fileP++;
 		}
 	}
 	
-	if (dirP == NULL) {
-		ret = -1;
-	} else {
-		ret = n;
-	}
+	xSemaphoreGive(catalog_mutex);
+	
+	*total = n;
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	ESP_LOGI(TAG, "%d <- file_get_named_directory_index(%s)", ret, name);
+	ESP_LOGI(TAG, "%d <- file_get_catalog_range(0x%lx, 0x%lx, %d, %d) of %d", cnt, start, end, offset, count, n);
 #endif
 	
-	xSemaphoreGive(catalog_mutex);
-	
-	return ret;
+	return cnt;
 }
 
 
 /**
- * Starting with the dirP directory record, find and return the nth file
- * record pointer (n = 0 returns the first entry).
+ * Copy the name of the nth directory into name (DIR_NAME_LEN bytes).  Returns false if
+ * it does not exist.
  */
-file_node_t* file_get_indexed_file(directory_node_t* dirP, int n)
+bool file_get_directory_name(int n, char* name)
 {
-	file_node_t* cur_fileP;
-#ifdef DEBUG_FS_INFO_STRUCT
-	int sav_n = n;
-#endif
+	bool ret = false;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	cur_fileP = dirP->fileP;
-	while ((cur_fileP != NULL) && (n-- != 0)) {
-		cur_fileP = cur_fileP->nextP;
+	if ((n >= 0) && (n < num_dirs)) {
+		file_make_dir_name(&dir_table[n], name);
+		ret = true;
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	if (cur_fileP != NULL) {
-		ESP_LOGI(TAG, "%s <- file_get_indexed_file(%s, %d)", cur_fileP->nameP, dirP->nameP, sav_n);
-	} else {
-		ESP_LOGI(TAG, "NULL <- file_get_indexed_file(%s, %d)", dirP->nameP, sav_n);
-	}
+	ESP_LOGI(TAG, "%s <- file_get_directory_name(%d)", ret ? name : "NULL", n);
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
 	
-	return cur_fileP;
+	return ret;
 }
 
 
 /**
- * Find and return the index of first file entry matching the specified file name.
+ * Find and return the index of the directory entry matching the specified directory name.
  * Return -1 if not found.
  */
-int file_get_named_file_index(directory_node_t* dirP, char* name)
+int file_get_named_directory_index(char* name)
 {
-	bool done = false;
-	file_node_t* cur_fileP;
-	int n = 0;
-	int ret;
+	int ret = -1;
+	uint16_t num;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	cur_fileP = dirP->fileP;
-	while ((cur_fileP != NULL) && !done) {
-		if (strcmp(name, cur_fileP->nameP) == 0) {
-			done = true;
-		} else {
-			cur_fileP = cur_fileP->nextP;
-			n++;
-		}
-	}
-	
-	if (cur_fileP == NULL) {
-		ret = -1;
-	} else {
-		ret = n;
+	if (file_parse_dir_name(name, &num)) {
+		ret = file_search_directory(num, NULL);
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	if (dirP != NULL) {
-		ESP_LOGI(TAG, "%d <- file_get_named_file_index(%s, %s)", ret, dirP->nameP, name);
-	} else {
-		ESP_LOGI(TAG, "%d <- file_get_named_file_index(NULL, %s)", ret, name);
-	}
+	ESP_LOGI(TAG, "%d <- file_get_named_directory_index(%s)", ret, name);
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
@@ -1034,95 +1587,99 @@ int file_get_named_file_index(directory_node_t* dirP, char* name)
 
 
 /**
- * Return the number of directories
+ * Copy the name of the nth file in the dir_index directory into name (FILE_NAME_LEN bytes).
+ * Returns false if it does not exist.
  */
-int file_get_num_directories()
+bool file_get_file_name(int dir_index, int n, char* name)
 {
-	int n = 0;
-	directory_node_t* dirP;
+	bool ret = false;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	dirP = indexed_fs_rootP;
-	
-	while (dirP != NULL) {
-		dirP = dirP->nextP;
-		n += 1;
+	if ((dir_index >= 0) && (dir_index < num_dirs) && (n >= 0) && (n < dir_table[dir_index].num_files)) {
+		file_make_file_name(&file_table[dir_table[dir_index].first_file + n], name);
+		ret = true;
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	ESP_LOGI(TAG, "%d <- file_get_num_directories()", n);
+	ESP_LOGI(TAG, "%s <- file_get_file_name(%d, %d)", ret ? name : "NULL", dir_index, n);
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
 	
-	return n;
+	return ret;
 }
 
 
 /**
- * Return the total number of files
+ * Find and return the index of the file entry in the dir_index directory matching the
+ * specified file name.  Return -1 if not found.
  */
-int file_get_num_files()
+int file_get_named_file_index(int dir_index, char* name)
 {
-	int n = 0;
-	directory_node_t* dirP;
+	int ret = -1;
+	uint16_t key;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	dirP = indexed_fs_rootP;
-	
-	while (dirP != NULL) {
-		n += dirP->num_files;
-		dirP = dirP->nextP;
+	if ((dir_index >= 0) && (dir_index < num_dirs) && file_parse_file_name(name, &key)) {
+		ret = file_search_file(dir_index, key, NULL);
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	ESP_LOGI(TAG, "%d <- file_get_num_files()", n);
+	ESP_LOGI(TAG, "%d <- file_get_named_file_index(%d, %s)", ret, dir_index, name);
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
 	
-	return n;
+	return ret;
+}
+
+
+/**
+ * Return the number of directories
+ */
+int file_get_num_directories()
+{
+#ifdef DEBUG_FS_INFO_STRUCT
+	ESP_LOGI(TAG, "%d <- file_get_num_directories()", num_dirs);
+#endif
+	
+	return num_dirs;
+}
+
+
+/**
+ * Return the total number of files
+ */
+int file_get_num_files()
+{
+#ifdef DEBUG_FS_INFO_STRUCT
+	ESP_LOGI(TAG, "%d <- file_get_num_files()", num_files_total);
+#endif
+	
+	return num_files_total;
 }
 
 
 /**
- * Return the absolute file index for the given dir_index and file_index in that directory node.
+ * Return the absolute file index for the given dir_index and file_index in that directory.
  * Return -1 if it does not exist.
  */
 int file_get_abs_file_index(int dir_index, int file_index)
 {
-	int abs_file_index = 0;
-	int n;
-	directory_node_t* dirP;
+	int abs_file_index = -1;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
-
-	dirP = indexed_fs_rootP;
 	
-	// Include all file counts up to the specified dir_index
-	n = dir_index - 1;
-	while ((dirP != NULL) && (n-- >= 0)) {
-		abs_file_index += dirP->num_files;
-		dirP = dirP->nextP;
-	}
-	
-	if (dirP == NULL) {
-		// Can't find the directory
-		abs_file_index = -1;
-	} else {
-		// Add the file_index in the current directory if it exists
-		if (file_index < dirP->num_files) {
-			abs_file_index += file_index;
-		} else {
-			// File doesn't exist
-			abs_file_index = -1;
+	if ((dir_index >= 0) && (dir_index < num_dirs)) {
+		if ((file_index >= 0) && (file_index < dir_table[dir_index].num_files)) {
+			abs_file_index = dir_table[dir_index].first_file + file_index;
 		}
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
-	ESP_LOGI(TAG, "%d <- file_get_abs_file_index(%d, %d)", n, dir_index, file_index);
+	ESP_LOGI(TAG, "%d <- file_get_abs_file_index(%d, %d)", abs_file_index, dir_index, file_index);
 #endif
 	
 	xSemaphoreGive(catalog_mutex);
@@ -1137,34 +1694,30 @@ int file_get_abs_file_index(int dir_index, int file_index)
  */
 bool file_get_indexes_from_abs(int abs_index, int* dir_index, int* file_index)
 {
-	bool ret = true;
-	int cur_file_total = 0;
-	int dir_i = 0;
+	bool ret = false;
+	int lo = 0;
+	int hi;
+	int mid;
 	
 	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
 	
-	directory_node_t* dirP;
-	
-	dirP = indexed_fs_rootP;
-	
-	// Scan through directory nodes until we find the total number of files greater than abs_index
-	while ((dirP != NULL) && (cur_file_total <= abs_index)) {
-		cur_file_total += dirP->num_files;
-		if (cur_file_total <= abs_index) {
-			// Next directory
-			dirP = dirP->nextP;
-			dir_i++;
+	if ((abs_index >= 0) && (abs_index < num_files_total)) {
+		// Binary search for the last directory starting at or before abs_index
+		hi = num_dirs - 1;
+		while (lo < hi) {
+			mid = (lo + hi + 1) / 2;
+			if (dir_table[mid].first_file <= (uint32_t) abs_index) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
 		}
-	}
-	
-	// If the abs_index is in the last directory then compute the diretory and file_index in the directory
-	if (abs_index < cur_file_total) {
-		// Found directory that has file
-		*dir_index = dir_i;
-		*file_index = dirP->num_files - (cur_file_total - abs_index);
-	} else {
-		// Did not find abs_index
-		ret = false;
+		
+		// Empty directories share the starting index of the next directory so this
+		// finds the one holding the file
+		*dir_index = lo;
+		*file_index = abs_index - dir_table[lo].first_file;
+		ret = (*file_index < dir_table[lo].num_files);
 	}
 	
 #ifdef DEBUG_FS_INFO_STRUCT
@@ -1192,6 +1745,57 @@ uint64_t file_get_storage_free()
 }
 
 
+/**
+ * Return catalog utilization information.  Deleted entries are removed from the tables
+ * (later entries move down) so num_xxx is always the space in use.
+ */
+void file_get_catalog_stats(file_catalog_stats_t* stats)
+{
+	xSemaphoreTake(catalog_mutex, portMAX_DELAY);
+	
+	stats->num_dirs = num_dirs;
+	stats->num_files = num_files_total;
+	stats->max_dirs = FILE_CAT_MAX_DIRS;
+	stats->max_files = FILE_CAT_MAX_FILES;
+	stats->peak_dirs = peak_dirs;
+	stats->peak_files = peak_files;
+	stats->peak_bytes = peak_dirs*sizeof(file_dir_rec_t) + peak_files*sizeof(file_file_rec_t);
+	
+	xSemaphoreGive(catalog_mutex);
+}
+
+
+/**
+ * Return the card write statistics.  They are cleared when a card is inserted.
+ */
+void file_get_write_stats(file_write_stats_t* stats)
+{
+	portENTER_CRITICAL(&write_stats_mux);
+	memcpy(stats, &write_stats, sizeof(file_write_stats_t));
+	portEXIT_CRITICAL(&write_stats_mux);
+}
+
+
+const char* file_get_op_name(int op)
+{
+	if ((op < 0) || (op >= FILE_NUM_OPS)) return "";
+	
+	return write_op_names[op];
+}
+
+
+/**
+ * Update storage utilization information after writing or deleting files on a mounted
+ * card.  This is fast because FatFs tracks the free cluster count while mounted.
+ */
+void file_update_storage_info()
+{
+	if (card_mounted) {
+		file_get_card_stats();
+	}
+}
+
+
 
 //
 // File Utilities internal functions
@@ -1290,7 +1894,7 @@ static void file_get_card_stats()
 	FRESULT ret;
 	FATFS *fs;
     DWORD fre_clust;
-
+	
 	ret = f_getfree("0:", &fre_clust, &fs);
 	if (ret != FR_OK) {
 		ESP_LOGE(TAG, "Could not get cluster info - %d", ret);
@@ -1307,9 +1911,27 @@ static void file_get_card_stats()
 
 
 /**
- * Create a directory, do nothing if the directory already exists.  Update write_dir_is_new.
+ * Return the cluster size to format the card with.  Larger clusters match the erase
+ * block size of larger cards and reduce the number of FAT updates while writing.
  */
-static bool file_create_directory(char* dir_name)
+static size_t file_format_au_size()
+{
+	uint64_t card_bytes = (uint64_t) sd_card.csd.capacity * sd_card.csd.sector_size;
+	
+	if (card_bytes >= FILE_FMT_SDXC_MIN_BYTES) {
+		return FILE_FMT_SDXC_AU_SIZE;
+	} else if (card_bytes >= FILE_FMT_SDHC_MIN_BYTES) {
+		return FILE_FMT_SDHC_AU_SIZE;
+	} else {
+		return mount_config.allocation_unit_size;
+	}
+}
+
+
+/**
+ * Create a directory, do nothing if the directory already exists.  Update write_dir_is_new.
+ */
+static bool file_create_directory(char* dir_name)
 {
 	FRESULT ret;
 	
@@ -1338,185 +1960,293 @@ static bool file_create_directory(char* dir_name)
 }
 
 
-// If not maybe it should and store # in entry.  And for writing we could have a way of 
-// getting last entry.  Then we could see how many files and act accordingly
-static directory_node_t* file_insert_directory_info(char* name)
+/**
+ * Empty the catalog.  The directory table is at the start of file_info_bufferP and the
+ * file table fills the rest of it.
+ */
+static void file_reset_filesystem_info()
 {
-	bool done = false;
-	char* nameP;
-	directory_node_t* dirP;
-	directory_node_t* newP;
+	dir_table = (file_dir_rec_t*) file_info_bufferP;
+	file_table = (file_file_rec_t*) ((uint8_t*) file_info_bufferP + FILE_CAT_MAX_DIRS*sizeof(file_dir_rec_t));
 	
-	// Create a new directory record
-	newP = file_allocate_dir_entry();
-	if (newP != NULL) {
-		newP->nextP = NULL;
-		newP->prevP = NULL;
-		newP->fileP = NULL;
-		newP->num_files = 0;
-		
-		// Add the name
-		nameP = file_allocate_name_entry(name);
-		if (nameP != NULL) {
-			strcpy(nameP, name);
-		}
-		newP->nameP = nameP;
-		
-		// Then either add it as the first record or insert it alphabetically in list
-		if (indexed_fs_rootP == NULL) {
-			indexed_fs_rootP = newP;
-		} else {
-			// Insert it before the first entry that is greater than it
-			dirP = indexed_fs_rootP;
-			while (!done) {
-				if (strcmp(dirP->nameP, name) > 0) {
-					// Insert before dirP
-					if (dirP == indexed_fs_rootP) {
-						// Insert at head of list
-						newP->nextP = indexed_fs_rootP;
-						indexed_fs_rootP = newP;
-						dirP->prevP = newP;
-					} else {
-						// Insert in the middle of list
-						newP->nextP = dirP;
-						newP->prevP = dirP->prevP;
-						dirP->prevP->nextP = newP;
-						dirP->prevP = newP;
-					}
-					done = true;
-				} else if (dirP->nextP == NULL) {
-					// Insert at end of list
-					dirP->nextP = newP;
-					newP->prevP = dirP;
-					done = true;
-				} else {
-					// Move to next record
-					dirP = dirP->nextP;
-				}
-			}
-		}
+	num_dirs = 0;
+	num_files_total = 0;
+}
+
+
+/**
+ * Get the number from a "NNNICAMF" directory name.  Returns false for any other name
+ * (which can't be represented in the catalog).
+ */
+static bool file_parse_dir_name(char* name, uint16_t* num)
+{
+	int i;
+	
+	for (i=0; i<3; i++) {
+		if ((name[i] < '0') || (name[i] > '9')) return false;
+	}
+	if (strcmp(&name[3], "ICAMF") != 0) {
+		return false;
 	}
 	
-	return newP;
+	*num = (name[0] - '0')*100 + (name[1] - '0')*10 + (name[2] - '0');
+	return true;
 }
 
 
-// It might have to change with different .types JPG, MJPG
-// or maybe not, we always key on number of files in a dir to figure out next one
-static file_node_t* file_insert_file_info(directory_node_t* dirP, char* name)
+/**
+ * Get the sort key (number and type) from an "ICAM_NNNN.ext" file name.  Returns false
+ * for any other name (which can't be represented in the catalog).
+ */
+static bool file_parse_file_name(char* name, uint16_t* key)
 {
-	bool done = false;
-	char* nameP;
-	file_node_t* fileP;
-	file_node_t* newP;
+	int i;
+	uint16_t num = 0;
 	
-	// Create a new file record
-	newP = file_allocate_file_entry();
-	if (newP != NULL) {
-		newP->nextP = NULL;
-		newP->prevP = NULL;
-	
-		// Add the name
-		nameP = file_allocate_name_entry(name);
-		if (nameP != NULL) {
-			strcpy(nameP, name);
+	if (strncmp(name, "ICAM_", 5) != 0) {
+		return false;
+	}
+	for (i=5; i<9; i++) {
+		if ((name[i] < '0') || (name[i] > '9')) return false;
+		num = num*10 + (name[i] - '0');
+	}
+	for (i=0; i<FILE_REC_NUM_TYPES; i++) {
+		if (strcmp(&name[9], file_rec_type_ext[i]) == 0) {
+			*key = (num << FILE_REC_TYPE_BITS) | i;
+			return true;
 		}
-		newP->nameP = nameP;
+	}
 	
-		// Then ether add it as the first record or insert it alphabetically in list
-		if (dirP->fileP == NULL) {
-			dirP->fileP = newP;
+	return false;
+}
+
+
+static void file_make_dir_name(file_dir_rec_t* dirP, char* name)
+{
+	sprintf(name, "%03dICAMF", dirP->num);
+}
+
+
+static void file_make_file_name(file_file_rec_t* fileP, char* name)
+{
+	sprintf(name, "ICAM_%04d%s", fileP->key >> FILE_REC_TYPE_BITS, file_rec_type_ext[fileP->key & FILE_REC_TYPE_MASK]);
+}
+
+
+/**
+ * Binary search for num in the sorted directory table.  Returns the index of the matching
+ * directory or -1 if not found.  Sets *insertP (if not NULL) to where num should be
+ * inserted to keep the table sorted.
+ */
+static int file_search_directory(uint16_t num, int* insertP)
+{
+	int lo = 0;
+	int hi = num_dirs - 1;
+	int mid;
+	
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (dir_table[mid].num == num) {
+			if (insertP != NULL) *insertP = mid;
+			return mid;
+		} else if (dir_table[mid].num < num) {
+			lo = mid + 1;
 		} else {
-			// Insert it before the first entry that is greater than it
-			fileP = dirP->fileP;
-			while (!done) {
-				if (strcmp(fileP->nameP, name) > 0) {
-					// Insert before fileP
-					if (fileP == dirP->fileP) {
-						// Insert at head of list
-						newP->nextP = fileP;
-						dirP->fileP = newP;
-						fileP->prevP = newP;
-					} else {
-						// Insert in the middle of list
-						newP->nextP = fileP;
-						newP->prevP = fileP->prevP;
-						fileP->prevP->nextP = newP;
-						fileP->prevP = newP;
-					}
-					done = true;
-				} else if (fileP->nextP == NULL) {
-					// Insert at end of list
-					fileP->nextP = newP;
-					newP->prevP = fileP;
-					done = true;
-				} else {
-					// Move to next record
-					fileP = fileP->nextP;
-				}
-			}
+			hi = mid - 1;
 		}
+	}
 	
-		// Increment the file count
-		dirP->num_files = dirP->num_files+1;
+	if (insertP != NULL) *insertP = lo;
+	return -1;
+}
+
+
+/**
+ * Binary search for key in the sorted files of the dir_index directory.  Returns the index
+ * in the directory of the matching file or -1 if not found.  Sets *insertP (if not NULL)
+ * to where key should be inserted to keep the directory sorted.
+ */
+static int file_search_file(int dir_index, uint16_t key, int* insertP)
+{
+	file_file_rec_t* filesP = &file_table[dir_table[dir_index].first_file];
+	int lo = 0;
+	int hi = dir_table[dir_index].num_files - 1;
+	int mid;
+	
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (filesP[mid].key == key) {
+			if (insertP != NULL) *insertP = mid;
+			return mid;
+		} else if (filesP[mid].key < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
 	}
 	
-	return newP;
+	if (insertP != NULL) *insertP = lo;
+	return -1;
 }
 
 
-static directory_node_t* file_allocate_dir_entry()
+static int file_compare_files(const void* a, const void* b)
 {
-	int len = sizeof(directory_node_t);
-	directory_node_t* dirP;
+	return (int) ((const file_file_rec_t*) a)->key - (int) ((const file_file_rec_t*) b)->key;
+}
+
+
+/**
+ * Add a directory to the catalog.  Returns its index (which may already have existed) or
+ * -1 if it can't be added.
+ */
+static int file_insert_directory_info(char* name)
+{
+	file_dir_rec_t* dirP;
+	int n;
+	uint16_t num;
 	
-	if (file_info_cur_bufferP >= file_info_bufferP + FILE_INFO_BUFFER_LEN) {
-		dirP = NULL;
-		ESP_LOGE(TAG, "filesystem information structure directory allocate failed");
-	} else {
-		dirP = (directory_node_t*) file_info_cur_bufferP;
-		file_info_cur_bufferP += len;	
+	if (!file_parse_dir_name(name, &num)) {
+		ESP_LOGI(TAG, "Skipping %s", name);
+		return -1;
+	}
+	if (file_search_directory(num, &n) >= 0) {
+		return n;
+	}
+	if (num_dirs >= FILE_CAT_MAX_DIRS) {
+		ESP_LOGE(TAG, "Too many directories for catalog - skipping %s", name);
+		return -1;
 	}
 	
-	return dirP;
+	// Insert it in order in the table.  It starts where the following directory starts.
+	memmove(&dir_table[n+1], &dir_table[n], (num_dirs - n) * sizeof(file_dir_rec_t));
+	dirP = &dir_table[n];
+	dirP->num = num;
+	dirP->num_files = 0;
+	dirP->first_file = (n < num_dirs) ? dir_table[n+1].first_file : num_files_total;
+	dirP->timestamp = 0;
+	num_dirs += 1;
+	file_update_catalog_peaks();
+	
+	return n;
 }
 
 
-static file_node_t* file_allocate_file_entry()
+/**
+ * Add a file to the dir_index directory.  Returns its absolute index (which may already
+ * have existed) or -1 if it can't be added.
+ */
+static int file_insert_file_info(int dir_index, char* name)
 {
-	int len = sizeof(file_node_t);
-	file_node_t* fileP;
+	file_file_rec_t* fileP;
+	int i;
+	int n;
+	uint16_t key;
 	
-	if (file_info_cur_bufferP >= file_info_bufferP + FILE_INFO_BUFFER_LEN) {
-		fileP = NULL;
-		ESP_LOGE(TAG, "filesystem information structure file allocate failed");
-	} else {
-		fileP = (file_node_t*) file_info_cur_bufferP;
-		file_info_cur_bufferP += len;	
+	if (!file_parse_file_name(name, &key)) {
+		ESP_LOGI(TAG, "Skipping %s", name);
+		return -1;
+	}
+	if (file_search_file(dir_index, key, &n) >= 0) {
+		return dir_table[dir_index].first_file + n;
+	}
+	if (num_files_total >= FILE_CAT_MAX_FILES) {
+		ESP_LOGE(TAG, "Too many files for catalog - skipping %s", name);
+		return -1;
+	}
+	
+	// Insert it in order in the table (usually at the end)
+	n += dir_table[dir_index].first_file;
+	memmove(&file_table[n+1], &file_table[n], (num_files_total - n) * sizeof(file_file_rec_t));
+	fileP = &file_table[n];
+	fileP->key = key;
+	fileP->reserved = 0;
+	fileP->size = 0;
+	fileP->timestamp = 0;
+	num_files_total += 1;
+	file_update_catalog_peaks();
+	
+	dir_table[dir_index].num_files += 1;
+	for (i=dir_index+1; i<num_dirs; i++) {
+		dir_table[i].first_file += 1;
 	}
 	
-	return fileP;
+	return n;
 }
 
 
-static char* file_allocate_name_entry(char* name)
+/**
+ * Remove the nth directory record, and the file records in it, from the table
+ */
+static void file_remove_directory_info(int n)
 {
-	char* nameP;
-	int len = strlen(name) + 1;
+	int i;
+	uint32_t first = dir_table[n].first_file;
+	uint32_t cnt = dir_table[n].num_files;
 	
-	if (file_info_cur_bufferP >= file_info_bufferP + FILE_INFO_BUFFER_LEN) {
-		nameP = NULL;
-		ESP_LOGE(TAG, "filesystem information structure name allocate failed");
-	} else {
-		// Make sure length is 32-bit aligned
-		if (len & 0x3) {
-			len = (len & 0xFFFFFFFC) + 4;
-		}
-		nameP = (char*) file_info_cur_bufferP;
-		file_info_cur_bufferP += len;	
+	memmove(&file_table[first], &file_table[first + cnt], (num_files_total - first - cnt) * sizeof(file_file_rec_t));
+	num_files_total -= cnt;
+	
+	memmove(&dir_table[n], &dir_table[n+1], (num_dirs - n - 1) * sizeof(file_dir_rec_t));
+	num_dirs -= 1;
+	for (i=n; i<num_dirs; i++) {
+		dir_table[i].first_file -= cnt;
+	}
+}
+
+
+/**
+ * Remove the nth file record from the dir_index directory
+ */
+static void file_remove_file_info(int dir_index, int n)
+{
+	int i;
+	
+	n += dir_table[dir_index].first_file;
+	memmove(&file_table[n], &file_table[n+1], (num_files_total - n - 1) * sizeof(file_file_rec_t));
+	num_files_total -= 1;
+	
+	dir_table[dir_index].num_files -= 1;
+	for (i=dir_index+1; i<num_dirs; i++) {
+		dir_table[i].first_file -= 1;
+	}
+}
+
+
+// Track the catalog high-water marks (called with the catalog growing)
+static void file_update_catalog_peaks()
+{
+	if (num_dirs > peak_dirs) peak_dirs = num_dirs;
+	if (num_files_total > peak_files) peak_files = num_files_total;
+}
+
+
+// Add the time since start_usec for a card write operation to the write statistics
+static void file_record_write_op(int op, int64_t start_usec, uint32_t len)
+{
+	file_op_stats_t* opP = &write_stats.ops[op];
+	int64_t d = esp_timer_get_time() - start_usec;
+	uint32_t usec = (d > UINT32_MAX) ? UINT32_MAX : (uint32_t) d;
+	uint32_t msec = usec / 1000;
+	int bin = 0;
+	
+	while ((msec != 0) && (bin < (FILE_LAT_NUM_BINS - 1))) {
+		msec >>= 1;
+		bin++;
 	}
 	
-	return nameP;
+	portENTER_CRITICAL(&write_stats_mux);
+	opP->count += 1;
+	opP->bins[bin] += 1;
+	opP->total_usec += usec;
+	if (usec > opP->max_usec) opP->max_usec = usec;
+	if (op == FILE_OP_WRITE) write_stats.write_bytes += len;
+	if (usec >= (FILE_STALL_MSEC * 1000)) write_stats.stalls += 1;
+	portEXIT_CRITICAL(&write_stats_mux);
+	
+	if (usec >= (FILE_STALL_MSEC * 1000)) {
+		ESP_LOGW(TAG, "Card %s stalled %lu mSec", write_op_names[op], usec / 1000);
+	}
 }
 
 
@@ -1544,7 +2274,7 @@ static bool file_is_valid_dir(char* name)
 }
 
 
-// Looking for "ICAM...JPG" or "ICAM...MJPG"
+// Looking for "ICAM...JPG", "ICAM...LOG", "ICAM...MJPG" or "ICAM...RAW"
 static bool file_is_valid_name(char* name)
 {
 	int n;
@@ -1559,8 +2289,9 @@ static bool file_is_valid_name(char* name)
 		return false;
 	}
 	
-	// Look for either ".JPG" or ".MJPG" in the last locations
-	if (strncmp((name + (n - 4)), ".JPG", 4) != 0) {
+	// Look for ".JPG", ".LOG", ".MJPG" or ".RAW" in the last locations
+	if ((strncmp((name + (n - 4)), ".JPG", 4) != 0) && (strncmp((name + (n - 4)), ".RAW", 4) != 0) &&
+	    (strncmp((name + (n - 4)), ".LOG", 4) != 0)) {
 		if (strncmp((name + (n - 5)), ".MJPG", 5) != 0) {
 			return false;
 		}
@@ -1582,14 +2313,14 @@ FRESULT delete_node (
 	UINT i, j;
     FRESULT fr;
     FF_DIR dir;
-
-
+	
+	
     fr = f_opendir(&dir, path); /* Open the sub-directory to make it empty */
     if (fr != FR_OK) return fr;
-
+	
     for (i = 0; path[i]; i++) ; /* Get current path length */
     path[i++] = _T('/');
-
+	
     for (;;) {
         fr = f_readdir(&dir, fno);  /* Get a directory item */
         if (fr != FR_OK || !fno->fname[0]) break;   /* End of directory? */
@@ -1607,71 +2338,482 @@ FRESULT delete_node (
         }
         if (fr != FR_OK) break;
     }
-
+	
     path[--i] = 0;  /* Restore the path name */
     f_closedir(&dir);
-
+	
     if (fr == FR_OK) fr = f_unlink(path);  /* Delete the empty sub-directory */
     return fr;
 }
 
 
 /**
- * Get the numeric portion of an image filename and return it as an integer
+ * Select write_dir_name/write_file_name for the next image or movie file with extension
+ * ext, creating the directory if necessary
  */
-static int parse_filename_for_number(const char* name)
+static bool file_set_write_names(const char* ext)
 {
-	char c;
-	const char* cP = name;
-	int n = 0;
+	char full_name[sizeof(base_path) + DIR_NAME_LEN + FILE_NAME_LEN + 9]; // include room for "DCIM" + '/' characters
+	file_dir_rec_t* dirP = NULL;
+	file_file_rec_t* fileP = NULL;
+	int dir_num;
+	int num_files = 0;
+	int new_file_num;
+	
+	// Get a pointer to the last directory if it exists and the number of files in it.
+	// Then get a pointer to the last file in that directory if it exists.
+	if (num_dirs != 0) {
+		dirP = &dir_table[num_dirs - 1];
+		num_files = dirP->num_files;
+		if (num_files != 0) {
+			fileP = &file_table[dirP->first_file + num_files - 1];
+		}
+	}
+	
+	// Get the current highest file number if possible
+	if (fileP != NULL) {
+		new_file_num = (fileP->key >> FILE_REC_TYPE_BITS) + 1;
+	} else {
+		new_file_num = 1;
+	}
+	num_files += 1;
 	
-	while ((c = *cP++) != 0) {
-		if (c == '.') {
+	// Determine the directory number to use and if a new directory is needed
+	if ((dirP == NULL) || (num_files > MAX_FILES_PER_DIR)) {
+		// Need a new directory
+		dir_num = DIR_NAME_START_NUM + num_dirs;
+	} else {
+		// Use the existing directory
+		dir_num = DIR_NAME_START_NUM + (num_dirs - 1);
+	}
+	
+	// Error if too many dirs
+	if ((dir_num - DIR_NAME_START_NUM) >= MAX_NUM_DIRS) {
+		ESP_LOGE(TAG, "Too many directories for writing");
+		return false;
+	}
+	
+	// Create the full directory and file names
+	sprintf(write_dir_name, "%03dICAMF", dir_num);
+	sprintf(write_file_name, "ICAM_%04d%s", new_file_num, ext);
+	
+	// Create the directory if necessary (will set write_dir_is_new if necessary)
+	sprintf(full_name, "DCIM/%s", write_dir_name);
+	if (!file_create_directory(full_name)) {
+		return false;
+	}
+	
+	return true;
+}
+
+
+/**
+ * Open write_dir_name/write_file_name for writing directly with FatFs, preallocating
+ * prealloc_len bytes if possible
+ */
+static bool file_open_write_file(uint32_t prealloc_len)
+{
+	char full_name[DIR_NAME_LEN + FILE_NAME_LEN + 8]; // include room for "/DCIM" + '/' characters
+	FRESULT ret;
+	int64_t start_usec;
+	
+	sprintf(full_name, "/DCIM/%s/%s", write_dir_name, write_file_name);
+	
+	// Attempt to open the file
+	start_usec = esp_timer_get_time();
+	ret = f_open(&write_fil, full_name, FA_WRITE | FA_CREATE_ALWAYS);
+	if (ret != FR_OK) {
+		ESP_LOGE(TAG, "Could not open %s for writing (%d)", full_name, ret);
+		return false;
+	}
+	write_buf_len = 0;
+	write_fattime = get_fattime();
+	
+	// Allocate the file as one contiguous piece (it is written over from the start)
+	if (prealloc_len != 0) {
+		ret = f_expand(&write_fil, (FSIZE_t) prealloc_len, 1);
+		if (ret != FR_OK) {
+			ESP_LOGW(TAG, "Could not preallocate %s (%d)", full_name, ret);
+		}
+	}
+	file_record_write_op(FILE_OP_OPEN, start_usec, 0);
+	
+	return true;
+}
+
+
+/**
+ * Write the data waiting in file_write_bufferP to the open write file
+ */
+static bool file_flush_write_file()
+{
+	FRESULT ret;
+	int64_t start_usec;
+	UINT bw;
+	
+	if (write_buf_len != 0) {
+		start_usec = esp_timer_get_time();
+		ret = f_write(&write_fil, file_write_bufferP, write_buf_len, &bw);
+		file_record_write_op(FILE_OP_WRITE, start_usec, bw);
+		if ((ret != FR_OK) || (bw != write_buf_len)) {
+			ESP_LOGE(TAG, "Write %s failed (%d)", write_file_name, ret);
+			return false;
+		}
+		write_buf_len = 0;
+	}
+	
+	return true;
+}
+
+
+/**
+ * Get the FAT timestamp and size of a catalog directory (file_name NULL) or file.  Returns
+ * 0 for both if it can't be read.  The filesystem should be mounted.
+ */
+static uint32_t file_get_stats(char* dir_name, char* file_name, uint32_t* size)
+{
+	char path[DIR_NAME_LEN + FILE_NAME_LEN + 8];
+	FILINFO fno;
+	
+	if (file_name == NULL) {
+		sprintf(path, "/DCIM/%s", dir_name);
+	} else {
+		sprintf(path, "/DCIM/%s/%s", dir_name, file_name);
+	}
+	
+	if (f_stat(path, &fno) != FR_OK) {
+		*size = 0;
+		return 0;
+	}
+	
+	*size = (uint32_t) fno.fsize;
+	return ((uint32_t) fno.fdate << 16) | fno.ftime;
+}
+
+
+/**
+ * Load the catalog from the index file.  Returns true if the index exists, describes
+ * this filesystem and nothing has changed the card since it was last updated.  The last
+ * record holds the free cluster count when it was written so a card written by another
+ * device (which changes the free space) is detected and rescanned.
+ */
+static bool file_index_load()
+{
+	bool success = true;
+	file_index_rec_t* recP;
+	uint16_t num;
+	FATFS* fs;
+	FRESULT res;
+	int cnt;
+	int d;
+	int i;
+	int n;
+	uint32_t rec_n = 0;
+	uint32_t free_clusters = 0;
+	DWORD fre_clust;
+	UINT br;
+	
+	index_valid = false;
+	
+	if (f_open(&index_fil, FILE_INDEX_NAME, FA_READ) != FR_OK) {
+		return false;
+	}
+	
+	// Validate the header against this filesystem
+	res = f_read(&index_fil, &index_hdr, sizeof(file_index_hdr_t), &br);
+	if ((res != FR_OK) || (br != sizeof(file_index_hdr_t)) ||
+	    (index_hdr.magic != FILE_INDEX_MAGIC) || (index_hdr.version != FILE_INDEX_VERSION) ||
+	    (index_hdr.num_recs == 0) || (index_hdr.num_recs > FILE_INDEX_MAX_RECS) ||
+	    (index_hdr.n_fatent != (uint32_t) fat_fs->n_fatent) || (index_hdr.csize != (uint32_t) fat_fs->csize)) {
+		f_close(&index_fil);
+		return false;
+	}
+	
+	// Replay the records
+	while (success && (rec_n < index_hdr.num_recs)) {
+		cnt = index_hdr.num_recs - rec_n;
+		if (cnt > FILE_INDEX_BUF_RECS) cnt = FILE_INDEX_BUF_RECS;
+		res = f_read(&index_fil, index_rec_buf, cnt * sizeof(file_index_rec_t), &br);
+		if ((res != FR_OK) || (br != cnt * sizeof(file_index_rec_t))) {
+			success = false;
 			break;
-		} else if ((c >= '0') && (c <= '9')) {
-			n = n*10 + (c - '0');
 		}
+		
+		for (i=0; i<cnt; i++) {
+			recP = &index_rec_buf[i];
+			recP->dir_name[DIR_NAME_LEN-1] = 0;
+			recP->file_name[sizeof(recP->file_name)-1] = 0;
+			free_clusters = recP->free_clusters;
+			
+			switch (recP->op) {
+				case FILE_INDEX_OP_ADD_DIR:
+					n = file_insert_directory_info(recP->dir_name);
+					if (n < 0) {
+						success = false;
+					} else {
+						dir_table[n].timestamp = recP->timestamp;
+					}
+					break;
+				
+				case FILE_INDEX_OP_ADD_FILE:
+					n = file_parse_dir_name(recP->dir_name, &num) ? file_search_directory(num, NULL) : -1;
+					n = (n < 0) ? -1 : file_insert_file_info(n, recP->file_name);
+					if (n < 0) {
+						success = false;
+					} else {
+						file_table[n].size = recP->size;
+						file_table[n].timestamp = recP->timestamp;
+					}
+					break;
+				
+				case FILE_INDEX_OP_DEL_DIR:
+					n = file_parse_dir_name(recP->dir_name, &num) ? file_search_directory(num, NULL) : -1;
+					if (n < 0) {
+						success = false;
+					} else {
+						file_remove_directory_info(n);
+					}
+					break;
+				
+				case FILE_INDEX_OP_DEL_FILE:
+					d = file_parse_dir_name(recP->dir_name, &num) ? file_search_directory(num, NULL) : -1;
+					n = ((d < 0) || !file_parse_file_name(recP->file_name, &num)) ? -1 : file_search_file(d, num, NULL);
+					if (n < 0) {
+						success = false;
+					} else {
+						file_remove_file_info(d, n);
+					}
+					break;
+				
+				case FILE_INDEX_OP_SYNC:
+					break;
+				
+				default:
+					success = false;
+			}
+			
+			if (!success) break;
+		}
+		rec_n += cnt;
 	}
+	f_close(&index_fil);
 	
-	return n;
+	// The card must not have changed since the last record was written
+	if (success) {
+		res = f_getfree("0:", &fre_clust, &fs);
+		success = (res == FR_OK) && ((uint32_t) fre_clust == free_clusters);
+	}
+	
+	if (success) {
+		index_num_recs = index_hdr.num_recs;
+		index_valid = true;
+	} else {
+		ESP_LOGI(TAG, "Catalog index out of date");
+	}
+	
+	return success;
 }
 
 
 /**
- * Dump the filesystem information structure
+ * Rewrite the index file from the catalog.  The header is invalidated first and written
+ * last so an interrupted rebuild leaves an index that won't load.
  */
-#ifdef DEBUG_FS_INFO_STRUCT
-static void dump_filesystem_info()
+static bool file_index_rebuild()
 {
-	directory_node_t* cur_dirP;
-	file_node_t* cur_fileP;
+	file_dir_rec_t* dirP;
+	file_index_rec_t* recP;
+	FATFS* fs;
+	int d;
+	int f;
+	int n = 0;
+	DWORD fre_clust;
+	UINT bw;
+	
+	index_valid = false;
 	
-	ESP_LOGI(TAG, "filesystem information structure requires %d bytes", (int) (file_info_cur_bufferP - file_info_bufferP));
+	// The index is sized for a full catalog so is never extended as it is updated
+	if (num_dirs + num_files_total + 1 > FILE_INDEX_MAX_RECS) {
+		return false;
+	}
+	
+	if (f_open(&index_fil, FILE_INDEX_NAME, FA_READ | FA_WRITE | FA_OPEN_ALWAYS) != FR_OK) {
+		ESP_LOGE(TAG, "Could not open catalog index");
+		return false;
+	}
 	
-	cur_dirP = indexed_fs_rootP;
-	while (cur_dirP != NULL) {
-		if (cur_dirP->nextP == NULL) {
-			ESP_LOGI(TAG, "Directory: %s (%d files): (next NULL)", cur_dirP->nameP, cur_dirP->num_files);
+	if (f_size(&index_fil) != FILE_INDEX_LEN) {
+		if (f_truncate(&index_fil) != FR_OK) {
+			goto error;
+		}
+		if (f_expand(&index_fil, FILE_INDEX_LEN, 1) != FR_OK) {
+			// Card is too fragmented for a contiguous file
+			if ((f_lseek(&index_fil, FILE_INDEX_LEN) != FR_OK) || (f_tell(&index_fil) != FILE_INDEX_LEN)) {
+				goto error;
+			}
+		}
+		(void) f_chmod(FILE_INDEX_NAME, AM_HID, AM_HID);
+	}
+	
+	memset(&index_hdr, 0, sizeof(file_index_hdr_t));
+	if ((f_lseek(&index_fil, 0) != FR_OK) || (f_write(&index_fil, &index_hdr, sizeof(file_index_hdr_t), &bw) != FR_OK) ||
+	    (bw != sizeof(file_index_hdr_t))) {
+		goto error;
+	}
+	
+	// Write a record for every directory followed by records for its files
+	for (d=0; d<=num_dirs; d++) {
+		if (d < num_dirs) {
+			dirP = &dir_table[d];
+			f = -1;
 		} else {
-			ESP_LOGI(TAG, "Directory: %s (%d files):", cur_dirP->nameP, cur_dirP->num_files);
+			// Final sync record with the current free space
+			dirP = NULL;
+			f = 0;
 		}
-		cur_fileP = cur_dirP->fileP;
-		cur_dirP = cur_dirP->nextP;
-		while (cur_fileP != NULL) {
-			if (cur_fileP->prevP == NULL) {
-				if (cur_fileP->nextP == NULL) {
-					ESP_LOGI(TAG, "  File: %s (prev NULL, next NULL)", cur_fileP->nameP);
-				} else {
-					ESP_LOGI(TAG, "  File: %s (prev NULL)", cur_fileP->nameP);
+		
+		do {
+			recP = &index_rec_buf[n % FILE_INDEX_BUF_RECS];
+			memset(recP, 0, sizeof(file_index_rec_t));
+			if (dirP != NULL) {
+				file_make_dir_name(dirP, recP->dir_name);
+			}
+			if (dirP == NULL) {
+				if (f_getfree("0:", &fre_clust, &fs) != FR_OK) {
+					goto error;
 				}
+				recP->op = FILE_INDEX_OP_SYNC;
+				recP->free_clusters = (uint32_t) fre_clust;
+			} else if (f < 0) {
+				recP->op = FILE_INDEX_OP_ADD_DIR;
+				recP->timestamp = dirP->timestamp;
 			} else {
-				if (cur_fileP->nextP == NULL) {
-					ESP_LOGI(TAG, "  File: %s (next NULL)", cur_fileP->nameP);
-				} else {
-					ESP_LOGI(TAG, "  File: %s", cur_fileP->nameP);
+				recP->op = FILE_INDEX_OP_ADD_FILE;
+				recP->size = file_table[dirP->first_file + f].size;
+				recP->timestamp = file_table[dirP->first_file + f].timestamp;
+				file_make_file_name(&file_table[dirP->first_file + f], recP->file_name);
+			}
+			n += 1;
+			
+			// Write full buffers and the remaining records after the sync record
+			if (((n % FILE_INDEX_BUF_RECS) == 0) || (dirP == NULL)) {
+				f_write(&index_fil, index_rec_buf, (((n - 1) % FILE_INDEX_BUF_RECS) + 1) * sizeof(file_index_rec_t), &bw);
+				if (bw != (((n - 1) % FILE_INDEX_BUF_RECS) + 1) * sizeof(file_index_rec_t)) {
+					goto error;
 				}
 			}
-			cur_fileP = cur_fileP->nextP;
+			f += 1;
+		} while ((dirP != NULL) && (f < dirP->num_files));
+	}
+	
+	// Commit the index
+	index_hdr.magic = FILE_INDEX_MAGIC;
+	index_hdr.version = FILE_INDEX_VERSION;
+	index_hdr.num_recs = (uint32_t) n;
+	index_hdr.n_fatent = (uint32_t) fat_fs->n_fatent;
+	index_hdr.csize = (uint32_t) fat_fs->csize;
+	if ((f_lseek(&index_fil, 0) != FR_OK) || (f_write(&index_fil, &index_hdr, sizeof(file_index_hdr_t), &bw) != FR_OK) ||
+	    (bw != sizeof(file_index_hdr_t))) {
+		goto error;
+	}
+	if (f_close(&index_fil) != FR_OK) {
+		ESP_LOGE(TAG, "Could not write catalog index");
+		return false;
+	}
+	
+	index_num_recs = n;
+	index_valid = true;
+	return true;
+	
+error:
+	ESP_LOGE(TAG, "Could not write catalog index");
+	f_close(&index_fil);
+	return false;
+}
+
+
+/**
+ * Append a record of a catalog change to the index file.  The record is written before
+ * the header that includes it so an interrupted update leaves the previous index intact
+ * (which will then fail its free space check and be rebuilt at the next mount).
+ */
+static void file_index_log(uint32_t op, char* dir_name, char* file_name, uint32_t size, uint32_t timestamp)
+{
+	file_index_rec_t rec;
+	FATFS* fs;
+	DWORD fre_clust;
+	UINT bw;
+	
+	if (!index_valid) {
+		// The next mount will rescan the card
+		return;
+	}
+	
+	if (index_num_recs >= FILE_INDEX_MAX_RECS) {
+		// Compact the index
+		(void) file_index_rebuild();
+		return;
+	}
+	
+	memset(&rec, 0, sizeof(file_index_rec_t));
+	rec.op = op;
+	rec.size = size;
+	rec.timestamp = timestamp;
+	strncpy(rec.dir_name, dir_name, DIR_NAME_LEN-1);
+	if (file_name != NULL) {
+		strncpy(rec.file_name, file_name, sizeof(rec.file_name)-1);
+	}
+	if (f_getfree("0:", &fre_clust, &fs) != FR_OK) {
+		index_valid = false;
+		return;
+	}
+	rec.free_clusters = (uint32_t) fre_clust;
+	
+	index_valid = false;
+	if (f_open(&index_fil, FILE_INDEX_NAME, FA_READ | FA_WRITE | FA_OPEN_EXISTING) == FR_OK) {
+		if ((f_lseek(&index_fil, sizeof(file_index_hdr_t) + index_num_recs * sizeof(file_index_rec_t)) == FR_OK) &&
+		    (f_write(&index_fil, &rec, sizeof(file_index_rec_t), &bw) == FR_OK) && (bw == sizeof(file_index_rec_t))) {
+			
+			index_hdr.num_recs = index_num_recs + 1;
+			if ((f_lseek(&index_fil, 0) == FR_OK) &&
+			    (f_write(&index_fil, &index_hdr, sizeof(file_index_hdr_t), &bw) == FR_OK) && (bw == sizeof(file_index_hdr_t))) {
+				index_valid = true;
+			}
+		}
+		if (f_close(&index_fil) != FR_OK) {
+			index_valid = false;
+		}
+	}
+	
+	if (index_valid) {
+		index_num_recs += 1;
+	} else {
+		ESP_LOGE(TAG, "Could not update catalog index");
+	}
+}
+
+
+/**
+ * Dump the filesystem information structure
+ */
+#ifdef DEBUG_FS_INFO_STRUCT
+static void dump_filesystem_info()
+{
+	char name[FILE_NAME_LEN];
+	int d;
+	int i;
+	file_dir_rec_t* cur_dirP;
+	
+	ESP_LOGI(TAG, "filesystem information structure has %d directories and %d files (%d bytes)", num_dirs, num_files_total,
+	         (int) (FILE_CAT_MAX_DIRS*sizeof(file_dir_rec_t) + num_files_total*sizeof(file_file_rec_t)));
+	
+	for (d=0; d<num_dirs; d++) {
+		cur_dirP = &dir_table[d];
+		file_make_dir_name(cur_dirP, name);
+		ESP_LOGI(TAG, "Directory: %s (%d files, first %lu):", name, cur_dirP->num_files, cur_dirP->first_file);
+		for (i=0; i<cur_dirP->num_files; i++) {
+			file_make_file_name(&file_table[cur_dirP->first_file + i], name);
+			ESP_LOGI(TAG, "  File: %s", name);
 		}
 	}
 }
@@ -29,7 +29,7 @@
 
 
 // Notes - for above
-// file_info_bufferP must be allocated elsewhere
+// file_info_bufferP and file_write_bufferP must be allocated elsewhere
 // FILE_MAX_FILES_PER_DIR
 // FILE_MAX_CATALOG_NAMES
 
@@ -59,11 +59,15 @@
 //        NNNICAMF sub-folders, each containing up to MAX_FILES_PER_DIR files, NNN is 100-999
 //          ICAM_NNNN.JPG files where NNNN is 0001-9999
 //          ICAM_NNNN.MJPG files where NNNN is 0001-9999
+//          ICAM_NNNN.LOG files where NNNN is 0001-9999
+//          ICAM_NNNN.THM files - thumbnail for the jpeg or movie file with the same number
 //      FW folder - created automatically if it does not exist (todo??? maybe this module doesn't deal with this)
 //        esp32_M_N_fw.bin file - ESP32 firmware update file where M, N are major/minor (optional)
 //        tiny1c_M_N_fw.bin file - Tiny1C firmware update file where M, N are major/minor (optional)
+//      SCREENS folder - created when the first screenshot is saved (CONFIG_SCREENDUMP_ENABLE)
+//        SCRN_NNNN.BMP files where NNNN is 0001-9999
 //
-// Filesystem catalog includes only image directories.
+// Filesystem catalog includes only image directories and files following these patterns.
 //
 // Starting sub-folder number
 #define DIR_NAME_START_NUM 100
@@ -80,6 +84,36 @@
 #define DIR_NAME_LEN       16
 #define FILE_NAME_LEN      21
 
+// Thumbnail file name extension
+#define FILE_THUMB_EXT     ".THM"
+
+// Firmware update files ("<prefix>M_N_fw.bin" in the FW directory)
+#define FILE_FW_DIR        "/FW"
+#define FILE_FW_SUFFIX     "_fw.bin"
+#define FILE_T1C_FW_PREFIX "tiny1c_"
+#define FILE_FW_NAME_LEN   32
+
+// Card write speed test file (in the root directory so it isn't catalogued)
+#define FILE_TEST_NAME     "/ICAMTEST.BIN"
+
+// Screenshots ("SCRN_NNNN.BMP" in their own directory so they aren't catalogued)
+#define FILE_SCREEN_DIR    "/SCREENS"
+#define FILE_SCREEN_PREFIX "SCRN_"
+#define FILE_SCREEN_EXT    ".BMP"
+
+// Card write operations timed for the write statistics
+#define FILE_OP_MOUNT      0
+#define FILE_OP_OPEN       1
+#define FILE_OP_WRITE      2
+#define FILE_OP_CLOSE      3
+#define FILE_NUM_OPS       4
+
+// Write latency histogram bins are powers of 2 mSec: < 1, < 2, < 4, ... < 256, >= 256
+#define FILE_LAT_NUM_BINS  10
+
+// Operations taking at least this long are counted (and logged) as stalls
+#define FILE_STALL_MSEC    100
+
 // Newlib buffer size increase (see https://blog.drorgluska.com/2022/06/esp32-sd-card-optimization.html)
 // Through experimentation it was discovered 8192 bytes is the largest that can be
 // taken from the heap during runtime without causing memory allocation problems.
@@ -89,23 +123,46 @@
 //
 // File System local data structure
 //
-typedef struct file_node_t file_node_t;
-
-struct file_node_t {
-	char* nameP;
-	file_node_t* nextP;
-	file_node_t* prevP;
-};
-
-typedef struct directory_node_t directory_node_t;
-
-struct directory_node_t {
-	char* nameP;
-	directory_node_t* nextP;
-	directory_node_t* prevP;
-	file_node_t* fileP;
+// Catalog page entry
+typedef struct {
+	char name[FILE_NAME_LEN];
+	uint32_t size;            // File length or number of files in a directory
+	uint32_t timestamp;
+} file_catalog_entry_t;
+
+// Catalog time range entry
+typedef struct {
+	uint16_t dir_index;
+	uint16_t file_index;
+	uint32_t timestamp;
+} file_range_entry_t;
+
+// Catalog utilization.  The peak values are high-water marks since the driver was
+// initialized (they survive catalog rebuilds) and show how close file_info_bufferP has
+// come to filling.
+typedef struct {
+	int num_dirs;
 	int num_files;
-};
+	int max_dirs;
+	int max_files;
+	int peak_dirs;
+	int peak_files;
+	uint32_t peak_bytes;      // Bytes of file_info_bufferP used at the peak
+} file_catalog_stats_t;
+
+// Card write statistics since the card was inserted (or the driver initialized)
+typedef struct {
+	uint32_t count;
+	uint32_t bins[FILE_LAT_NUM_BINS];
+	uint32_t max_usec;
+	uint64_t total_usec;
+} file_op_stats_t;
+
+typedef struct {
+	file_op_stats_t ops[FILE_NUM_OPS];
+	uint64_t write_bytes;     // Bytes written by FILE_OP_WRITE operations
+	uint32_t stalls;          // Operations taking at least FILE_STALL_MSEC
+} file_write_stats_t;
 
 
 //
@@ -120,36 +177,58 @@ bool file_init_card();
 bool file_reinit_card();
 bool file_mount_sdcard();
 bool file_delete_directory(char* dir_name);
+int file_delete_directory_step(char* dir_name);
 bool file_delete_file(char* dir_name, char* file_name);
-bool file_open_image_write_file(FILE** fp);
+bool file_open_image_write_file(const char* ext, uint32_t prealloc_len);
+bool file_open_image_sibling_file(const char* ext, uint32_t prealloc_len);
+bool file_write_file(const uint8_t* bufP, uint32_t len);
+bool file_close_write_file();
+bool file_write_image_file(char* dir_plus_file_name, const uint8_t* bufP, uint32_t len);
+bool file_write_image_sibling_file(const char* ext, const uint8_t* bufP, uint32_t len);
+bool file_write_test_file(uint32_t len);
+void file_delete_test_file();
+bool file_write_screen_file(const uint8_t* hdrP, uint32_t hdr_len, const uint8_t* bufP, uint32_t len, char* name);
+bool file_image_file_exists(char* dir_plus_file_name);
+void file_delete_sibling_file(char* dir_name, char* file_name, const char* ext);
 bool file_open_image_read_file(char* dir_plus_file_name, FILE** fp);
 char* file_get_open_write_dirname(bool* new);
 char* file_get_open_write_filename();
 int file_get_open_filelength(FILE* fp);
 bool file_read_open_section(FILE* fp, char* buf, int start_pos, int len);
+int file_read_image_section(char* dir_plus_file_name, uint32_t offset, uint8_t* buf, uint32_t len);
+bool file_open_fw_file(const char* prefix, char* name, uint32_t* len);
+int file_read_fw_file(uint8_t* buf, uint32_t len);
+void file_close_fw_file();
 void file_close_file(FILE* fp);
 void file_unmount_sdcard();
 
 // Local filesystem info management (file_task only)
 bool file_create_filesystem_info();
 void file_delete_filesystem_info();
-directory_node_t* file_add_directory_info(char* name);
-file_node_t* file_add_file_info(directory_node_t* dirP, char* name);
+bool file_add_directory_info(char* name);
+bool file_add_file_info(char* dir_name, char* name);
 void file_delete_directory_info(int n);
-void file_delete_file_info(directory_node_t* dirP, int n);
+void file_delete_file_info(int dir_index, int n);
+void file_sync_filesystem_info();
 int file_get_name_list(int type, char* list);
 
 // Local filesystem info management (mutex protected for multiple task access)
-directory_node_t* file_get_indexed_directory(int n);
+int file_get_catalog_page(int type, int offset, int count, file_catalog_entry_t* entries, int* total);
+int file_get_catalog_range(uint32_t start, uint32_t end, int offset, int count, file_range_entry_t* entries, int* total);
+bool file_get_directory_name(int n, char* name);
 int file_get_named_directory_index(char* name);
-file_node_t* file_get_indexed_file(directory_node_t* dirP, int n);
-int file_get_named_file_index(directory_node_t* dirP, char* name);
+bool file_get_file_name(int dir_index, int n, char* name);
+int file_get_named_file_index(int dir_index, char* name);
 int file_get_num_directories();
 int file_get_num_files();
 int file_get_abs_file_index(int dir_index, int file_index);
 bool file_get_indexes_from_abs(int abs_index, int* dir_index, int* file_index);
 uint64_t file_get_storage_len();
 uint64_t file_get_storage_free();
+void file_update_storage_info();
+void file_get_catalog_stats(file_catalog_stats_t* stats);
+void file_get_write_stats(file_write_stats_t* stats);
+const char* file_get_op_name(int op);
 
 
 #endif /* FILE_UTILITIES_H */
\ No newline at end of file
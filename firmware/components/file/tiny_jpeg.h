@@ -106,7 +106,7 @@ extern "C"
 //  PARAMETERS
 //      fd:                 Open filesystem descriptor
 //      width, height:      image size in pixels
-//      num_components:     3 is RGB. 4 is RGBA. Those are the only supported values
+//      num_components:     1 is grayscale. 3 is RGB. 4 is RGBA. Those are the only supported values
 //      src_data:           pointer to the pixel data.
 //
 //  RETURN:
@@ -129,7 +129,7 @@ int tje_encode_to_file(FILE* fd,
 //                          2: Very good quality. About 1/2 the size of 3.
 //                          1: Noticeable. About 1/6 the size of 3, or 1/3 the size of 2.
 //      width, height:      image size in pixels
-//      num_components:     3 is RGB. 4 is RGBA. Those are the only supported values
+//      num_components:     1 is grayscale. 3 is RGB. 4 is RGBA. Those are the only supported values
 //      src_data:           pointer to the pixel data.
 //
 //  RETURN:
@@ -176,6 +176,52 @@ int tje_encode_with_func(tje_write_func* func,
 typedef char* (*tje_comment_callback_func)(int item_index, char* buf);
 
 void tje_register_comment_callback(tje_comment_callback_func func);
+
+
+// - tje_register_app_callback -
+//
+// Usage:
+//  Registers a callback that is used to add APPn (marker 0 - 15) segments to the
+//  encoded image stream after the comments.  The callback is passed a buffer of
+//  TJEI_APP_LEN bytes and an index that is incremented for every segment.  It
+//  should fill the buffer with the next segment's data and return its length, or
+//  return 0 when there are no more segments to include.  Data larger than one
+//  segment is streamed through the buffer so it never has to exist in one piece.
+//  Register a NULL func to disable.
+//
+
+#define TJEI_APP_LEN 4096
+
+typedef int (*tje_app_callback_func)(int seg_index, unsigned char* buf);
+
+void tje_register_app_callback(int marker, tje_app_callback_func func);
+
+
+// - tje_set_chroma_subsampling -
+//
+// Usage:
+//  Selects 4:2:0 chroma subsampling (enable != 0) for the following encodes.  The
+//  chroma of each 2x2 block of pixels is averaged so only half the blocks are
+//  encoded, making the encode faster and the image smaller at the cost of color
+//  detail.  Width and height should be multiples of 16.  The default is 4:4:4.
+//
+
+void tje_set_chroma_subsampling(int enable);
+
+
+// - tje_register_strip_callback -
+//
+// Usage:
+//  Registers a callback that supplies the source image in horizontal strips of
+//  strip_height rows (a multiple of 16) as they are encoded so the whole image never
+//  has to exist at once.  The callback is passed the first row and the number of rows
+//  in the strip and returns a pointer to their pixel data.  The src_data passed to the
+//  encode function is ignored.  Register a NULL func to disable.
+//
+
+typedef const unsigned char* (*tje_strip_callback_func)(int y, int h);
+
+void tje_register_strip_callback(tje_strip_callback_func func, int strip_height);
 #endif // TJE_HEADER_GUARD
 
 
@@ -200,13 +246,9 @@ void tje_register_comment_callback(tje_comment_callback_func func);
 #define TJEI_FORCE_INLINE static // TODO: equivalent for gcc & clang
 #endif
 
-// Only use zero for debugging and/or inspection.
-#define TJE_USE_FAST_DCT 1
-
 // C std lib
 #include <assert.h>
 #include <inttypes.h>
-#include <math.h>   // floorf, ceilf
 #include <stdio.h>  // FILE, puts
 #include <string.h> // memcpy
 
@@ -258,6 +300,12 @@ typedef struct
     uint8_t         qt_luma[64];
     uint8_t         qt_chroma[64];
 
+    // Quantization reciprocals (natural order) for the integer DCT output, computed
+    // once for the current quality.
+    int             quality;
+    uint32_t        qr_luma[64];
+    uint32_t        qr_chroma[64];
+
     // fwrite by default. User-defined when using tje_encode_with_func.
     TJEWriteContext write_context;
 
@@ -426,6 +474,26 @@ static tje_comment_callback_func comment_callback;
 static int comment_index = 0;
 
 
+// ============================================================
+// Application segment support
+// ============================================================
+static tje_app_callback_func app_callback;
+static int app_marker = 0;
+
+
+// ============================================================
+// Chroma subsampling support
+// ============================================================
+static int chroma_subsample = 0;
+
+
+// ============================================================
+// Strip source support
+// ============================================================
+static tje_strip_callback_func strip_callback;
+static int strip_lines = 0;
+
+
 // ============================================================
 // The following structs exist only for code clarity, debugability, and
 // readability. They are used when writing to disk, but it is useful to have
@@ -460,6 +528,13 @@ typedef struct
     char     com_str[TJEI_COMMENT_LEN+1];
 } TJEJPEGComment;
 
+typedef struct
+{
+    uint16_t app;
+    uint16_t app_len;
+    uint8_t  app_data[TJEI_APP_LEN];
+} TJEJPEGApp;
+
 // Helper struct for TJEFrameHeader (below).
 typedef struct
 {
@@ -475,7 +550,7 @@ typedef struct
     uint8_t          precision;             // Sample precision (bits per sample).
     uint16_t         height;
     uint16_t         width;
-    uint8_t          num_components;        // For this implementation, will be equal to 3.
+    uint8_t          num_components;        // For this implementation, will be equal to 1 or 3.
     TJEComponentSpec component_spec[3];
 } TJEFrameHeader;
 
@@ -489,7 +564,7 @@ typedef struct
 {
     uint16_t              SOS;
     uint16_t              len;
-    uint8_t               num_components;  // 3.
+    uint8_t               num_components;  // 1 or 3.
     TJEFrameComponentSpec component_spec[3];
     uint8_t               first;  // 0
     uint8_t               last;  // 63
@@ -670,25 +745,47 @@ TJEI_FORCE_INLINE void tjei_write_bits(TJEState* state,
 }
 
 // DCT implementation by Thomas G. Lane.
-// Obtained through NVIDIA
-//  http://developer.download.nvidia.com/SDK/9.5/Samples/vidimaging_samples.html#gpgpu_dct
+//  Independent JPEG Group's jfdctint.c (the accurate integer method)
 //
 // QUOTE:
-//  This implementation is based on Arai, Agui, and Nakajima's algorithm for
-//  scaled DCT.  Their original paper (Trans. IEICE E-71(11):1095) is in
-//  Japanese, but the algorithm is described in the Pennebaker & Mitchell
-//  JPEG textbook (see REFERENCES section in file README).  The following code
-//  is based directly on figure 4-8 in P&M.
+//  This implementation is based on an algorithm described in
+//  C. Loeffler, A. Ligtenberg and G. Moschytz, "Practical Fast 1-D DCT
+//  Algorithms with 11 Multiplications", Proc. Int'l. Conf. on Acoustics,
+//  Speech, and Signal Processing 1989 (ICASSP '89), pp. 988-991.
 //
-static void tjei_fdct (float * data)
+// It uses only integer multiplies and shifts, which are much faster than floating
+// point on the ESP32.  The samples carry TJEI_SAMPLE_BITS fraction bits, which take
+// the place of the original's PASS1_BITS scaling of the intermediate results.  The
+// outputs are scaled up by 8 << TJEI_SAMPLE_BITS.
+//
+#define TJEI_CONST_BITS  13
+#define TJEI_SAMPLE_BITS 2
+
+#define TJEI_FIX_0_298631336  ((int32_t)  2446)
+#define TJEI_FIX_0_390180644  ((int32_t)  3196)
+#define TJEI_FIX_0_541196100  ((int32_t)  4433)
+#define TJEI_FIX_0_765366865  ((int32_t)  6270)
+#define TJEI_FIX_0_899976223  ((int32_t)  7373)
+#define TJEI_FIX_1_175875602  ((int32_t)  9633)
+#define TJEI_FIX_1_501321110  ((int32_t)  12299)
+#define TJEI_FIX_1_847759065  ((int32_t)  15137)
+#define TJEI_FIX_1_961570560  ((int32_t)  16069)
+#define TJEI_FIX_2_053119869  ((int32_t)  16819)
+#define TJEI_FIX_2_562915447  ((int32_t)  20995)
+#define TJEI_FIX_3_072711026  ((int32_t)  25172)
+
+#define TJEI_DESCALE(x, n)  (((x) + ((int32_t) 1 << ((n)-1))) >> (n))
+
+static void tjei_fdct (int32_t * data)
 {
-    float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
-    float tmp10, tmp11, tmp12, tmp13;
-    float z1, z2, z3, z4, z5, z11, z13;
-    float *dataptr;
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z1, z2, z3, z4, z5;
+    int32_t *dataptr;
     int ctr;
 
     /* Pass 1: process rows. */
+    /* Note results are scaled up by sqrt(8) compared to a true DCT. */
 
     dataptr = data;
     for ( ctr = 7; ctr >= 0; ctr-- ) {
@@ -703,42 +800,48 @@ static void tjei_fdct (float * data)
 
         /* Even part */
 
-        tmp10 = tmp0 + tmp3;    /* phase 2 */
+        tmp10 = tmp0 + tmp3;
         tmp13 = tmp0 - tmp3;
         tmp11 = tmp1 + tmp2;
         tmp12 = tmp1 - tmp2;
 
-        dataptr[0] = tmp10 + tmp11; /* phase 3 */
+        dataptr[0] = tmp10 + tmp11;
         dataptr[4] = tmp10 - tmp11;
 
-        z1 = (tmp12 + tmp13) * ((float) 0.707106781); /* c4 */
-        dataptr[2] = tmp13 + z1;    /* phase 5 */
-        dataptr[6] = tmp13 - z1;
+        z1 = (tmp12 + tmp13) * TJEI_FIX_0_541196100;
+        dataptr[2] = TJEI_DESCALE(z1 + tmp13 * TJEI_FIX_0_765366865, TJEI_CONST_BITS);
+        dataptr[6] = TJEI_DESCALE(z1 - tmp12 * TJEI_FIX_1_847759065, TJEI_CONST_BITS);
 
         /* Odd part */
 
-        tmp10 = tmp4 + tmp5;    /* phase 2 */
-        tmp11 = tmp5 + tmp6;
-        tmp12 = tmp6 + tmp7;
-
-        /* The rotator is modified from fig 4-8 to avoid extra negations. */
-        z5 = (tmp10 - tmp12) * ((float) 0.382683433); /* c6 */
-        z2 = ((float) 0.541196100) * tmp10 + z5; /* c2-c6 */
-        z4 = ((float) 1.306562965) * tmp12 + z5; /* c2+c6 */
-        z3 = tmp11 * ((float) 0.707106781); /* c4 */
-
-        z11 = tmp7 + z3;        /* phase 5 */
-        z13 = tmp7 - z3;
-
-        dataptr[5] = z13 + z2;  /* phase 6 */
-        dataptr[3] = z13 - z2;
-        dataptr[1] = z11 + z4;
-        dataptr[7] = z11 - z4;
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = (z3 + z4) * TJEI_FIX_1_175875602;
+
+        tmp4 = tmp4 * TJEI_FIX_0_298631336;
+        tmp5 = tmp5 * TJEI_FIX_2_053119869;
+        tmp6 = tmp6 * TJEI_FIX_3_072711026;
+        tmp7 = tmp7 * TJEI_FIX_1_501321110;
+        z1 = z1 * -TJEI_FIX_0_899976223;
+        z2 = z2 * -TJEI_FIX_2_562915447;
+        z3 = z3 * -TJEI_FIX_1_961570560;
+        z4 = z4 * -TJEI_FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        dataptr[7] = TJEI_DESCALE(tmp4 + z1 + z3, TJEI_CONST_BITS);
+        dataptr[5] = TJEI_DESCALE(tmp5 + z2 + z4, TJEI_CONST_BITS);
+        dataptr[3] = TJEI_DESCALE(tmp6 + z2 + z3, TJEI_CONST_BITS);
+        dataptr[1] = TJEI_DESCALE(tmp7 + z1 + z4, TJEI_CONST_BITS);
 
         dataptr += 8;     /* advance pointer to next row */
     }
 
     /* Pass 2: process columns. */
+    /* The results are left scaled up by an overall factor of 8. */
 
     dataptr = data;
     for ( ctr = 8-1; ctr >= 0; ctr-- ) {
@@ -753,70 +856,55 @@ static void tjei_fdct (float * data)
 
         /* Even part */
 
-        tmp10 = tmp0 + tmp3;    /* phase 2 */
+        tmp10 = tmp0 + tmp3;
         tmp13 = tmp0 - tmp3;
         tmp11 = tmp1 + tmp2;
         tmp12 = tmp1 - tmp2;
 
-        dataptr[8*0] = tmp10 + tmp11; /* phase 3 */
+        dataptr[8*0] = tmp10 + tmp11;
         dataptr[8*4] = tmp10 - tmp11;
 
-        z1 = (tmp12 + tmp13) * ((float) 0.707106781); /* c4 */
-        dataptr[8*2] = tmp13 + z1; /* phase 5 */
-        dataptr[8*6] = tmp13 - z1;
+        z1 = (tmp12 + tmp13) * TJEI_FIX_0_541196100;
+        dataptr[8*2] = TJEI_DESCALE(z1 + tmp13 * TJEI_FIX_0_765366865, TJEI_CONST_BITS);
+        dataptr[8*6] = TJEI_DESCALE(z1 - tmp12 * TJEI_FIX_1_847759065, TJEI_CONST_BITS);
 
         /* Odd part */
 
-        tmp10 = tmp4 + tmp5;    /* phase 2 */
-        tmp11 = tmp5 + tmp6;
-        tmp12 = tmp6 + tmp7;
-
-        /* The rotator is modified from fig 4-8 to avoid extra negations. */
-        z5 = (tmp10 - tmp12) * ((float) 0.382683433); /* c6 */
-        z2 = ((float) 0.541196100) * tmp10 + z5; /* c2-c6 */
-        z4 = ((float) 1.306562965) * tmp12 + z5; /* c2+c6 */
-        z3 = tmp11 * ((float) 0.707106781); /* c4 */
-
-        z11 = tmp7 + z3;        /* phase 5 */
-        z13 = tmp7 - z3;
-
-        dataptr[8*5] = z13 + z2; /* phase 6 */
-        dataptr[8*3] = z13 - z2;
-        dataptr[8*1] = z11 + z4;
-        dataptr[8*7] = z11 - z4;
+        z1 = tmp4 + tmp7;
+        z2 = tmp5 + tmp6;
+        z3 = tmp4 + tmp6;
+        z4 = tmp5 + tmp7;
+        z5 = (z3 + z4) * TJEI_FIX_1_175875602;
+
+        tmp4 = tmp4 * TJEI_FIX_0_298631336;
+        tmp5 = tmp5 * TJEI_FIX_2_053119869;
+        tmp6 = tmp6 * TJEI_FIX_3_072711026;
+        tmp7 = tmp7 * TJEI_FIX_1_501321110;
+        z1 = z1 * -TJEI_FIX_0_899976223;
+        z2 = z2 * -TJEI_FIX_2_562915447;
+        z3 = z3 * -TJEI_FIX_1_961570560;
+        z4 = z4 * -TJEI_FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        dataptr[8*7] = TJEI_DESCALE(tmp4 + z1 + z3, TJEI_CONST_BITS);
+        dataptr[8*5] = TJEI_DESCALE(tmp5 + z2 + z4, TJEI_CONST_BITS);
+        dataptr[8*3] = TJEI_DESCALE(tmp6 + z2 + z3, TJEI_CONST_BITS);
+        dataptr[8*1] = TJEI_DESCALE(tmp7 + z1 + z4, TJEI_CONST_BITS);
 
         dataptr++;          /* advance pointer to next column */
     }
 }
-#if !TJE_USE_FAST_DCT
-static float slow_fdct(int u, int v, float* data)
-{
-#define kPI 3.14159265f
-    float res = 0.0f;
-    float cu = (u == 0) ? 0.70710678118654f : 1;
-    float cv = (v == 0) ? 0.70710678118654f : 1;
-    for ( int y = 0; y < 8; ++y ) {
-        for ( int x = 0; x < 8; ++x ) {
-            res += (data[y * 8 + x]) *
-                    cosf(((2.0f * x + 1.0f) * u * kPI) / 16.0f) *
-                    cosf(((2.0f * y + 1.0f) * v * kPI) / 16.0f);
-        }
-    }
-    res *= 0.25f * cu * cv;
-    return res;
-#undef kPI
-}
-#endif
 
 #define ABS(x) ((x) < 0 ? -(x) : (x))
 
+// Quantization reciprocal precision
+#define TJEI_QR_BITS 18
+
 static void tjei_encode_and_write_MCU(TJEState* state,
-                                      float* mcu,
-#if TJE_USE_FAST_DCT
-                                      float* qt,  // Pre-processed quantization matrix.
-#else
-                                      uint8_t* qt,
-#endif
+                                      int32_t* mcu,  // Level shifted samples (overwritten)
+                                      uint32_t* qr,  // Quantization reciprocals.
                                       uint8_t* huff_dc_len, uint16_t* huff_dc_code, // Huffman tables
                                       uint8_t* huff_ac_len, uint16_t* huff_ac_code,
                                       int* pred,  // Previous DC coefficient
@@ -825,35 +913,13 @@ static void tjei_encode_and_write_MCU(TJEState* state,
 {
     int du[64];  // Data unit in zig-zag order
 
-    float dct_mcu[64];
-    memcpy(dct_mcu, mcu, 64 * sizeof(float));
-
-#if TJE_USE_FAST_DCT
-    tjei_fdct(dct_mcu);
-    for ( int i = 0; i < 64; ++i ) {
-        float fval = dct_mcu[i];
-        fval *= qt[i];
-#if 0
-        fval = (fval > 0) ? floorf(fval + 0.5f) : ceilf(fval - 0.5f);
-#else
-        fval = floorf(fval + 1024 + 0.5f);
-        fval -= 1024;
-#endif
-        int val = (int)fval;
-        du[tjei_zig_zag[i]] = val;
-    }
-#else
-    for ( int v = 0; v < 8; ++v ) {
-        for ( int u = 0; u < 8; ++u ) {
-            dct_mcu[v * 8 + u] = slow_fdct(u, v, mcu);
-        }
-    }
+    tjei_fdct(mcu);
     for ( int i = 0; i < 64; ++i ) {
-        float fval = dct_mcu[i] / (qt[i]);
-        int val = (int)((fval > 0) ? floorf(fval + 0.5f) : ceilf(fval - 0.5f));
-        du[tjei_zig_zag[i]] = val;
+        // Round the magnitude to the nearest quantization step
+        uint32_t aval = (uint32_t) ABS(mcu[i]);
+        int val = (int)((aval * qr[i] + (1 << (TJEI_QR_BITS - 1))) >> TJEI_QR_BITS);
+        du[tjei_zig_zag[i]] = (mcu[i] < 0) ? -val : val;
     }
-#endif
 
     uint16_t vli[2];
 
@@ -922,14 +988,6 @@ enum {
     TJEI_CHROMA_AC,
 };
 
-#if TJE_USE_FAST_DCT
-struct TJEProcessedQT
-{
-    float chroma[64];
-    float luma[64];
-};
-#endif
-
 // Set up huffman tables in state.
 static void tjei_huff_expand(TJEState* state)
 {
@@ -978,7 +1036,7 @@ static int tjei_encode_main(TJEState* state,
                             const int height,
                             const int src_num_components)
 {
-    if (src_num_components != 3 && src_num_components != 4) {
+    if (src_num_components != 1 && src_num_components != 3 && src_num_components != 4) {
         return 0;
     }
 
@@ -986,32 +1044,12 @@ static int tjei_encode_main(TJEState* state,
         return 0;
     }
 
-#if TJE_USE_FAST_DCT
-    struct TJEProcessedQT pqt;
-    // Again, taken from classic japanese implementation.
-    //
-    /* For float AA&N IDCT method, divisors are equal to quantization
-     * coefficients scaled by scalefactor[row]*scalefactor[col], where
-     *   scalefactor[0] = 1
-     *   scalefactor[k] = cos(k*PI/16) * sqrt(2)    for k=1..7
-     * We apply a further scale factor of 8.
-     * What's actually stored is 1/divisor so that the inner loop can
-     * use a multiplication rather than a division.
-     */
-    static const float aan_scales[] = {
-        1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
-        1.0f, 0.785694958f, 0.541196100f, 0.275899379f
-    };
-
-    // build (de)quantization tables
-    for(int y=0; y<8; y++) {
-        for(int x=0; x<8; x++) {
-            int i = y*8 + x;
-            pqt.luma[y*8+x] = 1.0f / (8 * aan_scales[x] * aan_scales[y] * state->qt_luma[tjei_zig_zag[i]]);
-            pqt.chroma[y*8+x] = 1.0f / (8 * aan_scales[x] * aan_scales[y] * state->qt_chroma[tjei_zig_zag[i]]);
-        }
-    }
-#endif
+    // Grayscale images only have the luma component
+    const int num_components = (src_num_components == 1) ? 1 : 3;
+
+    // 2x2 MCUs of luma blocks with 4:2:0 subsampling
+    const int subsample = (chroma_subsample && num_components == 3) ? 1 : 0;
+    const int mcu_size = 8 << subsample;
 
     { // Write header
         TJEJPEGHeader header;
@@ -1048,56 +1086,72 @@ static int tjei_encode_main(TJEState* state,
         	}
         } while (com_str != NULL);
     }
+    if (app_callback != NULL) {  // Write application segment(s)
+        static TJEJPEGApp app;   // Too large for the stack
+        int len;
+        int seg_index = 0;
+        app.app = tjei_be_word(0xffe0 + app_marker);
+        
+        while ((len = app_callback(seg_index++, app.app_data)) > 0) {
+            assert(len <= TJEI_APP_LEN);
+            app.app_len = tjei_be_word(2 + len);
+            tjei_write(state, &app, len + 4, 1);
+        }
+    }
 
     // Write quantization tables.
     tjei_write_DQT(state, state->qt_luma, 0x00);
-    tjei_write_DQT(state, state->qt_chroma, 0x01);
+    if (num_components == 3) {
+        tjei_write_DQT(state, state->qt_chroma, 0x01);
+    }
 
     {  // Write the frame marker.
         TJEFrameHeader header;
         header.SOF = tjei_be_word(0xffc0);
-        header.len = tjei_be_word(8 + 3 * 3);
+        header.len = tjei_be_word((uint16_t)(8 + 3 * num_components));
         header.precision = 8;
         assert(width <= 0xffff);
         assert(height <= 0xffff);
         header.width = tjei_be_word((uint16_t)width);
         header.height = tjei_be_word((uint16_t)height);
-        header.num_components = 3;
+        header.num_components = (uint8_t)num_components;
         uint8_t tables[3] = {
             0,  // Luma component gets luma table (see tjei_write_DQT call above.)
             1,  // Chroma component gets chroma table
             1,  // Chroma component gets chroma table
         };
-        for (int i = 0; i < 3; ++i) {
+        for (int i = 0; i < num_components; ++i) {
             TJEComponentSpec spec;
             spec.component_id = (uint8_t)(i + 1);  // No particular reason. Just 1, 2, 3.
-            spec.sampling_factors = (uint8_t)0x11;
+            spec.sampling_factors = (uint8_t)((i == 0 && subsample) ? 0x22 : 0x11);
             spec.qt = tables[i];
 
             header.component_spec[i] = spec;
         }
-        // Write to file.
-        tjei_write(state, &header, sizeof(TJEFrameHeader), 1);
+        // Write to file (only the specs for the components in use).
+        tjei_write(state, &header, sizeof(TJEFrameHeader) - (3 - num_components) * sizeof(TJEComponentSpec), 1);
     }
 
     tjei_write_DHT(state, state->ht_bits[TJEI_LUMA_DC],   state->ht_vals[TJEI_LUMA_DC], TJEI_DC, 0);
     tjei_write_DHT(state, state->ht_bits[TJEI_LUMA_AC],   state->ht_vals[TJEI_LUMA_AC], TJEI_AC, 0);
-    tjei_write_DHT(state, state->ht_bits[TJEI_CHROMA_DC], state->ht_vals[TJEI_CHROMA_DC], TJEI_DC, 1);
-    tjei_write_DHT(state, state->ht_bits[TJEI_CHROMA_AC], state->ht_vals[TJEI_CHROMA_AC], TJEI_AC, 1);
+    if (num_components == 3) {
+        tjei_write_DHT(state, state->ht_bits[TJEI_CHROMA_DC], state->ht_vals[TJEI_CHROMA_DC], TJEI_DC, 1);
+        tjei_write_DHT(state, state->ht_bits[TJEI_CHROMA_AC], state->ht_vals[TJEI_CHROMA_AC], TJEI_AC, 1);
+    }
 
     // Write start of scan
     {
         TJEScanHeader header;
         header.SOS = tjei_be_word(0xffda);
-        header.len = tjei_be_word((uint16_t)(6 + (sizeof(TJEFrameComponentSpec) * 3)));
-        header.num_components = 3;
+        header.len = tjei_be_word((uint16_t)(6 + (sizeof(TJEFrameComponentSpec) * num_components)));
+        header.num_components = (uint8_t)num_components;
 
         uint8_t tables[3] = {
             0x00,
             0x11,
             0x11,
         };
-        for (int i = 0; i < 3; ++i) {
+        for (int i = 0; i < num_components; ++i) {
             TJEFrameComponentSpec cs;
             // Must be equal to component_id from frame header above.
             cs.component_id = (uint8_t)(i + 1);
@@ -1108,14 +1162,16 @@ static int tjei_encode_main(TJEState* state,
         header.first = 0;
         header.last  = 63;
         header.ah_al = 0;
-        tjei_write(state, &header, sizeof(TJEScanHeader), 1);
+        // Write to file (only the specs for the components in use, then the rest).
+        tjei_write(state, &header, sizeof(TJEScanHeader) - 3 - (3 - num_components) * sizeof(TJEFrameComponentSpec), 1);
+        tjei_write(state, &header.first, 3, 1);
 
     }
     // Write compressed data.
 
-    float du_y[64];
-    float du_b[64];
-    float du_r[64];
+    int32_t du_y[64];
+    int32_t du_b[64];
+    int32_t du_r[64];
 
     // Set diff to 0.
     int pred_y = 0;
@@ -1126,70 +1182,110 @@ static int tjei_encode_main(TJEState* state,
     uint32_t bitbuffer = 0;
     uint32_t location = 0;
 
+    // Samples keep TJEI_SAMPLE_BITS fraction bits.  Chroma is summed over the 2x2 pixels
+    // that share a sample when subsampling.
+    const int luma_shift = 16 - TJEI_SAMPLE_BITS;
+    const int chroma_shift = 16 - TJEI_SAMPLE_BITS + 2 * subsample;
 
-    for ( int y = 0; y < height; y += 8 ) {
-        for ( int x = 0; x < width; x += 8 ) {
-            // Block loop: ====
-            for ( int off_y = 0; off_y < 8; ++off_y ) {
-                for ( int off_x = 0; off_x < 8; ++off_x ) {
-                    int block_index = (off_y * 8 + off_x);
-
-                    int src_index = (((y + off_y) * width) + (x + off_x)) * src_num_components;
+    // First image row held in src_data
+    int strip_y = 0;
 
-                    int col = x + off_x;
+    if (num_components == 1) {
+        // Grayscale: each MCU is one luma block taken directly from the samples
+        for ( int y = 0; y < height; y += 8 ) {
+            if (strip_callback && (y % strip_lines) == 0) {
+                strip_y = y;
+                src_data = strip_callback(y, (height - y < strip_lines) ? height - y : strip_lines);
+            }
+            for ( int x = 0; x < width; x += 8 ) {
+                // Block loop: ====
+                for ( int off_y = 0; off_y < 8; ++off_y ) {
                     int row = y + off_y;
-
                     if(row >= height) {
-                        src_index -= (width * (row - height + 1)) * src_num_components;
+                        row = height - 1;
                     }
-                    if(col >= width) {
-                        src_index -= (col - width + 1) * src_num_components;
+                    for ( int off_x = 0; off_x < 8; ++off_x ) {
+                        int col = x + off_x;
+                        if(col >= width) {
+                            col = width - 1;
+                        }
+                        du_y[off_y * 8 + off_x] = ((int32_t)src_data[(row - strip_y) * width + col] - 128) << TJEI_SAMPLE_BITS;
                     }
-                    assert(src_index < width * height * src_num_components);
-
-                    uint8_t r = src_data[src_index + 0];
-                    uint8_t g = src_data[src_index + 1];
-                    uint8_t b = src_data[src_index + 2];
-
-                    float luma = 0.299f   * r + 0.587f    * g + 0.114f    * b - 128;
-                    float cb   = -0.1687f * r - 0.3313f   * g + 0.5f      * b;
-                    float cr   = 0.5f     * r - 0.4187f   * g - 0.0813f   * b;
-
-                    du_y[block_index] = luma;
-                    du_b[block_index] = cb;
-                    du_r[block_index] = cr;
                 }
-            }
 
-            tjei_encode_and_write_MCU(state, du_y,
-#if TJE_USE_FAST_DCT
-                                     pqt.luma,
-#else
-                                     state->qt_luma,
-#endif
-                                     state->ehuffsize[TJEI_LUMA_DC], state->ehuffcode[TJEI_LUMA_DC],
-                                     state->ehuffsize[TJEI_LUMA_AC], state->ehuffcode[TJEI_LUMA_AC],
-                                     &pred_y, &bitbuffer, &location);
-            tjei_encode_and_write_MCU(state, du_b,
-#if TJE_USE_FAST_DCT
-                                     pqt.chroma,
-#else
-                                     state->qt_chroma,
-#endif
-                                     state->ehuffsize[TJEI_CHROMA_DC], state->ehuffcode[TJEI_CHROMA_DC],
-                                     state->ehuffsize[TJEI_CHROMA_AC], state->ehuffcode[TJEI_CHROMA_AC],
-                                     &pred_b, &bitbuffer, &location);
-            tjei_encode_and_write_MCU(state, du_r,
-#if TJE_USE_FAST_DCT
-                                     pqt.chroma,
-#else
-                                     state->qt_chroma,
-#endif
-                                     state->ehuffsize[TJEI_CHROMA_DC], state->ehuffcode[TJEI_CHROMA_DC],
-                                     state->ehuffsize[TJEI_CHROMA_AC], state->ehuffcode[TJEI_CHROMA_AC],
-                                     &pred_r, &bitbuffer, &location);
+                tjei_encode_and_write_MCU(state, du_y,
+                                         state->qr_luma,
+                                         state->ehuffsize[TJEI_LUMA_DC], state->ehuffcode[TJEI_LUMA_DC],
+                                         state->ehuffsize[TJEI_LUMA_AC], state->ehuffcode[TJEI_LUMA_AC],
+                                         &pred_y, &bitbuffer, &location);
+            }
+        }
+    } else {
+        for ( int y = 0; y < height; y += mcu_size ) {
+            if (strip_callback && (y % strip_lines) == 0) {
+                strip_y = y;
+                src_data = strip_callback(y, (height - y < strip_lines) ? height - y : strip_lines);
+            }
+            for ( int x = 0; x < width; x += mcu_size ) {
+                memset(du_b, 0, sizeof(du_b));
+                memset(du_r, 0, sizeof(du_r));
+
+                // Encode each luma block in the MCU as it is converted
+                for ( int block_y = 0; block_y < mcu_size; block_y += 8 ) {
+                    for ( int block_x = 0; block_x < mcu_size; block_x += 8 ) {
+                        // Block loop: ====
+                        for ( int off_y = 0; off_y < 8; ++off_y ) {
+                            for ( int off_x = 0; off_x < 8; ++off_x ) {
+                                int block_index = (off_y * 8 + off_x);
+                                int chroma_index = (((block_y + off_y) >> subsample) * 8) + ((block_x + off_x) >> subsample);
+
+                                int col = x + block_x + off_x;
+                                int row = y + block_y + off_y;
+
+                                if(row >= height) {
+                                    row = height - 1;
+                                }
+                                if(col >= width) {
+                                    col = width - 1;
+                                }
+                                int src_index = (((row - strip_y) * width) + col) * src_num_components;
+                                assert(src_index < width * height * src_num_components);
+
+                                int32_t r = src_data[src_index + 0];
+                                int32_t g = src_data[src_index + 1];
+                                int32_t b = src_data[src_index + 2];
+
+                                // ITU-R BT.601 conversion with 16-bit fixed point coefficients
+                                du_y[block_index] = TJEI_DESCALE(19595 * r + 38470 * g + 7471 * b, luma_shift) - (128 << TJEI_SAMPLE_BITS);
+                                du_b[chroma_index] += -11059 * r - 21709 * g + 32768 * b;
+                                du_r[chroma_index] += 32768 * r - 27439 * g - 5329 * b;
+                            }
+                        }
+
+                        tjei_encode_and_write_MCU(state, du_y,
+                                                 state->qr_luma,
+                                                 state->ehuffsize[TJEI_LUMA_DC], state->ehuffcode[TJEI_LUMA_DC],
+                                                 state->ehuffsize[TJEI_LUMA_AC], state->ehuffcode[TJEI_LUMA_AC],
+                                                 &pred_y, &bitbuffer, &location);
+                    }
+                }
 
+                for ( int i = 0; i < 64; ++i ) {
+                    du_b[i] = TJEI_DESCALE(du_b[i], chroma_shift);
+                    du_r[i] = TJEI_DESCALE(du_r[i], chroma_shift);
+                }
 
+                tjei_encode_and_write_MCU(state, du_b,
+                                         state->qr_chroma,
+                                         state->ehuffsize[TJEI_CHROMA_DC], state->ehuffcode[TJEI_CHROMA_DC],
+                                         state->ehuffsize[TJEI_CHROMA_AC], state->ehuffcode[TJEI_CHROMA_AC],
+                                         &pred_b, &bitbuffer, &location);
+                tjei_encode_and_write_MCU(state, du_r,
+                                         state->qr_chroma,
+                                         state->ehuffsize[TJEI_CHROMA_DC], state->ehuffcode[TJEI_CHROMA_DC],
+                                         state->ehuffsize[TJEI_CHROMA_AC], state->ehuffcode[TJEI_CHROMA_AC],
+                                         &pred_r, &bitbuffer, &location);
+            }
         }
     }
 
@@ -1263,32 +1359,51 @@ int tje_encode_with_func(tje_write_func* func,
 
 //    TJEState state = { 0 };
 
-    uint8_t qt_factor = 1;
-    switch(quality) {
-    case 3:
-        for ( int i = 0; i < 64; ++i ) {
-            state.qt_luma[i]   = 1;
-            state.qt_chroma[i] = 1;
-        }
-        break;
-    case 2:
-        qt_factor = 10;
-        // fall through
-    case 1:
-        for ( int i = 0; i < 64; ++i ) {
-            state.qt_luma[i]   = tjei_default_qt_luma_from_spec[i] / qt_factor;
-            if (state.qt_luma[i] == 0) {
-                state.qt_luma[i] = 1;
-            }
-            state.qt_chroma[i] = tjei_default_qt_chroma_from_paper[i] / qt_factor;
-            if (state.qt_chroma[i] == 0) {
+    // The tables are built once and kept in state between encodes
+    static int huff_ready = 0;
+    if (!huff_ready) {
+        tjei_huff_expand(&state);
+        huff_ready = 1;
+    }
+
+    if (quality != state.quality) {
+        uint8_t qt_factor = 1;
+        switch(quality) {
+        case 3:
+            for ( int i = 0; i < 64; ++i ) {
+                state.qt_luma[i]   = 1;
                 state.qt_chroma[i] = 1;
             }
+            break;
+        case 2:
+            qt_factor = 10;
+            // fall through
+        case 1:
+            for ( int i = 0; i < 64; ++i ) {
+                state.qt_luma[i]   = tjei_default_qt_luma_from_spec[i] / qt_factor;
+                if (state.qt_luma[i] == 0) {
+                    state.qt_luma[i] = 1;
+                }
+                state.qt_chroma[i] = tjei_default_qt_chroma_from_paper[i] / qt_factor;
+                if (state.qt_chroma[i] == 0) {
+                    state.qt_chroma[i] = 1;
+                }
+            }
+            break;
+        default:
+            assert(!"invalid code path");
+            break;
+        }
+
+        // The integer DCT output is scaled up by 8 << TJEI_SAMPLE_BITS.  Store 1/divisor so
+        // the inner loop can use a multiplication rather than a division.
+        for ( int i = 0; i < 64; ++i ) {
+            uint32_t d = (8 << TJEI_SAMPLE_BITS) * (uint32_t) state.qt_luma[tjei_zig_zag[i]];
+            state.qr_luma[i] = ((1 << TJEI_QR_BITS) + d/2) / d;
+            d = (8 << TJEI_SAMPLE_BITS) * (uint32_t) state.qt_chroma[tjei_zig_zag[i]];
+            state.qr_chroma[i] = ((1 << TJEI_QR_BITS) + d/2) / d;
         }
-        break;
-    default:
-        assert(!"invalid code path");
-        break;
+        state.quality = quality;
     }
 
     TJEWriteContext wc = { 0 };
@@ -1298,9 +1413,6 @@ int tje_encode_with_func(tje_write_func* func,
 
     state.write_context = wc;
 
-
-    tjei_huff_expand(&state);
-
     int result = tjei_encode_main(&state, src_data, width, height, num_components);
 
     return result;
@@ -1311,6 +1423,23 @@ void tje_register_comment_callback(tje_comment_callback_func func)
 	comment_callback = func;
 }
 
+void tje_register_app_callback(int marker, tje_app_callback_func func)
+{
+	app_marker = marker & 0x0f;
+	app_callback = func;
+}
+
+void tje_set_chroma_subsampling(int enable)
+{
+	chroma_subsample = enable;
+}
+
+void tje_register_strip_callback(tje_strip_callback_func func, int strip_height)
+{
+	strip_callback = func;
+	strip_lines = strip_height;
+}
+
 
 // ============================================================
 #endif // TJE_IMPLEMENTATION
@@ -3,11 +3,23 @@
 /*----------------------------------------------*/
 #include "esp_system.h"
 
+/* CONFIG_JPEG_FAST_DECODE selects table driven huffman decoding and a larger input buffer
+/  so files are read in fewer, larger pieces.  It costs about 9.5 KB more in each work pool.
+*/
+#if defined(CONFIG_JPEG_FAST_DECODE) || !defined(ESP_PLATFORM)
+#define JD_FAST_CFG		1
+#else
+#define JD_FAST_CFG		0
+#endif
+
+#if JD_FAST_CFG
+#define	JD_SZBUF		4096
+#else
 #define	JD_SZBUF		512
-//#define	JD_SZBUF		1024
+#endif
 /* Specifies size of stream input buffer */
 
-#ifdef CONFIG_BUILD_ICAM_MINI
+#if defined(CONFIG_BUILD_ICAM_MINI) || !defined(ESP_PLATFORM)
 #define JD_FORMAT		0
 #else
 #define JD_FORMAT		1
@@ -24,7 +36,7 @@
 /  1: Swap
 */ 
 
-#define	JD_USE_SCALE	0
+#define	JD_USE_SCALE	1
 /* Switches output descaling feature.
 /  0: Disable
 /  1: Enable
@@ -36,10 +48,19 @@
 /  1: Enable
 */
 
+#if JD_FAST_CFG
+#define JD_FASTDECODE	2
+#else
 #define JD_FASTDECODE	1
+#endif
 /* Optimization level
 /  0: Basic optimization. Suitable for 8/16-bit MCUs.
 /  1: + 32-bit barrel shifter. Suitable for 32-bit MCUs.
 /  2: + Table conversion for huffman decoding (wants 6 << HUFF_BIT bytes of RAM)
 */
 
+#define JD_WORK_LEN		(2988 + JD_SZBUF + ((JD_FASTDECODE == 2) ? 6144 : 0))
+/* Work pool length for jd_prepare (about 2264 bytes and the input buffer are used for a
+/  color image, plus the huffman decode tables).  Pools should be in internal RAM.
+*/
+
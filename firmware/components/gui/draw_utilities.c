@@ -0,0 +1,106 @@
+/*
+ * Clipped drawing primitives shared by the GUI, video and file renderers.  The same
+ * primitives are provided for 8-bit (video), 16-bit (GUI RGB565) and 32-bit (GUI web
+ * and file RGBA) pixels.  Horizontal spans, which make up most of the overlay pixels,
+ * are clipped once and then filled a word at a time.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "draw_utilities.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+
+//
+// Span fills
+//
+static inline void _span8(uint8_t* p, int16_t n, uint8_t c)
+{
+	memset(p, c, n);
+}
+
+
+static inline void _span16(uint16_t* p, int16_t n, uint16_t c)
+{
+	uint32_t c2 = ((uint32_t) c << 16) | c;
+	uint32_t* p32;
+	
+	// Align to a 32-bit boundary and store pixel pairs
+	if (((uintptr_t) p & 0x2) && (n > 0)) {
+		*p++ = c;
+		n--;
+	}
+	p32 = (uint32_t*) p;
+	while (n >= 2) {
+		*p32++ = c2;
+		n -= 2;
+	}
+	if (n > 0) {
+		*((uint16_t*) p32) = c;
+	}
+}
+
+
+static inline void _span32(uint32_t* p, int16_t n, uint32_t c)
+{
+	while (n >= 4) {
+		p[0] = c;
+		p[1] = c;
+		p[2] = c;
+		p[3] = c;
+		p += 4;
+		n -= 4;
+	}
+	while (n-- > 0) {
+		*p++ = c;
+	}
+}
+
+
+
+//
+// Primitives for each pixel type
+//
+#define DRAW_T        uint8_t
+#define DRAW_FN(f)    draw8_##f
+#define DRAW_PIXEL    draw8_pixel
+#define DRAW_SPAN     _span8
+#include "draw_utilities_tmpl.h"
+#undef DRAW_T
+#undef DRAW_FN
+#undef DRAW_PIXEL
+#undef DRAW_SPAN
+
+#define DRAW_T        uint16_t
+#define DRAW_FN(f)    draw16_##f
+#define DRAW_PIXEL    draw16_pixel
+#define DRAW_SPAN     _span16
+#include "draw_utilities_tmpl.h"
+#undef DRAW_T
+#undef DRAW_FN
+#undef DRAW_PIXEL
+#undef DRAW_SPAN
+
+#define DRAW_T        uint32_t
+#define DRAW_FN(f)    draw32_##f
+#define DRAW_PIXEL    draw32_pixel
+#define DRAW_SPAN     _span32
+#include "draw_utilities_tmpl.h"
+#undef DRAW_T
+#undef DRAW_FN
+#undef DRAW_PIXEL
+#undef DRAW_SPAN
@@ -0,0 +1,91 @@
+/*
+ * Clipped drawing primitives shared by the GUI, video and file renderers.  The same
+ * primitives are provided for 8-bit (video), 16-bit (GUI RGB565) and 32-bit (GUI web
+ * and file RGBA) pixels.  Horizontal spans, which make up most of the overlay pixels,
+ * are clipped once and then filled a word at a time.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DRAW_UTILITIES_H
+#define DRAW_UTILITIES_H
+
+#include <stdint.h>
+
+
+
+//
+// Typedefs
+//
+
+// Buffer layout and clip region.  Coordinates passed to the primitives are image
+// coordinates.  The buffer holds image rows starting at y0 (non-zero when an image is
+// rendered a strip at a time) and the clip region must lie within the rows it holds.
+typedef struct {
+	int16_t stride;     // Pixels per buffer row
+	int16_t y0;         // Image row held in the first buffer row
+	int16_t x1;         // Clip region (inclusive)
+	int16_t y1;
+	int16_t x2;
+	int16_t y2;
+} draw_clip_t;
+
+
+
+//
+// API
+//
+void draw8_hline(uint8_t* img, const draw_clip_t* cl, int16_t x1, int16_t x2, int16_t y, uint8_t c);
+void draw8_vline(uint8_t* img, const draw_clip_t* cl, int16_t x, int16_t y1, int16_t y2, uint8_t c);
+void draw8_line(uint8_t* img, const draw_clip_t* cl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t c);
+void draw8_circle(uint8_t* img, const draw_clip_t* cl, int16_t x0, int16_t y0, int16_t r, uint8_t c);
+void draw8_rect(uint8_t* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, uint8_t c);
+void draw8_fill_rect(uint8_t* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, uint8_t c);
+
+void draw16_hline(uint16_t* img, const draw_clip_t* cl, int16_t x1, int16_t x2, int16_t y, uint16_t c);
+void draw16_vline(uint16_t* img, const draw_clip_t* cl, int16_t x, int16_t y1, int16_t y2, uint16_t c);
+void draw16_line(uint16_t* img, const draw_clip_t* cl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t c);
+void draw16_circle(uint16_t* img, const draw_clip_t* cl, int16_t x0, int16_t y0, int16_t r, uint16_t c);
+void draw16_rect(uint16_t* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, uint16_t c);
+void draw16_fill_rect(uint16_t* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, uint16_t c);
+
+void draw32_hline(uint32_t* img, const draw_clip_t* cl, int16_t x1, int16_t x2, int16_t y, uint32_t c);
+void draw32_vline(uint32_t* img, const draw_clip_t* cl, int16_t x, int16_t y1, int16_t y2, uint32_t c);
+void draw32_line(uint32_t* img, const draw_clip_t* cl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint32_t c);
+void draw32_circle(uint32_t* img, const draw_clip_t* cl, int16_t x0, int16_t y0, int16_t r, uint32_t c);
+void draw32_rect(uint32_t* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, uint32_t c);
+void draw32_fill_rect(uint32_t* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, uint32_t c);
+
+
+// Single pixels are inline since text is drawn a pixel at a time
+static inline void draw8_pixel(uint8_t* img, const draw_clip_t* cl, int16_t x, int16_t y, uint8_t c)
+{
+	if ((x < cl->x1) || (x > cl->x2) || (y < cl->y1) || (y > cl->y2)) return;
+	*(img + (y - cl->y0)*cl->stride + x) = c;
+}
+
+static inline void draw16_pixel(uint16_t* img, const draw_clip_t* cl, int16_t x, int16_t y, uint16_t c)
+{
+	if ((x < cl->x1) || (x > cl->x2) || (y < cl->y1) || (y > cl->y2)) return;
+	*(img + (y - cl->y0)*cl->stride + x) = c;
+}
+
+static inline void draw32_pixel(uint32_t* img, const draw_clip_t* cl, int16_t x, int16_t y, uint32_t c)
+{
+	if ((x < cl->x1) || (x > cl->x2) || (y < cl->y1) || (y > cl->y2)) return;
+	*(img + (y - cl->y0)*cl->stride + x) = c;
+}
+
+#endif /* DRAW_UTILITIES_H */
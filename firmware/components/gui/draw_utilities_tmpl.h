@@ -0,0 +1,187 @@
+/*
+ * Drawing primitive bodies for one pixel type.  Included by draw_utilities.c once per
+ * pixel type with the following defined:
+ *
+ *   DRAW_T        Pixel type
+ *   DRAW_FN(f)    Public function name for primitive f
+ *   DRAW_PIXEL    Clipped single pixel store
+ *   DRAW_SPAN     Unclipped horizontal span fill (pointer, length, color)
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+void DRAW_FN(hline)(DRAW_T* img, const draw_clip_t* cl, int16_t x1, int16_t x2, int16_t y, DRAW_T c)
+{
+	if ((y < cl->y1) || (y > cl->y2)) return;
+	if (x1 < cl->x1)
+		x1 = cl->x1;
+	if (x2 > cl->x2)
+		x2 = cl->x2;
+	if (x1 > x2) return;
+	
+	DRAW_SPAN(img + (y - cl->y0)*cl->stride + x1, x2 - x1 + 1, c);
+}
+
+
+void DRAW_FN(vline)(DRAW_T* img, const draw_clip_t* cl, int16_t x, int16_t y1, int16_t y2, DRAW_T c)
+{
+	DRAW_T* imgP;
+	
+	if ((x < cl->x1) || (x > cl->x2)) return;
+	if (y1 < cl->y1)
+		y1 = cl->y1;
+	if (y2 > cl->y2)
+		y2 = cl->y2;
+	
+	imgP = img + (y1 - cl->y0)*cl->stride + x;
+	
+	while (y1++ <= y2) {
+		*imgP = c;
+		imgP += cl->stride;
+	}
+}
+
+
+void DRAW_FN(line)(DRAW_T* img, const draw_clip_t* cl, int16_t x1, int16_t y1, int16_t x2, int16_t y2, DRAW_T c)
+{
+	int16_t dx = abs(x2 - x1);
+	int16_t dy = -abs(y2 - y1);
+	int16_t err = dx + dy;
+	int16_t e2;
+	int16_t sx = (x1 < x2) ? 1 : -1;
+	int16_t sy = (y1 < y2) ? 1 : -1;
+	
+	// Horizontal and vertical lines are spans
+	if (dy == 0) {
+		DRAW_FN(hline)(img, cl, (x1 < x2) ? x1 : x2, (x1 < x2) ? x2 : x1, y1, c);
+		return;
+	}
+	if (dx == 0) {
+		DRAW_FN(vline)(img, cl, x1, (y1 < y2) ? y1 : y2, (y1 < y2) ? y2 : y1, c);
+		return;
+	}
+	
+	// Lines entirely to one side of the clip region aren't walked
+	if (((x1 < cl->x1) && (x2 < cl->x1)) || ((x1 > cl->x2) && (x2 > cl->x2)) ||
+	    ((y1 < cl->y1) && (y2 < cl->y1)) || ((y1 > cl->y2) && (y2 > cl->y2))) {
+		return;
+	}
+	
+	for (;;) {
+		DRAW_PIXEL(img, cl, x1, y1, c);
+	
+		if ((x1 == x2) && (y1 == y2)) break;
+	
+		e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x1 += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y1 += sy;
+		}
+	}
+}
+
+
+void DRAW_FN(circle)(DRAW_T* img, const draw_clip_t* cl, int16_t x0, int16_t y0, int16_t r, DRAW_T c)
+{
+	int16_t f = 1 - r;
+	int16_t ddF_x = 1;
+	int16_t ddF_y = -2 * r;
+	int16_t x = 0;
+	int16_t y = r;
+	
+	if (((x0 + r) < cl->x1) || ((x0 - r) > cl->x2) || ((y0 + r) < cl->y1) || ((y0 - r) > cl->y2)) {
+		return;
+	}
+	
+	DRAW_PIXEL(img, cl, x0, y0 + r, c);
+	DRAW_PIXEL(img, cl, x0, y0 - r, c);
+	DRAW_PIXEL(img, cl, x0 + r, y0, c);
+	DRAW_PIXEL(img, cl, x0 - r, y0, c);
+	
+	while (x < y) {
+		if (f >= 0) {
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+	
+		DRAW_PIXEL(img, cl, x0 + x, y0 + y, c);
+		DRAW_PIXEL(img, cl, x0 - x, y0 + y, c);
+		DRAW_PIXEL(img, cl, x0 + x, y0 - y, c);
+		DRAW_PIXEL(img, cl, x0 - x, y0 - y, c);
+		DRAW_PIXEL(img, cl, x0 + y, y0 + x, c);
+		DRAW_PIXEL(img, cl, x0 - y, y0 + x, c);
+		DRAW_PIXEL(img, cl, x0 + y, y0 - x, c);
+		DRAW_PIXEL(img, cl, x0 - y, y0 - x, c);
+	}
+}
+
+
+void DRAW_FN(rect)(DRAW_T* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, DRAW_T c)
+{
+	int16_t x2 = x + w - 1;
+	int16_t y2 = y + h - 1;
+	
+	if ((w <= 0) || (h <= 0)) return;
+	
+	// Top and bottom spans
+	DRAW_FN(hline)(img, cl, x, x2, y, c);
+	if (h > 1) {
+		DRAW_FN(hline)(img, cl, x, x2, y2, c);
+	}
+	
+	// Left and right sides between them
+	if (h > 2) {
+		DRAW_FN(vline)(img, cl, x, y + 1, y2 - 1, c);
+		if (w > 1) {
+			DRAW_FN(vline)(img, cl, x2, y + 1, y2 - 1, c);
+		}
+	}
+}
+
+
+void DRAW_FN(fill_rect)(DRAW_T* img, const draw_clip_t* cl, int16_t x, int16_t y, int16_t w, int16_t h, DRAW_T c)
+{
+	DRAW_T* imgP;
+	int16_t x2 = x + w - 1;
+	int16_t y2 = y + h - 1;
+	
+	// Clip once and fill each row as a span
+	if (x < cl->x1)
+		x = cl->x1;
+	if (x2 > cl->x2)
+		x2 = cl->x2;
+	if (y < cl->y1)
+		y = cl->y1;
+	if (y2 > cl->y2)
+		y2 = cl->y2;
+	if ((x > x2) || (y > y2)) return;
+	
+	w = x2 - x + 1;
+	imgP = img + (y - cl->y0)*cl->stride + x;
+	
+	while (y++ <= y2) {
+		DRAW_SPAN(imgP, w, c);
+		imgP += cl->stride;
+	}
+}
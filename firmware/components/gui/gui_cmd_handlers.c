@@ -25,12 +25,14 @@
 #include "gui_panel_file_browser_image.h"
 #include "gui_panel_image_controls.h"
 #include "gui_panel_image_main.h"
+#include "gui_panel_system_benchmark.h"
 #include "gui_render.h"
 #include "gui_state.h"
 #include "gui_sub_page_info.h"
 #include "gui_sub_page_time.h"
 #include "gui_utilities.h"
 #include "palettes.h"
+#include "y16_codec.h"
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
@@ -38,6 +40,9 @@
 #ifdef ESP_PLATFORM
 #include "falcon_cmd.h"
 #include "tiny1c.h"
+#else
+#include "tjpgd.h"
+#include "web_file_cache.h"
 #endif
 
 
@@ -47,16 +52,82 @@
 
 // These must match code below and in cmd handlers and sender
 #define CMD_AMBIENT_CORRECT_LEN 18
+#define CMD_IMAGE_Y8_LEN        (GUI_RAW_IMG_W*GUI_RAW_IMG_H)
+#define CMD_IMAGE_Y16_LEN       (2*GUI_RAW_IMG_W*GUI_RAW_IMG_H)
 #define CMD_SHUTTER_INFO_LEN    13
 #define CMD_TIME_LEN            36
 #define CMD_WIFI_INFO_LEN       (3 + 2*(GUI_SSID_MAX_LEN+1) + 2*(GUI_PW_MAX_LEN+1) + 3*4)
 
+// The image metadata ROI table entries are copied directly into ours
+_Static_assert((sizeof(gui_roi_spot_t) == sizeof(cmd_image_roi_spot_t)) && (GUI_ROI_MAX_SPOTS == CMD_IMAGE_ROI_SPOTS) &&
+               (sizeof(gui_roi_area_t) == sizeof(cmd_image_roi_area_t)) && (GUI_ROI_MAX_RECTS == CMD_IMAGE_ROI_RECTS) &&
+               (GUI_ROI_MAX_LINES == CMD_IMAGE_ROI_LINES), "Image metadata ROI table layout mismatch");
+
+// Stored jpeg file decode
+#define JPEG_WORK_BUF_LEN       JD_WORK_LEN
+#define JPEG_RGB_IMG_LEN        (3*GUI_RAW_IMG_W*GUI_RAW_IMG_H)
+
 
 
 //
-// Forward declarations for internal functions
+// Typedefs
 //
 #ifndef ESP_PLATFORM
+// Session identifier for tjpgd decoder input/output functions
+typedef struct {
+	uint8_t* src;           // Input jpeg data
+	uint32_t src_len;       // Remaining input jpeg data
+	uint8_t* fbuf;          // Output frame buffer
+	unsigned int wfbuf;     // Width of the frame buffer [pix]
+} jpeg_iodev_t;
+#endif
+
+
+//
+// Variables
+//
+#ifdef ESP_PLATFORM
+// Identity of the previous image from t1c_task to detect unchanged images
+static bool prev_img_valid = false;
+static uint32_t prev_img_hash;
+static uint32_t prev_img_agc_seq;
+static uint8_t prev_img_filt_mask;
+static bool prev_img_y16_render;
+#else
+// Decoded image data for CMD_STREAM_Y8_DELTA encoded images and full size images expanded
+// from a stream view
+static uint8_t y8_decode_buf[CMD_IMAGE_Y8_LEN];
+static uint8_t y8_view_buf[CMD_IMAGE_Y8_LEN];
+
+// Decoded image data for CMD_IMAGE_Y16 images (available for point temperatures)
+static uint16_t y16_decode_buf[GUI_RAW_IMG_W*GUI_RAW_IMG_H];
+
+// Decoded RGB888 image data for CMD_FILE_GET_JPEG and CMD_FILE_GET_THUMB
+static uint8_t jpeg_work_buf[JPEG_WORK_BUF_LEN];
+static uint8_t jpeg_decode_buf[JPEG_RGB_IMG_LEN];
+static uint8_t jpeg_thumb_buf[3*CMD_FILE_THUMB_W*CMD_FILE_THUMB_H];
+#endif
+
+
+
+//
+// Forward declarations for internal functions
+//
+#ifdef ESP_PLATFORM
+static void _copy_roi_table(t1c_roi_table_t* roi);
+#else
+static bool _decode_y8_delta(uint8_t* src, uint32_t len, int w, int h, uint8_t* dst);
+static inline uint8_t _y8_delta_pred(uint8_t* src, int w, int i);
+static void _expand_y8_view(uint8_t* src, int dec, int x1, int y1, int w, int h, uint8_t* dst);
+static bool _decode_y16_delta(uint8_t* src, uint32_t len, uint16_t* dst);
+static inline uint16_t _y16_delta_pred(uint16_t* src, int i);
+static void _scale_y16_to_y8(uint16_t* src, uint16_t agc_min, uint16_t agc_max, uint8_t* dst);
+static bool _decode_jpeg(uint8_t* src, uint32_t len, int w, int h, uint8_t* dst);
+static void _expand_thumb(uint8_t* src, uint8_t* dst);
+static size_t _jpeg_in_func(JDEC* jd, uint8_t* buff, size_t nbyte);
+static int _jpeg_out_func(JDEC* jd, void* bitmap, JRECT* rect);
+static uint32_t _get_image_meta(uint8_t* buf, uint32_t len, cmd_image_meta_t* meta);
+static void _set_image_meta(cmd_image_meta_t* meta);
 static uint8_t* _get_i16(int16_t* data, uint8_t* buf);
 static uint8_t* _get_u16(uint16_t* data, uint8_t* buf);
 #endif
@@ -126,54 +197,171 @@ void cmd_handler_set_image(cmd_data_t data_type, uint32_t len, uint8_t* data)
 		gui_panel_image_buf.region_max_x = t1cP->region_temp_info.max_temp_point.x;
 		gui_panel_image_buf.region_max_y = t1cP->region_temp_info.max_temp_point.y;
 		
-		// Scale Tiny1c raw data to 8-bits
-		gui_panel_image_buf.y8_data = gui_render_get_y8_data(t1cP->img_data, t1cP->y16_min, t1cP->y16_max);
+		// Get the ROI table
+		_copy_roi_table(&t1cP->roi);
+		
+		// Get the image statistics
+		gui_panel_image_buf.hist = t1cP->img_stats.hist;
+		gui_panel_image_buf.profile = (t1cP->img_stats.profile_len != 0) ? t1cP->img_stats.profile : NULL;
+		gui_panel_image_buf.profile_len = t1cP->img_stats.profile_len;
+		
+		// Get the Tiny1c data (pre-scaled to 8-bits unless we can render directly from Y16,
+		// which isn't possible when the scaled data has been filtered for us)
+		gui_panel_image_buf.y16_data = t1cP->img_data;
+		gui_panel_image_buf.y16_is_temp = t1cP->y16_is_temp;
+		gui_panel_image_buf.agc_min = t1cP->agc_min;
+		gui_panel_image_buf.agc_max = t1cP->agc_max;
+		gui_panel_image_buf.agc_seq = t1cP->agc_seq;
+		gui_panel_image_buf.chg_mask = t1cP->chg_valid ? t1cP->chg_mask : NULL;
+		gui_panel_image_buf.y16_render = gui_render_y16_enabled(&gui_state) &&
+		                                 ((t1cP->y8_filt_mask & T1C_Y8F_OUT_GUI) == 0);
+		if (!gui_panel_image_buf.y16_render) {
+			gui_panel_image_buf.y8_data = gui_render_get_y8_data(t1c_get_y8_data(t1cP, T1C_Y8F_OUT_GUI));
+		}
+		
+		// Note when the image would render the same as the previous one (for example while
+		// the shutter has frozen it)
+		gui_panel_image_buf.img_same = prev_img_valid &&
+		                               (t1cP->img_hash == prev_img_hash) &&
+		                               (t1cP->agc_seq == prev_img_agc_seq) &&
+		                               (t1cP->y8_filt_mask == prev_img_filt_mask) &&
+		                               (gui_panel_image_buf.y16_render == prev_img_y16_render);
+		prev_img_valid = true;
+		prev_img_hash = t1cP->img_hash;
+		prev_img_agc_seq = t1cP->agc_seq;
+		prev_img_filt_mask = t1cP->y8_filt_mask;
+		prev_img_y16_render = gui_panel_image_buf.y16_render;
 		
 		// Let the image display know we've got an image to display
 		gui_panel_image_render_image();
 	}
 #else
 	uint8_t* dP = data;
+	uint8_t* y8P;
+	uint16_t dec, x1, y1, w, h;
+	uint16_t agc_min, agc_max;
+	uint8_t is_temp;
+	uint32_t meta_len;
+	cmd_image_meta_t meta;
+	
+	// Unpack in the same order as encoded in ws_cmd_utilties.c
+	if ((data_type == CMD_DATA_BINARY) && ((meta_len = _get_image_meta(data, len, &meta)) != 0) &&
+	    (len > (meta_len + CMD_IMAGE_VIEW_HDR_LEN)) &&
+	    (len <= (meta_len + CMD_IMAGE_VIEW_HDR_LEN + CMD_IMAGE_Y8_LEN))) {
+		
+		dP += meta_len;
+		
+		// Unpack the view header and make sure the view fits in the image
+		dP = _get_u16(&dec, dP);
+		dP = _get_u16(&x1, dP);
+		dP = _get_u16(&y1, dP);
+		dP = _get_u16(&w, dP);
+		dP = _get_u16(&h, dP);
+		is_temp = *dP;
+		dP += 2;
+		dP = _get_u16(&agc_min, dP);
+		dP = _get_u16(&agc_max, dP);
+		if ((dec == 0) || (dec > 4) || ((x1 + w*dec) > GUI_RAW_IMG_W) || ((y1 + h*dec) > GUI_RAW_IMG_H)) {
+			return;
+		}
+		len -= meta_len + CMD_IMAGE_VIEW_HDR_LEN;
+		
+		// Get the pre-scaled 8-bit data (decoding it first if it is shorter than a raw image)
+		gui_panel_image_buf.y16_data = NULL;
+		gui_panel_image_buf.y16_is_temp = (is_temp != 0);
+		gui_panel_image_buf.agc_min = agc_min;
+		gui_panel_image_buf.agc_max = agc_max;
+		if (len == (w*h)) {
+			y8P = dP;
+		} else if (_decode_y8_delta(dP, len, w, h, y8_decode_buf)) {
+			y8P = y8_decode_buf;
+		} else {
+			return;
+		}
+		
+		// Expand a cropped or decimated view back to a full size image and copy it to our
+		// buffer
+		if ((w != GUI_RAW_IMG_W) || (h != GUI_RAW_IMG_H)) {
+			_expand_y8_view(y8P, dec, x1, y1, w, h, y8_view_buf);
+			y8P = y8_view_buf;
+		}
+		_set_image_meta(&meta);
+		gui_panel_image_buf.y8_data = gui_render_get_y8_data(y8P);
+		gui_panel_image_buf.img_same = false;
+		
+		// Let the image display know we've got an image to display
+		gui_panel_image_render_image();
+	}
+#endif
+}
+
+
+void cmd_handler_set_image_same(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	// web only:
+	//  the image data is the same as the last CMD_IMAGE or CMD_IMAGE_Y16 so just update
+	//  the metadata and display the image we already have with it
+#ifndef ESP_PLATFORM
+	cmd_image_meta_t meta;
+	
+	if ((data_type == CMD_DATA_BINARY) && (_get_image_meta(data, len, &meta) == len) && (gui_panel_image_buf.y8_data != NULL)) {
+		_set_image_meta(&meta);
+		gui_panel_image_buf.img_same = true;
+		
+		gui_panel_image_render_image();
+	}
+#endif
+}
+
+
+void cmd_handler_set_image_y16(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	// web only:
+	//  have to decode this into individual units, keep the Y16 data and scale it to
+	//  8-bits for colorizing
+#ifndef ESP_PLATFORM
+	uint8_t* dP = data;
+	uint8_t encoding;
+	uint16_t agc_min;
+	uint16_t agc_max;
+	uint32_t meta_len;
+	cmd_image_meta_t meta;
 	
 	// Unpack in the same order as encoded in ws_cmd_utilties.c
-	if ((data_type == CMD_DATA_BINARY) && (len == (54 + GUI_RAW_IMG_W*GUI_RAW_IMG_H))) {
-		//  Get boolean flags (each held in a byte)
-		gui_panel_image_buf.high_gain = *dP++;
-		gui_panel_image_buf.vid_frozen = *dP++;
-		gui_panel_image_buf.spot_valid = *dP++;
-		gui_panel_image_buf.minmax_valid = *dP++;
-		gui_panel_image_buf.region_valid = *dP++;
-		gui_panel_image_buf.amb_temp_valid = *dP++;
-		gui_panel_image_buf.amb_hum_valid = *dP++;
-		gui_panel_image_buf.distance_valid = *dP++;
+	if ((data_type == CMD_DATA_BINARY) && ((meta_len = _get_image_meta(data, len, &meta)) != 0) &&
+	    (len > (meta_len + CMD_IMAGE_Y16_HDR_LEN)) &&
+	    (len <= (meta_len + CMD_IMAGE_Y16_HDR_LEN + CMD_IMAGE_Y16_LEN))) {
 		
-		// Unpack the 16-bit values
-		dP = _get_i16(&gui_panel_image_buf.amb_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.amb_hum, dP);
-		dP = _get_u16(&gui_panel_image_buf.distance, dP);
-		dP = _get_u16(&gui_panel_image_buf.spot_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.spot_x, dP);
-		dP = _get_u16(&gui_panel_image_buf.spot_y, dP);
-		dP = _get_u16(&gui_panel_image_buf.min_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.min_x, dP);
-		dP = _get_u16(&gui_panel_image_buf.min_y, dP);
-		dP = _get_u16(&gui_panel_image_buf.max_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.max_x, dP);
-		dP = _get_u16(&gui_panel_image_buf.max_y, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_x1, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_y1, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_x2, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_y2, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_avg_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_min_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_min_x, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_min_y, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_max_temp, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_max_x, dP);
-		dP = _get_u16(&gui_panel_image_buf.region_max_y, dP);
+		dP += meta_len;
 		
-		// Copy the pre-scaled 8-bit data to our buffer
-		gui_panel_image_buf.y8_data = gui_render_get_y8_data((uint16_t*) dP, 0, 0);
+		// Unpack the Y16 header
+		encoding = *dP++;
+		gui_panel_image_buf.y16_is_temp = *dP++;
+		dP = _get_u16(&agc_min, dP);
+		dP = _get_u16(&agc_max, dP);
+		len -= meta_len + CMD_IMAGE_Y16_HDR_LEN;
+		
+		// Get the Y16 data
+		if (encoding == CMD_IMG_Y16_ENC_RICE) {
+			if (!y16_codec_decode(dP, len, y16_decode_buf, GUI_RAW_IMG_W, GUI_RAW_IMG_H)) return;
+		} else if (encoding == CMD_IMG_Y16_ENC_DELTA) {
+			if (!_decode_y16_delta(dP, len, y16_decode_buf)) return;
+		} else if ((encoding == CMD_IMG_Y16_ENC_RAW) && (len == CMD_IMAGE_Y16_LEN)) {
+			for (int i=0; i<GUI_RAW_IMG_W*GUI_RAW_IMG_H; i++) {
+				dP = _get_u16(&y16_decode_buf[i], dP);
+			}
+		} else {
+			return;
+		}
+		_set_image_meta(&meta);
+		gui_panel_image_buf.y16_data = y16_decode_buf;
+		gui_panel_image_buf.agc_min = agc_min;
+		gui_panel_image_buf.agc_max = agc_max;
+		
+		// Scale to 8-bits for display
+		_scale_y16_to_y8(y16_decode_buf, agc_min, agc_max, y8_decode_buf);
+		gui_panel_image_buf.y8_data = gui_render_get_y8_data(y8_decode_buf);
+		gui_panel_image_buf.img_same = false;
 		
 		// Let the image display know we've got an image to display
 		gui_panel_image_render_image();
@@ -198,6 +386,24 @@ void cmd_handler_set_msg_off(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_set_stream_rate(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	char buf[32];
+	uint32_t t;
+	
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		t = ntohl(*((uint32_t*) &data[0]));
+		
+		// Let the user know the camera has slowed the stream down for their link
+		if ((gui_state.stream_rate_x10 != 0) && (t < gui_state.stream_rate_x10)) {
+			sprintf(buf, "Slow link: %d.%d fps", (int) t/10, (int) t%10);
+			gui_panel_image_set_message(buf, 1500);
+		}
+		gui_state.stream_rate_x10 = t;
+	}
+}
+
+
 void cmd_handler_set_timelapse_status(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	bool new_running;
@@ -228,6 +434,15 @@ void cmd_handler_set_timelapse_status(cmd_data_t data_type, uint32_t len, uint8_
 }
 
 
+void cmd_handler_rsp_agc_mode(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		gui_state.agc_mode = ntohl(*((uint32_t*) &data[0]));
+		gui_state_note_item_inited(GUI_STATE_INIT_AGC);
+	}
+}
+
+
 void cmd_handler_rsp_ambient_correct(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if ((data_type == CMD_DATA_BINARY) && (len == CMD_AMBIENT_CORRECT_LEN)) {
@@ -260,6 +475,21 @@ void cmd_handler_rsp_batt_info(cmd_data_t data_type, uint32_t len, uint8_t* data
 }
 
 
+void cmd_handler_rsp_benchmark(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	int i;
+	uint32_t* rx32P = (uint32_t*) data;
+	uint32_t results[CMD_BENCH_NUM_ITEMS * 4];
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_BENCH_NUM_ITEMS * CMD_BENCH_ITEM_LEN)) {
+		for (i=0; i<CMD_BENCH_NUM_ITEMS * 4; i++) {
+			results[i] = ntohl(*rx32P++);
+		}
+		gui_panel_system_benchmark_set_results(results);
+	}
+}
+
+
 void cmd_handler_rsp_brightness(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
@@ -282,6 +512,8 @@ void cmd_handler_rsp_ctrl_activity(cmd_data_t data_type, uint32_t len, uint8_t*
 {
 	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
 		gui_update_activity_popup((bool) ntohl(*((uint32_t*) &data[0])));
+	} else if ((data_type == CMD_DATA_BINARY) && (len == CMD_CTRL_ACT_PROGRESS_LEN)) {
+		gui_update_activity_progress((int) ntohl(*((uint32_t*) &data[0])), (int) ntohl(*((uint32_t*) &data[4])));
 	}
 }
 
@@ -347,6 +579,43 @@ void cmd_handler_rsp_file_catalog(cmd_data_t data_type, uint32_t len, uint8_t* d
 }
 
 
+void cmd_handler_rsp_file_catalog_page(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+#ifndef ESP_PLATFORM
+	char* entries[CMD_FILE_CATALOG_PAGE_MAX];
+	uint32_t sizes[CMD_FILE_CATALOG_PAGE_MAX];
+	uint32_t timestamps[CMD_FILE_CATALOG_PAGE_MAX];
+	int i, n;
+	int16_t type;
+	uint16_t total, offset, num_entries;
+	uint8_t* endP = data + len;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len >= CMD_FILE_CATALOG_PAGE_HDR_LEN)) {
+		data = _get_i16(&type, data);
+		data = _get_u16(&total, data);
+		data = _get_u16(&offset, data);
+		data = _get_u16(&num_entries, data);
+		if (num_entries > CMD_FILE_CATALOG_PAGE_MAX) return;
+		
+		// Point to each name.  The size and timestamp aren't displayed but identify cached
+		// images.
+		for (i=0; i<num_entries; i++) {
+			if ((data + 8) >= endP) return;
+			sizes[i] = ntohl(*((uint32_t*) &data[0]));
+			timestamps[i] = ntohl(*((uint32_t*) &data[4]));
+			entries[i] = (char*) &data[8];
+			n = strnlen(entries[i], endP - &data[8]);
+			if (n == (endP - &data[8])) return;
+			data += 8 + n + 1;
+		}
+		
+		web_file_cache_set_catalog_page((int) type, (int) total, (int) offset, (int) num_entries, entries, sizes, timestamps);
+		gui_panel_file_browser_files_set_catalog_page((int) type, (int) total, (int) offset, (int) num_entries, entries);
+	}
+#endif
+}
+
+
 void cmd_handler_rsp_file_image(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 #ifdef ESP_PLATFORM
@@ -363,16 +632,71 @@ void cmd_handler_rsp_file_image(cmd_data_t data_type, uint32_t len, uint8_t* dat
 }
 
 
+void cmd_handler_rsp_file_jpeg(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+#ifndef ESP_PLATFORM
+	if (data_type == CMD_DATA_BINARY) {
+		web_file_cache_response(CMD_FILE_GET_JPEG, len, data);
+	}
+	if ((data_type == CMD_DATA_BINARY) && (len != 0)) {
+		if (_decode_jpeg(data, len, GUI_RAW_IMG_W, GUI_RAW_IMG_H, jpeg_decode_buf)) {
+			gui_panel_file_browser_image_set_valid(true);
+			gui_panel_file_browser_image_set_image(JPEG_RGB_IMG_LEN, jpeg_decode_buf);
+		} else {
+			gui_panel_file_browser_image_set_valid(false);
+		}
+	}
+#endif
+}
+
+
+void cmd_handler_rsp_file_thumb(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+#ifdef ESP_PLATFORM
+	if ((data_type == CMD_DATA_NONE)) {
+		gui_panel_file_browser_image_set_valid(true);
+		gui_panel_file_browser_image_set_image();
+		gui_panel_file_browser_files_thumb_loaded();
+	}
+#else
+	if (data_type == CMD_DATA_BINARY) {
+		web_file_cache_response(CMD_FILE_GET_THUMB, len, data);
+	}
+	if ((data_type == CMD_DATA_BINARY) && (len != 0)) {
+		if (_decode_jpeg(data, len, CMD_FILE_THUMB_W, CMD_FILE_THUMB_H, jpeg_thumb_buf)) {
+			_expand_thumb(jpeg_thumb_buf, jpeg_decode_buf);
+			gui_panel_file_browser_image_set_valid(true);
+			gui_panel_file_browser_image_set_image(JPEG_RGB_IMG_LEN, jpeg_decode_buf);
+			gui_panel_file_browser_files_thumb_loaded();
+		}
+	}
+#endif
+}
+
+
 void cmd_handler_rsp_gain(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
 	
 	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
 		t = ntohl(*((uint32_t*) &data[0]));
-		gui_state.high_gain = (t != 0);
+		if (t == CMD_GAIN_AUTO) {
+			gui_state.auto_gain_en = true;
+		} else {
+			gui_state.auto_gain_en = false;
+			gui_state.high_gain = (t != CMD_GAIN_LOW);
+		}
 		gui_state_note_item_inited(GUI_STATE_INIT_GAIN);
 	}
 }
+
+
+void cmd_handler_rsp_gui_state(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_GUI_STATE_LEN)) {
+		gui_state_set_session(ntohl(*((uint32_t*) &data[0])), ntohl(*((uint32_t*) &data[4])));
+	}
+}
 	
 
 void cmd_handler_rsp_min_max_en(cmd_data_t data_type, uint32_t len, uint8_t* data)
@@ -392,11 +716,50 @@ void cmd_handler_rsp_palette(cmd_data_t data_type, uint32_t len, uint8_t* data)
 	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
 		gui_state.palette_index = ntohl(*((uint32_t*) &data[0]));
 		set_palette(gui_state.palette_index);
+		if (gui_state_init_complete()) {
+			// Changed by another client
+			gui_panel_image_update_palette();
+		}
 		gui_state_note_item_inited(GUI_STATE_INIT_PALETTE);
 	}
 }
 
 
+void cmd_handler_rsp_palette_stops(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	palette_stop_t stops[PALETTE_MAX_STOPS];
+	int n = len / CMD_PALETTE_STOP_LEN;
+	
+	if ((data_type == CMD_DATA_BINARY) && ((len % CMD_PALETTE_STOP_LEN) == 0) && (n <= PALETTE_MAX_STOPS)) {
+		for (int i=0; i<n; i++) {
+			stops[i].pos = data[i*CMD_PALETTE_STOP_LEN + 0];
+			stops[i].r = data[i*CMD_PALETTE_STOP_LEN + 1];
+			stops[i].g = data[i*CMD_PALETTE_STOP_LEN + 2];
+			stops[i].b = data[i*CMD_PALETTE_STOP_LEN + 3];
+		}
+		if (set_custom_palette_stops(n, stops) && (gui_state.palette_index == PALETTE_CUSTOM)) {
+			gui_panel_image_update_palette();
+		}
+	}
+}
+
+
+void cmd_handler_rsp_palette_threshold(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint16_t t;
+	uint16_t mode;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_PALETTE_THRESH_LEN)) {
+		t = ntohs(*((uint16_t*) &data[0]));
+		mode = ntohs(*((uint16_t*) &data[2]));
+		set_threshold_palette(t, mode == CMD_PAL_THRESH_BELOW);
+		if (gui_state.palette_index == PALETTE_THRESHOLD) {
+			gui_panel_image_update_palette();
+		}
+	}
+}
+
+
 void cmd_handler_rsp_region_enable(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -409,6 +772,15 @@ void cmd_handler_rsp_region_enable(cmd_data_t data_type, uint32_t len, uint8_t*
 }
 
 
+void cmd_handler_rsp_save_format(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		gui_state.save_format = ntohl(*((uint32_t*) &data[0]));
+		gui_state_note_item_inited(GUI_STATE_INIT_SAVE_FMT);
+	}
+}
+
+
 void cmd_handler_rsp_save_ovl_en(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -475,6 +847,15 @@ void cmd_handler_rsp_time(cmd_data_t data_type, uint32_t len, uint8_t* data)
 }
 
 
+void cmd_handler_rsp_tnr(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	if ((data_type == CMD_DATA_INT32) && (len == 4)) {
+		gui_state.tnr_level = ntohl(*((uint32_t*) &data[0]));
+		gui_state_note_item_inited(GUI_STATE_INIT_TNR);
+	}
+}
+
+
 void cmd_handler_rsp_units(cmd_data_t data_type, uint32_t len, uint8_t* data)
 {
 	uint32_t t;
@@ -515,7 +896,342 @@ void cmd_handler_rsp_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data)
 //
 // Internal functions
 //
-#ifndef ESP_PLATFORM
+#ifdef ESP_PLATFORM
+static void _copy_roi_table(t1c_roi_table_t* roi)
+{
+	int i;
+	
+	gui_panel_image_buf.roi_num_spots = roi->num_spots;
+	gui_panel_image_buf.roi_num_rects = roi->num_rects;
+	gui_panel_image_buf.roi_num_lines = roi->num_lines;
+	gui_panel_image_buf.roi_spot_valid_mask = roi->spot_valid_mask;
+	gui_panel_image_buf.roi_rect_valid_mask = roi->rect_valid_mask;
+	gui_panel_image_buf.roi_line_valid_mask = roi->line_valid_mask;
+	
+	for (i=0; i<roi->num_spots; i++) {
+		gui_panel_image_buf.roi_spot[i].x = roi->spot_points[i].x;
+		gui_panel_image_buf.roi_spot[i].y = roi->spot_points[i].y;
+		gui_panel_image_buf.roi_spot[i].temp = roi->spot_temps[i];
+	}
+	
+	for (i=0; i<roi->num_rects; i++) {
+		gui_panel_image_buf.roi_rect[i].x1 = roi->rect_points[i].start_point.x;
+		gui_panel_image_buf.roi_rect[i].y1 = roi->rect_points[i].start_point.y;
+		gui_panel_image_buf.roi_rect[i].x2 = roi->rect_points[i].end_point.x;
+		gui_panel_image_buf.roi_rect[i].y2 = roi->rect_points[i].end_point.y;
+		gui_panel_image_buf.roi_rect[i].avg_temp = roi->rect_temp_info[i].temp_info_value.ave_temp;
+		gui_panel_image_buf.roi_rect[i].min_temp = roi->rect_temp_info[i].temp_info_value.min_temp;
+		gui_panel_image_buf.roi_rect[i].max_temp = roi->rect_temp_info[i].temp_info_value.max_temp;
+	}
+	
+	for (i=0; i<roi->num_lines; i++) {
+		gui_panel_image_buf.roi_line[i].x1 = roi->line_points[i].start_point.x;
+		gui_panel_image_buf.roi_line[i].y1 = roi->line_points[i].start_point.y;
+		gui_panel_image_buf.roi_line[i].x2 = roi->line_points[i].end_point.x;
+		gui_panel_image_buf.roi_line[i].y2 = roi->line_points[i].end_point.y;
+		gui_panel_image_buf.roi_line[i].avg_temp = roi->line_temp_info[i].temp_info_value.ave_temp;
+		gui_panel_image_buf.roi_line[i].min_temp = roi->line_temp_info[i].temp_info_value.min_temp;
+		gui_panel_image_buf.roi_line[i].max_temp = roi->line_temp_info[i].temp_info_value.max_temp;
+	}
+}
+#else
+// Decode w x h CMD_STREAM_Y8_DELTA image data (see cmd_list.h).  Returns false if the data is
+// malformed.
+static bool _decode_y8_delta(uint8_t* src, uint32_t len, int w, int h, uint8_t* dst)
+{
+	uint8_t* endP = src + len;
+	uint8_t b;
+	int i = 0;
+	int n;
+	
+	while ((src < endP) && (i < (w*h))) {
+		b = *src++;
+		switch (b & CMD_IMG_DELTA_OP_MASK) {
+			case CMD_IMG_DELTA_RUN:
+				n = (b & ~CMD_IMG_DELTA_OP_MASK) + 1;
+				if ((i + n) > (w*h)) return false;
+				while (n--) {
+					dst[i] = _y8_delta_pred(dst, w, i);
+					i++;
+				}
+				break;
+			case CMD_IMG_DELTA_PAIR:
+				if ((i + 2) > (w*h)) return false;
+				dst[i] = _y8_delta_pred(dst, w, i) + ((b >> 3) & 0x07) - 4;
+				i++;
+				dst[i] = _y8_delta_pred(dst, w, i) + (b & 0x07) - 4;
+				i++;
+				break;
+			case CMD_IMG_DELTA_DIFF:
+				dst[i] = _y8_delta_pred(dst, w, i) + (b & ~CMD_IMG_DELTA_OP_MASK) - 32;
+				i++;
+				break;
+			default:
+				if (src >= endP) return false;
+				dst[i++] = *src++;
+		}
+	}
+	
+	return ((src == endP) && (i == (w*h)));
+}
+
+
+// Prediction for pixel i: the pixel to the left, the pixel above at the start of a row
+static inline uint8_t _y8_delta_pred(uint8_t* src, int w, int i)
+{
+	if (i == 0) {
+		return 0;
+	} else if ((i % w) == 0) {
+		return src[i - w];
+	} else {
+		return src[i - 1];
+	}
+}
+
+
+// Expand a w x h (decimated pixels) view starting at x1, y1 into a full size image by
+// replicating each pixel dec x dec times.  Areas outside the view are black.
+static void _expand_y8_view(uint8_t* src, int dec, int x1, int y1, int w, int h, uint8_t* dst)
+{
+	uint8_t* dP;
+	
+	memset(dst, 0, CMD_IMAGE_Y8_LEN);
+	for (int y=0; y<h; y++) {
+		for (int x=0; x<w; x++) {
+			dP = dst + (y1 + y*dec)*GUI_RAW_IMG_W + x1 + x*dec;
+			for (int j=0; j<dec; j++) {
+				memset(dP, *src, dec);
+				dP += GUI_RAW_IMG_W;
+			}
+			src++;
+		}
+	}
+}
+
+
+// Decode CMD_IMG_Y16_ENC_DELTA image data (see cmd_list.h).  Returns false if the data
+// is malformed.
+static bool _decode_y16_delta(uint8_t* src, uint32_t len, uint16_t* dst)
+{
+	uint8_t* endP = src + len;
+	uint8_t b;
+	int i = 0;
+	int n;
+	
+	while ((src < endP) && (i < GUI_RAW_IMG_W*GUI_RAW_IMG_H)) {
+		b = *src++;
+		switch (b & CMD_IMG_DELTA_OP_MASK) {
+			case CMD_IMG16_DELTA_RUN:
+				n = (b & ~CMD_IMG_DELTA_OP_MASK) + 1;
+				if ((i + n) > GUI_RAW_IMG_W*GUI_RAW_IMG_H) return false;
+				while (n--) {
+					dst[i] = _y16_delta_pred(dst, i);
+					i++;
+				}
+				break;
+			case CMD_IMG16_DELTA_DIFF6:
+				dst[i] = _y16_delta_pred(dst, i) + (b & ~CMD_IMG_DELTA_OP_MASK) - 32;
+				i++;
+				break;
+			case CMD_IMG16_DELTA_DIFF14:
+				if (src >= endP) return false;
+				dst[i] = _y16_delta_pred(dst, i) + ((((b & ~CMD_IMG_DELTA_OP_MASK) << 8) | *src++) - 8192);
+				i++;
+				break;
+			default:
+				if ((src + 1) >= endP) return false;
+				dst[i++] = (*src << 8) | *(src+1);
+				src += 2;
+		}
+	}
+	
+	return ((src == endP) && (i == GUI_RAW_IMG_W*GUI_RAW_IMG_H));
+}
+
+
+static inline uint16_t _y16_delta_pred(uint16_t* src, int i)
+{
+	if (i == 0) {
+		return 0;
+	} else if ((i % GUI_RAW_IMG_W) == 0) {
+		return src[i - GUI_RAW_IMG_W];
+	} else {
+		return src[i - 1];
+	}
+}
+
+
+// Linearly scale Y16 data to 8-bits across the AGC range.  This matches the device's
+// linear AGC; histogram equalized images will differ in contrast.
+static void _scale_y16_to_y8(uint16_t* src, uint16_t agc_min, uint16_t agc_max, uint8_t* dst)
+{
+	int32_t range = (agc_max > agc_min) ? (agc_max - agc_min) : 1;
+	int32_t v;
+	
+	for (int i=0; i<GUI_RAW_IMG_W*GUI_RAW_IMG_H; i++) {
+		v = (int32_t) src[i] - agc_min;
+		if (v < 0) v = 0;
+		if (v > range) v = range;
+		dst[i] = (uint8_t) ((v * 255) / range);
+	}
+}
+
+
+// Copy the image metadata common to CMD_IMAGE, CMD_IMAGE_Y16 and CMD_IMAGE_SAME out of
+// len bytes of image data.  Returns the length of the metadata (which may be longer than
+// ours if sent by newer firmware) or 0 if it isn't a version we understand.
+static uint32_t _get_image_meta(uint8_t* buf, uint32_t len, cmd_image_meta_t* meta)
+{
+	if (len < CMD_IMAGE_META_LEN) return 0;
+	
+	memcpy(meta, buf, CMD_IMAGE_META_LEN);
+	if ((meta->version != CMD_IMAGE_META_VERSION) || (meta->len < CMD_IMAGE_META_LEN) || (meta->len > len)) {
+		return 0;
+	}
+	
+	return meta->len;
+}
+
+
+// Load the image metadata into the image buffer
+static void _set_image_meta(cmd_image_meta_t* meta)
+{
+	// Frame timing
+	gui_panel_image_buf.frame_seq = meta->frame_seq;
+	gui_panel_image_buf.frame_msec = meta->frame_msec;
+	
+	// Boolean flags
+	gui_panel_image_buf.high_gain = meta->high_gain;
+	gui_panel_image_buf.vid_frozen = meta->vid_frozen;
+	gui_panel_image_buf.spot_valid = meta->spot_valid;
+	gui_panel_image_buf.minmax_valid = meta->minmax_valid;
+	gui_panel_image_buf.region_valid = meta->region_valid;
+	gui_panel_image_buf.amb_temp_valid = meta->amb_temp_valid;
+	gui_panel_image_buf.amb_hum_valid = meta->amb_hum_valid;
+	gui_panel_image_buf.distance_valid = meta->distance_valid;
+	
+	// 16-bit values
+	gui_panel_image_buf.amb_temp = meta->amb_temp;
+	gui_panel_image_buf.amb_hum = meta->amb_hum;
+	gui_panel_image_buf.distance = meta->distance;
+	gui_panel_image_buf.spot_temp = meta->spot_temp;
+	gui_panel_image_buf.spot_x = meta->spot_x;
+	gui_panel_image_buf.spot_y = meta->spot_y;
+	gui_panel_image_buf.min_temp = meta->min_temp;
+	gui_panel_image_buf.min_x = meta->min_x;
+	gui_panel_image_buf.min_y = meta->min_y;
+	gui_panel_image_buf.max_temp = meta->max_temp;
+	gui_panel_image_buf.max_x = meta->max_x;
+	gui_panel_image_buf.max_y = meta->max_y;
+	gui_panel_image_buf.region_x1 = meta->region_x1;
+	gui_panel_image_buf.region_y1 = meta->region_y1;
+	gui_panel_image_buf.region_x2 = meta->region_x2;
+	gui_panel_image_buf.region_y2 = meta->region_y2;
+	gui_panel_image_buf.region_avg_temp = meta->region_avg_temp;
+	gui_panel_image_buf.region_min_temp = meta->region_min_temp;
+	gui_panel_image_buf.region_min_x = meta->region_min_x;
+	gui_panel_image_buf.region_min_y = meta->region_min_y;
+	gui_panel_image_buf.region_max_temp = meta->region_max_temp;
+	gui_panel_image_buf.region_max_x = meta->region_max_x;
+	gui_panel_image_buf.region_max_y = meta->region_max_y;
+	
+	// ROI table (the entries have the same layout)
+	gui_panel_image_buf.roi_num_spots = meta->roi_num_spots;
+	gui_panel_image_buf.roi_num_rects = meta->roi_num_rects;
+	gui_panel_image_buf.roi_num_lines = meta->roi_num_lines;
+	gui_panel_image_buf.roi_spot_valid_mask = meta->roi_spot_valid_mask;
+	gui_panel_image_buf.roi_rect_valid_mask = meta->roi_rect_valid_mask;
+	gui_panel_image_buf.roi_line_valid_mask = meta->roi_line_valid_mask;
+	memcpy(gui_panel_image_buf.roi_spot, meta->roi_spot, sizeof(gui_panel_image_buf.roi_spot));
+	memcpy(gui_panel_image_buf.roi_rect, meta->roi_rect, sizeof(gui_panel_image_buf.roi_rect));
+	memcpy(gui_panel_image_buf.roi_line, meta->roi_line, sizeof(gui_panel_image_buf.roi_line));
+}
+
+
+// Decode a stored jpeg file into a w x h RGB888 image.  Returns false if the file can't be
+// decoded or is not the expected size.
+static bool _decode_jpeg(uint8_t* src, uint32_t len, int w, int h, uint8_t* dst)
+{
+	JDEC jdec;
+	jpeg_iodev_t devid;
+	
+	devid.src = src;
+	devid.src_len = len;
+	if (jd_prepare(&jdec, _jpeg_in_func, jpeg_work_buf, JPEG_WORK_BUF_LEN, &devid) != JDR_OK) {
+		return false;
+	}
+	if ((jdec.width != w) || (jdec.height != h)) {
+		return false;
+	}
+	
+	devid.fbuf = dst;
+	devid.wfbuf = jdec.width;
+	return (jd_decomp(&jdec, _jpeg_out_func, 0) == JDR_OK);
+}
+
+
+// Expand a decoded RGB888 thumbnail into a GUI_RAW_IMG_W x GUI_RAW_IMG_H image, each
+// thumbnail pixel becoming a block of pixels
+static void _expand_thumb(uint8_t* src, uint8_t* dst)
+{
+	const int bw = GUI_RAW_IMG_W / CMD_FILE_THUMB_W;
+	const int bh = GUI_RAW_IMG_H / CMD_FILE_THUMB_H;
+	uint8_t* dP;
+	int i, j, x, y;
+	
+	for (y=0; y<CMD_FILE_THUMB_H; y++) {
+		for (x=0; x<CMD_FILE_THUMB_W; x++) {
+			for (j=0; j<bh; j++) {
+				dP = dst + 3*((y*bh + j)*GUI_RAW_IMG_W + x*bw);
+				for (i=0; i<bw; i++) {
+					*dP++ = src[0];
+					*dP++ = src[1];
+					*dP++ = src[2];
+				}
+			}
+			src += 3;
+		}
+	}
+}
+
+
+static size_t _jpeg_in_func(JDEC* jd, uint8_t* buff, size_t nbyte)
+{
+	jpeg_iodev_t* dev = (jpeg_iodev_t*) jd->device;
+	
+	if (nbyte > dev->src_len) nbyte = dev->src_len;
+	if (buff) {
+		// Read data from the input buffer
+		memcpy(buff, dev->src, nbyte);
+	}
+	dev->src += nbyte;
+	dev->src_len -= nbyte;
+	
+	return nbyte;
+}
+
+
+static int _jpeg_out_func(JDEC* jd, void* bitmap, JRECT* rect)
+{
+	jpeg_iodev_t* dev = (jpeg_iodev_t*) jd->device;
+	uint8_t* src = (uint8_t*) bitmap;
+	uint8_t* dst;
+	unsigned int bws, bwd;
+	
+	// Copy the output image rectangle to the frame buffer
+	dst = dev->fbuf + 3 * (rect->top * dev->wfbuf + rect->left);
+	bws = 3 * (rect->right - rect->left + 1);
+	bwd = 3 * dev->wfbuf;
+	for (int y = rect->top; y <= rect->bottom; y++) {
+		memcpy(dst, src, bws);
+		src += bws;
+		dst += bwd;
+	}
+	
+	return 1;
+}
+
+
 static uint8_t* _get_i16(int16_t* data, uint8_t* buf)
 {
 	// Network order - big endian
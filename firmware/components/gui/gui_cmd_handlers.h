@@ -30,28 +30,41 @@
 //
 void cmd_handler_set_critical_batt(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_image(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_image_same(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_image_y16(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_msg_on(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_msg_off(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_set_stream_rate(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_set_timelapse_status(cmd_data_t data_type, uint32_t len, uint8_t* data);
 
+void cmd_handler_rsp_agc_mode(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_ambient_correct(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_backlight(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_batt_info(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_benchmark(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_brightness(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_card_present(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_ctrl_activity(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_emissivity(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_file_catalog(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_file_catalog_page(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_file_image(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_file_jpeg(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_file_thumb(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_gain(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_gui_state(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_min_max_en(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_palette(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_palette_stops(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_palette_threshold(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_region_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_save_format(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_save_ovl_en(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_shutter(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_spot_enable(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_sys_info(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_time(cmd_data_t data_type, uint32_t len, uint8_t* data);
+void cmd_handler_rsp_tnr(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_units(cmd_data_t data_type, uint32_t len, uint8_t* data);
 void cmd_handler_rsp_wifi(cmd_data_t data_type, uint32_t len, uint8_t* data);
 
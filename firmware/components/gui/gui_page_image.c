@@ -23,6 +23,22 @@
 #include "gui_page_image.h"
 #include "gui_panel_image_main.h"
 #include "gui_panel_image_controls.h"
+#include "gui_render.h"
+
+
+
+//
+// Constants
+//
+
+// Image stream mode requested over the network.  Set to CMD_STREAM_Y16_DELTA to receive
+// the imager's Y16 data (temperatures when the device uses local radiometry).
+#define WEB_STREAM_MODE CMD_STREAM_Y8_DELTA
+
+// Image stream decimation (1, 2 or 4) requested over the network by desktop and mobile
+// browsers.  Larger values trade resolution for a 4x or 16x smaller stream.
+#define WEB_STREAM_DECIMATION        1
+#define WEB_STREAM_MOBILE_DECIMATION 1
 
 
 
@@ -41,6 +57,12 @@ static uint16_t left_spacing;
 static uint16_t top_spacing;
 static uint16_t inner_spacing;
 
+// Last stream view requested so panning only sends a command when the region changes
+static uint16_t stream_view_x1;
+static uint16_t stream_view_y1;
+static uint16_t stream_view_x2;
+static uint16_t stream_view_y2;
+
 // LVGL objects
 static lv_obj_t* my_page;
 static lv_obj_t* panel_image;
@@ -87,8 +109,18 @@ lv_obj_t* gui_page_image_init(lv_obj_t* screen, uint16_t page_w, uint16_t page_h
 
 void gui_page_image_set_active(bool is_active)
 {
-	// Enable image streaming when page is visible
-	(void) cmd_send_int32(CMD_SET, CMD_STREAM_EN, is_active ? 1 : 0);
+	// Enable image streaming when page is visible (requesting the encoded stream over the
+	// network)
+#ifdef ESP_PLATFORM
+	(void) cmd_send_int32(CMD_SET, CMD_STREAM_EN, is_active ? CMD_STREAM_Y8 : CMD_STREAM_OFF);
+#else
+	if (is_active) {
+		// Force the current view to be sent
+		stream_view_x2 = 0;
+		gui_page_image_update_stream_view();
+	}
+	(void) cmd_send_int32(CMD_SET, CMD_STREAM_EN, is_active ? WEB_STREAM_MODE : CMD_STREAM_OFF);
+#endif
 	
 	// Set page visibility
 	lv_obj_set_hidden(my_page, !is_active);
@@ -99,6 +131,27 @@ void gui_page_image_set_active(bool is_active)
 }
 
 
+// Request only the part of the image that is visible while zoomed so a zoomed stream costs
+// no more than the full view (the host resamples it).  The camera imager's own zoom isn't
+// used since it only applies to its ISP video output, not the Y16 frames we acquire.
+void gui_page_image_update_stream_view()
+{
+#ifndef ESP_PLATFORM
+	uint16_t x1, y1, x2, y2;
+	
+	gui_render_get_zoom_region(&x1, &y1, &x2, &y2);
+	if ((x1 != stream_view_x1) || (y1 != stream_view_y1) || (x2 != stream_view_x2) || (y2 != stream_view_y2)) {
+		stream_view_x1 = x1;
+		stream_view_y1 = y1;
+		stream_view_x2 = x2;
+		stream_view_y2 = y2;
+		(void) cmd_send_stream_view(CMD_SET, CMD_STREAM_VIEW, is_mobile ? WEB_STREAM_MOBILE_DECIMATION : WEB_STREAM_DECIMATION,
+		                            x1, y1, x2, y2);
+	}
+#endif
+}
+
+
 void gui_page_image_reset_screen_size(uint16_t page_w, uint16_t page_h)
 {
 	// Reconfigure page layout
@@ -109,6 +162,9 @@ void gui_page_image_reset_screen_size(uint16_t page_w, uint16_t page_h)
 	gui_panel_image_reset_size();
 	gui_panel_image_controls_reset_size();
 	
+	// The visible region of a zoomed image changes with the image size
+	gui_page_image_update_stream_view();
+	
 	// Inform our controller of any orientation changes
 	if (is_portrait != prev_is_portrait) {
 		_set_controller_orientation();
@@ -38,6 +38,7 @@
 //
 lv_obj_t* gui_page_image_init(lv_obj_t* screen, uint16_t page_w, uint16_t page_h, bool mobile);
 void gui_page_image_set_active(bool is_active);
+void gui_page_image_update_stream_view();
 void gui_page_image_reset_screen_size(uint16_t page_w, uint16_t page_h);
 
 
@@ -20,6 +20,7 @@
 #ifndef CONFIG_BUILD_ICAM_MINI
 
 #include "gui_page_settings.h"
+#include "gui_panel_settings_agc.h"
 #include "gui_panel_settings_ambient.h"
 #include "gui_panel_settings_backlight.h"
 #include "gui_panel_settings_brightness.h"
@@ -29,10 +30,12 @@
 #include "gui_panel_settings_palette.h"
 #include "gui_panel_settings_poweroff.h"
 #include "gui_panel_settings_save.h"
+#include "gui_panel_settings_save_fmt.h"
 #include "gui_panel_settings_shutter.h"
 #include "gui_panel_settings_system.h"
 #include "gui_panel_settings_time.h"
 #include "gui_panel_settings_timelapse.h"
+#include "gui_panel_settings_tnr.h"
 #include "gui_panel_settings_units.h"
 #include "gui_panel_settings_wifi.h"
 #include "gui_utilities.h"
@@ -51,7 +54,7 @@
 //
 
 // Maximum number of control panels we can add to this page
-#define MAX_CONTROL_PANELS  15
+#define MAX_CONTROL_PANELS  20
 
 
 //
@@ -169,6 +172,7 @@ lv_obj_t* gui_page_settings_init(lv_obj_t* screen, uint16_t page_w, uint16_t pag
 
 	// Add panels to the control page (they will register themselves with us)
 	gui_panel_settings_info_init(screen, page_controls);
+	gui_panel_settings_agc_init(page_controls);
 	gui_panel_settings_ambient_init(screen, page_controls);
 #ifdef ESP_PLATFORM
 	gui_panel_settings_backlight_init(page_controls);
@@ -179,10 +183,12 @@ lv_obj_t* gui_page_settings_init(lv_obj_t* screen, uint16_t page_w, uint16_t pag
 	gui_panel_settings_palette_init(page_controls);
 	gui_panel_settings_poweroff_init(page_controls);
 	gui_panel_settings_save_init(page_controls);
+	gui_panel_settings_save_fmt_init(page_controls);
 	gui_panel_settings_shutter_init(screen, page_controls);
 	gui_panel_settings_system_init(screen, page_controls);
 	gui_panel_settings_time_init(screen, page_controls);
 	gui_panel_settings_timelapse_init(screen, page_controls);
+	gui_panel_settings_tnr_init(page_controls);
 	gui_panel_settings_units_init(page_controls);
 #ifndef ESP_PLATFORM
 	gui_panel_settings_wifi_init(screen, page_controls);
@@ -210,6 +216,7 @@ void gui_page_settings_set_active(bool is_active)
 	
 	// Inform controls so they can manage state
 	gui_panel_settings_info_set_active(is_active);
+	gui_panel_settings_agc_set_active(is_active);
 	gui_panel_settings_ambient_set_active(is_active);
 #ifdef ESP_PLATFORM
 	gui_panel_settings_backlight_set_active(is_active);
@@ -220,10 +227,12 @@ void gui_page_settings_set_active(bool is_active)
 	gui_panel_settings_palette_set_active(is_active);
 	gui_panel_settings_poweroff_set_active(is_active);
 	gui_panel_settings_save_set_active(is_active);
+	gui_panel_settings_save_fmt_set_active(is_active);
 	gui_panel_settings_shutter_set_active(is_active);
 	gui_panel_settings_system_set_active(is_active);
 	gui_panel_settings_time_set_active(is_active);
 	gui_panel_settings_timelapse_set_active(is_active);
+	gui_panel_settings_tnr_set_active(is_active);
 	gui_panel_settings_units_set_active(is_active);
 #ifndef ESP_PLATFORM
 	gui_panel_settings_wifi_set_active(is_active);
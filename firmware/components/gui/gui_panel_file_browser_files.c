@@ -25,11 +25,15 @@
 #include "gui_panel_file_browser_image.h"
 #include "gui_state.h"
 #include "gui_utilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef ESP_PLATFORM
 	#include "gui_task.h"
 #else
 	#include "gui_main.h"
+	#include "web_file_cache.h"
 #endif
 
 
@@ -41,6 +45,26 @@
 #define SCROLL_UP   0
 #define SCROLL_DOWN 1
 
+// page_type value when not loading a catalog (catalog types are -1, 0..)
+#define PAGE_TYPE_NONE -2
+
+
+
+//
+// Local typedefs
+//
+
+// A catalog list is displayed with a table holding just the rows in view, moved down its
+// scrollable page as the page is scrolled.  The names are kept here instead of in the
+// table so they don't use the LVGL heap.
+typedef struct {
+	char* names;                          // num_entries names, GUI_FILE_NAME_LEN each
+	int names_len;                        // Number of names allocated
+	int num_entries;                      // Number of names in the displayed list
+	int first_row;                        // Catalog entry in the first table row
+} catalog_view_t;
+
+
 //
 // Local variables
 //
@@ -62,6 +86,17 @@ static int selected_file;                 // Set to a non-negative value when a
 static int prev_tbl_dir_row;
 static int prev_tbl_file_row;
 static int middle_entry_row;
+static int page_type;                     // Catalog being loaded a page at a time (PAGE_TYPE_NONE when done)
+static int page_next_offset;              // Next catalog entry expected
+static int image_req_dir;                 // File whose thumbnail was last requested
+static int image_req_file;
+
+// Catalog lists
+static catalog_view_t dir_view;
+static catalog_view_t file_view;
+static lv_coord_t row_h;                  // Height of a table row (set by the first table)
+static lv_signal_cb_t scrl_ancestor_signal;
+static bool updating_window = false;
 
 //
 // LVGL Objects
@@ -79,6 +114,9 @@ static lv_obj_t* tbl_file_browse;
 // Status update task
 static lv_task_t* task_update;
 
+// Full image request timer
+static lv_task_t* task_image_req;
+
 
 
 //
@@ -92,9 +130,20 @@ static void _status_update_task(lv_task_t * task);
 static void _cb_tbl_dir(lv_obj_t * obj, lv_event_t event);
 static void _cb_tbl_file(lv_obj_t * obj, lv_event_t event);
 static void _cb_messagebox(int btn_id);
+static lv_obj_t* _create_catalog_table(bool updating_file_list, int num_entries);
+static void _set_catalog_entry(catalog_view_t* vP, int r, char** entries);
+static bool _alloc_catalog_names(catalog_view_t* vP, int num_entries);
+static void _free_catalog_names(catalog_view_t* vP);
+static lv_res_t _scrl_signal(lv_obj_t* scrl, lv_signal_t sign, void* param);
+static void _update_table_window(bool updating_file_list);
+static void _refresh_table(lv_obj_t* tbl, catalog_view_t* vP, int selected_row);
+static void _set_row_type(lv_obj_t* tbl, catalog_view_t* vP, int row, uint8_t type);
+static void _catalog_loaded(bool updating_file_list, lv_obj_t* tbl);
 static void _request_dir_list();
 static void _request_file_list(int file_index);
+static void _request_catalog_page(int type, int offset);
 static void _request_image(int dir_index, int file_index);
+static void _task_eval_image_req_timer(lv_task_t* task);
 static void _delete_dir(int dir_index);
 static void _delete_file(int dir_index, int file_index);
 static void _scroll_table(lv_obj_t* tbl, int dir);
@@ -148,8 +197,8 @@ lv_obj_t* gui_panel_file_browser_files_init(lv_obj_t* page)
 	// Scrollable page for directory list table with no internal body padding (dynamic size and x offset)
 	page_tbl_dir_scroll = lv_page_create(my_panel, NULL);
 	lv_obj_set_y(page_tbl_dir_scroll, GUIPN_FILE_BROWSER_FILES_TBL_Y);
-	lv_page_set_scrollable_fit2(page_tbl_dir_scroll, LV_FIT_NONE, LV_FIT_TIGHT);
-	lv_page_set_scrl_layout(page_tbl_dir_scroll, LV_LAYOUT_COLUMN_MID);
+	lv_page_set_scrollable_fit2(page_tbl_dir_scroll, LV_FIT_NONE, LV_FIT_NONE);
+	lv_page_set_scrl_layout(page_tbl_dir_scroll, LV_LAYOUT_OFF);
 	lv_obj_set_auto_realign(page_tbl_dir_scroll, true);
 	lv_obj_add_protect(page_tbl_dir_scroll, LV_PROTECT_CLICK_FOCUS);
 	lv_obj_set_style_local_pad_top(page_tbl_dir_scroll, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
@@ -169,8 +218,8 @@ lv_obj_t* gui_panel_file_browser_files_init(lv_obj_t* page)
 	// Scrollable page for file list table with no internal body padding (dynamic size and x offset)
 	page_tbl_file_scroll = lv_page_create(my_panel, NULL);
 	lv_obj_set_y(page_tbl_file_scroll, GUIPN_FILE_BROWSER_FILES_TBL_Y);
-	lv_page_set_scrollable_fit2(page_tbl_file_scroll, LV_FIT_NONE, LV_FIT_TIGHT);
-	lv_page_set_scrl_layout(page_tbl_file_scroll, LV_LAYOUT_COLUMN_MID);
+	lv_page_set_scrollable_fit2(page_tbl_file_scroll, LV_FIT_NONE, LV_FIT_NONE);
+	lv_page_set_scrl_layout(page_tbl_file_scroll, LV_LAYOUT_OFF);
 	lv_obj_set_auto_realign(page_tbl_file_scroll, true);
 	lv_obj_add_protect(page_tbl_file_scroll, LV_PROTECT_CLICK_FOCUS);
 	lv_obj_set_style_local_pad_top(page_tbl_file_scroll, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
@@ -178,6 +227,11 @@ lv_obj_t* gui_panel_file_browser_files_init(lv_obj_t* page)
 	lv_obj_set_style_local_pad_left(page_tbl_file_scroll, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
 	lv_obj_set_style_local_pad_right(page_tbl_file_scroll, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
 	
+	// Move the table rows along with the scrollable parts of both pages
+	scrl_ancestor_signal = lv_obj_get_signal_cb(lv_page_get_scrollable(page_tbl_dir_scroll));
+	lv_obj_set_signal_cb(lv_page_get_scrollable(page_tbl_dir_scroll), _scrl_signal);
+	lv_obj_set_signal_cb(lv_page_get_scrollable(page_tbl_file_scroll), _scrl_signal);
+	
 	// File table (created when needed)
 	
 	// File table label (dynamic width)
@@ -225,6 +279,9 @@ void gui_panel_file_browser_files_set_active(bool is_active)
 			// Delete the table objects if they exist
 			tbl_dir_browse = _destroy_table(page_tbl_dir_scroll, tbl_dir_browse);
 			tbl_file_browse = _destroy_table(page_tbl_file_scroll, tbl_file_browse);
+			page_type = PAGE_TYPE_NONE;
+			_free_catalog_names(&dir_view);
+			_free_catalog_names(&file_view);
 			
 			// Delete the update task if it exists
 			if (task_update != NULL) {
@@ -232,6 +289,12 @@ void gui_panel_file_browser_files_set_active(bool is_active)
 				task_update = NULL;
 			}
 			
+			// Cancel any pending image request
+			if (task_image_req != NULL) {
+				lv_task_del(task_image_req);
+				task_image_req = NULL;
+			}
+			
 			_initialize_screen_values();
 			
 			prev_active = false;
@@ -242,72 +305,78 @@ void gui_panel_file_browser_files_set_active(bool is_active)
 
 void gui_panel_file_browser_files_set_catalog(int type, int num_entries, char* entries)
 {
-	bool saw_dot;
 	bool updating_file_list = (type >= 0);
-	char c;
-	char filename[GUI_FILE_NAME_LEN];  // Larger than longest expected name
-	int i, r;
+	catalog_view_t* vP = updating_file_list ? &file_view : &dir_view;
 	lv_obj_t* tbl;
+	int r;
 	
-	// Create a new table on the appropriate scrollable page (tables should be NULL on entry here)
-	if (updating_file_list) {
-		tbl_file_browse = _destroy_table(page_tbl_file_scroll, tbl_file_browse);
-		tbl_file_browse = _create_table(page_tbl_file_scroll, _cb_tbl_file);
-		tbl = tbl_file_browse;
-		num_files = num_entries;
-	} else {
-		tbl_dir_browse = _destroy_table(page_tbl_dir_scroll, tbl_dir_browse);
-		tbl_dir_browse = _create_table(page_tbl_dir_scroll, _cb_tbl_dir);
-		tbl = tbl_dir_browse;
-		num_dirs = num_entries;
+	tbl = _create_catalog_table(updating_file_list, num_entries);
+	
+	// Convert list of names into catalog entries
+	for (r=0; r<vP->num_entries; r++) {
+		_set_catalog_entry(vP, r, &entries);
 	}
+	_refresh_table(tbl, vP, -1);
 	
-    lv_table_set_row_cnt(tbl, num_entries);
-
-	// Convert list of names into table entries (strip off .JPG suffix)
-	r = 0;
-	while (num_entries--) {
-		i = 0;
-		saw_dot = false;
-		for (;;) {
-			c = *entries++;
-			if ((c == ',') || (i == (GUI_FILE_NAME_LEN-1))) {
-				filename[i] = 0;
-				break;
-			} else if (c == '.') {
-				filename[i] = 0;
-				saw_dot = true;
-			} else if (!saw_dot) {
-				filename[i] = c;
-			}
-			i++;
+	_catalog_loaded(updating_file_list, tbl);
+}
+
+
+void gui_panel_file_browser_files_set_catalog_page(int type, int total, int offset, int num_entries, char* entries[])
+{
+	bool updating_file_list = (type >= 0);
+	catalog_view_t* vP = updating_file_list ? &file_view : &dir_view;
+	lv_obj_t* tbl;
+	int i;
+	
+	if ((type != page_type) || (offset != page_next_offset)) {
+		// Ignore pages for an old request
+		return;
+	}
+	
+	if (offset == 0) {
+		// Create the table with all rows so it can be displayed and navigated before the
+		// remaining pages are loaded
+		tbl = _create_catalog_table(updating_file_list, total);
+	} else {
+		tbl = updating_file_list ? tbl_file_browse : tbl_dir_browse;
+		if (tbl == NULL) {
+			// Table deleted while loading
+			page_type = PAGE_TYPE_NONE;
+			return;
 		}
-		lv_table_set_cell_value(tbl, r, 0, filename);
-		lv_table_set_cell_align(tbl, r, 0, LV_LABEL_ALIGN_CENTER);
-		lv_table_set_cell_crop(tbl, r, 0, true);
-		r++;
 	}
-
-	// Handle special cases
-	if (updating_file_list) {
-		if (load_first_file || load_last_file) {
-			if (load_first_file) {
-				load_first_file = false;
-				_update_selected_file_indication(0);
-			} else {
-				load_last_file = false;
-				_update_selected_file_indication((uint16_t) (num_files-1));
-				
-				// Scroll to the end of the list
-				lv_page_scroll_ver(page_tbl_file_scroll, -lv_obj_get_height(tbl_file_browse));
-			}
-			_request_image(selected_dir, selected_file);
-			_update_image_panel_controls();
+	
+	for (i=0; i<num_entries; i++) {
+		if ((offset + i) < vP->num_entries) {
+			_set_catalog_entry(vP, offset + i, &entries[i]);
 		}
 	}
-	if (scroll_middle_entry) {
-		scroll_middle_entry = false;
-		_scroll_table_to_index(tbl, middle_entry_row);
+	_refresh_table(tbl, vP, updating_file_list ? prev_tbl_file_row : prev_tbl_dir_row);
+	page_next_offset = offset + num_entries;
+	
+	if (offset == 0) {
+		_catalog_loaded(updating_file_list, tbl);
+	}
+	
+	if ((num_entries != 0) && (page_next_offset < total)) {
+		_request_catalog_page(type, page_next_offset);
+	} else {
+		page_type = PAGE_TYPE_NONE;
+	}
+}
+
+
+// Called when the thumbnail for the selected file has been displayed.  The full image is
+// requested if the selection doesn't change for a little while.
+void gui_panel_file_browser_files_thumb_loaded()
+{
+	if (task_image_req == NULL) {
+		// Start the timer
+		task_image_req = lv_task_create(_task_eval_image_req_timer, GUIPN_FILE_BROWSER_FILES_IMAGE_MSEC, LV_TASK_PRIO_LOW, NULL);
+	} else {
+		// Reset timer
+		lv_task_reset(task_image_req);
 	}
 }
 
@@ -422,6 +491,9 @@ static lv_obj_t* _destroy_table(lv_obj_t* page, lv_obj_t* tbl)
 	if (tbl != NULL) {
 		lv_obj_del(tbl);
 	}
+	if (page != NULL) {
+		lv_page_set_scrl_height(page, 0);
+	}
 	
 	return NULL;
 }
@@ -471,13 +543,15 @@ static void _initialize_screen_values()
 	num_files = 0;
 	selected_dir = -1;
 	selected_file = -1;
+	page_type = PAGE_TYPE_NONE;
 	
 	// No tables yet
 	tbl_dir_browse = NULL;
 	tbl_file_browse = NULL;
 	
-	// No task yet
+	// No tasks yet
 	task_update = NULL;
+	task_image_req = NULL;
 }
 
 
@@ -521,6 +595,7 @@ static void _cb_tbl_dir(lv_obj_t * obj, lv_event_t event)
 	
 	if (event == LV_EVENT_CLICKED) {
 		if (lv_table_get_pressed_cell(obj, &row, &col) == LV_RES_OK) {
+			row += (uint16_t) dir_view.first_row;
 			if (((int) row != prev_tbl_dir_row) && ((int) row < num_dirs)) {
 				// Update the selected dir indications
 				_update_selected_dir_indication(row);
@@ -545,6 +620,7 @@ static void _cb_tbl_file(lv_obj_t * obj, lv_event_t event)
 	
 	if (event == LV_EVENT_CLICKED) {
 		if (lv_table_get_pressed_cell(obj, &row, &col) == LV_RES_OK) {
+			row += (uint16_t) file_view.first_row;
 			if (((int) row != prev_tbl_file_row) && ((int) row < num_files)) {
 				// Update the selected file indications
 				_update_selected_file_indication(row);
@@ -648,9 +724,224 @@ static void _cb_messagebox(int btn_id)
 }
 
 
+// Create a new table for a list of num_entries names on the appropriate scrollable page.
+// The scrollable page is sized for the whole list but the table only has the rows in view.
+static lv_obj_t* _create_catalog_table(bool updating_file_list, int num_entries)
+{
+	catalog_view_t* vP;
+	lv_obj_t* page;
+	lv_obj_t* tbl;
+	lv_coord_t pad_h;
+	int r, rows;
+	
+	if (updating_file_list) {
+		page = page_tbl_file_scroll;
+		tbl_file_browse = _destroy_table(page, tbl_file_browse);
+		tbl_file_browse = _create_table(page, _cb_tbl_file);
+		tbl = tbl_file_browse;
+		vP = &file_view;
+	} else {
+		page = page_tbl_dir_scroll;
+		tbl_dir_browse = _destroy_table(page, tbl_dir_browse);
+		tbl_dir_browse = _create_table(page, _cb_tbl_dir);
+		tbl = tbl_dir_browse;
+		vP = &dir_view;
+	}
+	
+	if (!_alloc_catalog_names(vP, num_entries)) {
+		printf("%s Could not allocate %d catalog names\n", TAG, num_entries);
+		num_entries = 0;
+	}
+	vP->num_entries = num_entries;
+	vP->first_row = 0;
+	if (updating_file_list) {
+		num_files = num_entries;
+	} else {
+		num_dirs = num_entries;
+	}
+	
+	rows = (num_entries < GUIPN_FILE_BROWSER_FILES_TBL_ROWS) ? num_entries : GUIPN_FILE_BROWSER_FILES_TBL_ROWS;
+	lv_table_set_row_cnt(tbl, rows);
+	for (r=0; r<rows; r++) {
+		lv_table_set_cell_value(tbl, r, 0, "");
+		lv_table_set_cell_align(tbl, r, 0, LV_LABEL_ALIGN_CENTER);
+		lv_table_set_cell_crop(tbl, r, 0, true);
+	}
+	
+	// All rows are the same height since the names are cropped to one line
+	pad_h = lv_obj_get_style_pad_top(tbl, LV_TABLE_PART_BG) + lv_obj_get_style_pad_bottom(tbl, LV_TABLE_PART_BG);
+	if (rows != 0) {
+		row_h = (lv_obj_get_height(tbl) - pad_h) / rows;
+	}
+	lv_page_set_scrl_height(page, (rows == 0) ? 0 : (pad_h + num_entries * row_h));
+	lv_obj_align(tbl, NULL, LV_ALIGN_IN_TOP_MID, 0, 0);
+	
+	return tbl;
+}
+
+
+// Set catalog entry r to the name pointed to by *entries (ending with a comma or null) with
+// its .JPG suffix stripped off and advance *entries past the name
+static void _set_catalog_entry(catalog_view_t* vP, int r, char** entries)
+{
+	bool saw_dot = false;
+	char c;
+	char* filename = &vP->names[r * GUI_FILE_NAME_LEN];  // Larger than longest expected name
+	char* cP = *entries;
+	int i = 0;
+	
+	for (;;) {
+		c = *cP++;
+		if ((c == ',') || (c == 0) || (i == (GUI_FILE_NAME_LEN-1))) {
+			filename[i] = 0;
+			break;
+		} else if (c == '.') {
+			filename[i] = 0;
+			saw_dot = true;
+		} else if (!saw_dot) {
+			filename[i] = c;
+		}
+		i++;
+	}
+	*entries = cP;
+}
+
+
+// Make sure there is room for num_entries names, cleared for a catalog loaded a page at
+// a time.  Storage is kept for the next list of the same or smaller size.
+static bool _alloc_catalog_names(catalog_view_t* vP, int num_entries)
+{
+	if (num_entries > vP->names_len) {
+		_free_catalog_names(vP);
+		vP->names = (char*) malloc(num_entries * GUI_FILE_NAME_LEN);
+		if (vP->names == NULL) return false;
+		vP->names_len = num_entries;
+	}
+	
+	if (vP->names != NULL) {
+		memset(vP->names, 0, vP->names_len * GUI_FILE_NAME_LEN);
+	}
+	
+	return true;
+}
+
+
+static void _free_catalog_names(catalog_view_t* vP)
+{
+	if (vP->names != NULL) {
+		free(vP->names);
+		vP->names = NULL;
+	}
+	vP->names_len = 0;
+	vP->num_entries = 0;
+	vP->first_row = 0;
+}
+
+
+// Scrollable part of a list page signal handler that moves the table to the rows in view
+// whenever the list is scrolled
+static lv_res_t _scrl_signal(lv_obj_t* scrl, lv_signal_t sign, void* param)
+{
+	lv_res_t res;
+	
+	res = scrl_ancestor_signal(scrl, sign, param);
+	if (res != LV_RES_OK) return res;
+	
+	if ((sign == LV_SIGNAL_COORD_CHG) && !updating_window) {
+		updating_window = true;
+		_update_table_window(scrl == lv_page_get_scrollable(page_tbl_file_scroll));
+		updating_window = false;
+	}
+	
+	return res;
+}
+
+
+// Move a list's table so its first row is a row above the top of the page and load the
+// names that are now in view
+static void _update_table_window(bool updating_file_list)
+{
+	catalog_view_t* vP = updating_file_list ? &file_view : &dir_view;
+	lv_obj_t* page = updating_file_list ? page_tbl_file_scroll : page_tbl_dir_scroll;
+	lv_obj_t* tbl = updating_file_list ? tbl_file_browse : tbl_dir_browse;
+	int first, rows;
+	
+	if ((tbl == NULL) || (row_h == 0)) return;
+	
+	rows = (int) lv_table_get_row_cnt(tbl);
+	first = (-lv_obj_get_y(lv_page_get_scrollable(page))) / row_h - 1;
+	if (first > (vP->num_entries - rows)) first = vP->num_entries - rows;
+	if (first < 0) first = 0;
+	
+	if (first != vP->first_row) {
+		vP->first_row = first;
+		lv_obj_set_y(tbl, first * row_h);
+		_refresh_table(tbl, vP, updating_file_list ? prev_tbl_file_row : prev_tbl_dir_row);
+	}
+}
+
+
+// Load the table rows with the names starting at the list's first_row, highlighting the
+// selected_row if it is in view
+static void _refresh_table(lv_obj_t* tbl, catalog_view_t* vP, int selected_row)
+{
+	int n;
+	uint16_t r;
+	
+	if ((tbl == NULL) || (vP->names == NULL)) return;
+	
+	for (r=0; r<lv_table_get_row_cnt(tbl); r++) {
+		n = vP->first_row + (int) r;
+		lv_table_set_cell_value(tbl, r, 0, &vP->names[n * GUI_FILE_NAME_LEN]);
+		lv_table_set_cell_type(tbl, r, 0, (n == selected_row) ? 2 : 1);
+	}
+}
+
+
+// Set the cell type of catalog entry row if it is in view
+static void _set_row_type(lv_obj_t* tbl, catalog_view_t* vP, int row, uint8_t type)
+{
+	int r = row - vP->first_row;
+	
+	if ((tbl != NULL) && (r >= 0) && (r < (int) lv_table_get_row_cnt(tbl))) {
+		lv_table_set_cell_type(tbl, (uint16_t) r, 0, type);
+	}
+}
+
+
+// Handle special cases once a catalog table has been created
+static void _catalog_loaded(bool updating_file_list, lv_obj_t* tbl)
+{
+	if (updating_file_list) {
+		if (load_first_file || load_last_file) {
+			if (load_first_file) {
+				load_first_file = false;
+				_update_selected_file_indication(0);
+			} else {
+				load_last_file = false;
+				_update_selected_file_indication((uint16_t) (num_files-1));
+				
+				// Scroll to the end of the list
+				lv_page_scroll_ver(page_tbl_file_scroll, -lv_obj_get_height(lv_page_get_scrollable(page_tbl_file_scroll)));
+			}
+			_request_image(selected_dir, selected_file);
+			_update_image_panel_controls();
+		}
+	}
+	if (scroll_middle_entry) {
+		scroll_middle_entry = false;
+		_scroll_table_to_index(tbl, middle_entry_row);
+	}
+}
+
+
 static void _request_dir_list()
 {
+#ifdef ESP_PLATFORM
 	(void) cmd_send_int32(CMD_GET, CMD_FILE_CATALOG, -1);
+#else
+	_request_catalog_page(-1, 0);
+#endif
 	num_dirs = 0;
 	selected_dir = -1;
 	prev_tbl_dir_row = -1;
@@ -659,16 +950,66 @@ static void _request_dir_list()
 
 static void _request_file_list(int file_index)
 {
+#ifdef ESP_PLATFORM
 	(void) cmd_send_int32(CMD_GET, CMD_FILE_CATALOG, (int32_t) file_index);
+#else
+	_request_catalog_page(file_index, 0);
+#endif
 	num_files = 0;
 	selected_file = -1;
 	prev_tbl_file_row = -1;
 }
 
 
+// The web GUI loads catalogs a page at a time so large catalogs can be displayed without
+// waiting for the whole list
+static void _request_catalog_page(int type, int offset)
+{
+	page_type = type;
+	page_next_offset = offset;
+	(void) cmd_send_catalog_page_request(CMD_GET, CMD_FILE_CATALOG_PAGE, type, offset, GUIPN_FILE_BROWSER_FILES_PAGE_LEN);
+}
+
+
+// Request the small thumbnail first so something is displayed right away.  The full image
+// is requested after the thumbnail has been displayed.
 static void _request_image(int dir_index, int file_index)
 {
-	(void) cmd_send_file_indicies(CMD_GET, CMD_FILE_GET_IMAGE, dir_index, file_index);
+	image_req_dir = dir_index;
+	image_req_file = file_index;
+	
+	// Cancel the full image request for a previous selection
+	if (task_image_req != NULL) {
+		lv_task_del(task_image_req);
+		task_image_req = NULL;
+	}
+	
+#ifdef ESP_PLATFORM
+	(void) cmd_send_file_indicies(CMD_GET, CMD_FILE_GET_THUMB, dir_index, file_index);
+#else
+	// Images already seen in this browser come from its cache
+	web_file_cache_request(CMD_FILE_GET_THUMB, dir_index, file_index);
+#endif
+}
+
+
+static void _task_eval_image_req_timer(lv_task_t* task)
+{
+	lv_task_del(task_image_req);
+	task_image_req = NULL;
+	
+	if ((image_req_dir != selected_dir) || (image_req_file != selected_file)) {
+		// Selection changed while the thumbnail was loading
+		return;
+	}
+	
+#ifdef ESP_PLATFORM
+	(void) cmd_send_file_indicies(CMD_GET, CMD_FILE_GET_IMAGE, image_req_dir, image_req_file);
+#else
+	// Get the stored jpeg file and decode it here instead of having the camera send the
+	// much larger decoded image
+	web_file_cache_request(CMD_FILE_GET_JPEG, image_req_dir, image_req_file);
+#endif
 }
 
 
@@ -689,18 +1030,10 @@ static void _scroll_table(lv_obj_t* tbl, int dir)
 	int16_t n;
 	
 	if (tbl == tbl_dir_browse) {
-		if (num_dirs <= 1) {
-			n = 0;
-		} else {
-			n = (lv_obj_get_height(tbl_dir_browse) - 29) / num_dirs;
-		}
+		n = (num_dirs <= 1) ? 0 : row_h;
 		lv_page_scroll_ver(page_tbl_dir_scroll, (dir == SCROLL_UP) ? -n : n);
 	} else if (tbl == tbl_file_browse) {
-		if (num_files <= 1) {
-			n = 0;
-		} else {
-			n = (lv_obj_get_height(tbl_file_browse) - 29) / num_files;
-		}
+		n = (num_files <= 1) ? 0 : row_h;
 		lv_page_scroll_ver(page_tbl_file_scroll, (dir == SCROLL_UP) ? -n : n);
 	}
 }
@@ -710,11 +1043,10 @@ static void _scroll_table_to_index(lv_obj_t* tbl, int index)
 {
 	int16_t n;
 	
+	n = row_h * index;
 	if (tbl == tbl_dir_browse) {
-		n = ((lv_obj_get_height(tbl_dir_browse) - 29) / num_dirs) * index;
 		lv_page_scroll_ver(page_tbl_dir_scroll, -n);
 	} else {
-		n = ((lv_obj_get_height(tbl_file_browse) - 29) / num_files) * index;
 		lv_page_scroll_ver(page_tbl_file_scroll, -n);
 	}
 }
@@ -724,11 +1056,11 @@ static void _update_selected_dir_indication(uint16_t row)
 {
 	// De-highlight any previously selected cell
 	if (prev_tbl_dir_row != -1) {
-		lv_table_set_cell_type(tbl_dir_browse, (uint16_t) prev_tbl_dir_row, 0, 1);
+		_set_row_type(tbl_dir_browse, &dir_view, prev_tbl_dir_row, 1);
 	}
 	
 	// Highlight the selected cell
-	lv_table_set_cell_type(tbl_dir_browse, row, 0, 2);
+	_set_row_type(tbl_dir_browse, &dir_view, (int) row, 2);
 	prev_tbl_dir_row = row;
 		
 	// Note user has selected a directory
@@ -740,11 +1072,11 @@ static void _update_selected_file_indication(uint16_t row)
 {
 	// De-highlight any previously selected cell
 	if (prev_tbl_file_row != -1) {
-		lv_table_set_cell_type(tbl_file_browse, (uint16_t) prev_tbl_file_row, 0, 1);
+		_set_row_type(tbl_file_browse, &file_view, prev_tbl_file_row, 1);
 	}
 	
 	// Highlight the selected cell
-	lv_table_set_cell_type(tbl_file_browse, row, 0, 2);
+	_set_row_type(tbl_file_browse, &file_view, (int) row, 2);
 	prev_tbl_file_row = row;
 	
 	// Note user has selected a file
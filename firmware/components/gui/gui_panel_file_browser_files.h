@@ -37,6 +37,13 @@
 // SD Card present poll rate
 #define GUIPN_FILE_BROWSER_FILES_POLL_MSEC 500
 
+// Catalog entries requested at a time by the web GUI (up to CMD_FILE_CATALOG_PAGE_MAX)
+#define GUIPN_FILE_BROWSER_FILES_PAGE_LEN  32
+
+// Delay after a thumbnail is displayed before requesting the full image so stepping
+// quickly through files only loads thumbnails
+#define GUIPN_FILE_BROWSER_FILES_IMAGE_MSEC 250
+
 
 // LVGL Objects
 
@@ -53,6 +60,10 @@
 #define GUIPN_FILE_BROWSER_FILES_PAD_B 10
 #define GUIPN_FILE_BROWSER_FILES_PAD_I 26
 
+// Table rows created for a list: enough to cover the tallest list plus a partially visible
+// row at each end.  They are reused for the rows in view as the list is scrolled.
+#define GUIPN_FILE_BROWSER_FILES_TBL_ROWS 16
+
 
 
 //
@@ -69,6 +80,8 @@ void gui_panel_file_browser_files_set_active(bool is_active);
 
 // From command handlers
 void gui_panel_file_browser_files_set_catalog(int type, int num_entries, char* entries);
+void gui_panel_file_browser_files_set_catalog_page(int type, int total, int offset, int num_entries, char* entries[]);
+void gui_panel_file_browser_files_thumb_loaded();
 
 // From our companion image panel
 void gui_panel_file_browser_files_action(int action);
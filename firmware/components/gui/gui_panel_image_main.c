@@ -21,6 +21,7 @@
 
 #include "cmd_list.h"
 #include "cmd_utilities.h"
+#include "gui_page_image.h"
 #include "gui_panel_image_main.h"
 #include "gui_render.h"
 #include "gui_state.h"
@@ -32,13 +33,16 @@
 	#include "esp_heap_caps.h"
 	#include "freertos/FreeRTOS.h"
 	#include "freertos/task.h"
+	#include "disp_driver.h"
 	#include "gui_task.h"
+	#include "bench_utilities.h"
+	#include "perf_utilities.h"
 #else
 	#include "gui_main.h"
 	#include <stdio.h>
-	#include <stdlib.h>
 #endif
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -72,6 +76,16 @@ static int region_sel_state = REGION_SEL_IDLE;
 static uint16_t region_start_x, region_start_y;
 static uint16_t region_end_x, region_end_y;
 
+// Zoom panning
+static bool zoom_panning;
+static bool zoom_press_used;
+static int16_t pan_last_x, pan_last_y;
+
+// Spotmeter location being dragged.  It is sent at most once per displayed image so a
+// drag doesn't flood the camera with commands.
+static bool spot_loc_pending = false;
+static uint16_t spot_loc_x, spot_loc_y;
+
 //
 // LVGL Objects
 //
@@ -86,7 +100,6 @@ static lv_obj_t* lbl_region_temp;
 
 // Palette bar
 static lv_obj_t* canvas_colormap;
-static lv_draw_line_dsc_t canvas_line_dsc;
 static lv_obj_t* lbl_max_temp;
 static lv_obj_t* lbl_min_temp;
 static lv_obj_t* line_temp_marker;
@@ -99,6 +112,24 @@ static lv_obj_t* lbl_message;
 // Image area
 static lv_obj_t* canvas_image;
 
+// Histogram and line profile - bottom of image area
+static lv_obj_t* cont_stats;
+static lv_obj_t* chart_hist;
+static lv_obj_t* chart_profile;
+static lv_obj_t* lbl_profile_temps;
+static lv_chart_series_t* ser_hist;
+static lv_chart_series_t* ser_profile;
+static lv_coord_t hist_points[GUI_IMG_STATS_HIST_BINS];
+static lv_coord_t profile_points[GUI_IMG_STATS_PROFILE_MAX];
+static uint16_t stats_profile_len = 0;
+static uint32_t stats_upd_tick;
+
+#ifndef ESP_PLATFORM
+// Stream info - bottom of image area
+static lv_obj_t* lbl_stream_info;
+static char stream_info_buf[32];
+#endif
+
 // Timer tasks
 static lv_task_t* task_batt_timer;          // Interval between update battery state requests
 static lv_task_t* task_timelapse_timer;     // Interval between alternating battery and timelapse labels
@@ -107,8 +138,18 @@ static lv_task_t* task_pmessage_timer;      // Countdown timer for display of pa
 static lv_task_t* task_palette_upd_timer;   // Countdown timer after palette change for NVS update
 static lv_task_t* task_region_sel_timer;    // Countdown timer to end region select with no selection
 
-// Canvas image buffers
+// State the canvas was last rendered from (without the image data pointers or frame
+// timing) so an unchanged image doesn't have to be rendered again
+static bool last_render_valid = false;
+static gui_img_buf_t last_render_buf;
+static gui_state_t last_render_state;
+
+// Canvas image buffers.  On the ESP32 the image is double buffered: img_canvas_buffer is
+// the one the canvas shows and each new image is rendered into the other while the shown
+// one may still be being pushed to the LCD.
 #ifdef ESP_PLATFORM
+	static uint16_t* img_canvas_buffers[2];
+	static int img_canvas_index = 0;
 	static uint16_t* img_canvas_buffer;
 	static uint16_t* cmap_canvas_buffer;
 #else
@@ -116,6 +157,21 @@ static lv_task_t* task_region_sel_timer;    // Countdown timer to end region sel
 	static uint32_t* cmap_canvas_buffer;
 #endif
 
+// The region selection drag marker is drawn over a cached copy of the rendered image so it
+// can follow a drag between images by restoring and redrawing only its outline.
+// drag_marker_area is the outer box (image coordinates) of the marker in the canvas.
+static GUI_REND_IMG_T* drag_cache_buffer = NULL;
+static bool drag_cache_valid = false;
+static bool drag_marker_drawn = false;
+static lv_area_t drag_marker_area;
+#ifdef ESP_PLATFORM
+// Set when the drag marker has moved for gui_task to update
+static bool drag_marker_pending = false;
+
+// A side of the marker gathered to be pushed to the display
+static GUI_REND_IMG_T drag_edge_buffer[2*GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W];
+#endif
+
 //
 // Externally accessible image structure
 //
@@ -134,12 +190,27 @@ static void _update_spot_temp(gui_img_buf_t* img_bufP);
 static void _update_min_max_temps(gui_img_buf_t* img_bufP);
 static void _update_region_temps(gui_img_buf_t* img_bufP);
 static void _update_palette_marker(gui_img_buf_t* img_bufP);
+static void _update_img_stats(gui_img_buf_t* img_bufP);
+static void _configure_stats_chart(lv_obj_t* chart);
 static void _update_message_string(char* msg);
+static void _update_canvas_image();
+static void _update_canvas_area(const lv_area_t* area);
+#ifdef ESP_PLATFORM
+static void _show_canvas_buffer();
+static bool _push_canvas_area(const lv_area_t* scr_area, const lv_color_t* src, bool async);
+#endif
+static void _start_drag_marker();
+static void _draw_drag_marker();
+static void _update_drag_marker();
+static int _get_drag_marker_edges(const lv_area_t* box, lv_area_t* edges);
+static bool _render_unchanged();
 
 static void _cb_change_palette(lv_obj_t* obj, lv_event_t event);
 static void _cb_canvas_event(lv_obj_t* obj, lv_event_t event);
 
+#ifdef ESP_PLATFORM
 static void _task_eval_batt_timer(lv_task_t* task);
+#endif
 static void _task_eval_timelapse_timer(lv_task_t* task);
 static void _task_eval_message_timer(lv_task_t* task);
 static void _task_eval_pmessage_timer(lv_task_t* task);
@@ -147,6 +218,8 @@ static void _task_eval_palette_upd_timer(lv_task_t* task);
 static void _task_eval_region_sel_timer(lv_task_t* task);
 
 static void _region_drag_coord_to_xy(uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2);
+static void _set_spot_location(uint16_t x, uint16_t y);
+static void _send_spot_location();
 
 
 //
@@ -208,12 +281,15 @@ lv_obj_t* gui_panel_image_init(lv_obj_t* page)
 	
 	// Allocate memory for the image
 #ifdef ESP_PLATFORM
-	img_canvas_buffer = (uint16_t*) heap_caps_calloc(2*GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W*GUI_RAW_IMG_W, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
-	if (img_canvas_buffer == NULL) {
-		ESP_LOGE(TAG, "Could not allocate img_canvas_buffer");
-		// Try to do anything else? Display a popup ???
-		vTaskDelete(NULL);
+	for (int i=0; i<2; i++) {
+		img_canvas_buffers[i] = (uint16_t*) heap_caps_calloc(2*GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W*GUI_RAW_IMG_W, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+		if (img_canvas_buffers[i] == NULL) {
+			ESP_LOGE(TAG, "Could not allocate img_canvas_buffer");
+			// Try to do anything else? Display a popup ???
+			vTaskDelete(NULL);
+		}
 	}
+	img_canvas_buffer = img_canvas_buffers[img_canvas_index];
 #else
 	img_canvas_buffer = (uint32_t*) calloc(2*GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W*GUI_RAW_IMG_W, sizeof(uint32_t));
 	if (img_canvas_buffer == NULL) {
@@ -270,10 +346,6 @@ lv_obj_t* gui_panel_image_init(lv_obj_t* page)
 		
 	// Palette bar - Left
 	//
-	// Line width for drawing colormap (palette)
-	lv_draw_line_dsc_init(&canvas_line_dsc);
-	canvas_line_dsc.width = 1;
-	
 	// Colormap canvas
 	canvas_colormap = lv_canvas_create(my_panel, NULL);
 	lv_canvas_set_buffer(canvas_colormap, cmap_canvas_buffer, GUIPN_IMAGE_PAL_W, GUIPN_IMAGE_PAL_H, LV_IMG_CF_TRUE_COLOR);
@@ -330,6 +402,46 @@ lv_obj_t* gui_panel_image_init(lv_obj_t* page)
 	lv_label_set_align(lbl_message, LV_LABEL_ALIGN_CENTER);
 	lv_obj_set_x(lbl_message, GUIPN_IMAGE_MSG_OFFSET_X);
 	_update_message_string("");
+	
+	// Histogram and line profile - bottom of image (size depends on image size so computed later)
+	cont_stats = lv_cont_create(my_panel, NULL);
+	lv_cont_set_fit(cont_stats, LV_FIT_NONE);
+	lv_obj_set_click(cont_stats, false);
+	lv_obj_set_style_local_bg_color(cont_stats, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUI_THEME_BG_COLOR);
+	lv_obj_set_style_local_bg_opa(cont_stats, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_70);
+	lv_obj_set_style_local_border_width(cont_stats, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
+	lv_obj_set_style_local_radius(cont_stats, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
+	
+	chart_hist = lv_chart_create(cont_stats, NULL);
+	lv_chart_set_type(chart_hist, LV_CHART_TYPE_COLUMN);
+	lv_chart_set_point_count(chart_hist, GUI_IMG_STATS_HIST_BINS);
+	ser_hist = lv_chart_add_series(chart_hist, LV_THEME_DEFAULT_COLOR_PRIMARY);
+	
+	chart_profile = lv_chart_create(cont_stats, NULL);
+	lv_chart_set_type(chart_profile, LV_CHART_TYPE_LINE);
+	lv_chart_set_point_count(chart_profile, GUI_IMG_STATS_PROFILE_MAX);
+	ser_profile = lv_chart_add_series(chart_profile, LV_THEME_DEFAULT_COLOR_PRIMARY);
+	
+	_configure_stats_chart(chart_hist);
+	_configure_stats_chart(chart_profile);
+	
+	// Line temperatures over the profile
+	lbl_profile_temps = lv_label_create(cont_stats, NULL);
+	lv_obj_set_style_local_text_font(lbl_profile_temps, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_THEME_DEFAULT_FONT_SMALL);
+	lv_label_set_long_mode(lbl_profile_temps, LV_LABEL_LONG_CROP);
+	lv_obj_set_width(lbl_profile_temps, GUIPN_IMAGE_STATS_LBL_W);
+	lv_label_set_static_text(lbl_profile_temps, "");
+	lv_obj_set_hidden(cont_stats, true);
+	
+#ifndef ESP_PLATFORM
+	// Stream info - bottom left of image (position depends on image size so computed later)
+	lbl_stream_info = lv_label_create(my_panel, NULL);
+	lv_obj_set_style_local_text_font(lbl_stream_info, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_THEME_DEFAULT_FONT_SMALL);
+	lv_obj_set_style_local_bg_color(lbl_stream_info, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, GUI_THEME_BG_COLOR);
+	lv_obj_set_style_local_bg_opa(lbl_stream_info, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_COVER);
+	lv_label_set_static_text(lbl_stream_info, "");
+	lv_obj_set_hidden(lbl_stream_info, true);
+#endif
 
 	// Setup dimensions of objects we computed in gui_panel_image_calculate_size()
 	_configure_sizes();
@@ -351,10 +463,13 @@ void gui_panel_image_set_active(bool is_active)
 		// Initialize display elements
 		_update_colormap();
 		
-		// Start the battery status update timer (the first time it immediately times out)
+#ifdef ESP_PLATFORM
+		// Start the battery status update timer (the first time it immediately times out).
+		// The camera pushes changes to the web GUI instead (see CMD_SUBSCRIBE).
 		if (task_batt_timer == NULL) {
 			task_batt_timer = lv_task_create(_task_eval_batt_timer, 500, LV_TASK_PRIO_LOW, NULL);
 		}
+#endif
 		
 		// Start the timelapse indicate timer if necessary
 		if (gui_state.timelapse_running) {
@@ -363,6 +478,11 @@ void gui_panel_image_set_active(bool is_active)
 			}
 		}
 	} else {
+#ifndef ESP_PLATFORM
+		// Stop any GPU rendering of the image
+		gui_render_gpu_hide();
+#endif
+		
 		// Stop the battery status update timer
 		if (task_batt_timer != NULL) {
 			lv_task_del(task_batt_timer);
@@ -400,21 +520,59 @@ void gui_panel_image_set_batt_percent(int percent)
 void gui_panel_image_render_image()
 {
 	static bool halt_updates = false;
+#ifdef ESP_PLATFORM
+	int64_t stage_usec = perf_start();
+#endif
+	
+	// Send the latest location of a spotmeter being dragged
+	_send_spot_location();
 	
 	if (gui_panel_image_buf.vid_frozen) {
 		// Just render the video frozen marker over whatever image we're currently displaying
 		if (!halt_updates) {
-		
+#ifdef ESP_PLATFORM
+			// The marker is drawn into the shown buffer
+			disp_driver_push_wait();
+#endif
 			gui_render_freeze_marker(img_canvas_buffer);
 			lv_obj_invalidate(canvas_image);
+			last_render_valid = false;
+			drag_cache_valid = false;
 		}
 		halt_updates = true;
+	} else if (_render_unchanged()) {
+		// The canvas already holds exactly what would be rendered
+		halt_updates = false;
 	} else {
 		
 		halt_updates = false;
 		
+#ifdef ESP_PLATFORM
+		// Render into the buffer not being shown.  Its push finished before the shown one's
+		// was started.
+		img_canvas_index ^= 1;
+		img_canvas_buffer = img_canvas_buffers[img_canvas_index];
+#endif
+		
 		// Render the image into the frame buffer
+#ifndef ESP_PLATFORM
+		lv_area_t img_area;
+		
+		lv_obj_get_coords(canvas_image, &img_area);
+		gui_render_set_screen_pos(img_area.x1, img_area.y1);
+#endif
+		// Runtime computed palettes may depend on the image's AGC range
+		if (update_palette_range(gui_panel_image_buf.agc_min, gui_panel_image_buf.agc_max, gui_panel_image_buf.y16_is_temp)) {
+			_update_colormap();
+		}
 		gui_render_image_data(&gui_panel_image_buf, img_canvas_buffer, &gui_state);
+		
+#ifdef ESP_PLATFORM
+		// Highlight changed pixels if change detection is running
+		if (gui_panel_image_buf.chg_mask != NULL) {
+			gui_render_change_overlay(&gui_panel_image_buf, img_canvas_buffer);
+		}
+#endif
 				
 		// Render the spot meter if enabled
 		if (gui_state.spotmeter_enable && gui_panel_image_buf.spot_valid) {
@@ -426,20 +584,26 @@ void gui_panel_image_render_image()
 			gui_render_min_max_markers(&gui_panel_image_buf, img_canvas_buffer);
 		}
 		
-		// Render the region marker if enabled or we dragging to select the region
-		if (region_sel_state == REGION_SEL_WAIT_RELEASE) {
-			// Draw drag marker (re-using gui_panel_image_buf state)
-			_region_drag_coord_to_xy(&gui_panel_image_buf.region_x1, &gui_panel_image_buf.region_y1, 
-			                         &gui_panel_image_buf.region_x2, &gui_panel_image_buf.region_y2);
-			gui_render_region_drag_marker(&gui_panel_image_buf, img_canvas_buffer);
-			
-		} else if (gui_state.region_enable && gui_panel_image_buf.region_valid) {
-			// Draw region marker
+		// Render the region marker if enabled (the drag marker is drawn last when we're
+		// dragging to select the region)
+		if ((region_sel_state != REGION_SEL_WAIT_RELEASE) && gui_state.region_enable && gui_panel_image_buf.region_valid) {
 			gui_render_region_marker(&gui_panel_image_buf, img_canvas_buffer);
 		}
 		
-		// Finally invalidate the object to force it to redraw from the buffer
-		lv_obj_invalidate(canvas_image);
+		// Render any ROI table entries
+		gui_render_roi_markers(&gui_panel_image_buf, img_canvas_buffer);
+		
+		// Cache the image under the drag marker and draw it
+		if (region_sel_state == REGION_SEL_WAIT_RELEASE) {
+			_start_drag_marker();
+			_draw_drag_marker();
+		}
+		
+		// Finally get the image to the display
+		_update_canvas_image();
+#ifdef ESP_PLATFORM
+		perf_end(PERF_STAGE_RENDER, stage_usec);
+#endif
 		
 		// Update temps
 		_update_env_info(&gui_panel_image_buf);
@@ -447,6 +611,7 @@ void gui_panel_image_render_image()
 		_update_min_max_temps(&gui_panel_image_buf);
 		_update_region_temps(&gui_panel_image_buf);
 		_update_palette_marker(&gui_panel_image_buf);
+		_update_img_stats(&gui_panel_image_buf);
 	}
 }
 
@@ -503,6 +668,29 @@ void gui_panel_image_set_timelapse(bool en)
 }
 
 
+#ifndef ESP_PLATFORM
+// Display the measured latency (from image acquisition on the camera to display here) in
+// mSec and the display frame rate in units of fps x 10.  A latency < 0 is unknown.  Hidden
+// when no images are being displayed.
+void gui_panel_image_set_stream_info(int latency_msec, int fps10)
+{
+	if (fps10 == 0) {
+		lv_obj_set_hidden(lbl_stream_info, true);
+		return;
+	}
+	
+	if (latency_msec < 0) {
+		sprintf(stream_info_buf, " -- mS  %d.%d fps ", fps10 / 10, fps10 % 10);
+	} else {
+		sprintf(stream_info_buf, " %d mS  %d.%d fps ", latency_msec, fps10 / 10, fps10 % 10);
+	}
+	lv_label_set_static_text(lbl_stream_info, stream_info_buf);
+	lv_obj_set_hidden(lbl_stream_info, false);
+	lv_obj_align(lbl_stream_info, canvas_image, LV_ALIGN_IN_BOTTOM_LEFT, 0, 0);
+}
+#endif
+
+
 void gui_panel_image_update_palette()
 {
 	_update_colormap();
@@ -534,12 +722,56 @@ bool gui_panel_image_region_selection_in_progress()
 }
 
 
+#ifdef ESP_PLATFORM
+/**
+ * Time the renderer at each magnification for the benchmark by rendering the current
+ * image into the canvas buffer (which is sized for the largest).  The configured
+ * magnification is restored and the next image redraws the canvas.
+ */
+void gui_panel_image_benchmark_render()
+{
+	int i, mag;
+	int64_t start_usec;
+	
+	disp_driver_push_wait();
+	for (mag=GUI_MAGNIFICATION_0_5; mag<=GUI_MAGNIFICATION_2_0; mag++) {
+		gui_render_set_configuration(is_portrait ? GUI_RENDER_PORTRAIT : GUI_RENDER_LANDSCAPE, mag);
+		for (i=0; i<BENCH_ITERATIONS; i++) {
+			start_usec = bench_begin();
+			gui_render_image_data(&gui_panel_image_buf, img_canvas_buffer, &gui_state);
+			bench_end(BENCH_ITEM_RENDER_0_5 + (mag - GUI_MAGNIFICATION_0_5), start_usec);
+		}
+	}
+	gui_render_set_configuration(is_portrait ? GUI_RENDER_PORTRAIT : GUI_RENDER_LANDSCAPE, mag_level);
+	last_render_valid = false;
+	drag_cache_valid = false;
+}
+
+
+// Move the drag marker if it has changed since the last image.  The canvas is pushed
+// directly to the display so this can't be done from the LVGL event handler.
+void gui_panel_image_eval_drag_marker()
+{
+	if (drag_marker_pending) {
+		drag_marker_pending = false;
+		if (region_sel_state == REGION_SEL_WAIT_RELEASE) {
+			_update_drag_marker();
+		}
+	}
+}
+#endif
+
+
 
 //
 // Internal functions
 //
 static void _configure_sizes()
 {
+	// The canvas has to be redrawn at the new size
+	last_render_valid = false;
+	drag_cache_valid = false;
+	
 	// Configure the size of the panel
 	lv_obj_set_size(my_panel, img_w + GUIPN_IMAGE_PAL_BAR_W, img_h + GUIPN_IMAGE_STATUS_H);
 	
@@ -555,6 +787,20 @@ static void _configure_sizes()
 	// Conifigure the width of the message bar text
 	lv_obj_set_width(lbl_message, img_w);
 	
+	// Configure the histogram and profile charts, side by side across the bottom of the image
+	lv_obj_set_size(cont_stats, img_w, GUIPN_IMAGE_STATS_H);
+	lv_obj_set_pos(cont_stats, GUIPN_IMAGE_IMG_X_OFFSET, GUIPN_IMAGE_IMG_Y_OFFSET + img_h - GUIPN_IMAGE_STATS_H);
+	lv_obj_set_size(chart_hist, img_w/2 - 2*GUIPN_IMAGE_STATS_PAD, GUIPN_IMAGE_STATS_H - 2*GUIPN_IMAGE_STATS_PAD);
+	lv_obj_set_pos(chart_hist, GUIPN_IMAGE_STATS_PAD, GUIPN_IMAGE_STATS_PAD);
+	lv_obj_set_size(chart_profile, img_w/2 - 2*GUIPN_IMAGE_STATS_PAD, GUIPN_IMAGE_STATS_H - 2*GUIPN_IMAGE_STATS_PAD);
+	lv_obj_set_pos(chart_profile, img_w/2 + GUIPN_IMAGE_STATS_PAD, GUIPN_IMAGE_STATS_PAD);
+	lv_obj_set_pos(lbl_profile_temps, img_w/2 + GUIPN_IMAGE_STATS_PAD, GUIPN_IMAGE_STATS_PAD);
+	
+#ifndef ESP_PLATFORM
+	// Configure the stream info position
+	lv_obj_align(lbl_stream_info, canvas_image, LV_ALIGN_IN_BOTTOM_LEFT, 0, 0);
+#endif
+	
 	// Configure the rendering engine
 	gui_render_set_configuration(is_portrait ? GUI_RENDER_PORTRAIT : GUI_RENDER_LANDSCAPE, mag_level);
 }
@@ -562,19 +808,28 @@ static void _configure_sizes()
 
 static void _update_colormap()
 {
-	int i;
-	lv_point_t points[2];
+	int i, j;
+#ifdef ESP_PLATFORM
+	uint16_t* cmapP = cmap_canvas_buffer;
+	uint16_t c;
+#else
+	uint32_t* cmapP = cmap_canvas_buffer;
+	uint32_t c;
+#endif
 	
-	points[0].x = GUIPN_IMAGE_PAL_X_OFFSET;
-	points[1].x = GUIPN_IMAGE_PAL_X_OFFSET + GUIPN_IMAGE_PAL_W;
+	// The image has to be redrawn with the new colors
+	last_render_valid = false;
 	
-	// Draw color map top -> bottom / hot -> cold
-	for (i=0; i<256; i++) {
-		points[0].y = i;
-		points[1].y = points[0].y;
-		canvas_line_dsc.color = (lv_color_t) PALETTE_LOOKUP(255-i);
-		lv_canvas_draw_line(canvas_colormap, points, 2, &canvas_line_dsc);
+	// Fill the color map top -> bottom / hot -> cold directly in the canvas buffer (the
+	// lookup tables are already in the canvas color format) and redraw it once instead of
+	// drawing 256 lines through the canvas
+	for (i=0; i<GUIPN_IMAGE_PAL_H; i++) {
+		c = PALETTE_LOOKUP(255-i);
+		for (j=0; j<GUIPN_IMAGE_PAL_W; j++) {
+			*cmapP++ = c;
+		}
 	}
+	lv_obj_invalidate(canvas_colormap);
 }
 
 
@@ -738,6 +993,84 @@ static void _update_palette_marker(gui_img_buf_t* img_bufP)
 }
 
 
+// Display the histogram and the profile along ROI line 0 while there is one.  The charts are
+// only redrawn every GUIPN_IMAGE_STATS_UPD_MSEC since they don't have to keep up with the
+// image.
+static void _update_img_stats(gui_img_buf_t* img_bufP)
+{
+	static char buf[24] = { 0 };                 // "-xxx - -xxx °C" + null + safety
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	uint16_t range;
+	int i;
+	
+	if ((img_bufP->hist == NULL) || (img_bufP->profile == NULL)) {
+		if (!lv_obj_get_hidden(cont_stats)) {
+			lv_obj_set_hidden(cont_stats, true);
+		}
+		return;
+	}
+	
+	if (!lv_obj_get_hidden(cont_stats) && (lv_tick_elaps(stats_upd_tick) < GUIPN_IMAGE_STATS_UPD_MSEC)) {
+		return;
+	}
+	stats_upd_tick = lv_tick_get();
+	
+	// Histogram scaled to its largest bin
+	for (i=0; i<GUI_IMG_STATS_HIST_BINS; i++) {
+		if (img_bufP->hist[i] > max) max = img_bufP->hist[i];
+	}
+	for (i=0; i<GUI_IMG_STATS_HIST_BINS; i++) {
+		hist_points[i] = (max == 0) ? 0 : (lv_coord_t) (((uint32_t) img_bufP->hist[i] * GUIPN_IMAGE_STATS_RANGE) / max);
+	}
+	lv_chart_set_points(chart_hist, ser_hist, hist_points);
+	
+	// Profile scaled to its range (the point count only changes with the line)
+	if (img_bufP->profile_len != stats_profile_len) {
+		stats_profile_len = img_bufP->profile_len;
+		lv_chart_set_point_count(chart_profile, stats_profile_len);
+	}
+	max = 0;
+	for (i=0; i<stats_profile_len; i++) {
+		if (img_bufP->profile[i] < min) min = img_bufP->profile[i];
+		if (img_bufP->profile[i] > max) max = img_bufP->profile[i];
+	}
+	range = (max > min) ? (max - min) : 1;
+	for (i=0; i<stats_profile_len; i++) {
+		profile_points[i] = (lv_coord_t) (((uint32_t) (img_bufP->profile[i] - min) * GUIPN_IMAGE_STATS_RANGE) / range);
+	}
+	lv_chart_set_points(chart_profile, ser_profile, profile_points);
+	
+	// ROI line temperatures
+	if ((img_bufP->roi_line_valid_mask & 0x01) != 0) {
+		sprintf(buf, "%d - %d %s", (int) round(gui_t1c_to_disp_temp(img_bufP->roi_line[0].min_temp, &gui_state)),
+		        (int) round(gui_t1c_to_disp_temp(img_bufP->roi_line[0].max_temp, &gui_state)),
+		        gui_state.temp_unit_C ? "°C" : "°F");
+	} else {
+		buf[0] = 0;
+	}
+	lv_label_set_static_text(lbl_profile_temps, buf);
+	
+	if (lv_obj_get_hidden(cont_stats)) {
+		lv_obj_set_hidden(cont_stats, false);
+	}
+}
+
+
+static void _configure_stats_chart(lv_obj_t* chart)
+{
+	lv_chart_set_y_range(chart, LV_CHART_AXIS_PRIMARY_Y, 0, GUIPN_IMAGE_STATS_RANGE);
+	lv_chart_set_div_line_count(chart, 0, 0);
+	lv_obj_set_click(chart, false);
+	lv_obj_set_style_local_bg_opa(chart, LV_CHART_PART_BG, LV_STATE_DEFAULT, LV_OPA_TRANSP);
+	lv_obj_set_style_local_border_width(chart, LV_CHART_PART_BG, LV_STATE_DEFAULT, 0);
+	lv_obj_set_style_local_pad_all(chart, LV_CHART_PART_BG, LV_STATE_DEFAULT, 0);
+	lv_obj_set_style_local_size(chart, LV_CHART_PART_SERIES, LV_STATE_DEFAULT, 0);
+	lv_obj_set_style_local_line_width(chart, LV_CHART_PART_SERIES, LV_STATE_DEFAULT, 1);
+	lv_obj_set_style_local_pad_inner(chart, LV_CHART_PART_SERIES, LV_STATE_DEFAULT, 0);
+}
+
+
 static void _update_message_string(char* msg)
 {
 	lv_obj_set_hidden(lbl_message, strlen(msg) == 0);
@@ -745,6 +1078,258 @@ static void _update_message_string(char* msg)
 }
 
 
+// Display the updated canvas image.  On the ESP32 the image is written directly to the LCD
+// when nothing but our own widgets covers it and those widgets overlapping it are redrawn by
+// LVGL (this is much faster than LVGL rendering the whole canvas through its draw buffers).
+// Otherwise the canvas is invalidated so LVGL redraws it.
+static void _update_canvas_image()
+{
+#ifdef ESP_PLATFORM
+	lv_area_t img_area;
+	
+	lv_obj_get_coords(canvas_image, &img_area);
+	_show_canvas_buffer();
+	if (_push_canvas_area(&img_area, (lv_color_t*) img_canvas_buffer, true)) {
+		return;
+	}
+	
+	// The next image is rendered into the buffer an earlier push may still be reading
+	disp_driver_push_wait();
+#endif
+	
+	lv_obj_invalidate(canvas_image);
+}
+
+
+// Send an area (image coordinates) of the canvas to the display
+static void _update_canvas_area(const lv_area_t* area)
+{
+	lv_area_t scr_area;
+	
+	lv_obj_get_coords(canvas_image, &scr_area);
+	scr_area.x2 = scr_area.x1 + area->x2;
+	scr_area.y2 = scr_area.y1 + area->y2;
+	scr_area.x1 += area->x1;
+	scr_area.y1 += area->y1;
+	
+#ifdef ESP_PLATFORM
+	GUI_REND_IMG_T* dP = drag_edge_buffer;
+	int16_t w = lv_area_get_width(area);
+	
+	if ((lv_area_get_size(area) <= (sizeof(drag_edge_buffer) / sizeof(GUI_REND_IMG_T)))) {
+		for (int16_t y=area->y1; y<=area->y2; y++) {
+			memcpy(dP, img_canvas_buffer + y*img_w + area->x1, w*sizeof(GUI_REND_IMG_T));
+			dP += w;
+		}
+		if (_push_canvas_area(&scr_area, (lv_color_t*) drag_edge_buffer, false)) {
+			return;
+		}
+	}
+#endif
+	
+	lv_obj_invalidate_area(canvas_image, &scr_area);
+}
+
+
+#ifdef ESP_PLATFORM
+// Point the canvas at img_canvas_buffer without lv_canvas_set_buffer() (which invalidates
+// the whole canvas).  LVGL's image cache has to forget the old buffer.
+static void _show_canvas_buffer()
+{
+	lv_img_dsc_t* dsc = lv_canvas_get_img(canvas_image);
+	
+	if (dsc->data != (const uint8_t*) img_canvas_buffer) {
+		dsc->data = (const uint8_t*) img_canvas_buffer;
+		lv_img_cache_invalidate_src(dsc);
+	}
+}
+
+
+// Write src directly to scr_area of the display, bypassing LVGL, if the canvas is visible.
+// An async push returns while src is still being read (see disp_driver_push_wait()).
+// Returns false if LVGL should draw it instead.
+static bool _push_canvas_area(const lv_area_t* scr_area, const lv_color_t* src, bool async)
+{
+	lv_area_t obj_area;
+	lv_area_t tmp_area;
+	lv_obj_t* obj;
+	
+	// Popups are drawn over the image
+	if (gui_popup_displayed()) return false;
+	
+	// Make sure we're on the screen
+	obj = canvas_image;
+	while ((obj != NULL) && !lv_obj_get_hidden(obj)) {
+		obj = lv_obj_get_parent(obj);
+	}
+	if (obj != NULL) return false;
+	
+	if (async) {
+		if (!disp_driver_push_area_async(scr_area, src)) return false;
+	} else {
+		if (!disp_driver_push_area(scr_area, src)) return false;
+	}
+	
+	// Redraw any of our widgets that are on top of the area
+	obj = lv_obj_get_child(my_panel, NULL);
+	while (obj != NULL) {
+		if ((obj != canvas_image) && !lv_obj_get_hidden(obj)) {
+			lv_obj_get_coords(obj, &obj_area);
+			if (_lv_area_intersect(&tmp_area, scr_area, &obj_area)) {
+				lv_obj_invalidate(obj);
+			}
+		}
+		obj = lv_obj_get_child(my_panel, obj);
+	}
+	
+	return true;
+}
+#endif
+
+
+// Cache the canvas contents (the rendered image without the drag marker) for the drag
+// marker to be drawn over.  The cache is allocated the first time a region is selected.
+// The drag marker only moves with new images if it can't be allocated.
+static void _start_drag_marker()
+{
+	drag_marker_drawn = false;
+	drag_cache_valid = false;
+#ifdef ESP_PLATFORM
+	drag_marker_pending = false;
+#endif
+	
+	if (drag_cache_buffer == NULL) {
+#ifdef ESP_PLATFORM
+		drag_cache_buffer = (GUI_REND_IMG_T*) heap_caps_malloc(2*GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W*GUI_RAW_IMG_W*sizeof(GUI_REND_IMG_T), MALLOC_CAP_SPIRAM);
+#else
+		drag_cache_buffer = (GUI_REND_IMG_T*) malloc(2*GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W*GUI_RAW_IMG_W*sizeof(GUI_REND_IMG_T));
+#endif
+		if (drag_cache_buffer == NULL) return;
+	}
+	
+	memcpy(drag_cache_buffer, img_canvas_buffer, img_w*img_h*sizeof(GUI_REND_IMG_T));
+	drag_cache_valid = true;
+}
+
+
+// Draw the drag marker into the canvas at the current drag position (re-using
+// gui_panel_image_buf state)
+static void _draw_drag_marker()
+{
+	_region_drag_coord_to_xy(&gui_panel_image_buf.region_x1, &gui_panel_image_buf.region_y1, 
+	                         &gui_panel_image_buf.region_x2, &gui_panel_image_buf.region_y2);
+	gui_render_region_drag_marker(&gui_panel_image_buf, img_canvas_buffer);
+	
+	// The marker's outer black box is one pixel outside the region
+	drag_marker_area.x1 = (lv_coord_t) gui_panel_image_buf.region_x1 - 1;
+	drag_marker_area.y1 = (lv_coord_t) gui_panel_image_buf.region_y1 - 1;
+	drag_marker_area.x2 = (lv_coord_t) gui_panel_image_buf.region_x2 + 1;
+	drag_marker_area.y2 = (lv_coord_t) gui_panel_image_buf.region_y2 + 1;
+	drag_marker_drawn = true;
+}
+
+
+// Move the drag marker between images by restoring the cached image under its old outline,
+// drawing it at the current drag position and updating just the old and new outlines
+static void _update_drag_marker()
+{
+	lv_area_t edges[8];
+	int16_t y;
+	int i, n = 0;
+	
+	if (!drag_cache_valid) return;
+	
+#ifdef ESP_PLATFORM
+	// The marker is moved in the shown buffer
+	disp_driver_push_wait();
+#endif
+	
+	if (drag_marker_drawn) {
+		n = _get_drag_marker_edges(&drag_marker_area, edges);
+		for (i=0; i<n; i++) {
+			for (y=edges[i].y1; y<=edges[i].y2; y++) {
+				memcpy(img_canvas_buffer + y*img_w + edges[i].x1, drag_cache_buffer + y*img_w + edges[i].x1,
+				       lv_area_get_width(&edges[i])*sizeof(GUI_REND_IMG_T));
+			}
+		}
+	}
+	
+	_draw_drag_marker();
+	n += _get_drag_marker_edges(&drag_marker_area, &edges[n]);
+	
+	for (i=0; i<n; i++) {
+		_update_canvas_area(&edges[i]);
+	}
+}
+
+
+// Get the two pixel wide sides of a drag marker with outer box box, clipped to the image.
+// Returns the number of sides (up to 4) loaded into edges.
+static int _get_drag_marker_edges(const lv_area_t* box, lv_area_t* edges)
+{
+	lv_area_t img_area = {0, 0, img_w - 1, img_h - 1};
+	lv_area_t side[4];
+	int i, n = 0;
+	
+	side[0] = *box;
+	side[0].y2 = box->y1 + 1;
+	side[1] = *box;
+	side[1].y1 = box->y2 - 1;
+	side[2] = *box;
+	side[2].x2 = box->x1 + 1;
+	side[3] = *box;
+	side[3].x1 = box->x2 - 1;
+	
+	for (i=0; i<4; i++) {
+		if (_lv_area_intersect(&edges[n], &side[i], &img_area)) {
+			n++;
+		}
+	}
+	
+	return n;
+}
+
+
+// Returns true if rendering the current image would draw exactly what is already in the
+// canvas (the image data and everything drawn over it are unchanged).  Otherwise the
+// current state is saved for the next comparison.
+static bool _render_unchanged()
+{
+	gui_img_buf_t cur;
+	bool unchanged;
+	
+	memcpy(&cur, &gui_panel_image_buf, sizeof(gui_img_buf_t));
+	cur.y8_data = NULL;
+	cur.y16_data = NULL;
+	cur.hist = NULL;
+	cur.profile = NULL;
+	cur.img_same = false;
+#ifdef ESP_PLATFORM
+	cur.chg_mask = NULL;
+#else
+	cur.frame_seq = 0;
+	cur.frame_msec = 0;
+#endif
+	
+	// The changed pixel mask can change even when the image doesn't
+	unchanged = last_render_valid && gui_panel_image_buf.img_same &&
+#ifdef ESP_PLATFORM
+	            (gui_panel_image_buf.chg_mask == NULL) &&
+#endif
+	            (region_sel_state == REGION_SEL_IDLE) &&
+	            (memcmp(&cur, &last_render_buf, sizeof(gui_img_buf_t)) == 0) &&
+	            (memcmp(&gui_state, &last_render_state, sizeof(gui_state_t)) == 0);
+	
+	if (!unchanged) {
+		memcpy(&last_render_buf, &cur, sizeof(gui_img_buf_t));
+		memcpy(&last_render_state, &gui_state, sizeof(gui_state_t));
+		last_render_valid = true;
+	}
+	
+	return unchanged;
+}
+
+
 static void _cb_change_palette(lv_obj_t* obj, lv_event_t event)
 {
 	bool inc_palette = false;
@@ -816,9 +1401,13 @@ static void _cb_canvas_event(lv_obj_t* obj, lv_event_t event)
 {
 	lv_indev_t* touch;          // Input device
 	lv_point_t cur_point;
-	uint16_t t, x1, y1, x2, y2;
+	uint16_t x1, y1, x2, y2;
+	uint16_t rx1, ry1, rx2, ry2;
+	uint16_t z;
+	char buf[16];
 	
-	if ((event == LV_EVENT_PRESSED) || (event == LV_EVENT_PRESSING) || (event == LV_EVENT_RELEASED)) {
+	if ((event == LV_EVENT_PRESSED) || (event == LV_EVENT_PRESSING) || (event == LV_EVENT_RELEASED) ||
+	    (event == LV_EVENT_LONG_PRESSED)) {
 		// Get absolute image units (account for position of this page)
 		touch = lv_indev_get_act();
 		lv_indev_get_point(touch, &cur_point);
@@ -834,27 +1423,67 @@ static void _cb_canvas_event(lv_obj_t* obj, lv_event_t event)
 			region_end_x = x1;
 			region_end_y = y1;
 			
-			// Setup for drag
+			// Setup for drag (the canvas holds the image without the drag marker)
 			region_sel_state = REGION_SEL_WAIT_RELEASE;
-		} else if (gui_state.spotmeter_enable) {
-			// Update spotmeter
-			if (is_portrait) {
-				// Rotate and de-scale coordinates
-				t = gui_act_coord_to_real_coord(mag_level, y1);
-				y1 = gui_act_coord_to_real_coord(mag_level, img_w - x1);
-				x1 = t;
+			_start_drag_marker();
+		} else {
+			// Setup for a possible pan
+			zoom_panning = false;
+			zoom_press_used = false;
+			pan_last_x = x1;
+			pan_last_y = y1;
+			
+			// Update spotmeter (deferred to release when zoomed since the press may be a pan)
+			if (gui_state.spotmeter_enable && (gui_render_get_zoom() == GUI_ZOOM_1X)) {
+				gui_render_img_to_raw_coord(x1, y1, &rx1, &ry1);
+				_set_spot_location(rx1, ry1);
+				_send_spot_location();
+			}
+		}
+	} else if (event == LV_EVENT_LONG_PRESSED) {
+		if ((region_sel_state == REGION_SEL_IDLE) && !zoom_panning) {
+			// Step the zoom centered on the press
+			z = 2 * gui_render_get_zoom();
+			if (z > GUIPN_IMAGE_ZOOM_MAX) z = GUI_ZOOM_1X;
+			gui_render_img_to_raw_coord(x1, y1, &rx1, &ry1);
+			gui_render_set_zoom(z, rx1, ry1);
+			gui_page_image_update_stream_view();
+			zoom_press_used = true;
+			
+			if (z == GUI_ZOOM_1X) {
+				gui_panel_image_set_message("Zoom Off", GUIPN_IMAGE_ZOOM_MSG_MSEC);
 			} else {
-				// De-scale native-orientation coordinates
-				x1 = gui_act_coord_to_real_coord(mag_level, x1);
-				y1 = gui_act_coord_to_real_coord(mag_level, y1);
+				sprintf(buf, "Zoom %dx", z / GUI_ZOOM_1X);
+				gui_panel_image_set_message(buf, GUIPN_IMAGE_ZOOM_MSG_MSEC);
 			}
-			(void) cmd_send_marker_location(CMD_SET, CMD_SPOT_LOC, x1, y1, 0, 0);
 		}
 	} else if (event == LV_EVENT_PRESSING) {
-		if (region_sel_state == REGION_SEL_WAIT_RELEASE) {
-			// Update end position
+		if ((region_sel_state == REGION_SEL_IDLE) && (gui_render_get_zoom() == GUI_ZOOM_1X)) {
+			// Drag the spotmeter
+			if (gui_state.spotmeter_enable) {
+				gui_render_img_to_raw_coord(x1, y1, &rx1, &ry1);
+				_set_spot_location(rx1, ry1);
+			}
+		} else if ((region_sel_state == REGION_SEL_IDLE) && (gui_render_get_zoom() != GUI_ZOOM_1X)) {
+			// Pan the zoomed image once they start dragging
+			if (!zoom_panning && ((abs((int16_t) x1 - pan_last_x) + abs((int16_t) y1 - pan_last_y)) > GUIPN_IMAGE_PAN_THRESH)) {
+				zoom_panning = true;
+			}
+			if (zoom_panning) {
+				gui_render_pan((int16_t) x1 - pan_last_x, (int16_t) y1 - pan_last_y);
+				gui_page_image_update_stream_view();
+				pan_last_x = x1;
+				pan_last_y = y1;
+			}
+		} else if (region_sel_state == REGION_SEL_WAIT_RELEASE) {
+			// Update end position and move the drag marker without waiting for an image
 			region_end_x = x1;
 			region_end_y = y1;
+#ifdef ESP_PLATFORM
+			drag_marker_pending = true;
+#else
+			_update_drag_marker();
+#endif
 			
 			// Stop timer once they start dragging
 			if (task_region_sel_timer != NULL) {
@@ -866,6 +1495,7 @@ static void _cb_canvas_event(lv_obj_t* obj, lv_event_t event)
 		if (region_sel_state == REGION_SEL_WAIT_RELEASE) {
 			// Done with region selection
 			region_sel_state = REGION_SEL_IDLE;
+			drag_cache_valid = false;
 			gui_panel_image_set_message("", 0);
 			if (task_region_sel_timer != NULL) {
 				lv_task_del(task_region_sel_timer);
@@ -880,30 +1510,34 @@ static void _cb_canvas_event(lv_obj_t* obj, lv_event_t event)
 				// Adjust to unified format with (x1,y1) upper-left
 				_region_drag_coord_to_xy(&x1, &y1, &x2, &y2);
 				
-				// Rotate if necessary and de-scale
-				if (is_portrait) {
-					t = gui_act_coord_to_real_coord(mag_level, y1);
-					y1 = gui_act_coord_to_real_coord(mag_level, img_w - x2);
-					x2 = gui_act_coord_to_real_coord(mag_level, y2);
-					y2 = gui_act_coord_to_real_coord(mag_level, img_w - x1);
-					x1 = t;
-				} else {
-					x1 = gui_act_coord_to_real_coord(mag_level, x1);
-					y1 = gui_act_coord_to_real_coord(mag_level, y1);
-					x2 = gui_act_coord_to_real_coord(mag_level, x2);
-					y2 = gui_act_coord_to_real_coord(mag_level, y2);
-				}
+				// Rotate if necessary, de-scale and restore (x1,y1) upper-left
+				gui_render_img_to_raw_coord(x1, y1, &rx1, &ry1);
+				gui_render_img_to_raw_coord(x2, y2, &rx2, &ry2);
+				x1 = (rx1 < rx2) ? rx1 : rx2;
+				y1 = (ry1 < ry2) ? ry1 : ry2;
+				x2 = (rx1 < rx2) ? rx2 : rx1;
+				y2 = (ry1 < ry2) ? ry2 : ry1;
 				
 				// Tell the controller about the region to get and enable the marker
 				(void) cmd_send_marker_location(CMD_SET, CMD_REGION_LOC, x1, y1, x2, y2);
 				gui_state.region_enable = true;
 				(void) cmd_send_int32(CMD_SET, CMD_REGION_EN, (int32_t) gui_state.region_enable);
 			}
+		} else if (gui_state.spotmeter_enable && (gui_render_get_zoom() != GUI_ZOOM_1X) &&
+		           !zoom_panning && !zoom_press_used) {
+			// Update spotmeter for a tap on a zoomed image
+			gui_render_img_to_raw_coord(x1, y1, &rx1, &ry1);
+			_set_spot_location(rx1, ry1);
+			_send_spot_location();
+		} else {
+			// Make sure the final location of a dragged spotmeter is sent
+			_send_spot_location();
 		}
 	}
 }
 
 
+#ifdef ESP_PLATFORM
 static void _task_eval_batt_timer(lv_task_t* task)
 {
 	// Reset our timer in case we're the first execution
@@ -912,6 +1546,7 @@ static void _task_eval_batt_timer(lv_task_t* task)
 	// Request battery status
 	(void) cmd_send(CMD_GET, CMD_BATT_LEVEL);
 }
+#endif
 
 
 static void _task_eval_timelapse_timer(lv_task_t* task)
@@ -1021,4 +1656,24 @@ static void _region_drag_coord_to_xy(uint16_t* x1, uint16_t* y1, uint16_t* x2, u
 	}
 }
 
+
+
+static void _set_spot_location(uint16_t x, uint16_t y)
+{
+	if (!spot_loc_pending && (x == spot_loc_x) && (y == spot_loc_y)) return;
+	
+	spot_loc_x = x;
+	spot_loc_y = y;
+	spot_loc_pending = true;
+}
+
+
+static void _send_spot_location()
+{
+	if (spot_loc_pending) {
+		(void) cmd_send_marker_location(CMD_SET, CMD_SPOT_LOC, spot_loc_x, spot_loc_y, 0, 0);
+		spot_loc_pending = false;
+	}
+}
+
 #endif /* !CONFIG_BUILD_ICAM_MINI */
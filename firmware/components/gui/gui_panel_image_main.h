@@ -42,6 +42,18 @@
 // Region selection timeout period
 #define GUIPN_IMAGE_REGION_SEL_MSEC  5000
 
+// Long press zoom steps (each press doubles the zoom up to the maximum then turns it off)
+#define GUIPN_IMAGE_ZOOM_MAX        (4*GUI_ZOOM_1X)
+
+// Zoom message display period
+#define GUIPN_IMAGE_ZOOM_MSG_MSEC   1000
+
+// Drag distance before a press on a zoomed image pans it (pixels)
+#define GUIPN_IMAGE_PAN_THRESH      8
+
+// Histogram and line profile display update period
+#define GUIPN_IMAGE_STATS_UPD_MSEC  250
+
 // Maximum message length
 #define GUIP_MAX_MSG_LEN            80
 
@@ -77,6 +89,13 @@
 #define GUIPN_IMAGE_IMG_X_OFFSET    GUIPN_IMAGE_PAL_BAR_W
 #define GUIPN_IMAGE_IMG_Y_OFFSET    GUIPN_IMAGE_STATUS_H
 
+// Histogram and line profile charts (across the bottom of the image while there is an
+// ROI line).  Chart values are scaled to 0 - GUIPN_IMAGE_STATS_RANGE.
+#define GUIPN_IMAGE_STATS_H         56
+#define GUIPN_IMAGE_STATS_PAD       2
+#define GUIPN_IMAGE_STATS_LBL_W     100
+#define GUIPN_IMAGE_STATS_RANGE     100
+
 // Message bar (y offset is from top of image)
 #define GUIPN_IMAGE_MSG_OFFSET_X    GUIPN_IMAGE_PAL_BAR_W
 #define GUIPN_IMAGE_MSG_OFFSET_Y    0
@@ -105,10 +124,19 @@ void gui_panel_image_set_batt_percent(int percent);
 void gui_panel_image_render_image();
 void gui_panel_image_set_message(char* msg, int display_msec);
 void gui_panel_image_set_timelapse(bool en);
+#ifndef ESP_PLATFORM
+void gui_panel_image_set_stream_info(int latency_msec, int fps10);
+#endif
 
 // From other gui pages
 void gui_panel_image_update_palette();
 void gui_panel_image_enable_region_selection(bool en);
 bool gui_panel_image_region_selection_in_progress();
 
+#ifdef ESP_PLATFORM
+// From gui_task
+void gui_panel_image_benchmark_render();
+void gui_panel_image_eval_drag_marker();   // Call outside of lv_task_handler()
+#endif
+
 #endif /* GUI_PANEL_IMAGE_MAIN_H */
\ No newline at end of file
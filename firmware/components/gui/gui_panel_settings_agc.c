@@ -0,0 +1,129 @@
+/*
+ * GUI settings AGC mode control panel
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "esp_system.h"
+#ifndef CONFIG_BUILD_ICAM_MINI
+
+#include "cmd_utilities.h"
+#include "gui_page_settings.h"
+#include "gui_panel_settings_agc.h"
+#include "gui_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+	#include "gui_task.h"
+#else
+	#include "gui_main.h"
+#endif
+
+
+
+//
+// Local variables
+//
+
+// State
+static bool prev_active = false;
+static int cur_agc_mode;
+
+//
+// LVGL Objects
+//
+static lv_obj_t* my_panel;
+static lv_obj_t* lbl_name;
+static lv_obj_t* rlr_agc;
+
+// Roller string - order must match T1C_AGC_MODE_xxx
+static const char* rlr_string = "Linear\nPercentile\nEqualize";
+
+
+
+//
+// Forward declarations for internal functions
+//
+static void _cb_rlr_agc(lv_obj_t* obj, lv_event_t event);
+
+
+
+//
+// API
+//
+void gui_panel_settings_agc_init(lv_obj_t* parent_cont)
+{
+	// Control panel - width fits parent, height fits contents with padding
+	my_panel = lv_cont_create(parent_cont, NULL);
+	lv_obj_set_click(my_panel, false);
+	lv_obj_set_auto_realign(my_panel, true);
+	lv_cont_set_fit2(my_panel, LV_FIT_PARENT, LV_FIT_TIGHT);
+	lv_cont_set_layout(my_panel, LV_LAYOUT_PRETTY_MID);
+	lv_obj_set_style_local_pad_top(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_TOP_PAD);
+	lv_obj_set_style_local_pad_bottom(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_BTM_PAD);
+	lv_obj_set_style_local_pad_left(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_LEFT_PAD);
+	lv_obj_set_style_local_pad_right(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_RIGHT_PAD);
+	
+	// Panel name
+	lbl_name = lv_label_create(my_panel, NULL);
+	lv_label_set_static_text(lbl_name, "AGC");
+	
+	// AGC mode selection roller
+	rlr_agc = lv_roller_create(my_panel, NULL);
+	lv_roller_set_options(rlr_agc, rlr_string, LV_ROLLER_MODE_NORMAL);
+	lv_roller_set_auto_fit(rlr_agc, false);
+	lv_obj_set_size(rlr_agc, GUIPN_SETTINGS_AGC_RLR_W, GUIPN_SETTINGS_AGC_RLR_H);
+	lv_obj_set_style_local_bg_color(rlr_agc, LV_ROLLER_PART_SELECTED, LV_STATE_DEFAULT, GUI_THEME_RLR_BG_COLOR);
+	lv_obj_set_event_cb(rlr_agc, _cb_rlr_agc);
+    
+    // Register with our parent page
+	gui_page_settings_register_panel(my_panel, NULL, NULL, NULL);
+}
+
+
+void gui_panel_settings_agc_set_active(bool is_active)
+{
+	if (is_active) {
+		// Get the current mode
+		cur_agc_mode = gui_state.agc_mode;
+		lv_roller_set_selected(rlr_agc, (uint16_t) cur_agc_mode, LV_ANIM_OFF);
+	} else {
+		if (prev_active) {
+			// Update the controller if there was a change
+			if (cur_agc_mode != gui_state.agc_mode) {
+				gui_state.agc_mode = cur_agc_mode;
+				(void) cmd_send_int32(CMD_SET, CMD_AGC_MODE, (int32_t) gui_state.agc_mode);
+			}
+		}
+	}
+	
+	prev_active = is_active;
+}
+
+
+
+//
+// Internal functions
+//
+static void _cb_rlr_agc(lv_obj_t* obj, lv_event_t event)
+{
+	if (event == LV_EVENT_VALUE_CHANGED) {
+		cur_agc_mode = (int) lv_roller_get_selected(obj);
+	}
+}
+
+#endif /* !CONFIG_BUILD_ICAM_MINI */
@@ -39,6 +39,7 @@
 // State
 static bool prev_active = false;
 static bool init_gain_flag;
+static bool init_auto_flag;
 
 //
 // LVGL Objects
@@ -49,6 +50,9 @@ static lv_obj_t* sw_assy;
 static lv_obj_t* sw_gain;
 static lv_obj_t* lbl_h;
 static lv_obj_t* lbl_l;
+static lv_obj_t* auto_assy;
+static lv_obj_t* sw_auto;
+static lv_obj_t* lbl_auto;
 
 
 
@@ -56,6 +60,8 @@ static lv_obj_t* lbl_l;
 // Forward declarations for internal functions
 //
 static void _cb_sw_gain(lv_obj_t* obj, lv_event_t event);
+static void _cb_sw_auto(lv_obj_t* obj, lv_event_t event);
+static void _set_gain_sw_state();
 
 
 
@@ -107,6 +113,28 @@ void gui_panel_settings_gain_init(lv_obj_t* parent_cont)
 	lv_obj_align(lbl_h, sw_gain, LV_ALIGN_OUT_RIGHT_MID, 5, 0);
 	lv_label_set_static_text(lbl_h, "High");
 	
+	// Auto gain assembly (label + switch aligned with the gain switch)
+	auto_assy = lv_obj_create(my_panel, NULL);
+	lv_obj_set_click(auto_assy, false);
+	lv_obj_set_height(auto_assy, GUIPN_SETTINGS_GAIN_SW_H + 10);
+	lv_obj_set_width(auto_assy, 2*GUIPN_SETTINGS_GAIN_TYP_W + GUIPN_SETTINGS_GAIN_SW_W);
+	lv_obj_set_style_local_border_width(auto_assy, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, 0);
+	
+	// Auto gain enable switch
+	sw_auto = lv_switch_create(auto_assy, NULL);
+	lv_obj_align(sw_auto, auto_assy, LV_ALIGN_CENTER, 0, 0);
+	lv_obj_add_protect(sw_auto, LV_PROTECT_CLICK_FOCUS);
+	lv_obj_set_size(sw_auto, GUIPN_SETTINGS_GAIN_SW_W, GUIPN_SETTINGS_GAIN_SW_H);
+	lv_obj_set_style_local_bg_color(sw_auto, LV_SWITCH_PART_BG, LV_STATE_DEFAULT, GUI_THEME_SLD_BG_COLOR);
+	lv_obj_set_style_local_bg_color(sw_auto, LV_SWITCH_PART_INDIC, LV_STATE_DEFAULT, GUI_THEME_SLD_BG_COLOR);
+	lv_obj_set_event_cb(sw_auto, _cb_sw_auto);
+	
+	// Add "Auto" to the left
+	lbl_auto = lv_label_create(auto_assy, NULL);
+	lv_obj_set_width(lbl_auto, GUIPN_SETTINGS_GAIN_TYP_W);
+	lv_obj_align(lbl_auto, sw_auto, LV_ALIGN_OUT_LEFT_MID, -5, 0);
+	lv_label_set_static_text(lbl_auto, "Auto");
+	
     // Register with our parent page
 	gui_page_settings_register_panel(my_panel, NULL, NULL, NULL);
 }
@@ -116,16 +144,27 @@ void gui_panel_settings_gain_set_active(bool is_active)
 {
 	if (is_active) {
 		init_gain_flag = gui_state.high_gain;
+		init_auto_flag = gui_state.auto_gain_en;
 		if (init_gain_flag) {
 			lv_switch_on(sw_gain, false);
 		} else {
 			lv_switch_off(sw_gain, false);
 		}
+		if (init_auto_flag) {
+			lv_switch_on(sw_auto, false);
+		} else {
+			lv_switch_off(sw_auto, false);
+		}
+		_set_gain_sw_state();
 	} else {
 		if (prev_active) {
 			// Update the controller gain if there was a change
-			if (init_gain_flag != gui_state.high_gain) {
-				(void) cmd_send_int32(CMD_SET, CMD_GAIN, (int32_t) gui_state.high_gain);
+			if ((init_gain_flag != gui_state.high_gain) || (init_auto_flag != gui_state.auto_gain_en)) {
+				if (gui_state.auto_gain_en) {
+					(void) cmd_send_int32(CMD_SET, CMD_GAIN, CMD_GAIN_AUTO);
+				} else {
+					(void) cmd_send_int32(CMD_SET, CMD_GAIN, gui_state.high_gain ? CMD_GAIN_HIGH : CMD_GAIN_LOW);
+				}
 			}
 		}
 	}
@@ -145,4 +184,20 @@ static void _cb_sw_gain(lv_obj_t* obj, lv_event_t event)
 	}
 }
 
+
+static void _cb_sw_auto(lv_obj_t* obj, lv_event_t event)
+{
+	if (event == LV_EVENT_VALUE_CHANGED) {
+		gui_state.auto_gain_en = lv_switch_get_state(obj);
+		_set_gain_sw_state();
+	}
+}
+
+
+// The manual gain selection doesn't apply while automatic gain is enabled
+static void _set_gain_sw_state()
+{
+	lv_obj_set_state(sw_gain, gui_state.auto_gain_en ? LV_STATE_DISABLED : LV_STATE_DEFAULT);
+}
+
 #endif /* !CONFIG_BUILD_ICAM_MINI */
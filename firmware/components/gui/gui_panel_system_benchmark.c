@@ -0,0 +1,194 @@
+/*
+ * GUI system settings benchmark control panel
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "esp_system.h"
+#ifndef CONFIG_BUILD_ICAM_MINI
+
+#include "cmd_utilities.h"
+#include "gui_page_settings.h"
+#include "gui_sub_page_system.h"
+#include "gui_panel_system_benchmark.h"
+#include "gui_state.h"
+#include "gui_utilities.h"
+#include <stdio.h>
+
+#ifdef ESP_PLATFORM
+	#include "gui_task.h"
+#else
+	#include "gui_main.h"
+#endif
+
+
+//
+// Local constants
+//
+
+// Results text buffer length (one line per item)
+#define RESULTS_BUF_LEN  (CMD_BENCH_NUM_ITEMS * 40)
+
+// Offsets into each item in the results
+#define RES_COUNT  0
+#define RES_MIN    1
+#define RES_AVG    2
+#define RES_MAX    3
+
+
+//
+// Local variables
+//
+
+// CMD_BENCHMARK order
+static const char* item_names[CMD_BENCH_NUM_ITEMS] = {
+	"SPI read", "CCI read", "Scale", "Render 0.5x", "Render 1x", "Render 1.5x", "Render 2x",
+	"File render", "JPEG encode", "JPEG decode", "SD write"
+};
+
+static char results_buf[RESULTS_BUF_LEN];
+
+//
+// LVGL Objects
+//
+static lv_obj_t* my_parent_page;
+static lv_obj_t* my_panel;
+static lv_obj_t* lbl_name;
+static lv_obj_t* btn_run;
+static lv_obj_t* lbl_btn_run;
+static lv_obj_t* lbl_results;
+
+
+
+//
+// Forward declarations for internal functions
+//
+static void _cb_btn_run(lv_obj_t* obj, lv_event_t event);
+static void _cb_activity_done(bool success);
+
+
+//
+// API
+//
+void gui_panel_system_benchmark_init(lv_obj_t* parent_cont)
+{
+	// Get the top-level displayed page holding us for our pop-ups
+	my_parent_page = lv_obj_get_parent(parent_cont);
+	
+	// Control panel - width fits parent, height fits contents with padding
+	my_panel = lv_cont_create(parent_cont, NULL);
+	lv_obj_set_click(my_panel, false);
+	lv_obj_set_auto_realign(my_panel, true);
+	lv_cont_set_fit2(my_panel, LV_FIT_PARENT, LV_FIT_TIGHT);
+	lv_cont_set_layout(my_panel, LV_LAYOUT_PRETTY_MID);
+	lv_obj_set_style_local_pad_top(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_TOP_PAD);
+	lv_obj_set_style_local_pad_bottom(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_BTM_PAD);
+	lv_obj_set_style_local_pad_left(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_LEFT_PAD);
+	lv_obj_set_style_local_pad_right(my_panel, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, GUIP_SETTINGS_RIGHT_PAD);
+	
+	// Panel name
+	lbl_name = lv_label_create(my_panel, NULL);
+	lv_label_set_static_text(lbl_name, "Benchmark");
+	
+	// Run Button
+	btn_run = lv_btn_create(my_panel, NULL);
+	lv_obj_set_y(btn_run, 5);
+	lv_obj_add_protect(btn_run, LV_PROTECT_CLICK_FOCUS);
+	lv_obj_set_size(btn_run, GUIPN_SYSTEM_BENCH_BTN_W, GUIPN_SYSTEM_BENCH_BTN_H);
+	lv_obj_set_event_cb(btn_run, _cb_btn_run);
+	
+	// Button Label
+	lbl_btn_run = lv_label_create(btn_run, NULL);
+	lv_label_set_align(lbl_btn_run, LV_LABEL_ALIGN_CENTER);
+	lv_label_set_static_text(lbl_btn_run, "Run");
+	
+	// Results (below the button)
+	lbl_results = lv_label_create(my_panel, NULL);
+	lv_label_set_long_mode(lbl_results, LV_LABEL_LONG_BREAK);
+	lv_obj_set_width(lbl_results, GUIPN_SYSTEM_BENCH_RES_W);
+	lv_label_set_static_text(lbl_results, "");
+	
+    // Register with our parent page
+	gui_sub_page_system_register_panel(my_panel);
+}
+
+
+void gui_panel_system_benchmark_set_active(bool is_active)
+{
+	if (is_active) {
+		// Get the results of any previous run
+		(void) cmd_send(CMD_GET, CMD_BENCHMARK);
+	}
+}
+
+
+void gui_panel_system_benchmark_set_results(uint32_t* results)
+{
+	int i;
+	int n = 0;
+	uint32_t* itemP;
+	
+	for (i=0; i<CMD_BENCH_NUM_ITEMS; i++) {
+		itemP = &results[i * 4];
+		
+		// Skip items that weren't measured (or have no room left to display)
+		if ((itemP[RES_COUNT] == 0) || (n >= (RESULTS_BUF_LEN - 1))) continue;
+		
+		if (i == (CMD_BENCH_NUM_ITEMS - 1)) {
+			// SD card writes are displayed as throughput
+			n += snprintf(&results_buf[n], RESULTS_BUF_LEN - n, "%s%s: %lu KB/sec",
+				(n == 0) ? "" : "\n", item_names[i],
+				(itemP[RES_AVG] == 0) ? 0 : (unsigned long) ((uint64_t) (CMD_BENCH_SD_WRITE_LEN / 1024) * 1000000 / itemP[RES_AVG]));
+		} else {
+			n += snprintf(&results_buf[n], RESULTS_BUF_LEN - n, "%s%s: %lu uS (max %lu)",
+				(n == 0) ? "" : "\n", item_names[i],
+				(unsigned long) itemP[RES_AVG], (unsigned long) itemP[RES_MAX]);
+		}
+	}
+	
+	if (n == 0) {
+		// Nothing has been run since boot
+		results_buf[0] = '\0';
+	}
+	lv_label_set_text(lbl_results, results_buf);
+}
+
+
+
+//
+// Internal functions
+//
+static void _cb_btn_run(lv_obj_t* obj, lv_event_t event)
+{
+	if (event == LV_EVENT_CLICKED) {
+		// We check for a popup displayed so that this won't trigger if pressed while some
+		// other controls keypad or messagebox is displayed
+		if (!gui_popup_displayed()) {
+			gui_send_activity_command(CMD_CTRL_ACT_BENCHMARK, 0, my_parent_page, "Benchmark in progress");
+			gui_set_activity_done_cb(_cb_activity_done);
+		}
+	}
+}
+
+
+static void _cb_activity_done(bool success)
+{
+	if (success) {
+		// Get the new results
+		(void) cmd_send(CMD_GET, CMD_BENCHMARK);
+	}
+}
+
+#endif /* !CONFIG_BUILD_ICAM_MINI */
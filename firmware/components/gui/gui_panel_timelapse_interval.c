@@ -45,9 +45,9 @@ static lv_obj_t* lbl_name;
 static lv_obj_t* rlr_interval;
 
 // Interval roller values
-#define NUM_I_PARM_VALS 12
-static const char* parm_i_list = "2 sec\n5 sec\n10 sec\n15 sec\n30 sec\n1 min\n2 min\n5 min\n10 min\n15 min\n30 min\n1 hour";
-static const uint32_t parm_i_value[] = {2, 5, 10, 15, 30, 60, 120, 300, 600, 900, 1800, 3600};
+#define NUM_I_PARM_VALS 15
+static const char* parm_i_list = "250 msec\n500 msec\n1 sec\n2 sec\n5 sec\n10 sec\n15 sec\n30 sec\n1 min\n2 min\n5 min\n10 min\n15 min\n30 min\n1 hour";
+static const uint32_t parm_i_value[] = {250, 500, 1000, 2000, 5000, 10000, 15000, 30000, 60000, 120000, 300000, 600000, 900000, 1800000, 3600000};  // mSec
 
 
 
@@ -98,7 +98,7 @@ void gui_panel_timelapse_interval_set_active(bool is_active)
 	
 	if (is_active) {
 		// Get the current value
-		cur_index = _interval_to_rlr_index((int) gui_state.timelapse_interval_sec);
+		cur_index = _interval_to_rlr_index((int) gui_state.timelapse_interval_msec);
 		lv_roller_set_selected(rlr_interval, (uint16_t) cur_index, LV_ANIM_OFF);
 	}
 }
@@ -111,7 +111,7 @@ void gui_panel_timelapse_interval_set_active(bool is_active)
 static void _cb_rlr_interval(lv_obj_t* obj, lv_event_t event)
 {
 	if (event == LV_EVENT_VALUE_CHANGED) {
-		gui_state.timelapse_interval_sec = parm_i_value[(int) lv_roller_get_selected(obj)];
+		gui_state.timelapse_interval_msec = parm_i_value[(int) lv_roller_get_selected(obj)];
 		
 		gui_sub_page_timelapse_note_change();
 	}
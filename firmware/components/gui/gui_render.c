@@ -23,10 +23,15 @@
 //	#include "esp_system.h"
 	#include "esp_log.h"
 	#include "esp_heap_caps.h"
+	#include "t1c_agc.h"
 #else
 	#include <stdio.h>
 	#include <stdlib.h>
+	#ifdef __wasm_simd128__
+		#include <wasm_simd128.h>
+	#endif
 #endif
+#include "draw_utilities.h"
 #include "gui_render.h"
 #include "palettes.h"
 #include <math.h>
@@ -45,14 +50,41 @@
 	#define COLOR_BLACK 0xFF000000
 #endif
 
-// Linear Doubling Interpolation Scale Factors
-//  DS = Dual Source Pixel case (SF_DS is typically 2 or 3)
-//  QS = Quad Source Pixel case (SF_QS is typically 3 or 5)
-//
-#define SF_DS 3
-#define SF_QS 5
-#define DIV_DS (SF_DS + 1)
-#define DIV_QS (SF_QS + 3)
+// Overlay drawing primitives for the pixel type
+#ifdef ESP_PLATFORM
+	#define GUI_DRAW(f) draw16_##f
+#else
+	#define GUI_DRAW(f) draw32_##f
+#endif
+
+// Store two horizontally adjacent pixels (the first at an even x) in one write
+#ifdef ESP_PLATFORM
+	#define STORE_PIXEL_PAIR(p, a, b) *((uint32_t*) (p)) = ((uint32_t) (a)) | (((uint32_t) (b)) << 16)
+#else
+	#define STORE_PIXEL_PAIR(p, a, b) do { (p)[0] = (a); (p)[1] = (b); } while (0)
+#endif
+
+// WASM SIMD builds (WASM_SIMD in emscripten/CMakeLists.txt) compute the palette indices of
+// several pixels at a time.  WASM has no gather so the palette lookups remain scalar.
+#ifdef __wasm_simd128__
+	#define GUI_RENDER_WASM_SIMD
+#endif
+
+// Undefine to always render through the intermediate y8 buffer instead of directly from
+// Y16 data using a combined AGC + palette LUT (local GUI only)
+#ifdef ESP_PLATFORM
+	#define GUI_RENDER_Y16_LUT
+#endif
+
+// Combined AGC + palette LUT length (indexed by the Y16 value relative to the AGC minimum
+// shifted down so the AGC range fits)
+#define Y16_LUT_BITS 12
+#define Y16_LUT_LEN  (1 << Y16_LUT_BITS)
+
+// Zoom resampler table length (largest rendered image dimension) and weight resolution
+#define ZOOM_MAX_DIM  (GUI_LARGEST_MAG_FACTOR*GUI_RAW_IMG_W)
+#define ZOOM_WT_BITS  4
+#define ZOOM_WT_ONE   (1 << ZOOM_WT_BITS)
 
 
 
@@ -66,10 +98,54 @@ static bool is_portrait = false;
 static int mag_level = GUI_MAGNIFICATION_1_0;
 static float mag_factor = 1;
 static int16_t img_w, img_h;   // Raw image dimensions accounting for rotation
+static draw_clip_t img_clip;   // Overlay clip region covering the image
 
 // y8 buffer (holds scaled and correctly rotated raw image data)
 static uint8_t* y8_buf;
 
+// Digital zoom.  The center is kept in raw image coordinates.  zoom_scale is the number of
+// rendered pixels per source pixel and (zoom_ox, zoom_oy) the source (rotated) coordinate
+// at the upper-left corner of the rendered image.
+static uint16_t zoom = GUI_ZOOM_1X;
+static float zoom_cx = GUI_RAW_IMG_W/2;
+static float zoom_cy = GUI_RAW_IMG_H/2;
+static float zoom_scale = 1;
+static float zoom_ox = 0;
+static float zoom_oy = 0;
+
+// Zoom resampler tables holding the source pixel index and the weight of the following
+// pixel (in 1/ZOOM_WT_ONE) for each rendered column and row, and the two horizontally
+// resampled source rows blended for the current rendered row
+static uint16_t zoom_col_index[ZOOM_MAX_DIM];
+static uint8_t zoom_col_wt[ZOOM_MAX_DIM];
+static uint16_t zoom_row_index[ZOOM_MAX_DIM];
+static uint8_t zoom_row_wt[ZOOM_MAX_DIM];
+static uint32_t zoom_hrow[2][ZOOM_MAX_DIM];
+
+#ifdef GUI_RENDER_WASM_SIMD
+// Palette index rows computed with SIMD and the edge padded column sums for the 2.0X
+// interpolation
+static uint8_t simd_idx[2][ZOOM_MAX_DIM];
+static uint16_t simd_psum[GUI_RAW_IMG_W + 2];
+#endif
+
+#ifndef ESP_PLATFORM
+// GPU renderer (web) and the screen position of the rendered image
+static gui_render_gpu_cb_t gpu_render_cb = NULL;
+static int16_t gpu_screen_x = 0;
+static int16_t gpu_screen_y = 0;
+#endif
+
+#ifdef GUI_RENDER_Y16_LUT
+// Combined AGC + palette LUT, rebuilt only when the AGC range or palette changes
+static GUI_REND_IMG_T* y16_lut;
+static bool y16_lut_valid = false;
+static uint32_t y16_lut_agc_seq;
+static uint32_t y16_lut_palette_index;
+static uint16_t y16_lut_base;
+static int y16_lut_shift;
+#endif
+
 
 
 //
@@ -81,19 +157,39 @@ static void _render_image_1_5(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state
 static void _render_image_2_0(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state_t* g);
 static void _render_min_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
 static void _render_max_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+static void _render_box_marker(GUI_REND_IMG_T* img, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+static void _raw_to_img_coord(uint16_t raw_x, uint16_t raw_y, int16_t* x, int16_t* y);
+static void _raw_to_img_coordf(float raw_x, float raw_y, float* x, float* y);
+static void _raw_to_src_coord(float raw_x, float raw_y, float* u, float* v);
+static void _src_to_raw_coord(float u, float v, float* raw_x, float* raw_y);
+
+
+static void _interp_row_pair(uint8_t* srcA, uint8_t* srcB, GUI_REND_IMG_T* dstA, GUI_REND_IMG_T* dstB, int16_t src_w);
+
+static void _zoom_update();
+static void _zoom_setup_table(float o, int16_t dst_len, int16_t src_len, uint16_t* index, uint8_t* wt);
+static void _render_image_zoom(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+static void _zoom_hrow(uint8_t* src, uint32_t* dst);
+
+#ifndef ESP_PLATFORM
+static void _render_gpu(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+#endif
 
-static void _draw_hline(GUI_REND_IMG_T* img, int16_t x1, int16_t x2, int16_t y, GUI_REND_IMG_T c);
-static void _draw_vline(GUI_REND_IMG_T* img, int16_t x, int16_t y1, int16_t y2, GUI_REND_IMG_T c);
-static void _draw_line(GUI_REND_IMG_T* img, int16_t x1, int16_t y1, int16_t x2, int16_t y2, GUI_REND_IMG_T c);
-static void _draw_circle(GUI_REND_IMG_T* img, int16_t x0, int16_t y0, int16_t r, GUI_REND_IMG_T c);
-static void _draw_rect(GUI_REND_IMG_T* img, int16_t x, int16_t y, int16_t w, int16_t h, GUI_REND_IMG_T c);
-static void _draw_fill_rect(GUI_REND_IMG_T* img, int16_t x, int16_t y, int16_t w, int16_t h, GUI_REND_IMG_T c);
-static __inline__ void _draw_pixel(GUI_REND_IMG_T* img, int16_t x, int16_t y, GUI_REND_IMG_T c);
+#ifdef GUI_RENDER_WASM_SIMD
+static void _simd_rotate_tile(uint8_t* src, uint8_t* dst);
+static void _simd_palette_row(uint8_t* idx, GUI_REND_IMG_T* dst, int n);
+#endif
 
-static void _interp_set_pixel(uint8_t src, GUI_REND_IMG_T* img, int x, int y);
-static void _interp_set_outer_row(uint8_t* src, GUI_REND_IMG_T* img, int16_t src_w, int16_t src_h, bool first_row);
-static void _interp_set_outer_col(uint8_t* src, GUI_REND_IMG_T* img, int16_t src_w, int16_t src_h, bool first_col);
-static void _interp_set_inner(uint8_t* src, int16_t src_w, int16_t src_h, GUI_REND_IMG_T* img);
+#ifdef GUI_RENDER_Y16_LUT
+static void _y16_lut_update(gui_img_buf_t* raw, gui_state_t* g);
+static __inline__ GUI_REND_IMG_T _y16_lut_lookup(uint32_t v);
+static void _render_y16_1_0(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+static void _render_y16_1_5(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+static void _render_y16_2_0(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+static void _interp_y16_row_pair(uint16_t* srcA, uint16_t* srcB, GUI_REND_IMG_T* dstA, GUI_REND_IMG_T* dstB, int16_t src_w);
+static void _render_y16_zoom(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+static void _zoom_y16_hrow(uint16_t* src, uint32_t* dst);
+#endif
 
 
 
@@ -117,6 +213,14 @@ bool gui_render_init()
 	}
 #endif
 
+#ifdef GUI_RENDER_Y16_LUT
+	// Allocate the LUT in internal memory for fast lookup (failure only disables direct rendering)
+	y16_lut = (GUI_REND_IMG_T*) heap_caps_malloc(Y16_LUT_LEN*sizeof(GUI_REND_IMG_T), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if (y16_lut == NULL) {
+		ESP_LOGE(TAG, "Could not allocate y16_lut");
+	}
+#endif
+
 	return true;
 }
 
@@ -148,19 +252,22 @@ void gui_render_set_configuration(int orientation, int magnification)
 		img_w = (int16_t) round((float) GUI_RAW_IMG_W * mag_factor);
 		img_h = (int16_t) round((float) GUI_RAW_IMG_H * mag_factor);
 	}
+	
+	img_clip.stride = img_w;
+	img_clip.y0 = 0;
+	img_clip.x1 = 0;
+	img_clip.y1 = 0;
+	img_clip.x2 = img_w - 1;
+	img_clip.y2 = img_h - 1;
+	
+	_zoom_update();
 }
 
 
-uint8_t* gui_render_get_y8_data(uint16_t* y16_data, uint16_t y16_min, uint16_t y16_max)
+uint8_t* gui_render_get_y8_data(uint8_t* src_y8_data)
 {
-#ifdef ESP_PLATFORM
-	uint32_t t32;
-	uint32_t diff;
-	
-	diff = y16_max - y16_min;
-	if (diff == 0) diff = 1;
-	
-	// We have to scale the y16 to 8-bits
+	// Data has already been scaled to 8 bits (by t1c_task locally or before being sent to
+	// the web) so we only have to copy it, rotating if necessary
 	if (is_portrait) {
 		// We also have to rotate the data
 		// 
@@ -189,65 +296,98 @@ uint8_t* gui_render_get_y8_data(uint16_t* y16_data, uint16_t y16_min, uint16_t y
 		// 02 = 33
 		// 03 = 43
 		//
-		// for x=(GUI_RAW_IMG_H-1) downto 0
-		//   dstP = dst + x
-		//   dstE = dstP + GUI_RAW_IMG_H*GUI_RAW_IMG_W
-		//   do {
-		//      *dstP = *srcP++
-		//      dstP += GUI_RAW_IMG_H
-		//   } while (dstP < dstE)
-		uint16_t* y16p = y16_data;
+		// dst[c*GUI_RAW_IMG_H + (GUI_RAW_IMG_H-1-r)] = src[r*GUI_RAW_IMG_W + c]
+		//
+		// This is done in 8x8 tiles so each tile's 8 source rows and 8 destination rows stay
+		// in the cache instead of striding down a whole destination column per source row.
+		uint8_t* srcp;
 		uint8_t* y8p;
-		uint8_t* y8end;
-	
-		for (int x=(GUI_RAW_IMG_H-1); x >= 0; x--) {
-			y8p = y8_buf + x;
-			y8end = y8p + (GUI_RAW_IMG_H*GUI_RAW_IMG_W);
-			do {
-				t32 = ((uint32_t)(*y16p++ - y16_min) * 255) / diff;
-				*y8p = (t32 > 255) ? 255 : (uint8_t) t32;
-				y8p += GUI_RAW_IMG_H;
-			} while (y8p < y8end);
-		}
-	} else {
-		// Landscape is native format
-		uint16_t* y16p = y16_data;
-		uint16_t* y16end = y16p + (GUI_RAW_IMG_W*GUI_RAW_IMG_H);
-		uint8_t* y8p = y8_buf;
-		do {
-			t32 = ((uint32_t)(*y16p - y16_min) * 255) / diff;
-			*y8p++ = (t32 > 255) ? 255 : (uint8_t) t32;
-		} while (++y16p < y16end);
-	}
+		int r, c;
+#ifndef GUI_RENDER_WASM_SIMD
+		int i;
+#endif
+	
+		for (r=0; r<GUI_RAW_IMG_H; r += 8) {
+			for (c=0; c<GUI_RAW_IMG_W; c += 8) {
+				srcp = src_y8_data + r*GUI_RAW_IMG_W + c;
+				y8p = y8_buf + c*GUI_RAW_IMG_H + (GUI_RAW_IMG_H-1-r);
+#ifdef GUI_RENDER_WASM_SIMD
+				_simd_rotate_tile(srcp, y8p - 7);
 #else
-	// Web data has already been scaled to 8 bits so we recast the y16 pointer and treat
-	// the data as 8 bits - no need to use min/max for scaling
-	if (is_portrait) {
-		// Rotate
-		uint8_t* y16p = (uint8_t*) y16_data;
-		uint8_t* y8p;
-		uint8_t* y8end;
-	
-		for (int x=(GUI_RAW_IMG_H-1); x >= 0; x--) {
-			y8p = y8_buf + x;
-			y8end = y8p + (GUI_RAW_IMG_H*GUI_RAW_IMG_W);
-			do {
-				*y8p = *y16p++;
-				y8p += GUI_RAW_IMG_H;
-			} while (y8p < y8end);
+				for (i=0; i<8; i++) {
+					// One destination row from a column of the tile
+					*y8p       = *(srcp);
+					*(y8p - 1) = *(srcp + 1*GUI_RAW_IMG_W);
+					*(y8p - 2) = *(srcp + 2*GUI_RAW_IMG_W);
+					*(y8p - 3) = *(srcp + 3*GUI_RAW_IMG_W);
+					*(y8p - 4) = *(srcp + 4*GUI_RAW_IMG_W);
+					*(y8p - 5) = *(srcp + 5*GUI_RAW_IMG_W);
+					*(y8p - 6) = *(srcp + 6*GUI_RAW_IMG_W);
+					*(y8p - 7) = *(srcp + 7*GUI_RAW_IMG_W);
+					srcp++;
+					y8p += GUI_RAW_IMG_H;
+				}
+#endif
+			}
 		}
 	} else {
-		// Only have copy it over
-		memcpy(y8_buf, (uint8_t*) y16_data, GUI_RAW_IMG_W*GUI_RAW_IMG_H);
+		// Landscape is native format so we only have copy it over
+		memcpy(y8_buf, src_y8_data, GUI_RAW_IMG_W*GUI_RAW_IMG_H);
 	}
-#endif
 
 	return y8_buf;
 }
 
 
+bool gui_render_y16_enabled(gui_state_t* g)
+{
+#ifdef GUI_RENDER_Y16_LUT
+	// Direct rendering is supported for the native (landscape) orientation and magnifications
+	// of 1.0X and larger with AGC modes that have a fixed mapping for a given AGC range
+	return ((y16_lut != NULL) && !is_portrait && (mag_level != GUI_MAGNIFICATION_0_5) &&
+	        (g->agc_mode != T1C_AGC_MODE_HIST_EQ));
+#else
+	return false;
+#endif
+}
+
+
 void gui_render_image_data(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state_t* g)
 {
+#ifdef GUI_RENDER_Y16_LUT
+	if (raw->y16_render) {
+		_y16_lut_update(raw, g);
+		if (zoom != GUI_ZOOM_1X) {
+			_render_y16_zoom(raw, img);
+			return;
+		}
+		switch (mag_level) {
+			case GUI_MAGNIFICATION_1_5:
+				_render_y16_1_5(raw, img);
+				break;
+			case GUI_MAGNIFICATION_2_0:
+				_render_y16_2_0(raw, img);
+				break;
+			default:
+				_render_y16_1_0(raw, img);
+		}
+		return;
+	}
+#endif
+
+#ifndef ESP_PLATFORM
+	if (gpu_render_cb != NULL) {
+		// The GPU renders the image where it shows through the cleared canvas
+		_render_gpu(raw, img);
+		return;
+	}
+#endif
+
+	if (zoom != GUI_ZOOM_1X) {
+		_render_image_zoom(raw, img);
+		return;
+	}
+	
 	switch (mag_level) {
 		case GUI_MAGNIFICATION_0_5:
 			_render_image_0_5(raw, img, g);
@@ -274,18 +414,12 @@ void gui_render_spotmeter(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 	r = (uint16_t) round(((float) GUI_SPOT_SIZE * mag_factor)) / 2;
 	
 	// Spot center
-	if (is_portrait) {
-		x = (int16_t) round(((float) img_w - (raw->spot_y * mag_factor)));
-		y = (int16_t) round(((float) raw->spot_x * mag_factor));
-	} else {
-		x = (int16_t) round(((float) raw->spot_x * mag_factor));
-		y = (int16_t) round(((float) raw->spot_y * mag_factor));
-	}
+	_raw_to_img_coord(raw->spot_x, raw->spot_y, &x, &y);
 	
 	// Draw a white circle surrounded by a black circle for contrast on
 	// all color palettes
-	_draw_circle(img, x, y, r, COLOR_WHITE);
-	_draw_circle(img, x, y, r+2, COLOR_BLACK);
+	GUI_DRAW(circle)(img, &img_clip, x, y, r, COLOR_WHITE);
+	GUI_DRAW(circle)(img, &img_clip, x, y, r+2, COLOR_BLACK);
 }
 
 
@@ -298,33 +432,7 @@ void gui_render_min_max_markers(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 
 void gui_render_region_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 {
-	int16_t x, y;
-	uint16_t w, h;
-	
-	// Upper left corner and dimensions of spot box
-	if (is_portrait) {
-		// Rotate x, y preserving origin
-		w = (uint16_t) round(((float) (raw->region_y2 - raw->region_y1 + 1) * mag_factor));
-		h = (uint16_t) round(((float) (raw->region_x2 - raw->region_x1 + 1) * mag_factor));
-		x = (int16_t) round(((float) img_w - (raw->region_y2 * mag_factor)));
-		y = (int16_t) round(((float) raw->region_x1 * mag_factor));
-	} else {
-		w = (uint16_t) round(((float) (raw->region_x2 - raw->region_x1 + 1) * mag_factor));
-		h = (uint16_t) round(((float) (raw->region_y2 - raw->region_y1 + 1) * mag_factor));
-		x = (int16_t) round(((float) raw->region_x1 * mag_factor));
-		y = (int16_t) round(((float) raw->region_y1 * mag_factor));
-	}
-	
-	// Draw a white bounding box surrounded by a black bounding box for contrast
-	// on all color palettes
-	_draw_rect(img, x, y, w, h, COLOR_WHITE);
-	
-	x--;
-	y--;
-	w += 2;
-	h += 2;
-	
-	_draw_rect(img, x, y, w, h, COLOR_BLACK);
+	_render_box_marker(img, raw->region_x1, raw->region_y1, raw->region_x2, raw->region_y2);
 }
 
 
@@ -342,17 +450,97 @@ void gui_render_region_drag_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 	
 	// Draw a white bounding box surrounded by a black bounding box for contrast
 	// on all color palettes
-	_draw_rect(img, x, y, w, h, COLOR_WHITE);
+	GUI_DRAW(rect)(img, &img_clip, x, y, w, h, COLOR_WHITE);
 	
 	x--;
 	y--;
 	w += 2;
 	h += 2;
 	
-	_draw_rect(img, x, y, w, h, COLOR_BLACK);
+	GUI_DRAW(rect)(img, &img_clip, x, y, w, h, COLOR_BLACK);
 }
 
 
+// Draws the ROI table entries that have measurements
+void gui_render_roi_markers(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	int i;
+	int16_t x1, y1, x2, y2;
+	int16_t r;
+	
+	r = (uint16_t) round(((float) GUI_ROI_SPOT_SIZE * mag_factor)) / 2;
+	
+	for (i=0; i<raw->roi_num_spots; i++) {
+		if (raw->roi_spot_valid_mask & (1 << i)) {
+			_raw_to_img_coord(raw->roi_spot[i].x, raw->roi_spot[i].y, &x1, &y1);
+			GUI_DRAW(circle)(img, &img_clip, x1, y1, r, COLOR_WHITE);
+			GUI_DRAW(circle)(img, &img_clip, x1, y1, r+1, COLOR_BLACK);
+		}
+	}
+	
+	for (i=0; i<raw->roi_num_rects; i++) {
+		if (raw->roi_rect_valid_mask & (1 << i)) {
+			_render_box_marker(img, raw->roi_rect[i].x1, raw->roi_rect[i].y1, raw->roi_rect[i].x2, raw->roi_rect[i].y2);
+		}
+	}
+	
+	for (i=0; i<raw->roi_num_lines; i++) {
+		if (raw->roi_line_valid_mask & (1 << i)) {
+			// Draw a white line over a black line offset by one pixel for contrast
+			_raw_to_img_coord(raw->roi_line[i].x1, raw->roi_line[i].y1, &x1, &y1);
+			_raw_to_img_coord(raw->roi_line[i].x2, raw->roi_line[i].y2, &x2, &y2);
+			GUI_DRAW(line)(img, &img_clip, x1+1, y1+1, x2+1, y2+1, COLOR_BLACK);
+			GUI_DRAW(line)(img, &img_clip, x1, y1, x2, y2, COLOR_WHITE);
+		}
+	}
+}
+
+
+#ifdef ESP_PLATFORM
+// Marks the changed pixels with a sparse white and black pattern that leaves half of the
+// image visible.  Mask words without changed pixels are skipped quickly.
+void gui_render_change_overlay(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	int i, n;
+	uint16_t raw_x, raw_y;
+	uint32_t bits;
+	uint32_t* maskP = raw->chg_mask;
+	float fx1, fy1, fx2, fy2;
+	int16_t x, y, x1, y1, x2, y2;
+	
+	for (i=0; i<GUI_RAW_IMG_W*GUI_RAW_IMG_H; i+=32) {
+		bits = *maskP++;
+		n = i;
+		while (bits != 0) {
+			if (bits & 1) {
+				// Rendered area covered by the raw pixel
+				raw_x = n % GUI_RAW_IMG_W;
+				raw_y = n / GUI_RAW_IMG_W;
+				_raw_to_img_coordf(raw_x, raw_y, &fx1, &fy1);
+				_raw_to_img_coordf(raw_x + 1, raw_y + 1, &fx2, &fy2);
+				x1 = (int16_t) round((fx1 < fx2) ? fx1 : fx2);
+				x2 = (int16_t) round((fx1 < fx2) ? fx2 : fx1) - 1;
+				y1 = (int16_t) round((fy1 < fy2) ? fy1 : fy2);
+				y2 = (int16_t) round((fy1 < fy2) ? fy2 : fy1) - 1;
+				
+				for (y=y1; y<=y2; y++) {
+					for (x=x1; x<=x2; x++) {
+						if (((x + y) & 3) == 0) {
+							GUI_DRAW(pixel)(img, &img_clip, x, y, COLOR_WHITE);
+						} else if (((x + y) & 3) == 2) {
+							GUI_DRAW(pixel)(img, &img_clip, x, y, COLOR_BLACK);
+						}
+					}
+				}
+			}
+			bits >>= 1;
+			n++;
+		}
+	}
+}
+#endif
+
+
 void gui_render_freeze_marker(GUI_REND_IMG_T* img)
 {
 	int16_t x, y;
@@ -367,10 +555,130 @@ void gui_render_freeze_marker(GUI_REND_IMG_T* img)
 	y = 10;
 	
 	// Draw a black bounding box
-	_draw_rect(img, x - 1, y - 1, w + 2, h + 2, COLOR_BLACK);
+	GUI_DRAW(rect)(img, &img_clip, x - 1, y - 1, w + 2, h + 2, COLOR_BLACK);
 	
 	// Draw the inner white box
-	_draw_fill_rect(img, x, y, w, h, COLOR_WHITE);
+	GUI_DRAW(fill_rect)(img, &img_clip, x, y, w, h, COLOR_WHITE);
+}
+
+
+#ifndef ESP_PLATFORM
+// Register a GPU renderer to take over rendering the image data (NULL to render on the CPU)
+void gui_render_set_gpu_renderer(gui_render_gpu_cb_t cb)
+{
+	gpu_render_cb = cb;
+}
+
+
+// Set the screen position of the upper-left corner of the rendered image for the GPU renderer
+void gui_render_set_screen_pos(int16_t x, int16_t y)
+{
+	gpu_screen_x = x;
+	gpu_screen_y = y;
+}
+
+
+// Tell the GPU renderer the image is no longer displayed
+void gui_render_gpu_hide()
+{
+	if (gpu_render_cb != NULL) {
+		gpu_render_cb(NULL, NULL);
+	}
+}
+#endif
+
+
+void gui_render_set_zoom(uint16_t z, uint16_t raw_x, uint16_t raw_y)
+{
+	if (z < GUI_ZOOM_1X) z = GUI_ZOOM_1X;
+	if (z > GUI_ZOOM_MAX) z = GUI_ZOOM_MAX;
+	
+	zoom = z;
+	zoom_cx = raw_x;
+	zoom_cy = raw_y;
+	_zoom_update();
+}
+
+
+uint16_t gui_render_get_zoom()
+{
+	return zoom;
+}
+
+
+void gui_render_pan(int16_t dx, int16_t dy)
+{
+	if (zoom == GUI_ZOOM_1X) return;
+	
+	// Dragging the image moves the center the opposite way
+	if (is_portrait) {
+		zoom_cx -= dy / zoom_scale;
+		zoom_cy += dx / zoom_scale;
+	} else {
+		zoom_cx -= dx / zoom_scale;
+		zoom_cy -= dy / zoom_scale;
+	}
+	_zoom_update();
+}
+
+
+// Get the inclusive raw image region visible in the rendered image (with a one pixel margin
+// for the resampler).  This is the whole image when not zoomed.
+void gui_render_get_zoom_region(uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2)
+{
+	float fx1, fy1, fx2, fy2;
+	float t;
+	
+	if (zoom == GUI_ZOOM_1X) {
+		*x1 = 0;
+		*y1 = 0;
+		*x2 = GUI_RAW_IMG_W-1;
+		*y2 = GUI_RAW_IMG_H-1;
+		return;
+	}
+	
+	// Opposite corners of the visible source region in raw coordinates
+	_src_to_raw_coord(zoom_ox, zoom_oy, &fx1, &fy1);
+	_src_to_raw_coord(zoom_ox + img_w / zoom_scale, zoom_oy + img_h / zoom_scale, &fx2, &fy2);
+	if (fx1 > fx2) {
+		t = fx1;
+		fx1 = fx2;
+		fx2 = t;
+	}
+	if (fy1 > fy2) {
+		t = fy1;
+		fy1 = fy2;
+		fy2 = t;
+	}
+	
+	fx1 = floor(fx1) - 1;
+	fy1 = floor(fy1) - 1;
+	fx2 = ceil(fx2) + 1;
+	fy2 = ceil(fy2) + 1;
+	*x1 = (fx1 < 0) ? 0 : (uint16_t) fx1;
+	*y1 = (fy1 < 0) ? 0 : (uint16_t) fy1;
+	*x2 = (fx2 > (GUI_RAW_IMG_W-1)) ? GUI_RAW_IMG_W-1 : (uint16_t) fx2;
+	*y2 = (fy2 > (GUI_RAW_IMG_H-1)) ? GUI_RAW_IMG_H-1 : (uint16_t) fy2;
+}
+
+
+// Convert a rendered image coordinate (for example a touch) to the raw image coordinate
+// it shows
+void gui_render_img_to_raw_coord(int16_t x, int16_t y, uint16_t* raw_x, uint16_t* raw_y)
+{
+	float fx, fy;
+	
+	_src_to_raw_coord(zoom_ox + x / zoom_scale, zoom_oy + y / zoom_scale, &fx, &fy);
+	
+	fx = round(fx);
+	fy = round(fy);
+	if (fx < 0) fx = 0;
+	if (fx > (GUI_RAW_IMG_W-1)) fx = GUI_RAW_IMG_W-1;
+	if (fy < 0) fy = 0;
+	if (fy > (GUI_RAW_IMG_H-1)) fy = GUI_RAW_IMG_H-1;
+	
+	*raw_x = (uint16_t) fx;
+	*raw_y = (uint16_t) fy;
 }
 
 
@@ -391,6 +699,26 @@ static void _render_image_0_5(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state
 	
 	// Average the 4 surrounding pixels into 1
 	while (row<img_h) {
+#ifdef GUI_RENDER_WASM_SIMD
+		// 8 pixels at a time from the horizontal pair sums of both rows
+		for (col=0; col<(img_w & ~7); col += 8) {
+			v128_t v = wasm_i16x8_add(wasm_u16x8_extadd_pairwise_u8x16(wasm_v128_load(src1)),
+			                          wasm_u16x8_extadd_pairwise_u8x16(wasm_v128_load(src2)));
+			v = wasm_u16x8_shr(v, 2);
+			wasm_v128_store64_lane(&simd_idx[0][col], wasm_u8x16_narrow_i16x8(v, v), 0);
+			src1 += 16;
+			src2 += 16;
+		}
+		for (; col<img_w; col++) {
+			s = *src1++;
+			s += *src2++;
+			s += *src1++;
+			s += *src2++;
+			simd_idx[0][col] = s/4;
+		}
+		_simd_palette_row(simd_idx[0], dst, img_w);
+		dst += img_w;
+#else
 		for (col=0; col<img_w; col++) {
 			// Each dest pixel is made up of 4 src pixels
 			s = *src1++;
@@ -399,6 +727,7 @@ static void _render_image_0_5(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state
 			s += *src2++;
 			*dst++ = PALETTE_LOOKUP(s/4);
 		}
+#endif
 		src1 += (img_w*2);
 		src2 += (img_w*2);
 		row += 2;
@@ -487,222 +816,157 @@ static void _render_image_1_5(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state
 static void _render_image_2_0(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state_t* g)
 {
 	uint8_t* src = raw->y8_data;
-	uint16_t src_w = img_w/2;
-	uint16_t src_h = img_h/2;
-	
-	// Corner pixels
-	_interp_set_pixel(*src, img, 0, 0);
-	_interp_set_pixel(*(src + (src_w-1)), img, img_w-1, 0);
-	_interp_set_pixel(*(src + src_w*(src_h-1)), img, 0, img_h-1);
-	_interp_set_pixel(*(src + src_w*(src_h-1) + (src_w-1)), img, img_w-1, img_h-1);
+	int16_t src_w = img_w/2;
+	int16_t src_h = img_h/2;
+	int y;
 	
-	// Top/Bottom rows
-	_interp_set_outer_row(src, img, src_w, src_h, true);
-	_interp_set_outer_row(src, img, src_w, src_h, false);
+	// Top row (the source row is its own vertical neighbor so it is written twice)
+	_interp_row_pair(src, src, img, img, src_w);
+	img += img_w;
 	
-	// Left/Right columns
-	_interp_set_outer_col(src, img, src_w, src_h, true);
-	_interp_set_outer_col(src, img, src_w, src_h, false);
+	// Rows between each pair of source rows
+	for (y=0; y<src_h-1; y++) {
+		_interp_row_pair(src, src + src_w, img, img + img_w, src_w);
+		src += src_w;
+		img += 2*img_w;
+	}
 	
-	// Inner pixels
-	_interp_set_inner(src, src_w, src_h, img);
+	// Bottom row
+	_interp_row_pair(src, src, img, img, src_w);
 }
 
 
 static void _render_min_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 {
 	int16_t x1, xm, x2, y1, y2;
+	float xc, yc;
 	
 	// Compute a bounding box around the marker triangle
-	if (is_portrait) {
-		x1 = (int16_t) round(img_w - (raw->min_y * mag_factor) - (GUI_MARKER_SIZE/2) * mag_factor);
-		xm = (int16_t) round(img_w - (raw->min_y * mag_factor));
-		y1 = (int16_t) round(raw->min_x * mag_factor - (GUI_MARKER_SIZE/2) * mag_factor);
-	} else {
-		x1 = (int16_t) round(raw->min_x * mag_factor - (GUI_MARKER_SIZE/2) * mag_factor);
-		xm = (int16_t) round(raw->min_x * mag_factor);
-		y1 = (int16_t) round(raw->min_y * mag_factor - (GUI_MARKER_SIZE/2) * mag_factor);
-	}
+	_raw_to_img_coordf(raw->min_x, raw->min_y, &xc, &yc);
+	x1 = (int16_t) round(xc - (GUI_MARKER_SIZE/2) * mag_factor);
+	xm = (int16_t) round(xc);
+	y1 = (int16_t) round(yc - (GUI_MARKER_SIZE/2) * mag_factor);
 	x2 = x1 + GUI_MARKER_SIZE * mag_factor;
 	y2 = y1 + GUI_MARKER_SIZE * mag_factor;
 	
 	// Draw a white downward facing triangle surrounded by a black triangle for contrast
-	_draw_hline(img, x1, x2, y1, COLOR_WHITE);
-	_draw_line(img, x1, y1, xm, y2, COLOR_WHITE);
-	_draw_line(img, xm, y2, x2, y1, COLOR_WHITE);
+	GUI_DRAW(hline)(img, &img_clip, x1, x2, y1, COLOR_WHITE);
+	GUI_DRAW(line)(img, &img_clip, x1, y1, xm, y2, COLOR_WHITE);
+	GUI_DRAW(line)(img, &img_clip, xm, y2, x2, y1, COLOR_WHITE);
 	
 	x1--;
 	y1--;
 	x2++;
 	y2++;
 	
-	_draw_hline(img, x1, x2, y1, COLOR_BLACK);
-	_draw_line(img, x1, y1, xm, y2, COLOR_BLACK);
-	_draw_line(img, xm, y2, x2, y1, COLOR_BLACK);
+	GUI_DRAW(hline)(img, &img_clip, x1, x2, y1, COLOR_BLACK);
+	GUI_DRAW(line)(img, &img_clip, x1, y1, xm, y2, COLOR_BLACK);
+	GUI_DRAW(line)(img, &img_clip, xm, y2, x2, y1, COLOR_BLACK);
 }
 
 
 static void _render_max_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 {
 	int16_t x1, xm, x2, y1, y2;
+	float xc, yc;
 	
 	// Compute a bounding box around the marker triangle
-	if (is_portrait) {
-		x1 = (int16_t) round(img_w - (raw->max_y * mag_factor) - (GUI_MARKER_SIZE/2) * mag_factor);
-		xm = (int16_t) round(img_w - (raw->max_y * mag_factor));
-		y1 = (int16_t) round(raw->max_x * mag_factor - (GUI_MARKER_SIZE/2) * mag_factor);
-	} else {
-		x1 = (int16_t) round(raw->max_x * mag_factor - (GUI_MARKER_SIZE/2) * mag_factor);
-		xm = (int16_t) round(raw->max_x * mag_factor);
-		y1 = (int16_t) round(raw->max_y * mag_factor - (GUI_MARKER_SIZE/2) * mag_factor);
-	}
+	_raw_to_img_coordf(raw->max_x, raw->max_y, &xc, &yc);
+	x1 = (int16_t) round(xc - (GUI_MARKER_SIZE/2) * mag_factor);
+	xm = (int16_t) round(xc);
+	y1 = (int16_t) round(yc - (GUI_MARKER_SIZE/2) * mag_factor);
 	x2 = x1 + GUI_MARKER_SIZE * mag_factor;
 	y2 = y1 + GUI_MARKER_SIZE * mag_factor;
 	
 	// Draw a white upward facing triangle surrounded by a black triangle for contrast
-	_draw_hline(img, x1, x2, y2, COLOR_WHITE);
-	_draw_line(img, x1, y2, xm, y1, COLOR_WHITE);
-	_draw_line(img, xm, y1, x2, y2, COLOR_WHITE);
+	GUI_DRAW(hline)(img, &img_clip, x1, x2, y2, COLOR_WHITE);
+	GUI_DRAW(line)(img, &img_clip, x1, y2, xm, y1, COLOR_WHITE);
+	GUI_DRAW(line)(img, &img_clip, xm, y1, x2, y2, COLOR_WHITE);
 	
 	x1--;
 	y1--;
 	x2++;
 	y2++;
 	
-	_draw_hline(img, x1, x2, y2, COLOR_BLACK);
-	_draw_line(img, x1, y2, xm, y1, COLOR_BLACK);
-	_draw_line(img, xm, y1, x2, y2, COLOR_BLACK);
+	GUI_DRAW(hline)(img, &img_clip, x1, x2, y2, COLOR_BLACK);
+	GUI_DRAW(line)(img, &img_clip, x1, y2, xm, y1, COLOR_BLACK);
+	GUI_DRAW(line)(img, &img_clip, xm, y1, x2, y2, COLOR_BLACK);
 }
 
 
-static void _draw_hline(GUI_REND_IMG_T* img, int16_t x1, int16_t x2, int16_t y, GUI_REND_IMG_T c)
+static void _render_box_marker(GUI_REND_IMG_T* img, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 {
-	GUI_REND_IMG_T* imgP;
-	
-	if ((y < 0) || (y >= img_h)) return;
-	
-	imgP = img + y*img_w + x1;
+	int16_t x, y;
+	uint16_t w, h;
 	
-	while (x1 <= x2) {
-		if ((x1 >= 0) && (x1 < img_w)) {
-			*imgP = c;
-		}
-		imgP++;
-		x1++;
+	// Upper left corner and dimensions of box
+	if (is_portrait) {
+		// Rotate x, y preserving origin
+		w = (uint16_t) round(((float) (y2 - y1 + 1) * zoom_scale));
+		h = (uint16_t) round(((float) (x2 - x1 + 1) * zoom_scale));
+		_raw_to_img_coord(x1, y2, &x, &y);
+	} else {
+		w = (uint16_t) round(((float) (x2 - x1 + 1) * zoom_scale));
+		h = (uint16_t) round(((float) (y2 - y1 + 1) * zoom_scale));
+		_raw_to_img_coord(x1, y1, &x, &y);
 	}
-}
-
-
-static void _draw_vline(GUI_REND_IMG_T* img, int16_t x, int16_t y1, int16_t y2, GUI_REND_IMG_T c)
-{
-	GUI_REND_IMG_T* imgP;
 	
-	if ((x < 0) || (x >= img_w)) return;
+	// Draw a white bounding box surrounded by a black bounding box for contrast
+	// on all color palettes
+	GUI_DRAW(rect)(img, &img_clip, x, y, w, h, COLOR_WHITE);
 	
-	imgP = img + y1*img_w + x;
+	x--;
+	y--;
+	w += 2;
+	h += 2;
 	
-	while (y1 <= y2) {
-		if ((y1 >= 0) && (y1 < img_h)) {
-			*imgP = c;
-		}
-		imgP += img_w;
-		y1++;
-	}
+	GUI_DRAW(rect)(img, &img_clip, x, y, w, h, COLOR_BLACK);
 }
 
 
-static void _draw_line(GUI_REND_IMG_T* img, int16_t x1, int16_t y1, int16_t x2, int16_t y2, GUI_REND_IMG_T c)
+// Convert a raw image coordinate to the rendered (rotated, magnified and zoomed) image
+static void _raw_to_img_coord(uint16_t raw_x, uint16_t raw_y, int16_t* x, int16_t* y)
 {
-	int16_t dx = abs(x2 - x1);
-	int16_t dy = -abs(y2 - y1);
-	int16_t err = dx + dy;
-	int16_t e2;
-	int16_t sx = (x1 < x2) ? 1 : -1;
-	int16_t sy = (y1 < y2) ? 1 : -1;
+	float fx, fy;
 	
-	for (;;) {
-		if ((x1 >= 0) && (x1 < img_w) && (y1 >= 0) && (y1 < img_h)) {
-			*(img + x1 + img_w*y1) = c;
-		}
-		
-		if ((x1 == x2) && (y1 == y2)) break;
-		
-		e2 = 2 * err;
-		if (e2 >= dy) {
-			err += dy;
-			x1 += sx;
-		}
-		if (e2 <= dx) {
-			err += dx;
-			y1 += sy;
-		}
-	}
-}
-
-
-static void _draw_circle(GUI_REND_IMG_T* img, int16_t x0, int16_t y0, int16_t r, GUI_REND_IMG_T c)
-{
-	int16_t f = 1 - r;
-	int16_t ddF_x = 1;
-	int16_t ddF_y = -2 * r;
-	int16_t x = 0;
-	int16_t y = r;
-
-	_draw_pixel(img, x0, y0 + r, c);
-	_draw_pixel(img, x0, y0 - r, c);
-	_draw_pixel(img, x0 + r, y0, c);
-	_draw_pixel(img, x0 - r, y0, c);
-
-	while (x < y) {
-		if (f >= 0) {
-			y--;
-			ddF_y += 2;
-			f += ddF_y;
-		}
-		x++;
-		ddF_x += 2;
-		f += ddF_x;
-		
-		_draw_pixel(img, x0 + x, y0 + y, c);
-		_draw_pixel(img, x0 - x, y0 + y, c);
-		_draw_pixel(img, x0 + x, y0 - y, c);
-		_draw_pixel(img, x0 - x, y0 - y, c);
-		_draw_pixel(img, x0 + y, y0 + x, c);
-		_draw_pixel(img, x0 - y, y0 + x, c);
-		_draw_pixel(img, x0 + y, y0 - x, c);
-		_draw_pixel(img, x0 - y, y0 - x, c);
-	}
+	_raw_to_img_coordf(raw_x, raw_y, &fx, &fy);
+	*x = (int16_t) round(fx);
+	*y = (int16_t) round(fy);
 }
 
 
-static void _draw_rect(GUI_REND_IMG_T* img, int16_t x, int16_t y, int16_t w, int16_t h, GUI_REND_IMG_T c)
+static void _raw_to_img_coordf(float raw_x, float raw_y, float* x, float* y)
 {
-	int16_t x1 = x + w - 1;
-	int16_t y1 = y + h - 1;
+	float u, v;
 	
-	_draw_hline(img, x, x1, y, c);
-	_draw_hline(img, x, x1, y1, c);
-	_draw_vline(img, x, y, y1, c);
-	_draw_vline(img, x1, y, y1, c);
+	_raw_to_src_coord(raw_x, raw_y, &u, &v);
+	*x = (u - zoom_ox) * zoom_scale;
+	*y = (v - zoom_oy) * zoom_scale;
 }
 
 
-static void _draw_fill_rect(GUI_REND_IMG_T* img, int16_t x, int16_t y, int16_t w, int16_t h, GUI_REND_IMG_T c)
+// Convert a raw image coordinate to the (rotated) source image being rendered
+static void _raw_to_src_coord(float raw_x, float raw_y, float* u, float* v)
 {
-	int16_t x1 = x + w - 1;
-	int16_t y1 = y + h - 1;
-	
-	do {
-		_draw_hline(img, x, x1, y, c);
-	} while (++y < y1);
+	if (is_portrait) {
+		*u = (float) GUI_RAW_IMG_H - raw_y;
+		*v = raw_x;
+	} else {
+		*u = raw_x;
+		*v = raw_y;
+	}
 }
 
 
-static __inline__ void _draw_pixel(GUI_REND_IMG_T* img, int16_t x, int16_t y, GUI_REND_IMG_T c)
+static void _src_to_raw_coord(float u, float v, float* raw_x, float* raw_y)
 {
-	if ((x < 0) || (x >= img_w)) return;
-	if ((y < 0) || (y >= img_h)) return;
-	*(img + x + y*img_w) = c;
+	if (is_portrait) {
+		*raw_x = v;
+		*raw_y = (float) GUI_RAW_IMG_H - u;
+	} else {
+		*raw_x = u;
+		*raw_y = v;
+	}
 }
 
 
@@ -726,152 +990,530 @@ static __inline__ void _draw_pixel(GUI_REND_IMG_T* img, int16_t x, int16_t y, GU
  *      | c | d | | c | d |
  *      +---+---+ +---+---+
  * 
- * There are three cases to calculate:
- *   1. The four corners of the source array (Aa, Bb, Cc, and Dd here)
- *      - These are simply set to the value of the source pixel (A, B, C and D)
- *   2. The outer edges of the source array (Ab, Ba, Ac, Bd, Ca, Db, Dc, Dc)
- *      - The sub-pixel value is based on two source pixels (the owning pixel and its neighbor)
- *      - The owning pixel contributes more to the sub-pixel by a Scale Factor (SF)
- *      - The sub-pixel = (SF * Owning Pixel + Neighbor Pixel) / DIV
- *      - The divisor scales the sum back to 8-bits = SF + 1
- *   3. The inner sub-pixels (Ad, Bc, Cb, Da)
- *      - The sub-pixel value is based on four source pixels (the owning pixel and its neighbors)
- *      - The owning pixel contributes more to the sub-pixel by a Scale Factor (SF)
- *      - The sub-pixel = (SF * Owning Pixel + 3 Neighbor Pixels) / DIV
- *      - The divisor scales the sum back to 8-bits = SF + 3
+ * Each sub-pixel is (5 * owning pixel + the 3 neighbors toward it) / 8.  With P the sum
+ * of the two source rows in a column this is (4 * owning pixel + P(owning column) +
+ * P(neighbor column)) / 8 so the two destination rows between a pair of source rows are
+ * computed together from one set of column sums, two sub-pixels at a time.  Neighbors
+ * outside the source array are clamped to the edge which reduces to (3 * owning pixel +
+ * neighbor) / 4 along the edges and the source pixel at the corners.
  *
  */
  
- 
+
+#ifdef GUI_RENDER_WASM_SIMD
 /**
- * Set a single pixel in the segment buffer
- *   d contains source buffer 8-bit value
- *   img points to display buffer
- *   x, y specify position in display buffer
+ * Compute the destination rows owned by source rows srcA (into dstA) and srcB (into dstB)
+ * where each is the other's vertical neighbor.  The column sums are stored with the clamped
+ * neighbors at each end so 8 source pixels are done at a time without edge cases.  src_w
+ * must be a multiple of 8.
  */
-static void _interp_set_pixel(uint8_t src, GUI_REND_IMG_T* img, int x, int y)
+static void _interp_row_pair(uint8_t* srcA, uint8_t* srcB, GUI_REND_IMG_T* dstA, GUI_REND_IMG_T* dstB, int16_t src_w)
 {
-	*(img + y*img_w + x) = PALETTE_LOOKUP(src);
+	int x;
+	uint16_t* P = simd_psum;
+	v128_t A, B;      // 4 * owning pixels
+	v128_t P0, P1, P2;
+	v128_t e, o;
+	
+	for (x=0; x<src_w; x += 8) {
+		wasm_v128_store(&P[x+1], wasm_i16x8_add(wasm_u16x8_load8x8(srcA + x), wasm_u16x8_load8x8(srcB + x)));
+	}
+	P[0] = P[1];
+	P[src_w+1] = P[src_w];
+	
+	for (x=0; x<src_w; x += 8) {
+		A = wasm_i16x8_shl(wasm_u16x8_load8x8(srcA + x), 2);
+		B = wasm_i16x8_shl(wasm_u16x8_load8x8(srcB + x), 2);
+		P0 = wasm_v128_load(&P[x]);
+		P1 = wasm_v128_load(&P[x+1]);
+		P2 = wasm_v128_load(&P[x+2]);
+		
+		// Even and odd sub-pixels interleaved
+		e = wasm_u16x8_shr(wasm_i16x8_add(A, wasm_i16x8_add(P0, P1)), 3);
+		o = wasm_u16x8_shr(wasm_i16x8_add(A, wasm_i16x8_add(P1, P2)), 3);
+		wasm_v128_store(&simd_idx[0][2*x], wasm_u8x16_narrow_i16x8(wasm_i16x8_shuffle(e, o, 0, 8, 1, 9, 2, 10, 3, 11),
+		                                                           wasm_i16x8_shuffle(e, o, 4, 12, 5, 13, 6, 14, 7, 15)));
+		e = wasm_u16x8_shr(wasm_i16x8_add(B, wasm_i16x8_add(P0, P1)), 3);
+		o = wasm_u16x8_shr(wasm_i16x8_add(B, wasm_i16x8_add(P1, P2)), 3);
+		wasm_v128_store(&simd_idx[1][2*x], wasm_u8x16_narrow_i16x8(wasm_i16x8_shuffle(e, o, 0, 8, 1, 9, 2, 10, 3, 11),
+		                                                           wasm_i16x8_shuffle(e, o, 4, 12, 5, 13, 6, 14, 7, 15)));
+	}
+	
+	_simd_palette_row(simd_idx[0], dstA, 2*src_w);
+	_simd_palette_row(simd_idx[1], dstB, 2*src_w);
 }
-
-
+#else
 /**
- * Process either the top or bottom row in the destination buffer where each pixel
- * only depends on contributions from two source locations.
- *   src points to the lepton source buffer
- *   img points to the display buffer
- *   first_row indicates top or bottom
+ * Compute the destination rows owned by source rows srcA (into dstA) and srcB (into dstB)
+ * where each is the other's vertical neighbor.
  */
-static void _interp_set_outer_row(uint8_t* src, GUI_REND_IMG_T* img, int16_t src_w, int16_t src_h, bool first_row)
+static void _interp_row_pair(uint8_t* srcA, uint8_t* srcB, GUI_REND_IMG_T* dstA, GUI_REND_IMG_T* dstB, int16_t src_w)
 {
 	int x;
-	uint8_t A, B, sub_pixel;
+	uint32_t A, B;        // 4 * owning pixels
+	uint32_t P0, P1, P2;  // Column sums to the left, at and to the right of the owning pixels
 	
-	// Set the pointers to the start of the row to load
-	if (first_row) {
-		// Top row starting 1 pixel in (dest)
-		img += 1;
-	} else {
-		// Bottom row starting 1 pixel in (dest)
-		src += (src_h-1)*src_w;
-		img += (img_h-1)*img_w + 1;
-	}
-	
-	// Inner pixels
-	B = *src;
+	// Left neighbor clamped
+	P1 = *srcA + *srcB;
+	P0 = P1;
 	for (x=0; x<src_w-1; x++) {
-		A = B;
-		B = *++src;
+		A = *srcA++ << 2;
+		B = *srcB++ << 2;
+		P2 = *srcA + *srcB;
 		
-		// Left sub-pixel Ab (top) / Ad (bottom)
-		sub_pixel = (SF_DS*A + B) / DIV_DS;
-		*img++ = PALETTE_LOOKUP(sub_pixel);
+		STORE_PIXEL_PAIR(dstA, PALETTE_LOOKUP((A + P0 + P1) >> 3), PALETTE_LOOKUP((A + P1 + P2) >> 3));
+		STORE_PIXEL_PAIR(dstB, PALETTE_LOOKUP((B + P0 + P1) >> 3), PALETTE_LOOKUP((B + P1 + P2) >> 3));
+		dstA += 2;
+		dstB += 2;
 		
-		// Right sub-pixel Ba (top) / Bc (bottom)
-		sub_pixel = (A + SF_DS*B) / DIV_DS;
-		*img++ = PALETTE_LOOKUP(sub_pixel);
+		P0 = P1;
+		P1 = P2;
 	}
+	
+	// Right neighbor clamped
+	A = *srcA << 2;
+	B = *srcB << 2;
+	STORE_PIXEL_PAIR(dstA, PALETTE_LOOKUP((A + P0 + P1) >> 3), PALETTE_LOOKUP((A + P1 + P1) >> 3));
+	STORE_PIXEL_PAIR(dstB, PALETTE_LOOKUP((B + P0 + P1) >> 3), PALETTE_LOOKUP((B + P1 + P1) >> 3));
 }
+#endif
 
 
-static void _interp_set_outer_col(uint8_t* src, GUI_REND_IMG_T* img, int16_t src_w, int16_t src_h, bool first_col)
+/******
+ *
+ * Zoom Resampler
+ *
+ * A zoomed image is rendered by bilinear resampling of the part of the (rotated) source image
+ * that fits.  The source index and fixed point weight for each rendered column and row are
+ * precomputed when the zoom changes.  Each source row needed is resampled horizontally once
+ * into zoom_hrow (moving down one source row reuses the previous lower row) and each rendered
+ * row is a vertical blend of two of them.
+ *
+ */
+static void _zoom_update()
 {
-	int y;
-	uint8_t A, B, sub_pixel;
+	int16_t src_w = is_portrait ? GUI_RAW_IMG_H : GUI_RAW_IMG_W;
+	int16_t src_h = is_portrait ? GUI_RAW_IMG_W : GUI_RAW_IMG_H;
+	float u, v;
+	float ws, hs;
+	
+	if (zoom == GUI_ZOOM_1X) {
+		zoom_scale = mag_factor;
+		zoom_ox = 0;
+		zoom_oy = 0;
+		return;
+	}
+	
+	// Size of the visible source region
+	zoom_scale = mag_factor * zoom / GUI_ZOOM_1X;
+	ws = img_w / zoom_scale;
+	hs = img_h / zoom_scale;
+	
+	// Keep the visible region inside the image
+	_raw_to_src_coord(zoom_cx, zoom_cy, &u, &v);
+	zoom_ox = u - ws/2;
+	if (zoom_ox > (src_w - ws)) zoom_ox = src_w - ws;
+	if (zoom_ox < 0) zoom_ox = 0;
+	zoom_oy = v - hs/2;
+	if (zoom_oy > (src_h - hs)) zoom_oy = src_h - hs;
+	if (zoom_oy < 0) zoom_oy = 0;
+	
+	// Limit the center too so panning back from an edge responds immediately
+	_src_to_raw_coord(zoom_ox + ws/2, zoom_oy + hs/2, &zoom_cx, &zoom_cy);
+	
+	_zoom_setup_table(zoom_ox, img_w, src_w, zoom_col_index, zoom_col_wt);
+	_zoom_setup_table(zoom_oy, img_h, src_h, zoom_row_index, zoom_row_wt);
+}
+
+
+static void _zoom_setup_table(float o, int16_t dst_len, int16_t src_len, uint16_t* index, uint8_t* wt)
+{
+	int i, n, w;
+	float s;
+	
+	for (i=0; i<dst_len; i++) {
+		// Source coordinate at the center of the rendered pixel
+		s = o + ((float) i + 0.5) / zoom_scale - 0.5;
+		if (s < 0) s = 0;
+		n = (int) s;
+		w = (int) round((s - n) * ZOOM_WT_ONE);
+		
+		// The following pixel must be in the image
+		if (n >= (src_len - 1)) {
+			n = src_len - 2;
+			w = ZOOM_WT_ONE;
+		}
+		index[i] = n;
+		wt[i] = w;
+	}
+}
+
+
+static void _render_image_zoom(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	uint8_t* src = raw->y8_data;
+	int16_t src_w = is_portrait ? GUI_RAW_IMG_H : GUI_RAW_IMG_W;
+	uint32_t* h0 = zoom_hrow[0];
+	uint32_t* h1 = zoom_hrow[1];
+	uint32_t* t;
+	uint32_t wa, wb;
+	int n;
+	int cur_n = -2;
+	int x, y;
 	
-	// Set the pointers to the start of the column to load
-	if (first_col) {
-		// Left column starting 1 pixel down (dest)
+	for (y=0; y<img_h; y++) {
+		// Get the horizontally resampled source rows around this row
+		n = zoom_row_index[y];
+		if (n != cur_n) {
+			if (n == (cur_n + 1)) {
+				t = h0;
+				h0 = h1;
+				h1 = t;
+			} else {
+				_zoom_hrow(src + n*src_w, h0);
+			}
+			_zoom_hrow(src + (n+1)*src_w, h1);
+			cur_n = n;
+		}
+		
+		// Blend them vertically
+		wb = zoom_row_wt[y];
+		wa = ZOOM_WT_ONE - wb;
+#ifdef GUI_RENDER_WASM_SIMD
+		for (x=0; x<(img_w & ~7); x += 8) {
+			// The weights sum to ZOOM_WT_ONE so the blend fits in 16 bits
+			v128_t a = wasm_u16x8_narrow_i32x4(wasm_v128_load(&h0[x]), wasm_v128_load(&h0[x+4]));
+			v128_t b = wasm_u16x8_narrow_i32x4(wasm_v128_load(&h1[x]), wasm_v128_load(&h1[x+4]));
+			v128_t v = wasm_i16x8_add(wasm_i16x8_mul(a, wasm_i16x8_splat(wa)), wasm_i16x8_mul(b, wasm_i16x8_splat(wb)));
+			v = wasm_u16x8_shr(v, 2*ZOOM_WT_BITS);
+			wasm_v128_store64_lane(&simd_idx[0][x], wasm_u8x16_narrow_i16x8(v, v), 0);
+		}
+		for (; x<img_w; x++) {
+			simd_idx[0][x] = (wa*h0[x] + wb*h1[x]) >> (2*ZOOM_WT_BITS);
+		}
+		_simd_palette_row(simd_idx[0], img, img_w);
 		img += img_w;
-	} else {
-		// Right column starting 1 pixel down (dest)
-		src += src_w - 1;
-		img += img_w + (img_w-1);
+#else
+		for (x=0; x<img_w; x += 2) {
+			STORE_PIXEL_PAIR(img, PALETTE_LOOKUP((wa*h0[x] + wb*h1[x]) >> (2*ZOOM_WT_BITS)),
+			                      PALETTE_LOOKUP((wa*h0[x+1] + wb*h1[x+1]) >> (2*ZOOM_WT_BITS)));
+			img += 2;
+		}
+#endif
+	}
+}
+
+
+static void _zoom_hrow(uint8_t* src, uint32_t* dst)
+{
+	int x;
+	uint8_t* p;
+	uint32_t w;
+	
+	for (x=0; x<img_w; x++) {
+		p = src + zoom_col_index[x];
+		w = zoom_col_wt[x];
+		*dst++ = (ZOOM_WT_ONE - w) * p[0] + w * p[1];
 	}
+}
+
+
+#ifndef ESP_PLATFORM
+/*
+ * GPU rendering
+ *
+ * The image is cleared to the transparent GUI_RENDER_GPU_KEY so the markers can still be
+ * drawn over it on the CPU and the y8 data is handed to the GPU renderer along with the view
+ * which it magnifies, zooms and colors where the key shows through on the screen.
+ */
+static void _render_gpu(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	gui_render_gpu_view_t view;
+	
+	// GUI_RENDER_GPU_KEY is all zero bytes
+	memset(img, 0, img_w*img_h*sizeof(GUI_REND_IMG_T));
+	
+	view.x = gpu_screen_x;
+	view.y = gpu_screen_y;
+	view.w = img_w;
+	view.h = img_h;
+	view.src_w = is_portrait ? GUI_RAW_IMG_H : GUI_RAW_IMG_W;
+	view.src_h = is_portrait ? GUI_RAW_IMG_W : GUI_RAW_IMG_H;
+	view.ox = zoom_ox;
+	view.oy = zoom_oy;
+	view.scale = zoom_scale;
+	gpu_render_cb(raw->y8_data, &view);
+}
+#endif
+
+
+#ifdef GUI_RENDER_WASM_SIMD
+/*
+ * WASM SIMD helpers
+ */
+
+// Rotate an 8x8 tile for portrait orientation.  Destination row c (GUI_RAW_IMG_H apart)
+// gets source column c from the bottom row up.  Interleaving 8, 16 and then 32-bit lanes of
+// the source rows (bottom up) turns each 64-bit lane into one of those columns.
+static void _simd_rotate_tile(uint8_t* src, uint8_t* dst)
+{
+	v128_t t0, t1, t2, t3;
+	v128_t u0, u1, u2, u3;
+	
+	t0 = wasm_i8x16_shuffle(wasm_v128_load64_zero(src + 7*GUI_RAW_IMG_W), wasm_v128_load64_zero(src + 6*GUI_RAW_IMG_W),
+	                        0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+	t1 = wasm_i8x16_shuffle(wasm_v128_load64_zero(src + 5*GUI_RAW_IMG_W), wasm_v128_load64_zero(src + 4*GUI_RAW_IMG_W),
+	                        0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+	t2 = wasm_i8x16_shuffle(wasm_v128_load64_zero(src + 3*GUI_RAW_IMG_W), wasm_v128_load64_zero(src + 2*GUI_RAW_IMG_W),
+	                        0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+	t3 = wasm_i8x16_shuffle(wasm_v128_load64_zero(src + 1*GUI_RAW_IMG_W), wasm_v128_load64_zero(src),
+	                        0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+	
+	u0 = wasm_i16x8_shuffle(t0, t1, 0, 8, 1, 9, 2, 10, 3, 11);    // Columns 0-3, rows 7-4
+	u1 = wasm_i16x8_shuffle(t0, t1, 4, 12, 5, 13, 6, 14, 7, 15);  // Columns 4-7, rows 7-4
+	u2 = wasm_i16x8_shuffle(t2, t3, 0, 8, 1, 9, 2, 10, 3, 11);    // Columns 0-3, rows 3-0
+	u3 = wasm_i16x8_shuffle(t2, t3, 4, 12, 5, 13, 6, 14, 7, 15);  // Columns 4-7, rows 3-0
+	
+	t0 = wasm_i32x4_shuffle(u0, u2, 0, 4, 1, 5);                  // Columns 0-1
+	t1 = wasm_i32x4_shuffle(u0, u2, 2, 6, 3, 7);                  // Columns 2-3
+	t2 = wasm_i32x4_shuffle(u1, u3, 0, 4, 1, 5);                  // Columns 4-5
+	t3 = wasm_i32x4_shuffle(u1, u3, 2, 6, 3, 7);                  // Columns 6-7
+	
+	wasm_v128_store64_lane(dst, t0, 0);
+	wasm_v128_store64_lane(dst + 1*GUI_RAW_IMG_H, t0, 1);
+	wasm_v128_store64_lane(dst + 2*GUI_RAW_IMG_H, t1, 0);
+	wasm_v128_store64_lane(dst + 3*GUI_RAW_IMG_H, t1, 1);
+	wasm_v128_store64_lane(dst + 4*GUI_RAW_IMG_H, t2, 0);
+	wasm_v128_store64_lane(dst + 5*GUI_RAW_IMG_H, t2, 1);
+	wasm_v128_store64_lane(dst + 6*GUI_RAW_IMG_H, t3, 0);
+	wasm_v128_store64_lane(dst + 7*GUI_RAW_IMG_H, t3, 1);
+}
+
+
+static void _simd_palette_row(uint8_t* idx, GUI_REND_IMG_T* dst, int n)
+{
+	uint8_t* end = idx + n;
+	
+	while (idx < end) {
+		*dst++ = PALETTE_LOOKUP(*idx++);
+	}
+}
+#endif
+
+
+#ifdef GUI_RENDER_Y16_LUT
+/*
+ * Direct Y16 rendering
+ *
+ * These renderers mirror the 8-bit versions above but interpolate Y16 pixels and convert
+ * them using a LUT that combines the AGC scaling done by t1c_task with the current palette.
+ * This skips the intermediate y8 buffer copy and the separate scaling pass.  They only
+ * support the native landscape orientation.
+ */
+static void _y16_lut_update(gui_img_buf_t* raw, gui_state_t* g)
+{
+	int i;
+	uint32_t range;
+	uint32_t v;
+	t1c_agc_linear_t agc;
+	
+	// Only rebuild the LUT when the mapping changes
+	if (y16_lut_valid && (raw->agc_seq == y16_lut_agc_seq) && (g->palette_index == y16_lut_palette_index)) {
+		return;
+	}
+	
+	t1c_agc_setup_linear(&agc, raw->agc_min, raw->agc_max, true, false);
+	
+	// Size the LUT bands so the AGC range fits
+	y16_lut_base = raw->agc_min;
+	range = (raw->agc_max > raw->agc_min) ? (raw->agc_max - raw->agc_min) : 0;
+	y16_lut_shift = 0;
+	while ((range >> y16_lut_shift) >= Y16_LUT_LEN) {
+		y16_lut_shift++;
+	}
+	
+	// Each entry is the value at the center of its band
+	for (i=0; i<Y16_LUT_LEN; i++) {
+		v = (uint32_t) y16_lut_base + ((uint32_t) i << y16_lut_shift) + ((1 << y16_lut_shift) >> 1);
+		if (v > 0xFFFF) v = 0xFFFF;
+		y16_lut[i] = PALETTE_LOOKUP(t1c_agc_scale_pixel(&agc, (uint16_t) v));
+	}
+	
+	y16_lut_agc_seq = raw->agc_seq;
+	y16_lut_palette_index = g->palette_index;
+	y16_lut_valid = true;
+}
+
+
+static __inline__ GUI_REND_IMG_T _y16_lut_lookup(uint32_t v)
+{
+	uint32_t i;
+	
+	i = (v > y16_lut_base) ? ((v - y16_lut_base) >> y16_lut_shift) : 0;
+	if (i >= Y16_LUT_LEN) i = Y16_LUT_LEN - 1;
+	
+	return y16_lut[i];
+}
+
+
+static void _render_y16_1_0(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	uint16_t* src = raw->y16_data;
+	uint16_t* src_end = src + (GUI_RAW_IMG_W*GUI_RAW_IMG_H);
+	
+	do {
+		*img++ = _y16_lut_lookup(*src++);
+	} while (src < src_end);
+}
+
+
+static void _render_y16_1_5(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	uint16_t* src1 = raw->y16_data;
+	uint16_t* src2;
+	uint16_t row = 0;
+	uint16_t col = 0;
+	uint32_t s;
+	GUI_REND_IMG_T* dst = img;
+	
+	// Scale the image 1.5x with an unrolled loop
+	while (row<img_h) {
+		// Row 0, 3, 6, ... {img_h-3}
+		for (col=0; col<img_w; col += 3) {
+			*dst++ = _y16_lut_lookup(*src1);
+			s = *src1++;
+			s += *src1;
+			*dst++ = _y16_lut_lookup(s/2);
+			*dst++ = _y16_lut_lookup(*src1++);
+		}
 		
-	// Inner pixels
-	B = *src;
+		// Row 1, 4, 7, ... {img_h-2}
+		src2 = src1;
+		src1 = src1 - (2*img_w/3);   // src1 = src1 - SRC_WIDTH
+		for (col=0; col<img_w; col += 3) {
+			s = *src1;
+			s += *src2;
+			*dst++ = _y16_lut_lookup(s/2);
+			s = *src1++;
+			s += *src2++;
+			s += *src1;
+			s += *src2;
+			*dst++ = _y16_lut_lookup(s/4);
+			s = *src1++;
+			s += *src2++;
+			*dst++ = _y16_lut_lookup(s/2);
+		}
+		
+		// Row 2, 5, 8, ... {img_h-1}
+		for (col=0; col<img_w; col += 3) {
+			*dst++ = _y16_lut_lookup(*src1);
+			s = *src1++;
+			s += *src1;
+			*dst++ = _y16_lut_lookup(s/2);
+			*dst++ = _y16_lut_lookup(*src1++);
+		}
+		row += 3;
+	}
+}
+
+
+static void _render_y16_2_0(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
+{
+	uint16_t* src = raw->y16_data;
+	int16_t src_w = img_w/2;
+	int16_t src_h = img_h/2;
+	int y;
+	
+	_interp_y16_row_pair(src, src, img, img, src_w);
+	img += img_w;
+	
 	for (y=0; y<src_h-1; y++) {
-		A = B;
+		_interp_y16_row_pair(src, src + src_w, img, img + img_w, src_w);
 		src += src_w;
-		B = *src;
+		img += 2*img_w;
+	}
 	
-		// Top sub-pixel Ac (left) / Ad (right)
-		sub_pixel = (SF_DS*A + B) / DIV_DS;
-		*img = PALETTE_LOOKUP(sub_pixel);
-		img += img_w;
+	_interp_y16_row_pair(src, src, img, img, src_w);
+}
+
+
+static void _interp_y16_row_pair(uint16_t* srcA, uint16_t* srcB, GUI_REND_IMG_T* dstA, GUI_REND_IMG_T* dstB, int16_t src_w)
+{
+	int x;
+	uint32_t A, B;
+	uint32_t P0, P1, P2;
+	
+	P1 = *srcA + *srcB;
+	P0 = P1;
+	for (x=0; x<src_w-1; x++) {
+		A = *srcA++ << 2;
+		B = *srcB++ << 2;
+		P2 = *srcA + *srcB;
 		
-		// Bottom sub-pixel Ba (left) / Bb (right)
-		sub_pixel = (A + SF_DS*B) / DIV_DS;
-		*img = PALETTE_LOOKUP(sub_pixel);
-		img += img_w;
+		STORE_PIXEL_PAIR(dstA, _y16_lut_lookup((A + P0 + P1) >> 3), _y16_lut_lookup((A + P1 + P2) >> 3));
+		STORE_PIXEL_PAIR(dstB, _y16_lut_lookup((B + P0 + P1) >> 3), _y16_lut_lookup((B + P1 + P2) >> 3));
+		dstA += 2;
+		dstB += 2;
+		
+		P0 = P1;
+		P1 = P2;
 	}
+	
+	A = *srcA << 2;
+	B = *srcB << 2;
+	STORE_PIXEL_PAIR(dstA, _y16_lut_lookup((A + P0 + P1) >> 3), _y16_lut_lookup((A + P1 + P1) >> 3));
+	STORE_PIXEL_PAIR(dstB, _y16_lut_lookup((B + P0 + P1) >> 3), _y16_lut_lookup((B + P1 + P1) >> 3));
 }
 
 
-static void _interp_set_inner(uint8_t* src, int16_t src_w, int16_t src_h, GUI_REND_IMG_T* img)
+static void _render_y16_zoom(gui_img_buf_t* raw, GUI_REND_IMG_T* img)
 {
+	uint16_t* src = raw->y16_data;
+	uint32_t* h0 = zoom_hrow[0];
+	uint32_t* h1 = zoom_hrow[1];
+	uint32_t* t;
+	uint32_t wa, wb;
+	int n;
+	int cur_n = -2;
 	int x, y;
-	uint8_t A, B, C, D, sub_pixel;
-	
-	// Set the destination pointer to the start of the first inner row
-	img += img_w + 1;
-
-	// Loop over inner lines (src_h-1 lines of src_w-1 pixels)
-	for (y=0; y<src_h-1; y++) {	
-		// Compute all four sub-pixels in the inner section
-		B = *src;
-		D = *(src + src_w);
-		for (x=0; x<src_w-1; x++) {
-			A = B;
-			C = D;
-			src++;
-			B = *src;
-			D = *(src + src_w);
-			
-			// Lower right sub-pixel Ad
-			sub_pixel = (SF_QS*A + B + C + D) / DIV_QS;
-			*img = PALETTE_LOOKUP(sub_pixel);
-			
-			// Upper right sub-pixel Cb
-			sub_pixel = (A + B + SF_QS*C + D) / DIV_QS;
-			*(img + img_w) = PALETTE_LOOKUP(sub_pixel);
-			img++;
-			
-			// Lower left sub-pixel Bc
-			sub_pixel = (A + SF_QS*B + C + D) / DIV_QS;
-			*img = PALETTE_LOOKUP(sub_pixel);
-			
-			// Upper left sub-pixel Da
-  			sub_pixel = (A + B + C + SF_QS*D) / DIV_QS;
-			*(img + img_w) = PALETTE_LOOKUP(sub_pixel);
-			img++;
+	
+	for (y=0; y<img_h; y++) {
+		n = zoom_row_index[y];
+		if (n != cur_n) {
+			if (n == (cur_n + 1)) {
+				t = h0;
+				h0 = h1;
+				h1 = t;
+			} else {
+				_zoom_y16_hrow(src + n*GUI_RAW_IMG_W, h0);
+			}
+			_zoom_y16_hrow(src + (n+1)*GUI_RAW_IMG_W, h1);
+			cur_n = n;
+		}
+		
+		wb = zoom_row_wt[y];
+		wa = ZOOM_WT_ONE - wb;
+		for (x=0; x<img_w; x += 2) {
+			STORE_PIXEL_PAIR(img, _y16_lut_lookup((wa*h0[x] + wb*h1[x]) >> (2*ZOOM_WT_BITS)),
+			                      _y16_lut_lookup((wa*h0[x+1] + wb*h1[x+1]) >> (2*ZOOM_WT_BITS)));
+			img += 2;
 		}
+	}
+}
+
 
-		// Next source line, 2 dest lines down, 1-pixel in
-		src++;
-		img += img_w + 2;
+static void _zoom_y16_hrow(uint16_t* src, uint32_t* dst)
+{
+	int x;
+	uint16_t* p;
+	uint32_t w;
+	
+	for (x=0; x<img_w; x++) {
+		p = src + zoom_col_index[x];
+		w = zoom_col_wt[x];
+		*dst++ = (ZOOM_WT_ONE - w) * p[0] + w * p[1];
 	}
 }
+#endif /* GUI_RENDER_Y16_LUT */
 
 #endif /* !CONFIG_BUILD_ICAM_MINI */
@@ -44,12 +44,28 @@
 
 #define GUI_LARGEST_MAG_FACTOR 2
 
+// Digital zoom (on top of the magnification) in units of GUI_ZOOM_1X
+#define GUI_ZOOM_1X         256
+#define GUI_ZOOM_MAX        (8*GUI_ZOOM_1X)
+
 // Spot meter (at 1X)
 #define GUI_SPOT_SIZE       6
 
 // Min/Max markers (at 1X)
 #define GUI_MARKER_SIZE     6
 
+// ROI table spot markers (at 1X)
+#define GUI_ROI_SPOT_SIZE   4
+
+// ROI table capacity (matches Tiny1C)
+#define GUI_ROI_MAX_SPOTS   8
+#define GUI_ROI_MAX_RECTS   4
+#define GUI_ROI_MAX_LINES   2
+
+// Image statistics sizes (matches Tiny1C)
+#define GUI_IMG_STATS_HIST_BINS   64
+#define GUI_IMG_STATS_PROFILE_MAX 64
+
 // Freeze marker (at 1X)
 #define GUI_FREEZE_MARKER_SIZE 10
 
@@ -60,12 +76,32 @@
 #else
 	// Web: Using 32-bit pixels: ARGB8888
 	#define GUI_REND_IMG_T uint32_t
+	
+	// Transparent pixel the image is cleared to when a GPU renderer draws it under the markers
+	#define GUI_RENDER_GPU_KEY 0x00000000
 #endif
 
 
 //
 // Typedefs
 //
+typedef struct {
+	uint16_t x;
+	uint16_t y;
+	uint16_t temp;
+} gui_roi_spot_t;
+
+// ROI table rectangles and lines
+typedef struct {
+	uint16_t x1;
+	uint16_t y1;
+	uint16_t x2;
+	uint16_t y2;
+	uint16_t avg_temp;
+	uint16_t min_temp;
+	uint16_t max_temp;
+} gui_roi_area_t;
+
 typedef struct {
 	bool high_gain;
 	bool vid_frozen;
@@ -76,6 +112,19 @@ typedef struct {
 	bool amb_hum_valid;
 	bool distance_valid;
 	uint8_t* y8_data;       // 8-bits pre-scaled from imager Y16 data and organized in portrait or landscape mode
+	uint16_t* y16_data;     // Imager Y16 data (landscape), NULL if not available
+	bool y16_is_temp;       // y16_data holds temperatures instead of AGC input values
+	uint16_t agc_min;       // AGC range from t1c_task
+	uint16_t agc_max;
+	bool img_same;          // Image data is the same as the previous image's
+#ifdef ESP_PLATFORM
+	bool y16_render;        // Render directly from y16_data instead of y8_data
+	uint32_t agc_seq;       // AGC mapping sequence number from t1c_task
+	uint32_t* chg_mask;     // Changed pixel mask from t1c_task (landscape), NULL if not available
+#else
+	uint32_t frame_seq;     // Camera frame sequence number
+	uint32_t frame_msec;    // Camera time the frame was acquired
+#endif
 	int16_t amb_temp;
 	uint16_t amb_hum;
 	uint16_t distance;
@@ -99,8 +148,40 @@ typedef struct {
 	uint16_t region_max_x;
 	uint16_t region_max_y;
 	uint16_t region_max_temp;
+	uint8_t roi_num_spots;
+	uint8_t roi_num_rects;
+	uint8_t roi_num_lines;
+	uint8_t roi_spot_valid_mask;  // Bit n set when entry n has a measurement
+	uint8_t roi_rect_valid_mask;
+	uint8_t roi_line_valid_mask;
+	gui_roi_spot_t roi_spot[GUI_ROI_MAX_SPOTS];
+	gui_roi_area_t roi_rect[GUI_ROI_MAX_RECTS];
+	gui_roi_area_t roi_line[GUI_ROI_MAX_LINES];
+	uint16_t* hist;         // Image Y16 histogram (GUI_IMG_STATS_HIST_BINS), NULL if not available
+	uint16_t* profile;      // Y16 values along ROI line 0, NULL if not available
+	uint16_t profile_len;
 } gui_img_buf_t;
 
+#ifndef ESP_PLATFORM
+// GPU rendering view (web).  Describes where the rendered image is on the screen and which
+// part of the (rotated) y8 data it shows.
+typedef struct {
+	int16_t x;              // Screen position of the upper-left corner of the rendered image
+	int16_t y;
+	int16_t w;              // Rendered image size
+	int16_t h;
+	int16_t src_w;          // y8 data dimensions (accounting for rotation)
+	int16_t src_h;
+	float ox;               // Source coordinate at the upper-left corner of the rendered image
+	float oy;
+	float scale;            // Rendered pixels per source pixel
+} gui_render_gpu_view_t;
+
+// GPU renderer called with each new image (y8 and view are NULL when the image is no longer
+// displayed)
+typedef void (*gui_render_gpu_cb_t)(uint8_t* y8, gui_render_gpu_view_t* view);
+#endif
+
 
 
 //
@@ -108,12 +189,27 @@ typedef struct {
 //
 bool gui_render_init();
 void gui_render_set_configuration(int orientation, int magnification);  // Must be called before using other routines
-uint8_t* gui_render_get_y8_data(uint16_t* y16_data, uint16_t y16_min, uint16_t y16_max);
+uint8_t* gui_render_get_y8_data(uint8_t* src_y8_data);
+bool gui_render_y16_enabled(gui_state_t* g);   // True if images may be rendered directly from Y16 data
 void gui_render_image_data(gui_img_buf_t* raw, GUI_REND_IMG_T* img, gui_state_t* g);
 void gui_render_spotmeter(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
 void gui_render_min_max_markers(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
 void gui_render_region_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
 void gui_render_region_drag_marker(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+void gui_render_roi_markers(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+#ifdef ESP_PLATFORM
+void gui_render_change_overlay(gui_img_buf_t* raw, GUI_REND_IMG_T* img);
+#endif
+void gui_render_set_zoom(uint16_t zoom, uint16_t raw_x, uint16_t raw_y);  // Zoom centered on a raw image coordinate
+uint16_t gui_render_get_zoom();
+void gui_render_pan(int16_t dx, int16_t dy);   // Move a zoomed image by rendered image pixels
+void gui_render_get_zoom_region(uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2);  // Visible raw image region
+void gui_render_img_to_raw_coord(int16_t x, int16_t y, uint16_t* raw_x, uint16_t* raw_y);
 void gui_render_freeze_marker(GUI_REND_IMG_T* img);
+#ifndef ESP_PLATFORM
+void gui_render_set_gpu_renderer(gui_render_gpu_cb_t cb);
+void gui_render_set_screen_pos(int16_t x, int16_t y);
+void gui_render_gpu_hide();
+#endif
 
 #endif /* GUI_RENDER_H */
\ No newline at end of file
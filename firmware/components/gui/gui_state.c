@@ -20,6 +20,7 @@
 #include "esp_system.h"
 #ifndef CONFIG_BUILD_ICAM_MINI
 
+#include <arpa/inet.h>
 #include "gui_state.h"
 #include "cmd_list.h"
 #include "cmd_utilities.h"
@@ -37,6 +38,11 @@ gui_state_t gui_state = { 0 };
 //
 static uint32_t gui_init_mask;
 
+// Camera session this state came from (see CMD_GUI_STATE)
+static bool session_valid = false;
+static uint32_t session_token;
+static uint32_t session_version;
+
 
 
 //
@@ -44,13 +50,17 @@ static uint32_t gui_init_mask;
 //
 void gui_state_init()
 {
+#ifndef ESP_PLATFORM
+	uint8_t buf[CMD_GUI_STATE_LEN];
+#endif
+	
 	// Request GUI state from the controller - this has to be updated whenever gui_state_t
 	// is changed
+#ifdef ESP_PLATFORM
 	gui_init_mask = 0;
+	(void) cmd_send(CMD_GET, CMD_AGC_MODE);
 	(void) cmd_send(CMD_GET, CMD_AMBIENT_CORRECT);
-#ifdef ESP_PLATFORM
 	(void) cmd_send(CMD_GET, CMD_BACKLIGHT);
-#endif
 	(void) cmd_send(CMD_GET, CMD_BRIGHTNESS);
 	(void) cmd_send(CMD_GET, CMD_CARD_PRESENT);
 	(void) cmd_send(CMD_GET, CMD_EMISSIVITY);
@@ -58,19 +68,37 @@ void gui_state_init()
 	(void) cmd_send(CMD_GET, CMD_MIN_MAX_EN);
 	(void) cmd_send(CMD_GET, CMD_PALETTE);
 	(void) cmd_send(CMD_GET, CMD_REGION_EN);
+	(void) cmd_send(CMD_GET, CMD_SAVE_FORMAT);
 	(void) cmd_send(CMD_GET, CMD_SAVE_OVL_EN);
 	(void) cmd_send(CMD_GET, CMD_SPOT_EN);
 	(void) cmd_send(CMD_GET, CMD_SHUTTER_INFO);
+	(void) cmd_send(CMD_GET, CMD_TNR);
 	(void) cmd_send(CMD_GET, CMD_UNITS);
-#ifndef ESP_PLATFORM
-	(void) cmd_send(CMD_GET, CMD_WIFI_INFO);
+#else
+	// The camera responds with a batch of the same items plus CMD_WIFI_INFO (see
+	// _cmd_handler_get_gui_state in ws_cmd_utilities.c).  After a reconnect we keep the
+	// state we have and are only sent what changed while we were disconnected (the camera
+	// sends everything if it restarted in the meantime).
+	if (session_valid) {
+		*((uint32_t*) &buf[0]) = htonl(session_token);
+		*((uint32_t*) &buf[4]) = htonl(session_version);
+		(void) cmd_send_binary(CMD_GET, CMD_GUI_STATE, CMD_GUI_STATE_LEN, buf);
+	} else {
+		gui_init_mask = 0;
+		(void) cmd_send(CMD_GET, CMD_GUI_STATE);
+	}
+	
+	// Have the camera push changes to the items that would otherwise be polled for
+	(void) cmd_send_int32(CMD_SET, CMD_SUBSCRIBE, CMD_SUB_BATT_LEVEL | CMD_SUB_CARD_PRESENT | CMD_SUB_SHUTTER_INFO);
+	
+	if (session_valid) return;
 #endif
 
 	// Timelapse default settings for GUI
 	gui_state.timelapse_enable = false;
 	gui_state.timelapse_notify = false;
 	gui_state.timelapse_running = false;
-	gui_state.timelapse_interval_sec = 2;
+	gui_state.timelapse_interval_msec = 2000;
 	gui_state.timelapse_num_img = 10;
 }
 
@@ -86,4 +114,13 @@ bool gui_state_init_complete()
 	return ((gui_init_mask & GUI_STATE_INIT_ALL_MASK) == GUI_STATE_INIT_ALL_MASK);
 }
 
+
+// Called with the session token and state version that follow the GUI state from the camera
+void gui_state_set_session(uint32_t token, uint32_t version)
+{
+	session_valid = true;
+	session_token = token;
+	session_version = version;
+}
+
 #endif /* !CONFIG_BUILD_ICAM_MINI */
@@ -44,10 +44,14 @@
 #define GUI_STATE_INIT_SPOT       0x00000800
 #define GUI_STATE_INIT_UNIT       0x00001000
 #define GUI_STATE_INIT_WIFI       0x00002000
+#define GUI_STATE_INIT_AGC        0x00004000
+#define GUI_STATE_INIT_SAVE_FMT   0x00008000
+#define GUI_STATE_INIT_TNR        0x00010000
 
 #ifdef ESP_PLATFORM
 // iCam doesn't need wifi
-#define GUI_STATE_INIT_ALL_MASK   (GUI_STATE_INIT_AMBIENT_C | \
+#define GUI_STATE_INIT_ALL_MASK   (GUI_STATE_INIT_AGC | \
+                                   GUI_STATE_INIT_AMBIENT_C | \
                                    GUI_STATE_INIT_BACKLIGHT | \
                                    GUI_STATE_INIT_BRIGHTNESS | \
                                    GUI_STATE_INIT_CARD_PRES | \
@@ -56,14 +60,17 @@
                                    GUI_STATE_INIT_MIN_MAX | \
                                    GUI_STATE_INIT_PALETTE | \
                                    GUI_STATE_INIT_REGION | \
+                                   GUI_STATE_INIT_SAVE_FMT | \
                                    GUI_STATE_INIT_SAVE_OVL | \
                                    GUI_STATE_INIT_SHUTTER | \
                                    GUI_STATE_INIT_SPOT | \
+                                   GUI_STATE_INIT_TNR | \
                                    GUI_STATE_INIT_UNIT \
                                   )
 #else
 // iCamMini doesn't need backlight
-#define GUI_STATE_INIT_ALL_MASK   (GUI_STATE_INIT_AMBIENT_C | \
+#define GUI_STATE_INIT_ALL_MASK   (GUI_STATE_INIT_AGC | \
+                                   GUI_STATE_INIT_AMBIENT_C | \
                                    GUI_STATE_INIT_BRIGHTNESS | \
                                    GUI_STATE_INIT_CARD_PRES | \
                                    GUI_STATE_INIT_EMISSIVITY | \
@@ -71,9 +78,11 @@
                                    GUI_STATE_INIT_MIN_MAX | \
                                    GUI_STATE_INIT_PALETTE | \
                                    GUI_STATE_INIT_REGION | \
+                                   GUI_STATE_INIT_SAVE_FMT | \
                                    GUI_STATE_INIT_SAVE_OVL | \
                                    GUI_STATE_INIT_SHUTTER | \
                                    GUI_STATE_INIT_SPOT | \
+                                   GUI_STATE_INIT_TNR | \
                                    GUI_STATE_INIT_UNIT | \
                                    GUI_STATE_INIT_WIFI \
                                   )
@@ -91,6 +100,7 @@
 // GUI state
 typedef struct {
 	bool auto_ffc_en;
+	bool auto_gain_en;
 	bool card_present;
 	bool high_gain;
 	bool mdns_en;
@@ -113,6 +123,9 @@ typedef struct {
 	uint8_t ap_ip_addr[4];
 	uint8_t sta_ip_addr[4];
 	uint8_t sta_netmask[4];
+	uint32_t agc_mode;
+	uint32_t save_format;
+	uint32_t tnr_level;
 	int32_t atmospheric_temp;
 	uint32_t brightness;
 	uint32_t distance;
@@ -124,7 +137,8 @@ typedef struct {
 	uint32_t max_ffc_interval;
 	uint32_t palette_index;
 	int32_t reflected_temp;
-	uint32_t timelapse_interval_sec;
+	uint32_t stream_rate_x10;
+	uint32_t timelapse_interval_msec;
 	uint32_t timelapse_num_img;
 } gui_state_t;
 
@@ -141,5 +155,6 @@ extern gui_state_t gui_state;
 void gui_state_init();
 void gui_state_note_item_inited(uint32_t mask);
 bool gui_state_init_complete();
+void gui_state_set_session(uint32_t token, uint32_t version);
 
 #endif /* GUI_STATE_H */
\ No newline at end of file
@@ -29,7 +29,7 @@
 //
 
 // Maximum length of info string
-#define GUISP_INFO_MAX_INFO   1024
+#define GUISP_INFO_MAX_INFO   2048
 
 //
 // LVGL setup
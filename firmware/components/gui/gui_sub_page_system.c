@@ -22,6 +22,7 @@
 #include "cmd_utilities.h"
 #include "gui_sub_page_system.h"
 #include "gui_page_settings.h"
+#include "gui_panel_system_benchmark.h"
 #include "gui_panel_system_restore.h"
 #include "gui_panel_system_format.h"
 #include "gui_panel_system_tiny1c_cal_1.h"
@@ -45,7 +46,7 @@
 //
 
 // Maximum number of control panels we can add to this page
-#define MAX_CONTROL_PANELS  5
+#define MAX_CONTROL_PANELS  6
 
 //
 // Local variables
@@ -147,6 +148,7 @@ lv_obj_t* gui_sub_page_system_init(lv_obj_t* screen)
 	gui_panel_system_tiny1c_cal_1_init(page_controls);
 	gui_panel_system_tiny1c_cal_2L_init(page_controls);
 	gui_panel_system_tiny1c_cal_2H_init(page_controls);
+	gui_panel_system_benchmark_init(page_controls);
 	
 	// We start off disabled
 	lv_obj_set_hidden(my_page, true);
@@ -167,6 +169,7 @@ void gui_sub_page_system_set_active(bool is_active)
 	gui_panel_system_tiny1c_cal_1_set_active(is_active);
 	gui_panel_system_tiny1c_cal_2L_set_active(is_active);
 	gui_panel_system_tiny1c_cal_2H_set_active(is_active);
+	gui_panel_system_benchmark_set_active(is_active);
 }
 
 
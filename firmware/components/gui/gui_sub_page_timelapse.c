@@ -247,7 +247,7 @@ static bool _send_timelapse_info()
 	// (cmd_handlers.c)
 	buf[0] = (uint8_t) gui_state.timelapse_enable;
 	buf[1] = (uint8_t) gui_state.timelapse_notify;
-	*(uint32_t*)&buf[2] = htonl((uint32_t) gui_state.timelapse_interval_sec);
+	*(uint32_t*)&buf[2] = htonl((uint32_t) gui_state.timelapse_interval_msec);
 	*(uint32_t*)&buf[6] = htonl((uint32_t) gui_state.timelapse_num_img);
 	
 	return cmd_send_binary(CMD_SET, CMD_TIMELAPSE_CFG, CMD_TIMELAPSE_CFG_LEN, buf);
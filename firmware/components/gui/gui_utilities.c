@@ -65,6 +65,7 @@ static lv_obj_t* act_pu_bg = NULL;
 static lv_obj_t* act_pu_win;
 static lv_obj_t* act_pu_spinner;
 static lv_obj_t* act_pu_desc;
+static const char* act_pu_desc_text;
 
 // Timer tasks
 static lv_task_t* task_card_update_timer = NULL;
@@ -88,6 +89,9 @@ static int keypad_type;
 // Keypad callback
 static keypad_handler_t keypad_cb;
 
+// Activity completion callback
+static activity_handler_t act_pu_done_cb = NULL;
+
 
 
 //
@@ -96,7 +100,9 @@ static keypad_handler_t keypad_cb;
 static void _cb_mbox(lv_obj_t *obj, lv_event_t event);
 static void _cb_keypad(lv_obj_t *obj, lv_event_t event);
 static void _cb_activity_pu(lv_obj_t *obj, lv_event_t event);
+#ifdef ESP_PLATFORM
 static void _cb_task_card_update_timer(lv_task_t* task);
+#endif
 static void _cb_task_act_pu_timer(lv_task_t* task);
 
 
@@ -265,10 +271,13 @@ void gui_enable_card_present_updating(bool en)
 		// Send an update request immediately
 		(void) cmd_send(CMD_GET, CMD_CARD_PRESENT);
 		
+#ifdef ESP_PLATFORM
 		if (task_card_update_timer == NULL) {			
-			// Start the timer
+			// Start the timer (the camera pushes changes to the web GUI instead, see
+			// CMD_SUBSCRIBE)
 			task_card_update_timer = lv_task_create(_cb_task_card_update_timer, GUI_CARD_PRESENT_POLL_MSEC, LV_TASK_PRIO_MID, NULL);
 		}
+#endif
 	} else {
 		if (task_card_update_timer != NULL) {
 			lv_task_del(task_card_update_timer);
@@ -421,6 +430,7 @@ void gui_display_activity_popup(lv_obj_t* parent, const char* desc)
 	
 	// Save our parent and then disable it so it can't receive input
 	act_pu_parent = parent;
+	act_pu_done_cb = NULL;
 	
 	// Create a base object for the modal background that covers the parent with opacity
 	parent_w = lv_obj_get_width(parent);
@@ -450,11 +460,20 @@ void gui_display_activity_popup(lv_obj_t* parent, const char* desc)
 	lv_obj_set_width(act_pu_desc, GUI_ACTIVITY_PU_W - 10);
 	lv_obj_set_pos(act_pu_desc, 5, GUI_ACT_PU_SPIN_H + 2*GUI_ACT_PU_SPIN_OFF_Y);
 	lv_label_set_text(act_pu_desc, desc);
+	act_pu_desc_text = desc;
 }
 
 
 void gui_update_activity_popup(bool success)
 {
+	activity_handler_t cb = act_pu_done_cb;
+	
+	// Let whoever started the activity know it is done even if the popup is gone
+	act_pu_done_cb = NULL;
+	if (cb != NULL) {
+		cb(success);
+	}
+	
 	// Don't execute if our page has gone away
 	if (act_pu_bg == NULL) return;
 	
@@ -478,12 +497,30 @@ void gui_update_activity_popup(bool success)
 }
 
 
+void gui_update_activity_progress(int step, int num_steps)
+{
+	// Don't execute if our page has gone away
+	if (act_pu_bg == NULL) return;
+	
+	lv_label_set_text_fmt(act_pu_desc, "%s\nStep %d of %d", act_pu_desc_text, step, num_steps);
+}
+
+
 bool gui_activity_popup_displayed()
 {
 	return (act_pu_bg != NULL);
 }
 
 
+void gui_set_activity_done_cb(activity_handler_t cb_done)
+{
+	// Only applies to a popup that is displayed
+	if (act_pu_bg != NULL) {
+		act_pu_done_cb = cb_done;
+	}
+}
+
+
 
 //
 // Internal functions
@@ -552,11 +589,13 @@ static void _cb_activity_pu(lv_obj_t *obj, lv_event_t event)
 }
 
 
+#ifdef ESP_PLATFORM
 static void _cb_task_card_update_timer(lv_task_t* task)
 {
 	// Request current card present status
 	(void) cmd_send(CMD_GET, CMD_CARD_PRESENT);
 }
+#endif
 
 
 static void _cb_task_act_pu_timer(lv_task_t* task)
@@ -92,6 +92,9 @@ typedef void (*messagebox_handler_t)(int btn_id);
 // Handler for Keypad pressed key
 typedef void (*keypad_handler_t)(int kp_event);
 
+// Handler for a controller activity completing
+typedef void (*activity_handler_t)(bool success);
+
 
 
 //
@@ -141,9 +144,13 @@ bool gui_keypad_displayed();
 // if one is not currently in progress
 void gui_send_activity_command(enum cmd_ctrl_act_param cmd, int32_t aux_data, lv_obj_t* parent, const char* desc);
 
-// Display a controller activity in process popup
+// Display a controller activity in process popup (desc must remain valid while it is displayed)
 void gui_display_activity_popup(lv_obj_t* parent, const char* desc);
 void gui_update_activity_popup(bool success);
+void gui_update_activity_progress(int step, int num_steps);
 bool gui_activity_popup_displayed();
 
+// Set a function to be called when the currently displayed activity completes
+void gui_set_activity_done_cb(activity_handler_t cb_done);
+
 #endif /* GUI_UTILITIES_H */
\ No newline at end of file
@@ -4,6 +4,11 @@
  * Provides I2C Sensor Access routines for other modules/tasks.  Provides a locking mechanism
  * since the underlying ESP IDF routines are not thread safe.
  *
+ * The bus is shared between the Tiny1C CCI and the environmental sensors.  Users lock it
+ * at one of two priorities.  A low priority user gives way to any waiting high priority
+ * user before it takes the bus so the CCI doesn't wait behind a string of sensor
+ * transfers.  Bus busy time is accumulated so utilization can be reported.
+ *
  * Copyright 2020-024 Dan Julio
  *
  * This program is free software: you can redistribute it and/or modify
@@ -21,17 +26,53 @@
  */
 #include "system_config.h"
 #include "driver/i2c_master.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "i2cs.h"
 
 
+//
+// I2C constants
+//
+
+// Maximum number of devices we keep attached to the bus
+#define I2C_MAX_DEVICES 6
+
+
+
 //
 // I2C variables
 //
 static i2c_master_bus_handle_t bus_handle;
 static SemaphoreHandle_t i2c_mutex;
 
+// Devices are attached the first time they are accessed and then kept
+static int num_devices = 0;
+static uint8_t dev_addr[I2C_MAX_DEVICES];
+static i2c_master_dev_handle_t dev_handles[I2C_MAX_DEVICES];
+
+// Number of high priority users waiting for the bus
+static volatile int high_prio_waiting = 0;
+static portMUX_TYPE prio_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+// Statistics
+static int64_t lock_usec;
+static int64_t stats_start_usec;
+static int64_t stats_busy_usec;
+static uint32_t stats_max_hold_usec;
+static uint32_t stats_max_high_wait_usec;
+static uint32_t stats_num_locks;
+
+
+
+//
+// Forward declarations for internal functions
+//
+static esp_err_t _get_device(uint8_t addr7, i2c_master_dev_handle_t* handle, bool* temp);
+static void _note_lock(int64_t wait_start_usec);
+
 
 
 //
@@ -58,16 +99,53 @@ esp_err_t i2c_sensor_init(int scl_pin, int sda_pin)
     i2c_mst_config.trans_queue_depth = 0;
     i2c_mst_config.flags.enable_internal_pullup = true;
     
+    stats_start_usec = esp_timer_get_time();
+    
 	return i2c_new_master_bus(&i2c_mst_config, &bus_handle);
 }
 
 
 /**
- * i2c master lock
+ * i2c master lock (high priority)
  */
 void i2c_sensor_lock()
 {
-	xSemaphoreTake(i2c_mutex, portMAX_DELAY);
+	i2c_sensor_lock_prio(I2C_PRIO_HIGH);
+}
+
+
+/**
+ * i2c master lock at the specified priority.  A low priority user waits until there
+ * are no high priority users waiting before it takes the bus.
+ */
+void i2c_sensor_lock_prio(int prio)
+{
+	int64_t wait_start_usec = esp_timer_get_time();
+	
+	if (prio == I2C_PRIO_HIGH) {
+		portENTER_CRITICAL(&prio_spinlock);
+		high_prio_waiting++;
+		portEXIT_CRITICAL(&prio_spinlock);
+		
+		xSemaphoreTake(i2c_mutex, portMAX_DELAY);
+		
+		portENTER_CRITICAL(&prio_spinlock);
+		high_prio_waiting--;
+		portEXIT_CRITICAL(&prio_spinlock);
+		
+		_note_lock(wait_start_usec);
+	} else {
+		while (1) {
+			xSemaphoreTake(i2c_mutex, portMAX_DELAY);
+			if (high_prio_waiting == 0) break;
+			
+			// Let the high priority user go first
+			xSemaphoreGive(i2c_mutex);
+			vTaskDelay(1);
+		}
+		
+		_note_lock(-1);
+	}
 }
 
 
@@ -76,6 +154,40 @@ void i2c_sensor_lock()
  */
 void i2c_sensor_unlock()
 {
+	uint32_t hold_usec = (uint32_t) (esp_timer_get_time() - lock_usec);
+	
+	stats_busy_usec += hold_usec;
+	if (hold_usec > stats_max_hold_usec) stats_max_hold_usec = hold_usec;
+	
+	xSemaphoreGive(i2c_mutex);
+}
+
+
+/**
+ * Get bus statistics since the previous call and start a new measurement period
+ */
+void i2c_sensor_get_stats(i2c_sensor_stats_t* stats)
+{
+	int64_t cur_usec;
+	
+	xSemaphoreTake(i2c_mutex, portMAX_DELAY);
+	
+	cur_usec = esp_timer_get_time();
+	if (cur_usec > stats_start_usec) {
+		stats->utilization = (uint8_t) ((stats_busy_usec * 100) / (cur_usec - stats_start_usec));
+	} else {
+		stats->utilization = 0;
+	}
+	stats->num_locks = stats_num_locks;
+	stats->max_hold_usec = stats_max_hold_usec;
+	stats->max_high_wait_usec = stats_max_high_wait_usec;
+	
+	stats_start_usec = cur_usec;
+	stats_busy_usec = 0;
+	stats_num_locks = 0;
+	stats_max_hold_usec = 0;
+	stats_max_high_wait_usec = 0;
+	
 	xSemaphoreGive(i2c_mutex);
 }
 
@@ -90,25 +202,23 @@ void i2c_sensor_unlock()
  */
 esp_err_t i2c_sensor_read_slave(uint8_t addr7, uint8_t *data_rd, size_t size)
 {
-	i2c_device_config_t dev_cfg;
+	bool temp;
 	i2c_master_dev_handle_t dev_handle;
 	
     if (size == 0) {
         return ESP_OK;
     }
     
-    dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
-    dev_cfg.device_address = (uint16_t) addr7;
-    dev_cfg.scl_speed_hz = I2C_SENSOR_FREQ_HZ;
-    
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
+    esp_err_t ret = _get_device(addr7, &dev_handle, &temp);
     if (ret != ESP_OK) {
     	return ret;
     }
     
     ret = i2c_master_receive(dev_handle, data_rd, size, 1000);
     
-    i2c_master_bus_rm_device(dev_handle);
+    if (temp) {
+    	i2c_master_bus_rm_device(dev_handle);
+    }
     
     return ret;
 }
@@ -124,21 +234,75 @@ esp_err_t i2c_sensor_read_slave(uint8_t addr7, uint8_t *data_rd, size_t size)
  */
 esp_err_t i2c_sensor_write_slave(uint8_t addr7, uint8_t *data_wr, size_t size)
 {
-    i2c_device_config_t dev_cfg;
+	bool temp;
 	i2c_master_dev_handle_t dev_handle;
 	
-	dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
-    dev_cfg.device_address = (uint16_t) addr7;
-    dev_cfg.scl_speed_hz = I2C_SENSOR_FREQ_HZ;
-    
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
+    esp_err_t ret = _get_device(addr7, &dev_handle, &temp);
     if (ret != ESP_OK) {
     	return ret;
     }
     
     ret = i2c_master_transmit(dev_handle, data_wr, size, 1000);
     
-    i2c_master_bus_rm_device(dev_handle);
+    if (temp) {
+    	i2c_master_bus_rm_device(dev_handle);
+    }
+    
+    return ret;
+}
+
+
+
+//
+// Internal functions
+//
+
+// Return the handle for a device, attaching it to the bus if necessary (bus must be
+// locked).  temp is set if the device table is full and the handle must be removed
+// after use.
+static esp_err_t _get_device(uint8_t addr7, i2c_master_dev_handle_t* handle, bool* temp)
+{
+	esp_err_t ret;
+	i2c_device_config_t dev_cfg;
+	
+	*temp = false;
+	for (int i=0; i<num_devices; i++) {
+		if (dev_addr[i] == addr7) {
+			*handle = dev_handles[i];
+			return ESP_OK;
+		}
+	}
+	
+	dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    dev_cfg.device_address = (uint16_t) addr7;
+    dev_cfg.scl_speed_hz = I2C_SENSOR_FREQ_HZ;
+    
+    ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, handle);
+    if (ret == ESP_OK) {
+    	if (num_devices < I2C_MAX_DEVICES) {
+    		dev_addr[num_devices] = addr7;
+    		dev_handles[num_devices] = *handle;
+    		num_devices++;
+    	} else {
+    		*temp = true;
+    	}
+    }
     
     return ret;
 }
+
+
+// Update statistics when the bus is taken.  wait_start_usec is the time a high priority
+// user started waiting (-1 for low priority users).
+static void _note_lock(int64_t wait_start_usec)
+{
+	uint32_t wait_usec;
+	
+	lock_usec = esp_timer_get_time();
+	stats_num_locks++;
+	
+	if (wait_start_usec >= 0) {
+		wait_usec = (uint32_t) (lock_usec - wait_start_usec);
+		if (wait_usec > stats_max_high_wait_usec) stats_max_high_wait_usec = wait_usec;
+	}
+}
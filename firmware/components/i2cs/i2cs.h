@@ -4,6 +4,10 @@
  * Provides I2C Sensor Access routines for other modules/tasks.  Provides a locking mechanism
  * since the underlying ESP IDF routines are not thread safe.
  *
+ * The Tiny1C CCI locks the bus at high priority.  Environmental sensors lock it at low
+ * priority and should keep each lock short (I2C_SENSOR_MAX_LOW_PRIO_LEN bytes) so a
+ * CCI transfer never waits long behind them.
+ *
  * Copyright 2020-2024 Dan Julio
  *
  * This program is free software: you can redistribute it and/or modify
@@ -26,13 +30,39 @@
 #include "esp_system.h"
 
 
+//
+// I2C constants
+//
+
+// Lock priorities
+#define I2C_PRIO_LOW  0
+#define I2C_PRIO_HIGH 1
+
+// Maximum bytes a low priority user should transfer in one lock
+#define I2C_SENSOR_MAX_LOW_PRIO_LEN 32
+
+
+
+//
+// I2C typedefs
+//
+typedef struct {
+	uint8_t utilization;           // Percent of the period the bus was locked
+	uint32_t num_locks;
+	uint32_t max_hold_usec;        // Longest time the bus was held
+	uint32_t max_high_wait_usec;   // Longest time a high priority user waited for the bus
+} i2c_sensor_stats_t;
+
+
 
 //
 // I2C API
 //
 esp_err_t i2c_sensor_init(int scl_pin, int sda_pin);
 void i2c_sensor_lock();
+void i2c_sensor_lock_prio(int prio);
 void i2c_sensor_unlock();
+void i2c_sensor_get_stats(i2c_sensor_stats_t* stats);
 esp_err_t i2c_sensor_read_slave(uint8_t addr7, uint8_t *data_rd, size_t size);
 esp_err_t i2c_sensor_write_slave(uint8_t addr7, uint8_t *data_wr, size_t size);
 
@@ -0,0 +1,239 @@
+/*
+ * MAVLink v2 encoder for the radiometric telemetry sent on the AUX port.  Only the few
+ * common message set messages we send are encoded so the MAVLink library isn't needed.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "esp_system.h"
+#if defined(CONFIG_BUILD_ICAM_MINI) && defined(CONFIG_AUX_UART_PROTO_MAVLINK)
+
+#include "aux_mavlink.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+
+
+//
+// Constants
+//
+
+// Packet framing
+#define MAV_STX                    0xFD
+#define MAV_HDR_LEN                10
+#define MAV_CRC_LEN                2
+
+// Messages (id, payload length and CRC_EXTRA seed from the common message set)
+#define MAV_MSG_HEARTBEAT          0
+#define MAV_LEN_HEARTBEAT          9
+#define MAV_CRC_HEARTBEAT          50
+
+#define MAV_MSG_NAMED_VALUE_FLOAT  251
+#define MAV_LEN_NAMED_VALUE_FLOAT  18
+#define MAV_CRC_NAMED_VALUE_FLOAT  170
+
+#define MAV_MSG_NAMED_VALUE_INT    252
+#define MAV_LEN_NAMED_VALUE_INT    18
+#define MAV_CRC_NAMED_VALUE_INT    44
+
+#define MAV_NAME_LEN               10
+
+// HEARTBEAT fields
+#define MAV_TYPE_CAMERA            30
+#define MAV_AUTOPILOT_INVALID      8
+#define MAV_STATE_ACTIVE           4
+#define MAV_VERSION                3
+
+
+
+//
+// Variables
+//
+static uint8_t mav_sys_id;
+static uint8_t mav_comp_id;
+static uint8_t mav_seq = 0;
+
+
+
+//
+// Forward declarations for internal functions
+//
+static uint8_t* _encode_msg(uint8_t* buf, uint32_t msg_id, uint8_t crc_extra, uint8_t* payload, uint8_t len);
+static uint8_t* _encode_named_float(uint8_t* buf, uint32_t msec, const char* name, float v);
+static uint8_t* _encode_named_int(uint8_t* buf, uint32_t msec, const char* name, int32_t v);
+static void _put_payload_u32(uint8_t* buf, uint32_t v);
+static void _put_payload_name(uint8_t* buf, const char* name);
+static void _crc_accumulate(uint16_t* crc, uint8_t b);
+
+
+
+//
+// API
+//
+void aux_mavlink_init(uint8_t sys_id, uint8_t comp_id)
+{
+	mav_sys_id = sys_id;
+	mav_comp_id = comp_id;
+}
+
+
+uint32_t aux_mavlink_encode_heartbeat(uint8_t* buf)
+{
+	uint8_t payload[MAV_LEN_HEARTBEAT];
+	
+	_put_payload_u32(&payload[0], 0);      // custom_mode
+	payload[4] = MAV_TYPE_CAMERA;
+	payload[5] = MAV_AUTOPILOT_INVALID;
+	payload[6] = 0;                        // base_mode
+	payload[7] = MAV_STATE_ACTIVE;
+	payload[8] = MAV_VERSION;
+	
+	return _encode_msg(buf, MAV_MSG_HEARTBEAT, MAV_CRC_HEARTBEAT, payload, MAV_LEN_HEARTBEAT) - buf;
+}
+
+
+// buf must be at least AUX_MAVLINK_MAX_FRAME_LEN bytes long
+uint32_t aux_mavlink_encode_frame(t1c_buffer_t* t1cP, uint8_t* buf)
+{
+	uint8_t* bufP = buf;
+	uint32_t msec;
+	
+	xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+	
+	msec = (uint32_t) (t1cP->frame_usec / 1000);
+	
+	if (t1cP->minmax_valid) {
+		bufP = _encode_named_float(bufP, msec, "TMIN", temp_to_float_temp(t1cP->max_min_temp_info.min_temp, true));
+		bufP = _encode_named_float(bufP, msec, "TMAX", temp_to_float_temp(t1cP->max_min_temp_info.max_temp, true));
+		bufP = _encode_named_int(bufP, msec, "HOT_X", (int32_t) t1cP->max_min_temp_info.max_temp_point.x);
+		bufP = _encode_named_int(bufP, msec, "HOT_Y", (int32_t) t1cP->max_min_temp_info.max_temp_point.y);
+	}
+	
+	if (t1cP->spot_valid) {
+		bufP = _encode_named_float(bufP, msec, "TSPOT", temp_to_float_temp(t1cP->spot_temp, true));
+	}
+	
+	if (t1cP->region_valid) {
+		bufP = _encode_named_float(bufP, msec, "TREG_MIN", temp_to_float_temp(t1cP->region_temp_info.temp_info_value.min_temp, true));
+		bufP = _encode_named_float(bufP, msec, "TREG_MAX", temp_to_float_temp(t1cP->region_temp_info.temp_info_value.max_temp, true));
+		bufP = _encode_named_float(bufP, msec, "TREG_AVG", temp_to_float_temp(t1cP->region_temp_info.temp_info_value.ave_temp, true));
+	}
+	
+	xSemaphoreGive(t1cP->mutex);
+	
+	return bufP - buf;
+}
+
+
+
+//
+// Internal functions
+//
+
+// Encode a message with its trailing zero payload bytes truncated as MAVLink v2 allows.
+// Returns a pointer to the byte following the message.
+static uint8_t* _encode_msg(uint8_t* buf, uint32_t msg_id, uint8_t crc_extra, uint8_t* payload, uint8_t len)
+{
+	int i;
+	uint16_t crc = 0xFFFF;
+	
+	while ((len > 1) && (payload[len-1] == 0)) {
+		len--;
+	}
+	
+	buf[0] = MAV_STX;
+	buf[1] = len;
+	buf[2] = 0;                            // incompat_flags
+	buf[3] = 0;                            // compat_flags
+	buf[4] = mav_seq++;
+	buf[5] = mav_sys_id;
+	buf[6] = mav_comp_id;
+	buf[7] = msg_id & 0xFF;
+	buf[8] = (msg_id >> 8) & 0xFF;
+	buf[9] = (msg_id >> 16) & 0xFF;
+	memcpy(&buf[MAV_HDR_LEN], payload, len);
+	
+	// Checksum excludes the start byte
+	for (i=1; i<(MAV_HDR_LEN + len); i++) {
+		_crc_accumulate(&crc, buf[i]);
+	}
+	_crc_accumulate(&crc, crc_extra);
+	
+	buf[MAV_HDR_LEN + len] = crc & 0xFF;
+	buf[MAV_HDR_LEN + len + 1] = crc >> 8;
+	
+	return buf + MAV_HDR_LEN + len + MAV_CRC_LEN;
+}
+
+
+static uint8_t* _encode_named_float(uint8_t* buf, uint32_t msec, const char* name, float v)
+{
+	uint8_t payload[MAV_LEN_NAMED_VALUE_FLOAT];
+	uint32_t u;
+	
+	memcpy(&u, &v, sizeof(u));
+	_put_payload_u32(&payload[0], msec);
+	_put_payload_u32(&payload[4], u);
+	_put_payload_name(&payload[8], name);
+	
+	return _encode_msg(buf, MAV_MSG_NAMED_VALUE_FLOAT, MAV_CRC_NAMED_VALUE_FLOAT, payload, MAV_LEN_NAMED_VALUE_FLOAT);
+}
+
+
+static uint8_t* _encode_named_int(uint8_t* buf, uint32_t msec, const char* name, int32_t v)
+{
+	uint8_t payload[MAV_LEN_NAMED_VALUE_INT];
+	
+	_put_payload_u32(&payload[0], msec);
+	_put_payload_u32(&payload[4], (uint32_t) v);
+	_put_payload_name(&payload[8], name);
+	
+	return _encode_msg(buf, MAV_MSG_NAMED_VALUE_INT, MAV_CRC_NAMED_VALUE_INT, payload, MAV_LEN_NAMED_VALUE_INT);
+}
+
+
+static void _put_payload_u32(uint8_t* buf, uint32_t v)
+{
+	// Little endian
+	buf[0] = v & 0xFF;
+	buf[1] = (v >> 8) & 0xFF;
+	buf[2] = (v >> 16) & 0xFF;
+	buf[3] = (v >> 24) & 0xFF;
+}
+
+
+// Names are null padded and not terminated if they fill the field
+static void _put_payload_name(uint8_t* buf, const char* name)
+{
+	int i;
+	
+	for (i=0; i<MAV_NAME_LEN; i++) {
+		buf[i] = (*name != 0) ? *name++ : 0;
+	}
+}
+
+
+// CRC-16/MCRF4XX (X.25) used by MAVLink
+static void _crc_accumulate(uint16_t* crc, uint8_t b)
+{
+	uint8_t t;
+	
+	t = b ^ (uint8_t) (*crc & 0xFF);
+	t ^= (t << 4);
+	*crc = (*crc >> 8) ^ ((uint16_t) t << 8) ^ ((uint16_t) t << 3) ^ (t >> 4);
+}
+
+#endif /* CONFIG_BUILD_ICAM_MINI && CONFIG_AUX_UART_PROTO_MAVLINK */
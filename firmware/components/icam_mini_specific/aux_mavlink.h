@@ -0,0 +1,58 @@
+/*
+ * MAVLink v2 encoder for the radiometric telemetry sent on the AUX port.  Only the few
+ * common message set messages we send are encoded so the MAVLink library isn't needed.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef AUX_MAVLINK_H
+#define AUX_MAVLINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tiny1c.h"
+
+
+
+//
+// Constants
+//
+
+// Each frame is sent as a burst of NAMED_VALUE_FLOAT (temperatures in °C) and
+// NAMED_VALUE_INT (pixel coordinates) messages with the frame's time since boot.  A
+// value is only sent when the camera has a valid measurement for it.
+//   TMIN, TMAX         - whole image minimum and maximum temperature
+//   HOT_X, HOT_Y       - location of the maximum temperature
+//   TSPOT              - spot meter temperature
+//   TREG_MIN, TREG_MAX,
+//   TREG_AVG           - region minimum, maximum and average temperature
+#define AUX_MAVLINK_MAX_FRAME_LEN  320
+
+// HEARTBEAT message length
+#define AUX_MAVLINK_HEARTBEAT_LEN  21
+
+// HEARTBEAT interval
+#define AUX_MAVLINK_HEARTBEAT_MSEC 1000
+
+
+
+//
+// API
+//
+void aux_mavlink_init(uint8_t sys_id, uint8_t comp_id);
+uint32_t aux_mavlink_encode_heartbeat(uint8_t* buf);
+uint32_t aux_mavlink_encode_frame(t1c_buffer_t* t1cP, uint8_t* buf);
+
+#endif /* AUX_MAVLINK_H */
@@ -0,0 +1,308 @@
+/*
+ * AUX Port Task - Stream frames and their radiometric metadata as framed binary packets
+ * on the iCamMini AUX port UART for a host connected by wire.
+ *
+ * t1c_task loads each frame into aux_t1c_buffer (skipping it if we are still encoding the
+ * last one) and we encode it with the websocket image serializers so a host parses the
+ * same data as a web client.  The UART driver interrupt feeds the hardware FIFO from its
+ * transmit buffer so the task only blocks while a packet larger than the buffer drains.
+ * With CONFIG_AUX_UART_PROTO_MAVLINK each frame's measurements are sent as MAVLink
+ * telemetry instead (see aux_mavlink.h) along with a periodic heartbeat.
+ * Data received from the host is currently ignored.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "esp_system.h"
+#if defined(CONFIG_BUILD_ICAM_MINI) && defined(CONFIG_AUX_UART_ENABLE)
+
+#include "aux_mavlink.h"
+#include "aux_task.h"
+#include "cmd_list.h"
+#include "driver/uart.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sys_utilities.h"
+#include "tiny1c.h"
+#include "ws_cmd_utilities.h"
+
+#ifdef CONFIG_PM_ENABLE
+	#include "esp_pm.h"
+#endif
+
+
+
+//
+// AUX Task private constants
+//
+
+// Stream mode for the configured image format
+#if defined(CONFIG_AUX_UART_FMT_Y8)
+	#define AUX_STREAM_MODE    CMD_STREAM_Y8
+#elif defined(CONFIG_AUX_UART_FMT_Y8_DELTA)
+	#define AUX_STREAM_MODE    CMD_STREAM_Y8_DELTA
+#elif defined(CONFIG_AUX_UART_FMT_Y16)
+	#define AUX_STREAM_MODE    CMD_STREAM_Y16
+#elif defined(CONFIG_AUX_UART_FMT_Y16_DELTA)
+	#define AUX_STREAM_MODE    CMD_STREAM_Y16_DELTA
+#else
+	#define AUX_STREAM_MODE    CMD_STREAM_OFF
+#endif
+
+#define AUX_STREAM_Y16 ((AUX_STREAM_MODE == CMD_STREAM_Y16) || (AUX_STREAM_MODE == CMD_STREAM_Y16_DELTA))
+
+#ifdef CONFIG_AUX_UART_DECIMATION
+	#define AUX_DECIMATION     CONFIG_AUX_UART_DECIMATION
+#else
+	#define AUX_DECIMATION     1
+#endif
+
+#if (AUX_DECIMATION != 1) && (AUX_DECIMATION != 2) && (AUX_DECIMATION != 4)
+	#error "CONFIG_AUX_UART_DECIMATION must be 1, 2 or 4"
+#endif
+
+#ifdef CONFIG_AUX_UART_FLOW_CTRL
+	#define AUX_FLOW_CTRL      UART_HW_FLOWCTRL_CTS_RTS
+	#define AUX_RTS_IO         BRD_AUX_RTS_IO
+	#define AUX_CTS_IO         BRD_AUX_CTS_IO
+#else
+	#define AUX_FLOW_CTRL      UART_HW_FLOWCTRL_DISABLE
+	#define AUX_RTS_IO         UART_PIN_NO_CHANGE
+	#define AUX_CTS_IO         UART_PIN_NO_CHANGE
+#endif
+
+// RTS is raised when the receive FIFO holds this many bytes
+#define AUX_RX_FLOW_THRESH     100
+
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+	// Largest packet (a frame's messages)
+	#define AUX_PKT_MAX_LEN    AUX_MAVLINK_MAX_FRAME_LEN
+	
+	// Wake up to send the heartbeat even when there are no frames
+	#define AUX_NOTIFY_WAIT    pdMS_TO_TICKS(AUX_MAVLINK_HEARTBEAT_MSEC)
+#else
+	// Largest packet (sized like the largest websocket image packet)
+	#define AUX_PKT_MAX_LEN    (AUX_PKT_HDR_LEN + WS_CMD_MAX_PKT_LEN + AUX_PKT_CRC_LEN)
+	
+	#define AUX_NOTIFY_WAIT    portMAX_DELAY
+#endif
+
+
+
+//
+// AUX Task variables
+//
+static const char* TAG = "aux_task";
+
+// Encoded packet and decimated image buffers (in PSRAM)
+static uint8_t* pkt_buf;
+static uint8_t* view_buf;
+
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+static int64_t prev_heartbeat_usec = 0;
+#else
+// Packets sent
+static uint32_t num_images = 0;
+static uint32_t num_metas = 0;
+#endif
+
+#ifdef CONFIG_PM_ENABLE
+// Held while the port is running so the APB clock (and baud rate) doesn't change and light
+// sleep doesn't stop a transmission
+static esp_pm_lock_handle_t aux_pm_lock;
+#endif
+
+
+
+//
+// AUX Task Forward Declarations for internal functions
+//
+static bool _aux_init();
+static void _aux_send_frame();
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+static void _aux_send_heartbeat();
+#else
+static void _aux_put_u32(uint32_t v, uint8_t* buf);
+#endif
+
+
+
+//
+// AUX Task API
+//
+void aux_task()
+{
+	uint32_t notification_value;
+	
+	ESP_LOGI(TAG, "Start task");
+	
+	if (!_aux_init()) {
+		task_handle_aux = NULL;
+		vTaskDelete(NULL);
+	}
+	
+	while (1) {
+		if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, AUX_NOTIFY_WAIT)) {
+			if (Notification(notification_value, AUX_NOTIFY_T1C_FRAME_MASK)) {
+				_aux_send_frame();
+			}
+		}
+		
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+		_aux_send_heartbeat();
+#endif
+	}
+}
+
+
+
+//
+// AUX Task internal functions
+//
+static bool _aux_init()
+{
+	esp_err_t ret;
+	uart_config_t uart_config = {
+		.baud_rate = CONFIG_AUX_UART_BAUD,
+		.data_bits = UART_DATA_8_BITS,
+		.parity = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = AUX_FLOW_CTRL,
+		.rx_flow_ctrl_thresh = AUX_RX_FLOW_THRESH,
+		.source_clk = UART_SCLK_DEFAULT
+	};
+	
+	pkt_buf = (uint8_t*) heap_caps_malloc(AUX_PKT_MAX_LEN, MALLOC_CAP_SPIRAM);
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+	view_buf = NULL;
+	if (pkt_buf == NULL) {
+#else
+	view_buf = (uint8_t*) heap_caps_malloc(T1C_WIDTH*T1C_HEIGHT, MALLOC_CAP_SPIRAM);
+	if ((pkt_buf == NULL) || (view_buf == NULL)) {
+#endif
+		ESP_LOGE(TAG, "malloc packet buffers failed");
+		return false;
+	}
+	
+	ret = uart_driver_install(AUX_UART_NUM, AUX_UART_RX_BUF_LEN, AUX_UART_TX_BUF_LEN, 0, NULL, 0);
+	if (ret == ESP_OK) {
+		ret = uart_param_config(AUX_UART_NUM, &uart_config);
+	}
+	if (ret == ESP_OK) {
+		ret = uart_set_pin(AUX_UART_NUM, BRD_AUX_TX_IO, BRD_AUX_RX_IO, AUX_RTS_IO, AUX_CTS_IO);
+	}
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "UART initialization failed - %d", ret);
+		return false;
+	}
+	
+#ifdef CONFIG_PM_ENABLE
+	if (esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "aux_uart", &aux_pm_lock) == ESP_OK) {
+		(void) esp_pm_lock_acquire(aux_pm_lock);
+	}
+#endif
+	
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+	aux_mavlink_init(CONFIG_AUX_UART_MAVLINK_SYS_ID, CONFIG_AUX_UART_MAVLINK_COMP_ID);
+	ESP_LOGI(TAG, "AUX port at %d baud, MAVLink telemetry", CONFIG_AUX_UART_BAUD);
+#else
+	ESP_LOGI(TAG, "AUX port at %d baud, stream mode %d, decimation %d", CONFIG_AUX_UART_BAUD, AUX_STREAM_MODE, AUX_DECIMATION);
+#endif
+	
+	return true;
+}
+
+
+#ifdef CONFIG_AUX_UART_PROTO_MAVLINK
+
+static void _aux_send_frame()
+{
+	uint32_t len;
+	
+	// The messages are small enough that the driver buffer holds several frames
+	len = aux_mavlink_encode_frame(&aux_t1c_buffer, pkt_buf);
+	if (len != 0) {
+		(void) uart_write_bytes(AUX_UART_NUM, pkt_buf, len);
+	}
+}
+
+
+static void _aux_send_heartbeat()
+{
+	int64_t cur_usec = esp_timer_get_time();
+	uint32_t len;
+	
+	if ((cur_usec - prev_heartbeat_usec) >= (AUX_MAVLINK_HEARTBEAT_MSEC * 1000)) {
+		prev_heartbeat_usec = cur_usec;
+		len = aux_mavlink_encode_heartbeat(pkt_buf);
+		(void) uart_write_bytes(AUX_UART_NUM, pkt_buf, len);
+	}
+}
+
+#else
+
+static void _aux_send_frame()
+{
+	bool image;
+	uint8_t type;
+	uint32_t crc;
+	uint32_t len;
+	
+	// Images are only encoded once the UART has finished sending the previous packet
+	image = (AUX_STREAM_MODE != CMD_STREAM_OFF) && (uart_wait_tx_done(AUX_UART_NUM, 0) == ESP_OK);
+	
+	if (image) {
+		len = ws_cmd_encode_t1c_data(&aux_t1c_buffer, AUX_STREAM_MODE, AUX_DECIMATION, T1C_Y8F_OUT_VID, view_buf, pkt_buf + AUX_PKT_HDR_LEN);
+		type = AUX_STREAM_Y16 ? AUX_PKT_IMAGE_Y16 : AUX_PKT_IMAGE;
+		num_images++;
+	} else {
+		len = ws_cmd_encode_t1c_meta(&aux_t1c_buffer, pkt_buf + AUX_PKT_HDR_LEN);
+		type = AUX_PKT_META;
+		num_metas++;
+	}
+	
+	pkt_buf[0] = AUX_PKT_SYNC_0;
+	pkt_buf[1] = AUX_PKT_SYNC_1;
+	pkt_buf[2] = type;
+	pkt_buf[3] = 0;
+	_aux_put_u32(len, &pkt_buf[4]);
+	crc = esp_rom_crc32_le(0, &pkt_buf[2], AUX_PKT_HDR_LEN - 2 + len);
+	_aux_put_u32(crc, &pkt_buf[AUX_PKT_HDR_LEN + len]);
+	
+	// Blocks while the part that doesn't fit in the driver's transmit buffer is sent
+	(void) uart_write_bytes(AUX_UART_NUM, pkt_buf, AUX_PKT_HDR_LEN + len + AUX_PKT_CRC_LEN);
+	
+	if (((num_images + num_metas) % 1000) == 0) {
+		ESP_LOGI(TAG, "Sent %lu images, %lu metadata only", num_images, num_metas);
+	}
+}
+
+
+static void _aux_put_u32(uint32_t v, uint8_t* buf)
+{
+	// Little endian
+	buf[0] = v & 0xFF;
+	buf[1] = (v >> 8) & 0xFF;
+	buf[2] = (v >> 16) & 0xFF;
+	buf[3] = (v >> 24) & 0xFF;
+}
+
+#endif /* CONFIG_AUX_UART_PROTO_MAVLINK */
+
+#endif /* CONFIG_BUILD_ICAM_MINI && CONFIG_AUX_UART_ENABLE */
@@ -0,0 +1,68 @@
+/*
+ * AUX Port Task - Stream frames and their radiometric metadata as framed binary packets
+ * on the iCamMini AUX port UART for a host connected by wire.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef AUX_TASK_H
+#define AUX_TASK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "system_config.h"
+
+
+//
+// AUX Task Constants
+//
+
+// Task notifications
+#define AUX_NOTIFY_T1C_FRAME_MASK  0x00000001
+
+// Each frame t1c_task hands us is sent as one packet
+//   uint8_t   sync[2]   (AUX_PKT_SYNC_0, AUX_PKT_SYNC_1)
+//   uint8_t   type      (AUX_PKT_xxx)
+//   uint8_t   reserved
+//   uint32_t  len       (length of the data, little endian)
+//   uint8_t[] data
+//   uint32_t  crc       (CRC-32 (IEEE 802.3) of type through the data, little endian)
+// The data has the same layout as the websocket command image data (see cmd_list.h)
+//   AUX_PKT_IMAGE      - CMD_IMAGE: metadata, view header and the whole image decimated by
+//                        CONFIG_AUX_UART_DECIMATION (delta encoded when that is smaller
+//                        for CONFIG_AUX_UART_FMT_Y8_DELTA)
+//   AUX_PKT_IMAGE_Y16  - CMD_IMAGE_Y16: metadata, Y16 header and the full resolution image
+//   AUX_PKT_META       - CMD_IMAGE_SAME: metadata only
+// A frame that arrives while the UART is still sending the previous image is sent as
+// AUX_PKT_META so the host gets every frame's measurements with the least delay and the
+// images at the rate the link can carry.
+#define AUX_PKT_SYNC_0             0xA5
+#define AUX_PKT_SYNC_1             0x5A
+
+#define AUX_PKT_IMAGE              1
+#define AUX_PKT_IMAGE_Y16          2
+#define AUX_PKT_META               3
+
+#define AUX_PKT_HDR_LEN            8
+#define AUX_PKT_CRC_LEN            4
+
+
+
+//
+// AUX Task API
+//
+void aux_task();
+
+#endif /* AUX_TASK_H */
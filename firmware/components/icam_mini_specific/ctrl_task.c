@@ -27,12 +27,15 @@
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#include "esp_sleep.h"
 #include "driver/gpio.h"
 #include "file_task.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "ps_utilities.h"
 #include "sys_utilities.h"
+#include "time_utilities.h"
 #include "wifi_utilities.h"
 #include "video_task.h"
 #include "web_task.h"
@@ -88,9 +91,15 @@
 #define CTRL_ST_FW_UPD_PROCESS     11
 #define CTRL_ST_WAIT_OFF           12
 
+// Input settle time after a button or card sense edge before it is evaluated
+#define CTRL_INPUT_SETTLE_MSEC     10
+
 // Battery averaging array size
 #define CTRL_BATT_ARRAY_LEN        10
 
+// Number of back-to-back conversions averaged for each battery reading
+#define CTRL_BATT_BURST_LEN        64
+
 //
 // GPIO to ADC1 Channel mapping
 //
@@ -111,6 +120,7 @@ static const char* TAG = "ctrl_task";
 // Board/IO related
 static bool sd_present = false;
 static int ctrl_output_format;
+static SemaphoreHandle_t input_edge_sem;
 
 // Batt/ADC related
 static int batt_channel;
@@ -135,6 +145,7 @@ static int ctrl_fault_type = CTRL_FAULT_NONE;
 // Incoming Notifications
 static bool notify_startup_done = false;
 static bool save_notification_success = false;
+static uint32_t sleep_msec;
 
 // Mode dependent notifications
 static TaskHandle_t output_task;
@@ -147,20 +158,24 @@ static uint32_t task_shutdown_notification;
 // Forward Declarations for internal functions
 //
 static void ctrl_task_init();
-static void ctrl_debounce_pwr_button(bool* short_p, bool* long_p, bool* down);
-static void ctrl_debounce_aux_button(bool* short_p, bool* long_p, bool* down);
-static void ctrl_debounce_sd_input(bool* present);
+static void ctrl_init_input_edges();
+static void IRAM_ATTR ctrl_input_isr_handler(void* arg);
+static bool ctrl_wait_eval(TickType_t* next_eval);
+static void ctrl_debounce_pwr_button(bool tick, bool* short_p, bool* long_p, bool* down);
+static void ctrl_debounce_aux_button(bool tick, bool* short_p, bool* long_p, bool* down);
+static void ctrl_debounce_sd_input(bool tick, bool* present);
 static void ctrl_eval_batt();
 static uint16_t ctrl_read_batt_mv();
 static uint16_t ctrl_get_new_batt_avg_mv(uint16_t cur_reading);
 static void ctrl_set_led(int color);
-static void ctrl_eval_sd_present();
-static void ctrl_eval_sm();
+static void ctrl_eval_sd_present(bool tick);
+static void ctrl_eval_sm(bool tick);
 static void ctrl_set_state(int new_st);
 static void ctrl_eval_led_sm();
 static void ctrl_set_led_state(int new_st);
 static void ctrl_handle_notifications();
 static void ctrl_setup_output_notifications();
+static void ctrl_deep_sleep(uint32_t msec);
 
 
 
@@ -169,21 +184,34 @@ static void ctrl_setup_output_notifications();
 //
 void ctrl_task()
 {
+	bool tick;
+	TickType_t next_eval;
+	
 	ESP_LOGI(TAG, "Start task");
 	
 	ctrl_task_init();
 	
+	next_eval = xTaskGetTickCount() + pdMS_TO_TICKS(CTRL_EVAL_MSEC);
 	while (1) {
-		vTaskDelay(pdMS_TO_TICKS(CTRL_EVAL_MSEC));
-		ctrl_handle_notifications();
-		ctrl_eval_led_sm();
-		ctrl_eval_sm();
+		// Sleep until the next periodic evaluation or until an input changes.  Inputs
+		// are evaluated immediately (once settled) when they change so button presses
+		// are acted on without waiting for the next periodic evaluation.
+		tick = ctrl_wait_eval(&next_eval);
+		if (tick) {
+			ctrl_handle_notifications();
+			ctrl_eval_led_sm();
+		}
+		ctrl_eval_sm(tick);
 		
 		// Evaluate notification generating tasks only after the system is up (all
 		// other tasks are running)
 		if (notify_startup_done) {
-			ctrl_eval_batt();
-			ctrl_eval_sd_present();
+			if (tick) {
+				ctrl_eval_batt();
+				(void) ps_flush_config(false);
+				time_resync();
+			}
+			ctrl_eval_sd_present(tick);
 		}
 	}
 }
@@ -249,6 +277,13 @@ bool ctrl_get_sdcard_present()
 }
 
 
+// Called before sending CTRL_NOTIFY_SLEEP
+void ctrl_set_sleep_msec(uint32_t msec)
+{
+	sleep_msec = msec;
+}
+
+
 
 //
 // Internal functions
@@ -262,6 +297,12 @@ static void ctrl_task_init()
 	gpio_set_pull_mode(BRD_PWR_HOLD_IO, GPIO_PULLDOWN_ONLY);
 	gpio_set_direction(BRD_PWR_HOLD_IO, GPIO_MODE_OUTPUT);
 	gpio_set_level(BRD_PWR_HOLD_IO, 1);
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+	// Release the pins held through deep sleep
+	gpio_deep_sleep_hold_dis();
+	gpio_hold_dis(BRD_PWR_HOLD_IO);
+	gpio_hold_dis(BRD_SENSOR_RSTN_IO);
+#endif
 	
 	// Determine the output mode
 	gpio_reset_pin(BRD_OUT_MODE_IO);
@@ -272,6 +313,12 @@ static void ctrl_task_init()
 	} else {
 		ctrl_output_format = CTRL_OUTPUT_VID;
 	}
+#ifdef CONFIG_TIMELAPSE_SLEEP_ENABLE
+	// Waking for the next timelapse picture skips starting WiFi
+	if (file_is_timelapse_wakeup()) {
+		ctrl_output_format = CTRL_OUTPUT_VID;
+	}
+#endif
 	
 	// Setup the GPIO
 	gpio_reset_pin(BRD_BTN1_IO);
@@ -291,6 +338,8 @@ static void ctrl_task_init()
 	gpio_reset_pin(BRD_SD_SNS_IO);
 	gpio_set_direction(BRD_SD_SNS_IO, GPIO_MODE_INPUT);
 	
+	ctrl_init_input_edges();
+	
 	// Setup and calibrate the battery monitor ADC (errors here should never occur - only
 	// during development if some wrong value is specified)
 	if ((batt_channel = gpio_2_adc1_ch[BRD_BATT_SNS_IO]) == -1) {
@@ -339,7 +388,62 @@ static void ctrl_task_init()
 }
 
 
-static void ctrl_debounce_pwr_button(bool* short_p, bool* long_p, bool* down)
+// Wake ctrl_task on any edge of the buttons or card sense input
+static void ctrl_init_input_edges()
+{
+	input_edge_sem = xSemaphoreCreateBinary();
+	
+	gpio_set_intr_type(BRD_BTN1_IO, GPIO_INTR_ANYEDGE);
+	gpio_set_intr_type(BRD_BTN2_IO, GPIO_INTR_ANYEDGE);
+	gpio_set_intr_type(BRD_SD_SNS_IO, GPIO_INTR_ANYEDGE);
+	
+	// The service may have already been installed by another task
+	(void) gpio_install_isr_service(0);
+	gpio_isr_handler_add(BRD_BTN1_IO, ctrl_input_isr_handler, NULL);
+	gpio_isr_handler_add(BRD_BTN2_IO, ctrl_input_isr_handler, NULL);
+	gpio_isr_handler_add(BRD_SD_SNS_IO, ctrl_input_isr_handler, NULL);
+}
+
+
+static void IRAM_ATTR ctrl_input_isr_handler(void* arg)
+{
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	
+	xSemaphoreGiveFromISR(input_edge_sem, &higher_priority_task_woken);
+	if (higher_priority_task_woken) {
+		portYIELD_FROM_ISR();
+	}
+}
+
+
+// Returns true at each CTRL_EVAL_MSEC periodic evaluation (which runs all timers) and
+// false when woken early by an input edge (after the input has had time to settle)
+static bool ctrl_wait_eval(TickType_t* next_eval)
+{
+	TickType_t now = xTaskGetTickCount();
+	
+	if ((int32_t) (*next_eval - now) > 0) {
+		if (xSemaphoreTake(input_edge_sem, *next_eval - now) == pdTRUE) {
+			vTaskDelay(pdMS_TO_TICKS(CTRL_INPUT_SETTLE_MSEC));
+			
+			// Ignore any further edges from bouncing while we waited
+			(void) xSemaphoreTake(input_edge_sem, 0);
+			return false;
+		}
+	} else if ((int32_t) (now - *next_eval) > pdMS_TO_TICKS(CTRL_EVAL_MSEC)) {
+		// Way behind (e.g. a long notification action) - restart the schedule
+		*next_eval = now;
+	}
+	
+	*next_eval += pdMS_TO_TICKS(CTRL_EVAL_MSEC);
+	return true;
+}
+
+
+// tick is true for the periodic evaluation.  The inputs are also evaluated, without
+// advancing timers, after they have settled following an edge.  In that case a
+// single reading is sufficient for debounce.
+static void ctrl_debounce_pwr_button(bool tick, bool* short_p, bool* long_p, bool* down)
 {
 	// Button press state (power button starts off pressed)
 	static bool prev_btn = true;
@@ -357,6 +461,7 @@ static void ctrl_debounce_pwr_button(bool* short_p, bool* long_p, bool* down)
 	
 	// Get current button value (active high)
 	cur_btn = gpio_get_level(BRD_BTN1_IO) == 1;
+	if (!tick) prev_btn = cur_btn;
 	
 	// Evaluate button logic
 	if (cur_btn && prev_btn && !btn_down) {
@@ -375,7 +480,7 @@ static void ctrl_debounce_pwr_button(bool* short_p, bool* long_p, bool* down)
 	prev_btn = cur_btn;
 	
 	// Evaluate timer for long press detection
-	if (btn_down && !init) {
+	if (btn_down && !init && tick) {
 		if (btn_timer != 0) {
 			if (--btn_timer == 0) {
 				// Long press detected
@@ -393,7 +498,7 @@ static void ctrl_debounce_pwr_button(bool* short_p, bool* long_p, bool* down)
 }
 
 
-static void ctrl_debounce_aux_button(bool* short_p, bool* long_p, bool* down)
+static void ctrl_debounce_aux_button(bool tick, bool* short_p, bool* long_p, bool* down)
 {
 	// Button press state (starts off not-pressed)
 	static bool prev_btn = false;
@@ -410,6 +515,7 @@ static void ctrl_debounce_aux_button(bool* short_p, bool* long_p, bool* down)
 	
 	// Get current button value (active low)
 	cur_btn = gpio_get_level(BRD_BTN2_IO) == 0;
+	if (!tick) prev_btn = cur_btn;
 	
 	// Evaluate button logic
 	if (cur_btn && prev_btn && !btn_down) {
@@ -424,7 +530,7 @@ static void ctrl_debounce_aux_button(bool* short_p, bool* long_p, bool* down)
 	prev_btn = cur_btn;
 	
 	// Evaluate timer for long press detection
-	if (btn_down) {
+	if (btn_down && tick) {
 		if (btn_timer != 0) {
 			if (--btn_timer == 0) {
 				// Long press detected
@@ -442,27 +548,36 @@ static void ctrl_debounce_aux_button(bool* short_p, bool* long_p, bool* down)
 }
 
 
-static void ctrl_debounce_sd_input(bool* present)
+static void ctrl_debounce_sd_input(bool tick, bool* present)
 {
 	static bool prev_sd_sense = false;
 	bool cur_sd_sense;
 	
 	cur_sd_sense = (gpio_get_level(BRD_SD_SNS_IO) == 0);
+	if (!tick) prev_sd_sense = cur_sd_sense;
 	*present = cur_sd_sense && prev_sd_sense;
 	prev_sd_sense = cur_sd_sense;
 }
 
 
+// Average a burst of conversions for each reading to reduce noise
 static uint16_t ctrl_read_batt_mv()
 {
 	esp_err_t ret;
 	int raw_adc;
 	int cal_mv;
+	int n = 0;
+	uint32_t sum = 0;
 	
-	if ((ret = adc_oneshot_read(adc1_handle, batt_channel, &raw_adc)) != ESP_OK) {
-		ESP_LOGE(TAG, "adc_oneshot_read failed - %d", ret);
-		raw_adc = 0;
+	for (int i=0; i<CTRL_BATT_BURST_LEN; i++) {
+		if ((ret = adc_oneshot_read(adc1_handle, batt_channel, &raw_adc)) != ESP_OK) {
+			ESP_LOGE(TAG, "adc_oneshot_read failed - %d", ret);
+			break;
+		}
+		sum += raw_adc;
+		n++;
 	}
+	raw_adc = (n == 0) ? 0 : (sum + n/2) / n;
 	
 	if ((ret = adc_cali_raw_to_voltage(cali_handle, raw_adc, &cal_mv)) != ESP_OK) {
 		ESP_LOGE(TAG, "adc_cali_raw_to_voltage failed - %d", ret);
@@ -561,11 +676,11 @@ static void ctrl_eval_batt()
 }
 
 
-static void ctrl_eval_sd_present()
+static void ctrl_eval_sd_present(bool tick)
 {
 	static bool prev_sd_present = false;
 	
-	ctrl_debounce_sd_input(&sd_present);
+	ctrl_debounce_sd_input(tick, &sd_present);
 	
 	// Notify file_task of changes
 	if (sd_present && !prev_sd_present) {
@@ -578,15 +693,15 @@ static void ctrl_eval_sd_present()
 }
 
 
-static void ctrl_eval_sm()
+static void ctrl_eval_sm(bool tick)
 {
 	bool btn_short_press[CTRL_NUM_BTN];
 	bool btn_long_press[CTRL_NUM_BTN];
 	bool btn_down[CTRL_NUM_BTN];
 	
 	// Look for button presses
-	ctrl_debounce_pwr_button(&btn_short_press[CTRL_BTN_PWR], &btn_long_press[CTRL_BTN_PWR], &btn_down[CTRL_BTN_PWR]);
-	ctrl_debounce_aux_button(&btn_short_press[CTRL_BTN_AUX], &btn_long_press[CTRL_BTN_AUX], &btn_down[CTRL_BTN_AUX]);
+	ctrl_debounce_pwr_button(tick, &btn_short_press[CTRL_BTN_PWR], &btn_long_press[CTRL_BTN_PWR], &btn_down[CTRL_BTN_PWR]);
+	ctrl_debounce_aux_button(tick, &btn_short_press[CTRL_BTN_AUX], &btn_long_press[CTRL_BTN_AUX], &btn_down[CTRL_BTN_AUX]);
 	
 	// Global power off handling
 	if (btn_long_press[CTRL_BTN_PWR]) {
@@ -665,7 +780,7 @@ static void ctrl_eval_sm()
 			break;
 		
 		case CTRL_ST_RESET_ALERT:
-			if (--ctrl_action_timer == 0) {
+			if (tick && (--ctrl_action_timer == 0)) {
 				// Reset alert done - initiate actual network reset
 				ctrl_set_state(CTRL_ST_RESET_ACTION);
 			}
@@ -684,7 +799,7 @@ static void ctrl_eval_sm()
 			break;
 		
 		case CTRL_ST_RESTART_ALERT:
-			if (--ctrl_action_timer == 0) {
+			if (tick && (--ctrl_action_timer == 0)) {
 				// Restart alert done - initiate actual network restart
 				ctrl_set_state(CTRL_ST_RESTART_ACTION);
 			}
@@ -720,6 +835,7 @@ static void ctrl_eval_sm()
 		
 		case CTRL_ST_WAIT_OFF:
 			if (!btn_down[CTRL_BTN_PWR]) {
+				(void) ps_flush_config(true);
 				gpio_set_level(BRD_PWR_HOLD_IO, 0);
 			}
 			break;
@@ -869,16 +985,21 @@ static void ctrl_set_state(int new_st)
 		case CTRL_ST_NET_NOT_CONNECTED:
 			// Start a slow blink
 			ctrl_set_led_state(CTRL_LED_ST_BLINK_ON);
+			wifi_set_profile(WIFI_PROFILE_IDLE);
 			break;
 			
 		case CTRL_ST_NET_CONNECTED:
 			ctrl_set_led(CTRL_LED_YEL);
 			ctrl_set_led_state(CTRL_LED_ST_SOLID);
+			wifi_set_profile(WIFI_PROFILE_IDLE);
 			break;
 		
 		case CTRL_ST_CLIENT_CONNECTED:
 			ctrl_set_led(CTRL_LED_GRN);
 			ctrl_set_led_state(CTRL_LED_ST_SOLID);
+			
+			// Lowest latency link while a client is streaming
+			wifi_set_profile(WIFI_PROFILE_STREAM);
 			break;
 		
 		case CTRL_ST_RESET_ALERT:
@@ -1086,6 +1207,7 @@ static void ctrl_handle_notifications()
 		if (Notification(notification_value, CTRL_NOTIFY_FW_UPD_REBOOT)) {
 			// Delay a bit to allow any final communication to occur and then reboot
 			vTaskDelay(pdMS_TO_TICKS(500));
+			(void) ps_flush_config(true);
 			esp_restart();
 		}
 		
@@ -1113,6 +1235,12 @@ static void ctrl_handle_notifications()
 			ctrl_set_state(CTRL_ST_RESTART_ALERT);
 			xTaskNotify(task_handle_web, WEB_NOTIFY_NETWORK_DISC_MASK, eSetBits);
 		}
+		
+		if (Notification(notification_value, CTRL_NOTIFY_SLEEP)) {
+			ESP_LOGI(TAG, "Sleep for %lu mSec", sleep_msec);
+			(void) ps_flush_config(true);
+			ctrl_deep_sleep(sleep_msec);
+		}
 	}
 }
 
@@ -1131,4 +1259,25 @@ static void ctrl_setup_output_notifications()
 	}
 }
 
+
+/**
+ * Deep sleep for msec (between timelapse pictures).  Power stays on and the Tiny1C (and
+ * other sensors) are held in reset.  A press of the power button also wakes us, ending
+ * the series since file_task only resumes it after a timer wakeup.  Doesn't return.
+ */
+static void ctrl_deep_sleep(uint32_t msec)
+{
+	ctrl_set_led(CTRL_LED_OFF);
+	
+	gpio_set_direction(BRD_SENSOR_RSTN_IO, GPIO_MODE_OUTPUT);
+	gpio_set_level(BRD_SENSOR_RSTN_IO, 0);
+	gpio_hold_en(BRD_SENSOR_RSTN_IO);
+	gpio_hold_en(BRD_PWR_HOLD_IO);
+	gpio_deep_sleep_hold_en();
+	
+	esp_sleep_enable_timer_wakeup((uint64_t) msec * 1000);
+	esp_sleep_enable_ext0_wakeup(BRD_BTN1_IO, 1);
+	esp_deep_sleep_start();
+}
+
 #endif /* CONFIG_BUILD_ICAM_MINI */
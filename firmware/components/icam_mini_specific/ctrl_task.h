@@ -86,6 +86,7 @@
 #define CTRL_NOTIFY_SAVE_END          0x00000200
 
 #define CTRL_NOTIFY_RESTART_NETWORK   0x00001000
+#define CTRL_NOTIFY_SLEEP             0x00002000
 
 
 //
@@ -98,5 +99,6 @@ void ctrl_set_save_success(bool s);
 uint16_t ctrl_get_batt_mv();
 int ctrl_get_batt_percent();
 bool ctrl_get_sdcard_present();
+void ctrl_set_sleep_msec(uint32_t msec);
 
 #endif /* CTRL_TASK_H */
\ No newline at end of file
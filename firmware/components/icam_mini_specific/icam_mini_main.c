@@ -25,10 +25,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "aux_task.h"
 #include "ctrl_task.h"
 #include "env_task.h"
 #include "file_task.h"
 #include "mon_task.h"
+#include "mqtt_task.h"
+#include "sync_task.h"
 #include "t1c_task.h"
 #include "video_task.h"
 #include "web_task.h"
@@ -36,11 +39,46 @@
 #include "sys_utilities.h"
 
 
+//
+// Constants
+//
+
+// vid_task and web_task are never both run so share a stack
+#define TASK_OUT_STACK ((TASK_VID_STACK > TASK_WEB_STACK) ? TASK_VID_STACK : TASK_WEB_STACK)
+
+
+
 //
 // Variables
 //
 static const char* TAG = "main";
 
+// Task stacks and control blocks
+static StackType_t ctrl_stack[TASK_CTRL_STACK];
+static StaticTask_t ctrl_tcb;
+static StackType_t out_stack[TASK_OUT_STACK];
+static StaticTask_t out_tcb;
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+static StackType_t mqtt_stack[TASK_MQTT_STACK];
+static StaticTask_t mqtt_tcb;
+#endif
+#ifdef CONFIG_AUX_UART_ENABLE
+static StackType_t aux_stack[TASK_AUX_STACK];
+static StaticTask_t aux_tcb;
+#endif
+static StackType_t env_stack[TASK_ENV_STACK];
+static StaticTask_t env_tcb;
+static StackType_t file_stack[TASK_FILE_STACK];
+static StaticTask_t file_tcb;
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+static StackType_t sync_stack[TASK_SYNC_STACK];
+static StaticTask_t sync_tcb;
+#endif
+static StackType_t t1c_stack[TASK_T1C_STACK];
+static StaticTask_t t1c_tcb;
+static StackType_t mon_stack[TASK_MON_STACK];
+static StaticTask_t mon_tcb;
+
 
 
 //
@@ -54,7 +92,7 @@ void icam_mini_app_main(void)
     
     // Start the control task to light the red light immediately
     // and to determine what type of video we will be generating
-    xTaskCreatePinnedToCore(&ctrl_task, "ctrl_task", 2176, NULL, 1, &task_handle_ctrl, 0);
+    (void) system_start_task(&ctrl_task, "ctrl_task", TASK_CTRL_STACK, ctrl_stack, &ctrl_tcb, TASK_CTRL_PRIO, &task_handle_ctrl, TASK_CTRL_CORE);
     
     // Allow task to start and determine operating mode
     vTaskDelay(pdMS_TO_TICKS(50));
@@ -66,6 +104,7 @@ void icam_mini_app_main(void)
     	ctrl_set_fault_type(CTRL_FAULT_ESP32_INIT);
     	while (1) {vTaskDelay(pdMS_TO_TICKS(100));}
     }
+    system_boot_mark(SYS_BOOT_IO_INIT);
     
     // Initialize system-level subsystems
     if (!system_peripheral_init(output_type == CTRL_OUTPUT_WIFI)) {
@@ -73,6 +112,7 @@ void icam_mini_app_main(void)
     	ctrl_set_fault_type(CTRL_FAULT_PERIPH_INIT);
     	while (1) {vTaskDelay(pdMS_TO_TICKS(100));}
     }
+    system_boot_mark(SYS_BOOT_PERIPH_INIT);
     
     // Pre-allocate shared big buffers
     if (!system_buffer_init(output_type == CTRL_OUTPUT_VID)) {
@@ -80,22 +120,30 @@ void icam_mini_app_main(void)
     	ctrl_set_fault_type(CTRL_FAULT_MEM_INIT);
     	while (1) {vTaskDelay(pdMS_TO_TICKS(100));}
     }
+    system_boot_mark(SYS_BOOT_BUFFER_INIT);
     
-    // Start tasks
+    // Start tasks (see system_config.h for the core assignments)
     //  Core 0 : PRO
     //  Core 1 : APP
     if (output_type == CTRL_OUTPUT_VID) {
-    	xTaskCreatePinnedToCore(&vid_task, "vid_task",  4096, NULL, 3, &task_handle_vid,  0);
+    	(void) system_start_task(&vid_task, "vid_task",   TASK_VID_STACK,  out_stack,  &out_tcb,  TASK_VID_PRIO,  &task_handle_vid,  TASK_VID_CORE);
     } else {
-    	xTaskCreatePinnedToCore(&web_task, "web_task",  4096, NULL, 2, &task_handle_web,  0);
+    	(void) system_start_task(&web_task, "web_task",   TASK_WEB_STACK,  out_stack,  &out_tcb,  TASK_WEB_PRIO,  &task_handle_web,  TASK_WEB_CORE);
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+    	(void) system_start_task(&mqtt_task, "mqtt_task", TASK_MQTT_STACK, mqtt_stack, &mqtt_tcb, TASK_MQTT_PRIO, &task_handle_mqtt, TASK_MQTT_CORE);
+#endif
     }
-    xTaskCreatePinnedToCore(&env_task,     "env_task",  3072, NULL, 1, &task_handle_env,  0);
-    xTaskCreatePinnedToCore(&file_task,    "file_task", 8192, NULL, 2, &task_handle_file, 1);
-    xTaskCreatePinnedToCore(&t1c_task,     "t1c_task",  4096, NULL, 2, &task_handle_t1c,  1);
-
-#ifdef INCLUDE_SYS_MON
-	xTaskCreatePinnedToCore(&mon_task,     "mon_task",  2048, NULL, 1, &task_handle_mon,  0);
+#ifdef CONFIG_AUX_UART_ENABLE
+    (void) system_start_task(&aux_task,   "aux_task",   TASK_AUX_STACK,  aux_stack,  &aux_tcb,  TASK_AUX_PRIO,  &task_handle_aux,  TASK_AUX_CORE);
+#endif
+    (void) system_start_task(&env_task,   "env_task",   TASK_ENV_STACK,  env_stack,  &env_tcb,  TASK_ENV_PRIO,  &task_handle_env,  TASK_ENV_CORE);
+    (void) system_start_task(&file_task,  "file_task",  TASK_FILE_STACK, file_stack, &file_tcb, TASK_FILE_PRIO, &task_handle_file, TASK_FILE_CORE);
+#ifdef CONFIG_SYNC_CAPTURE_ENABLE
+    (void) system_start_task(&sync_task,  "sync_task",  TASK_SYNC_STACK, sync_stack, &sync_tcb, TASK_SYNC_PRIO, &task_handle_sync, TASK_SYNC_CORE);
 #endif
+    (void) system_start_task(&t1c_task,   "t1c_task",   TASK_T1C_STACK,  t1c_stack,  &t1c_tcb,  TASK_T1C_PRIO,  &task_handle_t1c,  TASK_T1C_CORE);
+	(void) system_start_task(&mon_task,   "mon_task",   TASK_MON_STACK,  mon_stack,  &mon_tcb,  TASK_MON_PRIO,  &task_handle_mon,  TASK_MON_CORE);
+	system_boot_mark(SYS_BOOT_TASKS_START);
 	    
     // Notify control task that we've successfully started up
     xTaskNotify(task_handle_ctrl, CTRL_NOTIFY_STARTUP_DONE, eSetBits);
@@ -0,0 +1,436 @@
+/*
+ * MQTT Telemetry Task - Publish the radiometric measurements, temperature alarms and
+ * camera health to an MQTT broker.
+ *
+ * Measurements are requested from t1c_task at the sample interval, which hands us the
+ * next frame's info (no image) in mqtt_t1c_buffer.  They are encoded as data log records
+ * and batched so the broker gets a few larger messages instead of one per sample.  Alarms
+ * are evaluated on every sample.  The esp-mqtt client runs its own task and reconnects on
+ * its own.  It tells us when the connection comes and goes.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "esp_system.h"
+#if defined(CONFIG_BUILD_ICAM_MINI) && defined(CONFIG_MQTT_TELEMETRY_ENABLE)
+
+#include <stdio.h>
+#include <string.h>
+#include "mqtt_task.h"
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "file_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mqtt_client.h"
+#include "ps_utilities.h"
+#include "sys_utilities.h"
+#include "t1c_task.h"
+#include "time_utilities.h"
+#include "wifi_utilities.h"
+
+
+
+//
+// MQTT Task private constants
+//
+
+// Stats message
+#define MQTT_BATCH_LEN      (FILE_LOG_HDR_LEN + CONFIG_MQTT_BATCH_RECORDS*FILE_LOG_REC_LEN)
+#define MQTT_BATCH_RATE     ((CONFIG_MQTT_SAMPLE_MSEC <= 1000) ? (1000 / CONFIG_MQTT_SAMPLE_MSEC) : 0)
+
+// Longest alarm or health message
+#define MQTT_JSON_MAX_LEN   256
+
+#ifdef CONFIG_MQTT_ALARM_ENABLE
+// Alarm threshold and hysteresis in Tiny1C 1/16 °K units
+#define MQTT_ALARM_THRESH   ((int) ((CONFIG_MQTT_ALARM_TEMP_C + 273.15) * 16 + 0.5))
+#define MQTT_ALARM_HYST     (CONFIG_MQTT_ALARM_HYST_C * 16)
+#endif
+
+
+
+//
+// MQTT Task variables
+//
+static const char* TAG = "mqtt_task";
+
+static esp_mqtt_client_handle_t mqtt_client;
+static bool mqtt_connected = false;
+
+// Topics
+static char topic_status[MQTT_TOPIC_MAX_LEN];
+static char topic_stats[MQTT_TOPIC_MAX_LEN];
+static char topic_alarm[MQTT_TOPIC_MAX_LEN];
+static char topic_health[MQTT_TOPIC_MAX_LEN];
+
+// Stats batch being built (in PSRAM)
+static uint8_t* batch_buf;
+static uint32_t batch_len;
+static int batch_num = 0;
+static int64_t batch_start_usec;
+
+// Schedule
+static int64_t next_sample_usec;
+static int64_t next_health_usec;
+
+// Health counters
+static uint32_t last_frame_seq = 0;
+static uint32_t num_records = 0;
+static uint32_t num_pub_fails = 0;
+
+#ifdef CONFIG_MQTT_ALARM_ENABLE
+// Measurements in alarm and the highest of them
+static uint32_t alarm_mask = 0;
+static uint16_t alarm_max;
+#endif
+
+static char json_buf[MQTT_JSON_MAX_LEN];
+
+
+
+//
+// MQTT Task Forward Declarations for internal functions
+//
+static bool _mqtt_init();
+static void _mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data);
+static void _mqtt_set_topic(char* topic, const char* name, const char* sub_topic);
+static void _mqtt_connected();
+static void _mqtt_add_record();
+static void _mqtt_publish(const char* topic, const char* data, int len, int qos, bool retain);
+static void _mqtt_publish_health();
+#ifdef CONFIG_MQTT_ALARM_ENABLE
+static void _mqtt_eval_alarm(t1c_buffer_t* t1c);
+static void _mqtt_eval_alarm_item(uint32_t bit, bool valid, uint16_t t, uint32_t* maskP, uint16_t* maxP);
+static void _mqtt_publish_alarm();
+#endif
+
+
+
+//
+// MQTT Task API
+//
+void mqtt_task()
+{
+	int64_t cur_usec;
+	int64_t next_usec;
+	TickType_t wait;
+	uint32_t notification_value;
+	
+	ESP_LOGI(TAG, "Start task");
+	
+	if (!_mqtt_init()) {
+		task_handle_mqtt = NULL;
+		vTaskDelete(NULL);
+	}
+	
+	// The client can only be started once the network interface has been brought up by
+	// web_task
+	while (!wifi_is_enabled()) {
+		vTaskDelay(pdMS_TO_TICKS(MQTT_WIFI_RETRY_MSEC));
+	}
+	if (esp_mqtt_client_start(mqtt_client) != ESP_OK) {
+		ESP_LOGE(TAG, "Could not start MQTT client");
+		task_handle_mqtt = NULL;
+		vTaskDelete(NULL);
+	}
+	
+	while (1) {
+		// Sleep until the next sample or health message is due
+		if (mqtt_connected) {
+			cur_usec = esp_timer_get_time();
+			next_usec = (next_sample_usec < next_health_usec) ? next_sample_usec : next_health_usec;
+			wait = (next_usec > cur_usec) ? (pdMS_TO_TICKS((next_usec - cur_usec) / 1000) + 1) : 0;
+		} else {
+			wait = portMAX_DELAY;
+		}
+	
+		if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, wait)) {
+			if (Notification(notification_value, MQTT_NOTIFY_CONNECTED_MASK)) {
+				_mqtt_connected();
+			}
+	
+			if (Notification(notification_value, MQTT_NOTIFY_DISCONNECTED_MASK)) {
+				ESP_LOGI(TAG, "Disconnected from broker");
+				mqtt_connected = false;
+				batch_num = 0;
+			}
+	
+			if (Notification(notification_value, MQTT_NOTIFY_T1C_FRAME_MASK) && mqtt_connected) {
+				_mqtt_add_record();
+			}
+		}
+	
+		if (mqtt_connected) {
+			cur_usec = esp_timer_get_time();
+	
+			if (cur_usec >= next_sample_usec) {
+				xTaskNotify(task_handle_t1c, T1C_NOTIFY_MQTT_GET_INFO_MASK, eSetBits);
+	
+				// Samples missed while we were busy aren't made up
+				next_sample_usec += CONFIG_MQTT_SAMPLE_MSEC * 1000;
+				if (next_sample_usec <= cur_usec) {
+					next_sample_usec = cur_usec + CONFIG_MQTT_SAMPLE_MSEC * 1000;
+				}
+			}
+	
+			if (cur_usec >= next_health_usec) {
+				_mqtt_publish_health();
+				next_health_usec = cur_usec + (int64_t) CONFIG_MQTT_HEALTH_SEC * 1000000;
+			}
+		}
+	}
+}
+
+
+
+//
+// MQTT Task internal functions
+//
+static bool _mqtt_init()
+{
+	net_config_t net_config;
+	esp_mqtt_client_config_t mqtt_config;
+	
+	batch_buf = (uint8_t*) heap_caps_malloc(MQTT_BATCH_LEN, MALLOC_CAP_SPIRAM);
+	if (batch_buf == NULL) {
+		ESP_LOGE(TAG, "malloc batch buffer failed");
+		return false;
+	}
+	
+	// The camera name identifies us to the broker and in the topics
+	(void) ps_get_config(PS_CONFIG_TYPE_NET, &net_config);
+	_mqtt_set_topic(topic_status, net_config.ap_ssid, "status");
+	_mqtt_set_topic(topic_stats, net_config.ap_ssid, "stats");
+	_mqtt_set_topic(topic_alarm, net_config.ap_ssid, "alarm");
+	_mqtt_set_topic(topic_health, net_config.ap_ssid, "health");
+	
+	memset(&mqtt_config, 0, sizeof(esp_mqtt_client_config_t));
+	mqtt_config.broker.address.uri = CONFIG_MQTT_BROKER_URI;
+	mqtt_config.credentials.client_id = net_config.ap_ssid;
+	if (strlen(CONFIG_MQTT_USERNAME) != 0) {
+		mqtt_config.credentials.username = CONFIG_MQTT_USERNAME;
+		mqtt_config.credentials.authentication.password = CONFIG_MQTT_PASSWORD;
+	}
+	mqtt_config.session.last_will.topic = topic_status;
+	mqtt_config.session.last_will.msg = "offline";
+	mqtt_config.session.last_will.qos = 1;
+	mqtt_config.session.last_will.retain = 1;
+	
+	// The client copies the configuration strings
+	mqtt_client = esp_mqtt_client_init(&mqtt_config);
+	if (mqtt_client == NULL) {
+		ESP_LOGE(TAG, "Could not create MQTT client");
+		return false;
+	}
+	
+	if (esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, _mqtt_event_handler, NULL) != ESP_OK) {
+		ESP_LOGE(TAG, "Could not register MQTT event handler");
+		return false;
+	}
+	
+	ESP_LOGI(TAG, "Broker %s, status topic %s", CONFIG_MQTT_BROKER_URI, topic_status);
+	
+	return true;
+}
+
+
+// Called in the context of the MQTT client task
+static void _mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data)
+{
+	switch ((esp_mqtt_event_id_t) event_id) {
+		case MQTT_EVENT_CONNECTED:
+			xTaskNotify(task_handle_mqtt, MQTT_NOTIFY_CONNECTED_MASK, eSetBits);
+			break;
+	
+		case MQTT_EVENT_DISCONNECTED:
+			xTaskNotify(task_handle_mqtt, MQTT_NOTIFY_DISCONNECTED_MASK, eSetBits);
+			break;
+	
+		default:
+			break;
+	}
+}
+
+
+// Topic levels can't contain the separator or wildcards so they are replaced in the name
+static void _mqtt_set_topic(char* topic, const char* name, const char* sub_topic)
+{
+	char* cP;
+	int n;
+	
+	n = snprintf(topic, MQTT_TOPIC_MAX_LEN, "%s/", CONFIG_MQTT_TOPIC_PREFIX);
+	cP = topic + n;
+	while ((*name != 0) && (n < (MQTT_TOPIC_MAX_LEN - 1))) {
+		*cP++ = ((*name == '/') || (*name == '+') || (*name == '#')) ? '_' : *name;
+		name++;
+		n++;
+	}
+	(void) snprintf(cP, MQTT_TOPIC_MAX_LEN - n, "/%s", sub_topic);
+}
+
+
+static void _mqtt_connected()
+{
+	ESP_LOGI(TAG, "Connected to broker");
+	mqtt_connected = true;
+	
+	_mqtt_publish(topic_status, "online", 0, 1, true);
+#ifdef CONFIG_MQTT_ALARM_ENABLE
+	_mqtt_publish_alarm();
+#endif
+	
+	// Start a new batch
+	batch_num = 0;
+	next_sample_usec = esp_timer_get_time();
+	next_health_usec = next_sample_usec;
+}
+
+
+static void _mqtt_add_record()
+{
+	tmElements_t te;
+	
+	if (xSemaphoreTake(mqtt_t1c_buffer.mutex, portMAX_DELAY) != pdTRUE) {
+		return;
+	}
+	
+	// Each message starts with a header timed from its first record
+	if (batch_num == 0) {
+		time_get(&te);
+		batch_len = file_log_encode_header(&te, MQTT_BATCH_RATE, batch_buf);
+		batch_start_usec = mqtt_t1c_buffer.frame_usec;
+	}
+	batch_len += file_log_encode_record(&mqtt_t1c_buffer, batch_start_usec, batch_buf + batch_len);
+	batch_num++;
+	last_frame_seq = mqtt_t1c_buffer.frame_seq;
+	num_records++;
+	
+#ifdef CONFIG_MQTT_ALARM_ENABLE
+	_mqtt_eval_alarm(&mqtt_t1c_buffer);
+#endif
+	
+	xSemaphoreGive(mqtt_t1c_buffer.mutex);
+	
+	if (batch_num == CONFIG_MQTT_BATCH_RECORDS) {
+		_mqtt_publish(topic_stats, (const char*) batch_buf, batch_len, 0, false);
+		batch_num = 0;
+	}
+}
+
+
+// len of 0 publishes a string
+static void _mqtt_publish(const char* topic, const char* data, int len, int qos, bool retain)
+{
+	if (esp_mqtt_client_publish(mqtt_client, topic, data, len, qos, retain ? 1 : 0) < 0) {
+		num_pub_fails++;
+	}
+}
+
+
+static void _mqtt_publish_health()
+{
+	const esp_app_desc_t* app_desc;
+	int8_t rssi;
+	int n;
+	
+	app_desc = esp_app_get_description();
+	
+	n = sprintf(json_buf, "{\"uptime\":%lu,\"heap_int\":%u,\"heap_int_min\":%u,\"heap_ext\":%u,",
+		(uint32_t) (esp_timer_get_time() / 1000000),
+		heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+		heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+		heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+	if (wifi_get_rssi(&rssi)) {
+		n += sprintf(json_buf + n, "\"rssi\":%d,", rssi);
+	} else {
+		n += sprintf(json_buf + n, "\"rssi\":null,");
+	}
+	(void) snprintf(json_buf + n, MQTT_JSON_MAX_LEN - n, "\"seq\":%lu,\"records\":%lu,\"pub_fail\":%lu,\"fw\":\"%s\"}",
+		last_frame_seq, num_records, num_pub_fails, app_desc->version);
+	
+	_mqtt_publish(topic_health, json_buf, 0, 0, false);
+}
+
+
+#ifdef CONFIG_MQTT_ALARM_ENABLE
+static void _mqtt_eval_alarm(t1c_buffer_t* t1c)
+{
+	int i;
+	uint16_t max = 0;
+	uint32_t mask = 0;
+	
+	_mqtt_eval_alarm_item(MQTT_ALARM_SPOT, t1c->spot_valid, t1c->spot_temp, &mask, &max);
+	_mqtt_eval_alarm_item(MQTT_ALARM_SCENE_MAX, t1c->minmax_valid, t1c->max_min_temp_info.max_temp, &mask, &max);
+	_mqtt_eval_alarm_item(MQTT_ALARM_REGION_MAX, t1c->region_valid, t1c->region_temp_info.temp_info_value.max_temp, &mask, &max);
+	
+	for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+		_mqtt_eval_alarm_item(1 << (MQTT_ALARM_ROI_SPOT_SHIFT + i), (t1c->roi.spot_valid_mask & (1 << i)) != 0,
+		                      t1c->roi.spot_temps[i], &mask, &max);
+	}
+	for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+		_mqtt_eval_alarm_item(1 << (MQTT_ALARM_ROI_RECT_SHIFT + i), (t1c->roi.rect_valid_mask & (1 << i)) != 0,
+		                      t1c->roi.rect_temp_info[i].temp_info_value.max_temp, &mask, &max);
+	}
+	for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+		_mqtt_eval_alarm_item(1 << (MQTT_ALARM_ROI_LINE_SHIFT + i), (t1c->roi.line_valid_mask & (1 << i)) != 0,
+		                      t1c->roi.line_temp_info[i].temp_info_value.max_temp, &mask, &max);
+	}
+	
+	if (mask != alarm_mask) {
+		ESP_LOGI(TAG, "Alarm mask 0x%08lx", mask);
+		alarm_mask = mask;
+		alarm_max = max;
+		_mqtt_publish_alarm();
+	}
+}
+
+
+// A measurement goes into alarm at the threshold and stays in alarm until it falls the
+// hysteresis below it
+static void _mqtt_eval_alarm_item(uint32_t bit, bool valid, uint16_t t, uint32_t* maskP, uint16_t* maxP)
+{
+	if (!valid) return;
+	
+	if (((int) t >= MQTT_ALARM_THRESH) ||
+	    (((alarm_mask & bit) != 0) && ((int) t > (MQTT_ALARM_THRESH - MQTT_ALARM_HYST)))) {
+	
+		*maskP |= bit;
+		if (t > *maxP) {
+			*maxP = t;
+		}
+	}
+}
+
+
+static void _mqtt_publish_alarm()
+{
+	int n;
+	
+	n = sprintf(json_buf, "{\"active\":%lu,\"seq\":%lu,", alarm_mask, last_frame_seq);
+	if (alarm_mask != 0) {
+		(void) sprintf(json_buf + n, "\"max\":%.1f}", temp_to_float_temp(alarm_max, true));
+	} else {
+		(void) sprintf(json_buf + n, "\"max\":null}");
+	}
+
+	_mqtt_publish(topic_alarm, json_buf, 0, 1, true);
+}
+#endif /* CONFIG_MQTT_ALARM_ENABLE */
+
+#endif /* CONFIG_BUILD_ICAM_MINI && CONFIG_MQTT_TELEMETRY_ENABLE */
@@ -0,0 +1,72 @@
+/*
+ * MQTT Telemetry Task - Publish the radiometric measurements, temperature alarms and
+ * camera health to an MQTT broker.
+ *
+ * Topics are CONFIG_MQTT_TOPIC_PREFIX/<camera name>/...
+ *   status  - "online" when connected and "offline" (the last will) when the broker loses
+ *             the camera.  Retained.
+ *   stats   - A data log header followed by the records for the measurements sampled every
+ *             CONFIG_MQTT_SAMPLE_MSEC, CONFIG_MQTT_BATCH_RECORDS per message.  The same
+ *             format as a data log file (see file_log.h) with record times from the first
+ *             record in the message.  QoS 0.
+ *   alarm   - {"active":<mask>,"seq":<frame seq>,"max":<°C>} whenever the set of
+ *             measurements at or above CONFIG_MQTT_ALARM_TEMP_C changes.  max is the
+ *             highest of them (null when none are).  QoS 1, retained.
+ *   health  - {"uptime":<sec>,"heap_int":<bytes>,"heap_int_min":<bytes>,"heap_ext":<bytes>,
+ *             "rssi":<dBm>,"seq":<frame seq>,"records":<n>,"pub_fail":<n>,"fw":"<version>"}
+ *             every CONFIG_MQTT_HEALTH_SEC.  QoS 0.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MQTT_TASK_H
+#define MQTT_TASK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "system_config.h"
+
+
+//
+// MQTT Task Constants
+//
+
+// Task notifications
+#define MQTT_NOTIFY_T1C_FRAME_MASK     0x00000001
+#define MQTT_NOTIFY_CONNECTED_MASK     0x00000002
+#define MQTT_NOTIFY_DISCONNECTED_MASK  0x00000004
+
+// Alarm active mask bits
+#define MQTT_ALARM_SPOT                0x00000001
+#define MQTT_ALARM_SCENE_MAX           0x00000002
+#define MQTT_ALARM_REGION_MAX          0x00000004
+#define MQTT_ALARM_ROI_SPOT_SHIFT      8
+#define MQTT_ALARM_ROI_RECT_SHIFT      16
+#define MQTT_ALARM_ROI_LINE_SHIFT      24
+
+// Interval to check for the network to be brought up by web_task
+#define MQTT_WIFI_RETRY_MSEC           1000
+
+// Longest topic
+#define MQTT_TOPIC_MAX_LEN             96
+
+
+
+//
+// MQTT Task API
+//
+void mqtt_task();
+
+#endif /* MQTT_TASK_H */
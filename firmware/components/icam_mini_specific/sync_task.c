@@ -0,0 +1,252 @@
+/*
+ * Synchronized Capture Task - Turn triggers shared by several cameras (a UDP broadcast or
+ * an edge on the AUX port) into a capture time for file_task.
+ *
+ * The trigger time is taken in esp_timer time when the datagram arrives (plus its delay)
+ * or in the edge interrupt.  file_task has t1c_task pick the frame acquired closest to it
+ * from the pre-trigger ring, so it doesn't matter how long we take to pass it on.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "esp_system.h"
+#if defined(CONFIG_BUILD_ICAM_MINI) && defined(CONFIG_SYNC_CAPTURE_ENABLE)
+
+#include <errno.h>
+#include <string.h>
+#include "sync_task.h"
+#include "cmd_list.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "file_task.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sys_utilities.h"
+#include "wifi_utilities.h"
+
+#ifdef CONFIG_SYNC_CAPTURE_UDP
+	#include "lwip/sockets.h"
+#endif
+
+
+
+//
+// Sync Task variables
+//
+static const char* TAG = "sync_task";
+
+#ifdef CONFIG_SYNC_CAPTURE_UDP
+static int sync_sock = -1;
+static bool sync_id_valid = false;
+static uint32_t sync_prev_id;
+#endif
+
+#ifdef CONFIG_SYNC_CAPTURE_GPIO
+// Set by the edge interrupt
+static volatile int64_t gpio_edge_usec = 0;
+#endif
+
+
+
+//
+// Sync Task Forward Declarations for internal functions
+//
+static void _sync_trigger(int64_t target_usec);
+#ifdef CONFIG_SYNC_CAPTURE_UDP
+static bool _sync_open_socket();
+static void _sync_eval_udp();
+static uint32_t _sync_get_u32(uint8_t* buf);
+#endif
+#ifdef CONFIG_SYNC_CAPTURE_GPIO
+static void _sync_init_gpio();
+static void IRAM_ATTR _sync_gpio_isr_handler(void* arg);
+#endif
+
+
+
+//
+// Sync Task API
+//
+void sync_task()
+{
+	TickType_t wait;
+	uint32_t notification_value;
+	
+	ESP_LOGI(TAG, "Start task");
+	
+#ifdef CONFIG_SYNC_CAPTURE_GPIO
+	_sync_init_gpio();
+#endif
+	
+	while (1) {
+		wait = portMAX_DELAY;
+		
+#ifdef CONFIG_SYNC_CAPTURE_UDP
+		if ((sync_sock >= 0) || _sync_open_socket()) {
+			// Blocks for up to SYNC_RX_TIMEOUT_MSEC
+			_sync_eval_udp();
+			wait = 0;
+		} else {
+			wait = pdMS_TO_TICKS(SYNC_SOCKET_RETRY_MSEC);
+		}
+#endif
+		
+		if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, wait)) {
+#ifdef CONFIG_SYNC_CAPTURE_GPIO
+			if (Notification(notification_value, SYNC_NOTIFY_GPIO_MASK)) {
+				ESP_LOGI(TAG, "GPIO trigger");
+				_sync_trigger(gpio_edge_usec);
+			}
+#endif
+		}
+	}
+}
+
+
+
+//
+// Sync Task internal functions
+//
+static void _sync_trigger(int64_t target_usec)
+{
+	file_set_sync_capture(target_usec);
+	xTaskNotify(task_handle_file, FILE_NOTIFY_SYNC_MASK, eSetBits);
+}
+
+
+#ifdef CONFIG_SYNC_CAPTURE_UDP
+// The socket is opened once the network interface has been brought up by web_task
+static bool _sync_open_socket()
+{
+	int en = 1;
+	struct sockaddr_in addr;
+	struct timeval tv;
+	
+	if (!wifi_is_enabled()) {
+		return false;
+	}
+	
+	sync_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sync_sock < 0) {
+		ESP_LOGE(TAG, "Could not create socket (%d)", errno);
+		return false;
+	}
+	
+	(void) setsockopt(sync_sock, SOL_SOCKET, SO_BROADCAST, &en, sizeof(en));
+	tv.tv_sec = 0;
+	tv.tv_usec = SYNC_RX_TIMEOUT_MSEC * 1000;
+	(void) setsockopt(sync_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(CMD_SYNC_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sync_sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TAG, "Could not bind socket (%d)", errno);
+		close(sync_sock);
+		sync_sock = -1;
+		return false;
+	}
+	
+	ESP_LOGI(TAG, "Listening for triggers on UDP port %d", CMD_SYNC_PORT);
+	return true;
+}
+
+
+static void _sync_eval_udp()
+{
+	int len;
+	int64_t rx_usec;
+	uint8_t buf[CMD_SYNC_PKT_LEN + 1];
+	uint32_t id;
+	uint32_t delay_msec;
+	
+	len = recv(sync_sock, buf, sizeof(buf), 0);
+	rx_usec = esp_timer_get_time();
+	
+	if (len < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+			ESP_LOGE(TAG, "Receive failed (%d)", errno);
+			close(sync_sock);
+			sync_sock = -1;
+		}
+		return;
+	}
+	
+	if ((len != CMD_SYNC_PKT_LEN) || (memcmp(buf, CMD_SYNC_MAGIC, 4) != 0)) {
+		return;
+	}
+	
+	id = _sync_get_u32(&buf[4]);
+	delay_msec = _sync_get_u32(&buf[8]);
+	
+	// Ignore repeats of a trigger we've already acted on
+	if (sync_id_valid && (id == sync_prev_id)) {
+		return;
+	}
+	sync_id_valid = true;
+	sync_prev_id = id;
+	
+	if (delay_msec > CMD_SYNC_MAX_DELAY_MSEC) delay_msec = CMD_SYNC_MAX_DELAY_MSEC;
+	
+	ESP_LOGI(TAG, "UDP trigger %lu in %lu mSec", id, delay_msec);
+	_sync_trigger(rx_usec + (int64_t) delay_msec * 1000);
+}
+
+
+static uint32_t _sync_get_u32(uint8_t* buf)
+{
+	// Little endian
+	return (uint32_t) buf[0] | ((uint32_t) buf[1] << 8) | ((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+#endif /* CONFIG_SYNC_CAPTURE_UDP */
+
+
+#ifdef CONFIG_SYNC_CAPTURE_GPIO
+static void _sync_init_gpio()
+{
+	gpio_config_t io_conf = {
+		.pin_bit_mask = (1ULL << SYNC_TRIG_IO),
+		.mode = GPIO_MODE_INPUT,
+		.pull_up_en = GPIO_PULLUP_DISABLE,
+		.pull_down_en = GPIO_PULLDOWN_DISABLE,
+		.intr_type = GPIO_INTR_NEGEDGE
+	};
+	
+	gpio_config(&io_conf);
+	
+	// The service may have already been installed by another task
+	(void) gpio_install_isr_service(0);
+	gpio_isr_handler_add(SYNC_TRIG_IO, _sync_gpio_isr_handler, NULL);
+}
+
+
+static void IRAM_ATTR _sync_gpio_isr_handler(void* arg)
+{
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	int64_t t = esp_timer_get_time();
+	
+	if ((t - gpio_edge_usec) >= (SYNC_GPIO_HOLDOFF_MSEC * 1000)) {
+		gpio_edge_usec = t;
+		xTaskNotifyFromISR(task_handle_sync, SYNC_NOTIFY_GPIO_MASK, eSetBits, &higher_priority_task_woken);
+		if (higher_priority_task_woken) {
+			portYIELD_FROM_ISR();
+		}
+	}
+}
+#endif /* CONFIG_SYNC_CAPTURE_GPIO */
+
+#endif /* CONFIG_BUILD_ICAM_MINI && CONFIG_SYNC_CAPTURE_ENABLE */
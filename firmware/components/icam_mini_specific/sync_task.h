@@ -0,0 +1,51 @@
+/*
+ * Synchronized Capture Task - Turn triggers shared by several cameras (a UDP broadcast or
+ * an edge on the AUX port) into a capture time for file_task.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SYNC_TASK_H
+#define SYNC_TASK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "system_config.h"
+
+
+//
+// Sync Task Constants
+//
+
+// Task notifications
+#define SYNC_NOTIFY_GPIO_MASK      0x00000001
+
+// Edges on the trigger input closer together than this are ignored
+#define SYNC_GPIO_HOLDOFF_MSEC     100
+
+// Receive timeout so GPIO triggers are also handled while waiting for a datagram
+#define SYNC_RX_TIMEOUT_MSEC       100
+
+// Interval to retry opening the UDP socket until the network is up
+#define SYNC_SOCKET_RETRY_MSEC     1000
+
+
+
+//
+// Sync Task API
+//
+void sync_task();
+
+#endif /* SYNC_TASK_H */
@@ -147,6 +147,43 @@ bool gcore_get_reg16(uint8_t offset, uint16_t* dat)
 }
 
 
+bool gcore_get_regs(uint8_t offset, uint8_t* dat, uint8_t len)
+{
+	esp_err_t ret;
+	uint8_t buf[2];
+	uint16_t reg_addr;
+	
+	if ((offset + len) > GCORE_REG_LEN) {
+		ESP_LOGE(TAG, "REG offset %0x + len %d too large", offset, len);
+		return false;
+	}
+	
+	reg_addr = GCORE_REG_BASE + offset;
+	buf[0] = reg_addr >> 8;
+	buf[1] = reg_addr & 0xFF;
+	
+	i2c_gcore_lock();
+	
+	// Write the starting register address
+	if ((ret = i2c_gcore_write_slave(GCORE_I2C_ADDR, buf, 2)) != ESP_OK) {
+		i2c_gcore_unlock();
+		ESP_LOGE(TAG, "failed to write register block address %02x (%d)", offset, ret);
+		return false;
+	}
+
+	// Read the registers (the address auto-increments)
+	if ((ret = i2c_gcore_read_slave(GCORE_I2C_ADDR, dat, len)) != ESP_OK) {
+		i2c_gcore_unlock();
+		ESP_LOGE(TAG, "failed to read %d bytes from register %02x (%d)", len, offset, ret);
+		return false;
+	}
+	
+	i2c_gcore_unlock();
+
+	return true;
+}
+
+
 bool gcore_set_reg16(uint8_t offset, uint16_t dat)
 {
 	esp_err_t ret;
@@ -127,6 +127,7 @@ bool gcore_get_reg8(uint8_t offset, uint8_t* dat);
 bool gcore_set_reg8(uint8_t offset, uint8_t dat);
 bool gcore_get_reg16(uint8_t offset, uint16_t* dat);
 bool gcore_set_reg16(uint8_t offset, uint16_t dat);
+bool gcore_get_regs(uint8_t offset, uint8_t* dat, uint8_t len);
 
 bool gcore_set_wakeup_bit(uint8_t mask, bool en);
 
@@ -32,7 +32,9 @@
 #include "gui_task.h"
 #include "gcore.h"
 #include "out_state_utilities.h"
+#include "ps_utilities.h"
 #include "sys_utilities.h"
+#include "time_utilities.h"
 #include "system_config.h"
 
 //
@@ -45,6 +47,10 @@
 // Power state update count
 #define GCORE_UPD_STEPS (GCORE_PWR_UPDATE_MSEC / GCORE_EVAL_MSEC)
 
+// Load current averaging (exponential, 1/2^N of each new reading).  The instantaneous
+// reading swings with the CPU clock and light sleep between frames.
+#define GCORE_LOAD_AVG_SHIFT 3
+
 
 
 //
@@ -60,6 +66,7 @@ static enum BATT_STATE_t upd_batt_state = BATT_0;
 static enum CHARGE_STATE_t upd_charge_state = CHARGE_OFF;
 static uint16_t batt_voltage_mv;
 static uint16_t batt_current_ma;
+static uint32_t batt_avg_ma_x = 0;              // Average load current << GCORE_LOAD_AVG_SHIFT
 static SemaphoreHandle_t power_state_mutex;
 
 // Backlight state
@@ -129,6 +136,12 @@ void gcore_task()
 			cur_bl_val = backlight_percent;
 		}
 		
+		// Write configuration changes that have settled
+		(void) ps_flush_config(false);
+		
+		// Periodically correct system time drift from the RTC
+		time_resync();
+		
 		// Look for time to get info from gCore
 		if (++batt_mon_count >= GCORE_BATT_MON_STEPS) {
 			batt_mon_count = 0;
@@ -138,6 +151,11 @@ void gcore_task()
 			power_get_batt(&cur_batt_status);
 			batt_voltage_mv = (uint16_t) (cur_batt_status.batt_voltage * 1000.0);
 			batt_current_ma = cur_batt_status.load_ma;
+			if (batt_avg_ma_x == 0) {
+				batt_avg_ma_x = (uint32_t) batt_current_ma << GCORE_LOAD_AVG_SHIFT;
+			} else {
+				batt_avg_ma_x += batt_current_ma - (batt_avg_ma_x >> GCORE_LOAD_AVG_SHIFT);
+			}
 				
 			// Look for power-off button press
 			if (power_button_pressed() || notify_poweroff) {
@@ -224,6 +242,12 @@ uint16_t gcore_get_load_ma()
 }
 
 
+uint16_t gcore_get_avg_load_ma()
+{
+	return (uint16_t) (batt_avg_ma_x >> GCORE_LOAD_AVG_SHIFT);
+}
+
+
 int gcore_get_batt_percent()
 {
 	uint16_t local_mv = batt_voltage_mv;
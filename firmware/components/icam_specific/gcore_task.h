@@ -60,6 +60,7 @@ void gcore_task();
 void gcore_get_power_state(enum BATT_STATE_t* bs, enum CHARGE_STATE_t* cs);
 uint16_t gcore_get_batt_mv();
 uint16_t gcore_get_load_ma();
+uint16_t gcore_get_avg_load_ma();
 int gcore_get_batt_percent();
 
 #endif /* GCORE_TASK_H_ */
@@ -25,6 +25,7 @@
 #ifndef CONFIG_BUILD_ICAM_MINI
 
 #include <arpa/inet.h>
+#include "bench_utilities.h"
 #include "cmd_list.h"
 #include "cmd_handlers.h"
 #include "cmd_utilities.h"
@@ -35,11 +36,13 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "esp_freertos_hooks.h"
 #include "file_task.h"
 #include "gui_page_image.h"
 #include "gui_page_settings.h"
 #include "gui_page_file_browser.h"
+#include "gui_panel_image_main.h"
 #include "gui_render.h"
 #include "gui_state.h"
 #include "gui_utilities.h"
@@ -47,6 +50,7 @@
 #include "palettes.h"
 #include "sys_utilities.h"
 #include "system_config.h"
+#include "t1c_task.h"
 #include "tiny1c.h"
 #include "disp_spi.h"
 #include "disp_driver.h"
@@ -56,6 +60,10 @@
 #include "mem_fb.h"
 #endif
 
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
 
 
 //
@@ -89,9 +97,15 @@ typedef enum {
 
 static const char* TAG = "gui_task";
 
-// Dual display update buffers to allow DMA/SPI transfer of one while the other is updated
+// Dual display update buffers to allow DMA/SPI transfer of one while the other is updated.
+// A full-frame PSRAM buffer is single since LVGL would flush the whole screen every update
+// with two (the display driver sends it through its own bounce buffers).
+#if CONFIG_LCD_BUF_PSRAM
+static lv_color_t* lvgl_disp_buf1;
+#else
 static lv_color_t lvgl_disp_buf1[DISP_BUF_SIZE];
 static lv_color_t lvgl_disp_buf2[DISP_BUF_SIZE];
+#endif
 static lv_disp_buf_t lvgl_disp_buf;
 
 // Display driver
@@ -110,6 +124,15 @@ static lv_obj_t* lv_pages[GUI_NUM_MAIN_PAGES];
 static uint16_t page_w;
 static uint16_t page_h;
 
+#ifdef CONFIG_PM_ENABLE
+// Held while LVGL updates and draws the display
+static esp_pm_lock_handle_t render_pm_lock;
+#endif
+
+// LVGL heap statistics for other tasks (the heap may only be walked by this task)
+static portMUX_TYPE mem_info_mux = portMUX_INITIALIZER_UNLOCKED;
+static gui_mem_info_t mem_info;
+
 
 
 //
@@ -118,11 +141,15 @@ static uint16_t page_h;
 static bool _gui_cmd_init();
 static void _gui_send_image(int render_buf_index);
 static void _gui_notification_handler();
-static void _gui_lvgl_init();
+static bool _gui_lvgl_init();
+static void _gui_mem_info_task(lv_task_t* task);
 static bool _gui_send_get_file_catalog_response();
 static bool _gui_send_get_file_image_response(); 
+static bool _gui_send_ctrl_activity_progress();
 static void _cmd_handler_set_shutdown(cmd_data_t data_type, uint32_t len, uint8_t* data);
+#if LV_TICK_CUSTOM == 0
 static void IRAM_ATTR _lv_tick_callback();
+#endif
 #if (CONFIG_SCREENDUMP_ENABLE == true)
 static void _gui_do_screendump();
 #endif
@@ -144,7 +171,10 @@ void gui_task()
 	}
 
 	// Initialize LVGL
-	_gui_lvgl_init();
+	if (!_gui_lvgl_init()) {
+		ESP_LOGE(TAG, "Could not initialize LVGL");
+		vTaskDelete(NULL);
+	}
 	
 	// Our page dimensions are fixed
 	page_w = LV_HOR_RES_MAX;
@@ -171,8 +201,10 @@ void gui_task()
 	// Start the display
 	lv_scr_load(screen);
 	
-	// Display LVGL memory utilization
+	// Display LVGL memory utilization and keep the statistics updated for the system information
 	gui_dump_mem_info();
+	_gui_mem_info_task(NULL);
+	(void) lv_task_create(_gui_mem_info_task, GUI_MEM_INFO_MSEC, LV_TASK_PRIO_LOWEST, NULL);
 	
 	// Get the GUI state (this completes immediately so we don't need to poll for it done
 	// like we do when running over a websocket)
@@ -185,7 +217,17 @@ void gui_task()
 	gui_main_set_page(GUI_MAIN_PAGE_IMAGE);
 	
 	while (1) {
+#ifdef CONFIG_PM_ENABLE
+		// Render at the maximum CPU frequency
+		(void) esp_pm_lock_acquire(render_pm_lock);
 		lv_task_handler();
+		(void) esp_pm_lock_release(render_pm_lock);
+#else
+		lv_task_handler();
+#endif
+		
+		// Move the region selection marker while it's being dragged
+		gui_panel_image_eval_drag_marker();
 		
 		// Handle incoming notifications
 		_gui_notification_handler();
@@ -219,6 +261,17 @@ void gui_main_set_page(uint32_t page)
 }
 
 
+/**
+ * Get the LVGL heap statistics from the last GUI_MEM_INFO_MSEC update
+ */
+void gui_get_mem_info(gui_mem_info_t* info)
+{
+	portENTER_CRITICAL(&mem_info_mux);
+	*info = mem_info;
+	portEXIT_CRITICAL(&mem_info_mux);
+}
+
+
 
 //
 // GUI Task Internal functions
@@ -231,18 +284,27 @@ static bool _gui_cmd_init()
 	}
 	
 	// Register command handlers (get, set, rsp)
+	(void) cmd_register_cmd_id(CMD_AGC_MODE, cmd_handler_get_agc_mode, cmd_handler_set_agc_mode, cmd_handler_rsp_agc_mode);
 	(void) cmd_register_cmd_id(CMD_AMBIENT_CORRECT, cmd_handler_get_ambient_correct, cmd_handler_set_ambient_correct, cmd_handler_rsp_ambient_correct);
 	(void) cmd_register_cmd_id(CMD_BACKLIGHT, cmd_handler_get_backlight, cmd_handler_set_backlight, cmd_handler_rsp_backlight);
 	(void) cmd_register_cmd_id(CMD_SAVE_BACKLIGHT, NULL, cmd_handler_set_save_backlight, NULL);
 	(void) cmd_register_cmd_id(CMD_BATT_LEVEL, cmd_handler_get_batt_level, NULL, cmd_handler_rsp_batt_info);
+	(void) cmd_register_cmd_id(CMD_BENCHMARK, cmd_handler_get_benchmark, NULL, cmd_handler_rsp_benchmark);
 	(void) cmd_register_cmd_id(CMD_BRIGHTNESS, cmd_handler_get_brightness, cmd_handler_set_brightness, cmd_handler_rsp_brightness);
+	(void) cmd_register_cmd_id(CMD_BURST, NULL, cmd_handler_set_burst, NULL);
 	(void) cmd_register_cmd_id(CMD_CRIT_BATT, NULL, cmd_handler_set_critical_batt, NULL);
 	(void) cmd_register_cmd_id(CMD_CTRL_ACTIVITY, NULL, cmd_handler_set_ctrl_activity, cmd_handler_rsp_ctrl_activity);
+	(void) cmd_register_cmd_id(CMD_DEAD_PIXELS, cmd_handler_get_dead_pixels, cmd_handler_set_dead_pixels, NULL);
 	(void) cmd_register_cmd_id(CMD_CARD_PRESENT, cmd_handler_get_card_present, NULL, cmd_handler_rsp_card_present);
+	(void) cmd_register_cmd_id(CMD_CHANGE_DETECT, cmd_handler_get_change_detect, cmd_handler_set_change_detect, NULL);
 	(void) cmd_register_cmd_id(CMD_EMISSIVITY, cmd_handler_get_emissivity, cmd_handler_set_emissivity, cmd_handler_rsp_emissivity);
 	(void) cmd_register_cmd_id(CMD_FILE_CATALOG, cmd_handler_get_file_catalog, NULL, cmd_handler_rsp_file_catalog);
 	(void) cmd_register_cmd_id(CMD_FILE_DELETE, NULL, cmd_handler_set_file_delete, NULL);
 	(void) cmd_register_cmd_id(CMD_FILE_GET_IMAGE, cmd_handler_get_file_image, NULL, cmd_handler_rsp_file_image);
+	(void) cmd_register_cmd_id(CMD_FILE_GET_THUMB, cmd_handler_get_file_thumb, NULL, cmd_handler_rsp_file_thumb);
+	(void) cmd_register_cmd_id(CMD_FRAME_STATS, cmd_handler_get_frame_stats, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_PERF_STATS, cmd_handler_get_perf_stats, NULL, NULL);
+	(void) cmd_register_cmd_id(CMD_PICTURE_AVG, cmd_handler_get_picture_avg, cmd_handler_set_picture_avg, NULL);
 	(void) cmd_register_cmd_id(CMD_FFC, NULL, cmd_handler_set_ffc, NULL);
 	(void) cmd_register_cmd_id(CMD_GAIN, cmd_handler_get_gain, cmd_handler_set_gain, cmd_handler_rsp_gain);
 	(void) cmd_register_cmd_id(CMD_IMAGE, NULL, cmd_handler_set_image, NULL);
@@ -252,20 +314,31 @@ static bool _gui_cmd_init()
 	(void) cmd_register_cmd_id(CMD_ORIENTATION, NULL, cmd_handler_set_orientation, NULL);
 	(void) cmd_register_cmd_id(CMD_PALETTE, cmd_handler_get_palette, cmd_handler_set_palette, cmd_handler_rsp_palette);
 	(void) cmd_register_cmd_id(CMD_POWEROFF, NULL, cmd_handler_set_poweroff, NULL);
+	(void) cmd_register_cmd_id(CMD_PRE_TRIGGER, NULL, cmd_handler_set_pre_trigger, NULL);
+	(void) cmd_register_cmd_id(CMD_RECORD, NULL, cmd_handler_set_record, NULL);
 	(void) cmd_register_cmd_id(CMD_REGION_EN, cmd_handler_get_region_enable, cmd_handler_set_region_enable, cmd_handler_rsp_region_enable);
 	(void) cmd_register_cmd_id(CMD_REGION_LOC, NULL, cmd_handler_set_region_location, NULL);
+	(void) cmd_register_cmd_id(CMD_REPLAY, cmd_handler_get_replay, cmd_handler_set_replay, NULL);
+	(void) cmd_register_cmd_id(CMD_REPLAY_FRAME, NULL, cmd_handler_set_replay_frame, NULL);
+	(void) cmd_register_cmd_id(CMD_REPLAY_RATE, cmd_handler_get_replay_rate, cmd_handler_set_replay_rate, NULL);
+	(void) cmd_register_cmd_id(CMD_ROI_TABLE, cmd_handler_get_roi_table, cmd_handler_set_roi_table, NULL);
+	(void) cmd_register_cmd_id(CMD_SAVE_FORMAT, cmd_handler_get_save_format, cmd_handler_set_save_format, cmd_handler_rsp_save_format);
 	(void) cmd_register_cmd_id(CMD_SAVE_OVL_EN, cmd_handler_get_save_ovl_en, cmd_handler_set_save_ovl_en, cmd_handler_rsp_save_ovl_en);
 	(void) cmd_register_cmd_id(CMD_SHUTTER_INFO, cmd_handler_get_shutter, cmd_handler_set_shutter, cmd_handler_rsp_shutter);
 	(void) cmd_register_cmd_id(CMD_SAVE_PALETTE, NULL, cmd_handler_set_save_palette, NULL);
 	(void) cmd_register_cmd_id(CMD_SHUTDOWN, NULL, _cmd_handler_set_shutdown, NULL);
+	(void) cmd_register_cmd_id(CMD_SPATIAL_FILTER, cmd_handler_get_spatial_filter, cmd_handler_set_spatial_filter, NULL);
 	(void) cmd_register_cmd_id(CMD_SPOT_EN, cmd_handler_get_spot_enable, cmd_handler_set_spot_enable, cmd_handler_rsp_spot_enable);
 	(void) cmd_register_cmd_id(CMD_SPOT_LOC, NULL, cmd_handler_set_spot_location, NULL);
 	(void) cmd_register_cmd_id(CMD_STREAM_EN, NULL, cmd_handler_set_stream_enable, NULL);
 	(void) cmd_register_cmd_id(CMD_SYS_INFO, cmd_handler_get_sys_info, NULL, cmd_handler_rsp_sys_info);
 	(void) cmd_register_cmd_id(CMD_TAKE_PICTURE, NULL, cmd_handler_set_take_picture, NULL);
+	(void) cmd_register_cmd_id(CMD_TELEMETRY, cmd_handler_get_telemetry, cmd_handler_set_telemetry, NULL);
 	(void) cmd_register_cmd_id(CMD_TIME, cmd_handler_get_time, cmd_handler_set_time, cmd_handler_rsp_time);
 	(void) cmd_register_cmd_id(CMD_TIMELAPSE_CFG, NULL, cmd_handler_set_timelapse_cfg, NULL);
 	(void) cmd_register_cmd_id(CMD_TIMELAPSE_STATUS, NULL, cmd_handler_set_timelapse_status, NULL);
+	(void) cmd_register_cmd_id(CMD_TNR, cmd_handler_get_tnr, cmd_handler_set_tnr, cmd_handler_rsp_tnr);
+	(void) cmd_register_cmd_id(CMD_TRIGGER_CFG, NULL, cmd_handler_set_trigger_cfg, NULL);
 	(void) cmd_register_cmd_id(CMD_UNITS, cmd_handler_get_units, cmd_handler_set_units, cmd_handler_rsp_units);
 	(void) cmd_register_cmd_id(CMD_WIFI_INFO, cmd_handler_get_wifi, cmd_handler_set_wifi, cmd_handler_rsp_wifi);
 	
@@ -279,6 +352,8 @@ static void _gui_send_image(int render_buf_index)
 	
 	t1c_buffer_t* t1cP = (render_buf_index == 0) ? &out_t1c_buffer[0] : &out_t1c_buffer[1];
 	
+	t1c_note_frame_consumed(T1C_CONSUMER_GUI, t1cP->frame_seq);
+	
 	buf[0] = ((uint32_t) t1cP >> 24) & 0xFF;
 	buf[1] = ((uint32_t) t1cP >> 16) & 0xFF;
 	buf[2] = ((uint32_t) t1cP >> 8) & 0xFF;
@@ -345,6 +420,18 @@ static void _gui_notification_handler()
 			(void) _gui_send_get_file_image_response();
 		}
 		
+		if (Notification(notification_value, GUI_NOTIFY_FILE_THUMB_READY_MASK)) {
+			// The expanded thumbnail is in the shared image buffer
+			(void) cmd_send(CMD_RSP, CMD_FILE_GET_THUMB);
+		}
+		
+		if (Notification(notification_value, GUI_NOTIFY_FILE_BENCHMARK_MASK)) {
+			// Time our renderer to finish the benchmark
+			gui_panel_image_benchmark_render();
+			bench_finish();
+			(void) cmd_send_int32(CMD_RSP, CMD_CTRL_ACTIVITY, 1);
+		}
+		
 		if (Notification(notification_value, GUI_NOTIFY_FILE_TIMELAPSE_ON_MASK)) {
 			(void) cmd_send_int32(CMD_SET, CMD_TIMELAPSE_STATUS, 1);
 		}
@@ -360,6 +447,10 @@ static void _gui_notification_handler()
 		if (Notification(notification_value, GUI_NOTIFY_CTRL_ACT_FAILED_MASK)) {
 			(void) cmd_send_int32(CMD_RSP, CMD_CTRL_ACTIVITY, 0);
 		}
+		
+		if (Notification(notification_value, GUI_NOTIFY_CTRL_ACT_PROGRESS_MASK)) {
+			(void) _gui_send_ctrl_activity_progress();
+		}
 
 #if (CONFIG_SCREENDUMP_ENABLE == true)
 		if (Notification(notification_value, GUI_NOTIFY_SCREENDUMP_MASK)) {
@@ -370,8 +461,14 @@ static void _gui_notification_handler()
 }
 
 
-static void _gui_lvgl_init()
+static bool _gui_lvgl_init()
 {
+#ifdef CONFIG_PM_ENABLE
+	if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "gui_render", &render_pm_lock) != ESP_OK) {
+		return false;
+	}
+#endif
+	
 	// Initialize lvgl
 	lv_init();
 	
@@ -380,7 +477,16 @@ static void _gui_lvgl_init()
 	touch_driver_init();
 	
 	// Install the display driver
+#if CONFIG_LCD_BUF_PSRAM
+	lvgl_disp_buf1 = (lv_color_t*) heap_caps_malloc(DISP_BUF_SIZE*sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+	if (lvgl_disp_buf1 == NULL) {
+		ESP_LOGE(TAG, "Could not allocate LVGL draw buffer");
+		return false;
+	}
+	lv_disp_buf_init(&lvgl_disp_buf, lvgl_disp_buf1, NULL, DISP_BUF_SIZE);
+#else
 	lv_disp_buf_init(&lvgl_disp_buf, lvgl_disp_buf1, lvgl_disp_buf2, DISP_BUF_SIZE);
+#endif
 	lv_disp_drv_init(&lvgl_disp_drv);
 	lvgl_disp_drv.flush_cb = disp_driver_flush;
 	lvgl_disp_drv.buffer = &lvgl_disp_buf;
@@ -392,8 +498,30 @@ static void _gui_lvgl_init()
     lvgl_indev_drv.type = LV_INDEV_TYPE_POINTER;
     lv_indev_drv_register(&lvgl_indev_drv);
 	
+#if LV_TICK_CUSTOM == 0
     // Hook LVGL's timebase to the CPU system tick so it can keep track of time
     esp_register_freertos_tick_hook(_lv_tick_callback);
+#endif
+    
+    return true;
+}
+
+
+// Update the LVGL heap statistics for gui_get_mem_info
+static void _gui_mem_info_task(lv_task_t* task)
+{
+	lv_mem_monitor_t mon;
+	
+	lv_mem_monitor(&mon);
+	
+	portENTER_CRITICAL(&mem_info_mux);
+	mem_info.total_size = mon.total_size;
+	mem_info.free_size = mon.free_size;
+	mem_info.free_biggest_size = mon.free_biggest_size;
+	mem_info.max_used = mon.max_used;
+	mem_info.used_pct = mon.used_pct;
+	mem_info.frag_pct = mon.frag_pct;
+	portEXIT_CRITICAL(&mem_info_mux);
 }
 
 
@@ -446,21 +574,33 @@ static void _cmd_handler_set_shutdown(cmd_data_t data_type, uint32_t len, uint8_
 }
 
 
+#if LV_TICK_CUSTOM == 0
 static void _lv_tick_callback()
 {
 	lv_tick_inc(portTICK_PERIOD_MS);
 }
+#endif
+
+
+// gui_task specific routine to send controller activity progress to our own response handler
+static bool _gui_send_ctrl_activity_progress()
+{
+	int step, num_steps;
+	uint8_t buf[CMD_CTRL_ACT_PROGRESS_LEN];
+	uint32_t* tx32P = (uint32_t*) buf;
+	
+	t1c_get_activity_progress(&step, &num_steps);
+	*tx32P++ = htonl((uint32_t) step);
+	*tx32P = htonl((uint32_t) num_steps);
+	
+	return cmd_send_binary(CMD_RSP, CMD_CTRL_ACTIVITY, CMD_CTRL_ACT_PROGRESS_LEN, buf);
+}
 
 
 #if (CONFIG_SCREENDUMP_ENABLE == true)
-// This task blocks gui_task
+// Render the screen into the screendump frame buffer and have file_task save it to the card
 void _gui_do_screendump()
 {
-	char line_buf[161];   // Large enough for 32 16-bit hex values with a space between them
-	int i, j, n;
-	int len = MEM_FB_W * MEM_FB_H;
-	uint16_t* fb;
-	
 	// Configure the display driver to render to the screendump frame buffer
 	disp_driver_en_dump(true);
 	
@@ -471,18 +611,9 @@ void _gui_do_screendump()
 	// Reconfigure the driver back to the LCD
 	disp_driver_en_dump(false);
 	
-	// Dump the fb
-	fb = (uint16_t*) mem_fb_get_buffer();
-	i = 0;
-	while (i < len) {
-		n = 0;
-		for (j=0; j<32; j++) {
-			sprintf(line_buf + n, "%x ", *fb++);
-			n = strlen(line_buf);
-		}
-		i += j;
-		printf("%s: FB: %s\n", TAG, line_buf);
-		vTaskDelay(pdMS_TO_TICKS(20));
+	if (mem_fb_get_buffer() != NULL) {
+		file_set_screenshot_info((uint16_t*) mem_fb_get_buffer(), MEM_FB_W, MEM_FB_H, LV_COLOR_16_SWAP != 0);
+		xTaskNotify(task_handle_file, FILE_NOTIFY_SCREENSHOT_MASK, eSetBits);
 	}
 }
 #endif
@@ -74,14 +74,36 @@
 #define GUI_NOTIFY_FILE_IMAGE_READY_MASK    0x00008000
 #define GUI_NOTIFY_FILE_TIMELAPSE_ON_MASK   0x00010000
 #define GUI_NOTIFY_FILE_TIMELAPSE_OFF_MASK  0x00020000
+#define GUI_NOTIFY_FILE_THUMB_READY_MASK    0x00040000
+#define GUI_NOTIFY_FILE_BENCHMARK_MASK      0x00080000
 
 // From a controller activity
 #define GUI_NOTIFY_CTRL_ACT_SUCCEEDED_MASK  0x00100000
 #define GUI_NOTIFY_CTRL_ACT_FAILED_MASK     0x00200000
+#define GUI_NOTIFY_CTRL_ACT_PROGRESS_MASK   0x00400000
 
 // From gcore_task
 #define GUI_NOTIFY_SCREENDUMP_MASK          0x80000000
 
+// LVGL heap statistics update rate
+#define GUI_MEM_INFO_MSEC                   1000
+
+
+
+//
+// GUI Task typedefs
+//
+
+// LVGL heap statistics (from lv_mem_monitor)
+typedef struct {
+	uint32_t total_size;
+	uint32_t free_size;
+	uint32_t free_biggest_size;
+	uint32_t max_used;
+	uint8_t used_pct;
+	uint8_t frag_pct;
+} gui_mem_info_t;
+
 
 
 //
@@ -91,5 +113,6 @@ void gui_task();
 
 // API calls for other tasks
 void gui_main_set_page(uint32_t page);
+void gui_get_mem_info(gui_mem_info_t* info);
 
 #endif /* GUI_TASK_H */
\ No newline at end of file
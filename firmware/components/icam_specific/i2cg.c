@@ -35,6 +35,17 @@
 static i2c_master_bus_handle_t bus_handle;
 static SemaphoreHandle_t i2c_mutex;
 
+// One device may be accessed at a faster clock than the rest of the bus
+static uint8_t fast_dev_addr7 = 0;
+static uint32_t fast_dev_freq_hz = I2C_GCORE_FREQ_HZ;
+
+
+
+//
+// I2C Forward declarations for internal functions
+//
+static uint32_t _get_dev_freq(uint8_t addr7);
+
 
 
 //
@@ -65,6 +76,17 @@ esp_err_t i2c_gcore_init(int scl_pin, int sda_pin)
 }
 
 
+/**
+ * Access the device at addr7 at freq_hz instead of the bus frequency (for a device that
+ * supports a faster clock than others on the bus)
+ */
+void i2c_gcore_set_dev_freq(uint8_t addr7, uint32_t freq_hz)
+{
+	fast_dev_addr7 = addr7;
+	fast_dev_freq_hz = freq_hz;
+}
+
+
 /**
  * i2c master lock
  */
@@ -102,7 +124,7 @@ esp_err_t i2c_gcore_read_slave(uint8_t addr7, uint8_t *data_rd, size_t size)
     
     dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
     dev_cfg.device_address = (uint16_t) addr7;
-    dev_cfg.scl_speed_hz = I2C_GCORE_FREQ_HZ;
+    dev_cfg.scl_speed_hz = _get_dev_freq(addr7);
     
     esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
     if (ret != ESP_OK) {
@@ -132,7 +154,7 @@ esp_err_t i2c_gcore_write_slave(uint8_t addr7, uint8_t *data_wr, size_t size)
 	
 	dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
     dev_cfg.device_address = (uint16_t) addr7;
-    dev_cfg.scl_speed_hz = I2C_GCORE_FREQ_HZ;
+    dev_cfg.scl_speed_hz = _get_dev_freq(addr7);
     
     esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
     if (ret != ESP_OK) {
@@ -146,5 +168,15 @@ esp_err_t i2c_gcore_write_slave(uint8_t addr7, uint8_t *data_wr, size_t size)
     return ret;
 }
 
+
+
+//
+// I2C Internal functions
+//
+static uint32_t _get_dev_freq(uint8_t addr7)
+{
+	return (addr7 == fast_dev_addr7) ? fast_dev_freq_hz : I2C_GCORE_FREQ_HZ;
+}
+
 #endif /* !CONFIG_BUILD_ICAM_MINI */
 
@@ -31,6 +31,7 @@
 // I2C API
 //
 esp_err_t i2c_gcore_init(int scl_pin, int sda_pin);
+void i2c_gcore_set_dev_freq(uint8_t addr7, uint32_t freq_hz);
 void i2c_gcore_lock();
 void i2c_gcore_unlock();
 esp_err_t i2c_gcore_read_slave(uint8_t addr7, uint8_t *data_rd, size_t size);
@@ -25,6 +25,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "disp_driver.h"
 #include "env_task.h"
 #include "file_task.h"
 #include "gcore_task.h"
@@ -40,6 +41,22 @@
 //
 static const char* TAG = "main";
 
+// Task stacks and control blocks
+static StackType_t env_stack[TASK_ENV_STACK];
+static StaticTask_t env_tcb;
+static StackType_t gcore_stack[TASK_GCORE_STACK];
+static StaticTask_t gcore_tcb;
+static StackType_t gui_stack[TASK_GUI_STACK];
+static StaticTask_t gui_tcb;
+static StackType_t disp_stack[TASK_DISP_STACK];
+static StaticTask_t disp_tcb;
+static StackType_t file_stack[TASK_FILE_STACK];
+static StaticTask_t file_tcb;
+static StackType_t t1c_stack[TASK_T1C_STACK];
+static StaticTask_t t1c_tcb;
+static StackType_t mon_stack[TASK_MON_STACK];
+static StaticTask_t mon_tcb;
+
 
 
 //
@@ -54,31 +71,33 @@ void icam_app_main(void)
     	ESP_LOGE(TAG, "ESP32 init failed");
     	while (1) {vTaskDelay(pdMS_TO_TICKS(100));}
     }
+    system_boot_mark(SYS_BOOT_IO_INIT);
     
     // Initialize system-level subsystems
     if (!system_peripheral_init(false)) {
     	ESP_LOGE(TAG, "Peripheral init failed");
     	while (1) {vTaskDelay(pdMS_TO_TICKS(100));}
     }
+    system_boot_mark(SYS_BOOT_PERIPH_INIT);
     
     // Pre-allocate shared big buffers
     if (!system_buffer_init(false)) {
     	ESP_LOGE(TAG, "Memory allocate failed");
     	while (1) {vTaskDelay(pdMS_TO_TICKS(100));}
     }
+    system_boot_mark(SYS_BOOT_BUFFER_INIT);
     
-    // Start tasks
+    // Start tasks (see system_config.h for the core assignments)
     //  Core 0 : PRO
     //  Core 1 : APP
-    xTaskCreatePinnedToCore(&env_task,   "env_task",   3072, NULL, 1, &task_handle_env,   0);
-    xTaskCreatePinnedToCore(&gcore_task, "gcore_task", 3072, NULL, 2, &task_handle_gcore, 0);
-	xTaskCreatePinnedToCore(&gui_task,   "gui_task",   3072, NULL, 2, &task_handle_gui,   0);
-	xTaskCreatePinnedToCore(&file_task,  "file_task",  8192, NULL, 2, &task_handle_file,  1);
-    xTaskCreatePinnedToCore(&t1c_task,   "t1c_task",   4096, NULL, 2, &task_handle_t1c,   1);
-
-#ifdef INCLUDE_SYS_MON
-	xTaskCreatePinnedToCore(&mon_task,   "mon_task",   2048, NULL, 1, &task_handle_mon,   0);
-#endif
+    (void) system_start_task(&env_task,   "env_task",   TASK_ENV_STACK,   env_stack,   &env_tcb,   TASK_ENV_PRIO,   &task_handle_env,   TASK_ENV_CORE);
+    (void) system_start_task(&gcore_task, "gcore_task", TASK_GCORE_STACK, gcore_stack, &gcore_tcb, TASK_GCORE_PRIO, &task_handle_gcore, TASK_GCORE_CORE);
+	(void) system_start_task(&gui_task,   "gui_task",   TASK_GUI_STACK,   gui_stack,   &gui_tcb,   TASK_GUI_PRIO,   &task_handle_gui,   TASK_GUI_CORE);
+	(void) system_start_task(&disp_driver_push_task, "disp_task", TASK_DISP_STACK, disp_stack, &disp_tcb, TASK_DISP_PRIO, &task_handle_disp, TASK_DISP_CORE);
+	(void) system_start_task(&file_task,  "file_task",  TASK_FILE_STACK,  file_stack,  &file_tcb,  TASK_FILE_PRIO,  &task_handle_file,  TASK_FILE_CORE);
+    (void) system_start_task(&t1c_task,   "t1c_task",   TASK_T1C_STACK,   t1c_stack,   &t1c_tcb,   TASK_T1C_PRIO,   &task_handle_t1c,   TASK_T1C_CORE);
+	(void) system_start_task(&mon_task,   "mon_task",   TASK_MON_STACK,   mon_stack,   &mon_tcb,   TASK_MON_PRIO,   &task_handle_mon,   TASK_MON_CORE);
+	system_boot_mark(SYS_BOOT_TASKS_START);
 }
 
 #endif /* !CONFIG_BUILD_ICAM_MINI */
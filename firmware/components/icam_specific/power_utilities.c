@@ -28,10 +28,22 @@
 #include "freertos/semphr.h"
 #include "gcore.h"
 #include "power_utilities.h"
+#include "ps_utilities.h"
 #include "system_config.h"
 
 
 
+//
+// Power Utilities constants
+//
+
+// Status register block read each update (STATUS through IL)
+#define POWER_BLK_START      GCORE_REG_STATUS
+#define POWER_BLK_LEN        (GCORE_REG_IL + 2 - GCORE_REG_STATUS)
+#define POWER_BLK_IDX(r)     ((r) - POWER_BLK_START)
+
+
+
 //
 // Power Utilities variables
 //
@@ -60,6 +72,7 @@ static int aux_average_index;
 static enum CHARGE_STATE_t gpio_to_charge_state(uint8_t reg);
 static enum BATT_STATE_t batt_mv_to_level(uint16_t mv);
 static bool validate_status(uint8_t s);
+static uint16_t get_blk16(uint8_t* blk, uint8_t reg);
 
 
 
@@ -161,51 +174,53 @@ void power_set_brightness(int percent)
 
 void power_batt_update()
 {
-	bool btn = false;
-	bool sdcard = false;
-	enum CHARGE_STATE_t cs = CHARGE_OFF;
+	bool btn;
+	bool sdcard;
+	enum CHARGE_STATE_t cs;
 	int i;
 	uint8_t t8;
-	uint16_t mv[2] = {0, 0};
-	uint16_t ma[2] = {0, 0};
+	uint8_t blk[POWER_BLK_LEN];
+	uint16_t mv[2];
+	uint16_t ma[2];
 	uint32_t sum = 0;
 	
-	// Update charge state and sd card present - assume, at this point, gCore accesses are working
-	if (gcore_get_reg8(GCORE_REG_GPIO, &t8)) {
-		cs = gpio_to_charge_state(t8);
-		sdcard = (t8 & GCORE_GPIO_SD_CARD_MASK) == GCORE_GPIO_SD_CARD_MASK;
+	// Read all the status registers in one transaction.  Keep the previous values if
+	// the read fails.
+	if (!gcore_get_regs(POWER_BLK_START, blk, POWER_BLK_LEN)) {
+		return;
 	}
 	
+	// Update charge state and sd card present
+	t8 = blk[POWER_BLK_IDX(GCORE_REG_GPIO)];
+	cs = gpio_to_charge_state(t8);
+	sdcard = (t8 & GCORE_GPIO_SD_CARD_MASK) == GCORE_GPIO_SD_CARD_MASK;
+	
 	// Update voltages and currents
-	if (gcore_get_reg16(GCORE_REG_VB, &mv[0])) {
-		batt_average_array[batt_average_index] = mv[0];
-		if (++batt_average_index == BATT_NUM_AVG_SAMPLES) batt_average_index = 0;
-		
-		// Compute the battery voltage average mV
-		for (i=0; i<BATT_NUM_AVG_SAMPLES; i++) {
-			sum += batt_average_array[i];
-		}
-		mv[0] = sum / BATT_NUM_AVG_SAMPLES;
+	mv[0] = get_blk16(blk, GCORE_REG_VB);
+	batt_average_array[batt_average_index] = mv[0];
+	if (++batt_average_index == BATT_NUM_AVG_SAMPLES) batt_average_index = 0;
+	
+	// Compute the battery voltage average mV
+	for (i=0; i<BATT_NUM_AVG_SAMPLES; i++) {
+		sum += batt_average_array[i];
 	}
+	mv[0] = sum / BATT_NUM_AVG_SAMPLES;
 	
-	(void) gcore_get_reg16(GCORE_REG_IL, &ma[0]);
-	load_average_array[aux_average_index] = ma[0];
+	load_average_array[aux_average_index] = get_blk16(blk, GCORE_REG_IL);
 	sum = 0;
 	for (i=0; i<POWER_AUX_AVG_SAMPLES; i++) {
 		sum += load_average_array[i];
 	}
 	ma[0] = sum / POWER_AUX_AVG_SAMPLES;
 	
-	(void) gcore_get_reg16(GCORE_REG_VU, &mv[1]);
-	vusb_average_array[aux_average_index] = mv[1];
+	vusb_average_array[aux_average_index] = get_blk16(blk, GCORE_REG_VU);
 	sum = 0;
 	for (i=0; i<POWER_AUX_AVG_SAMPLES; i++) {
 		sum += vusb_average_array[i];
 	}
 	mv[1] = sum / POWER_AUX_AVG_SAMPLES;
 	
-	(void) gcore_get_reg16(GCORE_REG_IU, &ma[1]);
-	lusb_average_array[aux_average_index] = ma[1];
+	lusb_average_array[aux_average_index] = get_blk16(blk, GCORE_REG_IU);
 	sum = 0;
 	for (i=0; i<POWER_AUX_AVG_SAMPLES; i++) {
 		sum += lusb_average_array[i];
@@ -214,12 +229,12 @@ void power_batt_update()
 	if (++aux_average_index == POWER_AUX_AVG_SAMPLES) aux_average_index = 0;
 	
 	// Update button press state
-	if (gcore_get_reg8(GCORE_REG_STATUS, &t8)) {
-		if (validate_status(t8)) {
-			btn = (t8 & GCORE_ST_PB_PRESS_MASK);
-		} else {
-			ESP_LOGE(TAG, "Illegal STATUS = 0x%x", t8);
-		}
+	t8 = blk[POWER_BLK_IDX(GCORE_REG_STATUS)];
+	if (validate_status(t8)) {
+		btn = (t8 & GCORE_ST_PB_PRESS_MASK);
+	} else {
+		ESP_LOGE(TAG, "Illegal STATUS = 0x%x", t8);
+		btn = false;
 	}
 	
 	xSemaphoreTake(status_mutex, portMAX_DELAY);
@@ -274,6 +289,9 @@ bool power_get_sdcard_present()
 
 void power_off()
 {
+	// Save any deferred configuration changes before power is removed
+	(void) ps_flush_config(true);
+	
 	(void) gcore_set_reg8(GCORE_REG_SHDOWN, GCORE_SHUTDOWN_TRIG);
 }
 
@@ -347,4 +365,11 @@ static bool validate_status(uint8_t s)
 	return true;
 }
 
+
+// Get a big-endian 16-bit register from the status block
+static uint16_t get_blk16(uint8_t* blk, uint8_t reg)
+{
+	return (blk[POWER_BLK_IDX(reg)] << 8) | blk[POWER_BLK_IDX(reg) + 1];
+}
+
 #endif /* !CONFIG_BUILD_ICAM_MINI */
\ No newline at end of file
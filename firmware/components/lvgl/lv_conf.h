@@ -97,13 +97,21 @@ typedef int16_t lv_coord_t;
 #if LV_MEM_CUSTOM == 0
 /* Size of the memory used by `lv_mem_alloc` in bytes (>= 2kB)*/
 #ifdef ESP_PLATFORM
-#  define LV_MEM_SIZE    (64U * 1024U)
+#  if CONFIG_LVGL_MEM_PSRAM
+#    define LV_MEM_SIZE    (CONFIG_LVGL_MEM_PSRAM_KB * 1024U)
+#  else
+#    define LV_MEM_SIZE    (64U * 1024U)
+#  endif
 #else
 #  define LV_MEM_SIZE    (64U * 1024U)
 #endif
 
 /* Compiler prefix for a big array declaration */
+#if defined(ESP_PLATFORM) && CONFIG_LVGL_MEM_PSRAM
+#  define LV_MEM_ATTR     EXT_RAM_BSS_ATTR
+#else
 #  define LV_MEM_ATTR
+#endif
 
 /* Set an address for the memory pool instead of allocating it as an array.
  * Can be in external SRAM too. */
@@ -322,7 +330,15 @@ typedef void * lv_img_decoder_user_data_t;
 /* 1: use a custom tick source.
  * It removes the need to manually update the tick with `lv_tick_inc`) */
 #ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+    #ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    /* The FreeRTOS tick hook isn't called for ticks skipped while in light sleep */
+    #define LV_TICK_CUSTOM     1
+    #define LV_TICK_CUSTOM_INCLUDE  "esp_timer.h"
+    #define LV_TICK_CUSTOM_SYS_TIME_EXPR ((uint32_t)(esp_timer_get_time() / 1000))
+    #else
     #define LV_TICK_CUSTOM     0
+    #endif
 #else
     #define LV_TICK_CUSTOM     1
     #if LV_TICK_CUSTOM == 1
@@ -625,7 +641,7 @@ typedef void * lv_obj_user_data_t;
 #define LV_USE_CHECKBOX       1
 
 /*Chart (dependencies: -)*/
-#define LV_USE_CHART    0
+#define LV_USE_CHART    1
 #if LV_USE_CHART
 #  define LV_CHART_AXIS_TICK_LABEL_MAX_LEN    256
 #endif
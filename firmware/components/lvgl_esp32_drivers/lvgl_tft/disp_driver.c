@@ -7,10 +7,20 @@
 #include "disp_spi.h"
 #include "ili9488.h"
 #include "mem_fb.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 
 
 static bool enable_dump;
 
+// Asynchronous push state.  Only one push is outstanding at a time.
+static TaskHandle_t push_task = NULL;
+static SemaphoreHandle_t push_done_sem;
+static volatile bool push_pending = false;
+static lv_area_t push_area;
+static const lv_color_t * push_src;
+
 
 
 void disp_driver_init(bool init_spi)
@@ -22,10 +32,14 @@ void disp_driver_init(bool init_spi)
 	ili9488_init();
 	mem_fb_init();
 	enable_dump = false;
+	push_done_sem = xSemaphoreCreateBinary();
 }
 
 void disp_driver_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map)
 {
+	// LVGL flushes share the bounce buffers with pushes
+	disp_driver_push_wait();
+	
 	if (enable_dump) {
 		mem_fb_flush(drv, area, color_map);
 	} else {
@@ -38,4 +52,71 @@ void disp_driver_en_dump(bool en_dump)
 	enable_dump = en_dump;
 }
 
+// Write src directly to area of the display bypassing LVGL rendering.  Must be called from
+// the LVGL task outside of lv_task_handler().  Returns false if the caller should let LVGL
+// draw area instead.
+bool disp_driver_push_area(const lv_area_t * area, const lv_color_t * src)
+{
+	lv_disp_t * disp = lv_disp_get_default();
+	
+	// Screen dumps need LVGL to render everything
+	if (enable_dump || (disp == NULL)) return false;
+	
+	// Wait for any earlier push and final LVGL flush to finish
+	disp_driver_push_wait();
+	while (lv_disp_get_buf(disp)->flushing) {}
+	
+	return ili9488_push_area(area, src);
+}
+
+// Start writing src directly to area of the display and return while it is written by
+// disp_driver_push_task (falls back to disp_driver_push_area() if that task isn't running).
+// src must not be changed until disp_driver_push_wait() returns.  Same calling rules and
+// return value as disp_driver_push_area().
+bool disp_driver_push_area_async(const lv_area_t * area, const lv_color_t * src)
+{
+	lv_disp_t * disp = lv_disp_get_default();
+	
+	if (push_task == NULL) return disp_driver_push_area(area, src);
+	
+	// Make sure the push task can't fail after we've returned
+	if (enable_dump || (disp == NULL) || !ili9488_push_init()) return false;
+	
+	disp_driver_push_wait();
+	while (lv_disp_get_buf(disp)->flushing) {}
+	
+	push_area = *area;
+	push_src = src;
+	push_pending = true;
+	xTaskNotifyGive(push_task);
+	
+	return true;
+}
+
+// Block until any push started by disp_driver_push_area_async() has read all of its source
+// (the last band may still be on the bus but it is sent from a bounce buffer).
+void disp_driver_push_wait(void)
+{
+	while (push_pending) {
+		(void) xSemaphoreTake(push_done_sem, pdMS_TO_TICKS(10));
+	}
+}
+
+// Task that copies asynchronous pushes to the display so the next frame can be rendered
+// while the SPI DMA sends this one.  The copy blocks on the bus between bands.
+void disp_driver_push_task(void * arg)
+{
+	push_task = xTaskGetCurrentTaskHandle();
+	
+	while (1) {
+		(void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		
+		if (push_pending) {
+			(void) ili9488_push_area(&push_area, push_src);
+			push_pending = false;
+			xSemaphoreGive(push_done_sem);
+		}
+	}
+}
+
 #endif /* CONFIG_BUILD_ICAM_MINI */
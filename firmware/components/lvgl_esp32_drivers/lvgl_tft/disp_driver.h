@@ -32,6 +32,10 @@ extern "C" {
 void disp_driver_init(bool init_spi);
 void disp_driver_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map);
 void disp_driver_en_dump(bool en_dump);
+bool disp_driver_push_area(const lv_area_t * area, const lv_color_t * src);
+bool disp_driver_push_area_async(const lv_area_t * area, const lv_color_t * src);
+void disp_driver_push_wait(void);
+void disp_driver_push_task(void * arg);
 
 
 /**********************
@@ -46,6 +46,7 @@ static spi_device_handle_t spi;
 static volatile bool spi_trans_in_progress = false;
 static volatile bool spi_color_sent;
 static transaction_cb_t chained_post_cb;
+static SemaphoreHandle_t spi_done_sem;
 
 
 /**********************
@@ -60,6 +61,8 @@ void disp_spi_add_device_config(spi_host_device_t host, spi_device_interface_con
 {
     chained_post_cb=devcfg->post_cb;
     devcfg->post_cb=spi_ready;
+    spi_done_sem=xSemaphoreCreateBinary();
+    assert(spi_done_sem!=NULL);
     esp_err_t ret=spi_bus_add_device(host, devcfg, &spi);
     assert(ret==ESP_OK);
 }
@@ -93,7 +96,7 @@ void disp_spi_init(void)
             .sclk_io_num=DISP_SPI_CLK,
             .quadwp_io_num=-1,
             .quadhd_io_num=-1,
-            .max_transfer_sz = DISP_BUF_SIZE * 2
+            .max_transfer_sz = DISP_DMA_BUF_SIZE * 2
     };
 
     //Initialize the SPI bus
@@ -147,6 +150,16 @@ bool disp_spi_is_busy(void)
 }
 
 
+// Block (letting other tasks run) until the current transaction is done.  The timeout
+// covers a stale completion left from an earlier transaction nobody waited on.
+void disp_spi_wait_idle(void)
+{
+    while (spi_trans_in_progress) {
+        (void) xSemaphoreTake(spi_done_sem, pdMS_TO_TICKS(10));
+    }
+}
+
+
 
 /**********************
  *   STATIC FUNCTIONS
@@ -154,11 +167,15 @@ bool disp_spi_is_busy(void)
 
 static void spi_ready (spi_transaction_t *trans)
 {
+    BaseType_t task_woken = pdFALSE;
+
     spi_trans_in_progress = false;
+    xSemaphoreGiveFromISR(spi_done_sem, &task_woken);
 
     lv_disp_t * disp = _lv_refr_get_disp_refreshing();
     if (spi_color_sent) lv_disp_flush_ready(&disp->driver);
     if (chained_post_cb) chained_post_cb(trans);
+    if (task_woken) portYIELD_FROM_ISR();
 }
 
 #endif /* CONFIG_BUILD_ICAM_MINI */
@@ -30,7 +30,22 @@ extern "C" {
 #define DISP_SPI_DMA  LCD_DMA_NUM
 
 // Buffer size - sets maximum update region (and can use a lot of memory!)
-#define DISP_BUF_SIZE (8*LV_HOR_RES_MAX)
+#if CONFIG_LCD_BUF_PSRAM
+#define DISP_BUF_LINES LV_VER_RES_MAX
+#elif CONFIG_LCD_BUF_LARGE
+#define DISP_BUF_LINES 32
+#else
+#define DISP_BUF_LINES 8
+#endif
+#define DISP_BUF_SIZE (DISP_BUF_LINES*LV_HOR_RES_MAX)
+
+// Size of the internal RAM bounce buffers used to send data from PSRAM (also the largest
+// single transfer)
+#if CONFIG_LCD_BUF_PSRAM
+#define DISP_DMA_BUF_SIZE (8*LV_HOR_RES_MAX)
+#else
+#define DISP_DMA_BUF_SIZE DISP_BUF_SIZE
+#endif
  
 // Display-specific GPIO
 #define DISP_SPI_MOSI BRD_LCD_MOSI_IO
@@ -54,6 +69,7 @@ void disp_spi_add_device_config(spi_host_device_t host, spi_device_interface_con
 void disp_spi_send_data(uint8_t * data, uint16_t length);
 void disp_spi_send_colors(uint8_t * data, uint16_t length);
 bool disp_spi_is_busy(void);
+void disp_spi_wait_idle(void);
 
 /**********************
  *      MACROS
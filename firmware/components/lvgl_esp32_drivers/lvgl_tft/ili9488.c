@@ -11,14 +11,20 @@
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include <string.h>
+#include <stdlib.h>
 
 /*********************
  *      DEFINES
  *********************/
 #define TAG "ILI9488"
+
+// Size (pixels) of each of the DMA capable bounce buffers
+#define PUSH_BUF_SIZE DISP_DMA_BUF_SIZE
  
 
 
@@ -41,12 +47,15 @@ typedef struct {
 static void ili9488_send_cmd(uint8_t cmd);
 static void ili9488_send_data(void * data, uint16_t length);
 static void ili9488_send_color(void * data, uint16_t length);
+static bool ili9488_send_bounced(const lv_area_t * area, const lv_color_t * src, bool lvgl_flush);
 
 
 
 /**********************
  *  STATIC VARIABLES
  **********************/
+static lv_color_t * push_buf[2];
+static int push_buf_index = 0;
 
 /**********************
  *      MACROS
@@ -117,6 +126,14 @@ void ili9488_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * col
 {
     uint32_t size = lv_area_get_width(area) * lv_area_get_height(area);
 
+	/* PSRAM draw buffers are sent through the bounce buffers */
+	if (esp_ptr_external_ram(color_map)) {
+		if (!ili9488_send_bounced(area, color_map, true)) {
+			lv_disp_flush_ready(drv);
+		}
+		return;
+	}
+
 	/* Column addresses  */
 	uint8_t xb[] = {
 	    (uint8_t) (area->x1 >> 8) & 0xFF,
@@ -147,6 +164,37 @@ void ili9488_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * col
 }
 
 
+// Write src (area sized, possibly in PSRAM which the SPI DMA can't read) directly to area
+// outside of LVGL.  Returns as soon as the last band is queued so that transfer overlaps
+// whatever the caller does next (later bus users wait for it).  The bus must not be in use
+// by a LVGL flush.  Returns false if the bounce buffers can't be allocated.
+bool ili9488_push_area(const lv_area_t * area, const lv_color_t * src)
+{
+	return ili9488_send_bounced(area, src, false);
+}
+
+
+// Allocate the bounce buffers if they don't already exist.  Called by the first push but
+// may be called earlier by code that needs to know a push can't fail for lack of memory.
+bool ili9488_push_init(void)
+{
+	if (push_buf[0] == NULL) {
+		push_buf[0] = heap_caps_malloc(PUSH_BUF_SIZE * sizeof(lv_color_t), MALLOC_CAP_DMA);
+		push_buf[1] = heap_caps_malloc(PUSH_BUF_SIZE * sizeof(lv_color_t), MALLOC_CAP_DMA);
+		if ((push_buf[0] == NULL) || (push_buf[1] == NULL)) {
+			ESP_LOGE(TAG, "Could not allocate bounce buffers");
+			free(push_buf[0]);
+			free(push_buf[1]);
+			push_buf[0] = NULL;
+			push_buf[1] = NULL;
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
 
 /**********************
  *   STATIC FUNCTIONS
@@ -174,4 +222,63 @@ static void ili9488_send_color(void * data, uint16_t length)
     disp_spi_send_colors(data, length);
 }
 
+// Send src (area sized) through the bounce buffers.  Bands of rows are copied into two DMA
+// capable buffers alternately so the next band is copied while the previous one is sent.
+// The task blocks while it waits for the bus and returns as soon as the last band is queued.
+// When lvgl_flush is set the last band is sent as color data so the LVGL flush is marked ready
+// when it is done.  Returns false if the bounce buffers can't be allocated.
+static bool ili9488_send_bounced(const lv_area_t * area, const lv_color_t * src, bool lvgl_flush)
+{
+	uint32_t w = lv_area_get_width(area);
+	uint32_t h = lv_area_get_height(area);
+	uint32_t lines = PUSH_BUF_SIZE / w;
+	uint32_t n;
+	lv_color_t* bufP;
+	
+	if ((lines == 0) || !ili9488_push_init()) return false;
+	
+	uint8_t xb[] = {
+	    (uint8_t) (area->x1 >> 8) & 0xFF,
+	    (uint8_t) (area->x1) & 0xFF,
+	    (uint8_t) (area->x2 >> 8) & 0xFF,
+	    (uint8_t) (area->x2) & 0xFF,
+	};
+	
+	uint8_t yb[] = {
+	    (uint8_t) (area->y1 >> 8) & 0xFF,
+	    (uint8_t) (area->y1) & 0xFF,
+	    (uint8_t) (area->y2 >> 8) & 0xFF,
+	    (uint8_t) (area->y2) & 0xFF,
+	};
+	
+	// The last band of a previous push may still be in flight
+	disp_spi_wait_idle();
+	ili9488_send_cmd(ILI9488_CMD_COLUMN_ADDRESS_SET);
+	ili9488_send_data(xb, 4);
+	ili9488_send_cmd(ILI9488_CMD_PAGE_ADDRESS_SET);
+	ili9488_send_data(yb, 4);
+	ili9488_send_cmd(ILI9488_CMD_MEMORY_WRITE);
+	
+	while (h) {
+		n = (h > lines) ? lines : h;
+		bufP = push_buf[push_buf_index];
+		push_buf_index ^= 1;
+		
+		// Only one transfer is in flight and it is from the other buffer
+		memcpy(bufP, src, n * w * sizeof(lv_color_t));
+		src += n * w;
+		h -= n;
+		
+		// Only the last band of a LVGL flush marks it ready
+		disp_spi_wait_idle();
+		if (lvgl_flush && (h == 0)) {
+			ili9488_send_color(bufP, n * w * sizeof(lv_color_t));
+		} else {
+			ili9488_send_data(bufP, n * w * sizeof(lv_color_t));
+		}
+	}
+	
+	return true;
+}
+
 #endif /* CONFIG_BUILD_ICAM_MINI */
@@ -139,6 +139,8 @@ extern "C" {
  **********************/
 void ili9488_init(void);
 void ili9488_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map);
+bool ili9488_push_area(const lv_area_t * area, const lv_color_t * src);
+bool ili9488_push_init(void);
 
 
 
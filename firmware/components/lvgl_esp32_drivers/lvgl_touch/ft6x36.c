@@ -21,6 +21,7 @@
 
 #include <esp_log.h>
 #include <driver/i2c.h>
+#include <driver/gpio.h>
 #include "lvgl.h"
 #include "ft6x36.h"
 #include "i2cg.h"
@@ -45,7 +46,7 @@ bool saw_touch = false;
 
 // Forward Declarations
 static esp_err_t ft6x36_i2c_read8(uint8_t slave_addr, uint8_t register_addr, uint8_t *data_buf);
-static esp_err_t ft6x36_i2c_read16(uint8_t slave_addr, uint8_t register_addr, uint16_t *data_buf);
+static esp_err_t ft6x36_i2c_read(uint8_t slave_addr, uint8_t register_addr, uint8_t *data_buf, size_t len);
 static esp_err_t ft6x36_i2c_write8(uint8_t slave_addr, uint8_t register_addr, uint8_t data_buf);
 
 
@@ -83,6 +84,9 @@ void ft6x36_init(uint16_t dev_addr) {
         ft6x36_status.inited = true;
         current_dev_addr = dev_addr;
         
+        // The FT6236 supports a faster clock than the rest of the gCore bus
+        i2c_gcore_set_dev_freq(dev_addr, I2C_TOUCH_FREQ_HZ);
+        
         ESP_LOGI(TAG, "Found touch panel controller");
         if ((ret = ft6x36_i2c_read8(dev_addr, FT6X36_PANEL_ID_REG, &data_buf) != ESP_OK))
             ESP_LOGE(TAG, "Error reading from device: %s",
@@ -102,6 +106,21 @@ void ft6x36_init(uint16_t dev_addr) {
         ESP_LOGI(TAG, "\tRelease code: 0x%02x", data_buf);
         
         ft6x36_i2c_write8(dev_addr, FT6X36_TH_GROUP_REG, FT62X36_DEFAULT_THRESHOLD);
+        
+#ifdef BRD_TOUCH_INT_IO
+        // INT is held low while the panel is touched so we only need to read the
+        // controller then (and once more to see the release)
+        ft6x36_i2c_write8(dev_addr, FT6X36_G_MODE_REG, FT6X36_G_MODE_POLLING);
+        
+        gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << BRD_TOUCH_INT_IO,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_DISABLE
+        };
+        gpio_config(&io_conf);
+#endif
     }
 }
 
@@ -113,49 +132,49 @@ void ft6x36_init(uint16_t dev_addr) {
   */
 bool ft6x36_read(lv_indev_drv_t *drv, lv_indev_data_t *data) {
 	esp_err_t ret;
+    uint8_t buf[FT6X36_P1_READ_LEN];
     uint8_t touch_pnt_cnt;        // Number of detected touch points
     uint16_t cur_x;
     uint16_t cur_y;
     static int16_t last_x = 0;  // 12bit pixel value
     static int16_t last_y = 0;  // 12bit pixel value
+#ifdef BRD_TOUCH_INT_IO
+    static bool last_pressed = false;
+    
+    // Skip the I2C access when nothing is touching the panel
+    if (!last_pressed && (gpio_get_level(BRD_TOUCH_INT_IO) != 0)) {
+        data->point.x = last_x;
+        data->point.y = last_y;
+        data->state = LV_INDEV_STATE_REL;
+        return false;
+    }
+    last_pressed = false;
+#endif
 
-    ret = ft6x36_i2c_read8(current_dev_addr, FT6X36_TD_STAT_REG, &touch_pnt_cnt);
+    // Read the status and first touch point together
+    ret = ft6x36_i2c_read(current_dev_addr, FT6X36_TD_STAT_REG, buf, FT6X36_P1_READ_LEN);
     if (ret != ESP_OK) {
     	// There is an occasional failure of this read (perhaps from the FT6236 clock
     	// stretching) so we ignore failures (otherwise touch_pnt_cnt seems corrupted and
     	// we get an erroneous touch)
-    	ESP_LOGE(TAG, "Error getting STATUS register: %s", esp_err_to_name(ret));
+    	ESP_LOGE(TAG, "Error getting touch data: %s", esp_err_to_name(ret));
         data->point.x = last_x;
         data->point.y = last_y;
         data->state = LV_INDEV_STATE_REL;   // no touch detected
         return false;
     }
+    touch_pnt_cnt = buf[0] & FT6X36_TD_STAT_MASK;
     if (touch_pnt_cnt != 1) {    // ignore no touch & multi touch
         data->point.x = last_x;
         data->point.y = last_y;
         data->state = LV_INDEV_STATE_REL;
         return false;
     }
-	
-    // Read X value
-    ret = ft6x36_i2c_read16(current_dev_addr, FT6X36_P1_XH_REG, &cur_x);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Error getting X coordinates: %s", esp_err_to_name(ret));
-        data->point.x = last_x;
-        data->point.y = last_y;
-        data->state = LV_INDEV_STATE_REL;   // no touch detected
-        return false;
-    }
-
-    // Read Y value
-    ret = ft6x36_i2c_read16(current_dev_addr, FT6X36_P1_YH_REG, &cur_y);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Error getting Y coordinates: %s", esp_err_to_name(ret));
-        data->point.x = last_x;
-        data->point.y = last_y;
-        data->state = LV_INDEV_STATE_REL;   // no touch detected
-        return false;
-    }
+    cur_x = (buf[FT6X36_P1_XH_REG - FT6X36_TD_STAT_REG] << 8) | buf[FT6X36_P1_XL_REG - FT6X36_TD_STAT_REG];
+    cur_y = (buf[FT6X36_P1_YH_REG - FT6X36_TD_STAT_REG] << 8) | buf[FT6X36_P1_YL_REG - FT6X36_TD_STAT_REG];
+#ifdef BRD_TOUCH_INT_IO
+    last_pressed = true;
+#endif
 
 	last_x = cur_x & ((FT6X36_MSB_MASK << 8) | FT6X36_LSB_MASK);
 	last_y = cur_y & ((FT6X36_MSB_MASK << 8) | FT6X36_LSB_MASK);
@@ -229,29 +248,20 @@ static esp_err_t ft6x36_i2c_read8(uint8_t slave_addr, uint8_t register_addr, uin
 }
 
 
-static esp_err_t ft6x36_i2c_read16(uint8_t slave_addr, uint8_t register_addr, uint16_t *data_buf) {
-	uint8_t buf[2];
+static esp_err_t ft6x36_i2c_read(uint8_t slave_addr, uint8_t register_addr, uint8_t *data_buf, size_t len) {
 	esp_err_t ret;
 	
 	i2c_gcore_lock();
 	
-   // Write the register address
+   // Write the starting register address
    	ret = i2c_gcore_write_slave(slave_addr, &register_addr, 1);
-   	if (ret != ESP_OK) {
-   		i2c_gcore_unlock();
-   		return ret;
-   	}
-
-	// Read the register
-	ret = i2c_gcore_read_slave(slave_addr, buf, 2);
-	if (ret != ESP_OK) {
-		i2c_gcore_unlock();
-		return ret;
+   	if (ret == ESP_OK) {
+   		// Read the registers
+		ret = i2c_gcore_read_slave(slave_addr, data_buf, len);
 	}
 	
 	i2c_gcore_unlock();
-
-	*data_buf = (buf[0] << 8) | buf[1];
+	
     return ret;
 }
 
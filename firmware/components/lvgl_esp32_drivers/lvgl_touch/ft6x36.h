@@ -86,6 +86,9 @@ extern "C" {
 #define FT6X36_P1_YH_REG                0x05
 #define FT6X36_P1_YL_REG                0x06
 
+/* Length of TD_STAT through P1_YL, read together for each touch sample */
+#define FT6X36_P1_READ_LEN              5
+
 #define FT6X36_P1_WEIGHT_REG            0x07    /* Register reporting touch pressure - read only */
 #define FT6X36_TOUCH_WEIGHT_MASK        0xFF
 #define FT6X36_TOUCH_WEIGHT_SHIFT       0
@@ -132,6 +135,10 @@ extern "C" {
 
 #define FT6X36_CHIPSELECT_REG            0xA3       /* 0x36 for ft6236; 0x06 for ft6206 */
 
+#define FT6X36_G_MODE_REG                0xA4       /* Interrupt mode */
+#define FT6X36_G_MODE_POLLING            0x00       /* INT held low while touched */
+#define FT6X36_G_MODE_TRIGGER            0x01       /* INT pulsed low for each new report */
+
 #define FT6X36_POWER_MODE_REG            0xA5
 #define FT6X36_FIRMWARE_ID_REG           0xA6
 #define FT6X36_RELEASECODE_REG           0xAF
@@ -16,6 +16,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this software.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <string.h>
 #include "palettes.h"
 #include "arctic.h"
 #include "banded.h"
@@ -72,6 +73,14 @@ static palette_t palettes[PALETTE_COUNT] = {
 	{
 		.name = "IsoTherm",
 		.map_ptr = &isotherm_palette_map
+	},
+	{
+		.name = "Custom",
+		.map_ptr = NULL
+	},
+	{
+		.name = "Threshold",
+		.map_ptr = NULL
 	}
 };
 
@@ -80,15 +89,52 @@ static palette_t palettes[PALETTE_COUNT] = {
 //
 // Palette variables
 //
+// The lookup tables are aligned so renderers can read them a vector at a time
 #ifdef ESP_PLATFORM
-uint16_t palette16[256];                 // Current palette for display fast lookup
-uint32_t palette24[256];                 // Current palette for file save fast lookup
+uint16_t palette16[256] __attribute__((aligned(16)));  // Current palette for display fast lookup
+uint32_t palette24[256] __attribute__((aligned(16)));  // Current palette for file save fast lookup
 #else
-uint32_t palette24[256];                 // Current palette for file save fast lookup
-uint32_t palette32[256];                 // Current palette for display fast lookup
+uint32_t palette24[256] __attribute__((aligned(16)));  // Current palette for file save fast lookup
+uint32_t palette32[256] __attribute__((aligned(16)));  // Current palette for display fast lookup
 #endif
-int cur_palette;
-int cur_save_palette;
+int cur_palette = -1;
+int cur_save_palette = -1;
+
+// Custom palette computed from its gradient stops (white hot until stops are set)
+static palette_stop_t custom_stops[PALETTE_MAX_STOPS] = {
+	{0, 0, 0, 0},
+	{255, 255, 255, 255}
+};
+static int custom_num_stops = 2;
+static uint8_t custom_palette_map[256][3];
+static bool custom_palette_valid = false;
+
+// Threshold palette.  Palette indices whose temperature, given the AGC range mapping Y16
+// to the 8-bit data, is above (or below) the threshold are colored with the ironblack (or
+// arctic) colors and the rest in gray.  The display and save tables each have their own
+// range since they are updated by different tasks.
+typedef struct {
+	uint16_t agc_min;
+	uint16_t agc_max;
+	bool is_temp;
+} palette_range_t;
+
+static uint16_t threshold_t = PALETTE_DEF_THRESHOLD;
+static bool threshold_below = false;
+static palette_range_t threshold_range;
+static palette_range_t threshold_save_range;
+static uint8_t threshold_map[256][3];
+
+
+
+//
+// Forward declarations for internal functions
+//
+static void _build_palette(int n);
+static void _build_save_palette(int n);
+static palette_map_t* _get_map(int n, palette_range_t* range);
+static void _compute_custom_map();
+static void _compute_threshold_map(palette_range_t* range);
 
 
 
@@ -96,48 +142,228 @@ int cur_save_palette;
 // Palette API
 //
 void set_palette(int n)
+{
+	// The tables are only rebuilt when the palette actually changes.  Remote GUIs set the
+	// palette again each time the camera reports it.
+	if ((n < PALETTE_COUNT) && (n != cur_palette)) {
+		_build_palette(n);
+		cur_palette = n;
+	}
+}
+
+
+void set_save_palette(int n)
+{
+	if ((n < PALETTE_COUNT) && (n != cur_save_palette)) {
+		_build_save_palette(n);
+		cur_save_palette = n;
+	}
+}
+
+
+char* get_palette_name(int n)
+{
+	return palettes[n].name;
+}
+
+
+/**
+ * Set the custom palette's gradient stops (2 - PALETTE_MAX_STOPS with increasing
+ * positions).  Returns false if they are invalid.
+ */
+bool set_custom_palette_stops(int num, const palette_stop_t* stops)
+{
+	int i;
+	
+	if ((num < 2) || (num > PALETTE_MAX_STOPS)) return false;
+	for (i=1; i<num; i++) {
+		if (stops[i].pos <= stops[i-1].pos) return false;
+	}
+	
+	memcpy(custom_stops, stops, num * sizeof(palette_stop_t));
+	custom_num_stops = num;
+	custom_palette_valid = false;
+	
+	if (cur_palette == PALETTE_CUSTOM) _build_palette(PALETTE_CUSTOM);
+	if (cur_save_palette == PALETTE_CUSTOM) _build_save_palette(PALETTE_CUSTOM);
+	
+	return true;
+}
+
+
+/**
+ * Load the custom palette's gradient stops into stops (which must hold PALETTE_MAX_STOPS)
+ * and return the number of them
+ */
+int get_custom_palette_stops(palette_stop_t* stops)
+{
+	memcpy(stops, custom_stops, custom_num_stops * sizeof(palette_stop_t));
+	
+	return custom_num_stops;
+}
+
+
+/**
+ * Set the threshold palette's temperature (Tiny1C 1/16 °K units) and whether it colors
+ * temperatures below instead of above it
+ */
+void set_threshold_palette(uint16_t t, bool below)
+{
+	threshold_t = t;
+	threshold_below = below;
+	
+	if (cur_palette == PALETTE_THRESHOLD) _build_palette(PALETTE_THRESHOLD);
+	if (cur_save_palette == PALETTE_THRESHOLD) _build_save_palette(PALETTE_THRESHOLD);
+}
+
+
+void get_threshold_palette(uint16_t* t, bool* below)
+{
+	*t = threshold_t;
+	*below = threshold_below;
+}
+
+
+/**
+ * Let the display palette know the AGC range of the image about to be rendered.  The
+ * threshold palette table is rebuilt when it changes.  Returns true if the table changed
+ * (so the colormap can be redrawn).
+ */
+bool update_palette_range(uint16_t agc_min, uint16_t agc_max, bool is_temp)
+{
+	if (cur_palette != PALETTE_THRESHOLD) return false;
+	if ((agc_min == threshold_range.agc_min) && (agc_max == threshold_range.agc_max) && (is_temp == threshold_range.is_temp)) return false;
+	
+	threshold_range.agc_min = agc_min;
+	threshold_range.agc_max = agc_max;
+	threshold_range.is_temp = is_temp;
+	_build_palette(PALETTE_THRESHOLD);
+	
+	return true;
+}
+
+
+/**
+ * Let the save palette know the AGC range of the image about to be rendered
+ */
+void update_save_palette_range(uint16_t agc_min, uint16_t agc_max, bool is_temp)
+{
+	if (cur_save_palette != PALETTE_THRESHOLD) return;
+	if ((agc_min == threshold_save_range.agc_min) && (agc_max == threshold_save_range.agc_max) && (is_temp == threshold_save_range.is_temp)) return;
+	
+	threshold_save_range.agc_min = agc_min;
+	threshold_save_range.agc_max = agc_max;
+	threshold_save_range.is_temp = is_temp;
+	_build_save_palette(PALETTE_THRESHOLD);
+}
+
+
+
+//
+// Internal functions
+//
+static void _build_palette(int n)
 {
 	int i;
+	palette_map_t* mapP = _get_map(n, &threshold_range);
 	
-	if (n < PALETTE_COUNT) {
-		for (i=0; i<256; i++) {
+	for (i=0; i<256; i++) {
 #ifdef ESP_PLATFORM
-			palette16[i] = RGB_TO_16BIT_SWAP(
-				(*(palettes[n].map_ptr))[i][0],
-				(*(palettes[n].map_ptr))[i][1],
-				(*(palettes[n].map_ptr))[i][2]
-			);
+		palette16[i] = RGB_TO_16BIT_SWAP((*mapP)[i][0], (*mapP)[i][1], (*mapP)[i][2]);
 #else
-			palette32[i] = RGB_TO_32BIT(
-				(*(palettes[n].map_ptr))[i][0],
-				(*(palettes[n].map_ptr))[i][1],
-				(*(palettes[n].map_ptr))[i][2]
-			);
+		palette32[i] = RGB_TO_32BIT((*mapP)[i][0], (*mapP)[i][1], (*mapP)[i][2]);
 #endif
-		}
-		cur_palette = n;
 	}
 }
 
 
-void set_save_palette(int n)
+static void _build_save_palette(int n)
 {
 	int i;
+	palette_map_t* mapP = _get_map(n, &threshold_save_range);
 	
-	if (n < PALETTE_COUNT) {		
-		for (i=0; i<256; i++) {
-			palette24[i] = RGB_TO_24BIT(
-				(*(palettes[n].map_ptr))[i][0],
-				(*(palettes[n].map_ptr))[i][1],
-				(*(palettes[n].map_ptr))[i][2]
-			);
+	for (i=0; i<256; i++) {
+		palette24[i] = RGB_TO_24BIT((*mapP)[i][0], (*mapP)[i][1], (*mapP)[i][2]);
+	}
+}
+
+
+// Return the colormap for palette n, computing it first if necessary.  The threshold
+// palette's colormap is only valid until the next call.
+static palette_map_t* _get_map(int n, palette_range_t* range)
+{
+	if (n == PALETTE_CUSTOM) {
+		if (!custom_palette_valid) _compute_custom_map();
+		return (palette_map_t*) &custom_palette_map;
+	} else if (n == PALETTE_THRESHOLD) {
+		_compute_threshold_map(range);
+		return (palette_map_t*) &threshold_map;
+	}
+	
+	return palettes[n].map_ptr;
+}
+
+
+static void _compute_custom_map()
+{
+	int i, s, c;
+	int d, f;
+	palette_stop_t* s1P;
+	palette_stop_t* s2P;
+	
+	s = 0;
+	for (i=0; i<256; i++) {
+		// Find the stops around i
+		while ((s < (custom_num_stops - 2)) && (i > custom_stops[s+1].pos)) s++;
+		s1P = &custom_stops[s];
+		s2P = &custom_stops[s+1];
+		
+		if (i <= s1P->pos) {
+			f = 0;
+		} else if (i >= s2P->pos) {
+			f = 256;
+		} else {
+			d = s2P->pos - s1P->pos;
+			f = ((i - s1P->pos) * 256) / d;
 		}
-		cur_save_palette = n;
+		
+		c = s1P->r + (((s2P->r - s1P->r) * f) >> 8);
+		custom_palette_map[i][0] = (uint8_t) c;
+		c = s1P->g + (((s2P->g - s1P->g) * f) >> 8);
+		custom_palette_map[i][1] = (uint8_t) c;
+		c = s1P->b + (((s2P->b - s1P->b) * f) >> 8);
+		custom_palette_map[i][2] = (uint8_t) c;
 	}
+	
+	custom_palette_valid = true;
 }
 
 
-char* get_palette_name(int n)
+static void _compute_threshold_map(palette_range_t* range)
 {
-	return palettes[n].name;
+	int i;
+	int32_t t;
+	int32_t r = (int32_t) range->agc_max - (int32_t) range->agc_min;
+	bool colored;
+	palette_map_t* colorP = threshold_below ? &arctic_palette_map : &ironblack_palette_map;
+	
+	if (r < 1) r = 1;
+	
+	for (i=0; i<256; i++) {
+		// Temperature the 8-bit value maps back to
+		t = (int32_t) range->agc_min + (i * r + 127) / 255;
+		if (!range->is_temp) {
+			colored = false;
+		} else if (threshold_below) {
+			colored = (t <= threshold_t);
+		} else {
+			colored = (t >= threshold_t);
+		}
+		
+		if (colored) {
+			memcpy(threshold_map[i], (*colorP)[i], 3);
+		} else {
+			memcpy(threshold_map[i], gray_palette_map[i], 3);
+		}
+	}
 }
@@ -19,6 +19,7 @@
 #ifndef PALETTES_H
 #define PALETTES_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 
@@ -37,16 +38,33 @@
 #define PALETTE_SEPIA          7
 #define PALETTE_BANDED         8
 #define PALETTE_ISOTHERM       9
+#define PALETTE_CUSTOM         10
+#define PALETTE_THRESHOLD      11
 
-#define PALETTE_COUNT          10
+#define PALETTE_COUNT          12
+
+// Custom palette gradient stops
+#define PALETTE_MAX_STOPS      16
+
+// Default threshold palette temperature (40 °C in Tiny1C 1/16 °K units)
+#define PALETTE_DEF_THRESHOLD  5010
 
 typedef const uint8_t palette_map_t[256][3];
 
 typedef struct {
 	char name[32];
-	palette_map_t* map_ptr;
+	palette_map_t* map_ptr;               // NULL for palettes computed at runtime
 } palette_t;
 
+// Custom palette gradient stop.  Colors are linearly interpolated between stops and the
+// end stops extend to 0 and 255.
+typedef struct {
+	uint8_t pos;                          // Palette index 0-255
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+} palette_stop_t;
+
 
 
 //
@@ -91,5 +109,11 @@ extern int cur_palette;
 void set_palette(int n);
 void set_save_palette(int n);
 char* get_palette_name(int n);
+bool set_custom_palette_stops(int num, const palette_stop_t* stops);
+int get_custom_palette_stops(palette_stop_t* stops);
+void set_threshold_palette(uint16_t t, bool below);
+void get_threshold_palette(uint16_t* t, bool* below);
+bool update_palette_range(uint16_t agc_min, uint16_t agc_max, bool is_temp);
+void update_save_palette_range(uint16_t agc_min, uint16_t agc_max, bool is_temp);
 
 #endif
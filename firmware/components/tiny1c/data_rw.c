@@ -10,6 +10,10 @@
 static const char* TAG = "data_rw";
 
 static uint16_t special_poll_delay_ms = 0;
+static uint32_t expected_latency_usec = 0;
+
+
+static ir_error_t i2c_check_access_done(uint32_t first_poll_usec);
 
 
 ir_error_t i2c_init()
@@ -49,12 +53,18 @@ ir_error_t i2c_data_read(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t w
 }
 
 
-static ir_error_t i2c_check_access_done(void)
+static ir_error_t i2c_check_access_done(uint32_t first_poll_usec)
 {
 	HAL_StatusTypeDef rst;
     uint8_t status = 0xFF;
     uint8_t error_type=0;
-    uint16_t wWaitTime = I2C_TRANSFER_WAIT_TIME_MS;
+    uint32_t wait_usec = I2C_TRANSFER_WAIT_TIME_MS * 1000;
+    uint32_t poll_usec = POLL_MIN_USEC;
+    
+    // Don't poll before the command could have completed
+    if (first_poll_usec != 0) {
+    	HAL_Delay_us(first_poll_usec);
+    }
     
     do
     {
@@ -89,9 +99,12 @@ static ir_error_t i2c_check_access_done(void)
         {
             return IR_SUCCESS;
         }
-        HAL_Delay(5);
-        wWaitTime-=5;
-    } while (wWaitTime);
+        
+        // Back off so short commands complete quickly without long commands flooding the bus
+        HAL_Delay_us(poll_usec);
+        wait_usec = (wait_usec > poll_usec) ? (wait_usec - poll_usec) : 0;
+        poll_usec = (poll_usec < (POLL_MAX_USEC/2)) ? (2 * poll_usec) : POLL_MAX_USEC;
+    } while (wait_usec);
     
 i2c_check_access_done_err:
     ESP_LOGE(TAG, "check done fail!");
@@ -103,6 +116,7 @@ ir_error_t i2c_data_write(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t
 {
     HAL_StatusTypeDef rst;
     int n;
+    uint32_t latency_usec;
 
     if (wLen > I2C_OUT_BUFFER_MAX)
     {
@@ -113,6 +127,7 @@ ir_error_t i2c_data_write(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t
     if (rst != HAL_OK)
     {
         ESP_LOGE(TAG, "I2C write command failed (error_code:%d)", rst);
+        expected_latency_usec = 0;
         return IR_I2C_SET_REGISTER_FAIL;
     }
         //when wI2CRegAddr bit[15] = 1,only transfer data to vdcmd buf,no need to call check_access_done
@@ -122,22 +137,28 @@ ir_error_t i2c_data_write(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t
     }
     else
     {
+    	// Latency hints only apply to the one command they were set for
+    	latency_usec = expected_latency_usec;
+    	expected_latency_usec = 0;
+    	
     	if (special_poll_delay_ms != 0) {
     		n = special_poll_delay_ms / SPECIAL_POLL_DELAY_INC_MSEC;
     		while (n--) {    	
     			HAL_Delay(SPECIAL_POLL_DELAY_INC_MSEC);
     		
     			// Ignore failures but return a successful poll during delay period
-    			if (i2c_check_access_done() == IR_SUCCESS) {
+    			if (i2c_check_access_done(0) == IR_SUCCESS) {
+    				special_poll_delay_ms = 0;
     				return IR_SUCCESS;
     			}
     		}
     		// Reset to zero after use (commands must explicitly set this)
     		special_poll_delay_ms = 0;
+    		latency_usec = 0;
     	}
     	
     	// Return poll result immediately if no special poll delay or after poll delay expires
-    	return i2c_check_access_done();
+    	return i2c_check_access_done(latency_usec);
     }
 
 }
@@ -166,3 +187,9 @@ void i2c_set_special_poll_delay(uint16_t delay_ms)
 {
 	special_poll_delay_ms = delay_ms;
 }
+
+
+void i2c_set_expected_latency(uint32_t latency_usec)
+{
+	expected_latency_usec = latency_usec;
+}
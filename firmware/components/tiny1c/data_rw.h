@@ -45,6 +45,11 @@
 
 #define SPECIAL_POLL_DELAY_INC_MSEC 100
 
+// Command completion polling.  The first status poll is made after the command's expected
+// latency (if set) and then the poll interval doubles from POLL_MIN_USEC to POLL_MAX_USEC.
+#define POLL_MIN_USEC               100
+#define POLL_MAX_USEC               5000
+
 
 typedef struct
 {
@@ -93,4 +98,5 @@ ir_error_t i2c_data_read(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t w
 ir_error_t i2c_data_write(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t wLen, uint8_t* pbyData);
 ir_error_t i2c_data_write_no_wait(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t wLen, uint8_t* pbyData);
 void i2c_set_special_poll_delay(uint16_t delay_ms);
+void i2c_set_expected_latency(uint32_t latency_usec);
 #endif
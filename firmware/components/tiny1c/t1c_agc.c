@@ -0,0 +1,156 @@
+/*
+ * Automatic Gain Control (AGC) utility functions for scaling Tiny1C Y16 image data to
+ * 8-bits.  Uses a fixed-point reciprocal computed once per frame so pixels are scaled
+ * with a multiply and shift instead of a divide.  Also supports percentile clipped
+ * linear and plateau histogram equalized modes built from a per-frame histogram.  Both
+ * derive their mapping from the histogram so their cost is O(pixels + bins).
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "t1c_agc.h"
+
+
+
+//
+// API
+//
+void t1c_agc_setup_linear(t1c_agc_linear_t* agc, uint16_t y16_min, uint16_t y16_max, bool clamp, bool invert)
+{
+	uint32_t diff;
+	
+	diff = (y16_max > y16_min) ? (y16_max - y16_min) : 1;
+	
+	agc->y16_min = y16_min;
+	agc->diff = (uint16_t) diff;
+	agc->recip = ((255 << AGC_RECIP_SHIFT) + diff - 1) / diff;
+	agc->clamp = clamp;
+	agc->invert_mask = invert ? 0xFF : 0x00;
+}
+
+
+void t1c_agc_scale_linear(const t1c_agc_linear_t* agc, const uint16_t* src, uint8_t* dst, int len)
+{
+	uint16_t min = agc->y16_min;
+	uint32_t recip = agc->recip;
+	uint8_t mask = agc->invert_mask;
+	uint32_t t32;
+	
+	if (agc->clamp) {
+		while (len--) {
+			*dst++ = t1c_agc_scale_pixel(agc, *src++);
+		}
+	} else {
+		// Pixels are known to be in the range y16_min - y16_max so (v - y16_min) <= diff
+		// and the product cannot overflow
+		while (len--) {
+			t32 = ((uint32_t) (*src++ - min) * recip) >> AGC_RECIP_SHIFT;
+			*dst++ = ((t32 > 255) ? 255 : (uint8_t) t32) ^ mask;
+		}
+	}
+}
+
+
+void t1c_agc_percentile_range(const uint16_t* hist, uint16_t base, int shift, uint16_t* y16_min, uint16_t* y16_max)
+{
+	int lo, hi;
+	uint32_t sum = 0;
+	uint32_t total = 0;
+	uint32_t thresh;
+	uint32_t t32;
+	
+	for (int i=0; i<AGC_HIST_BINS; i++) {
+		total += hist[i];
+	}
+	
+	// Find the first bin where the cumulative count exceeds the low threshold
+	thresh = (total * AGC_PERCENTILE_LOW) / 100;
+	for (lo=0; lo<(AGC_HIST_BINS-1); lo++) {
+		sum += hist[lo];
+		if (sum > thresh) break;
+	}
+	
+	// Find the last bin where the cumulative count from the top exceeds the high threshold
+	thresh = (total * AGC_PERCENTILE_HIGH) / 100;
+	sum = 0;
+	for (hi=(AGC_HIST_BINS-1); hi>lo; hi--) {
+		sum += hist[hi];
+		if (sum > thresh) break;
+	}
+	
+	*y16_min = base + (uint16_t) (lo << shift);
+	t32 = (uint32_t) base + (((uint32_t) hi + 1) << shift) - 1;
+	*y16_max = (t32 > 0xFFFF) ? 0xFFFF : (uint16_t) t32;
+}
+
+
+void t1c_agc_setup_hist_eq(t1c_agc_hist_eq_t* agc, const uint16_t* hist, uint16_t base, int shift, bool invert)
+{
+	uint32_t total = 0;
+	uint32_t plateau;
+	uint32_t sum;
+	uint32_t t32;
+	
+	agc->base = base;
+	agc->shift = shift;
+	agc->invert_mask = invert ? 0xFF : 0x00;
+	
+	// Plateau limit each bin
+	for (int i=0; i<AGC_HIST_BINS; i++) {
+		total += hist[i];
+	}
+	plateau = (AGC_HIST_PLATEAU_MULT * total) / AGC_HIST_BINS;
+	if (plateau == 0) plateau = 1;
+	
+	total = 0;
+	for (int i=0; i<AGC_HIST_BINS; i++) {
+		total += (hist[i] > plateau) ? plateau : hist[i];
+	}
+	if (total == 0) total = 1;
+	
+	// Build the cumulative distribution mapping
+	sum = 0;
+	for (int i=0; i<AGC_HIST_BINS; i++) {
+		agc->lut[i] = (uint8_t) ((sum * 255) / total);
+		sum += (hist[i] > plateau) ? plateau : hist[i];
+	}
+	t32 = (sum * 255) / total;
+	agc->lut[AGC_HIST_BINS] = (t32 > 255) ? 255 : (uint8_t) t32;
+}
+
+
+void t1c_agc_scale_hist_eq(const t1c_agc_hist_eq_t* agc, const uint16_t* src, uint8_t* dst, int len)
+{
+	uint16_t base = agc->base;
+	int shift = agc->shift;
+	uint32_t frac_mask = (1 << shift) - 1;
+	uint32_t d;
+	uint32_t bin;
+	uint32_t lo, hi;
+	
+	while (len--) {
+		d = (*src > base) ? (uint32_t) (*src - base) : 0;
+		src++;
+		bin = d >> shift;
+		if (bin >= AGC_HIST_BINS) {
+			*dst++ = agc->lut[AGC_HIST_BINS] ^ agc->invert_mask;
+		} else {
+			// Interpolate within the bin
+			lo = agc->lut[bin];
+			hi = agc->lut[bin+1];
+			*dst++ = (uint8_t) (lo + (((hi - lo) * (d & frac_mask)) >> shift)) ^ agc->invert_mask;
+		}
+	}
+}
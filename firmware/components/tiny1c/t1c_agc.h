@@ -0,0 +1,107 @@
+/*
+ * Automatic Gain Control (AGC) utility functions for scaling Tiny1C Y16 image data to
+ * 8-bits.  Uses a fixed-point reciprocal computed once per frame so pixels are scaled
+ * with a multiply and shift instead of a divide.  Also supports percentile clipped
+ * linear and plateau histogram equalized modes built from a per-frame histogram.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef _T1C_AGC_H_
+#define _T1C_AGC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//
+// Constants
+//
+
+// AGC modes (values used by CMD_AGC_MODE and stored persistently)
+#define T1C_AGC_MODE_LINEAR      0
+#define T1C_AGC_MODE_PERCENTILE  1
+#define T1C_AGC_MODE_HIST_EQ     2
+
+#define T1C_AGC_NUM_MODES        3
+
+// Reciprocal fixed-point precision
+#define AGC_RECIP_SHIFT   16
+
+// Histogram length (bins)
+#define AGC_HIST_BINS            256
+
+// Percentile clip points (percent of pixels excluded below and above the range)
+#define AGC_PERCENTILE_LOW       1
+#define AGC_PERCENTILE_HIGH      1
+
+// Histogram equalization bin plateau (multiple of the average bin count) - limits the
+// contrast stretch large uniform areas (e.g. sky) get
+#define AGC_HIST_PLATEAU_MULT    4
+
+
+//
+// Data structures
+//
+
+// Linear scaling parameters, computed once per frame by t1c_agc_setup_linear()
+typedef struct {
+	uint16_t y16_min;
+	uint16_t diff;                 // y16_max - y16_min (never 0)
+	uint32_t recip;                // Q16 255/diff, rounded up so y16_max maps to 255
+	bool clamp;                    // Set if pixels may lie outside y16_min - y16_max
+	uint8_t invert_mask;           // 0x00 or 0xFF (XOR'd with output)
+} t1c_agc_linear_t;
+
+// Histogram equalization mapping, computed once per frame by t1c_agc_setup_hist_eq().
+// lut[n] is the output value at the start of histogram bin n (lut[AGC_HIST_BINS] is the
+// end of the last bin) and values within a bin are interpolated.
+typedef struct {
+	uint16_t base;                 // Y16 value at the start of bin 0
+	int shift;                     // Each bin covers (1 << shift) Y16 counts
+	uint8_t invert_mask;           // 0x00 or 0xFF (XOR'd with output)
+	uint8_t lut[AGC_HIST_BINS+1];
+} t1c_agc_hist_eq_t;
+
+
+//
+// API
+//
+void t1c_agc_setup_linear(t1c_agc_linear_t* agc, uint16_t y16_min, uint16_t y16_max, bool clamp, bool invert);
+void t1c_agc_scale_linear(const t1c_agc_linear_t* agc, const uint16_t* src, uint8_t* dst, int len);
+
+// Histogram based AGC.  The histogram has AGC_HIST_BINS bins starting at Y16 value base with
+// each bin covering (1 << shift) counts (pixels outside the range are counted in the end bins).
+void t1c_agc_percentile_range(const uint16_t* hist, uint16_t base, int shift, uint16_t* y16_min, uint16_t* y16_max);
+void t1c_agc_setup_hist_eq(t1c_agc_hist_eq_t* agc, const uint16_t* hist, uint16_t base, int shift, bool invert);
+void t1c_agc_scale_hist_eq(const t1c_agc_hist_eq_t* agc, const uint16_t* src, uint8_t* dst, int len);
+
+// Scale a single pixel
+static inline uint8_t t1c_agc_scale_pixel(const t1c_agc_linear_t* agc, uint16_t v)
+{
+	uint32_t d;
+	
+	if (v <= agc->y16_min) {
+		d = 0;
+	} else {
+		d = v - agc->y16_min;
+		if (d > agc->diff) d = agc->diff;
+	}
+	d = (d * agc->recip) >> AGC_RECIP_SHIFT;
+	
+	return ((d > 255) ? 255 : (uint8_t) d) ^ agc->invert_mask;
+}
+
+#endif /* _T1C_AGC_H_ */
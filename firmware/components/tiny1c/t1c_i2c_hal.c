@@ -17,6 +17,7 @@
  * along with this software.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "esp_system.h"
+#include "esp_rom_sys.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "t1c_i2c_hal.h"
@@ -38,6 +39,17 @@ void HAL_Delay(int n)
 }
 
 
+// Busy-wait delays shorter than a tick, otherwise block for the whole number of mSec
+void HAL_Delay_us(uint32_t us)
+{
+	if (us < (1000 * portTICK_PERIOD_MS)) {
+		esp_rom_delay_us(us);
+	} else {
+		vTaskDelay(pdMS_TO_TICKS(us / 1000));
+	}
+}
+
+
 HAL_StatusTypeDef HAL_I2C_Init()
 {
 	// I2C bus initialized at startup by sys_utilities
@@ -34,6 +34,7 @@ typedef enum
 
 
 void HAL_Delay(int n);
+void HAL_Delay_us(uint32_t us);
 HAL_StatusTypeDef HAL_I2C_Init();
 HAL_StatusTypeDef HAL_I2C_Mem_Write(uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
 HAL_StatusTypeDef HAL_I2C_Mem_Read(uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
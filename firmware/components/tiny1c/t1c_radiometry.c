@@ -0,0 +1,371 @@
+/*
+ * Local radiometry functions computing spot, min/max and region temperatures directly
+ * from Tiny1C Y16 temperature data (Y16_MODE_TEMPERATURE) instead of requesting them
+ * from the Tiny1C over the CCI.  Results use the same units (1/16 °K) and structures
+ * as the Tiny1C TPD commands.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "t1c_radiometry.h"
+#include "tiny1c.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+//
+// Forward declarations for internal functions
+//
+static uint16_t _clip(uint16_t v, uint16_t max);
+
+
+
+//
+// API
+//
+uint16_t t1c_rad_point_temp(const uint16_t* img, const IrPoint_t* point)
+{
+	uint16_t x = _clip(point->x, T1C_WIDTH-1);
+	uint16_t y = _clip(point->y, T1C_HEIGHT-1);
+	
+	return img[y*T1C_WIDTH + x];
+}
+
+
+void t1c_rad_min_max_temp(const uint16_t* img, MaxMinTempInfo_t* info)
+{
+	int i;
+	int min_i = 0;
+	int max_i = 0;
+	uint16_t v;
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	
+	for (i=0; i<(T1C_WIDTH*T1C_HEIGHT); i++) {
+		v = img[i];
+		if (v < min) {
+			min = v;
+			min_i = i;
+		}
+		if (v > max) {
+			max = v;
+			max_i = i;
+		}
+	}
+	
+	info->max_temp = max;
+	info->min_temp = min;
+	info->max_temp_point.x = max_i % T1C_WIDTH;
+	info->max_temp_point.y = max_i / T1C_WIDTH;
+	info->min_temp_point.x = min_i % T1C_WIDTH;
+	info->min_temp_point.y = min_i / T1C_WIDTH;
+}
+
+
+void t1c_rad_region_temp(const uint16_t* img, const IrRect_t* rect, TpdLineRectTempInfo_t* info)
+{
+	uint16_t x, y;
+	uint16_t x1, y1, x2, y2;
+	uint16_t v;
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	uint32_t sum = 0;
+	uint32_t count;
+	const uint16_t* rowP;
+	
+	x1 = _clip(rect->start_point.x, T1C_WIDTH-1);
+	y1 = _clip(rect->start_point.y, T1C_HEIGHT-1);
+	x2 = _clip(rect->end_point.x, T1C_WIDTH-1);
+	y2 = _clip(rect->end_point.y, T1C_HEIGHT-1);
+	if (x2 < x1) x2 = x1;
+	if (y2 < y1) y2 = y1;
+	
+	info->max_temp_point.x = x1;
+	info->max_temp_point.y = y1;
+	info->min_temp_point.x = x1;
+	info->min_temp_point.y = y1;
+	
+	for (y=y1; y<=y2; y++) {
+		rowP = img + y*T1C_WIDTH;
+		for (x=x1; x<=x2; x++) {
+			v = rowP[x];
+			sum += v;
+			if (v < min) {
+				min = v;
+				info->min_temp_point.x = x;
+				info->min_temp_point.y = y;
+			}
+			if (v > max) {
+				max = v;
+				info->max_temp_point.x = x;
+				info->max_temp_point.y = y;
+			}
+		}
+	}
+	
+	count = (uint32_t) (x2 - x1 + 1) * (uint32_t) (y2 - y1 + 1);
+	info->temp_info_value.ave_temp = (uint16_t) ((sum + count/2) / count);
+	info->temp_info_value.max_temp = max;
+	info->temp_info_value.min_temp = min;
+}
+
+
+// Walks the pixels between the end points (inclusive) using Bresenham's algorithm
+void t1c_rad_line_temp(const uint16_t* img, const IrLine_t* line, TpdLineRectTempInfo_t* info)
+{
+	int16_t x, y;
+	int16_t x2, y2;
+	int16_t dx, dy;
+	int16_t sx, sy;
+	int16_t err, e2;
+	uint16_t v;
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	uint32_t sum = 0;
+	uint32_t count = 0;
+	
+	x = (int16_t) _clip(line->start_point.x, T1C_WIDTH-1);
+	y = (int16_t) _clip(line->start_point.y, T1C_HEIGHT-1);
+	x2 = (int16_t) _clip(line->end_point.x, T1C_WIDTH-1);
+	y2 = (int16_t) _clip(line->end_point.y, T1C_HEIGHT-1);
+	
+	dx = abs(x2 - x);
+	dy = -abs(y2 - y);
+	sx = (x < x2) ? 1 : -1;
+	sy = (y < y2) ? 1 : -1;
+	err = dx + dy;
+	
+	info->max_temp_point.x = x;
+	info->max_temp_point.y = y;
+	info->min_temp_point.x = x;
+	info->min_temp_point.y = y;
+	
+	for (;;) {
+		v = img[y*T1C_WIDTH + x];
+		sum += v;
+		count++;
+		if (v < min) {
+			min = v;
+			info->min_temp_point.x = x;
+			info->min_temp_point.y = y;
+		}
+		if (v > max) {
+			max = v;
+			info->max_temp_point.x = x;
+			info->max_temp_point.y = y;
+		}
+		
+		if ((x == x2) && (y == y2)) break;
+		
+		e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y += sy;
+		}
+	}
+	
+	info->temp_info_value.ave_temp = (uint16_t) ((sum + count/2) / count);
+	info->temp_info_value.max_temp = max;
+	info->temp_info_value.min_temp = min;
+}
+
+
+int t1c_rad_line_profile(const uint16_t* img, const IrLine_t* line, uint16_t* profile, int max_len)
+{
+	int16_t x, y;
+	int16_t x2, y2;
+	int16_t dx, dy;
+	int16_t sx, sy;
+	int16_t err, e2;
+	int len, n;
+	int i, k;
+	int slot;
+	uint32_t sum = 0;
+	uint32_t count = 0;
+	
+	x = (int16_t) _clip(line->start_point.x, T1C_WIDTH-1);
+	y = (int16_t) _clip(line->start_point.y, T1C_HEIGHT-1);
+	x2 = (int16_t) _clip(line->end_point.x, T1C_WIDTH-1);
+	y2 = (int16_t) _clip(line->end_point.y, T1C_HEIGHT-1);
+	
+	dx = abs(x2 - x);
+	dy = -abs(y2 - y);
+	sx = (x < x2) ? 1 : -1;
+	sy = (y < y2) ? 1 : -1;
+	err = dx + dy;
+	
+	// The walk visits one pixel per step along the longer axis.  Pixels are averaged into
+	// max_len samples when there are more of them.
+	len = ((dx > -dy) ? dx : -dy) + 1;
+	n = (len < max_len) ? len : max_len;
+	i = 0;
+	
+	// Same walk as t1c_rad_line_temp so the profile covers the pixels it measures
+	for (k=0; k<len; k++) {
+		slot = (k * n) / len;
+		if (slot != i) {
+			profile[i++] = (uint16_t) ((sum + count/2) / count);
+			sum = 0;
+			count = 0;
+		}
+		sum += img[y*T1C_WIDTH + x];
+		count++;
+		
+		e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			y += sy;
+		}
+	}
+	profile[i] = (uint16_t) ((sum + count/2) / count);
+	
+	return n;
+}
+
+
+void t1c_rad_point_temps(const uint16_t* img, const IrPoint_t* points, uint16_t* temps, int n)
+{
+	while (n--) {
+		*temps++ = t1c_rad_point_temp(img, points++);
+	}
+}
+
+
+void t1c_rad_region_temps(const uint16_t* img, const IrRect_t* rects, TpdLineRectTempInfo_t* infos, int n)
+{
+	while (n--) {
+		t1c_rad_region_temp(img, rects++, infos++);
+	}
+}
+
+
+void t1c_rad_line_temps(const uint16_t* img, const IrLine_t* lines, TpdLineRectTempInfo_t* infos, int n)
+{
+	while (n--) {
+		t1c_rad_line_temp(img, lines++, infos++);
+	}
+}
+
+
+void t1c_rad_build_sat(const uint16_t* img, uint32_t* sum, uint64_t* sum_sq)
+{
+	int x, y;
+	uint32_t v;
+	uint32_t row_sum;
+	uint64_t row_sum_sq;
+	uint32_t* sumP = sum + T1C_RAD_SAT_W;
+	uint64_t* sqP = sum_sq + T1C_RAD_SAT_W;
+	
+	memset(sum, 0, T1C_RAD_SAT_W * sizeof(uint32_t));
+	memset(sum_sq, 0, T1C_RAD_SAT_W * sizeof(uint64_t));
+	
+	// Each entry is the entry above it plus the running total of its row
+	for (y=0; y<T1C_HEIGHT; y++) {
+		row_sum = 0;
+		row_sum_sq = 0;
+		*sumP++ = 0;
+		*sqP++ = 0;
+		for (x=0; x<T1C_WIDTH; x++) {
+			v = *img++;
+			row_sum += v;
+			row_sum_sq += v*v;
+			*sumP = *(sumP - T1C_RAD_SAT_W) + row_sum;
+			*sqP = *(sqP - T1C_RAD_SAT_W) + row_sum_sq;
+			sumP++;
+			sqP++;
+		}
+	}
+}
+
+
+void t1c_rad_sat_rect_stats(const uint32_t* sum, const uint64_t* sum_sq, const IrRect_t* rect, uint16_t* mean, uint16_t* stddev)
+{
+	uint16_t x1, y1, x2, y2;
+	uint32_t n;
+	uint32_t s;
+	uint64_t s2;
+	int i11, i12, i21, i22;
+	
+	x1 = _clip(rect->start_point.x, T1C_WIDTH-1);
+	y1 = _clip(rect->start_point.y, T1C_HEIGHT-1);
+	x2 = _clip(rect->end_point.x, T1C_WIDTH-1);
+	y2 = _clip(rect->end_point.y, T1C_HEIGHT-1);
+	if (x2 < x1) x2 = x1;
+	if (y2 < y1) y2 = y1;
+	
+	// Table corners enclosing the rectangle
+	i11 = y1*T1C_RAD_SAT_W + x1;
+	i12 = y1*T1C_RAD_SAT_W + x2 + 1;
+	i21 = (y2 + 1)*T1C_RAD_SAT_W + x1;
+	i22 = (y2 + 1)*T1C_RAD_SAT_W + x2 + 1;
+	
+	n = (uint32_t) (x2 - x1 + 1) * (uint32_t) (y2 - y1 + 1);
+	s = sum[i22] - sum[i12] - sum[i21] + sum[i11];
+	s2 = sum_sq[i22] - sum_sq[i12] - sum_sq[i21] + sum_sq[i11];
+	
+	// n * s2 - s^2 stays within 64 bits for a full frame of 16-bit values
+	*mean = (uint16_t) ((s + n/2) / n);
+	*stddev = (uint16_t) round(sqrt((double) (n*s2 - (uint64_t) s*s)) / n);
+}
+
+
+// The measured radiance is eps0*T0^4 + (1-eps0)*Tu^4.  Solving the same for a surface of
+// emissivity eps gives T^4 = (eps0*T0^4 + (eps - eps0)*Tu^4) / eps.
+uint16_t t1c_rad_emissivity_correct(uint16_t t, float eps0, float eps, float tu_k)
+{
+	float t0 = (float) t / 16.0;
+	float tu4 = tu_k * tu_k * tu_k * tu_k;
+	float w;
+	
+	if ((eps <= 0) || (eps == eps0)) {
+		return t;
+	}
+	
+	w = (eps0 * t0 * t0 * t0 * t0 + (eps - eps0) * tu4) / eps;
+	if (w <= 0) {
+		return 0;
+	}
+	
+	t0 = sqrtf(sqrtf(w)) * 16.0;
+	return (t0 > 65535.0) ? 0xFFFF : (uint16_t) roundf(t0);
+}
+
+
+void t1c_rad_emissivity_correct_info(TpdLineRectTempInfo_t* info, float eps0, float eps, float tu_k)
+{
+	info->temp_info_value.ave_temp = t1c_rad_emissivity_correct(info->temp_info_value.ave_temp, eps0, eps, tu_k);
+	info->temp_info_value.max_temp = t1c_rad_emissivity_correct(info->temp_info_value.max_temp, eps0, eps, tu_k);
+	info->temp_info_value.min_temp = t1c_rad_emissivity_correct(info->temp_info_value.min_temp, eps0, eps, tu_k);
+}
+
+
+
+//
+// Internal functions
+//
+static uint16_t _clip(uint16_t v, uint16_t max)
+{
+	return (v > max) ? max : v;
+}
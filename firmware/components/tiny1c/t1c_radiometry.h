@@ -0,0 +1,72 @@
+/*
+ * Local radiometry functions computing spot, min/max and region temperatures directly
+ * from Tiny1C Y16 temperature data (Y16_MODE_TEMPERATURE) instead of requesting them
+ * from the Tiny1C over the CCI.  Results use the same units (1/16 °K) and structures
+ * as the Tiny1C TPD commands.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef _T1C_RADIOMETRY_H_
+#define _T1C_RADIOMETRY_H_
+
+#include "falcon_cmd.h"
+#include "tiny1c.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//
+// Constants
+//
+
+// Summed-area table dimensions.  Entry (x, y) holds the total of the pixels above and to
+// the left of pixel (x, y) so the first row and column are zero.
+#define T1C_RAD_SAT_W   (T1C_WIDTH + 1)
+#define T1C_RAD_SAT_H   (T1C_HEIGHT + 1)
+
+
+//
+// API
+//
+// img points to a T1C_WIDTH x T1C_HEIGHT Y16 temperature frame.  Point and region
+// coordinates are clipped to the frame.
+uint16_t t1c_rad_point_temp(const uint16_t* img, const IrPoint_t* point);
+void t1c_rad_min_max_temp(const uint16_t* img, MaxMinTempInfo_t* info);
+void t1c_rad_region_temp(const uint16_t* img, const IrRect_t* rect, TpdLineRectTempInfo_t* info);
+void t1c_rad_line_temp(const uint16_t* img, const IrLine_t* line, TpdLineRectTempInfo_t* info);
+
+// Copy the pixels along a line, from its start point, into profile (any Y16 data).  Longer
+// lines are averaged down to max_len samples.  Returns the number of samples.
+int t1c_rad_line_profile(const uint16_t* img, const IrLine_t* line, uint16_t* profile, int max_len);
+
+// Multiple measurement versions (n entries in each array)
+void t1c_rad_point_temps(const uint16_t* img, const IrPoint_t* points, uint16_t* temps, int n);
+void t1c_rad_region_temps(const uint16_t* img, const IrRect_t* rects, TpdLineRectTempInfo_t* infos, int n);
+void t1c_rad_line_temps(const uint16_t* img, const IrLine_t* lines, TpdLineRectTempInfo_t* infos, int n);
+
+// Summed-area tables of the pixels and their squares (T1C_RAD_SAT_W x T1C_RAD_SAT_H entries
+// each) built in one pass over img.  The mean and standard deviation of any rectangle
+// (inclusive, clipped to the frame) are then read from four entries of each table.
+void t1c_rad_build_sat(const uint16_t* img, uint32_t* sum, uint64_t* sum_sq);
+void t1c_rad_sat_rect_stats(const uint32_t* sum, const uint64_t* sum_sq, const IrRect_t* rect, uint16_t* mean, uint16_t* stddev);
+
+// Correct a temperature (1/16 °K) measured with emissivity eps0 and reflected temperature
+// tu_k (°K) for a surface with emissivity eps.  Uses total radiance (T^4) so it approximates
+// the Tiny1C's own correction.
+uint16_t t1c_rad_emissivity_correct(uint16_t t, float eps0, float eps, float tu_k);
+void t1c_rad_emissivity_correct_info(TpdLineRectTempInfo_t* info, float eps0, float eps, float tu_k);
+
+#endif /* _T1C_RADIOMETRY_H_ */
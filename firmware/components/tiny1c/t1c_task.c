@@ -2,10 +2,10 @@
  * Tiny1C Task
  *
  * Initializes and then repeatedly reads image data from the Tiny1C core via SPI and also
- * reads spotmeter, min/max and optionally region temperature information via the I2C
- * CCI interface.  The camera  module is operated in the Y16 mode.  Applies a linear
- * transformation to convert the image data into 8-bit words loaded into ping-pong buffers
- * for other tasks.
+ * reads spotmeter, min/max and optionally region and ROI table temperature information
+ * via the I2C CCI interface.  The camera  module is operated in the Y16 mode.  Applies a linear
+ * transformation to convert the image data into 8-bit words loaded, along with the Y16
+ * data, into ping-pong buffers for other tasks.
  *
  * Copyright 2024 Dan Julio
  *
@@ -24,7 +24,9 @@
  */
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
+#include "bench_utilities.h"
 #include "data_rw.h"
+#include "esp_heap_caps.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_timer.h"
@@ -32,21 +34,34 @@
 #include "file_task.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/ringbuf.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "hal/spi_types.h"
 #include "out_state_utilities.h"
+#include "perf_utilities.h"
 #include "ps_utilities.h"
 #include "sys_utilities.h"
 #include "system_config.h"
+#include "t1c_agc.h"
+#include "t1c_i2c_hal.h"
+#include "t1c_radiometry.h"
 #include "t1c_task.h"
 #include "t1c_tau.h"
+#include "t1c_y8_filter.h"
 #include "tiny1c.h"
 #include "vdcmd.h"
+#include <stddef.h>
+#include <stdlib.h>
 #include <String.h>
 
+#ifdef CONFIG_PM_ENABLE
+	#include "esp_pm.h"
+#endif
+
 #ifdef CONFIG_BUILD_ICAM_MINI
+	#include "aux_task.h"
 	#include "ctrl_task.h"
+	#include "mqtt_task.h"
 	#include "video_task.h"
 	#include "web_task.h"
 #else
@@ -64,13 +79,42 @@
 // Undefine to display various parameters at startup
 //#define INCLUDE_SHUTTER_DISPLAY
 //#define INCLUDE_IMAGE_DISPLAY
-#define INCLUDE_TPD_DISPLAY
+//#define INCLUDE_TPD_DISPLAY
+
+// Undefine to periodically display measured frame period jitter
+//#define INCLUDE_JITTER_DISPLAY
+
 
+// Undefine to use the polled single-transaction VOSPI acquisition instead of queued DMA
+#define VOSPI_QUEUED_ACQ
 
-// VOSPI interface
+// Undefine to configure the Tiny1C for Y16 temperature output and compute spot, min/max
+// and region temperatures from each frame instead of requesting them over the CCI
+//#define T1C_LOCAL_RADIOMETRY
+
+// Undefine to save the Tiny1C configuration to its flash after a calibration or restore
+//#define T1C_SAVE_CONFIG
+
+// VOSPI interface.  Every Tiny1C VOSPI output is 16 bits/pixel (its preview YUV422 as well
+// as Y16) so there is no narrower format to read when radiometric data isn't needed.
 #define VOSPI_TX_DUMMY_LEN  (512)
 #define VOSPI_ROW_LEN       (T1C_WIDTH*2)
 
+// Number of row transactions kept in flight by the queued acquisition
+#define VOSPI_NUM_TRANS     4
+
+// VOSPI frame integrity.  A frame is corrupt if the header doesn't mark it valid or its
+// index jumps more than VOSPI_MAX_INDEX_STEP from the previous frame.  Corrupt frames are
+// skipped, which idles the bus for a frame period so the Tiny1C VOSPI can resynchronize.
+// Each corrupt frame adds VOSPI_ERR_WEIGHT to an error level that each good frame reduces
+// by one and the clock falls back to T1C_SPI_FREQ_HZ when it reaches VOSPI_ERR_FALLBACK.
+// The valid flag is ignored if VOSPI_MAX_CONSEC_BAD frames in a row at the fallback clock
+// don't have it set.
+#define VOSPI_MAX_INDEX_STEP 8
+#define VOSPI_ERR_WEIGHT     25
+#define VOSPI_ERR_FALLBACK   100
+#define VOSPI_MAX_CONSEC_BAD (T1C_FPS * 2)
+
 // VOSPI header
 #define VOSPI_HEADER_OFFSET (VOSPI_TX_DUMMY_LEN-32)
 // Header indicies
@@ -84,37 +128,165 @@
 #define HEADER_FREEZE_STATE    12
 
 
+// Y16 histogram (sized for the AGC routines)
+#define Y16_HIST_BINS           AGC_HIST_BINS
+
+// Y16 histogram bins combined into each image statistics bin (log2)
+#define IMG_STATS_HIST_SHIFT 2
+#if (Y16_HIST_BINS >> IMG_STATS_HIST_SHIFT) != T1C_IMG_STATS_HIST_BINS
+#error "IMG_STATS_HIST_SHIFT doesn't match T1C_IMG_STATS_HIST_BINS"
+#endif
+
+// AGC range smoothing - first order IIR filter time constant (set to 0 to disable)
+#define AGC_SMOOTH_TC_MSEC      500
+#define AGC_SMOOTH_FRAC_BITS    8
+#define AGC_SMOOTH_ALPHA        (((1 << AGC_SMOOTH_FRAC_BITS) * (1000/T1C_FPS)) / (AGC_SMOOTH_TC_MSEC + (1000/T1C_FPS)))
+
+// Min/max marker tracking.  Markers follow the frame's min and max (found by the row
+// kernels) refined to 1/(2^TRACK_FRAC_BITS) pixel with a quadratic fit and smoothed by a
+// first order IIR filter.  A marker stays on the feature it is following (the extreme within
+// TRACK_WINDOW pixels of it) unless the frame's extreme is beyond it by more than
+// 1/(2^TRACK_HYST_SHIFT) of the frame's range and jumps without smoothing to locations more
+// than TRACK_SNAP_PIXELS away.  The reported pixel changes when the smoothed location is
+// TRACK_OUT_HYST past the midpoint to the next pixel.
+#define TRACK_FRAC_BITS         8
+#define TRACK_SMOOTH_TC_MSEC    150
+#define TRACK_SMOOTH_ALPHA      (((1 << TRACK_FRAC_BITS) * (1000/T1C_FPS)) / (TRACK_SMOOTH_TC_MSEC + (1000/T1C_FPS)))
+#define TRACK_WINDOW            2
+#define TRACK_HYST_SHIFT        5
+#define TRACK_SNAP_PIXELS       4
+#define TRACK_OUT_HYST          ((1 << TRACK_FRAC_BITS) / 4)
+
+// Automatic gain switching.  Switch to low gain when the hottest AUTO_GAIN_HOT_PIXELS pixels
+// exceed AUTO_GAIN_HIGH_LIMIT_C (the high gain range ends at 150°C) for AUTO_GAIN_LOW_DWELL
+// frames and back to high gain when they fall below AUTO_GAIN_LOW_LIMIT_C for the (longer)
+// AUTO_GAIN_HIGH_DWELL frames.  Evaluation is held off after a switch until the Tiny1C
+// reports the new gain and AUTO_GAIN_SETTLE frames have passed.
+#define AUTO_GAIN_HIGH_LIMIT_C  140
+#define AUTO_GAIN_LOW_LIMIT_C   120
+#define AUTO_GAIN_HOT_PIXELS    ((T1C_WIDTH*T1C_HEIGHT)/200)
+#define AUTO_GAIN_LOW_DWELL     (T1C_FPS/5)
+#define AUTO_GAIN_HIGH_DWELL    (T1C_FPS*3)
+#define AUTO_GAIN_SETTLE        (T1C_FPS)
+
+// Y16 temperature (1/16 °K) for a °C value
+#define Y16_TEMP_C(t)           ((uint16_t) (((t) + 273) * 16))
+
 // Main loop evaluation period (uSec)
 #define EVAL_USEC               (1000000/T1C_FPS)
 
+// Acquisition rate governor.  Frames are acquired at IDLE_FPS once no consumer has needed
+// the full rate for IDLE_DELAY_MSEC.  The CPU is held at its maximum frequency only while
+// acquiring at the full rate when power management is enabled.
+#define IDLE_FPS                2
+#define IDLE_EVAL_USEC          (1000000/IDLE_FPS)
+#define IDLE_DELAY_MSEC         5000
+
+// Frame jitter statistics reporting period (frames)
+#define JITTER_REPORT_FRAMES    (T1C_FPS*30)
+
+// Maximum frames a pending picture skips because a shutter event has frozen the image
+#define FFC_SKIP_MAX_FRAMES     (T1C_FPS*2)
+
+// Minimum time since the last shutter event for a pre-capture FFC to be run (mSec)
+#define FFC_PRE_CAPTURE_MSEC    15000
+
+// Dead pixel detection.  A pixel is proposed when its mean differs from the median of its
+// neighbors by more than DPC_DEV_MIN counts plus DPC_DEV_NOISE_X times their mean frame to
+// frame change or when it is stuck (changes less than 1/DPC_STUCK_RATIO as much as its
+// neighbors while they change by at least a count per frame).  Frame to frame changes are
+// limited to DPC_MAX_DIFF so the per-pixel totals fit in 16 bits.  The statistics are
+// analyzed DPC_ANALYZE_ROWS rows per frame after they have been accumulated.
+#define DPC_DEV_MIN             64
+#define DPC_DEV_NOISE_X         8
+#define DPC_STUCK_RATIO         8
+#define DPC_MAX_DIFF            1023
+#define DPC_ANALYZE_ROWS        8
+#define DPC_ANALYZE_FRAMES      (T1C_HEIGHT / DPC_ANALYZE_ROWS)
+_Static_assert(((T1C_DPC_DETECT_FRAMES - 1) * DPC_MAX_DIFF) <= 0xFFFF, "DPC_MAX_DIFF too large");
+
+// Change detection background.  Every CHG_BG_PERIOD frames each background pixel moves one
+// count toward the (filtered) incoming pixel, tracking its median, so slow drift is absorbed
+// while a change stays marked for about threshold * CHG_BG_PERIOD frames.
+#define CHG_BG_PERIOD           4
+
 // Pattern display period (mSec)
 #define PATTERN_DISP_MSEC       2000
 
 // CCI Access state
 #define CCI_ACCESS_ST_IDLE      0
-#define CCI_ACCESS_ST_REQ_SPOT  1
-#define CCI_ACCESS_ST_WAIT_SPOT 2
-#define CCI_ACCESS_ST_REQ_MM    3
-#define CCI_ACCESS_ST_WAIT_MM   4
-#define CCI_ACCESS_ST_REQ_REG   5
-#define CCI_ACCESS_ST_WAIT_REG  6
-#define CCI_ACCESS_ST_EX_CMD    7
-#define CCI_ACCESS_ST_WAIT_CMD  8
+#define CCI_ACCESS_ST_WAIT_MEAS 1
+#define CCI_ACCESS_ST_WAIT_CMD  2
+#define CCI_ACCESS_ST_WAIT_JOB  3
+
+// CCI command completion poll interval (mSec)
+#define CCI_POLL_MSEC           1
+
+// Tiny1C boot after reset (mSec from the reset).  It isn't polled until it could be ready
+// and is then polled until it answers over the CCI or the boot times out.
+#define T1C_BOOT_MIN_MSEC       300
+#define T1C_BOOT_MAX_MSEC       5000
+#define T1C_BOOT_POLL_MSEC      20
+
+// Time reserved before the next frame where we won't access the CCI (uSec)
+#define CCI_GUARD_USEC          2000
+
+// CCI measurements (cci_meas[] indicies must match T1C_MEAS_xxx)
+#define CCI_NUM_MEAS            T1C_NUM_MEAS
+
+// Default measurement priority (lower is higher) and period (frames).  The min/max locations
+// are tracked in each frame so only its temperatures are read less often.
+#define CCI_DEF_SPOT_PRI        0
+#define CCI_DEF_MINMAX_PRI      1
+#define CCI_DEF_REGION_PRI      2
+#define CCI_DEF_ROI_PRI         3
+#define CCI_DEF_PERIOD          1
+#define CCI_DEF_MINMAX_PERIOD   2
+
+// CCI job step run conditions
+#define CCI_JOB_RUN_OK          0
+#define CCI_JOB_RUN_FAIL        1
+#define CCI_JOB_RUN_ALWAYS      2
+
+// CCI job step timeouts (mSec) - the Tiny1C may not respond to I2C while executing these
+#define CCI_JOB_CMD_MSEC        1000
+#define CCI_JOB_FFC_MSEC        5000
+#define CCI_JOB_CFG_MSEC        10000
+#define CCI_JOB_RECAL_MSEC      30000
+
+// Humidity used for tau when it isn't measured (percent) - selects the first table level
+#define DEF_HUMIDITY_PERCENT    0
+
+// Measured distance changes smaller than this are ignored (percent)
+#define DIST_HYST_PERCENT       2
+
+// Delay after reporting the result of a restore before shutting down (mSec)
+#define RESTORE_SHUTDOWN_MSEC   1500
+
+// Firmware update.  The image is written to the start of the Tiny1C flash after it has
+// been reset into its update firmware.  Each buffer is read back in pieces to verify it.
+#define FW_UPD_FLASH_ADDR       0x00000000
+#define FW_UPD_SECTOR_LEN       4096
+#define FW_UPD_VERIFY_LEN       256
+#define FW_UPD_BUF_WAIT_MSEC    10000
 
 // Parameter buffer types
 #define PARAM_BUF_TYPE_SHUTTER  0
 #define PARAM_BUF_TYPE_IMAGE    1
 #define PARAM_BUF_TYPE_TPD      2
+#define PARAM_NUM_TYPES         3
 
 // Number of parameters we keep local copies of for each type (based on falcon_cmd.h valid enums)
 #define PARAM_NUM_TYPE_SHUTTER  (SHUTTER_CHANGE_GAIN_2ND_DELAY+1)
 #define PARAM_NUM_TYPE_IMAGE    (IMAGE_PROP_SEL_MIRROR_FLIP+1)
 #define PARAM_NUM_TYPE_TPD      (TPD_PROP_GAIN_SEL+1)
 
-// Calibration activities (for _t1c_perform_cal())
-#define CAL_1_PT                0
-#define CAL_2_PT_L              1
-#define CAL_2_PT_H              2
+// Parameter cache size for each type (must be >= all PARAM_NUM_TYPE_xxx and <= 32)
+#define PARAM_CACHE_NUM_PARAM   16
+
+// Power-on parameter cache (NVS key and format version)
+#define PARAM_PON_CACHE_KEY     "t1c_pon"
+#define PARAM_PON_CACHE_VERSION 1
 
 
 // Environmental conditions entry
@@ -134,7 +306,69 @@ typedef struct {
 	uint8_t param;
 	uint16_t value;
 } param_buffer_entry_t;
-#define PARAM_BUFFER_LEN       (16*(8+sizeof(param_buffer_entry_t)))
+
+
+// Power-on parameter cache.  The parameters the Tiny1C loads from its flash at power-on
+// are kept in NVS so they don't have to be read back at every startup.  The signature
+// identifies the module (serial number and firmware version) so a different or updated
+// module is read again.
+typedef struct {
+	uint32_t version;
+	uint32_t signature;
+	uint16_t shutter[PARAM_NUM_TYPE_SHUTTER];
+	uint16_t image[PARAM_NUM_TYPE_IMAGE];
+	uint16_t tpd[PARAM_NUM_TYPE_TPD];
+	uint32_t checksum;                     // Of everything before it
+} param_pon_cache_t;
+
+
+// CCI measurement scheduling entry
+typedef struct {
+	bool* enP;                             // Measurement enable
+	int priority;                          // Lower values are issued first
+	int period;                            // Frames between updates
+	int age;                               // Frames since last update
+	void (*req)();                         // Initiates the command
+	bool (*read)();                        // Reads the result, returns true when the update is complete
+	const char* name;
+} cci_meas_t;
+
+
+// Min/max marker tracker
+typedef struct {
+	bool valid;
+	int32_t x;                             // Smoothed location (TRACK_FRAC_BITS fraction)
+	int32_t y;
+	IrPoint_t out;                         // Pixel reported for the marker
+} minmax_track_t;
+
+
+// CCI job step (one long running Tiny1C command issued by a background job)
+typedef struct {
+	bool (*req)(uint8_t arg);              // Initiates the command, returns false if it could not be sent
+	uint8_t arg;
+	int run;                               // CCI_JOB_RUN_xxx
+	int timeout_msec;                      // Time allowed for the Tiny1C to finish the command
+	const char* name;
+} cci_job_step_t;
+
+
+// CCI background job.  Jobs are executed one step at a time between frames so the image
+// stream continues while they run.
+typedef struct {
+	const cci_job_step_t* steps;
+	int num_steps;
+	bool report;                           // Report progress and the result to output_task
+	void (*done)(bool success);            // Called when the job finishes (may be NULL)
+	const char* name;
+} cci_job_t;
+
+
+// Firmware update buffer passed between file_task and t1c_task
+typedef struct {
+	uint8_t* buf;
+	uint32_t len;
+} fw_upd_buf_t;
 
 
 // Preview setups
@@ -157,31 +391,149 @@ static const char* TAG = "t1c_task";
 // Task ready for other tasks to command it
 static bool t1c_task_running = false;
 
+// Frame scheduler
+static esp_timer_handle_t frame_timer;
+static SemaphoreHandle_t frame_timer_sem;
+
+// Acquisition rate governor
+static bool rate_idle = false;
+static int64_t rate_busy_usec = 0;              // Last time the full rate was needed
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t frame_pm_lock;      // Held while handling each frame
+#endif
+
+// Frame period jitter measurement (uSec)
+static int32_t frame_jitter_max;
+static int64_t frame_jitter_sum;
+static uint32_t frame_jitter_count;
+static uint32_t frame_jitter_report_avg = 0;
+static uint32_t frame_jitter_report_max = 0;
+
 // SPI Interface
 static spi_device_handle_t spi;
 static spi_transaction_t spi_trans;
+static int spi_freq_hz;
+
+// VOSPI frame integrity
+static bool vospi_check_valid = true;
+static int vospi_err_level = 0;
+static int vospi_consec_bad = 0;
+static uint32_t vospi_bad_frames = 0;
+#ifdef VOSPI_QUEUED_ACQ
+static spi_transaction_t spi_row_trans[VOSPI_NUM_TRANS];
+#endif
 
 // SPI DMA buffers allocated in on-board memory
 static uint8_t vospi_TxBuf[VOSPI_TX_DUMMY_LEN];
 static uint8_t vospi_RxBuf1[VOSPI_TX_DUMMY_LEN];
 static uint8_t vospi_RxBuf2[VOSPI_TX_DUMMY_LEN];
+#ifdef VOSPI_QUEUED_ACQ
+static uint8_t vospi_RowBuf[VOSPI_NUM_TRANS][VOSPI_ROW_LEN];
+#endif
 
 // Per-image data from vospi header
 static bool frame_high_gain;
 static bool frame_pix_freeze;
+static uint16_t frame_index;
+static int64_t frame_usec;
+
+// Frame accounting (consumer entries are only written by the consumer)
+static bool frame_index_valid = false;
+static uint32_t frame_seq = 0;
+static uint32_t frame_sensor_skipped = 0;
+static bool consumer_seq_valid[T1C_NUM_CONSUMERS];
+static uint32_t consumer_last_seq[T1C_NUM_CONSUMERS];
+static uint32_t consumer_consumed[T1C_NUM_CONSUMERS];
+static uint32_t consumer_dropped[T1C_NUM_CONSUMERS];
+
+// Image plane pool - reference counts for each entry in t1c_y16_pool (only manipulated by
+// this task) and the planes the current frame is read and scaled into
+static uint8_t y16_pool_refs[T1C_Y16_POOL_LEN];
+static uint16_t* cur_y16P;
+static uint8_t* cur_y8P;
+static uint8_t* cur_y8fP;
+static uint32_t* cur_chgP;
 
 // Image processing
 static uint16_t y16_min;
 static uint16_t y16_max;
+static uint16_t* y16_minP;                      // Locations of the min and max in cur_y16P
+static uint16_t* y16_maxP;
+
+// FNV-1a hash of the processed Y16 frame so consumers can detect unchanged images.  Frozen
+// frames after the first keep its hash (they aren't hashed) since the image shouldn't
+// change while the shutter is closed.
+static uint32_t frame_hash = 0;
+static bool frame_hash_frozen = false;
+
+// Per-frame Y16 histogram.  Bins span the range of the previous frame starting at
+// y16_hist_base with each bin covering (1 << y16_hist_shift) counts.
+static uint16_t y16_hist[Y16_HIST_BINS];
+static uint16_t y16_hist_base = 0;
+static int y16_hist_shift = 8;
+
+// Histogram and ROI line profile of the current frame for consumers' live displays
+static t1c_img_stats_t img_stats;
 
 // Preview mode data inversion
 static bool invert_y16_data = false;
 
+// AGC mode used to scale Y16 data to Y8
+static int agc_mode = T1C_AGC_MODE_LINEAR;
+
+// Temporal noise reduction.  Each pixel is a recursive filter of the incoming pixel and
+// its history in t1c_tnr_history.  The history is restarted when the level, frame source
+// or gain changes.
+static int tnr_level = T1C_TNR_OFF;
+static bool tnr_hist_valid = false;
+static bool tnr_hist_high_gain;
+static int tnr_hist_source;
+static int tnr_hist_level;
+static int tnr_w_min;                 // Minimum weight (1/16ths) of the incoming pixel
+static uint16_t tnr_xor;              // Applied to the incoming pixel (inversion)
+static const int tnr_level_w_min[T1C_TNR_NUM_LEVELS] = {16, 8, 4, 2};
+
+// Change detection.  Runs in the temporal filter kernel (with the filter passing pixels
+// through when it is off) comparing each filtered pixel with its background in
+// t1c_chg_background.  The background is reloaded when it is enabled or the frame source,
+// gain or inversion changes.
+static int chg_mode = T1C_CHG_OFF;
+static uint16_t chg_thresh = 64;
+static bool chg_active = false;       // Current frame is using the change detection kernel
+static bool chg_frame_valid = false;  // Current frame's mask is valid
+static bool chg_bg_valid = false;
+static bool chg_bg_load;              // Load the background from the current frame
+static bool chg_bg_update;            // Update the background from the current frame
+static bool chg_bg_high_gain;
+static bool chg_bg_invert;
+static int chg_bg_source;
+static uint32_t chg_bg_count = 0;
+static int32_t chg_lo;                // Pixels below (background + chg_lo) or above
+static int32_t chg_hi;                //   (background + chg_hi) have changed
+
+// Spatial filter of the scaled image and the outputs (T1C_Y8F_OUT_xxx) that use it
+static int y8_filt_mode = T1C_Y8F_MODE_OFF;
+static uint8_t y8_filt_outputs = 0;
+static uint8_t y8_filt_mask = 0;            // Outputs the current frame was filtered for
+static uint16_t y8_filt_ring[3*T1C_WIDTH];
+
+// Smoothed AGC range (fixed point with AGC_SMOOTH_FRAC_BITS fractional bits) and the range
+// published with each frame.  The published range only moves when the smoothed range moves
+// by more than one output level so consumers can cache mappings built from it.
+static bool agc_range_valid = false;
+static bool agc_range_high_gain;
+static int32_t agc_min_fp;
+static int32_t agc_max_fp;
+static uint16_t agc_min;
+static uint16_t agc_max;
+static uint32_t agc_seq = 0;
+
 // CCI Access 
 static int cci_state = CCI_ACCESS_ST_IDLE;
 static uint16_t shutter_settings_values[PARAM_NUM_TYPE_SHUTTER] = { 0 };
 static uint16_t image_settings_values[PARAM_NUM_TYPE_IMAGE] = { 0 };
 static uint16_t tpd_settings_values[PARAM_NUM_TYPE_TPD] = { 0 };
+static float tau_humidity = DEF_HUMIDITY_PERCENT;    // Humidity used for the current TAU
 
 // Image metadata handling
 //
@@ -195,13 +547,18 @@ static MaxMinTempInfo_t max_min_temp_data;
 // PS Config used to initially configure the Tiny1C
 static t1c_config_t t1c_config;
 
-// Parameter setting buffer
-static RingbufHandle_t param_buf_handle;
+// Parameter setting cache.  Holds the most recent value set for each parameter until the
+// CCI scheduler writes it to the Tiny1C so rapid changes (e.g. dragging a slider) coalesce
+// into one write.  Bit n of a dirty mask is set when parameter n has a pending value.
+static uint16_t param_cache_values[PARAM_NUM_TYPES][PARAM_CACHE_NUM_PARAM];
+static uint32_t param_cache_dirty[PARAM_NUM_TYPES];
 static SemaphoreHandle_t param_mutex;
 
-// Min/max temp
+// Min/max temp (also measured when required by automatic gain switching)
 static bool minmax_en = false;
+static bool minmax_meas_en = false;
 static bool minmax_valid = false;
+static minmax_track_t minmax_track[2];          // Max, min
 
 // Spot temp
 static bool spot_en = false;
@@ -210,6 +567,10 @@ static uint16_t spot_temp_raw;
 static IrPoint_t spot_param = {0, 0};
 static IrPoint_t spot_new_param;
 
+// Spot and region locations may be updated faster than frames arrive (a marker being dragged)
+// so only the last location set before a frame is used.  loc_mux keeps it from being torn.
+static portMUX_TYPE loc_mux = portMUX_INITIALIZER_UNLOCKED;
+
 // Region temp
 static bool region_en = false;
 static bool region_valid = false;
@@ -217,8 +578,89 @@ static TpdLineRectTempInfo_t region_temp_info;
 static IrRect_t region_param = {{0, 0}, {10, 10}};
 static IrRect_t region_new_param;
 
+// ROI table (one entry is measured per CCI access, the measurement is complete after all
+// entries have been measured)
+static bool roi_en = false;
+static int roi_cci_index = 0;                   // Next entry to request
+static int roi_cci_cur = -1;                    // Entry currently requested (-1 to discard)
+static t1c_roi_table_t roi_table = { 0 };
+static t1c_roi_table_t roi_new_table;
+
+// Automatic gain switching
+static bool auto_gain_en = false;
+static bool auto_gain_high;                     // Gain we last requested
+static int auto_gain_count = 0;                 // Frames the switch condition has been met
+static int auto_gain_settle = 0;                // Frames remaining before evaluation resumes
+
 // File task related
 static bool notify_get_file_image = false;
+static bool notify_get_file_avg = false;
+
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+// MQTT task related
+static bool notify_get_mqtt_info = false;
+#endif
+
+// Frame averaging for pictures.  Frames are summed into t1c_avg_accum (and the measured
+// temperatures into the temperature sums) until avg_num frames have been accumulated.
+static int avg_new_num = 1;
+static int avg_num = 1;
+static int avg_count = 0;                       // Frames accumulated so far (0 = not averaging)
+static bool avg_high_gain;
+static uint32_t avg_spot_sum;
+static uint32_t avg_spot_count;
+static uint32_t avg_minmax_sum[2];              // Max, min
+static uint32_t avg_minmax_count;
+static uint32_t avg_region_sum[3];              // Average, max, min
+static uint32_t avg_region_count;
+
+// FFC coordination.  While file_task (or an averaged picture) holds shutter events off, the
+// Tiny1C's automatic shutter is switched off for up to max_ffc_interval seconds.  Pending
+// pictures skip frames frozen by a shutter event.
+static uint32_t ffc_hold_mask = 0;              // T1C_FFC_HOLD_xxx sources set by file_task
+static bool ffc_hold_active = false;            // Automatic shutter switched off by us
+static bool ffc_hold_expired = false;           // Timed out, not reapplied until all clear
+static int64_t ffc_hold_start_usec;
+static int64_t ffc_last_usec = 0;               // Start of the last shutter event
+static bool ffc_prev_freeze = false;
+static int ffc_skip_count = 0;                  // Frozen frames skipped by the pending picture
+
+// Dead pixel detection and correction
+static t1c_dpc_status_t dpc_status = { 0 };
+static bool dpc_correct = false;                // Set when the proposed points are corrected
+static int dpc_correct_next;                    // Next point to correct in the frame being read
+static int dpc_frames;                          // Frames accumulated by the detection
+static int dpc_pairs;                           // Frame to frame changes accumulated
+static int dpc_row;                             // Next row to analyze
+static bool dpc_prev_valid;
+static bool dpc_high_gain;
+static cci_job_step_t dpc_steps[T1C_DPC_MAX_POINTS + 1];
+static int burst_new_num;
+static int burst_new_pre;
+static int burst_num = 0;                       // Frames in the burst being captured (0 = none)
+static int burst_index = 0;                     // Frames of the burst captured so far
+static int burst_first = 0;                     // file_burst_buffer entry of the first frame
+static int burst_total = 0;                     // Frames in the burst including pre-trigger frames
+static int burst_next = 0;                      // Next file_burst_buffer entry
+static bool burst_ring_en = false;
+static int burst_ring_count = 0;                // Pre-trigger frames held in file_burst_buffer
+static bool sync_pending = false;               // Synchronized capture waiting for its frame
+static int64_t sync_new_usec;
+static int64_t sync_target_usec;
+
+// Scene statistics for event triggers
+static bool scene_stats_en = false;
+static bool scene_sig_valid = false;
+static t1c_scene_stats_t scene_stats;
+static uint16_t scene_sig[T1C_MOTION_BLOCKS_W * T1C_MOTION_BLOCKS_H];
+
+// Summed-area tables of the current temperature frame for rectangle statistics (allocated
+// when first enabled).  sat_mutex keeps a table from being read while it is rebuilt.
+static bool rect_stats_en = false;
+static bool sat_valid = false;
+static uint32_t* sat_sum = NULL;
+static uint64_t* sat_sum_sq = NULL;
+static SemaphoreHandle_t sat_mutex = NULL;
 
 // Mode dependent notification variables
 static TaskHandle_t platform_task;
@@ -228,11 +670,40 @@ static uint32_t task_frame_2_notification;
 static uint32_t task_shutdown_notification;
 static uint32_t task_ctrl_act_succeeded_notification;
 static uint32_t task_ctrl_act_failed_notification;
+static uint32_t task_ctrl_act_progress_notification;
+
+// Benchmark frames remaining to be timed (0 when not running)
+static int bench_frames = 0;
+
+// Frame replay (t1c_replay_buffer entries alternate between being loaded and being used)
+static portMUX_TYPE replay_mux = portMUX_INITIALIZER_UNLOCKED;
+static int replay_source = T1C_REPLAY_OFF;
+static int replay_load_index = 0;               // Entry the loader fills
+static bool replay_loaded = false;              // Set when the loader has filled its entry
+static bool replay_load_high_gain;
+static bool replay_valid = false;               // Set when the other entry holds a frame
+static bool replay_high_gain;
 
 // Calibration related
 static bool cal_2pt_in_progress = false;        // Prevents TPD updates between L and H points
 static uint16_t bb_temp_k;                      // Calibration blackbody temperature (°K)
 
+// Background CCI job (NULL when no job is running)
+static const cci_job_t* cci_job = NULL;
+static int cci_job_step;
+static bool cci_job_failed;
+static int64_t cci_job_step_usec;
+static int cci_job_progress_step = 0;
+static int cci_job_progress_num_steps = 0;
+
+// Firmware update (buffers are allocated by the first update)
+static volatile bool fw_upd_running = false;
+static uint32_t fw_upd_len;
+static uint8_t* fw_upd_bufs[T1C_FW_UPD_NUM_BUFS];
+static QueueHandle_t fw_upd_free_queue = NULL;  // Buffers for file_task to fill
+static QueueHandle_t fw_upd_full_queue = NULL;  // Buffers for us to write
+static uint8_t fw_upd_verify_buf[FW_UPD_VERIFY_LEN];
+
 // Tiny1C info (buffer size dictated by Tiny1C Info command length)
 static char t1c_version_buf[64];
 static char t1c_sn_buf[64];
@@ -242,24 +713,109 @@ static char t1c_sn_buf[64];
 //
 // Tiny1C Task Forward declarations for internal functions
 //
+static bool _t1c_init_frame_timer();
+static void _frame_timer_cb(void* arg);
+static void _update_frame_jitter(int64_t period_usec);
+static void _eval_rate_governor(int64_t cur_usec);
+static bool _rate_full_needed();
 static bool _t1c_init_spi();
+static bool _t1c_set_spi_freq(int freq_hz);
+static bool _t1c_wait_ready();
 static bool _t1c_init_cci();
-static bool _t1c_init_param_buffer();
+static bool _t1c_init_param_cache();
+static bool _param_cache_set(uint8_t type, uint8_t param, uint16_t value);
+static bool _param_cache_get_next(param_buffer_entry_t* buf_entryP);
 static bool _t1c_read_params(int type);
-static ir_error_t _t1c_restore_default_config();
-static ir_error_t _t1c_perform_cal(int type);
+static bool _t1c_load_pon_params();
+static uint32_t _t1c_checksum(const void* data, int len, uint32_t h);
+static bool _t1c_init_param(int type, int param, uint16_t value);
 static bool _set_y16_mode(enum y16_isp_stream_src_types n);
+static void _init_frame_pool();
+static int _frame_pool_get();
+static void _frame_pool_ref(uint16_t* planeP);
+static void _frame_pool_release(uint16_t* planeP);
+static bool _get_frame_header();
+static void _vospi_bad_frame();
 static void _get_frame();
+static void _get_replay_frame();
+static void _setup_y16_hist();
+static void _eval_img_stats();
+static bool _setup_frame_hash();
+static void _hash_y16_line(uint16_t* line);
 static void _process_y16_line(uint16_t* src, uint16_t* dst, int len);
-static void _push_frame(t1c_buffer_t* buf);
+static void _process_y16_line_inv(uint16_t* src, uint16_t* dst, int len);
+static void _process_y16_line_tnr(uint16_t* src, uint16_t* dst, int len);
+static void _process_y16_line_tnr_chg(uint16_t* src, uint16_t* dst, int len);
+static bool _setup_tnr(bool invert);
+static bool _setup_chg(bool invert);
+static void _scale_y8();
+static void _update_frame_index(uint16_t index);
+static void _update_agc_range(uint16_t min, uint16_t max);
+static bool _push_frame(t1c_buffer_t* buf, TickType_t wait);
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+static bool _push_frame_info(t1c_buffer_t* buf);
+#endif
+static void _push_burst_frame(t1c_buffer_t* buf);
+static void _eval_sync_capture();
+static bool _eval_avg_frame();
+static void _push_avg_temps(t1c_buffer_t* buf);
+static void _eval_ffc_hold();
+static bool _ffc_skip_frame();
+static void _start_dpc_detect();
+static void _start_dpc_apply();
+static void _eval_dpc_detect();
+static bool _dpc_analyze_row(int y);
+static uint32_t _dpc_median(uint32_t* v, int n);
+static void _dpc_correct_line(uint16_t* line, int row);
+static void _run_fw_update();
+static bool _fw_upd_wait_ready();
+static bool _fw_upd_write(uint32_t addr, uint8_t* buf, uint32_t len);
+static void _eval_minmax_track();
+static void _track_extreme(minmax_track_t* t, uint16_t* peakP, bool is_max);
+static int32_t _track_refine(int32_t fl, int32_t fc, int32_t fr);
+static void _track_output(uint16_t* out, int32_t v);
+static void _eval_scene_stats();
+static void _copy_frame_info(t1c_buffer_t* buf);
 static void _push_metadata();
 static void _handle_notifications();
 static void _update_tpd_params(bool force_update);
-static void _eval_cci();
+#ifdef T1C_LOCAL_RADIOMETRY
+static void _eval_local_radiometry();
+#endif
+static void _eval_benchmark();
+static void _eval_auto_gain();
+static bool _auto_gain_hot_temp(uint16_t* t);
+static void _eval_cci(int64_t deadline_usec);
+static int _cci_next_meas();
+static void _cci_send_tpd_get(uint8_t sub_cmd, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint8_t len);
 static void _cci_send_get_point_temp();
 static void _cci_set_get_min_max_temp();
 static void _cci_set_get_region_temp();
-static void _cci_write_param(uint8_t sub_cmd, uint8_t param, uint16_t value);
+static void _cci_send_get_roi_temp();
+static bool _cci_read_point_temp();
+static bool _cci_read_min_max_temp();
+static bool _cci_read_region_temp();
+static bool _cci_read_roi_temp();
+static bool _cci_read_line_rect_temp(TpdLineRectTempInfo_t* info);
+static void _roi_correct_temp(uint16_t* t, uint8_t eps_pct);
+static void _roi_correct_info(TpdLineRectTempInfo_t* info, uint8_t eps_pct);
+static bool _cci_write_param(uint8_t sub_cmd, uint8_t param, uint16_t value);
+static bool _cci_write_std_cmd(uint8_t cmd_type, uint8_t sub_cmd, uint8_t para, uint8_t len, uint8_t* data);
+static bool _cci_write_long_cmd(uint8_t cmd_type, uint8_t sub_cmd, uint32_t addr1, uint32_t addr2);
+static void _cci_start_job(const cci_job_t* job);
+static bool _cci_job_next_step();
+static bool _cci_job_eval_step();
+static void _cci_job_finish();
+static bool _cci_job_restore_cfg(uint8_t cfg_type);
+static bool _cci_job_save_cfg(uint8_t spi_module);
+static bool _cci_job_shutter(uint8_t enable);
+static bool _cci_job_b_update(uint8_t update_type);
+static bool _cci_job_recal_1pt(uint8_t unused);
+static bool _cci_job_recal_2pt(uint8_t point);
+static bool _cci_job_dpc_add(uint8_t index);
+static void _cci_job_dpc_done(bool success);
+static void _cci_job_cal_2l_done(bool success);
+static void _cci_job_restore_done(bool success);
 static void _cci_fast_set_param(param_buffer_entry_t* buf_entryP);
 #ifdef INCLUDE_SHUTTER_DISPLAY
 static void _display_shutter_values();
@@ -273,18 +829,91 @@ static void _display_tpd_values();
 
 
 
+//
+// Tiny1C Task Tables (after forward declarations since they reference internal functions)
+//
+
+// CCI measurement schedule
+static int cci_cur_meas;
+static cci_meas_t cci_meas[CCI_NUM_MEAS] = {
+	{&spot_en, CCI_DEF_SPOT_PRI, CCI_DEF_PERIOD, 0, _cci_send_get_point_temp, _cci_read_point_temp, "spot"},
+	{&minmax_meas_en, CCI_DEF_MINMAX_PRI, CCI_DEF_MINMAX_PERIOD, 0, _cci_set_get_min_max_temp, _cci_read_min_max_temp, "minmax"},
+	{&region_en, CCI_DEF_REGION_PRI, CCI_DEF_PERIOD, 0, _cci_set_get_region_temp, _cci_read_region_temp, "rect"},
+	{&roi_en, CCI_DEF_ROI_PRI, CCI_DEF_PERIOD, 0, _cci_send_get_roi_temp, _cci_read_roi_temp, "roi"}
+};
+
+
+// CCI jobs
+static const cci_job_step_t restore_steps[] = {
+	{_cci_job_restore_cfg, DEF_CFG_ALL, CCI_JOB_RUN_OK, CCI_JOB_CFG_MSEC, "restore cfg"},
+#ifdef T1C_SAVE_CONFIG
+	{_cci_job_save_cfg, SPI_MOD_CFG_ALL, CCI_JOB_RUN_OK, CCI_JOB_CFG_MSEC, "save"}
+#endif
+};
+
+static const cci_job_step_t cal_1_steps[] = {
+	{_cci_job_restore_cfg, DEF_CFG_TPD, CCI_JOB_RUN_OK, CCI_JOB_CFG_MSEC, "restore cfg"},
+	{_cci_job_shutter, 0, CCI_JOB_RUN_OK, CCI_JOB_CMD_MSEC, "shutter 0"},
+	{_cci_job_b_update, B_UPDATE, CCI_JOB_RUN_OK, CCI_JOB_FFC_MSEC, "b update"},
+	{_cci_job_recal_1pt, 0, CCI_JOB_RUN_OK, CCI_JOB_RECAL_MSEC, "recal"},
+	{_cci_job_restore_cfg, DEF_CFG_TPD, CCI_JOB_RUN_FAIL, CCI_JOB_CFG_MSEC, "restore"},
+	{_cci_job_shutter, 1, CCI_JOB_RUN_ALWAYS, CCI_JOB_CMD_MSEC, "shutter 1"},
+#ifdef T1C_SAVE_CONFIG
+	{_cci_job_save_cfg, SPI_MOD_CFG_ALL, CCI_JOB_RUN_OK, CCI_JOB_CFG_MSEC, "save"}
+#endif
+};
+
+static const cci_job_step_t cal_2l_steps[] = {
+	{_cci_job_restore_cfg, DEF_CFG_TPD, CCI_JOB_RUN_OK, CCI_JOB_CFG_MSEC, "restore cfg"},
+	{_cci_job_shutter, 0, CCI_JOB_RUN_OK, CCI_JOB_CMD_MSEC, "shutter 0"},
+	{_cci_job_b_update, B_UPDATE, CCI_JOB_RUN_OK, CCI_JOB_FFC_MSEC, "b update"},
+	{_cci_job_recal_2pt, TPD_KTBT_RECAL_P1, CCI_JOB_RUN_OK, CCI_JOB_RECAL_MSEC, "recal"},
+	{_cci_job_restore_cfg, DEF_CFG_TPD, CCI_JOB_RUN_FAIL, CCI_JOB_CFG_MSEC, "restore"},
+	{_cci_job_shutter, 1, CCI_JOB_RUN_FAIL, CCI_JOB_CMD_MSEC, "shutter 1"}
+};
+
+static const cci_job_step_t cal_2h_steps[] = {
+	{_cci_job_b_update, B_UPDATE, CCI_JOB_RUN_OK, CCI_JOB_FFC_MSEC, "b update"},
+	{_cci_job_recal_2pt, TPD_KTBT_RECAL_P2, CCI_JOB_RUN_OK, CCI_JOB_RECAL_MSEC, "recal"},
+	{_cci_job_restore_cfg, DEF_CFG_TPD, CCI_JOB_RUN_FAIL, CCI_JOB_CFG_MSEC, "restore"},
+	{_cci_job_shutter, 1, CCI_JOB_RUN_ALWAYS, CCI_JOB_CMD_MSEC, "shutter 1"},
+#ifdef T1C_SAVE_CONFIG
+	{_cci_job_save_cfg, SPI_MOD_CFG_ALL, CCI_JOB_RUN_OK, CCI_JOB_CFG_MSEC, "save"}
+#endif
+};
+
+static const cci_job_step_t ffc_steps[] = {
+	{_cci_job_b_update, B_UPDATE, CCI_JOB_RUN_OK, CCI_JOB_FFC_MSEC, "b update"}
+};
+
+#define CCI_JOB_STEPS(s) s, (sizeof(s) / sizeof(cci_job_step_t))
+
+static const cci_job_t restore_job = {CCI_JOB_STEPS(restore_steps), true, _cci_job_restore_done, "Restore default"};
+static const cci_job_t cal_1_job = {CCI_JOB_STEPS(cal_1_steps), true, NULL, "One point calibration"};
+static const cci_job_t cal_2l_job = {CCI_JOB_STEPS(cal_2l_steps), true, _cci_job_cal_2l_done, "Two point calibration (low)"};
+static const cci_job_t cal_2h_job = {CCI_JOB_STEPS(cal_2h_steps), true, NULL, "Two point calibration (high)"};
+static const cci_job_t ffc_job = {CCI_JOB_STEPS(ffc_steps), false, NULL, "Manual FFC"};
+
+// Steps are filled in for the proposed points when the job is started
+static cci_job_t dpc_job = {dpc_steps, 0, false, _cci_job_dpc_done, "Dead pixel update"};
+
+
+
 //
 // Tiny1C Task API
 //
 void t1c_task()
 {
 	int vid_buf_index = 0;     // 0 or 1 for ping-pong
+	int pool_index;
+	bool avg_done;
 	int64_t cur_usec;
-	int64_t prev_usec = 0;
+	int64_t prev_usec;
+	int64_t stage_usec;
 	
-	// Create the parameter setting queue (buffer) to allow other tasks to configure the Tiny1C
-	if (!_t1c_init_param_buffer()) {
-		ESP_LOGE(TAG, "Could not initialize parameter buffer");
+	// Create the parameter setting cache to allow other tasks to configure the Tiny1C
+	if (!_t1c_init_param_cache()) {
+		ESP_LOGE(TAG, "Could not initialize parameter cache");
 #ifdef CONFIG_BUILD_ICAM_MINI
 		ctrl_set_fault_type(CTRL_FAULT_MEM_INIT);
 #else
@@ -293,16 +922,14 @@ void t1c_task()
 		vTaskDelete(NULL);
 	}
 	
-	// Delay to allow Tiny1C to boot after reset
-	vTaskDelay(pdMS_TO_TICKS(1000));
-	
 	ESP_LOGI(TAG, "Start task");
 	
 	// Get our initial configuration
 	(void) ps_get_config(PS_CONFIG_TYPE_T1C, &t1c_config);
 	
-	// Attempt to initialize our SPI interface for VOSPI communication
-	if (!_t1c_init_spi()) {
+	// Read the TAU tables and initialize our SPI interface for VOSPI communication while
+	// the Tiny1C boots
+	if ((read_correct_tables() != 0) || !_t1c_init_spi()) {
 		ESP_LOGE(TAG, "Could not initialize Tiny1C VOSPI");
 #ifdef CONFIG_BUILD_ICAM_MINI
 		ctrl_set_fault_type(CTRL_FAULT_T1C_CCI);
@@ -312,8 +939,8 @@ void t1c_task()
 		vTaskDelete(NULL);
 	}
 	
-	// Attempt to initialize the Tiny1C and start it streaming
-	if (!_t1c_init_cci()) {
+	// Attempt to initialize the Tiny1C, once it is ready, and start it streaming
+	if (!_t1c_wait_ready() || !_t1c_init_cci()) {
 		ESP_LOGE(TAG, "Could not initialize Tiny1C CCI");
 #ifdef CONFIG_BUILD_ICAM_MINI
 		ctrl_set_fault_type(CTRL_FAULT_T1C_VOSPI);
@@ -330,6 +957,11 @@ void t1c_task()
 	t1c_set_minmax_marker_enable(out_state.min_max_mrk_enable);
 	t1c_set_region_location(T1C_WIDTH/4, T1C_HEIGHT/4, 3*T1C_WIDTH/4, 3*T1C_HEIGHT/4);
 	t1c_set_region_enable(out_state.region_enable);
+	t1c_set_agc_mode(out_state.agc_mode);
+	t1c_set_tnr_level(out_state.tnr_level);
+	t1c_set_y8_filter(out_state.y8_filt_mode, out_state.y8_filt_outputs);
+	t1c_set_change_detect(out_state.chg_mode, out_state.chg_thresh);
+	t1c_set_auto_gain_enable(out_state.auto_gain_en);
 	
 	// Setup our notifications
 #ifdef CONFIG_BUILD_ICAM_MINI
@@ -346,6 +978,7 @@ void t1c_task()
 	task_shutdown_notification = CTRL_NOTIFY_SHUTDOWN;
 	task_ctrl_act_succeeded_notification = WEB_NOTIFY_CTRL_ACT_SUCCEEDED_MASK;
 	task_ctrl_act_failed_notification = WEB_NOTIFY_CTRL_ACT_FAILED_MASK;
+	task_ctrl_act_progress_notification = WEB_NOTIFY_CTRL_ACT_PROGRESS_MASK;
 #else
 	platform_task = task_handle_gcore;
 	output_task = task_handle_gui;
@@ -354,19 +987,43 @@ void t1c_task()
 	task_shutdown_notification = GCORE_NOTIFY_SHUTOFF_MASK;
 	task_ctrl_act_succeeded_notification = GUI_NOTIFY_CTRL_ACT_SUCCEEDED_MASK;
 	task_ctrl_act_failed_notification = GUI_NOTIFY_CTRL_ACT_FAILED_MASK;
+	task_ctrl_act_progress_notification = GUI_NOTIFY_CTRL_ACT_PROGRESS_MASK;
+#endif
+
+	// Account for the image planes initially assigned to the shared buffers
+	_init_frame_pool();
+	
+	// Start the frame scheduler
+	if (!_t1c_init_frame_timer()) {
+		ESP_LOGE(TAG, "Could not start frame timer");
+#ifdef CONFIG_BUILD_ICAM_MINI
+		ctrl_set_fault_type(CTRL_FAULT_MEM_INIT);
+#else
+		// ???
 #endif
+		vTaskDelete(NULL);
+	}
 
 	t1c_task_running = true;
 	
-	cur_usec = esp_timer_get_time();
+	prev_usec = esp_timer_get_time();
 	
 	// Process frames
 	while (1) {
-		// Spin until time to get a frame
-		while ((cur_usec - prev_usec) < EVAL_USEC) {
-			// Tickle the task WDT
-			vTaskDelay(pdMS_TO_TICKS(1));
-			cur_usec = esp_timer_get_time();
+		// Block until the frame scheduler indicates it is time to get a frame
+		(void) xSemaphoreTake(frame_timer_sem, portMAX_DELAY);
+#ifdef CONFIG_PM_ENABLE
+		// Run at the maximum CPU frequency while handling the frame.  The clock can drop,
+		// and the system light sleep, until the next frame period.
+		(void) esp_pm_lock_acquire(frame_pm_lock);
+#endif
+		cur_usec = esp_timer_get_time();
+		if (rate_idle) {
+			// Periods are long (or cut short by a wakeup) and the Tiny1C frame index skips
+			// while acquisition is throttled
+			frame_index_valid = false;
+		} else {
+			_update_frame_jitter(cur_usec - prev_usec);
 		}
 		prev_usec = cur_usec;
 		
@@ -376,30 +1033,157 @@ void t1c_task()
 		// Process any incoming notifications
 		_handle_notifications();
 		
-		// Get an image from the Tiny1C
-		_get_frame();  
+		// Throttle acquisition when nothing needs every frame
+		_eval_rate_governor(cur_usec);
+		
+		// Start reading a frame from the Tiny1C, skipping it if it is corrupt
+		if ((replay_source == T1C_REPLAY_OFF) && !_get_frame_header()) {
+			_eval_cci(cur_usec + EVAL_USEC - CCI_GUARD_USEC);
+#ifdef CONFIG_PM_ENABLE
+			(void) esp_pm_lock_release(frame_pm_lock);
+#endif
+#ifdef INCLUDE_T1C_DIAG_OUTPUT
+			gpio_set_level(BRD_DIAG_IO, 0);
+#endif
+			continue;
+		}
+		
+		// Get an image from the Tiny1C into a free image plane
+		pool_index = _frame_pool_get();
+		cur_y16P = t1c_y16_pool[pool_index];
+		cur_y8P = t1c_y8_pool[pool_index];
+		cur_y8fP = t1c_y8f_pool[pool_index];
+		cur_chgP = t1c_chg_pool[pool_index];
+		stage_usec = perf_start();
+		if (replay_source == T1C_REPLAY_OFF) {
+			_get_frame();
+		} else {
+			_get_replay_frame();
+		}
+		perf_end(PERF_STAGE_ACQUIRE, stage_usec);
+		if (bench_frames != 0) {
+			bench_end(BENCH_ITEM_SPI_READ, stage_usec);
+		}
+#ifdef T1C_LOCAL_RADIOMETRY
+		_eval_local_radiometry();
+#endif
+		if (auto_gain_en) {
+			_eval_auto_gain();
+		}
+		_eval_minmax_track();
+		_eval_img_stats();
+		if (dpc_status.state == T1C_DPC_ST_DETECT) {
+			_eval_dpc_detect();
+		}
+		_eval_ffc_hold();
+		
+		// Accumulate frames for an averaged picture (the last one is replaced by the average
+		// before it is scaled).  Frames frozen by a shutter event are left out of pictures.
+		avg_done = notify_get_file_avg && !_ffc_skip_frame() && _eval_avg_frame();
 		
-		// Send to our output task
-		if (vid_buf_index == 0) {
-			_push_frame(&out_t1c_buffer[0]);
-			xTaskNotify(output_task, task_frame_1_notification, eSetBits);
-			vid_buf_index = 1;
+		// Scale (and filter) it once for all consumers
+		stage_usec = perf_start();
+		_scale_y8();
+		if ((y8_filt_mode != T1C_Y8F_MODE_OFF) && (y8_filt_outputs != 0)) {
+			t1c_y8_filter(y8_filt_mode, cur_y8P, cur_y8fP, T1C_WIDTH, T1C_HEIGHT, y8_filt_ring);
+			y8_filt_mask = y8_filt_outputs;
 		} else {
-			_push_frame(&out_t1c_buffer[1]);
-			xTaskNotify(output_task, task_frame_2_notification, eSetBits);
-			vid_buf_index = 0;
+			y8_filt_mask = 0;
+		}
+		perf_end(PERF_STAGE_SCALE, stage_usec);
+		if (bench_frames != 0) {
+			bench_end(BENCH_ITEM_SCALE, stage_usec);
+		}
+		frame_seq++;
+		
+		// Send to our output task.  We never wait for the output task.  If it is still
+		// using the buffer that is next then the frame goes into the other buffer (which
+		// stays next) and if it is using both then the frame is dropped for it (and counted
+		// by its frame accounting).
+		if (_push_frame(&out_t1c_buffer[vid_buf_index], 0)) {
+			xTaskNotify(output_task, (vid_buf_index == 0) ? task_frame_1_notification : task_frame_2_notification, eSetBits);
+			vid_buf_index = (vid_buf_index == 0) ? 1 : 0;
+		} else if (_push_frame(&out_t1c_buffer[(vid_buf_index == 0) ? 1 : 0], 0)) {
+			xTaskNotify(output_task, (vid_buf_index == 0) ? task_frame_2_notification : task_frame_1_notification, eSetBits);
+		}
+		
+#ifdef CONFIG_AUX_UART_ENABLE
+		// Send to the AUX port task, skipping it if it is still encoding the last frame
+		if ((task_handle_aux != NULL) && _push_frame(&aux_t1c_buffer, 0)) {
+			xTaskNotify(task_handle_aux, AUX_NOTIFY_T1C_FRAME_MASK, eSetBits);
+		}
+#endif
+		
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+		// Send the measurements (not the image) to mqtt_task if requested, trying again
+		// with the next frame if it is still encoding the last ones
+		if (notify_get_mqtt_info && _push_frame_info(&mqtt_t1c_buffer)) {
+			xTaskNotify(task_handle_mqtt, MQTT_NOTIFY_T1C_FRAME_MASK, eSetBits);
+			notify_get_mqtt_info = false;
+		}
+#endif
+		
+		if (frame_seq == 1) {
+			system_boot_mark(SYS_BOOT_FIRST_FRAME);
 		}
 		
 		// Send to file_task if requested
-		if (notify_get_file_image) {
-			_push_frame(&file_t1c_buffer);
+		if (notify_get_file_image || avg_done) {
+			(void) _push_frame(&file_t1c_buffer, portMAX_DELAY);
+			if (avg_done) {
+				_push_avg_temps(&file_t1c_buffer);
+				avg_count = 0;
+			}
 			_push_metadata();
 			xTaskNotify(task_handle_file, FILE_NOTIFY_T1C_FRAME_MASK, eSetBits);
 			notify_get_file_image = false;
 		}
 		
-		_eval_cci();
+		// Time the Tiny1C interface during a benchmark and then hand the last frame to
+		// file_task for the rest of it
+		if (bench_frames != 0) {
+			_eval_benchmark();
+		}
+		
+		// Copy to the next burst buffer if a burst is in progress or keep the pre-trigger
+		// ring of recent frames
+		if (burst_index < burst_num) {
+			if (burst_index == 0) {
+				_push_metadata();
+			}
+			_push_burst_frame(&file_burst_buffer[burst_next]);
+			if (++burst_next == FILE_BURST_MAX_FRAMES) burst_next = 0;
+			if (++burst_index == burst_num) {
+				burst_num = 0;
+				burst_index = 0;
+				burst_ring_en = false;
+				burst_ring_count = 0;
+				xTaskNotify(task_handle_file, FILE_NOTIFY_T1C_BURST_MASK, eSetBits);
+			}
+		} else if (burst_ring_en) {
+			_push_burst_frame(&file_burst_buffer[burst_next]);
+			if (++burst_next == FILE_BURST_MAX_FRAMES) burst_next = 0;
+			if (burst_ring_count < FILE_BURST_MAX_FRAMES) burst_ring_count++;
+			if (sync_pending) {
+				_eval_sync_capture();
+			}
+		}
+		
+		if (scene_stats_en) {
+			_eval_scene_stats();
+			xTaskNotify(task_handle_file, FILE_NOTIFY_T1C_STATS_MASK, eSetBits);
+		}
+		
+		// Drop our reference (the plane is now owned by the buffers it was pushed to)
+		_frame_pool_release(cur_y16P);
 		
+		stage_usec = perf_start();
+		_eval_cci(cur_usec + EVAL_USEC - CCI_GUARD_USEC);
+		perf_end(PERF_STAGE_CCI, stage_usec);
+		
+#ifdef CONFIG_PM_ENABLE
+		(void) esp_pm_lock_release(frame_pm_lock);
+#endif
 #ifdef INCLUDE_T1C_DIAG_OUTPUT
 		gpio_set_level(BRD_DIAG_IO, 0);
 #endif
@@ -424,8 +1208,10 @@ void t1c_set_spot_enable(bool en)
 
 void t1c_set_spot_location(uint16_t x, uint16_t y)
 {
+	portENTER_CRITICAL(&loc_mux);
 	spot_new_param.x = x;
 	spot_new_param.y = y;
+	portEXIT_CRITICAL(&loc_mux);
 	
 	// Notify ourselves so we can atomically set these values internally
 	xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_SPOT_LOC_MASK, eSetBits);
@@ -435,17 +1221,34 @@ void t1c_set_spot_location(uint16_t x, uint16_t y)
 void t1c_set_minmax_marker_enable(bool en)
 {
 	// Always make sure we output minmax if enabled (but leave disabling to t1c_set_minmax_temp_enable)
-	if (en) minmax_en = true;
+	if (en) {
+		minmax_en = true;
+		minmax_meas_en = true;
+	}
 }
 
 
 void t1c_set_minmax_temp_enable(bool en)
 {
 	minmax_en = en;
+	minmax_meas_en = en || auto_gain_en;
 	minmax_valid = false;
 }
 
 
+void t1c_set_auto_gain_enable(bool en)
+{
+	if (en && !auto_gain_en) {
+		// Start from the gain the Tiny1C is currently configured for
+		auto_gain_high = (tpd_settings_values[TPD_PROP_GAIN_SEL] != 0);
+		auto_gain_count = 0;
+		auto_gain_settle = 0;
+	}
+	auto_gain_en = en;
+	minmax_meas_en = minmax_en || en;
+}
+
+
 void t1c_set_region_enable(bool en)
 {
 	region_en = en;
@@ -455,495 +1258,2473 @@ void t1c_set_region_enable(bool en)
 
 void t1c_set_region_location(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 {
+	portENTER_CRITICAL(&loc_mux);
 	region_new_param.start_point.x = x1;
 	region_new_param.start_point.y = y1;
 	region_new_param.end_point.x = x2;
 	region_new_param.end_point.y = y2;
+	portEXIT_CRITICAL(&loc_mux);
 	
 	// Notify ourselves so we can atomically set these values internally
 	xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_REGION_LOC_MASK, eSetBits);
 }
 
 
-void t1c_set_ambient_temp(int16_t t, bool valid)
+void t1c_set_roi_table(const t1c_roi_table_t* roi)
 {
-	new_env_cond.ambient_temp = t;
-	new_env_cond.ambient_temp_valid = valid;
+	int i;
+	
+	roi_new_table = *roi;
+	if (roi_new_table.num_spots > T1C_ROI_MAX_SPOTS) roi_new_table.num_spots = T1C_ROI_MAX_SPOTS;
+	if (roi_new_table.num_rects > T1C_ROI_MAX_RECTS) roi_new_table.num_rects = T1C_ROI_MAX_RECTS;
+	if (roi_new_table.num_lines > T1C_ROI_MAX_LINES) roi_new_table.num_lines = T1C_ROI_MAX_LINES;
+	for (i=0; i<T1C_ROI_MAX_SPOTS; i++) {
+		if (roi_new_table.spot_emissivity[i] > 100) roi_new_table.spot_emissivity[i] = 100;
+	}
+	for (i=0; i<T1C_ROI_MAX_RECTS; i++) {
+		if (roi_new_table.rect_emissivity[i] > 100) roi_new_table.rect_emissivity[i] = 100;
+	}
+	for (i=0; i<T1C_ROI_MAX_LINES; i++) {
+		if (roi_new_table.line_emissivity[i] > 100) roi_new_table.line_emissivity[i] = 100;
+	}
+	
+	// Notify ourselves so we can atomically set these values internally
+	xTaskNotify(task_handle_t1c, T1C_NOTIFY_SET_ROI_TABLE_MASK, eSetBits);
 }
 
 
-void t1c_set_ambient_humidity(uint16_t h, bool valid)
+void t1c_get_roi_table(t1c_roi_table_t* roi)
 {
-	new_env_cond.ambient_humidity = h;
-	new_env_cond.ambient_humidity_valid = valid;
+	*roi = roi_table;
 }
 
 
-void t1c_set_target_distance(uint16_t cm, bool valid)
+void t1c_set_meas_schedule(int meas, int priority, int period_frames)
 {
-	new_env_cond.target_distance = cm;
-	new_env_cond.target_distance_valid = valid;
+	if ((meas >= 0) && (meas < CCI_NUM_MEAS) && (period_frames > 0)) {
+		cci_meas[meas].priority = priority;
+		cci_meas[meas].period = period_frames;
+	}
 }
 
 
-bool t1c_set_param_shutter(uint8_t param, uint16_t param_value)
+void t1c_set_agc_mode(int mode)
 {
-	param_buffer_entry_t param_entry;
-	UBaseType_t ret;
-	
-	param_entry.type = PARAM_BUF_TYPE_SHUTTER;
-	param_entry.param = param;
-	param_entry.value = param_value;
-	
-	xSemaphoreTake(param_mutex, portMAX_DELAY);
-	ret = xRingbufferSend(param_buf_handle, &param_entry, sizeof(param_entry), pdMS_TO_TICKS(1000));
-	xSemaphoreGive(param_mutex);
-	
-	return (ret == pdTRUE);
+	if ((mode >= 0) && (mode < T1C_AGC_NUM_MODES)) {
+		agc_mode = mode;
+	}
 }
 
 
-bool t1c_set_param_image(uint8_t param, uint16_t param_value)
+/**
+ * Set the temporal noise reduction level (T1C_TNR_OFF disables the filter)
+ */
+void t1c_set_tnr_level(int level)
 {
-	param_buffer_entry_t param_entry;
-	UBaseType_t ret;
-	
-	param_entry.type = PARAM_BUF_TYPE_IMAGE;
-	param_entry.param = param;
-	param_entry.value = param_value;
+	if ((level >= 0) && (level < T1C_TNR_NUM_LEVELS)) {
+		tnr_level = level;
+	}
+}
+
+
+/**
+ * Set the spatial filter mode and the outputs (T1C_Y8F_OUT_xxx) that use the filtered
+ * image.  The filter is run once per frame if any output uses it.
+ */
+void t1c_set_y8_filter(int mode, uint8_t outputs)
+{
+	if ((mode >= 0) && (mode < T1C_Y8F_NUM_MODES)) {
+		y8_filt_mode = mode;
+		y8_filt_outputs = outputs & T1C_Y8F_OUT_MASK;
+	}
+}
+
+
+/**
+ * Set the change detection mode (T1C_CHG_OFF disables it) and threshold (Y16 counts)
+ */
+void t1c_set_change_detect(int mode, uint16_t threshold)
+{
+	if ((mode >= 0) && (mode < T1C_CHG_NUM_MODES) &&
+	    (threshold >= T1C_CHG_THRESH_MIN) && (threshold <= T1C_CHG_THRESH_MAX)) {
+		
+		chg_thresh = threshold;
+		chg_mode = mode;
+	}
+}
+
+
+void t1c_set_picture_avg(int n)
+{
+	if ((n >= 1) && (n <= T1C_PICTURE_AVG_MAX)) {
+		avg_new_num = n;
+	}
+}
+
+
+int t1c_get_picture_avg()
+{
+	return avg_new_num;
+}
+
+
+void t1c_set_ffc_hold(uint32_t source, bool hold)
+{
+	if (hold) {
+		ffc_hold_mask |= source;
+		t1c_wake();
+	} else {
+		ffc_hold_mask &= ~source;
+	}
+}
+
+
+uint32_t t1c_get_ffc_age_msec()
+{
+	int64_t age_usec;
 	
-	xSemaphoreTake(param_mutex, portMAX_DELAY);
-	ret = xRingbufferSend(param_buf_handle, &param_entry, sizeof(param_entry), pdMS_TO_TICKS(1000));
-	xSemaphoreGive(param_mutex);
+	if (ffc_last_usec == 0) {
+		// No shutter event seen since boot (the Tiny1C runs one when it starts)
+		age_usec = esp_timer_get_time();
+	} else {
+		age_usec = esp_timer_get_time() - ffc_last_usec;
+	}
 	
-	return (ret == pdTRUE);
+	return (uint32_t) (age_usec / 1000);
 }
 
 
-bool t1c_set_param_tpd(uint8_t param, uint16_t param_value)
+void t1c_get_dpc_status(t1c_dpc_status_t* status)
 {
-	param_buffer_entry_t param_entry;
-	UBaseType_t ret;
-	
-	param_entry.type = PARAM_BUF_TYPE_TPD;
-	param_entry.param = param;
-	param_entry.value = param_value;
+	*status = dpc_status;
+}
 
-	xSemaphoreTake(param_mutex, portMAX_DELAY);
-	ret = xRingbufferSend(param_buf_handle, &param_entry, sizeof(param_entry), pdMS_TO_TICKS(1000));
-	xSemaphoreGive(param_mutex);
+
+void t1c_start_burst(int n, int pre)
+{
+	if (n > FILE_BURST_MAX_FRAMES) n = FILE_BURST_MAX_FRAMES;
+	if (pre > (FILE_BURST_MAX_FRAMES - n)) pre = FILE_BURST_MAX_FRAMES - n;
+	burst_new_num = n;
+	burst_new_pre = pre;
 	
-	return (ret == pdTRUE);
+	// Notify ourselves so the burst starts on a frame boundary
+	xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_BURST_MASK, eSetBits);
+	t1c_wake();
 }
 
 
-void t1c_set_blackbody_temp(uint16_t temp_k)
+void t1c_start_sync_capture(int64_t target_usec)
 {
-	bb_temp_k = temp_k;
+	sync_new_usec = target_usec;
+	
+	// Notify ourselves so the capture is evaluated on a frame boundary
+	xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_SYNC_MASK, eSetBits);
+	t1c_wake();
 }
 
 
-char* t1c_get_module_version()
+int t1c_get_burst_frames(int* num)
 {
-	return t1c_version_buf;
+	*num = burst_total;
+	return burst_first;
 }
 
 
-char* t1c_get_module_sn()
+void t1c_set_burst_ring_enable(bool en)
 {
-	return t1c_sn_buf;
+	if (en && !burst_ring_en) {
+		burst_ring_count = 0;
+	}
+	burst_ring_en = en;
 }
 
 
+void t1c_set_scene_stats_enable(bool en)
+{
+	if (en && !scene_stats_en) {
+		scene_sig_valid = false;
+	}
+	scene_stats_en = en;
+}
 
 
-//
-// Tiny1C Task internal functions
-//
-static bool _t1c_init_spi()
+void t1c_get_scene_stats(t1c_scene_stats_t* stats)
 {
-	// Attempt to initialize the SPI Master used by t1c_task to read the Tiny1C
-	spi_bus_config_t spi_buscfg = {
-		.miso_io_num=BRD_T1C_MISO_IO,
-		.mosi_io_num=BRD_T1C_MOSI_IO,
-		.sclk_io_num=BRD_T1C_SCK_IO,
-		.max_transfer_sz=VOSPI_TX_DUMMY_LEN,
-		.quadwp_io_num=-1,
-		.quadhd_io_num=-1
-	};
-	
-	spi_device_interface_config_t devcfg = {
-		.command_bits = 0,
-		.address_bits = 0,
-		.clock_speed_hz = T1C_SPI_FREQ_HZ,
-		.mode = 3,
-		.spics_io_num = BRD_T1C_CSN_IO,
-		.queue_size = 1,
-		.flags = 0,
-		.cs_ena_pretrans = 2
-	};
+	*stats = scene_stats;
+}
 
-	if (spi_bus_initialize(T1C_SPI_HOST, &spi_buscfg, T1C_DMA_NUM) != ESP_OK) {
-		ESP_LOGE(TAG, "SPI Master initialization failed");
-		return false;
+
+void t1c_set_rect_stats_enable(bool en)
+{
+#ifdef T1C_LOCAL_RADIOMETRY
+	if (en && (sat_mutex == NULL)) {
+		sat_sum = (uint32_t*) heap_caps_malloc(T1C_RAD_SAT_W * T1C_RAD_SAT_H * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+		sat_sum_sq = (uint64_t*) heap_caps_malloc(T1C_RAD_SAT_W * T1C_RAD_SAT_H * sizeof(uint64_t), MALLOC_CAP_SPIRAM);
+		if ((sat_sum == NULL) || (sat_sum_sq == NULL)) {
+			ESP_LOGE(TAG, "Could not allocate summed-area tables");
+			heap_caps_free(sat_sum);
+			heap_caps_free(sat_sum_sq);
+			sat_sum = NULL;
+			sat_sum_sq = NULL;
+			return;
+		}
+		sat_mutex = xSemaphoreCreateMutex();
+		if (sat_mutex == NULL) {
+			ESP_LOGE(TAG, "Could not create summed-area table mutex");
+			return;
+		}
 	}
 	
-	if (spi_bus_add_device(T1C_SPI_HOST, &devcfg, &spi) != ESP_OK) {
-		ESP_LOGE(TAG, "Could not add SPI device");
-		return false;
+	if (!en) {
+		sat_valid = false;
 	}
-	
-	// Initialize the SPI transaction we use
-	memset(&spi_trans, 0, sizeof(spi_transaction_t));
-	spi_trans.tx_buffer = vospi_TxBuf;
-	spi_trans.rx_buffer = vospi_RxBuf1;
-	
-	return true;
+	rect_stats_en = en;
+#else
+	ESP_LOGE(TAG, "Rectangle statistics require local radiometry");
+#endif
 }
 
 
-static bool _t1c_init_cci()
+bool t1c_get_rect_stats(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t* mean, uint16_t* stddev)
 {
-	uint16_t param_value;
+	IrRect_t rect;
 	
-	// Read the TAU table
-	if (read_correct_table(t1c_config.high_gain ? HIGH_GAIN : LOW_GAIN) != 0) {
+	if (!rect_stats_en || !sat_valid) {
 		return false;
 	}
 	
-	// Initialize the Tiny1C interface
-	if (vdcmd_init_by_type(VDCMD_I2C_VDCMD) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "vdcmd_init_by_type failed");
+	rect.start_point.x = x1;
+	rect.start_point.y = y1;
+	rect.end_point.x = x2;
+	rect.end_point.y = y2;
+	
+	xSemaphoreTake(sat_mutex, portMAX_DELAY);
+	t1c_rad_sat_rect_stats(sat_sum, sat_sum_sq, &rect, mean, stddev);
+	xSemaphoreGive(sat_mutex);
+	
+	return true;
+}
+
+
+void t1c_set_ambient_temp(int16_t t, bool valid)
+{
+	new_env_cond.ambient_temp = t;
+	new_env_cond.ambient_temp_valid = valid;
+}
+
+
+void t1c_set_ambient_humidity(uint16_t h, bool valid)
+{
+	new_env_cond.ambient_humidity = h;
+	new_env_cond.ambient_humidity_valid = valid;
+}
+
+
+void t1c_set_target_distance(uint16_t cm, bool valid)
+{
+	new_env_cond.target_distance = cm;
+	new_env_cond.target_distance_valid = valid;
+}
+
+
+bool t1c_set_param_shutter(uint8_t param, uint16_t param_value)
+{
+	return _param_cache_set(PARAM_BUF_TYPE_SHUTTER, param, param_value);
+}
+
+
+bool t1c_set_param_image(uint8_t param, uint16_t param_value)
+{
+	return _param_cache_set(PARAM_BUF_TYPE_IMAGE, param, param_value);
+}
+
+
+bool t1c_set_param_tpd(uint8_t param, uint16_t param_value)
+{
+	return _param_cache_set(PARAM_BUF_TYPE_TPD, param, param_value);
+}
+
+
+void t1c_set_blackbody_temp(uint16_t temp_k)
+{
+	bb_temp_k = temp_k;
+}
+
+
+bool t1c_start_fw_update(uint32_t len)
+{
+	fw_upd_buf_t b;
+	int i;
+	
+	if (fw_upd_running || (len == 0) || (len > T1C_FW_UPD_MAX_LEN)) {
+		ESP_LOGE(TAG, "Firmware update rejected");
 		return false;
 	}
 	
-	// Get the firmware version
-	if (get_device_info(DEV_INFO_FW_BUILD_VERSION_INFO, (uint8_t*) &t1c_version_buf[0]) == IR_SUCCESS) {
-		ESP_LOGI(TAG, "Tiny1C Firmware version: %s", t1c_version_buf);
-	} else {
-		ESP_LOGE(TAG, "Could not read firmware version");
+	if (fw_upd_free_queue == NULL) {
+		for (i=0; i<T1C_FW_UPD_NUM_BUFS; i++) {
+			fw_upd_bufs[i] = (uint8_t*) heap_caps_malloc(T1C_FW_UPD_BUF_LEN, MALLOC_CAP_SPIRAM);
+			if (fw_upd_bufs[i] == NULL) {
+				ESP_LOGE(TAG, "Could not allocate firmware update buffers");
+				while (--i >= 0) {
+					heap_caps_free(fw_upd_bufs[i]);
+				}
+				return false;
+			}
+		}
+		fw_upd_free_queue = xQueueCreate(T1C_FW_UPD_NUM_BUFS, sizeof(fw_upd_buf_t));
+		fw_upd_full_queue = xQueueCreate(T1C_FW_UPD_NUM_BUFS, sizeof(fw_upd_buf_t));
+		if ((fw_upd_free_queue == NULL) || (fw_upd_full_queue == NULL)) {
+			ESP_LOGE(TAG, "Could not create firmware update queues");
+			return false;
+		}
 	}
 	
-	// Get the camera serial number
-	if (get_device_info(DEV_INFO_GET_SN, (uint8_t*) &t1c_sn_buf[0]) == IR_SUCCESS) {
-		ESP_LOGI(TAG, "Tiny1C Serial Number: %s", t1c_sn_buf);
-	} else {
-		ESP_LOGE(TAG, "Could not read serial number");
+	// All buffers start out free
+	(void) xQueueReset(fw_upd_free_queue);
+	(void) xQueueReset(fw_upd_full_queue);
+	for (i=0; i<T1C_FW_UPD_NUM_BUFS; i++) {
+		b.buf = fw_upd_bufs[i];
+		b.len = 0;
+		(void) xQueueSend(fw_upd_free_queue, &b, 0);
 	}
 	
-	// Start the Tiny1C video stream
-	if (preview_start((PreviewStartParam_t*)&stream_param) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "preview_start failed");
+	fw_upd_len = len;
+	fw_upd_running = true;
+	xTaskNotify(task_handle_t1c, T1C_NOTIFY_FILE_FW_UPD_MASK, eSetBits);
+	t1c_wake();
+	
+	return true;
+}
+
+
+uint8_t* t1c_fw_update_get_buffer()
+{
+	fw_upd_buf_t b;
+	
+	// Buffers are returned as they are written
+	while (fw_upd_running) {
+		if (xQueueReceive(fw_upd_free_queue, &b, pdMS_TO_TICKS(100)) == pdTRUE) {
+			return b.buf;
+		}
+	}
+	
+	return NULL;
+}
+
+
+void t1c_fw_update_put_buffer(uint8_t* buf, uint32_t len)
+{
+	fw_upd_buf_t b;
+	
+	b.buf = buf;
+	b.len = len;
+	(void) xQueueSend(fw_upd_full_queue, &b, portMAX_DELAY);
+}
+
+
+void t1c_get_activity_progress(int* step, int* num_steps)
+{
+	*step = cci_job_progress_step;
+	*num_steps = cci_job_progress_num_steps;
+}
+
+
+char* t1c_get_module_version()
+{
+	return t1c_version_buf;
+}
+
+
+char* t1c_get_module_sn()
+{
+	return t1c_sn_buf;
+}
+
+
+void t1c_get_frame_jitter(uint32_t* avg_usec, uint32_t* max_usec)
+{
+	*avg_usec = frame_jitter_report_avg;
+	*max_usec = frame_jitter_report_max;
+}
+
+
+void t1c_note_frame_consumed(int consumer, uint32_t seq)
+{
+	if ((consumer < 0) || (consumer >= T1C_NUM_CONSUMERS)) return;
+	
+	// Frames between the last one the consumer read and this one were overwritten in the
+	// ping-pong buffers before it got to them
+	if (consumer_seq_valid[consumer]) {
+		if (seq == consumer_last_seq[consumer]) return;
+		if ((seq - consumer_last_seq[consumer]) > 1) {
+			consumer_dropped[consumer] += seq - consumer_last_seq[consumer] - 1;
+		}
+	}
+	consumer_last_seq[consumer] = seq;
+	consumer_seq_valid[consumer] = true;
+	consumer_consumed[consumer] += 1;
+}
+
+
+/**
+ * Acquire the next frame immediately if acquisition is throttled.  The governor restores
+ * the full rate if the caller needs it.
+ */
+void t1c_wake()
+{
+	if (rate_idle && (frame_timer_sem != NULL)) {
+		(void) xSemaphoreGive(frame_timer_sem);
+	}
+}
+
+
+bool t1c_is_idle()
+{
+	return rate_idle;
+}
+
+
+void t1c_reset_frame_consumers()
+{
+	for (int i=0; i<T1C_NUM_CONSUMERS; i++) {
+		consumer_seq_valid[i] = false;
+	}
+}
+
+
+void t1c_get_frame_stats(t1c_frame_stats_t* stats)
+{
+	stats->frames = frame_seq;
+	stats->sensor_skipped = frame_sensor_skipped;
+	stats->vospi_bad = vospi_bad_frames;
+	stats->vospi_freq_khz = spi_freq_hz / 1000;
+	for (int i=0; i<T1C_NUM_CONSUMERS; i++) {
+		stats->consumed[i] = consumer_consumed[i];
+		stats->dropped[i] = consumer_dropped[i];
+	}
+}
+
+
+/**
+ * Select where frames come from.  Changing the source discards any replayed frame so the
+ * Tiny1C image is used until the new source loads one.
+ */
+void t1c_set_replay_source(int src)
+{
+	portENTER_CRITICAL(&replay_mux);
+	if (src != replay_source) {
+		replay_source = src;
+		replay_loaded = false;
+		replay_valid = false;
+	}
+	portEXIT_CRITICAL(&replay_mux);
+}
+
+
+int t1c_get_replay_source()
+{
+	return replay_source;
+}
+
+
+/**
+ * Get the t1c_replay_buffer entry for the loader to fill with a T1C_WIDTH x T1C_HEIGHT
+ * frame.  Returns NULL if replay is off or the last frame loaded hasn't been used yet.
+ */
+uint16_t* t1c_get_replay_buffer()
+{
+	uint16_t* bufP = NULL;
+	
+	portENTER_CRITICAL(&replay_mux);
+	if ((replay_source != T1C_REPLAY_OFF) && !replay_loaded) {
+		bufP = t1c_replay_buffer[replay_load_index];
+	}
+	portEXIT_CRITICAL(&replay_mux);
+	
+	return bufP;
+}
+
+
+/**
+ * Called by the loader when the entry from t1c_get_replay_buffer has been filled
+ */
+void t1c_set_replay_frame_loaded(bool high_gain)
+{
+	portENTER_CRITICAL(&replay_mux);
+	if (replay_source != T1C_REPLAY_OFF) {
+		replay_loaded = true;
+		replay_load_high_gain = high_gain;
+	}
+	portEXIT_CRITICAL(&replay_mux);
+}
+
+
+
+
+//
+// Tiny1C Task internal functions
+//
+static bool _t1c_init_frame_timer()
+{
+	const esp_timer_create_args_t frame_timer_args = {
+		.callback = &_frame_timer_cb,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "t1c_frame",
+		.skip_unhandled_events = true
+	};
+	
+	frame_timer_sem = xSemaphoreCreateBinary();
+	if (frame_timer_sem == NULL) {
 		return false;
 	}
 	
-	// Configure the output for Y16 data output
-	//   Set the output from the GAMMA process since that utilizes the entire video processing
-	//   chain and looks best with a linear transformation to 8-bits
-	if (!_set_y16_mode(Y16_MODE_GAMMA)) {
-		ESP_LOGE(TAG, "set_y16_mode failed");
+	if (esp_timer_create(&frame_timer_args, &frame_timer) != ESP_OK) {
 		return false;
 	}
 	
-	// Get initial (power-on) parameter configuration
-	if (!_t1c_read_params(PARAM_BUF_TYPE_SHUTTER)) return false;
-	if (!_t1c_read_params(PARAM_BUF_TYPE_IMAGE)) return false;
-	if (!_t1c_read_params(PARAM_BUF_TYPE_TPD)) return false;
-/*	
-#ifdef INCLUDE_SHUTTER_DISPLAY
-	_display_shutter_values();
+#ifdef CONFIG_PM_ENABLE
+	if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "t1c_frame", &frame_pm_lock) != ESP_OK) {
+		return false;
+	}
 #endif
-#ifdef INCLUDE_IMAGE_DISPLAY
-	_display_image_values();
+	
+	return (esp_timer_start_periodic(frame_timer, EVAL_USEC) == ESP_OK);
+}
+
+
+static void _frame_timer_cb(void* arg)
+{
+	// Release the main loop once per frame period (a missed period is not queued since the
+	// semaphore is binary)
+	(void) xSemaphoreGive(frame_timer_sem);
+}
+
+
+/**
+ * Switch between the full and idle acquisition rates.  The full rate is restored as soon
+ * as it is needed and the idle rate is only used after it hasn't been needed for a while.
+ */
+static void _eval_rate_governor(int64_t cur_usec)
+{
+	if (_rate_full_needed()) {
+		rate_busy_usec = cur_usec;
+		if (rate_idle) {
+			rate_idle = false;
+			(void) esp_timer_stop(frame_timer);
+			(void) esp_timer_start_periodic(frame_timer, EVAL_USEC);
+			ESP_LOGI(TAG, "Acquisition at %d fps", T1C_FPS);
+		}
+	} else if (!rate_idle && ((cur_usec - rate_busy_usec) >= (IDLE_DELAY_MSEC * 1000))) {
+		rate_idle = true;
+		(void) esp_timer_stop(frame_timer);
+		(void) esp_timer_start_periodic(frame_timer, IDLE_EVAL_USEC);
+		ESP_LOGI(TAG, "Acquisition throttled to %d fps", IDLE_FPS);
+	}
+}
+
+
+/**
+ * Returns true if something is using every frame: a display, a client or stream, a
+ * capture (including the lead up to a timelapse picture, which holds FFC off), a trigger
+ * evaluating the scene, or an activity run over many frames
+ */
+static bool _rate_full_needed()
+{
+	if ((ffc_hold_mask != 0) || notify_get_file_image || notify_get_file_avg ||
+	    (burst_num != 0) || burst_ring_en || scene_stats_en || (bench_frames != 0) ||
+	    (replay_source != T1C_REPLAY_OFF) || (dpc_status.state == T1C_DPC_ST_DETECT) ||
+	    (cci_job != NULL)) {
+		
+		return true;
+	}
+	
+#ifdef CONFIG_BUILD_ICAM_MINI
+	return (ctrl_get_output_mode() == CTRL_OUTPUT_VID) || web_needs_frames();
+#else
+	// The local GUI is always displaying images
+	return true;
 #endif
-#ifdef INCLUDE_TPD_DISPLAY
-	_display_tpd_values();
+}
+
+
+static void _update_frame_jitter(int64_t period_usec)
+{
+	int32_t jitter;
+	
+	jitter = (int32_t) (period_usec - EVAL_USEC);
+	if (jitter < 0) jitter = -jitter;
+	
+	if (jitter > frame_jitter_max) {
+		frame_jitter_max = jitter;
+	}
+	frame_jitter_sum += jitter;
+	
+	if (++frame_jitter_count >= JITTER_REPORT_FRAMES) {
+		frame_jitter_report_avg = (uint32_t) (frame_jitter_sum / frame_jitter_count);
+		frame_jitter_report_max = (uint32_t) frame_jitter_max;
+#ifdef INCLUDE_JITTER_DISPLAY
+		ESP_LOGI(TAG, "Frame jitter: avg %d uSec, max %d uSec", (int) frame_jitter_report_avg, (int) frame_jitter_report_max);
 #endif
-*/
+		frame_jitter_max = 0;
+		frame_jitter_sum = 0;
+		frame_jitter_count = 0;
+	}
+}
 
-	// Configure the Tiny1C with our settings
-	//
 
-	// Set Auto Shutter enable
-	param_value = t1c_config.auto_ffc_en ? 1 : 0;
-	if (set_prop_auto_shutter_params(SHUTTER_PROP_SWITCH, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter enable failed");
+static bool _t1c_init_spi()
+{
+	// Attempt to initialize the SPI Master used by t1c_task to read the Tiny1C
+	spi_bus_config_t spi_buscfg = {
+		.miso_io_num=BRD_T1C_MISO_IO,
+		.mosi_io_num=BRD_T1C_MOSI_IO,
+		.sclk_io_num=BRD_T1C_SCK_IO,
+		.max_transfer_sz=VOSPI_TX_DUMMY_LEN,
+		.quadwp_io_num=-1,
+		.quadhd_io_num=-1
+	};
+	
+	if (spi_bus_initialize(T1C_SPI_HOST, &spi_buscfg, T1C_DMA_NUM) != ESP_OK) {
+		ESP_LOGE(TAG, "SPI Master initialization failed");
 		return false;
 	}
-	shutter_settings_values[SHUTTER_PROP_SWITCH] = param_value;
 	
-	// Set Auto shutter minimum interval
-	param_value = (uint16_t) t1c_config.min_ffc_interval;
-	if (set_prop_auto_shutter_params(SHUTTER_PROP_MIN_INTERVAL, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter min interval failed");
-		return false;
+	// Start at the fast clock, if configured, and fall back to the standard clock if it
+	// can't be used
+	spi = NULL;
+	if (!_t1c_set_spi_freq(T1C_SPI_FAST_FREQ_HZ)) {
+		if ((T1C_SPI_FAST_FREQ_HZ == T1C_SPI_FREQ_HZ) || !_t1c_set_spi_freq(T1C_SPI_FREQ_HZ)) {
+			ESP_LOGE(TAG, "Could not add SPI device");
+			return false;
+		}
+	}
+	ESP_LOGI(TAG, "VOSPI clock: %d kHz", spi_freq_hz / 1000);
+	
+	// Initialize the SPI transaction we use
+	memset(&spi_trans, 0, sizeof(spi_transaction_t));
+	spi_trans.tx_buffer = vospi_TxBuf;
+	spi_trans.rx_buffer = vospi_RxBuf1;
+	
+#ifdef VOSPI_QUEUED_ACQ
+	// Initialize the ring of row transactions, each with its own receive buffer
+	for (int i=0; i<VOSPI_NUM_TRANS; i++) {
+		memset(&spi_row_trans[i], 0, sizeof(spi_transaction_t));
+		spi_row_trans[i].tx_buffer = vospi_TxBuf;
+		spi_row_trans[i].rx_buffer = vospi_RowBuf[i];
+		spi_row_trans[i].length = VOSPI_ROW_LEN*8;
+		spi_row_trans[i].rxlength = VOSPI_ROW_LEN*8;
+	}
+#endif
+	
+	return true;
+}
+
+
+// (Re)add the Tiny1C SPI device with a clock of freq_hz.  Must not be called while
+// transactions are in flight.
+static bool _t1c_set_spi_freq(int freq_hz)
+{
+	spi_device_interface_config_t devcfg = {
+		.command_bits = 0,
+		.address_bits = 0,
+		.clock_speed_hz = freq_hz,
+		.mode = 3,
+		.spics_io_num = BRD_T1C_CSN_IO,
+#ifdef VOSPI_QUEUED_ACQ
+		.queue_size = VOSPI_NUM_TRANS,
+#else
+		.queue_size = 1,
+#endif
+		.flags = 0,
+		.cs_ena_pretrans = 2
+	};
+	
+	if (spi != NULL) {
+		(void) spi_bus_remove_device(spi);
+		spi = NULL;
+	}
+	
+	if (spi_bus_add_device(T1C_SPI_HOST, &devcfg, &spi) != ESP_OK) {
+		spi = NULL;
+		return false;
+	}
+	spi_freq_hz = freq_hz;
+	
+	return true;
+}
+
+
+// Wait for the Tiny1C to finish booting after the reset at startup.  It doesn't respond
+// over the CCI while it boots so it is ready when its status can be read and shows it
+// isn't busy.  Returns false if it isn't ready within T1C_BOOT_MAX_MSEC.
+static bool _t1c_wait_ready()
+{
+	int64_t reset_usec = system_boot_get_usec(SYS_BOOT_T1C_RESET);
+	int32_t msec;
+	uint8_t status;
+	
+	// Don't bother it until it could be ready
+	msec = (int32_t) ((esp_timer_get_time() - reset_usec) / 1000);
+	if (msec < T1C_BOOT_MIN_MSEC) {
+		vTaskDelay(pdMS_TO_TICKS(T1C_BOOT_MIN_MSEC - msec));
+	}
+	
+	for (;;) {
+		// Read the status directly to avoid error logging while it doesn't respond
+		if (HAL_I2C_Mem_Read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, I2C_MEMADD_SIZE_16BIT, &status, 1, 0) == HAL_OK) {
+			if ((status & VCMD_BUSY_STS_BIT) == VCMD_BUSY_STS_IDLE) {
+				break;
+			}
+		}
+		
+		msec = (int32_t) ((esp_timer_get_time() - reset_usec) / 1000);
+		if (msec >= T1C_BOOT_MAX_MSEC) {
+			ESP_LOGE(TAG, "Tiny1C not ready after %d mSec", (int) msec);
+			return false;
+		}
+		vTaskDelay(pdMS_TO_TICKS(T1C_BOOT_POLL_MSEC));
+	}
+	
+	system_boot_mark(SYS_BOOT_T1C_READY);
+	return true;
+}
+
+
+static bool _t1c_init_cci()
+{
+	uint16_t param_value;
+	
+	(void) select_correct_table(t1c_config.high_gain ? HIGH_GAIN : LOW_GAIN);
+	
+	// Initialize the Tiny1C interface
+	if (vdcmd_init_by_type(VDCMD_I2C_VDCMD) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "vdcmd_init_by_type failed");
+		return false;
+	}
+	
+	// Get the firmware version
+	if (get_device_info(DEV_INFO_FW_BUILD_VERSION_INFO, (uint8_t*) &t1c_version_buf[0]) == IR_SUCCESS) {
+		ESP_LOGI(TAG, "Tiny1C Firmware version: %s", t1c_version_buf);
+	} else {
+		ESP_LOGE(TAG, "Could not read firmware version");
+	}
+	
+	// Get the camera serial number
+	if (get_device_info(DEV_INFO_GET_SN, (uint8_t*) &t1c_sn_buf[0]) == IR_SUCCESS) {
+		ESP_LOGI(TAG, "Tiny1C Serial Number: %s", t1c_sn_buf);
+	} else {
+		ESP_LOGE(TAG, "Could not read serial number");
+	}
+	
+	// Start the Tiny1C video stream
+	if (preview_start((PreviewStartParam_t*)&stream_param) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "preview_start failed");
+		return false;
+	}
+	
+	// Configure the output for Y16 data output
+	//   Set the output from the GAMMA process since that utilizes the entire video processing
+	//   chain and looks best with a linear transformation to 8-bits (or temperature data
+	//   when we measure locally)
+#ifdef T1C_LOCAL_RADIOMETRY
+	if (!_set_y16_mode(Y16_MODE_TEMPERATURE)) {
+#else
+	if (!_set_y16_mode(Y16_MODE_GAMMA)) {
+#endif
+		ESP_LOGE(TAG, "set_y16_mode failed");
+		return false;
+	}
+	
+	// Get initial (power-on) parameter configuration
+	if (!_t1c_load_pon_params()) return false;
+/*	
+#ifdef INCLUDE_SHUTTER_DISPLAY
+	_display_shutter_values();
+#endif
+#ifdef INCLUDE_IMAGE_DISPLAY
+	_display_image_values();
+#endif
+#ifdef INCLUDE_TPD_DISPLAY
+	_display_tpd_values();
+#endif
+*/
+
+	// Configure the Tiny1C with our settings (only those that differ from the power-on
+	// values are written)
+	//
+
+	// Set Auto Shutter enable
+	param_value = t1c_config.auto_ffc_en ? 1 : 0;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PROP_SWITCH, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter enable failed");
+		return false;
+	}
+	
+	// Set Auto shutter minimum interval
+	param_value = (uint16_t) t1c_config.min_ffc_interval;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PROP_MIN_INTERVAL, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter min interval failed");
+		return false;
+	}
+	
+	// Set Auto shutter maximum interval
+	param_value = (uint16_t) t1c_config.max_ffc_interval;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PROP_MAX_INTERVAL, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter max interval failed");
+		return false;
+	}
+	
+	// Set Auto shutter temp threshold
+	param_value = (uint16_t) (t1c_config.ffc_temp_threshold_x10 * 36 / 10);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PROP_TEMP_THRESHOLD_B, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter temp threshold failed");
+		return false;
+	}
+	
+	// Set Manual shutter minimum interval
+	param_value = (uint16_t) t1c_config.min_ffc_interval;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PROP_ANY_INTERVAL, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter any interval failed");
+		return false;
+	}
+	
+	// Shutter timing on preview start
+	param_value = T1C_SHUTTER_PREVIEW_1_SECS;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PREVIEW_START_1ST_DELAY, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter preview 1 failed");
+		return false;
+	}
+	
+	param_value = T1C_SHUTTER_PREVIEW_2_SECS;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_PREVIEW_START_2ND_DELAY, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter preview 2 failed");
+		return false;
+	}
+	
+	// Shutter timing on gain change
+	param_value = T1C_SHUTTER_GAIN_CHG_1_SECS;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_CHANGE_GAIN_1ST_DELAY, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter gain 1 failed");
+		return false;
+	}
+	
+	param_value = T1C_SHUTTER_GAIN_CHG_2_SECS;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_SHUTTER, SHUTTER_CHANGE_GAIN_2ND_DELAY, param_value)) {
+		ESP_LOGE(TAG, "Initialize auto shutter gain 2 failed");
+		return false;
+	}
+	
+	// Set the default brightness
+	param_value = brightness_to_param_value(t1c_config.brightness);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_IMAGE, IMAGE_PROP_LEVEL_BRIGHTNESS, param_value)) {
+		ESP_LOGE(TAG, "Initialize brightness failed");
+		return false;
+	}
+	
+	// Setup the default distance
+	param_value = dist_cm_to_param_value(t1c_config.distance);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_TPD, TPD_PROP_DISTANCE, param_value)) {
+		ESP_LOGE(TAG, "Initialize distance failed");
+		return false;
+	}
+	
+	// Set the default emissivity
+	param_value = emissivity_to_param_value(t1c_config.emissivity);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_TPD, TPD_PROP_EMS, param_value)) {
+		ESP_LOGE(TAG, "Initialize emissivity failed");
+		return false;
+	}
+	
+	// Set the default atmospheric temp
+	param_value = temperature_to_param_value(t1c_config.atmospheric_temp);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_TPD, TPD_PROP_TA, param_value)) {
+		ESP_LOGE(TAG, "Initialize atmospheric temp failed");
+		return false;
+	}
+	
+	// Set the default reflective temp
+	param_value = temperature_to_param_value(t1c_config.reflected_temp);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_TPD, TPD_PROP_TU, param_value)) {
+		ESP_LOGE(TAG, "Initialize reflective temp failed");
+		return false;
+	}
+	
+	// Set the default TAU (humidity is applied once it has been measured)
+	param_value = estimate_tau((float) t1c_config.atmospheric_temp, (float) t1c_config.distance/100.0, DEF_HUMIDITY_PERCENT);
+	if (!_t1c_init_param(PARAM_BUF_TYPE_TPD, TPD_PROP_TAU, param_value)) {
+		ESP_LOGE(TAG, "Initialize TAU failed");
+		return false;
+	}
+	
+	// Set gain mode
+	param_value = t1c_config.high_gain ? 1 : 0;
+	if (!_t1c_init_param(PARAM_BUF_TYPE_TPD, TPD_PROP_GAIN_SEL, param_value)) {
+		ESP_LOGE(TAG, "Initialize gain %u failed", param_value);
+		return false;
+	}
+	
+#ifdef INCLUDE_SHUTTER_DISPLAY
+	_display_shutter_values();
+#endif
+#ifdef INCLUDE_IMAGE_DISPLAY
+	_display_image_values();
+#endif
+#ifdef INCLUDE_TPD_DISPLAY
+	_display_tpd_values();
+#endif
+
+	return true;
+}
+
+static bool _t1c_init_param_cache()
+{
+	int i;
+	
+	for (i=0; i<PARAM_NUM_TYPES; i++) {
+		param_cache_dirty[i] = 0;
+	}
+	
+	param_mutex = xSemaphoreCreateMutex();
+	
+	return (param_mutex != NULL);
+}
+
+
+// Set a pending value, replacing any value not yet written to the Tiny1C
+static bool _param_cache_set(uint8_t type, uint8_t param, uint16_t value)
+{
+	if ((type >= PARAM_NUM_TYPES) || (param >= PARAM_CACHE_NUM_PARAM)) {
+		return false;
+	}
+	
+	xSemaphoreTake(param_mutex, portMAX_DELAY);
+	param_cache_values[type][param] = value;
+	param_cache_dirty[type] |= 1 << param;
+	xSemaphoreGive(param_mutex);
+	
+	return true;
+}
+
+
+// Get and clear the next pending value (in type and then parameter order).  Returns false
+// if there are none.
+static bool _param_cache_get_next(param_buffer_entry_t* buf_entryP)
+{
+	bool found = false;
+	int i, j;
+	
+	xSemaphoreTake(param_mutex, portMAX_DELAY);
+	for (i=0; i<PARAM_NUM_TYPES; i++) {
+		if (param_cache_dirty[i] != 0) {
+			j = __builtin_ctz(param_cache_dirty[i]);
+			param_cache_dirty[i] &= ~(1 << j);
+			buf_entryP->type = i;
+			buf_entryP->param = j;
+			buf_entryP->value = param_cache_values[i][j];
+			found = true;
+			break;
+		}
+	}
+	xSemaphoreGive(param_mutex);
+	
+	return found;
+}
+
+
+static bool _t1c_read_params(int type)
+{
+	int n;
+	uint16_t read_value;
+	
+	switch (type) {
+		case PARAM_BUF_TYPE_SHUTTER:
+			n = PARAM_NUM_TYPE_SHUTTER;
+			break;
+		case PARAM_BUF_TYPE_IMAGE:
+			n =  PARAM_NUM_TYPE_IMAGE;
+			break;
+		default:
+			n = PARAM_NUM_TYPE_TPD;
+	}
+	
+	for (int i=0; i<n; i++) {
+		switch (type) {
+			case PARAM_BUF_TYPE_SHUTTER:
+				if (get_prop_auto_shutter_params(SHUTTER_PROP_SWITCH + i, &read_value) != IR_SUCCESS) {
+					ESP_LOGE(TAG, "Get Shutter Param %d failed", i);
+					return false;
+				} else {
+					shutter_settings_values[i] = read_value;
+				}
+				break;
+			
+			case PARAM_BUF_TYPE_IMAGE:
+				if (get_prop_image_params(IMAGE_PROP_LEVEL_TNR + i, &read_value) != IR_SUCCESS) {
+					ESP_LOGE(TAG, "Get Image Param %d failed", i);
+					return false;
+				} else {
+					image_settings_values[i] = read_value;
+				}
+				break;
+			
+			default:
+				if (get_prop_tpd_params(TPD_PROP_DISTANCE + i, &read_value) != IR_SUCCESS) {
+					ESP_LOGE(TAG, "Get TPD Param %d failed", i);
+					return false;
+				} else {
+					tpd_settings_values[i] = read_value;
+				}
+		}
+	}
+	
+	return true;
+}
+
+
+// Get the power-on parameters from the cache if it is valid for this module, otherwise
+// read them from the Tiny1C and update the cache
+static bool _t1c_load_pon_params()
+{
+	param_pon_cache_t cache;
+	uint32_t signature;
+	
+	signature = _t1c_checksum(t1c_sn_buf, strlen(t1c_sn_buf), 0);
+	signature = _t1c_checksum(t1c_version_buf, strlen(t1c_version_buf), signature);
+	
+	if (ps_get_cache(PARAM_PON_CACHE_KEY, &cache, sizeof(cache)) &&
+	    (cache.version == PARAM_PON_CACHE_VERSION) && (cache.signature == signature) &&
+	    (cache.checksum == _t1c_checksum(&cache, offsetof(param_pon_cache_t, checksum), 0))) {
+		memcpy(shutter_settings_values, cache.shutter, sizeof(shutter_settings_values));
+		memcpy(image_settings_values, cache.image, sizeof(image_settings_values));
+		memcpy(tpd_settings_values, cache.tpd, sizeof(tpd_settings_values));
+		ESP_LOGI(TAG, "Using cached power-on parameters");
+		return true;
+	}
+	
+	if (!_t1c_read_params(PARAM_BUF_TYPE_SHUTTER)) return false;
+	if (!_t1c_read_params(PARAM_BUF_TYPE_IMAGE)) return false;
+	if (!_t1c_read_params(PARAM_BUF_TYPE_TPD)) return false;
+	
+	memset(&cache, 0, sizeof(cache));
+	cache.version = PARAM_PON_CACHE_VERSION;
+	cache.signature = signature;
+	memcpy(cache.shutter, shutter_settings_values, sizeof(shutter_settings_values));
+	memcpy(cache.image, image_settings_values, sizeof(image_settings_values));
+	memcpy(cache.tpd, tpd_settings_values, sizeof(tpd_settings_values));
+	cache.checksum = _t1c_checksum(&cache, offsetof(param_pon_cache_t, checksum), 0);
+	(void) ps_set_cache(PARAM_PON_CACHE_KEY, &cache, sizeof(cache));
+	
+	return true;
+}
+
+
+// FNV-1a hash of len bytes continuing from h (0 to start)
+static uint32_t _t1c_checksum(const void* data, int len, uint32_t h)
+{
+	const uint8_t* p = (const uint8_t*) data;
+	
+	if (h == 0) h = 2166136261UL;
+	while (len--) {
+		h = (h ^ *p++) * 16777619UL;
+	}
+	
+	return h;
+}
+
+
+// Set a parameter during initialization, skipping the write if the Tiny1C already has
+// the value
+static bool _t1c_init_param(int type, int param, uint16_t value)
+{
+	uint16_t* valP;
+	ir_error_t ret;
+	
+	switch (type) {
+		case PARAM_BUF_TYPE_SHUTTER:
+			valP = &shutter_settings_values[param];
+			break;
+		case PARAM_BUF_TYPE_IMAGE:
+			valP = &image_settings_values[param];
+			break;
+		default:
+			valP = &tpd_settings_values[param];
+	}
+	
+	if (*valP == value) {
+		return true;
+	}
+	
+	switch (type) {
+		case PARAM_BUF_TYPE_SHUTTER:
+			ret = set_prop_auto_shutter_params((enum prop_auto_shutter_params) param, value);
+			break;
+		case PARAM_BUF_TYPE_IMAGE:
+			ret = set_prop_image_params((enum prop_image_params) param, value);
+			break;
+		default:
+			ret = set_prop_tpd_params((enum prop_tpd_params) param, value);
+	}
+	if (ret != IR_SUCCESS) {
+		return false;
+	}
+	*valP = value;
+	
+	return true;
+}
+
+
+static bool _set_y16_mode(enum y16_isp_stream_src_types n)
+{
+	if (y16_preview_start(PREVIEW_PATH0, n) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "y16_preview_start failed");
+		return false;
+	}
+
+  if ((n == Y16_MODE_TEMPERATURE) || (n == Y16_MODE_GAMMA)) {
+    // Data does not need to be inverted for RAD (TEMP) or GAMMA modes
+    invert_y16_data = false;
+  } else {
+    // Data needs to be inverted for all other modes
+    invert_y16_data = true;
+  }
+  
+  return true;
+}
+
+
+static void _init_frame_pool()
+{
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		y16_pool_refs[i] = 0;
+	}
+	_frame_pool_ref(out_t1c_buffer[0].img_data);
+	_frame_pool_ref(out_t1c_buffer[1].img_data);
+	_frame_pool_ref(file_t1c_buffer.img_data);
+#ifdef CONFIG_AUX_UART_ENABLE
+	_frame_pool_ref(aux_t1c_buffer.img_data);
+#endif
+}
+
+
+static int _frame_pool_get()
+{
+	// There is always at least one free plane since the pool has one more entry than the
+	// number of buffers that can hold a reference between frames
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		if (y16_pool_refs[i] == 0) {
+			y16_pool_refs[i] = 1;
+			return i;
+		}
+	}
+	
+	ESP_LOGE(TAG, "No free image plane");
+	return 0;
+}
+
+
+static void _frame_pool_ref(uint16_t* planeP)
+{
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		if (t1c_y16_pool[i] == planeP) {
+			y16_pool_refs[i] += 1;
+			return;
+		}
+	}
+}
+
+
+static void _frame_pool_release(uint16_t* planeP)
+{
+	for (int i=0; i<T1C_Y16_POOL_LEN; i++) {
+		if (t1c_y16_pool[i] == planeP) {
+			if (y16_pool_refs[i] != 0) y16_pool_refs[i] -= 1;
+			return;
+		}
+	}
+}
+
+
+/**
+ * Read the dummy and header data that start a frame.  Returns false, after noting the
+ * error, if the frame is corrupt and should be skipped (its rows aren't read).
+ */
+static bool _get_frame_header()
+{
+	uint8_t* hdrP;
+	uint16_t index;
+	uint16_t delta;
+	bool valid;
+	
+	vospi_TxBuf[0]= 0xAA;
+	spi_trans.length = VOSPI_TX_DUMMY_LEN*8;
+	spi_trans.rxlength = spi_trans.length;
+	spi_trans.rx_buffer = vospi_RxBuf1;
+	(void) spi_device_polling_transmit(spi, &spi_trans);
+	
+	hdrP = &vospi_RxBuf1[VOSPI_HEADER_OFFSET];
+	index = *(hdrP + HEADER_FRAME_INDEX_L) | (*(hdrP + HEADER_FRAME_INDEX_H) << 8);
+	valid = !vospi_check_valid || (*(hdrP + HEADER_FRAME_VALID) != 0);
+	if (valid && frame_index_valid) {
+		// Modulo 16-bits.  The same frame may be read twice when the timer runs ahead of
+		// the Tiny1C.
+		delta = index - frame_index;
+		valid = (delta <= VOSPI_MAX_INDEX_STEP);
+	}
+	if (!valid) {
+		_vospi_bad_frame();
+		return false;
+	}
+	
+	// Parse some header data
+	frame_high_gain = *(hdrP + HEADER_GAIN_STATE) == 0 ? false : true;
+	frame_pix_freeze = *(hdrP + HEADER_FREEZE_STATE) == 0 ? false : true;
+	frame_usec = esp_timer_get_time();
+	_update_frame_index(index);
+	
+	vospi_consec_bad = 0;
+	if (vospi_err_level > 0) vospi_err_level -= 1;
+	
+	return true;
+}
+
+
+/**
+ * Account for a corrupt frame and fall back to the standard VOSPI clock if they are too
+ * frequent at a faster clock
+ */
+static void _vospi_bad_frame()
+{
+	vospi_bad_frames += 1;
+	vospi_consec_bad += 1;
+	
+	// The next frame's index can't be checked against one we didn't trust
+	frame_index_valid = false;
+	
+	if (spi_freq_hz > T1C_SPI_FREQ_HZ) {
+		vospi_err_level += VOSPI_ERR_WEIGHT;
+		if (vospi_err_level >= VOSPI_ERR_FALLBACK) {
+			ESP_LOGE(TAG, "Corrupt frames at %d kHz - VOSPI clock falling back to %d kHz",
+				spi_freq_hz / 1000, T1C_SPI_FREQ_HZ / 1000);
+			if (!_t1c_set_spi_freq(T1C_SPI_FREQ_HZ)) {
+				ESP_LOGE(TAG, "Could not change VOSPI clock");
+				(void) _t1c_set_spi_freq(T1C_SPI_FAST_FREQ_HZ);
+			}
+			vospi_err_level = 0;
+			vospi_consec_bad = 0;
+		}
+	} else if (vospi_check_valid && (vospi_consec_bad >= VOSPI_MAX_CONSEC_BAD)) {
+		ESP_LOGE(TAG, "VOSPI frame valid flag not being set - ignoring it");
+		vospi_check_valid = false;
+	}
+}
+
+
+static void _get_frame()
+{
+	int row = 0;
+	uint16_t* bufP;
+	uint16_t* lineP;
+	bool hash;
+#ifdef VOSPI_QUEUED_ACQ
+	int queued_rows = 0;
+	spi_transaction_t* transP;
+#endif
+	
+	void (*process_line)(uint16_t* src, uint16_t* dst, int len);
+	
+	// Setup histogram binning from the previous frame's range before resetting it
+	_setup_y16_hist();
+	
+	y16_min = 0xFFFF;
+	y16_max = 0;
+	y16_minP = cur_y16P;
+	y16_maxP = cur_y16P;
+	
+	// Select the row kernel once per frame instead of testing for inversion or filtering on
+	// each pixel
+	if (_setup_tnr(invert_y16_data)) {
+		process_line = chg_active ? _process_y16_line_tnr_chg : _process_y16_line_tnr;
+	} else {
+		process_line = invert_y16_data ? _process_y16_line_inv : _process_y16_line;
+	}
+	hash = _setup_frame_hash();
+	dpc_correct_next = 0;
+	
+#ifdef VOSPI_QUEUED_ACQ
+	// Read a frame into the image buffer using DMA transactions queued to the SPI driver.
+	// The task blocks (instead of spinning) while rows are transferred, letting other tasks
+	// run, and keeps VOSPI_NUM_TRANS rows in flight so the bus never idles while we process
+	// a completed row.
+	bufP = cur_y16P;
+	vospi_TxBuf[0]= 0x55;
+	while ((queued_rows < VOSPI_NUM_TRANS) && (queued_rows < T1C_HEIGHT)) {
+		if (spi_device_queue_trans(spi, &spi_row_trans[queued_rows], portMAX_DELAY) != ESP_OK) {
+			break;
+		}
+		queued_rows += 1;
+	}
+	while (row < queued_rows) {
+		// Wait for the oldest transfer (completed in order)
+		if (spi_device_get_trans_result(spi, &transP, portMAX_DELAY) != ESP_OK) {
+			break;
+		}
+		
+		// Copy the SPI buffer to the image buffer and update min/max and the histogram
+		lineP = (uint16_t*) transP->rx_buffer;
+		if (dpc_correct) _dpc_correct_line(lineP, row);
+		process_line(lineP, bufP, T1C_WIDTH);
+		if (hash) _hash_y16_line(bufP);
+		bufP += T1C_WIDTH;
+		row += 1;
+		
+		// Re-use the transaction for the next row still to be read
+		if (queued_rows < T1C_HEIGHT) {
+			if (spi_device_queue_trans(spi, transP, portMAX_DELAY) == ESP_OK) {
+				queued_rows += 1;
+			}
+		}
+	}
+#else
+    // Read a frame into the image buffer
+    bufP = cur_y16P;
+    vospi_TxBuf[0]= 0x55;
+    spi_trans.length = VOSPI_ROW_LEN*8;
+    spi_trans.rxlength = spi_trans.length;
+    spi_trans.rx_buffer = ((row % 2) == 0) ? vospi_RxBuf1 : vospi_RxBuf2;
+    (void) spi_device_polling_start(spi, &spi_trans, portMAX_DELAY);  // Prime pipeline
+    while (row<T1C_HEIGHT) {
+    	// Wait for previous transfer
+		(void) spi_device_polling_end(spi, portMAX_DELAY);
+		
+		if (row < (T1C_HEIGHT-1)) {
+			// Start next transfer on all but last row
+			spi_trans.rx_buffer = (((row+1) % 2) == 0) ? vospi_RxBuf1 : vospi_RxBuf2;
+			(void) spi_device_polling_start(spi, &spi_trans, portMAX_DELAY);
+		}
+		
+		// Copy the SPI buffer to the image buffer and update min/max and the histogram
+		lineP = (uint16_t*) (((row % 2) == 0) ? vospi_RxBuf1 : vospi_RxBuf2);
+		if (dpc_correct) _dpc_correct_line(lineP, row);
+		process_line(lineP, bufP, T1C_WIDTH);
+		if (hash) _hash_y16_line(bufP);
+		bufP += T1C_WIDTH;
+		row += 1;
+    }
+#endif
+}
+
+
+/**
+ * Get the current replay frame in place of a frame from the Tiny1C.  It is processed like
+ * the rows read over VOSPI (without the inversion, which was done when it was recorded).
+ */
+static void _get_replay_frame()
+{
+	int row;
+	uint16_t* srcP;
+	uint16_t* dstP = cur_y16P;
+	void (*process_line)(uint16_t* src, uint16_t* dst, int len);
+	
+	// Take a newly loaded frame and let the loader fill the other entry
+	portENTER_CRITICAL(&replay_mux);
+	if (replay_loaded) {
+		replay_loaded = false;
+		replay_valid = true;
+		replay_high_gain = replay_load_high_gain;
+		replay_load_index = (replay_load_index == 0) ? 1 : 0;
+	}
+	portEXIT_CRITICAL(&replay_mux);
+	
+	if (!replay_valid) {
+		// Nothing to replay yet (a corrupt frame is used rather than leaving the plane empty)
+		(void) _get_frame_header();
+		_get_frame();
+		return;
+	}
+	
+	_setup_y16_hist();
+	
+	y16_min = 0xFFFF;
+	y16_max = 0;
+	y16_minP = cur_y16P;
+	y16_maxP = cur_y16P;
+	
+	frame_high_gain = replay_high_gain;
+	frame_pix_freeze = false;
+	frame_usec = esp_timer_get_time();
+	_update_frame_index(frame_index + 1);
+	
+	if (_setup_tnr(false)) {
+		process_line = chg_active ? _process_y16_line_tnr_chg : _process_y16_line_tnr;
+	} else {
+		process_line = _process_y16_line;
+	}
+	(void) _setup_frame_hash();
+	
+	srcP = t1c_replay_buffer[(replay_load_index == 0) ? 1 : 0];
+	for (row=0; row<T1C_HEIGHT; row++) {
+		process_line(srcP, dstP, T1C_WIDTH);
+		_hash_y16_line(dstP);
+		srcP += T1C_WIDTH;
+		dstP += T1C_WIDTH;
+	}
+}
+
+
+/**
+ * Start the hash for the frame being read (after its header has been parsed).  Returns
+ * false if the frame is frozen and keeps the previous hash.
+ */
+static bool _setup_frame_hash()
+{
+	bool keep = frame_pix_freeze && frame_hash_frozen;
+	
+	frame_hash_frozen = frame_pix_freeze;
+	if (!keep) {
+		frame_hash = 2166136261UL;
+	}
+	
+	return !keep;
+}
+
+
+// Add a processed row (still in the cache) to the frame hash, two pixels at a time
+static void _hash_y16_line(uint16_t* line)
+{
+	uint32_t* wP = (uint32_t*) line;
+	uint32_t h = frame_hash;
+	int n = T1C_WIDTH / 2;
+	
+	while (n--) {
+		h = (h ^ *wP++) * 16777619UL;
+	}
+	frame_hash = h;
+}
+
+
+static void _setup_y16_hist()
+{
+	uint32_t range;
+	
+	// Size bins so the previous frame's range fits in the histogram (the scene changes slowly
+	// enough that this is a good estimate for the current frame)
+	if (y16_max > y16_min) {
+		y16_hist_base = y16_min;
+		range = y16_max - y16_min;
+		y16_hist_shift = 0;
+		while ((range >> y16_hist_shift) >= Y16_HIST_BINS) {
+			y16_hist_shift++;
+		}
+	} else {
+		y16_hist_base = 0;
+		y16_hist_shift = 8;
+	}
+	
+	memset(y16_hist, 0, sizeof(y16_hist));
+}
+
+
+/**
+ * Reduce the histogram the row kernels built for this frame and sample the profile along
+ * ROI line 0.  Neither looks at more than a line of pixels.
+ */
+static void _eval_img_stats()
+{
+	const int n = 1 << IMG_STATS_HIST_SHIFT;
+	const uint16_t* hP = y16_hist;
+	uint32_t sum;
+	int i, j;
+	
+	for (i=0; i<T1C_IMG_STATS_HIST_BINS; i++) {
+		sum = 0;
+		for (j=0; j<n; j++) {
+			sum += *hP++;
+		}
+		img_stats.hist[i] = (uint16_t) sum;
+	}
+	img_stats.hist_base = y16_hist_base;
+	img_stats.hist_shift = (uint8_t) (y16_hist_shift + IMG_STATS_HIST_SHIFT);
+	
+	if (roi_table.num_lines > 0) {
+		img_stats.profile_len = t1c_rad_line_profile(cur_y16P, &roi_table.line_points[0], img_stats.profile, T1C_IMG_STATS_PROFILE_MAX);
+	} else {
+		img_stats.profile_len = 0;
+	}
+}
+
+
+// Row kernels: single pass over a row, still in the internal RAM DMA buffer, that copies it
+// to the image buffer while computing min/max (and where they are) and the histogram.
+// Separate versions for inverted and non-inverted data keep the inner loop free of the
+// inversion test.
+static void _process_y16_line(uint16_t* src, uint16_t* dst, int len)
+{
+	uint16_t v;
+	uint16_t min = y16_min;
+	uint16_t max = y16_max;
+	uint16_t* minP = y16_minP;
+	uint16_t* maxP = y16_maxP;
+	uint16_t base = y16_hist_base;
+	int shift = y16_hist_shift;
+	uint32_t bin;
+	
+	while (len--) {
+		v = *src++;
+		if (v < min) {
+			min = v;
+			minP = dst;
+		}
+		if (v > max) {
+			max = v;
+			maxP = dst;
+		}
+		bin = (v > base) ? ((uint32_t) (v - base) >> shift) : 0;
+		if (bin >= Y16_HIST_BINS) bin = Y16_HIST_BINS - 1;
+		y16_hist[bin]++;
+		*dst++ = v;
+	}
+	
+	y16_min = min;
+	y16_max = max;
+	y16_minP = minP;
+	y16_maxP = maxP;
+}
+
+
+static void _process_y16_line_inv(uint16_t* src, uint16_t* dst, int len)
+{
+	uint16_t v;
+	uint16_t min = y16_min;
+	uint16_t max = y16_max;
+	uint16_t* minP = y16_minP;
+	uint16_t* maxP = y16_maxP;
+	uint16_t base = y16_hist_base;
+	int shift = y16_hist_shift;
+	uint32_t bin;
+	
+	while (len--) {
+		v = ~(*src++);
+		if (v < min) {
+			min = v;
+			minP = dst;
+		}
+		if (v > max) {
+			max = v;
+			maxP = dst;
+		}
+		bin = (v > base) ? ((uint32_t) (v - base) >> shift) : 0;
+		if (bin >= Y16_HIST_BINS) bin = Y16_HIST_BINS - 1;
+		y16_hist[bin]++;
+		*dst++ = v;
+	}
+	
+	y16_min = min;
+	y16_max = max;
+	y16_minP = minP;
+	y16_maxP = maxP;
+}
+
+
+// Temporal noise reduction row kernel.  Fuses the recursive filter into the single pass
+// over the row: h += w * (v - h) where the weight w of the incoming pixel v rises from
+// tnr_w_min/16 for small differences (noise) to 1 for differences of T1C_TNR_MOTION_THRESH
+// or more (motion or a scene change) so moving objects don't leave trails.  The filtered
+// value is stored in both the image buffer and the history and is used for min/max and the
+// histogram.
+static void _process_y16_line_tnr(uint16_t* src, uint16_t* dst, int len)
+{
+	uint16_t v;
+	uint16_t* hist = t1c_tnr_history + (dst - cur_y16P);
+	uint16_t xor = tnr_xor;
+	uint16_t min = y16_min;
+	uint16_t max = y16_max;
+	uint16_t* minP = y16_minP;
+	uint16_t* maxP = y16_maxP;
+	uint16_t base = y16_hist_base;
+	int shift = y16_hist_shift;
+	int w_min = tnr_w_min;
+	int32_t d, ad;
+	uint32_t bin;
+	
+	while (len--) {
+		v = *src++ ^ xor;
+		d = (int32_t) v - (int32_t) *hist;
+		ad = (d < 0) ? -d : d;
+		if (ad < T1C_TNR_MOTION_THRESH) {
+			d = (d * (w_min + ((ad * (16 - w_min)) >> T1C_TNR_MOTION_SHIFT))) >> 4;
+			v = *hist + d;
+		}
+		*hist++ = v;
+		if (v < min) {
+			min = v;
+			minP = dst;
+		}
+		if (v > max) {
+			max = v;
+			maxP = dst;
+		}
+		bin = (v > base) ? ((uint32_t) (v - base) >> shift) : 0;
+		if (bin >= Y16_HIST_BINS) bin = Y16_HIST_BINS - 1;
+		y16_hist[bin]++;
+		*dst++ = v;
+	}
+	
+	y16_min = min;
+	y16_max = max;
+	y16_minP = minP;
+	y16_maxP = maxP;
+}
+
+
+// Temporal noise reduction kernel with change detection.  Each filtered pixel is compared
+// with its background and a bit is set in the frame's mask (cur_chgP) if it has changed.
+// The background is updated in the same pass.
+static void _process_y16_line_tnr_chg(uint16_t* src, uint16_t* dst, int len)
+{
+	uint16_t v;
+	uint16_t* hist = t1c_tnr_history + (dst - cur_y16P);
+	uint16_t* bg = t1c_chg_background + (dst - cur_y16P);
+	uint32_t* maskP = cur_chgP + ((dst - cur_y16P) >> 5);
+	uint32_t bits = 0;
+	uint16_t xor = tnr_xor;
+	uint16_t min = y16_min;
+	uint16_t max = y16_max;
+	uint16_t* minP = y16_minP;
+	uint16_t* maxP = y16_maxP;
+	uint16_t base = y16_hist_base;
+	int shift = y16_hist_shift;
+	int w_min = tnr_w_min;
+	int32_t lo = chg_lo;
+	int32_t hi = chg_hi;
+	bool load = chg_bg_load;
+	bool update = chg_bg_update;
+	int n = 0;
+	int32_t d, ad;
+	uint32_t bin;
+	
+	while (len--) {
+		v = *src++ ^ xor;
+		d = (int32_t) v - (int32_t) *hist;
+		ad = (d < 0) ? -d : d;
+		if (ad < T1C_TNR_MOTION_THRESH) {
+			d = (d * (w_min + ((ad * (16 - w_min)) >> T1C_TNR_MOTION_SHIFT))) >> 4;
+			v = *hist + d;
+		}
+		*hist++ = v;
+		
+		// Compare with and update the background (the first pixel ends up in bit 0)
+		if (load) {
+			*bg = v;
+		}
+		d = (int32_t) v - (int32_t) *bg;
+		bits >>= 1;
+		if ((d < lo) || (d > hi)) {
+			bits |= 0x80000000;
+		}
+		if (update) {
+			if (d > 0) {
+				*bg += 1;
+			} else if (d < 0) {
+				*bg -= 1;
+			}
+		}
+		bg++;
+		if (++n == 32) {
+			*maskP++ = bits;
+			n = 0;
+		}
+		
+		if (v < min) {
+			min = v;
+			minP = dst;
+		}
+		if (v > max) {
+			max = v;
+			maxP = dst;
+		}
+		bin = (v > base) ? ((uint32_t) (v - base) >> shift) : 0;
+		if (bin >= Y16_HIST_BINS) bin = Y16_HIST_BINS - 1;
+		y16_hist[bin]++;
+		*dst++ = v;
+	}
+	
+	y16_min = min;
+	y16_max = max;
+	y16_minP = minP;
+	y16_maxP = maxP;
+}
+
+
+// Setup the temporal noise reduction filter for the current frame.  Returns true if the
+// filter kernel should be used (which is also the case when only change detection is
+// enabled).  The first frame after a level, source or gain change loads the history (with
+// a weight of 1) so stale data is never blended in.
+static bool _setup_tnr(bool invert)
+{
+	if (tnr_level == T1C_TNR_OFF) {
+		tnr_hist_valid = false;
+		if (!_setup_chg(invert)) {
+			return false;
+		}
+		
+		// Pass pixels through the filter
+		tnr_w_min = 16;
+		tnr_xor = invert ? 0xFFFF : 0;
+		return true;
+	}
+	
+	if (!tnr_hist_valid || (tnr_hist_high_gain != frame_high_gain) ||
+	    (tnr_hist_source != replay_source) || (tnr_hist_level != tnr_level)) {
+		
+		tnr_hist_valid = true;
+		tnr_hist_high_gain = frame_high_gain;
+		tnr_hist_source = replay_source;
+		tnr_hist_level = tnr_level;
+		tnr_w_min = 16;
+	} else {
+		tnr_w_min = tnr_level_w_min[tnr_level];
+	}
+	tnr_xor = invert ? 0xFFFF : 0;
+	(void) _setup_chg(invert);
+	
+	return true;
+}
+
+
+// Setup change detection for the current frame.  Returns true if it is enabled.  Its mask
+// is invalid for the first frame after the background is (re)loaded.
+static bool _setup_chg(bool invert)
+{
+	bool warmer, cooler;
+	
+	if (chg_mode == T1C_CHG_OFF) {
+		chg_active = false;
+		chg_frame_valid = false;
+		chg_bg_valid = false;
+		return false;
+	}
+	
+	if (!chg_bg_valid || (chg_bg_high_gain != frame_high_gain) ||
+	    (chg_bg_source != replay_source) || (chg_bg_invert != invert)) {
+		
+		chg_bg_valid = true;
+		chg_bg_high_gain = frame_high_gain;
+		chg_bg_source = replay_source;
+		chg_bg_invert = invert;
+		chg_bg_load = true;
+	} else {
+		chg_bg_load = false;
+	}
+	chg_bg_update = (++chg_bg_count % CHG_BG_PERIOD) == 0;
+	
+	// Inverted data is cooler when it increases
+	warmer = (chg_mode == (invert ? T1C_CHG_COOLER : T1C_CHG_WARMER));
+	cooler = (chg_mode == (invert ? T1C_CHG_WARMER : T1C_CHG_COOLER));
+	chg_lo = warmer ? INT32_MIN : -((int32_t) chg_thresh);
+	chg_hi = cooler ? INT32_MAX : (int32_t) chg_thresh;
+	
+	chg_active = true;
+	chg_frame_valid = !chg_bg_load;
+	
+	return true;
+}
+
+
+static void _update_frame_index(uint16_t index)
+{
+	uint16_t delta;
+	
+	// Count gaps in the Tiny1C frame index (modulo 16-bits)
+	if (frame_index_valid) {
+		delta = index - frame_index;
+		if (delta > 1) {
+			frame_sensor_skipped += delta - 1;
+		}
+	}
+	frame_index = index;
+	frame_index_valid = true;
+}
+
+
+static void _scale_y8()
+{
+	uint16_t min, max;
+	t1c_agc_linear_t agc;
+	static t1c_agc_hist_eq_t agc_he;   // Static to keep the LUT off the stack
+	
+	// Linear modes scale over the smoothed range so pixels outside it must be clamped
+	switch (agc_mode) {
+		case T1C_AGC_MODE_PERCENTILE:
+			// Range excluding outlying pixels
+			t1c_agc_percentile_range(y16_hist, y16_hist_base, y16_hist_shift, &min, &max);
+			_update_agc_range(min, max);
+			t1c_agc_setup_linear(&agc, agc_min, agc_max, true, false);
+			t1c_agc_scale_linear(&agc, cur_y16P, cur_y8P, T1C_WIDTH*T1C_HEIGHT);
+			break;
+		
+		case T1C_AGC_MODE_HIST_EQ:
+			// Mapping is rebuilt from each frame's histogram
+			_update_agc_range(y16_min, y16_max);
+			agc_seq++;
+			t1c_agc_setup_hist_eq(&agc_he, y16_hist, y16_hist_base, y16_hist_shift, false);
+			t1c_agc_scale_hist_eq(&agc_he, cur_y16P, cur_y8P, T1C_WIDTH*T1C_HEIGHT);
+			break;
+		
+		default:
+			_update_agc_range(y16_min, y16_max);
+			t1c_agc_setup_linear(&agc, agc_min, agc_max, true, false);
+			t1c_agc_scale_linear(&agc, cur_y16P, cur_y8P, T1C_WIDTH*T1C_HEIGHT);
+	}
+}
+
+
+static void _update_agc_range(uint16_t min, uint16_t max)
+{
+	int32_t new_min, new_max;
+	int32_t deadband;
+	
+	// Restart the filter when the gain changes since the range jumps
+	if (!agc_range_valid || (agc_range_high_gain != frame_high_gain)) {
+		agc_range_valid = true;
+		agc_range_high_gain = frame_high_gain;
+		agc_min_fp = (int32_t) min << AGC_SMOOTH_FRAC_BITS;
+		agc_max_fp = (int32_t) max << AGC_SMOOTH_FRAC_BITS;
+		agc_min = min;
+		agc_max = max;
+		agc_seq++;
+		return;
+	}
+	
+	agc_min_fp += (int32_t) ((((int64_t) min << AGC_SMOOTH_FRAC_BITS) - agc_min_fp) * AGC_SMOOTH_ALPHA >> AGC_SMOOTH_FRAC_BITS);
+	agc_max_fp += (int32_t) ((((int64_t) max << AGC_SMOOTH_FRAC_BITS) - agc_max_fp) * AGC_SMOOTH_ALPHA >> AGC_SMOOTH_FRAC_BITS);
+	new_min = (agc_min_fp + (1 << (AGC_SMOOTH_FRAC_BITS-1))) >> AGC_SMOOTH_FRAC_BITS;
+	new_max = (agc_max_fp + (1 << (AGC_SMOOTH_FRAC_BITS-1))) >> AGC_SMOOTH_FRAC_BITS;
+	
+	// Only publish movements larger than one Y8 output level
+	deadband = ((int32_t) agc_max - (int32_t) agc_min) >> 8;
+	if ((abs(new_min - (int32_t) agc_min) > deadband) || (abs(new_max - (int32_t) agc_max) > deadband)) {
+		agc_min = (uint16_t) new_min;
+		agc_max = (uint16_t) new_max;
+		agc_seq++;
+	}
+}
+
+
+/**
+ * Hand the current frame to a consumer buffer.  Returns false if the buffer couldn't be
+ * locked within wait ticks.
+ */
+static bool _push_frame(t1c_buffer_t* buf, TickType_t wait)
+{
+	// Lock data structure
+	if (xSemaphoreTake(buf->mutex, wait) != pdTRUE) {
+		return false;
+	}
+	
+	_copy_frame_info(buf);
+	
+	// Hand off the image data by swapping in the plane we just read (the buffer's previous
+	// plane returns to the pool once nothing else references it)
+	if (buf->img_data != cur_y16P) {
+		_frame_pool_release(buf->img_data);
+		_frame_pool_ref(cur_y16P);
+		buf->img_data = cur_y16P;
+		buf->y8_data = cur_y8P;
+		buf->y8_filt_data = cur_y8fP;
+		buf->chg_mask = cur_chgP;
+	}
+	buf->y8_filt_mask = y8_filt_mask;
+	buf->chg_valid = chg_frame_valid;
+	
+	// Unlock data structure
+	xSemaphoreGive(buf->mutex);
+	
+	return true;
+}
+
+
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+/**
+ * Hand the current frame's header info and measurements, without the image data, to a
+ * consumer buffer.  Returns false if the buffer is locked.
+ */
+static bool _push_frame_info(t1c_buffer_t* buf)
+{
+	if (xSemaphoreTake(buf->mutex, 0) != pdTRUE) {
+		return false;
+	}
+	
+	_copy_frame_info(buf);
+	
+	xSemaphoreGive(buf->mutex);
+	
+	return true;
+}
+#endif
+
+
+/**
+ * Copy the current frame into a burst buffer.  The raw image data is copied since a burst
+ * holds more frames than the pool.  Burst buffers aren't locked because file_task doesn't
+ * read them until the burst is complete.
+ */
+static void _push_burst_frame(t1c_buffer_t* buf)
+{
+	_copy_frame_info(buf);
+	memcpy(buf->img_data, cur_y16P, T1C_WIDTH*T1C_HEIGHT*2);
+}
+
+
+/**
+ * Called after a frame is added to the pre-trigger ring while a synchronized capture is
+ * pending.  When the newest frame was acquired at or after the target time the ring is
+ * searched back for the frame closest to it, which is handed to file_task as a one frame
+ * burst.  The ring is stopped so it isn't overwritten while it is saved.
+ */
+static void _eval_sync_capture()
+{
+	int i;
+	int n;
+	int best;
+	int64_t dt;
+	int64_t best_dt;
+	
+	n = (burst_next == 0) ? FILE_BURST_MAX_FRAMES - 1 : burst_next - 1;
+	if (file_burst_buffer[n].frame_usec < sync_target_usec) return;
+	
+	// Frames are in acquisition order so the distance shrinks and then grows going back
+	best = n;
+	best_dt = file_burst_buffer[n].frame_usec - sync_target_usec;
+	for (i=1; i<burst_ring_count; i++) {
+		if (--n < 0) n = FILE_BURST_MAX_FRAMES - 1;
+		dt = file_burst_buffer[n].frame_usec - sync_target_usec;
+		if (dt < 0) dt = -dt;
+		if (dt >= best_dt) break;
+		best = n;
+		best_dt = dt;
+	}
+	
+	sync_pending = false;
+	burst_first = best;
+	burst_total = 1;
+	burst_ring_en = false;
+	burst_ring_count = 0;
+	_push_metadata();
+	xTaskNotify(task_handle_file, FILE_NOTIFY_T1C_BURST_MASK, eSetBits);
+}
+
+
+/**
+ * Note shutter events and switch the Tiny1C's automatic shutter off while a capture holds
+ * it (only when automatic FFC is enabled).  A hold is released after max_ffc_interval
+ * seconds and isn't reapplied until all the sources have cleared.
+ */
+static void _eval_ffc_hold()
+{
+	bool held;
+	int64_t cur_usec = esp_timer_get_time();
+	
+	if (frame_pix_freeze && !ffc_prev_freeze) {
+		ffc_last_usec = cur_usec;
+	}
+	ffc_prev_freeze = frame_pix_freeze;
+	
+	held = (ffc_hold_mask != 0) || notify_get_file_avg;
+	if (!held) {
+		ffc_hold_expired = false;
+	}
+	
+	if (ffc_hold_active) {
+		if (!held || ((cur_usec - ffc_hold_start_usec) >= ((int64_t) t1c_config.max_ffc_interval * 1000000))) {
+			// Restore the user's setting (the Tiny1C runs the FFC it deferred, if any)
+			if (t1c_set_param_shutter(SHUTTER_PROP_SWITCH, out_state.auto_ffc_en ? 1 : 0)) {
+				ffc_hold_active = false;
+				ffc_hold_expired = held;
+			}
+		}
+	} else if (held && !ffc_hold_expired && out_state.auto_ffc_en) {
+		if (t1c_set_param_shutter(SHUTTER_PROP_SWITCH, 0)) {
+			ffc_hold_active = true;
+			ffc_hold_start_usec = cur_usec;
+		}
+	}
+}
+
+
+/**
+ * Returns true if a pending picture should skip the current frame because a shutter event
+ * has frozen it.  Frames are only skipped for a limited time so the picture can't stall.
+ */
+static bool _ffc_skip_frame()
+{
+	if (frame_pix_freeze && (ffc_skip_count < FFC_SKIP_MAX_FRAMES)) {
+		ffc_skip_count++;
+		return true;
 	}
-	shutter_settings_values[SHUTTER_PROP_MIN_INTERVAL] = param_value;
 	
-	// Set Auto shutter maximum interval
-	param_value = (uint16_t) t1c_config.max_ffc_interval;
-	if (set_prop_auto_shutter_params(SHUTTER_PROP_MAX_INTERVAL, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter max interval failed");
-		return false;
+	return false;
+}
+
+
+/**
+ * Update the min and max marker locations from the current frame.  Frozen frames are
+ * the same as the last one so the markers are left where they are.
+ */
+static void _eval_minmax_track()
+{
+	if (!minmax_en) {
+		minmax_track[0].valid = false;
+		minmax_track[1].valid = false;
+		return;
 	}
-	shutter_settings_values[SHUTTER_PROP_MAX_INTERVAL] = param_value;
 	
-	// Set Auto shutter temp threshold
-	param_value = (uint16_t) (t1c_config.ffc_temp_threshold_x10 * 36 / 10);
-	if (set_prop_auto_shutter_params(SHUTTER_PROP_TEMP_THRESHOLD_B, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter temp threshold failed");
-		return false;
+	if (!frame_pix_freeze) {
+		_track_extreme(&minmax_track[0], y16_maxP, true);
+		_track_extreme(&minmax_track[1], y16_minP, false);
 	}
-	shutter_settings_values[SHUTTER_PROP_TEMP_THRESHOLD_B] = param_value;
+}
+
+
+static void _track_extreme(minmax_track_t* t, uint16_t* peakP, bool is_max)
+{
+	int i, x, y, tx, ty, x1, x2, y1, y2;
+	int32_t hyst, sx, sy, d;
+	uint16_t v, tv;
+	uint16_t* pP;
 	
-	// Set Manual shutter minimum interval
-	param_value = (uint16_t) t1c_config.min_ffc_interval;
-	if (set_prop_auto_shutter_params(SHUTTER_PROP_ANY_INTERVAL, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter any interval failed");
-		return false;
-	}
-	shutter_settings_values[SHUTTER_PROP_ANY_INTERVAL] = param_value;
+	i = peakP - cur_y16P;
+	x = i % T1C_WIDTH;
+	y = i / T1C_WIDTH;
 	
-	// Shutter timing on preview start
-	param_value = T1C_SHUTTER_PREVIEW_1_SECS;
-	if (set_prop_auto_shutter_params(SHUTTER_PREVIEW_START_1ST_DELAY, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter preview 1 failed");
-		return false;
+	// Stay on the feature being followed unless the frame's extreme is clearly beyond it
+	if (t->valid) {
+		x1 = (t->out.x > TRACK_WINDOW) ? (t->out.x - TRACK_WINDOW) : 0;
+		x2 = (t->out.x < (T1C_WIDTH - 1 - TRACK_WINDOW)) ? (t->out.x + TRACK_WINDOW) : (T1C_WIDTH - 1);
+		y1 = (t->out.y > TRACK_WINDOW) ? (t->out.y - TRACK_WINDOW) : 0;
+		y2 = (t->out.y < (T1C_HEIGHT - 1 - TRACK_WINDOW)) ? (t->out.y + TRACK_WINDOW) : (T1C_HEIGHT - 1);
+		tx = t->out.x;
+		ty = t->out.y;
+		tv = cur_y16P[ty*T1C_WIDTH + tx];
+		for (int yy=y1; yy<=y2; yy++) {
+			pP = cur_y16P + yy*T1C_WIDTH;
+			for (int xx=x1; xx<=x2; xx++) {
+				v = pP[xx];
+				if (is_max ? (v > tv) : (v < tv)) {
+					tv = v;
+					tx = xx;
+					ty = yy;
+				}
+			}
+		}
+		
+		hyst = ((int32_t) y16_max - (int32_t) y16_min) >> TRACK_HYST_SHIFT;
+		d = (int32_t) *peakP - (int32_t) tv;
+		if (((d < 0) ? -d : d) <= hyst) {
+			x = tx;
+			y = ty;
+		}
 	}
-	shutter_settings_values[SHUTTER_PREVIEW_START_1ST_DELAY] = param_value;
 	
-	param_value = T1C_SHUTTER_PREVIEW_2_SECS;
-	if (set_prop_auto_shutter_params(SHUTTER_PREVIEW_START_2ND_DELAY, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter preview 2 failed");
-		return false;
+	// Refine the location with a quadratic fit through the neighbors on each axis
+	pP = cur_y16P + y*T1C_WIDTH + x;
+	sx = x << TRACK_FRAC_BITS;
+	sy = y << TRACK_FRAC_BITS;
+	if ((x > 0) && (x < (T1C_WIDTH - 1))) {
+		sx += _track_refine(*(pP - 1), *pP, *(pP + 1));
 	}
-	shutter_settings_values[SHUTTER_PREVIEW_START_2ND_DELAY] = param_value;
-	
-	// Shutter timing on gain change
-	param_value = T1C_SHUTTER_GAIN_CHG_1_SECS;
-	if (set_prop_auto_shutter_params(SHUTTER_CHANGE_GAIN_1ST_DELAY, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter gain 1 failed");
-		return false;
+	if ((y > 0) && (y < (T1C_HEIGHT - 1))) {
+		sy += _track_refine(*(pP - T1C_WIDTH), *pP, *(pP + T1C_WIDTH));
 	}
-	shutter_settings_values[SHUTTER_CHANGE_GAIN_1ST_DELAY] = param_value;
 	
-	param_value = T1C_SHUTTER_GAIN_CHG_2_SECS;
-	if (set_prop_auto_shutter_params(SHUTTER_CHANGE_GAIN_2ND_DELAY, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize auto shutter gain 2 failed");
-		return false;
+	// Smooth small movements and jump to new locations
+	if (!t->valid || (abs(sx - t->x) > (TRACK_SNAP_PIXELS << TRACK_FRAC_BITS)) ||
+	    (abs(sy - t->y) > (TRACK_SNAP_PIXELS << TRACK_FRAC_BITS))) {
+	    
+		t->valid = true;
+		t->x = sx;
+		t->y = sy;
+		t->out.x = (sx + (1 << (TRACK_FRAC_BITS - 1))) >> TRACK_FRAC_BITS;
+		t->out.y = (sy + (1 << (TRACK_FRAC_BITS - 1))) >> TRACK_FRAC_BITS;
+	} else {
+		t->x += ((sx - t->x) * TRACK_SMOOTH_ALPHA) >> TRACK_FRAC_BITS;
+		t->y += ((sy - t->y) * TRACK_SMOOTH_ALPHA) >> TRACK_FRAC_BITS;
+		_track_output(&t->out.x, t->x);
+		_track_output(&t->out.y, t->y);
 	}
-	shutter_settings_values[SHUTTER_CHANGE_GAIN_2ND_DELAY] = param_value;
+}
+
+
+// Offset (TRACK_FRAC_BITS fraction, within +/- 1/2 pixel) of the vertex of the parabola
+// through three adjacent pixels
+static int32_t _track_refine(int32_t fl, int32_t fc, int32_t fr)
+{
+	const int32_t half = 1 << (TRACK_FRAC_BITS - 1);
+	int32_t d = fl - 2*fc + fr;
+	int32_t o;
 	
-	// Set the default brightness
-	param_value = brightness_to_param_value(t1c_config.brightness);
-	if (set_prop_image_params(IMAGE_PROP_LEVEL_BRIGHTNESS, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize brightness failed");
-		return false;
-	}
-	image_settings_values[IMAGE_PROP_LEVEL_BRIGHTNESS] = param_value;
+	if (d == 0) return 0;
 	
-	// Setup the default distance
-	param_value = dist_cm_to_param_value(t1c_config.distance);
-	if (set_prop_tpd_params(TPD_PROP_DISTANCE, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize distance failed");
-		return false;
-	}
-	tpd_settings_values[TPD_PROP_DISTANCE] = param_value;
+	o = ((fl - fr) << TRACK_FRAC_BITS) / (2 * d);
+	if (o > half) o = half;
+	if (o < -half) o = -half;
 	
-	// Set the default emissivity
-	param_value = emissivity_to_param_value(t1c_config.emissivity);
-	if (set_prop_tpd_params(TPD_PROP_EMS, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize emissivity failed");
-		return false;
-	}
-	tpd_settings_values[TPD_PROP_EMS] = param_value;
+	return o;
+}
+
+
+// Move a reported pixel coordinate when the smoothed location is far enough into the next pixel
+static void _track_output(uint16_t* out, int32_t v)
+{
+	const int32_t half = 1 << (TRACK_FRAC_BITS - 1);
+	int32_t d = v - ((int32_t) *out << TRACK_FRAC_BITS);
 	
-	// Set the default atmospheric temp
-	param_value = temperature_to_param_value(t1c_config.atmospheric_temp);
-	if (set_prop_tpd_params(TPD_PROP_TA, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize atmospheric temp failed");
-		return false;
+	if ((d > (half + TRACK_OUT_HYST)) || (d < -(half + TRACK_OUT_HYST))) {
+		*out = (uint16_t) ((v + half) >> TRACK_FRAC_BITS);
 	}
-	tpd_settings_values[TPD_PROP_TA] = param_value;
-	
-	// Set the default reflective temp
-	param_value = temperature_to_param_value(t1c_config.reflected_temp);
-	if (set_prop_tpd_params(TPD_PROP_TU, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize reflective temp failed");
-		return false;
+}
+
+
+/**
+ * Start analyzing frames for dead pixels.  Any points already proposed are discarded (and
+ * no longer corrected so they are found again).  Automatic FFC is held off while frames are
+ * accumulated.
+ */
+static void _start_dpc_detect()
+{
+	if (dpc_status.state == T1C_DPC_ST_APPLY) {
+		ESP_LOGE(TAG, "Dead pixel detection rejected, %s in progress", dpc_job.name);
+		return;
 	}
-	tpd_settings_values[TPD_PROP_TU] = param_value;
 	
-	// Set the default TAU (ignore humidity for now)
-	param_value = estimate_tau((float) t1c_config.atmospheric_temp, (float) t1c_config.distance/100.0, 0.0);
-	if (set_prop_tpd_params(TPD_PROP_TAU, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize TAU failed");
-		return false;
+	ESP_LOGI(TAG, "Start dead pixel detection");
+	dpc_status.state = T1C_DPC_ST_DETECT;
+	dpc_status.progress = 0;
+	dpc_status.num_points = 0;
+	dpc_correct = false;
+	dpc_frames = 0;
+	ffc_hold_mask |= T1C_FFC_HOLD_DPC;
+}
+
+
+/**
+ * Start a job to add the proposed points to the Tiny1C dead pixel table and save it
+ */
+static void _start_dpc_apply()
+{
+	int i;
+	
+	if (((dpc_status.state != T1C_DPC_ST_FOUND) && (dpc_status.state != T1C_DPC_ST_FAILED)) ||
+	    (dpc_status.num_points == 0) || (cci_job != NULL)) {
+	    
+		ESP_LOGE(TAG, "%s rejected", dpc_job.name);
+		return;
 	}
-	tpd_settings_values[TPD_PROP_TAU] = param_value;
 	
-	// Set gain mode
-	param_value = t1c_config.high_gain ? 1 : 0;
-	if (set_prop_tpd_params(TPD_PROP_GAIN_SEL, param_value) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "Initialize gain %u failed", param_value);
-		return false;
+	for (i=0; i<dpc_status.num_points; i++) {
+		dpc_steps[i].req = _cci_job_dpc_add;
+		dpc_steps[i].arg = i;
+		dpc_steps[i].run = CCI_JOB_RUN_OK;
+		dpc_steps[i].timeout_msec = CCI_JOB_CMD_MSEC;
+		dpc_steps[i].name = "add point";
 	}
-	tpd_settings_values[TPD_PROP_GAIN_SEL] = param_value;
+	dpc_steps[i].req = _cci_job_save_cfg;
+	dpc_steps[i].arg = SPI_MOD_CFG_DEAD_PIX;
+	dpc_steps[i].run = CCI_JOB_RUN_OK;
+	dpc_steps[i].timeout_msec = CCI_JOB_CFG_MSEC;
+	dpc_steps[i].name = "save";
+	dpc_job.num_steps = i + 1;
 	
-#ifdef INCLUDE_SHUTTER_DISPLAY
-	_display_shutter_values();
-#endif
-#ifdef INCLUDE_IMAGE_DISPLAY
-	_display_image_values();
-#endif
-#ifdef INCLUDE_TPD_DISPLAY
-	_display_tpd_values();
-#endif
-
-	return true;
+	dpc_status.state = T1C_DPC_ST_APPLY;
+	_cci_start_job(&dpc_job);
 }
 
-static ir_error_t _t1c_restore_default_config()
+
+/**
+ * Accumulate the sum and total frame to frame change of each pixel over the detection
+ * frames and then analyze them a few rows at a time.  Frames frozen by a shutter event are
+ * left out and the detection is restarted if the gain changes.
+ */
+static void _eval_dpc_detect()
 {
-	ir_error_t ret;
-	
-	ESP_LOGI(TAG, "Restore default values");
+	int i;
+	uint16_t* srcP = cur_y16P;
+	uint32_t* accP = t1c_dpc_accum;
+	uint32_t prev, act, d;
+	uint16_t v;
 	
-	// Restore factor default values
-	ret = restore_default_cfg(DEF_CFG_ALL);
-/*	
-	// Save to internal flash
-	if (ret == IR_SUCCESS) {
-		ret = spi_config_save(SPI_MOD_CFG_ALL);
+	if (dpc_frames < T1C_DPC_DETECT_FRAMES) {
+		if (frame_pix_freeze) {
+			dpc_prev_valid = false;
+			return;
+		}
+		
+		if ((dpc_frames == 0) || (dpc_high_gain != frame_high_gain)) {
+			memset(accP, 0, T1C_WIDTH*T1C_HEIGHT*8);
+			dpc_high_gain = frame_high_gain;
+			dpc_prev_valid = false;
+			dpc_frames = 0;
+			dpc_pairs = 0;
+		}
+		
+		// Each pixel has its sum followed by its total change (upper 16 bits) and its
+		// previous value (lower 16 bits)
+		for (i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+			v = *srcP++;
+			accP[0] += v;
+			prev = accP[1] & 0xFFFF;
+			act = accP[1] >> 16;
+			if (dpc_prev_valid) {
+				d = (v > prev) ? (v - prev) : (prev - v);
+				act += (d > DPC_MAX_DIFF) ? DPC_MAX_DIFF : d;
+			}
+			accP[1] = (act << 16) | v;
+			accP += 2;
+		}
+		if (dpc_prev_valid) dpc_pairs++;
+		dpc_prev_valid = true;
+		dpc_frames++;
+		dpc_row = 0;
+	} else {
+		for (i=0; (i<DPC_ANALYZE_ROWS) && (dpc_row<T1C_HEIGHT); i++) {
+			if (!_dpc_analyze_row(dpc_row++)) {
+				ESP_LOGE(TAG, "Dead pixel detection found more than %d points", T1C_DPC_MAX_POINTS);
+				dpc_status.state = T1C_DPC_ST_FAILED;
+				dpc_status.num_points = 0;
+				ffc_hold_mask &= ~T1C_FFC_HOLD_DPC;
+				return;
+			}
+		}
+		
+		if (dpc_row == T1C_HEIGHT) {
+			ESP_LOGI(TAG, "Dead pixel detection found %d points", dpc_status.num_points);
+			dpc_status.state = T1C_DPC_ST_FOUND;
+			dpc_correct = (dpc_status.num_points != 0);
+			ffc_hold_mask &= ~T1C_FFC_HOLD_DPC;
+		}
 	}
-*/	
-	return ret;
+	
+	dpc_status.progress = (100 * (dpc_frames + dpc_row / DPC_ANALYZE_ROWS)) / (T1C_DPC_DETECT_FRAMES + DPC_ANALYZE_FRAMES);
 }
 
 
-static ir_error_t _t1c_perform_cal(int type)
+/**
+ * Compare each pixel in a row with the median of its neighbors and add the ones that
+ * appear dead (or stuck) to the proposed points.  Returns false if there are too many.
+ */
+static bool _dpc_analyze_row(int y)
 {
-	ir_error_t ret = IR_SUCCESS;
-	
-	ESP_LOGI(TAG, "Starting calibration type %d, blackbody temp = %u °K", type, bb_temp_k);
+	int x, dx, dy, n;
+	uint32_t* accP;
+	uint32_t nbr_sum[8];
+	uint32_t nbr_act[8];
+	uint32_t sum, act, med_sum, med_act, dev;
 	
-	// Restore default configuration
-	if ((type == CAL_1_PT) || (type == CAL_2_PT_L)) {
-		ESP_LOGI(TAG, "  restore cfg");
-		ret = restore_default_cfg(DEF_CFG_TPD);
+	for (x=0; x<T1C_WIDTH; x++) {
+		n = 0;
+		for (dy=-1; dy<=1; dy++) {
+			if (((y + dy) < 0) || ((y + dy) >= T1C_HEIGHT)) continue;
+			for (dx=-1; dx<=1; dx++) {
+				if (((dx == 0) && (dy == 0)) || ((x + dx) < 0) || ((x + dx) >= T1C_WIDTH)) continue;
+				accP = &t1c_dpc_accum[2*((y + dy)*T1C_WIDTH + x + dx)];
+				nbr_sum[n] = accP[0];
+				nbr_act[n] = accP[1] >> 16;
+				n++;
+			}
+		}
+		med_sum = _dpc_median(nbr_sum, n);
+		med_act = _dpc_median(nbr_act, n);
+		
+		accP = &t1c_dpc_accum[2*(y*T1C_WIDTH + x)];
+		sum = accP[0];
+		act = accP[1] >> 16;
+		dev = (sum > med_sum) ? (sum - med_sum) : (med_sum - sum);
+		
+		// Sums are over dpc_frames frames and changes over dpc_pairs pairs of frames
+		if ((((uint64_t) dev * dpc_pairs) > (((uint64_t) DPC_DEV_MIN * dpc_pairs + DPC_DEV_NOISE_X * med_act) * dpc_frames)) ||
+		    (((act * DPC_STUCK_RATIO) < med_act) && (med_act >= dpc_pairs))) {
+		    
+			if (dpc_status.num_points == T1C_DPC_MAX_POINTS) {
+				return false;
+			}
+			dpc_status.points[dpc_status.num_points].x = x;
+			dpc_status.points[dpc_status.num_points].y = y;
+			dpc_status.num_points++;
+		}
 	}
 	
-#ifdef INCLUDE_TPD_DISPLAY
-	_display_tpd_values();
-#endif
-	
-	// Prevent main loop TPD updates from occurring between the L and H settings for 2 point cal
-	cal_2pt_in_progress = (type == CAL_2_PT_L);
+	return true;
+}
+
+
+// Median of up to 8 values (upper median for an even number), sorts the values
+static uint32_t _dpc_median(uint32_t* v, int n)
+{
+	int i, j;
+	uint32_t t;
 	
-	// Disable automatic FFC
-	if ((ret == IR_SUCCESS) && ((type == CAL_1_PT) || (type == CAL_2_PT_L))) {
-		ESP_LOGI(TAG, "  shutter 0");
-		ret = set_prop_auto_shutter_params(SHUTTER_PROP_SWITCH, 0);
+	for (i=1; i<n; i++) {
+		t = v[i];
+		for (j=i; (j > 0) && (v[j-1] > t); j--) {
+			v[j] = v[j-1];
+		}
+		v[j] = t;
 	}
 	
-	// Update B value (FFC)
-	if (ret == IR_SUCCESS) {
-		ESP_LOGI(TAG, "  b update");
-		ret = ooc_b_update(B_UPDATE);
+	return v[n/2];
+}
+
+
+/**
+ * Replace the proposed points in a row read from the Tiny1C, before it is processed so
+ * they don't affect min/max or the histogram, with the average of the pixels on either
+ * side.  Points are in row order so only the pixel to the left can already have been
+ * corrected.
+ */
+static void _dpc_correct_line(uint16_t* line, int row)
+{
+	IrPoint_t* pP;
+	bool right_ok;
+	int x;
+	
+	while (dpc_correct_next < dpc_status.num_points) {
+		pP = &dpc_status.points[dpc_correct_next];
+		if (pP->y > row) break;
+		
+		x = pP->x;
+		right_ok = (x < (T1C_WIDTH - 1)) &&
+		           !(((dpc_correct_next + 1) < dpc_status.num_points) && ((pP+1)->y == row) && ((pP+1)->x == (x + 1)));
+		if (x == 0) {
+			line[x] = line[x+1];
+		} else if (right_ok) {
+			line[x] = (uint16_t) (((uint32_t) line[x-1] + line[x+1]) / 2);
+		} else {
+			line[x] = line[x-1];
+		}
+		dpc_correct_next++;
 	}
+}
+
+
+/**
+ * Write the firmware image file_task is reading from the SD card into the Tiny1C.  The
+ * Tiny1C is reset into its update firmware so the image stream stops (this runs in place
+ * of frame processing).  Each buffer is erased, written and verified while file_task reads
+ * the next one.  The tag marking the new firmware valid is written after the last buffer.
+ * The system is always shut down when done since the Tiny1C must be restarted.
+ */
+static void _run_fw_update()
+{
+	fw_upd_buf_t b;
+	uint32_t addr = FW_UPD_FLASH_ADDR;
+	uint32_t end_addr = FW_UPD_FLASH_ADDR + fw_upd_len;
+	bool success = false;
+	
+	ESP_LOGI(TAG, "Tiny1C firmware update (%lu bytes)", fw_upd_len);
+	
+	cci_job_progress_step = 0;
+	cci_job_progress_num_steps = (fw_upd_len + T1C_FW_UPD_BUF_LEN - 1) / T1C_FW_UPD_BUF_LEN;
+	xTaskNotify(output_task, task_ctrl_act_progress_notification, eSetBits);
 	
-	// Collect blackbody data and set new calibration value
-	if (ret == IR_SUCCESS) {
-		ESP_LOGI(TAG, "  recal");
-		if (type == CAL_1_PT) {
-			ret = tpd_ktbt_recal_1point(bb_temp_k);
-		} else if (type == CAL_2_PT_L) {
-			ret = tpd_ktbt_recal_2point(TPD_KTBT_RECAL_P1, bb_temp_k);
-		} else if (type == CAL_2_PT_H) {
-			ret = tpd_ktbt_recal_2point(TPD_KTBT_RECAL_P2, bb_temp_k);
+	if (cci_job != NULL) {
+		ESP_LOGE(TAG, "%s running", cci_job->name);
+	} else if ((sys_reset_to_update_fw() != IR_SUCCESS) || !_fw_upd_wait_ready()) {
+		ESP_LOGE(TAG, "Could not start Tiny1C update firmware");
+	} else {
+		while (addr < end_addr) {
+			if (xQueueReceive(fw_upd_full_queue, &b, pdMS_TO_TICKS(FW_UPD_BUF_WAIT_MSEC)) != pdTRUE) {
+				ESP_LOGE(TAG, "Timed out waiting for firmware data");
+				break;
+			}
+			if ((b.len == 0) || (b.len > (end_addr - addr))) {
+				ESP_LOGE(TAG, "Firmware update aborted");
+				break;
+			}
+			if (!_fw_upd_write(addr, b.buf, b.len)) {
+				break;
+			}
+			addr += b.len;
+			
+			// Let file_task refill the buffer
+			(void) xQueueSend(fw_upd_free_queue, &b, 0);
+			
+			cci_job_progress_step += 1;
+			xTaskNotify(output_task, task_ctrl_act_progress_notification, eSetBits);
 		}
 		
-		// Attempt to restore default values if calibration fails
-		if (ret != IR_SUCCESS) {
-			ESP_LOGI(TAG, "  restore");
-			(void) restore_default_cfg(DEF_CFG_TPD);
+		if (addr == end_addr) {
+			if (spi_write_tag() == IR_SUCCESS) {
+				success = true;
+			} else {
+				ESP_LOGE(TAG, "Could not write firmware tag");
+			}
 		}
 	}
 	
-	// Restart automatic FFC when done (even if failure)
-	if ((ret == IR_SUCCESS) && ((type == CAL_1_PT) || (type == CAL_2_PT_H))) {
-		ESP_LOGI(TAG, "  shutter 1");
-		if (ret == IR_SUCCESS) {
-			ret = set_prop_auto_shutter_params(SHUTTER_PROP_SWITCH, 1);
-		} else {
-			(void) set_prop_auto_shutter_params(SHUTTER_PROP_SWITCH, 1);
-		}
+	// Stops file_task
+	fw_upd_running = false;
+	
+	if (success) {
+		ESP_LOGI(TAG, "Tiny1C firmware update done");
+	} else {
+		ESP_LOGE(TAG, "Tiny1C firmware update failed at 0x%lx", addr);
 	}
+	xTaskNotify(output_task, success ? task_ctrl_act_succeeded_notification : task_ctrl_act_failed_notification, eSetBits);
 	
-	// Save the TPD parameters after a successful cal
-	/*
-	if ((ret == IR_SUCCESS) && ((type == CAL_1_PT) || (type == CAL_2_PT_H))) {
-		ESP_LOGI(TAG, "  save");
-		ret = spi_config_save(SPI_MOD_CFG_ALL);
-	}*/
+	// Delay to let the GUI display the result
+	vTaskDelay(pdMS_TO_TICKS(RESTORE_SHUTDOWN_MSEC));
 	
-	return ret;
+	xTaskNotify(platform_task, task_shutdown_notification, eSetBits);
 }
 
 
-static bool _t1c_init_param_buffer()
+// Wait for the Tiny1C to start running its update firmware after being reset
+static bool _fw_upd_wait_ready()
 {
-	param_buf_handle = xRingbufferCreate(PARAM_BUFFER_LEN, RINGBUF_TYPE_NOSPLIT);
+	int64_t reset_usec = esp_timer_get_time();
+	uint8_t status;
 	
-	param_mutex = xSemaphoreCreateMutex();
+	vTaskDelay(pdMS_TO_TICKS(T1C_BOOT_MIN_MSEC));
 	
-	return (param_buf_handle != NULL) && (param_mutex != NULL);
+	for (;;) {
+		// Read the status directly to avoid error logging while it doesn't respond
+		if (HAL_I2C_Mem_Read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, I2C_MEMADD_SIZE_16BIT, &status, 1, 0) == HAL_OK) {
+			if ((status & VCMD_BUSY_STS_BIT) == VCMD_BUSY_STS_IDLE) {
+				return true;
+			}
+		}
+		
+		if ((esp_timer_get_time() - reset_usec) >= ((int64_t) T1C_BOOT_MAX_MSEC * 1000)) {
+			return false;
+		}
+		vTaskDelay(pdMS_TO_TICKS(T1C_BOOT_POLL_MSEC));
+	}
 }
 
 
-static bool _t1c_read_params(int type)
+// Erase the flash sectors for one buffer, write it and then read it back
+static bool _fw_upd_write(uint32_t addr, uint8_t* buf, uint32_t len)
 {
-	int n;
-	uint16_t read_value;
+	uint32_t offset;
+	uint16_t n;
 	
-	switch (type) {
-		case PARAM_BUF_TYPE_SHUTTER:
-			n = PARAM_NUM_TYPE_SHUTTER;
-			break;
-		case PARAM_BUF_TYPE_IMAGE:
-			n =  PARAM_NUM_TYPE_IMAGE;
-			break;
-		default:
-			n = PARAM_NUM_TYPE_TPD;
+	if (spi_erase_sector(addr, (uint16_t) ((len + FW_UPD_SECTOR_LEN - 1) / FW_UPD_SECTOR_LEN)) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "Erase at 0x%lx failed", addr);
+		return false;
 	}
 	
-	for (int i=0; i<n; i++) {
-		switch (type) {
-			case PARAM_BUF_TYPE_SHUTTER:
-				if (get_prop_auto_shutter_params(SHUTTER_PROP_SWITCH + i, &read_value) != IR_SUCCESS) {
-					ESP_LOGE(TAG, "Get Shutter Param %d failed", i);
-					return false;
-				} else {
-					shutter_settings_values[i] = read_value;
-				}
-				break;
-			
-			case PARAM_BUF_TYPE_IMAGE:
-				if (get_prop_image_params(IMAGE_PROP_LEVEL_TNR + i, &read_value) != IR_SUCCESS) {
-					ESP_LOGE(TAG, "Get Image Param %d failed", i);
-					return false;
-				} else {
-					image_settings_values[i] = read_value;
-				}
-				break;
-			
-			default:
-				if (get_prop_tpd_params(TPD_PROP_DISTANCE + i, &read_value) != IR_SUCCESS) {
-					ESP_LOGE(TAG, "Get TPD Param %d failed", i);
-					return false;
-				} else {
-					tpd_settings_values[i] = read_value;
-				}
+	if (spi_write(addr, (uint16_t) len, buf) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "Write at 0x%lx failed", addr);
+		return false;
+	}
+	
+	for (offset=0; offset<len; offset+=n) {
+		n = ((len - offset) < FW_UPD_VERIFY_LEN) ? (uint16_t) (len - offset) : FW_UPD_VERIFY_LEN;
+		if ((spi_read(addr + offset, n, fw_upd_verify_buf) != IR_SUCCESS) ||
+		    (memcmp(fw_upd_verify_buf, buf + offset, n) != 0)) {
+			ESP_LOGE(TAG, "Verify at 0x%lx failed", addr + offset);
+			return false;
 		}
 	}
 	
@@ -951,112 +3732,187 @@ static bool _t1c_read_params(int type)
 }
 
 
-static bool _set_y16_mode(enum y16_isp_stream_src_types n)
+/**
+ * Add the current frame (and its measured temperatures) to the averaged picture.  Returns
+ * true when avg_num frames have been accumulated and the current frame has been replaced
+ * with their average.  The average is restarted if the gain changes since frames taken
+ * at different gains can't be combined.
+ */
+static bool _eval_avg_frame()
 {
-	if (y16_preview_start(PREVIEW_PATH0, n) != IR_SUCCESS) {
-		ESP_LOGE(TAG, "y16_preview_start failed");
-		return false;
+	int i;
+	uint16_t* srcP = cur_y16P;
+	uint32_t* accP = t1c_avg_accum;
+	uint32_t round;
+	uint16_t v;
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	
+	if ((avg_count == 0) || (avg_high_gain != frame_high_gain)) {
+		avg_num = avg_new_num;
+		avg_count = 0;
+		avg_high_gain = frame_high_gain;
+		avg_spot_sum = 0;
+		avg_spot_count = 0;
+		avg_minmax_sum[0] = 0;
+		avg_minmax_sum[1] = 0;
+		avg_minmax_count = 0;
+		avg_region_sum[0] = 0;
+		avg_region_sum[1] = 0;
+		avg_region_sum[2] = 0;
+		avg_region_count = 0;
 	}
-
-  if ((n == Y16_MODE_TEMPERATURE) || (n == Y16_MODE_GAMMA)) {
-    // Data does not need to be inverted for RAD (TEMP) or GAMMA modes
-    invert_y16_data = false;
-  } else {
-    // Data needs to be inverted for all other modes
-    invert_y16_data = true;
-  }
-  
-  return true;
+	
+	if (avg_num <= 1) {
+		// Averaging is off so this frame is the picture
+		notify_get_file_avg = false;
+		return true;
+	}
+	
+	// Accumulate the image, starting with a copy of the first frame
+	if (avg_count == 0) {
+		for (i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+			*accP++ = *srcP++;
+		}
+	} else {
+		for (i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+			*accP++ += *srcP++;
+		}
+	}
+	
+	// Accumulate the temperatures measured for this frame
+	if (spot_valid) {
+		avg_spot_sum += spot_temp_raw;
+		avg_spot_count += 1;
+	}
+	if (minmax_en && minmax_valid) {
+		avg_minmax_sum[0] += max_min_temp_data.max_temp;
+		avg_minmax_sum[1] += max_min_temp_data.min_temp;
+		avg_minmax_count += 1;
+	}
+	if (region_valid) {
+		avg_region_sum[0] += region_temp_info.temp_info_value.ave_temp;
+		avg_region_sum[1] += region_temp_info.temp_info_value.max_temp;
+		avg_region_sum[2] += region_temp_info.temp_info_value.min_temp;
+		avg_region_count += 1;
+	}
+	
+	if (++avg_count < avg_num) {
+		return false;
+	}
+	
+	// Replace the current frame with the rounded average and update its range for scaling
+	round = (uint32_t) avg_num / 2;
+	srcP = cur_y16P;
+	accP = t1c_avg_accum;
+	for (i=0; i<T1C_WIDTH*T1C_HEIGHT; i++) {
+		v = (uint16_t) ((*accP++ + round) / (uint32_t) avg_num);
+		if (v < min) min = v;
+		if (v > max) max = v;
+		*srcP++ = v;
+	}
+	y16_min = min;
+	y16_max = max;
+	
+	ESP_LOGI(TAG, "Averaged %d frames", avg_num);
+	notify_get_file_avg = false;
+	return true;
 }
 
 
-static void _get_frame()
+/**
+ * Replace the temperatures in a buffer just loaded with an averaged picture with their
+ * averages over the frames that had them
+ */
+static void _push_avg_temps(t1c_buffer_t* buf)
 {
-	int row = 0;
-	uint8_t* hdrP;
-	uint16_t* bufP;
-	
-	y16_min = 0xFFFF;
-	y16_max = 0;
-	
-	// Start acquiring frame - read dummy + header data
-	vospi_TxBuf[0]= 0xAA;
-	spi_trans.length = VOSPI_TX_DUMMY_LEN*8;
-	spi_trans.rxlength = spi_trans.length;
-	spi_trans.rx_buffer = vospi_RxBuf1;
-	(void) spi_device_polling_transmit(spi, &spi_trans);
+	xSemaphoreTake(buf->mutex, portMAX_DELAY);
 	
-	// Parse some header data
-	hdrP = &vospi_RxBuf1[VOSPI_HEADER_OFFSET];
-	frame_high_gain = *(hdrP + HEADER_GAIN_STATE) == 0 ? false : true;
-	frame_pix_freeze = *(hdrP + HEADER_FREEZE_STATE) == 0 ? false : true;
+	if (buf->spot_valid && (avg_spot_count != 0)) {
+		buf->spot_temp = (uint16_t) ((avg_spot_sum + avg_spot_count/2) / avg_spot_count);
+	}
+	if (buf->minmax_valid && (avg_minmax_count != 0)) {
+		buf->max_min_temp_info.max_temp = (uint16_t) ((avg_minmax_sum[0] + avg_minmax_count/2) / avg_minmax_count);
+		buf->max_min_temp_info.min_temp = (uint16_t) ((avg_minmax_sum[1] + avg_minmax_count/2) / avg_minmax_count);
+	}
+	if (buf->region_valid && (avg_region_count != 0)) {
+		buf->region_temp_info.temp_info_value.ave_temp = (uint16_t) ((avg_region_sum[0] + avg_region_count/2) / avg_region_count);
+		buf->region_temp_info.temp_info_value.max_temp = (uint16_t) ((avg_region_sum[1] + avg_region_count/2) / avg_region_count);
+		buf->region_temp_info.temp_info_value.min_temp = (uint16_t) ((avg_region_sum[2] + avg_region_count/2) / avg_region_count);
+	}
 	
-    // Read a frame into the image buffer
-    bufP = t1c_y16_buffer;
-    vospi_TxBuf[0]= 0x55;
-    spi_trans.length = VOSPI_ROW_LEN*8;
-    spi_trans.rxlength = spi_trans.length;
-    spi_trans.rx_buffer = ((row % 2) == 0) ? vospi_RxBuf1 : vospi_RxBuf2;
-    (void) spi_device_polling_start(spi, &spi_trans, portMAX_DELAY);  // Prime pipeline
-    while (row<T1C_HEIGHT) {
-    	// Wait for previous transfer
-		(void) spi_device_polling_end(spi, portMAX_DELAY);
-		
-		if (row < (T1C_HEIGHT-1)) {
-			// Start next transfer on all but last row
-			spi_trans.rx_buffer = (((row+1) % 2) == 0) ? vospi_RxBuf1 : vospi_RxBuf2;
-			(void) spi_device_polling_start(spi, &spi_trans, portMAX_DELAY);
-		}
-		
-		// Copy the SPI buffer to the image buffer and update min/max
-		_process_y16_line((uint16_t*) (((row % 2) == 0) ? vospi_RxBuf1 : vospi_RxBuf2), bufP, T1C_WIDTH);
-		bufP += T1C_WIDTH;
-		row += 1;
-    }
+	xSemaphoreGive(buf->mutex);
 }
 
 
-static void _process_y16_line(uint16_t* src, uint16_t* dst, int len)
+/**
+ * Update the scene statistics for the current frame.  Motion is the mean absolute change
+ * in a signature of T1C_MOTION_BLOCK_SIZE square block averages since the previous frame
+ * (using Y16 so it isn't affected by AGC changes).
+ */
+static void _eval_scene_stats()
 {
+	int bx, by, x, y;
+	uint16_t* rowP;
+	uint16_t* sigP = scene_sig;
+	uint32_t acc;
+	uint32_t diff = 0;
 	uint16_t v;
 	
-	while (len--) {
-		v = invert_y16_data ? ~(*src++) : *src++;
-		if (v < y16_min) {
-			y16_min = v;
-		}
-		if (v > y16_max) {
-			y16_max = v;
+	for (by=0; by<T1C_MOTION_BLOCKS_H; by++) {
+		for (bx=0; bx<T1C_MOTION_BLOCKS_W; bx++) {
+			acc = 0;
+			rowP = cur_y16P + (by * T1C_MOTION_BLOCK_SIZE * T1C_WIDTH) + (bx * T1C_MOTION_BLOCK_SIZE);
+			for (y=0; y<T1C_MOTION_BLOCK_SIZE; y++) {
+				for (x=0; x<T1C_MOTION_BLOCK_SIZE; x++) {
+					acc += rowP[x];
+				}
+				rowP += T1C_WIDTH;
+			}
+			v = (uint16_t) (acc / (T1C_MOTION_BLOCK_SIZE * T1C_MOTION_BLOCK_SIZE));
+			diff += (v > *sigP) ? (v - *sigP) : (*sigP - v);
+			*sigP++ = v;
 		}
-		*dst++ = v;
+	}
+	
+	scene_stats.frame_seq = frame_seq;
+	scene_stats.frame_usec = frame_usec;
+	scene_stats.motion = scene_sig_valid ? (uint16_t) (diff / (T1C_MOTION_BLOCKS_W * T1C_MOTION_BLOCKS_H)) : 0;
+	scene_sig_valid = true;
+	
+	if (region_en && region_valid) {
+		scene_stats.temp_valid = true;
+		scene_stats.max_temp = region_temp_info.temp_info_value.max_temp;
+	} else if (minmax_en && minmax_valid) {
+		scene_stats.temp_valid = true;
+		scene_stats.max_temp = max_min_temp_data.max_temp;
+	} else {
+		scene_stats.temp_valid = false;
 	}
 }
 
 
-static void _push_frame(t1c_buffer_t* buf)
+static void _copy_frame_info(t1c_buffer_t* buf)
 {
-	uint16_t* imgP;
-	uint16_t* imgEndP;
-	uint16_t* frameP;
-	
-	// Lock data structure
-	xSemaphoreTake(buf->mutex, portMAX_DELAY);
-	
-	// Save the current header info
+	// Save the current header info and sequence the frame for consumers
+	buf->frame_seq = frame_seq;
+	buf->frame_index = frame_index;
+	buf->frame_usec = frame_usec;
 	buf->high_gain = frame_high_gain;
 	buf->vid_frozen = frame_pix_freeze;
+	buf->img_hash = frame_hash;
+#ifdef T1C_LOCAL_RADIOMETRY
+	buf->y16_is_temp = true;
+#else
+	buf->y16_is_temp = false;
+#endif
 	
-	// Copy the image data
-	imgP = buf->img_data;
-	imgEndP = imgP + T1C_WIDTH*T1C_HEIGHT;
-	frameP = t1c_y16_buffer;
-	while (imgP < imgEndP) {
-		*imgP++ = *frameP++;
-	}
-	
-	// Copy the raw min/max values for scaling
+	// Copy the raw min/max values and the range used for scaling
 	buf->y16_min = y16_min;
 	buf->y16_max = y16_max;
+	buf->agc_min = agc_min;
+	buf->agc_max = agc_max;
+	buf->agc_seq = agc_seq;
 	
 	// Add environmental conditions
 	buf->amb_temp_valid = env_cond.ambient_temp_valid;
@@ -1067,8 +3923,13 @@ static void _push_frame(t1c_buffer_t* buf)
 	buf->distance = env_cond.target_distance;
 	
 	// Copy temperature metadata
-	buf->minmax_valid = minmax_valid;
+	buf->minmax_valid = minmax_en && minmax_valid;
 	buf->max_min_temp_info = max_min_temp_data;
+	if (minmax_track[0].valid) {
+		// Tracked locations replace the ones from the Tiny1C
+		buf->max_min_temp_info.max_temp_point = minmax_track[0].out;
+		buf->max_min_temp_info.min_temp_point = minmax_track[1].out;
+	}
 	
 	buf->spot_valid = spot_valid;
 	buf->spot_point = spot_param;
@@ -1078,9 +3939,8 @@ static void _push_frame(t1c_buffer_t* buf)
 	buf->region_temp_info = region_temp_info;
 	buf->region_points = region_param;
 	
-	// Unlock data structure
-	xSemaphoreGive(buf->mutex);
-	
+	buf->roi = roi_table;
+	buf->img_stats = img_stats;
 }
 
 
@@ -1105,64 +3965,94 @@ static void _handle_notifications()
 	// Look for incoming notifications (clear them upon reading)
 	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, 0)) {
 		if (Notification(notification_value, T1C_NOTIFY_SET_SPOT_LOC_MASK)) {
+			portENTER_CRITICAL(&loc_mux);
 			spot_param = spot_new_param;
+			portEXIT_CRITICAL(&loc_mux);
 		}
 		
 		if (Notification(notification_value, T1C_NOTIFY_SET_REGION_LOC_MASK)) {
+			portENTER_CRITICAL(&loc_mux);
 			region_param = region_new_param;
+			portEXIT_CRITICAL(&loc_mux);
 		}
 		
-		if (Notification(notification_value, T1C_NOTIFY_RESTORE_DEFAULT_MASK)) {
-			ir_error_t ret = _t1c_restore_default_config();
-			if (ret != IR_SUCCESS) {
-				ESP_LOGE(TAG, "Restore default failed with %d", ret);
-				xTaskNotify(output_task, task_ctrl_act_failed_notification, eSetBits);
-			} else {
-				xTaskNotify(output_task, task_ctrl_act_succeeded_notification, eSetBits);
-			}
+		if (Notification(notification_value, T1C_NOTIFY_SET_ROI_TABLE_MASK)) {
+			roi_table = roi_new_table;
+			roi_table.spot_valid_mask = 0;
+			roi_table.rect_valid_mask = 0;
+			roi_table.line_valid_mask = 0;
+			roi_en = (roi_table.num_spots + roi_table.num_rects + roi_table.num_lines) != 0;
 			
-			// Delay to let the GUI display the result
-			vTaskDelay(pdMS_TO_TICKS(1500));
-			
-			// This command always shuts down the system when complete
-			xTaskNotify(platform_task, task_shutdown_notification, eSetBits);
+			// Restart the measurement cycle and discard any result in progress for the old table
+			roi_cci_index = 0;
+			roi_cci_cur = -1;
+		}
+		
+		// Long running Tiny1C commands are executed as background jobs by _eval_cci()
+		if (Notification(notification_value, T1C_NOTIFY_RESTORE_DEFAULT_MASK)) {
+			_cci_start_job(&restore_job);
 		}
 		
 		if (Notification(notification_value, T1C_NOTIFY_CAL_1_MASK)) {
-			ir_error_t ret = _t1c_perform_cal(CAL_1_PT);
-			if (ret != IR_SUCCESS) {
-				ESP_LOGE(TAG, "One point calibration failed with %d", ret);
-				xTaskNotify(output_task, task_ctrl_act_failed_notification, eSetBits);
-			} else {
-				xTaskNotify(output_task, task_ctrl_act_succeeded_notification, eSetBits);
-			}
+			ESP_LOGI(TAG, "Blackbody temp = %u °K", bb_temp_k);
+			cal_2pt_in_progress = false;
+			_cci_start_job(&cal_1_job);
 		}
 		
 		if (Notification(notification_value, T1C_NOTIFY_CAL_2L_MASK)) {
-			ir_error_t ret = _t1c_perform_cal(CAL_2_PT_L);
-			if (ret != IR_SUCCESS) {
-				ESP_LOGE(TAG, "Two point calibration (low) failed with %d", ret);
-				xTaskNotify(output_task, task_ctrl_act_failed_notification, eSetBits);
-			} else {
-				xTaskNotify(output_task, task_ctrl_act_succeeded_notification, eSetBits);
-			}
+			ESP_LOGI(TAG, "Blackbody temp = %u °K", bb_temp_k);
+			cal_2pt_in_progress = false;
+			_cci_start_job(&cal_2l_job);
 		}
 		
 		if (Notification(notification_value, T1C_NOTIFY_CAL_2H_MASK)) {
-			ir_error_t ret = _t1c_perform_cal(CAL_2_PT_H);
-			if (ret != IR_SUCCESS) {
-				ESP_LOGE(TAG, "Two point calibration (high) failed with %d", ret);
-				xTaskNotify(output_task, task_ctrl_act_failed_notification, eSetBits);
-			} else {
-				xTaskNotify(output_task, task_ctrl_act_succeeded_notification, eSetBits);
-			}
+			ESP_LOGI(TAG, "Blackbody temp = %u °K", bb_temp_k);
+			cal_2pt_in_progress = false;
+			_cci_start_job(&cal_2h_job);
 		}
 		
 		if (Notification(notification_value, T1C_NOTIFY_FFC_MASK)) {
-			ESP_LOGI(TAG, "Manual FFC triggered");
-			ir_error_t ret = ooc_b_update(B_UPDATE);
-			if (ret != IR_SUCCESS) {
-				ESP_LOGE(TAG, "FFC failed with %d", ret);
+			_cci_start_job(&ffc_job);
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_FILE_PRE_FFC_MASK)) {
+			// Only when the Tiny1C is managing FFC itself and hasn't just run one
+			if (out_state.auto_ffc_en && (cci_job == NULL) && (t1c_get_ffc_age_msec() >= FFC_PRE_CAPTURE_MSEC)) {
+				_cci_start_job(&ffc_job);
+			}
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_DPC_DETECT_MASK)) {
+			_start_dpc_detect();
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_DPC_APPLY_MASK)) {
+			_start_dpc_apply();
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_DPC_CLEAR_MASK)) {
+			// Not while the job is using the points
+			if (dpc_status.state != T1C_DPC_ST_APPLY) {
+				dpc_status.state = T1C_DPC_ST_IDLE;
+				dpc_status.progress = 0;
+				dpc_status.num_points = 0;
+				dpc_correct = false;
+				ffc_hold_mask &= ~T1C_FFC_HOLD_DPC;
+			}
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_FILE_FW_UPD_MASK)) {
+			_run_fw_update();
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_BENCHMARK_MASK)) {
+			// Not while a job is changing the Tiny1C or another benchmark is running
+			if ((cci_job == NULL) && bench_start()) {
+				ESP_LOGI(TAG, "Start benchmark");
+				bench_frames = BENCH_T1C_FRAMES;
+			} else {
+				ESP_LOGE(TAG, "Benchmark rejected");
+				xTaskNotify(output_task, task_ctrl_act_failed_notification, eSetBits);
 			}
 		}
 		
@@ -1173,15 +4063,15 @@ static void _handle_notifications()
 		}
 		
 		if (Notification(notification_value, T1C_NOTIFY_SET_T_H_MASK)) {
-			// Currently we don't use humidity
-			env_cond.ambient_humidity = new_env_cond.ambient_humidity;
-			env_cond.ambient_humidity_valid = new_env_cond.ambient_humidity_valid;
-			
 			if ((env_cond.ambient_temp_valid != new_env_cond.ambient_temp_valid) ||
-			    (env_cond.ambient_temp != new_env_cond.ambient_temp)) {
+			    (env_cond.ambient_temp != new_env_cond.ambient_temp) ||
+			    (env_cond.ambient_humidity_valid != new_env_cond.ambient_humidity_valid) ||
+			    (env_cond.ambient_humidity != new_env_cond.ambient_humidity)) {
 			    
 			    env_cond.ambient_temp = new_env_cond.ambient_temp;
 				env_cond.ambient_temp_valid = new_env_cond.ambient_temp_valid;
+				env_cond.ambient_humidity = new_env_cond.ambient_humidity;
+				env_cond.ambient_humidity_valid = new_env_cond.ambient_humidity_valid;
 				
 				if (t1c_config.use_auto_ambient) {
 					// Update the Tiny1C if necessary
@@ -1208,6 +4098,34 @@ static void _handle_notifications()
 			notify_get_file_image = true;
 		}
 		
+#ifdef CONFIG_MQTT_TELEMETRY_ENABLE
+		if (Notification(notification_value, T1C_NOTIFY_MQTT_GET_INFO_MASK)) {
+			notify_get_mqtt_info = true;
+		}
+#endif
+		
+		if (Notification(notification_value, T1C_NOTIFY_FILE_GET_AVG_MASK)) {
+			notify_get_file_avg = true;
+			avg_count = 0;
+			ffc_skip_count = 0;
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_FILE_BURST_MASK)) {
+			// Start with the pre-trigger frames already in the ring
+			if (burst_new_pre > burst_ring_count) burst_new_pre = burst_ring_count;
+			if (burst_ring_count == 0) burst_next = 0;
+			burst_first = burst_next - burst_new_pre;
+			if (burst_first < 0) burst_first += FILE_BURST_MAX_FRAMES;
+			burst_total = burst_new_pre + burst_new_num;
+			burst_num = burst_new_num;
+			burst_index = 0;
+		}
+		
+		if (Notification(notification_value, T1C_NOTIFY_FILE_SYNC_MASK)) {
+			sync_target_usec = sync_new_usec;
+			sync_pending = true;
+		}
+		
 		if (Notification(notification_value, T1C_NOTIFY_ENV_UPD_MASK)) {			
 			// Update the Tiny1C if necessary
 			_update_tpd_params(false);
@@ -1221,6 +4139,8 @@ static void _update_tpd_params(bool force_update)
 	bool update_tau = force_update;
 	float ta = 0;
 	float dist = 0;
+	float hum;
+	int dist_diff;
 	uint16_t new_param_val;
 	
 	// Look at environmental conditions that affect tau and reconfigure the Tiny1C as necessary
@@ -1254,6 +4174,13 @@ static void _update_tpd_params(bool force_update)
 	if (t1c_config.use_auto_ambient && env_cond.target_distance_valid) {
 		new_param_val = dist_cm_to_param_value(env_cond.target_distance);
 		dist = (float) env_cond.target_distance / 100.0;
+		
+		// Ignore small changes in the continuously measured distance
+		dist_diff = abs((int) new_param_val - (int) tpd_settings_values[TPD_PROP_DISTANCE]);
+		if (!force_update && ((dist_diff * 100) < (DIST_HYST_PERCENT * tpd_settings_values[TPD_PROP_DISTANCE]))) {
+			new_param_val = tpd_settings_values[TPD_PROP_DISTANCE];
+			dist = (float) param_to_dist_cm_value(new_param_val) / 100.0;
+		}
 	} else {
 		new_param_val = dist_cm_to_param_value(t1c_config.distance);
 		dist = (float) t1c_config.distance / 100.0;
@@ -1263,240 +4190,503 @@ static void _update_tpd_params(bool force_update)
 		update_tau = true;
 	}
 	
-	// Tau
+	// Humidity (only measured, the Tiny1C doesn't have a humidity parameter)
+	if (t1c_config.use_auto_ambient && env_cond.ambient_humidity_valid) {
+		hum = (float) env_cond.ambient_humidity;
+	} else {
+		hum = DEF_HUMIDITY_PERCENT;
+	}
+	if (hum != tau_humidity) {
+		tau_humidity = hum;
+		update_tau = true;
+	}
+	
+	// Tau (only written when it changes by a meaningful amount)
 	if (update_tau) {
-		new_param_val = estimate_tau(ta, dist, 0);
-		t1c_set_param_tpd(TPD_PROP_TAU, new_param_val);
+		new_param_val = estimate_tau_cached(ta, dist, hum);
+		if (force_update || (new_param_val != tpd_settings_values[TPD_PROP_TAU])) {
+			t1c_set_param_tpd(TPD_PROP_TAU, new_param_val);
+		}
+	}
+}
+
+
+#ifdef T1C_LOCAL_RADIOMETRY
+// Compute enabled measurements from the current (temperature) frame so they are consistent
+// with the image they are displayed with
+static void _eval_local_radiometry()
+{
+	int i;
+	
+	if (spot_en) {
+		spot_temp_raw = t1c_rad_point_temp(cur_y16P, &spot_param);
+		spot_valid = true;
 	}
+	
+	if (minmax_en) {
+		t1c_rad_min_max_temp(cur_y16P, &max_min_temp_data);
+		minmax_valid = true;
+	}
+	
+	if (region_en) {
+		t1c_rad_region_temp(cur_y16P, &region_param, &region_temp_info);
+		region_valid = true;
+	}
+	
+	if (roi_en) {
+		t1c_rad_point_temps(cur_y16P, roi_table.spot_points, roi_table.spot_temps, roi_table.num_spots);
+		t1c_rad_region_temps(cur_y16P, roi_table.rect_points, roi_table.rect_temp_info, roi_table.num_rects);
+		t1c_rad_line_temps(cur_y16P, roi_table.line_points, roi_table.line_temp_info, roi_table.num_lines);
+		for (i=0; i<roi_table.num_spots; i++) {
+			_roi_correct_temp(&roi_table.spot_temps[i], roi_table.spot_emissivity[i]);
+		}
+		for (i=0; i<roi_table.num_rects; i++) {
+			_roi_correct_info(&roi_table.rect_temp_info[i], roi_table.rect_emissivity[i]);
+		}
+		for (i=0; i<roi_table.num_lines; i++) {
+			_roi_correct_info(&roi_table.line_temp_info[i], roi_table.line_emissivity[i]);
+		}
+		roi_table.spot_valid_mask = (1 << roi_table.num_spots) - 1;
+		roi_table.rect_valid_mask = (1 << roi_table.num_rects) - 1;
+		roi_table.line_valid_mask = (1 << roi_table.num_lines) - 1;
+	}
+	
+	if (rect_stats_en) {
+		xSemaphoreTake(sat_mutex, portMAX_DELAY);
+		t1c_rad_build_sat(cur_y16P, sat_sum, sat_sum_sq);
+		sat_valid = true;
+		xSemaphoreGive(sat_mutex);
+	}
+}
+#endif
+
+
+// Time a CCI parameter read for each benchmark frame (the SPI read and scaling are timed
+// as the frame is processed) and hand the last frame to file_task for the processing
+// benchmarks.  The read is skipped when a background CCI command is outstanding since it
+// would collect that command's response.
+static void _eval_benchmark()
+{
+	int64_t start_usec;
+	uint16_t v;
+	
+	if (cci_state == CCI_ACCESS_ST_IDLE) {
+		start_usec = bench_begin();
+		if (get_prop_tpd_params(TPD_PROP_GAIN_SEL, &v) == IR_SUCCESS) {
+			bench_end(BENCH_ITEM_CCI, start_usec);
+		}
+	}
+	
+	if (--bench_frames == 0) {
+		(void) _push_frame(&file_t1c_buffer, portMAX_DELAY);
+		xTaskNotify(task_handle_file, FILE_NOTIFY_BENCHMARK_MASK, eSetBits);
+	}
+}
+
+
+// Switch the Tiny1C gain based on the hottest part of the current frame.  The switch goes
+// through the parameter cache so the TAU table is swapped (both are resident) and the TPD
+// parameters recomputed as soon as the gain is written.
+static void _eval_auto_gain()
+{
+	uint16_t hot_t;
+	
+	// Wait for a switch to take effect (the Tiny1C may also run the shutter after a change)
+	if (auto_gain_settle > 0) {
+		if ((frame_high_gain == auto_gain_high) && !frame_pix_freeze) {
+			auto_gain_settle -= 1;
+		}
+		return;
+	}
+	
+	if (!_auto_gain_hot_temp(&hot_t)) {
+		return;
+	}
+	
+	if (auto_gain_high) {
+		if (hot_t > Y16_TEMP_C(AUTO_GAIN_HIGH_LIMIT_C)) {
+			auto_gain_count += 1;
+		} else {
+			auto_gain_count = 0;
+		}
+	} else {
+		if (hot_t < Y16_TEMP_C(AUTO_GAIN_LOW_LIMIT_C)) {
+			auto_gain_count += 1;
+		} else {
+			auto_gain_count = 0;
+		}
+	}
+	
+	if (auto_gain_count >= (auto_gain_high ? AUTO_GAIN_LOW_DWELL : AUTO_GAIN_HIGH_DWELL)) {
+		if (t1c_set_param_tpd(TPD_PROP_GAIN_SEL, auto_gain_high ? 0 : 1)) {
+			auto_gain_high = !auto_gain_high;
+			ESP_LOGI(TAG, "Auto gain switched to %s", auto_gain_high ? "high" : "low");
+			
+			// Temperatures measured at the old gain no longer apply
+			minmax_valid = false;
+		}
+		auto_gain_count = 0;
+		auto_gain_settle = AUTO_GAIN_SETTLE;
+	}
+}
+
+
+// Get the temperature (1/16 °K) of the hottest part of the scene.  With local radiometry
+// this is where the histogram of the current temperature frame reaches AUTO_GAIN_HOT_PIXELS
+// counting down from the top so a few hot pixels don't cause a switch.  Otherwise it is
+// the most recent Tiny1C maximum temperature measurement.  Returns false if unavailable.
+static bool _auto_gain_hot_temp(uint16_t* t)
+{
+#ifdef T1C_LOCAL_RADIOMETRY
+	int i;
+	uint32_t count = 0;
+	
+	for (i=Y16_HIST_BINS-1; i>0; i--) {
+		count += y16_hist[i];
+		if (count >= AUTO_GAIN_HOT_PIXELS) break;
+	}
+	*t = y16_hist_base + (i << y16_hist_shift);
+	return true;
+#else
+	if (!minmax_valid) {
+		return false;
+	}
+	*t = max_min_temp_data.max_temp;
+	return true;
+#endif
 }
 
 
 // Access the Tiny1C CCI between frames.  We do this because I found that accessing the
 // CCI while reading frame data could cause a malfunction.  In order to minimize impact
 // on the frame rate we re-implement some of the Falcon CCI commands here so that we can
-// separate polling for CCI ready from the actual access.  We poll between frames until
-// the CCI is ready then we make the access after the next frame.
-static void _eval_cci()
+// separate polling for CCI ready from the actual access.  After each frame we issue
+// commands back-to-back, polling for completion every CCI_POLL_MSEC, until there is
+// nothing due or the time before the next frame runs out (a command still in progress
+// is picked up after the next frame).  A background job owns the CCI until it finishes.
+// Otherwise parameter updates take precedence over measurements.  Measurements are issued
+// in priority order when they are due.
+static void _eval_cci(int64_t deadline_usec)
 {
-	uint8_t data[16];
+	int i;
 	uint8_t status;
-	size_t param_len;
-	uint8_t* param;
-	
-	switch (cci_state) {
-		case CCI_ACCESS_ST_IDLE:
-			if (spot_en) {
-				cci_state = CCI_ACCESS_ST_REQ_SPOT;
-			} else if (minmax_en) {
-				cci_state = CCI_ACCESS_ST_REQ_MM;
-			} else if (region_en) {
-				cci_state = CCI_ACCESS_ST_REQ_REG;
-			} else {
-				cci_state = CCI_ACCESS_ST_EX_CMD;
-			}		
-			break;
-		
-		case CCI_ACCESS_ST_REQ_SPOT:
-			// Initiate the TPD_GET_POINT_TEMP command
-			_cci_send_get_point_temp();
-			cci_state = CCI_ACCESS_ST_WAIT_SPOT; 
-			break;
-		
-		case CCI_ACCESS_ST_WAIT_SPOT:
-			// Check if the Tiny1C is no longer busy processing the command
-			if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, 1, &status) != IR_SUCCESS) {
-				ESP_LOGE(TAG, "read (spot) status failed");
-			} else if ((status & (VCMD_BUSY_STS_BIT)) == VCMD_BUSY_STS_IDLE) {
-				if ((status & VCMD_RST_STS_BIT) == VCMD_RST_STS_PASS) {
-					// Read the spot location
-					if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 2, data) != IR_SUCCESS) {
-						ESP_LOGE(TAG, "read spot data failed");
-					} else {
-						spot_temp_raw = ((uint16_t)data[0] << 8) + data[1];
-						spot_valid = true;
-					}
-				} else {
-					ESP_LOGE(TAG, "read (spot) status returned error 0x%x", status & VCMD_ERR_STS_BIT);
+	param_buffer_entry_t param;
+	
+	// Age the measurements for rate control
+	for (i=0; i<CCI_NUM_MEAS; i++) {
+		if (cci_meas[i].age < cci_meas[i].period) {
+			cci_meas[i].age += 1;
+		}
+	}
+	
+	while (esp_timer_get_time() < deadline_usec) {
+		if (cci_state == CCI_ACCESS_ST_IDLE) {
+			if (cci_job != NULL) {
+				// Issue the next job step (the job is finished if there isn't one)
+				if (_cci_job_next_step()) {
+					cci_state = CCI_ACCESS_ST_WAIT_JOB;
 				}
-				
-				if (minmax_en) {
-					cci_state = CCI_ACCESS_ST_REQ_MM;
-				} else if (region_en) {
-					cci_state = CCI_ACCESS_ST_REQ_REG;
-				} else {
-					cci_state = CCI_ACCESS_ST_EX_CMD;
+			} else if (!cal_2pt_in_progress && _param_cache_get_next(&param)) {
+				// Parameter updates next
+				_cci_fast_set_param(&param);
+				cci_state = CCI_ACCESS_ST_WAIT_CMD;
+			} else {
+				// Issue the next measurement that is due
+#ifdef T1C_LOCAL_RADIOMETRY
+				cci_cur_meas = -1;     // Computed from the frame instead
+#else
+				cci_cur_meas = _cci_next_meas();
+#endif
+				if (cci_cur_meas < 0) {
+					// Nothing more to do until the next frame
+					break;
 				}
+				cci_meas[cci_cur_meas].req();
+				cci_state = CCI_ACCESS_ST_WAIT_MEAS;
 			}
-			break;
-		
-		case CCI_ACCESS_ST_REQ_MM:
-			// Initiate the TPD_GET_MAX_MIN_TEMP command
-			_cci_set_get_min_max_temp();
-			cci_state = CCI_ACCESS_ST_WAIT_MM;
-			break;
-		
-		case CCI_ACCESS_ST_WAIT_MM:
-			// Check if the Tiny1C is no longer busy processing the command
-			if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, 1, &status) != IR_SUCCESS) {
-				ESP_LOGE(TAG, "read (minmax) status failed");
-			} else if ((status & (VCMD_BUSY_STS_BIT)) == VCMD_BUSY_STS_IDLE) {
-				if ((status & VCMD_RST_STS_BIT) == VCMD_RST_STS_PASS) {
-					// Read the spot location
-					if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 12, data) != IR_SUCCESS) {
-						ESP_LOGE(TAG, "read minmax data failed");
-					} else {
-					    max_min_temp_data.max_temp = ((uint16_t)data[0] << 8) + data[1];
-					    max_min_temp_data.min_temp = ((uint16_t)data[2] << 8) + data[3];
-					    max_min_temp_data.max_temp_point.x = ((uint16_t)data[4] << 8) + data[5];
-					    max_min_temp_data.max_temp_point.y = ((uint16_t)data[6] << 8) + data[7];
-					    max_min_temp_data.min_temp_point.x = ((uint16_t)data[8] << 8) + data[9];
-					    max_min_temp_data.min_temp_point.y = ((uint16_t)data[10] << 8) + data[11];
-					    minmax_valid = true;
-					}
-				} else {
-					ESP_LOGE(TAG, "read (minmax) status returned error 0x%x", status & VCMD_ERR_STS_BIT);
-				}
-				
-				if (region_en) {
-					cci_state = CCI_ACCESS_ST_REQ_REG;
-				} else {
-					cci_state = CCI_ACCESS_ST_EX_CMD;
-				}
+		} else if (cci_state == CCI_ACCESS_ST_WAIT_JOB) {
+			// Job steps take a long time so only check them once per frame
+			if (!_cci_job_eval_step()) {
+				break;
 			}
-			break;
-		
-		case CCI_ACCESS_ST_REQ_REG:
-			// Initiate the TPD_GET_RECT_TEMP command
-			_cci_set_get_region_temp();
-			cci_state = CCI_ACCESS_ST_WAIT_REG;
-			break;
-		
-		case CCI_ACCESS_ST_WAIT_REG:
+			cci_state = CCI_ACCESS_ST_IDLE;
+		} else {
 			// Check if the Tiny1C is no longer busy processing the command
 			if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, 1, &status) != IR_SUCCESS) {
-				ESP_LOGE(TAG, "read (rect) status failed");
-			} else if ((status & (VCMD_BUSY_STS_BIT)) == VCMD_BUSY_STS_IDLE) {
-				if ((status & VCMD_RST_STS_BIT) == VCMD_RST_STS_PASS) {
-					// Read the region temp info
-					if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 14, data) != IR_SUCCESS) {
-						ESP_LOGE(TAG, "read rect data failed");
-					} else {
-						    region_temp_info.temp_info_value.ave_temp = ((uint16_t)data[0] << 8) + data[1];
-						    region_temp_info.temp_info_value.max_temp = ((uint16_t)data[2] << 8) + data[3];
-						    region_temp_info.temp_info_value.min_temp = ((uint16_t)data[4] << 8) + data[5];
-						    region_temp_info.max_temp_point.x = ((uint16_t)data[6] << 8) + data[7];
-						    region_temp_info.max_temp_point.y = ((uint16_t)data[8] << 8) + data[9];
-						    region_temp_info.min_temp_point.x = ((uint16_t)data[10] << 8) + data[11];
-						    region_temp_info.min_temp_point.y = ((uint16_t)data[12] << 8) + data[13];
-						    region_valid = true;
-					}
-				} else {
-					ESP_LOGE(TAG, "read (rect) status returned error 0x%x", status & VCMD_ERR_STS_BIT);
-				}
-				
-				cci_state = CCI_ACCESS_ST_EX_CMD;
+				ESP_LOGE(TAG, "read (%s) status failed", (cci_state == CCI_ACCESS_ST_WAIT_MEAS) ? cci_meas[cci_cur_meas].name : "cmd");
+				break;
 			}
-			break;
-		
-		case CCI_ACCESS_ST_EX_CMD:
-			// Look for a parameter update (we process one at a time as we don't expect them frequently
-			// and that has the least impact to frame rate)
-			param = (uint8_t*) xRingbufferReceive(param_buf_handle, &param_len, 0);
-			if ((param != NULL) && (!cal_2pt_in_progress)) {
-				if (param_len == sizeof(param_buffer_entry_t)) {
-					_cci_fast_set_param((param_buffer_entry_t*) param);
-				} else {
-					ESP_LOGE(TAG, "Unexpected parameter length %d", param_len);
-				}
-				vRingbufferReturnItem(param_buf_handle, (void *)param);
-				
-				cci_state = CCI_ACCESS_ST_WAIT_CMD;
-			} else {			
-				if (spot_en) {
-					cci_state = CCI_ACCESS_ST_REQ_SPOT;
-				} else if (minmax_en) {
-					cci_state = CCI_ACCESS_ST_REQ_MM;
-				} else if (region_en) {
-					cci_state = CCI_ACCESS_ST_REQ_REG;
-				} else {
-					cci_state = CCI_ACCESS_ST_EX_CMD;
-				}
+			if ((status & (VCMD_BUSY_STS_BIT)) != VCMD_BUSY_STS_IDLE) {
+				vTaskDelay(pdMS_TO_TICKS(CCI_POLL_MSEC));
+				continue;
 			}
-			break;
-		
-		case CCI_ACCESS_ST_WAIT_CMD:
-			// Check if the Tiny1C is no longer busy processing the command
-			if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, 1, &status) != IR_SUCCESS) {
-				ESP_LOGE(TAG, "read (rect) status failed");
-			} else if ((status & (VCMD_BUSY_STS_BIT)) == VCMD_BUSY_STS_IDLE) {
-				if (spot_en) {
-					cci_state = CCI_ACCESS_ST_REQ_SPOT;
-				} else if (minmax_en) {
-					cci_state = CCI_ACCESS_ST_REQ_MM;
-				} else if (region_en) {
-					cci_state = CCI_ACCESS_ST_REQ_REG;
+			
+			if (cci_state == CCI_ACCESS_ST_WAIT_MEAS) {
+				if ((status & VCMD_RST_STS_BIT) == VCMD_RST_STS_PASS) {
+					if (cci_meas[cci_cur_meas].read()) {
+						cci_meas[cci_cur_meas].age = 0;
+					}
 				} else {
-					cci_state = CCI_ACCESS_ST_EX_CMD;
+					ESP_LOGE(TAG, "read (%s) status returned error 0x%x", cci_meas[cci_cur_meas].name, status & VCMD_ERR_STS_BIT);
+					cci_meas[cci_cur_meas].age = 0;
 				}
 			}
-			break;
-		
-		default:
 			cci_state = CCI_ACCESS_ST_IDLE;
+		}
+	}
+}
+
+
+// Returns the index of the highest priority enabled measurement that is due or -1
+static int _cci_next_meas()
+{
+	int i;
+	int n = -1;
+	
+	for (i=0; i<CCI_NUM_MEAS; i++) {
+		if (*cci_meas[i].enP && (cci_meas[i].age >= cci_meas[i].period)) {
+			if ((n < 0) || (cci_meas[i].priority < cci_meas[n].priority)) {
+				n = i;
+			}
+		}
 	}
+	
+	return n;
 }
 
 
-// Fast get_spot_temp API call (Tiny1C must be ready)
-static void _cci_send_get_point_temp()
+// Fast implementation of the long TPD get commands (Tiny1C must be ready).  Commands that
+// don't use coordinates or the second point are sent with them set to 0.  len is the
+// length of the result.
+static void _cci_send_tpd_get(uint8_t sub_cmd, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint8_t len)
 {
 	uint8_t cci_reg_array[8];
 	
-	// Simulate a long command 
+	// Simulate a long command
 	cci_reg_array[0] = CMDTYPE_LONG_TYPE_TPD;            // byCmdType   (wParam[15:8])
-	cci_reg_array[1] = SUBCMD_TPD_GET_POINT_TEMP;        // bySubCmd    (wParam[7:0])
+	cci_reg_array[1] = sub_cmd;                          // bySubCmd    (wParam[7:0])
 	cci_reg_array[2] = 0;                                // byParam_h
 	cci_reg_array[3] = 0;                                // byParam_l
-	cci_reg_array[4] = spot_param.x >> 8;                // byAddr1_hh  (dwAddr1[31:24])
-	cci_reg_array[5] = spot_param.x & 0xFF;              // byAddr1_h   (dwAddr1[23:16])
-	cci_reg_array[6] = spot_param.y >> 8;                // byAddr1_l   (dwAddr1[15:8])
-	cci_reg_array[7] = spot_param.y & 0xFF;              // byAddr1_ll  (dwAddr1[7:0])
+	cci_reg_array[4] = x1 >> 8;                          // byAddr1_hh  (dwAddr1[31:24])
+	cci_reg_array[5] = x1 & 0xFF;                        // byAddr1_h   (dwAddr1[23:16])
+	cci_reg_array[6] = y1 >> 8;                          // byAddr1_l   (dwAddr1[15:8])
+	cci_reg_array[7] = y1 & 0xFF;                        // byAddr1_ll  (dwAddr1[7:0])
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_HLD, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_HLD failed");
 		return;
 	}
 	
-	cci_reg_array[0] = 0;                                // byAddr2_hh  (dwAddr2[31:24])
-	cci_reg_array[1] = 0;                                // byAddr2_h   (dwAddr2[23:16])
-	cci_reg_array[2] = 0;                                // byAddr2_l   (dwAddr2[15:8])
-	cci_reg_array[3] = 0;                                // byAddr2_ll  (dwAddr2[7:0])
+	cci_reg_array[0] = x2 >> 8;                          // byAddr2_hh  (dwAddr2[31:24])
+	cci_reg_array[1] = x2 & 0xFF;                        // byAddr2_h   (dwAddr2[23:16])
+	cci_reg_array[2] = y2 >> 8;                          // byAddr2_l   (dwAddr2[15:8])
+	cci_reg_array[3] = y2 & 0xFF;                        // byAddr2_ll  (dwAddr2[7:0])
 	cci_reg_array[4] = 0;                                // byLen_hh    (dwLen[31:24])
 	cci_reg_array[5] = 0;                                // byLen_h     (dwLen[23:16])
 	cci_reg_array[6] = 0;                                // byLen_l     (dwLen[15:8])
-	cci_reg_array[7] = 2;                                // byLen_ll    (dwLen[7:0])
+	cci_reg_array[7] = len;                              // byLen_ll    (dwLen[7:0])
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 8, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_RW failed");
 	}
 }
 
 
+// Fast get_spot_temp API call (Tiny1C must be ready)
+static void _cci_send_get_point_temp()
+{
+	_cci_send_tpd_get(SUBCMD_TPD_GET_POINT_TEMP, spot_param.x, spot_param.y, 0, 0, 2);
+}
+
+
 // Fast get_min_max_temp API call (Tiny1C must be ready)
 static void _cci_set_get_min_max_temp()
+{
+	_cci_send_tpd_get(SUBCMD_TPD_GET_MAX_MIN_TEMP_INFO, 0, 0, 0, 0, 12);
+}
+
+
+// Fast get_rect_temp API call (Tiny1C must be ready)
+static void _cci_set_get_region_temp()
+{
+	_cci_send_tpd_get(SUBCMD_TPD_GET_RECT_TEMP, region_param.start_point.x, region_param.start_point.y,
+	                  region_param.end_point.x, region_param.end_point.y, 14);
+}
+
+
+// Request the next ROI table entry (spots, then rectangles, then lines) using the point,
+// rect or line temp API call (Tiny1C must be ready)
+static void _cci_send_get_roi_temp()
+{
+	int n;
+	int total = roi_table.num_spots + roi_table.num_rects + roi_table.num_lines;
+	
+	if (roi_cci_index >= total) roi_cci_index = 0;
+	roi_cci_cur = roi_cci_index;
+	if (++roi_cci_index >= total) roi_cci_index = 0;
+	
+	n = roi_cci_cur;
+	if (n < roi_table.num_spots) {
+		_cci_send_tpd_get(SUBCMD_TPD_GET_POINT_TEMP, roi_table.spot_points[n].x, roi_table.spot_points[n].y, 0, 0, 2);
+		return;
+	}
+	
+	n -= roi_table.num_spots;
+	if (n < roi_table.num_rects) {
+		_cci_send_tpd_get(SUBCMD_TPD_GET_RECT_TEMP, roi_table.rect_points[n].start_point.x, roi_table.rect_points[n].start_point.y,
+		                  roi_table.rect_points[n].end_point.x, roi_table.rect_points[n].end_point.y, 14);
+		return;
+	}
+	
+	n -= roi_table.num_rects;
+	_cci_send_tpd_get(SUBCMD_TPD_GET_LINE_TEMP, roi_table.line_points[n].start_point.x, roi_table.line_points[n].start_point.y,
+	                  roi_table.line_points[n].end_point.x, roi_table.line_points[n].end_point.y, 14);
+}
+
+
+// Read the TPD_GET_POINT_TEMP result (Tiny1C must be ready)
+static bool _cci_read_point_temp()
+{
+	uint8_t data[2];
+	
+	if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 2, data) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "read spot data failed");
+	} else {
+		spot_temp_raw = ((uint16_t)data[0] << 8) + data[1];
+		spot_valid = true;
+	}
+	
+	return true;
+}
+
+
+// Read the TPD_GET_MAX_MIN_TEMP result (Tiny1C must be ready)
+static bool _cci_read_min_max_temp()
+{
+	uint8_t data[12];
+	
+	if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 12, data) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "read minmax data failed");
+	} else {
+	    max_min_temp_data.max_temp = ((uint16_t)data[0] << 8) + data[1];
+	    max_min_temp_data.min_temp = ((uint16_t)data[2] << 8) + data[3];
+	    max_min_temp_data.max_temp_point.x = ((uint16_t)data[4] << 8) + data[5];
+	    max_min_temp_data.max_temp_point.y = ((uint16_t)data[6] << 8) + data[7];
+	    max_min_temp_data.min_temp_point.x = ((uint16_t)data[8] << 8) + data[9];
+	    max_min_temp_data.min_temp_point.y = ((uint16_t)data[10] << 8) + data[11];
+	    minmax_valid = true;
+	}
+	
+	return true;
+}
+
+
+// Read the TPD_GET_RECT_TEMP result (Tiny1C must be ready)
+static bool _cci_read_region_temp()
+{
+	if (_cci_read_line_rect_temp(&region_temp_info)) {
+		region_valid = true;
+	}
+	
+	return true;
+}
+
+
+// Read the result for the ROI table entry requested by _cci_send_get_roi_temp (Tiny1C must
+// be ready).  The update is complete when the last entry has been read.
+static bool _cci_read_roi_temp()
+{
+	int n = roi_cci_cur;
+	uint8_t data[2];
+	
+	if (n < 0) {
+		// Table changed while the command was in progress
+		return false;
+	}
+	roi_cci_cur = -1;
+	
+	if (n < roi_table.num_spots) {
+		if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 2, data) != IR_SUCCESS) {
+			ESP_LOGE(TAG, "read roi spot data failed");
+		} else {
+			roi_table.spot_temps[n] = ((uint16_t)data[0] << 8) + data[1];
+			_roi_correct_temp(&roi_table.spot_temps[n], roi_table.spot_emissivity[n]);
+			roi_table.spot_valid_mask |= 1 << n;
+		}
+	} else if ((n -= roi_table.num_spots) < roi_table.num_rects) {
+		if (_cci_read_line_rect_temp(&roi_table.rect_temp_info[n])) {
+			_roi_correct_info(&roi_table.rect_temp_info[n], roi_table.rect_emissivity[n]);
+			roi_table.rect_valid_mask |= 1 << n;
+		}
+	} else {
+		n -= roi_table.num_rects;
+		if (_cci_read_line_rect_temp(&roi_table.line_temp_info[n])) {
+			_roi_correct_info(&roi_table.line_temp_info[n], roi_table.line_emissivity[n]);
+			roi_table.line_valid_mask |= 1 << n;
+		}
+	}
+	
+	return (roi_cci_index == 0);
+}
+
+
+// Read a TPD_GET_RECT_TEMP or TPD_GET_LINE_TEMP result (Tiny1C must be ready)
+static bool _cci_read_line_rect_temp(TpdLineRectTempInfo_t* info)
+{
+	uint8_t data[14];
+	
+	if (i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 16, 14, data) != IR_SUCCESS) {
+		ESP_LOGE(TAG, "read rect data failed");
+		return false;
+	}
+	
+	info->temp_info_value.ave_temp = ((uint16_t)data[0] << 8) + data[1];
+	info->temp_info_value.max_temp = ((uint16_t)data[2] << 8) + data[3];
+	info->temp_info_value.min_temp = ((uint16_t)data[4] << 8) + data[5];
+	info->max_temp_point.x = ((uint16_t)data[6] << 8) + data[7];
+	info->max_temp_point.y = ((uint16_t)data[8] << 8) + data[9];
+	info->min_temp_point.x = ((uint16_t)data[10] << 8) + data[11];
+	info->min_temp_point.y = ((uint16_t)data[12] << 8) + data[13];
+	
+	return true;
+}
+
+
+// Correct an ROI measurement for its own emissivity (eps_pct 0 leaves it at the global
+// emissivity the measurement was made with)
+static void _roi_correct_temp(uint16_t* t, uint8_t eps_pct)
+{
+	if (eps_pct != 0) {
+		*t = t1c_rad_emissivity_correct(*t, (float) tpd_settings_values[TPD_PROP_EMS] / 128.0,
+		                                (float) eps_pct / 100.0, (float) tpd_settings_values[TPD_PROP_TU]);
+	}
+}
+
+
+static void _roi_correct_info(TpdLineRectTempInfo_t* info, uint8_t eps_pct)
+{
+	if (eps_pct != 0) {
+		t1c_rad_emissivity_correct_info(info, (float) tpd_settings_values[TPD_PROP_EMS] / 128.0,
+		                                (float) eps_pct / 100.0, (float) tpd_settings_values[TPD_PROP_TU]);
+	}
+}
+
+
+// Fast implementation of parameter setting routines
+static bool _cci_write_param(uint8_t sub_cmd, uint8_t param, uint16_t value)
 {
 	uint8_t cci_reg_array[8];
 	
 	// Simulate a long command 
-	cci_reg_array[0] = CMDTYPE_LONG_TYPE_TPD;
-	cci_reg_array[1] = SUBCMD_TPD_GET_MAX_MIN_TEMP_INFO;
+	cci_reg_array[0] = CMDTYPE_LONG_TYPE_PROP_PAGE;
+	cci_reg_array[1] = sub_cmd;
 	cci_reg_array[2] = 0;
-	cci_reg_array[3] = 0;
+	cci_reg_array[3] = param;
 	cci_reg_array[4] = 0;
 	cci_reg_array[5] = 0;
-	cci_reg_array[6] = 0;
-	cci_reg_array[7] = 0;
+	cci_reg_array[6] = value >> 8;
+	cci_reg_array[7] = value & 0xFF;
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_HLD, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_HLD failed");
-		return;
+		return false;
 	}
 	
 	cci_reg_array[0] = 0;
@@ -1506,83 +4696,282 @@ static void _cci_set_get_min_max_temp()
 	cci_reg_array[4] = 0;
 	cci_reg_array[5] = 0;
 	cci_reg_array[6] = 0;
-	cci_reg_array[7] = 12;
+	cci_reg_array[7] = 2;
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 8, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_RW failed");
+		return false;
 	}
+	
+	return true;
 }
 
 
-// Fast get_rect_temp API call (Tiny1C must be ready)
-static void _cci_set_get_region_temp()
+// Fast implementation of standard commands with up to 8 bytes of data (Tiny1C must be ready)
+static bool _cci_write_std_cmd(uint8_t cmd_type, uint8_t sub_cmd, uint8_t para, uint8_t len, uint8_t* data)
 {
 	uint8_t cci_reg_array[8];
 	
-	// Simulate a long command 
-	cci_reg_array[0] = CMDTYPE_LONG_TYPE_TPD;
-	cci_reg_array[1] = SUBCMD_TPD_GET_RECT_TEMP;
-	cci_reg_array[2] = 0;
-	cci_reg_array[3] = 0;
-	cci_reg_array[4] = region_param.start_point.x >> 8;
-	cci_reg_array[5] = region_param.start_point.x & 0xFF;
-	cci_reg_array[6] = region_param.start_point.y >> 8;
-	cci_reg_array[7] = region_param.start_point.y & 0xFF;
+	cci_reg_array[0] = cmd_type;                         // byCmdType
+	cci_reg_array[1] = sub_cmd;                          // bySubCmd
+	cci_reg_array[2] = para;                             // byPara
+	cci_reg_array[3] = 0;                                // byAddr_h
+	cci_reg_array[4] = 0;                                // byAddr_l
+	cci_reg_array[5] = 0;                                // byAddr_ll
+	cci_reg_array[6] = 0;                                // byLen_h
+	cci_reg_array[7] = len;                              // byLen_l
+	
+	if (len == 0) {
+		// No data stage, writing the header starts the command
+		if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_RW, 8, cci_reg_array) != IR_SUCCESS) {
+			ESP_LOGE(TAG, "write I2C_VD_BUFFER_RW failed");
+			return false;
+		}
+		return true;
+	}
+	
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_HLD, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_HLD failed");
-		return;
+		return false;
 	}
-	
-	cci_reg_array[0] = region_param.end_point.x >> 8;
-	cci_reg_array[1] = region_param.end_point.x & 0xFF;
-	cci_reg_array[2] = region_param.end_point.y >> 8;
-	cci_reg_array[3] = region_param.end_point.y & 0xFF;
-	cci_reg_array[4] = 0;
-	cci_reg_array[5] = 0;
-	cci_reg_array[6] = 0;
-	cci_reg_array[7] = 14;
-	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 8, 8, cci_reg_array) != IR_SUCCESS) {
+	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 8, len, data) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_RW failed");
+		return false;
 	}
+	
+	return true;
 }
 
-// Fast implementation of parameter setting routines
-static void _cci_write_param(uint8_t sub_cmd, uint8_t param, uint16_t value)
+
+// Fast implementation of long commands without a data stage (Tiny1C must be ready)
+static bool _cci_write_long_cmd(uint8_t cmd_type, uint8_t sub_cmd, uint32_t addr1, uint32_t addr2)
 {
 	uint8_t cci_reg_array[8];
 	
-	// Simulate a long command 
-	cci_reg_array[0] = CMDTYPE_LONG_TYPE_PROP_PAGE;
-	cci_reg_array[1] = sub_cmd;
-	cci_reg_array[2] = 0;
-	cci_reg_array[3] = param;
-	cci_reg_array[4] = 0;
-	cci_reg_array[5] = 0;
-	cci_reg_array[6] = value >> 8;
-	cci_reg_array[7] = value & 0xFF;
+	cci_reg_array[0] = cmd_type;                         // byCmdType
+	cci_reg_array[1] = sub_cmd;                          // bySubCmd
+	cci_reg_array[2] = 0;                                // byParam_h
+	cci_reg_array[3] = 0;                                // byParam_l
+	cci_reg_array[4] = addr1 >> 24;                      // byAddr1_hh
+	cci_reg_array[5] = addr1 >> 16;
+	cci_reg_array[6] = addr1 >> 8;
+	cci_reg_array[7] = addr1 & 0xFF;
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_HLD, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_HLD failed");
-		return;
+		return false;
 	}
 	
-	cci_reg_array[0] = 0;
-	cci_reg_array[1] = 0;
-	cci_reg_array[2] = 0;
-	cci_reg_array[3] = 0;
-	cci_reg_array[4] = 0;
+	cci_reg_array[0] = addr2 >> 24;                      // byAddr2_hh
+	cci_reg_array[1] = addr2 >> 16;
+	cci_reg_array[2] = addr2 >> 8;
+	cci_reg_array[3] = addr2 & 0xFF;
+	cci_reg_array[4] = 0;                                // byLen_hh
 	cci_reg_array[5] = 0;
 	cci_reg_array[6] = 0;
-	cci_reg_array[7] = 2;
+	cci_reg_array[7] = 0;
 	if (i2c_data_write_no_wait(I2C_SLAVE_ID, I2C_VD_BUFFER_RW + 8, 8, cci_reg_array) != IR_SUCCESS) {
 		ESP_LOGE(TAG, "write I2C_VD_BUFFER_RW failed");
+		return false;
+	}
+	
+	return true;
+}
+
+
+// Queue a background job to be executed by _eval_cci().  Only one job may run at a time.
+static void _cci_start_job(const cci_job_t* job)
+{
+	if (cci_job != NULL) {
+		ESP_LOGE(TAG, "%s rejected, %s in progress", job->name, cci_job->name);
+		if (job->report) {
+			xTaskNotify(output_task, task_ctrl_act_failed_notification, eSetBits);
+		}
+		return;
+	}
+	
+	ESP_LOGI(TAG, "Starting %s", job->name);
+	cci_job_step = -1;
+	cci_job_failed = false;
+	cci_job_progress_step = 0;
+	cci_job_progress_num_steps = job->num_steps;
+	cci_job = job;
+}
+
+
+// Issue the next job step that should run (Tiny1C must be ready).  Steps marked
+// CCI_JOB_RUN_OK are skipped after a failure and steps marked CCI_JOB_RUN_FAIL only run
+// after one.  Returns false when the job has finished.
+static bool _cci_job_next_step()
+{
+	const cci_job_step_t* stepP;
+	
+	while (++cci_job_step < cci_job->num_steps) {
+		stepP = &cci_job->steps[cci_job_step];
+		
+		if ((stepP->run == CCI_JOB_RUN_ALWAYS) || ((stepP->run == CCI_JOB_RUN_FAIL) == cci_job_failed)) {
+			ESP_LOGI(TAG, "  %s", stepP->name);
+			if (stepP->req(stepP->arg)) {
+				cci_job_step_usec = esp_timer_get_time();
+				return true;
+			}
+			
+			cci_job_failed = true;
+		}
+	}
+	
+	_cci_job_finish();
+	return false;
+}
+
+
+// Check if the current job step has finished.  The Tiny1C may not respond to I2C while it
+// executes some of these commands so read failures are ignored until the step times out.
+// Returns true when the step is done.
+static bool _cci_job_eval_step()
+{
+	const cci_job_step_t* stepP = &cci_job->steps[cci_job_step];
+	bool timed_out;
+	uint8_t status;
+	
+	timed_out = (esp_timer_get_time() - cci_job_step_usec) > ((int64_t) stepP->timeout_msec * 1000);
+	
+	if ((i2c_data_read(I2C_SLAVE_ID, I2C_VD_BUFFER_STATUS, 1, &status) != IR_SUCCESS) ||
+	    ((status & (VCMD_BUSY_STS_BIT)) != VCMD_BUSY_STS_IDLE)) {
+	    
+		if (!timed_out) {
+			return false;
+		}
+		ESP_LOGE(TAG, "%s: %s timed out", cci_job->name, stepP->name);
+		cci_job_failed = true;
+	} else if ((status & VCMD_RST_STS_BIT) != VCMD_RST_STS_PASS) {
+		ESP_LOGE(TAG, "%s: %s returned error 0x%x", cci_job->name, stepP->name, status & VCMD_ERR_STS_BIT);
+		cci_job_failed = true;
+	}
+	
+	if (cci_job->report) {
+		cci_job_progress_step = cci_job_step + 1;
+		xTaskNotify(output_task, task_ctrl_act_progress_notification, eSetBits);
+	}
+	
+	return true;
+}
+
+
+static void _cci_job_finish()
+{
+	const cci_job_t* job = cci_job;
+	bool success = !cci_job_failed;
+	
+	cci_job = NULL;
+	
+	if (success) {
+		ESP_LOGI(TAG, "%s done", job->name);
+	} else {
+		ESP_LOGE(TAG, "%s failed", job->name);
+	}
+	
+	if (job->report) {
+		xTaskNotify(output_task, success ? task_ctrl_act_succeeded_notification : task_ctrl_act_failed_notification, eSetBits);
+	}
+	
+	if (job->done != NULL) {
+		job->done(success);
 	}
 }
 
 
+static bool _cci_job_restore_cfg(uint8_t cfg_type)
+{
+	return _cci_write_std_cmd(CMDTYPE_STANDARD_TYPE_SPI, SUBCMD_SPI_DEFAULT_CFG_RESTORE, cfg_type, 0, NULL);
+}
+
+
+static bool _cci_job_save_cfg(uint8_t spi_module)
+{
+	// The power-on parameters will be the ones saved
+	ps_clear_cache(PARAM_PON_CACHE_KEY);
+	
+	return _cci_write_std_cmd(CMDTYPE_STANDARD_TYPE_SPI, SUBCMD_SPI_CFG_SAVE, spi_module, 0, NULL);
+}
+
+
+static bool _cci_job_shutter(uint8_t enable)
+{
+	return _cci_write_param(SUBCMD_PROP_AUTO_SHUTTER_PARAM_SET, SHUTTER_PROP_SWITCH, enable);
+}
+
+
+static bool _cci_job_b_update(uint8_t update_type)
+{
+	return _cci_write_std_cmd(CMDTYPE_STANDARD_TYPE_FW_ISP, SUBCMD_FW_ISP_OOC_B_UPDATE, update_type, 0, NULL);
+}
+
+
+static bool _cci_job_recal_1pt(uint8_t unused)
+{
+	uint8_t data[2];
+	
+	data[0] = bb_temp_k >> 8;
+	data[1] = bb_temp_k & 0xFF;
+	return _cci_write_std_cmd(CMDTYPE_STANDARD_TYPE_TPD, SUBCMD_TPD_KTBT_RECAL_1_POINT, 0, 2, data);
+}
+
+
+static bool _cci_job_recal_2pt(uint8_t point)
+{
+	uint8_t data[2];
+	
+	data[0] = bb_temp_k >> 8;
+	data[1] = bb_temp_k & 0xFF;
+	return _cci_write_std_cmd(CMDTYPE_STANDARD_TYPE_TPD, SUBCMD_TPD_KTBT_RECAL_2_POINT,
+	                          (point == TPD_KTBT_RECAL_P1) ? 0x00 : 0x01, 2, data);
+}
+
+
+// Add a proposed point to the Tiny1C dead pixel table.  The table is in sensor coordinates
+// (before the image is mirrored or flipped).
+static bool _cci_job_dpc_add(uint8_t index)
+{
+	uint32_t x = dpc_status.points[index].x;
+	uint32_t y = dpc_status.points[index].y;
+	uint16_t mf = image_settings_values[IMAGE_PROP_SEL_MIRROR_FLIP];
+	
+	if ((mf == ONLY_MIRROR) || (mf == MIRROR_FLIP)) x = (T1C_WIDTH - 1) - x;
+	if ((mf == ONLY_FLIP) || (mf == MIRROR_FLIP)) y = (T1C_HEIGHT - 1) - y;
+	
+	return _cci_write_long_cmd(CMDTYPE_LONG_TYPE_DPC, SUBCMD_DPC_ADD_DP, x, y);
+}
+
+
+// The Tiny1C corrects the points once they are saved.  We keep correcting them if it failed.
+static void _cci_job_dpc_done(bool success)
+{
+	dpc_status.state = success ? T1C_DPC_ST_APPLIED : T1C_DPC_ST_FAILED;
+	dpc_correct = !success;
+}
+
+
+// Prevent TPD updates between the L and H points of a successful 2 point calibration
+static void _cci_job_cal_2l_done(bool success)
+{
+	cal_2pt_in_progress = success;
+}
+
+
+// A restore always shuts down the system when complete
+static void _cci_job_restore_done(bool success)
+{
+	// Delay to let the GUI display the result
+	vTaskDelay(pdMS_TO_TICKS(RESTORE_SHUTDOWN_MSEC));
+	
+	xTaskNotify(platform_task, task_shutdown_notification, eSetBits);
+}
+
+
 static void _cci_fast_set_param(param_buffer_entry_t* buf_entryP)
 {
 	switch (buf_entryP->type) {
 		case PARAM_BUF_TYPE_SHUTTER:
-			_cci_write_param(SUBCMD_PROP_AUTO_SHUTTER_PARAM_SET, buf_entryP->param, buf_entryP->value);
+			(void) _cci_write_param(SUBCMD_PROP_AUTO_SHUTTER_PARAM_SET, buf_entryP->param, buf_entryP->value);
 			
 			// Update our local copy for change detection
 			if (buf_entryP->param < PARAM_NUM_TYPE_SHUTTER) {
@@ -1590,7 +4979,7 @@ static void _cci_fast_set_param(param_buffer_entry_t* buf_entryP)
 			}
 			break;
 		case PARAM_BUF_TYPE_IMAGE:
-			_cci_write_param(SUBCMD_PROP_IMAGE_PARAM_SET, buf_entryP->param, buf_entryP->value);
+			(void) _cci_write_param(SUBCMD_PROP_IMAGE_PARAM_SET, buf_entryP->param, buf_entryP->value);
 			
 			// Update our local copy for change detection
 			if (buf_entryP->param < PARAM_NUM_TYPE_IMAGE) {
@@ -1598,24 +4987,25 @@ static void _cci_fast_set_param(param_buffer_entry_t* buf_entryP)
 			}
 			break;
 		case PARAM_BUF_TYPE_TPD:
-			_cci_write_param(SUBCMD_PROP_TPD_PARAM_SET, buf_entryP->param, buf_entryP->value);
-			
-			// Update our local copy for change detection
-			if (buf_entryP->param < PARAM_NUM_TYPE_TPD) {
-				tpd_settings_values[buf_entryP->param] = buf_entryP->value;
-			}
+			(void) _cci_write_param(SUBCMD_PROP_TPD_PARAM_SET, buf_entryP->param, buf_entryP->value);
 			
-			// Re-read the TAU table on gain change
+			// Switch TAU tables on gain change (checked before updating our local copy)
 			if (buf_entryP->param == TPD_PROP_GAIN_SEL) {
 				if (tpd_settings_values[TPD_PROP_GAIN_SEL] != buf_entryP->value) {
-					if (read_correct_table((buf_entryP->value != 0) ? HIGH_GAIN : LOW_GAIN) != 0) {
-						ESP_LOGE(TAG, "Could not read correct_table for gain %u", buf_entryP->value);
+					tpd_settings_values[TPD_PROP_GAIN_SEL] = buf_entryP->value;
+					if (select_correct_table((buf_entryP->value != 0) ? HIGH_GAIN : LOW_GAIN) != 0) {
+						ESP_LOGE(TAG, "Could not select correct_table for gain %u", buf_entryP->value);
 					}
 					
 					// Force a recompute of TAU
 					_update_tpd_params(true);
 				}
 			}
+			
+			// Update our local copy for change detection
+			if (buf_entryP->param < PARAM_NUM_TYPE_TPD) {
+				tpd_settings_values[buf_entryP->param] = buf_entryP->value;
+			}
 			break;
 		default:
 			ESP_LOGE(TAG, "Unknown param type %u", buf_entryP->type);
@@ -25,6 +25,7 @@
 #ifndef T1C_TASK_H
 #define T1C_TASK_H
 
+#include "tiny1c.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -51,6 +52,7 @@
 // From ourselves
 #define T1C_NOTIFY_SET_SPOT_LOC_MASK     0x00000001
 #define T1C_NOTIFY_SET_REGION_LOC_MASK   0x00000002
+#define T1C_NOTIFY_SET_ROI_TABLE_MASK    0x00000004
 
 // From a command handler
 #define T1C_NOTIFY_RESTORE_DEFAULT_MASK  0x00000010
@@ -60,6 +62,7 @@
 #define T1C_NOTIFY_FFC_MASK              0x00000100
 #define T1C_NOTIFY_ENV_UPD_MASK          0x00000200
 #define T1C_NOTIFY_UPD_T1C_CONFIG        0x00000400
+#define T1C_NOTIFY_BENCHMARK_MASK        0x00000800
 
 // From env_task
 #define T1C_NOTIFY_SET_T_H_MASK          0x00001000
@@ -67,6 +70,128 @@
 
 // From file_task
 #define T1C_NOTIFY_FILE_GET_IMAGE_MASK   0x00010000
+#define T1C_NOTIFY_FILE_BURST_MASK       0x00020000
+#define T1C_NOTIFY_FILE_GET_AVG_MASK     0x00040000
+#define T1C_NOTIFY_FILE_PRE_FFC_MASK     0x00080000
+#define T1C_NOTIFY_FILE_SYNC_MASK        0x00800000
+#define T1C_NOTIFY_FILE_FW_UPD_MASK      0x01000000
+
+// From a command handler (dead pixel correction)
+#define T1C_NOTIFY_DPC_DETECT_MASK       0x00100000
+#define T1C_NOTIFY_DPC_APPLY_MASK        0x00200000
+#define T1C_NOTIFY_DPC_CLEAR_MASK        0x00400000
+
+// From mqtt_task
+#define T1C_NOTIFY_MQTT_GET_INFO_MASK    0x02000000
+
+
+
+// CCI measurements (for t1c_set_meas_schedule)
+#define T1C_MEAS_SPOT                    0
+#define T1C_MEAS_MINMAX                  1
+#define T1C_MEAS_REGION                  2
+#define T1C_MEAS_ROI                     3
+
+#define T1C_NUM_MEAS                     4
+
+// Frame consumers for drop accounting
+#define T1C_CONSUMER_GUI                 0
+#define T1C_CONSUMER_VID                 1
+#define T1C_CONSUMER_WEB                 2
+
+#define T1C_NUM_CONSUMERS                3
+
+// Frame replay sources (for t1c_set_replay_source)
+#define T1C_REPLAY_OFF                   0
+#define T1C_REPLAY_FILE                  1
+#define T1C_REPLAY_HOST                  2
+
+// Temporal noise reduction levels (for t1c_set_tnr_level)
+#define T1C_TNR_OFF                      0
+#define T1C_TNR_LOW                      1
+#define T1C_TNR_MED                      2
+#define T1C_TNR_HIGH                     3
+
+#define T1C_TNR_NUM_LEVELS               4
+
+// Pixels that change by T1C_TNR_MOTION_THRESH (Y16 counts) or more between frames are
+// considered motion and are not filtered
+#define T1C_TNR_MOTION_SHIFT             5
+#define T1C_TNR_MOTION_THRESH            (1 << T1C_TNR_MOTION_SHIFT)
+
+// Change detection modes (for t1c_set_change_detect).  Pixels that differ from a slowly
+// updated background by more than the threshold (Y16 counts) are marked in chg_mask.
+#define T1C_CHG_OFF                      0
+#define T1C_CHG_ANY                      1
+#define T1C_CHG_WARMER                   2
+#define T1C_CHG_COOLER                   3
+
+#define T1C_CHG_NUM_MODES                4
+
+#define T1C_CHG_THRESH_MIN               4
+#define T1C_CHG_THRESH_MAX               4096
+
+// Maximum number of frames averaged for a picture (for t1c_set_picture_avg)
+#define T1C_PICTURE_AVG_MAX              64
+
+// Sources holding off automatic FFC (for t1c_set_ffc_hold)
+#define T1C_FFC_HOLD_BURST               0x01
+#define T1C_FFC_HOLD_RECORD              0x02
+#define T1C_FFC_HOLD_TIMELAPSE           0x04
+#define T1C_FFC_HOLD_DPC                 0x08     // Used by t1c_task during dead pixel detection
+
+// Dead pixel detection (for t1c_get_dpc_status)
+#define T1C_DPC_MAX_POINTS               32
+#define T1C_DPC_DETECT_FRAMES            64
+
+#define T1C_DPC_ST_IDLE                  0        // No proposed points
+#define T1C_DPC_ST_DETECT                1        // Analyzing frames
+#define T1C_DPC_ST_FOUND                 2        // Proposed points found (corrected by t1c_task)
+#define T1C_DPC_ST_APPLY                 3        // Adding the points to the Tiny1C table
+#define T1C_DPC_ST_APPLIED               4        // Points saved in the Tiny1C table
+#define T1C_DPC_ST_FAILED                5        // Too many points found or the Tiny1C update failed
+
+// Tiny1C firmware update (for t1c_start_fw_update).  Buffers are a multiple of the Tiny1C
+// flash sector size so each one is erased and written on its own.
+#define T1C_FW_UPD_NUM_BUFS              2
+#define T1C_FW_UPD_BUF_LEN               (32*1024)
+#define T1C_FW_UPD_MAX_LEN               (4*1024*1024)
+
+
+
+//
+// Tiny1C Task typedefs
+//
+typedef struct {
+	uint32_t frames;                           // Frames acquired and pushed to consumers
+	uint32_t sensor_skipped;                   // Frames skipped by the Tiny1C frame index
+	uint32_t vospi_bad;                        // Corrupt frames skipped
+	uint32_t vospi_freq_khz;                   // Current VOSPI clock
+	uint32_t consumed[T1C_NUM_CONSUMERS];      // Frames read by each consumer
+	uint32_t dropped[T1C_NUM_CONSUMERS];       // Frames overwritten before a consumer read them
+} t1c_frame_stats_t;
+
+// Per-frame scene statistics for event triggers
+typedef struct {
+	uint32_t frame_seq;
+	int64_t frame_usec;
+	bool temp_valid;                           // Set when max_temp has been measured
+	uint16_t max_temp;                         // Region max (scene max without a region) in 1/16 °K
+	uint16_t motion;                           // Mean change in the block averaged Y16 image
+} t1c_scene_stats_t;
+
+// Scene statistics motion signature (blocks averaged across the image)
+#define T1C_MOTION_BLOCK_SIZE            16
+#define T1C_MOTION_BLOCKS_W              (T1C_WIDTH / T1C_MOTION_BLOCK_SIZE)
+#define T1C_MOTION_BLOCKS_H              (T1C_HEIGHT / T1C_MOTION_BLOCK_SIZE)
+
+// Dead pixel detection and correction state
+typedef struct {
+	int state;                                 // T1C_DPC_ST_xxx
+	int progress;                              // Percent of the detection completed
+	int num_points;
+	IrPoint_t points[T1C_DPC_MAX_POINTS];      // Image coordinates in row order
+} t1c_dpc_status_t;
 
 
 
@@ -81,8 +206,82 @@ void t1c_set_spot_enable(bool en);
 void t1c_set_spot_location(uint16_t x, uint16_t y);
 void t1c_set_minmax_marker_enable(bool en);
 void t1c_set_minmax_temp_enable(bool en);
+void t1c_set_auto_gain_enable(bool en);
 void t1c_set_region_enable(bool en);
 void t1c_set_region_location(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void t1c_set_agc_mode(int mode);
+void t1c_set_tnr_level(int level);
+void t1c_set_y8_filter(int mode, uint8_t outputs);
+void t1c_set_change_detect(int mode, uint16_t threshold);
+
+// Called by file_task to copy the next n frames (up to FILE_BURST_MAX_FRAMES) into
+// file_burst_buffer.  FILE_NOTIFY_T1C_BURST_MASK is sent when they have been captured.
+// Up to pre frames already held in the pre-trigger ring start the burst.
+// t1c_get_burst_frames returns the index of the first frame and sets the total number
+// of frames.  Frames wrap around the end of file_burst_buffer.
+void t1c_start_burst(int n, int pre);
+int t1c_get_burst_frames(int* num);
+
+// Called by file_task for a synchronized capture.  Once a frame acquired at or after
+// target_usec (esp_timer time) is in the pre-trigger ring the ring frame acquired closest
+// to it is handed to file_task as a one frame burst (FILE_NOTIFY_T1C_BURST_MASK).  The
+// pre-trigger ring must be enabled.
+void t1c_start_sync_capture(int64_t target_usec);
+
+// Called by file_task to hold the Tiny1C's automatic shutter off while it is capturing
+// (T1C_FFC_HOLD_xxx, each set and cleared independently).  Sending T1C_NOTIFY_FILE_PRE_FFC_MASK
+// just before a scheduled capture runs an FFC if the last one wasn't recent.
+// t1c_get_ffc_age_msec returns the time since the last shutter event.
+void t1c_set_ffc_hold(uint32_t source, bool hold);
+uint32_t t1c_get_ffc_age_msec();
+
+// Dead pixel detection.  T1C_NOTIFY_DPC_DETECT_MASK analyzes the next T1C_DPC_DETECT_FRAMES
+// frames (of a uniform scene) for pixels that are stuck or differ from their neighbors.  The
+// points found are corrected in the image by t1c_task until T1C_NOTIFY_DPC_APPLY_MASK adds
+// them to the Tiny1C dead pixel table and saves it.  T1C_NOTIFY_DPC_CLEAR_MASK discards them.
+void t1c_get_dpc_status(t1c_dpc_status_t* status);
+
+// Tiny1C firmware update.  file_task calls t1c_start_fw_update with the length of the image
+// (returns false if an update can't be started) and then fills each buffer it gets from
+// t1c_fw_update_get_buffer with the next T1C_FW_UPD_BUF_LEN bytes of the image (or what
+// is left) and hands it back with t1c_fw_update_put_buffer.  t1c_task writes one buffer into
+// the Tiny1C while the next is being read.  t1c_fw_update_get_buffer returns NULL if the
+// update was stopped and putting a buffer with len 0 aborts it.  t1c_task reports progress
+// and the result to the output task and then shuts the system down.
+bool t1c_start_fw_update(uint32_t len);
+uint8_t* t1c_fw_update_get_buffer();
+void t1c_fw_update_put_buffer(uint8_t* buf, uint32_t len);
+
+// Number of consecutive frames (1 - T1C_PICTURE_AVG_MAX) averaged into the image sent to
+// file_task for T1C_NOTIFY_FILE_GET_AVG_MASK (along with averaged spot, region and
+// min/max temperatures).  1 makes it the same as T1C_NOTIFY_FILE_GET_IMAGE_MASK.
+void t1c_set_picture_avg(int n);
+int t1c_get_picture_avg();
+
+// Called by file_task to keep the most recent frames in file_burst_buffer as a pre-trigger
+// ring.  The ring is stopped when a burst is captured so the frames can be saved.
+void t1c_set_burst_ring_enable(bool en);
+
+// Called by file_task to have scene statistics computed for each frame.
+// FILE_NOTIFY_T1C_STATS_MASK is sent when new statistics are available.
+void t1c_set_scene_stats_enable(bool en);
+void t1c_get_scene_stats(t1c_scene_stats_t* stats);
+
+// Mean and standard deviation (1/16 °K) of any rectangle (inclusive image coordinates) of
+// the most recent temperature frame.  While enabled t1c_task builds summed-area tables
+// from each frame so a query costs the same for any size or number of rectangles and
+// needs no CCI access.  Requires T1C_LOCAL_RADIOMETRY.  t1c_get_rect_stats returns false
+// if statistics aren't available.
+void t1c_set_rect_stats_enable(bool en);
+bool t1c_get_rect_stats(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t* mean, uint16_t* stddev);
+
+// ROI table geometry (counts and points).  Measurements are cleared when the table is set.
+void t1c_set_roi_table(const t1c_roi_table_t* roi);
+void t1c_get_roi_table(t1c_roi_table_t* roi);
+
+// Set the order measurements are requested from the Tiny1C when more than one is due (lower
+// priority values first) and how many frames between each update (1 = every frame)
+void t1c_set_meas_schedule(int meas, int priority, int period_frames);
 
 void t1c_set_ambient_temp(int16_t t, bool valid);
 void t1c_set_ambient_humidity(uint16_t h, bool valid);
@@ -95,7 +294,39 @@ bool t1c_set_param_tpd(uint8_t param, uint16_t param_value);
 // Called before initiating a calibration activity, contains the temp in °K
 void t1c_set_blackbody_temp(uint16_t temp_k);
 
+// Progress of the current (or last) calibration or restore activity, updated before each
+// progress notification to the output task
+void t1c_get_activity_progress(int* step, int* num_steps);
+
 char* t1c_get_module_version();
 char* t1c_get_module_sn();
 
+// Frame period jitter (average and maximum deviation from the frame period) over the last
+// measurement window
+void t1c_get_frame_jitter(uint32_t* avg_usec, uint32_t* max_usec);
+
+// Acquisition is throttled while no consumer needs every frame (an iCamMini in WiFi mode
+// without a client or multicast stream and nothing being captured).  A task that starts
+// consuming frames calls t1c_wake so the next frame is acquired immediately at the full
+// rate.  t1c_is_idle returns true while throttled.
+void t1c_wake();
+bool t1c_is_idle();
+
+// Frame accounting.  Consumers note each frame they read (using the frame_seq from its
+// t1c_buffer_t) so frames they missed may be counted.  A consumer is reset when it stops
+// reading frames intentionally (e.g. streaming is disabled).
+void t1c_note_frame_consumed(int consumer, uint32_t frame_seq);
+void t1c_reset_frame_consumers();
+void t1c_get_frame_stats(t1c_frame_stats_t* stats);
+
+// Frame replay.  Replaces the Tiny1C image data with frames loaded into t1c_replay_buffer
+// by file_task (T1C_REPLAY_FILE) or a command handler (T1C_REPLAY_HOST).  The loader gets
+// the buffer to fill (NULL until t1c_task has taken the previous frame) and then marks it
+// loaded.  Each frame is used until the next one is loaded.  The Tiny1C image is used until
+// the first frame is loaded.
+void t1c_set_replay_source(int src);
+int t1c_get_replay_source();
+uint16_t* t1c_get_replay_buffer();
+void t1c_set_replay_frame_loaded(bool high_gain);
+
 #endif /* T1C_TASK_H */
\ No newline at end of file
@@ -22,6 +22,7 @@
 #include "esp_spiffs.h"
 #include "t1c_tau.h"
 #include <math.h>
+#include <stdlib.h>
 
 
 //
@@ -41,13 +42,22 @@
 // but I've put nothing in there
 #define SEARCHABLE_TEMP_ENTRIES (TAU_TABLE_NUM_TEMP-1)
 #define SEARCHABLE_DIST_ENTRIES (TAU_TABLE_NUM_DIST)
+#define SEARCHABLE_HUM_ENTRIES  (TAU_TABLE_NUM_HUM)
 
 //
 // Variables
 //
 static const char* TAG = "t1c_tau";
 
-static uint16_t correct_table[TAU_TABLE_SIZE]={0};
+// Both gain correction tables are kept resident so switching gain is just a pointer change
+static uint16_t correct_tables[2][TAU_TABLE_SIZE]={{0}};
+static uint16_t* correct_table = correct_tables[LOW_GAIN];
+static bool correct_tables_loaded = false;
+
+// Tau cache
+static bool tau_cache_valid = false;
+static int32_t tau_cache_key[3];
+static uint16_t tau_cache_value;
 
 // Lookup tables to find indexes into correct_table
 // (from Tiny1C Ambient Correction Document - note it doesn't use humidity at this time)
@@ -60,14 +70,19 @@ static float dist_array[] = {0.25, 0.30, 0.35, 0.40, 0.45, 0.50, 0.55, 0.60, 0.6
                              13.00, 14.00, 16.00, 18.00, 20.00, 22.00, 24.00, 26.00, 28.00, \
                              30.00, 35.00, 40.00, 45.00, 50.00};
 
+// The correction document doesn't specify the humidity points (and the supplied tables
+// contain the same data at each level) so we assume they are evenly spaced
+static float hum_array[] = {0, 33.3, 66.7, 100};
+
 
 
 //
 // Forward declarations for internal functions
 //
-static void _lookup_temp_indices(float t, int* i1, float* i1_fit, int* i2, float* i2_fit);
-static void _lookup_dist_indices(float d, int* i1, float* i1_fit, int* i2, float* i2_fit);
+static void _lookup_indices(float v, const float* axis, int len, int* i1, float* i1_fit, int* i2, float* i2_fit);
+static float _bilinear_tau(int hi, int ti1, float ti1_fit, int ti2, float ti2_fit, int di1, float di1_fit, int di2, float di2_fit);
 static float _lookup_tau_value(int hi, int ti, int di);
+static int _read_table_file(const char* name, uint16_t* table);
 #ifdef DIAG_DUMP_TABLES
 static void _dump_table(uint16_t* table, int len);
 #endif
@@ -76,12 +91,10 @@ static void _dump_table(uint16_t* table, int len);
 //
 // API
 //
-int read_correct_table(int gain)
+int read_correct_tables()
 {
-	FILE* f;
 	esp_err_t ret;
-	int n;
-	int f_ret = SUCCESS;
+	int f_ret;
 	
 	esp_vfs_spiffs_conf_t conf = {
 		.base_path = "/spiffs",
@@ -103,88 +116,49 @@ int read_correct_table(int gain)
         return FAIL;
     }
     
-    // Open correction file
-    if (gain == HIGH_GAIN) {
-    	f = fopen("/spiffs/tau_H.bin", "r");
-    } else {
-    	f = fopen("/spiffs/tau_L.bin", "r");
-    }
-    if (f == NULL) {
-        ESP_LOGE(TAG, "Failed to open tau file");
-        f_ret = FAIL;
-        goto clean;
-    }
-    
-    // Read the file into correct_table
-    n = fread(correct_table, 1, sizeof(correct_table), f);
-    if (n != sizeof(correct_table)) {
-       ESP_LOGE(TAG, "Read %d bytes in tau data, expected %d", n, sizeof(correct_table));
-        f_ret = FAIL;
-        goto clean;
+    // Read both tables
+    f_ret = _read_table_file("/spiffs/tau_L.bin", correct_tables[LOW_GAIN]);
+    if (f_ret == SUCCESS) {
+    	f_ret = _read_table_file("/spiffs/tau_H.bin", correct_tables[HIGH_GAIN]);
     }
+    correct_tables_loaded = (f_ret == SUCCESS);
     
-    if (gain == HIGH_GAIN) {
-    	ESP_LOGI(TAG, "Read tau table: tau_H.bin");
-    } else {
-    	ESP_LOGI(TAG, "Read tau table: tau_L.bin");
-    }
-    
-#ifdef DIAG_DUMP_TABLES
-    _dump_table(correct_table, TAU_TABLE_SIZE);
-#endif
-
-clean:
-	if (f != NULL) {
-		fclose(f);
-	}
 	esp_vfs_spiffs_unregister(NULL);
 	return f_ret;
 }
 
 
-uint16_t estimate_tau(float ta, float dist, float hum)
+int select_correct_table(int gain)
 {
-	int hi;
-	int ti1, ti2, di1, di2;
-	float ti1_fit, ti2_fit, di1_fit, di2_fit;
-	float p11, p21, p12, p22;
-	float r1, r2, tau_f;
-	uint16_t t1c_tau;
-	
-	// Bilinear Fit
-	//
-	//     d
-	//     ^
-	//     |
-	// di2 |    P12       R2     P22
-	//     |              P
-	//     |
-	// di1 |    P11       R1     P21
-	//     |
-	//     +---------------------------> t
-	//           |                |
-	//          ti1              ti2
-	//
+	if (!correct_tables_loaded) {
+		ESP_LOGE(TAG, "Tau tables not loaded");
+		return FAIL;
+	}
 	
-	// For now we just ignore the humidity value
-	hi = 0;
+	correct_table = correct_tables[(gain == HIGH_GAIN) ? HIGH_GAIN : LOW_GAIN];
 	
-	// Look up the four indices (at the one humidity level) bracketing the desired tau value
-	_lookup_temp_indices(ta, &ti1, &ti1_fit, &ti2, &ti2_fit);
-	_lookup_dist_indices(dist, &di1, &di1_fit, &di2, &di2_fit);
+	// Cached values no longer apply
+	tau_cache_valid = false;
 	
-	// Get the integer tau values at the four points
-	p11 = _lookup_tau_value(hi, ti1, di1);
-	p21 = _lookup_tau_value(hi, ti2, di1);
-	p12 = _lookup_tau_value(hi, ti1, di2);
-	p22 = _lookup_tau_value(hi, ti2, di2);
+	return SUCCESS;
+}
+
+
+uint16_t estimate_tau(float ta, float dist, float hum)
+{
+	int hi1, hi2, ti1, ti2, di1, di2;
+	float hi1_fit, hi2_fit, ti1_fit, ti2_fit, di1_fit, di2_fit;
+	float tau_f;
+	uint16_t t1c_tau;
 	
-	// Compute the intermediate values in the t axis
-	r1 = p11 * ti1_fit + p21 * ti2_fit;
-	r2 = p12 * ti1_fit + p22 * ti2_fit;
+	// Trilinear Fit - a bilinear fit in the temperature and distance axes at the two humidity
+	// levels bracketing hum followed by a linear fit between them
+	_lookup_indices(hum, hum_array, SEARCHABLE_HUM_ENTRIES, &hi1, &hi1_fit, &hi2, &hi2_fit);
+	_lookup_indices(ta, temp_array, SEARCHABLE_TEMP_ENTRIES, &ti1, &ti1_fit, &ti2, &ti2_fit);
+	_lookup_indices(dist, dist_array, SEARCHABLE_DIST_ENTRIES, &di1, &di1_fit, &di2, &di2_fit);
 	
-	// Finally compute P in the d axis
-	tau_f = r1 * di1_fit + r2 * di2_fit;
+	tau_f = _bilinear_tau(hi1, ti1, ti1_fit, ti2, ti2_fit, di1, di1_fit, di2, di2_fit) * hi1_fit;
+	tau_f += _bilinear_tau(hi2, ti1, ti1_fit, ti2, ti2_fit, di1, di1_fit, di2, di2_fit) * hi2_fit;
 	
 #ifdef DIAG_PRINT_VALS
 	ESP_LOGI(TAG, "estimate_tau(%1.1f, %1.1f, %1.1f) = %1.2f", ta, dist, hum, tau_f);
@@ -195,16 +169,43 @@ uint16_t estimate_tau(float ta, float dist, float hum)
 }    
 
 
+uint16_t estimate_tau_cached(float ta, float dist, float hum)
+{
+	int32_t key[3];
+	uint16_t t1c_tau;
+	
+	key[0] = (int32_t) lroundf(ta / TAU_CACHE_TEMP_STEP);
+	key[1] = (int32_t) lroundf(dist / TAU_CACHE_DIST_STEP);
+	key[2] = (int32_t) lroundf(hum / TAU_CACHE_HUM_STEP);
+	
+	if (tau_cache_valid && (key[0] == tau_cache_key[0]) && (key[1] == tau_cache_key[1]) && (key[2] == tau_cache_key[2])) {
+		return tau_cache_value;
+	}
+	
+	t1c_tau = estimate_tau(ta, dist, hum);
+	if (!tau_cache_valid || (abs((int) t1c_tau - (int) tau_cache_value) >= TAU_CACHE_HYSTERESIS)) {
+		tau_cache_value = t1c_tau;
+	}
+	tau_cache_key[0] = key[0];
+	tau_cache_key[1] = key[1];
+	tau_cache_key[2] = key[2];
+	tau_cache_valid = true;
+	
+	return tau_cache_value;
+}
+
+
 
 //
 // Internal routines
 //
-static void _lookup_temp_indices(float t, int* i1, float* i1_fit, int* i2, float* i2_fit)
+// Find the two entries in axis bracketing v and their weights
+static void _lookup_indices(float v, const float* axis, int len, int* i1, float* i1_fit, int* i2, float* i2_fit)
 {
 	int n;
 	
-	for (n=0; n<SEARCHABLE_TEMP_ENTRIES; n++) {
-		if (t < temp_array[n]) {
+	for (n=0; n<len; n++) {
+		if (v < axis[n]) {
 			if (n == 0) {
 				// Before first entry - we return both points with equal values
 				*i1 = n;
@@ -215,7 +216,7 @@ static void _lookup_temp_indices(float t, int* i1, float* i1_fit, int* i2, float
 				// Between two entries
 				*i1 = n - 1;
 				*i2 = n;
-				*i2_fit = (t - temp_array[*i1]) / (temp_array[*i2] - temp_array[*i1]);
+				*i2_fit = (v - axis[*i1]) / (axis[*i2] - axis[*i1]);
 				*i1_fit = 1.0 - *i2_fit;
 			}
 			return;
@@ -223,41 +224,45 @@ static void _lookup_temp_indices(float t, int* i1, float* i1_fit, int* i2, float
 	}
 	
 	// After final entry
-	*i1 = SEARCHABLE_TEMP_ENTRIES - 1;
+	*i1 = len - 1;
 	*i1_fit = 0.5;
-	*i2 = SEARCHABLE_TEMP_ENTRIES - 1;
+	*i2 = len - 1;
 	*i2_fit = 0.5;
 }
 
 
-static void _lookup_dist_indices(float d, int* i1, float* i1_fit, int* i2, float* i2_fit)
+static float _bilinear_tau(int hi, int ti1, float ti1_fit, int ti2, float ti2_fit, int di1, float di1_fit, int di2, float di2_fit)
 {
-	int n;
+	float p11, p21, p12, p22;
+	float r1, r2;
 	
-	for (n=0; n<SEARCHABLE_DIST_ENTRIES; n++) {
-		if (d < dist_array[n]) {
-			if (n == 0) {
-				// Before first entry
-				*i1 = n;
-				*i1_fit = 0.5;
-				*i2 = n;
-				*i2_fit = 0.5;
-			} else {
-				// Between two entries
-				*i1 = n - 1;
-				*i2 = n;
-				*i2_fit = (d - dist_array[*i1]) / (dist_array[*i2] - dist_array[*i1]);
-				*i1_fit = 1.0 - *i2_fit;
-			}
-			return;
-		}
-	}
+	// Bilinear Fit
+	//
+	//     d
+	//     ^
+	//     |
+	// di2 |    P12       R2     P22
+	//     |              P
+	//     |
+	// di1 |    P11       R1     P21
+	//     |
+	//     +---------------------------> t
+	//           |                |
+	//          ti1              ti2
+	//
 	
-	// After final entry
-	*i1 = SEARCHABLE_DIST_ENTRIES - 1;
-	*i1_fit = 0.5;
-	*i2 = SEARCHABLE_DIST_ENTRIES - 1;
-	*i2_fit = 0.5;
+	// Get the integer tau values at the four points
+	p11 = _lookup_tau_value(hi, ti1, di1);
+	p21 = _lookup_tau_value(hi, ti2, di1);
+	p12 = _lookup_tau_value(hi, ti1, di2);
+	p22 = _lookup_tau_value(hi, ti2, di2);
+	
+	// Compute the intermediate values in the t axis
+	r1 = p11 * ti1_fit + p21 * ti2_fit;
+	r2 = p12 * ti1_fit + p22 * ti2_fit;
+	
+	// Finally compute P in the d axis
+	return r1 * di1_fit + r2 * di2_fit;
 }
 
 
@@ -282,6 +287,34 @@ static float _lookup_tau_value(int hi, int ti, int di)
 }
 
 
+static int _read_table_file(const char* name, uint16_t* table)
+{
+	FILE* f;
+	int n;
+	
+    f = fopen(name, "r");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", name);
+        return FAIL;
+    }
+    
+    n = fread(table, 1, TAU_TABLE_SIZE*sizeof(uint16_t), f);
+    fclose(f);
+    if (n != TAU_TABLE_SIZE*sizeof(uint16_t)) {
+        ESP_LOGE(TAG, "Read %d bytes in %s, expected %d", n, name, TAU_TABLE_SIZE*sizeof(uint16_t));
+        return FAIL;
+    }
+    
+    ESP_LOGI(TAG, "Read tau table: %s", name);
+    
+#ifdef DIAG_DUMP_TABLES
+    _dump_table(table, TAU_TABLE_SIZE);
+#endif
+
+	return SUCCESS;
+}
+
+
 #ifdef DIAG_DUMP_TABLES
 static void _dump_table(uint16_t* table, int len)
 {
@@ -34,6 +34,12 @@
 
 #define TAU_TABLE_SIZE (TAU_TABLE_NUM_HUM*TAU_TABLE_NUM_TEMP*TAU_TABLE_NUM_DIST)
 
+// Cache quantization (°C, M, %) and minimum change in the returned TAU value
+#define TAU_CACHE_TEMP_STEP   1.0
+#define TAU_CACHE_DIST_STEP   0.05
+#define TAU_CACHE_HUM_STEP    10.0
+#define TAU_CACHE_HYSTERESIS  2
+
 // Gain selectors
 #define HIGH_GAIN 1
 #define LOW_GAIN  0
@@ -44,8 +50,11 @@
 //
 // Functions return 0 for success, -1 for failure
 
-// read the environmental correction table from SPIFFS
-int read_correct_table(int gain);
+// read both environmental correction tables from SPIFFS (once at startup)
+int read_correct_tables();
+
+// select the correction table for a gain (HIGH_GAIN or LOW_GAIN)
+int select_correct_table(int gain);
 
 // Estimate tau using the correction table
 //  ta : Ambient temp °C
@@ -54,4 +63,9 @@ int read_correct_table(int gain);
 //  returns 8-bit TAU value for Tiny1c (1 - 128)
 uint16_t estimate_tau(float ta, float dist, float hum);
 
+// Cached version of estimate_tau for frequently changing conditions.  Returns the last
+// value until the quantized conditions change and the new value differs from it by at
+// least TAU_CACHE_HYSTERESIS.  The cache is cleared when a correction table is selected.
+uint16_t estimate_tau_cached(float ta, float dist, float hum);
+
 #endif /* _T1C_TEMP_H_ */
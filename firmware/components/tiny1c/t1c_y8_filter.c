@@ -0,0 +1,125 @@
+/*
+ * Spatial filter utility functions for 8-bit scaled Tiny1C image data.  A 3x3 binomial
+ * (1-2-1) kernel is applied separably, one row at a time, using a ring of three
+ * horizontally filtered rows so the source plane is only read once.  The local mean is
+ * used either for an edge-preserving denoise or an unsharp mask.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "t1c_y8_filter.h"
+#include <string.h>
+
+
+
+//
+// Forward declarations for internal functions
+//
+static void _filter_row_h(const uint8_t* src, uint16_t* dst, int w);
+static void _filter_row_denoise(const uint8_t* src, const uint16_t* a, const uint16_t* c, const uint16_t* b, uint8_t* dst, int w);
+static void _filter_row_sharpen(const uint8_t* src, const uint16_t* a, const uint16_t* c, const uint16_t* b, uint8_t* dst, int w);
+
+
+
+//
+// API
+//
+void t1c_y8_filter(int mode, const uint8_t* src, uint8_t* dst, int w, int h, uint16_t* ring)
+{
+	int y;
+	uint16_t* aP;
+	uint16_t* cP;
+	uint16_t* bP;
+	void (*filter_row)(const uint8_t* src, const uint16_t* a, const uint16_t* c, const uint16_t* b, uint8_t* dst, int w);
+	
+	if ((mode == T1C_Y8F_MODE_OFF) || (mode >= T1C_Y8F_NUM_MODES) || (w < 2) || (h < 2)) {
+		memcpy(dst, src, w*h);
+		return;
+	}
+	
+	// Select the row kernel once instead of testing the mode on each pixel
+	filter_row = (mode == T1C_Y8F_MODE_DENOISE) ? _filter_row_denoise : _filter_row_sharpen;
+	
+	// Row y is held in ring entry (y % 3).  The row above the first and below the last are
+	// replicated from the edge rows.
+	_filter_row_h(src, ring, w);
+	for (y=0; y<h; y++) {
+		if (y < (h-1)) {
+			_filter_row_h(src + (y+1)*w, ring + ((y+1) % 3)*w, w);
+		}
+		cP = ring + (y % 3)*w;
+		aP = (y == 0) ? cP : ring + ((y+2) % 3)*w;
+		bP = (y == (h-1)) ? cP : ring + ((y+1) % 3)*w;
+		filter_row(src + y*w, aP, cP, bP, dst + y*w, w);
+	}
+}
+
+
+
+//
+// Internal functions
+//
+
+// Horizontal pass: 1-2-1 sum (4x the mean) with the edge pixels replicated
+static void _filter_row_h(const uint8_t* src, uint16_t* dst, int w)
+{
+	int x;
+	
+	*dst++ = 3*src[0] + src[1];
+	for (x=1; x<(w-1); x++) {
+		*dst++ = src[x-1] + 2*src[x] + src[x+1];
+	}
+	*dst = src[w-2] + 3*src[w-1];
+}
+
+
+// Vertical pass with the rows above (a), at (c) and below (b) the source row giving the
+// local mean.  Pixels near their mean take it and pixels that differ by more than
+// T1C_Y8F_EDGE_THRESH are edges (or small hot or cold spots) and are left alone.
+static void _filter_row_denoise(const uint8_t* src, const uint16_t* a, const uint16_t* c, const uint16_t* b, uint8_t* dst, int w)
+{
+	int32_t m, d;
+	
+	while (w--) {
+		m = (*a++ + 2*(*c++) + *b++ + 8) >> 4;
+		d = m - *src;
+		if ((d <= T1C_Y8F_EDGE_THRESH) && (d >= -T1C_Y8F_EDGE_THRESH)) {
+			*dst++ = (uint8_t) m;
+		} else {
+			*dst++ = *src;
+		}
+		src++;
+	}
+}
+
+
+// Vertical pass for an unsharp mask: the pixel plus a multiple of its difference from the
+// local mean (clamped)
+static void _filter_row_sharpen(const uint8_t* src, const uint16_t* a, const uint16_t* c, const uint16_t* b, uint8_t* dst, int w)
+{
+	int32_t m, d, t;
+	
+	while (w--) {
+		m = (*a++ + 2*(*c++) + *b++ + 8) >> 4;
+		d = *src - m;
+		if ((d < T1C_Y8F_SHARPEN_CORE) && (d > -T1C_Y8F_SHARPEN_CORE)) {
+			*dst++ = *src;
+		} else {
+			t = *src + ((d * T1C_Y8F_SHARPEN_GAIN) / 4);
+			*dst++ = (t < 0) ? 0 : ((t > 255) ? 255 : (uint8_t) t);
+		}
+		src++;
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * Spatial filter utility functions for 8-bit scaled Tiny1C image data.  A 3x3 binomial
+ * (1-2-1) kernel is applied separably, one row at a time, using a ring of three
+ * horizontally filtered rows so the source plane is only read once.  The local mean is
+ * used either for an edge-preserving denoise or an unsharp mask.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * It is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef _T1C_Y8_FILTER_H_
+#define _T1C_Y8_FILTER_H_
+
+#include <stdint.h>
+
+
+//
+// Constants
+//
+
+// Filter modes (values used by CMD_SPATIAL_FILTER and stored persistently)
+#define T1C_Y8F_MODE_OFF         0
+#define T1C_Y8F_MODE_DENOISE     1
+#define T1C_Y8F_MODE_SHARPEN     2
+
+#define T1C_Y8F_NUM_MODES        3
+
+// Denoise: pixels further than this from their local mean are treated as edges and kept
+#define T1C_Y8F_EDGE_THRESH      12
+
+// Sharpen: detail (difference from the local mean) is boosted by
+// T1C_Y8F_SHARPEN_GAIN / 4 unless it is smaller than T1C_Y8F_SHARPEN_CORE (noise)
+#define T1C_Y8F_SHARPEN_GAIN     3
+#define T1C_Y8F_SHARPEN_CORE     2
+
+
+//
+// API
+//
+
+// Filter the w x h plane src into dst (which must not be src).  ring holds 3*w entries
+// and should be in internal RAM.
+void t1c_y8_filter(int mode, const uint8_t* src, uint8_t* dst, int w, int h, uint16_t* ring);
+
+#endif /* _T1C_Y8_FILTER_H_ */
@@ -119,3 +119,37 @@ float temp_to_float_temp(uint16_t v, bool temp_unit_C)
 	
 	return t;
 }
+
+
+void temp_fixed_conv_init(temp_fixed_conv_t* conv, bool temp_unit_C)
+{
+	if (temp_unit_C) {
+		// v * 100/16 - 27315
+		conv->mult = 1600;
+		conv->offset = -27315*256 + 128;
+	} else {
+		// (v/16 - 273.15) * 9/5 + 32 = v * 0.1125 - 459.67
+		conv->mult = 2880;
+		conv->offset = -45967*256 + 128;
+	}
+}
+
+
+void temp_to_fixed_temps(const temp_fixed_conv_t* conv, const uint16_t* v, int32_t* t, int n)
+{
+	int32_t m = conv->mult;
+	int32_t o = conv->offset;
+	
+	while (n >= 4) {
+		t[0] = ((int32_t) v[0] * m + o) >> 8;
+		t[1] = ((int32_t) v[1] * m + o) >> 8;
+		t[2] = ((int32_t) v[2] * m + o) >> 8;
+		t[3] = ((int32_t) v[3] * m + o) >> 8;
+		v += 4;
+		t += 4;
+		n -= 4;
+	}
+	while (n-- > 0) {
+		*t++ = ((int32_t) *v++ * m + o) >> 8;
+	}
+}
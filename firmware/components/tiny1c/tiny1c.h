@@ -20,6 +20,7 @@
 #define _TINY1C_H_
 
 #include "falcon_cmd.h"
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include <stdbool.h>
@@ -33,14 +34,79 @@
 #define T1C_WIDTH  256
 #define T1C_HEIGHT 192
 
+// Number of image planes in the frame pool (one each for the two output buffers, the file
+// buffer, the AUX port buffer when it is enabled and the frame currently being read).  Each
+// Y16 plane has a paired Y8 plane.
+#ifdef CONFIG_AUX_UART_ENABLE
+#define T1C_Y16_POOL_LEN 5
+#else
+#define T1C_Y16_POOL_LEN 4
+#endif
+
+// Changed pixel mask words (32 pixels each) paired with each Y16 plane.  Rows start on a
+// word boundary since T1C_WIDTH is a multiple of 32.
+#define T1C_CHG_MASK_WORDS (T1C_WIDTH*T1C_HEIGHT/32)
+
+// ROI table capacity (in addition to the spot meter and region)
+#define T1C_ROI_MAX_SPOTS 8
+#define T1C_ROI_MAX_RECTS 4
+#define T1C_ROI_MAX_LINES 2
+
+// Image statistics for live displays.  The histogram is the row kernels' Y16 histogram
+// reduced to fewer bins.  The profile follows ROI table line 0 and is averaged down when
+// the line is longer (every t1c_buffer_t carries a copy so both are kept small).
+#define T1C_IMG_STATS_HIST_BINS   64
+#define T1C_IMG_STATS_PROFILE_MAX 64
+
+// Outputs that may use the spatially filtered Y8 plane (bit mask)
+#define T1C_Y8F_OUT_GUI   0x01
+#define T1C_Y8F_OUT_VID   0x02
+#define T1C_Y8F_OUT_SAVE  0x04
+
+#define T1C_Y8F_OUT_MASK  0x07
+
 
 
 //
 // Data Structures
 //
 
+// Table of additional measurement regions.  Only the first num_xxx entries of each type are
+// in use.  Bit n of a valid mask is set when entry n has a temperature measurement.  An entry
+// with a non-zero emissivity (percent) has its temperatures corrected from the global
+// emissivity the Tiny1C measures with.
+typedef struct {
+	uint8_t num_spots;
+	uint8_t num_rects;
+	uint8_t num_lines;
+	uint8_t spot_valid_mask;
+	uint8_t rect_valid_mask;
+	uint8_t line_valid_mask;
+	IrPoint_t spot_points[T1C_ROI_MAX_SPOTS];
+	uint16_t spot_temps[T1C_ROI_MAX_SPOTS];
+	IrRect_t rect_points[T1C_ROI_MAX_RECTS];
+	TpdLineRectTempInfo_t rect_temp_info[T1C_ROI_MAX_RECTS];
+	IrLine_t line_points[T1C_ROI_MAX_LINES];
+	TpdLineRectTempInfo_t line_temp_info[T1C_ROI_MAX_LINES];
+	uint8_t spot_emissivity[T1C_ROI_MAX_SPOTS];
+	uint8_t rect_emissivity[T1C_ROI_MAX_RECTS];
+	uint8_t line_emissivity[T1C_ROI_MAX_LINES];
+} t1c_roi_table_t;
+
+// Per-frame statistics gathered without another pass over the image
+typedef struct {
+	uint16_t hist[T1C_IMG_STATS_HIST_BINS];
+	uint16_t hist_base;                // Y16 value at the start of bin 0
+	uint8_t hist_shift;                // Each bin covers (1 << hist_shift) Y16 values
+	uint16_t profile_len;              // Samples in profile (0 if there is no ROI line)
+	uint16_t profile[T1C_IMG_STATS_PROFILE_MAX];  // Y16 values from the start of ROI line 0
+} t1c_img_stats_t;
+
 // Tiny1C per-image data structure
 typedef struct {
+	uint32_t frame_seq;                // Incremented by t1c_task for each frame pushed
+	uint16_t frame_index;              // Tiny1C frame index from the VOSPI header
+	int64_t frame_usec;                // esp_timer time the frame was acquired
 	bool high_gain;
 	bool vid_frozen;
 	bool spot_valid;
@@ -49,10 +115,20 @@ typedef struct {
 	bool amb_temp_valid;
 	bool amb_hum_valid;
 	bool distance_valid;
+	bool y16_is_temp;                  // img_data is temperature (1/16 °K) instead of gamma
 	int16_t amb_temp;
 	uint16_t* img_data;
+	uint32_t img_hash;                 // Hash of img_data (the same for unchanged frames)
+	uint8_t* y8_data;                  // img_data linearly scaled to 8-bits by t1c_task
+	uint8_t* y8_filt_data;             // y8_data spatially filtered by t1c_task
+	uint8_t y8_filt_mask;              // T1C_Y8F_OUT_xxx outputs that should use y8_filt_data
+	uint32_t* chg_mask;                // Pixels changed from the background (1 bit per pixel, LSB first)
+	bool chg_valid;                    // chg_mask is valid for img_data
 	uint16_t y16_min;
 	uint16_t y16_max;
+	uint16_t agc_min;                  // Smoothed AGC range used to scale y8_data
+	uint16_t agc_max;
+	uint32_t agc_seq;                  // Changes whenever the Y16 to Y8 mapping changes
 	uint16_t amb_hum;
 	uint16_t distance;
 	uint16_t spot_temp;
@@ -60,6 +136,8 @@ typedef struct {
 	MaxMinTempInfo_t max_min_temp_info;
 	TpdLineRectTempInfo_t region_temp_info;
 	IrRect_t region_points;
+	t1c_roi_table_t roi;
+	t1c_img_stats_t img_stats;
 	SemaphoreHandle_t mutex;
 } t1c_buffer_t;
 
@@ -69,6 +147,15 @@ typedef struct {
 	uint16_t tpd_params[TPD_PROP_GAIN_SEL+1];
 } t1c_param_metadata_t;
 
+// Fixed-point conversion from Y16 temperature (1/16 °K) to hundredths of a degree C or F
+// for converting many values (temperature maps, exports).  The conversion is linear with
+// exact 8-bit fractional coefficients (6.25 or 11.25 per count) so each value is a
+// multiply and add.  Initialize with temp_fixed_conv_init when the unit changes.
+typedef struct {
+	int32_t mult;                      // Per count (8 fractional bits)
+	int32_t offset;                    // 8 fractional bits, includes rounding
+} temp_fixed_conv_t;
+
 
 
 
@@ -84,5 +171,19 @@ uint32_t param_to_emissivity_value(uint16_t p);
 uint16_t temperature_to_param_value(int32_t t);
 int32_t param_to_temperature_value(uint16_t p);
 float temp_to_float_temp(uint16_t v, bool temp_unit_C);
+void temp_fixed_conv_init(temp_fixed_conv_t* conv, bool temp_unit_C);
+void temp_to_fixed_temps(const temp_fixed_conv_t* conv, const uint16_t* v, int32_t* t, int n);
+
+// Single value fixed-point conversion (hundredths of a degree)
+static inline int32_t temp_to_fixed_temp(const temp_fixed_conv_t* conv, uint16_t v)
+{
+	return ((int32_t) v * conv->mult + conv->offset) >> 8;
+}
+
+// Get the scaled image an output should use (filtered if it has been enabled for it)
+static inline uint8_t* t1c_get_y8_data(const t1c_buffer_t* t1c, uint8_t output)
+{
+	return ((t1c->y8_filt_mask & output) != 0) ? t1c->y8_filt_data : t1c->y8_data;
+}
 
 #endif /* _TINY1C_H_ */
\ No newline at end of file
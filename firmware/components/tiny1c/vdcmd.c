@@ -7,6 +7,14 @@
 
 static const char* TAG = "vdcmd";
 
+// Expected command latencies (uSec) used to delay the first completion poll.  These are
+// conservative so the adaptive poll picks up commands that complete faster.
+#define VDCMD_LATENCY_PARAM_USEC   300
+#define VDCMD_LATENCY_TPD_USEC     1000
+#define VDCMD_LATENCY_SPI_USEC     5000
+
+static void vdcmd_set_latency_hint(uint8_t byCmdType);
+
 vdcmd_rw_handle_t vdcmd_read_handle = { 0 };
 vdcmd_rw_handle_t vdcmd_write_handle = { 0 };
 
@@ -18,10 +26,12 @@ ir_error_t vdcmd_rw_handle_register(enum product_types product_type, enum driver
         if (i2c_init() == IR_SUCCESS) {
             vdcmd_read_handle.handle = i2c_data_read;
             vdcmd_read_handle.delay = i2c_set_special_poll_delay;
+            vdcmd_read_handle.latency = i2c_set_expected_latency;
             vdcmd_read_handle.slave_id = I2C_SLAVE_ID;
 
             vdcmd_write_handle.handle = i2c_data_write;
             vdcmd_write_handle.delay = i2c_set_special_poll_delay;
+            vdcmd_write_handle.latency = i2c_set_expected_latency;
             vdcmd_write_handle.slave_id = I2C_SLAVE_ID;
         } else {
             return IR_I2C_DEVICE_OPEN_FAIL;
@@ -181,6 +191,7 @@ ir_error_t standard_cmd_read(vdcmd_std_header_t* ptVdCmdHeader, uint16_t wLen, u
             return IR_VDCMD_NOT_REGISTER;
         }
 
+        vdcmd_set_latency_hint(ptVdCmdHeader->byCmdType);
         rst = vdcmd_write_handle.handle(vdcmd_write_handle.slave_id, I2C_VD_BUFFER_RW, \
                                        sizeof(vdcmd_std_header_t), (uint8_t*)ptVdCmdHeader);
         if (rst != IR_SUCCESS)
@@ -225,6 +236,7 @@ ir_error_t standard_cmd_write(vdcmd_std_header_t* ptVdCmdHeader, uint16_t wLen,
                 return IR_VDCMD_NOT_REGISTER;
             }
             // no data stage, just send command info
+            vdcmd_set_latency_hint(ptVdCmdHeader->byCmdType);
             rst = vdcmd_write_handle.handle(vdcmd_write_handle.slave_id, I2C_VD_BUFFER_RW, \
                 sizeof(vdcmd_std_header_t), (uint8_t*)ptVdCmdHeader);
             if (rst < 0)
@@ -258,6 +270,7 @@ ir_error_t standard_cmd_write(vdcmd_std_header_t* ptVdCmdHeader, uint16_t wLen,
             ESP_LOGE(TAG, "standard_cmd_write: send write cmd failed");
             return rst;
         }
+        vdcmd_set_latency_hint(ptVdCmdHeader->byCmdType);
         dwDataOffset = 0;
         while (wTmpLen > 0)
         {
@@ -362,6 +375,7 @@ ir_error_t long_cmd_read(vdcmd_long_header_t* ptVdCmdHeader, uint16_t wParam, ui
         return rst;
     }
 
+    vdcmd_set_latency_hint(ptVdCmdHeader->byCmdType);
     rst = vdcmd_write_handle.handle(vdcmd_write_handle.slave_id, \
         I2C_VD_BUFFER_RW + 8, 8, ((uint8_t*)ptVdCmdHeader) + 8);
     if (rst != IR_SUCCESS)
@@ -419,6 +433,7 @@ ir_error_t long_cmd_write(vdcmd_long_header_t* ptVdCmdHeader, uint16_t wParam, u
         ESP_LOGE(TAG, "long_cmd_write 1 failed!");
         return rst;
     }
+    vdcmd_set_latency_hint(ptVdCmdHeader->byCmdType);
     rst = vdcmd_write_handle.handle(vdcmd_write_handle.slave_id,\
                                    I2C_VD_BUFFER_RW + 8, 8, ((uint8_t*)ptVdCmdHeader) + 8);
     if (rst != IR_SUCCESS)
@@ -437,3 +452,34 @@ void vdcmd_set_special_poll_delay(uint16_t delay_ms)
 	}
 }
 
+
+// Set the expected latency for the next command issued (commands that need a special poll
+// delay set it explicitly and it takes precedence)
+static void vdcmd_set_latency_hint(uint8_t byCmdType)
+{
+	uint32_t latency_usec;
+	
+	switch (byCmdType) {
+		case CMDTYPE_STANDARD_TYPE_ISP_PARAM:
+		case CMDTYPE_STANDARD_TYPE_PREVIEW:
+		case CMDTYPE_STANDARD_TYPE_SHUTTER:
+		case CMDTYPE_LONG_TYPE_PROP_PAGE:
+			latency_usec = VDCMD_LATENCY_PARAM_USEC;
+			break;
+		case CMDTYPE_STANDARD_TYPE_TPD:
+		case CMDTYPE_LONG_TYPE_TPD:
+			latency_usec = VDCMD_LATENCY_TPD_USEC;
+			break;
+		case CMDTYPE_STANDARD_TYPE_SPI:
+		case CMDTYPE_LONG_TYPE_SPI:
+			latency_usec = VDCMD_LATENCY_SPI_USEC;
+			break;
+		default:
+			latency_usec = 0;
+	}
+	
+	if (vdcmd_write_handle.latency != NULL) {
+		vdcmd_write_handle.latency(latency_usec);
+	}
+}
+
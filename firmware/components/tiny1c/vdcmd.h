@@ -206,10 +206,12 @@ enum driver_types
 //typedef int (*handle_func)(uint32_t param,...);
 typedef ir_error_t (*handle_func)(uint16_t byI2CSlaveID, uint16_t wI2CRegAddr, uint16_t wLen, uint8_t* pbyData);
 typedef void (*delay_func)(uint16_t delay_ms);
+typedef void (*latency_func)(uint32_t latency_usec);
 
 typedef struct {
     handle_func handle;
     delay_func delay;
+    latency_func latency;
     uint16_t slave_id;
 }vdcmd_rw_handle_t;
 
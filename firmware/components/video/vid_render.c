@@ -20,6 +20,7 @@
 #include <math.h>
 #include <string.h>
 #include "vid_render.h"
+#include "draw_utilities.h"
 #include "font.h"
 #include "font7x10.h"
 #include "esp_ota_ops.h"
@@ -34,15 +35,48 @@
 #define CLIP_REGION_TMRK  2
 #define CLIP_REGION_IMAGE 3
 
+// Text cache slots (one per overlay string)
+#define TEXT_SLOT_SPOT    0
+#define TEXT_SLOT_REGION  1
+#define TEXT_SLOT_MAX     2
+#define TEXT_SLOT_MIN     3
+#define TEXT_SLOT_PARM    4
+#define TEXT_SLOT_BATT    5
+#define TEXT_SLOT_ENV     6
+#define TEXT_SLOT_TL      7
+#define TEXT_NUM_SLOTS    8
+
+// Text cache string limits (longer strings are drawn directly)
+#define TEXT_CACHE_MAX_LEN   40
+#define TEXT_CACHE_ROW_WORDS ((TEXT_CACHE_MAX_LEN*8 + 31) / 32)
+#define TEXT_CACHE_MAX_ROWS  10
+
+// vid_render_t1c_data copies image rows a word at a time
+_Static_assert(((IMG_BUF_CMAP_WIDTH % 4) == 0) && ((T1C_WIDTH % 4) == 0), "Image rows must be word aligned");
+
 
 
 //
 // Variables
 //
-static int16_t clip_x1;
-static int16_t clip_y1;
-static int16_t clip_x2;
-static int16_t clip_y2;
+// Current clip region
+static draw_clip_t clip = {IMG_BUF_WIDTH, 0, 0, 0, IMG_BUF_WIDTH - 1, IMG_BUF_HEIGHT - 1};
+
+// Text cache.  Each slot holds the last string drawn with it rendered as a 1-bit mask per
+// row (bit 0 of word 0 is the leftmost pixel) so it is only rasterized when it changes and
+// can be drawn as runs of pixels.
+typedef struct {
+	bool valid;
+	char str[TEXT_CACHE_MAX_LEN+1];
+	uint16_t num_words;
+	uint32_t mask[TEXT_CACHE_MAX_ROWS][TEXT_CACHE_ROW_WORDS];
+} text_cache_t;
+
+static text_cache_t text_cache[TEXT_NUM_SLOTS];
+
+// Palette bar values (top to bottom) computed for the video palette in pal_bar_palette
+static uint8_t pal_bar_index[IMG_BUF_CMAP_HEIGHT];
+static int pal_bar_palette = -1;
 
 
 
@@ -52,16 +86,12 @@ static int16_t clip_y2;
 static void set_clip_region(int region);
 static void draw_min_marker(t1c_buffer_t* t1c, int16_t n, uint8_t* img);
 static void draw_max_marker(t1c_buffer_t* t1c, int16_t n, uint8_t* img);
-static void draw_temp(uint8_t* img, int16_t x, int16_t y, uint16_t v, out_state_t* g);
-static void draw_hline(uint8_t* img, int16_t x1, int16_t x2, int16_t y, uint8_t c);
-static void draw_vline(uint8_t* img, int16_t x, int16_t y1, int16_t y2, uint8_t c);
-static void draw_line(uint8_t* img, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t c);
-static void draw_circle(uint8_t* img, int16_t x0, int16_t y0, int16_t r, uint8_t c);
-static void draw_rect(uint8_t* img, int16_t x, int16_t y, int16_t w, int16_t h, uint8_t c);
-static void draw_fill_rect(uint8_t* img, int16_t x, int16_t y, int16_t w, int16_t h, uint8_t c);
+static void draw_temp(uint8_t* img, int16_t x, int16_t y, uint16_t v, out_state_t* g, int slot);
 static int16_t draw_char(uint8_t* img, int16_t x, int16_t y, uint8_t c, const Font_TypeDef *Font);
 static void draw_string(uint8_t* img, int16_t x, int16_t y, const char *str, const Font_TypeDef *Font);
-static __inline__ void draw_pixel(uint8_t* img, int16_t x, int16_t y, uint8_t c);
+static void draw_cached_string(uint8_t* img, int16_t x, int16_t y, const char *str, const Font_TypeDef *Font, int slot);
+static void render_cached_string(text_cache_t* tc, const char *str, const Font_TypeDef *Font);
+static void compute_palette_bar(int vid_palette_index);
 
 
 
@@ -78,20 +108,20 @@ void vid_render_test_pattern(uint8_t* img)
 	set_clip_region(CLIP_REGION_ALL);
 	
 	// Clear the frame buffer
-	draw_fill_rect(img, 0, 0, IMG_BUF_WIDTH, IMG_BUF_HEIGHT, 0x00);
+	draw8_fill_rect(img, &clip, 0, 0, IMG_BUF_WIDTH, IMG_BUF_HEIGHT, 0x00);
 	
 	// Bounding box
-	draw_rect(img, 0, 0, IMG_BUF_WIDTH, IMG_BUF_HEIGHT, 0xFF);
+	draw8_rect(img, &clip, 0, 0, IMG_BUF_WIDTH, IMG_BUF_HEIGHT, 0xFF);
 	
 	// Grayscale rectangles at the top, horizontal lines at the bottom
 	n = (IMG_BUF_WIDTH - 16) / 16;
 	for (i=0; i<16; i++) {
-		draw_fill_rect(img, i * n + 8, 4, n, n, i*16);
-		draw_vline(img, i * n + 8 + n/2, IMG_BUF_HEIGHT - n - 4, IMG_BUF_HEIGHT - 4, 0xFF);
+		draw8_fill_rect(img, &clip, i * n + 8, 4, n, n, i*16);
+		draw8_vline(img, &clip, i * n + 8 + n/2, IMG_BUF_HEIGHT - n - 4, IMG_BUF_HEIGHT - 4, 0xFF);
 	}
 	
 	// Centered circle
-	draw_circle(img, IMG_BUF_WIDTH/2, IMG_BUF_HEIGHT/2, (IMG_BUF_HEIGHT - 40)/2, 0xFF);	
+	draw8_circle(img, &clip, IMG_BUF_WIDTH/2, IMG_BUF_HEIGHT/2, (IMG_BUF_HEIGHT - 40)/2, 0xFF);	
 	
 	// Draw some text
 	app_desc = esp_app_get_description();
@@ -105,67 +135,92 @@ void vid_render_test_pattern(uint8_t* img)
 	// Vertical lines on either side
 	n = (IMG_BUF_HEIGHT - 40) / 16;
 	for (i=0; i<16; i++) {
-		draw_hline(img, 4, 4 + n, i*n + 20 + 8, 0xFF);
-		draw_hline(img, IMG_BUF_WIDTH - n - 4, IMG_BUF_WIDTH - 4, i*n + 20 + 8, 0xFF);
+		draw8_hline(img, &clip, 4, 4 + n, i*n + 20 + 8, 0xFF);
+		draw8_hline(img, &clip, IMG_BUF_WIDTH - n - 4, IMG_BUF_WIDTH - 4, i*n + 20 + 8, 0xFF);
 	}
 }
 
 
 void vid_render_t1c_data(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 {
-	uint8_t render_palette_mod;    // Either 0x00 or 0xFF, used to invert image (white-hot -> black-hot)
-	uint8_t* imgP = img;
-	uint16_t* t1cP = t1c->img_data;
-	uint32_t diff;
-	uint32_t t32;
+	uint32_t* imgP = (uint32_t*) img;
+	uint32_t* t1cP = (uint32_t*) t1c_get_y8_data(t1c, T1C_Y8F_OUT_VID);
 	uint32_t x, y;
 	
 	// Don't worry about setting a clip region, this only generates valid x,y by design
 	
-	// Setup the global palette modifier
-	render_palette_mod = (g->vid_palette_index == 1) ? 0xFF : 0x00;
-
-	diff = t1c->y16_max - t1c->y16_min;
-	if (diff == 0) diff = 1;
+	// Rows are copied (or inverted for black-hot) four pixels at a time.  Both buffers are
+	// word aligned and so are the image rows since IMG_BUF_CMAP_WIDTH and IMG_BUF_WIDTH are
+	// multiples of 4.
 	y = T1C_HEIGHT;
-	while (y--) {
-		x = T1C_WIDTH;
-		imgP += IMG_BUF_CMAP_WIDTH;
-		while (x--) {
-			t32 = ((uint32_t)(*t1cP++ - t1c->y16_min) * 255) / diff;
-			*imgP++ = ((t32 > 255) ? 255 : (uint8_t) t32) ^ render_palette_mod;
+	if (g->vid_palette_index == 1) {
+		while (y--) {
+			x = T1C_WIDTH/4;
+			imgP += IMG_BUF_CMAP_WIDTH/4;
+			while (x--) {
+				*imgP++ = *t1cP++ ^ 0xFFFFFFFF;
+			}
+		}
+	} else {
+		while (y--) {
+			imgP += IMG_BUF_CMAP_WIDTH/4;
+			memcpy(imgP, t1cP, T1C_WIDTH);
+			imgP += T1C_WIDTH/4;
+			t1cP += T1C_WIDTH/4;
+		}
+	}
+}
+
+
+void vid_render_change_overlay(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
+{
+	uint32_t* maskP = t1c->chg_mask;
+	uint8_t* rowP = img + IMG_BUF_CMAP_WIDTH;
+	uint8_t* pixP;
+	uint32_t bits;
+	int x, y, i;
+	
+	// Mark the changed pixels with a sparse white and black pattern that leaves half of
+	// the image visible.  The mask rows skip quickly over words without changed pixels.
+	for (y=0; y<T1C_HEIGHT; y++) {
+		for (x=0; x<T1C_WIDTH; x+=32) {
+			bits = *maskP++;
+			pixP = rowP + x;
+			i = x + y;
+			while (bits != 0) {
+				if (bits & 1) {
+					if ((i & 3) == 0) {
+						*pixP = MARKER_COLOR;
+					} else if ((i & 3) == 2) {
+						*pixP = 0x00;
+					}
+				}
+				bits >>= 1;
+				pixP++;
+				i++;
+			}
 		}
+		rowP += IMG_BUF_WIDTH;
 	}
 }
 
 
 void vid_render_palette(uint8_t* img, out_state_t* g)
 {
-	float delta;
-	float cur;
-	int16_t y;
-	uint8_t c;
+	int16_t i;
+	
+	if (pal_bar_palette != g->vid_palette_index) {
+		compute_palette_bar(g->vid_palette_index);
+	}
 	
 	set_clip_region(CLIP_REGION_CMAP);
 	
 	// Blank the entire area
-	draw_fill_rect(img, 0, 0, IMG_BUF_CMAP_WIDTH, IMG_BUF_HEIGHT, CMAP_TEXT_BG_COLOR);
+	draw8_fill_rect(img, &clip, 0, 0, IMG_BUF_CMAP_WIDTH, IMG_BUF_HEIGHT, CMAP_TEXT_BG_COLOR);
 	
 	// Draw the palette from top to bottom (warm to cold)
-	if (g->vid_palette_index == 1) {
-		// Black hot palette
-		delta = 255.0 / (float) IMG_BUF_CMAP_HEIGHT;
-		cur = 0;
-	} else {
-		// White hot palette
-		delta = 255.0 / (float) -IMG_BUF_CMAP_HEIGHT;
-		cur = 255.0;
-	}
-	
-	for (y=IMG_BUF_BATT_RGN_H+IMG_BUF_CMAP_TEXT_H; y<(IMG_BUF_CMAP_HEIGHT+IMG_BUF_BATT_RGN_H+IMG_BUF_CMAP_TEXT_H); y++) {
-		c = round(cur);
-		draw_hline(img, PALETTE_BAR_X_OFFSET, PALETTE_BAR_X_OFFSET+PALETTE_BAR_WIDTH, y, c);
-		cur += delta;
+	for (i=0; i<IMG_BUF_CMAP_HEIGHT; i++) {
+		draw8_hline(img, &clip, PALETTE_BAR_X_OFFSET, PALETTE_BAR_X_OFFSET+PALETTE_BAR_WIDTH, IMG_BUF_BATT_RGN_H+IMG_BUF_CMAP_TEXT_H+i, pal_bar_index[i]);
 	}
 }
 
@@ -189,8 +244,8 @@ void vid_render_spotmeter(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 	
 	// Draw a white circle surrounded by a black circle for contrast on all
 	// color palettes
-	draw_circle(img, c, r, d/2, MARKER_COLOR);
-	draw_circle(img, c, r, (d+2)/2, 0x00);
+	draw8_circle(img, &clip, c, r, d/2, MARKER_COLOR);
+	draw8_circle(img, &clip, c, r, (d+2)/2, 0x00);
 	
 	// Get the temperature string
 	if (g->temp_unit_C) {
@@ -206,8 +261,8 @@ void vid_render_spotmeter(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 	y = (r <= (IMG_BUF_HEIGHT/2)) ? r + d/2 + 3 : r - d/2 - h - 3;  // below if r < half, above if r > half
 	
 	// Blank an area and the draw the text
-	draw_fill_rect(img, x-1, y-1, w+2, h+2, IMG_TEXT_BG_COLOR);
-	draw_string(img, x, y, buf, &Font7x10);
+	draw8_fill_rect(img, &clip, x-1, y-1, w+2, h+2, IMG_TEXT_BG_COLOR);
+	draw_cached_string(img, x, y, buf, &Font7x10, TEXT_SLOT_SPOT);
 }
 
 
@@ -244,8 +299,8 @@ void vid_render_region_marker(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 	
 	// Draw a white bounding box surrounded by a black bounding box for contrast
 	// on all color palettes
-	draw_rect(img, x, y, w, h, MARKER_COLOR);	
-	draw_rect(img, x-1, y-1, w+2, h+2, 0x00);
+	draw8_rect(img, &clip, x, y, w, h, MARKER_COLOR);	
+	draw8_rect(img, &clip, x-1, y-1, w+2, h+2, 0x00);
 }
 
 
@@ -274,11 +329,53 @@ void vid_render_region_temps(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 	y = 0;
 	
 	// Blank an area for the text
-	draw_fill_rect(img, x-1, y, w+1, IMG_BUF_REG_TEXT_H, IMG_TEXT_BG_COLOR);
+	draw8_fill_rect(img, &clip, x-1, y, w+1, IMG_BUF_REG_TEXT_H, IMG_TEXT_BG_COLOR);
 	
 	// Offset y in text area and draw string
 	y += (IMG_BUF_REG_TEXT_H - h) / 2;
-	draw_string(img, x, y, buf, &Font7x10);
+	draw_cached_string(img, x, y, buf, &Font7x10, TEXT_SLOT_REGION);
+}
+
+
+void vid_render_roi_markers(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
+{
+	int i;
+	int16_t x1, y1, x2, y2;
+	t1c_roi_table_t* roi = &t1c->roi;
+	
+	set_clip_region(CLIP_REGION_IMAGE);
+	
+	// Each marker is drawn in white with a black outline for contrast on all color palettes
+	for (i=0; i<roi->num_spots; i++) {
+		if (roi->spot_valid_mask & (1 << i)) {
+			x1 = (int16_t) roi->spot_points[i].x + IMG_BUF_CMAP_WIDTH;
+			y1 = (int16_t) roi->spot_points[i].y;
+			draw8_circle(img, &clip, x1, y1, IMG_ROI_SPOT_SIZE/2, MARKER_COLOR);
+			draw8_circle(img, &clip, x1, y1, (IMG_ROI_SPOT_SIZE+2)/2, 0x00);
+		}
+	}
+	
+	for (i=0; i<roi->num_rects; i++) {
+		if (roi->rect_valid_mask & (1 << i)) {
+			x1 = (int16_t) roi->rect_points[i].start_point.x + IMG_BUF_CMAP_WIDTH;
+			y1 = (int16_t) roi->rect_points[i].start_point.y;
+			x2 = (int16_t) roi->rect_points[i].end_point.x + IMG_BUF_CMAP_WIDTH;
+			y2 = (int16_t) roi->rect_points[i].end_point.y;
+			draw8_rect(img, &clip, x1, y1, x2 - x1 + 1, y2 - y1 + 1, MARKER_COLOR);
+			draw8_rect(img, &clip, x1-1, y1-1, x2 - x1 + 3, y2 - y1 + 3, 0x00);
+		}
+	}
+	
+	for (i=0; i<roi->num_lines; i++) {
+		if (roi->line_valid_mask & (1 << i)) {
+			x1 = (int16_t) roi->line_points[i].start_point.x + IMG_BUF_CMAP_WIDTH;
+			y1 = (int16_t) roi->line_points[i].start_point.y;
+			x2 = (int16_t) roi->line_points[i].end_point.x + IMG_BUF_CMAP_WIDTH;
+			y2 = (int16_t) roi->line_points[i].end_point.y;
+			draw8_line(img, &clip, x1+1, y1+1, x2+1, y2+1, 0x00);
+			draw8_line(img, &clip, x1, y1, x2, y2, MARKER_COLOR);
+		}
+	}
 }
 
 
@@ -286,8 +383,8 @@ void vid_render_min_max_temps(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 {
 	set_clip_region(CLIP_REGION_CMAP);
 	
-	draw_temp(img, 0, IMG_BUF_BATT_RGN_H, t1c->max_min_temp_info.max_temp, g);
-	draw_temp(img, 0, T1C_HEIGHT - IMG_BUF_CMAP_TEXT_H, t1c->max_min_temp_info.min_temp, g);
+	draw_temp(img, 0, IMG_BUF_BATT_RGN_H, t1c->max_min_temp_info.max_temp, g, TEXT_SLOT_MAX);
+	draw_temp(img, 0, T1C_HEIGHT - IMG_BUF_CMAP_TEXT_H, t1c->max_min_temp_info.min_temp, g, TEXT_SLOT_MIN);
 }
 
 
@@ -308,10 +405,10 @@ void vid_render_palette_marker(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 	y_offset = IMG_BUF_BATT_RGN_H + IMG_BUF_CMAP_TEXT_H + round(offset);
 	
 	// Erase all possible locations of the previous marker
-	draw_fill_rect(img, x_offset, IMG_BUF_BATT_RGN_H + IMG_BUF_CMAP_TEXT_H, PALETTE_MARKER_WIDTH, IMG_BUF_CMAP_HEIGHT, CMAP_TEXT_BG_COLOR);
+	draw8_fill_rect(img, &clip, x_offset, IMG_BUF_BATT_RGN_H + IMG_BUF_CMAP_TEXT_H, PALETTE_MARKER_WIDTH, IMG_BUF_CMAP_HEIGHT, CMAP_TEXT_BG_COLOR);
 	
 	// Draw the new marker
-	draw_hline(img, x_offset, x_offset + PALETTE_MARKER_WIDTH - 1, y_offset, MARKER_COLOR);
+	draw8_hline(img, &clip, x_offset, x_offset + PALETTE_MARKER_WIDTH - 1, y_offset, MARKER_COLOR);
 }
 
 
@@ -334,8 +431,8 @@ void vid_render_parm_string(const char* s, uint8_t* img)
 	y = IMG_BUF_HEIGHT/3;
 	
 	// Blank an area and draw the text
-	draw_fill_rect(img, x-1, y-1, w+2, h+2, IMG_TEXT_BG_COLOR);
-	draw_string(img, x, y, s, &Font7x10);
+	draw8_fill_rect(img, &clip, x-1, y-1, w+2, h+2, IMG_TEXT_BG_COLOR);
+	draw_cached_string(img, x, y, s, &Font7x10, TEXT_SLOT_PARM);
 }
 
 
@@ -350,10 +447,10 @@ void vid_render_freeze_marker(uint8_t* img)
 	y = 10;
 	
 	// Draw a black bounding box
-	draw_rect(img, x - 1, y - 1, IMG_FREEZE_SIZE + 2, IMG_FREEZE_SIZE + 2, 0x00);
+	draw8_rect(img, &clip, x - 1, y - 1, IMG_FREEZE_SIZE + 2, IMG_FREEZE_SIZE + 2, 0x00);
 	
 	// Draw the inner white box
-	draw_fill_rect(img, x, y, IMG_FREEZE_SIZE, IMG_FREEZE_SIZE, MARKER_COLOR);
+	draw8_fill_rect(img, &clip, x, y, IMG_FREEZE_SIZE, IMG_FREEZE_SIZE, MARKER_COLOR);
 }
 
 
@@ -365,28 +462,28 @@ void vid_render_battery_info(uint8_t* img, int batt_percent, bool batt_critical)
 	set_clip_region(CLIP_REGION_CMAP);
 	
 	// Erase the battery status region
-	draw_fill_rect(img, 0, 0, IMG_BUF_CMAP_WIDTH, IMG_BUF_BATT_RGN_H, CMAP_TEXT_BG_COLOR);
+	draw8_fill_rect(img, &clip, 0, 0, IMG_BUF_CMAP_WIDTH, IMG_BUF_BATT_RGN_H, CMAP_TEXT_BG_COLOR);
 	
 	// Update with current battery status
 	if (batt_critical) {
 		// Critical battery warning
 		x = (IMG_BUF_CMAP_WIDTH - font_get_string_width("CRIT", &Font7x10)) / 2;
 		y = (IMG_BUF_BATT_RGN_H - IMG_BUF_BATT_BOD_H) / 2;
-		draw_string(img, x, y, "CRIT", &Font7x10);
+		draw_cached_string(img, x, y, "CRIT", &Font7x10, TEXT_SLOT_BATT);
 	} else {
 		// Draw the battery nipple
 		x = IMG_BUF_CMAP_WIDTH - ((IMG_BUF_CMAP_WIDTH - IMG_BUF_BATT_BOD_W) / 2);
 		y = ((IMG_BUF_BATT_RGN_H - IMG_BUF_BATT_BOD_H) / 2) + 3;
-		draw_fill_rect(img, x, y, 2, IMG_BUF_BATT_BOD_H - 2*3, BATT_COLOR);
+		draw8_fill_rect(img, &clip, x, y, 2, IMG_BUF_BATT_BOD_H - 2*3, BATT_COLOR);
 		
 		// Draw the battery body
 		x = (IMG_BUF_CMAP_WIDTH - IMG_BUF_BATT_BOD_W) / 2;
 		y = (IMG_BUF_BATT_RGN_H - IMG_BUF_BATT_BOD_H) / 2;
-		draw_rect(img, x, y, IMG_BUF_BATT_BOD_W, IMG_BUF_BATT_BOD_H, BATT_COLOR);
+		draw8_rect(img, &clip, x, y, IMG_BUF_BATT_BOD_W, IMG_BUF_BATT_BOD_H, BATT_COLOR);
 		
 		// Draw the battery fill state
 		w = batt_percent * IMG_BUF_BATT_BOD_W / 100;
-		draw_fill_rect(img, x, y, w, IMG_BUF_BATT_BOD_H, BATT_COLOR);
+		draw8_fill_rect(img, &clip, x, y, w, IMG_BUF_BATT_BOD_H, BATT_COLOR);
 	}
 }
 
@@ -443,11 +540,11 @@ void vid_render_env_info(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g)
 		y = IMG_BUF_HEIGHT - IMG_ENV_TEXT_HEIGHT;
 		
 		// Blank an area for the text
-		draw_fill_rect(img, x-1, y, w+1, IMG_ENV_TEXT_HEIGHT, IMG_TEXT_BG_COLOR);
+		draw8_fill_rect(img, &clip, x-1, y, w+1, IMG_ENV_TEXT_HEIGHT, IMG_TEXT_BG_COLOR);
 		
 		// Offset y in text area and draw string
 		y += (IMG_ENV_TEXT_HEIGHT - h) / 2;
-		draw_string(img, x, y, buf, &Font7x10);
+		draw_cached_string(img, x, y, buf, &Font7x10, TEXT_SLOT_ENV);
 	}
 }
 
@@ -461,14 +558,14 @@ void vid_render_timelapse_status(uint8_t* img)
 	set_clip_region(CLIP_REGION_CMAP);
 	
 	// Erase the battery status region
-	draw_fill_rect(img, 0, 0, IMG_BUF_CMAP_WIDTH, IMG_BUF_BATT_RGN_H, CMAP_TEXT_BG_COLOR);
+	draw8_fill_rect(img, &clip, 0, 0, IMG_BUF_CMAP_WIDTH, IMG_BUF_BATT_RGN_H, CMAP_TEXT_BG_COLOR);
 	
 	// Draw the text where the battery icon usually goes
 	w = font_get_string_width(buf, &Font7x10) + 1;
 	h = Font7x10.font_Height;
 	x = (IMG_BUF_CMAP_WIDTH - w) / 2;
 	y = (IMG_BUF_BATT_RGN_H - h) / 2;
-	draw_string(img, x, y, buf, &Font7x10);
+	draw_cached_string(img, x, y, buf, &Font7x10, TEXT_SLOT_TL);
 }
 
 
@@ -479,38 +576,38 @@ static void set_clip_region(int region)
 {
 	switch (region) {
 		case CLIP_REGION_ALL:
-			clip_x1 = 0;
-			clip_y1 = 0;
-			clip_x2 = IMG_BUF_WIDTH - 1;
-			clip_y2 = IMG_BUF_HEIGHT - 1;
+			clip.x1 = 0;
+			clip.y1 = 0;
+			clip.x2 = IMG_BUF_WIDTH - 1;
+			clip.y2 = IMG_BUF_HEIGHT - 1;
 			break;
 			
 		case CLIP_REGION_CMAP:
-			clip_x1 = 0;
-			clip_y1 = 0;
-			clip_x2 = IMG_BUF_CMAP_WIDTH - 1;
-			clip_y2 = IMG_BUF_HEIGHT - 1;
+			clip.x1 = 0;
+			clip.y1 = 0;
+			clip.x2 = IMG_BUF_CMAP_WIDTH - 1;
+			clip.y2 = IMG_BUF_HEIGHT - 1;
 			break;
 			
 		case CLIP_REGION_TMRK:
-			clip_x1 = PALETTE_BAR_X_OFFSET + PALETTE_BAR_WIDTH;
-			clip_y1 = IMG_BUF_BATT_RGN_H + IMG_BUF_CMAP_TEXT_H;
-			clip_x2 = IMG_BUF_CMAP_WIDTH - 1;
-			clip_y2 = IMG_BUF_HEIGHT - IMG_BUF_CMAP_TEXT_H - 1;
+			clip.x1 = PALETTE_BAR_X_OFFSET + PALETTE_BAR_WIDTH;
+			clip.y1 = IMG_BUF_BATT_RGN_H + IMG_BUF_CMAP_TEXT_H;
+			clip.x2 = IMG_BUF_CMAP_WIDTH - 1;
+			clip.y2 = IMG_BUF_HEIGHT - IMG_BUF_CMAP_TEXT_H - 1;
 			break;
 		
 		case CLIP_REGION_IMAGE:
-			clip_x1 = IMG_BUF_CMAP_WIDTH;
-			clip_y1 = 0;
-			clip_x2 = IMG_BUF_WIDTH - 1;
-			clip_y2 = IMG_BUF_HEIGHT - 1;
+			clip.x1 = IMG_BUF_CMAP_WIDTH;
+			clip.y1 = 0;
+			clip.x2 = IMG_BUF_WIDTH - 1;
+			clip.y2 = IMG_BUF_HEIGHT - 1;
 			break;
 			
 		default:
-			clip_x1 = 0;
-			clip_y1 = 0;
-			clip_x2 = 0;
-			clip_y2 = 0;
+			clip.x1 = 0;
+			clip.y1 = 0;
+			clip.x2 = 0;
+			clip.y2 = 0;
 	}
 }
 
@@ -527,18 +624,18 @@ static void draw_min_marker(t1c_buffer_t* t1c, int16_t n, uint8_t* img)
 	y2 = y1 + n;
 	
 	// Draw a white downward facing triangle surrounded by a black triangle for contrast
-	draw_hline(img, x1, x2, y1, MARKER_COLOR);
-	draw_line(img, x1, y1, xm, y2, MARKER_COLOR);
-	draw_line(img, xm, y2, x2, y1, MARKER_COLOR);
+	draw8_hline(img, &clip, x1, x2, y1, MARKER_COLOR);
+	draw8_line(img, &clip, x1, y1, xm, y2, MARKER_COLOR);
+	draw8_line(img, &clip, xm, y2, x2, y1, MARKER_COLOR);
 	
 	x1--;
 	y1--;
 	x2++;
 	y2++;
 	
-	draw_hline(img, x1, x2, y1, 0x00);
-	draw_line(img, x1, y1, xm, y2, 0x00);
-	draw_line(img, xm, y2, x2, y1, 0x00);
+	draw8_hline(img, &clip, x1, x2, y1, 0x00);
+	draw8_line(img, &clip, x1, y1, xm, y2, 0x00);
+	draw8_line(img, &clip, xm, y2, x2, y1, 0x00);
 }
 
 
@@ -554,22 +651,22 @@ static void draw_max_marker(t1c_buffer_t* t1c, int16_t n, uint8_t* img)
 	y2 = y1 + n;
 	
 	// Draw a white upward facing triangle surrounded by a black triangle for contrast
-	draw_hline(img, x1, x2, y2, MARKER_COLOR);
-	draw_line(img, x1, y2, xm, y1, MARKER_COLOR);
-	draw_line(img, xm, y1, x2, y2, MARKER_COLOR);
+	draw8_hline(img, &clip, x1, x2, y2, MARKER_COLOR);
+	draw8_line(img, &clip, x1, y2, xm, y1, MARKER_COLOR);
+	draw8_line(img, &clip, xm, y1, x2, y2, MARKER_COLOR);
 	
 	x1--;
 	y1--;
 	x2++;
 	y2++;
 	
-	draw_hline(img, x1, x2, y2, 0x00);
-	draw_line(img, x1, y2, xm, y1, 0x00);
-	draw_line(img, xm, y1, x2, y2, 0x00);
+	draw8_hline(img, &clip, x1, x2, y2, 0x00);
+	draw8_line(img, &clip, x1, y2, xm, y1, 0x00);
+	draw8_line(img, &clip, xm, y1, x2, y2, 0x00);
 }
 
 
-static void draw_temp(uint8_t* img, int16_t x, int16_t y, uint16_t v, out_state_t* g)
+static void draw_temp(uint8_t* img, int16_t x, int16_t y, uint16_t v, out_state_t* g, int slot)
 {
 	char buf[8];
 	uint16_t w, h;
@@ -585,167 +682,10 @@ static void draw_temp(uint8_t* img, int16_t x, int16_t y, uint16_t v, out_state_
 	y += (IMG_BUF_CMAP_TEXT_H - h) / 2;
 	
 	// Blank the text area
-	draw_fill_rect(img, x, y, IMG_BUF_CMAP_WIDTH, h, CMAP_TEXT_BG_COLOR);
+	draw8_fill_rect(img, &clip, x, y, IMG_BUF_CMAP_WIDTH, h, CMAP_TEXT_BG_COLOR);
 	
 	// Draw the text
-	draw_string(img, x + (IMG_BUF_CMAP_WIDTH-w)/2, y, buf, &Font7x10);
-}
-
-
-static void draw_hline(uint8_t* img, int16_t x1, int16_t x2, int16_t y, uint8_t c)
-{
-	uint8_t* imgP;
-	
-	if (x1 < clip_x1)
-		x1 = clip_x1;
-	if (x2 > clip_x2)
-		x2 = clip_x2;
-	if ((y < clip_y1) || (y > clip_y2)) return;
-	
-	imgP = img + y*IMG_BUF_WIDTH + x1;
-	memset(imgP, c, x2 - x1 + 1);
-}
-
-
-static void draw_vline(uint8_t* img, int16_t x, int16_t y1, int16_t y2, uint8_t c)
-{
-	uint8_t* imgP;
-	
-	if ((x < clip_x1) || (x > clip_x2)) return;
-	if (y1 < clip_y1)
-		y1 = clip_y1;
-	if (y2 > clip_y2)
-		y2 = clip_y2;
-	
-	imgP = img + y1*IMG_BUF_WIDTH + x;
-	
-	while (y1++ <= y2) {
-		*imgP = c;
-		imgP += IMG_BUF_WIDTH;
-	}
-}
-
-
-static void draw_line(uint8_t* img, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t c)
-{
-	int16_t dx = abs(x2 - x1);
-	int16_t dy = -abs(y2 - y1);
-	int16_t err = dx + dy;
-	int16_t e2;
-	int16_t sx = (x1 < x2) ? 1 : -1;
-	int16_t sy = (y1 < y2) ? 1 : -1;
-	
-	for (;;) {
-		draw_pixel(img, x1, y1, c);
-		
-		if ((x1 == x2) && (y1 == y2)) break;
-		
-		e2 = 2 * err;
-		if (e2 >= dy) {
-			err += dy;
-			x1 += sx;
-		}
-		if (e2 <= dx) {
-			err += dx;
-			y1 += sy;
-		}
-	}
-}
-
-
-static void draw_circle(uint8_t* img, int16_t x0, int16_t y0, int16_t r, uint8_t c) {
-	int16_t f = 1 - r;
-	int16_t ddF_x = 1;
-	int16_t ddF_y = -2 * r;
-	int16_t x = 0;
-	int16_t y = r;
-
-	draw_pixel(img, x0, y0 + r, c);
-	draw_pixel(img, x0, y0 - r, c);
-	draw_pixel(img, x0 + r, y0, c);
-	draw_pixel(img, x0 - r, y0, c);
-
-	while (x < y) {
-		if (f >= 0) {
-			y--;
-			ddF_y += 2;
-			f += ddF_y;
-		}
-		x++;
-		ddF_x += 2;
-		f += ddF_x;
-		
-		draw_pixel(img, x0 + x, y0 + y, c);
-		draw_pixel(img, x0 - x, y0 + y, c);
-		draw_pixel(img, x0 + x, y0 - y, c);
-		draw_pixel(img, x0 - x, y0 - y, c);
-		draw_pixel(img, x0 + y, y0 + x, c);
-		draw_pixel(img, x0 - y, y0 + x, c);
-		draw_pixel(img, x0 + y, y0 - x, c);
-		draw_pixel(img, x0 - y, y0 - x, c);
-	}
-}
-
-
-static void draw_rect(uint8_t* img, int16_t x, int16_t y, int16_t w, int16_t h, uint8_t c)
-{
-	uint8_t* imgP;
-	int16_t y1;
-	
-	if (x < clip_x1) {
-		w -= (clip_x1 - x);
-		if (w <= 0) return;
-		x = clip_x1;
-	}
-	if ((x+w-1) > clip_x2)
-		w -= (x+w) - clip_x2;
-	if (y < clip_y1) {
-		h -= (clip_y1 - y);
-		if (h <= 0) return;
-		y = clip_y1;
-	}
-	if ((y+h-1) > clip_y2)
-		h -= (y+h) - clip_y2;
-	
-	// Top and bottom lines
-	imgP = img + y*IMG_BUF_WIDTH + x;
-	memset(imgP, c, w);
-	memset(imgP + IMG_BUF_WIDTH * (h-1), c, w);
-	
-	// Left and right lines
-	y1 = y + h;
-	while (y++ < y1) {
-		*imgP = c;
-		*(imgP + w - 1) = c;
-		imgP += IMG_BUF_WIDTH;
-	}
-}
-
-
-static void draw_fill_rect(uint8_t* img, int16_t x, int16_t y, int16_t w, int16_t h, uint8_t c)
-{
-	if (x < clip_x1) {
-		w -= (clip_x1 - x);
-		if (w <= 0) return;
-		x = clip_x1;
-	}
-	if ((x+w-1) > clip_x2)
-		w -= (x+w) - clip_x2;
-	if (y < clip_y1) {
-		h -= (clip_y1 - y);
-		if (h <= 0) return;
-		y = clip_y1;
-	}
-	if ((y+h-1) > clip_y2)
-		h -= (y+h) - clip_y2;
-		
-	int16_t y1 = y;
-	uint8_t* imgP = img + y*IMG_BUF_WIDTH + x;
-	
-	while (y1++ < (y+h)) {
-		memset(imgP, c, w);
-		imgP += IMG_BUF_WIDTH;
-	}
+	draw_cached_string(img, x + (IMG_BUF_CMAP_WIDTH-w)/2, y, buf, &Font7x10, slot);
 }
 
 
@@ -773,7 +713,7 @@ static int16_t draw_char(uint8_t* img, int16_t x, int16_t y, uint8_t c, const Fo
 				pY = y;
 				tmpCh = *pCh++;
 				while (tmpCh) {
-					if (tmpCh & 0x01) draw_pixel(img, pX, pY, TEXT_COLOR);
+					if (tmpCh & 0x01) draw8_pixel(img, &clip, pX, pY, TEXT_COLOR);
 					tmpCh >>= 1;
 					pY++;
 				}
@@ -789,7 +729,7 @@ static int16_t draw_char(uint8_t* img, int16_t x, int16_t y, uint8_t c, const Fo
 					tmpCh = *pCh++;
 					if (tmpCh) {
 						while (bL) {
-							if (tmpCh & 0x01) draw_pixel(img, pX, pY, TEXT_COLOR);
+							if (tmpCh & 0x01) draw8_pixel(img, &clip, pX, pY, TEXT_COLOR);
 							tmpCh >>= 1;
 							if (tmpCh) {
 								pY++;
@@ -815,7 +755,7 @@ static int16_t draw_char(uint8_t* img, int16_t x, int16_t y, uint8_t c, const Fo
 				pX = x;
 				tmpCh = *pCh++;
 				while (tmpCh) {
-					if (tmpCh & 0x01) draw_pixel(img, pX, pY, TEXT_COLOR);
+					if (tmpCh & 0x01) draw8_pixel(img, &clip, pX, pY, TEXT_COLOR);
 					tmpCh >>= 1;
 					pX++;
 				}
@@ -831,7 +771,7 @@ static int16_t draw_char(uint8_t* img, int16_t x, int16_t y, uint8_t c, const Fo
 					tmpCh = *pCh++;
 					if (tmpCh) {
 						while (bL) {
-							if (tmpCh & 0x01) draw_pixel(img, pX, pY, TEXT_COLOR);
+							if (tmpCh & 0x01) draw8_pixel(img, &clip, pX, pY, TEXT_COLOR);
 							tmpCh >>= 1;
 							if (tmpCh) {
 								pX++;
@@ -866,9 +806,104 @@ static void draw_string(uint8_t* img, int16_t x, int16_t y, const char *str, con
 }
 
 
-static __inline__ void draw_pixel(uint8_t* img, int16_t x, int16_t y, uint8_t c)
+// Draw a string using a text cache slot.  The string is rasterized into the slot's row
+// masks only when it differs from the last string drawn with the slot, otherwise the
+// cached masks are drawn as runs of pixels (clipped like draw_string).  Only fonts with
+// one byte per row (horizontal scan, 8 pixels or less wide) can be cached.
+static void draw_cached_string(uint8_t* img, int16_t x, int16_t y, const char *str, const Font_TypeDef *Font, int slot)
 {
-	if ((x < clip_x1) || (x > clip_x2)) return;
-	if ((y < clip_y1) || (y > clip_y2)) return;
-	*(img + x + y*IMG_BUF_WIDTH) = c;
+	text_cache_t* tc = &text_cache[slot];
+	int16_t r, py;
+	int i, s, n;
+	int16_t xo;
+	uint32_t v;
+	
+	if ((Font->font_Scan != FONT_H) || (Font->font_Width > 8) || (Font->font_Height > TEXT_CACHE_MAX_ROWS) ||
+	    (strlen(str) > TEXT_CACHE_MAX_LEN)) {
+		draw_string(img, x, y, str, Font);
+		return;
+	}
+	
+	if (!tc->valid || (strcmp(tc->str, str) != 0)) {
+		render_cached_string(tc, str, Font);
+	}
+	
+	for (r=0; r<Font->font_Height; r++) {
+		py = y + r;
+		if ((py < clip.y1) || (py > clip.y2)) continue;
+		
+		for (i=0; i<tc->num_words; i++) {
+			v = tc->mask[r][i];
+			xo = x + i*32;
+			while (v) {
+				// Skip to the next run of set pixels and find its length
+				s = __builtin_ctz(v);
+				v >>= s;
+				xo += s;
+				n = (v == 0xFFFFFFFF) ? 32 : __builtin_ctz(~v);
+				draw8_hline(img, &clip, xo, xo + n - 1, py, TEXT_COLOR);
+				v = (n == 32) ? 0 : v >> n;
+				xo += n;
+			}
+		}
+	}
+}
+
+
+static void render_cached_string(text_cache_t* tc, const char *str, const Font_TypeDef *Font)
+{
+	int i, r;
+	int px;
+	uint8_t c;
+	uint32_t bits;
+	const uint8_t *pCh;
+	int n = strlen(str);
+	
+	strcpy(tc->str, str);
+	tc->num_words = (n*(Font->font_Width + 1) + 31) / 32;
+	memset(tc->mask, 0, sizeof(tc->mask));
+	
+	for (i=0; i<n; i++) {
+		c = (uint8_t) str[i];
+		if ((c < Font->font_MinChar) || (c > Font->font_MaxChar)) c = Font->font_UnknownChar;
+		pCh = &Font->font_Data[(c - Font->font_MinChar) * Font->font_BPC];
+		px = i*(Font->font_Width + 1);
+		
+		for (r=0; r<Font->font_Height; r++) {
+			bits = *pCh++;
+			tc->mask[r][px/32] |= bits << (px % 32);
+			if (((px % 32) + Font->font_Width) > 32) {
+				tc->mask[r][px/32 + 1] |= bits >> (32 - (px % 32));
+			}
+		}
+	}
+	
+	tc->valid = true;
 }
+
+
+static void compute_palette_bar(int vid_palette_index)
+{
+	float delta;
+	float cur;
+	int16_t n;
+	
+	if (vid_palette_index == 1) {
+		// Black hot palette
+		delta = 255.0 / (float) IMG_BUF_CMAP_HEIGHT;
+		cur = 0;
+	} else {
+		// White hot palette
+		delta = 255.0 / (float) -IMG_BUF_CMAP_HEIGHT;
+		cur = 255.0;
+	}
+	
+	for (n=0; n<IMG_BUF_CMAP_HEIGHT; n++) {
+		pal_bar_index[n] = (uint8_t) round(cur);
+		cur += delta;
+	}
+	
+	pal_bar_palette = vid_palette_index;
+}
+
+
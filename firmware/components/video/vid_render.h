@@ -60,6 +60,9 @@
 // Spot meter
 #define IMG_SPOT_SIZE       6
 
+// ROI table spot markers
+#define IMG_ROI_SPOT_SIZE   4
+
 // Min/Max markers
 #define IMG_MARKER_SIZE_S   6
 #define IMG_MARKER_SIZE_L   8
@@ -87,11 +90,13 @@
 //
 void vid_render_test_pattern(uint8_t* img);
 void vid_render_t1c_data(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
+void vid_render_change_overlay(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_palette(uint8_t* img, out_state_t* g);
 void vid_render_spotmeter(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_min_max_markers(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_region_marker(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_region_temps(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
+void vid_render_roi_markers(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_min_max_temps(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_palette_marker(t1c_buffer_t* t1c, uint8_t* img, out_state_t* g);
 void vid_render_parm_string(const char* s, uint8_t* img);
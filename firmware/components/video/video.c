@@ -43,6 +43,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <math.h>
 #include <string.h>
 
+#ifdef CONFIG_PM_ENABLE
+	#include "esp_pm.h"
+#endif
+
 
 //
 // Constants
@@ -76,6 +80,39 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define NTSC_CONST_OFFSET_Y 8
 #define NTSC_CONST_OFFSET_X 0
 
+// Scaled output raster lines (active picture area)
+#define PAL_SCALED_LINES 288
+#define NTSC_SCALED_LINES 240
+
+// Scaled output maximum width (larger than any low frequency active line)
+#define SCALED_MAX_WIDTH 448
+
+// Color burst start (from the start of sync) and number of subcarrier cycles
+#define PAL_BURST_START_US 5.6
+#define PAL_BURST_CYCLES 10
+#define NTSC_BURST_START_US 5.3
+#define NTSC_BURST_CYCLES 9
+
+// Color burst amplitude (±20 IRE) and chroma scale (DAC counts per unit U or V)
+#define COLOR_BURST_AMPLITUDE 36
+#define COLOR_CHROMA_SCALE (DAC_LEVEL_WHITE - g_video_signal.dac_level_black)
+
+// Horizontal interpolation fraction bits
+#define SCALED_FRAC_BITS 4
+#define SCALED_FRAC_MASK ((1 << SCALED_FRAC_BITS) - 1)
+
+// Contents of each scan line held in the DMA buffers.  A line is only generated when the
+// line in the DMA buffer holds something else so sync, blank lines and the sync, blank and
+// burst around the pixels of visible lines are not regenerated every frame.  Lines with
+// a color burst are kept per burst phase.
+#define LINE_TYPE_NONE 0
+#define LINE_TYPE_VSYNC 1     // + 2*(first pulse long) + (second pulse long)
+#define LINE_TYPE_BLANK 5     // + burst phase
+#define LINE_TYPE_ACTIVE 7    // + burst phase
+
+// Maximum scan lines in a DMA buffer (the lowest DAC frequency fits 5)
+#define MAX_LINES_PER_DMA_BUF 8
+
 #define US_FREQ_TO_SAMPLES(freq, time_us) (round((double)freq*time_us/1000000.0))
 #define US_TO_SAMPLES(time_us) (round(((double)g_video_signal.dac_frequency*time_us/1000000.0)))
 #define SAMPLES_TO_US(samples) (1000000.0 * (double)samples / (double)g_video_signal.dac_frequency)
@@ -97,8 +134,30 @@ static volatile uint32_t g_current_dma_buf_offset = 0;
 
 static volatile uint16_t pixel_map_buf[256];
 
+// Scaled output tables: source frame buffer row offset for each output line and source
+// pixel index (upper bits) and interpolation fraction (lower bits) for each output sample
+static DRAM_ATTR uint32_t scaled_line_offset[PAL_TOTAL_LINES_COUNT];
+static DRAM_ATTR uint16_t scaled_x_index[SCALED_MAX_WIDTH];
+
+// Color output tables.  The DAC runs at 4x the subcarrier so each pixel is two samples
+// at a fixed subcarrier phase: even pixels are phases 0 and 1, odd pixels 2 and 3.  Each
+// entry holds the two DMA words (sample pairs) for a palette index.  PAL uses the second
+// set on lines where the V component is inverted.  The burst holds one subcarrier cycle.
+static DRAM_ATTR uint32_t color_lut[2][256][2];
+static DRAM_ATTR uint32_t color_burst[2][2];
+static DRAM_ATTR uint16_t color_burst_offset_words;
+static DRAM_ATTR uint16_t color_burst_cycles;
+static const uint32_t* color_palette = NULL;
+
 static intr_handle_t i2s_interrupt_handle;
+#ifdef CONFIG_PM_ENABLE
+// Held while generating video: scan lines are rendered by the I2S interrupt and the DMA
+// must never stop so the CPU stays at the maximum frequency and light sleep is blocked
+static esp_pm_lock_handle_t video_pm_lock = NULL;
+#endif
 static lldesc_t DRAM_ATTR dma_buffers[2] = {0};
+static DRAM_ATTR uint8_t dma_line_type[2][MAX_LINES_PER_DMA_BUF];
+static volatile uint8_t* g_current_line_type;
 
 DRAM_ATTR volatile VIDEO_SIGNAL_PARAMS g_video_signal;
 
@@ -108,16 +167,23 @@ static volatile bool new_fb_valid = false;
 //
 // Forward Declarations
 //
-static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uint16_t width_pixels, uint16_t height_pixels, uint8_t* fb);
+static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uint16_t width_pixels, uint16_t height_pixels, uint8_t* fb, bool scaled, uint16_t out_width, uint16_t out_height);
+static void setup_line_table();
+static void setup_scale_tables();
+static void setup_color_tables();
 static bool set_dac_frequency();
 static bool setup_video_dac();
 static inline void pal_render_scan_line() __attribute__((always_inline));
 static inline void ntsc_render_scan_line() __attribute__((always_inline));
 static /*IRAM_ATTR*/ void i2s_interrupt();
+static /*IRAM_ATTR*/ inline bool set_line_type(uint8_t type);
 static /*IRAM_ATTR*/ void signal_vertical_sync_line(VSYNC_PULSE_LENGTH first_pulse, VSYNC_PULSE_LENGTH second_pulse);
 static /*IRAM_ATTR*/ inline void signal_blank_line();
 static /*IRAM_ATTR*/ void signal_line_start();
 static /*IRAM_ATTR*/ void render_pixels_grey_8bpp();
+static /*IRAM_ATTR*/ void render_pixels_grey_8bpp_scaled();
+static /*IRAM_ATTR*/ void render_pixels_color_8bpp();
+static /*IRAM_ATTR*/ inline void signal_color_burst();
 
 
 
@@ -136,14 +202,22 @@ static /*IRAM_ATTR*/ void render_pixels_grey_8bpp();
  * 
  * @param width Image width in pixels.
  * @param height Image height in pixels.
- * @param mode PAL or NTSC mode
+ * @param mode PAL or NTSC mode.  The color modes map the frame buffer values through
+ *        the palette set with \a video_set_color_palette() and output two samples per
+ *        pixel.
+ * @param scaled Scale the image to fill the active raster.  Pixels are interpolated
+ *        horizontally and lines repeated vertically as the scan lines are generated
+ *        so the frame buffer is the same size.  The color modes only repeat lines.
  * 
  * @see video_stop()
  */
-bool video_init(uint16_t width, uint16_t height, uint8_t* fb, VIDEO_MODE mode)
+bool video_init(uint16_t width, uint16_t height, uint8_t* fb, VIDEO_MODE mode, bool scaled)
 {
 	uint32_t max_low_freq_width;
 	uint32_t max_high_freq_width;
+	uint16_t out_width;
+	uint16_t out_height;
+	bool color = false;
 		
 	if (fb == NULL) {
 		ESP_LOGE(TAG, "Frame buffer = null");
@@ -227,13 +301,63 @@ bool video_init(uint16_t width, uint16_t height, uint8_t* fb, VIDEO_MODE mode)
         	}
             break;
 
+        case VIDEO_MODE_PAL_COLOR:
+        	if (height > (PAL_TOTAL_LINES_COUNT - 8)) {
+        		ESP_LOGE(TAG, "Height %u exceeds PAL color limits", height);
+        		return false;
+        	}
+        	max_high_freq_width = US_FREQ_TO_SAMPLES(DAC_FREQ_PAL_17_734MHz, PAL_LINE_DURATION_US - PAL_FRONT_PORCH_US - PAL_BACK_PORCH_US);
+        	if (2*width > max_high_freq_width) {
+        		ESP_LOGE(TAG, "Width %u exceeds PAL color limits", width);
+        		return false;
+        	}
+        	freq = DAC_FREQ_PAL_17_734MHz;
+        	color = true;
+            break;
+
+        case VIDEO_MODE_NTSC_COLOR:
+        	if (height > (NTSC_TOTAL_LINES_COUNT - 10)) {
+        		ESP_LOGE(TAG, "Height %u exceeds NTSC color limits", height);
+        		return false;
+        	}
+        	max_high_freq_width = US_FREQ_TO_SAMPLES(DAC_FREQ_NTSC_14_318MHz, NTSC_LINE_DURATION_US - NTSC_FRONT_PORCH_US - NTSC_BACK_PORCH_US);
+        	if (2*width > max_high_freq_width) {
+        		ESP_LOGE(TAG, "Width %u exceeds NTSC color limits", width);
+        		return false;
+        	}
+        	freq = DAC_FREQ_NTSC_14_318MHz;
+        	color = true;
+            break;
+
         default:
             ESP_LOGE(TAG, "Illegal video mode - %d", (int) mode);
             return false;
             break;
     }
 
-    if (setup_video_signal(mode, freq, width, height, fb)) {
+    // Scaled output fills the active line at the low DAC frequency (color output is
+    // always two samples per pixel)
+    if (scaled) {
+    	out_height = (mode >= VIDEO_MODE_NTSC) ? NTSC_SCALED_LINES : PAL_SCALED_LINES;
+    	if (color) {
+    		out_width = 2*width;
+    	} else {
+    		out_width = max_low_freq_width & ~1;  // must be even
+    		if ((width > max_low_freq_width) || (max_low_freq_width > SCALED_MAX_WIDTH)) {
+    			ESP_LOGE(TAG, "Cannot scale %ux%u", width, height);
+    			return false;
+    		}
+    	}
+    	if (height > out_height) {
+    		ESP_LOGE(TAG, "Cannot scale %ux%u", width, height);
+    		return false;
+    	}
+    } else {
+    	out_width = color ? 2*width : width;
+    	out_height = height;
+    }
+
+    if (setup_video_signal(mode, freq, width, height, fb, scaled, out_width, out_height)) {
 	    ESP_LOGD(TAG, "Scan line duration: %d DAC samples (%.2fµs) (PAL:64µs, NTSC:63.55µs)", g_video_signal.samples_per_line, SAMPLES_TO_US(g_video_signal.samples_per_line));
 	    ESP_LOGD(TAG, "HSYNC: %u samples (%.2fµs)", g_video_signal.hsync_samples,SAMPLES_TO_US(g_video_signal.hsync_samples));
 	    ESP_LOGD(TAG, "VSYNC LONG: %u samples (%.2fµs)", g_video_signal.vsync_long_samples, SAMPLES_TO_US(g_video_signal.vsync_long_samples));
@@ -262,6 +386,14 @@ bool video_init(uint16_t width, uint16_t height, uint8_t* fb, VIDEO_MODE mode)
     	ESP_LOGD(TAG,"DAC BLACK level: %u", g_video_signal.dac_level_black);
     	ESP_LOGD(TAG,"DAC WHITE level: %u", DAC_LEVEL_WHITE);
 
+#ifdef CONFIG_PM_ENABLE
+    	if (video_pm_lock == NULL) {
+    		(void) esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "video", &video_pm_lock);
+    	}
+    	if (video_pm_lock != NULL) {
+    		(void) esp_pm_lock_acquire(video_pm_lock);
+    	}
+#endif
     	g_video_initialized = true;
     } else {
     	return false;
@@ -278,6 +410,41 @@ void video_set_alt_fb(uint8_t* fb)
 }
 
 
+/**
+ * Set the palette used by the color modes: 256 entries, each with red in bits 7:0, green
+ * in bits 15:8 and blue in bits 23:16 (RGB_TO_24BIT).  The palette is read again each
+ * time this is called or video is initialized so it must remain valid.  Grey is used if
+ * no palette was set.
+ */
+void video_set_color_palette(const uint32_t* rgb)
+{
+	color_palette = rgb;
+	if (g_video_initialized && g_video_signal.color) {
+		setup_color_tables();
+	}
+}
+
+
+/**
+ * Return the frame buffer being displayed
+ */
+uint8_t* video_get_cur_fb()
+{
+	return g_video_signal.frame_buffer;
+}
+
+
+/**
+ * Return the frame buffer waiting to be displayed at the next frame end or NULL if there is
+ * none.  A caller looking for a buffer that isn't in use should get this before the
+ * current buffer since the waiting buffer may become current between the calls.
+ */
+uint8_t* video_get_alt_fb()
+{
+	return new_fb_valid ? (uint8_t*) new_fb : NULL;
+}
+
+
 
 /**
  * @brief Get the mode description, e.g. "NTSC 320x200"
@@ -307,6 +474,14 @@ void video_get_mode_description(char* buffer, size_t buffer_size)
             mode_name = "NTSC'";
             break; 
 
+        case VIDEO_MODE_PAL_COLOR:
+            mode_name = "PAL C";
+            break;
+
+        case VIDEO_MODE_NTSC_COLOR:
+            mode_name = "NTSC C";
+            break;
+
         default:
             mode_name = "";
             break;
@@ -355,6 +530,12 @@ void video_stop()
 
     ESP_LOGI(TAG, "Video generation stopped.");
 
+#ifdef CONFIG_PM_ENABLE
+    if (video_pm_lock != NULL) {
+        (void) esp_pm_lock_release(video_pm_lock);
+    }
+#endif
+
     g_video_initialized = false;
 }
 
@@ -363,17 +544,17 @@ void video_stop()
 //
 // Internal functions
 //
-static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uint16_t width_pixels, uint16_t height_pixels, uint8_t* fb)
+static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uint16_t width_pixels, uint16_t height_pixels, uint8_t* fb, bool scaled, uint16_t out_width, uint16_t out_height)
 {
 	g_video_signal.dac_frequency = (uint32_t)dac_frequency;
 
-    if( mode == VIDEO_MODE_PAL || mode == VIDEO_MODE_PAL_BT601 )
+    if( mode < VIDEO_MODE_NTSC )
     {
         g_video_signal.samples_per_line = US_TO_SAMPLES(PAL_LINE_DURATION_US);
         g_video_signal.front_porch_samples = US_TO_SAMPLES(PAL_FRONT_PORCH_US);
         g_video_signal.back_porch_samples = US_TO_SAMPLES(PAL_BACK_PORCH_US);
         g_video_signal.offset_x_samples = PAL_CONST_OFFSET_X;
-        g_video_signal.offset_y_lines = PAL_CONST_OFFSET_Y + PAL_TOTAL_LINES_COUNT/2 - height_pixels/2;
+        g_video_signal.offset_y_lines = PAL_CONST_OFFSET_Y + PAL_TOTAL_LINES_COUNT/2 - out_height/2;
         g_video_signal.number_of_lines = PAL_TOTAL_LINES_COUNT;
         g_video_signal.dac_level_blank = DAC_LEVEL_P_BLANK;
         g_video_signal.dac_level_black = DAC_LEVEL_P_BLACK;
@@ -384,19 +565,29 @@ static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uin
         g_video_signal.front_porch_samples = US_TO_SAMPLES(NTSC_FRONT_PORCH_US);
         g_video_signal.back_porch_samples = US_TO_SAMPLES(NTSC_BACK_PORCH_US);
         g_video_signal.offset_x_samples = NTSC_CONST_OFFSET_X;
-        g_video_signal.offset_y_lines = NTSC_CONST_OFFSET_Y + NTSC_TOTAL_LINES_COUNT/2 - height_pixels/2;
+        g_video_signal.offset_y_lines = NTSC_CONST_OFFSET_Y + NTSC_TOTAL_LINES_COUNT/2 - out_height/2;
         g_video_signal.number_of_lines = NTSC_TOTAL_LINES_COUNT;
         g_video_signal.dac_level_blank = DAC_LEVEL_BLANK;
         g_video_signal.dac_level_black = DAC_LEVEL_BLACK;
     }
     
-    g_video_signal.samples_per_line &=~1; //must be even
+    if (mode == VIDEO_MODE_PAL_COLOR || mode == VIDEO_MODE_NTSC_COLOR) {
+        // A multiple of the 4 sample subcarrier cycle so the phase is the same on every line
+        g_video_signal.samples_per_line = (g_video_signal.samples_per_line + 2) & ~3;
+        g_video_signal.color = true;
+    } else {
+        g_video_signal.samples_per_line &=~1; //must be even
+        g_video_signal.color = false;
+    }
     g_video_signal.hsync_samples = US_TO_SAMPLES(HSYNC_US);
     g_video_signal.vsync_short_samples = US_TO_SAMPLES(VSYNC_SHORT_US);
     g_video_signal.vsync_long_samples = g_video_signal.samples_per_line/2 - g_video_signal.hsync_samples;
 
-    g_video_signal.width_pixels = width_pixels;
-    g_video_signal.height_pixels = height_pixels;
+    g_video_signal.width_pixels = out_width;
+    g_video_signal.height_pixels = out_height;
+    g_video_signal.fb_width_pixels = width_pixels;
+    g_video_signal.fb_height_pixels = height_pixels;
+    g_video_signal.scaled = scaled;
     g_video_signal.offset_x_samples +=
             g_video_signal.back_porch_samples + 
             g_video_signal.hsync_samples +
@@ -406,16 +597,38 @@ static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uin
             g_video_signal.back_porch_samples-
             g_video_signal.hsync_samples)
             /2 -
-            (width_pixels/2);
+            (out_width/2);
+    if (g_video_signal.color) {
+        g_video_signal.offset_x_samples &= ~3; // pixels start at subcarrier phase 0
+        if (mode < VIDEO_MODE_NTSC) {
+            color_burst_offset_words = ((uint16_t) US_TO_SAMPLES(PAL_BURST_START_US) & ~3) / 2;
+            color_burst_cycles = PAL_BURST_CYCLES;
+        } else {
+            color_burst_offset_words = ((uint16_t) US_TO_SAMPLES(NTSC_BURST_START_US) & ~3) / 2;
+            color_burst_cycles = NTSC_BURST_CYCLES;
+        }
+    }
     
     // Find the maximum number of lines we can put in a DMA buffer
     size_t line_num_bytes = g_video_signal.samples_per_line*sizeof(uint16_t);
     g_video_signal.num_lines_per_dma_buf = (4092 / line_num_bytes);
+    if (g_video_signal.num_lines_per_dma_buf > MAX_LINES_PER_DMA_BUF) {
+        g_video_signal.num_lines_per_dma_buf = MAX_LINES_PER_DMA_BUF;
+    }
     ESP_LOGD(TAG, "Bytes per line: %d, Lines per DMA buffer: %u", line_num_bytes, g_video_signal.num_lines_per_dma_buf);
     
     g_video_signal.video_mode = mode;
     g_video_signal.bits_per_pixel = 8;
-    g_video_signal.pixel_render_func = render_pixels_grey_8bpp;
+    setup_line_table();
+    if (g_video_signal.color) {
+    	setup_color_tables();
+    	g_video_signal.pixel_render_func = render_pixels_color_8bpp;
+    } else if (scaled) {
+    	setup_scale_tables();
+    	g_video_signal.pixel_render_func = render_pixels_grey_8bpp_scaled;
+    } else {
+    	g_video_signal.pixel_render_func = render_pixels_grey_8bpp;
+    }
     g_video_signal.frame_buffer_size_bytes = width_pixels*height_pixels;
     g_video_signal.frame_buffer = fb;
     ESP_LOGD(TAG, "Bits per pixel: %u, %ux%u. FB size %lu bytes ", g_video_signal.bits_per_pixel, g_video_signal.width_pixels, g_video_signal.height_pixels, g_video_signal.frame_buffer_size_bytes);
@@ -424,6 +637,98 @@ static bool setup_video_signal(VIDEO_MODE mode, DAC_FREQUENCY dac_frequency, uin
 }
 
 
+// Compute the source frame buffer row for each output line so the ISR only has to look
+// it up.  Lines are repeated when the output is scaled.
+static void setup_line_table()
+{
+	int i;
+	int32_t s;
+	uint16_t fb_w = g_video_signal.fb_width_pixels;
+	uint16_t fb_h = g_video_signal.fb_height_pixels;
+	uint16_t out_h = g_video_signal.height_pixels;
+	
+	for (i=0; i<out_h; i++) {
+		s = (i*fb_h + fb_h/2) / out_h;
+		if (s >= fb_h) s = fb_h - 1;
+		scaled_line_offset[i] = s * fb_w;
+	}
+}
+
+
+// Compute the source pixel pair and interpolation fraction for each output sample so the
+// ISR only has to look them up.  Output pixel centers are mapped to source pixel centers.
+static void setup_scale_tables()
+{
+	int i;
+	int32_t s;
+	int32_t max_s;
+	uint16_t fb_w = g_video_signal.fb_width_pixels;
+	uint16_t out_w = g_video_signal.width_pixels;
+	
+	// Source position in 1/(2^SCALED_FRAC_BITS) pixels, clamped so the second pixel of the
+	// interpolated pair is always in the row
+	max_s = (fb_w - 1) << SCALED_FRAC_BITS;
+	for (i=0; i<out_w; i++) {
+		s = (((2*i + 1)*fb_w - out_w) << SCALED_FRAC_BITS) / (2*out_w);
+		if (s < 0) s = 0;
+		if (s >= max_s) s = max_s - (1 << SCALED_FRAC_BITS) + SCALED_FRAC_MASK;
+		scaled_x_index[i] = s;
+	}
+}
+
+
+// Compute the DAC samples for each palette entry at each of the 4 subcarrier phases
+// (0°, 90°, 180°, 270°) where the sample is Y + U*sin + V*cos, and the burst cycle.
+// NTSC burst is at 180° (-U).  PAL burst is at 135° and 225° with V alternating each line.
+static void setup_color_tables()
+{
+	int i, k, n;
+	float r, g, b, y, u, v;
+	int32_t s[4];
+	const float sin_tbl[4] = {0, 1, 0, -1};
+	const float cos_tbl[4] = {1, 0, -1, 0};
+	bool is_pal = g_video_signal.video_mode < VIDEO_MODE_NTSC;
+	
+	for (n=0; n<2; n++) {
+		for (i=0; i<256; i++) {
+			if (color_palette != NULL) {
+				r = (float) (color_palette[i] & 0xFF) / 255.0;
+				g = (float) ((color_palette[i] >> 8) & 0xFF) / 255.0;
+				b = (float) ((color_palette[i] >> 16) & 0xFF) / 255.0;
+			} else {
+				r = g = b = (float) i / 255.0;
+			}
+			y = 0.299*r + 0.587*g + 0.114*b;
+			u = 0.492*(b - y);
+			v = 0.877*(r - y);
+			if (n == 1) v = -v;
+			
+			for (k=0; k<4; k++) {
+				s[k] = round(g_video_signal.dac_level_black + y*(DAC_LEVEL_WHITE - g_video_signal.dac_level_black) +
+				             (u*sin_tbl[k] + v*cos_tbl[k])*COLOR_CHROMA_SCALE);
+				if (s[k] < DAC_LEVEL_SYNC) s[k] = DAC_LEVEL_SYNC;
+				if (s[k] > DAC_LEVEL_WHITE) s[k] = DAC_LEVEL_WHITE;
+			}
+			
+			// First sample in the high half of each DMA word
+			color_lut[n][i][0] = ((uint32_t) s[0] << 24) | ((uint32_t) s[1] << 8);
+			color_lut[n][i][1] = ((uint32_t) s[2] << 24) | ((uint32_t) s[3] << 8);
+		}
+		
+		for (k=0; k<4; k++) {
+			if (is_pal) {
+				s[k] = round(g_video_signal.dac_level_blank + COLOR_BURST_AMPLITUDE *
+				             (-sin_tbl[k] + ((n == 0) ? cos_tbl[k] : -cos_tbl[k])) / sqrt(2.0));
+			} else {
+				s[k] = round(g_video_signal.dac_level_blank - COLOR_BURST_AMPLITUDE*sin_tbl[k]);
+			}
+		}
+		color_burst[n][0] = ((uint32_t) s[0] << 24) | ((uint32_t) s[1] << 8);
+		color_burst[n][1] = ((uint32_t) s[2] << 24) | ((uint32_t) s[3] << 8);
+	}
+}
+
+
 static bool set_dac_frequency()
 {
     switch(g_video_signal.dac_frequency)
@@ -464,6 +769,18 @@ static bool set_dac_frequency()
             ESP_LOGI(TAG, "DAC clock configured to 6.75 MHz. BT.601 PAL/NTSC 320 pixels.");
             break;
 
+        case DAC_FREQ_PAL_17_734MHz: // =17.734477
+        	rtc_clk_apll_enable(true);
+        	rtc_clk_apll_coeff_set(1, 4, 164, 6);
+            ESP_LOGI(TAG, "DAC clock configured to 17.734 MHz. PAL color.");
+            break;
+
+        case DAC_FREQ_NTSC_14_318MHz: // =14.318180
+        	rtc_clk_apll_enable(true);
+        	rtc_clk_apll_coeff_set(2, 93, 116, 7);
+            ESP_LOGI(TAG, "DAC clock configured to 14.318 MHz. NTSC color.");
+            break;
+
         default:
             ESP_LOGE(TAG, "Not supported DAC frequency");
             return false;
@@ -521,6 +838,7 @@ static bool setup_video_dac()
         dma_buffers[n].empty = (uint32_t)(n==DMA_BUFFER_COUNT-1? &dma_buffers[0] : &dma_buffers[n+1]);
     }
     I2S0.out_link.addr = (uint32_t)&dma_buffers[0];
+    memset(dma_line_type, LINE_TYPE_NONE, sizeof(dma_line_type));
     ESP_LOGI(TAG, "DMA buffers configured. Buffers: %u, Size: %u bytes each", DMA_BUFFER_COUNT, dma_buffer_size_bytes);
 
     if (!set_dac_frequency()) {
@@ -653,16 +971,19 @@ static IRAM_ATTR void i2s_interrupt()
 	{
         num_lines = g_video_signal.num_lines_per_dma_buf;
         g_current_dma_buf_offset = 0;
+        g_current_line_type = dma_line_type[((lldesc_t*)I2S0.out_eof_des_addr == &dma_buffers[0]) ? 0 : 1];
 
         if( g_video_signal.video_mode >= VIDEO_MODE_NTSC )
         	while (num_lines--) {
             	ntsc_render_scan_line();
             	g_current_dma_buf_offset += g_video_signal.samples_per_line * sizeof(uint16_t);
+            	g_current_line_type++;
             }
         else
         	while (num_lines--) {
             	pal_render_scan_line();
             	g_current_dma_buf_offset += g_video_signal.samples_per_line * sizeof(uint16_t);
+            	g_current_line_type++;
             }
 	}
 
@@ -671,8 +992,21 @@ static IRAM_ATTR void i2s_interrupt()
 }
 
 
+// Returns true if the current line in the DMA buffer has to be generated for type
+static IRAM_ATTR inline bool set_line_type(uint8_t type)
+{
+	if (*g_current_line_type == type) return false;
+	
+	*g_current_line_type = type;
+	return true;
+}
+
+
 static IRAM_ATTR void signal_vertical_sync_line(const VSYNC_PULSE_LENGTH first_pulse, const VSYNC_PULSE_LENGTH second_pulse)
 {
+	if (!set_line_type(LINE_TYPE_VSYNC + 2*(first_pulse == VSYNC_PULSE_LONG) + (second_pulse == VSYNC_PULSE_LONG))) return;
+	
+
 	// Compute vsync byte lengths that are an even multiple of 4 bytes (they be close enough to the calculated hsync period).
     // We do this so vysnc always ends on a 4 byte boundary to avoid a condition due to the ESP32 little endianness the first
 	// 16-bit word of the subsequent portion is output first causing a one pixel-clock glitch between portions.
@@ -694,17 +1028,24 @@ static IRAM_ATTR void signal_vertical_sync_line(const VSYNC_PULSE_LENGTH first_p
 
 static IRAM_ATTR void signal_blank_line()
 {
+	if (!set_line_type(LINE_TYPE_BLANK + (g_video_signal.color ? (g_current_scan_line & 1) : 0))) return;
+	
+
 	// Compute an hsync byte length that is an even multiple of 4 bytes (it will be close enough to the calculated hsync period).
 	// We do this so hysnc always ends on a 4 byte boundary to avoid a condition due to the ESP32 little endianness the first
 	// 16-bit word of the subsequent portion is output first causing a one pixel-clock glitch between portions.
 	const size_t hsync_byte_len = (g_video_signal.hsync_samples*sizeof(uint16_t)) & 0xFFFFFFFC;
     memset(DMA_BUFFER_UINT8+g_current_dma_buf_offset, DAC_LEVEL_SYNC, hsync_byte_len);
     memset(DMA_BUFFER_UINT8+g_current_dma_buf_offset+hsync_byte_len, g_video_signal.dac_level_blank, (g_video_signal.samples_per_line*sizeof(uint16_t)) - hsync_byte_len);
+    
+    if (g_video_signal.color) signal_color_burst();
 }
 
 
 static IRAM_ATTR void signal_line_start()
 {
+	if (!set_line_type(LINE_TYPE_ACTIVE + (g_video_signal.color ? (g_current_scan_line & 1) : 0))) return;
+	
 	// Sync
 	size_t offset_byte_len = (g_video_signal.hsync_samples*sizeof(uint16_t)) & 0xFFFFFFFC;
 	memset(DMA_BUFFER_UINT8+g_current_dma_buf_offset, DAC_LEVEL_SYNC, offset_byte_len);
@@ -715,6 +1056,21 @@ static IRAM_ATTR void signal_line_start()
 	// Blank after pixels
 	offset_byte_len += g_video_signal.width_pixels*sizeof(uint16_t);
 	memset(DMA_BUFFER_UINT8+g_current_dma_buf_offset+offset_byte_len, g_video_signal.dac_level_blank, (g_video_signal.samples_per_line*sizeof(uint16_t)) - offset_byte_len);
+	
+	if (g_video_signal.color) signal_color_burst();
+}
+
+
+static IRAM_ATTR void signal_color_burst()
+{
+	uint32_t* p = DMA_BUFFER_UINT32 + g_current_dma_buf_offset/4 + color_burst_offset_words;
+	uint32_t* b = color_burst[g_current_scan_line & 1];
+	int n = color_burst_cycles;
+	
+	while (n--) {
+		*p++ = b[0];
+		*p++ = b[1];
+	}
 }
 
 
@@ -735,3 +1091,48 @@ static IRAM_ATTR void render_pixels_grey_8bpp()
     }
 
 }
+
+
+static IRAM_ATTR void render_pixels_grey_8bpp_scaled()
+{
+    uint32_t* p = DMA_BUFFER_UINT32 + g_current_dma_buf_offset/4 + g_video_signal.offset_x_samples/2;
+    uint8_t* s = g_video_signal.frame_buffer + scaled_line_offset[g_current_scan_line-g_video_signal.offset_y_lines];
+    uint16_t* x = scaled_x_index;
+    size_t len = g_video_signal.width_pixels;
+    uint8_t* sp;
+    uint32_t f;
+    uint32_t v;
+    uint32_t d;
+	
+    while (len)
+    {
+    	// Linearly interpolate between the pair of source pixels
+    	sp = s + (*x >> SCALED_FRAC_BITS);
+    	f = *x++ & SCALED_FRAC_MASK;
+    	v = (*sp * ((1 << SCALED_FRAC_BITS) - f) + *(sp+1) * f) >> SCALED_FRAC_BITS;
+    	d = pixel_map_buf[v] << 16;
+    	
+    	sp = s + (*x >> SCALED_FRAC_BITS);
+    	f = *x++ & SCALED_FRAC_MASK;
+    	v = (*sp * ((1 << SCALED_FRAC_BITS) - f) + *(sp+1) * f) >> SCALED_FRAC_BITS;
+    	*p++ = d | (pixel_map_buf[v]);
+    	len -= 2;
+    }
+}
+
+
+static IRAM_ATTR void render_pixels_color_8bpp()
+{
+    uint32_t* p = DMA_BUFFER_UINT32 + g_current_dma_buf_offset/4 + g_video_signal.offset_x_samples/2;
+    uint8_t* s = g_video_signal.frame_buffer + scaled_line_offset[g_current_scan_line-g_video_signal.offset_y_lines];
+    uint32_t (*lut)[2] = color_lut[g_current_scan_line & 1];
+    size_t len = g_video_signal.fb_width_pixels;
+	
+    // Table lookups only: each pixel is the two DMA words for its subcarrier phase
+    while (len)
+    {
+    	*p++ = lut[*s++][0];
+    	*p++ = lut[*s++][1];
+    	len -= 2;
+    }
+}
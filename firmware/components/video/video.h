@@ -32,10 +32,12 @@ typedef enum _VIDEO_MODE
 {
     VIDEO_MODE_PAL, ///< PAL, typically Europe 50 frames/second, max 625 scan lines. 14.75MHz or 7.375 MHz.
     VIDEO_MODE_PAL_BT601, ///< As \c VIDEO_MODE_PAL but using 13.5 or 6.75 MHz.
+    VIDEO_MODE_PAL_COLOR, ///< As \c VIDEO_MODE_PAL with a color palette using 17.734 MHz (4x subcarrier).
     // put mode PAL modes here
 
     VIDEO_MODE_NTSC, ///< NTSC, typically USA and Japan, 60 frames/second, max 525 scan lines. 12.273 or or 6.136 MHz.
     VIDEO_MODE_NTSC_BT601, ///< As \c VIDEO_MODE_NTSC but using 13.5 or 6.75 MHz.
+    VIDEO_MODE_NTSC_COLOR, ///< As \c VIDEO_MODE_NTSC with a color palette using 14.318 MHz (4x subcarrier).
     // put more NTSC modes here
 } VIDEO_MODE;
 
@@ -52,7 +54,9 @@ typedef enum _DAC_FREQUENCY
     DAC_FREQ_NTSC_12_273MHz=12272720, //12.273 MHz NTSC 640 pixels
     DAC_FREQ_NTSC_6_136MHz=6136360, // 6.136 MHz NTSC 320 pixels
     DAC_FREQ_PAL_NTSC_13_5MHz=13500001, // 13.5 MHz BT.601 640 pixels
-    DAC_FREQ_PAL_NTSC_6_75MHz=6750000 // 6.75 MHz BT.601 320 pixels
+    DAC_FREQ_PAL_NTSC_6_75MHz=6750000, // 6.75 MHz BT.601 320 pixels
+    DAC_FREQ_PAL_17_734MHz=17734475, // 17.734 MHz PAL 4x color subcarrier
+    DAC_FREQ_NTSC_14_318MHz=14318180 // 14.318 MHz NTSC 4x color subcarrier
 } DAC_FREQUENCY;
 
 typedef void (*p_pixel_render_func)(void);
@@ -60,8 +64,12 @@ typedef void (*p_pixel_render_func)(void);
 typedef struct _VIDEO_SIGNAL_PARAMS
 {
     VIDEO_MODE video_mode;
-    uint16_t width_pixels;
+    uint16_t width_pixels;           // Output raster size
     uint16_t height_pixels;
+    uint16_t fb_width_pixels;        // Frame buffer size (same as output unless scaled)
+    uint16_t fb_height_pixels;
+    bool     scaled;
+    bool     color;
     uint16_t offset_x_samples;
     uint16_t offset_y_lines;
     uint16_t hsync_samples;
@@ -85,7 +93,10 @@ typedef struct _VIDEO_SIGNAL_PARAMS
 
 extern volatile VIDEO_SIGNAL_PARAMS g_video_signal;
 
-bool video_init(uint16_t width, uint16_t height, uint8_t* fb, VIDEO_MODE mode);
+bool video_init(uint16_t width, uint16_t height, uint8_t* fb, VIDEO_MODE mode, bool scaled);
 void video_set_alt_fb(uint8_t* fb);
+void video_set_color_palette(const uint32_t* rgb);
+uint8_t* video_get_cur_fb();
+uint8_t* video_get_alt_fb();
 void video_get_mode_description(char* buffer, size_t buffer_size);
 void video_stop();
\ No newline at end of file
@@ -29,10 +29,12 @@
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "cmd_list.h"
 #include "ctrl_task.h"
 #include "file_task.h"
 #include "out_state_utilities.h"
 #include "palettes.h"
+#include "perf_utilities.h"
 #include "system_config.h"
 #include "sys_utilities.h"
 #include "t1c_task.h"
@@ -86,8 +88,10 @@ data += 4; \
 #define PARM_INDEX_TL_NOTIFY    13
 #define PARM_INDEX_UNITS        14
 #define PARM_INDEX_VID_MODE     15
+#define PARM_INDEX_VID_SCALE    16
+#define PARM_INDEX_VID_COLOR    17
 
-#define NUM_PARMS               16
+#define NUM_PARMS               18
 
 // Timeout from non-default parameter selection
 //  Must be longer than button long-press
@@ -147,9 +151,10 @@ static const char* parm_e_name[] = {"5", "10", "20", "30", "40", "50", "60", "70
 static const parm_entry_t parm_e_entry = {NUM_E_PARM_VALS, "Emissivity: ", parm_e_value};
 
 // Gain Parameter related
-#define NUM_G_PARM_VALS 2
-static const char* parm_g_name[] = {"Low", "High"};
-static const parm_entry_t parm_g_entry = {NUM_G_PARM_VALS, "Gain: ", parm_on_off_value};
+#define NUM_G_PARM_VALS 3
+static const int parm_g_value[] = {CMD_GAIN_LOW, CMD_GAIN_HIGH, CMD_GAIN_AUTO};
+static const char* parm_g_name[] = {"Low", "High", "Auto"};
+static const parm_entry_t parm_g_entry = {NUM_G_PARM_VALS, "Gain: ", parm_g_value};
 
 // FFC related
 #define NUM_FFC_PARM_VALS 1
@@ -194,6 +199,14 @@ static const parm_entry_t parm_u_entry = {NUM_U_PARM_VALS, "Units: ", parm_on_of
 static const char* parm_vm_name[] = {"NTSC", "PAL"};
 static const parm_entry_t parm_vm_entry = {NUM_VM_PARM_VALS, "Video: ", parm_on_off_value};
 
+// Video Scale related
+#define NUM_VS_PARM_VALS 2
+static const parm_entry_t parm_vs_entry = {NUM_VS_PARM_VALS, "Video Scale: ", parm_on_off_value};
+
+// Video Color related (video uses the save palette)
+#define NUM_VC_PARM_VALS 2
+static const parm_entry_t parm_vc_entry = {NUM_VC_PARM_VALS, "Video Color: ", parm_on_off_value};
+
 // Parameter management array
 static const parm_entry_t* parm_entries[] = {
 	&parm_vp_entry,
@@ -211,7 +224,9 @@ static const parm_entry_t* parm_entries[] = {
 	&parm_tl3_entry,
 	&parm_tl4_entry,
 	&parm_u_entry,
-	&parm_vm_entry
+	&parm_vm_entry,
+	&parm_vs_entry,
+	&parm_vc_entry
 };
 
 
@@ -229,6 +244,7 @@ static bool notify_disp_tl_off_message = false;
 // Battery state
 static bool notify_crit_batt = false;
 static int batt_percent = 0;
+static int64_t batt_update_usec = 0;            // Last battery state update
 
 // Timelapse state
 static bool timelapse_running = false;
@@ -239,14 +255,12 @@ static uint32_t timelapse_interval_sec = parm_tl2_value[0];
 static uint32_t timelapse_num_img = parm_tl3_value[0];
 static int64_t timelapse_toggle_usec;
 	
-// Video Driver Frame buffer pointer
-static uint8_t* drv_fbP;
-
 // Parameter selection and modification
 static char parm_string[PARM_DISP_MAX_LEN+1];
 static int parm_disp_state = PARM_DISP_NONE;
 static int cur_parm_index;
 static int cur_parm_value_index;
+static int64_t parm_disp_usec = 0;              // Last parameter change or message display
 
 
 
@@ -254,7 +268,8 @@ static int cur_parm_value_index;
 // VID Task Forward Declarations for internal functions
 //
 static bool _vid_init_output();
-static void _vid_handle_notifications();
+static TickType_t _vid_get_eval_wait();
+static void _vid_handle_notifications(TickType_t wait);
 static void _vid_eval_batt_update();
 static void _vid_eval_parm_update();
 static void _vid_get_parm_value_index();
@@ -263,7 +278,7 @@ static void _vid_set_parm_string();
 static void _vid_render_testpattern();
 static void _vid_render_palette();
 static void _vid_render_image(int render_buf_index);
-static void _vid_display_image(int render_buf_index);
+static uint8_t* _vid_get_free_fb();
 static int _vid_get_parm_index(int cur_val, const int* values, int num_values);
 
 
@@ -275,20 +290,13 @@ void vid_task()
 {
 	ESP_LOGI(TAG, "Start task");
 	
-	// Configure the save palette
+	// Configure the save palette (also used for color video)
 	set_save_palette(out_state.sav_palette_index);
+	video_set_color_palette(palette24);
 	
 	// We are always a landscape display
 	out_state.is_portrait = false;
 	
-	// Allocate our frame buffer
-	drv_fbP = (uint8_t*) heap_caps_calloc(IMG_BUF_WIDTH*IMG_BUF_HEIGHT, sizeof(uint8_t), MALLOC_CAP_8BIT);
-	if (drv_fbP == NULL) {
-		ESP_LOGE(TAG, "Could not allocate frame buffer");
-		ctrl_set_fault_type(CTRL_FAULT_VIDEO);
-		vTaskDelete(NULL);
-	}
-	
 	// Initialize the output stream
 	if (!_vid_init_output()) {
 		vTaskDelete(NULL);
@@ -304,7 +312,8 @@ void vid_task()
 	_vid_render_palette();
 	
 	while (1) {
-		_vid_handle_notifications();
+		// Block until notified (e.g. a new frame) or the next timed evaluation is due
+		_vid_handle_notifications(_vid_get_eval_wait());
 		_vid_eval_batt_update();
 		_vid_eval_parm_update();
 		
@@ -317,8 +326,6 @@ void vid_task()
 			notify_image_2 = false;
 			_vid_render_image(0);
 		}
-		
-		vTaskDelay(pdMS_TO_TICKS(1));
 	}
 }
 
@@ -330,14 +337,14 @@ void vid_task()
 static bool _vid_init_output()
 {
 	if (out_state.output_mode_PAL) {
-		if (!video_init(IMG_BUF_WIDTH, IMG_BUF_HEIGHT, drv_fbP, VIDEO_MODE_PAL)) {
+		if (!video_init(IMG_BUF_WIDTH, IMG_BUF_HEIGHT, rend_fbP[0], out_state.output_color ? VIDEO_MODE_PAL_COLOR : VIDEO_MODE_PAL, out_state.output_scaled)) {
 			ESP_LOGE(TAG, "PAL video init failed");
 			ctrl_set_fault_type(CTRL_FAULT_VIDEO);
 			return false;
 		}
 		ESP_LOGI(TAG, "Video Mode: PAL");
 	} else {
-		if (!video_init(IMG_BUF_WIDTH, IMG_BUF_HEIGHT, drv_fbP, VIDEO_MODE_NTSC)) {
+		if (!video_init(IMG_BUF_WIDTH, IMG_BUF_HEIGHT, rend_fbP[0], out_state.output_color ? VIDEO_MODE_NTSC_COLOR : VIDEO_MODE_NTSC, out_state.output_scaled)) {
 			ESP_LOGE(TAG, "NTSC video init failed");
 			ctrl_set_fault_type(CTRL_FAULT_VIDEO);
 			return false;
@@ -349,12 +356,40 @@ static bool _vid_init_output()
 }
 
 
-static void _vid_handle_notifications()
+/**
+ * Get how long the main loop can block waiting for a notification: until the next battery
+ * state update, timelapse indication toggle or parameter display timeout
+ */
+static TickType_t _vid_get_eval_wait()
+{
+	int64_t cur_usec = esp_timer_get_time();
+	int64_t next_usec = batt_update_usec + VID_BATT_STATE_UPDATE_MSEC * 1000;
+	
+	if (timelapse_running && (timelapse_toggle_usec < next_usec)) {
+		next_usec = timelapse_toggle_usec;
+	}
+	
+	if ((parm_disp_state == PARM_DISP_PARM) && ((parm_disp_usec + PARM_ENTRY_TIMEOUT_MSEC * 1000) < next_usec)) {
+		next_usec = parm_disp_usec + PARM_ENTRY_TIMEOUT_MSEC * 1000;
+	} else if ((parm_disp_state == PARM_DISP_TIMELAPSE_MSG) && ((parm_disp_usec + VID_TIMELAPSE_MSG_MSEC * 1000) < next_usec)) {
+		next_usec = parm_disp_usec + VID_TIMELAPSE_MSG_MSEC * 1000;
+	}
+	
+	if (next_usec <= cur_usec) {
+		return 0;
+	}
+	
+	// Round up and past the deadline so its evaluation is due when we wake
+	return pdMS_TO_TICKS((next_usec - cur_usec) / 1000 + 1);
+}
+
+
+static void _vid_handle_notifications(TickType_t wait)
 {
 	uint32_t notification_value;
 	
 	notification_value = 0;
-	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, 0)) {
+	if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, wait)) {
 		if (Notification(notification_value, VID_NOTIFY_T1C_FRAME_MASK_1)) {
 			notify_image_1 = true;
 		}
@@ -421,12 +456,11 @@ static void _vid_handle_notifications()
 static void _vid_eval_batt_update()
 {
 	int64_t cur_usec;
-	static int64_t prev_usec = 0;
 	
 	cur_usec = esp_timer_get_time();
-	if (cur_usec > (prev_usec + VID_BATT_STATE_UPDATE_MSEC*1000)) {
+	if (cur_usec > (batt_update_usec + VID_BATT_STATE_UPDATE_MSEC*1000)) {
 		batt_percent = ctrl_get_batt_percent();
-		prev_usec = cur_usec;
+		batt_update_usec = cur_usec;
 	}
 	
 	if (timelapse_running) {
@@ -441,7 +475,6 @@ static void _vid_eval_batt_update()
 static void _vid_eval_parm_update()
 {
 	int64_t cur_time;
-	static int64_t prev_time = 0;
 	
 	switch (parm_disp_state) {
 		case PARM_DISP_NONE:
@@ -451,7 +484,7 @@ static void _vid_eval_parm_update()
 				cur_parm_index = 0;
 				_vid_get_parm_value_index();
 				_vid_set_parm_string();
-				prev_time = esp_timer_get_time();
+				parm_disp_usec = esp_timer_get_time();
 			} else if (notify_b1_short_press) {
 				// Request a picture (or start timelapse)
 				xTaskNotify(task_handle_file, FILE_NOTIFY_SAVE_JPG_MASK, eSetBits);
@@ -463,11 +496,11 @@ static void _vid_eval_parm_update()
 			} else if (notify_disp_tl_on_message) {
 				parm_disp_state = PARM_DISP_TIMELAPSE_MSG;
 				strcpy(parm_string, "Timelapse Start");
-				prev_time = esp_timer_get_time();
+				parm_disp_usec = esp_timer_get_time();
 			} else if (notify_disp_tl_on_message) {
 				parm_disp_state = PARM_DISP_TIMELAPSE_MSG;
 				strcpy(parm_string, "Timelapse Stop");
-				prev_time = esp_timer_get_time();
+				parm_disp_usec = esp_timer_get_time();
 			}
 			break;
 			
@@ -484,7 +517,7 @@ static void _vid_eval_parm_update()
 				if (++cur_parm_value_index >= parm_entries[cur_parm_index]->num_parms) cur_parm_value_index = 0;
 				_vid_update_val_from_parm();
 				_vid_set_parm_string();
-				prev_time = esp_timer_get_time();
+				parm_disp_usec = esp_timer_get_time();
 			}
 			
 			else if (notify_b2_short_press) {
@@ -492,22 +525,22 @@ static void _vid_eval_parm_update()
 				if (++cur_parm_index >= NUM_PARMS) cur_parm_index = 0;
 				_vid_get_parm_value_index();
 				_vid_set_parm_string();
-				prev_time = esp_timer_get_time();
+				parm_disp_usec = esp_timer_get_time();
 			}
 			
 			else if (notify_b2_long_press) {
 				// Exit parameter set mode
 				parm_disp_state = PARM_DISP_NONE;
-				file_set_timelapse_info(timelapse_enable, timelapse_notify, timelapse_interval_sec, timelapse_num_img);
+				file_set_timelapse_info(timelapse_enable, timelapse_notify, timelapse_interval_sec * 1000, timelapse_num_img);
 				out_state_save();
 			}
 			
 			else {
 				// Look for parameter entry timeout
 				cur_time = esp_timer_get_time();
-				if ((cur_time - prev_time) >= (PARM_ENTRY_TIMEOUT_MSEC * 1000)) {
+				if ((cur_time - parm_disp_usec) >= (PARM_ENTRY_TIMEOUT_MSEC * 1000)) {
 					parm_disp_state = PARM_DISP_NONE;
-					file_set_timelapse_info(timelapse_enable, timelapse_notify, timelapse_interval_sec, timelapse_num_img);
+					file_set_timelapse_info(timelapse_enable, timelapse_notify, timelapse_interval_sec * 1000, timelapse_num_img);
 					out_state_save();
 				}
 			}
@@ -516,7 +549,7 @@ static void _vid_eval_parm_update()
 		case PARM_DISP_TIMELAPSE_MSG:
 			// Look for message timeout
 			cur_time = esp_timer_get_time();
-			if ((cur_time - prev_time) >= (VID_TIMELAPSE_MSG_MSEC * 1000)) {
+			if ((cur_time - parm_disp_usec) >= (VID_TIMELAPSE_MSG_MSEC * 1000)) {
 				// Done displaying message
 				parm_disp_state = PARM_DISP_NONE;
 			}
@@ -555,7 +588,11 @@ static void _vid_get_parm_value_index() {
 			cur_parm_value_index = _vid_get_parm_index(out_state.emissivity, parm_e_value, NUM_E_PARM_VALS);
 			break;
 		case PARM_INDEX_GAIN:
-			cur_parm_value_index = out_state.high_gain ? 1 : 0;
+			if (out_state.auto_gain_en) {
+				cur_parm_value_index = CMD_GAIN_AUTO;
+			} else {
+				cur_parm_value_index = out_state.high_gain ? CMD_GAIN_HIGH : CMD_GAIN_LOW;
+			}
 			break;
 		case PARM_INDEX_ENV_CORRECT:
 			cur_parm_value_index = out_state.use_auto_ambient ? 1 : 0;
@@ -584,6 +621,12 @@ static void _vid_get_parm_value_index() {
 		case PARM_INDEX_VID_MODE:
 			cur_parm_value_index = out_state.output_mode_PAL ? 1 : 0;
 			break;
+		case PARM_INDEX_VID_SCALE:
+			cur_parm_value_index = out_state.output_scaled ? 1 : 0;
+			break;
+		case PARM_INDEX_VID_COLOR:
+			cur_parm_value_index = out_state.output_color ? 1 : 0;
+			break;
 	}
 }
 
@@ -633,11 +676,20 @@ static void _vid_update_val_from_parm() {
 			}
 			break;
 		case PARM_INDEX_GAIN:
-			out_state.high_gain = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index];
-			
-			// Update Tiny1C
-			if (!t1c_set_param_tpd(TPD_PROP_GAIN_SEL, out_state.high_gain ? 1 : 0)) {
-				ESP_LOGE(TAG, "Failed to set gain");
+			if (parm_entries[cur_parm_index]->parm_values[cur_parm_value_index] == CMD_GAIN_AUTO) {
+				out_state.auto_gain_en = true;
+				
+				// t1c_task takes over the gain
+				t1c_set_auto_gain_enable(true);
+			} else {
+				out_state.auto_gain_en = false;
+				out_state.high_gain = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index] == CMD_GAIN_HIGH;
+				
+				// Update Tiny1C
+				t1c_set_auto_gain_enable(false);
+				if (!t1c_set_param_tpd(TPD_PROP_GAIN_SEL, out_state.high_gain ? 1 : 0)) {
+					ESP_LOGE(TAG, "Failed to set gain");
+				}
 			}
 			break;
 		case PARM_INDEX_ENV_CORRECT:
@@ -652,6 +704,7 @@ static void _vid_update_val_from_parm() {
 		case PARM_INDEX_SAV_PALETTE:
 			out_state.sav_palette_index = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index];
 			set_save_palette(out_state.sav_palette_index);
+			video_set_color_palette(palette24);
 			break;
 		case PARM_INDEX_TL_EN:
 			timelapse_enable = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index];
@@ -671,6 +724,24 @@ static void _vid_update_val_from_parm() {
 		case PARM_INDEX_VID_MODE:
 			out_state.output_mode_PAL = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index];
 			
+			// Update video output
+			video_stop();
+			if (!_vid_init_output()) {
+				ctrl_set_fault_type(CTRL_FAULT_VIDEO);
+			}
+			break;
+		case PARM_INDEX_VID_SCALE:
+			out_state.output_scaled = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index];
+			
+			// Update video output
+			video_stop();
+			if (!_vid_init_output()) {
+				ctrl_set_fault_type(CTRL_FAULT_VIDEO);
+			}
+			break;
+		case PARM_INDEX_VID_COLOR:
+			out_state.output_color = parm_entries[cur_parm_index]->parm_values[cur_parm_value_index];
+			
 			// Update video output
 			video_stop();
 			if (!_vid_init_output()) {
@@ -733,6 +804,12 @@ static void _vid_set_parm_string() {
 		case PARM_INDEX_VID_MODE:
 			parm_value_str = parm_vm_name[cur_parm_value_index];
 			break;
+		case PARM_INDEX_VID_SCALE:
+			parm_value_str = parm_on_off_name[cur_parm_value_index];
+			break;
+		case PARM_INDEX_VID_COLOR:
+			parm_value_str = parm_on_off_name[cur_parm_value_index];
+			break;
 		default:
 			parm_value_str = 0;
 	}
@@ -743,25 +820,27 @@ static void _vid_set_parm_string() {
 
 static void _vid_render_testpattern()
 {
-	uint8_t* rendP = rend_fbP[0];
+	uint8_t* rendP = _vid_get_free_fb();
 	
 	vid_render_test_pattern(rendP);
-	_vid_display_image(0);
+	video_set_alt_fb(rendP);
 }
 
 
 static void _vid_render_palette()
 {
-	// Render the static part of the current palette into both buffers
-	vid_render_palette(rend_fbP[0], &out_state);
-	vid_render_palette(rend_fbP[1], &out_state);
+	// Render the static part of the current palette into all buffers
+	for (int i=0; i<VID_NUM_FB; i++) {
+		vid_render_palette(rend_fbP[i], &out_state);
+	}
 }
 
 
 static void _vid_render_image(int render_buf_index)
 {
 	t1c_buffer_t* t1cP = (render_buf_index == 0) ? &out_t1c_buffer[0] : &out_t1c_buffer[1];
-	uint8_t* rendP = rend_fbP[render_buf_index];
+	uint8_t* rendP;
+	int64_t stage_usec;
 	static bool halt_updates = false;
 	
 #ifdef INCLUDE_VID_DIAG_OUTPUT
@@ -770,21 +849,30 @@ static void _vid_render_image(int render_buf_index)
 	
 	if (t1cP->vid_frozen) {
 		// Just render the video frozen marker over whatever image we're currently displaying
+		// (or will display next)
 		if (!halt_updates) {
-			xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+			rendP = video_get_alt_fb();
+			if (rendP == NULL) rendP = video_get_cur_fb();
 			vid_render_freeze_marker(rendP);
-			xSemaphoreGive(t1cP->mutex);
-			_vid_display_image(render_buf_index);
 		}
 		halt_updates = true;
 	} else {	
 		halt_updates = false;
+		rendP = _vid_get_free_fb();
 		
 		xSemaphoreTake(t1cP->mutex, portMAX_DELAY);
+		stage_usec = perf_start();
+		
+		t1c_note_frame_consumed(T1C_CONSUMER_VID, t1cP->frame_seq);
 		
 		// Render the image into the frame buffer
 		vid_render_t1c_data(t1cP, rendP, &out_state);
 		
+		// Highlight changed pixels if change detection is running
+		if (t1cP->chg_valid) {
+			vid_render_change_overlay(t1cP, rendP, &out_state);
+		}
+		
 		// Render the battery or timelapse status
 		if (timelapse_running && timelapse_display) {
 			vid_render_timelapse_status(rendP);
@@ -805,6 +893,9 @@ static void _vid_render_image(int render_buf_index)
 			vid_render_region_marker(t1cP, rendP, &out_state);
 			vid_render_region_temps(t1cP, rendP, &out_state);
 		}
+		
+		// Render any ROI table entries
+		vid_render_roi_markers(t1cP, rendP, &out_state);
 	
 		// Render the spot meter if enabled
 		if (out_state.spotmeter_enable && t1cP->spot_valid) {
@@ -818,9 +909,11 @@ static void _vid_render_image(int render_buf_index)
 		if (parm_disp_state != PARM_DISP_NONE) {
 			vid_render_parm_string(parm_string, rendP);
 		}
+		perf_end(PERF_STAGE_RENDER, stage_usec);
 		xSemaphoreGive(t1cP->mutex);
 		
-		_vid_display_image(render_buf_index);
+		// Display it at the next vertical blank (replacing an earlier frame still waiting)
+		video_set_alt_fb(rendP);
 	}
 	
 #ifdef INCLUDE_VID_DIAG_OUTPUT
@@ -829,12 +922,22 @@ static void _vid_render_image(int render_buf_index)
 }
 
 
-static void _vid_display_image(int render_buf_index)
+/**
+ * Return a frame buffer that is neither displayed nor waiting to be displayed.  There is
+ * always one with VID_NUM_FB buffers.
+ */
+static uint8_t* _vid_get_free_fb()
 {
-	uint8_t* drvP = drv_fbP;
-	uint8_t* rendP = rend_fbP[render_buf_index];
-
-	memcpy(drvP, rendP, IMG_BUF_WIDTH*IMG_BUF_HEIGHT);
+	uint8_t* altP = video_get_alt_fb();   // Must be read first
+	uint8_t* curP = video_get_cur_fb();
+	
+	for (int i=0; i<VID_NUM_FB; i++) {
+		if ((rend_fbP[i] != altP) && (rend_fbP[i] != curP)) {
+			return rend_fbP[i];
+		}
+	}
+	
+	return rend_fbP[0];
 }
 
 
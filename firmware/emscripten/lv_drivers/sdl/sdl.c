@@ -108,6 +108,8 @@ static lv_indev_state_t wheel_state = LV_INDEV_STATE_REL;
 
 static char buf[KEYBOARD_BUFFER_SIZE];
 
+static void (*present_cb)(const uint32_t * fb, int w, int h) = NULL;
+
 /**********************
  *      MACROS
  **********************/
@@ -137,6 +139,15 @@ void sdl_init(void)
     lv_task_create(sdl_event_handler, 10, LV_TASK_PRIO_HIGH, NULL);
 }
 
+/**
+ * Register a function to present the frame buffer instead of SDL (NULL to use SDL)
+ * @param cb called with the ARGB8888 frame buffer and its width and height
+ */
+void sdl_set_present_cb(void (*cb)(const uint32_t * fb, int w, int h))
+{
+    present_cb = cb;
+}
+
 /**
  * Flush a buffer to the marked area
  * @param disp_drv pointer to driver where this function belongs
@@ -369,6 +380,10 @@ static void window_create(monitor_t * m)
 static void window_update(monitor_t * m)
 {
 #if SDL_DOUBLE_BUFFERED == 0
+    if(present_cb != NULL) {
+        present_cb(m->tft_fb, SDL_HOR_RES, SDL_VER_RES);
+        return;
+    }
     SDL_UpdateTexture(m->texture, NULL, m->tft_fb, SDL_HOR_RES * sizeof(uint32_t));
 #else
     if(m->tft_fb_act == NULL) return;
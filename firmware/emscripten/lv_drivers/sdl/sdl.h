@@ -48,6 +48,12 @@ extern "C" {
  */
 void sdl_init(void);
 
+/**
+ * Register a function to present the frame buffer instead of SDL (NULL to use SDL)
+ * @param cb called with the ARGB8888 frame buffer and its width and height
+ */
+void sdl_set_present_cb(void (*cb)(const uint32_t * fb, int w, int h));
+
 /**
  * Flush a buffer to the marked area
  * @param disp_drv pointer to driver where this function belongs
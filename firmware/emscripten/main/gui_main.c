@@ -105,8 +105,14 @@ void gui_main_set_connected(bool is_connected)
 		// Attempt to get the GUI state
 		gui_state_init();
 		
-		// Start a timer to check for completion of gui_state initialization
-		task_init_wait = lv_task_create(_check_init_done_task, 100, LV_TASK_PRIO_LOW, NULL);
+		if (gui_state_init_complete()) {
+			// Resuming the last session so start streaming now, changes to our state are
+			// processed as they arrive as if another client had made them
+			gui_main_set_page(GUI_MAIN_PAGE_IMAGE);
+		} else {
+			// Start a timer to check for completion of gui_state initialization
+			task_init_wait = lv_task_create(_check_init_done_task, 100, LV_TASK_PRIO_LOW, NULL);
+		}
 	} else {
 		// Display the disconnected page
 		gui_main_set_page(GUI_MAIN_PAGE_DISCONNECTED);
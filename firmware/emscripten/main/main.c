@@ -24,6 +24,7 @@
 #include <SDL2/SDL.h>
 #include <emscripten.h>
 #include <emscripten/em_js.h>
+#include <emscripten/eventloop.h>
 #include <emscripten/html5.h>
 #include <emscripten/websocket.h>
 #include "gui_main.h"
@@ -31,6 +32,20 @@
 #include "lvgl/lvgl.h"
 #include "lv_drivers/sdl/sdl.h"
 #include "web_cmd_utilities.h"
+#include "web_gallery_sync.h"
+#include "web_gl_render.h"
+
+
+//
+// Constants
+//
+
+// The main loop runs on each animation frame for LOOP_ACTIVE_MSEC after input or a websocket
+// packet, or while LVGL is animating, redrawing or tracking a press.  Otherwise it sleeps
+// until the next image is due, waking every LOOP_IDLE_MSEC to run the GUI's timers.
+#define LOOP_ACTIVE_MSEC 500
+#define LOOP_IDLE_MSEC   200
+
 
 
 //
@@ -57,6 +72,11 @@ static lv_task_t*    task_ws_trig;
  EMSCRIPTEN_WEBSOCKET_T ws;
  static bool websocket_open = false;
  
+// Main loop scheduling
+static long loop_frame_id = 0;       // Pending animation frame request
+static long loop_timeout_id = 0;     // Pending idle timeout
+static double loop_active_until = 0;
+ 
 
 
 //
@@ -74,6 +94,15 @@ EM_JS(int, get_browser_height, (), {
   return window.innerHeight;
 });
 
+// Wake the main loop on any input (SDL also sees these events)
+EM_JS(void, add_input_listeners, (), {
+  var events = ["pointerdown", "pointermove", "pointerup", "mousedown", "mousemove", "mouseup",
+                "touchstart", "touchmove", "touchend", "wheel", "keydown", "keyup"];
+  for (var i=0; i<events.length; i++) {
+    window.addEventListener(events[i], function() { Module._handleInputEvent(); }, {capture: true, passive: true});
+  }
+});
+
 
 
 //
@@ -81,6 +110,11 @@ EM_JS(int, get_browser_height, (), {
 //
 static EM_BOOL cb_orientation(int type, const EmscriptenOrientationChangeEvent* e, void* data);
 static void do_loop(void *arg);
+static void wake_loop();
+static void schedule_loop();
+static void request_loop_frame();
+static EM_BOOL cb_loop_frame(double time, void* arg);
+static void cb_loop_timeout(void* arg);
 static void hal_init(void);
 static void gui_init(void);
 static void cb_ws_trig_timer(lv_task_t* t);
@@ -139,8 +173,10 @@ int main()
 	task_ws_trig = lv_task_create(cb_ws_trig_timer, 100, LV_TASK_PRIO_LOW, NULL);
 	lv_task_set_repeat_count(task_ws_trig, 1);
 
-	// Start the main emscripten loop
-    emscripten_set_main_loop_arg(do_loop, NULL, -1, true);
+	// Start the main loop, run from animation frames and timeouts when there is something to do
+	add_input_listeners();
+	wake_loop();
+	emscripten_exit_with_live_runtime();
     
     return 0;
 }
@@ -160,6 +196,13 @@ void handleBrowserResize() {
 	printf("Browser resize\n");
 	
 	reconfig_gui = true;
+	wake_loop();
+}
+
+
+EMSCRIPTEN_KEEPALIVE
+void handleInputEvent() {
+	wake_loop();
 }
 
 
@@ -172,6 +215,7 @@ static EM_BOOL cb_orientation(int type, const EmscriptenOrientationChangeEvent*
     printf("Orientation (C) changed: type:%d, angle: %d\n", e->orientationIndex, e->orientationAngle);
     
     reconfig_gui = true;
+    wake_loop();
     
     return EM_TRUE;
 }
@@ -179,6 +223,9 @@ static EM_BOOL cb_orientation(int type, const EmscriptenOrientationChangeEvent*
 
 static void do_loop(void *arg)
 {
+	// Decode and render the latest image received since the last loop
+	web_cmd_process_pending_image();
+	
 	// Evaluate LVGL
     lv_task_handler();
     
@@ -196,9 +243,82 @@ static void do_loop(void *arg)
 }
 
 
+// Run the loop on the next animation frame and keep running it for a while
+static void wake_loop()
+{
+	loop_active_until = emscripten_get_now() + LOOP_ACTIVE_MSEC;
+	request_loop_frame();
+}
+
+
+// Decide when the loop runs next
+static void schedule_loop()
+{
+	int msec;
+	
+	if ((emscripten_get_now() < loop_active_until) ||
+	    (lv_anim_count_running() != 0) ||
+	    (disp1->inv_p != 0) ||
+	    (mouse_indev->proc.state == LV_INDEV_STATE_PR) ||
+	    (mouse_indev->proc.types.pointer.drag_throw_vect.x != 0) ||
+	    (mouse_indev->proc.types.pointer.drag_throw_vect.y != 0)) {
+		request_loop_frame();
+		return;
+	}
+	
+	msec = web_cmd_get_pending_image_msec();
+	if (msec == 0) {
+		request_loop_frame();
+	} else if (loop_frame_id == 0) {
+		if ((msec < 0) || (msec > LOOP_IDLE_MSEC)) msec = LOOP_IDLE_MSEC;
+		if (loop_timeout_id != 0) emscripten_clear_timeout(loop_timeout_id);
+		loop_timeout_id = emscripten_set_timeout(cb_loop_timeout, (double) msec, NULL);
+	}
+}
+
+
+// Multiple requests before the frame are coalesced into one run of the loop
+static void request_loop_frame()
+{
+	if (loop_timeout_id != 0) {
+		emscripten_clear_timeout(loop_timeout_id);
+		loop_timeout_id = 0;
+	}
+	if (loop_frame_id == 0) {
+		loop_frame_id = emscripten_request_animation_frame(cb_loop_frame, NULL);
+	}
+}
+
+
+static EM_BOOL cb_loop_frame(double time, void* arg)
+{
+	loop_frame_id = 0;
+	do_loop(NULL);
+	schedule_loop();
+	
+	return EM_FALSE;
+}
+
+
+static void cb_loop_timeout(void* arg)
+{
+	loop_timeout_id = 0;
+	do_loop(NULL);
+	schedule_loop();
+}
+
+
 static void hal_init(void)
 {
     sdl_init();
+    
+    // Present the display and render the camera image on the GPU when WebGL is available
+    if (web_gl_render_init(LV_HOR_RES_MAX, LV_VER_RES_MAX)) {
+        sdl_set_present_cb(web_gl_render_present);
+        gui_render_set_gpu_renderer(web_gl_render_set_image);
+    } else {
+        printf("WebGL not available - rendering on the CPU\n");
+    }
 
     // Create display buffers
     static lv_disp_buf_t disp_buf1;
@@ -309,6 +429,8 @@ static EM_BOOL onopen(int eventType, const EmscriptenWebSocketOpenEvent *websock
 	web_cmd_register_socket(websocketEvent->socket);
 	gui_main_set_connected(true);
 	websocket_open = true;
+	web_gallery_sync_start();
+	wake_loop();
 	
 	return EM_TRUE;
 }
@@ -321,6 +443,9 @@ static EM_BOOL onmessage(int eventType, const EmscriptenWebSocketMessageEvent *w
 		if (!web_cmd_process_socket_rx_data(websocketEvent->numBytes, websocketEvent->data)) {
 			printf("web_cmd_process_socket_rx_data failed\n");
 		}
+		
+		// Images are processed when due, everything else may have updated the GUI
+		request_loop_frame();
 	} else {
 		printf("unexpected websocket text packet of %d bytes\n", websocketEvent->numBytes);
 	}
@@ -342,7 +467,9 @@ static EM_BOOL onclose(int eventType, const EmscriptenWebSocketCloseEvent *webso
 	printf("websocket closed: %s\n", websocketEvent->reason);
 	web_cmd_register_socket(0);
 	gui_main_set_connected(false);
+	web_gallery_sync_stop();
 	(void) emscripten_websocket_delete(websocketEvent->socket);
 	websocket_open = false;
+	wake_loop();
 	return EM_TRUE;
 }
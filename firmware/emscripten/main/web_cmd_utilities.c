@@ -21,10 +21,13 @@
 #include "cmd_utilities.h"
 #include "gui_cmd_handlers.h"
 #include "gui_main.h"
+#include "gui_panel_image_main.h"
 #include "web_cmd_utilities.h"
 #include <emscripten/emscripten.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 
@@ -48,6 +51,22 @@
 // Minimum websocket packet size (no data)
 #define MIN_WS_PKT_LEN      16
 
+// Minimum image packet size (frame timing at the start of the metadata)
+#define MIN_WS_IMG_PKT_LEN  (WS_PKT_DATA_OFFSET + offsetof(cmd_image_meta_t, frame_msec) + 4)
+
+// Image jitter buffer
+#define JB_NUM_FRAMES       4      // Images held waiting for their display time
+#define JB_MAX_DELAY_MSEC   250    // Largest delay added to smooth out network jitter
+#define JB_JITTER_MULT      3      // Added delay in units of the measured jitter
+#define JB_MIN_WINDOW       256    // Frames the minimum transit time is tracked over
+
+// Camera clock offset measurement
+#define PING_MSEC           2000
+#define PING_NUM_SAMPLES    8      // The lowest round trip time of these samples is used
+
+// Stream info display update interval
+#define STREAM_INFO_MSEC    1000
+
 
 //
 // Local variables
@@ -61,10 +80,61 @@ static uint32_t tx_len = 0;
 // Our web socket
 EMSCRIPTEN_WEBSOCKET_T web_socket;
 
+// Jitter buffer holding received images until their display time.  Each image buffer is
+// grown to fit as necessary.
+typedef struct {
+	uint8_t* buf;
+	uint32_t buf_size;
+	uint32_t len;
+	uint32_t seq;
+	uint32_t cam_msec;
+	uint32_t play_msec;
+	bool valid;
+} jb_entry_t;
+
+static jb_entry_t jb[JB_NUM_FRAMES];
+
+// Jitter buffer timing (local mSec).  Transit is the local arrival time minus the camera
+// acquisition time so it includes the (unknown) offset between the clocks.
+static bool jb_timing_valid = false;
+static uint32_t jb_prev_transit;
+static uint32_t jb_min_transit;
+static uint32_t jb_win_min_transit;
+static int jb_win_count;
+static uint32_t jb_jitter16;         // RFC 3550 interarrival jitter in 1/16 mSec
+static bool jb_shown_valid = false;
+static uint32_t jb_shown_seq;
+
+// Camera clock offset (local = camera + offset) from the ping with the lowest round trip time
+static bool clock_offset_valid = false;
+static int32_t clock_offset;
+static uint32_t ping_win_rtt;
+static int32_t ping_win_offset;
+static int ping_win_count = 0;
+
+// Stream info accumulated between display updates
+static int info_frames = 0;
+static int info_latency_frames = 0;
+static int32_t info_latency_sum = 0;
+static double info_start_msec;
+
+// Timer tasks
+static lv_task_t* task_ping_timer = NULL;
+static lv_task_t* task_info_timer = NULL;
+
 
 //
 // Forward declarations for internal functions
 //
+static bool _process_packet(uint32_t len, uint8_t* data, bool in_batch);
+static bool _is_image_packet(uint8_t* data);
+static bool _jb_insert(uint32_t len, uint8_t* data);
+static void _jb_update_timing(uint32_t cam_msec, uint32_t now);
+static void _jb_reset();
+static uint32_t _get_u32(uint8_t* buf);
+static void _cmd_handler_rsp_ping(cmd_data_t data_type, uint32_t len, uint8_t* data);
+static void _task_eval_ping_timer(lv_task_t* task);
+static void _task_eval_info_timer(lv_task_t* task);
 static void _cmd_handler_set_shutdown(cmd_data_t data_type, uint32_t len, uint8_t* data);
 
 
@@ -80,29 +150,43 @@ bool web_cmd_init()
 	}
 	
 	// Register command handlers supported on our end (get, set, rsp)
+	(void) cmd_register_cmd_id(CMD_AGC_MODE, NULL, NULL, cmd_handler_rsp_agc_mode);
 	(void) cmd_register_cmd_id(CMD_AMBIENT_CORRECT, NULL, NULL, cmd_handler_rsp_ambient_correct);
 	(void) cmd_register_cmd_id(CMD_BATT_LEVEL, NULL, NULL, cmd_handler_rsp_batt_info);
+	(void) cmd_register_cmd_id(CMD_BENCHMARK, NULL, NULL, cmd_handler_rsp_benchmark);
 	(void) cmd_register_cmd_id(CMD_BRIGHTNESS, NULL, NULL, cmd_handler_rsp_brightness);
 	(void) cmd_register_cmd_id(CMD_CRIT_BATT, NULL, cmd_handler_set_critical_batt, NULL);
 	(void) cmd_register_cmd_id(CMD_CTRL_ACTIVITY, NULL, NULL, cmd_handler_rsp_ctrl_activity);
 	(void) cmd_register_cmd_id(CMD_CARD_PRESENT, NULL, NULL, cmd_handler_rsp_card_present);
 	(void) cmd_register_cmd_id(CMD_EMISSIVITY, NULL, NULL, cmd_handler_rsp_emissivity);
 	(void) cmd_register_cmd_id(CMD_FILE_CATALOG, NULL, NULL, cmd_handler_rsp_file_catalog);
+	(void) cmd_register_cmd_id(CMD_FILE_CATALOG_PAGE, NULL, NULL, cmd_handler_rsp_file_catalog_page);
 	(void) cmd_register_cmd_id(CMD_FILE_GET_IMAGE, NULL, NULL, cmd_handler_rsp_file_image);
+	(void) cmd_register_cmd_id(CMD_FILE_GET_JPEG, NULL, NULL, cmd_handler_rsp_file_jpeg);
+	(void) cmd_register_cmd_id(CMD_FILE_GET_THUMB, NULL, NULL, cmd_handler_rsp_file_thumb);
 	(void) cmd_register_cmd_id(CMD_GAIN, NULL, NULL, cmd_handler_rsp_gain);
+	(void) cmd_register_cmd_id(CMD_GUI_STATE, NULL, NULL, cmd_handler_rsp_gui_state);
 	(void) cmd_register_cmd_id(CMD_IMAGE, NULL, cmd_handler_set_image, NULL);
+	(void) cmd_register_cmd_id(CMD_IMAGE_SAME, NULL, cmd_handler_set_image_same, NULL);
+	(void) cmd_register_cmd_id(CMD_IMAGE_Y16, NULL, cmd_handler_set_image_y16, NULL);
 	(void) cmd_register_cmd_id(CMD_MIN_MAX_EN, NULL, NULL, cmd_handler_rsp_min_max_en);
 	(void) cmd_register_cmd_id(CMD_MSG_ON, NULL, cmd_handler_set_msg_on, NULL);
 	(void) cmd_register_cmd_id(CMD_MSG_OFF, NULL, cmd_handler_set_msg_off, NULL);
 	(void) cmd_register_cmd_id(CMD_PALETTE, NULL, NULL, cmd_handler_rsp_palette);
+	(void) cmd_register_cmd_id(CMD_PALETTE_STOPS, NULL, NULL, cmd_handler_rsp_palette_stops);
+	(void) cmd_register_cmd_id(CMD_PALETTE_THRESHOLD, NULL, NULL, cmd_handler_rsp_palette_threshold);
+	(void) cmd_register_cmd_id(CMD_PING, NULL, NULL, _cmd_handler_rsp_ping);
 	(void) cmd_register_cmd_id(CMD_REGION_EN, NULL, NULL, cmd_handler_rsp_region_enable);
+	(void) cmd_register_cmd_id(CMD_SAVE_FORMAT, NULL, NULL, cmd_handler_rsp_save_format);
 	(void) cmd_register_cmd_id(CMD_SAVE_OVL_EN, NULL, NULL, cmd_handler_rsp_save_ovl_en);
 	(void) cmd_register_cmd_id(CMD_SHUTTER_INFO, NULL, NULL, cmd_handler_rsp_shutter);
 	(void) cmd_register_cmd_id(CMD_SHUTDOWN, NULL, _cmd_handler_set_shutdown, NULL);
 	(void) cmd_register_cmd_id(CMD_SPOT_EN, NULL, NULL, cmd_handler_rsp_spot_enable);
+	(void) cmd_register_cmd_id(CMD_STREAM_RATE, NULL, cmd_handler_set_stream_rate, NULL);
 	(void) cmd_register_cmd_id(CMD_SYS_INFO, NULL, NULL, cmd_handler_rsp_sys_info);
 	(void) cmd_register_cmd_id(CMD_TIME, NULL, NULL, cmd_handler_rsp_time);
 	(void) cmd_register_cmd_id(CMD_TIMELAPSE_STATUS, NULL, cmd_handler_set_timelapse_status, NULL);
+	(void) cmd_register_cmd_id(CMD_TNR, NULL, NULL, cmd_handler_rsp_tnr);
 	(void) cmd_register_cmd_id(CMD_UNITS, NULL, NULL, cmd_handler_rsp_units);
 	(void) cmd_register_cmd_id(CMD_WIFI_INFO, NULL, NULL, cmd_handler_rsp_wifi);
 	
@@ -113,37 +197,114 @@ bool web_cmd_init()
 void web_cmd_register_socket(EMSCRIPTEN_WEBSOCKET_T socket)
 {
 	web_socket = socket;
+	
+	// Start over with each connection (the camera may have restarted)
+	_jb_reset();
+	clock_offset_valid = false;
+	ping_win_count = 0;
+	info_frames = 0;
+	info_latency_frames = 0;
+	info_latency_sum = 0;
+	info_start_msec = emscripten_get_now();
+	
+	if (socket != 0) {
+		// Start measuring the camera clock offset (the first ping is sent immediately)
+		if (task_ping_timer == NULL) {
+			task_ping_timer = lv_task_create(_task_eval_ping_timer, PING_MSEC, LV_TASK_PRIO_LOW, NULL);
+			lv_task_ready(task_ping_timer);
+		}
+		if (task_info_timer == NULL) {
+			task_info_timer = lv_task_create(_task_eval_info_timer, STREAM_INFO_MSEC, LV_TASK_PRIO_LOW, NULL);
+		}
+	} else {
+		if (task_ping_timer != NULL) {
+			lv_task_del(task_ping_timer);
+			task_ping_timer = NULL;
+		}
+		if (task_info_timer != NULL) {
+			lv_task_del(task_info_timer);
+			task_info_timer = NULL;
+		}
+		gui_panel_image_set_stream_info(-1, 0);
+	}
 }
 
 
+// Images are only copied into the jitter buffer here and processed by
+// web_cmd_process_pending_image from the main loop when they are due so they are displayed
+// at the pace the camera acquired them instead of the pace the network delivered them.  A
+// burst of them (for example after the browser stalls) is also reduced to the latest one
+// instead of each being decoded and rendered in turn before LVGL gets to run.  Other
+// packets are processed immediately.
 bool web_cmd_process_socket_rx_data(uint32_t len, uint8_t* data)
 {
-	cmd_t cmd_type;
-	cmd_id_t cmd_id;
-	cmd_data_t data_type;
-	uint32_t dlen;
+	if ((len >= MIN_WS_IMG_PKT_LEN) && _is_image_packet(data)) {
+		return _jb_insert(len, data);
+	}
 	
-	// Make sure received data contains at least the minimum cmd arguments
-	if (len < MIN_WS_PKT_LEN) {
-		printf("%s Illegal websocket packet length %u\n", TAG, len);
-		return false;
+	return _process_packet(len, data, false);
+}
+
+
+// Process the latest image in the jitter buffer that is due for display, dropping any
+// older ones
+void web_cmd_process_pending_image()
+{
+	int i;
+	int n = -1;
+	uint32_t now = (uint32_t) emscripten_get_now();
+	
+	for (i=0; i<JB_NUM_FRAMES; i++) {
+		if (jb[i].valid && ((int32_t) (now - jb[i].play_msec) >= 0)) {
+			if ((n < 0) || ((int32_t) (jb[i].seq - jb[n].seq) > 0)) {
+				n = i;
+			}
+		}
 	}
+	if (n < 0) return;
 	
-	// Make sure the received data length matches what the cmd says its length is
-	dlen = ntohl(*((uint32_t*) &data[WS_PKT_LEN_OFFSET]));
-	if (len != dlen) {
-		printf("%s websocket packet len %u does not match expected %u\n", TAG, len, dlen);
-		return false;
+	for (i=0; i<JB_NUM_FRAMES; i++) {
+		if (jb[i].valid && ((int32_t) (jb[i].seq - jb[n].seq) < 0)) {
+			jb[i].valid = false;
+		}
 	}
 	
-	// Convert raw packet data in network order to cmd arguments
-	cmd_type = (cmd_t) ntohl(*((uint32_t*) &data[WS_PKT_CTYPE_OFFSET]));
-	cmd_id = (cmd_id_t) ntohl(*((uint32_t*) &data[WS_PKT_ID_OFFSET]));
-	data_type = (cmd_data_t) ntohl(*((uint32_t*) &data[WS_PKT_DTYPE_OFFSET]));
+	jb[n].valid = false;
+	jb_shown_valid = true;
+	jb_shown_seq = jb[n].seq;
+	if (!_process_packet(jb[n].len, jb[n].buf, false)) {
+		printf("%s image packet processing failed\n", TAG);
+		return;
+	}
 	
-	dlen = len - WS_PKT_DATA_OFFSET;
+	// Latency from acquisition on the camera to being rendered here (LVGL displays it
+	// on this pass through the main loop)
+	info_frames++;
+	if (clock_offset_valid) {
+		now = (uint32_t) emscripten_get_now();
+		info_latency_sum += (int32_t) (now - (jb[n].cam_msec + (uint32_t) clock_offset));
+		info_latency_frames++;
+	}
+}
+
+
+// mSec until the next image in the jitter buffer is due for display (0 if one is already
+// due) so the main loop can sleep until then
+int web_cmd_get_pending_image_msec()
+{
+	int32_t d;
+	int msec = -1;
+	uint32_t now = (uint32_t) emscripten_get_now();
 	
-	return cmd_process_received_cmd(cmd_type, cmd_id, data_type, dlen, data + WS_PKT_DATA_OFFSET);
+	for (int i=0; i<JB_NUM_FRAMES; i++) {
+		if (jb[i].valid) {
+			d = (int32_t) (jb[i].play_msec - now);
+			if (d < 0) d = 0;
+			if ((msec < 0) || (d < msec)) msec = d;
+		}
+	}
+	
+	return msec;
 }
 
 
@@ -186,6 +347,251 @@ bool web_cmd_send_handler(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type,
 //
 // Internal functions
 //
+static bool _process_packet(uint32_t len, uint8_t* data, bool in_batch)
+{
+	cmd_t cmd_type;
+	cmd_id_t cmd_id;
+	cmd_data_t data_type;
+	uint32_t dlen;
+	uint32_t plen;
+	
+	// Make sure received data contains at least the minimum cmd arguments
+	if (len < MIN_WS_PKT_LEN) {
+		printf("%s Illegal websocket packet length %u\n", TAG, len);
+		return false;
+	}
+	
+	// Make sure the received data length matches what the cmd says its length is
+	dlen = ntohl(*((uint32_t*) &data[WS_PKT_LEN_OFFSET]));
+	if (len != dlen) {
+		printf("%s websocket packet len %u does not match expected %u\n", TAG, len, dlen);
+		return false;
+	}
+	
+	// Convert raw packet data in network order to cmd arguments
+	cmd_type = (cmd_t) ntohl(*((uint32_t*) &data[WS_PKT_CTYPE_OFFSET]));
+	cmd_id = (cmd_id_t) ntohl(*((uint32_t*) &data[WS_PKT_ID_OFFSET]));
+	data_type = (cmd_data_t) ntohl(*((uint32_t*) &data[WS_PKT_DTYPE_OFFSET]));
+	
+	dlen = len - WS_PKT_DATA_OFFSET;
+	data += WS_PKT_DATA_OFFSET;
+	
+	if ((cmd_type == CMD_SET) && (cmd_id == CMD_BATCH)) {
+		if (in_batch) {
+			printf("%s Nested batch packet\n", TAG);
+			return false;
+		}
+		
+		// Process each contained packet in order
+		while (dlen != 0) {
+			if (dlen < MIN_WS_PKT_LEN) {
+				printf("%s Illegal batch packet length %u\n", TAG, dlen);
+				return false;
+			}
+			plen = ntohl(*((uint32_t*) &data[WS_PKT_LEN_OFFSET]));
+			if ((plen < MIN_WS_PKT_LEN) || (plen > dlen)) {
+				printf("%s Illegal batch packet length %u\n", TAG, plen);
+				return false;
+			}
+			if (!_process_packet(plen, data, true)) {
+				return false;
+			}
+			data += plen;
+			dlen -= plen;
+		}
+		return true;
+	}
+	
+	return cmd_process_received_cmd(cmd_type, cmd_id, data_type, dlen, data);
+}
+
+
+static bool _is_image_packet(uint8_t* data)
+{
+	cmd_t cmd_type = (cmd_t) ntohl(*((uint32_t*) &data[WS_PKT_CTYPE_OFFSET]));
+	cmd_id_t cmd_id = (cmd_id_t) ntohl(*((uint32_t*) &data[WS_PKT_ID_OFFSET]));
+	
+	return ((cmd_type == CMD_SET) && ((cmd_id == CMD_IMAGE) || (cmd_id == CMD_IMAGE_SAME) ||
+	                                  (cmd_id == CMD_IMAGE_Y16)));
+}
+
+
+// Copy an image packet into the jitter buffer, replacing the oldest image if it is full.
+// Images older than the one last displayed are dropped.
+static bool _jb_insert(uint32_t len, uint8_t* data)
+{
+	int i;
+	int n = -1;
+	uint8_t* buf;
+	uint32_t seq;
+	uint32_t cam_msec;
+	uint32_t now = (uint32_t) emscripten_get_now();
+	uint32_t delay;
+	
+	// The image metadata is little endian like us
+	memcpy(&seq, data + WS_PKT_DATA_OFFSET + offsetof(cmd_image_meta_t, frame_seq), 4);
+	memcpy(&cam_msec, data + WS_PKT_DATA_OFFSET + offsetof(cmd_image_meta_t, frame_msec), 4);
+	
+	_jb_update_timing(cam_msec, now);
+	
+	if (jb_shown_valid && ((int32_t) (seq - jb_shown_seq) < 0)) {
+		return true;
+	}
+	
+	// Find a free entry or the oldest image
+	for (i=0; i<JB_NUM_FRAMES; i++) {
+		if (!jb[i].valid) {
+			n = i;
+			break;
+		}
+		if ((n < 0) || ((int32_t) (jb[i].seq - jb[n].seq) < 0)) {
+			n = i;
+		}
+	}
+	
+	if (len > jb[n].buf_size) {
+		buf = (uint8_t*) realloc(jb[n].buf, len);
+		if (buf == NULL) {
+			printf("%s Could not allocate jitter buffer\n", TAG);
+			jb[n].buf_size = 0;
+			jb[n].buf = NULL;
+			jb[n].valid = false;
+			return false;
+		}
+		jb[n].buf = buf;
+		jb[n].buf_size = len;
+	}
+	memcpy(jb[n].buf, data, len);
+	jb[n].len = len;
+	jb[n].seq = seq;
+	jb[n].cam_msec = cam_msec;
+	
+	// Display the image when an image with the lowest transit time would arrive plus
+	// enough delay to cover most of the jitter
+	delay = JB_JITTER_MULT * (jb_jitter16 >> 4);
+	if (delay > JB_MAX_DELAY_MSEC) delay = JB_MAX_DELAY_MSEC;
+	jb[n].play_msec = cam_msec + jb_min_transit + delay;
+	jb[n].valid = true;
+	
+	return true;
+}
+
+
+// Update the transit time statistics with an image arrival.  The minimum transit time is
+// reset every JB_MIN_WINDOW images so it follows drift between the clocks.
+static void _jb_update_timing(uint32_t cam_msec, uint32_t now)
+{
+	uint32_t transit = now - cam_msec;
+	int32_t d;
+	
+	if (!jb_timing_valid) {
+		jb_timing_valid = true;
+		jb_prev_transit = transit;
+		jb_min_transit = transit;
+		jb_win_min_transit = transit;
+		jb_win_count = 0;
+		jb_jitter16 = 0;
+		return;
+	}
+	
+	// Interarrival jitter (RFC 3550 section 6.4.1)
+	d = (int32_t) (transit - jb_prev_transit);
+	if (d < 0) d = -d;
+	jb_jitter16 += d - ((jb_jitter16 + 8) >> 4);
+	jb_prev_transit = transit;
+	
+	if ((int32_t) (transit - jb_min_transit) < 0) {
+		jb_min_transit = transit;
+	}
+	if ((int32_t) (transit - jb_win_min_transit) < 0) {
+		jb_win_min_transit = transit;
+	}
+	if (++jb_win_count >= JB_MIN_WINDOW) {
+		jb_min_transit = jb_win_min_transit;
+		jb_win_min_transit = transit;
+		jb_win_count = 0;
+	}
+}
+
+
+static void _jb_reset()
+{
+	for (int i=0; i<JB_NUM_FRAMES; i++) {
+		jb[i].valid = false;
+	}
+	jb_timing_valid = false;
+	jb_shown_valid = false;
+}
+
+
+static uint32_t _get_u32(uint8_t* buf)
+{
+	// Network order - big endian
+	return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+
+// Ping response: our send time followed by the camera time.  Assuming the network delay is
+// the same in both directions the camera time corresponds to the middle of the round trip.
+static void _cmd_handler_rsp_ping(cmd_data_t data_type, uint32_t len, uint8_t* data)
+{
+	uint32_t t0, t1, rtt;
+	uint32_t now = (uint32_t) emscripten_get_now();
+	int32_t offset;
+	
+	if ((data_type == CMD_DATA_BINARY) && (len == CMD_PING_LEN)) {
+		t0 = _get_u32(data);
+		t1 = _get_u32(data + 4);
+		rtt = now - t0;
+		offset = (int32_t) (t0 + rtt/2 - t1);
+		
+		// Use the first sample until a full set has been made
+		if (!clock_offset_valid) {
+			clock_offset = offset;
+			clock_offset_valid = true;
+		}
+		
+		if ((ping_win_count == 0) || (rtt < ping_win_rtt)) {
+			ping_win_rtt = rtt;
+			ping_win_offset = offset;
+		}
+		if (++ping_win_count >= PING_NUM_SAMPLES) {
+			clock_offset = ping_win_offset;
+			ping_win_count = 0;
+		}
+	}
+}
+
+
+static void _task_eval_ping_timer(lv_task_t* task)
+{
+	uint32_t t = htonl((uint32_t) emscripten_get_now());
+	
+	(void) cmd_send_binary(CMD_GET, CMD_PING, 4, (uint8_t*) &t);
+}
+
+
+static void _task_eval_info_timer(lv_task_t* task)
+{
+	double now = emscripten_get_now();
+	int fps10 = 0;
+	int latency = -1;
+	
+	if (now > info_start_msec) {
+		fps10 = (int) (info_frames * 10000.0 / (now - info_start_msec) + 0.5);
+	}
+	if (info_latency_frames != 0) {
+		latency = info_latency_sum / info_latency_frames;
+		if (latency < 0) latency = 0;
+	}
+	gui_panel_image_set_stream_info(latency, fps10);
+	
+	info_frames = 0;
+	info_latency_frames = 0;
+	info_latency_sum = 0;
+	info_start_msec = now;
+}
+
 
 // Web-specific handling of shutdown command
 static void _cmd_handler_set_shutdown(cmd_data_t data_type, uint32_t len, uint8_t* data)
@@ -34,6 +34,8 @@ void web_cmd_register_socket(EMSCRIPTEN_WEBSOCKET_T socket);
 
 // web socket interface
 bool web_cmd_process_socket_rx_data(uint32_t len, uint8_t* data);
+void web_cmd_process_pending_image();
+int web_cmd_get_pending_image_msec();   // Returns -1 if no image is waiting
 
 // cmd_utilities send handler
 bool web_cmd_send_handler(cmd_t cmd_type, cmd_id_t cmd_id, cmd_data_t data_type, uint32_t len, uint8_t* data);
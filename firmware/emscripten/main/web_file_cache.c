@@ -0,0 +1,278 @@
+/*
+ * Browser IndexedDB cache for file browser images and thumbnails.  Stored images are
+ * keyed by their directory and file name, size and timestamp from the catalog so an
+ * image that has changed on the card is fetched again.
+ *
+ * A request is first looked up in the cache and only sent to the camera if it isn't
+ * there.  The camera's responses aren't tagged with the file they are for and file_task
+ * may combine requests that arrive while it is busy so a response is only stored when
+ * exactly one request has been sent since the previous response.  Full jpeg images must
+ * also be the length of the file in the catalog.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <emscripten.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmd_utilities.h"
+#include "gui_cmd_handlers.h"
+#include "gui_utilities.h"
+#include "web_file_cache.h"
+
+
+
+//
+// Local constants
+//
+
+// Request types
+#define REQ_THUMB   0
+#define REQ_JPEG    1
+#define NUM_REQS    2
+
+
+
+//
+// Local typedefs
+//
+typedef struct {
+	char name[GUI_FILE_NAME_LEN];
+	uint32_t size;
+	uint32_t timestamp;
+} cache_entry_t;
+
+// Copy of the catalog displayed by the file browser
+typedef struct {
+	cache_entry_t* entries;
+	int num_entries;
+	int entries_len;
+	int type;                                 // -1 for directories, 0.. for files
+} cache_catalog_t;
+
+typedef struct {
+	cmd_id_t cmd_id;
+	int dir_index;
+	int file_index;
+	uint32_t seq;                             // Identifies the latest request
+	int outstanding;                          // Requests sent since the last response
+	char key[WEB_FILE_CACHE_KEY_LEN];         // Latest request (empty if not cacheable)
+	uint32_t size;                            // Required response length (0 for any)
+} cache_req_t;
+
+
+
+//
+// Local variables
+//
+static const char* TAG = "web_file_cache";
+
+static cache_catalog_t dir_catalog = {NULL, 0, 0, -1};
+static cache_catalog_t file_catalog = {NULL, 0, 0, 0};
+
+static cache_req_t reqs[NUM_REQS] = {
+	{CMD_FILE_GET_THUMB, 0, 0, 0, 0, "", 0},
+	{CMD_FILE_GET_JPEG, 0, 0, 0, 0, "", 0}
+};
+
+// Set while a cached image is passed to its response handler
+static bool delivering = false;
+
+
+
+//
+// Forward declarations for internal functions
+//
+static bool _set_catalog_len(cache_catalog_t* cP, int num_entries);
+static bool _get_key(int t, int dir_index, int file_index, char* key, uint32_t* size);
+static void _send_request(int t);
+static void _cb_load(void* arg, void* buf, int size);
+static void _cb_load_error(void* arg);
+static void _cb_store_error(void* arg);
+
+
+
+//
+// API
+//
+
+/**
+ * Keep the names, sizes and timestamps of a page of the directory or file catalog
+ */
+void web_file_cache_set_catalog_page(int type, int total, int offset, int num_entries, char* entries[], uint32_t* sizes, uint32_t* timestamps)
+{
+	cache_catalog_t* cP = (type < 0) ? &dir_catalog : &file_catalog;
+	cache_entry_t* eP;
+	int i;
+	
+	if (offset == 0) {
+		cP->type = type;
+		if (!_set_catalog_len(cP, total)) {
+			printf("%s Could not allocate %d catalog entries\n", TAG, total);
+			return;
+		}
+	} else if (cP->type != type) {
+		return;
+	}
+	
+	for (i=0; i<num_entries; i++) {
+		if ((offset + i) < cP->num_entries) {
+			eP = &cP->entries[offset + i];
+			strncpy(eP->name, entries[i], GUI_FILE_NAME_LEN - 1);
+			eP->name[GUI_FILE_NAME_LEN - 1] = 0;
+			eP->size = sizes[i];
+			eP->timestamp = timestamps[i];
+		}
+	}
+}
+
+
+/**
+ * Get a thumbnail or jpeg image from the cache, or from the camera if it isn't cached.
+ * The image is passed to its response handler either way.
+ */
+void web_file_cache_request(cmd_id_t cmd_id, int dir_index, int file_index)
+{
+	int t = (cmd_id == CMD_FILE_GET_JPEG) ? REQ_JPEG : REQ_THUMB;
+	cache_req_t* rP = &reqs[t];
+	
+	rP->dir_index = dir_index;
+	rP->file_index = file_index;
+	rP->seq += 1;
+	
+	if (_get_key(t, dir_index, file_index, rP->key, &rP->size)) {
+		// The lookup result is ignored if another request has been made since
+		emscripten_idb_async_load(WEB_FILE_CACHE_DB_NAME, rP->key, (void*) ((uintptr_t) ((rP->seq << 1) | t)), _cb_load, _cb_load_error);
+	} else {
+		_send_request(t);
+	}
+}
+
+
+/**
+ * Store an image received from the camera if it is known to be for the latest request
+ */
+void web_file_cache_response(cmd_id_t cmd_id, uint32_t len, uint8_t* data)
+{
+	int t = (cmd_id == CMD_FILE_GET_JPEG) ? REQ_JPEG : REQ_THUMB;
+	cache_req_t* rP = &reqs[t];
+	
+	if (delivering) return;
+	
+	if ((rP->outstanding == 1) && (rP->key[0] != 0) && (len != 0) &&
+	    ((rP->size == 0) || (len == rP->size))) {
+		emscripten_idb_async_store(WEB_FILE_CACHE_DB_NAME, rP->key, (void*) data, (int) len, NULL, NULL, _cb_store_error);
+	}
+	rP->outstanding = 0;
+}
+
+
+
+//
+// Internal functions
+//
+static bool _set_catalog_len(cache_catalog_t* cP, int num_entries)
+{
+	if (num_entries > cP->entries_len) {
+		free(cP->entries);
+		cP->entries = (cache_entry_t*) malloc(num_entries * sizeof(cache_entry_t));
+		if (cP->entries == NULL) {
+			cP->entries_len = 0;
+			cP->num_entries = 0;
+			return false;
+		}
+		cP->entries_len = num_entries;
+	}
+	
+	if (cP->entries != NULL) {
+		memset(cP->entries, 0, cP->entries_len * sizeof(cache_entry_t));
+	}
+	cP->num_entries = num_entries;
+	
+	return true;
+}
+
+
+// Create the key for a request.  Returns false if the file isn't in the catalog copies.
+static bool _get_key(int t, int dir_index, int file_index, char* key, uint32_t* size)
+{
+	cache_entry_t* dP;
+	cache_entry_t* fP;
+	
+	key[0] = 0;
+	if ((dir_index < 0) || (dir_index >= dir_catalog.num_entries) ||
+	    (file_catalog.type != dir_index) ||
+	    (file_index < 0) || (file_index >= file_catalog.num_entries)) {
+		return false;
+	}
+	
+	dP = &dir_catalog.entries[dir_index];
+	fP = &file_catalog.entries[file_index];
+	if ((dP->name[0] == 0) || (fP->name[0] == 0)) {
+		// Page not loaded yet
+		return false;
+	}
+	
+	sprintf(key, "%s/%s/%u/%u/%c", dP->name, fP->name, fP->size, fP->timestamp, (t == REQ_JPEG) ? 'J' : 'T');
+	*size = (t == REQ_JPEG) ? fP->size : 0;
+	
+	return true;
+}
+
+
+static void _send_request(int t)
+{
+	cache_req_t* rP = &reqs[t];
+	
+	rP->outstanding += 1;
+	(void) cmd_send_file_indicies(CMD_GET, rP->cmd_id, rP->dir_index, rP->file_index);
+}
+
+
+static void _cb_load(void* arg, void* buf, int size)
+{
+	int t = (int) ((uintptr_t) arg & 1);
+	uint32_t seq = (uint32_t) ((uintptr_t) arg >> 1);
+	
+	if (seq != reqs[t].seq) return;
+	
+	delivering = true;
+	if (t == REQ_JPEG) {
+		cmd_handler_rsp_file_jpeg(CMD_DATA_BINARY, (uint32_t) size, (uint8_t*) buf);
+	} else {
+		cmd_handler_rsp_file_thumb(CMD_DATA_BINARY, (uint32_t) size, (uint8_t*) buf);
+	}
+	delivering = false;
+}
+
+
+static void _cb_load_error(void* arg)
+{
+	int t = (int) ((uintptr_t) arg & 1);
+	uint32_t seq = (uint32_t) ((uintptr_t) arg >> 1);
+	
+	// Not cached, get it from the camera if it is still wanted
+	if (seq == reqs[t].seq) {
+		_send_request(t);
+	}
+}
+
+
+static void _cb_store_error(void* arg)
+{
+	printf("%s Could not store image\n", TAG);
+}
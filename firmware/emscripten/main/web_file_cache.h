@@ -0,0 +1,55 @@
+/*
+ * Browser IndexedDB cache for file browser images and thumbnails.  Stored images are
+ * keyed by their directory and file name, size and timestamp from the catalog so an
+ * image that has changed on the card is fetched again.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef WEB_FILE_CACHE_H
+#define WEB_FILE_CACHE_H
+
+#include "cmd_list.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+//
+// Constants
+//
+
+// IndexedDB database holding the cached images
+#define WEB_FILE_CACHE_DB_NAME   "iCamFiles"
+
+// Key length ("<dir>/<file>/<size>/<timestamp>/<T|J>" + null)
+#define WEB_FILE_CACHE_KEY_LEN   80
+
+
+
+//
+// API
+//
+
+// From the catalog page response handler
+void web_file_cache_set_catalog_page(int type, int total, int offset, int num_entries, char* entries[], uint32_t* sizes, uint32_t* timestamps);
+
+// From the file browser in place of requesting CMD_FILE_GET_THUMB or CMD_FILE_GET_JPEG
+void web_file_cache_request(cmd_id_t cmd_id, int dir_index, int file_index);
+
+// From the CMD_FILE_GET_THUMB and CMD_FILE_GET_JPEG response handlers
+void web_file_cache_response(cmd_id_t cmd_id, uint32_t len, uint8_t* data);
+
+#endif /* WEB_FILE_CACHE_H */
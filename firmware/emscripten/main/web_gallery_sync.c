@@ -0,0 +1,200 @@
+/*
+ * Background copy of the camera's card into the browser.  Files newer than the last sync
+ * point are listed by the stream server's /sync.json and downloaded one at a time into
+ * an IndexedDB database so a tablet or phone running the web GUI collects the camera's
+ * images without re-listing and fetching the whole card on each connection.
+ *
+ * The sync point is the newest catalog timestamp copied, kept in localStorage for each
+ * camera address, and is only advanced at the end of a complete pass.  Files already in
+ * the database with the same size and timestamp are skipped so an interrupted pass just
+ * picks up where it left off.  Requests go to the stream server, which serves one client
+ * at a time, with a low fetch priority and a pause between files so the live image over
+ * the websocket stays responsive.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <emscripten.h>
+#include <emscripten/em_js.h>
+#include <stdbool.h>
+#include "web_gallery_sync.h"
+
+
+
+//
+// Javascript
+//
+
+// Setup the sync state and database helpers
+EM_JS(void, web_gallery_sync_init_js, (const char* db_name, const char* store, int port, int gap_msec), {
+	var db_s = UTF8ToString(db_name);
+	var store_s = UTF8ToString(store);
+	var base = window.location.protocol + "//" + window.location.hostname + ":" + port;
+	var since_key = "iCamGallerySince:" + window.location.host;
+	
+	function req(r) {
+		return new Promise(function(resolve, reject) {
+			r.onsuccess = function() { resolve(r.result); };
+			r.onerror = function() { reject(r.error); };
+		});
+	}
+	
+	function sleep(msec) {
+		return new Promise(function(resolve) { setTimeout(resolve, msec); });
+	}
+	
+	function open_db() {
+		var r = indexedDB.open(db_s, 1);
+		r.onupgradeneeded = function() {
+			r.result.createObjectStore(store_s);
+		};
+		return req(r);
+	}
+	
+	async function copy_file(db, f) {
+		var key = f.dir + "/" + f.name;
+		var have = await req(db.transaction(store_s, "readonly").objectStore(store_s).get(key));
+		if (have && (have.size == f.size) && (have.timestamp == f.timestamp)) {
+			return false;
+		}
+		
+		var rsp = await fetch(base + "/DCIM/" + key, {priority: "low", cache: "no-store"});
+		if (!rsp.ok) {
+			// Deleted since it was listed
+			return false;
+		}
+		var blob = await rsp.blob();
+		await req(db.transaction(store_s, "readwrite").objectStore(store_s).put(
+			{dir: f.dir, name: f.name, size: f.size, timestamp: f.timestamp, data: blob}, key));
+		return true;
+	}
+	
+	async function pass() {
+		var s = Module.gallerySync;
+		var since = parseInt(localStorage.getItem(since_key) || "0", 10);
+		var newest = since;
+		var next = "";
+		var num_copied = 0;
+		var db = await open_db();
+		
+		try {
+			do {
+				var url = base + "/sync.json?since=" + since + (next ? ("&" + next) : "");
+				var rsp = await fetch(url, {priority: "low", cache: "no-store"});
+				if (!rsp.ok) {
+					throw new Error("sync.json status " + rsp.status);
+				}
+				var list = await rsp.json();
+				
+				for (var i=0; (i<list.files.length) && s.running; i++) {
+					if (await copy_file(db, list.files[i])) {
+						num_copied += 1;
+						await sleep(gap_msec);
+					}
+					if (list.files[i].timestamp > newest) {
+						newest = list.files[i].timestamp;
+					}
+				}
+				next = list.more ? list.next : "";
+			} while (next && s.running);
+			
+			if (s.running) {
+				localStorage.setItem(since_key, String(newest));
+				if (num_copied != 0) {
+					console.log("gallery sync copied " + num_copied + " files");
+				}
+			}
+		} finally {
+			db.close();
+		}
+	}
+	
+	Module.gallerySync = {
+		running: false,
+		busy: false,
+		timer: null,
+		run: async function() {
+			var s = Module.gallerySync;
+			s.timer = null;
+			if (!s.running || s.busy) return;
+			s.busy = true;
+			try {
+				await pass();
+			} catch (e) {
+				console.log("gallery sync: " + e);
+			}
+			s.busy = false;
+		}
+	};
+});
+
+
+// Run passes every period_msec starting after start_msec
+EM_JS(void, web_gallery_sync_start_js, (int start_msec, int period_msec), {
+	var s = Module.gallerySync;
+	if (!s || s.running || !window.indexedDB) return;
+	
+	s.running = true;
+	s.timer = setTimeout(function tick() {
+		s.run().then(function() {
+			if (s.running && !s.timer) {
+				s.timer = setTimeout(tick, period_msec);
+			}
+		});
+	}, start_msec);
+});
+
+
+// A pass in progress ends after its current file
+EM_JS(void, web_gallery_sync_stop_js, (), {
+	var s = Module.gallerySync;
+	if (!s) return;
+	
+	s.running = false;
+	if (s.timer) {
+		clearTimeout(s.timer);
+		s.timer = null;
+	}
+});
+
+
+
+//
+// Variables
+//
+static bool sync_init = false;
+
+
+
+//
+// API
+//
+void web_gallery_sync_start()
+{
+	if (!sync_init) {
+		web_gallery_sync_init_js(WEB_GALLERY_SYNC_DB_NAME, WEB_GALLERY_SYNC_STORE, WEB_GALLERY_SYNC_PORT, WEB_GALLERY_SYNC_GAP_MSEC);
+		sync_init = true;
+	}
+	
+	web_gallery_sync_start_js(WEB_GALLERY_SYNC_START_MSEC, WEB_GALLERY_SYNC_PERIOD_MSEC);
+}
+
+
+void web_gallery_sync_stop()
+{
+	if (sync_init) {
+		web_gallery_sync_stop_js();
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Background copy of the camera's card into the browser.  Files newer than the last sync
+ * point are listed by the stream server's /sync.json and downloaded one at a time into
+ * an IndexedDB database so a tablet or phone running the web GUI collects the camera's
+ * images without re-listing and fetching the whole card on each connection.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef WEB_GALLERY_SYNC_H
+#define WEB_GALLERY_SYNC_H
+
+
+
+//
+// Constants
+//
+
+// IndexedDB database and object store holding the copied files (keyed by "<dir>/<file>")
+#define WEB_GALLERY_SYNC_DB_NAME    "iCamGallery"
+#define WEB_GALLERY_SYNC_STORE      "files"
+
+// Camera stream server port
+#define WEB_GALLERY_SYNC_PORT       81
+
+// Delay after connecting before the first pass so the GUI's own requests go first
+#define WEB_GALLERY_SYNC_START_MSEC 5000
+
+// Pause between file downloads to leave the camera time for the websocket image stream
+#define WEB_GALLERY_SYNC_GAP_MSEC   250
+
+// Interval between passes while connected
+#define WEB_GALLERY_SYNC_PERIOD_MSEC 60000
+
+
+
+//
+// API
+//
+
+// From the websocket open and close callbacks
+void web_gallery_sync_start();
+void web_gallery_sync_stop();
+
+#endif /* WEB_GALLERY_SYNC_H */
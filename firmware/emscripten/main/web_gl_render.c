@@ -0,0 +1,237 @@
+/*
+ * WebGL renderer for the browser.  Presents the LVGL frame buffer and colors, magnifies and
+ * zooms the camera image on the GPU where it shows through the frame buffer.
+ *
+ * The camera image canvas is cleared to the transparent GUI_RENDER_GPU_KEY by gui_render
+ * with the markers drawn over it.  Everything else LVGL draws is opaque (including anything
+ * drawn on top of the image) so the fragment shader shows the palette colored, bilinear
+ * resampled y8 data only where a key pixel is found inside the image rectangle.  This
+ * replaces the CPU interpolation and palette lookup of every image pixel and the 2D canvas
+ * copy SDL does with one texture upload of the frame buffer and y8 data per frame.
+ *
+ * The WebGL canvas sits on top of the SDL canvas (which still receives mouse and keyboard
+ * events) and tracks its placement.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <emscripten.h>
+#include <emscripten/em_js.h>
+#include <stdlib.h>
+#include "palettes.h"
+#include "web_gl_render.h"
+
+
+
+//
+// Javascript
+//
+
+// Create the WebGL canvas, shaders and textures for a w x h frame buffer.  Textures
+// are frame buffer (unit 0), y8 image data (unit 1) and palette (unit 2).  Frame buffer
+// and palette pixels are little-endian ARGB8888 so their bytes are uploaded as BGRA.
+EM_JS(bool, web_gl_init_js, (int w, int h), {
+	var c = document.createElement("canvas");
+	var gl = c.getContext("webgl", {alpha: false, antialias: false, depth: false, stencil: false});
+	if (!gl) {
+		return false;
+	}
+	
+	var vs_src =
+		"attribute vec2 a_pos;\n" +
+		"uniform vec2 u_fb_size;\n" +
+		"varying vec2 v_xy;\n" +
+		"void main() {\n" +
+		"  v_xy = vec2(a_pos.x + 1.0, 1.0 - a_pos.y) * 0.5 * u_fb_size;\n" +
+		"  gl_Position = vec4(a_pos, 0.0, 1.0);\n" +
+		"}\n";
+	var fs_src =
+		"#ifdef GL_FRAGMENT_PRECISION_HIGH\n" +
+		"precision highp float;\n" +
+		"#else\n" +
+		"precision mediump float;\n" +
+		"#endif\n" +
+		"uniform sampler2D u_fb;\n" +
+		"uniform sampler2D u_img;\n" +
+		"uniform sampler2D u_pal;\n" +
+		"uniform vec2 u_fb_size;\n" +
+		"uniform vec4 u_img_rect;\n" +
+		"uniform vec3 u_zoom;\n" +
+		"uniform vec2 u_src_size;\n" +
+		"uniform float u_img_en;\n" +
+		"varying vec2 v_xy;\n" +
+		"void main() {\n" +
+		"  vec4 c = texture2D(u_fb, v_xy / u_fb_size);\n" +
+		"  vec2 p = v_xy - u_img_rect.xy;\n" +
+		"  if ((u_img_en > 0.5) && (c.a < 0.5) && all(greaterThanEqual(p, vec2(0.0))) && all(lessThan(p, u_img_rect.zw))) {\n" +
+		"    float i = texture2D(u_img, (u_zoom.xy + p / u_zoom.z) / u_src_size).r;\n" +
+		"    c = texture2D(u_pal, vec2((i * 255.0 + 0.5) / 256.0, 0.5));\n" +
+		"  }\n" +
+		"  gl_FragColor = vec4(c.bgr, 1.0);\n" +
+		"}\n";
+	
+	function compile(type, src) {
+		var s = gl.createShader(type);
+		gl.shaderSource(s, src);
+		gl.compileShader(s);
+		if (!gl.getShaderParameter(s, gl.COMPILE_STATUS)) {
+			console.error("WebGL shader: " + gl.getShaderInfoLog(s));
+			return null;
+		}
+		return s;
+	}
+	
+	function texture(unit, filter) {
+		var t = gl.createTexture();
+		gl.activeTexture(gl.TEXTURE0 + unit);
+		gl.bindTexture(gl.TEXTURE_2D, t);
+		gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, filter);
+		gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, filter);
+		gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+		gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+		return t;
+	}
+	
+	var vs = compile(gl.VERTEX_SHADER, vs_src);
+	var fs = compile(gl.FRAGMENT_SHADER, fs_src);
+	if (!vs || !fs) {
+		return false;
+	}
+	var prog = gl.createProgram();
+	gl.attachShader(prog, vs);
+	gl.attachShader(prog, fs);
+	gl.linkProgram(prog);
+	if (!gl.getProgramParameter(prog, gl.LINK_STATUS)) {
+		console.error("WebGL program: " + gl.getProgramInfoLog(prog));
+		return false;
+	}
+	gl.useProgram(prog);
+	
+	// Full canvas quad
+	var buf = gl.createBuffer();
+	gl.bindBuffer(gl.ARRAY_BUFFER, buf);
+	gl.bufferData(gl.ARRAY_BUFFER, new Float32Array([-1, -1, 1, -1, -1, 1, 1, 1]), gl.STATIC_DRAW);
+	var a_pos = gl.getAttribLocation(prog, "a_pos");
+	gl.enableVertexAttribArray(a_pos);
+	gl.vertexAttribPointer(a_pos, 2, gl.FLOAT, false, 0, 0);
+	
+	gl.pixelStorei(gl.UNPACK_ALIGNMENT, 1);
+	texture(0, gl.NEAREST);
+	gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, w, h, 0, gl.RGBA, gl.UNSIGNED_BYTE, null);
+	texture(1, gl.LINEAR);
+	texture(2, gl.NEAREST);
+	gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, 256, 1, 0, gl.RGBA, gl.UNSIGNED_BYTE, null);
+	
+	gl.uniform1i(gl.getUniformLocation(prog, "u_fb"), 0);
+	gl.uniform1i(gl.getUniformLocation(prog, "u_img"), 1);
+	gl.uniform1i(gl.getUniformLocation(prog, "u_pal"), 2);
+	gl.uniform2f(gl.getUniformLocation(prog, "u_fb_size"), w, h);
+	gl.viewport(0, 0, w, h);
+	
+	c.width = w;
+	c.height = h;
+	c.style.position = "absolute";
+	c.style.pointerEvents = "none";
+	Module.canvas.parentNode.appendChild(c);
+	
+	Module.webGl = {
+		canvas: c,
+		gl: gl,
+		src_w: 0,
+		src_h: 0,
+		u_img_rect: gl.getUniformLocation(prog, "u_img_rect"),
+		u_zoom: gl.getUniformLocation(prog, "u_zoom"),
+		u_src_size: gl.getUniformLocation(prog, "u_src_size"),
+		u_img_en: gl.getUniformLocation(prog, "u_img_en")
+	};
+	gl.uniform1f(Module.webGl.u_img_en, 0);
+	
+	return true;
+});
+
+
+// Upload the y8 image data and palette and set the view (y8 == 0 stops drawing the image)
+EM_JS(void, web_gl_set_image_js, (uint8_t* y8, int src_w, int src_h, const uint32_t* pal, int x, int y, int w, int h, float ox, float oy, float scale), {
+	var s = Module.webGl;
+	var gl = s.gl;
+	
+	if (y8 == 0) {
+		gl.uniform1f(s.u_img_en, 0);
+		return;
+	}
+	
+	gl.activeTexture(gl.TEXTURE1);
+	if ((s.src_w != src_w) || (s.src_h != src_h)) {
+		gl.texImage2D(gl.TEXTURE_2D, 0, gl.LUMINANCE, src_w, src_h, 0, gl.LUMINANCE, gl.UNSIGNED_BYTE, HEAPU8.subarray(y8, y8 + src_w*src_h));
+		s.src_w = src_w;
+		s.src_h = src_h;
+	} else {
+		gl.texSubImage2D(gl.TEXTURE_2D, 0, 0, 0, src_w, src_h, gl.LUMINANCE, gl.UNSIGNED_BYTE, HEAPU8.subarray(y8, y8 + src_w*src_h));
+	}
+	
+	gl.activeTexture(gl.TEXTURE2);
+	gl.texSubImage2D(gl.TEXTURE_2D, 0, 0, 0, 256, 1, gl.RGBA, gl.UNSIGNED_BYTE, HEAPU8.subarray(pal, pal + 4*256));
+	
+	gl.uniform4f(s.u_img_rect, x, y, w, h);
+	gl.uniform3f(s.u_zoom, ox, oy, scale);
+	gl.uniform2f(s.u_src_size, src_w, src_h);
+	gl.uniform1f(s.u_img_en, 1);
+});
+
+
+// Upload the frame buffer and draw
+EM_JS(void, web_gl_present_js, (const uint32_t* fb, int w, int h), {
+	var s = Module.webGl;
+	var gl = s.gl;
+	var c = s.canvas;
+	var sdl_c = Module.canvas;
+	
+	// Follow the SDL canvas
+	if (c.style.left != sdl_c.style.left) c.style.left = sdl_c.style.left;
+	if (c.style.top != sdl_c.style.top) c.style.top = sdl_c.style.top;
+	if (c.style.width != sdl_c.style.width) c.style.width = sdl_c.style.width;
+	if (c.style.height != sdl_c.style.height) c.style.height = sdl_c.style.height;
+	
+	gl.activeTexture(gl.TEXTURE0);
+	gl.texSubImage2D(gl.TEXTURE_2D, 0, 0, 0, w, h, gl.RGBA, gl.UNSIGNED_BYTE, HEAPU8.subarray(fb, fb + 4*w*h));
+	gl.drawArrays(gl.TRIANGLE_STRIP, 0, 4);
+});
+
+
+
+//
+// API
+//
+bool web_gl_render_init(int w, int h)
+{
+	return web_gl_init_js(w, h);
+}
+
+
+void web_gl_render_set_image(uint8_t* y8, gui_render_gpu_view_t* view)
+{
+	if ((y8 == NULL) || (view == NULL)) {
+		web_gl_set_image_js(NULL, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0);
+	} else {
+		web_gl_set_image_js(y8, view->src_w, view->src_h, palette32, view->x, view->y, view->w, view->h,
+		                    view->ox, view->oy, view->scale);
+	}
+}
+
+
+void web_gl_render_present(const uint32_t* fb, int w, int h)
+{
+	web_gl_present_js(fb, w, h);
+}
@@ -0,0 +1,40 @@
+/*
+ * WebGL renderer for the browser.  Presents the LVGL frame buffer and colors, magnifies and
+ * zooms the camera image on the GPU where it shows through the frame buffer.
+ *
+ * Copyright 2024 Dan Julio
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef WEB_GL_RENDER_H
+#define WEB_GL_RENDER_H
+
+#include "gui_render.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+//
+// API
+//
+bool web_gl_render_init(int w, int h);   // Returns false if WebGL is not available
+
+// gui_render GPU renderer
+void web_gl_render_set_image(uint8_t* y8, gui_render_gpu_view_t* view);
+
+// SDL driver present function
+void web_gl_render_present(const uint32_t* fb, int w, int h);
+
+#endif /* WEB_GL_RENDER_H */
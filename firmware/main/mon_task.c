@@ -2,7 +2,10 @@
  * Mon Task
  *
  * Monitor system CPU and memory utilization for debugging and application turning.
- * This task should only be included during development.
+ * The task is idle until a client enables telemetry (CMD_TELEMETRY) and then samples the
+ * task and heap statistics periodically for the client.  Including INCLUDE_SYS_MON
+ * starts sampling at boot and logs each sample for development.  The stack use of each
+ * task and the memory left are logged once after startup.
  *
  * Copyright 2020-2024 Dan Julio
  *
@@ -22,10 +25,23 @@
 #include "mon_task.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "cmd_list.h"
+#include "i2cs.h"
+#include "file_utilities.h"
+#include "system_config.h"
+#include "sys_utilities.h"
+#include <arpa/inet.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#ifdef CONFIG_BUILD_ICAM_MINI
+	#include "web_task.h"
+#endif
 
 
 //
@@ -33,8 +49,27 @@
 //
 static const char* TAG = "mon_task";
 
+// Task samples at the start and end of the current interval (swapped after each sample)
 static TaskStatus_t* start_task_sample_array;
 static TaskStatus_t* end_task_sample_array;
+static UBaseType_t start_array_size = 0;
+static UBaseType_t end_array_size = 0;
+static uint32_t start_run_time;
+static uint32_t end_run_time;
+
+// Telemetry period (0 = off) and the latest sample encoded as a CMD_TELEMETRY response
+#ifdef INCLUDE_SYS_MON
+static int telem_period_msec = MON_SAMPLE_MSEC;
+#else
+static int telem_period_msec = 0;
+#endif
+static SemaphoreHandle_t telem_mutex;
+static uint8_t telem_buf[CMD_TELEM_MAX_LEN];
+static uint32_t telem_len = 0;
+
+static bool boot_report_done = false;
+
+_Static_assert(MON_MAX_TASKS <= CMD_TELEM_MAX_TASKS, "CMD_TELEMETRY can't hold MON_MAX_TASKS");
 
 
 
@@ -42,12 +77,24 @@ static TaskStatus_t* end_task_sample_array;
 // Mon Task Forward Declarations for internal functions
 //
 static bool init_mon_task();
+static bool sample_tasks();
+static uint32_t get_task_load(int end_index, uint32_t* elapsed);
+static void update_telemetry(bool have_interval);
+static void print_boot_report();
+#ifdef INCLUDE_SYS_MON
 #ifdef MON_MEM
 static void print_memory_stats();
 #endif
 #ifdef MON_TASKS
 static void print_task_stats();
 #endif
+#ifdef MON_I2C
+static void print_i2c_stats();
+#endif
+#ifdef MON_CATALOG
+static void print_catalog_stats();
+#endif
+#endif /* INCLUDE_SYS_MON */
 
 
 
@@ -56,6 +103,12 @@ static void print_task_stats();
 //
 void mon_task()
 {
+	bool have_interval = false;
+	int period;
+	int report_msec;
+	TickType_t wait;
+	uint32_t notification_value;
+	
 	ESP_LOGI(TAG, "Start task");
 	
 	// Allocate memory for our statistics in the external SPI SRAM (least impact)
@@ -64,28 +117,104 @@ void mon_task()
 		vTaskDelete(NULL);
 	}
 	
-	// Let the system start up
-	vTaskDelay(pdMS_TO_TICKS(5000));
-	
 	while (1) {
-		// This shouldn't happen, but we check to protect from overrunning our sample arrays
-		if (uxTaskGetNumberOfTasks() > MON_MAX_TASKS) {
-			ESP_LOGE(TAG, "More than MON_MAX_TASKS tasks (%d) - bailing", uxTaskGetNumberOfTasks());
-			vTaskDelete(NULL);
+		// Sleep until the next sample, a change to the period or the boot report
+		period = telem_period_msec;
+		wait = (period == 0) ? portMAX_DELAY : pdMS_TO_TICKS(period);
+		if (!boot_report_done) {
+			report_msec = MON_BOOT_REPORT_MSEC - (int) (esp_timer_get_time() / 1000);
+			if (report_msec < 0) report_msec = 0;
+			if ((period == 0) || (report_msec < period)) {
+				wait = pdMS_TO_TICKS(report_msec);
+			}
+		}
+		notification_value = 0;
+		if (xTaskNotifyWait(0x00, 0xFFFFFFFF, &notification_value, wait)) {
+			// Start a new interval at the new period
+			have_interval = false;
 		}
 		
+		if (!boot_report_done && (esp_timer_get_time() >= ((int64_t) MON_BOOT_REPORT_MSEC * 1000))) {
+			print_boot_report();
+			boot_report_done = true;
+		}
+		if (telem_period_msec == 0) continue;
+		
+		if (!sample_tasks()) {
+			ESP_LOGE(TAG, "More than MON_MAX_TASKS tasks (%d)", uxTaskGetNumberOfTasks());
+			have_interval = false;
+			continue;
+		}
+		update_telemetry(have_interval);
+		
+#ifdef INCLUDE_SYS_MON
 #ifdef MON_MEM
 		print_memory_stats();
 #endif
 #ifdef MON_TASKS
-		print_task_stats();
+		if (have_interval) print_task_stats();
+#endif
+#ifdef MON_I2C
+		print_i2c_stats();
+#endif
+#ifdef MON_CATALOG
+		print_catalog_stats();
 #endif
+#endif /* INCLUDE_SYS_MON */
 
-		vTaskDelay(pdMS_TO_TICKS(MON_SAMPLE_MSEC));
+#ifdef CONFIG_BUILD_ICAM_MINI
+		// Push the sample to any websocket clients
+		if ((task_handle_web != NULL) && web_has_client()) {
+			xTaskNotify(task_handle_web, WEB_NOTIFY_TELEMETRY_MASK, eSetBits);
+		}
+#endif
+		have_interval = true;
 	}
 }
 
 
+/**
+ * Set the telemetry sample period in mSec (0 to stop sampling).  Non-zero periods are
+ * limited to CMD_TELEM_MIN_MSEC - CMD_TELEM_MAX_MSEC.
+ */
+void mon_set_telemetry_period(int msec)
+{
+	if (msec < 0) msec = 0;
+	if ((msec != 0) && (msec < CMD_TELEM_MIN_MSEC)) msec = CMD_TELEM_MIN_MSEC;
+	if (msec > CMD_TELEM_MAX_MSEC) msec = CMD_TELEM_MAX_MSEC;
+	
+	if (msec != telem_period_msec) {
+		telem_period_msec = msec;
+		if (task_handle_mon != NULL) {
+			xTaskNotify(task_handle_mon, 0, eNoAction);
+		}
+	}
+}
+
+
+int mon_get_telemetry_period()
+{
+	return telem_period_msec;
+}
+
+
+/**
+ * Copy the latest telemetry sample, encoded as a CMD_TELEMETRY response, into buf (which
+ * must hold CMD_TELEM_MAX_LEN bytes) and return its length (0 if there isn't one yet).
+ */
+uint32_t mon_get_telemetry(uint8_t* buf)
+{
+	uint32_t len;
+	
+	xSemaphoreTake(telem_mutex, portMAX_DELAY);
+	len = telem_len;
+	memcpy(buf, telem_buf, len);
+	xSemaphoreGive(telem_mutex);
+	
+	return len;
+}
+
+
 
 //
 // Mon Task internal functions
@@ -102,10 +231,130 @@ static bool init_mon_task()
 		return false;
 	}
 	
+	telem_mutex = xSemaphoreCreateMutex();
+	
 	return true;
 }
 
 
+// Take a new task sample, making the last one the start of the interval.  Returns false
+// if there are too many tasks to sample.
+static bool sample_tasks()
+{
+	TaskStatus_t* t;
+	
+	t = start_task_sample_array;
+	start_task_sample_array = end_task_sample_array;
+	end_task_sample_array = t;
+	start_array_size = end_array_size;
+	start_run_time = end_run_time;
+	
+	// uxTaskGetSystemState doesn't fill the array if it is too small
+	end_array_size = uxTaskGetSystemState(end_task_sample_array, MON_MAX_TASKS, &end_run_time);
+	
+	return (end_array_size != 0);
+}
+
+
+// Return the percentage of the total CPU time (all cores) an end sample task used over
+// the interval and the time it ran in elapsed.  Tasks created during the interval return 0.
+static uint32_t get_task_load(int end_index, uint32_t* elapsed)
+{
+	uint32_t total_elapsed_time = end_run_time - start_run_time;
+	
+	*elapsed = 0;
+	for (int i=0; i<start_array_size; i++) {
+		if (start_task_sample_array[i].xHandle == end_task_sample_array[end_index].xHandle) {
+			*elapsed = end_task_sample_array[end_index].ulRunTimeCounter - start_task_sample_array[i].ulRunTimeCounter;
+			break;
+		}
+	}
+	
+	if (total_elapsed_time == 0) return 0;
+	return (uint32_t) (((uint64_t) *elapsed * 100ULL) / ((uint64_t) total_elapsed_time * portNUM_PROCESSORS));
+}
+
+
+// Encode the latest sample into telem_buf as a CMD_TELEMETRY response
+static void update_telemetry(bool have_interval)
+{
+	int n;
+	uint32_t elapsed;
+	uint32_t interval_msec;
+	uint8_t* bufP;
+	TaskStatus_t* t;
+	
+	n = (end_array_size > CMD_TELEM_MAX_TASKS) ? CMD_TELEM_MAX_TASKS : end_array_size;
+	interval_msec = have_interval ? ((end_run_time - start_run_time) / 1000) : 0;
+	if (interval_msec > 0xFFFF) interval_msec = 0xFFFF;
+	
+	xSemaphoreTake(telem_mutex, portMAX_DELAY);
+	
+	*(uint32_t*)&telem_buf[0] = htonl((uint32_t) (esp_timer_get_time() / 1000));
+	*(uint32_t*)&telem_buf[4] = htonl((uint32_t) heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+	*(uint32_t*)&telem_buf[8] = htonl((uint32_t) heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+	*(uint32_t*)&telem_buf[12] = htonl((uint32_t) heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+	*(uint32_t*)&telem_buf[16] = htonl((uint32_t) heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+	*(uint16_t*)&telem_buf[20] = htons((uint16_t) interval_msec);
+	telem_buf[22] = (uint8_t) n;
+	telem_buf[23] = 0;
+	
+	bufP = &telem_buf[CMD_TELEM_HDR_LEN];
+	for (int i=0; i<n; i++) {
+		t = &end_task_sample_array[i];
+		memset(bufP, 0, CMD_TELEM_NAME_LEN);
+		strncpy((char*) bufP, t->pcTaskName, CMD_TELEM_NAME_LEN - 1);
+		bufP[12] = have_interval ? (uint8_t) get_task_load(i, &elapsed) : 0;
+		bufP[13] = (uint8_t) t->uxCurrentPriority;
+		*(uint16_t*)&bufP[14] = htons((t->usStackHighWaterMark > 0xFFFF) ? 0xFFFF : (uint16_t) t->usStackHighWaterMark);
+		bufP += CMD_TELEM_TASK_LEN;
+	}
+	telem_len = CMD_TELEM_HDR_LEN + n*CMD_TELEM_TASK_LEN;
+	
+	xSemaphoreGive(telem_mutex);
+}
+
+
+// Log the stack use of each task and the memory left once startup is done so the stack
+// sizes in system_config.h can be checked.  Tasks not started by system_start_task (the
+// IDF's) only have their minimum free stack logged.
+static void print_boot_report()
+{
+	int n;
+	uint32_t len;
+	uint32_t static_len = 0;
+	TaskStatus_t* tasks;
+	
+	tasks = heap_caps_malloc(sizeof(TaskStatus_t) * MON_MAX_TASKS, MALLOC_CAP_SPIRAM);
+	if (tasks == NULL) {
+		return;
+	}
+	
+	n = uxTaskGetSystemState(tasks, MON_MAX_TASKS, NULL);
+	ESP_LOGI(TAG, "Task stack bytes (size / min free):");
+	for (int i=0; i<n; i++) {
+		len = system_get_task_stack_len(tasks[i].xHandle);
+		if (len != 0) {
+			ESP_LOGI(TAG, "  %-16s %5lu / %5lu", tasks[i].pcTaskName, len, tasks[i].usStackHighWaterMark);
+			static_len += len;
+		} else {
+			ESP_LOGI(TAG, "  %-16s     - / %5lu", tasks[i].pcTaskName, tasks[i].usStackHighWaterMark);
+		}
+	}
+	heap_caps_free(tasks);
+	
+	ESP_LOGI(TAG, "Static stacks %lu - Int free %d (min %d, largest %d) / PSRAM free %d (min %d)",
+	         static_len,
+	         heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+	         heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+	         heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+}
+
+
+#ifdef INCLUDE_SYS_MON
+
 #ifdef MON_MEM
 static void print_memory_stats()
 {
@@ -127,57 +376,44 @@ static void print_memory_stats()
 #ifdef MON_TASKS
 static void print_task_stats()
 {
-	uint32_t start_run_time, end_run_time;
-	uint32_t total_elapsed_time;
-	uint32_t task_elapsed_time;
 	uint32_t percentage_time;
-	volatile UBaseType_t start_array_size, end_array_size;
-    
-    // Sample the tasks over a 1 second period so we can compute some stats
-    start_array_size = uxTaskGetSystemState(start_task_sample_array, MON_MAX_TASKS, &start_run_time);
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    end_array_size = uxTaskGetSystemState(end_task_sample_array, MON_MAX_TASKS, &end_run_time);
-	
-    // Compute and display stats
-    total_elapsed_time = end_run_time - start_run_time;
-    if (total_elapsed_time != 0) {
-    	ESP_LOGI(TAG, "Task Statistics:");
-    	printf("\tTask\t\tRun Time\t%%\tPri\tStack Highwater\n");
-    	
-    	// Match each task in start_array to those in the end_array
-    	for (int i = 0; i < start_array_size; i++) {
-        	int k = -1;
-        	for (int j = 0; j < end_array_size; j++) {
-            	if (start_task_sample_array[i].xHandle == end_task_sample_array[j].xHandle) {
-               	 k = j;
-                	// Mark that task have been matched by overwriting their handles
-                	start_task_sample_array[i].xHandle = NULL;
-                	end_task_sample_array[j].xHandle = NULL;
-                	break;
-            	}
-        	}
-        	// Check if matching task found
-        	if (k >= 0) {
-            	task_elapsed_time = end_task_sample_array[k].ulRunTimeCounter - start_task_sample_array[i].ulRunTimeCounter;
-            	percentage_time = (task_elapsed_time * 100UL) / (total_elapsed_time * portNUM_PROCESSORS);
-            	printf("\t%16s\t%lu\t%lu%%\t%d\t%lu\n", start_task_sample_array[i].pcTaskName,
-            	       task_elapsed_time, percentage_time,
-            	       start_task_sample_array[i].uxCurrentPriority,
-            	       start_task_sample_array[i].usStackHighWaterMark);
-        	}
-    	}
-    
-    	// Print unmatched tasks
-    	for (int i = 0; i < start_array_size; i++) {
-        	if (start_task_sample_array[i].xHandle != NULL) {
-           	 ESP_LOGI(TAG, "Task %s deleted\n", start_task_sample_array[i].pcTaskName);
-        	}
-    	}
-    	for (int i = 0; i < end_array_size; i++) {
-       	 if (end_task_sample_array[i].xHandle != NULL) {
-            	ESP_LOGI(TAG, "Task %s created\n", end_task_sample_array[i].pcTaskName);
-        	}
-    	}
-    }
+	uint32_t task_elapsed_time;
+	
+	ESP_LOGI(TAG, "Task Statistics:");
+	printf("\tTask\t\tRun Time\t%%\tPri\tStack Highwater\n");
+	for (int i=0; i<end_array_size; i++) {
+		percentage_time = get_task_load(i, &task_elapsed_time);
+		printf("\t%16s\t%lu\t%lu%%\t%d\t%lu\n", end_task_sample_array[i].pcTaskName,
+		       task_elapsed_time, percentage_time,
+		       end_task_sample_array[i].uxCurrentPriority,
+		       end_task_sample_array[i].usStackHighWaterMark);
+	}
 }
 #endif
+
+
+#ifdef MON_I2C
+static void print_i2c_stats()
+{
+	i2c_sensor_stats_t stats;
+	
+	i2c_sensor_get_stats(&stats);
+	ESP_LOGI(TAG, "I2C busy: %u%% - Locks: %lu / Max hold: %lu uS / Max CCI wait: %lu uS",
+	         stats.utilization, stats.num_locks, stats.max_hold_usec, stats.max_high_wait_usec);
+}
+#endif
+
+
+#ifdef MON_CATALOG
+static void print_catalog_stats()
+{
+	file_catalog_stats_t stats;
+	
+	file_get_catalog_stats(&stats);
+	ESP_LOGI(TAG, "Catalog: %d/%d dirs, %d/%d files - Peak: %d dirs, %d files (%lu of %d bytes)",
+	         stats.num_dirs, stats.max_dirs, stats.num_files, stats.max_files,
+	         stats.peak_dirs, stats.peak_files, stats.peak_bytes, FILE_INFO_BUFFER_LEN);
+}
+#endif
+
+#endif /* INCLUDE_SYS_MON */
@@ -2,7 +2,9 @@
  * Mon Task
  *
  * Monitor system CPU and memory utilization for debugging and application turning.
- * This task should only be included during development.
+ * The task is idle until a client enables telemetry (CMD_TELEMETRY) and then samples the
+ * task and heap statistics periodically for the client.  Including INCLUDE_SYS_MON
+ * starts sampling at boot and logs each sample for development.
  *
  * Copyright 2020-2024 Dan Julio
  *
@@ -22,16 +24,24 @@
 #ifndef MON_TASK_H
 #define MON_TASK_H
 
+#include <stdint.h>
+
 
 //
 // Mon Task Constants
 //
 #define MON_SAMPLE_MSEC 5000
-#define MON_MAX_TASKS   20
+#define MON_MAX_TASKS   24
+
+// Time after boot to log the task stack and memory report (startup is done by then)
+#define MON_BOOT_REPORT_MSEC 15000
 
-// Uncomment to enable monitoring of memory and/or tasks
+// Uncomment to enable logging of memory, tasks, sensor I2C bus and/or catalog usage
+// (INCLUDE_SYS_MON)
 #define MON_MEM
 #define MON_TASKS
+#define MON_I2C
+#define MON_CATALOG
 
 // Uncomment for a more verbose memory monitoring output
 //#define MON_MEM_VERBOSE
@@ -42,5 +52,8 @@
 // Mon Task API
 //
 void mon_task();
+void mon_set_telemetry_period(int msec);
+int mon_get_telemetry_period();
+uint32_t mon_get_telemetry(uint8_t* buf);
 
 #endif /* MON_TASK_H */
\ No newline at end of file
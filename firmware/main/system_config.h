@@ -28,7 +28,8 @@
 // System debug
 //
 
-// Undefine to include the system monitoring task (included only for debugging/tuning)
+// Undefine to start the system monitoring task sampling at boot and logging its statistics
+// (for debugging/tuning).  Clients can always enable its telemetry using CMD_TELEMETRY.
 //#define INCLUDE_SYS_MON
 
 
@@ -70,6 +71,9 @@
 #define BRD_I2C_SENSOR_SDA_IO 21
 #define BRD_I2C_SENSOR_SCL_IO 22
 
+// Define if the VL53L4CX GPIO1 (data ready) output is connected
+//#define BRD_DIST_INT_IO       -1
+
 #define BRD_AUX_TX_IO         25
 #define BRD_AUX_RX_IO         39
 #define BRD_AUX_RTS_IO        27
@@ -85,7 +89,7 @@
 #define BRD_LCD_DC_IO         -1
 #define BRD_LCD_MOSI_IO       -1
 
-#define LCD_SPI_HOST    VSPI_HOST
+#define LCD_SPI_HOST    SPI3_HOST
 #define LCD_DMA_NUM     1
 #define LCD_SPI_FREQ_HZ 80000000
 
@@ -99,13 +103,15 @@
 #define I2C_SENSOR_FREQ_HZ 400000
 
 // SPI
-//   Tiny1C uses HSPI
-#define T1C_SPI_HOST    HSPI_HOST
+//   Tiny1C uses HSPI (SPI2, on its IO_MUX pins so it can be clocked faster than the
+//   fallback T1C_SPI_FREQ_HZ)
+#define T1C_SPI_HOST    SPI2_HOST
 #define T1C_DMA_NUM     1
 #define T1C_SPI_FREQ_HZ 26670000
+#define T1C_SPI_FAST_FREQ_HZ (CONFIG_T1C_SPI_FREQ_KHZ * 1000)
 
-//   SD Card uses VSPI
-#define SD_SPI_HOST     VSPI_HOST
+//   SD Card uses VSPI (SPI3)
+#define SD_SPI_HOST     SPI3_HOST
 #define SD_DMA_NUM      2
 #define SD_SPI_FREQ_HZ  20000000
 
@@ -119,6 +125,15 @@
 // battery and sense input (measured on prototype unit)
 #define BATT_OFFSET_MV        20
 
+// AUX port UART (aux_task).  The driver's transmit buffer is in internal RAM and packets
+// larger than it are written as it drains.
+#define AUX_UART_NUM          UART_NUM_2
+#define AUX_UART_TX_BUF_LEN   4096
+#define AUX_UART_RX_BUF_LEN   256
+
+// Synchronized capture trigger input (sync_task)
+#define SYNC_TRIG_IO          BRD_AUX_RX_IO
+
 // Filesystem utilities configuration
 //  Using SPI
 #define FILE_USE_SPI_IF
@@ -153,6 +168,12 @@
 #define BRD_I2C_SENSOR_SDA_IO 33
 #define BRD_I2C_SENSOR_SCL_IO 32
 
+// Define if the VL53L4CX GPIO1 (data ready) output is connected
+//#define BRD_DIST_INT_IO       -1
+
+// Define if the FT6236 touchscreen controller INT output is connected
+//#define BRD_TOUCH_INT_IO      -1
+
 #define BRD_BTN1_IO           35
 #define BRD_BTN2_IO           36
 
@@ -166,18 +187,20 @@
 //  I2C Bus 2 - Sensor bus (Tiny1C, distance, temp/humidity)
 #define I2C_GCORE_NUM      0
 #define I2C_GCORE_FREQ_HZ  100000
+#define I2C_TOUCH_FREQ_HZ  400000
 #define I2C_SENSOR_NUM     1
 #define I2C_SENSOR_FREQ_HZ 400000
 
 // SPI
-//   LCD uses VSPI (no MISO)
-//   Tiny1C uses HSPI
-#define LCD_SPI_HOST    VSPI_HOST
+//   LCD uses VSPI (SPI3, no MISO)
+//   Tiny1C uses HSPI (SPI2)
+#define LCD_SPI_HOST    SPI3_HOST
 #define LCD_DMA_NUM     1
 #define LCD_SPI_FREQ_HZ 80000000
-#define T1C_SPI_HOST    HSPI_HOST
+#define T1C_SPI_HOST    SPI2_HOST
 #define T1C_DMA_NUM     2
 #define T1C_SPI_FREQ_HZ 26670000
+#define T1C_SPI_FAST_FREQ_HZ T1C_SPI_FREQ_HZ
 
 // Filesystem utilities configuration
 //   Using SDMMC interface
@@ -187,6 +210,81 @@
 
 
 
+// ======================================================================================
+// Task configuration
+//
+// Frames move through a pipeline of tasks
+//   acquire, scale and stats : t1c_task
+//   save encode              : file_task (the card is written by file_wr_task)
+//   render and output        : gui_task and disp_task (iCam), vid_task or web_task and aux_task (iCamMini)
+// t1c_task and the save stages run on the APP core (1) with t1c_task at a higher priority
+// so encoding never delays frame acquisition.  The render and output stages run on the PRO
+// core (0) with the WiFi stack.  Each stage hands frames to the next through its own
+// buffers (locked only while one is updated) and task notifications.
+//
+// Stack size (bytes), priority and core
+#define TASK_CTRL_STACK        2176
+#define TASK_CTRL_PRIO         1
+#define TASK_CTRL_CORE         0
+
+#define TASK_ENV_STACK         3072
+#define TASK_ENV_PRIO          1
+#define TASK_ENV_CORE          0
+
+#define TASK_GCORE_STACK       3072
+#define TASK_GCORE_PRIO        2
+#define TASK_GCORE_CORE        0
+
+#define TASK_GUI_STACK         3072
+#define TASK_GUI_PRIO          2
+#define TASK_GUI_CORE          0
+
+#define TASK_DISP_STACK        2048
+#define TASK_DISP_PRIO         3
+#define TASK_DISP_CORE         0
+
+#define TASK_VID_STACK         4096
+#define TASK_VID_PRIO          3
+#define TASK_VID_CORE          0
+
+#define TASK_WEB_STACK         4096
+#define TASK_WEB_PRIO          2
+#define TASK_WEB_CORE          0
+
+#define TASK_WEB_OTA_WR_STACK  3072
+#define TASK_WEB_OTA_WR_PRIO   2
+#define TASK_WEB_OTA_WR_CORE   1
+
+#define TASK_AUX_STACK         3072
+#define TASK_AUX_PRIO          2
+#define TASK_AUX_CORE          0
+
+#define TASK_SYNC_STACK        3072
+#define TASK_SYNC_PRIO         3
+#define TASK_SYNC_CORE         0
+
+#define TASK_MQTT_STACK        4096
+#define TASK_MQTT_PRIO         2
+#define TASK_MQTT_CORE         0
+
+#define TASK_FILE_STACK        8192
+#define TASK_FILE_PRIO         2
+#define TASK_FILE_CORE         1
+
+#define TASK_FILE_WR_STACK     4096
+#define TASK_FILE_WR_PRIO      2
+#define TASK_FILE_WR_CORE      1
+
+#define TASK_T1C_STACK         4096
+#define TASK_T1C_PRIO          3
+#define TASK_T1C_CORE          1
+
+#define TASK_MON_STACK         2048
+#define TASK_MON_PRIO          1
+#define TASK_MON_CORE          0
+
+
+
 // ======================================================================================
 // System configuration
 //
@@ -209,19 +307,77 @@
 #define CRIT_BATTERY_OFF_SEC    30
 
 // Filesystem Information Structure buffer (catalog)
-//   Holds records for directories (36 bytes/each) and files in those directories
-//   (32 bytes/each).  This buffer should be sized larger than the most files and
-//   directories ever expected to be seen by the system.
-#define FILE_INFO_BUFFER_LEN   (1024 * 512)
+//   Holds a table for every possible directory (12 bytes/each) and then as many files
+//   (12 bytes/each) as fit - about 12,600.  It must hold at least FILE_MAX_DIRS full
+//   directories (checked at compile time in file_utilities.c).
+#define FILE_INFO_BUFFER_LEN   (1024 * 160)
+
+// Card write buffer (internal DMA capable RAM).  Image and movie files are written to
+// the card in pieces this size so it must be a multiple of the 512 byte sector size.
+// Powers of two up to the card's cluster size keep the writes cluster aligned.
+#define FILE_WRITE_BUF_LEN     (1024 * 16)
 
-// Maximum number of image files per sub-directory
+// Maximum number of image files written per sub-directory
 #define FILE_MAX_FILES_PER_DIR 100
 
-// Maximum number of image directories
+// Maximum number of image directories written
 #define FILE_MAX_DIRS          100
 
 // Maximum number of names stored in a comma separated catalog listing
 // This number should be the larger of FILES_PER_DIR or DIRS
 #define FILE_MAX_CATALOG_NAMES 100
 
+// Encoded image buffers for the save pipeline.  An image can be encoded into one while the
+// previous one is written to the card from another.  Each must hold an encoded jpeg image
+// with the delta encoded Y16 data of a radiometric jpeg image, or an uncompressed raw image
+// (FILE_RAW_MAX_LEN).
+#define FILE_JPEG_NUM_SLOTS    2
+#define FILE_JPEG_SLOT_LEN     (1024 * 192)
+
+// Thumbnail saved with each jpeg image for the file browser (must match CMD_FILE_THUMB_W
+// and CMD_FILE_THUMB_H).  The image dimensions must be the thumbnail dimensions times 1,
+// 2, 4 or 8.
+#define FILE_THUMB_W           64
+#define FILE_THUMB_H           48
+
+// Room for an encoded thumbnail made for an image that was saved without one
+#define FILE_THUMB_JPEG_LEN    (1024 * 12)
+
+// Saved images are rendered this many rows at a time into an internal RAM strip buffer
+// as they are encoded.  Must be a multiple of 16 (the largest jpeg MCU) and of the
+// thumbnail block height (T1C_HEIGHT / FILE_THUMB_H).
+#define FILE_SAVE_STRIP_LINES  16
+
+// Maximum number of entries in a catalog page (must match CMD_FILE_CATALOG_PAGE_MAX)
+#define FILE_MAX_CATALOG_PAGE  32
+
+// Maximum number of files returned for a catalog time range (must match
+// CMD_FILE_CATALOG_RANGE_MAX)
+#define FILE_MAX_CATALOG_RANGE 64
+
+// Browser image cache: the image being viewed in the file browser and the ones before and
+// after it, which are prefetched while the browser is idle.  Each takes the size of
+// rgb_file_image in external RAM.
+#define FILE_PREFETCH_NUM      3
+
+// Maximum number of raw frames held for a burst capture (must match CMD_BURST_MAX_FRAMES).
+// Each frame takes T1C_WIDTH*T1C_HEIGHT*2 bytes of external RAM.
+#define FILE_BURST_MAX_FRAMES  16
+
+// Video output frame buffers (iCamMini).  vid_task renders into one while the video driver
+// displays another and a third may be waiting to be displayed at the next vertical blank.
+// They are in internal RAM since the video driver interrupt reads them.
+#define VID_NUM_FB             3
+
+// Space preallocated for a movie file when recording starts.  Longer recordings grow the
+// file normally and the unused space is released when recording stops.
+#define FILE_MOVIE_PREALLOC_LEN (1024 * 1024 * 32)
+
+// Data log records are collected in a save pipeline slot and written to the card this many
+// bytes at a time (a multiple of FILE_WRITE_BUF_LEN so all but the last write of a log are
+// whole write buffers).  Space for about an hour of records at the maximum rate is
+// preallocated when logging starts and the unused space released when it stops.
+#define FILE_LOG_FLUSH_LEN     (1024 * 32)
+#define FILE_LOG_PREALLOC_LEN  (1024 * 1024 * 8)
+
 #endif // SYSTEM_CONFIG_H
\ No newline at end of file